@@ -20,6 +20,7 @@ LOCAL_PATH:= $(call my-dir)
 #
 
 dalvikvm_src_files := \
+    LaunchServer.cpp \
     Main.cpp
 
 dalvikvm_c_includes := \
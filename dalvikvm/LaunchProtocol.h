@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * What "dvz --launcher" and "dalvikvm --launch-server" say to each other.
+ *
+ * The client connects to the server's Unix domain socket and sends one
+ * request:
+ *
+ *   u4 magic (LAUNCH_MAGIC)
+ *   u4 length of the strings that follow
+ *   the working directory, the main class name and each argument to
+ *   main(), all NUL-terminated
+ *
+ * The part of the request holding the magic carries the client's stdin,
+ * stdout and stderr, in that order, as SCM_RIGHTS ancillary data.
+ *
+ * The server forks a process that runs the class with those descriptors
+ * and replies with its pid as a s4, or -1 if it could not start one.
+ * Once that process is gone the server sends its status as a s4: the
+ * exit code, or 128 plus the number of the signal that killed it.  Both
+ * ends run on the same machine, so all values are in host byte order.
+ */
+#ifndef DALVIKVM_LAUNCHPROTOCOL_H_
+#define DALVIKVM_LAUNCHPROTOCOL_H_
+
+#define LAUNCH_MAGIC        0x44565a31      /* "DVZ1" */
+#define LAUNCH_MAX_REQUEST  (64 * 1024)     /* longest the strings can be */
+#define LAUNCH_NUM_FDS      3
+
+#endif  // DALVIKVM_LAUNCHPROTOCOL_H_
@@ -0,0 +1,552 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Warm VM launcher for command-line tools.
+ *
+ * "dalvikvm --launch-server=<socket> [options] [class ...]" starts a VM
+ * in zygote mode, loads the class path and the given classes, and then
+ * waits for "dvz --launcher=<socket>" requests (see LaunchProtocol.h).
+ * Each request is served by a process forked through
+ * dalvik.system.Zygote, which then runs the requested main class with
+ * the client's stdio, so a job only pays for the fork.
+ *
+ * The VM reaps the children of a zygote from a SIGCHLD handler, which
+ * would lose their exit status.  SIGCHLD stays blocked in every thread
+ * of the server so that handler never runs.  Instead, each child holds
+ * the write end of a pipe.  When the read end hangs up the child is on
+ * its way out, and the server polls waitpid() for its status until it
+ * has it.
+ */
+#include "jni.h"
+#include "LaunchProtocol.h"
+#include "LaunchServer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/* dalvik.system.Zygote.forkAndSpecialize() */
+static const char* kForkSignature =
+    "(II[II[[IILjava/lang/String;Ljava/lang/String;)I";
+
+/* How often to look for finished children, in msec */
+static const int kReapInterval = 1000;
+static const int kExitingReapInterval = 2;
+
+/*
+ * A request whose process is running.
+ */
+struct Launch {
+    int sock;           /* connection to the client */
+    int exitFd;         /* read end of the pipe the child holds, or -1 */
+    pid_t pid;
+};
+
+static Launch* gLaunches;
+static int gLaunchCount;
+static int gLaunchAlloc;
+
+static bool writeFully(int fd, const void* buf, size_t len)
+{
+    const char* cp = (const char*) buf;
+
+    while (len > 0) {
+        ssize_t actual = write(fd, cp, len);
+        if (actual < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        cp += actual;
+        len -= actual;
+    }
+    return true;
+}
+
+static bool readFully(int fd, void* buf, size_t len)
+{
+    char* cp = (char*) buf;
+
+    while (len > 0) {
+        ssize_t actual = read(fd, cp, len);
+        if (actual < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (actual == 0)
+            return false;
+        cp += actual;
+        len -= actual;
+    }
+    return true;
+}
+
+static void closeFds(int* fds, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+/*
+ * Read a request from "sock".  On success, returns the strings, with
+ * their count in "*pCount", and the client's stdio in "fds".  Returns
+ * NULL if the request is bad or the client went away.
+ */
+static char* readRequest(int sock, int fds[LAUNCH_NUM_FDS], int* pCount)
+{
+    uint32_t header[2];
+    char control[CMSG_SPACE(sizeof(int) * LAUNCH_NUM_FDS)];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr* cmsg;
+    char* strings = NULL;
+    ssize_t actual;
+    int count;
+
+    for (int i = 0; i < LAUNCH_NUM_FDS; i++)
+        fds[i] = -1;
+
+    iov.iov_base = header;
+    iov.iov_len = sizeof(header);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    do {
+        actual = recvmsg(sock, &msg, 0);
+    } while (actual < 0 && errno == EINTR);
+    if (actual <= 0)
+        return NULL;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* receivedFds = (const int*) CMSG_DATA(cmsg);
+        for (int i = 0; i < received; i++) {
+            if (i < LAUNCH_NUM_FDS && fds[i] < 0)
+                fds[i] = receivedFds[i];
+            else
+                close(receivedFds[i]);
+        }
+    }
+
+    if ((size_t) actual < sizeof(header) &&
+        !readFully(sock, (char*) header + actual, sizeof(header) - actual))
+    {
+        goto fail;
+    }
+    if (header[0] != LAUNCH_MAGIC || header[1] == 0 ||
+        header[1] > LAUNCH_MAX_REQUEST)
+    {
+        fprintf(stderr, "Launch server: bad request\n");
+        goto fail;
+    }
+    for (int i = 0; i < LAUNCH_NUM_FDS; i++) {
+        if (fds[i] < 0) {
+            fprintf(stderr, "Launch server: request without stdio\n");
+            goto fail;
+        }
+    }
+
+    strings = (char*) malloc(header[1]);
+    if (strings == NULL || !readFully(sock, strings, header[1]))
+        goto fail;
+    if (strings[header[1] - 1] != '\0') {
+        fprintf(stderr, "Launch server: bad request\n");
+        goto fail;
+    }
+
+    /* the working directory and the class name, at least */
+    count = 0;
+    for (uint32_t i = 0; i < header[1]; i++) {
+        if (strings[i] == '\0')
+            count++;
+    }
+    if (count < 2) {
+        fprintf(stderr, "Launch server: request without a class name\n");
+        goto fail;
+    }
+
+    *pCount = count;
+    return strings;
+
+fail:
+    free(strings);
+    closeFds(fds, LAUNCH_NUM_FDS);
+    return NULL;
+}
+
+/*
+ * Set up a forked process to run the request: give it the client's
+ * stdio and working directory, drop the server's descriptors, and split
+ * the strings into the argument list.
+ */
+static bool specializeChild(int listenSock, int sock, int exitFd,
+    int fds[LAUNCH_NUM_FDS], char* strings, int count, char*** pArgv,
+    int* pArgc)
+{
+    sigset_t mask;
+
+    close(listenSock);
+    close(sock);
+    for (int i = 0; i < gLaunchCount; i++) {
+        close(gLaunches[i].sock);
+        if (gLaunches[i].exitFd >= 0)
+            close(gLaunches[i].exitFd);
+    }
+    free(gLaunches);
+    gLaunches = NULL;
+    gLaunchCount = gLaunchAlloc = 0;
+
+    /* exitFd stays open until the process is gone */
+    fcntl(exitFd, F_SETFD, FD_CLOEXEC);
+
+    for (int i = 0; i < LAUNCH_NUM_FDS; i++) {
+        if (dup2(fds[i], i) < 0) {
+            perror("dup2");
+            return false;
+        }
+    }
+    for (int i = 0; i < LAUNCH_NUM_FDS; i++) {
+        if (fds[i] >= LAUNCH_NUM_FDS)
+            close(fds[i]);
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
+    if (chdir(strings) != 0) {
+        fprintf(stderr, "Unable to change to directory %s: %s\n", strings,
+            strerror(errno));
+        return false;
+    }
+
+    char** argv = (char**) malloc(sizeof(char*) * count);
+    if (argv == NULL)
+        return false;
+    char* cp = strings + strlen(strings) + 1;
+    for (int i = 0; i < count - 1; i++) {
+        argv[i] = cp;
+        cp += strlen(cp) + 1;
+    }
+    argv[count - 1] = NULL;
+
+    *pArgv = argv;
+    *pArgc = count - 1;
+    return true;
+}
+
+/*
+ * Tell the client how its process ended and forget about it.
+ */
+static void finishLaunch(int idx, int status)
+{
+    Launch* launch = &gLaunches[idx];
+    int32_t result;
+
+    if (WIFEXITED(status))
+        result = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        result = 128 + WTERMSIG(status);
+    else
+        result = 255;
+
+    /* the client may already be gone */
+    writeFully(launch->sock, &result, sizeof(result));
+    close(launch->sock);
+    if (launch->exitFd >= 0)
+        close(launch->exitFd);
+
+    *launch = gLaunches[--gLaunchCount];
+}
+
+/*
+ * Collect the status of every child that has finished.
+ */
+static void reapLaunches()
+{
+    while (true) {
+        int status;
+        pid_t done;
+
+        do {
+            done = waitpid(-1, &status, WNOHANG);
+        } while (done < 0 && errno == EINTR);
+        if (done <= 0)
+            break;
+
+        for (int i = 0; i < gLaunchCount; i++) {
+            if (gLaunches[i].pid == done) {
+                finishLaunch(i, status);
+                break;
+            }
+        }
+    }
+}
+
+static bool addLaunch(int sock, int exitFd, pid_t pid)
+{
+    if (gLaunchCount == gLaunchAlloc) {
+        int newAlloc = (gLaunchAlloc == 0) ? 16 : gLaunchAlloc * 2;
+        Launch* newLaunches =
+            (Launch*) realloc(gLaunches, sizeof(Launch) * newAlloc);
+        if (newLaunches == NULL)
+            return false;
+        gLaunches = newLaunches;
+        gLaunchAlloc = newAlloc;
+    }
+
+    Launch* launch = &gLaunches[gLaunchCount++];
+    launch->sock = sock;
+    launch->exitFd = exitFd;
+    launch->pid = pid;
+    return true;
+}
+
+/*
+ * Load the class path and the classes everybody is going to use.
+ */
+static void preloadClasses(JNIEnv* env, char* const preload[],
+    int preloadCount)
+{
+    jclass loaderClass = env->FindClass("java/lang/ClassLoader");
+    if (loaderClass != NULL) {
+        jmethodID getSystem = env->GetStaticMethodID(loaderClass,
+            "getSystemClassLoader", "()Ljava/lang/ClassLoader;");
+        if (getSystem != NULL) {
+            jobject loader = env->CallStaticObjectMethod(loaderClass,
+                getSystem);
+            env->DeleteLocalRef(loader);
+        }
+        env->DeleteLocalRef(loaderClass);
+    }
+    if (env->ExceptionCheck()) {
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+    }
+
+    for (int i = 0; i < preloadCount; i++) {
+        char* slashClass = strdup(preload[i]);
+        if (slashClass == NULL)
+            break;
+        for (char* cp = slashClass; *cp != '\0'; cp++) {
+            if (*cp == '.')
+                *cp = '/';
+        }
+
+        jclass clazz = env->FindClass(slashClass);
+        if (clazz == NULL) {
+            fprintf(stderr, "Launch server: unable to preload '%s'\n",
+                preload[i]);
+            env->ExceptionClear();
+        }
+        env->DeleteLocalRef(clazz);
+        free(slashClass);
+    }
+}
+
+static int createListenSocket(const char* socketPath)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Launch server: socket path too long\n");
+        return -1;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+
+    /* a stale socket from an earlier server */
+    unlink(socketPath);
+    if (bind(sock, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+        listen(sock, 64) != 0)
+    {
+        fprintf(stderr, "Launch server: unable to listen on %s: %s\n",
+            socketPath, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    return sock;
+}
+
+void prepareLaunchServer()
+{
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0)
+        fprintf(stderr, "WARNING: SIGCHLD not blocked\n");
+}
+
+bool runLaunchServer(JNIEnv* env, const char* socketPath,
+    char* const preload[], int preloadCount, char*** pArgv, int* pArgc)
+{
+    jclass zygoteClass = env->FindClass("dalvik/system/Zygote");
+    if (zygoteClass == NULL) {
+        fprintf(stderr, "Launch server: unable to find dalvik.system.Zygote\n");
+        return false;
+    }
+    jmethodID forkMeth = env->GetStaticMethodID(zygoteClass,
+        "forkAndSpecialize", kForkSignature);
+    if (forkMeth == NULL) {
+        fprintf(stderr, "Launch server: unable to find forkAndSpecialize\n");
+        return false;
+    }
+
+    preloadClasses(env, preload, preloadCount);
+
+    int listenSock = createListenSocket(socketPath);
+    if (listenSock < 0)
+        return false;
+
+    while (true) {
+        int pollCount = gLaunchCount + 1;
+        struct pollfd* pollFds =
+            (struct pollfd*) malloc(sizeof(struct pollfd) * pollCount);
+        if (pollFds == NULL) {
+            fprintf(stderr, "Launch server: out of memory\n");
+            return false;
+        }
+
+        int timeout = -1;
+        pollFds[0].fd = listenSock;
+        pollFds[0].events = POLLIN;
+        for (int i = 0; i < gLaunchCount; i++) {
+            /* poll() skips the negative ones */
+            pollFds[i + 1].fd = gLaunches[i].exitFd;
+            pollFds[i + 1].events = POLLIN;
+            if (gLaunches[i].exitFd < 0)
+                timeout = kExitingReapInterval;
+            else if (timeout < 0)
+                timeout = kReapInterval;
+        }
+
+        int ready = poll(pollFds, pollCount, timeout);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll");
+            free(pollFds);
+            return false;
+        }
+
+        /* Children that are exiting */
+        for (int i = 1; ready > 0 && i < pollCount; i++) {
+            if (pollFds[i].revents != 0) {
+                close(gLaunches[i - 1].exitFd);
+                gLaunches[i - 1].exitFd = -1;
+            }
+        }
+        reapLaunches();
+
+        bool newClient = (ready > 0 && (pollFds[0].revents & POLLIN) != 0);
+        free(pollFds);
+        if (!newClient)
+            continue;
+
+        int sock = accept(listenSock, NULL, NULL);
+        if (sock < 0) {
+            if (errno != EINTR && errno != ECONNABORTED)
+                perror("accept");
+            continue;
+        }
+        fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+        int fds[LAUNCH_NUM_FDS];
+        int count;
+        char* strings = readRequest(sock, fds, &count);
+        if (strings == NULL) {
+            close(sock);
+            continue;
+        }
+
+        int exitPipe[2];
+        jint pid = -1;
+        if (pipe(exitPipe) == 0) {
+            fcntl(exitPipe[0], F_SETFD, FD_CLOEXEC);
+            pid = env->CallStaticIntMethod(zygoteClass, forkMeth,
+                (jint) getuid(), (jint) getgid(), NULL, 0, NULL, 0, NULL,
+                NULL);
+            if (env->ExceptionCheck()) {
+                env->ExceptionDescribe();
+                env->ExceptionClear();
+                pid = -1;
+            }
+
+            if (pid == 0) {
+                close(exitPipe[0]);
+                if (!specializeChild(listenSock, sock, exitPipe[1], fds,
+                        strings, count, pArgv, pArgc))
+                {
+                    _exit(1);
+                }
+                return true;
+            }
+            close(exitPipe[1]);
+        } else {
+            perror("pipe");
+        }
+        closeFds(fds, LAUNCH_NUM_FDS);
+        free(strings);
+
+        int32_t reply = pid;
+        if (pid < 0) {
+            fprintf(stderr, "Launch server: unable to start a process\n");
+            writeFully(sock, &reply, sizeof(reply));
+            close(sock);
+            continue;
+        }
+
+        /* if the client has already gone, it just won't hear the status */
+        writeFully(sock, &reply, sizeof(reply));
+        if (!addLaunch(sock, exitPipe[0], pid)) {
+            fprintf(stderr, "Launch server: out of memory\n");
+            close(sock);
+            close(exitPipe[0]);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Warm VM launcher for command-line tools.
+ */
+#ifndef DALVIKVM_LAUNCHSERVER_H_
+#define DALVIKVM_LAUNCHSERVER_H_
+
+#include "jni.h"
+
+/*
+ * Block the signals the server has to handle itself.  Call before the VM
+ * is created, so that every VM thread inherits the mask.
+ */
+void prepareLaunchServer();
+
+/*
+ * Serve "dvz --launcher" requests on the Unix domain socket "socketPath".
+ * The VM must have been started with -Xzygote.  The classes in "preload"
+ * are loaded first, along with the class path, so that every process
+ * forked for a request already has them.
+ *
+ * Returns "true" in a forked process, with the main class name and the
+ * arguments to main() in "*pArgv" and their count in "*pArgc".  The
+ * process has the client's stdio and working directory.  The server
+ * itself only returns, with "false", if it cannot keep going.
+ */
+bool runLaunchServer(JNIEnv* env, const char* socketPath,
+    char* const preload[], int preloadCount, char*** pArgv, int* pArgc);
+
+#endif  // DALVIKVM_LAUNCHSERVER_H_
@@ -15,8 +15,13 @@
  */
 /*
  * Command-line invocation of the Dalvik VM.
+ *
+ * With "--launch-server=<socket>" as the first argument, the VM instead
+ * serves "dvz --launcher" requests; see LaunchServer.cpp.  Arguments
+ * after the VM options then name classes to preload.
  */
 #include "jni.h"
+#include "LaunchServer.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -145,6 +150,8 @@ int main(int argc, char* const argv[])
     JavaVMInitArgs initArgs;
     JavaVMOption* options = NULL;
     char* slashClass = NULL;
+    const char* launchSocket = NULL;
+    char** launchArgv = NULL;
     int optionCount, curOpt, i, argIdx;
     int needExtra = JNI_FALSE;
     int result = 1;
@@ -155,6 +162,12 @@ int main(int argc, char* const argv[])
     argv++;
     argc--;
 
+    if (argc > 0 && strncmp(argv[0], "--launch-server=", 16) == 0) {
+        launchSocket = argv[0] + 16;
+        argv++;
+        argc--;
+    }
+
     /*
      * If we're adding any additional stuff, e.g. function hook specifiers,
      * add them to the count here.
@@ -162,7 +175,7 @@ int main(int argc, char* const argv[])
      * We're over-allocating, because this includes the options to the VM
      * plus the options to the program.
      */
-    optionCount = argc;
+    optionCount = argc + 1;
 
     options = (JavaVMOption*) malloc(sizeof(JavaVMOption) * optionCount);
     memset(options, 0, sizeof(JavaVMOption) * optionCount);
@@ -194,6 +207,8 @@ int main(int argc, char* const argv[])
     }
 
     /* insert additional internal options here */
+    if (launchSocket != NULL)
+        options[curOpt++].optionString = strdup("-Xzygote");
 
     assert(curOpt <= optionCount);
 
@@ -205,6 +220,8 @@ int main(int argc, char* const argv[])
     //printf("nOptions = %d\n", initArgs.nOptions);
 
     blockSigpipe();
+    if (launchSocket != NULL)
+        prepareLaunchServer();
 
     /*
      * Start VM.  The current thread becomes the main thread of the VM.
@@ -214,6 +231,23 @@ int main(int argc, char* const argv[])
         goto bail;
     }
 
+    /*
+     * Serve launch requests.  This only comes back in a process forked
+     * for a request, which then carries on with the requested class.
+     */
+    if (launchSocket != NULL) {
+        int launchArgc;
+
+        if (!runLaunchServer(env, launchSocket, &argv[argIdx], argc - argIdx,
+                &launchArgv, &launchArgc))
+        {
+            goto bail;
+        }
+        argv = launchArgv;
+        argc = launchArgc;
+        argIdx = 0;
+    }
+
     /*
      * Make sure they provided a class name.  We do this after VM init
      * so that things like "-Xrunjdwp:help" have the opportunity to emit
@@ -296,6 +330,7 @@ bail:
         free((char*) options[i].optionString);
     free(options);
     free(slashClass);
+    free(launchArgv);
     /*printf("--- VM is down, process exiting\n");*/
     return result;
 }
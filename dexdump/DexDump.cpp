@@ -49,14 +49,25 @@
 #include <getopt.h>
 #include <errno.h>
 #include <assert.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#endif
 
 static const char* gProgName = "dexdump";
 
 enum OutputFormat {
     OUTPUT_PLAIN = 0,               /* default */
     OUTPUT_XML,                     /* fancy */
+    OUTPUT_COMPACT,                 /* one tab-separated line per item */
 };
 
+/* most worker processes we'll start for -j */
+#define kMaxJobs 64
+
+/* stdout buffer; the dump is many small printf()s */
+#define kOutputBufferSize (1024 * 1024)
+
 /* command-line options */
 struct Options {
     bool checksumOnly;
@@ -69,6 +80,7 @@ struct Options {
     const char* tempFileName;
     bool exportsOnly;
     bool verbose;
+    int numJobs;
 };
 
 struct Options gOptions;
@@ -505,12 +517,10 @@ void dumpOptDirectory(const DexFile* pDexFile)
 void dumpClassDef(DexFile* pDexFile, int idx)
 {
     const DexClassDef* pClassDef;
-    const u1* pEncodedData;
     DexClassData* pClassData;
 
     pClassDef = dexGetClassDef(pDexFile, idx);
-    pEncodedData = dexGetClassData(pDexFile, pClassDef);
-    pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+    pClassData = dexReadClassData(pDexFile, pClassDef);
 
     if (pClassData == NULL) {
         fprintf(stderr, "Trouble reading class data\n");
@@ -1357,7 +1367,6 @@ void dumpClass(DexFile* pDexFile, int idx, char** pLastPackage)
     const DexTypeList* pInterfaces;
     const DexClassDef* pClassDef;
     DexClassData* pClassData = NULL;
-    const u1* pEncodedData;
     const char* fileName;
     const char* classDescriptor;
     const char* superclassDescriptor;
@@ -1372,8 +1381,7 @@ void dumpClass(DexFile* pDexFile, int idx, char** pLastPackage)
         goto bail;
     }
 
-    pEncodedData = dexGetClassData(pDexFile, pClassDef);
-    pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+    pClassData = dexReadClassData(pDexFile, pClassDef);
 
     if (pClassData == NULL) {
         printf("Trouble reading class data (#%d)\n", idx);
@@ -1683,13 +1691,11 @@ void dumpRegisterMaps(DexFile* pDexFile)
          * direct method, then one for every virtual method.
          */
         DexClassData* pClassData;
-        const u1* pEncodedData;
         const u1* data = (u1*) pClassPool + classOffsets[idx];
         u2 methodCount;
         int i;
 
-        pEncodedData = dexGetClassData(pDexFile, pClassDef);
-        pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+        pClassData = dexReadClassData(pDexFile, pClassDef);
         if (pClassData == NULL) {
             fprintf(stderr, "Trouble reading class data\n");
             continue;
@@ -1723,13 +1729,204 @@ void dumpRegisterMaps(DexFile* pDexFile)
     }
 }
 
+/*
+ * Dump a class for "-l compact": one line for the class, then one per
+ * field and method, all tab-separated and starting with a record type:
+ *
+ *   C  class  access  superclass  source-file
+ *   F  class  name  type  access                (S for static fields)
+ *   M  class  name  proto  access  insns-size  code-offset
+ *
+ * Missing values are "-".  Access flags are in hex.
+ */
+void dumpClassCompact(DexFile* pDexFile, int idx)
+{
+    const DexClassDef* pClassDef = dexGetClassDef(pDexFile, idx);
+
+    if (gOptions.exportsOnly && (pClassDef->accessFlags & ACC_PUBLIC) == 0)
+        return;
+
+    DexClassData* pClassData = dexReadClassData(pDexFile, pClassDef);
+    if (pClassData == NULL) {
+        fprintf(stderr, "Trouble reading class data (#%d)\n", idx);
+        return;
+    }
+
+    const char* classDescriptor =
+        dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
+    const char* superclassDescriptor = "-";
+    if (pClassDef->superclassIdx != kDexNoIndex) {
+        superclassDescriptor =
+            dexStringByTypeIdx(pDexFile, pClassDef->superclassIdx);
+    }
+    const char* fileName = "-";
+    if (pClassDef->sourceFileIdx != kDexNoIndex)
+        fileName = dexStringById(pDexFile, pClassDef->sourceFileIdx);
+
+    printf("C\t%s\t0x%04x\t%s\t%s\n", classDescriptor,
+        pClassDef->accessFlags, superclassDescriptor, fileName);
+
+    u4 i;
+    for (i = 0; i < pClassData->header.staticFieldsSize; i++) {
+        const DexField* pField = &pClassData->staticFields[i];
+        const DexFieldId* pFieldId = dexGetFieldId(pDexFile, pField->fieldIdx);
+        printf("S\t%s\t%s\t%s\t0x%04x\n", classDescriptor,
+            dexStringById(pDexFile, pFieldId->nameIdx),
+            dexStringByTypeIdx(pDexFile, pFieldId->typeIdx),
+            pField->accessFlags);
+    }
+    for (i = 0; i < pClassData->header.instanceFieldsSize; i++) {
+        const DexField* pField = &pClassData->instanceFields[i];
+        const DexFieldId* pFieldId = dexGetFieldId(pDexFile, pField->fieldIdx);
+        printf("F\t%s\t%s\t%s\t0x%04x\n", classDescriptor,
+            dexStringById(pDexFile, pFieldId->nameIdx),
+            dexStringByTypeIdx(pDexFile, pFieldId->typeIdx),
+            pField->accessFlags);
+    }
+
+    u4 numMethods = pClassData->header.directMethodsSize +
+        pClassData->header.virtualMethodsSize;
+    for (i = 0; i < numMethods; i++) {
+        const DexMethod* pMethod = (i < pClassData->header.directMethodsSize) ?
+            &pClassData->directMethods[i] :
+            &pClassData->virtualMethods[i - pClassData->header.directMethodsSize];
+        const DexMethodId* pMethodId =
+            dexGetMethodId(pDexFile, pMethod->methodIdx);
+        char* proto = dexCopyDescriptorFromMethodId(pDexFile, pMethodId);
+        const DexCode* pCode = dexGetCode(pDexFile, pMethod);
+
+        if (pCode != NULL) {
+            printf("M\t%s\t%s\t%s\t0x%04x\t%u\t0x%06x\n", classDescriptor,
+                dexStringById(pDexFile, pMethodId->nameIdx), proto,
+                pMethod->accessFlags, pCode->insnsSize, pMethod->codeOff);
+        } else {
+            printf("M\t%s\t%s\t%s\t0x%04x\t-\t-\n", classDescriptor,
+                dexStringById(pDexFile, pMethodId->nameIdx), proto,
+                pMethod->accessFlags);
+        }
+        free(proto);
+    }
+
+    free(pClassData);
+}
+
+/*
+ * Dump class defs [start, end) in order, in the current output format.
+ * "*pLastPackage" carries the XML package state from class to class.
+ */
+static void dumpClassRange(DexFile* pDexFile, int start, int end,
+    char** pLastPackage)
+{
+    for (int i = start; i < end; i++) {
+        if (gOptions.outputFormat == OUTPUT_COMPACT) {
+            dumpClassCompact(pDexFile, i);
+            continue;
+        }
+        if (gOptions.showSectionHeaders)
+            dumpClassDef(pDexFile, i);
+
+        dumpClass(pDexFile, i, pLastPackage);
+    }
+}
+
+#ifndef _WIN32
+/*
+ * Copy all of "fp" to stdout.
+ */
+static void copyToStdout(FILE* fp)
+{
+    char buf[64 * 1024];
+    size_t actual;
+
+    rewind(fp);
+    while ((actual = fread(buf, 1, sizeof(buf), fp)) > 0)
+        fwrite(buf, 1, actual, stdout);
+}
+
+/*
+ * Dump all class defs with gOptions.numJobs worker processes, each of
+ * which formats a contiguous range of classes into a temp file.  The
+ * files are copied to stdout in order as the workers finish, so the
+ * output is the same as a serial dump.
+ *
+ * The workers are forked rather than run as threads because all of the
+ * formatting code writes straight to stdout; each child gets its own.
+ * The DEX file is mapped, so the children share its pages with us.
+ *
+ * Returns false if the workers couldn't be started, in which case
+ * nothing has been written.
+ */
+static bool dumpClassesParallel(DexFile* pDexFile)
+{
+    int count = (int) pDexFile->pHeader->classDefsSize;
+    int numJobs = gOptions.numJobs;
+    FILE* outputs[kMaxJobs];
+    pid_t pids[kMaxJobs];
+    bool result = true;
+    int started;
+
+    if (numJobs > count)
+        numJobs = count;
+
+    fflush(stdout);
+    for (started = 0; started < numJobs; started++) {
+        outputs[started] = tmpfile();
+        if (outputs[started] == NULL)
+            break;
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            fclose(outputs[started]);
+            break;
+        }
+        if (pid == 0) {
+            /* child: format our range into the temp file */
+            int start = (int) ((long long) count * started / numJobs);
+            int end = (int) ((long long) count * (started + 1) / numJobs);
+            char* package = NULL;
+
+            if (dup2(fileno(outputs[started]), STDOUT_FILENO) < 0)
+                _exit(1);
+            dumpClassRange(pDexFile, start, end, &package);
+            fflush(stdout);
+            _exit(ferror(stdout) ? 1 : 0);
+        }
+        pids[started] = pid;
+    }
+
+    if (started != numJobs) {
+        fprintf(stderr, "%s: unable to start workers: %s\n", gProgName,
+            strerror(errno));
+        for (int j = 0; j < started; j++) {
+            kill(pids[j], SIGKILL);
+            waitpid(pids[j], NULL, 0);
+            fclose(outputs[j]);
+        }
+        return false;
+    }
+
+    for (int j = 0; j < numJobs; j++) {
+        int status;
+        if (waitpid(pids[j], &status, 0) != pids[j] ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "%s: worker %d failed\n", gProgName, j);
+            result = false;
+        }
+        copyToStdout(outputs[j]);
+        fclose(outputs[j]);
+    }
+
+    return result;
+}
+#endif
+
 /*
  * Dump the requested sections of the file.
  */
 void processDexFile(const char* fileName, DexFile* pDexFile)
 {
     char* package = NULL;
-    int i;
 
     if (gOptions.verbose) {
         printf("Opened '%s', DEX version '%.3s'\n", fileName,
@@ -1749,11 +1946,18 @@ void processDexFile(const char* fileName, DexFile* pDexFile)
     if (gOptions.outputFormat == OUTPUT_XML)
         printf("<api>\n");
 
-    for (i = 0; i < (int) pDexFile->pHeader->classDefsSize; i++) {
-        if (gOptions.showSectionHeaders)
-            dumpClassDef(pDexFile, i);
-
-        dumpClass(pDexFile, i, &package);
+    /*
+     * The XML output groups classes by package across class boundaries,
+     * so it always runs serially.
+     */
+    bool dumped = false;
+#ifndef _WIN32
+    if (gOptions.numJobs > 1 && gOptions.outputFormat != OUTPUT_XML)
+        dumped = dumpClassesParallel(pDexFile);
+#endif
+    if (!dumped) {
+        dumpClassRange(pDexFile, 0, (int) pDexFile->pHeader->classDefsSize,
+            &package);
     }
 
     /* free the last one allocated */
@@ -1819,7 +2023,7 @@ void usage(void)
 {
     fprintf(stderr, "Copyright (C) 2007 The Android Open Source Project\n\n");
     fprintf(stderr,
-        "%s: [-c] [-d] [-f] [-h] [-i] [-l layout] [-m] [-t tempfile] dexfile...\n",
+        "%s: [-c] [-d] [-f] [-h] [-i] [-j jobs] [-l layout] [-m] [-t tempfile] dexfile...\n",
         gProgName);
     fprintf(stderr, "\n");
     fprintf(stderr, " -c : verify checksum and exit\n");
@@ -1827,7 +2031,8 @@ void usage(void)
     fprintf(stderr, " -f : display summary information from file header\n");
     fprintf(stderr, " -h : display file header details\n");
     fprintf(stderr, " -i : ignore checksum failures\n");
-    fprintf(stderr, " -l : output layout, either 'plain' or 'xml'\n");
+    fprintf(stderr, " -j : format classes with this many worker processes\n");
+    fprintf(stderr, " -l : output layout, either 'plain', 'xml' or 'compact'\n");
     fprintf(stderr, " -m : dump register maps (and nothing else)\n");
     fprintf(stderr, " -t : temp file name (defaults to /sdcard/dex-temp-*)\n");
 }
@@ -1846,7 +2051,7 @@ int main(int argc, char* const argv[])
     gOptions.verbose = true;
 
     while (1) {
-        ic = getopt(argc, argv, "cdfhil:mt:");
+        ic = getopt(argc, argv, "cdfhij:l:mt:");
         if (ic < 0)
             break;
 
@@ -1866,6 +2071,13 @@ int main(int argc, char* const argv[])
         case 'i':       // continue even if checksum is bad
             gOptions.ignoreBadChecksum = true;
             break;
+        case 'j':       // number of worker processes
+            gOptions.numJobs = atoi(optarg);
+            if (gOptions.numJobs < 1 || gOptions.numJobs > kMaxJobs) {
+                fprintf(stderr, "%s: -j must be 1-%d\n", gProgName, kMaxJobs);
+                wantUsage = true;
+            }
+            break;
         case 'l':       // layout
             if (strcmp(optarg, "plain") == 0) {
                 gOptions.outputFormat = OUTPUT_PLAIN;
@@ -1873,6 +2085,9 @@ int main(int argc, char* const argv[])
                 gOptions.outputFormat = OUTPUT_XML;
                 gOptions.verbose = false;
                 gOptions.exportsOnly = true;
+            } else if (strcmp(optarg, "compact") == 0) {
+                gOptions.outputFormat = OUTPUT_COMPACT;
+                gOptions.verbose = false;
             } else {
                 wantUsage = true;
             }
@@ -1904,6 +2119,8 @@ int main(int argc, char* const argv[])
         return 2;
     }
 
+    setvbuf(stdout, NULL, _IOFBF, kOutputBufferSize);
+
     int result = 0;
     while (optind < argc) {
         result |= process(argv[optind++]);
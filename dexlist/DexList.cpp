@@ -38,6 +38,9 @@
 
 static const char* gProgName = "dexlist";
 
+/* stdout buffer size */
+#define kOutputBufferSize (1024 * 1024)
+
 /* command-line args */
 static struct {
     char*       argCopy;
@@ -156,13 +159,11 @@ void dumpClass(DexFile* pDexFile, int idx)
 {
     const DexClassDef* pClassDef;
     DexClassData* pClassData;
-    const u1* pEncodedData;
     const char* fileName;
     int i;
 
     pClassDef = dexGetClassDef(pDexFile, idx);
-    pEncodedData = dexGetClassData(pDexFile, pClassDef);
-    pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+    pClassData = dexReadClassData(pDexFile, pClassDef);
 
     if (pClassData == NULL) {
         fprintf(stderr, "Trouble reading class data\n");
@@ -284,6 +285,9 @@ int main(int argc, char* const argv[])
         return 2;
     }
 
+    /* one line per method adds up to a lot of small writes */
+    setvbuf(stdout, NULL, _IOFBF, kOutputBufferSize);
+
     /*
      * Run through the list of files.  If one of them fails we contine on,
      * only returning a failure at the end.
@@ -28,7 +28,8 @@
  *     class path is in BOOTCLASSPATH, etc).
  * (3) On the host during a build for preoptimization. This behaves
  *     almost the same as (2), except it takes file names instead of
- *     file descriptors.
+ *     file descriptors.  A batch of files can be done with one command,
+ *     several at a time.
  *
  * There are some fragile aspects around bootclasspath entries, owing
  * largely to the VM's history of working on whenever it thought it needed
@@ -41,18 +42,71 @@
 #include "cutils/log.h"
 #include "cutils/process_name.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 static const char* kClassesDex = "classes.dex";
 
 
+/*
+ * Parse the dexopt flags string into the modes and flags the VM takes.
+ * Anything not mentioned keeps the value passed in.
+ */
+static void parseDexoptFlags(const char* dexoptFlagStr,
+    DexClassVerifyMode* pVerifyMode, DexOptimizerMode* pDexOptMode,
+    int* pDexoptFlags)
+{
+    if (dexoptFlagStr[0] != '\0') {
+        const char* opc;
+
+        opc = strstr(dexoptFlagStr, "v=");      /* verification */
+        if (opc != NULL) {
+            switch (*(opc+2)) {
+            case 'n':   *pVerifyMode = VERIFY_MODE_NONE;        break;
+            case 'r':   *pVerifyMode = VERIFY_MODE_REMOTE;      break;
+            case 'a':   *pVerifyMode = VERIFY_MODE_ALL;         break;
+            default:                                            break;
+            }
+        }
+
+        opc = strstr(dexoptFlagStr, "o=");      /* optimization */
+        if (opc != NULL) {
+            switch (*(opc+2)) {
+            case 'n':   *pDexOptMode = OPTIMIZE_MODE_NONE;      break;
+            case 'v':   *pDexOptMode = OPTIMIZE_MODE_VERIFIED;  break;
+            case 'a':   *pDexOptMode = OPTIMIZE_MODE_ALL;       break;
+            case 'f':   *pDexOptMode = OPTIMIZE_MODE_FULL;      break;
+            default:                                            break;
+            }
+        }
+
+        opc = strstr(dexoptFlagStr, "m=y");     /* register map */
+        if (opc != NULL) {
+            *pDexoptFlags |= DEXOPT_GEN_REGISTER_MAPS;
+        }
+
+        opc = strstr(dexoptFlagStr, "u=");      /* uniprocessor target */
+        if (opc != NULL) {
+            switch (*(opc+2)) {
+            case 'y':   *pDexoptFlags |= DEXOPT_UNIPROCESSOR;   break;
+            case 'n':   *pDexoptFlags |= DEXOPT_SMP;            break;
+            default:                                            break;
+            }
+        }
+    }
+}
+
 /*
  * Extract "classes.dex" from zipFd into "cacheFd", leaving a little space
  * up front for the DEX optimization header.
+ *
+ * If "bootClassPath" is NULL the VM has already been prepared.
  */
 static int extractAndProcessZip(int zipFd, int cacheFd,
     const char* debugFileName, bool isBootstrap, const char* bootClassPath,
@@ -128,52 +182,13 @@ static int extractAndProcessZip(int zipFd, int cacheFd,
         goto bail;
     }
 
-    /* Parse the options. */
-    if (dexoptFlagStr[0] != '\0') {
-        const char* opc;
-        const char* val;
-
-        opc = strstr(dexoptFlagStr, "v=");      /* verification */
-        if (opc != NULL) {
-            switch (*(opc+2)) {
-            case 'n':   verifyMode = VERIFY_MODE_NONE;          break;
-            case 'r':   verifyMode = VERIFY_MODE_REMOTE;        break;
-            case 'a':   verifyMode = VERIFY_MODE_ALL;           break;
-            default:                                            break;
-            }
-        }
-
-        opc = strstr(dexoptFlagStr, "o=");      /* optimization */
-        if (opc != NULL) {
-            switch (*(opc+2)) {
-            case 'n':   dexOptMode = OPTIMIZE_MODE_NONE;        break;
-            case 'v':   dexOptMode = OPTIMIZE_MODE_VERIFIED;    break;
-            case 'a':   dexOptMode = OPTIMIZE_MODE_ALL;         break;
-            case 'f':   dexOptMode = OPTIMIZE_MODE_FULL;        break;
-            default:                                            break;
-            }
-        }
-
-        opc = strstr(dexoptFlagStr, "m=y");     /* register map */
-        if (opc != NULL) {
-            dexoptFlags |= DEXOPT_GEN_REGISTER_MAPS;
-        }
-
-        opc = strstr(dexoptFlagStr, "u=");      /* uniprocessor target */
-        if (opc != NULL) {
-            switch (*(opc+2)) {
-            case 'y':   dexoptFlags |= DEXOPT_UNIPROCESSOR;     break;
-            case 'n':   dexoptFlags |= DEXOPT_SMP;              break;
-            default:                                            break;
-            }
-        }
-    }
-
     /*
      * Prep the VM and perform the optimization.
      */
 
-    if (dvmPrepForDexOpt(bootClassPath, dexOptMode, verifyMode,
+    parseDexoptFlags(dexoptFlagStr, &verifyMode, &dexOptMode, &dexoptFlags);
+    if (bootClassPath != NULL &&
+        dvmPrepForDexOpt(bootClassPath, dexOptMode, verifyMode,
             dexoptFlags) != 0)
     {
         ALOGE("DexOptZ: VM init failed");
@@ -313,6 +328,24 @@ bail:
     return result;
 }
 
+static int preoptFile(const char* zipName, const char* outName,
+        const char* dexoptFlags, bool vmReady);
+
+/*
+ * Preoptimization needs to be told which kind of processor the output is
+ * for.
+ */
+static bool checkPreoptFlags(const char* dexoptFlags)
+{
+    if (strstr(dexoptFlags, "u=y") == NULL &&
+        strstr(dexoptFlags, "u=n") == NULL)
+    {
+        fprintf(stderr, "Either 'u=y' or 'u=n' must be specified\n");
+        return false;
+    }
+    return true;
+}
+
 /*
  * Parse arguments for a preoptimization run. This is when dalvikvm is run
  * on a host to optimize dex files for eventual running on a (different)
@@ -333,10 +366,6 @@ bail:
  */
 static int preopt(int argc, char* const argv[])
 {
-    int zipFd = -1;
-    int outFd = -1;
-    int result = -1;
-
     if (argc != 5) {
         /*
          * Use stderr here, since this variant is meant to be called on
@@ -351,26 +380,43 @@ static int preopt(int argc, char* const argv[])
     const char* outName = argv[3];
     const char* dexoptFlags = argv[4];
 
-    if (strstr(dexoptFlags, "u=y") == NULL &&
-        strstr(dexoptFlags, "u=n") == NULL)
-    {
-        fprintf(stderr, "Either 'u=y' or 'u=n' must be specified\n");
+    if (!checkPreoptFlags(dexoptFlags)) {
         return -1;
     }
 
+    return preoptFile(zipName, outName, dexoptFlags, false);
+}
+
+/*
+ * Optimize "zipName" into the new file "outName".  If "vmReady" is set,
+ * the VM has already been prepared and the file is not on the boot class
+ * path.
+ */
+static int preoptFile(const char* zipName, const char* outName,
+        const char* dexoptFlags, bool vmReady)
+{
+    int zipFd = -1;
+    int outFd = -1;
+    int result = -1;
+
     zipFd = open(zipName, O_RDONLY);
     if (zipFd < 0) {
-        perror(argv[0]);
+        perror(zipName);
         return -1;
     }
 
     outFd = open(outName, O_RDWR | O_EXCL | O_CREAT, 0666);
     if (outFd < 0) {
-        perror(argv[0]);
+        perror(outName);
         goto bail;
     }
 
-    result = processZipFile(zipFd, outFd, zipName, dexoptFlags);
+    if (vmReady) {
+        result = extractAndProcessZip(zipFd, outFd, zipName, false, NULL,
+                dexoptFlags);
+    } else {
+        result = processZipFile(zipFd, outFd, zipName, dexoptFlags);
+    }
 
 bail:
     if (zipFd >= 0) {
@@ -384,6 +430,213 @@ bail:
     return result;
 }
 
+/*
+ * One file of a batch preoptimization run.
+ */
+struct PreoptJob {
+    const char* zipName;
+    const char* outName;
+    int bcpOffset;      /* position in BOOTCLASSPATH, or -1 */
+    int argIndex;       /* position on the command line */
+    pid_t pid;          /* child optimizing it, or 0 */
+};
+
+/*
+ * Files on the boot class path come first, in boot class path order;
+ * everything else keeps its command line order.
+ */
+static int comparePreoptJobs(const void* a, const void* b)
+{
+    const PreoptJob* jobA = (const PreoptJob*) a;
+    const PreoptJob* jobB = (const PreoptJob*) b;
+
+    if ((jobA->bcpOffset < 0) != (jobB->bcpOffset < 0)) {
+        return (jobA->bcpOffset < 0) ? 1 : -1;
+    }
+    if (jobA->bcpOffset != jobB->bcpOffset) {
+        return jobA->bcpOffset - jobB->bcpOffset;
+    }
+    return jobA->argIndex - jobB->argIndex;
+}
+
+/*
+ * Start a child process that optimizes "job".  Returns its pid, or -1.
+ */
+static pid_t startPreoptJob(PreoptJob* job, const char* dexoptFlags,
+        bool vmReady)
+{
+    fprintf(stderr, "Processing %s\n", job->zipName);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int result = preoptFile(job->zipName, job->outName, dexoptFlags,
+                vmReady);
+        /* skip the atexit handlers; they belong to the parent */
+        _exit(result == 0 ? 0 : 1);
+    } else if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    job->pid = pid;
+    return pid;
+}
+
+/*
+ * Wait for any child to finish.  Returns false if it failed, or if there
+ * was no child to wait for.
+ */
+static bool waitForPreoptJob(PreoptJob* jobs, int numJobs)
+{
+    int status;
+    pid_t pid;
+
+    do {
+        pid = waitpid(-1, &status, 0);
+    } while (pid < 0 && errno == EINTR);
+    if (pid < 0) {
+        perror("waitpid");
+        return false;
+    }
+
+    const char* zipName = "(unknown)";
+    for (int i = 0; i < numJobs; i++) {
+        if (jobs[i].pid == pid) {
+            zipName = jobs[i].zipName;
+            jobs[i].pid = 0;
+            break;
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        if (WIFSIGNALED(status)) {
+            fprintf(stderr, "Optimization of %s died with signal %d\n",
+                    zipName, WTERMSIG(status));
+        } else {
+            fprintf(stderr, "Optimization of %s failed\n", zipName);
+        }
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Parse arguments for a batch preoptimization run, which optimizes many
+ * files with one dexopt command.  We want:
+ *   0. (name of dexopt command -- ignored)
+ *   1. "--preopt-batch"
+ *   2. number of files to optimize at the same time (0 means one per CPU)
+ *   3. dexopt flags
+ *   4. zipfile name
+ *   5. output file name
+ *   ... (more pairs of zipfile and output file names)
+ *
+ * The BOOTCLASSPATH environment variable is assumed to hold the correct
+ * boot class path, as with --preopt.  Each file on it depends on the ones
+ * before it, so those are optimized first, one at a time and in boot
+ * class path order, each in a child process of its own.
+ *
+ * The VM is then prepared once with the whole boot class path and the
+ * core classes are loaded.  Every other file is optimized in a child
+ * forked from that, so none of them has to open the boot class path or
+ * load the core classes again.  If one file fails, no new ones are
+ * started and the command fails once the running ones finish.
+ */
+static int preoptBatch(int argc, char* const argv[])
+{
+    if (argc < 6 || (argc % 2) != 0) {
+        fprintf(stderr,
+                "Wrong number of args for --preopt-batch (found %d)\n", argc);
+        return -1;
+    }
+
+    char* endp;
+    long maxRunning = strtol(argv[2], &endp, 0);
+    if (*endp != '\0' || maxRunning < 0) {
+        fprintf(stderr, "Bad job count '%s'\n", argv[2]);
+        return -1;
+    }
+    if (maxRunning == 0) {
+        maxRunning = sysconf(_SC_NPROCESSORS_ONLN);
+        if (maxRunning < 1)
+            maxRunning = 1;
+    }
+
+    const char* dexoptFlags = argv[3];
+    if (!checkPreoptFlags(dexoptFlags)) {
+        return -1;
+    }
+
+    const char* bcp = getenv("BOOTCLASSPATH");
+    if (bcp == NULL) {
+        fprintf(stderr, "BOOTCLASSPATH not set\n");
+        return -1;
+    }
+
+    int numJobs = (argc - 4) / 2;
+    PreoptJob* jobs = (PreoptJob*) calloc(numJobs, sizeof(PreoptJob));
+    if (jobs == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    for (int i = 0; i < numJobs; i++) {
+        PreoptJob* job = &jobs[i];
+        job->zipName = argv[4 + i * 2];
+        job->outName = argv[5 + i * 2];
+        /* same partial match as processZipFile() */
+        const char* match = strstr(bcp, job->zipName);
+        job->bcpOffset = (match != NULL) ? match - bcp : -1;
+        job->argIndex = i;
+    }
+    qsort(jobs, numJobs, sizeof(PreoptJob), comparePreoptJobs);
+
+    int result = -1;
+    int next = 0;
+    int running = 0;
+
+    /* The boot class path, in order */
+    for (; next < numJobs && jobs[next].bcpOffset >= 0; next++) {
+        if (startPreoptJob(&jobs[next], dexoptFlags, false) < 0 ||
+            !waitForPreoptJob(jobs, numJobs))
+        {
+            goto bail;
+        }
+    }
+
+    if (next < numJobs) {
+        DexClassVerifyMode verifyMode = VERIFY_MODE_ALL;
+        DexOptimizerMode dexOptMode = OPTIMIZE_MODE_VERIFIED;
+        int flags = 0;
+
+        parseDexoptFlags(dexoptFlags, &verifyMode, &dexOptMode, &flags);
+        if (dvmPrepForDexOpt(bcp, dexOptMode, verifyMode, flags) != 0 ||
+            !dvmPreloadForDexOpt())
+        {
+            fprintf(stderr, "VM init failed\n");
+            goto bail;
+        }
+    }
+
+    /* Everything else, in parallel */
+    result = 0;
+    while (running > 0 || (next < numJobs && result == 0)) {
+        if (next < numJobs && result == 0 && running < maxRunning) {
+            if (startPreoptJob(&jobs[next++], dexoptFlags, true) < 0)
+                result = -1;
+            else
+                running++;
+            continue;
+        }
+        if (!waitForPreoptJob(jobs, numJobs))
+            result = -1;
+        running--;
+    }
+
+bail:
+    free(jobs);
+    return result;
+}
+
 /*
  * Parse arguments for an "old-style" invocation directly from the VM.
  *
@@ -567,6 +820,8 @@ int main(int argc, char* const argv[])
             return fromDex(argc, argv);
         else if (strcmp(argv[1], "--preopt") == 0)
             return preopt(argc, argv);
+        else if (strcmp(argv[1], "--preopt-batch") == 0)
+            return preoptBatch(argc, argv);
     }
 
     fprintf(stderr,
@@ -9,7 +9,8 @@ LOCAL_SRC_FILES:= \
 LOCAL_SHARED_LIBRARIES := \
 	libcutils
 
-LOCAL_C_INCLUDES :=
+LOCAL_C_INCLUDES := \
+	dalvik/dalvikvm
 
 LOCAL_CFLAGS :=
 
@@ -16,11 +16,18 @@
 
 #include <cutils/zygote.h>
 
+#include "LaunchProtocol.h"
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <signal.h>
 
@@ -38,11 +45,32 @@ static void signal_forwarder (int signal, siginfo_t *si, void *context)
     }
 }
 
+static void forward_signals (void) {
+    int signals[]
+        = {SIGHUP, SIGINT, SIGTERM, SIGWINCH,
+        SIGTSTP, SIGTTIN, SIGTTOU, SIGCONT};
+
+    struct sigaction sa;
+    int i;
+    int err;
+
+    memset(&sa, 0, sizeof(sa));
+
+    sa.sa_sigaction = signal_forwarder;
+    sa.sa_flags = SA_SIGINFO;
+
+    for (i = 0; i < NELEM(signals); i++) {
+        err = sigaction(signals[i], &sa, NULL);
+        if (err < 0) {
+            perror ("unexpected error");
+            exit (-1);
+        }
+    }
+}
+
 static void post_run_func (int pid) {
     int my_pgid;
     int spawned_pgid;
-    int i;
-    int err;
 
     g_pid = pid;
 
@@ -61,34 +89,158 @@ static void post_run_func (int pid) {
     if (my_pgid != spawned_pgid) {
         // The zygote was unable to move this process into our pgid
         // We have to forward signals
+        forward_signals();
+    }
+}
 
-        int forward_signals[]
-            = {SIGHUP, SIGINT, SIGTERM, SIGWINCH,
-            SIGTSTP, SIGTTIN, SIGTTOU, SIGCONT};
-
-        struct sigaction sa;
-        memset(&sa, 0, sizeof(sa));
+static int read_int (int fd, int32_t *value) {
+    char *cp = (char *) value;
+    size_t len = sizeof(*value);
 
-        sa.sa_sigaction = signal_forwarder;
-        sa.sa_flags = SA_SIGINFO;
+    while (len > 0) {
+        ssize_t actual = read(fd, cp, len);
+        if (actual < 0 && errno == EINTR) {
+            continue;
+        }
+        if (actual <= 0) {
+            return -1;
+        }
+        cp += actual;
+        len -= actual;
+    }
+    return 0;
+}
 
-        for (i = 0; i < NELEM(forward_signals); i++) {
-            err = sigaction(forward_signals[i], &sa, NULL);
-            if (err < 0) {
-                perror ("unexpected error");
-                exit (-1);
-            }
+static int write_fully (int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t actual = write(fd, buf, len);
+        if (actual < 0 && errno == EINTR) {
+            continue;
+        }
+        if (actual < 0) {
+            return -1;
         }
+        buf += actual;
+        len -= actual;
+    }
+    return 0;
+}
+
+/*
+ * Ask the launch server on "socket_path" to run argv[0] with the rest of
+ * argv as its arguments, and exit with its exit code.  See
+ * dalvikvm/LaunchProtocol.h.
+ */
+static void launch_run (const char *socket_path, int argc, const char **argv) {
+    struct sockaddr_un addr;
+    char cwd[PATH_MAX];
+    char *request;
+    size_t request_len;
+    uint32_t header[2];
+    int fds[LAUNCH_NUM_FDS] = {0, 1, 2};
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int32_t pid;
+    int32_t status;
+    int sock;
+    int i;
+
+    if (argc < 1) {
+        fprintf(stderr, "no class name given\n");
+        exit(-1);
     }
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        exit(-1);
+    }
+
+    request_len = strlen(cwd) + 1;
+    for (i = 0; i < argc; i++) {
+        request_len += strlen(argv[i]) + 1;
+    }
+    if (request_len > LAUNCH_MAX_REQUEST) {
+        fprintf(stderr, "argument list too long\n");
+        exit(-1);
+    }
+    request = (char *) malloc(request_len);
+    if (request == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    strcpy(request, cwd);
+    request_len = strlen(cwd) + 1;
+    for (i = 0; i < argc; i++) {
+        strcpy(request + request_len, argv[i]);
+        request_len += strlen(argv[i]) + 1;
+    }
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long\n");
+        exit(-1);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("unable to reach launch server");
+        exit(-1);
+    }
+
+    // The header carries our stdio
+    header[0] = LAUNCH_MAGIC;
+    header[1] = request_len;
+    iov.iov_base = header;
+    iov.iov_len = sizeof(header);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(sock, &msg, 0) != (ssize_t) sizeof(header)
+            || write_fully(sock, request, request_len) < 0) {
+        perror("unable to send request");
+        exit(-1);
+    }
+    free(request);
+
+    if (read_int(sock, &pid) < 0 || pid < 0) {
+        fprintf(stderr, "launch server was unable to start the process\n");
+        exit(-1);
+    }
+
+    // The process belongs to the server's process group
+    g_pid = pid;
+    forward_signals();
+
+    if (read_int(sock, &status) < 0) {
+        fprintf(stderr, "lost contact with launch server\n");
+        exit(-1);
+    }
+    exit(status);
 }
 
 static void usage(const char *argv0) {
     fprintf(stderr,"Usage: %s [--help] [-classpath <classpath>] \n"
     "\t[additional zygote args] fully.qualified.java.ClassName [args]\n", argv0);
+    fprintf(stderr,"   or: %s --launcher=<socket> fully.qualified.java.ClassName [args]\n",
+    argv0);
     fprintf(stderr, "\nRequests a new Dalvik VM instance to be spawned from the zygote\n"
     "process. stdin, stdout, and stderr are hooked up. This process remains\n"
     "while the spawned VM instance is alive and forwards some signals.\n"
     "The exit code of the spawned VM instance is dropped.\n");
+    fprintf(stderr, "\nWith --launcher, the instance is spawned by the server that\n"
+    "\"dalvikvm --launch-server=<socket>\" started, with that server's class\n"
+    "path, and its exit code becomes the exit code of this process.\n");
 }
 
 int main (int argc, const char **argv) {
@@ -99,6 +251,10 @@ int main (int argc, const char **argv) {
         exit(0);
     }
 
+    if (argc > 1 && 0 == strncmp(argv[1], "--launcher=", 11)) {
+        launch_run(argv[1] + 11, argc - 2, argv + 2);
+    }
+
     err = zygote_run_wait(argc - 1, argv + 1, post_run_func);
 
     if (err < 0) {
@@ -34,12 +34,16 @@ public class Main {
         "  [--dump-method=<name>[*]] [--verbose-dump] [--no-files] " +
         "[--core-library]\n" +
         "  [--num-threads=<n>] [--incremental] [--force-jumbo]\n" +
+        "  [--layout-profile=<file>]\n" +
         "  [<file>.class | <file>.{zip,jar,apk} | <directory>] ...\n" +
         "    Convert a set of classfiles into a dex file, optionally " +
         "embedded in a\n" +
         "    jar/zip. Output name must end with one of: .dex .jar " +
         ".zip .apk. Positions\n" +
-        "    options: none, important, lines.\n" +
+        "    options: none, important, lines. The layout profile lists " +
+        "classes, hottest\n" +
+        "    first, whose code and data are placed at the front of " +
+        "their sections.\n" +
         "  dx --annotool --annotation=<class> [--element=<element types>]\n" +
         "  [--print=<print types>]\n" +
         "  dx --dump [--debug] [--strict] [--bytes] [--optimize]\n" +
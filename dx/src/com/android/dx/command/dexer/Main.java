@@ -40,10 +40,12 @@ import com.android.dx.rop.annotation.AnnotationsList;
 import com.android.dx.rop.cst.CstNat;
 import com.android.dx.rop.cst.CstString;
 import com.android.dx.util.FileUtils;
+import java.io.BufferedReader;
 import java.io.ByteArrayInputStream;
 import java.io.ByteArrayOutputStream;
 import java.io.File;
 import java.io.FileOutputStream;
+import java.io.FileReader;
 import java.io.IOException;
 import java.io.OutputStream;
 import java.io.OutputStreamWriter;
@@ -53,9 +55,12 @@ import java.util.Arrays;
 import java.util.List;
 import java.util.Map;
 import java.util.TreeMap;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
 import java.util.concurrent.ExecutorService;
 import java.util.concurrent.Executors;
-import java.util.concurrent.TimeUnit;
+import java.util.concurrent.Future;
+import java.util.concurrent.atomic.AtomicInteger;
 import java.util.jar.Attributes;
 import java.util.jar.JarEntry;
 import java.util.jar.JarOutputStream;
@@ -127,10 +132,10 @@ public class Main {
     };
 
     /** number of warnings during processing */
-    private static int warnings = 0;
+    private static final AtomicInteger warnings = new AtomicInteger();
 
     /** number of errors during processing */
-    private static int errors = 0;
+    private static final AtomicInteger errors = new AtomicInteger();
 
     /** {@code non-null;} parsed command-line arguments */
     private static Arguments args;
@@ -150,6 +155,13 @@ public class Main {
     /** thread pool object used for multi-threaded file processing */
     private static ExecutorService threadPool;
 
+    /**
+     * class file translations handed to {@link #threadPool}, in the order
+     * the class files were read, so results and errors are collected in
+     * the same order every time
+     */
+    private static List<Future<Boolean>> classTranslations;
+
     /** true if any files are successfully processed */
     private static boolean anyFilesProcessed;
 
@@ -184,8 +196,8 @@ public class Main {
      */
     public static int run(Arguments arguments) throws IOException {
         // Reset the error/warning count to start fresh.
-        warnings = 0;
-        errors = 0;
+        warnings.set(0);
+        errors.set(0);
         // empty the list, so that  tools that load dx and keep it around
         // for multiple runs don't reuse older buffers.
         libraryDexBuffers.clear();
@@ -289,6 +301,18 @@ public class Main {
      * same type, this fails with an exception.
      */
     private static byte[] mergeLibraryDexBuffers(byte[] outArray) throws IOException {
+        if (args.numThreads > 1 && !libraryDexBuffers.isEmpty()) {
+            List<DexBuffer> dexes = new ArrayList<DexBuffer>();
+            if (outArray != null) {
+                dexes.add(new DexBuffer(outArray));
+            }
+            for (byte[] libraryDexBuffer : libraryDexBuffers) {
+                dexes.add(new DexBuffer(libraryDexBuffer));
+            }
+            return DexMerger.mergeAll(dexes, CollisionPolicy.FAIL, args.numThreads)
+                    .getBytes();
+        }
+
         for (byte[] libraryDexBuffer : libraryDexBuffers) {
             if (outArray == null) {
                 outArray = libraryDexBuffer;
@@ -304,6 +328,71 @@ public class Main {
         return outArray;
     }
 
+    /**
+     * Reads a layout profile: the classes to place first in the output,
+     * one per line, hottest first. A line may hold a descriptor
+     * ({@code Lfoo/Bar;}), a class name in either dotted or internal
+     * form, or a {@code ':'}-separated class loading log line, in which
+     * case its first descriptor field is used. Blank lines and lines
+     * starting with {@code '#'} are ignored.
+     *
+     * @param fileName {@code non-null;} the profile to read
+     * @return {@code non-null;} the class descriptors, in file order
+     */
+    private static List<String> readLayoutProfile(String fileName) {
+        List<String> result = new ArrayList<String>();
+
+        try {
+            BufferedReader in = new BufferedReader(new FileReader(fileName));
+
+            try {
+                String line;
+                while ((line = in.readLine()) != null) {
+                    String descriptor = layoutProfileDescriptor(line.trim());
+                    if (descriptor != null) {
+                        result.add(descriptor);
+                    }
+                }
+            } finally {
+                in.close();
+            }
+        } catch (IOException ex) {
+            // Let the exception percolate up as a RuntimeException.
+            throw new RuntimeException("Error with layout profile: " +
+                    fileName, ex);
+        }
+
+        return result;
+    }
+
+    /**
+     * Extracts the class descriptor from one line of a layout profile.
+     *
+     * @param line {@code non-null;} the trimmed line
+     * @return {@code null-ok;} the descriptor, or {@code null} if the line
+     * names no class
+     */
+    private static String layoutProfileDescriptor(String line) {
+        if (line.length() == 0 || line.startsWith("#")) {
+            return null;
+        }
+
+        if (line.indexOf(':') >= 0) {
+            for (String field : line.split(":")) {
+                if (field.startsWith("L") && field.endsWith(";")) {
+                    return field;
+                }
+            }
+            return null;
+        }
+
+        if (line.startsWith("L") && line.endsWith(";")) {
+            return line;
+        }
+
+        return "L" + line.replace('.', '/') + ";";
+    }
+
     /**
      * Constructs the output {@link DexFile}, fill it in with all the
      * specified classes, and populate the resources map if required.
@@ -326,6 +415,7 @@ public class Main {
 
         if (args.numThreads > 1) {
             threadPool = Executors.newFixedThreadPool(args.numThreads);
+            classTranslations = new ArrayList<Future<Boolean>>();
         }
 
         try {
@@ -342,22 +432,25 @@ public class Main {
         }
 
         if (args.numThreads > 1) {
-            try {
-                threadPool.shutdown();
-                threadPool.awaitTermination(600L, TimeUnit.SECONDS);
-            } catch (InterruptedException ex) {
-                throw new RuntimeException("Timed out waiting for threads.");
+            threadPool.shutdown();
+            for (Future<Boolean> translation : classTranslations) {
+                if (finishTranslation(translation)) {
+                    anyFilesProcessed = true;
+                }
             }
+            classTranslations = null;
         }
 
-        if (warnings != 0) {
-            DxConsole.err.println(warnings + " warning" +
-                               ((warnings == 1) ? "" : "s"));
+        int warningCount = warnings.get();
+        if (warningCount != 0) {
+            DxConsole.err.println(warningCount + " warning" +
+                               ((warningCount == 1) ? "" : "s"));
         }
 
-        if (errors != 0) {
-            DxConsole.err.println(errors + " error" +
-                    ((errors == 1) ? "" : "s") + "; aborting");
+        int errorCount = errors.get();
+        if (errorCount != 0) {
+            DxConsole.err.println(errorCount + " error" +
+                    ((errorCount == 1) ? "" : "s") + "; aborting");
             return false;
         }
 
@@ -391,8 +484,14 @@ public class Main {
         opener = new ClassPathOpener(pathname, false,
                 new ClassPathOpener.Consumer() {
             public boolean processFileBytes(String name, long lastModified, byte[] bytes) {
-                if (args.numThreads > 1) {
-                    threadPool.execute(new ParallelProcessor(name, lastModified, bytes));
+                /*
+                 * Only the translation of class files is worth farming
+                 * out. Resources and library dex files are cheap, and
+                 * keeping them on this thread keeps them in input order.
+                 */
+                if (args.numThreads > 1 && name.endsWith(".class")) {
+                    classTranslations.add(threadPool.submit(
+                            new ParallelProcessor(name, lastModified, bytes)));
                     return false;
                 } else {
                     return Main.processFileBytes(name, lastModified, bytes);
@@ -401,15 +500,8 @@ public class Main {
             public void onException(Exception ex) {
                 if (ex instanceof StopProcessing) {
                     throw (StopProcessing) ex;
-                } else if (ex instanceof SimException) {
-                    DxConsole.err.println("\nEXCEPTION FROM SIMULATION:");
-                    DxConsole.err.println(ex.getMessage() + "\n");
-                    DxConsole.err.println(((SimException) ex).getContext());
-                } else {
-                    DxConsole.err.println("\nUNEXPECTED TOP-LEVEL EXCEPTION:");
-                    ex.printStackTrace(DxConsole.err);
                 }
-                errors++;
+                reportException(ex);
             }
             public void onProcessArchiveStart(File file) {
                 if (args.verbose) {
@@ -422,6 +514,46 @@ public class Main {
         return opener.process();
     }
 
+    /**
+     * Reports an exception thrown while processing a file, and counts it
+     * as an error.
+     */
+    private static void reportException(Throwable ex) {
+        if (ex instanceof SimException) {
+            DxConsole.err.println("\nEXCEPTION FROM SIMULATION:");
+            DxConsole.err.println(ex.getMessage() + "\n");
+            DxConsole.err.println(((SimException) ex).getContext());
+        } else {
+            DxConsole.err.println("\nUNEXPECTED TOP-LEVEL EXCEPTION:");
+            ex.printStackTrace(DxConsole.err);
+        }
+        errors.incrementAndGet();
+    }
+
+    /**
+     * Waits for a class file translation handed to the thread pool and
+     * reports anything it threw, as {@link #processOne} does for files
+     * processed on the calling thread.
+     *
+     * @return whether the class was processed
+     */
+    private static boolean finishTranslation(Future<Boolean> translation) {
+        try {
+            return translation.get();
+        } catch (InterruptedException ex) {
+            throw new RuntimeException("Interrupted waiting for threads.", ex);
+        } catch (ExecutionException ex) {
+            Throwable cause = ex.getCause();
+            if (cause instanceof Error) {
+                throw (Error) cause;
+            } else if (!(cause instanceof StopProcessing)) {
+                // StopProcessing has already been reported and counted.
+                reportException(cause);
+            }
+            return false;
+        }
+    }
+
     /**
      * Processes one file, which may be either a class or a resource.
      *
@@ -499,7 +631,7 @@ public class Main {
             }
         }
 
-        warnings++;
+        warnings.incrementAndGet();
         return false;
     }
 
@@ -539,7 +671,7 @@ public class Main {
 
         DxConsole.err.println("\ntrouble processing \"" + name + "\":\n\n" +
                 IN_RE_CORE_CLASSES);
-        errors++;
+        errors.incrementAndGet();
         throw new StopProcessing();
     }
 
@@ -962,6 +1094,9 @@ public class Main {
         /** number of threads to run with */
         public int numThreads = 1;
 
+        /** {@code null-ok;} file listing the classes to lay out first */
+        public String layoutProfileFile = null;
+
         private static class ArgumentsParser {
 
             /** The arguments to process. */
@@ -1142,6 +1277,8 @@ public class Main {
                     localInfo = false;
                 } else if (parser.isArg("--num-threads=")) {
                     numThreads = Integer.parseInt(parser.getLastValue());
+                } else if (parser.isArg("--layout-profile=")) {
+                    layoutProfileFile = parser.getLastValue();
                 } else if (parser.isArg("--incremental")) {
                     incremental = true;
                 } else if (parser.isArg("--force-jumbo")) {
@@ -1187,11 +1324,15 @@ public class Main {
             dexOptions = new DexOptions();
             dexOptions.targetApiLevel = targetApiLevel;
             dexOptions.forceJumbo = forceJumbo;
+
+            if (layoutProfileFile != null) {
+                dexOptions.layoutProfile = readLayoutProfile(layoutProfileFile);
+            }
         }
     }
 
     /** Runnable helper class to process files in multiple threads */
-    private static class ParallelProcessor implements Runnable {
+    private static class ParallelProcessor implements Callable<Boolean> {
 
         String path;
         long lastModified;
@@ -1214,10 +1355,8 @@ public class Main {
          * Task run by each thread in the thread pool. Runs processFileBytes
          * with the given path and bytes.
          */
-        public void run() {
-            if (Main.processFileBytes(path, lastModified, bytes)) {
-                anyFilesProcessed = true;
-            }
+        public Boolean call() {
+            return Main.processFileBytes(path, lastModified, bytes);
         }
     }
 }
@@ -16,6 +16,8 @@
 
 package com.android.dx.dex;
 
+import java.util.List;
+
 /**
  * Container for options used to control details of dex file generation.
  */
@@ -26,6 +28,13 @@ public class DexOptions {
     /** force generation of jumbo opcodes */
     public boolean forceJumbo = false;
 
+    /**
+     * {@code null-ok;} descriptors of the classes to lay out first, in
+     * the order they are used at startup, or {@code null} for the
+     * default layout
+     */
+    public List<String> layoutProfile = null;
+
     /**
      * Gets the dex file magic number corresponding to this instance.
      */
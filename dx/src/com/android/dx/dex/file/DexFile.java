@@ -34,6 +34,8 @@ import java.io.Writer;
 import java.security.DigestException;
 import java.security.MessageDigest;
 import java.security.NoSuchAlgorithmException;
+import java.util.HashMap;
+import java.util.List;
 import java.util.zip.Adler32;
 
 import static com.android.dx.dex.file.MixedItemSection.SortType;
@@ -105,6 +107,18 @@ public final class DexFile {
     /** {@code >= 40;} maximum width of the file dump */
     private int dumpWidth;
 
+    /**
+     * {@code null-ok;} layout rank of each profiled class, by descriptor, or
+     * {@code null} if there is no layout profile
+     */
+    private final HashMap<String, Integer> layoutRanks;
+
+    /**
+     * {@code >= 0;} layout rank of the item whose contents are being added,
+     * inherited by everything it adds
+     */
+    private int currentLayoutRank;
+
     /**
      * Constructs an instance. It is initially empty.
      */
@@ -137,6 +151,20 @@ public final class DexFile {
 
         fileSize = -1;
         dumpWidth = 79;
+
+        List<String> profile = dexOptions.layoutProfile;
+        if (profile != null) {
+            layoutRanks = new HashMap<String, Integer>();
+            for (String descriptor : profile) {
+                if (!layoutRanks.containsKey(descriptor)) {
+                    layoutRanks.put(descriptor, layoutRanks.size());
+                }
+            }
+        } else {
+            layoutRanks = null;
+        }
+
+        currentLayoutRank = Integer.MAX_VALUE;
     }
 
     /**
@@ -161,6 +189,44 @@ public final class DexFile {
      */
     public void add(ClassDefItem clazz) {
         classDefs.add(clazz);
+
+        if (layoutRanks != null) {
+            Integer rank = layoutRanks.get(
+                    clazz.getThisClass().getClassType().getDescriptor());
+            if (rank != null) {
+                clazz.lowerLayoutRank(rank);
+            }
+        }
+    }
+
+    /**
+     * Returns whether items are to be placed by layout rank.
+     *
+     * @return whether there is a layout profile
+     */
+    /*package*/ boolean hasLayoutProfile() {
+        return layoutRanks != null;
+    }
+
+    /**
+     * Sets the layout rank of the item whose contents are about to be
+     * added. Sections call this from their {@code prepare0()} loops.
+     *
+     * @param rank {@code >= 0;} the rank, or {@code Integer.MAX_VALUE}
+     * once the section is done
+     */
+    /*package*/ void setCurrentLayoutRank(int rank) {
+        currentLayoutRank = rank;
+    }
+
+    /**
+     * Notes that the given item is used by the item whose contents are
+     * being added, so it is placed no later than that item's class.
+     *
+     * @param item {@code non-null;} the used item
+     */
+    /*package*/ void noteLayoutUse(Item item) {
+        item.lowerLayoutRank(currentLayoutRank);
     }
 
     /**
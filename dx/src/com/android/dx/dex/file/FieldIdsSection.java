@@ -109,6 +109,7 @@ public final class FieldIdsSection extends MemberIdsSection {
             fieldIds.put(field, result);
         }
 
+        getFile().noteLayoutUse(result);
         return result;
     }
 
@@ -23,11 +23,17 @@ import com.android.dx.util.AnnotatedOutput;
  * repeated piece of a Dalvik file.
  */
 public abstract class Item {
+    /**
+     * {@code >= 0;} position of the earliest profiled class that uses this
+     * item, or {@code Integer.MAX_VALUE} if no profiled class does
+     */
+    private int layoutRank;
+
     /**
      * Constructs an instance.
      */
     public Item() {
-        // This space intentionally left blank.
+        layoutRank = Integer.MAX_VALUE;
     }
 
     /**
@@ -77,4 +83,26 @@ public abstract class Item {
      * @param out {@code non-null;} where to write to
      */
     public abstract void writeTo(DexFile file, AnnotatedOutput out);
+
+    /**
+     * Gets the layout rank of this instance. Items with lower ranks are
+     * placed first within their section when a layout profile is in use.
+     *
+     * @return {@code >= 0;} the layout rank
+     */
+    public final int getLayoutRank() {
+        return layoutRank;
+    }
+
+    /**
+     * Lowers the layout rank of this instance to the given one, if that
+     * is lower than its current rank.
+     *
+     * @param rank {@code >= 0;} the rank of a user of this instance
+     */
+    /*package*/ final void lowerLayoutRank(int rank) {
+        if (rank < layoutRank) {
+            layoutRank = rank;
+        }
+    }
 }
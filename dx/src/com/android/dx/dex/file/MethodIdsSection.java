@@ -109,6 +109,7 @@ public final class MethodIdsSection extends MemberIdsSection {
             methodIds.put(method, result);
         }
 
+        getFile().noteLayoutUse(result);
         return result;
     }
 
@@ -60,6 +60,23 @@ public final class MixedItemSection extends Section {
         }
     };
 
+    /**
+     * {@code non-null;} sorter which keeps instances grouped by type and
+     * orders them by layout rank within each type
+     */
+    private static final Comparator<OffsettedItem> LAYOUT_SORTER =
+        new Comparator<OffsettedItem>() {
+        public int compare(OffsettedItem item1, OffsettedItem item2) {
+            int result = TYPE_SORTER.compare(item1, item2);
+            if (result != 0) {
+                return result;
+            }
+            int rank1 = item1.getLayoutRank();
+            int rank2 = item2.getLayoutRank();
+            return (rank1 < rank2) ? -1 : ((rank1 == rank2) ? 0 : 1);
+        }
+    };
+
     /** {@code non-null;} the items in this part */
     private final ArrayList<OffsettedItem> items;
 
@@ -179,6 +196,7 @@ public final class MixedItemSection extends Section {
             throw new NullPointerException("item == null");
         }
 
+        getFile().noteLayoutUse(item);
         items.add(item);
     }
 
@@ -196,6 +214,7 @@ public final class MixedItemSection extends Section {
         OffsettedItem result = interns.get(item);
 
         if (result != null) {
+            getFile().noteLayoutUse(result);
             return (T) result;
         }
 
@@ -277,9 +296,12 @@ public final class MixedItemSection extends Section {
 
             for (/*i*/; i < sz; i++) {
                 OffsettedItem one = items.get(i);
+                file.setCurrentLayoutRank(one.getLayoutRank());
                 one.addContents(file);
             }
         }
+
+        file.setCurrentLayoutRank(Integer.MAX_VALUE);
     }
 
     /**
@@ -304,6 +326,16 @@ public final class MixedItemSection extends Section {
             }
         }
 
+        /*
+         * With a layout profile, move the items that the profiled classes
+         * use to the front of their type's run, in profile order. The sort
+         * is stable, so each rank keeps the order established above, and
+         * the section is unchanged when there is no profile.
+         */
+        if (getFile().hasLayoutProfile()) {
+            Collections.sort(items, LAYOUT_SORTER);
+        }
+
         int sz = items.size();
         int outAt = 0;
         for (int i = 0; i < sz; i++) {
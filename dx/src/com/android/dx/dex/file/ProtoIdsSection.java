@@ -101,6 +101,7 @@ public final class ProtoIdsSection extends UniformItemSection {
             protoIds.put(prototype, result);
         }
 
+        getFile().noteLayoutUse(result);
         return result;
     }
 
@@ -129,9 +129,11 @@ public final class StringIdsSection
         StringIdItem already = strings.get(value);
 
         if (already != null) {
+            getFile().noteLayoutUse(already);
             return already;
         }
 
+        getFile().noteLayoutUse(string);
         strings.put(value, string);
         return string;
     }
@@ -114,6 +114,7 @@ public final class TypeIdsSection extends UniformItemSection {
             typeIds.put(type, result);
         }
 
+        getFile().noteLayoutUse(result);
         return result;
     }
 
@@ -138,6 +139,7 @@ public final class TypeIdsSection extends UniformItemSection {
             typeIds.put(typePerSe, result);
         }
 
+        getFile().noteLayoutUse(result);
         return result;
     }
 
@@ -73,8 +73,11 @@ public abstract class UniformItemSection extends Section {
         orderItems();
 
         for (Item one : items()) {
+            file.setCurrentLayoutRank(one.getLayoutRank());
             one.addContents(file);
         }
+
+        file.setCurrentLayoutRank(Integer.MAX_VALUE);
     }
 
     /** {@inheritDoc} */
@@ -34,6 +34,11 @@ import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Collections;
 import java.util.List;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
 
 /**
  * Combine two dex files into one.
@@ -216,6 +221,77 @@ public final class DexMerger {
         return result;
     }
 
+    /**
+     * Merges any number of dex files into one. The inputs are merged as a
+     * balanced tree of pairwise merges, and the merges of each level run on
+     * up to {@code numThreads} threads. When two inputs define the same
+     * type, an earlier input counts as "A" for {@code collisionPolicy}, just
+     * as when merging them one by one in order. The result depends only on
+     * the inputs and their order, not on the number of threads.
+     *
+     * @param dexes {@code non-null;} at least one dex file
+     */
+    public static DexBuffer mergeAll(List<DexBuffer> dexes,
+            final CollisionPolicy collisionPolicy, int numThreads)
+            throws IOException {
+        if (dexes.isEmpty()) {
+            throw new IllegalArgumentException("no dex files to merge");
+        }
+
+        List<DexBuffer> level = new ArrayList<DexBuffer>(dexes);
+        ExecutorService pool = Executors.newFixedThreadPool(Math.max(1, numThreads));
+        try {
+            while (level.size() > 1) {
+                List<Future<DexBuffer>> merges = new ArrayList<Future<DexBuffer>>();
+                for (int i = 0; i + 1 < level.size(); i += 2) {
+                    final DexBuffer a = level.get(i);
+                    final DexBuffer b = level.get(i + 1);
+                    merges.add(pool.submit(new Callable<DexBuffer>() {
+                        public DexBuffer call() throws IOException {
+                            return new DexMerger(a, b, collisionPolicy).merge();
+                        }
+                    }));
+                }
+
+                List<DexBuffer> next = new ArrayList<DexBuffer>();
+                for (Future<DexBuffer> merge : merges) {
+                    next.add(getMergeResult(merge));
+                }
+                if (level.size() % 2 != 0) {
+                    next.add(level.get(level.size() - 1));
+                }
+                level = next;
+            }
+        } finally {
+            pool.shutdownNow();
+        }
+
+        return level.get(0);
+    }
+
+    /**
+     * Waits for a merge started by {@link #mergeAll} and rethrows whatever
+     * it threw.
+     */
+    private static DexBuffer getMergeResult(Future<DexBuffer> merge) throws IOException {
+        try {
+            return merge.get();
+        } catch (InterruptedException e) {
+            Thread.currentThread().interrupt();
+            throw new DexException(e);
+        } catch (ExecutionException e) {
+            Throwable cause = e.getCause();
+            if (cause instanceof IOException) {
+                throw (IOException) cause;
+            } else if (cause instanceof RuntimeException) {
+                throw (RuntimeException) cause;
+            } else if (cause instanceof Error) {
+                throw (Error) cause;
+            }
+            throw new DexException(cause);
+        }
+    }
+
     /**
      * Reads an IDs section of two dex files and writes an IDs section of a
      * merged dex file. Populates maps from old to new indices in the process.
@@ -1053,20 +1129,23 @@ public final class DexMerger {
     }
 
     public static void main(String[] args) throws IOException {
-        if (args.length != 3) {
+        if (args.length < 3) {
             printUsage();
             return;
         }
 
-        DexBuffer dexA = new DexBuffer(new File(args[1]));
-        DexBuffer dexB = new DexBuffer(new File(args[2]));
-        DexBuffer merged = new DexMerger(dexA, dexB, CollisionPolicy.KEEP_FIRST).merge();
+        List<DexBuffer> dexes = new ArrayList<DexBuffer>();
+        for (int i = 1; i < args.length; i++) {
+            dexes.add(new DexBuffer(new File(args[i])));
+        }
+        int numThreads = Runtime.getRuntime().availableProcessors();
+        DexBuffer merged = mergeAll(dexes, CollisionPolicy.KEEP_FIRST, numThreads);
         merged.writeTo(new File(args[0]));
     }
 
     private static void printUsage() {
-        System.out.println("Usage: DexMerger <out.dex> <a.dex> <b.dex>");
+        System.out.println("Usage: DexMerger <out.dex> <a.dex> <b.dex> [<c.dex>...]");
         System.out.println();
-        System.out.println("If both a and b define the same classes, a's copy will be used.");
+        System.out.println("If several inputs define the same classes, the first copy will be used.");
     }
 }
@@ -26,7 +26,9 @@ import java.io.OutputStream;
 import java.lang.annotation.Annotation;
 import java.lang.reflect.Field;
 import java.lang.reflect.Method;
+import java.util.ArrayList;
 import java.util.Arrays;
+import java.util.List;
 import java.util.jar.JarEntry;
 import java.util.jar.JarOutputStream;
 import junit.framework.TestCase;
@@ -155,6 +157,29 @@ public final class DexMergeTest extends TestCase {
         assertTrue(maxLength + " < " + maxExpectedLength, maxLength < maxExpectedLength);
     }
 
+    /**
+     * Merging several dex files at once should give the same bytes however
+     * many threads do the work.
+     */
+    public void testMergeAllIsDeterministic() throws Exception {
+        List<DexBuffer> dexes = new ArrayList<DexBuffer>();
+        dexes.add(resourceToDexBuffer("/testdata/Annotated.dex"));
+        dexes.add(resourceToDexBuffer("/testdata/Basic.dex"));
+        dexes.add(resourceToDexBuffer("/testdata/FillArrayData.dex"));
+        dexes.add(resourceToDexBuffer("/testdata/StaticValues.dex"));
+        dexes.add(resourceToDexBuffer("/testdata/TryCatchFinally.dex"));
+
+        byte[] serial = DexMerger.mergeAll(dexes, CollisionPolicy.FAIL, 1).getBytes();
+        byte[] parallel = DexMerger.mergeAll(dexes, CollisionPolicy.FAIL, 4).getBytes();
+        assertTrue(Arrays.equals(serial, parallel));
+
+        int classDefs = 0;
+        for (DexBuffer dex : dexes) {
+            classDefs += dex.getTableOfContents().classDefs.size;
+        }
+        assertEquals(classDefs, new DexBuffer(serial).getTableOfContents().classDefs.size);
+    }
+
     public ClassLoader mergeAndLoad(String dexAResource, String dexBResource) throws Exception {
         DexBuffer dexA = resourceToDexBuffer(dexAResource);
         DexBuffer dexB = resourceToDexBuffer(dexBResource);
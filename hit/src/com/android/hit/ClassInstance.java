@@ -19,6 +19,7 @@ package com.android.hit;
 import java.io.ByteArrayInputStream;
 import java.io.DataInputStream;
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.Set;
 
 public class ClassInstance extends Instance {
@@ -30,10 +31,9 @@ public class ClassInstance extends Instance {
         mClassId = classId;
     }
 
-    public final void loadFieldData(DataInputStream in, int numBytes)
-            throws IOException {
+    public final void loadFieldData(ByteBuffer in, int numBytes) {
         mFieldValues = new byte[numBytes];
-        in.readFully(mFieldValues);
+        in.get(mFieldValues);
     }
 
     @Override
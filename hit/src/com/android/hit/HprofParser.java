@@ -18,9 +18,13 @@ package com.android.hit;
 
 import java.io.ByteArrayOutputStream;
 import java.io.DataInputStream;
-import java.io.InputStream;
-import java.io.EOFException;
+import java.io.File;
+import java.io.FileInputStream;
 import java.io.IOException;
+import java.nio.BufferUnderflowException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.FileChannel;
 import java.util.HashMap;
 
 public class HprofParser
@@ -79,7 +83,12 @@ public class HprofParser
     private static final int ROOT_UNREACHABLE           =   0x90;
     private static final int ROOT_PRIMITIVE_ARRAY_NODATA=   0xc3;
 
-    DataInputStream mInput;
+    /*
+     * The whole dump.  When parsing a file this is a read-only mapping of
+     * it, so the dump is paged in by the OS instead of being copied through
+     * a stream, and skipping a record is just a change of position.
+     */
+    ByteBuffer mInput;
     int mIdSize;
     State mState;
 
@@ -92,8 +101,41 @@ public class HprofParser
     HashMap<Long, String> mStrings = new HashMap<Long, String>();
     HashMap<Long, String> mClassNames = new HashMap<Long, String>();
 
-    public HprofParser(DataInputStream in) {
-        mInput = in;
+    public HprofParser(ByteBuffer in) {
+        mInput = in.order(ByteOrder.BIG_ENDIAN);
+    }
+
+    /**
+     * Reads the rest of the stream into memory and parses it from there.
+     * Prefer {@link #HprofParser(File)}, which maps the file instead.
+     */
+    public HprofParser(DataInputStream in) throws IOException {
+        ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+        byte[] buffer = new byte[64 * 1024];
+
+        for (int n = in.read(buffer); n != -1; n = in.read(buffer)) {
+            bytes.write(buffer, 0, n);
+        }
+
+        mInput = ByteBuffer.wrap(bytes.toByteArray());
+    }
+
+    /**
+     * Maps the dump in "file" for parsing.  A single mapping is limited
+     * to 2GB, so larger dumps are not supported.
+     */
+    public HprofParser(File file) throws IOException {
+        FileInputStream fis = new FileInputStream(file);
+
+        try {
+            FileChannel channel = fis.getChannel();
+
+            mInput = channel.map(FileChannel.MapMode.READ_ONLY, 0,
+                channel.size());
+        } finally {
+            //  the mapping stays valid after the channel is closed
+            fis.close();
+        }
     }
 
     public final State parse() {
@@ -102,17 +144,17 @@ public class HprofParser
 
         try {
             String  s = readNullTerminatedString();
-            DataInputStream in = mInput;
+            ByteBuffer in = mInput;
 
-            mIdSize = in.readInt();
+            mIdSize = in.getInt();
             Types.setIdSize(mIdSize);
 
-            in.readLong();  //  Timestamp, ignored for now
+            in.getLong();  //  Timestamp, ignored for now
 
-            while (true) {
-                int tag = in.readUnsignedByte();
-                int timestamp = in.readInt();
-                int length = in.readInt();
+            while (in.hasRemaining()) {
+                int tag = readUnsignedByte();
+                int timestamp = in.getInt();
+                int length = in.getInt();
 
                 switch (tag) {
                     case STRING_IN_UTF8:
@@ -146,8 +188,8 @@ public class HprofParser
                 }
 
             }
-        } catch (EOFException eof) {
-            //  this is fine
+        } catch (BufferUnderflowException eof) {
+            //  a truncated dump; keep what we have
         } catch (Exception e) {
             e.printStackTrace();
         }
@@ -159,21 +201,29 @@ public class HprofParser
 
     private String readNullTerminatedString() throws IOException {
         StringBuilder s = new StringBuilder();
-        DataInputStream in = mInput;
+        ByteBuffer in = mInput;
 
-        for (int c = in.read(); c != 0; c = in.read()) {
+        for (int c = in.get(); c != 0; c = in.get()) {
             s.append((char) c);
         }
 
         return s.toString();
     }
 
+    private int readUnsignedByte() {
+        return mInput.get() & 0xff;
+    }
+
+    private int readUnsignedShort() {
+        return mInput.getShort() & 0xffff;
+    }
+
     private long readId() throws IOException {
         switch (mIdSize) {
-            case 1: return mInput.readUnsignedByte();
-            case 2: return mInput.readUnsignedShort();
-            case 4: return ((long) mInput.readInt()) & 0x00000000ffffffffL;
-            case 8: return mInput.readLong();
+            case 1: return readUnsignedByte();
+            case 2: return readUnsignedShort();
+            case 4: return ((long) mInput.getInt()) & 0x00000000ffffffffL;
+            case 8: return mInput.getLong();
         }
 
         throw new IllegalArgumentException("ID Length must be 1, 2, 4, or 8");
@@ -182,7 +232,7 @@ public class HprofParser
     private String readUTF8(int length) throws IOException {
         byte[] b = new byte[length];
 
-        mInput.read(b);
+        mInput.get(b);
 
         return new String(b, "utf-8");
     }
@@ -195,10 +245,10 @@ public class HprofParser
     }
 
     private void loadClass() throws IOException {
-        DataInputStream in = mInput;
-        int serial = in.readInt();
+        ByteBuffer in = mInput;
+        int serial = in.getInt();
         long id = readId();
-        int stackTrace = in.readInt();              //  unused
+        int stackTrace = in.getInt();               //  unused
         String name = mStrings.get(readId());
 
         mClassNames.put(id, name);
@@ -209,8 +259,8 @@ public class HprofParser
         String methodName = mStrings.get(readId());
         String methodSignature = mStrings.get(readId());
         String sourceFile = mStrings.get(readId());
-        int serial = mInput.readInt();
-        int lineNumber = mInput.readInt();
+        int serial = mInput.getInt();
+        int lineNumber = mInput.getInt();
 
         StackFrame frame = new StackFrame(id, methodName, methodSignature,
             sourceFile, serial, lineNumber);
@@ -219,9 +269,9 @@ public class HprofParser
     }
 
     private void loadStackTrace() throws IOException {
-        int serialNumber = mInput.readInt();
-        int threadSerialNumber = mInput.readInt();
-        final int numFrames = mInput.readInt();
+        int serialNumber = mInput.getInt();
+        int threadSerialNumber = mInput.getInt();
+        final int numFrames = mInput.getInt();
         StackFrame[] frames = new StackFrame[numFrames];
 
         for (int i = 0; i < numFrames; i++) {
@@ -235,10 +285,8 @@ public class HprofParser
     }
 
     private void loadHeapDump(int length) throws IOException {
-        DataInputStream in = mInput;
-
         while (length > 0) {
-            int tag = in.readUnsignedByte();
+            int tag = readUnsignedByte();
             length--;
 
             switch (tag) {
@@ -304,7 +352,7 @@ public class HprofParser
                         "Don't know how to load a nodata array");
 
                 case ROOT_HEAP_DUMP_INFO:
-                    int heapId = mInput.readInt();
+                    int heapId = mInput.getInt();
                     long heapNameId = readId();
                     String heapName = mStrings.get(heapNameId);
 
@@ -343,7 +391,7 @@ public class HprofParser
                 default:
                     throw new IllegalArgumentException(
                         "loadHeapDump loop with unknown tag " + tag
-                        + " with " + mInput.available()
+                        + " with " + mInput.remaining()
                         + " bytes possibly remaining");
             }
         }
@@ -351,8 +399,8 @@ public class HprofParser
 
     private int loadJniLocal() throws IOException {
         long id = readId();
-        int threadSerialNumber = mInput.readInt();
-        int stackFrameNumber = mInput.readInt();
+        int threadSerialNumber = mInput.getInt();
+        int stackFrameNumber = mInput.getInt();
         ThreadObj thread = mState.getThread(threadSerialNumber);
         StackTrace trace = mState.getStackTraceAtDepth(thread.mStackTrace,
             stackFrameNumber);
@@ -367,8 +415,8 @@ public class HprofParser
 
     private int loadJavaFrame() throws IOException {
         long id = readId();
-        int threadSerialNumber = mInput.readInt();
-        int stackFrameNumber = mInput.readInt();
+        int threadSerialNumber = mInput.getInt();
+        int stackFrameNumber = mInput.getInt();
         ThreadObj thread = mState.getThread(threadSerialNumber);
         StackTrace trace = mState.getStackTraceAtDepth(thread.mStackTrace,
             stackFrameNumber);
@@ -383,7 +431,7 @@ public class HprofParser
 
     private int loadNativeStack() throws IOException {
         long id = readId();
-        int threadSerialNumber = mInput.readInt();
+        int threadSerialNumber = mInput.getInt();
         ThreadObj thread = mState.getThread(threadSerialNumber);
         StackTrace trace = mState.getStackTrace(thread.mStackTrace);
         RootObj root = new RootObj(RootType.NATIVE_STACK, id,
@@ -407,7 +455,7 @@ public class HprofParser
 
     private int loadThreadBlock() throws IOException {
         long id = readId();
-        int threadSerialNumber = mInput.readInt();
+        int threadSerialNumber = mInput.getInt();
         ThreadObj thread = mState.getThread(threadSerialNumber);
         StackTrace stack = mState.getStackTrace(thread.mStackTrace);
         RootObj root = new RootObj(RootType.THREAD_BLOCK, id,
@@ -421,8 +469,8 @@ public class HprofParser
 
     private int loadThreadObject() throws IOException {
         long id = readId();
-        int threadSerialNumber = mInput.readInt();
-        int stackSerialNumber = mInput.readInt();
+        int threadSerialNumber = mInput.getInt();
+        int stackSerialNumber = mInput.getInt();
         ThreadObj thread = new ThreadObj(id, stackSerialNumber);
 
         mState.addThread(thread, threadSerialNumber);
@@ -432,9 +480,9 @@ public class HprofParser
 
     private int loadClassDump() throws IOException {
         int bytesRead = 0;
-        DataInputStream in = mInput;
+        ByteBuffer in = mInput;
         long id = readId();
-        int stackSerialNumber = in.readInt();
+        int stackSerialNumber = in.getInt();
         StackTrace stack = mState.getStackTrace(stackSerialNumber);
         long superClassId = readId();
         long classLoaderId = readId();
@@ -442,21 +490,21 @@ public class HprofParser
         long protectionDomainId = readId();
         long reserved1 = readId();
         long reserved2 = readId();
-        int instanceSize = in.readInt();
+        int instanceSize = in.getInt();
 
         bytesRead = (7 * mIdSize) + 4 + 4;
 
         //  Skip over the constant pool
-        int numEntries = in.readUnsignedShort();
+        int numEntries = readUnsignedShort();
         bytesRead += 2;
 
         for (int i = 0; i < numEntries; i++) {
-            in.readUnsignedShort();
+            readUnsignedShort();
             bytesRead += 2 + skipValue();
         }
 
         //  Static fields
-        numEntries = in.readUnsignedShort();
+        numEntries = readUnsignedShort();
         bytesRead += 2;
 
         String[] staticFieldNames = new String[numEntries];
@@ -467,18 +515,18 @@ public class HprofParser
         for (int i = 0; i < numEntries; i++) {
             staticFieldNames[i] = mStrings.get(readId());
 
-            int fieldType = in.readByte();
+            int fieldType = in.get();
             int fieldSize = Types.getTypeSize(fieldType);
             staticFieldTypes[i] = fieldType;
 
-            in.readFully(buffer, 0, fieldSize);
+            in.get(buffer, 0, fieldSize);
             staticFieldValues.write(buffer, 0, fieldSize);
 
             bytesRead += mIdSize + 1 + fieldSize;
         }
 
         //  Instance fields
-        numEntries = in.readUnsignedShort();
+        numEntries = readUnsignedShort();
         bytesRead += 2;
 
         String[] names = new String[numEntries];
@@ -486,7 +534,7 @@ public class HprofParser
 
         for (int i = 0; i < numEntries; i++) {
             long fieldName = readId();
-            int type = in.readUnsignedByte();
+            int type = readUnsignedByte();
 
             names[i] = mStrings.get(fieldName);
             types[i] = type;
@@ -514,10 +562,10 @@ public class HprofParser
 
     private int loadInstanceDump() throws IOException {
         long id = readId();
-        int stackId = mInput.readInt();
+        int stackId = mInput.getInt();
         StackTrace stack = mState.getStackTrace(stackId);
         long classId = readId();
-        int remaining = mInput.readInt();
+        int remaining = mInput.getInt();
         ClassInstance instance = new ClassInstance(id, stack, classId);
 
         instance.loadFieldData(mInput, remaining);
@@ -529,15 +577,15 @@ public class HprofParser
 
     private int loadObjectArrayDump() throws IOException {
         long id = readId();
-        int stackId = mInput.readInt();
+        int stackId = mInput.getInt();
         StackTrace stack = mState.getStackTrace(stackId);
-        int numElements = mInput.readInt();
+        int numElements = mInput.getInt();
         long classId = readId();
         int totalBytes = numElements * mIdSize;
         byte[] data = new byte[totalBytes];
         String className = mClassNames.get(classId);
 
-        mInput.readFully(data);
+        mInput.get(data);
 
         ArrayInstance array = new ArrayInstance(id, stack, Types.OBJECT,
             numElements, data);
@@ -551,15 +599,15 @@ public class HprofParser
 
     private int loadPrimitiveArrayDump() throws IOException {
         long id = readId();
-        int stackId = mInput.readInt();
+        int stackId = mInput.getInt();
         StackTrace stack = mState.getStackTrace(stackId);
-        int numElements = mInput.readInt();
-        int type = mInput.readUnsignedByte();
+        int numElements = mInput.getInt();
+        int type = readUnsignedByte();
         int size = Types.getTypeSize(type);
         int totalBytes = numElements * size;
         byte[] data = new byte[totalBytes];
 
-        mInput.readFully(data);
+        mInput.get(data);
 
         ArrayInstance array = new ArrayInstance(id, stack, type, numElements,
             data);
@@ -572,8 +620,8 @@ public class HprofParser
 
     private int loadJniMonitor() throws IOException {
         long id = readId();
-        int threadSerialNumber = mInput.readInt();
-        int stackDepth = mInput.readInt();
+        int threadSerialNumber = mInput.getInt();
+        int stackDepth = mInput.getInt();
         ThreadObj thread = mState.getThread(threadSerialNumber);
         StackTrace trace = mState.getStackTraceAtDepth(thread.mStackTrace,
             stackDepth);
@@ -587,7 +635,7 @@ public class HprofParser
     }
 
     private int skipValue() throws IOException {
-        int type = mInput.readUnsignedByte();
+        int type = readUnsignedByte();
         int size = Types.getTypeSize(type);
 
         skipFully(size);
@@ -595,17 +643,11 @@ public class HprofParser
         return size + 1;
     }
 
-    /*
-     * BufferedInputStream will not skip(int) the entire requested number
-     * of bytes if it extends past the current buffer boundary.  So, this
-     * routine is needed to actually skip over the requested number of bytes
-     * using as many iterations as needed.
-     */
     private void skipFully(long numBytes) throws IOException {
-        while (numBytes > 0) {
-            long skipped = mInput.skip(numBytes);
-
-            numBytes -= skipped;
+        if (numBytes > mInput.remaining()) {
+            throw new BufferUnderflowException();
         }
+
+        mInput.position(mInput.position() + (int) numBytes);
     }
 }
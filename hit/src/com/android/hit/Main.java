@@ -16,27 +16,15 @@
 
 package com.android.hit;
 
-import java.io.BufferedInputStream;
-import java.io.DataInputStream;
-import java.io.FileInputStream;
+import java.io.File;
 import java.util.Map;
 import java.util.Set;
 
 public class Main
 {
     public static void main(String argv[]) {
-        FileInputStream fis;
-        BufferedInputStream bis;
-        DataInputStream dis;
-
         try {
-            fis = new FileInputStream(argv[0]);
-            bis = new BufferedInputStream(fis);
-            dis = new DataInputStream(bis);
-
-            State state = (new HprofParser(dis)).parse();
-
-            dis.close();
+            State state = (new HprofParser(new File(argv[0]))).parse();
 
             testClassesQuery(state);
             testAllClassesQuery(state);
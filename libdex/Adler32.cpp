@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Adler-32 over 16-byte vectors.
+ *
+ * For a run of n bytes b[0..n-1], starting from sums s1 and s2:
+ *
+ *   s1' = s1 + sum(b[i])
+ *   s2' = s2 + n * s1 + sum((n - i) * b[i])
+ *
+ * so a block can be folded in with one horizontal byte sum and one dot
+ * product against the weights 16..1, plus 16 times the running s1 total
+ * of the blocks before it.  As in zlib, the sums are reduced modulo
+ * kBase once every kNmax bytes, the most that can't overflow 32 bits.
+ *
+ * Both SSE2 and NEON are part of the baseline ABI wherever this is
+ * compiled with them enabled, so the choice is made at compile time.
+ */
+
+#include "Adler32.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+# define ADLER32_SSE2
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+# include <arm_neon.h>
+# define ADLER32_NEON
+#endif
+
+static const u4 kBase = 65521;     /* largest prime smaller than 65536 */
+static const size_t kNmax = 5552;  /* 255n(n+1)/2 + (n+1)(kBase-1) < 2^32 */
+
+/*
+ * Plain byte-at-a-time loop, for the tail and for other CPUs.
+ */
+static void adler32Scalar(u4* pS1, u4* pS2, const u1* buf, size_t len)
+{
+    u4 s1 = *pS1;
+    u4 s2 = *pS2;
+
+    while (len != 0) {
+        size_t n = (len < kNmax) ? len : kNmax;
+        len -= n;
+        while (n >= 4) {
+            s1 += buf[0]; s2 += s1;
+            s1 += buf[1]; s2 += s1;
+            s1 += buf[2]; s2 += s1;
+            s1 += buf[3]; s2 += s1;
+            buf += 4;
+            n -= 4;
+        }
+        while (n-- != 0) {
+            s1 += *buf++;
+            s2 += s1;
+        }
+        s1 %= kBase;
+        s2 %= kBase;
+    }
+
+    *pS1 = s1;
+    *pS2 = s2;
+}
+
+#if defined(ADLER32_SSE2)
+/*
+ * Consume all whole 16-byte blocks; returns the number of bytes used.
+ */
+static size_t adler32Vector(u4* pS1, u4* pS2, const u1* buf, size_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weightsHi = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+    const __m128i weightsLo = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+    u4 s1 = *pS1;
+    u4 s2 = *pS2;
+    size_t done = 0;
+
+    len &= ~(size_t) 15;
+    while (len != 0) {
+        size_t n = (len < kNmax) ? len : kNmax;     /* kNmax % 16 == 0 */
+        len -= n;
+        done += n;
+        s2 += s1 * n;
+
+        __m128i vs1 = zero;     /* byte sums, in lanes 0 and 2 */
+        __m128i vs2 = zero;     /* weighted sums within each block */
+        __m128i vps = zero;     /* vs1 totals of the earlier blocks */
+        for (size_t blocks = n / 16; blocks != 0; blocks--) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*) buf);
+            vps = _mm_add_epi32(vps, vs1);
+            vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(bytes, zero));
+            vs2 = _mm_add_epi32(vs2,
+                _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weightsHi));
+            vs2 = _mm_add_epi32(vs2,
+                _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weightsLo));
+            buf += 16;
+        }
+        vs2 = _mm_add_epi32(vs2, _mm_slli_epi32(vps, 4));
+
+        vs1 = _mm_add_epi32(vs1, _mm_shuffle_epi32(vs1, _MM_SHUFFLE(1,0,3,2)));
+        vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(1,0,3,2)));
+        vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(2,3,0,1)));
+        s1 += (u4) _mm_cvtsi128_si32(vs1);
+        s2 += (u4) _mm_cvtsi128_si32(vs2);
+        s1 %= kBase;
+        s2 %= kBase;
+    }
+
+    *pS1 = s1;
+    *pS2 = s2;
+    return done;
+}
+#elif defined(ADLER32_NEON)
+static inline u4 sumLanes(uint32x4_t v)
+{
+    uint32x2_t pair = vadd_u32(vget_low_u32(v), vget_high_u32(v));
+    return vget_lane_u32(vpadd_u32(pair, pair), 0);
+}
+
+/*
+ * Consume all whole 16-byte blocks; returns the number of bytes used.
+ */
+static size_t adler32Vector(u4* pS1, u4* pS2, const u1* buf, size_t len)
+{
+    static const uint16_t kWeights[16] = {
+        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1
+    };
+    const uint16x4_t w0 = vld1_u16(&kWeights[0]);
+    const uint16x4_t w1 = vld1_u16(&kWeights[4]);
+    const uint16x4_t w2 = vld1_u16(&kWeights[8]);
+    const uint16x4_t w3 = vld1_u16(&kWeights[12]);
+    u4 s1 = *pS1;
+    u4 s2 = *pS2;
+    size_t done = 0;
+
+    len &= ~(size_t) 15;
+    while (len != 0) {
+        size_t n = (len < kNmax) ? len : kNmax;     /* kNmax % 16 == 0 */
+        len -= n;
+        done += n;
+        s2 += s1 * n;
+
+        uint32x4_t vs1 = vdupq_n_u32(0);
+        uint32x4_t vs2 = vdupq_n_u32(0);
+        uint32x4_t vps = vdupq_n_u32(0);
+        for (size_t blocks = n / 16; blocks != 0; blocks--) {
+            uint8x16_t bytes = vld1q_u8(buf);
+            vps = vaddq_u32(vps, vs1);
+            vs1 = vpadalq_u16(vs1, vpaddlq_u8(bytes));
+            uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+            uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+            vs2 = vmlal_u16(vs2, vget_low_u16(lo), w0);
+            vs2 = vmlal_u16(vs2, vget_high_u16(lo), w1);
+            vs2 = vmlal_u16(vs2, vget_low_u16(hi), w2);
+            vs2 = vmlal_u16(vs2, vget_high_u16(hi), w3);
+            buf += 16;
+        }
+        vs2 = vaddq_u32(vs2, vshlq_n_u32(vps, 4));
+
+        s1 += sumLanes(vs1);
+        s2 += sumLanes(vs2);
+        s1 %= kBase;
+        s2 %= kBase;
+    }
+
+    *pS1 = s1;
+    *pS2 = s2;
+    return done;
+}
+#endif
+
+/* (documented in header file) */
+u4 dexAdler32(u4 adler, const u1* buf, size_t len)
+{
+    u4 s1 = adler & 0xffff;
+    u4 s2 = adler >> 16;
+
+#if defined(ADLER32_SSE2) || defined(ADLER32_NEON)
+    size_t done = adler32Vector(&s1, &s2, buf, len);
+    buf += done;
+    len -= done;
+#endif
+    adler32Scalar(&s1, &s2, buf, len);
+
+    return (s2 << 16) | s1;
+}
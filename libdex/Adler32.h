@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Adler-32 checksum, as used in the DEX and opt headers.
+ */
+
+#ifndef LIBDEX_ADLER32_H_
+#define LIBDEX_ADLER32_H_
+
+#include "DexFile.h"
+
+/* the starting value for a new checksum */
+#define kDexAdler32Init 1
+
+/*
+ * Continue the checksum "adler" over "len" bytes at "buf".  Returns the
+ * same value as zlib's adler32(), but uses the vector unit where there
+ * is one, since the DEX checksum covers every byte of the file.
+ */
+u4 dexAdler32(u4 adler, const u1* buf, size_t len);
+
+#endif  // LIBDEX_ADLER32_H_
@@ -15,6 +15,7 @@
 LOCAL_PATH:= $(call my-dir)
 
 dex_src_files := \
+	Adler32.cpp \
 	CmdUtils.cpp \
 	DexCatch.cpp \
 	DexClass.cpp \
@@ -91,6 +91,19 @@ bool dexReadAndVerifyClassDataMethod(const u1** pData, const u1* pLimit,
     return true;
 }
 
+/* Helper for dexReadAndVerifyClassData(), which turns the index deltas
+ * of a list of "count" decoded items, each "width" words wide, into
+ * indices. */
+static void applyIndexDeltas(u4* item, u4 count, u4 width) {
+    u4 lastIndex = 0;
+
+    while (count-- != 0) {
+        lastIndex += item[0];
+        item[0] = lastIndex;
+        item += width;
+    }
+}
+
 /* Read, verify, and return an entire class_data_item. This updates
  * the given data pointer to point past the end of the read data. This
  * function allocates a single chunk of memory for the result, which
@@ -103,7 +116,6 @@ bool dexReadAndVerifyClassDataMethod(const u1** pData, const u1* pLimit,
  * are valid. */
 DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit) {
     DexClassDataHeader header;
-    u4 lastIndex;
 
     if (*pData == NULL) {
         DexClassData* result = (DexClassData*) malloc(sizeof(DexClassData));
@@ -123,8 +135,6 @@ DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit) {
 
     DexClassData* result = (DexClassData*) malloc(resultSize);
     u1* ptr = ((u1*) result) + sizeof(DexClassData);
-    bool okay = true;
-    u4 i;
 
     if (result == NULL) {
         return NULL;
@@ -159,34 +169,42 @@ DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit) {
         result->virtualMethods = NULL;
     }
 
-    lastIndex = 0;
-    for (i = 0; okay && (i < header.staticFieldsSize); i++) {
-        okay = dexReadAndVerifyClassDataField(pData, pLimit,
-                &result->staticFields[i], &lastIndex);
-    }
-
-    lastIndex = 0;
-    for (i = 0; okay && (i < header.instanceFieldsSize); i++) {
-        okay = dexReadAndVerifyClassDataField(pData, pLimit,
-                &result->instanceFields[i], &lastIndex);
-    }
-
-    lastIndex = 0;
-    for (i = 0; okay && (i < header.directMethodsSize); i++) {
-        okay = dexReadAndVerifyClassDataMethod(pData, pLimit,
-                &result->directMethods[i], &lastIndex);
-    }
-
-    lastIndex = 0;
-    for (i = 0; okay && (i < header.virtualMethodsSize); i++) {
-        okay = dexReadAndVerifyClassDataMethod(pData, pLimit,
-                &result->virtualMethods[i], &lastIndex);
-    }
-
-    if (! okay) {
+    /*
+     * The encoded fields and methods are runs of uleb128s in the same
+     * order as the members of DexField and DexMethod, which are all u4,
+     * and the four lists sit back to back in the result. So decode them
+     * all in one go straight into place, then turn the index deltas
+     * into indices.
+     */
+    u4 fieldWidth = sizeof(DexField) / sizeof(u4);
+    u4 methodWidth = sizeof(DexMethod) / sizeof(u4);
+    u4* items = (u4*) (((u1*) result) + sizeof(DexClassData));
+    u4 count =
+        (header.staticFieldsSize + header.instanceFieldsSize) * fieldWidth +
+        (header.directMethodsSize + header.virtualMethodsSize) * methodWidth;
+
+    if (! readAndVerifyUnsignedLeb128Array(pData, pLimit, items, count)) {
         free(result);
         return NULL;
     }
 
+    applyIndexDeltas((u4*) result->staticFields,
+            header.staticFieldsSize, fieldWidth);
+    applyIndexDeltas((u4*) result->instanceFields,
+            header.instanceFieldsSize, fieldWidth);
+    applyIndexDeltas((u4*) result->directMethods,
+            header.directMethodsSize, methodWidth);
+    applyIndexDeltas((u4*) result->virtualMethods,
+            header.virtualMethodsSize, methodWidth);
+
     return result;
 }
+
+/* (documented in header file) */
+DexClassData* dexReadClassData(const DexFile* pDexFile,
+        const DexClassDef* pClassDef) {
+    const u1* pData = dexGetClassData(pDexFile, pClassDef);
+    const u1* pLimit = pDexFile->baseAddr + pDexFile->pHeader->fileSize;
+
+    return dexReadAndVerifyClassData(&pData, pLimit);
+}
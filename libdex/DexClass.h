@@ -102,6 +102,12 @@ bool dexReadAndVerifyClassDataMethod(const u1** pData, const u1* pLimit,
  * are valid. */
 DexClassData* dexReadAndVerifyClassData(const u1** pData, const u1* pLimit);
 
+/* Read, verify, and return the class_data_item of the given class, as
+ * dexReadAndVerifyClassData() does, using the end of the DEX data as the
+ * limit. The result must be free()d. */
+DexClassData* dexReadClassData(const DexFile* pDexFile,
+        const DexClassDef* pClassDef);
+
 /*
  * Get the DexCode for a DexMethod.  Returns NULL if the class is native
  * or abstract.
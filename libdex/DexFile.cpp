@@ -18,6 +18,7 @@
  * Access the contents of a .dex file.
  */
 
+#include "Adler32.h"
 #include "DexFile.h"
 #include "DexOptData.h"
 #include "DexProto.h"
@@ -26,8 +27,6 @@
 #include "sha1.h"
 #include "ZipArchive.h"
 
-#include <zlib.h>
-
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
@@ -170,6 +169,12 @@ static u4 classDescriptorHash(const char* str)
     return hash;
 }
 
+/* (documented in header) */
+u4 dexComputeClassDescriptorHash(const char* descriptor)
+{
+    return classDescriptorHash(descriptor);
+}
+
 /*
  * Add an entry to the class lookup table.  We hash the string and probe
  * until we find an open slot.
@@ -261,6 +266,255 @@ DexClassLookup* dexCreateClassLookup(DexFile* pDexFile)
     return pLookup;
 }
 
+/*
+ * Perfect hash support.  The descriptor hash is a simple "times 31" sum,
+ * so it is run through a finalizer before being reduced to a bucket or
+ * slot index.  Reduction uses a multiply and shift instead of a modulus.
+ */
+#define kClassHashBucketLoad    4       /* average keys per bucket */
+#define kClassHashMaxSeed       0xffff
+#define kClassHashSeedMult      0x9e3779b9
+
+static inline u4 classHashMix(u4 h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline u4 classHashReduce(u4 h, u4 n)
+{
+    return (u4) (((u8) h * n) >> 32);
+}
+
+static inline u4 classHashBucket(const DexClassPerfectHash* pHash, u4 hash)
+{
+    return classHashReduce(classHashMix(hash), pHash->numBuckets);
+}
+
+static inline u4 classHashSlot(u4 numEntries, u4 hash, u4 seed)
+{
+    return classHashReduce(classHashMix(hash ^ ((seed + 1) * kClassHashSeedMult)),
+        numEntries);
+}
+
+static inline const DexClassHashEntry* classHashEntries(
+    const DexClassPerfectHash* pHash)
+{
+    return (const DexClassHashEntry*) ((const u1*) pHash + pHash->entriesOff);
+}
+
+/*
+ * Create the perfect hash table, using "hash and displace": keys are
+ * split into buckets, and the buckets are placed largest first, each one
+ * trying seeds until all of its keys land in free slots.  The table is
+ * kept at ~97% occupancy so the last few buckets don't need an
+ * exhaustive seed search.
+ */
+DexClassPerfectHash* dexCreateClassPerfectHash(const DexFile* pDexFile)
+{
+    u4 numClasses = pDexFile->pHeader->classDefsSize;
+    if (numClasses == 0)
+        return NULL;
+
+    u4 numBuckets = (numClasses + kClassHashBucketLoad - 1) /
+                    kClassHashBucketLoad;
+    u4 numEntries = numClasses + numClasses / 32 + 1;
+    u4 entriesOff = (offsetof(DexClassPerfectHash, seeds)
+                    + numBuckets * sizeof(u2) + 3) & ~3;
+    u4 allocSize = entriesOff + numEntries * sizeof(DexClassHashEntry);
+
+    DexClassPerfectHash* pHash = (DexClassPerfectHash*) calloc(1, allocSize);
+    u4* hashes = (u4*) malloc(numClasses * sizeof(u4));
+    u4* bucketStart = (u4*) calloc(numBuckets + 1, sizeof(u4));
+    u4* members = (u4*) malloc(numClasses * sizeof(u4));
+    u4* order = (u4*) malloc(numBuckets * sizeof(u4));
+    u1* taken = (u1*) calloc(numEntries, 1);
+    u4 slots[64];
+    u4 maxBucket = 0;
+    u4 maxSeed = 0;
+    bool ok = false;
+
+    if (pHash == NULL || hashes == NULL || bucketStart == NULL ||
+        members == NULL || order == NULL || taken == NULL)
+    {
+        goto bail;
+    }
+    pHash->size = allocSize;
+    pHash->numBuckets = numBuckets;
+    pHash->numEntries = numEntries;
+    pHash->entriesOff = entriesOff;
+
+    /* group the classes by bucket (counting sort) */
+    for (u4 i = 0; i < numClasses; i++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+        hashes[i] = classDescriptorHash(
+            dexStringByTypeIdx(pDexFile, pClassDef->classIdx));
+        bucketStart[classHashBucket(pHash, hashes[i]) + 1]++;
+    }
+    for (u4 b = 0; b < numBuckets; b++) {
+        u4 count = bucketStart[b + 1];
+        if (count > maxBucket)
+            maxBucket = count;
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    if (maxBucket > sizeof(slots) / sizeof(slots[0]))
+        goto bail;
+    {
+        u4* fill = (u4*) calloc(numBuckets, sizeof(u4));
+        if (fill == NULL)
+            goto bail;
+        for (u4 i = 0; i < numClasses; i++) {
+            u4 b = classHashBucket(pHash, hashes[i]);
+            members[bucketStart[b] + fill[b]++] = i;
+        }
+        free(fill);
+    }
+
+    /* order the buckets largest first */
+    {
+        u4 n = 0;
+        for (u4 size = maxBucket; size > 0; size--) {
+            for (u4 b = 0; b < numBuckets; b++) {
+                if (bucketStart[b + 1] - bucketStart[b] == size)
+                    order[n++] = b;
+            }
+        }
+        numBuckets = n;     /* empty buckets keep seed 0 */
+    }
+
+    for (u4 o = 0; o < numBuckets; o++) {
+        u4 b = order[o];
+        u4 first = bucketStart[b];
+        u4 count = bucketStart[b + 1] - first;
+        u4 seed;
+
+        for (seed = 0; seed <= kClassHashMaxSeed; seed++) {
+            u4 k;
+            for (k = 0; k < count; k++) {
+                u4 slot = classHashSlot(numEntries, hashes[members[first + k]],
+                    seed);
+                if (taken[slot])
+                    break;
+                u4 j;
+                for (j = 0; j < k; j++) {
+                    if (slots[j] == slot)
+                        break;
+                }
+                if (j != k)
+                    break;
+                slots[k] = slot;
+            }
+            if (k == count)
+                break;
+        }
+        if (seed > kClassHashMaxSeed) {
+            ALOGW("Class perfect hash: no seed for bucket of %u", count);
+            goto bail;
+        }
+        if (seed > maxSeed)
+            maxSeed = seed;
+
+        pHash->seeds[b] = (u2) seed;
+        for (u4 k = 0; k < count; k++) {
+            u4 idx = members[first + k];
+            const DexClassDef* pClassDef = dexGetClassDef(pDexFile, idx);
+            const char* pString =
+                dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
+            DexClassHashEntry* pEntry = (DexClassHashEntry*)
+                classHashEntries(pHash) + slots[k];
+
+            taken[slots[k]] = 1;
+            pEntry->classDescriptorHash = hashes[idx];
+            pEntry->classDescriptorOffset =
+                (const u1*) pString - pDexFile->baseAddr;
+            pEntry->classDefOffset =
+                (const u1*) pClassDef - pDexFile->baseAddr;
+        }
+    }
+
+    ALOGV("Class perfect hash: classes=%u buckets=%u slots=%u alloc=%u"
+         " maxBucket=%u maxSeed=%u",
+        numClasses, pHash->numBuckets, numEntries, allocSize,
+        maxBucket, maxSeed);
+    ok = true;
+
+bail:
+    free(hashes);
+    free(bucketStart);
+    free(members);
+    free(order);
+    free(taken);
+    if (!ok) {
+        free(pHash);
+        pHash = NULL;
+    }
+    return pHash;
+}
+
+/* (documented in header) */
+bool dexClassPerfectHashIsValid(const DexClassPerfectHash* pHash, u4 size)
+{
+    if (size < sizeof(DexClassPerfectHash) || (u4) pHash->size != size)
+        return false;
+    if (pHash->numBuckets == 0 || pHash->numEntries == 0)
+        return false;
+    if (pHash->entriesOff < offsetof(DexClassPerfectHash, seeds)
+            + pHash->numBuckets * sizeof(u2) ||
+        (pHash->entriesOff & 3) != 0)
+    {
+        return false;
+    }
+    return pHash->entriesOff +
+        (u8) pHash->numEntries * sizeof(DexClassHashEntry) <= size;
+}
+
+/* (documented in header) */
+u4 dexStringLiteralsSize(u4 count, u4 charsCount)
+{
+    return offsetof(DexStringLiterals, entries) +
+        count * sizeof(DexStringLiteral) + charsCount * sizeof(u2);
+}
+
+/* (documented in header) */
+bool dexStringLiteralsIsValid(const DexStringLiterals* pLiterals, u4 size)
+{
+    if (size < offsetof(DexStringLiterals, entries))
+        return false;
+    return (u8) offsetof(DexStringLiterals, entries) +
+        (u8) pLiterals->count * sizeof(DexStringLiteral) +
+        (u8) pLiterals->charsCount * sizeof(u2) <= size;
+}
+
+/* (documented in header) */
+const DexStringLiteral* dexFindStringLiteral(const DexFile* pDexFile,
+    u4 stringIdx, const u2** pChars)
+{
+    const DexStringLiterals* pLiterals = pDexFile->pStringLiterals;
+    if (pLiterals == NULL)
+        return NULL;
+
+    int lo = 0;
+    int hi = (int) pLiterals->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        const DexStringLiteral* pEntry = &pLiterals->entries[mid];
+        if (pEntry->stringIdx < stringIdx) {
+            lo = mid + 1;
+        } else if (pEntry->stringIdx > stringIdx) {
+            hi = mid - 1;
+        } else {
+            if ((u8) pEntry->charsOff + pEntry->length > pLiterals->charsCount)
+                return NULL;
+            *pChars = dexStringLiteralChars(pLiterals) + pEntry->charsOff;
+            return pEntry;
+        }
+    }
+    return NULL;
+}
 
 /*
  * Set up the basic raw data pointers of a DexFile. This function isn't
@@ -344,19 +598,29 @@ DexFile* dexFileParse(const u1* data, size_t length, int flags)
      * Verify the checksum(s).  This is reasonably quick, but does require
      * touching every byte in the DEX file.  The base checksum changes after
      * byte-swapping and DEX optimization.
+     *
+     * The DEX checksum of an optimized file was computed by dexopt after
+     * it verified the data, so a caller that trusts the file's origin
+     * can check just the (much smaller) deps and opt data.
      */
     if (flags & kDexParseVerifyChecksum) {
-        u4 adler = dexComputeChecksum(pHeader);
-        if (adler != pHeader->checksum) {
-            ALOGE("ERROR: bad checksum (%08x vs %08x)",
-                adler, pHeader->checksum);
-            if (!(flags & kDexParseContinueOnError))
-                goto bail;
+        const DexOptHeader* pOptHeader = pDexFile->pOptHeader;
+        u4 adler;
+
+        if (pOptHeader != NULL && (flags & kDexParseTrustOptimized)) {
+            ALOGV("+++ adler32 checksum of optimized DEX skipped");
         } else {
-            ALOGV("+++ adler32 checksum (%08x) verified", adler);
+            adler = dexComputeChecksum(pHeader);
+            if (adler != pHeader->checksum) {
+                ALOGE("ERROR: bad checksum (%08x vs %08x)",
+                    adler, pHeader->checksum);
+                if (!(flags & kDexParseContinueOnError))
+                    goto bail;
+            } else {
+                ALOGV("+++ adler32 checksum (%08x) verified", adler);
+            }
         }
 
-        const DexOptHeader* pOptHeader = pDexFile->pOptHeader;
         if (pOptHeader != NULL) {
             adler = dexComputeOptChecksum(pOptHeader);
             if (adler != pOptHeader->checksum) {
@@ -441,11 +705,34 @@ void dexFileFree(DexFile* pDexFile)
 const DexClassDef* dexFindClass(const DexFile* pDexFile,
     const char* descriptor)
 {
+    return dexFindClassWithHash(pDexFile, descriptor,
+        classDescriptorHash(descriptor));
+}
+
+/* (documented in header) */
+const DexClassDef* dexFindClassWithHash(const DexFile* pDexFile,
+    const char* descriptor, u4 hash)
+{
+    const DexClassPerfectHash* pHash = pDexFile->pClassPerfectHash;
+    if (pHash != NULL) {
+        u4 seed = pHash->seeds[classHashBucket(pHash, hash)];
+        const DexClassHashEntry* pEntry = classHashEntries(pHash)
+            + classHashSlot(pHash->numEntries, hash, seed);
+        int offset = pEntry->classDescriptorOffset;
+
+        if (offset != 0 && pEntry->classDescriptorHash == hash &&
+            strcmp((const char*) (pDexFile->baseAddr + offset),
+                descriptor) == 0)
+        {
+            return (const DexClassDef*)
+                (pDexFile->baseAddr + pEntry->classDefOffset);
+        }
+        return NULL;
+    }
+
     const DexClassLookup* pLookup = pDexFile->pClassLookup;
-    u4 hash;
     int idx, mask;
 
-    hash = classDescriptorHash(descriptor);
     mask = pLookup->numEntries - 1;
     idx = hash & mask;
 
@@ -481,10 +768,10 @@ u4 dexComputeChecksum(const DexHeader* pHeader)
 {
     const u1* start = (const u1*) pHeader;
 
-    uLong adler = adler32(0L, Z_NULL, 0);
     const int nonSum = sizeof(pHeader->magic) + sizeof(pHeader->checksum);
 
-    return (u4) adler32(adler, start + nonSum, pHeader->fileSize - nonSum);
+    return dexAdler32(kDexAdler32Init, start + nonSum,
+        pHeader->fileSize - nonSum);
 }
 
 /*
@@ -189,6 +189,10 @@ enum {
 enum {
     kDexChunkClassLookup            = 0x434c4b50,   /* CLKP */
     kDexChunkRegisterMaps           = 0x524d4150,   /* RMAP */
+    kDexChunkClassPerfectHash       = 0x43504846,   /* CPHF */
+    kDexChunkTypeIdHashes           = 0x54484153,   /* THAS */
+    kDexChunkResolveProfile         = 0x52534c56,   /* RSLV */
+    kDexChunkStringLiterals         = 0x5354524c,   /* STRL */
 
     kDexChunkEnd                    = 0x41454e44,   /* AEND */
 };
@@ -463,6 +467,53 @@ struct DexClassLookup {
     } table[1];
 };
 
+/*
+ * Minimal-ish perfect hash over the class descriptors, built by dexopt and
+ * stored next to the DexClassLookup table.  A descriptor hash picks a
+ * bucket, the bucket's seed picks exactly one slot, and only that slot has
+ * to be checked, so lookups never probe.
+ *
+ * The table is laid out as this header and seeds[numBuckets], followed
+ * (at "entriesOff" bytes from the start of the struct, 4-byte aligned) by
+ * numEntries DexClassHashEntry structs.  Unused slots have a zero
+ * classDescriptorOffset.
+ *
+ * Older VMs skip the chunk and keep using DexClassLookup.
+ */
+struct DexClassHashEntry {
+    u4      classDescriptorHash;        // class descriptor hash code
+    int     classDescriptorOffset;      // in bytes, from start of DEX
+    int     classDefOffset;             // in bytes, from start of DEX
+};
+
+struct DexClassPerfectHash {
+    int     size;                       // total size, including "size"
+    u4      numBuckets;                 // size of seeds[]
+    u4      numEntries;                 // number of DexClassHashEntry slots
+    u4      entriesOff;                 // in bytes, from start of struct
+    u2      seeds[1];
+};
+
+/*
+ * The UTF-16 contents and String.hashCode() of every string that a
+ * const-string instruction loads, so the VM can create the String objects
+ * without decoding MUTF-8 or hashing.  Entries are sorted by string
+ * index.  The chars of an entry start "charsOff" code units past the end
+ * of entries[count].
+ */
+struct DexStringLiteral {
+    u4      stringIdx;
+    u4      hash;                       // String.hashCode() of the chars
+    u4      charsOff;                   // in code units
+    u4      length;                     // in code units
+};
+
+struct DexStringLiterals {
+    u4      count;                      // number of entries
+    u4      charsCount;                 // code units following entries[]
+    DexStringLiteral entries[1];
+};
+
 /*
  * Header added by DEX optimization pass.  Values are always written in
  * local byte and structure padding.  The first field (magic + version)
@@ -491,6 +542,10 @@ struct DexOptHeader {
 
 #define DEX_INTERFACE_CACHE_SIZE    128     /* must be power of 2 */
 
+/* bounds for the per-call-site interface cache, sized by method count */
+#define DEX_INTERFACE_SITE_CACHE_MIN    128
+#define DEX_INTERFACE_SITE_CACHE_MAX    2048
+
 /*
  * Structure representing a DEX file.
  *
@@ -516,6 +571,11 @@ struct DexFile {
      * included in the file.
      */
     const DexClassLookup* pClassLookup;
+    const DexClassPerfectHash* pClassPerfectHash;
+    const u4*           pTypeIdHashes;          // [typeIdsSize], VM hash
+    const u4*           pResolveProfile;        // type IDs to pre-resolve
+    u4                  resolveProfileCount;
+    const DexStringLiterals* pStringLiterals;
     const void*         pRegisterMapPool;       // RegisterMapClassPool
 
     /* points to start of DEX file data */
@@ -545,6 +605,7 @@ enum {
     kDexParseDefault            = 0,
     kDexParseVerifyChecksum     = 1,
     kDexParseContinueOnError    = (1 << 1),
+    kDexParseTrustOptimized     = (1 << 2), /* don't checksum DEX in odex */
 };
 
 /*
@@ -588,11 +649,63 @@ void dexFileFree(DexFile* pDexFile);
  */
 DexClassLookup* dexCreateClassLookup(DexFile* pDexFile);
 
+/*
+ * Create the perfect hash for the class descriptors.  Returns NULL if
+ * no perfect hash could be found (e.g. two descriptors share a hash
+ * code), in which case lookups fall back to DexClassLookup.
+ *
+ * Returns newly-allocated storage.
+ */
+DexClassPerfectHash* dexCreateClassPerfectHash(const DexFile* pDexFile);
+
+/*
+ * Sanity-check a perfect hash table mapped out of the opt data.
+ */
+bool dexClassPerfectHashIsValid(const DexClassPerfectHash* pHash, u4 size);
+
+/*
+ * Size in bytes of a DexStringLiterals with "count" entries holding
+ * "charsCount" code units.
+ */
+u4 dexStringLiteralsSize(u4 count, u4 charsCount);
+
+/*
+ * Get the code units that the entries' "charsOff" values index.
+ */
+DEX_INLINE const u2* dexStringLiteralChars(const DexStringLiterals* pLiterals) {
+    return (const u2*) &pLiterals->entries[pLiterals->count];
+}
+
+/*
+ * Sanity-check the string literals mapped out of the opt data.  Only the
+ * header is checked; dexFindStringLiteral() checks the entry it returns.
+ */
+bool dexStringLiteralsIsValid(const DexStringLiterals* pLiterals, u4 size);
+
+/*
+ * Find the precomputed literal for a string index.  Returns NULL if the
+ * file has none for it.  On success "*pChars" points at its contents.
+ */
+const DexStringLiteral* dexFindStringLiteral(const DexFile* pDexFile,
+    u4 stringIdx, const u2** pChars);
+
+/*
+ * Compute the hash code used in the class lookup table for a descriptor.
+ */
+u4 dexComputeClassDescriptorHash(const char* descriptor);
+
 /*
  * Find a class definition by descriptor.
  */
 const DexClassDef* dexFindClass(const DexFile* pFile, const char* descriptor);
 
+/*
+ * Like dexFindClass(), but with the descriptor's hash already computed by
+ * dexComputeClassDescriptorHash().  Handy when searching several files.
+ */
+const DexClassDef* dexFindClassWithHash(const DexFile* pFile,
+    const char* descriptor, u4 hash);
+
 /*
  * Set up the basic raw data pointers of a DexFile. This function isn't
  * meant for general use.
@@ -651,6 +764,18 @@ DEX_INLINE const char* dexStringByTypeIdx(const DexFile* pDexFile, u4 idx) {
     return dexStringById(pDexFile, typeId->descriptorIdx);
 }
 
+/*
+ * Get the precomputed VM hash of the descriptor of a given type index,
+ * if dexopt stored one.  Returns false if the file has no type hashes.
+ */
+DEX_INLINE bool dexGetTypeIdHash(const DexFile* pDexFile, u4 idx, u4* pHash) {
+    if (pDexFile->pTypeIdHashes == NULL)
+        return false;
+    assert(idx < pDexFile->pHeader->typeIdsSize);
+    *pHash = pDexFile->pTypeIdHashes[idx];
+    return true;
+}
+
 /* return the MethodId with the specified index */
 DEX_INLINE const DexMethodId* dexGetMethodId(const DexFile* pDexFile, u4 idx) {
     assert(idx < pDexFile->pHeader->methodIdsSize);
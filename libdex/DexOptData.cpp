@@ -19,8 +19,7 @@
  * to optimized .dex files.
  */
 
-#include <zlib.h>
-
+#include "Adler32.h"
 #include "DexOptData.h"
 
 /*
@@ -40,9 +39,7 @@ u4 dexComputeOptChecksum(const DexOptHeader* pOptHeader)
     const u1* end = (const u1*) pOptHeader +
         pOptHeader->optOffset + pOptHeader->optLength;
 
-    uLong adler = adler32(0L, Z_NULL, 0);
-
-    return (u4) adler32(adler, start, end - start);
+    return dexAdler32(kDexAdler32Init, start, end - start);
 }
 
 /* (documented in header file) */
@@ -108,6 +105,38 @@ bool dexParseOptData(const u1* data, size_t length, DexFile* pDexFile)
         case kDexChunkClassLookup:
             pDexFile->pClassLookup = (const DexClassLookup*) pOptData;
             break;
+        case kDexChunkClassPerfectHash:
+            if (dexClassPerfectHashIsValid(
+                    (const DexClassPerfectHash*) pOptData, size))
+            {
+                pDexFile->pClassPerfectHash =
+                    (const DexClassPerfectHash*) pOptData;
+            } else {
+                ALOGW("Ignoring malformed class perfect hash, size=%u", size);
+            }
+            break;
+        case kDexChunkTypeIdHashes:
+            /* one u4 per type ID, as computed by the VM's UTF-8 hash */
+            if (size == pDexFile->pHeader->typeIdsSize * sizeof(u4)) {
+                pDexFile->pTypeIdHashes = (const u4*) pOptData;
+            } else {
+                ALOGW("Ignoring type ID hashes, size=%u", size);
+            }
+            break;
+        case kDexChunkResolveProfile:
+            pDexFile->pResolveProfile = (const u4*) pOptData;
+            pDexFile->resolveProfileCount = size / sizeof(u4);
+            break;
+        case kDexChunkStringLiterals:
+            if (dexStringLiteralsIsValid(
+                    (const DexStringLiterals*) pOptData, size))
+            {
+                pDexFile->pStringLiterals =
+                    (const DexStringLiterals*) pOptData;
+            } else {
+                ALOGW("Ignoring malformed string literals, size=%u", size);
+            }
+            break;
         case kDexChunkRegisterMaps:
             ALOGV("+++ found register maps, size=%u", size);
             pDexFile->pRegisterMapPool = pOptData;
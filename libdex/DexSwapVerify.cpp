@@ -18,6 +18,7 @@
  * Byte-swapping and verification of dex files.
  */
 
+#include "Adler32.h"
 #include "DexFile.h"
 #include "DexClass.h"
 #include "DexDataMap.h"
@@ -26,10 +27,13 @@
 #include "Leb128.h"
 
 #include <safe_iop.h>
-#include <zlib.h>
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 #ifndef __BYTE_ORDER
 # error "byte ordering not defined"
@@ -929,7 +933,8 @@ static bool verifyClassDataIsForDef(const CheckState* state, u4 offset,
     }
 
     const u1* data = (const u1*) filePointer(state, offset);
-    DexClassData* classData = dexReadAndVerifyClassData(&data, NULL);
+    DexClassData* classData = dexReadAndVerifyClassData(&data,
+            state->fileEnd);
 
     if (classData == NULL) {
         // Shouldn't happen, but bail here just in case.
@@ -1870,6 +1875,23 @@ static void* intraVerifyStringDataItem(const CheckState* state, void* ptr) {
     }
 
     for (i = 0; i < utf16Size; i++) {
+        /*
+         * Step over plain ASCII a block at a time.  Each such byte is one
+         * UTF-16 unit, so don't look past the declared length.
+         */
+        if (utf16Size - i >= kDexUtfBlockLen) {
+            size_t limit = utf16Size - i;
+            if ((size_t) (fileEnd - data) < limit) {
+                limit = fileEnd - data;
+            }
+            size_t ascii = dexUtf8AsciiSpan((const char*) data, limit);
+            data += ascii;
+            i += ascii;
+            if (i == utf16Size) {
+                break;
+            }
+        }
+
         if (data >= fileEnd) {
             ALOGE("String data would go beyond end-of-file");
             return NULL;
@@ -2680,101 +2702,210 @@ static bool swapEverythingButHeaderAndMap(CheckState* state,
 }
 
 /*
- * Perform cross-item verification on everything that needs it. This
- * pass is only called after all items are byte-swapped and
- * intra-verified (checked for internal consistency).
+ * Perform cross-item verification on one section of the map.  This only
+ * reads the file, the data map and the DexFile, and the only state it
+ * changes is in "state", so different sections can be verified at the
+ * same time as long as each has its own CheckState.
  */
-static bool crossVerifyEverything(CheckState* state, DexMapList* pMap)
+static bool crossVerifySection(CheckState* state, const DexMapItem* item)
 {
-    const DexMapItem* item = pMap->list;
-    u4 count = pMap->size;
+    u4 sectionOffset = item->offset;
+    u4 sectionCount = item->size;
     bool okay = true;
 
-    while (okay && count--) {
-        u4 sectionOffset = item->offset;
-        u4 sectionCount = item->size;
+    switch (item->type) {
+        case kDexTypeHeaderItem:
+        case kDexTypeMapList:
+        case kDexTypeTypeList:
+        case kDexTypeCodeItem:
+        case kDexTypeStringDataItem:
+        case kDexTypeDebugInfoItem:
+        case kDexTypeAnnotationItem:
+        case kDexTypeEncodedArrayItem: {
+            // There is no need for cross-item verification for these.
+            break;
+        }
+        case kDexTypeStringIdItem: {
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyStringIdItem, sizeof(u4), NULL);
+            break;
+        }
+        case kDexTypeTypeIdItem: {
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyTypeIdItem, sizeof(u4), NULL);
+            break;
+        }
+        case kDexTypeProtoIdItem: {
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyProtoIdItem, sizeof(u4), NULL);
+            break;
+        }
+        case kDexTypeFieldIdItem: {
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyFieldIdItem, sizeof(u4), NULL);
+            break;
+        }
+        case kDexTypeMethodIdItem: {
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyMethodIdItem, sizeof(u4), NULL);
+            break;
+        }
+        case kDexTypeClassDefItem: {
+            // Allocate (on the stack) the "observed class_def" bits.
+            size_t arraySize = calcDefinedClassBitsSize(state);
+            u4 definedClassBits[arraySize];
+            memset(definedClassBits, 0, arraySize * sizeof(u4));
+            state->pDefinedClassBits = definedClassBits;
 
-        switch (item->type) {
-            case kDexTypeHeaderItem:
-            case kDexTypeMapList:
-            case kDexTypeTypeList:
-            case kDexTypeCodeItem:
-            case kDexTypeStringDataItem:
-            case kDexTypeDebugInfoItem:
-            case kDexTypeAnnotationItem:
-            case kDexTypeEncodedArrayItem: {
-                // There is no need for cross-item verification for these.
-                break;
-            }
-            case kDexTypeStringIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyStringIdItem, sizeof(u4), NULL);
-                break;
-            }
-            case kDexTypeTypeIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyTypeIdItem, sizeof(u4), NULL);
-                break;
-            }
-            case kDexTypeProtoIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyProtoIdItem, sizeof(u4), NULL);
-                break;
-            }
-            case kDexTypeFieldIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyFieldIdItem, sizeof(u4), NULL);
-                break;
-            }
-            case kDexTypeMethodIdItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyMethodIdItem, sizeof(u4), NULL);
-                break;
-            }
-            case kDexTypeClassDefItem: {
-                // Allocate (on the stack) the "observed class_def" bits.
-                size_t arraySize = calcDefinedClassBitsSize(state);
-                u4 definedClassBits[arraySize];
-                memset(definedClassBits, 0, arraySize * sizeof(u4));
-                state->pDefinedClassBits = definedClassBits;
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyClassDefItem, sizeof(u4), NULL);
 
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyClassDefItem, sizeof(u4), NULL);
+            state->pDefinedClassBits = NULL;
+            break;
+        }
+        case kDexTypeAnnotationSetRefList: {
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyAnnotationSetRefList, sizeof(u4), NULL);
+            break;
+        }
+        case kDexTypeAnnotationSetItem: {
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyAnnotationSetItem, sizeof(u4), NULL);
+            break;
+        }
+        case kDexTypeClassDataItem: {
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyClassDataItem, sizeof(u1), NULL);
+            break;
+        }
+        case kDexTypeAnnotationsDirectoryItem: {
+            okay = iterateSection(state, sectionOffset, sectionCount,
+                    crossVerifyAnnotationsDirectoryItem, sizeof(u4), NULL);
+            break;
+        }
+        default: {
+            ALOGE("Unknown map item type %04x", item->type);
+            return false;
+        }
+    }
 
-                state->pDefinedClassBits = NULL;
-                break;
-            }
-            case kDexTypeAnnotationSetRefList: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyAnnotationSetRefList, sizeof(u4), NULL);
-                break;
-            }
-            case kDexTypeAnnotationSetItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyAnnotationSetItem, sizeof(u4), NULL);
-                break;
-            }
-            case kDexTypeClassDataItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyClassDataItem, sizeof(u1), NULL);
-                break;
-            }
-            case kDexTypeAnnotationsDirectoryItem: {
-                okay = iterateSection(state, sectionOffset, sectionCount,
-                        crossVerifyAnnotationsDirectoryItem, sizeof(u4), NULL);
-                break;
-            }
-            default: {
-                ALOGE("Unknown map item type %04x", item->type);
-                return false;
-            }
+    if (!okay) {
+        ALOGE("Cross-item verify of section type %04x failed",
+                item->type);
+    }
+
+    return okay;
+}
+
+#ifdef HAVE_PTHREADS
+/*
+ * Files smaller than this are cross-verified on the calling thread;
+ * starting threads would cost more than it saves.
+ */
+#define kParallelVerifyMinFileLen (2 * 1024 * 1024)
+
+/* most threads to cross-verify with, counting the caller */
+#define kMaxVerifyThreads 4
+
+/*
+ * Work shared by the cross-verification threads.  Each thread takes the
+ * next unclaimed section of the map until none are left.
+ */
+struct CrossVerifyWork {
+    const CheckState* state;        // template; each thread copies it
+    const DexMapItem* items;
+    u4 count;
+    pthread_mutex_t lock;
+    u4 next;                        // guarded by lock
+    bool okay;                      // guarded by lock
+};
+
+static void* crossVerifyThreadStart(void* arg)
+{
+    CrossVerifyWork* work = (CrossVerifyWork*) arg;
+    CheckState state = *work->state;
+
+    while (true) {
+        pthread_mutex_lock(&work->lock);
+        bool stop = !work->okay || work->next == work->count;
+        u4 idx = work->next++;
+        pthread_mutex_unlock(&work->lock);
+        if (stop) {
+            break;
         }
 
-        if (!okay) {
-            ALOGE("Cross-item verify of section type %04x failed",
-                    item->type);
+        if (!crossVerifySection(&state, &work->items[idx])) {
+            pthread_mutex_lock(&work->lock);
+            work->okay = false;
+            pthread_mutex_unlock(&work->lock);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Cross-verify the sections of a big file on several threads.  Returns
+ * false if verification failed.
+ */
+static bool crossVerifyParallel(CheckState* state, DexMapList* pMap,
+        int numThreads)
+{
+    CrossVerifyWork work;
+    pthread_t threads[kMaxVerifyThreads];
+    int started;
+
+    work.state = state;
+    work.items = pMap->list;
+    work.count = pMap->size;
+    work.next = 0;
+    work.okay = true;
+    pthread_mutex_init(&work.lock, NULL);
+
+    /* the caller is one of the threads */
+    for (started = 0; started < numThreads - 1; started++) {
+        if (pthread_create(&threads[started], NULL, crossVerifyThreadStart,
+                    &work) != 0) {
+            break;
+        }
+    }
+    crossVerifyThreadStart(&work);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&work.lock);
+    return work.okay;
+}
+#endif
+
+/*
+ * Perform cross-item verification on everything that needs it. This
+ * pass is only called after all items are byte-swapped and
+ * intra-verified (checked for internal consistency).
+ *
+ * The sections don't depend on each other at this point, so for big
+ * files they are shared out among a few threads.
+ */
+static bool crossVerifyEverything(CheckState* state, DexMapList* pMap)
+{
+#ifdef HAVE_PTHREADS
+    if (state->fileLen >= kParallelVerifyMinFileLen) {
+        long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int numThreads = (numCpus > kMaxVerifyThreads) ?
+                kMaxVerifyThreads : (int) numCpus;
+        if (numThreads > 1) {
+            return crossVerifyParallel(state, pMap, numThreads);
         }
+    }
+#endif
+
+    const DexMapItem* item = pMap->list;
+    u4 count = pMap->size;
+    bool okay = true;
 
+    while (okay && count--) {
+        okay = crossVerifySection(state, item);
         item++;
     }
 
@@ -2855,16 +2986,15 @@ int dexSwapAndVerify(u1* addr, int len)
          * This might be a big-endian system, so we need to do this before
          * we byte-swap the header.
          */
-        uLong adler = adler32(0L, Z_NULL, 0);
         const int nonSum = sizeof(pHeader->magic) + sizeof(pHeader->checksum);
         u4 storedFileSize = SWAP4(pHeader->fileSize);
         u4 expectedChecksum = SWAP4(pHeader->checksum);
 
-        adler = adler32(adler, ((const u1*) pHeader) + nonSum,
-                    storedFileSize - nonSum);
+        u4 adler = dexAdler32(kDexAdler32Init,
+                    ((const u1*) pHeader) + nonSum, storedFileSize - nonSum);
 
         if (adler != expectedChecksum) {
-            ALOGE("ERROR: bad checksum (%08lx, expected %08x)",
+            ALOGE("ERROR: bad checksum (%08x, expected %08x)",
                 adler, expectedChecksum);
             okay = false;
         }
@@ -20,12 +20,156 @@
 
 #include "DexUtf.h"
 
+#if defined(__SSE2__)
+# include <emmintrin.h>
+# define DEX_UTF_SSE2
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+# include <arm_neon.h>
+# define DEX_UTF_NEON
+#endif
+
+/*
+ * Block tests for the ASCII fast paths. Nearly every string in a dex
+ * file is plain ASCII, so it pays to look at kDexUtfBlockLen bytes at
+ * a time and only decode blocks that need it. The caller makes sure
+ * the whole block is readable.
+ */
+#if defined(DEX_UTF_SSE2)
+#define DEX_UTF_VECTOR
+
+/* Are all bytes in 0x01..0x7f? */
+static inline bool blockIsAscii(const u1* p) {
+    __m128i v = _mm_loadu_si128((const __m128i*) p);
+    __m128i nul = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    return _mm_movemask_epi8(_mm_or_si128(v, nul)) == 0;
+}
+
+static inline void widenBlock(u2* out, const u1* p) {
+    __m128i v = _mm_loadu_si128((const __m128i*) p);
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128((__m128i*) out, _mm_unpacklo_epi8(v, zero));
+    _mm_storeu_si128((__m128i*) (out + 8), _mm_unpackhi_epi8(v, zero));
+}
+
+/* Are the blocks the same, and all ASCII other than '\0'? */
+static inline bool blocksMatchAscii(const u1* p1, const u1* p2) {
+    __m128i v1 = _mm_loadu_si128((const __m128i*) p1);
+    __m128i v2 = _mm_loadu_si128((const __m128i*) p2);
+    __m128i nul = _mm_cmpeq_epi8(v1, _mm_setzero_si128());
+    int same = _mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2));
+    return (same == 0xffff) && _mm_movemask_epi8(_mm_or_si128(v1, nul)) == 0;
+}
+
+/* Are all bytes in the low-ASCII member name set [0-9A-Za-z$_-]? */
+static inline bool blockIsMemberName(const u1* p) {
+    __m128i v = _mm_loadu_si128((const __m128i*) p);
+    /* bytes >= 0x80 are negative as signed and fail every range */
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                               _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    ok = _mm_or_si128(ok,
+            _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                          _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1))));
+    ok = _mm_or_si128(ok,
+            _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                          _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1))));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('$')));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    return _mm_movemask_epi8(ok) == 0xffff;
+}
+#elif defined(DEX_UTF_NEON)
+#define DEX_UTF_VECTOR
+
+static inline bool noneSet(uint8x16_t v) {
+    uint64x2_t w = vreinterpretq_u64_u8(v);
+    return (vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) == 0;
+}
+
+/* Are all bytes in 0x01..0x7f? */
+static inline bool blockIsAscii(const u1* p) {
+    uint8x16_t v = vld1q_u8(p);
+    return noneSet(vorrq_u8(vcgeq_u8(v, vdupq_n_u8(0x80)),
+                            vceqq_u8(v, vdupq_n_u8(0))));
+}
+
+static inline void widenBlock(u2* out, const u1* p) {
+    uint8x16_t v = vld1q_u8(p);
+    vst1q_u16(out, vmovl_u8(vget_low_u8(v)));
+    vst1q_u16(out + 8, vmovl_u8(vget_high_u8(v)));
+}
+
+/* Are the blocks the same, and all ASCII other than '\0'? */
+static inline bool blocksMatchAscii(const u1* p1, const u1* p2) {
+    uint8x16_t v1 = vld1q_u8(p1);
+    uint8x16_t v2 = vld1q_u8(p2);
+    return noneSet(vorrq_u8(vorrq_u8(vcgeq_u8(v1, vdupq_n_u8(0x80)),
+                                     vceqq_u8(v1, vdupq_n_u8(0))),
+                            veorq_u8(v1, v2)));
+}
+
+/* Are all bytes in the low-ASCII member name set [0-9A-Za-z$_-]? */
+static inline bool blockIsMemberName(const u1* p) {
+    uint8x16_t v = vld1q_u8(p);
+    /* (c - lo) <= (hi - lo), unsigned, tests lo <= c <= hi */
+    uint8x16_t ok = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+    ok = vorrq_u8(ok, vcleq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(25)));
+    ok = vorrq_u8(ok, vcleq_u8(vsubq_u8(v, vdupq_n_u8('a')), vdupq_n_u8(25)));
+    ok = vorrq_u8(ok, vceqq_u8(v, vdupq_n_u8('$')));
+    ok = vorrq_u8(ok, vceqq_u8(v, vdupq_n_u8('-')));
+    ok = vorrq_u8(ok, vceqq_u8(v, vdupq_n_u8('_')));
+    return noneSet(vmvnq_u8(ok));
+}
+#endif
+
+/* (documented in header) */
+size_t dexUtf8AsciiSpan(const char* s, size_t maxLen) {
+    size_t len = 0;
+#if defined(DEX_UTF_VECTOR)
+    const u1* p = (const u1*) s;
+    while (maxLen - len >= kDexUtfBlockLen && blockIsAscii(p + len)) {
+        len += kDexUtfBlockLen;
+    }
+#endif
+    return len;
+}
+
+/* (documented in header) */
+size_t dexUtf8WidenAscii(u2* utf16Str, const char* s, size_t maxLen) {
+    size_t len = 0;
+#if defined(DEX_UTF_VECTOR)
+    const u1* p = (const u1*) s;
+    while (maxLen - len >= kDexUtfBlockLen && blockIsAscii(p + len)) {
+        widenBlock(utf16Str + len, p + len);
+        len += kDexUtfBlockLen;
+    }
+#endif
+    return len;
+}
+
 /* Compare two '\0'-terminated modified UTF-8 strings, using Unicode
  * code point values for comparison. This treats different encodings
  * for the same code point as equivalent, except that only a real '\0'
  * byte is considered the string terminator. The return value is as
  * for strcmp(). */
 int dexUtf8Cmp(const char* s1, const char* s2) {
+#if defined(DEX_UTF_VECTOR)
+    /*
+     * Skip the common ASCII prefix a block at a time. Identical ASCII
+     * blocks end on a character boundary, so decoding can pick up
+     * after them.
+     */
+    for (;;) {
+        size_t limit1 = dexUtf8ScanLimit(s1);
+        size_t limit2 = dexUtf8ScanLimit(s2);
+        if (limit1 < kDexUtfBlockLen || limit2 < kDexUtfBlockLen ||
+                !blocksMatchAscii((const u1*) s1, (const u1*) s2)) {
+            break;
+        }
+        s1 += kDexUtfBlockLen;
+        s2 += kDexUtfBlockLen;
+    }
+#endif
+
     for (;;) {
         if (*s1 == '\0') {
             if (*s2 == '\0') {
@@ -131,6 +275,14 @@ bool dexIsValidMemberName(const char* s) {
         }
     }
 
+#if defined(DEX_UTF_VECTOR)
+    /* Long names are mostly plain identifier characters; skip those. */
+    while (dexUtf8ScanLimit(s) >= kDexUtfBlockLen &&
+            blockIsMemberName((const u1*) s)) {
+        s += kDexUtfBlockLen;
+    }
+#endif
+
     for (;;) {
         switch (*s) {
             case '\0': {
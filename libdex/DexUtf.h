@@ -62,6 +62,26 @@ DEX_INLINE u2 dexGetUtf16FromUtf8(const char** pUtf8Ptr)
     }
 }
 
+/* Block size of the ASCII fast paths below. */
+#define kDexUtfBlockLen 16
+
+/* Return how many bytes starting at "s" can be scanned a block at a
+ * time without crossing into a page that the string might not reach.
+ * Use this as the limit when the length of the string isn't known. */
+DEX_INLINE size_t dexUtf8ScanLimit(const char* s) {
+    return 4096 - ((uintptr_t) s & 4095);
+}
+
+/* Return how many leading bytes of "s" are ASCII other than '\0',
+ * counting in whole blocks of kDexUtfBlockLen and looking at no more
+ * than "maxLen" bytes, all of which must be readable. The result may
+ * be less than the real run of ASCII; the caller decodes the rest a
+ * byte at a time. */
+size_t dexUtf8AsciiSpan(const char* s, size_t maxLen);
+
+/* Like dexUtf8AsciiSpan(), but also widen the bytes into "utf16Str". */
+size_t dexUtf8WidenAscii(u2* utf16Str, const char* s, size_t maxLen);
+
 /* Compare two '\0'-terminated modified UTF-8 strings, using Unicode
  * code point values for comparison. This treats different encodings
  * for the same code point as equivalent, except that only a real '\0'
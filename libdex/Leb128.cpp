@@ -20,6 +20,8 @@
 
 #include "Leb128.h"
 
+#include <string.h>
+
 /*
  * Reads an unsigned LEB128 value, updating the given pointer to point
  * just past the end of the read value and also indicating whether the
@@ -63,3 +65,63 @@ int readAndVerifySignedLeb128(const u1** pStream, const u1* limit,
 
     return result;
 }
+
+/* (documented in header file) */
+bool readAndVerifyUnsignedLeb128Array(const u1** pStream, const u1* limit,
+        u4* values, u4 count) {
+    const u1* ptr = *pStream;
+    bool okay = true;
+
+#if defined(HAVE_LITTLE_ENDIAN)
+    /*
+     * Look at eight bytes at once. A clear high bit ends a value, so a
+     * run of clear high bits at the bottom of the word is a run of one-
+     * byte values, and the lowest clear high bit gives the length of a
+     * longer one. That leaves only a mask-and-shift to gather its
+     * seven-bit groups, with no per-byte branches.
+     */
+    const u8 kHighBits = 0x8080808080808080ULL;
+
+    while (count != 0 && limit != NULL && limit - ptr >= 8) {
+        u8 word;
+        memcpy(&word, ptr, sizeof(word));
+
+        u8 more = word & kHighBits;
+        u4 singles = (more == 0) ? 8 : (__builtin_ctzll(more) >> 3);
+        if (singles != 0) {
+            if (singles > count) {
+                singles = count;
+            }
+            for (u4 i = 0; i < singles; i++) {
+                values[i] = (u1) (word >> (i * 8));
+            }
+            values += singles;
+            ptr += singles;
+            count -= singles;
+            continue;
+        }
+
+        u8 ends = ~word & kHighBits;
+        u4 len = (ends == 0) ? 9 : (__builtin_ctzll(ends) >> 3) + 1;
+        if (len > 5 || (len == 5 && ptr[4] > 0x0f)) {
+            return false;
+        }
+        word &= ~0ULL >> (64 - len * 8);
+        *values++ = (u4) ((word & 0x7f) |
+                          ((word >> 1) & 0x3f80) |
+                          ((word >> 2) & 0x1fc000) |
+                          ((word >> 3) & 0xfe00000) |
+                          ((word >> 4) & 0xf0000000));
+        ptr += len;
+        count--;
+    }
+#endif
+
+    while (okay && count != 0) {
+        *values++ = readAndVerifyUnsignedLeb128(&ptr, limit, &okay);
+        count--;
+    }
+
+    *pStream = ptr;
+    return okay;
+}
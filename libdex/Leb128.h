@@ -124,6 +124,19 @@ int readAndVerifyUnsignedLeb128(const u1** pStream, const u1* limit,
  */
 int readAndVerifySignedLeb128(const u1** pStream, const u1* limit, bool* okay);
 
+/*
+ * Reads "count" unsigned LEB128 values into "values", updating the given
+ * pointer to point just past the last one. Returns false if any of them
+ * is invalid in the sense of readAndVerifyUnsignedLeb128(), in which case
+ * the pointer and the contents of "values" are undefined.
+ *
+ * If "limit" is non-NULL, values are picked up eight bytes at a time
+ * while at least that many bytes remain before it, which is much faster
+ * than reading the bytes one by one when most values are short.
+ */
+bool readAndVerifyUnsignedLeb128Array(const u1** pStream, const u1* limit,
+        u4* values, u4 count);
+
 
 /*
  * Writes a 32-bit value in unsigned ULEB128 format.
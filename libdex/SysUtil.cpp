@@ -306,6 +306,49 @@ int sysMapFileSegmentInShmem(int fd, off_t start, size_t length,
 #endif
 }
 
+/*
+ * Map part of a file into a private, read-only memory segment that can be
+ * made writable.  The "start" offset is absolute, not relative.
+ *
+ * On success, returns 0 and fills out "pMap".  On failure, returns a nonzero
+ * value and does not disturb "pMap".
+ */
+int sysMapFileSegmentInShmemWritableReadOnly(int fd, off_t start,
+    size_t length, MemMapping* pMap)
+{
+#ifdef HAVE_POSIX_FILEMAP
+    size_t actualLength;
+    off_t actualStart;
+    int adjust;
+    void* memPtr;
+
+    assert(pMap != NULL);
+
+    /* adjust to be page-aligned */
+    adjust = start % SYSTEM_PAGE_SIZE;
+    actualStart = start - adjust;
+    actualLength = length + adjust;
+
+    memPtr = mmap(NULL, actualLength, PROT_READ, MAP_FILE | MAP_PRIVATE,
+                fd, actualStart);
+    if (memPtr == MAP_FAILED) {
+        ALOGW("mmap(%d, R, FILE|PRIVATE, %d, %d) failed: %s",
+            (int) actualLength, fd, (int) actualStart, strerror(errno));
+        return -1;
+    }
+
+    pMap->baseAddr = memPtr;
+    pMap->baseLength = actualLength;
+    pMap->addr = (char*)memPtr + adjust;
+    pMap->length = length;
+
+    return 0;
+#else
+    ALOGE("sysMapFileSegmentInShmemWritableReadOnly not implemented.");
+    return -1;
+#endif
+}
+
 /*
  * Change the access rights on one or more pages to read-only or read-write.
  *
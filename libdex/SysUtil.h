@@ -87,6 +87,14 @@ int sysMapFileInShmemWritableReadOnly(int fd, MemMapping* pMap);
 int sysMapFileSegmentInShmem(int fd, off_t start, size_t length,
     MemMapping* pMap);
 
+/*
+ * Like sysMapFileInShmemWritableReadOnly, but on only part of a file.
+ * Pages that are made writable are private copies; changes never reach
+ * the underlying file.
+ */
+int sysMapFileSegmentInShmemWritableReadOnly(int fd, off_t start,
+    size_t length, MemMapping* pMap);
+
 /*
  * Create a private anonymous mapping, useful for large allocations.
  *
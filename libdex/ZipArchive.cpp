@@ -78,7 +78,7 @@ static int entryToIndex(const ZipArchive* pArchive, const ZipEntry entry)
 {
     long ent = ((long) entry) - kZipEntryAdj;
     if (ent < 0 || ent >= pArchive->mHashTableSize ||
-        pArchive->mHashTable[ent].name == NULL)
+        pArchive->mHashTable[ent].nameOffset == 0)
     {
         ALOGW("Zip: invalid ZipEntry %p (%ld)", entry, ent);
         return -1;
@@ -99,6 +99,24 @@ static unsigned int computeHash(const char* str, int len)
     return hash;
 }
 
+/*
+ * Bits of the hash kept in the table entry.  The low bits pick the slot,
+ * so the high ones are the useful discriminator.
+ */
+static inline unsigned short hashTag(unsigned int hash)
+{
+    return (unsigned short) (hash >> 16);
+}
+
+/*
+ * Get a pointer to the (non-null-terminated) name for a hash table entry.
+ */
+static inline const char* getEntryName(const ZipArchive* pArchive, int ent)
+{
+    return (const char*) pArchive->mDirectoryMap.addr +
+        pArchive->mHashTable[ent].nameOffset;
+}
+
 /*
  * Add a new entry to the hash table.
  */
@@ -111,11 +129,13 @@ static void addToHash(ZipArchive* pArchive, const char* str, int strLen,
     /*
      * We over-allocated the table, so we're guaranteed to find an empty slot.
      */
-    while (pArchive->mHashTable[ent].name != NULL)
+    while (pArchive->mHashTable[ent].nameOffset != 0)
         ent = (ent + 1) & (hashTableSize-1);
 
-    pArchive->mHashTable[ent].name = str;
+    pArchive->mHashTable[ent].nameOffset =
+        str - (const char*) pArchive->mDirectoryMap.addr;
     pArchive->mHashTable[ent].nameLen = strLen;
+    pArchive->mHashTable[ent].hashTag = hashTag(hash);
 }
 
 /*
@@ -429,9 +449,12 @@ ZipEntry dexZipFindEntry(const ZipArchive* pArchive, const char* entryName)
     const int hashTableSize = pArchive->mHashTableSize;
     int ent = hash & (hashTableSize-1);
 
-    while (pArchive->mHashTable[ent].name != NULL) {
-        if (pArchive->mHashTable[ent].nameLen == nameLen &&
-            memcmp(pArchive->mHashTable[ent].name, entryName, nameLen) == 0)
+    const unsigned short tag = hashTag(hash);
+
+    while (pArchive->mHashTable[ent].nameOffset != 0) {
+        if (pArchive->mHashTable[ent].hashTag == tag &&
+            pArchive->mHashTable[ent].nameLen == nameLen &&
+            memcmp(getEntryName(pArchive, ent), entryName, nameLen) == 0)
         {
             /* match */
             return (ZipEntry)(long)(ent + kZipEntryAdj);
@@ -460,7 +483,7 @@ ZipEntry findEntryByIndex(ZipArchive* pArchive, int idx)
 
     int ent;
     for (ent = 0; ent < pArchive->mHashTableSize; ent++) {
-        if (pArchive->mHashTable[ent].name != NULL) {
+        if (pArchive->mHashTable[ent].nameOffset != 0) {
             if (idx-- == 0)
                 return (ZipEntry) (ent + kZipEntryAdj);
         }
@@ -492,7 +515,7 @@ int dexZipGetEntryInfo(const ZipArchive* pArchive, ZipEntry entry,
     const unsigned char* basePtr = (const unsigned char*)
         pArchive->mDirectoryMap.addr;
     const unsigned char* ptr = (const unsigned char*)
-        pArchive->mHashTable[ent].name;
+        getEntryName(pArchive, ent);
     off_t cdOffset = pArchive->mDirectoryOffset;
 
     ptr -= kCDELen;
@@ -581,13 +604,73 @@ int dexZipGetEntryInfo(const ZipArchive* pArchive, ZipEntry entry,
 }
 
 /*
- * Uncompress "deflate" data from the archive's file to an open file
- * descriptor.
+ * Size of the read and inflate buffers used when streaming an entry.
+ */
+#define kStreamBufSize      32768
+
+/*
+ * Read "count" bytes at absolute offset "offset".  We use pread() rather
+ * than seeking so that several threads can stream entries out of the same
+ * archive at once without fighting over the file position.
+ */
+static int readFullyAt(int fd, void* buf, size_t count, off_t offset)
+{
+    unsigned char* ptr = (unsigned char*) buf;
+
+    while (count != 0) {
+        ssize_t actual = TEMP_FAILURE_RETRY(pread(fd, ptr, count, offset));
+        if (actual <= 0) {
+            ALOGW("Zip: pread at %ld failed: %s", (long) offset,
+                actual == 0 ? "unexpected EOF" : strerror(errno));
+            return -1;
+        }
+        ptr += actual;
+        offset += actual;
+        count -= actual;
+    }
+    return 0;
+}
+
+/*
+ * Hand a stored (uncompressed) entry to "func" a buffer at a time.
+ */
+static int copyToCallback(int inFd, off_t offset, size_t len,
+    ZipChunkFunc func, void* arg)
+{
+    int result = -1;
+    unsigned char* buf = (unsigned char*) malloc(kStreamBufSize);
+
+    if (buf == NULL)
+        goto bail;
+
+    while (len != 0) {
+        size_t getSize = (len > kStreamBufSize) ? kStreamBufSize : len;
+
+        if (readFullyAt(inFd, buf, getSize, offset) != 0)
+            goto bail;
+        if ((*func)(buf, getSize, arg) != 0)
+            goto bail;
+
+        offset += getSize;
+        len -= getSize;
+    }
+
+    result = 0;
+
+bail:
+    free(buf);
+    return result;
+}
+
+/*
+ * Uncompress "deflate" data from the archive's file, handing the output
+ * to "func" a buffer at a time.
  */
-static int inflateToFile(int outFd, int inFd, size_t uncompLen, size_t compLen)
+static int inflateToCallback(int inFd, off_t offset, size_t uncompLen,
+    size_t compLen, ZipChunkFunc func, void* arg)
 {
     int result = -1;
-    const size_t kBufSize = 32768;
+    const size_t kBufSize = kStreamBufSize;
     unsigned char* readBuf = (unsigned char*) malloc(kBufSize);
     unsigned char* writeBuf = (unsigned char*) malloc(kBufSize);
     z_stream zstream;
@@ -632,13 +715,12 @@ static int inflateToFile(int outFd, int inFd, size_t uncompLen, size_t compLen)
         if (zstream.avail_in == 0) {
             size_t getSize = (compLen > kBufSize) ? kBufSize : compLen;
 
-            ssize_t actual = TEMP_FAILURE_RETRY(read(inFd, readBuf, getSize));
-            if (actual != (ssize_t) getSize) {
-                ALOGW("Zip: inflate read failed (%d vs %zd)",
-                    (int)actual, getSize);
+            if (readFullyAt(inFd, readBuf, getSize, offset) != 0) {
+                ALOGW("Zip: inflate read failed (%zd bytes)", getSize);
                 goto z_bail;
             }
 
+            offset += getSize;
             compLen -= getSize;
 
             zstream.next_in = readBuf;
@@ -654,12 +736,12 @@ static int inflateToFile(int outFd, int inFd, size_t uncompLen, size_t compLen)
             goto z_bail;
         }
 
-        /* write when we're full or when we're done */
+        /* hand it off when we're full or when we're done */
         if (zstream.avail_out == 0 ||
             (zerr == Z_STREAM_END && zstream.avail_out != kBufSize))
         {
             size_t writeSize = zstream.next_out - writeBuf;
-            if (sysWriteFully(outFd, writeBuf, writeSize, "Zip inflate") != 0)
+            if ((*func)(writeBuf, writeSize, arg) != 0)
                 goto z_bail;
 
             zstream.next_out = writeBuf;
@@ -688,18 +770,16 @@ bail:
 }
 
 /*
- * Uncompress an entry, in its entirety, to an open file descriptor.
- *
- * TODO: this doesn't verify the data's CRC, but probably should (especially
- * for uncompressed data).
+ * Uncompress an entry, in its entirety, handing the data to "func" in
+ * order.  The archive's file position is not used or changed.
  */
-int dexZipExtractEntryToFile(const ZipArchive* pArchive,
-    const ZipEntry entry, int fd)
+int dexZipStreamEntry(const ZipArchive* pArchive, const ZipEntry entry,
+    ZipChunkFunc func, void* arg)
 {
     int result = -1;
     int ent = entryToIndex(pArchive, entry);
     if (ent < 0) {
-        ALOGW("Zip: extract can't find entry %p", entry);
+        ALOGW("Zip: stream can't find entry %p", entry);
         goto bail;
     }
 
@@ -712,16 +792,14 @@ int dexZipExtractEntryToFile(const ZipArchive* pArchive,
     {
         goto bail;
     }
-    if (lseek(pArchive->mFd, dataOffset, SEEK_SET) != dataOffset) {
-        ALOGW("Zip: lseek to data at %ld failed", (long) dataOffset);
-        goto bail;
-    }
 
     if (method == kCompressStored) {
-        if (sysCopyFileToFile(fd, pArchive->mFd, uncompLen) != 0)
+        if (copyToCallback(pArchive->mFd, dataOffset, uncompLen,
+                func, arg) != 0)
             goto bail;
     } else {
-        if (inflateToFile(fd, pArchive->mFd, uncompLen, compLen) != 0)
+        if (inflateToCallback(pArchive->mFd, dataOffset, uncompLen, compLen,
+                func, arg) != 0)
             goto bail;
     }
 
@@ -730,3 +808,67 @@ int dexZipExtractEntryToFile(const ZipArchive* pArchive,
 bail:
     return result;
 }
+
+/*
+ * dexZipStreamEntry() consumer that appends to a file descriptor.
+ */
+static int writeChunkToFile(const void* data, size_t len, void* arg)
+{
+    int fd = *(int*) arg;
+    return sysWriteFully(fd, data, len, "Zip extract");
+}
+
+/*
+ * Uncompress an entry, in its entirety, to an open file descriptor.
+ */
+int dexZipExtractEntryToFile(const ZipArchive* pArchive,
+    const ZipEntry entry, int fd)
+{
+    return dexZipStreamEntry(pArchive, entry, writeChunkToFile, &fd);
+}
+
+/*
+ * dexZipStreamEntry() consumer that accumulates a CRC-32.
+ */
+static int crcChunk(const void* data, size_t len, void* arg)
+{
+    u4* pCrc = (u4*) arg;
+    *pCrc = dexComputeCrc32(*pCrc, data, len);
+    return 0;
+}
+
+/*
+ * Uncompress an entry and compare its CRC-32 against the one recorded
+ * in the central directory.
+ */
+int dexZipVerifyEntryCrc(const ZipArchive* pArchive, const ZipEntry entry)
+{
+    long expected;
+    u4 crc = dexInitCrc32();
+
+    if (dexZipGetEntryInfo(pArchive, entry, NULL, NULL, NULL, NULL, NULL,
+            &expected) != 0)
+        return -1;
+    if (dexZipStreamEntry(pArchive, entry, crcChunk, &crc) != 0)
+        return -1;
+    if (crc != (u4) expected) {
+        ALOGW("Zip: CRC mismatch (0x%08x vs 0x%08x)", crc, (u4) expected);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Utility functions to compute a CRC-32.  zlib's implementation is
+ * table-driven (and vectorized in the newer releases), so we just defer
+ * to whichever one we're linked against.
+ */
+u4 dexInitCrc32()
+{
+    return crc32(0L, Z_NULL, 0);
+}
+
+u4 dexComputeCrc32(u4 crc, const void* buf, size_t len)
+{
+    return crc32(crc, (const Bytef*) buf, len);
+}
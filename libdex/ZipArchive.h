@@ -30,11 +30,16 @@
 typedef void* ZipEntry;
 
 /*
- * One entry in the hash table.
+ * One entry in the hash table.  The name is recorded as an offset into the
+ * mapped central directory (never zero, since it follows a fixed-size
+ * header) so the entry is 8 bytes regardless of pointer size.  "hashTag"
+ * holds the top bits of the name's hash, which lets a probe reject most
+ * mismatches without touching the directory pages.
  */
 struct ZipHashEntry {
-    const char*     name;
+    u4              nameOffset;     // 0 means "empty slot"
     unsigned short  nameLen;
+    unsigned short  hashTag;
 };
 
 /*
@@ -54,7 +59,8 @@ struct ZipHashEntry {
  * "private" (copy-on-write) and null-terminate the filenames after verifying
  * the record structure.  However, this requires a private mapping of
  * every page that the Central Directory touches.  Easier to tuck a copy
- * of the string length into the hash table entry.
+ * of the string length, and a few bits of its hash, into the hash table
+ * entry.
  */
 struct ZipArchive {
     /* open Zip archive */
@@ -163,6 +169,24 @@ DEX_INLINE long dexGetZipEntryCrc32(const ZipArchive* pArchive,
     return val;
 }
 
+/*
+ * Consumer for dexZipStreamEntry().  Called with successive pieces of
+ * the uncompressed entry; a nonzero return stops the stream.
+ */
+typedef int (*ZipChunkFunc)(const void* data, size_t len, void* arg);
+
+/*
+ * Uncompress an entry, passing the data to "func" as it's produced, so
+ * the caller can checksum or parse it without writing it out first.
+ *
+ * This reads with pread() and doesn't touch the archive's file position,
+ * so several entries may be streamed from one archive in parallel.
+ *
+ * Returns 0 on success.
+ */
+int dexZipStreamEntry(const ZipArchive* pArchive, const ZipEntry entry,
+    ZipChunkFunc func, void* arg);
+
 /*
  * Uncompress and write an entry to a file descriptor.
  *
@@ -171,6 +195,14 @@ DEX_INLINE long dexGetZipEntryCrc32(const ZipArchive* pArchive,
 int dexZipExtractEntryToFile(const ZipArchive* pArchive,
     const ZipEntry entry, int fd);
 
+/*
+ * Uncompress an entry and check it against the CRC-32 in the Zip
+ * directory.
+ *
+ * Returns 0 if the data matches.
+ */
+int dexZipVerifyEntryCrc(const ZipArchive* pArchive, const ZipEntry entry);
+
 /*
  * Utility function to compute a CRC-32.
  */
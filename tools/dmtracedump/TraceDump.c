@@ -48,6 +48,9 @@ int versionNumber;
 /* Size of temporary buffers for escaping html strings */
 #define HTML_BUFSIZE 10240
 
+/* Largest data record we know how to skip over */
+#define MAX_RECORD_SIZE 64
+
 char *htmlHeader =
 "<html>\n<head>\n<script type=\"text/javascript\" src=\"%ssortable.js\"></script>\n"
 "<script langugage=\"javascript\">\n"
@@ -181,7 +184,7 @@ typedef struct MethodEntry {
  * The parsed contents of the key file.
  */
 typedef struct DataKeys {
-    char*        fileData;      /* contents of the entire file */
+    char*        fileData;      /* contents of the key section */
     long         fileLen;
     int          numThreads;
     ThreadEntry* threads;
@@ -932,6 +935,69 @@ void sortMethodList(DataKeys* pKeys)
 /*
  * Parse the key section, and return a copy of the parsed contents.
  */
+/*
+ * Read the file from the current position up to and including the
+ * "*end" line into pKeys->fileData, in growing blocks.
+ *
+ * Returns 0 on success.
+ */
+#define KEY_READ_BLOCK  65536
+
+static int readKeySection(FILE *fp, DataKeys* pKeys)
+{
+    static const char endToken[] = { TOKEN_CHAR, 'e', 'n', 'd' };
+    size_t cap = KEY_READ_BLOCK;
+    size_t len = 0;
+    size_t scanFrom = 0;
+    char* buf = (char*) malloc(cap);
+
+    if (buf == NULL) {
+        fprintf(stderr, "ERROR: unable to alloc %zu bytes\n", cap);
+        return -1;
+    }
+
+    while (1) {
+        size_t actual, i;
+
+        if (len == cap) {
+            char* newBuf = (char*) realloc(buf, cap * 2);
+            if (newBuf == NULL) {
+                fprintf(stderr, "ERROR: unable to alloc %zu bytes\n", cap * 2);
+                free(buf);
+                return -1;
+            }
+            buf = newBuf;
+            cap *= 2;
+        }
+        actual = fread(buf + len, 1, cap - len, fp);
+        if (actual == 0)
+            break;
+        len += actual;
+
+        /* look for "*end" at the start of a line, followed by a newline */
+        for (i = scanFrom; i + sizeof(endToken) < len; i++) {
+            if ((i == 0 || buf[i-1] == '\n') &&
+                memcmp(buf + i, endToken, sizeof(endToken)) == 0)
+            {
+                if (findNextChar(buf + i, len - i, '\n') >= 0) {
+                    pKeys->fileData = buf;
+                    pKeys->fileLen = len;
+                    return 0;
+                }
+                break;
+            }
+        }
+        scanFrom = i;
+    }
+
+    if (len == 0)
+        fprintf(stderr, "Key file is empty.\n");
+    else
+        fprintf(stderr, "ERROR: no '%cend' found in trace file\n", TOKEN_CHAR);
+    free(buf);
+    return -1;
+}
+
 DataKeys* parseKeys(FILE *fp, int verbose)
 {
     DataKeys* pKeys = NULL;
@@ -943,32 +1009,14 @@ DataKeys* parseKeys(FILE *fp, int verbose)
         goto fail;
 
     /*
-     * We load the entire file into memory.  We do this, rather than memory-
-     * mapping it, because we want to change some whitespace to NULs.
+     * We load the key section into memory.  We do this, rather than memory-
+     * mapping it, because we want to change some whitespace to NULs.  The
+     * data section that follows can be gigabytes, so we read in blocks
+     * only until we have seen the "*end" line.
      */
-    if (fseek(fp, 0L, SEEK_END) != 0) {
-        perror("fseek");
-        goto fail;
-    }
-    pKeys->fileLen = ftell(fp);
-    if (pKeys->fileLen == 0) {
-        fprintf(stderr, "Key file is empty.\n");
-        goto fail;
-    }
     rewind(fp);
-
-    pKeys->fileData = (char*) malloc(pKeys->fileLen);
-    if (pKeys->fileData == NULL) {
-        fprintf(stderr, "ERROR: unable to alloc %ld bytes\n", pKeys->fileLen);
+    if (readKeySection(fp, pKeys) != 0)
         goto fail;
-    }
-
-    if (fread(pKeys->fileData, 1, pKeys->fileLen, fp) != (size_t) pKeys->fileLen)
-    {
-        fprintf(stderr, "ERROR: unable to read %ld bytes from trace file\n",
-            pKeys->fileLen);
-        goto fail;
-    }
 
     offset = 0;
 
@@ -979,8 +1027,11 @@ DataKeys* parseKeys(FILE *fp, int verbose)
     if (offset < 0)
         goto fail;
 
-    /* Reduce our allocation now that we know where the end of the key section is. */
-    pKeys->fileData = (char *)realloc(pKeys->fileData, offset);
+    /*
+     * Don't shrink the buffer: the thread and method entries point into
+     * it, and realloc() could move it.  At most one block past the key
+     * section was read.
+     */
     pKeys->fileLen = offset;
     /* Leave fp pointing to the beginning of the data section. */
     fseek(fp, offset, SEEK_SET);
@@ -1131,33 +1182,40 @@ MethodEntry* lookupMethod(DataKeys* pKeys, unsigned int methodId)
 int readDataRecord(FILE *dataFp, DataHeader* dataHeader,
         int *threadId, unsigned int *methodVal, uint64_t *elapsedTime)
 {
-    int id;
-    int bytesToRead;
+    unsigned char rec[MAX_RECORD_SIZE];
+    const unsigned char* ptr = rec;
+    size_t recordSize = dataHeader->recordSize;
+    size_t actual;
 
-    bytesToRead = dataHeader->recordSize;
-    if (dataHeader->version == 1) {
-        id = getc(dataFp);
-        bytesToRead -= 1;
-    } else {
-        id = read2LE(dataFp);
-        bytesToRead -= 2;
-    }
-    if (id == EOF)
+    /*
+     * Read the record in one call rather than a getc() per byte; the data
+     * section of a big trace is hundreds of millions of records.
+     */
+    if (recordSize > sizeof(rec) ||
+        recordSize < (dataHeader->version == 1 ? 9u : 10u))
+    {
+        fprintf(stderr, "ERROR: unsupported record size %zu\n", recordSize);
         return 1;
-    *threadId = id;
-
-    *methodVal = read4LE(dataFp);
-    *elapsedTime = read4LE(dataFp);
-    bytesToRead -= 8;
-
-    while (bytesToRead-- > 0) {
-        getc(dataFp);
     }
-
-    if (feof(dataFp)) {
+    actual = fread(rec, 1, recordSize, dataFp);
+    if (actual == 0)
+        return 1;
+    if (actual != recordSize) {
         fprintf(stderr, "WARNING: hit EOF mid-record\n");
         return 1;
     }
+
+    if (dataHeader->version == 1) {
+        *threadId = *ptr++;
+    } else {
+        *threadId = ptr[0] | (ptr[1] << 8);
+        ptr += 2;
+    }
+    *methodVal = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16)
+        | ((unsigned int) ptr[3] << 24);
+    ptr += 4;
+    *elapsedTime = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16)
+        | ((unsigned int) ptr[3] << 24);
     return 0;
 }
 
@@ -16,6 +16,7 @@ LOCAL_PATH:= $(call my-dir)
 
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES := HprofConv.c
+LOCAL_STATIC_LIBRARIES := libz
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := hprof-conv
 include $(BUILD_HOST_EXECUTABLE)
@@ -26,6 +26,8 @@
 #include <errno.h>
 #include <assert.h>
 
+#include <zlib.h>
+
 //#define VERBOSE_DEBUG
 #ifdef VERBOSE_DEBUG
 # define DBUG(...) fprintf(stderr, __VA_ARGS__)
@@ -54,6 +56,7 @@ typedef enum HprofTag {
     /* tags we must handle specially */
     HPROF_TAG_HEAP_DUMP                 = 0x0c,
     HPROF_TAG_HEAP_DUMP_SEGMENT         = 0x1c,
+    HPROF_TAG_HEAP_DUMP_END             = 0x2c,
 } HprofTag;
 
 typedef enum HprofHeapTag {
@@ -87,6 +90,11 @@ typedef enum HprofHeapTag {
 #define kIdentSize  4
 #define kRecHdrLen  9
 
+/* largest heap dump segment we build in memory */
+#define kMaxSegmentLen  (1024 * 1024)
+/* block size when copying through records we don't need to look at */
+#define kCopyChunkLen   65536
+
 
 /*
  * ===========================================================================
@@ -193,15 +201,15 @@ static int ebAddData(ExpandBuf* pBuf, const void* data, size_t count)
 /*
  * Read a NULL-terminated string from the input.
  */
-static int ebReadString(ExpandBuf* pBuf, FILE* in)
+static int ebReadString(ExpandBuf* pBuf, gzFile in)
 {
     int ic;
 
     do {
         ebEnsureCapacity(pBuf, 1);
 
-        ic = getc(in);
-        if (feof(in) || ferror(in)) {
+        ic = gzgetc(in);
+        if (ic < 0) {
             fprintf(stderr, "ERROR: failed reading input\n");
             return -1;
         }
@@ -217,20 +225,25 @@ static int ebReadString(ExpandBuf* pBuf, FILE* in)
  *
  * This will ensure that the buffer has enough space to hold the new data
  * (plus the previous contents).
+ *
+ * Returns 1 without touching the buffer if "eofExpected" is set and the
+ * input is already exhausted.
  */
-static int ebReadData(ExpandBuf* pBuf, FILE* in, size_t count, int eofExpected)
+static int ebReadData(ExpandBuf* pBuf, gzFile in, size_t count, int eofExpected)
 {
-    size_t actual;
+    int actual;
 
     assert(count > 0);
 
-    ebEnsureCapacity(pBuf, count);
-    actual = fread(pBuf->storage + pBuf->curLen, 1, count, in);
-    if (actual != count) {
-        if (eofExpected && feof(in) && !ferror(in)) {
+    if (ebEnsureCapacity(pBuf, count) != 0)
+        return -1;
+    actual = gzread(in, pBuf->storage + pBuf->curLen, count);
+    if (actual != (int) count) {
+        if (eofExpected && actual == 0 && gzeof(in)) {
             /* return without reporting an error */
+            return 1;
         } else {
-            fprintf(stderr, "ERROR: read %d of %d bytes\n", actual, count);
+            fprintf(stderr, "ERROR: read %d of %d bytes\n", actual, (int) count);
             return -1;
         }
     }
@@ -242,27 +255,94 @@ static int ebReadData(ExpandBuf* pBuf, FILE* in, size_t count, int eofExpected)
 }
 
 /*
- * Write the data from the buffer.  Resets the data count to zero.
+ * Return a pointer to the last "count" bytes in the buffer.
  */
-static int ebWriteData(ExpandBuf* pBuf, FILE* out)
+static inline unsigned char* ebGetTail(ExpandBuf* pBuf, size_t count)
 {
-    size_t actual;
+    assert(count <= pBuf->curLen);
+    return pBuf->storage + pBuf->curLen - count;
+}
+
 
+/*
+ * ===========================================================================
+ *      Output stream
+ * ===========================================================================
+ */
+
+/*
+ * Output goes to a plain file or through zlib.  Input always goes through
+ * zlib, which reads uncompressed data transparently.
+ */
+typedef struct {
+    FILE* fp;
+    gzFile gz;
+} OutStream;
+
+/*
+ * Write "count" bytes to the output.
+ */
+static int writeOut(OutStream* out, const void* data, size_t count)
+{
+    if (count == 0)
+        return 0;
+
+    if (out->gz != NULL) {
+        if (gzwrite(out->gz, data, count) != (int) count) {
+            int err;
+            fprintf(stderr, "ERROR: compressed write of %d bytes failed: %s\n",
+                (int) count, gzerror(out->gz, &err));
+            return -1;
+        }
+    } else {
+        size_t actual = fwrite(data, 1, count, out->fp);
+        if (actual != count) {
+            fprintf(stderr, "ERROR: write %d of %d bytes\n", (int) actual, (int) count);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Write the data from the buffer.  Resets the data count to zero.
+ */
+static int ebWriteData(ExpandBuf* pBuf, OutStream* out)
+{
     assert(pBuf->curLen > 0);
     assert(pBuf->curLen <= pBuf->maxLen);
 
-    actual = fwrite(pBuf->storage, 1, pBuf->curLen, out);
-    if (actual != pBuf->curLen) {
-        fprintf(stderr, "ERROR: write %d of %d bytes\n", actual, pBuf->curLen);
+    if (writeOut(out, pBuf->storage, pBuf->curLen) != 0)
         return -1;
-    }
 
     pBuf->curLen = 0;
 
     return 0;
 }
 
+/*
+ * Copy "count" bytes straight from the input to the output, a block at
+ * a time, so that large records never have to be held in memory.
+ */
+static int copyData(gzFile in, OutStream* out, uint32_t count)
+{
+    static unsigned char buf[kCopyChunkLen];
 
+    while (count > 0) {
+        int want = (count < sizeof(buf)) ? (int) count : (int) sizeof(buf);
+        int actual = gzread(in, buf, want);
+        if (actual != want) {
+            fprintf(stderr, "ERROR: read %d of %d bytes\n", actual, want);
+            return -1;
+        }
+        if (writeOut(out, buf, actual) != 0)
+            return -1;
+        count -= actual;
+    }
+
+    return 0;
+}
 /*
  * ===========================================================================
  *      Hprof stuff
@@ -317,260 +397,368 @@ static int computeBasicLen(HprofBasicType basicType)
 }
 
 /*
- * Compute the length of a HPROF_CLASS_DUMP block.
+ * Write a record header.
  */
-static int computeClassDumpLen(const unsigned char* origBuf, int len)
+static int writeRecordHeader(OutStream* out, unsigned char type,
+    uint32_t timestamp, uint32_t length)
 {
-    const unsigned char* buf = origBuf;
-    int blockLen = 0;
-    int i, count;
+    unsigned char hdr[kRecHdrLen];
+
+    hdr[0] = type;
+    set4BE(hdr + 1, timestamp);
+    set4BE(hdr + 5, length);
+    return writeOut(out, hdr, kRecHdrLen);
+}
+
+/*
+ * State for converting a single heap dump record.
+ *
+ * Converted sub-records are gathered in "pOutBuf".  In 1.0.3 data nothing
+ * tells us how long the converted record will be until we've seen all of
+ * it, so rather than holding the whole record we emit the output as a
+ * series of HEAP_DUMP_SEGMENT records, each no larger than kMaxSegmentLen
+ * (apart from single sub-records that are bigger than that on their own).
+ * A record that fits in one segment keeps its original type.
+ */
+typedef struct {
+    unsigned char type;         /* type of the original record */
+    uint32_t timestamp;         /* timestamp of the original record */
+    uint32_t remaining;         /* input bytes left in the record */
+    int split;                  /* have we written a segment yet? */
+    ExpandBuf* pOutBuf;         /* converted data not yet written */
+} HeapDumpState;
+
+/*
+ * Write the pending output as a HEAP_DUMP_SEGMENT.
+ */
+static int flushSegment(HeapDumpState* pState, OutStream* out)
+{
+    size_t len = ebGetLength(pState->pOutBuf);
 
-    blockLen += kIdentSize * 7 + 8;
-    buf += blockLen;
-    len -= blockLen;
+    if (len == 0)
+        return 0;
 
-    if (len < 0)
+    DBUG("Writing segment (%d bytes)\n", len);
+    if (writeRecordHeader(out, HPROF_TAG_HEAP_DUMP_SEGMENT,
+            pState->timestamp, len) != 0)
         return -1;
+    pState->split = TRUE;
+    return ebWriteData(pState->pOutBuf, out);
+}
 
-    count = get2BE(buf);
-    buf += 2;
-    len -= 2;
+/*
+ * Make room for "count" more bytes of output, writing out what we have
+ * if the segment would otherwise grow past kMaxSegmentLen.
+ */
+static int reserveOutput(HeapDumpState* pState, OutStream* out, size_t count)
+{
+    if (ebGetLength(pState->pOutBuf) + count > kMaxSegmentLen)
+        return flushSegment(pState, out);
+    return 0;
+}
+
+/*
+ * Read "count" bytes of the current sub-record into "pBuf", making sure we
+ * don't run past the end of the enclosing record.
+ */
+static int readSubData(HeapDumpState* pState, ExpandBuf* pBuf, gzFile in,
+    size_t count)
+{
+    if (count == 0)
+        return 0;
+    if (count > pState->remaining) {
+        fprintf(stderr, "ERROR: sub-record overruns heap dump record\n");
+        return -1;
+    }
+    if (ebReadData(pBuf, in, count, FALSE) != 0)
+        return -1;
+    pState->remaining -= count;
+    return 0;
+}
+
+/*
+ * Read the variable-length part of a HPROF_CLASS_DUMP block.  The fixed
+ * part has already been read into "pBuf".
+ */
+static int readClassDumpTail(HeapDumpState* pState, ExpandBuf* pBuf,
+    gzFile in)
+{
+    int i, count;
+
+    /* constant pool: (2b) index, (1b) type, value */
+    if (readSubData(pState, pBuf, in, 2) != 0)
+        return -1;
+    count = get2BE(ebGetTail(pBuf, 2));
     DBUG("CDL: 1st count is %d\n", count);
     for (i = 0; i < count; i++) {
         HprofBasicType basicType;
         int basicLen;
 
-        basicType = buf[2];
+        if (readSubData(pState, pBuf, in, 2 + 1) != 0)
+            return -1;
+        basicType = *ebGetTail(pBuf, 1);
         basicLen = computeBasicLen(basicType);
         if (basicLen < 0) {
-            DBUG("ERROR: invalid basicType %d\n", basicType);
+            fprintf(stderr, "ERROR: invalid basicType %d\n", basicType);
             return -1;
         }
-
-        buf += 2 + 1 + basicLen;
-        len -= 2 + 1 + basicLen;
-        if (len < 0)
+        if (readSubData(pState, pBuf, in, basicLen) != 0)
             return -1;
     }
 
-    count = get2BE(buf);
-    buf += 2;
-    len -= 2;
+    /* static fields: (id) name, (1b) type, value */
+    if (readSubData(pState, pBuf, in, 2) != 0)
+        return -1;
+    count = get2BE(ebGetTail(pBuf, 2));
     DBUG("CDL: 2nd count is %d\n", count);
     for (i = 0; i < count; i++) {
         HprofBasicType basicType;
         int basicLen;
 
-        basicType = buf[kIdentSize];
+        if (readSubData(pState, pBuf, in, kIdentSize + 1) != 0)
+            return -1;
+        basicType = *ebGetTail(pBuf, 1);
         basicLen = computeBasicLen(basicType);
         if (basicLen < 0) {
             fprintf(stderr, "ERROR: invalid basicType %d\n", basicType);
             return -1;
         }
-
-        buf += kIdentSize + 1 + basicLen;
-        len -= kIdentSize + 1 + basicLen;
-        if (len < 0)
+        if (readSubData(pState, pBuf, in, basicLen) != 0)
             return -1;
     }
 
-    count = get2BE(buf);
-    buf += 2;
-    len -= 2;
+    /* instance fields: (id) name, (1b) type */
+    if (readSubData(pState, pBuf, in, 2) != 0)
+        return -1;
+    count = get2BE(ebGetTail(pBuf, 2));
     DBUG("CDL: 3rd count is %d\n", count);
-    for (i = 0; i < count; i++) {
-        buf += kIdentSize + 1;
-        len -= kIdentSize + 1;
-        if (len < 0)
-            return -1;
-    }
-
-    DBUG("Total class dump len: %d\n", buf - origBuf);
-    return buf - origBuf;
-}
-
-/*
- * Compute the length of a HPROF_INSTANCE_DUMP block.
- */
-static int computeInstanceDumpLen(const unsigned char* origBuf, int len)
-{
-    int extraCount = get4BE(origBuf + kIdentSize * 2 + 4);
-    return kIdentSize * 2 + 8 + extraCount;
-}
-
-/*
- * Compute the length of a HPROF_OBJECT_ARRAY_DUMP block.
- */
-static int computeObjectArrayDumpLen(const unsigned char* origBuf, int len)
-{
-    int arrayCount = get4BE(origBuf + kIdentSize + 4);
-    return kIdentSize * 2 + 8 + arrayCount * kIdentSize;
-}
-
-/*
- * Compute the length of a HPROF_PRIMITIVE_ARRAY_DUMP block.
- */
-static int computePrimitiveArrayDumpLen(const unsigned char* origBuf, int len)
-{
-    int arrayCount = get4BE(origBuf + kIdentSize + 4);
-    HprofBasicType basicType = origBuf[kIdentSize + 8];
-    int basicLen = computeBasicLen(basicType);
+    if (readSubData(pState, pBuf, in, count * (kIdentSize + 1)) != 0)
+        return -1;
 
-    return kIdentSize + 9 + arrayCount * basicLen;
+    DBUG("Total class dump len: %d\n", ebGetLength(pBuf) - 1);
+    return 0;
 }
 
 /*
- * Crunch through a heap dump record, writing the original or converted
- * data to "out".
+ * Crunch through a heap dump record of "length" bytes, writing the
+ * original or converted data to "out".  The record header has already
+ * been consumed.
+ *
+ * Sub-records are read one at a time.  Instance and array dumps are
+ * copied through without being buffered if they won't fit in a segment,
+ * so memory use doesn't depend on the size of the record or the objects
+ * in it.
  */
-static int processHeapDump(ExpandBuf* pBuf, FILE* out)
+static int processHeapDump(gzFile in, OutStream* out, unsigned char type,
+    uint32_t timestamp, uint32_t length)
 {
-    ExpandBuf* pOutBuf = ebAlloc();
-    unsigned char* origBuf = ebGetBuffer(pBuf);
-    unsigned char* buf = origBuf;
-    int len = ebGetLength(pBuf);
+    HeapDumpState state;
+    ExpandBuf* pInBuf = ebAlloc();
     int result = -1;
 
-    pBuf = NULL;        /* we just use the raw pointer from here forward */
-
-    /* copy the original header to the output buffer */
-    if (ebAddData(pOutBuf, buf, kRecHdrLen) != 0)
+    state.type = type;
+    state.timestamp = timestamp;
+    state.remaining = length;
+    state.split = FALSE;
+    state.pOutBuf = ebAlloc();
+    if (pInBuf == NULL || state.pOutBuf == NULL)
         goto bail;
 
-    buf += kRecHdrLen;      /* skip past record header */
-    len -= kRecHdrLen;
-
-    while (len > 0) {
-        unsigned char subType = buf[0];
+    while (state.remaining > 0) {
+        unsigned char* buf;
+        unsigned char subType;
+        unsigned char newType;
         int justCopy = TRUE;
-        int subLen;
+        size_t keepLen = 0;
+        size_t fixedLen;
+        uint64_t tailLen = 0;
+
+        ebClear(pInBuf);
+        if (readSubData(&state, pInBuf, in, 1) != 0)
+            goto bail;
+        subType = newType = ebGetBuffer(pInBuf)[0];
 
         DBUG("--- 0x%02x  ", subType);
         switch (subType) {
         /* 1.0.2 types */
         case HPROF_ROOT_UNKNOWN:
-            subLen = kIdentSize;
+            fixedLen = kIdentSize;
             break;
         case HPROF_ROOT_JNI_GLOBAL:
-            subLen = kIdentSize * 2;
+            fixedLen = kIdentSize * 2;
             break;
         case HPROF_ROOT_JNI_LOCAL:
-            subLen = kIdentSize + 8;
+            fixedLen = kIdentSize + 8;
             break;
         case HPROF_ROOT_JAVA_FRAME:
-            subLen = kIdentSize + 8;
+            fixedLen = kIdentSize + 8;
             break;
         case HPROF_ROOT_NATIVE_STACK:
-            subLen = kIdentSize + 4;
+            fixedLen = kIdentSize + 4;
             break;
         case HPROF_ROOT_STICKY_CLASS:
-            subLen = kIdentSize;
+            fixedLen = kIdentSize;
             break;
         case HPROF_ROOT_THREAD_BLOCK:
-            subLen = kIdentSize + 4;
+            fixedLen = kIdentSize + 4;
             break;
         case HPROF_ROOT_MONITOR_USED:
-            subLen = kIdentSize;
+            fixedLen = kIdentSize;
             break;
         case HPROF_ROOT_THREAD_OBJECT:
-            subLen = kIdentSize + 8;
+            fixedLen = kIdentSize + 8;
             break;
         case HPROF_CLASS_DUMP:
-            subLen = computeClassDumpLen(buf+1, len-1);
+            fixedLen = kIdentSize * 7 + 8;
             break;
         case HPROF_INSTANCE_DUMP:
-            subLen = computeInstanceDumpLen(buf+1, len-1);
+            /* id, serial, class id, (4b) length of field data */
+            fixedLen = kIdentSize * 2 + 8;
             break;
         case HPROF_OBJECT_ARRAY_DUMP:
-            subLen = computeObjectArrayDumpLen(buf+1, len-1);
+            /* id, serial, (4b) count, class id */
+            fixedLen = kIdentSize * 2 + 8;
             break;
         case HPROF_PRIMITIVE_ARRAY_DUMP:
-            subLen = computePrimitiveArrayDumpLen(buf+1, len-1);
+            /* id, serial, (4b) count, (1b) type */
+            fixedLen = kIdentSize + 9;
             break;
 
         /* these were added for Android in 1.0.3 */
         case HPROF_HEAP_DUMP_INFO:
             justCopy = FALSE;
-            subLen = kIdentSize + 4;
+            fixedLen = kIdentSize + 4;
             // no 1.0.2 equivalent for this
             break;
         case HPROF_ROOT_INTERNED_STRING:
-            buf[0] = HPROF_ROOT_UNKNOWN;
-            subLen = kIdentSize;
-            break;
         case HPROF_ROOT_FINALIZING:
-            buf[0] = HPROF_ROOT_UNKNOWN;
-            subLen = kIdentSize;
-            break;
         case HPROF_ROOT_DEBUGGER:
-            buf[0] = HPROF_ROOT_UNKNOWN;
-            subLen = kIdentSize;
-            break;
         case HPROF_ROOT_REFERENCE_CLEANUP:
-            buf[0] = HPROF_ROOT_UNKNOWN;
-            subLen = kIdentSize;
-            break;
         case HPROF_ROOT_VM_INTERNAL:
-            buf[0] = HPROF_ROOT_UNKNOWN;
-            subLen = kIdentSize;
+        case HPROF_UNREACHABLE:
+            newType = HPROF_ROOT_UNKNOWN;
+            fixedLen = kIdentSize;
             break;
         case HPROF_ROOT_JNI_MONITOR:
             /* keep the ident, drop the next 8 bytes */
-            buf[0] = HPROF_ROOT_UNKNOWN;
+            newType = HPROF_ROOT_UNKNOWN;
             justCopy = FALSE;
-            ebAddData(pOutBuf, buf, 1 + kIdentSize);
-            subLen = kIdentSize + 8;
-            break;
-        case HPROF_UNREACHABLE:
-            buf[0] = HPROF_ROOT_UNKNOWN;
-            subLen = kIdentSize;
+            keepLen = 1 + kIdentSize;
+            fixedLen = kIdentSize + 8;
             break;
         case HPROF_PRIMITIVE_ARRAY_NODATA_DUMP:
-            buf[0] = HPROF_PRIMITIVE_ARRAY_DUMP;
-            buf[5] = buf[6] = buf[7] = buf[8] = 0;  /* set array len to 0 */
-            subLen = kIdentSize + 9;
+            newType = HPROF_PRIMITIVE_ARRAY_DUMP;
+            fixedLen = kIdentSize + 9;
             break;
 
         /* shouldn't get here */
         default:
-            fprintf(stderr, "ERROR: unexpected subtype 0x%02x at offset %d\n",
-                subType, buf - origBuf);
+            fprintf(stderr, "ERROR: unexpected subtype 0x%02x at offset %u\n",
+                subType, length - state.remaining - 1);
+            goto bail;
+        }
+
+        if (readSubData(&state, pInBuf, in, fixedLen) != 0)
+            goto bail;
+        buf = ebGetBuffer(pInBuf);
+        buf[0] = newType;
+
+        switch (subType) {
+        case HPROF_CLASS_DUMP:
+            if (readClassDumpTail(&state, pInBuf, in) != 0)
+                goto bail;
+            break;
+        case HPROF_INSTANCE_DUMP:
+            tailLen = get4BE(buf + 1 + kIdentSize * 2 + 4);
+            break;
+        case HPROF_OBJECT_ARRAY_DUMP:
+            tailLen = (uint64_t) get4BE(buf + 1 + kIdentSize + 4) * kIdentSize;
+            break;
+        case HPROF_PRIMITIVE_ARRAY_DUMP: {
+            int basicLen = computeBasicLen(buf[1 + kIdentSize + 8]);
+            if (basicLen < 0) {
+                fprintf(stderr, "ERROR: invalid basicType %d\n",
+                    buf[1 + kIdentSize + 8]);
+                goto bail;
+            }
+            tailLen = (uint64_t) get4BE(buf + 1 + kIdentSize + 4) * basicLen;
+            break;
+        }
+        case HPROF_PRIMITIVE_ARRAY_NODATA_DUMP:
+            set4BE(buf + 1 + kIdentSize + 4, 0);    /* set array len to 0 */
+            break;
+        default:
+            break;
+        }
+
+        if (tailLen > state.remaining) {
+            fprintf(stderr, "ERROR: sub-record overruns heap dump record\n");
             goto bail;
         }
 
-        if (justCopy) {
+        if (!justCopy) {
+            /* add what we keep, if anything; the rest is omitted */
+            DBUG("(adv %d)\n", ebGetLength(pInBuf));
+            if (keepLen > 0) {
+                if (reserveOutput(&state, out, keepLen) != 0)
+                    goto bail;
+                ebAddData(state.pOutBuf, buf, keepLen);
+            }
+        } else if (ebGetLength(pInBuf) + tailLen <= kMaxSegmentLen) {
             /* copy source data */
-            DBUG("(%d)\n", 1 + subLen);
-            ebAddData(pOutBuf, buf, 1 + subLen);
+            DBUG("(%d)\n", ebGetLength(pInBuf) + (size_t) tailLen);
+            if (readSubData(&state, pInBuf, in, (size_t) tailLen) != 0)
+                goto bail;
+            if (reserveOutput(&state, out, ebGetLength(pInBuf)) != 0)
+                goto bail;
+            ebAddData(state.pOutBuf, ebGetBuffer(pInBuf),
+                ebGetLength(pInBuf));
         } else {
-            /* other data has been written, or the sub-record omitted */
-            DBUG("(adv %d)\n", 1 + subLen);
+            /* too big to buffer; give it a segment of its own */
+            DBUG("(stream %d)\n", ebGetLength(pInBuf) + (size_t) tailLen);
+            if (flushSegment(&state, out) != 0)
+                goto bail;
+            if (writeRecordHeader(out, HPROF_TAG_HEAP_DUMP_SEGMENT, timestamp,
+                    ebGetLength(pInBuf) + (uint32_t) tailLen) != 0)
+                goto bail;
+            if (ebWriteData(pInBuf, out) != 0)
+                goto bail;
+            if (copyData(in, out, (uint32_t) tailLen) != 0)
+                goto bail;
+            state.remaining -= (uint32_t) tailLen;
+            state.split = TRUE;
         }
-
-        /* advance to next entry */
-        buf += 1 + subLen;
-        len -= 1 + subLen;
     }
 
-    /*
-     * Update the record length.
-     */
-    set4BE(ebGetBuffer(pOutBuf) + 5, ebGetLength(pOutBuf) - kRecHdrLen);
-
-    if (ebWriteData(pOutBuf, out) != 0)
-        goto bail;
+    if (!state.split) {
+        /* it all fit; write it out as a single record of the original type */
+        if (writeRecordHeader(out, type, timestamp,
+                ebGetLength(state.pOutBuf)) != 0)
+            goto bail;
+        if (ebGetLength(state.pOutBuf) > 0 &&
+            ebWriteData(state.pOutBuf, out) != 0)
+            goto bail;
+    } else {
+        if (flushSegment(&state, out) != 0)
+            goto bail;
+        /* a segmented HEAP_DUMP needs the terminator a real one implies */
+        if (type == HPROF_TAG_HEAP_DUMP &&
+            writeRecordHeader(out, HPROF_TAG_HEAP_DUMP_END, timestamp, 0) != 0)
+            goto bail;
+    }
 
     result = 0;
 
 bail:
-    ebFree(pOutBuf);
+    ebFree(pInBuf);
+    ebFree(state.pOutBuf);
     return result;
 }
 
 /*
  * Filter an hprof data file.
  */
-static int filterData(FILE* in, FILE* out)
+static int filterData(gzFile in, OutStream* out)
 {
     const char *magicString;
     ExpandBuf* pBuf;
@@ -616,14 +804,19 @@ static int filterData(FILE* in, FILE* out)
      * (1b) type
      * (4b) timestamp
      * (4b) length of data that follows
+     *
+     * Only the header is buffered; the record data is streamed.
      */
     while (1) {
+        int cc;
+
         assert(ebGetLength(pBuf) == 0);
 
         /* read type char */
-        if (ebReadData(pBuf, in, 1, TRUE) != 0)
+        cc = ebReadData(pBuf, in, 1, TRUE);
+        if (cc < 0)
             goto bail;
-        if (feof(in))
+        if (cc > 0)
             break;
 
         /* read the rest of the header */
@@ -639,25 +832,21 @@ static int filterData(FILE* in, FILE* out)
         length = get4BE(buf + 5);
         buf = NULL;     /* ptr invalid after next read op */
 
-        /* read the record data */
-        if (length != 0) {
-            if (ebReadData(pBuf, in, length, FALSE) != 0)
-                goto bail;
-        }
-
         if (type == HPROF_TAG_HEAP_DUMP ||
             type == HPROF_TAG_HEAP_DUMP_SEGMENT)
         {
             DBUG("Processing heap dump 0x%02x (%d bytes)\n",
                 type, length);
-            if (processHeapDump(pBuf, out) != 0)
-                goto bail;
             ebClear(pBuf);
+            if (processHeapDump(in, out, type, timestamp, length) != 0)
+                goto bail;
         } else {
             /* keep */
             DBUG("Keeping 0x%02x (%d bytes)\n", type, length);
             if (ebWriteData(pBuf, out) != 0)
                 goto bail;
+            if (copyData(in, out, length) != 0)
+                goto bail;
         }
     }
 
@@ -668,19 +857,37 @@ bail:
     return result;
 }
 
+/*
+ * Return TRUE if "name" ends in ".gz".
+ */
+static int hasGzipSuffix(const char* name)
+{
+    size_t len = strlen(name);
+    return (len > 3 && strcmp(name + len - 3, ".gz") == 0);
+}
+
 /*
  * Get args.
  */
 int main(int argc, char** argv)
 {
-    FILE* in = stdin;
-    FILE* out = stdout;
+    gzFile in;
+    OutStream out;
+    int compress = FALSE;
     int cc;
 
+    if (argc > 1 && strcmp(argv[1], "-z") == 0) {
+        compress = TRUE;
+        argc--;
+        argv++;
+    }
+
     if (argc != 3) {
-        fprintf(stderr, "Usage: hprof-conf infile outfile\n\n");
+        fprintf(stderr, "Usage: hprof-conv [-z] infile outfile\n\n");
         fprintf(stderr,
-            "Specify '-' for either or both to use stdin/stdout.\n\n");
+            "Specify '-' for either or both to use stdin/stdout.\n"
+            "Compressed (gzip) input is detected automatically.  Output is\n"
+            "compressed with -z, or if outfile ends in \".gz\".\n\n");
 
         fprintf(stderr,
             "Copyright (C) 2009 The Android Open Source Project\n\n"
@@ -695,30 +902,58 @@ int main(int argc, char** argv)
         return 2;
     }
 
-    if (strcmp(argv[1], "-") != 0) {
-        in = fopen(argv[1], "rb");
-        if (in == NULL) {
-            fprintf(stderr, "ERROR: failed to open input '%s': %s\n",
-                argv[1], strerror(errno));
-            return 1;
-        }
+    if (strcmp(argv[1], "-") != 0)
+        in = gzopen(argv[1], "rb");
+    else
+        in = gzdopen(fileno(stdin), "rb");
+    if (in == NULL) {
+        fprintf(stderr, "ERROR: failed to open input '%s': %s\n",
+            argv[1], strerror(errno));
+        return 1;
     }
+
+    out.fp = stdout;
+    out.gz = NULL;
     if (strcmp(argv[2], "-") != 0) {
-        out = fopen(argv[2], "wb");
-        if (out == NULL) {
+        out.fp = fopen(argv[2], "wb");
+        if (out.fp == NULL) {
             fprintf(stderr, "ERROR: failed to open output '%s': %s\n",
                 argv[2], strerror(errno));
-            if (in != stdin)
-                fclose(in);
+            gzclose(in);
+            return 1;
+        }
+        if (hasGzipSuffix(argv[2]))
+            compress = TRUE;
+    }
+    if (compress) {
+        out.gz = gzdopen(fileno(out.fp), "wb");
+        if (out.gz == NULL) {
+            fprintf(stderr, "ERROR: failed to set up compressed output\n");
+            gzclose(in);
+            if (out.fp != stdout)
+                fclose(out.fp);
             return 1;
         }
     }
 
-    cc = filterData(in, out);
+    cc = filterData(in, &out);
 
-    if (in != stdin)
-        fclose(in);
-    if (out != stdout)
-        fclose(out);
+    gzclose(in);
+    if (out.gz != NULL) {
+        /* this closes the underlying descriptor as well */
+        if (gzclose(out.gz) != Z_OK) {
+            fprintf(stderr, "ERROR: failed finishing compressed output\n");
+            cc = -1;
+        }
+    } else if (out.fp != stdout) {
+        if (fclose(out.fp) != 0) {
+            fprintf(stderr, "ERROR: failed closing output: %s\n",
+                strerror(errno));
+            cc = -1;
+        }
+    } else if (fflush(out.fp) != 0) {
+        fprintf(stderr, "ERROR: failed writing output: %s\n", strerror(errno));
+        cc = -1;
+    }
     return (cc != 0);
 }
@@ -0,0 +1,74 @@
+# Copyright (C) 2012 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# the benchmark payload, for the device
+# ============================================================
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := $(call all-java-files-under, src)
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := vmbench
+include $(BUILD_JAVA_LIBRARY)
+
+# the native half of the JNI benchmarks, for the device
+# ============================================================
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := jni/vmbench_jni.cpp
+LOCAL_C_INCLUDES := $(JNI_H_INCLUDE)
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := libvmbench_jni
+include $(BUILD_SHARED_LIBRARY)
+
+# the native half again, for the host VM (which runs the device jar, as
+# the run-tests do)
+# ============================================================
+ifeq ($(WITH_HOST_DALVIK),true)
+    include $(CLEAR_VARS)
+    LOCAL_SRC_FILES := jni/vmbench_jni.cpp
+    LOCAL_C_INCLUDES := $(JNI_H_INCLUDE)
+    LOCAL_MODULE_TAGS := optional
+    LOCAL_MODULE := libvmbench_jni
+    include $(BUILD_HOST_SHARED_LIBRARY)
+endif
+
+# the driver scripts
+# ============================================================
+include $(CLEAR_VARS)
+LOCAL_IS_HOST_MODULE := true
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_MODULE := run-vm-bench
+
+include $(BUILD_SYSTEM)/base_rules.mk
+
+$(LOCAL_BUILT_MODULE): $(LOCAL_PATH)/etc/run-vm-bench | $(ACP)
+	@echo "Copy: $(PRIVATE_MODULE) ($@)"
+	$(copy-file-to-new-target)
+	$(hide) chmod 755 $@
+
+# the startup timing script
+# ============================================================
+include $(CLEAR_VARS)
+LOCAL_IS_HOST_MODULE := true
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_MODULE := run-startup-bench
+
+include $(BUILD_SYSTEM)/base_rules.mk
+
+$(LOCAL_BUILT_MODULE): $(LOCAL_PATH)/etc/run-startup-bench | $(ACP)
+	@echo "Copy: $(PRIVATE_MODULE) ($@)"
+	$(copy-file-to-new-target)
+	$(hide) chmod 755 $@
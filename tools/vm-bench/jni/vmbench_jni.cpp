@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Native halves of the JNI benchmarks.  They do as little as possible so
+ * that what gets timed is the transition itself.
+ */
+#include <jni.h>
+
+extern "C" {
+
+JNIEXPORT void JNICALL
+Java_com_android_vmbench_Benchmarks_nativeNop(JNIEnv* env, jclass clazz)
+{
+}
+
+JNIEXPORT jint JNICALL
+Java_com_android_vmbench_Benchmarks_nativeAdd(JNIEnv* env, jclass clazz,
+    jint a, jint b)
+{
+    return a + b;
+}
+
+JNIEXPORT jobject JNICALL
+Java_com_android_vmbench_Benchmarks_nativeReturnThis(JNIEnv* env,
+    jobject thiz)
+{
+    return thiz;
+}
+
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.vmbench;
+
+/**
+ * One timed operation.  {@link #run} performs the operation {@code reps}
+ * times; the harness picks {@code reps} so that a call takes long enough
+ * to time with {@link System#nanoTime}.
+ */
+public abstract class Benchmark {
+    private final String mName;
+
+    /**
+     * Somewhere for benchmarks to put results, so the work they time
+     * can't be thrown away.
+     */
+    public static volatile int sink;
+
+    protected Benchmark(String name) {
+        mName = name;
+    }
+
+    public String getName() {
+        return mName;
+    }
+
+    /**
+     * Returns {@code false} if this benchmark can't run here (for example,
+     * a native library didn't load).
+     */
+    public boolean isAvailable() {
+        return true;
+    }
+
+    public abstract void run(int reps);
+}
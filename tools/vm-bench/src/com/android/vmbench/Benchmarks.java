@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.vmbench;
+
+/**
+ * The benchmarks.  Each one exercises a single VM path the interpreter,
+ * the JIT or the runtime spends a lot of time in.
+ */
+public class Benchmarks {
+    private static boolean sHaveNative;
+
+    static {
+        try {
+            System.loadLibrary("vmbench_jni");
+            sHaveNative = true;
+        } catch (UnsatisfiedLinkError ule) {
+            System.err.println("vmbench: JNI benchmarks disabled: " + ule);
+        }
+    }
+
+    private Benchmarks() {}
+
+    /* native halves, in jni/vmbench_jni.cpp */
+    private static native void nativeNop();
+    private static native int nativeAdd(int a, int b);
+    private native Object nativeReturnThis();
+
+    public static Benchmark[] all() {
+        return new Benchmark[] {
+            new AllocObject(),
+            new AllocIntArray(),
+            new MonitorUncontended(),
+            new MonitorRecursive(),
+            new InvokeVirtual(),
+            new InvokeInterfaceMono(),
+            new InvokeInterfacePoly(),
+            new JniStaticNop(),
+            new JniStaticArgs(),
+            new JniInstanceObject(),
+            new InstanceOfHit(),
+            new InstanceOfMiss(),
+            new InstanceOfInterface(),
+            new CheckCast(),
+            new StringLength(),
+            new StringCharAt(),
+            new StringEquals(),
+            new StringCompareTo(),
+            new StringIndexOf(),
+            new ArrayCopyChar(16),
+            new ArrayCopyChar(1024),
+            new ArrayCopyInt(256),
+            new ArrayCopyObject(16),
+        };
+    }
+
+    /*
+     * ===========================================================
+     *      Allocation
+     * ===========================================================
+     */
+
+    static class AllocObject extends Benchmark {
+        AllocObject() { super("alloc-object"); }
+        public void run(int reps) {
+            Object o = null;
+            for (int i = 0; i < reps; i++) {
+                o = new Object();
+            }
+            sink = (o != null) ? 1 : 0;
+        }
+    }
+
+    static class AllocIntArray extends Benchmark {
+        AllocIntArray() { super("alloc-int-array-16"); }
+        public void run(int reps) {
+            int[] a = null;
+            for (int i = 0; i < reps; i++) {
+                a = new int[16];
+            }
+            sink = a.length;
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      Monitors
+     * ===========================================================
+     */
+
+    static class MonitorUncontended extends Benchmark {
+        private final Object mLock = new Object();
+        MonitorUncontended() { super("monitor-enter-exit"); }
+        public void run(int reps) {
+            int count = 0;
+            for (int i = 0; i < reps; i++) {
+                synchronized (mLock) {
+                    count++;
+                }
+            }
+            sink = count;
+        }
+    }
+
+    static class MonitorRecursive extends Benchmark {
+        private final Object mLock = new Object();
+        MonitorRecursive() { super("monitor-recursive"); }
+        public void run(int reps) {
+            int count = 0;
+            synchronized (mLock) {
+                for (int i = 0; i < reps; i++) {
+                    synchronized (mLock) {
+                        count++;
+                    }
+                }
+            }
+            sink = count;
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      Dispatch
+     * ===========================================================
+     */
+
+    interface Adder {
+        int add(int x);
+    }
+
+    static class AddOne implements Adder {
+        public int add(int x) { return x + 1; }
+    }
+    static class AddTwo implements Adder {
+        public int add(int x) { return x + 2; }
+    }
+    static class AddThree implements Adder {
+        public int add(int x) { return x + 3; }
+    }
+    static class AddFour implements Adder {
+        public int add(int x) { return x + 4; }
+    }
+
+    static class Base {
+        int get(int x) { return x; }
+    }
+    static class Derived extends Base {
+        int get(int x) { return x + 1; }
+    }
+
+    static class InvokeVirtual extends Benchmark {
+        private final Base mTarget = new Derived();
+        InvokeVirtual() { super("invoke-virtual"); }
+        public void run(int reps) {
+            Base target = mTarget;
+            int x = 0;
+            for (int i = 0; i < reps; i++) {
+                x = target.get(x);
+            }
+            sink = x;
+        }
+    }
+
+    static class InvokeInterfaceMono extends Benchmark {
+        private final Adder mTarget = new AddOne();
+        InvokeInterfaceMono() { super("invoke-interface-mono"); }
+        public void run(int reps) {
+            Adder target = mTarget;
+            int x = 0;
+            for (int i = 0; i < reps; i++) {
+                x = target.add(x);
+            }
+            sink = x;
+        }
+    }
+
+    static class InvokeInterfacePoly extends Benchmark {
+        private final Adder[] mTargets = {
+            new AddOne(), new AddTwo(), new AddThree(), new AddFour()
+        };
+        InvokeInterfacePoly() { super("invoke-interface-poly4"); }
+        public void run(int reps) {
+            Adder[] targets = mTargets;
+            int x = 0;
+            for (int i = 0; i < reps; i++) {
+                x = targets[i & 3].add(x);
+            }
+            sink = x;
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      JNI transitions
+     * ===========================================================
+     */
+
+    static abstract class JniBenchmark extends Benchmark {
+        JniBenchmark(String name) { super(name); }
+        public boolean isAvailable() { return sHaveNative; }
+    }
+
+    static class JniStaticNop extends JniBenchmark {
+        JniStaticNop() { super("jni-static-nop"); }
+        public void run(int reps) {
+            for (int i = 0; i < reps; i++) {
+                nativeNop();
+            }
+        }
+    }
+
+    static class JniStaticArgs extends JniBenchmark {
+        JniStaticArgs() { super("jni-static-int-args"); }
+        public void run(int reps) {
+            int x = 0;
+            for (int i = 0; i < reps; i++) {
+                x = nativeAdd(x, i);
+            }
+            sink = x;
+        }
+    }
+
+    static class JniInstanceObject extends JniBenchmark {
+        private final Benchmarks mReceiver = new Benchmarks();
+        JniInstanceObject() { super("jni-instance-return-object"); }
+        public void run(int reps) {
+            Benchmarks receiver = mReceiver;
+            Object o = null;
+            for (int i = 0; i < reps; i++) {
+                o = receiver.nativeReturnThis();
+            }
+            sink = (o != null) ? 1 : 0;
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      Type checks
+     * ===========================================================
+     */
+
+    static class InstanceOfHit extends Benchmark {
+        private final Object mObj = new Derived();
+        InstanceOfHit() { super("instanceof-class-hit"); }
+        public void run(int reps) {
+            Object obj = mObj;
+            int count = 0;
+            for (int i = 0; i < reps; i++) {
+                if (obj instanceof Base) {
+                    count++;
+                }
+            }
+            sink = count;
+        }
+    }
+
+    static class InstanceOfMiss extends Benchmark {
+        private final Object mObj = new Base();
+        InstanceOfMiss() { super("instanceof-class-miss"); }
+        public void run(int reps) {
+            Object obj = mObj;
+            int count = 0;
+            for (int i = 0; i < reps; i++) {
+                if (obj instanceof Derived) {
+                    count++;
+                }
+            }
+            sink = count;
+        }
+    }
+
+    static class InstanceOfInterface extends Benchmark {
+        private final Object mObj = new AddThree();
+        InstanceOfInterface() { super("instanceof-interface"); }
+        public void run(int reps) {
+            Object obj = mObj;
+            int count = 0;
+            for (int i = 0; i < reps; i++) {
+                if (obj instanceof Adder) {
+                    count++;
+                }
+            }
+            sink = count;
+        }
+    }
+
+    static class CheckCast extends Benchmark {
+        private final Object mObj = new AddTwo();
+        CheckCast() { super("check-cast-interface"); }
+        public void run(int reps) {
+            Object obj = mObj;
+            int x = 0;
+            for (int i = 0; i < reps; i++) {
+                Adder a = (Adder) obj;
+                if (a != null) {
+                    x++;
+                }
+            }
+            sink = x;
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      String intrinsics
+     * ===========================================================
+     */
+
+    private static final String STR_A = "the quick brown fox jumps over the lazy dog";
+    private static final String STR_B =
+            new String("the quick brown fox jumps over the lazy dog");
+    private static final String STR_C = "the quick brown fox jumps over the lazy cat";
+
+    static class StringLength extends Benchmark {
+        StringLength() { super("string-length"); }
+        public void run(int reps) {
+            String s = STR_A;
+            int x = 0;
+            for (int i = 0; i < reps; i++) {
+                x += s.length();
+            }
+            sink = x;
+        }
+    }
+
+    static class StringCharAt extends Benchmark {
+        StringCharAt() { super("string-charAt"); }
+        public void run(int reps) {
+            String s = STR_A;
+            int len = s.length();
+            int x = 0;
+            for (int i = 0; i < reps; i++) {
+                x += s.charAt(i % len);
+            }
+            sink = x;
+        }
+    }
+
+    static class StringEquals extends Benchmark {
+        StringEquals() { super("string-equals"); }
+        public void run(int reps) {
+            String a = STR_A, b = STR_B;
+            int count = 0;
+            for (int i = 0; i < reps; i++) {
+                if (a.equals(b)) {
+                    count++;
+                }
+            }
+            sink = count;
+        }
+    }
+
+    static class StringCompareTo extends Benchmark {
+        StringCompareTo() { super("string-compareTo"); }
+        public void run(int reps) {
+            String a = STR_A, c = STR_C;
+            int x = 0;
+            for (int i = 0; i < reps; i++) {
+                x += a.compareTo(c);
+            }
+            sink = x;
+        }
+    }
+
+    static class StringIndexOf extends Benchmark {
+        StringIndexOf() { super("string-indexOf"); }
+        public void run(int reps) {
+            String s = STR_A;
+            int x = 0;
+            for (int i = 0; i < reps; i++) {
+                x += s.indexOf('z');
+            }
+            sink = x;
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      System.arraycopy
+     * ===========================================================
+     */
+
+    static class ArrayCopyChar extends Benchmark {
+        private final char[] mSrc, mDst;
+        ArrayCopyChar(int len) {
+            super("arraycopy-char-" + len);
+            mSrc = new char[len];
+            mDst = new char[len];
+        }
+        public void run(int reps) {
+            char[] src = mSrc, dst = mDst;
+            for (int i = 0; i < reps; i++) {
+                System.arraycopy(src, 0, dst, 0, src.length);
+            }
+        }
+    }
+
+    static class ArrayCopyInt extends Benchmark {
+        private final int[] mSrc, mDst;
+        ArrayCopyInt(int len) {
+            super("arraycopy-int-" + len);
+            mSrc = new int[len];
+            mDst = new int[len];
+        }
+        public void run(int reps) {
+            int[] src = mSrc, dst = mDst;
+            for (int i = 0; i < reps; i++) {
+                System.arraycopy(src, 0, dst, 0, src.length);
+            }
+        }
+    }
+
+    static class ArrayCopyObject extends Benchmark {
+        private final Object[] mSrc, mDst;
+        ArrayCopyObject(int len) {
+            super("arraycopy-object-" + len);
+            mSrc = new Object[len];
+            mDst = new Object[len];
+            for (int i = 0; i < len; i++) {
+                mSrc[i] = "x";
+            }
+        }
+        public void run(int reps) {
+            Object[] src = mSrc, dst = mDst;
+            for (int i = 0; i < reps; i++) {
+                System.arraycopy(src, 0, dst, 0, src.length);
+            }
+        }
+    }
+}
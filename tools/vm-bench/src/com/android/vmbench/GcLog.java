@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.vmbench;
+
+import java.lang.reflect.Method;
+
+/**
+ * Reads the VM's GC event log through VMDebug.getGcEvents(), which is
+ * looked up reflectively so the suite still runs (without pause data)
+ * on a VM or core library that doesn't have it.
+ */
+public class GcLog {
+    /* GcKind in vm/alloc/HeapDebug.h */
+    public static final String[] KIND_NAMES = {
+        "GC_FOR_ALLOC", "GC_YOUNG", "GC_CONCURRENT", "GC_EXPLICIT",
+        "GC_BEFORE_OOM"
+    };
+
+    /* values per event, and the most the VM keeps */
+    private static final int VALUES_PER_EVENT = 8;
+    private static final int MAX_EVENTS = 512;
+
+    public static class Event {
+        public long seq;
+        public int kind;
+        public long startMsec;
+        public long pauseMsec;
+        public long totalMsec;
+        public long bytesFreed;
+        public long allocated;
+        public long footprint;
+    }
+
+    private final Method mGetEvents;
+    private final Method mResetEvents;
+
+    public GcLog() {
+        Method get = null, reset = null;
+        try {
+            Class<?> vmDebug = Class.forName("dalvik.system.VMDebug");
+            get = vmDebug.getDeclaredMethod("getGcEvents", long[].class);
+            reset = vmDebug.getDeclaredMethod("resetGcEvents");
+            get.setAccessible(true);
+            reset.setAccessible(true);
+        } catch (Exception ex) {
+            System.err.println("vmbench: no GC event log: " + ex);
+            get = reset = null;
+        }
+        mGetEvents = get;
+        mResetEvents = reset;
+    }
+
+    public boolean isAvailable() {
+        return mGetEvents != null;
+    }
+
+    public void reset() {
+        if (mResetEvents == null) {
+            return;
+        }
+        try {
+            mResetEvents.invoke(null);
+        } catch (Exception ex) {
+            throw new RuntimeException(ex);
+        }
+    }
+
+    /**
+     * Returns the logged collections, oldest first.  Only the most recent
+     * 512 are kept; callers that poll can use Event.seq to skip the ones
+     * they've already seen.
+     */
+    public Event[] read() {
+        if (mGetEvents == null) {
+            return new Event[0];
+        }
+        long[] data = new long[MAX_EVENTS * VALUES_PER_EVENT];
+        int count;
+        try {
+            count = (Integer) mGetEvents.invoke(null, data);
+        } catch (Exception ex) {
+            throw new RuntimeException(ex);
+        }
+        Event[] events = new Event[count];
+        for (int i = 0; i < count; i++) {
+            int base = i * VALUES_PER_EVENT;
+            Event e = new Event();
+            e.seq = data[base];
+            e.kind = (int) data[base + 1];
+            e.startMsec = data[base + 2];
+            e.pauseMsec = data[base + 3];
+            e.totalMsec = data[base + 4];
+            e.bytesFreed = data[base + 5];
+            e.allocated = data[base + 6];
+            e.footprint = data[base + 7];
+            events[i] = e;
+        }
+        return events;
+    }
+
+    public static String kindName(int kind) {
+        if (kind >= 0 && kind < KIND_NAMES.length) {
+            return KIND_NAMES[kind];
+        }
+        return "kind-" + kind;
+    }
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.vmbench;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+
+/**
+ * Command-line entry point for the GC benchmarks.
+ *
+ * Usage: GcMain [--duration-ms N] [--threads N] [--list] [name-prefix ...]
+ *
+ * For each workload, prints the allocation throughput, the pause-time
+ * percentiles of each kind of collection that ran, and the heap
+ * footprint over time.
+ */
+public class GcMain {
+    private static final long SAMPLE_MSEC = 250;
+
+    private static void usage() {
+        System.err.println("usage: GcMain [--duration-ms N] [--threads N] "
+                + "[--list] [name-prefix ...]");
+        System.exit(2);
+    }
+
+    public static void main(String[] args) throws InterruptedException {
+        long durationMsec = 5000;
+        int threads = 8;
+        boolean list = false;
+        int argIdx = 0;
+
+        try {
+            for (; argIdx < args.length; argIdx++) {
+                String arg = args[argIdx];
+                if (!arg.startsWith("--")) {
+                    break;
+                } else if (arg.equals("--duration-ms")) {
+                    durationMsec = Long.parseLong(args[++argIdx]);
+                } else if (arg.equals("--threads")) {
+                    threads = Integer.parseInt(args[++argIdx]);
+                } else if (arg.equals("--list")) {
+                    list = true;
+                } else {
+                    usage();
+                }
+            }
+        } catch (ArrayIndexOutOfBoundsException aioobe) {
+            usage();
+        } catch (NumberFormatException nfe) {
+            usage();
+        }
+
+        GcWorkloads.Workload[] workloads = GcWorkloads.all(threads);
+        if (list) {
+            for (GcWorkloads.Workload w : workloads) {
+                System.out.println(w.getName());
+            }
+            return;
+        }
+
+        GcLog log = new GcLog();
+        for (GcWorkloads.Workload w : workloads) {
+            if (selected(w.getName(), args, argIdx)) {
+                runOne(w, log, durationMsec);
+            }
+        }
+    }
+
+    private static boolean selected(String name, String[] args, int first) {
+        if (first == args.length) {
+            return true;
+        }
+        for (int i = first; i < args.length; i++) {
+            if (name.startsWith(args[i])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Samples the footprint and drains the GC log while a workload runs.
+     */
+    static class Sampler extends Thread {
+        private final GcLog mLog;
+        private final long mStartNanos;
+        private volatile boolean mDone;
+        private long mLastSeq = -1;
+
+        final ArrayList<GcLog.Event> events = new ArrayList<GcLog.Event>();
+        final ArrayList<long[]> footprint = new ArrayList<long[]>();
+
+        Sampler(GcLog log, long startNanos) {
+            super("vmbench-sampler");
+            mLog = log;
+            mStartNanos = startNanos;
+        }
+
+        public void run() {
+            while (!mDone) {
+                sample();
+                try {
+                    Thread.sleep(SAMPLE_MSEC);
+                } catch (InterruptedException ie) {
+                    break;
+                }
+            }
+            sample();
+        }
+
+        private void sample() {
+            Runtime rt = Runtime.getRuntime();
+            long total = rt.totalMemory();
+            long used = total - rt.freeMemory();
+            long when = (System.nanoTime() - mStartNanos) / 1000000;
+            footprint.add(new long[] { when, used, total });
+
+            for (GcLog.Event e : mLog.read()) {
+                if (e.seq > mLastSeq) {
+                    events.add(e);
+                    mLastSeq = e.seq;
+                }
+            }
+        }
+
+        void finish() throws InterruptedException {
+            mDone = true;
+            interrupt();
+            join();
+        }
+    }
+
+    private static void runOne(GcWorkloads.Workload w, GcLog log,
+            long durationMsec) throws InterruptedException {
+        System.out.println("=== " + w.getName());
+
+        w.setUp();
+        System.gc();
+        System.runFinalization();
+        System.gc();
+        log.reset();
+
+        long start = System.nanoTime();
+        Sampler sampler = new Sampler(log, start);
+        sampler.start();
+        long bytes = w.run(start + durationMsec * 1000000L);
+        long elapsed = System.nanoTime() - start;
+        sampler.finish();
+        w.tearDown();
+
+        double seconds = elapsed / 1e9;
+        System.out.println(String.format("throughput: %.1f MB/s allocated "
+                + "(%d MB in %.2f s)", bytes / seconds / (1 << 20),
+                bytes >> 20, seconds));
+
+        if (!log.isAvailable()) {
+            System.out.println("(pause times need VMDebug.getGcEvents)");
+        } else {
+            printPauses(sampler.events);
+        }
+        printFootprint(sampler.footprint);
+        System.out.println();
+    }
+
+    private static void printPauses(ArrayList<GcLog.Event> events) {
+        System.out.println(String.format("%-14s %6s %6s %6s %6s %6s %8s",
+                "pauses (ms)", "count", "p50", "p90", "p99", "max",
+                "total-p50"));
+        for (int kind = 0; kind < GcLog.KIND_NAMES.length; kind++) {
+            int n = 0;
+            for (GcLog.Event e : events) {
+                if (e.kind == kind) {
+                    n++;
+                }
+            }
+            if (n == 0) {
+                continue;
+            }
+            long[] pauses = new long[n];
+            long[] totals = new long[n];
+            int i = 0;
+            for (GcLog.Event e : events) {
+                if (e.kind == kind) {
+                    pauses[i] = e.pauseMsec;
+                    totals[i] = e.totalMsec;
+                    i++;
+                }
+            }
+            Arrays.sort(pauses);
+            Arrays.sort(totals);
+            System.out.println(String.format(
+                    "%-14s %6d %6d %6d %6d %6d %8d", GcLog.kindName(kind), n,
+                    percentile(pauses, 50), percentile(pauses, 90),
+                    percentile(pauses, 99), pauses[n - 1],
+                    percentile(totals, 50)));
+        }
+    }
+
+    /**
+     * Nearest-rank percentile of a sorted, non-empty array.
+     */
+    private static long percentile(long[] sorted, int pct) {
+        int rank = (int) Math.ceil(pct / 100.0 * sorted.length);
+        return sorted[Math.max(rank, 1) - 1];
+    }
+
+    private static void printFootprint(ArrayList<long[]> samples) {
+        long peak = 0;
+        StringBuilder sb = new StringBuilder();
+        for (long[] s : samples) {
+            peak = Math.max(peak, s[2]);
+            sb.append(String.format(" %d:%d/%d", s[0], s[1] >> 10, s[2] >> 10));
+        }
+        System.out.println("footprint peak " + (peak >> 10) + "K; "
+                + "samples (ms:usedK/footprintK):");
+        System.out.println(" " + sb);
+    }
+}
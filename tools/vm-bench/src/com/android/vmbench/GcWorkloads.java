@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.vmbench;
+
+import java.lang.ref.SoftReference;
+import java.lang.ref.WeakReference;
+import java.util.ArrayList;
+
+/**
+ * Allocation workloads for the GC benchmarks.  Each one allocates until
+ * a deadline and returns roughly how many bytes it asked for.
+ */
+public class GcWorkloads {
+    private GcWorkloads() {}
+
+    public static abstract class Workload {
+        private final String mName;
+
+        protected Workload(String name) {
+            mName = name;
+        }
+
+        public String getName() {
+            return mName;
+        }
+
+        /** Called before timing starts. */
+        public void setUp() {}
+
+        /** Allocates until System.nanoTime() passes the deadline. */
+        public abstract long run(long deadlineNanos);
+
+        /** Drops everything the workload is holding on to. */
+        public void tearDown() {}
+    }
+
+    public static Workload[] all(int threads) {
+        return new Workload[] {
+            new Churn(),
+            new LiveSet(),
+            new References(),
+            new LargeArrays(),
+            new Explicit(),
+            new ManyThreads(threads),
+        };
+    }
+
+    /* rough object sizes, for throughput; header plus fields or data */
+    private static final int OBJECT_HEADER = 8;
+
+    /* check the clock this often, so its cost stays out of the way */
+    private static final int CLOCK_INTERVAL = 1024;
+
+    /**
+     * Short-lived objects of mixed sizes, with a small window of them
+     * kept alive so that not everything dies young.
+     */
+    static class Churn extends Workload {
+        private static final int WINDOW = 1024;
+
+        Churn() { super("churn"); }
+
+        public long run(long deadlineNanos) {
+            return churn(deadlineNanos, new Object[WINDOW]);
+        }
+    }
+
+    static long churn(long deadlineNanos, Object[] window) {
+        long bytes = 0;
+        int i = 0;
+        while (true) {
+            for (int j = 0; j < CLOCK_INTERVAL; j++, i++) {
+                int len = 2 + (i & 63);
+                window[i & (window.length - 1)] = new int[len];
+                bytes += OBJECT_HEADER + 4 + len * 4;
+            }
+            if (System.nanoTime() >= deadlineNanos) {
+                return bytes;
+            }
+        }
+    }
+
+    static class Node {
+        Node next;
+        Node other;
+        int value;
+    }
+
+    /**
+     * Churn against a large, pointer-rich live set that every full
+     * collection has to trace.
+     */
+    static class LiveSet extends Workload {
+        private Node mHead;
+
+        LiveSet() { super("live-set"); }
+
+        public void setUp() {
+            /* about a third of the heap, at ~24 bytes a node */
+            long target = Runtime.getRuntime().maxMemory() / 3;
+            int nodes = (int) Math.min(target / 24, Integer.MAX_VALUE);
+            Node head = null;
+            Node middle = null;
+            for (int i = 0; i < nodes; i++) {
+                Node n = new Node();
+                n.next = head;
+                n.other = middle;
+                n.value = i;
+                head = n;
+                if ((i & 1023) == 0) {
+                    middle = n;
+                }
+            }
+            mHead = head;
+        }
+
+        public long run(long deadlineNanos) {
+            return churn(deadlineNanos, new Object[1024]);
+        }
+
+        public void tearDown() {
+            mHead = null;
+        }
+    }
+
+    static class Finalizable {
+        static volatile int sFinalized;
+        private final int[] mPayload = new int[8];
+
+        protected void finalize() {
+            sFinalized++;
+        }
+    }
+
+    /**
+     * Objects reachable only through soft and weak references, and
+     * objects with finalizers, so every GC has reference work to do.
+     */
+    static class References extends Workload {
+        private static final int WINDOW = 1024;
+
+        References() { super("references"); }
+
+        public long run(long deadlineNanos) {
+            Object[] window = new Object[WINDOW];
+            long bytes = 0;
+            int i = 0;
+            while (true) {
+                for (int j = 0; j < CLOCK_INTERVAL; j++, i++) {
+                    Object obj;
+                    switch (i % 3) {
+                    case 0:
+                        obj = new SoftReference<int[]>(new int[16]);
+                        break;
+                    case 1:
+                        obj = new WeakReference<int[]>(new int[16]);
+                        break;
+                    default:
+                        obj = new Finalizable();
+                        break;
+                    }
+                    window[i & (WINDOW - 1)] = obj;
+                    bytes += 2 * OBJECT_HEADER + 16 + 16 * 4;
+                }
+                if (System.nanoTime() >= deadlineNanos) {
+                    return bytes;
+                }
+            }
+        }
+    }
+
+    /**
+     * Arrays from 64KB to 1MB, a few kept alive at a time.
+     */
+    static class LargeArrays extends Workload {
+        private static final int WINDOW = 8;
+
+        LargeArrays() { super("large-arrays"); }
+
+        public long run(long deadlineNanos) {
+            byte[][] window = new byte[WINDOW][];
+            long bytes = 0;
+            int i = 0;
+            while (System.nanoTime() < deadlineNanos) {
+                int len = (64 * 1024) << (i % 5);
+                window[i % WINDOW] = new byte[len];
+                bytes += OBJECT_HEADER + 4 + len;
+                i++;
+            }
+            return bytes;
+        }
+    }
+
+    /**
+     * Churn with an explicit System.gc() every 100ms, to measure
+     * GC_EXPLICIT.
+     */
+    static class Explicit extends Workload {
+        private static final long PERIOD_NANOS = 100 * 1000000L;
+
+        Explicit() { super("explicit"); }
+
+        public long run(long deadlineNanos) {
+            Object[] window = new Object[1024];
+            long bytes = 0;
+            while (true) {
+                long sliceEnd = Math.min(System.nanoTime() + PERIOD_NANOS,
+                        deadlineNanos);
+                bytes += churn(sliceEnd, window);
+                if (sliceEnd >= deadlineNanos) {
+                    return bytes;
+                }
+                System.gc();
+            }
+        }
+    }
+
+    /**
+     * Churn on several threads at once.
+     */
+    static class ManyThreads extends Workload {
+        private final int mThreads;
+
+        ManyThreads(int threads) {
+            super("threads-" + threads);
+            mThreads = threads;
+        }
+
+        public long run(final long deadlineNanos) {
+            final long[] bytes = new long[mThreads];
+            ArrayList<Thread> threads = new ArrayList<Thread>();
+            for (int t = 0; t < mThreads; t++) {
+                final int index = t;
+                Thread thread = new Thread("vmbench-alloc-" + t) {
+                    public void run() {
+                        bytes[index] = churn(deadlineNanos, new Object[1024]);
+                    }
+                };
+                thread.start();
+                threads.add(thread);
+            }
+
+            long total = 0;
+            for (int t = 0; t < mThreads; t++) {
+                try {
+                    threads.get(t).join();
+                } catch (InterruptedException ie) {
+                    throw new RuntimeException(ie);
+                }
+                total += bytes[t];
+            }
+            return total;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.vmbench;
+
+import java.io.PrintStream;
+
+/**
+ * Times benchmarks and reports ns/op with a 95% confidence interval.
+ *
+ * Each benchmark is calibrated until one call to run() takes at least
+ * the target sample time, warmed up (which also gives the JIT a chance
+ * to compile the loop), and then sampled.  The interval uses Student's t
+ * for the number of samples, treating the samples as independent.
+ */
+public class Harness {
+    /* two-sided 95% t values for 1..30 degrees of freedom */
+    private static final double[] T_95 = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+        2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+        2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+        2.048, 2.045, 2.042
+    };
+    private static final double T_95_LARGE = 1.960;
+
+    private final PrintStream mOut;
+    private final int mSamples;
+    private final long mSampleNanos;
+    private final long mWarmupNanos;
+
+    public Harness(PrintStream out, int samples, long sampleMsec,
+            long warmupMsec) {
+        if (samples < 2) {
+            throw new IllegalArgumentException("need at least 2 samples");
+        }
+        mOut = out;
+        mSamples = samples;
+        mSampleNanos = sampleMsec * 1000000L;
+        mWarmupNanos = warmupMsec * 1000000L;
+    }
+
+    public void printHeader() {
+        mOut.println(String.format("%-28s %12s %10s %8s %10s",
+                "benchmark", "ns/op", "+/- 95%", "cv%", "reps"));
+    }
+
+    /**
+     * Runs one benchmark and prints its line.
+     */
+    public void measure(Benchmark b) {
+        if (!b.isAvailable()) {
+            mOut.println(String.format("%-28s %12s", b.getName(),
+                    "(unavailable)"));
+            return;
+        }
+
+        int reps = calibrate(b);
+
+        long warmupEnd = System.nanoTime() + mWarmupNanos;
+        while (System.nanoTime() < warmupEnd) {
+            b.run(reps);
+        }
+
+        double[] nsPerOp = new double[mSamples];
+        for (int i = 0; i < mSamples; i++) {
+            long start = System.nanoTime();
+            b.run(reps);
+            long elapsed = System.nanoTime() - start;
+            nsPerOp[i] = (double) elapsed / reps;
+        }
+
+        double mean = 0;
+        for (double v : nsPerOp) {
+            mean += v;
+        }
+        mean /= mSamples;
+
+        double var = 0;
+        for (double v : nsPerOp) {
+            var += (v - mean) * (v - mean);
+        }
+        var /= (mSamples - 1);
+        double stddev = Math.sqrt(var);
+
+        int dof = mSamples - 1;
+        double t = (dof <= T_95.length) ? T_95[dof - 1] : T_95_LARGE;
+        double halfWidth = t * stddev / Math.sqrt(mSamples);
+        double cv = (mean > 0) ? 100.0 * stddev / mean : 0;
+
+        mOut.println(String.format("%-28s %12.2f %10.2f %8.1f %10d",
+                b.getName(), mean, halfWidth, cv, reps));
+    }
+
+    /**
+     * Doubles the repetition count until a single run() takes at least
+     * the sample time.
+     */
+    private int calibrate(Benchmark b) {
+        int reps = 1;
+        while (true) {
+            long start = System.nanoTime();
+            b.run(reps);
+            long elapsed = System.nanoTime() - start;
+            if (elapsed >= mSampleNanos || reps >= (1 << 30)) {
+                break;
+            }
+            int factor = (elapsed < mSampleNanos / 16) ? 8 : 2;
+            reps = (int) Math.min((long) reps * factor, 1 << 30);
+        }
+        return reps;
+    }
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.vmbench;
+
+/**
+ * Kernels whose speed depends mostly on the quality of JIT output:
+ * tight array loops, call chains, field traffic, long and double math,
+ * and string processing.
+ */
+public class JitKernels {
+    private JitKernels() {}
+
+    public static Benchmark[] all() {
+        return new Benchmark[] {
+            new ArraySum(),
+            new ArrayCopyLoop(),
+            new ArrayReverse(),
+            new VirtualChain(),
+            new InterfaceChain(),
+            new FieldUpdate(),
+            new StaticFieldUpdate(),
+            new LongMath(),
+            new DoubleMath(),
+            new StringScan(),
+            new StringBuild(),
+        };
+    }
+
+    private static final int[] INTS = new int[1024];
+    static {
+        for (int i = 0; i < INTS.length; i++) {
+            INTS[i] = i * 7 + 3;
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      Array loops (per element)
+     * ===========================================================
+     */
+
+    static class ArraySum extends Benchmark {
+        ArraySum() { super("kernel-array-sum"); }
+        public void run(int reps) {
+            int[] a = INTS;
+            int sum = 0;
+            for (int r = 0, i = 0; r < reps; r++) {
+                sum += a[i];
+                i = (i + 1) & (1024 - 1);
+            }
+            sink = sum;
+        }
+    }
+
+    static class ArrayCopyLoop extends Benchmark {
+        private final int[] mDst = new int[1024];
+        ArrayCopyLoop() { super("kernel-array-copy-loop"); }
+        public void run(int reps) {
+            int[] src = INTS, dst = mDst;
+            for (int r = 0, i = 0; r < reps; r++) {
+                dst[i] = src[i] + 1;
+                i = (i + 1) & (1024 - 1);
+            }
+        }
+    }
+
+    static class ArrayReverse extends Benchmark {
+        private final int[] mData = INTS.clone();
+        ArrayReverse() { super("kernel-array-reverse"); }
+        public void run(int reps) {
+            int[] a = mData;
+            int n = a.length;
+            for (int r = 0, i = 0; r < reps; r++) {
+                int j = n - 1 - i;
+                int t = a[i];
+                a[i] = a[j];
+                a[j] = t;
+                i = (i + 1) & (512 - 1);
+            }
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      Call chains (per chain of four calls)
+     * ===========================================================
+     */
+
+    static class Link {
+        Link next;
+        int step(int x) {
+            return (next == null) ? x + 1 : next.step(x + 1);
+        }
+    }
+
+    static class OtherLink extends Link {
+        int step(int x) {
+            return (next == null) ? x + 2 : next.step(x + 2);
+        }
+    }
+
+    static Link makeChain() {
+        Link a = new Link(), b = new OtherLink(), c = new Link();
+        Link d = new OtherLink();
+        a.next = b;
+        b.next = c;
+        c.next = d;
+        return a;
+    }
+
+    static class VirtualChain extends Benchmark {
+        private final Link mHead = makeChain();
+        VirtualChain() { super("kernel-virtual-chain"); }
+        public void run(int reps) {
+            Link head = mHead;
+            int x = 0;
+            for (int r = 0; r < reps; r++) {
+                x = head.step(x);
+            }
+            sink = x;
+        }
+    }
+
+    interface Stage {
+        int apply(int x);
+    }
+
+    static class Scale implements Stage {
+        private final Stage mNext;
+        Scale(Stage next) { mNext = next; }
+        public int apply(int x) {
+            return (mNext == null) ? x * 3 : mNext.apply(x * 3);
+        }
+    }
+
+    static class Offset implements Stage {
+        private final Stage mNext;
+        Offset(Stage next) { mNext = next; }
+        public int apply(int x) {
+            return (mNext == null) ? x + 5 : mNext.apply(x + 5);
+        }
+    }
+
+    static class InterfaceChain extends Benchmark {
+        private final Stage mHead =
+                new Scale(new Offset(new Scale(new Offset(null))));
+        InterfaceChain() { super("kernel-interface-chain"); }
+        public void run(int reps) {
+            Stage head = mHead;
+            int x = 0;
+            for (int r = 0; r < reps; r++) {
+                x = head.apply(x);
+            }
+            sink = x;
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      Field access (per iteration)
+     * ===========================================================
+     */
+
+    static class Point {
+        int x, y;
+        long stamp;
+        double weight;
+    }
+
+    static class FieldUpdate extends Benchmark {
+        private final Point mPoint = new Point();
+        FieldUpdate() { super("kernel-field-update"); }
+        public void run(int reps) {
+            Point p = mPoint;
+            for (int r = 0; r < reps; r++) {
+                p.x += p.y;
+                p.y ^= r;
+                p.stamp += p.x;
+                p.weight += 0.5;
+            }
+            sink = p.x;
+        }
+    }
+
+    static int sX, sY;
+
+    static class StaticFieldUpdate extends Benchmark {
+        StaticFieldUpdate() { super("kernel-static-field-update"); }
+        public void run(int reps) {
+            for (int r = 0; r < reps; r++) {
+                sX += sY;
+                sY ^= r;
+            }
+            sink = sX;
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      Long and double math (per iteration)
+     * ===========================================================
+     */
+
+    static class LongMath extends Benchmark {
+        LongMath() { super("kernel-long-math"); }
+        public void run(int reps) {
+            long a = 0x123456789abcdefL, b = 7;
+            for (int r = 0; r < reps; r++) {
+                a = a * 6364136223846793005L + 1442695040888963407L;
+                b += (a >>> 17) ^ (a << 5);
+                b %= 1000000007L;
+            }
+            sink = (int) b;
+        }
+    }
+
+    static class DoubleMath extends Benchmark {
+        DoubleMath() { super("kernel-double-math"); }
+        public void run(int reps) {
+            double x = 1.0, y = 0.5;
+            for (int r = 0; r < reps; r++) {
+                x = x * 0.999 + y;
+                y = y / 1.0001 - x * 1e-6;
+            }
+            sink = (int) (x + y);
+        }
+    }
+
+    /*
+     * ===========================================================
+     *      String processing (per character)
+     * ===========================================================
+     */
+
+    private static final String TEXT =
+            "Lorem ipsum dolor sit amet, consectetur adipisicing elit, sed do "
+            + "eiusmod tempor incididunt ut labore et dolore magna aliqua.";
+
+    static class StringScan extends Benchmark {
+        StringScan() { super("kernel-string-scan"); }
+        public void run(int reps) {
+            String s = TEXT;
+            int len = s.length();
+            int vowels = 0;
+            for (int r = 0, i = 0; r < reps; r++) {
+                char c = s.charAt(i);
+                if (c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u') {
+                    vowels++;
+                }
+                if (++i == len) {
+                    i = 0;
+                }
+            }
+            sink = vowels;
+        }
+    }
+
+    static class StringBuild extends Benchmark {
+        StringBuild() { super("kernel-string-build"); }
+        public void run(int reps) {
+            StringBuilder sb = new StringBuilder(256);
+            String s = TEXT;
+            int len = s.length();
+            for (int r = 0, i = 0; r < reps; r++) {
+                sb.append(s.charAt(i));
+                if (++i == len) {
+                    i = 0;
+                    sb.setLength(0);
+                }
+            }
+            sink = sb.length();
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.vmbench;
+
+import java.io.PrintStream;
+import java.lang.reflect.Method;
+
+/**
+ * Reads the JIT's compilation telemetry through VMDebug.getJitStats(),
+ * looked up reflectively; see GcLog.
+ */
+public class JitStats {
+    /* layout of getJitStats() in vm/native/dalvik_system_VMDebug.cpp */
+    private static final int TELEMETRY_BUCKETS = 24;
+    private static final int CACHE_BASE = 11 + 2 * TELEMETRY_BUCKETS;
+    private static final int NUM_VALUES = CACHE_BASE + 3;
+
+    private final Method mGetStats;
+
+    public JitStats() {
+        Method get = null;
+        try {
+            Class<?> vmDebug = Class.forName("dalvik.system.VMDebug");
+            get = vmDebug.getDeclaredMethod("getJitStats", long[].class);
+            get.setAccessible(true);
+        } catch (Exception ex) {
+            get = null;
+        }
+        mGetStats = get;
+    }
+
+    /**
+     * Returns a snapshot, or null if the VM can't provide one.  A VM
+     * built without the JIT returns all zeros.
+     */
+    public long[] snapshot() {
+        if (mGetStats == null) {
+            return null;
+        }
+        long[] values = new long[NUM_VALUES];
+        try {
+            mGetStats.invoke(null, values);
+        } catch (Exception ex) {
+            throw new RuntimeException(ex);
+        }
+        return values;
+    }
+
+    /**
+     * Prints what changed between two snapshots, plus the current code
+     * cache fill.
+     */
+    public static void printDelta(PrintStream out, long[] before,
+            long[] after) {
+        if (before == null || after == null) {
+            out.println("jit: (stats need VMDebug.getJitStats)");
+            return;
+        }
+        out.println(String.format("jit: compiled=%d failed=%d "
+                + "code=%d bytes compile=%d usec (max %d)",
+                after[0] - before[0], after[1] - before[1],
+                after[2] - before[2], after[3] - before[3], after[4]));
+        out.println(String.format("jit: code cache %d/%d bytes, resets=%d",
+                after[CACHE_BASE], after[CACHE_BASE + 1],
+                after[CACHE_BASE + 2] - before[CACHE_BASE + 2]));
+    }
+}
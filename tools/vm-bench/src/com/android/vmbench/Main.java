@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.vmbench;
+
+/**
+ * Command-line entry point.
+ *
+ * Usage: Main [--suite micro|jit] [--samples N] [--sample-ms N]
+ *             [--warmup-ms N] [--list] [name-prefix ...]
+ *
+ * The "micro" suite (the default) times single VM operations; the "jit"
+ * suite times the JitKernels and then reports what the JIT compiled.
+ * With no names, runs every benchmark in the suite.
+ */
+public class Main {
+    private static void usage() {
+        System.err.println("usage: Main [--suite micro|jit] [--samples N] "
+                + "[--sample-ms N] [--warmup-ms N] [--list] "
+                + "[name-prefix ...]");
+        System.exit(2);
+    }
+
+    public static void main(String[] args) {
+        int samples = 10;
+        long sampleMsec = 100;
+        long warmupMsec = 500;
+        boolean list = false;
+        String suite = "micro";
+        int argIdx = 0;
+
+        try {
+            for (; argIdx < args.length; argIdx++) {
+                String arg = args[argIdx];
+                if (!arg.startsWith("--")) {
+                    break;
+                } else if (arg.equals("--suite")) {
+                    suite = args[++argIdx];
+                } else if (arg.equals("--samples")) {
+                    samples = Integer.parseInt(args[++argIdx]);
+                } else if (arg.equals("--sample-ms")) {
+                    sampleMsec = Long.parseLong(args[++argIdx]);
+                } else if (arg.equals("--warmup-ms")) {
+                    warmupMsec = Long.parseLong(args[++argIdx]);
+                } else if (arg.equals("--list")) {
+                    list = true;
+                } else {
+                    usage();
+                }
+            }
+        } catch (ArrayIndexOutOfBoundsException aioobe) {
+            usage();
+        } catch (NumberFormatException nfe) {
+            usage();
+        }
+
+        Benchmark[] benchmarks;
+        if (suite.equals("micro")) {
+            benchmarks = Benchmarks.all();
+        } else if (suite.equals("jit")) {
+            benchmarks = JitKernels.all();
+        } else {
+            usage();
+            return;
+        }
+        if (list) {
+            for (Benchmark b : benchmarks) {
+                System.out.println(b.getName());
+            }
+            return;
+        }
+
+        Harness harness = new Harness(System.out, samples, sampleMsec,
+                warmupMsec);
+        JitStats jitStats = new JitStats();
+        long[] before = jitStats.snapshot();
+        harness.printHeader();
+        for (Benchmark b : benchmarks) {
+            if (selected(b, args, argIdx)) {
+                harness.measure(b);
+            }
+        }
+        if (suite.equals("jit")) {
+            JitStats.printDelta(System.out, before, jitStats.snapshot());
+        }
+    }
+
+    private static boolean selected(Benchmark b, String[] args, int first) {
+        if (first == args.length) {
+            return true;
+        }
+        for (int i = first; i < args.length; i++) {
+            if (b.getName().startsWith(args[i])) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -36,6 +36,15 @@
  * references here to the root set (or just disable class unloading while
  * this is active).
  *
+ * With -Xallocsample (or a DDM request) we sample instead: each thread
+ * counts down a randomized number of bytes, about one sampling interval
+ * on average, and only the allocation that crosses zero is recorded.
+ * The randomization keeps allocation patterns with a fixed period from
+ * always hitting or always missing the same site.  Samples go into the
+ * ring as usual and are also aggregated by class and stack in a hash
+ * table with no size limit, so a long run still shows where the bytes
+ * went.  Threads between samples don't take the lock.
+ *
  * TODO: consider making the parameters configurable, so DDMS can decide
  * how many allocations it wants to see and what the stack depth should be.
  * Changing the window size is easy, changing the max stack depth is harder
@@ -43,9 +52,15 @@
  */
 #include "Dalvik.h"
 
+#include <limits.h>
+#include <math.h>
+
 #define kMaxAllocRecordStackDepth   16      /* max 255 */
 #define kNumAllocRecords            512     /* MUST be power of 2 */
 
+/* initial size of the sample table; it grows as needed */
+#define kInitialAllocSamples        256
+
 /*
  * Record the details of an allocation.
  */
@@ -69,6 +84,20 @@ struct AllocRecord {
     //u4      timestamp;
 };
 
+/*
+ * Aggregated samples for one class and allocating stack.
+ */
+struct AllocSampleEntry {
+    ClassObject*    clazz;
+    struct {
+        const Method* method;   /* NULL past the end of the stack */
+        int         pc;
+    } stackElem[kMaxAllocRecordStackDepth];
+
+    u4              count;      /* number of samples */
+    u8              bytes;      /* total size of the sampled allocations */
+};
+
 /*
  * Initialize a few things.  This gets called early, so keep activity to
  * a minimum.
@@ -90,6 +119,7 @@ bool dvmAllocTrackerStartup()
 void dvmAllocTrackerShutdown()
 {
     free(gDvm.allocRecords);
+    dvmHashTableFree(gDvm.allocSamples);
     dvmDestroyMutex(&gDvm.allocTrackerLock);
 }
 
@@ -122,10 +152,42 @@ bool dvmEnableAllocTracker()
             result = false;
     }
 
+    if (result && gDvm.allocSampleInterval != 0 &&
+        gDvm.allocSamples == NULL)
+    {
+        ALOGI("Sampling allocations every %d bytes",
+            gDvm.allocSampleInterval);
+        gDvm.allocSamples = dvmHashTableCreate(kInitialAllocSamples, free);
+        gDvm.allocSamplesDropped = 0;
+        if (gDvm.allocSamples == NULL)
+            result = false;
+    }
+
     dvmUnlockMutex(&gDvm.allocTrackerLock);
+    if (result) {
+        dvmRetireAllocBuffers();
+    }
     return result;
 }
 
+/*
+ * Switch to sampling one allocation per "intervalBytes" on average, or
+ * back to recording every allocation if it's zero, and enable tracking.
+ * Discards the samples aggregated so far.
+ *
+ * Returns "true" on success.
+ */
+bool dvmEnableAllocSampling(int intervalBytes)
+{
+    dvmLockMutex(&gDvm.allocTrackerLock);
+    gDvm.allocSampleInterval = intervalBytes;
+    dvmHashTableFree(gDvm.allocSamples);
+    gDvm.allocSamples = NULL;
+    dvmUnlockMutex(&gDvm.allocTrackerLock);
+
+    return dvmEnableAllocTracker();
+}
+
 /*
  * Disable allocation tracking.  Does nothing if tracking is not enabled.
  */
@@ -137,6 +199,8 @@ void dvmDisableAllocTracker()
         free(gDvm.allocRecords);
         gDvm.allocRecords = NULL;
     }
+    dvmHashTableFree(gDvm.allocSamples);
+    gDvm.allocSamples = NULL;
 
     dvmUnlockMutex(&gDvm.allocTrackerLock);
 }
@@ -181,6 +245,97 @@ static void getStackFrames(Thread* self, AllocRecord* pRec)
     }
 }
 
+/*
+ * Pick the number of bytes until the next sample.  The gaps are
+ * exponentially distributed with a mean of the sampling interval, which
+ * makes every byte allocated equally likely to be sampled.
+ */
+static int nextSampleGap(Thread* self, int interval)
+{
+    u4 x = self->allocSampleSeed;
+    if (x == 0)
+        x = (self->threadId * 2654435761u) | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    self->allocSampleSeed = x;
+
+    /* uniform in (0,1] */
+    double u = ((double) (x >> 8) + 1.0) / (double) (1 << 24);
+    double gap = -log(u) * interval;
+    if (gap < 1.0)
+        return 1;
+    if (gap > (double) (INT_MAX / 2))
+        return INT_MAX / 2;
+    return (int) gap;
+}
+
+static u4 hashSample(const AllocSampleEntry* pKey)
+{
+    u4 hash = (u4) pKey->clazz >> 3;
+
+    for (int i = 0; i < kMaxAllocRecordStackDepth; i++) {
+        if (pKey->stackElem[i].method == NULL)
+            break;
+        hash = hash * 31 + ((u4) pKey->stackElem[i].method >> 2);
+        hash = hash * 31 + pKey->stackElem[i].pc;
+    }
+    return hash;
+}
+
+static int compareSamples(const void* tableItem, const void* looseItem)
+{
+    const AllocSampleEntry* a = (const AllocSampleEntry*) tableItem;
+    const AllocSampleEntry* b = (const AllocSampleEntry*) looseItem;
+
+    if (a->clazz != b->clazz)
+        return 1;
+    for (int i = 0; i < kMaxAllocRecordStackDepth; i++) {
+        if (a->stackElem[i].method != b->stackElem[i].method ||
+            a->stackElem[i].pc != b->stackElem[i].pc)
+        {
+            return 1;
+        }
+        if (a->stackElem[i].method == NULL)
+            break;
+    }
+    return 0;
+}
+
+/*
+ * Charge a sampled allocation to the entry for its class and stack,
+ * adding the entry if needed.  Caller must hold allocTrackerLock.
+ */
+static void addSample(const AllocRecord* pRec)
+{
+    AllocSampleEntry key;
+
+    key.clazz = pRec->clazz;
+    for (int i = 0; i < kMaxAllocRecordStackDepth; i++) {
+        key.stackElem[i].method = pRec->stackElem[i].method;
+        key.stackElem[i].pc = pRec->stackElem[i].pc;
+    }
+    u4 hash = hashSample(&key);
+
+    AllocSampleEntry* pEntry = (AllocSampleEntry*)
+        dvmHashTableLookup(gDvm.allocSamples, hash, &key, compareSamples,
+            false);
+    if (pEntry == NULL) {
+        pEntry = (AllocSampleEntry*) malloc(sizeof(*pEntry));
+        if (pEntry == NULL) {
+            gDvm.allocSamplesDropped++;
+            return;
+        }
+        *pEntry = key;
+        pEntry->count = 0;
+        pEntry->bytes = 0;
+        dvmHashTableLookup(gDvm.allocSamples, hash, pEntry, compareSamples,
+            true);
+    }
+    pEntry->count++;
+    pEntry->bytes += pRec->size;
+}
+
 /*
  * Add a new allocation to the set.
  */
@@ -192,6 +347,18 @@ void dvmDoTrackAllocation(ClassObject* clazz, size_t size)
         return;
     }
 
+    /*
+     * When sampling, most allocations just count down; racing with a
+     * change of interval only costs one odd-sized gap.
+     */
+    int interval = gDvm.allocSampleInterval;
+    if (interval != 0) {
+        self->allocSampleBytesLeft -= (int) size;
+        if (self->allocSampleBytesLeft > 0)
+            return;
+        self->allocSampleBytesLeft = nextSampleGap(self, interval);
+    }
+
     dvmLockMutex(&gDvm.allocTrackerLock);
     if (gDvm.allocRecords == NULL) {
         dvmUnlockMutex(&gDvm.allocTrackerLock);
@@ -212,6 +379,9 @@ void dvmDoTrackAllocation(ClassObject* clazz, size_t size)
     if (gDvm.allocRecordCount < kNumAllocRecords)
         gDvm.allocRecordCount++;
 
+    if (gDvm.allocSamples != NULL)
+        addSample(pRec);
+
     dvmUnlockMutex(&gDvm.allocTrackerLock);
 }
 
@@ -589,6 +759,163 @@ bail:
     return result;
 }
 
+/*
+ * Sort samples by total bytes, largest first.
+ */
+static int compareSampleBytes(const void* vp1, const void* vp2)
+{
+    const AllocSampleEntry* p1 = *(const AllocSampleEntry**) vp1;
+    const AllocSampleEntry* p2 = *(const AllocSampleEntry**) vp2;
+
+    if (p1->bytes != p2->bytes)
+        return (p1->bytes < p2->bytes) ? 1 : -1;
+    return 0;
+}
+
+/*
+ * Store a string as a 2-byte big-endian length followed by its
+ * modified UTF-8 bytes.  Returns the number of bytes used.  With a NULL
+ * "buf", just computes the length.
+ */
+static size_t putString(u1* buf, const char* str)
+{
+    size_t len = strlen(str);
+
+    if (len > 0xffff)
+        len = 0xffff;
+    if (buf != NULL) {
+        set2BE(buf, len);
+        memcpy(buf + 2, str, len);
+    }
+    return 2 + len;
+}
+
+/*
+ * Write one sample entry to "buf", or just compute its size if "buf" is
+ * NULL.  See dvmDdmGenerateAllocSamples() for the layout.
+ */
+static size_t putSample(u1* buf, const AllocSampleEntry* pEntry)
+{
+    size_t len = 0;
+    int depth = 0;
+
+    while (depth < kMaxAllocRecordStackDepth &&
+           pEntry->stackElem[depth].method != NULL)
+    {
+        depth++;
+    }
+
+    if (buf != NULL) {
+        set4BE(buf + 0, pEntry->count);
+        set8BE(buf + 4, pEntry->bytes);
+        set1(buf + 12, depth);
+    }
+    len += 13;
+
+    len += putString(buf != NULL ? buf + len : NULL,
+        pEntry->clazz->descriptor);
+    for (int i = 0; i < depth; i++) {
+        const Method* method = pEntry->stackElem[i].method;
+        int lineNum = dvmIsNativeMethod(method) ? -2 :
+            dvmLineNumFromPC(method, pEntry->stackElem[i].pc);
+
+        len += putString(buf != NULL ? buf + len : NULL,
+            method->clazz->descriptor);
+        len += putString(buf != NULL ? buf + len : NULL, method->name);
+        if (buf != NULL)
+            set4BE(buf + len, lineNum);
+        len += 4;
+    }
+    return len;
+}
+
+/*
+ * Generate the contents of an ASMP chunk, the aggregated allocation
+ * samples.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) maximum stack depth
+ *  (4b) sampling interval, in bytes
+ *  (4b) number of entries
+ *  (4b) samples dropped for lack of memory
+ * Then, per entry, most bytes first:
+ *  (4b) number of samples
+ *  (8b) total size of the sampled allocations
+ *  (1b) stack depth
+ *  (str) class descriptor of the allocated object
+ *  per frame, innermost first:
+ *    (str) class descriptor
+ *    (str) method name
+ *    (4b) line number, -1 if unknown or -2 for native methods
+ *
+ * Strings are a 2-byte length followed by modified UTF-8.  An entry with
+ * N samples stands for roughly N times the interval in allocated bytes.
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure or if
+ * sampling is disabled.  The caller must call dvmReleaseTrackedAlloc()
+ * on the array.
+ */
+ArrayObject* dvmDdmGenerateAllocSamples()
+{
+    const int kHeaderLen = 14;
+
+    /*
+     * Build the data in a native buffer, since allocating on the managed
+     * heap would call back into the tracker while we hold its lock.
+     */
+    dvmLockMutex(&gDvm.allocTrackerLock);
+    if (gDvm.allocSamples == NULL) {
+        dvmUnlockMutex(&gDvm.allocTrackerLock);
+        return NULL;
+    }
+
+    int count = dvmHashTableNumEntries(gDvm.allocSamples);
+    AllocSampleEntry** sorted = (AllocSampleEntry**)
+        malloc(sizeof(*sorted) * (count + 1));
+    if (sorted == NULL) {
+        dvmUnlockMutex(&gDvm.allocTrackerLock);
+        return NULL;
+    }
+    int numSorted = 0;
+    HashIter iter;
+    for (dvmHashIterBegin(gDvm.allocSamples, &iter); !dvmHashIterDone(&iter);
+        dvmHashIterNext(&iter))
+    {
+        sorted[numSorted++] = (AllocSampleEntry*) dvmHashIterData(&iter);
+    }
+    assert(numSorted == count);
+    qsort(sorted, numSorted, sizeof(*sorted), compareSampleBytes);
+
+    size_t bufLen = kHeaderLen;
+    for (int i = 0; i < numSorted; i++)
+        bufLen += putSample(NULL, sorted[i]);
+
+    u1* data = (u1*) malloc(bufLen);
+    if (data == NULL) {
+        free(sorted);
+        dvmUnlockMutex(&gDvm.allocTrackerLock);
+        return NULL;
+    }
+    u1* buf = data;
+    set1(buf+0, kHeaderLen);
+    set1(buf+1, kMaxAllocRecordStackDepth);
+    set4BE(buf+2, gDvm.allocSampleInterval);
+    set4BE(buf+6, numSorted);
+    set4BE(buf+10, gDvm.allocSamplesDropped);
+    buf += kHeaderLen;
+    for (int i = 0; i < numSorted; i++)
+        buf += putSample(buf, sorted[i]);
+    free(sorted);
+    dvmUnlockMutex(&gDvm.allocTrackerLock);
+
+    ArrayObject* arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj != NULL)
+        memcpy(arrayObj->contents, data, bufLen);
+    free(data);
+    return arrayObj;
+}
+
 /*
  * Dump the tracked allocations to the log file.
  *
@@ -35,6 +35,13 @@ bool dvmEnableAllocTracker(void);
  */
 void dvmDisableAllocTracker(void);
 
+/*
+ * Sample about one allocation per "intervalBytes" instead of recording
+ * every one, or go back to recording everything if it's zero.  Enables
+ * tracking, and discards any samples aggregated before.
+ */
+bool dvmEnableAllocSampling(int intervalBytes);
+
 /*
  * If allocation tracking is enabled, add a new entry to the set.
  */
@@ -53,6 +60,13 @@ void dvmDoTrackAllocation(ClassObject* clazz, size_t size);
  */
 bool dvmGenerateTrackedAllocationReport(u1** pData, size_t* pDataLen);
 
+/*
+ * Generate a byte[] with the aggregated allocation samples for DDM, or
+ * NULL if sampling is disabled.  The caller must call
+ * dvmReleaseTrackedAlloc() on the array.
+ */
+ArrayObject* dvmDdmGenerateAllocSamples(void);
+
 /*
  * Dump the tracked allocations to the log file.  If "enable" is set, this
  * will enable tracking if it's not already on.
@@ -28,16 +28,28 @@
 #define NEED_MAC_QUASI_ATOMICS 1
 
 #elif defined(__i386__) || defined(__x86_64__)
+// cmpxchg8b is available on everything from the Pentium up.
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+#define NEED_GCC_SYNC_QUASI_ATOMICS 1
+#else
 #define NEED_PTHREADS_QUASI_ATOMICS 1
+#endif
 
 #elif defined(__mips__)
+// lld/scd only exist on 64-bit MIPS; the compiler knows which we have.
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+#define NEED_GCC_SYNC_QUASI_ATOMICS 1
+#else
 #define NEED_PTHREADS_QUASI_ATOMICS 1
+#endif
 
 #elif defined(__arm__)
 
 // TODO: Clang can not process our inline assembly at the moment.
 #if defined(__ARM_HAVE_LDREXD) && !defined(__clang__)
 #define NEED_ARM_LDREXD_QUASI_ATOMICS 1
+#elif defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+#define NEED_GCC_SYNC_QUASI_ATOMICS 1
 #else
 #define NEED_PTHREADS_QUASI_ATOMICS 1
 #endif
@@ -157,6 +169,53 @@ int64_t dvmQuasiAtomicRead64(volatile const int64_t* addr)
 
 /*****************************************************************************/
 
+#if NEED_GCC_SYNC_QUASI_ATOMICS
+
+// The compiler's __sync builtins expand to the native 64-bit CAS
+// (cmpxchg8b on i386, lld/scd on MIPS64, ldrexd/strexd on ARM) and are
+// full barriers.
+
+int dvmQuasiAtomicCas64(int64_t oldvalue, int64_t newvalue,
+    volatile int64_t* addr)
+{
+    return __sync_val_compare_and_swap(addr, oldvalue, newvalue) != oldvalue;
+}
+
+static inline int64_t dvmQuasiAtomicSwap64Body(int64_t value,
+                                               volatile int64_t* addr)
+{
+    int64_t oldValue;
+    do {
+        oldValue = *addr;
+    } while (dvmQuasiAtomicCas64(oldValue, value, addr));
+    return oldValue;
+}
+
+int64_t dvmQuasiAtomicSwap64(int64_t value, volatile int64_t* addr)
+{
+    return dvmQuasiAtomicSwap64Body(value, addr);
+}
+
+/* Same as dvmQuasiAtomicSwap64 - the CAS is a full barrier */
+int64_t dvmQuasiAtomicSwap64Sync(int64_t value, volatile int64_t* addr)
+{
+    return dvmQuasiAtomicSwap64Body(value, addr);
+}
+
+int64_t dvmQuasiAtomicRead64(volatile const int64_t* addr)
+{
+#if defined(__x86_64__) || (defined(__mips__) && _MIPS_SIM == _ABI64)
+    return *addr;
+#else
+    // A CAS that stores back what it finds is the only way to get a
+    // single-copy-atomic 64-bit load here.
+    return __sync_val_compare_and_swap((volatile int64_t*) addr, 0, 0);
+#endif
+}
+#endif
+
+/*****************************************************************************/
+
 #if NEED_PTHREADS_QUASI_ATOMICS
 
 // In the absence of a better implementation, we implement the 64-bit atomic
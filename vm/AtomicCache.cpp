@@ -21,6 +21,7 @@
 #include "Dalvik.h"
 
 #include <stdlib.h>
+#include <sched.h>
 
 /*
  * I think modern C mandates that the results of a boolean expression are
@@ -161,6 +162,36 @@ void dvmUpdateAtomicCache(u4 key1, u4 key2, u4 value, AtomicCacheEntry* pEntry,
     }
 }
 
+/*
+ * Remove all entries keyed on "key1".
+ *
+ * Unlike a lookup miss, we can't just give up when another thread holds
+ * the entry's write lock, because a stale entry would outlive its key.
+ * Writers only hold the lock for a handful of stores, so yield and retry.
+ */
+void dvmPurgeAtomicCacheKey1(AtomicCache* cache, u4 key1)
+{
+    if (cache == NULL || key1 == 0)
+        return;
+
+    for (int i = 0; i < cache->numEntries; i++) {
+        AtomicCacheEntry* pEntry = cache->entries + i;
+
+        while (true) {
+            u4 firstVersion =
+                android_atomic_acquire_load((int32_t*) &pEntry->version);
+            if (pEntry->key1 != key1 && (firstVersion & 0x01) == 0)
+                break;
+            if ((firstVersion & (ATOMIC_LOCK_FLAG | 0x01)) != 0) {
+                sched_yield();
+                continue;
+            }
+            dvmUpdateAtomicCache(0, 0, 0, pEntry, firstVersion
+                CACHE_XARG(cache));
+        }
+    }
+}
+
 
 /*
  * Dump the "instanceof" cache stats.
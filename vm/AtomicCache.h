@@ -165,6 +165,14 @@ void dvmUpdateAtomicCache(u4 key1, u4 key2, u4 value, AtomicCacheEntry* pEntry,
 #endif
     );
 
+/*
+ * Remove every entry whose first key is "key1".  Used when the object the
+ * key refers to is going away and its address may be recycled.
+ *
+ * This walks the whole cache, so it should only be used on rare events.
+ */
+void dvmPurgeAtomicCacheKey1(AtomicCache* cache, u4 key1);
+
 /*
  * Debugging.
  */
@@ -21,9 +21,117 @@
 
 #include <stdlib.h>
 #include <strings.h>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define kBitVectorGrowth    4   /* increase by 4 u4s when limit hit */
 
+/*
+ * The set operations below work on blocks of four words at a time, with
+ * NEON or SSE2 where available, and finish the odd words one at a time.
+ * The storage is only guaranteed to be word aligned, so the vector loads
+ * and stores are unaligned ones.
+ */
+#define kBlockWords         4
+
+/* dst = a | b */
+static inline void orWords(u4* dst, const u4* a, const u4* b, u4 count)
+{
+    u4 idx = 0;
+#if defined(__ARM_NEON__)
+    for (; idx + kBlockWords <= count; idx += kBlockWords) {
+        vst1q_u32(dst + idx, vorrq_u32(vld1q_u32(a + idx), vld1q_u32(b + idx)));
+    }
+#elif defined(__SSE2__)
+    for (; idx + kBlockWords <= count; idx += kBlockWords) {
+        _mm_storeu_si128((__m128i*) (dst + idx),
+            _mm_or_si128(_mm_loadu_si128((const __m128i*) (a + idx)),
+                         _mm_loadu_si128((const __m128i*) (b + idx))));
+    }
+#endif
+    for (; idx < count; idx++) {
+        dst[idx] = a[idx] | b[idx];
+    }
+}
+
+/* dst = a & b */
+static inline void andWords(u4* dst, const u4* a, const u4* b, u4 count)
+{
+    u4 idx = 0;
+#if defined(__ARM_NEON__)
+    for (; idx + kBlockWords <= count; idx += kBlockWords) {
+        vst1q_u32(dst + idx, vandq_u32(vld1q_u32(a + idx), vld1q_u32(b + idx)));
+    }
+#elif defined(__SSE2__)
+    for (; idx + kBlockWords <= count; idx += kBlockWords) {
+        _mm_storeu_si128((__m128i*) (dst + idx),
+            _mm_and_si128(_mm_loadu_si128((const __m128i*) (a + idx)),
+                          _mm_loadu_si128((const __m128i*) (b + idx))));
+    }
+#endif
+    for (; idx < count; idx++) {
+        dst[idx] = a[idx] & b[idx];
+    }
+}
+
+/* dst = a & ~b */
+static inline void andNotWords(u4* dst, const u4* a, const u4* b, u4 count)
+{
+    u4 idx = 0;
+#if defined(__ARM_NEON__)
+    for (; idx + kBlockWords <= count; idx += kBlockWords) {
+        vst1q_u32(dst + idx, vbicq_u32(vld1q_u32(a + idx), vld1q_u32(b + idx)));
+    }
+#elif defined(__SSE2__)
+    for (; idx + kBlockWords <= count; idx += kBlockWords) {
+        _mm_storeu_si128((__m128i*) (dst + idx),
+            _mm_andnot_si128(_mm_loadu_si128((const __m128i*) (b + idx)),
+                             _mm_loadu_si128((const __m128i*) (a + idx))));
+    }
+#endif
+    for (; idx < count; idx++) {
+        dst[idx] = a[idx] & ~b[idx];
+    }
+}
+
+/*
+ * dst |= src.  Returns true if any bit of "dst" changed, which is the case
+ * iff "src" has a bit that "dst" lacks.  The check doesn't branch per word.
+ */
+static inline bool mergeWords(u4* dst, const u4* src, u4 count)
+{
+    u4 idx = 0;
+    u4 added = 0;
+#if defined(__ARM_NEON__)
+    uint32x4_t vadded = vdupq_n_u32(0);
+    for (; idx + kBlockWords <= count; idx += kBlockWords) {
+        uint32x4_t d = vld1q_u32(dst + idx);
+        uint32x4_t s = vld1q_u32(src + idx);
+        vadded = vorrq_u32(vadded, vbicq_u32(s, d));
+        vst1q_u32(dst + idx, vorrq_u32(d, s));
+    }
+    uint32x2_t w = vorr_u32(vget_low_u32(vadded), vget_high_u32(vadded));
+    added = vget_lane_u32(w, 0) | vget_lane_u32(w, 1);
+#elif defined(__SSE2__)
+    __m128i vadded = _mm_setzero_si128();
+    for (; idx + kBlockWords <= count; idx += kBlockWords) {
+        __m128i d = _mm_loadu_si128((const __m128i*) (dst + idx));
+        __m128i s = _mm_loadu_si128((const __m128i*) (src + idx));
+        vadded = _mm_or_si128(vadded, _mm_andnot_si128(d, s));
+        _mm_storeu_si128((__m128i*) (dst + idx), _mm_or_si128(d, s));
+    }
+    added = _mm_movemask_epi8(_mm_cmpeq_epi8(vadded, _mm_setzero_si128())) != 0xffff;
+#endif
+    for (; idx < count; idx++) {
+        added |= src[idx] & ~dst[idx];
+        dst[idx] |= src[idx];
+    }
+    return added != 0;
+}
+
 
 /*
  * Allocate a bit vector with enough space to hold at least the specified
@@ -181,19 +289,7 @@ int dvmCountSetBits(const BitVector* pBits)
     unsigned int count = 0;
 
     for (word = 0; word < pBits->storageSize; word++) {
-        u4 val = pBits->storage[word];
-
-        if (val != 0) {
-            if (val == 0xffffffff) {
-                count += 32;
-            } else {
-                /* count the number of '1' bits */
-                while (val != 0) {
-                    val &= val - 1;
-                    count++;
-                }
-            }
-        }
+        count += __builtin_popcount(pBits->storage[word]);
     }
 
     return count;
@@ -235,10 +331,7 @@ bool dvmIntersectBitVectors(BitVector *dest, const BitVector *src1,
         dest->expandable != src2->expandable)
         return false;
 
-    unsigned int idx;
-    for (idx = 0; idx < dest->storageSize; idx++) {
-        dest->storage[idx] = src1->storage[idx] & src2->storage[idx];
-    }
+    andWords(dest->storage, src1->storage, src2->storage, dest->storageSize);
     return true;
 }
 
@@ -254,10 +347,23 @@ bool dvmUnifyBitVectors(BitVector *dest, const BitVector *src1,
         dest->expandable != src2->expandable)
         return false;
 
-    unsigned int idx;
-    for (idx = 0; idx < dest->storageSize; idx++) {
-        dest->storage[idx] = src1->storage[idx] | src2->storage[idx];
-    }
+    orWords(dest->storage, src1->storage, src2->storage, dest->storageSize);
+    return true;
+}
+
+/*
+ * Subtract "src2" from "src1" and store the result to the dest vector.
+ */
+bool dvmSubtractBitVectors(BitVector *dest, const BitVector *src1,
+                           const BitVector *src2)
+{
+    if (dest->storageSize != src1->storageSize ||
+        dest->storageSize != src2->storageSize ||
+        dest->expandable != src1->expandable ||
+        dest->expandable != src2->expandable)
+        return false;
+
+    andNotWords(dest->storage, src1->storage, src2->storage, dest->storageSize);
     return true;
 }
 
@@ -294,16 +400,21 @@ int dvmBitVectorIteratorNext(BitVectorIterator* iterator)
     assert(iterator->bitSize == pBits->storageSize * sizeof(u4) * 8);
     if (bitIndex >= iterator->bitSize) return -1;
 
-    for (; bitIndex < iterator->bitSize; bitIndex++) {
-        unsigned int wordIndex = bitIndex >> 5;
-        unsigned int mask = 1 << (bitIndex & 0x1f);
-        if (pBits->storage[wordIndex] & mask) {
-            iterator->idx = bitIndex+1;
-            return bitIndex;
+    /* Mask off the bits below bitIndex, then skip whole zero words */
+    unsigned int wordIndex = bitIndex >> 5;
+    unsigned int numWords = iterator->bitSize >> 5;
+    u4 word = pBits->storage[wordIndex] & (~0U << (bitIndex & 0x1f));
+    while (word == 0) {
+        if (++wordIndex >= numWords) {
+            /* No more set bits */
+            iterator->idx = iterator->bitSize;
+            return -1;
         }
+        word = pBits->storage[wordIndex];
     }
-    /* No more set bits */
-    return -1;
+    bitIndex = (wordIndex << 5) + __builtin_ctz(word);
+    iterator->idx = bitIndex + 1;
+    return bitIndex;
 }
 
 
@@ -315,18 +426,7 @@ int dvmBitVectorIteratorNext(BitVectorIterator* iterator)
  */
 bool dvmCheckMergeBitVectors(BitVector* dst, const BitVector* src)
 {
-    bool changed = false;
-
     checkSizes(dst, src);
 
-    unsigned int idx;
-    for (idx = 0; idx < dst->storageSize; idx++) {
-        u4 merged = src->storage[idx] | dst->storage[idx];
-        if (dst->storage[idx] != merged) {
-            dst->storage[idx] = merged;
-            changed = true;
-        }
-    }
-
-    return changed;
+    return mergeWords(dst->storage, src->storage, dst->storageSize);
 }
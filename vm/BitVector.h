@@ -32,7 +32,10 @@ struct BitVector {
     u4*     storage;
 };
 
-/* Handy iterator to walk through the bit positions set to 1 */
+/*
+ * Handy iterator to walk through the bit positions set to 1.  It skips
+ * over a zero word at a time, so sparse vectors are cheap to walk.
+ */
 struct BitVectorIterator {
     BitVector *pBits;
     u4 idx;
@@ -81,6 +84,12 @@ bool dvmIntersectBitVectors(BitVector *dest, const BitVector *src1,
 bool dvmUnifyBitVectors(BitVector *dest, const BitVector *src1,
                         const BitVector *src2);
 
+/*
+ * Store the bits of "src1" that are not in "src2" to the dest vector.
+ */
+bool dvmSubtractBitVectors(BitVector *dest, const BitVector *src1,
+                           const BitVector *src2);
+
 /*
  * Merge the contents of "src" into "dst", checking to see if this causes
  * any changes to occur.
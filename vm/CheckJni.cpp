@@ -143,7 +143,7 @@ void dvmCheckCallJNIMethod(const u4* args, JValue* pResult,
     const Method* method, Thread* self)
 {
     dvmCallJNIMethod(args, pResult, method, self);
-    if (callNeedsCheck(args, pResult, method, self)) {
+    if (!gDvmJni.checkJniLight && callNeedsCheck(args, pResult, method, self)) {
         checkCallResultCommon(args, pResult, method, self);
     }
 }
@@ -202,17 +202,39 @@ static const char* indirectRefKindName(IndirectRef iref)
     return indirectRefKindToString(indirectRefKind(iref));
 }
 
+/*
+ * Decide whether this call to a JNI function gets the full argument checks.
+ * "pCallCount" counts the calls to that function.  The count is bumped
+ * without synchronization; a lost update only shifts which call is picked.
+ */
+static bool sampleCall(u4* pCallCount) {
+    if (gDvmJni.checkJniLight) {
+        return false;
+    }
+    u4 interval = gDvmJni.checkJniSampleInterval;
+    if (interval <= 1) {
+        return true;
+    }
+    return ((*pCallCount)++ % interval) == 0;
+}
+
 class ScopedCheck {
 public:
-    // For JNIEnv* functions.
-    explicit ScopedCheck(JNIEnv* env, int flags, const char* functionName) {
+    // For JNIEnv* functions.  The thread, critical section and pending
+    // exception checks are cheap and run on every call; the argument checks
+    // only run on the calls picked by -Xjniopts:sample=N, and never with
+    // -Xjniopts:light.
+    explicit ScopedCheck(JNIEnv* env, int flags, const char* functionName,
+            u4* pCallCount) {
         init(env, flags, functionName, true);
+        mCheckArgs = sampleCall(pCallCount);
         checkThread(flags);
     }
 
     // For JavaVM* functions.
     explicit ScopedCheck(bool hasMethod, const char* functionName) {
         init(NULL, kFlag_Invocation, functionName, hasMethod);
+        mCheckArgs = true;
     }
 
     /*
@@ -229,6 +251,9 @@ public:
      * "[Ljava/lang/Object;".
      */
     void checkClassName(const char* className) {
+        if (!mCheckArgs) {
+            return;
+        }
         if (!dexIsValidClassName(className, false)) {
             ALOGW("JNI WARNING: illegal class name '%s' (%s)", className, mFunctionName);
             ALOGW("             (should be formed like 'dalvik/system/DexFile')");
@@ -238,6 +263,9 @@ public:
     }
 
     void checkFieldTypeForGet(jfieldID fid, const char* expectedSignature, bool isStatic) {
+        if (!mCheckArgs) {
+            return;
+        }
         if (fid == NULL) {
             ALOGW("JNI WARNING: null jfieldID");
             showLocation();
@@ -281,6 +309,9 @@ public:
      * Works for both static and instance fields.
      */
     void checkFieldTypeForSet(jobject jobj, jfieldID fieldID, PrimitiveType prim, bool isStatic) {
+        if (!mCheckArgs) {
+            return;
+        }
         if (fieldID == NULL) {
             ALOGW("JNI WARNING: null jfieldID");
             showLocation();
@@ -339,6 +370,9 @@ public:
      * Assumes "jobj" has already been validated.
      */
     void checkInstanceFieldID(jobject jobj, jfieldID fieldID) {
+        if (!mCheckArgs) {
+            return;
+        }
         ScopedCheckJniThreadState ts(mEnv);
 
         Object* obj = dvmDecodeIndirectRef(self(), jobj);
@@ -382,6 +416,9 @@ public:
      * 'expectedType' will be "L" for all objects, including arrays.
      */
     void checkSig(jmethodID methodID, const char* expectedType, bool isStatic) {
+        if (!mCheckArgs) {
+            return;
+        }
         const Method* method = (const Method*) methodID;
         bool printWarn = false;
 
@@ -412,6 +449,9 @@ public:
      * Assumes "jclazz" has already been validated.
      */
     void checkStaticFieldID(jclass jclazz, jfieldID fieldID) {
+        if (!mCheckArgs) {
+            return;
+        }
         ScopedCheckJniThreadState ts(mEnv);
         ClassObject* clazz = (ClassObject*) dvmDecodeIndirectRef(self(), jclazz);
         StaticField* base = &clazz->sfields[0];
@@ -435,6 +475,9 @@ public:
      * Instances of "jclazz" must be instances of the method's declaring class.
      */
     void checkStaticMethod(jclass jclazz, jmethodID methodID) {
+        if (!mCheckArgs) {
+            return;
+        }
         ScopedCheckJniThreadState ts(mEnv);
 
         ClassObject* clazz = (ClassObject*) dvmDecodeIndirectRef(self(), jclazz);
@@ -456,6 +499,9 @@ public:
      * will be handled automatically by the instanceof check.)
      */
     void checkVirtualMethod(jobject jobj, jmethodID methodID) {
+        if (!mCheckArgs) {
+            return;
+        }
         ScopedCheckJniThreadState ts(mEnv);
 
         Object* obj = dvmDecodeIndirectRef(self(), jobj);
@@ -662,8 +708,8 @@ public:
             }
         }
 
-        // We always do the thorough checks on entry, and never on exit...
-        if (entry) {
+        // We do the thorough checks on entry, when this call was picked, and never on exit...
+        if (entry && mCheckArgs) {
             va_start(ap, fmt0);
             for (const char* fmt = fmt0; *fmt; ++fmt) {
                 char ch = *fmt;
@@ -712,6 +758,7 @@ private:
     const char* mFunctionName;
     int mFlags;
     bool mHasMethod;
+    bool mCheckArgs;
     size_t mIndent;
 
     void init(JNIEnv* env, int flags, const char* functionName, bool hasMethod) {
@@ -1309,7 +1356,8 @@ static void* releaseGuardedPACopy(JNIEnv* env, jarray jarr, void* dataBuf, int m
  */
 
 #define CHECK_JNI_ENTRY(flags, types, args...) \
-    ScopedCheck sc(env, flags, __FUNCTION__); \
+    static u4 _callCount; \
+    ScopedCheck sc(env, flags, __FUNCTION__, &_callCount); \
     sc.check(true, types, ##args)
 
 #define CHECK_JNI_EXIT(type, exp) ({ \
@@ -57,6 +57,7 @@
 #include "alloc/Alloc.h"
 #include "alloc/CardTable.h"
 #include "alloc/HeapDebug.h"
+#include "alloc/HeapHistogram.h"
 #include "alloc/WriteBarrier.h"
 #include "oo/AccessCheck.h"
 #include "JarFile.h"
@@ -66,12 +67,16 @@
 #include "JniInternal.h"
 #include "LinearAlloc.h"
 #include "analysis/DexVerify.h"
+#include "analysis/BackgroundVerify.h"
 #include "analysis/DexPrepare.h"
 #include "analysis/RegisterMap.h"
 #include "Init.h"
 #include "libdex/DexOpcodes.h"
 #include "libdex/InstrUtils.h"
 #include "AllocTracker.h"
+#include "LockProfiler.h"
+#include "SamplingProfiler.h"
+#include "VmMetrics.h"
 #include "PointerSet.h"
 #if defined(WITH_JIT)
 #include "compiler/Compiler.h"
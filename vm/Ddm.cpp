@@ -418,6 +418,279 @@ ArrayObject* dvmDdmGenerateThreadStats()
     return arrayObj;
 }
 
+/*
+ * Generate the contents of a GCPH chunk, the histograms of how long
+ * each phase of the garbage collections so far has taken.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) bytes per entry
+ *  (1b) phase count
+ *  (1b) buckets per phase
+ * Then, for each phase, in GcPhase order:
+ *  (4b) number of times the phase ran
+ *  (8b) total time, in usec
+ *  (4b) longest time, in usec
+ *  (4b) per bucket, the count of times in [2^(i-1), 2^i) usec
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure.  The
+ * caller must call dvmReleaseTrackedAlloc() on the array.
+ */
+ArrayObject* dvmDdmGenerateGcPhaseStats()
+{
+    const int kHeaderLen = 4;
+    const int kBytesPerEntry = 16 + 4 * GC_PHASE_HISTOGRAM_BUCKETS;
+
+    GcPhaseHistogram histograms[kGcPhaseCount];
+    dvmGetGcPhaseHistograms(histograms);
+
+    int bufLen = kHeaderLen + kGcPhaseCount * kBytesPerEntry;
+    ArrayObject* arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj == NULL)
+        return NULL;
+    u1* buf = (u1*) arrayObj->contents;
+
+    set1(buf+0, kHeaderLen);
+    set1(buf+1, kBytesPerEntry);
+    set1(buf+2, kGcPhaseCount);
+    set1(buf+3, GC_PHASE_HISTOGRAM_BUCKETS);
+    buf += kHeaderLen;
+
+    for (int i = 0; i < kGcPhaseCount; i++) {
+        const GcPhaseHistogram* hist = &histograms[i];
+        set4BE(buf+0, hist->count);
+        set8BE(buf+4, hist->totalUsec);
+        set4BE(buf+12, hist->maxUsec);
+        for (int j = 0; j < GC_PHASE_HISTOGRAM_BUCKETS; j++)
+            set4BE(buf+16 + j*4, hist->buckets[j]);
+        buf += kBytesPerEntry;
+    }
+    return arrayObj;
+}
+
+/*
+ * Generate the contents of a JITS chunk, the live JIT compilation
+ * telemetry.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) buckets per histogram
+ *  (2b) reserved
+ * Then:
+ *  (4b) translations installed
+ *  (4b) requests that bailed out or were dropped
+ *  (8b) code cache bytes taken by the translations
+ *  (8b) total compile time, in usec
+ *  (4b) longest compile time, in usec
+ *  (8b) total time requests spent queued, in usec
+ *  (4b) longest queue wait, in usec
+ *  (4b) requests queued right now
+ *  (4b) punts to the interpreter, or -1 if not counted in this build
+ *  (4b) unchained exits, or -1 if not counted in this build
+ *  (4b) self-verification failures, or -1 if not counted in this build
+ *  (4b) per bucket, the count of compile times in [2^(i-1), 2^i) usec
+ *  (4b) per bucket, the count of queue waits in [2^(i-1), 2^i) usec
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure or if the
+ * VM was built without the JIT.  The caller must call
+ * dvmReleaseTrackedAlloc() on the array.
+ */
+ArrayObject* dvmDdmGenerateJitStats()
+{
+#if defined(WITH_JIT)
+    const int kHeaderLen = 4;
+    const int kFixedLen = 56;
+
+    JitTelemetry telemetry;
+    dvmCompilerGetTelemetry(&telemetry);
+
+    int bufLen = kHeaderLen + kFixedLen + 2 * 4 * JIT_TELEMETRY_BUCKETS;
+    ArrayObject* arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj == NULL)
+        return NULL;
+    u1* buf = (u1*) arrayObj->contents;
+
+    set1(buf+0, kHeaderLen);
+    set1(buf+1, JIT_TELEMETRY_BUCKETS);
+    set2BE(buf+2, 0);
+    buf += kHeaderLen;
+
+    set4BE(buf+0, telemetry.numCompiled);
+    set4BE(buf+4, telemetry.numFailed);
+    set8BE(buf+8, telemetry.codeBytes);
+    set8BE(buf+16, telemetry.compileUsec);
+    set4BE(buf+24, telemetry.maxCompileUsec);
+    set8BE(buf+28, telemetry.queueWaitUsec);
+    set4BE(buf+36, telemetry.maxQueueWaitUsec);
+    set4BE(buf+40, telemetry.queueLength);
+    set4BE(buf+44, telemetry.numPunts);
+    set4BE(buf+48, telemetry.numNoChainExits);
+    set4BE(buf+52, telemetry.numSelfVerificationFailures);
+    buf += kFixedLen;
+
+    for (int i = 0; i < JIT_TELEMETRY_BUCKETS; i++)
+        set4BE(buf + i*4, telemetry.compileBuckets[i]);
+    buf += 4 * JIT_TELEMETRY_BUCKETS;
+    for (int i = 0; i < JIT_TELEMETRY_BUCKETS; i++)
+        set4BE(buf + i*4, telemetry.queueWaitBuckets[i]);
+    return arrayObj;
+#else
+    return NULL;
+#endif
+}
+
+/*
+ * Generate the contents of a VMMT chunk, the always-on VM counters.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) format version, currently 1
+ *  (2b) number of counters
+ * Then, per counter in VmMetric order:
+ *  (8b) value
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure.  The
+ * caller must call dvmReleaseTrackedAlloc() on the array.
+ */
+ArrayObject* dvmDdmGenerateVmMetrics()
+{
+    const int kHeaderLen = 4;
+
+    u8 values[kVmMetricCount];
+    dvmGetVmMetrics(values);
+
+    int bufLen = kHeaderLen + 8 * kVmMetricCount;
+    ArrayObject* arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj == NULL)
+        return NULL;
+    u1* buf = (u1*) arrayObj->contents;
+
+    set1(buf+0, kHeaderLen);
+    set1(buf+1, 1);
+    set2BE(buf+2, kVmMetricCount);
+    buf += kHeaderLen;
+
+    for (int i = 0; i < kVmMetricCount; i++)
+        set8BE(buf + i*8, values[i]);
+    return arrayObj;
+}
+
+/*
+ * Generate the contents of a THAL chunk, what each thread has allocated
+ * since it started.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) bytes per entry
+ *  (2b) thread count
+ * Then, per thread:
+ *  (4b) thread id
+ *  (8b) objects allocated
+ *  (8b) bytes allocated
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure.  The
+ * caller must call dvmReleaseTrackedAlloc() on the array.
+ */
+ArrayObject* dvmDdmGenerateThreadAllocStats()
+{
+    const int kHeaderLen = 4;
+    const int kBytesPerEntry = 20;
+
+    dvmLockThreadList(NULL);
+
+    Thread* thread;
+    int threadCount = 0;
+    for (thread = gDvm.threadList; thread != NULL; thread = thread->next)
+        threadCount++;
+
+    /* no heap allocation with the thread list lock held, as above */
+    int bufLen = kHeaderLen + threadCount * kBytesPerEntry;
+    u1 tmpBuf[bufLen];
+    u1* buf = tmpBuf;
+
+    set1(buf+0, kHeaderLen);
+    set1(buf+1, kBytesPerEntry);
+    set2BE(buf+2, (u2) threadCount);
+    buf += kHeaderLen;
+
+    for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        set4BE(buf+0, thread->threadId);
+        set8BE(buf+4, dvmGetThreadMetric(thread, kThreadMetricAllocObjects));
+        set8BE(buf+12, dvmGetThreadMetric(thread, kThreadMetricAllocBytes));
+        buf += kBytesPerEntry;
+    }
+    dvmUnlockThreadList();
+
+    ArrayObject* arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj != NULL)
+        memcpy(arrayObj->contents, tmpBuf, bufLen);
+    return arrayObj;
+}
+
+/*
+ * Generate the contents of a CLUS chunk, the live heap usage of each
+ * class loader as of the last collection that measured it.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) format version, currently 1
+ *  (2b) number of loaders
+ * Then, per loader:
+ *  (4b) identity hash code of the loader, 0 for the boot class path
+ *  (8b) live objects
+ *  (8b) live bytes
+ *  (str) descriptor of the loader's class, empty for the boot class path
+ *
+ * Strings are a 2-byte length followed by modified UTF-8.
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure.  The
+ * caller must call dvmReleaseTrackedAlloc() on the array.
+ */
+ArrayObject* dvmDdmGenerateLoaderUsage()
+{
+    const int kHeaderLen = 4;
+    const int kEntryLen = 20;
+
+    size_t numLoaders;
+    VmLoaderUsage* usage = dvmCopyLoaderUsage(&numLoaders);
+    size_t count = MIN(numLoaders, 0xffff);
+
+    size_t bufLen = kHeaderLen;
+    for (size_t i = 0; i < count; i++) {
+        if (usage[i].loader != NULL) {
+            size_t len = strlen(usage[i].loader->clazz->descriptor);
+            bufLen += MIN(len, 0xffff);
+        }
+        bufLen += kEntryLen + 2;
+    }
+
+    ArrayObject* arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj != NULL) {
+        u1* buf = (u1*) arrayObj->contents;
+        set1(buf+0, kHeaderLen);
+        set1(buf+1, 1);
+        set2BE(buf+2, count);
+        buf += kHeaderLen;
+        for (size_t i = 0; i < count; i++) {
+            Object* loader = usage[i].loader;
+            const char* descriptor =
+                (loader != NULL) ? loader->clazz->descriptor : "";
+            size_t len = MIN(strlen(descriptor), 0xffff);
+
+            set4BE(buf+0, dvmIdentityHashCode(loader));
+            set8BE(buf+4, usage[i].liveObjects);
+            set8BE(buf+12, usage[i].liveBytes);
+            set2BE(buf+20, len);
+            memcpy(buf+22, descriptor, len);
+            buf += kEntryLen + 2 + len;
+        }
+        assert(buf == (u1*) arrayObj->contents + bufLen);
+    }
+
+    dvmFreeLoaderUsage(usage, numLoaders);
+    return arrayObj;
+}
+
 
 /*
  * Find the specified thread and return its stack trace as an array of
@@ -431,10 +704,7 @@ ArrayObject* dvmDdmGetStackTraceById(u4 threadId)
 
     dvmLockThreadList(self);
 
-    for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
-        if (thread->threadId == threadId)
-            break;
-    }
+    thread = dvmGetThreadByThreadId(threadId);
     if (thread == NULL) {
         ALOGI("dvmDdmGetStackTraceById: threadid=%d not found", threadId);
         dvmUnlockThreadList();
@@ -442,16 +712,11 @@ ArrayObject* dvmDdmGetStackTraceById(u4 threadId)
     }
 
     /*
-     * Suspend the thread, pull out the stack trace, then resume the thread
-     * and release the thread list lock.  If we're being asked to examine
-     * our own stack trace, skip the suspend/resume.
+     * Pull out the stack trace at the thread's next safe point, then
+     * release the thread list lock.
      */
     size_t stackDepth;
-    if (thread != self)
-        dvmSuspendThread(thread);
-    traceBuf = dvmFillInStackTraceRaw(thread, &stackDepth);
-    if (thread != self)
-        dvmResumeThread(thread);
+    traceBuf = dvmFillInThreadStackTraceRaw(thread, &stackDepth);
     dvmUnlockThreadList();
 
     /*
@@ -56,6 +56,33 @@ void dvmDdmSendThreadNameChange(int threadId, StringObject* newName);
  */
 ArrayObject* dvmDdmGenerateThreadStats(void);
 
+/*
+ * Generate a byte[] full of GC phase timing histograms for a GCPH packet.
+ */
+ArrayObject* dvmDdmGenerateGcPhaseStats(void);
+
+/*
+ * Generate a byte[] full of JIT compilation telemetry for a JITS packet.
+ */
+ArrayObject* dvmDdmGenerateJitStats(void);
+
+/*
+ * Generate a byte[] with the always-on VM counters for a VMMT packet.
+ */
+ArrayObject* dvmDdmGenerateVmMetrics(void);
+
+/*
+ * Generate a byte[] with the allocation counts of each thread for a THAL
+ * packet.
+ */
+ArrayObject* dvmDdmGenerateThreadAllocStats(void);
+
+/*
+ * Generate a byte[] with the live heap usage of each class loader for a
+ * CLUS packet.
+ */
+ArrayObject* dvmDdmGenerateLoaderUsage(void);
+
 /*
  * Let the heap know that the HPIF when value has changed.
  *
@@ -72,6 +99,12 @@ bool dvmDdmHandleHpifChunk(int when);
  */
 bool dvmDdmHandleHpsgNhsgChunk(int when, int what, bool native);
 
+/*
+ * Stop the thread that sends heap segments, and free the state kept to
+ * report only the changes.
+ */
+void dvmDdmHeapShutdown(void);
+
 /*
  * Get an array of StackTraceElement objects for the specified thread.
  */
@@ -398,12 +398,80 @@ void dvmDbgActive()
     ALOGI("Debugger is active");
     dvmInitBreakpoints();
     gDvm.debuggerActive = true;
-    dvmEnableAllSubMode(kSubModeDebuggerActive);
+}
+
+/*
+ * Turn instruction-level checks on or off for all threads.
+ */
+static void setDebuggerWatching(bool watching)
+{
+    if (watching == gDvm.debuggerWatching)
+        return;
+
+    gDvm.debuggerWatching = watching;
+    if (watching) {
+        dvmEnableAllSubMode(kSubModeDebuggerActive);
+    } else {
+        dvmDisableAllSubMode(kSubModeDebuggerActive);
+        /*
+         * A step in progress still needs its thread watched.  The step
+         * may outlive its thread, so only trust the pointer if the
+         * thread is still on the list.
+         */
+        dvmLockThreadList(NULL);
+        if (gDvm.stepControl.active) {
+            for (Thread* thread = gDvm.threadList; thread != NULL;
+                 thread = thread->next)
+            {
+                if (thread == gDvm.stepControl.thread) {
+                    dvmEnableSubMode(thread, kSubModeDebuggerActive);
+                    break;
+                }
+            }
+        }
+        dvmUnlockThreadList();
+    }
 #if defined(WITH_JIT)
     dvmCompilerUpdateGlobalState();
 #endif
 }
 
+/*
+ * The JDWP event mechanism has registered an event that only the
+ * interpreter can detect, e.g. a breakpoint or method entry.  Once
+ * dvmDbgUpdateInterpWatch() runs, and until the event is removed, every
+ * thread checks each instruction.
+ *
+ * Called with the JDWP event lock held, possibly on an app thread, so
+ * this only does the counting.
+ */
+void dvmDbgWatchInterpEvents()
+{
+    gDvm.debuggerWatchCount++;
+}
+
+/*
+ * An event registered with dvmDbgWatchInterpEvents() has been removed.
+ *
+ * Called with the JDWP event lock held.
+ */
+void dvmDbgUnwatchInterpEvents()
+{
+    assert(gDvm.debuggerWatchCount > 0);
+    gDvm.debuggerWatchCount--;
+}
+
+/*
+ * Bring the threads' subModes and the JIT in line with the registered
+ * events.  Turning the checks on can mean suspending every thread to
+ * flush the JIT, so this is done by the JDWP thread after each request,
+ * with no JDWP locks held.
+ */
+void dvmDbgUpdateInterpWatch()
+{
+    setDebuggerWatching(gDvm.debuggerWatchCount != 0);
+}
+
 /*
  * Disable debugging features.
  *
@@ -417,10 +485,8 @@ void dvmDbgDisconnected()
     assert(gDvm.debuggerConnected);
 
     gDvm.debuggerActive = false;
-    dvmDisableAllSubMode(kSubModeDebuggerActive);
-#if defined(WITH_JIT)
-    dvmCompilerUpdateGlobalState();
-#endif
+    gDvm.debuggerWatchCount = 0;
+    setDebuggerWatching(false);
 
     dvmHashTableLock(gDvm.dbgRegistry);
     gDvm.debuggerConnected = false;
@@ -1523,12 +1589,15 @@ void dvmDbgSetFieldValue(ObjectId objectId, FieldId fieldId, u8 value,
         break;
     case JT_BYTE:
         assert(width == 1);
-        dvmSetFieldInt(obj, field->byteOffset, value);
+        dvmSetFieldByte(obj, field->byteOffset, value);
         break;
     case JT_SHORT:
+        assert(width == 2);
+        dvmSetFieldShort(obj, field->byteOffset, value);
+        break;
     case JT_CHAR:
         assert(width == 2);
-        dvmSetFieldInt(obj, field->byteOffset, value);
+        dvmSetFieldChar(obj, field->byteOffset, value);
         break;
     case JT_INT:
     case JT_FLOAT:
@@ -2068,11 +2137,22 @@ int dvmDbgGetThreadFrameCount(ObjectId threadId)
  */
 bool dvmDbgGetThreadFrame(ObjectId threadId, int num, FrameId* pFrameId,
     JdwpLocation* pLoc)
+{
+    return dvmDbgGetThreadFrames(threadId, num, 1, pFrameId, pLoc) == 1;
+}
+
+/*
+ * Get info for frames [start, start+count) from the specified thread's
+ * stack, in one pass.  Returns the number of frames filled in.
+ */
+int dvmDbgGetThreadFrames(ObjectId threadId, int start, int count,
+    FrameId* frameIds, JdwpLocation* locs)
 {
     Object* threadObj;
     Thread* thread;
     void* framePtr;
-    int count;
+    int depth;
+    int filled = 0;
 
     threadObj = objectIdToObject(threadId);
 
@@ -2083,14 +2163,16 @@ bool dvmDbgGetThreadFrame(ObjectId threadId, int num, FrameId* pFrameId,
         goto bail;
 
     framePtr = thread->interpSave.curFrame;
-    count = 0;
-    while (framePtr != NULL) {
+    depth = 0;
+    while (framePtr != NULL && filled < count) {
         const StackSaveArea* saveArea = SAVEAREA_FROM_FP(framePtr);
         const Method* method = saveArea->method;
 
         if (!dvmIsBreakFrame((u4*)framePtr)) {
-            if (count == num) {
-                *pFrameId = frameToFrameId(framePtr);
+            if (depth >= start) {
+                JdwpLocation* pLoc = &locs[filled];
+
+                frameIds[filled] = frameToFrameId(framePtr);
                 if (dvmIsInterfaceClass(method->clazz))
                     pLoc->typeTag = TT_INTERFACE;
                 else
@@ -2101,11 +2183,10 @@ bool dvmDbgGetThreadFrame(ObjectId threadId, int num, FrameId* pFrameId,
                     pLoc->idx = (u8)-1;
                 else
                     pLoc->idx = saveArea->xtra.currentPc - method->insns;
-                dvmUnlockThreadList();
-                return true;
+                filled++;
             }
 
-            count++;
+            depth++;
         }
 
         framePtr = saveArea->prevFrame;
@@ -2113,7 +2194,7 @@ bool dvmDbgGetThreadFrame(ObjectId threadId, int num, FrameId* pFrameId,
 
 bail:
     dvmUnlockThreadList();
-    return false;
+    return filled;
 }
 
 /*
@@ -242,6 +242,8 @@ void dvmDbgGetAllThreads(ObjectId** ppThreadIds, u4* pThreadCount);
 int dvmDbgGetThreadFrameCount(ObjectId threadId);
 bool dvmDbgGetThreadFrame(ObjectId threadId, int num, FrameId* pFrameId,
     JdwpLocation* pLoc);
+int dvmDbgGetThreadFrames(ObjectId threadId, int start, int count,
+    FrameId* frameIds, JdwpLocation* locs);
 
 ObjectId dvmDbgGetThreadSelfId(void);
 void dvmDbgSuspendVM(bool isEvent);
@@ -278,6 +280,9 @@ enum {
 
 bool dvmDbgWatchLocation(const JdwpLocation* pLoc);
 void dvmDbgUnwatchLocation(const JdwpLocation* pLoc);
+void dvmDbgWatchInterpEvents(void);
+void dvmDbgUnwatchInterpEvents(void);
+void dvmDbgUpdateInterpWatch(void);
 bool dvmDbgConfigureStep(ObjectId threadId, JdwpStepSize size,
     JdwpStepDepth depth);
 void dvmDbgUnconfigureStep(ObjectId threadId);
@@ -99,25 +99,32 @@ LOCAL_SRC_FILES := \
 	Jni.cpp \
 	JarFile.cpp \
 	LinearAlloc.cpp \
+	LockProfiler.cpp \
 	Misc.cpp \
 	Native.cpp \
 	PointerSet.cpp \
 	Profile.cpp \
 	RawDexFile.cpp \
 	ReferenceTable.cpp \
+	SamplingProfiler.cpp \
 	SignalCatcher.cpp \
 	StdioConverter.cpp \
 	Sync.cpp \
 	Thread.cpp \
 	UtfString.cpp \
+	VmMetrics.cpp \
 	alloc/Alloc.cpp \
 	alloc/CardTable.cpp \
 	alloc/HeapBitmap.cpp.arm \
 	alloc/HeapDebug.cpp \
+	alloc/HeapHistogram.cpp \
+	alloc/HugePages.cpp \
 	alloc/Heap.cpp.arm \
 	alloc/DdmHeap.cpp \
+	alloc/GcWorkers.cpp \
 	alloc/Verify.cpp \
 	alloc/Visit.cpp \
+	analysis/BackgroundVerify.cpp \
 	analysis/CodeVerify.cpp \
 	analysis/DexPrepare.cpp \
 	analysis/DexVerify.cpp \
@@ -191,6 +198,9 @@ else
   LOCAL_SRC_FILES += os/linux.cpp
 endif
 
+# Use the mostly-copying, compacting collector in alloc/Copying.cpp
+# instead of mark-sweep.  Such a VM defaults to -Xgc:copying and
+# refuses -Xgc:nocopying; other VMs refuse -Xgc:copying.
 WITH_COPYING_GC := $(strip $(WITH_COPYING_GC))
 
 ifeq ($(WITH_COPYING_GC),true)
@@ -201,7 +211,9 @@ else
   LOCAL_SRC_FILES += \
 	alloc/DlMalloc.cpp \
 	alloc/HeapSource.cpp \
-	alloc/MarkSweep.cpp.arm
+	alloc/LargeObjectSpace.cpp \
+	alloc/MarkSweep.cpp.arm \
+	alloc/SlotRuns.cpp
 endif
 
 WITH_JIT := $(strip $(WITH_JIT))
@@ -218,6 +230,10 @@ ifeq ($(WITH_JIT),true)
 	compiler/SSATransformation.cpp \
 	compiler/Loop.cpp \
 	compiler/Ralloc.cpp \
+	compiler/WarmStart.cpp \
+	compiler/PerfMap.cpp \
+	compiler/TraceSampler.cpp \
+	compiler/ImplicitChecks.cpp \
 	interp/Jit.cpp
 endif
 
@@ -324,6 +340,13 @@ ifeq ($(dvm_arch),x86)
   endif
 endif
 
+# NOTE: there is no x86-64 port.  An x86_64 build lands in the portable
+# FFI case below, without mterp or the JIT.  A real port is more than new
+# mterp and template sources and a 64-bit libenc:  object references are
+# stored in u4 Dalvik registers, JValue halves, field slots and
+# the JIT's IA-32 calling conventions, so the VM would first need 32-bit
+# compressed references (or a heap mapped below 4GB) before a back end
+# could use the extra registers.
 ifeq ($(MTERP_ARCH_KNOWN),false)
   # unknown architecture, try to use FFI
   LOCAL_C_INCLUDES += external/libffi/$(dvm_os)-$(dvm_arch)
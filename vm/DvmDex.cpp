@@ -38,21 +38,64 @@
  * at dexopt time.
  */
 
+/*
+ * Size the call site interface cache at one entry per 16 method refs, so
+ * that large DEX files with many interface call sites get a bigger cache.
+ */
+static int interfaceSiteCacheSize(const DexHeader* pHeader)
+{
+    int size = DEX_INTERFACE_SITE_CACHE_MIN;
+
+    while (size < DEX_INTERFACE_SITE_CACHE_MAX &&
+           size * 16 < (int) pHeader->methodIdsSize) {
+        size *= 2;
+    }
+    return size;
+}
+
+/*
+ * Sizes of the pieces of the aux structure region.
+ *
+ * The DvmDex itself (which holds a mutex) and each of the tables start on
+ * their own pages.  The boot class path tables are mostly filled in the
+ * zygote, so this keeps a write to one of them, or to the header, from
+ * dirtying a shared page of its neighbour.  Untouched pages of the region
+ * cost nothing.
+ */
+struct AuxSizes {
+    u4 headerSize, stringSize, classSize, methodSize, fieldSize;
+    u4 totalSize;
+};
+
+static void computeAuxSizes(const DexHeader* pHeader, AuxSizes* pSizes)
+{
+    pSizes->headerSize = ALIGN_UP_TO_PAGE_SIZE(sizeof(DvmDex));
+    pSizes->stringSize = ALIGN_UP_TO_PAGE_SIZE(
+        pHeader->stringIdsSize * sizeof(struct StringObject*));
+    pSizes->classSize  = ALIGN_UP_TO_PAGE_SIZE(
+        pHeader->typeIdsSize * sizeof(struct ClassObject*));
+    pSizes->methodSize = ALIGN_UP_TO_PAGE_SIZE(
+        pHeader->methodIdsSize * sizeof(struct Method*));
+    pSizes->fieldSize  = ALIGN_UP_TO_PAGE_SIZE(
+        pHeader->fieldIdsSize * sizeof(struct Field*));
+    pSizes->totalSize = pSizes->headerSize + pSizes->stringSize +
+        pSizes->classSize + pSizes->methodSize + pSizes->fieldSize;
+}
+
 static DvmDex* allocateAuxStructures(DexFile* pDexFile)
 {
     DvmDex* pDvmDex;
     const DexHeader* pHeader;
-    u4 stringSize, classSize, methodSize, fieldSize;
+    AuxSizes sizes;
 
     pHeader = pDexFile->pHeader;
-
-    stringSize = pHeader->stringIdsSize * sizeof(struct StringObject*);
-    classSize  = pHeader->typeIdsSize * sizeof(struct ClassObject*);
-    methodSize = pHeader->methodIdsSize * sizeof(struct Method*);
-    fieldSize  = pHeader->fieldIdsSize * sizeof(struct Field*);
-
-    u4 totalSize = sizeof(DvmDex) +
-                   stringSize + classSize + methodSize + fieldSize;
+    computeAuxSizes(pHeader, &sizes);
+    u4 headerSize = sizes.headerSize;
+    u4 stringSize = sizes.stringSize;
+    u4 classSize  = sizes.classSize;
+    u4 methodSize = sizes.methodSize;
+    u4 fieldSize  = sizes.fieldSize;
+    u4 totalSize  = sizes.totalSize;
 
     u1 *blob = (u1 *)dvmAllocRegion(totalSize,
                               PROT_READ | PROT_WRITE, "dalvik-aux-structure");
@@ -60,7 +103,7 @@ static DvmDex* allocateAuxStructures(DexFile* pDexFile)
         return NULL;
 
     pDvmDex = (DvmDex*)blob;
-    blob += sizeof(DvmDex);
+    blob += headerSize;
 
     pDvmDex->pDexFile = pDexFile;
     pDvmDex->pHeader = pHeader;
@@ -78,6 +121,8 @@ static DvmDex* allocateAuxStructures(DexFile* pDexFile)
         stringSize + classSize + methodSize + fieldSize);
 
     pDvmDex->pInterfaceCache = dvmAllocAtomicCache(DEX_INTERFACE_CACHE_SIZE);
+    pDvmDex->pInterfaceSiteCache =
+        dvmAllocAtomicCache(interfaceSiteCacheSize(pHeader));
 
     return pDvmDex;
 }
@@ -98,6 +143,8 @@ int dvmDexFileOpenFromFd(int fd, DvmDex** ppDvmDex)
 
     if (gDvm.verifyDexChecksum)
         parseFlags |= kDexParseVerifyChecksum;
+    if (gDvm.trustOptDexChecksum)
+        parseFlags |= kDexParseTrustOptimized;
 
     if (lseek(fd, 0, SEEK_SET) < 0) {
         ALOGE("lseek rewind failed");
@@ -133,6 +180,72 @@ bail:
     return result;
 }
 
+/*
+ * Map an unoptimized DEX file that lives inside another file, such as a
+ * "stored" classes.dex in a Jar, and parse it where it sits.
+ *
+ * The contents are not run through the structural verifier or the
+ * optimizer, both of which rewrite the data in place, so this is only
+ * appropriate for archives we trust.  With no opt header there's no
+ * class lookup table to borrow, so we build one.  Classes are verified
+ * as they're loaded, like those from a DEX in a byte array.
+ *
+ * Returns nonzero on error.
+ */
+int dvmDexFileOpenFromSegment(int fd, off_t start, size_t length,
+    DvmDex** ppDvmDex)
+{
+    DvmDex* pDvmDex;
+    DexFile* pDexFile;
+    DexClassLookup* pClassLookup;
+    MemMapping memMap;
+    int parseFlags = kDexParseDefault;
+    int result = -1;
+
+    if (gDvm.verifyDexChecksum)
+        parseFlags |= kDexParseVerifyChecksum;
+
+    if (sysMapFileSegmentInShmemWritableReadOnly(fd, start, length,
+            &memMap) != 0)
+    {
+        ALOGE("Unable to map DEX segment");
+        goto bail;
+    }
+
+    pDexFile = dexFileParse((u1*)memMap.addr, memMap.length, parseFlags);
+    if (pDexFile == NULL || pDexFile->pOptHeader != NULL) {
+        ALOGE("DEX parse failed");
+        dexFileFree(pDexFile);
+        sysReleaseShmem(&memMap);
+        goto bail;
+    }
+
+    pClassLookup = dexCreateClassLookup(pDexFile);
+    if (pClassLookup == NULL) {
+        dexFileFree(pDexFile);
+        sysReleaseShmem(&memMap);
+        goto bail;
+    }
+    pDexFile->pClassLookup = pClassLookup;
+
+    pDvmDex = allocateAuxStructures(pDexFile);
+    if (pDvmDex == NULL) {
+        free(pClassLookup);
+        dexFileFree(pDexFile);
+        sysReleaseShmem(&memMap);
+        goto bail;
+    }
+
+    sysCopyMap(&pDvmDex->memMap, &memMap);
+    pDvmDex->isMappedReadOnly = true;
+    pDvmDex->pOwnedClassLookup = pClassLookup;
+    *ppDvmDex = pDvmDex;
+    result = 0;
+
+bail:
+    return result;
+}
+
 /*
  * Create a DexFile structure for a "partial" DEX.  This is one that is in
  * the process of being optimized.  The optimization header isn't finished
@@ -179,23 +292,21 @@ bail:
  */
 void dvmDexFileFree(DvmDex* pDvmDex)
 {
-    u4 totalSize;
+    AuxSizes sizes;
 
     if (pDvmDex == NULL)
         return;
 
-    totalSize  = pDvmDex->pHeader->stringIdsSize * sizeof(struct StringObject*);
-    totalSize += pDvmDex->pHeader->typeIdsSize * sizeof(struct ClassObject*);
-    totalSize += pDvmDex->pHeader->methodIdsSize * sizeof(struct Method*);
-    totalSize += pDvmDex->pHeader->fieldIdsSize * sizeof(struct Field*);
-    totalSize += sizeof(DvmDex);
+    computeAuxSizes(pDvmDex->pHeader, &sizes);
 
     dexFileFree(pDvmDex->pDexFile);
+    free(pDvmDex->pOwnedClassLookup);
 
     ALOGV("+++ DEX %p: freeing aux structs", pDvmDex);
     dvmFreeAtomicCache(pDvmDex->pInterfaceCache);
+    dvmFreeAtomicCache(pDvmDex->pInterfaceSiteCache);
     sysReleaseShmem(&pDvmDex->memMap);
-    munmap(pDvmDex, totalSize);
+    munmap(pDvmDex, sizes.totalSize);
 }
 
 
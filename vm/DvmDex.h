@@ -57,10 +57,19 @@ struct DvmDex {
     /* interface method lookup cache */
     struct AtomicCache* pInterfaceCache;
 
+    /* interpreter inline caches for invoke-interface, keyed on call site */
+    struct AtomicCache* pInterfaceSiteCache;
+
     /* shared memory region with file contents */
     bool                isMappedReadOnly;
     MemMapping          memMap;
 
+    /* class lookup table we built ourselves (no opt header); may be NULL */
+    DexClassLookup*     pOwnedClassLookup;
+
+    /* set once dvmStartPreResolve() has claimed this file */
+    volatile int32_t    preResolveStarted;
+
     /* lock ensuring mutual exclusion during updates */
     pthread_mutex_t     modLock;
 };
@@ -75,6 +84,16 @@ struct DvmDex {
  */
 int dvmDexFileOpenFromFd(int fd, DvmDex** ppDvmDex);
 
+/*
+ * Map an unoptimized DEX file stored at "start" in the file open on "fd"
+ * (e.g. an uncompressed Zip entry) and parse it in place, without
+ * extracting or optimizing it.
+ *
+ * On success, returns 0 and sets "*ppDvmDex" to a newly-allocated DvmDex.
+ */
+int dvmDexFileOpenFromSegment(int fd, off_t start, size_t length,
+    DvmDex** ppDvmDex);
+
 /*
  * Open a partial DEX file.  Only useful as part of the optimization process.
  */
@@ -95,10 +95,39 @@ Current plan is option (b), because it's simple, fast, and doesn't change
 the way the stack works.
 */
 
+/*
+ * Number of entries in the catch lookup cache; must be a power of 2.
+ */
+#define CATCH_CACHE_SIZE        512
+
+/*
+ * Stack traces up to this deep are gathered in one walk, in a buffer on
+ * the native stack.
+ */
+#define kLocalTraceDepth        64
+
 /* fwd */
 static bool initException(Object* exception, const char* msg, Object* cause,
     Thread* self);
 
+/*
+ * Allocate the catch lookup cache.
+ */
+bool dvmExceptionStartup()
+{
+    gDvm.catchCache = dvmAllocAtomicCache(CATCH_CACHE_SIZE);
+    return gDvm.catchCache != NULL;
+}
+
+/*
+ * Free the catch lookup cache.
+ */
+void dvmExceptionShutdown()
+{
+    dvmFreeAtomicCache(gDvm.catchCache);
+    gDvm.catchCache = NULL;
+}
+
 void dvmThrowExceptionFmtV(ClassObject* exceptionClass,
     const char* fmt, va_list args)
 {
@@ -596,9 +625,11 @@ void dvmPrintExceptionStackTrace()
  * Search the method's list of exceptions for a match.
  *
  * Returns the offset of the catch block on success, or -1 on failure.
+ * "*pCacheable" is cleared if a catch class could not be resolved, since
+ * the answer may be different next time.
  */
-static int findCatchInMethod(Thread* self, const Method* method, int relPc,
-    ClassObject* excepClass)
+static int findCatchInMethodUncached(Thread* self, const Method* method,
+    int relPc, ClassObject* excepClass, bool* pCacheable)
 {
     /*
      * Need to clear the exception before entry.  Otherwise, dvmResolveClass
@@ -677,6 +708,7 @@ static int findCatchInMethod(Thread* self, const Method* method, int relPc,
                             (self->exception != NULL) ?
                             self->exception->clazz->descriptor : "(none)");
                     dvmClearException(self);
+                    *pCacheable = false;
                     continue;
                 }
             }
@@ -698,6 +730,54 @@ static int findCatchInMethod(Thread* self, const Method* method, int relPc,
     return -1;
 }
 
+/*
+ * Like findCatchInMethodUncached(), but remembers the answer.
+ *
+ * Code that throws exceptions for control flow throws the same classes
+ * through the same frames over and over, and most frames on the way don't
+ * catch anything.  The answer for a given instruction and exception class
+ * never changes once the catch classes are resolved, so we look it up in
+ * an AtomicCache keyed on the address of the instruction and the class.
+ * Methods from the same DEX file that share a code item share a class
+ * loader, so they'd get the same answer anyway.
+ */
+static int findCatchInMethod(Thread* self, const Method* method, int relPc,
+    ClassObject* excepClass)
+{
+    AtomicCache* cache = gDvm.catchCache;
+    bool cacheable = true;
+
+    if (cache == NULL) {
+        /* not set up, e.g. in dexopt */
+        return findCatchInMethodUncached(self, method, relPc, excepClass,
+            &cacheable);
+    }
+
+    u4 key1 = (u4) (method->insns + relPc);
+    u4 key2 = (u4) excepClass;
+    int hash = ((key1 >> 2) ^ key2) & (CATCH_CACHE_SIZE - 1);
+    AtomicCacheEntry* pEntry = cache->entries + hash;
+
+    /* same protocol as ATOMIC_CACHE_LOOKUP, with a conditional fill */
+    u4 firstVersion = android_atomic_acquire_load((int32_t*) &pEntry->version);
+    if (pEntry->key1 == key1 && pEntry->key2 == key2) {
+        u4 value = android_atomic_acquire_load((int32_t*) &pEntry->value);
+        if ((firstVersion & 0x01) == 0 && firstVersion == pEntry->version)
+            return (int) value;
+    }
+
+    int catchAddr = findCatchInMethodUncached(self, method, relPc, excepClass,
+        &cacheable);
+    if (cacheable) {
+        dvmUpdateAtomicCache(key1, key2, (u4) catchAddr, pEntry, firstVersion
+#if CALC_CACHE_STATS > 0
+            , cache
+#endif
+            );
+    }
+    return catchAddr;
+}
+
 /*
  * Find a matching "catch" block.  "pc" is the relative PC within the
  * current method, indicating the offset from the start in 16-bit units.
@@ -801,6 +881,22 @@ int dvmFindCatchBlock(Thread* self, int relPc, Object* exception,
     return catchAddr;
 }
 
+/*
+ * Get the relative PC to record for a stack frame.
+ */
+static inline int savedPcOf(const StackSaveArea* saveArea)
+{
+    const Method* method = saveArea->method;
+
+    if (dvmIsNativeMethod(method))
+        return 0;       /* no saved PC for native methods */
+
+    assert(saveArea->xtra.currentPc >= method->insns &&
+            saveArea->xtra.currentPc <
+            method->insns + dvmGetMethodInsnsSize(method));
+    return (int) (saveArea->xtra.currentPc - method->insns);
+}
+
 /*
  * We have to carry the exception's stack trace around, but in many cases
  * it will never be examined.  It makes sense to keep it in a compact,
@@ -860,14 +956,22 @@ void* dvmFillInStackTraceInternal(Thread* thread, bool wantObject, size_t* pCoun
     startFp = fp;
 
     /*
-     * Compute the stack depth.
+     * Compute the stack depth.  Most stacks are shallow enough that we
+     * can record the frames while we count them; deeper ones are walked
+     * again below once we know how much room they need.
      */
+    int localData[kLocalTraceDepth * 2];
     stackDepth = 0;
     while (fp != NULL) {
         const StackSaveArea* saveArea = SAVEAREA_FROM_FP(fp);
 
-        if (!dvmIsBreakFrame((u4*)fp))
+        if (!dvmIsBreakFrame((u4*)fp)) {
+            if (stackDepth < kLocalTraceDepth) {
+                localData[stackDepth * 2] = (int) saveArea->method;
+                localData[stackDepth * 2 + 1] = savedPcOf(saveArea);
+            }
             stackDepth++;
+        }
 
         assert(fp != saveArea->prevFrame);
         fp = saveArea->prevFrame;
@@ -902,24 +1006,21 @@ void* dvmFillInStackTraceInternal(Thread* thread, bool wantObject, size_t* pCoun
     if (pCount != NULL)
         *pCount = stackDepth;
 
+    if (stackDepth <= kLocalTraceDepth) {
+        memcpy(intPtr, localData, stackDepth * 2 * sizeof(int));
+        goto bail;
+    }
+
     fp = startFp;
     while (fp != NULL) {
         const StackSaveArea* saveArea = SAVEAREA_FROM_FP(fp);
-        const Method* method = saveArea->method;
 
         if (!dvmIsBreakFrame((u4*)fp)) {
-            //ALOGD("EXCEP keeping %s.%s", method->clazz->descriptor,
-            //         method->name);
+            //ALOGD("EXCEP keeping %s.%s", saveArea->method->clazz->descriptor,
+            //         saveArea->method->name);
 
-            *intPtr++ = (int) method;
-            if (dvmIsNativeMethod(method)) {
-                *intPtr++ = 0;      /* no saved PC for native methods */
-            } else {
-                assert(saveArea->xtra.currentPc >= method->insns &&
-                        saveArea->xtra.currentPc <
-                        method->insns + dvmGetMethodInsnsSize(method));
-                *intPtr++ = (int) (saveArea->xtra.currentPc - method->insns);
-            }
+            *intPtr++ = (int) saveArea->method;
+            *intPtr++ = savedPcOf(saveArea);
 
             stackDepth--;       // for verification
         }
@@ -938,6 +1039,34 @@ bail:
     }
 }
 
+struct RawTraceRequest {
+    int*    traceBuf;
+    size_t  stackDepth;
+};
+
+static void fillInRawTraceCheckpoint(Thread* thread, void* arg)
+{
+    RawTraceRequest* req = (RawTraceRequest*) arg;
+    req->traceBuf = dvmFillInStackTraceRaw(thread, &req->stackDepth);
+}
+
+/*
+ * Like dvmFillInStackTraceRaw(), but for any thread.  The trace of
+ * another thread is taken at its next safe point through a checkpoint,
+ * so other threads keep running.
+ *
+ * Grab threadListLock before calling.
+ */
+int* dvmFillInThreadStackTraceRaw(Thread* thread, size_t* pCount)
+{
+    RawTraceRequest req;
+    req.traceBuf = NULL;
+    req.stackDepth = 0;
+    dvmRunCheckpoint(thread, fillInRawTraceCheckpoint, &req);
+    *pCount = req.stackDepth;
+    return req.traceBuf;
+}
+
 
 /*
  * Given an Object previously created by dvmFillInStackTrace(), use the
@@ -20,6 +20,10 @@
 #ifndef DALVIK_EXCEPTION_H_
 #define DALVIK_EXCEPTION_H_
 
+/* initialization */
+bool dvmExceptionStartup(void);
+void dvmExceptionShutdown(void);
+
 /*
  * Create a Throwable and throw an exception in the current thread (where
  * "throwing" just means "set the thread's exception pointer").
@@ -194,6 +198,8 @@ ArrayObject* dvmGetStackTrace(const Object* stackState);
 INLINE int* dvmFillInStackTraceRaw(Thread* thread, size_t* pCount) {
     return (int*) dvmFillInStackTraceInternal(thread, false, pCount);
 }
+/* same, for another thread at its next safe point; hold threadListLock */
+int* dvmFillInThreadStackTraceRaw(Thread* thread, size_t* pCount);
 ArrayObject* dvmGetStackTraceRaw(const int* intVals, size_t stackDepth);
 void dvmFillStackTraceElements(const int* intVals, size_t stackDepth, ArrayObject* steArray);
 
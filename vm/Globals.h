@@ -75,6 +75,15 @@ enum ProfilerClockSource {
     kProfilerClockSourceDual,
 };
 
+/*
+ * What backs the heap, card table, mark stack and JIT code cache.
+ */
+enum HugePageMode {
+    kHugePagesNone = 0,         /* ordinary pages */
+    kHugePagesTransparent,      /* MADV_HUGEPAGE */
+    kHugePagesExplicit,         /* hugetlbfs pool for the code cache */
+};
+
 /*
  * All fields are initialized to zero.
  *
@@ -100,6 +109,12 @@ struct DvmGlobals {
     bool        verboseJni;
     bool        verboseClass;
     bool        verboseShutdown;
+    bool        verboseStartup;
+
+    /* -Xstartuptrace: time each step of startup, and zygote preloading */
+    bool        startupTrace;
+    u8          startupEndUsec;         // when dvmStartup finished
+    u8          startupEndCpuUsec;
 
     bool        jdwpAllowed;        // debugging allowed for this process?
     bool        jdwpConfigured;     // has debugging info been provided?
@@ -119,6 +134,9 @@ struct DvmGlobals {
      */
     u4          lockProfThreshold;
 
+    /* bias thin locks to the first thread that acquires them */
+    bool        biasedLocking;
+
     int         (*vfprintfHook)(FILE*, const char*, va_list);
     void        (*exitHook)(int);
     void        (*abortHook)(void);
@@ -126,12 +144,21 @@ struct DvmGlobals {
 
     int         jniGrefLimit;       // 0 means no limit
     char*       jniTrace;
+    bool        jniEagerBind;       // bind natives at System.loadLibrary
     bool        reduceSignals;
     bool        noQuitHandler;
     bool        verifyDexChecksum;
+    bool        trustOptDexChecksum; // skip the DEX part of an odex
+    bool        mapStoredDex;       // map stored classes.dex in place
+    bool        preResolve;         // pre-resolve from the odex profile
+    bool        preInternLiterals;  // intern boot literals before fork
+    bool        reflectCache;       // reuse per-class reflection objects
     char*       stackTraceFile;     // for SIGQUIT-inspired output
 
     bool        logStdio;
+    char*       stdioForwardFile;   // send stdio here instead of the log
+    int         stdioForwardFd;     // ...or to this descriptor
+    int         stdioRateLimit;     // lines per second; 0 for no limit
 
     DexOptimizerMode    dexOptMode;
     DexClassVerifyMode  classVerifyMode;
@@ -141,6 +168,9 @@ struct DvmGlobals {
 
     bool        monitorVerification;
 
+    /* verify classes dexopt couldn't in a background thread */
+    bool        backgroundVerify;
+
     bool        dexOptForSmp;
 
     /*
@@ -151,7 +181,25 @@ struct DvmGlobals {
     bool        postVerify;
     bool        concurrentMarkSweep;
     bool        verifyCardTable;
+    bool        cardAging;              /* preclean cards concurrently */
     bool        disableExplicitGc;
+    bool        forkHeapDump;           /* write hprof dumps from a child */
+    bool        heapHistogramOnSigQuit;
+    bool        nonStopStackDump;   // SIGQUIT dump without suspend-all
+    bool        useTlabs;
+    bool        useSlotRuns;
+    bool        lazySweep;
+    bool        generationalGc;
+    bool        copyingGc;
+    bool        idleCompaction;
+    bool        zygoteCompaction;       /* compact the heap before fork */
+    HugePageMode hugePageMode;
+    size_t      largeObjectThreshold;
+    size_t      arenaSpaceSize;
+    size_t      parallelGcThreads;
+    u4          gcPauseTargetMs;
+    u4          gcTimePercent;
+    size_t      maxPendingFinalizers;
 
     int         assertionCtrlCount;
     AssertionControl*   assertionCtrl;
@@ -178,6 +226,12 @@ struct DvmGlobals {
      * Where the VM goes to find system classes.
      */
     ClassPathEntry* bootClassPath;
+    /*
+     * Bloom filter over the descriptor hashes of every class in
+     * bootClassPath, so misses don't have to probe each DEX file.
+     */
+    u4*         bootClassFilter;
+    u4          bootClassFilterMask;    // bit count - 1
     /* used by the DEX optimizer to load classes from an unfinished DEX */
     DvmDex*     bootClassPathOptExtra;
     bool        optimizingBootstrapClass;
@@ -208,14 +262,15 @@ struct DvmGlobals {
      * Interned strings.
      */
 
-    /* A mutex that guards access to the interned string tables. */
-    pthread_mutex_t internLock;
+    /* Mutexes that serialize inserts into the interned string tables,
+     * chosen by hash.  Lookups take none. */
+    pthread_mutex_t internLocks[INTERN_LOCK_STRIPES];
 
-    /* Hash table of strings interned by the user. */
-    HashTable*  internedStrings;
+    /* Table of strings interned by the user. */
+    InternTable* internedStrings;
 
-    /* Hash table of strings interned by the class loader. */
-    HashTable*  literalStrings;
+    /* Table of strings interned by the class loader. */
+    InternTable* literalStrings;
 
     /*
      * Classes constructed directly by the vm.
@@ -235,6 +290,9 @@ struct DvmGlobals {
     ClassObject* typeFloat;
     ClassObject* typeDouble;
 
+    /* java/lang/Integer and friends, indexed by PrimitiveType */
+    ClassObject* boxClasses[PRIM_DOUBLE + 1];
+
     /* synthetic classes for arrays of primitives */
     ClassObject* classArrayBoolean;
     ClassObject* classArrayByte;
@@ -404,6 +462,9 @@ struct DvmGlobals {
     /* direct method pointers - java.lang.reflect.Proxy */
     Method*     methJavaLangReflectProxy_constructorPrototype;
 
+    /* interface method pointers - java.lang.reflect.InvocationHandler */
+    Method*     methJavaLangReflectInvocationHandler_invoke;
+
     /* field offsets - java.lang.reflect.Proxy */
     int         offJavaLangReflectProxy_h;
 
@@ -483,6 +544,17 @@ struct DvmGlobals {
      */
     pthread_cond_t  threadSuspendCountCond;
 
+    /*
+     * Threads that see a pending suspend broadcast this as they stop
+     * running, to wake the thread waiting in waitForThreadSuspend().
+     *
+     * Paired with "threadSuspendCountLock".
+     */
+    pthread_cond_t  threadSuspendAckCond;
+
+    /* time-to-safepoint of dvmSuspendAllThreads(), by cause */
+    SuspendStats    suspendStats[SUSPEND_NUM_CAUSES];
+
     /*
      * Sum of all threads' suspendCount fields. Guarded by
      * threadSuspendCountLock.
@@ -505,6 +577,22 @@ struct DvmGlobals {
      */
     BitVector*  threadIdMap;
 
+    /*
+     * Interpreter stacks of exited threads, kept for reuse by new ones.
+     * Only stacks of the default size (stackSize) are kept.  They are
+     * chained through their lowest word.
+     */
+    pthread_mutex_t interpStackPoolLock;
+    u1*         interpStackPool;
+    size_t      interpStackPoolCount;
+
+    /*
+     * Threads on threadList, indexed by thread ID.  Chunks are allocated
+     * on first use and never freed, so lookups don't need threadListLock;
+     * it is only needed to keep the Thread found from going away.
+     */
+    Thread**    threadIdTable[THREAD_ID_CHUNKS];
+
     /*
      * Manage exit conditions.  The VM exits when all non-daemon threads
      * have exited.  If the main thread returns early, we need to sleep
@@ -519,12 +607,12 @@ struct DvmGlobals {
     HashTable*  userDexFiles;
 
     /*
-     * JNI global reference table.
+     * JNI global reference tables, split into shards.  The water marks
+     * are guarded by jniGlobalRefMarkLock.
      */
-    IndirectRefTable jniGlobalRefTable;
-    IndirectRefTable jniWeakGlobalRefTable;
-    pthread_mutex_t jniGlobalRefLock;
-    pthread_mutex_t jniWeakGlobalRefLock;
+    IndirectRefShard jniGlobalRefs[kIndirectRefShardCount];
+    IndirectRefShard jniWeakGlobalRefs[kIndirectRefShardCount];
+    pthread_mutex_t jniGlobalRefMarkLock;
     int         jniGlobalRefHiMark;
     int         jniGlobalRefLoMark;
 
@@ -534,6 +622,13 @@ struct DvmGlobals {
     ReferenceTable  jniPinRefTable;
     pthread_mutex_t jniPinRefLock;
 
+    /*
+     * Cache of JNI GetMethodID/GetFieldID results, keyed on the class and
+     * a hash of the member's name and signature.  Entries for a class are
+     * purged when it is freed.
+     */
+    AtomicCache*    jniMemberCache;
+
     /*
      * Native shared library table.
      */
@@ -583,6 +678,18 @@ struct DvmGlobals {
      */
     AtomicCache* instanceofCache;
 
+    /*
+     * Cache results of catch block lookups, keyed on the address of the
+     * throwing instruction and the exception class.
+     */
+    AtomicCache* catchCache;
+
+    /*
+     * Decoded pc-to-line tables, keyed on Method*, so stack traces don't
+     * have to rerun the debug info state machine for every frame.
+     */
+    HashTable*  lineNumTables;
+
     /* inline substitution table, used during optimization */
     InlineSub*          inlineSubs;
 
@@ -611,6 +718,16 @@ struct DvmGlobals {
      */
     bool        debuggerConnected;      /* debugger or DDMS is connected */
     bool        debuggerActive;         /* debugger is making requests */
+
+    /*
+     * Registered events that only the interpreter can detect, such as
+     * breakpoints and method entry.  While there are any, every thread
+     * runs with kSubModeDebuggerActive and the JIT is off; otherwise only
+     * a thread being single-stepped does.  The count is guarded by the
+     * JDWP event lock; the flag follows it after each JDWP request.
+     */
+    int         debuggerWatchCount;
+    bool        debuggerWatching;       /* debuggerWatchCount != 0 */
     JdwpState*  jdwpState;
 
     /*
@@ -650,6 +767,71 @@ struct DvmGlobals {
     int             allocRecordHead;        /* most-recently-added entry */
     int             allocRecordCount;       /* #of valid entries */
 
+    /*
+     * Allocation sampling.  With a nonzero "allocSampleInterval" the
+     * tracker only records about one allocation per that many bytes, and
+     * aggregates the samples by class and stack in "allocSamples".
+     */
+    int             allocSampleInterval;    /* bytes; 0 records everything */
+    HashTable*      allocSamples;
+    u4              allocSamplesDropped;    /* samples we had no memory for */
+
+    /*
+     * Monitor contention profile.  "lockProfile" is non-NULL while
+     * profiling is enabled, from -Xlockprofile or a DDMS request.
+     */
+    pthread_mutex_t lockProfileLock;
+    LockProfileEntry* lockProfile;
+    u4              lockProfileDropped;     /* waits that didn't fit */
+    bool            lockProfileAtStartup;
+
+    /*
+     * Sampling method profile.  "sampleProfile" is non-NULL while the
+     * sampling thread is collecting, from -Xsampleprofile.
+     */
+    pthread_mutex_t sampleProfileLock;
+    pthread_cond_t  sampleProfileCond;
+    SampleProfileEntry* sampleProfile;
+    u4              sampleProfileSamples;
+    u4              sampleProfileDropped;   /* samples that didn't fit */
+    int             sampleIntervalUsec;
+    char*           sampleProfileFile;      /* folded stacks go here */
+    bool            sampleProfileAtStartup;
+    bool            haltSampling;
+    bool            samplingThreadStarted;
+    pthread_t       samplingThreadHandle;
+
+    /*
+     * Always-on counters; see VmMetrics.h.  "metricsBlocks" heads the
+     * list of per-thread counter blocks, which only ever grows.  With
+     * -Xmetricsfile the publisher thread copies the totals to
+     * "metricsPage" every "metricsIntervalMsec".  With -Xloaderaccounting
+     * marking charges live objects to their class loader, the results
+     * going in "loaderUsage".
+     */
+    VmMetricsBlock* volatile metricsBlocks;
+    VmMetricsBlock  metricsOverflow;        /* shared if calloc fails */
+    VmGcMetrics     gcMetrics;              /* guarded by the heap lock */
+    bool            loaderAccounting;
+    VmLoaderUsage*  loaderUsage;            /* guarded by the heap lock */
+    size_t          loaderUsageCount;
+    u4              liveCountGcs;           /* collections that counted */
+    pthread_mutex_t metricsLock;
+    pthread_cond_t  metricsCond;
+    char*           metricsFile;
+    int             metricsIntervalMsec;
+    void*           metricsPage;
+    size_t          metricsPageLen;
+    bool            haltMetrics;
+    bool            metricsThreadStarted;
+    pthread_t       metricsThreadHandle;
+
+    /*
+     * Starts the optional services after a fork, off the main thread.
+     */
+    bool            deferredStartThreadStarted;
+    pthread_t       deferredStartHandle;
+
     /*
      * When a profiler is enabled, this is incremented.  Distinct profilers
      * include "dmtrace" method tracing, emulator method tracing, and
@@ -726,6 +908,9 @@ struct DvmGlobals {
     /* some RegisterMap statistics, useful during development */
     void*       registerMapStats;
 
+    /* bounded cache of expanded register maps; see RegisterMap.cpp */
+    void*       expandedMapCache;
+
 #ifdef VERIFIER_STATS
     VerifierStats verifierStats;
 #endif
@@ -808,6 +993,12 @@ struct DvmJitGlobals {
     /* Trigger for trace selection */
     unsigned short threshold;
 
+    /*
+     * Interval at which each thread halves the progress of its trace head
+     * counters towards the threshold, in msec.  0 disables the decay.
+     */
+    unsigned int profDecayMsec;
+
     /* JIT Compiler Control */
     bool               haltCompilerThread;
     bool               blockingMode;
@@ -821,14 +1012,16 @@ struct DvmJitGlobals {
     pthread_cond_t     compilerQueueEmpty;
     volatile int       compilerQueueLength;
     int                compilerHighWater;
-    int                compilerWorkEnqueueIndex;
-    int                compilerWorkDequeueIndex;
+    unsigned int       compilerWorkSeq;     /* orders ever enqueued */
     int                compilerICPatchIndex;
 
     /* JIT internal stats */
     int                compilerMaxQueued;
     int                translationChains;
 
+    /* Compile time, queue wait and code size, guarded by compilerLock */
+    JitTelemetry       telemetry;
+
     /* Compiled code cache */
     void* codeCache;
 
@@ -864,6 +1057,12 @@ struct DvmJitGlobals {
     /* Lock to change the protection type of the code cache */
     pthread_mutex_t    codeCacheProtectionLock;
 
+    /*
+     * The whole code cache is mapped writable while the compiler thread
+     * works through its queue.  Guarded by codeCacheProtectionLock.
+     */
+    bool codeCacheWritable;
+
     /* Number of times that the code cache has been reset */
     int numCodeCacheReset;
 
@@ -916,12 +1115,46 @@ struct DvmJitGlobals {
     /* Filter method compilation blacklist with call-graph information */
     bool checkCallGraph;
 
+    /* Trace heads saved by an earlier run, from -Xjitwarmstart */
+    char *warmStartFile;
+
+    /* Write /tmp/perf-<pid>.map for profilers, from -Xjitperfmap */
+    bool perfMap;
+
+    /* Sample the translations threads are in, from -Xjittracesample */
+    bool traceSampleAtStartup;
+    int traceSampleIntervalUsec;
+
+    /* Let field accesses fault instead of null-checking, -Xjitimplicitchecks */
+    bool implicitChecks;
+
+    /*
+     * Forward conditional branches a trace may continue through to form a
+     * superblock, from -Xjitsuperblock.  0 ends traces at every branch.
+     */
+    int superblockBranches;
+
+    /* Core whose latencies the instruction scheduler uses, -Xjitcore */
+    char *schedCore;
+
+    /* Classes whose saved trace heads are still to be primed */
+    HashTable *warmStartClasses;
+
+    /* Trace heads that have been primed */
+    HashTable *warmTraceHeads;
+
+    /* Callees seen at each predicted chaining cell, guarded by ICPatchLock */
+    HashTable *icSiteTable;
+
     /* New translation chain has been set up */
     volatile bool hasNewChain;
 
 #if defined(WITH_SELF_VERIFICATION)
     /* Spin when error is detected, volatile so GDB can reset it */
     volatile bool selfVerificationSpin;
+
+    /* Number of divergences found so far */
+    u4 selfVerificationFailures;
 #endif
 
     /* Framework or stand-alone? */
@@ -953,12 +1186,14 @@ struct DvmJitGlobals {
     int                invokeMonoSetterInlined;
     int                invokePolyGetterInlined;
     int                invokePolySetterInlined;
+    int                invokeDevirtualized;
     int                returnOp;
     int                icPatchInit;
     int                icPatchLockFree;
     int                icPatchQueued;
     int                icPatchRejected;
     int                icPatchDropped;
+    int                icPatchMegamorphic;
     int                codeCachePatches;
     int                numCompilerThreadBlockGC;
     u8                 jitTime;
@@ -999,6 +1234,13 @@ struct DvmJniGlobals {
     // Debugging help for third-party developers. Similar to -Xjnitrace.
     bool logThirdPartyJni;
 
+    // Cheaper CheckJNI for production use.  With "light" only the thread,
+    // critical section and pending exception checks run; otherwise the
+    // argument checks run on 1 in checkJniSampleInterval calls of each
+    // function (0 or 1 means every call).
+    bool checkJniLight;
+    u4 checkJniSampleInterval;
+
     // We only support a single JavaVM per process.
     JavaVM*     jniVm;
 };
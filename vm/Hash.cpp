@@ -15,20 +15,38 @@
  */
 /*
  * Hash table.  The dominant calls are add and lookup, with removals
- * happening very infrequently.  We use probing, and don't worry much
- * about tombstone removal.
+ * happening very infrequently.
+ *
+ * We use linear probing.  Besides its entry, each slot has a control
+ * byte that holds either HASH_CTRL_EMPTY or the top seven bits of the
+ * entry's hash.  Probes look at HASH_GROUP_SIZE control bytes at a
+ * time, with SIMD compares where we have them, and only compare the
+ * entries whose bits match in full.  The first HASH_GROUP_SIZE - 1
+ * control bytes are repeated past the end of the table so that a group
+ * can be loaded from any slot.  Removing an entry shifts the rest of
+ * its probe sequence back, so there are no tombstones to step over.
  */
 #include "Dalvik.h"
 
 #include <stdlib.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* table load factor, i.e. how full can it get before we resize */
-//#define LOAD_NUMER  3       // 75%
-//#define LOAD_DENOM  4
-#define LOAD_NUMER  5       // 62.5%
-#define LOAD_DENOM  8
-//#define LOAD_NUMER  1       // 50%
-//#define LOAD_DENOM  2
+#define LOAD_NUMER  3       // 75%
+#define LOAD_DENOM  4
+
+#define HASH_CTRL_EMPTY 0x80
+
+/* memory dropped by a table that allows concurrent reads */
+struct HashRetired {
+    HashRetired* next;
+    void* ptr;
+};
 
 /*
  * Compute the capacity needed for a table to hold "size" elements.
@@ -37,6 +55,64 @@ size_t dvmHashSize(size_t size) {
     return (size * LOAD_DENOM) / LOAD_NUMER +1;
 }
 
+static inline u1 ctrlTag(u4 hashValue)
+{
+    return hashValue >> 25;
+}
+
+/*
+ * Returns a mask with bit i set iff ctrl[i] equals "value", for i less
+ * than HASH_GROUP_SIZE.
+ */
+static inline u4 matchGroup(const u1* ctrl, u1 value)
+{
+#if defined(__ARM_NEON__)
+    static const u1 kBits[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    uint8x16_t eq = vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(value));
+    uint8x16_t bits = vandq_u8(eq, vld1q_u8(kBits));
+    uint8x8_t lo = vget_low_u8(bits);
+    uint8x8_t hi = vget_high_u8(bits);
+    lo = vpadd_u8(lo, hi);
+    lo = vpadd_u8(lo, lo);
+    lo = vpadd_u8(lo, lo);
+    return vget_lane_u8(lo, 0) | (vget_lane_u8(lo, 1) << 8);
+#elif defined(__SSE2__)
+    __m128i v = _mm_loadu_si128((const __m128i*) ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char) value)));
+#else
+    u4 mask = 0;
+    for (int i = 0; i < HASH_GROUP_SIZE; i++) {
+        if (ctrl[i] == value)
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+/*
+ * Set the control byte of a slot, and its copy past the end.  Concurrent
+ * readers look at the control byte first, so the slot's entry must be
+ * visible before it is.
+ */
+static inline void setCtrl(HashTable* pHashTable, int idx, u1 value)
+{
+    if (pHashTable->concurrentReads)
+        ANDROID_MEMBAR_STORE();
+    pHashTable->pCtrl[idx] = value;
+    if (idx < HASH_GROUP_SIZE - 1)
+        pHashTable->pCtrl[pHashTable->tableSize + idx] = value;
+}
+
+static u1* allocCtrl(int tableSize)
+{
+    size_t len = tableSize + HASH_GROUP_SIZE - 1;
+    u1* pCtrl = (u1*) malloc(len);
+    if (pCtrl != NULL)
+        memset(pCtrl, HASH_CTRL_EMPTY, len);
+    return pCtrl;
+}
 
 /*
  * Create and initialize a hash table.
@@ -54,11 +130,18 @@ HashTable* dvmHashTableCreate(size_t initialSize, HashFreeFunc freeFunc)
     dvmInitMutex(&pHashTable->lock);
 
     pHashTable->tableSize = dexRoundUpPower2(initialSize);
-    pHashTable->numEntries = pHashTable->numDeadEntries = 0;
+    if (pHashTable->tableSize < HASH_GROUP_SIZE)
+        pHashTable->tableSize = HASH_GROUP_SIZE;
+    pHashTable->numEntries = 0;
     pHashTable->freeFunc = freeFunc;
+    pHashTable->concurrentReads = false;
+    pHashTable->pRetired = NULL;
     pHashTable->pEntries =
         (HashEntry*) calloc(pHashTable->tableSize, sizeof(HashEntry));
-    if (pHashTable->pEntries == NULL) {
+    pHashTable->pCtrl = allocCtrl(pHashTable->tableSize);
+    if (pHashTable->pEntries == NULL || pHashTable->pCtrl == NULL) {
+        free(pHashTable->pEntries);
+        free(pHashTable->pCtrl);
         free(pHashTable);
         return NULL;
     }
@@ -76,19 +159,17 @@ void dvmHashTableClear(HashTable* pHashTable)
 
     pEnt = pHashTable->pEntries;
     for (i = 0; i < pHashTable->tableSize; i++, pEnt++) {
-        if (pEnt->data == HASH_TOMBSTONE) {
-            // nuke entry
-            pEnt->data = NULL;
-        } else if (pEnt->data != NULL) {
+        if (pEnt->data != NULL) {
             // call free func then nuke entry
             if (pHashTable->freeFunc != NULL)
                 (*pHashTable->freeFunc)(pEnt->data);
             pEnt->data = NULL;
         }
     }
+    memset(pHashTable->pCtrl, HASH_CTRL_EMPTY,
+        pHashTable->tableSize + HASH_GROUP_SIZE - 1);
 
     pHashTable->numEntries = 0;
-    pHashTable->numDeadEntries = 0;
 }
 
 /*
@@ -99,25 +180,52 @@ void dvmHashTableFree(HashTable* pHashTable)
     if (pHashTable == NULL)
         return;
     dvmHashTableClear(pHashTable);
+    dvmHashTableFreeRetired(pHashTable);
     free(pHashTable->pEntries);
+    free(pHashTable->pCtrl);
     free(pHashTable);
 }
 
-#ifndef NDEBUG
 /*
- * Count up the number of tombstone entries in the hash table.
+ * Find the slot holding an item, or the empty slot where it would go.
+ * With a NULL "cmpFunc", items are compared by pointer.  Sets "*pFound"
+ * accordingly and returns the index of the slot.
  */
-static int countTombStones(HashTable* pHashTable)
+static int findSlot(const HashTable* pHashTable, u4 itemHash,
+    const void* item, HashCompareFunc cmpFunc, bool* pFound)
 {
-    int i, count;
-
-    for (count = i = 0; i < pHashTable->tableSize; i++) {
-        if (pHashTable->pEntries[i].data == HASH_TOMBSTONE)
-            count++;
+    int mask = pHashTable->tableSize - 1;
+    u1 tag = ctrlTag(itemHash);
+    int idx = itemHash & mask;
+
+    /* there is always an empty slot, so this ends within one lap */
+    for (;;) {
+        const u1* ctrl = &pHashTable->pCtrl[idx];
+        u4 empty = matchGroup(ctrl, HASH_CTRL_EMPTY);
+        u4 match = matchGroup(ctrl, tag);
+        if (empty != 0) {
+            /* nothing past the first empty slot is in this item's run */
+            match &= (empty & -empty) - 1;
+        }
+        while (match != 0) {
+            int i = (idx + __builtin_ctz(match)) & mask;
+            const HashEntry* pEntry = &pHashTable->pEntries[i];
+            if (cmpFunc == NULL ? pEntry->data == item :
+                (pEntry->hashValue == itemHash &&
+                 (*cmpFunc)(pEntry->data, item) == 0))
+            {
+                *pFound = true;
+                return i;
+            }
+            match &= match - 1;
+        }
+        if (empty != 0) {
+            *pFound = false;
+            return (idx + __builtin_ctz(empty)) & mask;
+        }
+        idx = (idx + HASH_GROUP_SIZE) & mask;
     }
-    return count;
 }
-#endif
 
 /*
  * Resize a hash table.  We do this when adding an entry increased the
@@ -131,38 +239,52 @@ static int countTombStones(HashTable* pHashTable)
  */
 static bool resizeHash(HashTable* pHashTable, int newSize)
 {
-    HashEntry* pNewEntries;
+    HashTable newTable = *pHashTable;
     int i;
 
-    assert(countTombStones(pHashTable) == pHashTable->numDeadEntries);
-    //ALOGI("before: dead=%d", pHashTable->numDeadEntries);
-
-    pNewEntries = (HashEntry*) calloc(newSize, sizeof(HashEntry));
-    if (pNewEntries == NULL)
+    newTable.concurrentReads = false;
+    newTable.tableSize = newSize;
+    newTable.pEntries = (HashEntry*) calloc(newSize, sizeof(HashEntry));
+    newTable.pCtrl = allocCtrl(newSize);
+    if (newTable.pEntries == NULL || newTable.pCtrl == NULL) {
+        free(newTable.pEntries);
+        free(newTable.pCtrl);
         return false;
+    }
 
     for (i = 0; i < pHashTable->tableSize; i++) {
-        void* data = pHashTable->pEntries[i].data;
-        if (data != NULL && data != HASH_TOMBSTONE) {
-            int hashValue = pHashTable->pEntries[i].hashValue;
-            int newIdx;
-
-            /* probe for new spot, wrapping around */
-            newIdx = hashValue & (newSize-1);
-            while (pNewEntries[newIdx].data != NULL)
-                newIdx = (newIdx + 1) & (newSize-1);
-
-            pNewEntries[newIdx].hashValue = hashValue;
-            pNewEntries[newIdx].data = data;
+        const HashEntry* pOldEntry = &pHashTable->pEntries[i];
+        if (pOldEntry->data != NULL) {
+            bool found;
+            int newIdx = findSlot(&newTable, pOldEntry->hashValue,
+                            pOldEntry->data, NULL, &found);
+
+            assert(!found);
+            newTable.pEntries[newIdx] = *pOldEntry;
+            setCtrl(&newTable, newIdx, pHashTable->pCtrl[i]);
         }
     }
 
-    free(pHashTable->pEntries);
-    pHashTable->pEntries = pNewEntries;
-    pHashTable->tableSize = newSize;
-    pHashTable->numDeadEntries = 0;
-
-    assert(countTombStones(pHashTable) == 0);
+    HashEntry* pOldEntries = pHashTable->pEntries;
+    u1* pOldCtrl = pHashTable->pCtrl;
+
+    /*
+     * A concurrent reader loads the size first, so if it sees the new
+     * size it also sees the new arrays.  With the old size it may see
+     * either array, which are both at least that big.
+     */
+    pHashTable->pCtrl = newTable.pCtrl;
+    android_atomic_release_store((int32_t) newTable.pEntries,
+        (int32_t*) &pHashTable->pEntries);
+    android_atomic_release_store(newSize, &pHashTable->tableSize);
+
+    if (pHashTable->concurrentReads) {
+        dvmHashTableRetire(pHashTable, pOldEntries);
+        dvmHashTableRetire(pHashTable, pOldCtrl);
+    } else {
+        free(pOldEntries);
+        free(pOldCtrl);
+    }
     return true;
 }
 
@@ -174,47 +296,25 @@ static bool resizeHash(HashTable* pHashTable, int newSize)
 void* dvmHashTableLookup(HashTable* pHashTable, u4 itemHash, void* item,
     HashCompareFunc cmpFunc, bool doAdd)
 {
-    HashEntry* pEntry;
-    HashEntry* pEnd;
     void* result = NULL;
+    bool found;
 
     assert(pHashTable->tableSize > 0);
     assert(item != HASH_TOMBSTONE);
     assert(item != NULL);
 
-    /* jump to the first entry and probe for a match */
-    pEntry = &pHashTable->pEntries[itemHash & (pHashTable->tableSize-1)];
-    pEnd = &pHashTable->pEntries[pHashTable->tableSize];
-    while (pEntry->data != NULL) {
-        if (pEntry->data != HASH_TOMBSTONE &&
-            pEntry->hashValue == itemHash &&
-            (*cmpFunc)(pEntry->data, item) == 0)
-        {
-            /* match */
-            //ALOGD("+++ match on entry %d", pEntry - pHashTable->pEntries);
-            break;
-        }
-
-        pEntry++;
-        if (pEntry == pEnd) {     /* wrap around to start */
-            if (pHashTable->tableSize == 1)
-                break;      /* edge case - single-entry table */
-            pEntry = pHashTable->pEntries;
-        }
-
-        //ALOGI("+++ look probing %d...", pEntry - pHashTable->pEntries);
-    }
-
-    if (pEntry->data == NULL) {
+    int idx = findSlot(pHashTable, itemHash, item, cmpFunc, &found);
+    if (!found) {
         if (doAdd) {
-            pEntry->hashValue = itemHash;
-            pEntry->data = item;
+            pHashTable->pEntries[idx].hashValue = itemHash;
+            pHashTable->pEntries[idx].data = item;
+            setCtrl(pHashTable, idx, ctrlTag(itemHash));
             pHashTable->numEntries++;
 
             /*
              * We've added an entry.  See if this brings us too close to full.
              */
-            if ((pHashTable->numEntries+pHashTable->numDeadEntries) * LOAD_DENOM
+            if (pHashTable->numEntries * LOAD_DENOM
                 > pHashTable->tableSize * LOAD_NUMER)
             {
                 if (!resizeHash(pHashTable, pHashTable->tableSize * 2)) {
@@ -222,11 +322,6 @@ void* dvmHashTableLookup(HashTable* pHashTable, u4 itemHash, void* item,
                     ALOGE("Dalvik hash resize failure");
                     dvmAbort();
                 }
-                /* note "pEntry" is now invalid */
-            } else {
-                //ALOGW("okay %d/%d/%d",
-                //    pHashTable->numEntries, pHashTable->tableSize,
-                //    (pHashTable->tableSize * LOAD_NUMER) / LOAD_DENOM);
             }
 
             /* full table is bad -- search for nonexistent never halts */
@@ -236,12 +331,114 @@ void* dvmHashTableLookup(HashTable* pHashTable, u4 itemHash, void* item,
             assert(result == NULL);
         }
     } else {
-        result = pEntry->data;
+        result = pHashTable->pEntries[idx].data;
     }
 
     return result;
 }
 
+void dvmHashTableSetConcurrentReads(HashTable* pHashTable)
+{
+    pHashTable->concurrentReads = true;
+}
+
+/*
+ * Like findSlot(), but for a table that may be changing under us.  Takes
+ * a consistent size and set of arrays, checks for entries emptied after
+ * their control byte was read, and gives up after one lap in case the
+ * run it is following is being shifted.
+ */
+void* dvmHashTableLookupConcurrent(HashTable* pHashTable, u4 itemHash,
+    const void* item, HashCompareFunc cmpFunc)
+{
+    int tableSize = android_atomic_acquire_load(&pHashTable->tableSize);
+    const HashEntry* pEntries = (const HashEntry*)
+        android_atomic_acquire_load((int32_t*) &pHashTable->pEntries);
+    const u1* pCtrl = pHashTable->pCtrl;
+    int mask = tableSize - 1;
+    u1 tag = ctrlTag(itemHash);
+    int idx = itemHash & mask;
+
+    assert(pHashTable->concurrentReads);
+
+    for (int scanned = 0; scanned < tableSize; scanned += HASH_GROUP_SIZE) {
+        const u1* ctrl = &pCtrl[idx];
+        u4 empty = matchGroup(ctrl, HASH_CTRL_EMPTY);
+        u4 match = matchGroup(ctrl, tag);
+        if (empty != 0)
+            match &= (empty & -empty) - 1;
+        /* read the entries no earlier than the control bytes */
+        ANDROID_MEMBAR_FULL();
+        while (match != 0) {
+            const HashEntry* pEntry =
+                &pEntries[(idx + __builtin_ctz(match)) & mask];
+            void* data = pEntry->data;
+            if (data != NULL && pEntry->hashValue == itemHash &&
+                (*cmpFunc)(data, item) == 0)
+            {
+                return data;
+            }
+            match &= match - 1;
+        }
+        if (empty != 0)
+            break;
+        idx = (idx + HASH_GROUP_SIZE) & mask;
+    }
+    return NULL;
+}
+
+void dvmHashTableRetire(HashTable* pHashTable, void* ptr)
+{
+    HashRetired* pRetired = (HashRetired*) malloc(sizeof(*pRetired));
+    if (pRetired == NULL) {
+        /* better to leak it than to free it under a reader */
+        ALOGW("Unable to retire %p from hash table", ptr);
+        return;
+    }
+    pRetired->ptr = ptr;
+    pRetired->next = pHashTable->pRetired;
+    pHashTable->pRetired = pRetired;
+}
+
+void dvmHashTableFreeRetired(HashTable* pHashTable)
+{
+    while (pHashTable->pRetired != NULL) {
+        HashRetired* next = pHashTable->pRetired->next;
+        free(pHashTable->pRetired->ptr);
+        free(pHashTable->pRetired);
+        pHashTable->pRetired = next;
+    }
+}
+
+/*
+ * Empty a slot, moving later entries of the same run back into the
+ * hole so that probes never have to step over a dead slot.  An entry
+ * moves back unless its home slot lies between the hole and itself.
+ */
+static void removeSlot(HashTable* pHashTable, int idx)
+{
+    int mask = pHashTable->tableSize - 1;
+    int hole = idx;
+    int i = idx;
+
+    for (;;) {
+        i = (i + 1) & mask;
+        HashEntry* pEntry = &pHashTable->pEntries[i];
+        if (pEntry->data == NULL)
+            break;
+        int home = pEntry->hashValue & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            pHashTable->pEntries[hole] = *pEntry;
+            setCtrl(pHashTable, hole, pHashTable->pCtrl[i]);
+            hole = i;
+        }
+    }
+
+    pHashTable->pEntries[hole].data = NULL;
+    setCtrl(pHashTable, hole, HASH_CTRL_EMPTY);
+    pHashTable->numEntries--;
+}
+
 /*
  * Remove an entry from the table.
  *
@@ -249,34 +446,15 @@ void* dvmHashTableLookup(HashTable* pHashTable, u4 itemHash, void* item,
  */
 bool dvmHashTableRemove(HashTable* pHashTable, u4 itemHash, void* item)
 {
-    HashEntry* pEntry;
-    HashEntry* pEnd;
+    bool found;
 
     assert(pHashTable->tableSize > 0);
 
-    /* jump to the first entry and probe for a match */
-    pEntry = &pHashTable->pEntries[itemHash & (pHashTable->tableSize-1)];
-    pEnd = &pHashTable->pEntries[pHashTable->tableSize];
-    while (pEntry->data != NULL) {
-        if (pEntry->data == item) {
-            //ALOGI("+++ stepping on entry %d", pEntry - pHashTable->pEntries);
-            pEntry->data = HASH_TOMBSTONE;
-            pHashTable->numEntries--;
-            pHashTable->numDeadEntries++;
-            return true;
-        }
-
-        pEntry++;
-        if (pEntry == pEnd) {     /* wrap around to start */
-            if (pHashTable->tableSize == 1)
-                break;      /* edge case - single-entry table */
-            pEntry = pHashTable->pEntries;
-        }
-
-        //ALOGI("+++ del probing %d...", pEntry - pHashTable->pEntries);
-    }
-
-    return false;
+    int idx = findSlot(pHashTable, itemHash, item, NULL, &found);
+    if (!found)
+        return false;
+    removeSlot(pHashTable, idx);
+    return true;
 }
 
 /*
@@ -287,25 +465,36 @@ bool dvmHashTableRemove(HashTable* pHashTable, u4 itemHash, void* item)
  * Does NOT invoke the "free" function on the item.
  *
  * Returning values other than 0 or 1 will abort the routine.
+ *
+ * The scan starts just past an empty slot.  Removal only moves entries
+ * back within a run, and runs never cross an empty slot, so an entry
+ * that moves lands on a slot that has not been scanned yet, and every
+ * entry is seen exactly once.
  */
 int dvmHashForeachRemove(HashTable* pHashTable, HashForeachRemoveFunc func)
 {
-    int i, val;
+    int mask = pHashTable->tableSize - 1;
+    int start, i, val;
 
-    for (i = 0; i < pHashTable->tableSize; i++) {
+    for (start = 0; pHashTable->pEntries[start].data != NULL; start++)
+        ;
+
+    i = (start + 1) & mask;
+    while (i != start) {
         HashEntry* pEnt = &pHashTable->pEntries[i];
 
-        if (pEnt->data != NULL && pEnt->data != HASH_TOMBSTONE) {
+        if (pEnt->data != NULL) {
             val = (*func)(pEnt->data);
             if (val == 1) {
-                pEnt->data = HASH_TOMBSTONE;
-                pHashTable->numEntries--;
-                pHashTable->numDeadEntries++;
+                removeSlot(pHashTable, i);
+                /* look at whatever moved into this slot */
+                continue;
             }
             else if (val != 0) {
                 return val;
             }
         }
+        i = (i + 1) & mask;
     }
     return 0;
 }
@@ -323,7 +512,7 @@ int dvmHashForeach(HashTable* pHashTable, HashForeachFunc func, void* arg)
     for (i = 0; i < pHashTable->tableSize; i++) {
         HashEntry* pEnt = &pHashTable->pEntries[i];
 
-        if (pEnt->data != NULL && pEnt->data != HASH_TOMBSTONE) {
+        if (pEnt->data != NULL) {
             val = (*func)(pEnt->data, arg);
             if (val != 0)
                 return val;
@@ -335,46 +524,24 @@ int dvmHashForeach(HashTable* pHashTable, HashForeachFunc func, void* arg)
 
 
 /*
- * Look up an entry, counting the number of times we have to probe.
+ * Look up an entry, counting the number of slots we have to probe past.
  *
  * Returns -1 if the entry wasn't found.
  */
 static int countProbes(HashTable* pHashTable, u4 itemHash, const void* item,
     HashCompareFunc cmpFunc)
 {
-    HashEntry* pEntry;
-    HashEntry* pEnd;
-    int count = 0;
+    bool found;
 
     assert(pHashTable->tableSize > 0);
     assert(item != HASH_TOMBSTONE);
     assert(item != NULL);
 
-    /* jump to the first entry and probe for a match */
-    pEntry = &pHashTable->pEntries[itemHash & (pHashTable->tableSize-1)];
-    pEnd = &pHashTable->pEntries[pHashTable->tableSize];
-    while (pEntry->data != NULL) {
-        if (pEntry->data != HASH_TOMBSTONE &&
-            pEntry->hashValue == itemHash &&
-            (*cmpFunc)(pEntry->data, item) == 0)
-        {
-            /* match */
-            break;
-        }
-
-        pEntry++;
-        if (pEntry == pEnd) {     /* wrap around to start */
-            if (pHashTable->tableSize == 1)
-                break;      /* edge case - single-entry table */
-            pEntry = pHashTable->pEntries;
-        }
-
-        count++;
-    }
-    if (pEntry->data == NULL)
+    int idx = findSlot(pHashTable, itemHash, item, cmpFunc, &found);
+    if (!found)
         return -1;
 
-    return count;
+    return (idx - (int) itemHash) & (pHashTable->tableSize - 1);
 }
 
 /*
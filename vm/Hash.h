@@ -51,8 +51,9 @@ typedef int (*HashForeachRemoveFunc)(void* data);
 /*
  * One entry in the hash table.  "data" values are expected to be (or have
  * the same characteristics as) valid pointers.  In particular, a NULL
- * value for "data" indicates an empty slot, and HASH_TOMBSTONE indicates
- * a no-longer-used slot that must be stepped over during probing.
+ * value for "data" indicates an empty slot.  Removal never leaves dead
+ * slots behind, so HASH_TOMBSTONE is not stored by the table itself; it
+ * remains for callers that want an invalid pointer of their own.
  *
  * Attempting to add a NULL or tombstone value is an error.
  *
@@ -65,18 +66,24 @@ struct HashEntry {
 
 #define HASH_TOMBSTONE ((void*) 0xcbcacccd)     // invalid ptr value
 
+/* number of control bytes examined per probe step */
+#define HASH_GROUP_SIZE 16
+
 /*
  * Expandable hash table.
  *
  * This structure should be considered opaque.
  */
+struct HashRetired;
 struct HashTable {
     int         tableSize;          /* must be power of 2 */
     int         numEntries;         /* current #of "live" entries */
-    int         numDeadEntries;     /* current #of tombstone entries */
     HashEntry*  pEntries;           /* array on heap */
+    u1*         pCtrl;              /* control byte per entry, see Hash.cpp */
     HashFreeFunc freeFunc;
     pthread_mutex_t lock;
+    bool        concurrentReads;    /* see dvmHashTableLookupConcurrent */
+    HashRetired* pRetired;          /* memory awaiting dvmHashTableFreeRetired */
 };
 
 /*
@@ -129,7 +136,8 @@ INLINE int dvmHashTableNumEntries(HashTable* pHashTable) {
  * Get total size of hash table (for memory usage calculations).
  */
 INLINE int dvmHashTableMemUsage(HashTable* pHashTable) {
-    return sizeof(HashTable) + pHashTable->tableSize * sizeof(HashEntry);
+    return sizeof(HashTable) + pHashTable->tableSize * sizeof(HashEntry) +
+        pHashTable->tableSize + HASH_GROUP_SIZE - 1;
 }
 
 /*
@@ -145,6 +153,37 @@ INLINE int dvmHashTableMemUsage(HashTable* pHashTable) {
 void* dvmHashTableLookup(HashTable* pHashTable, u4 itemHash, void* item,
     HashCompareFunc cmpFunc, bool doAdd);
 
+/*
+ * Allow dvmHashTableLookupConcurrent() on a table.  From then on, memory
+ * the table stops using is kept until dvmHashTableFreeRetired(), rather
+ * than freed when the table is resized.
+ */
+void dvmHashTableSetConcurrentReads(HashTable* pHashTable);
+
+/*
+ * Look up an entry without holding the table's lock, while other threads
+ * may be adding or removing entries under it.  A match is always a real
+ * entry, but an entry that is being moved by a resize or a removal can be
+ * missed, so callers that must not miss should repeat a failed lookup
+ * with dvmHashTableLookup() under the lock.
+ */
+void* dvmHashTableLookupConcurrent(HashTable* pHashTable, u4 itemHash,
+    const void* item, HashCompareFunc cmpFunc);
+
+/*
+ * Free "ptr" once no concurrent lookup can still be reading it.  Lets a
+ * table's users hang data off its entries that the lookup's compare
+ * function reads.  The table must be locked.
+ */
+void dvmHashTableRetire(HashTable* pHashTable, void* ptr);
+
+/*
+ * Free the memory retired by resizes and dvmHashTableRetire().  Only
+ * call this while no thread can be in dvmHashTableLookupConcurrent(),
+ * e.g. with all threads suspended.
+ */
+void dvmHashTableFreeRetired(HashTable* pHashTable);
+
 /*
  * Remove an item from the hash table, given its "data" pointer.  Does not
  * invoke the "free" function; just detaches it from the table.
@@ -189,7 +228,7 @@ INLINE void dvmHashIterNext(HashIter* pIter) {
     int lim = pIter->pHashTable->tableSize;
     for ( ; i < lim; i++) {
         void* data = pIter->pHashTable->pEntries[i].data;
-        if (data != NULL && data != HASH_TOMBSTONE)
+        if (data != NULL)
             break;
     }
     pIter->idx = i;
@@ -34,16 +34,32 @@ bool IndirectRefTable::init(size_t initialCount,
     assert(initialCount <= maxCount);
     assert(desiredKind != kIndirectKindInvalid);
 
-    table_ = (IndirectRefSlot*) malloc(initialCount * sizeof(IndirectRefSlot));
-    if (table_ == NULL) {
+    /* chunks are the initial size, rounded up to a power of two */
+    u4 shift = 0;
+    while (((size_t) 1 << shift) < initialCount) {
+        shift++;
+    }
+    size_t chunkSize = (size_t) 1 << shift;
+    size_t maxChunks = (maxCount + chunkSize - 1) >> shift;
+
+    chunks_ = (IndirectRefSlot**) calloc(maxChunks, sizeof(IndirectRefSlot*));
+    if (chunks_ == NULL) {
         return false;
     }
-    memset(table_, 0xd1, initialCount * sizeof(IndirectRefSlot));
+    chunks_[0] = (IndirectRefSlot*) malloc(chunkSize * sizeof(IndirectRefSlot));
+    if (chunks_[0] == NULL) {
+        free(chunks_);
+        chunks_ = NULL;
+        return false;
+    }
+    memset(chunks_[0], 0xd1, chunkSize * sizeof(IndirectRefSlot));
 
     segmentState.all = IRT_FIRST_SEGMENT;
-    alloc_entries_ = initialCount;
+    alloc_entries_ = chunkSize;
     max_entries_ = maxCount;
     kind_ = desiredKind;
+    chunkShift_ = shift;
+    freeHead_ = 0;
 
     return true;
 }
@@ -53,11 +69,60 @@ bool IndirectRefTable::init(size_t initialCount,
  */
 void IndirectRefTable::destroy()
 {
-    free(table_);
-    table_ = NULL;
+    if (chunks_ != NULL) {
+        size_t numChunks = alloc_entries_ >> chunkShift_;
+        for (size_t i = 0; i < numChunks; i++) {
+            free(chunks_[i]);
+        }
+        free(chunks_);
+    }
+    chunks_ = NULL;
     alloc_entries_ = max_entries_ = -1;
 }
 
+static inline Object* holeLink(u4 linkIndex)
+{
+    return reinterpret_cast<Object*>((linkIndex << 1) | 1);
+}
+
+/*
+ * Put the hole at "index" at the head of the free list.
+ */
+void IndirectRefTable::pushHole(u4 index)
+{
+    IndirectRefSlot* hole = slot(index);
+    hole->obj = holeLink(0);
+    hole->serial = (hole->serial & 0xfff) | (freeHead_ << 12);
+    if (freeHead_ != 0) {
+        slot(freeHead_ - 1)->obj = holeLink(index + 1);
+    }
+    freeHead_ = index + 1;
+}
+
+/*
+ * Take the hole at "index" off the free list and clear it.
+ */
+void IndirectRefTable::unlinkHole(u4 index)
+{
+    IndirectRefSlot* hole = slot(index);
+    assert(((uintptr_t) hole->obj & 1) != 0);
+    u4 prev = (uintptr_t) hole->obj >> 1;
+    u4 next = hole->serial >> 12;
+
+    if (prev != 0) {
+        IndirectRefSlot* prevHole = slot(prev - 1);
+        prevHole->serial = (prevHole->serial & 0xfff) | (next << 12);
+    } else {
+        assert(freeHead_ == index + 1);
+        freeHead_ = next;
+    }
+    if (next != 0) {
+        slot(next - 1)->obj = holeLink(prev);
+    }
+    hole->obj = NULL;
+    hole->serial &= 0xfff;
+}
+
 IndirectRef IndirectRefTable::add(u4 cookie, Object* obj)
 {
     IRTSegmentState prevState;
@@ -66,9 +131,9 @@ IndirectRef IndirectRefTable::add(u4 cookie, Object* obj)
 
     assert(obj != NULL);
     assert(dvmIsHeapAddress(obj));
-    assert(table_ != NULL);
-    assert(alloc_entries_ <= max_entries_);
+    assert(chunks_ != NULL);
     assert(segmentState.parts.numHoles >= prevState.parts.numHoles);
+    assert(!usesFreeList() || cookie == IRT_FIRST_SEGMENT);
 
     /*
      * We know there's enough room in the table.  Now we just need to find
@@ -76,57 +141,58 @@ IndirectRef IndirectRefTable::add(u4 cookie, Object* obj)
      * add to the end of the list.
      */
     IndirectRef result;
-    IndirectRefSlot* slot;
+    IndirectRefSlot* entry;
+    u4 index;
     int numHoles = segmentState.parts.numHoles - prevState.parts.numHoles;
     if (numHoles > 0) {
         assert(topIndex > 1);
-        /* find the first hole; likely to be near the end of the list,
-         * we know the item at the topIndex is not a hole */
-        slot = &table_[topIndex - 1];
-        assert(slot->obj != NULL);
-        while ((--slot)->obj != NULL) {
-            assert(slot >= table_ + prevState.parts.topIndex);
+        if (usesFreeList()) {
+            assert(freeHead_ != 0);
+            index = freeHead_ - 1;
+            unlinkHole(index);
+        } else {
+            /* find the first hole; likely to be near the end of the list,
+             * we know the item at the topIndex is not a hole */
+            index = topIndex - 1;
+            assert(slot(index)->obj != NULL);
+            while (slot(--index)->obj != NULL) {
+                assert(index >= prevState.parts.topIndex);
+            }
         }
+        entry = slot(index);
         segmentState.parts.numHoles--;
     } else {
         /* add to the end, grow if needed */
+        if (topIndex == max_entries_) {
+            ALOGE("JNI ERROR (app bug): %s reference table overflow (max=%d)",
+                    indirectRefKindToString(kind_), max_entries_);
+            return NULL;
+        }
         if (topIndex == alloc_entries_) {
-            /* reached end of allocated space; did we hit buffer max? */
-            if (topIndex == max_entries_) {
-                ALOGE("JNI ERROR (app bug): %s reference table overflow (max=%d)",
-                        indirectRefKindToString(kind_), max_entries_);
-                return NULL;
-            }
-
-            size_t newSize = alloc_entries_ * 2;
-            if (newSize > max_entries_) {
-                newSize = max_entries_;
-            }
-            assert(newSize > alloc_entries_);
-
-            IndirectRefSlot* newTable =
-                    (IndirectRefSlot*) realloc(table_, newSize * sizeof(IndirectRefSlot));
-            if (table_ == NULL) {
+            /* reached end of allocated space; add a chunk */
+            size_t chunkSize = (size_t) 1 << chunkShift_;
+            IndirectRefSlot* newChunk =
+                    (IndirectRefSlot*) malloc(chunkSize * sizeof(IndirectRefSlot));
+            if (newChunk == NULL) {
                 ALOGE("JNI ERROR (app bug): unable to expand %s reference table "
                         "(from %d to %d, max=%d)",
                         indirectRefKindToString(kind_),
-                        alloc_entries_, newSize, max_entries_);
+                        alloc_entries_, alloc_entries_ + chunkSize, max_entries_);
                 return NULL;
             }
+            memset(newChunk, 0xd1, chunkSize * sizeof(IndirectRefSlot));
 
-            memset(newTable + alloc_entries_, 0xd1,
-                   (newSize - alloc_entries_) * sizeof(IndirectRefSlot));
-
-            alloc_entries_ = newSize;
-            table_ = newTable;
+            chunks_[alloc_entries_ >> chunkShift_] = newChunk;
+            alloc_entries_ += chunkSize;
         }
-        slot = &table_[topIndex++];
+        index = topIndex++;
+        entry = slot(index);
         segmentState.parts.topIndex = topIndex;
     }
 
-    slot->obj = obj;
-    slot->serial = nextSerial(slot->serial);
-    result = toIndirectRef(slot - table_, slot->serial, kind_);
+    entry->obj = obj;
+    entry->serial = nextSerial(entry->serial & 0xfff);
+    result = toIndirectRef(index, entry->serial, kind_);
 
     assert(result != NULL);
     return result;
@@ -164,8 +230,9 @@ Object* IndirectRefTable::get(IndirectRef iref) const {
         return kInvalidIndirectRefObject;
     }
 
-    Object* obj = table_[index].obj;
-    if (obj == NULL) {
+    const IndirectRefSlot* entry = slot(index);
+    Object* obj = entry->obj;
+    if (indirectRefSlotIsHole(obj)) {
         ALOGI("JNI ERROR (app bug): accessed deleted %s reference %p",
                 indirectRefKindToString(kind_), iref);
         abortMaybe();
@@ -173,7 +240,7 @@ Object* IndirectRefTable::get(IndirectRef iref) const {
     }
 
     u4 serial = extractSerial(iref);
-    if (serial != table_[index].serial) {
+    if (serial != entry->serial) {
         ALOGE("JNI ERROR (app bug): attempt to use stale %s reference %p",
                 indirectRefKindToString(kind_), iref);
         abortMaybe();
@@ -183,10 +250,13 @@ Object* IndirectRefTable::get(IndirectRef iref) const {
     return obj;
 }
 
-static int findObject(const Object* obj, int bottomIndex, int topIndex,
-        const IndirectRefSlot* table) {
+/*
+ * Returns the index of "obj" between bottomIndex and topIndex, or -1.
+ * Holes never match, since hole markers aren't object pointers.
+ */
+int IndirectRefTable::findObject(const Object* obj, int bottomIndex, int topIndex) const {
     for (int i = bottomIndex; i < topIndex; ++i) {
-        if (table[i].obj == obj) {
+        if (slot(i)->obj == obj) {
             return i;
         }
     }
@@ -194,7 +264,7 @@ static int findObject(const Object* obj, int bottomIndex, int topIndex,
 }
 
 bool IndirectRefTable::contains(const Object* obj) const {
-    return findObject(obj, 0, segmentState.parts.topIndex, table_) >= 0;
+    return findObject(obj, 0, segmentState.parts.topIndex) >= 0;
 }
 
 /*
@@ -217,9 +287,9 @@ bool IndirectRefTable::remove(u4 cookie, IndirectRef iref)
     u4 topIndex = segmentState.parts.topIndex;
     u4 bottomIndex = prevState.parts.topIndex;
 
-    assert(table_ != NULL);
-    assert(alloc_entries_ <= max_entries_);
+    assert(chunks_ != NULL);
     assert(segmentState.parts.numHoles >= prevState.parts.numHoles);
+    assert(!usesFreeList() || cookie == IRT_FIRST_SEGMENT);
 
     IndirectRefKind kind = indirectRefKind(iref);
     u4 index;
@@ -237,20 +307,20 @@ bool IndirectRefTable::remove(u4 cookie, IndirectRef iref)
                     index, bottomIndex, topIndex);
             return false;
         }
-        if (table_[index].obj == NULL) {
+        if (indirectRefSlotIsHole(slot(index)->obj)) {
             ALOGD("Attempt to remove cleared %s reference %p",
                     indirectRefKindToString(kind_), iref);
             return false;
         }
         u4 serial = extractSerial(iref);
-        if (table_[index].serial != serial) {
+        if (slot(index)->serial != serial) {
             ALOGD("Attempt to remove stale %s reference %p",
                     indirectRefKindToString(kind_), iref);
             return false;
         }
     } else if (kind == kIndirectKindInvalid && gDvmJni.workAroundAppJniBugs) {
         // reference looks like a pointer, scan the table to find the index
-        int i = findObject(reinterpret_cast<Object*>(iref), bottomIndex, topIndex, table_);
+        int i = findObject(reinterpret_cast<Object*>(iref), bottomIndex, topIndex);
         if (i < 0) {
             ALOGW("trying to work around app JNI bugs, but didn't find %p in table!", iref);
             return false;
@@ -267,11 +337,14 @@ bool IndirectRefTable::remove(u4 cookie, IndirectRef iref)
         if (numHoles != 0) {
             while (--topIndex > bottomIndex && numHoles != 0) {
                 ALOGV("+++ checking for hole at %d (cookie=0x%08x) val=%p",
-                    topIndex-1, cookie, table_[topIndex-1].obj);
-                if (table_[topIndex-1].obj != NULL) {
+                    topIndex-1, cookie, slot(topIndex-1)->obj);
+                if (!indirectRefSlotIsHole(slot(topIndex-1)->obj)) {
                     break;
                 }
                 ALOGV("+++ ate hole at %d", topIndex-1);
+                if (usesFreeList()) {
+                    unlinkHole(topIndex-1);
+                }
                 numHoles--;
             }
             segmentState.parts.numHoles = numHoles + prevState.parts.numHoles;
@@ -282,11 +355,15 @@ bool IndirectRefTable::remove(u4 cookie, IndirectRef iref)
         }
     } else {
         /*
-         * Not the top-most entry.  This creates a hole.  We NULL out the
+         * Not the top-most entry.  This creates a hole.  We clear out the
          * entry to prevent somebody from deleting it twice and screwing up
          * the hole count.
          */
-        table_[index].obj = NULL;
+        if (usesFreeList()) {
+            pushHole(index);
+        } else {
+            slot(index)->obj = NULL;
+        }
         segmentState.parts.numHoles++;
         ALOGV("+++ left hole at %d, holes=%d", index, segmentState.parts.numHoles);
     }
@@ -310,7 +387,8 @@ void IndirectRefTable::dump(const char* descr) const
     size_t count = capacity();
     Object** copy = new Object*[count];
     for (size_t i = 0; i < count; i++) {
-        copy[i] = table_[i].obj;
+        Object* obj = slot(i)->obj;
+        copy[i] = indirectRefSlotIsHole(obj) ? NULL : obj;
     }
     dvmDumpReferenceTableContents(copy, count, descr);
     delete[] copy;
@@ -49,6 +49,9 @@
  *  - removing individual references
  *  - scanning the entire table straight through
  *
+ * The slots are kept in fixed-size chunks that are allocated as the table
+ * grows, so growing never copies and slots never move.
+ *
  * If there's more than one segment, we don't guarantee that the table
  * will fill completely before we fail due to lack of space.  We do ensure
  * that the current segment will pack tightly, which should satisfy JNI
@@ -113,14 +116,46 @@ INLINE IndirectRefKind indirectRefKind(IndirectRef iref)
     return (IndirectRefKind)((u4) iref & 0x03);
 }
 
+/*
+ * The global and weak global tables are split into shards, each with its
+ * own lock, so that threads adding and deleting global refs at the same
+ * time rarely contend.  Bits 18-19, which the table itself ignores, hold
+ * the number of the shard a global ref came from.
+ */
+#define kIndirectRefShardCount  4       /* must be a power of 2, at most 4 */
+
+INLINE u4 indirectRefShard(IndirectRef iref)
+{
+    return ((u4) iref >> 18) & (kIndirectRefShardCount - 1);
+}
+
+INLINE IndirectRef indirectRefInShard(IndirectRef iref, u4 shard)
+{
+    assert(shard < kIndirectRefShardCount);
+    return (IndirectRef) ((u4) iref | (shard << 18));
+}
+
 /*
  * Information we store for each slot in the reference table.
+ *
+ * A hole in a table without segments (see IndirectRefTable) is on a
+ * doubly-linked free list.  Its "obj" holds the previous hole's index+1,
+ * shifted left with the low bit set, which can't be an object pointer;
+ * "serial" holds the next hole's index+1 above the 12 serial bits.
  */
 struct IndirectRefSlot {
     Object* obj;        /* object pointer itself, NULL if the slot is unused */
     u4      serial;     /* slot serial number */
 };
 
+/*
+ * Returns true if a slot holding "obj" is unused.
+ */
+INLINE bool indirectRefSlotIsHole(const Object* obj)
+{
+    return obj == NULL || ((uintptr_t) obj & 1) != 0;
+}
+
 /* use as initial value for "cookie", and when table has only one segment */
 #define IRT_FIRST_SEGMENT   0
 
@@ -133,13 +168,17 @@ struct IndirectRefSlot {
  * operations are adding a new entry and removing an entire table segment.
  *
  * If "alloc_entries_" is not equal to "max_entries_", the table may expand
- * when entries are added, which means the memory may move.  If you want
- * to keep pointers into "table" rather than offsets, you must use a
- * fixed-size table.
+ * when entries are added.  It does so by allocating another chunk of
+ * slots, so existing slots stay where they are.
  *
  * If we delete entries from the middle of the list, we will be left with
  * "holes".  We track the number of holes so that, when adding new elements,
- * we can quickly decide to do a trivial append or go slot-hunting.
+ * we can quickly decide to do a trivial append or fill a hole.  JNI local
+ * tables go slot-hunting within the current segment.  The other tables
+ * are only ever used with IRT_FIRST_SEGMENT, so they keep their holes on
+ * a free list and fill them in O(1).  (A local table can't: frames are
+ * popped by the interpreter restoring "segmentState" directly, which
+ * would leave the list pointing into popped segments.)
  *
  * When the top-most entry is removed, any holes immediately below it are
  * also removed.  Thus, deletion of an entry may reduce "topIndex" by more
@@ -201,8 +240,9 @@ union IRTSegmentState {
 
 class iref_iterator {
 public:
-    explicit iref_iterator(IndirectRefSlot* table, size_t i, size_t capacity) :
-            table_(table), i_(i), capacity_(capacity) {
+    explicit iref_iterator(IndirectRefSlot** chunks, u4 chunkShift, size_t i,
+            size_t capacity) :
+            chunks_(chunks), chunkShift_(chunkShift), i_(i), capacity_(capacity) {
         skipNullsAndTombstones();
     }
 
@@ -213,23 +253,28 @@ public:
     }
 
     Object** operator*() {
-        return &table_[i_].obj;
+        return &slot()->obj;
     }
 
     bool equals(const iref_iterator& rhs) const {
-        return (i_ == rhs.i_ && table_ == rhs.table_);
+        return (i_ == rhs.i_ && chunks_ == rhs.chunks_);
     }
 
 private:
+    IndirectRefSlot* slot() const {
+        return &chunks_[i_ >> chunkShift_][i_ & ((1 << chunkShift_) - 1)];
+    }
+
     void skipNullsAndTombstones() {
-        // We skip NULLs and tombstones. Clients don't want to see implementation details.
-        while (i_ < capacity_ && (table_[i_].obj == NULL
-                || table_[i_].obj == kClearedJniWeakGlobal)) {
+        // We skip holes and tombstones. Clients don't want to see implementation details.
+        while (i_ < capacity_ && (indirectRefSlotIsHole(slot()->obj)
+                || slot()->obj == kClearedJniWeakGlobal)) {
             ++i_;
         }
     }
 
-    IndirectRefSlot* table_;
+    IndirectRefSlot** chunks_;
+    u4 chunkShift_;
     size_t i_;
     size_t capacity_;
 };
@@ -251,14 +296,18 @@ public:
      * TODO: we can't make these private as long as the interpreter
      * uses offsetof, since private member data makes us non-POD.
      */
-    /* bottom of the stack */
-    IndirectRefSlot* table_;
+    /* slot chunks; entry i is in chunks_[i >> chunkShift_] */
+    IndirectRefSlot** chunks_;
     /* bit mask, ORed into all irefs */
     IndirectRefKind kind_;
     /* #of entries we have space for */
     size_t          alloc_entries_;
     /* max #of entries allowed */
     size_t          max_entries_;
+    /* log2 of the #of entries per chunk */
+    u4              chunkShift_;
+    /* first hole on the free list as index+1, or 0 (non-local tables) */
+    u4              freeHead_;
 
     // TODO: want hole-filling stats (#of holes filled, total entries scanned)
     //       for performance evaluation.
@@ -336,14 +385,26 @@ public:
     }
 
     iterator begin() {
-        return iterator(table_, 0, capacity());
+        return iterator(chunks_, chunkShift_, 0, capacity());
     }
 
     iterator end() {
-        return iterator(table_, capacity(), capacity());
+        return iterator(chunks_, chunkShift_, capacity(), capacity());
     }
 
 private:
+    IndirectRefSlot* slot(u4 index) const {
+        return &chunks_[index >> chunkShift_][index & ((1 << chunkShift_) - 1)];
+    }
+
+    bool usesFreeList() const {
+        return kind_ != kIndirectKindLocal;
+    }
+
+    void pushHole(u4 index);
+    void unlinkHole(u4 index);
+    int findObject(const Object* obj, int bottomIndex, int topIndex) const;
+
     static inline u4 extractIndex(IndirectRef iref) {
         u4 uref = (u4) iref;
         return (uref >> 2) & 0xffff;
@@ -364,4 +425,12 @@ private:
     }
 };
 
+/*
+ * One shard of a global reference table.  "lock" guards "table".
+ */
+struct IndirectRefShard {
+    IndirectRefTable table;
+    pthread_mutex_t lock;
+};
+
 #endif  // DALVIK_INDIRECTREFTABLE_H_
@@ -85,6 +85,7 @@ static void usage(const char* progName)
     dvmFprintf(stderr, "  -classpath classpath\n");
     dvmFprintf(stderr, "  -Dproperty=value\n");
     dvmFprintf(stderr, "  -verbose:tag  ('gc', 'jni', or 'class')\n");
+    dvmFprintf(stderr, "  -verbose:startup  (time post-fork initialization)\n");
     dvmFprintf(stderr, "  -ea[:<package name>... |:<class name>]\n");
     dvmFprintf(stderr, "  -da[:<package name>... |:<class name>]\n");
     dvmFprintf(stderr, "   (-enableassertions, -disableassertions)\n");
@@ -119,24 +120,67 @@ static void usage(const char* progName)
     dvmFprintf(stderr, "  -Xnoquithandler\n");
     dvmFprintf(stderr,
                 "  -Xjnigreflimit:N  (must be multiple of 100, >= 200)\n");
-    dvmFprintf(stderr, "  -Xjniopts:{warnonly,forcecopy}\n");
+    dvmFprintf(stderr, "  -Xjniopts:{warnonly,forcecopy,light,sample=N}\n");
     dvmFprintf(stderr, "  -Xjnitrace:substring (eg NativeClass or nativeMethod)\n");
+    dvmFprintf(stderr, "  -Xjnibind:{lazy,eager}\n");
     dvmFprintf(stderr, "  -Xstacktracefile:<filename>\n");
+    dvmFprintf(stderr, "  -Xlog-stdio\n");
+    dvmFprintf(stderr, "  -Xstdioforward:{<filename>,fd:<n>}\n");
+    dvmFprintf(stderr, "  -Xstdiorate:<lines/sec>\n");
     dvmFprintf(stderr, "  -Xgc:[no]precise\n");
     dvmFprintf(stderr, "  -Xgc:[no]preverify\n");
     dvmFprintf(stderr, "  -Xgc:[no]postverify\n");
     dvmFprintf(stderr, "  -Xgc:[no]concurrent\n");
     dvmFprintf(stderr, "  -Xgc:[no]verifycardtable\n");
+    dvmFprintf(stderr, "  -Xgc:[no]cardaging\n");
+    dvmFprintf(stderr, "  -Xgc:[no]tlab\n");
+    dvmFprintf(stderr, "  -Xgc:[no]slotruns\n");
+    dvmFprintf(stderr, "  -Xgc:[no]lazysweep\n");
+    dvmFprintf(stderr, "  -Xgc:[no]generational\n");
+    dvmFprintf(stderr, "  -Xgc:[no]copying\n");
+    dvmFprintf(stderr, "  -Xgc:[no]idlecompact\n");
+    dvmFprintf(stderr, "  -Xgc:[no]zygotecompact\n");
+    dvmFprintf(stderr, "  -Xhugepages:{none,transparent,explicit}\n");
+    dvmFprintf(stderr, "  -Xlockbias:{on,off}\n");
+    dvmFprintf(stderr, "  -Xlockprofile\n");
+    dvmFprintf(stderr, "  -Xallocsample:<bytes>\n");
+    dvmFprintf(stderr, "  -Xsampleprofile[:<usec>]\n");
+    dvmFprintf(stderr, "  -Xsampleprofilefile:<filename>\n");
+    dvmFprintf(stderr, "  -Xstartuptrace\n");
+    dvmFprintf(stderr, "  -Xmetricsfile:<filename>\n");
+    dvmFprintf(stderr, "  -Xmetricsinterval:<msec>\n");
+    dvmFprintf(stderr, "  -X[no]loaderaccounting\n");
     dvmFprintf(stderr, "  -XX:+DisableExplicitGC\n");
+    dvmFprintf(stderr, "  -Xforkheapdump\n");
+    dvmFprintf(stderr, "  -Xheaphistogram\n");
+    dvmFprintf(stderr, "  -Xstackdump:{suspendall,nonstop}\n");
+    dvmFprintf(stderr, "  -XX:ParallelGCThreads=N  (0 = one per CPU, 1 = serial)\n");
+    dvmFprintf(stderr, "  -XX:LargeObjectThreshold=N  (must be >= 4K)\n");
+    dvmFprintf(stderr, "  -XX:ArenaSpaceSize=N  (must be >= 1M)\n");
+    dvmFprintf(stderr, "  -XX:MaxGCPauseMillis=N\n");
+    dvmFprintf(stderr, "  -XX:GCTimePercent=N  (1-50, replaces MaxGCPauseMillis)\n");
+    dvmFprintf(stderr, "  -XX:MaxPendingFinalizers=N  (0 = no limit)\n");
     dvmFprintf(stderr, "  -X[no]genregmap\n");
     dvmFprintf(stderr, "  -Xverifyopt:[no]checkmon\n");
-    dvmFprintf(stderr, "  -Xcheckdexsum\n");
+    dvmFprintf(stderr, "  -Xverifyopt:[no]background\n");
+    dvmFprintf(stderr, "  -Xcheckdexsum[:trustopt]\n");
+    dvmFprintf(stderr, "  -Xmapstoreddex\n");
+    dvmFprintf(stderr, "  -Xpreresolve\n");
+    dvmFprintf(stderr, "  -X[no]preintern\n");
+    dvmFprintf(stderr, "  -X[no]reflectcache\n");
 #if defined(WITH_JIT)
     dvmFprintf(stderr, "  -Xincludeselectedop\n");
     dvmFprintf(stderr, "  -Xjitop:hexopvalue[-endvalue]"
                        "[,hexopvalue[-endvalue]]*\n");
     dvmFprintf(stderr, "  -Xincludeselectedmethod\n");
     dvmFprintf(stderr, "  -Xjitthreshold:decimalvalue\n");
+    dvmFprintf(stderr, "  -Xjitprofdecay:msec  (0 to disable)\n");
+    dvmFprintf(stderr, "  -Xjitwarmstart:filename\n");
+    dvmFprintf(stderr, "  -Xjitperfmap\n");
+    dvmFprintf(stderr, "  -Xjittracesample[:<usec>]\n");
+    dvmFprintf(stderr, "  -Xjitimplicitchecks\n");
+    dvmFprintf(stderr, "  -Xjitsuperblock:branches  (0 to disable)\n");
+    dvmFprintf(stderr, "  -Xjitcore:name  (eg cortex-a9, 74k)\n");
     dvmFprintf(stderr, "  -Xjitblocking\n");
     dvmFprintf(stderr, "  -Xjitmethod:signature[,signature]* "
                        "(eg Ljava/lang/String\\;replace)\n");
@@ -937,6 +981,22 @@ static int processOptions(int argc, const char* const argv[],
                 dvmFprintf(stderr, "Invalid -XX:HeapMaxFree option '%s'\n", argv[i]);
                 return -1;
             }
+        } else if (strncmp(argv[i], "-XX:LargeObjectThreshold=", 25) == 0) {
+            size_t val = parseMemOption(argv[i] + 25, 1024);
+            if (val >= 4096) {
+                gDvm.largeObjectThreshold = val;
+            } else {
+                dvmFprintf(stderr, "Invalid -XX:LargeObjectThreshold option '%s'\n", argv[i]);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "-XX:ArenaSpaceSize=", 19) == 0) {
+            size_t val = parseMemOption(argv[i] + 19, 1024);
+            if (val >= 1024 * 1024) {
+                gDvm.arenaSpaceSize = val;
+            } else {
+                dvmFprintf(stderr, "Invalid -XX:ArenaSpaceSize option '%s'\n", argv[i]);
+                return -1;
+            }
         } else if (strncmp(argv[i], "-XX:HeapTargetUtilization=", 26) == 0) {
             const char* start = argv[i] + 26;
             const char* end = start;
@@ -951,6 +1011,48 @@ static int processOptions(int argc, const char* const argv[],
                 dvmFprintf(stderr, "Invalid -XX:HeapTargetUtilization option '%s'\n", argv[i]);
                 return -1;
             }
+        } else if (strncmp(argv[i], "-XX:ParallelGCThreads=", 22) == 0) {
+            const char* start = argv[i] + 22;
+            char* end;
+            long val = strtol(start, &end, 10);
+            if (start != end && *end == '\0' && val >= 0) {
+                gDvm.parallelGcThreads = val;
+            } else {
+                dvmFprintf(stderr, "Invalid -XX:ParallelGCThreads option '%s'\n", argv[i]);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "-XX:MaxGCPauseMillis=", 21) == 0) {
+            const char* start = argv[i] + 21;
+            char* end;
+            long val = strtol(start, &end, 10);
+            if (start != end && *end == '\0' && val > 0) {
+                gDvm.gcPauseTargetMs = val;
+                gDvm.gcTimePercent = 0;
+            } else {
+                dvmFprintf(stderr, "Invalid -XX:MaxGCPauseMillis option '%s'\n", argv[i]);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "-XX:GCTimePercent=", 18) == 0) {
+            const char* start = argv[i] + 18;
+            char* end;
+            long val = strtol(start, &end, 10);
+            if (start != end && *end == '\0' && val >= 1 && val <= 50) {
+                gDvm.gcTimePercent = val;
+                gDvm.gcPauseTargetMs = 0;
+            } else {
+                dvmFprintf(stderr, "Invalid -XX:GCTimePercent option '%s'\n", argv[i]);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "-XX:MaxPendingFinalizers=", 25) == 0) {
+            const char* start = argv[i] + 25;
+            char* end;
+            long val = strtol(start, &end, 10);
+            if (start != end && *end == '\0' && val >= 0) {
+                gDvm.maxPendingFinalizers = val;
+            } else {
+                dvmFprintf(stderr, "Invalid -XX:MaxPendingFinalizers option '%s'\n", argv[i]);
+                return -1;
+            }
         } else if (strncmp(argv[i], "-Xss", 4) == 0) {
             size_t val = parseMemOption(argv[i]+4, 1);
             if (val != 0) {
@@ -986,6 +1088,14 @@ static int processOptions(int argc, const char* const argv[],
 
         } else if (strncmp(argv[i], "-XX:+DisableExplicitGC", 22) == 0) {
             gDvm.disableExplicitGc = true;
+        } else if (strcmp(argv[i], "-Xforkheapdump") == 0) {
+            gDvm.forkHeapDump = true;
+        } else if (strcmp(argv[i], "-Xheaphistogram") == 0) {
+            gDvm.heapHistogramOnSigQuit = true;
+        } else if (strcmp(argv[i], "-Xstackdump:nonstop") == 0) {
+            gDvm.nonStopStackDump = true;
+        } else if (strcmp(argv[i], "-Xstackdump:suspendall") == 0) {
+            gDvm.nonStopStackDump = false;
         } else if (strcmp(argv[i], "-verbose") == 0 ||
             strcmp(argv[i], "-verbose:class") == 0)
         {
@@ -998,6 +1108,8 @@ static int processOptions(int argc, const char* const argv[],
             gDvm.verboseGc = true;
         } else if (strcmp(argv[i], "-verbose:shutdown") == 0) {
             gDvm.verboseShutdown = true;
+        } else if (strcmp(argv[i], "-verbose:startup") == 0) {
+            gDvm.verboseStartup = true;
 
         } else if (strncmp(argv[i], "-enableassertions", 17) == 0) {
             enableAssertions(argv[i] + 17, true);
@@ -1081,8 +1193,44 @@ static int processOptions(int argc, const char* const argv[],
             gDvm.jniGrefLimit = lim;
         } else if (strncmp(argv[i], "-Xjnitrace:", 11) == 0) {
             gDvm.jniTrace = strdup(argv[i] + 11);
+        } else if (strncmp(argv[i], "-Xjnibind:", 10) == 0) {
+            if (strcmp(argv[i] + 10, "lazy") == 0) {
+                gDvm.jniEagerBind = false;
+            } else if (strcmp(argv[i] + 10, "eager") == 0) {
+                gDvm.jniEagerBind = true;
+            } else {
+                dvmFprintf(stderr, "Bad value for -Xjnibind: '%s'\n",
+                    argv[i]+10);
+                return -1;
+            }
         } else if (strcmp(argv[i], "-Xlog-stdio") == 0) {
             gDvm.logStdio = true;
+        } else if (strncmp(argv[i], "-Xstdioforward:fd:", 18) == 0) {
+            char* end;
+            long val = strtol(argv[i] + 18, &end, 0);
+            if (*end != '\0' || val < 0) {
+                dvmFprintf(stderr, "Invalid -Xstdioforward option '%s'\n",
+                    argv[i]);
+                return -1;
+            }
+            free(gDvm.stdioForwardFile);
+            gDvm.stdioForwardFile = NULL;
+            gDvm.stdioForwardFd = val;
+            gDvm.logStdio = true;
+        } else if (strncmp(argv[i], "-Xstdioforward:", 15) == 0) {
+            free(gDvm.stdioForwardFile);
+            gDvm.stdioForwardFile = strdup(argv[i] + 15);
+            gDvm.stdioForwardFd = -1;
+            gDvm.logStdio = true;
+        } else if (strncmp(argv[i], "-Xstdiorate:", 12) == 0) {
+            char* end;
+            long val = strtol(argv[i] + 12, &end, 0);
+            if (*end != '\0' || val < 0) {
+                dvmFprintf(stderr, "Invalid -Xstdiorate option '%s'\n",
+                    argv[i]);
+                return -1;
+            }
+            gDvm.stdioRateLimit = val;
 
         } else if (strncmp(argv[i], "-Xint", 5) == 0) {
             if (argv[i][5] == ':') {
@@ -1107,6 +1255,59 @@ static int processOptions(int argc, const char* const argv[],
         } else if (strncmp(argv[i], "-Xlockprofthreshold:", 20) == 0) {
             gDvm.lockProfThreshold = atoi(argv[i] + 20);
 
+        } else if (strcmp(argv[i], "-Xlockprofile") == 0) {
+            gDvm.lockProfileAtStartup = true;
+
+        } else if (strncmp(argv[i], "-Xallocsample:", 14) == 0) {
+            char* end;
+            long val = strtol(argv[i] + 14, &end, 0);
+            if (*end != '\0' || val <= 0) {
+                dvmFprintf(stderr, "Invalid -Xallocsample option '%s'\n",
+                    argv[i]);
+                return -1;
+            }
+            gDvm.allocSampleInterval = val;
+
+        } else if (strcmp(argv[i], "-Xsampleprofile") == 0) {
+            gDvm.sampleProfileAtStartup = true;
+        } else if (strncmp(argv[i], "-Xsampleprofile:", 16) == 0) {
+            char* end;
+            long val = strtol(argv[i] + 16, &end, 0);
+            if (*end != '\0' || val <= 0) {
+                dvmFprintf(stderr, "Invalid -Xsampleprofile option '%s'\n",
+                    argv[i]);
+                return -1;
+            }
+            gDvm.sampleProfileAtStartup = true;
+            gDvm.sampleIntervalUsec = val;
+        } else if (strncmp(argv[i], "-Xsampleprofilefile:", 20) == 0) {
+            free(gDvm.sampleProfileFile);
+            gDvm.sampleProfileFile = strdup(argv[i] + 20);
+
+        } else if (strcmp(argv[i], "-Xstartuptrace") == 0) {
+            gDvm.startupTrace = true;
+        } else if (strncmp(argv[i], "-Xmetricsfile:", 14) == 0) {
+            free(gDvm.metricsFile);
+            gDvm.metricsFile = strdup(argv[i] + 14);
+        } else if (strncmp(argv[i], "-Xmetricsinterval:", 18) == 0) {
+            char* end;
+            long val = strtol(argv[i] + 18, &end, 0);
+            if (*end != '\0' || val <= 0) {
+                dvmFprintf(stderr, "Invalid -Xmetricsinterval option '%s'\n",
+                    argv[i]);
+                return -1;
+            }
+            gDvm.metricsIntervalMsec = val;
+        } else if (strcmp(argv[i], "-Xloaderaccounting") == 0) {
+            gDvm.loaderAccounting = true;
+        } else if (strcmp(argv[i], "-Xnoloaderaccounting") == 0) {
+            gDvm.loaderAccounting = false;
+
+        } else if (strcmp(argv[i], "-Xlockbias:on") == 0) {
+            gDvm.biasedLocking = true;
+        } else if (strcmp(argv[i], "-Xlockbias:off") == 0) {
+            gDvm.biasedLocking = false;
+
 #ifdef WITH_JIT
         } else if (strncmp(argv[i], "-Xjitop", 7) == 0) {
             processXjitop(argv[i]);
@@ -1118,10 +1319,15 @@ static int processOptions(int argc, const char* const argv[],
             processXjitoffset(argv[i] + strlen("-Xjitoffset:"));
         } else if (strncmp(argv[i], "-Xjitconfig:", 12) == 0) {
             processXjitconfig(argv[i] + strlen("-Xjitconfig:"));
+        } else if (strncmp(argv[i], "-Xjitwarmstart:", 15) == 0) {
+          free(gDvmJit.warmStartFile);
+          gDvmJit.warmStartFile = strdup(argv[i] + 15);
         } else if (strncmp(argv[i], "-Xjitblocking", 13) == 0) {
           gDvmJit.blockingMode = true;
         } else if (strncmp(argv[i], "-Xjitthreshold:", 15) == 0) {
           gDvmJit.threshold = atoi(argv[i] + 15);
+        } else if (strncmp(argv[i], "-Xjitprofdecay:", 15) == 0) {
+          gDvmJit.profDecayMsec = atoi(argv[i] + 15);
         } else if (strncmp(argv[i], "-Xincludeselectedop", 19) == 0) {
           gDvmJit.includeSelectedOp = true;
         } else if (strncmp(argv[i], "-Xincludeselectedmethod", 23) == 0) {
@@ -1130,6 +1336,27 @@ static int processOptions(int argc, const char* const argv[],
           gDvmJit.checkCallGraph = true;
           /* Need to enable blocking mode due to stack crawling */
           gDvmJit.blockingMode = true;
+        } else if (strcmp(argv[i], "-Xjitperfmap") == 0) {
+          gDvmJit.perfMap = true;
+        } else if (strcmp(argv[i], "-Xjittracesample") == 0) {
+          gDvmJit.traceSampleAtStartup = true;
+        } else if (strncmp(argv[i], "-Xjittracesample:", 17) == 0) {
+          char* end;
+          long val = strtol(argv[i] + 17, &end, 0);
+          if (*end != '\0' || val <= 0) {
+              dvmFprintf(stderr, "Invalid -Xjittracesample option '%s'\n",
+                  argv[i]);
+              return -1;
+          }
+          gDvmJit.traceSampleAtStartup = true;
+          gDvmJit.traceSampleIntervalUsec = val;
+        } else if (strcmp(argv[i], "-Xjitimplicitchecks") == 0) {
+          gDvmJit.implicitChecks = true;
+        } else if (strncmp(argv[i], "-Xjitsuperblock:", 16) == 0) {
+          gDvmJit.superblockBranches = atoi(argv[i] + 16);
+        } else if (strncmp(argv[i], "-Xjitcore:", 10) == 0) {
+          free(gDvmJit.schedCore);
+          gDvmJit.schedCore = strdup(argv[i] + 10);
         } else if (strncmp(argv[i], "-Xjitdumpbin", 12) == 0) {
           gDvmJit.printBinary = true;
         } else if (strncmp(argv[i], "-Xjitverbose", 12) == 0) {
@@ -1160,6 +1387,10 @@ static int processOptions(int argc, const char* const argv[],
             gDvm.monitorVerification = true;
         } else if (strcmp(argv[i], "Xverifyopt:nocheckmon") == 0) {
             gDvm.monitorVerification = false;
+        } else if (strcmp(argv[i], "-Xverifyopt:background") == 0) {
+            gDvm.backgroundVerify = true;
+        } else if (strcmp(argv[i], "-Xverifyopt:nobackground") == 0) {
+            gDvm.backgroundVerify = false;
 
         } else if (strncmp(argv[i], "-Xgc:", 5) == 0) {
             if (strcmp(argv[i] + 5, "precise") == 0)
@@ -1182,14 +1413,74 @@ static int processOptions(int argc, const char* const argv[],
                 gDvm.verifyCardTable = true;
             else if (strcmp(argv[i] + 5, "noverifycardtable") == 0)
                 gDvm.verifyCardTable = false;
+            else if (strcmp(argv[i] + 5, "cardaging") == 0)
+                gDvm.cardAging = true;
+            else if (strcmp(argv[i] + 5, "nocardaging") == 0)
+                gDvm.cardAging = false;
+            else if (strcmp(argv[i] + 5, "tlab") == 0)
+                gDvm.useTlabs = true;
+            else if (strcmp(argv[i] + 5, "notlab") == 0)
+                gDvm.useTlabs = false;
+            else if (strcmp(argv[i] + 5, "slotruns") == 0)
+                gDvm.useSlotRuns = true;
+            else if (strcmp(argv[i] + 5, "noslotruns") == 0)
+                gDvm.useSlotRuns = false;
+            else if (strcmp(argv[i] + 5, "lazysweep") == 0)
+                gDvm.lazySweep = true;
+            else if (strcmp(argv[i] + 5, "nolazysweep") == 0)
+                gDvm.lazySweep = false;
+            else if (strcmp(argv[i] + 5, "generational") == 0)
+                gDvm.generationalGc = true;
+            else if (strcmp(argv[i] + 5, "nogenerational") == 0)
+                gDvm.generationalGc = false;
+            else if (strcmp(argv[i] + 5, "copying") == 0)
+                gDvm.copyingGc = true;
+            else if (strcmp(argv[i] + 5, "nocopying") == 0)
+                gDvm.copyingGc = false;
+            else if (strcmp(argv[i] + 5, "idlecompact") == 0)
+                gDvm.idleCompaction = true;
+            else if (strcmp(argv[i] + 5, "noidlecompact") == 0)
+                gDvm.idleCompaction = false;
+            else if (strcmp(argv[i] + 5, "zygotecompact") == 0)
+                gDvm.zygoteCompaction = true;
+            else if (strcmp(argv[i] + 5, "nozygotecompact") == 0)
+                gDvm.zygoteCompaction = false;
             else {
                 dvmFprintf(stderr, "Bad value for -Xgc");
                 return -1;
             }
             ALOGV("Precise GC configured %s", gDvm.preciseGc ? "ON" : "OFF");
 
+        } else if (strcmp(argv[i], "-Xhugepages:none") == 0) {
+            gDvm.hugePageMode = kHugePagesNone;
+        } else if (strcmp(argv[i], "-Xhugepages:transparent") == 0) {
+            gDvm.hugePageMode = kHugePagesTransparent;
+        } else if (strcmp(argv[i], "-Xhugepages:explicit") == 0) {
+            gDvm.hugePageMode = kHugePagesExplicit;
+
         } else if (strcmp(argv[i], "-Xcheckdexsum") == 0) {
             gDvm.verifyDexChecksum = true;
+        } else if (strcmp(argv[i], "-Xcheckdexsum:trustopt") == 0) {
+            /*
+             * dexopt verified the DEX data of an optimized file and wrote
+             * its checksum, so only check the deps and opt data.
+             */
+            gDvm.verifyDexChecksum = true;
+            gDvm.trustOptDexChecksum = true;
+
+        } else if (strcmp(argv[i], "-Xmapstoreddex") == 0) {
+            gDvm.mapStoredDex = true;
+
+        } else if (strcmp(argv[i], "-Xpreresolve") == 0) {
+            gDvm.preResolve = true;
+        } else if (strcmp(argv[i], "-Xpreintern") == 0) {
+            gDvm.preInternLiterals = true;
+        } else if (strcmp(argv[i], "-Xnopreintern") == 0) {
+            gDvm.preInternLiterals = false;
+        } else if (strcmp(argv[i], "-Xreflectcache") == 0) {
+            gDvm.reflectCache = true;
+        } else if (strcmp(argv[i], "-Xnoreflectcache") == 0) {
+            gDvm.reflectCache = false;
 
         } else if (strcmp(argv[i], "-Xprofile:threadcpuclock") == 0) {
             gDvm.profilerClockSource = kProfilerClockSourceThreadCpu;
@@ -1239,6 +1530,7 @@ static void setCommandLineDefaults()
     gDvm.heapGrowthLimit = 0;  // 0 means no growth limit
     gDvm.stackSize = kDefaultStackSize;
     gDvm.mainThreadStackSize = kDefaultStackSize;
+    gDvm.stdioForwardFd = -1;
     // When the heap is less than the maximum or growth limited size,
     // fix the free portion of the heap. The utilization is the ratio
     // of live to free memory, 0.5 implies half the heap is available
@@ -1250,6 +1542,13 @@ static void setCommandLineDefaults()
     gDvm.heapMinFree = gDvm.heapMaxFree / 4;
 
     gDvm.concurrentMarkSweep = true;
+    gDvm.cardAging = true;
+    gDvm.useTlabs = true;
+    gDvm.biasedLocking = true;
+#ifdef WITH_COPYING_GC
+    gDvm.copyingGc = true;
+#endif
+    gDvm.zygoteCompaction = true;
 
     /* gDvm.jdwpSuspend = true; */
 
@@ -1260,6 +1559,10 @@ static void setCommandLineDefaults()
     gDvm.classVerifyMode = VERIFY_MODE_ALL;
     gDvm.dexOptMode = OPTIMIZE_MODE_VERIFIED;
     gDvm.monitorVerification = false;
+    gDvm.backgroundVerify = true;
+    gDvm.preInternLiterals = true;
+    gDvm.reflectCache = true;
+    gDvm.loaderAccounting = true;
     gDvm.generateRegisterMaps = true;
     gDvm.registerMapMode = kRegisterMapModeTypePrecise;
 
@@ -1277,6 +1580,7 @@ static void setCommandLineDefaults()
     gDvmJit.includeSelectedOffset = false;
     gDvmJit.methodTable = NULL;
     gDvmJit.classTable = NULL;
+    gDvmJit.profDecayMsec = 1000;
 
     gDvm.constInit = false;
     gDvm.commonInit = false;
@@ -1367,6 +1671,55 @@ private:
     bool armed_;
 };
 
+/*
+ * -Xstartuptrace bookkeeping.  markStartupStep() charges the wall and
+ * thread CPU time since the previous mark to the named step.  Before the
+ * options are parsed we don't know whether tracing is on, so the first
+ * mark always takes the timestamps.
+ */
+struct StartupStep {
+    const char* name;
+    u8 wallUsec;
+    u8 cpuUsec;
+};
+
+#define kMaxStartupSteps 48
+static StartupStep gStartupSteps[kMaxStartupSteps];
+static int gNumStartupSteps;
+static u8 gStepStartWall;
+static u8 gStepStartCpu;
+
+static void markStartupStep(const char* name)
+{
+    if (!gDvm.startupTrace || gNumStartupSteps == kMaxStartupSteps) {
+        return;
+    }
+    u8 wall = dvmGetRelativeTimeUsec();
+    u8 cpu = dvmGetThreadCpuTimeUsec();
+    StartupStep* step = &gStartupSteps[gNumStartupSteps++];
+    step->name = name;
+    step->wallUsec = wall - gStepStartWall;
+    step->cpuUsec = cpu - gStepStartCpu;
+    gStepStartWall = wall;
+    gStepStartCpu = cpu;
+}
+
+static void dumpStartupTrace()
+{
+    u8 totalWall = 0, totalCpu = 0;
+
+    ALOGI("startup-trace: %-24s %8s %8s", "step", "wall", "cpu");
+    for (int i = 0; i < gNumStartupSteps; i++) {
+        const StartupStep* step = &gStartupSteps[i];
+        ALOGI("startup-trace: %-24s %8d %8d", step->name,
+            (int) step->wallUsec, (int) step->cpuUsec);
+        totalWall += step->wallUsec;
+        totalCpu += step->cpuUsec;
+    }
+    ALOGI("startup-trace: %-24s %8d %8d usec, %d classes loaded", "total",
+        (int) totalWall, (int) totalCpu, gDvm.numLoadedClasses);
+}
+
 /*
  * VM initialization.  Pass in any options provided on the command line.
  * Do not pass in the class name or the options for the class.
@@ -1379,6 +1732,8 @@ std::string dvmStartup(int argc, const char* const argv[],
     ScopedShutdown scopedShutdown;
 
     assert(gDvm.initializing);
+    gStepStartWall = dvmGetRelativeTimeUsec();
+    gStepStartCpu = dvmGetThreadCpuTimeUsec();
 
     ALOGV("VM init args (%d):", argc);
     for (int i = 0; i < argc; i++) {
@@ -1397,6 +1752,7 @@ std::string dvmStartup(int argc, const char* const argv[],
         }
         return "syntax error";
     }
+    markStartupStep("options");
 
 #if WITH_EXTRA_GC_CHECKS > 1
     /* only "portable" interp has the extra goodies */
@@ -1432,27 +1788,58 @@ std::string dvmStartup(int argc, const char* const argv[],
      * Initialize components.
      */
     dvmQuasiAtomicsStartup();
+    markStartupStep("setup");
     if (!dvmAllocTrackerStartup()) {
         return "dvmAllocTrackerStartup failed";
     }
+    markStartupStep("alloc-tracker");
+    if (!dvmLockProfilerStartup()) {
+        return "dvmLockProfilerStartup failed";
+    }
+    markStartupStep("lock-profiler");
+    if (!dvmSamplingProfilerStartup()) {
+        return "dvmSamplingProfilerStartup failed";
+    }
+    markStartupStep("sampling-profiler");
+    if (!dvmMetricsStartup()) {
+        return "dvmMetricsStartup failed";
+    }
+    markStartupStep("metrics");
     if (!dvmGcStartup()) {
         return "dvmGcStartup failed";
     }
+    markStartupStep("gc");
     if (!dvmThreadStartup()) {
         return "dvmThreadStartup failed";
     }
+    markStartupStep("thread");
     if (!dvmInlineNativeStartup()) {
         return "dvmInlineNativeStartup";
     }
+    markStartupStep("inline-native");
     if (!dvmRegisterMapStartup()) {
         return "dvmRegisterMapStartup failed";
     }
+    markStartupStep("register-map");
     if (!dvmInstanceofStartup()) {
         return "dvmInstanceofStartup failed";
     }
+    markStartupStep("instanceof");
+    if (!dvmExceptionStartup()) {
+        return "dvmExceptionStartup failed";
+    }
+    markStartupStep("exception");
+    if (!dvmLineNumStartup()) {
+        return "dvmLineNumStartup failed";
+    }
+    markStartupStep("line-num");
+    if (!dvmBackgroundVerifyStartup()) {
+        return "dvmBackgroundVerifyStartup failed";
+    }
     if (!dvmClassStartup()) {
         return "dvmClassStartup failed";
     }
+    markStartupStep("class (boot class path)");
 
     /*
      * At this point, the system is guaranteed to be sufficiently
@@ -1463,22 +1850,28 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!dvmFindRequiredClassesAndMembers()) {
         return "dvmFindRequiredClassesAndMembers failed";
     }
+    markStartupStep("required-classes");
 
     if (!dvmStringInternStartup()) {
         return "dvmStringInternStartup failed";
     }
+    markStartupStep("string-intern");
     if (!dvmNativeStartup()) {
         return "dvmNativeStartup failed";
     }
+    markStartupStep("native");
     if (!dvmInternalNativeStartup()) {
         return "dvmInternalNativeStartup failed";
     }
+    markStartupStep("internal-native");
     if (!dvmJniStartup()) {
         return "dvmJniStartup failed";
     }
+    markStartupStep("jni");
     if (!dvmProfilingStartup()) {
         return "dvmProfilingStartup failed";
     }
+    markStartupStep("profiling");
 
     /*
      * Create a table of methods for which we will substitute an "inline"
@@ -1487,6 +1880,7 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!dvmCreateInlineSubsTable()) {
         return "dvmCreateInlineSubsTable failed";
     }
+    markStartupStep("inline-subs");
 
     /*
      * Miscellaneous class library validation.
@@ -1494,6 +1888,7 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!dvmValidateBoxClasses()) {
         return "dvmValidateBoxClasses failed";
     }
+    markStartupStep("box-classes");
 
     /*
      * Do the last bits of Thread struct initialization we need to allow
@@ -1502,6 +1897,7 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!dvmPrepMainForJni(pEnv)) {
         return "dvmPrepMainForJni failed";
     }
+    markStartupStep("prep-main-jni");
 
     /*
      * Explicitly initialize java.lang.Class.  This doesn't happen
@@ -1513,6 +1909,7 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!dvmInitClass(gDvm.classJavaLangClass)) {
         return "couldn't initialized java.lang.Class";
     }
+    markStartupStep("init-class-Class");
 
     /*
      * Register the system native methods, which are registered through JNI.
@@ -1520,6 +1917,7 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!registerSystemNatives(pEnv)) {
         return "couldn't register system natives";
     }
+    markStartupStep("system-natives");
 
     /*
      * Do some "late" initialization for the memory allocator.  This may
@@ -1528,6 +1926,7 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!dvmCreateStockExceptions()) {
         return "dvmCreateStockExceptions failed";
     }
+    markStartupStep("stock-exceptions");
 
     /*
      * At this point, the VM is in a pretty good state.  Finish prep on
@@ -1538,6 +1937,7 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!dvmPrepMainThread()) {
         return "dvmPrepMainThread failed";
     }
+    markStartupStep("prep-main-thread");
 
     /*
      * Make sure we haven't accumulated any tracked references.  The main
@@ -1553,10 +1953,12 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!dvmDebuggerStartup()) {
         return "dvmDebuggerStartup failed";
     }
+    markStartupStep("debugger");
 
     if (!dvmGcStartupClasses()) {
         return "dvmGcStartupClasses failed";
     }
+    markStartupStep("gc-classes");
 
     /*
      * Init for either zygote mode or non-zygote mode.  The key difference
@@ -1571,6 +1973,7 @@ std::string dvmStartup(int argc, const char* const argv[],
             return "dvmInitAfterZygote failed";
         }
     }
+    markStartupStep(gDvm.zygote ? "zygote-init" : "after-zygote-init");
 
 
 #ifndef NDEBUG
@@ -1585,6 +1988,12 @@ std::string dvmStartup(int argc, const char* const argv[],
         return "Exception pending at end of VM initialization";
     }
 
+    if (gDvm.startupTrace) {
+        dumpStartupTrace();
+    }
+    gDvm.startupEndUsec = dvmGetRelativeTimeUsec();
+    gDvm.startupEndCpuUsec = dvmGetThreadCpuTimeUsec();
+
     scopedShutdown.disarm();
     return "";
 }
@@ -1664,9 +2073,68 @@ static bool initZygote()
         }
     }
 
+#ifdef WITH_JIT
+    /* Set up the code cache once, for all the children to share */
+    if (gDvm.executionMode == kExecutionModeJit &&
+        !dvmCompilerZygoteStartup()) {
+        ALOGW("JIT: zygote code cache setup failed");
+    }
+#endif
+
     return true;
 }
 
+/*
+ * Start the services that nothing needs before the first frame of app
+ * code runs.  Each of them creates a thread and waits for it to check in,
+ * so they run here, on a short-lived thread of their own, instead of
+ * holding up the main thread.  dvmShutdown() waits for this thread before
+ * stopping any of them.
+ */
+static void* deferredStartThreadStart(void* arg)
+{
+    u8 start = dvmGetRelativeTimeUsec();
+
+    /* start sampled allocation tracking, if requested; not fatal */
+    if (gDvm.allocSampleInterval != 0) {
+        if (!dvmEnableAllocTracker())
+            ALOGW("Allocation sampling failed to start");
+    }
+
+    /* start the sampling profiler, if requested; not fatal */
+    if (gDvm.sampleProfileAtStartup) {
+        if (!dvmEnableSamplingProfiler(0))
+            ALOGW("Sampling profiler failed to start");
+    }
+
+#ifdef WITH_JIT
+    /*
+     * The compiler thread does its real setup later, once it is asked
+     * for a translation, and nothing is queued until then.
+     */
+    if (gDvm.executionMode == kExecutionModeJit) {
+        if (!dvmCompilerStartup()) {
+            ALOGE("JIT compiler failed to start");
+            dvmAbort();
+        }
+
+        /* start sampling the translations, if requested; not fatal */
+        if (gDvmJit.traceSampleAtStartup) {
+            if (!dvmEnableJitTraceSampling(0))
+                ALOGW("JIT trace sampling failed to start");
+        }
+    }
+#endif
+
+    int elapsed = (int) (dvmGetRelativeTimeUsec() - start);
+    if (gDvm.verboseStartup) {
+        ALOGI("deferred startup: %d usec", elapsed);
+    } else {
+        ALOGV("deferred startup: %d usec", elapsed);
+    }
+    return NULL;
+}
+
 /*
  * Do non-zygote-mode initialization.  This is done during VM init for
  * standard startup, or after a "zygote fork" when creating a new process.
@@ -1700,6 +2168,22 @@ bool dvmInitAfterZygote()
             return false;
     }
 
+    /* clear the zygote's counters, and publish ours if requested */
+    if (!dvmStartMetricsPublisher())
+        ALOGW("Metrics publisher failed to start");
+
+    /* verify what dexopt couldn't before the app gets to it; not fatal */
+    if (!dvmStartBackgroundVerifier())
+        ALOGW("Background verifier failed to start");
+
+    /* everything else that can wait; see deferredStartThreadStart() */
+    if (!dvmCreateInternalThread(&gDvm.deferredStartHandle, "Deferred Start",
+            deferredStartThreadStart, NULL))
+    {
+        return false;
+    }
+    gDvm.deferredStartThreadStarted = true;
+
     endQuit = dvmGetRelativeTimeUsec();
     startJdwp = dvmGetRelativeTimeUsec();
 
@@ -1714,16 +2198,15 @@ bool dvmInitAfterZygote()
 
     endJdwp = dvmGetRelativeTimeUsec();
 
-    ALOGV("thread-start heap=%d quit=%d jdwp=%d total=%d usec",
-        (int)(endHeap-startHeap), (int)(endQuit-startQuit),
-        (int)(endJdwp-startJdwp), (int)(endJdwp-startHeap));
-
-#ifdef WITH_JIT
-    if (gDvm.executionMode == kExecutionModeJit) {
-        if (!dvmCompilerStartup())
-            return false;
+    if (gDvm.verboseStartup) {
+        ALOGI("thread-start heap=%d quit=%d jdwp=%d total=%d usec",
+            (int)(endHeap-startHeap), (int)(endQuit-startQuit),
+            (int)(endJdwp-startJdwp), (int)(endJdwp-startHeap));
+    } else {
+        ALOGV("thread-start heap=%d quit=%d jdwp=%d total=%d usec",
+            (int)(endHeap-startHeap), (int)(endQuit-startQuit),
+            (int)(endJdwp-startJdwp), (int)(endJdwp-startHeap));
     }
-#endif
 
     return true;
 }
@@ -1892,6 +2375,15 @@ void dvmShutdown()
     if (CALC_CACHE_STATS)
         dvmDumpAtomicCacheStats(gDvm.instanceofCache);
 
+    /*
+     * Let the deferred starts finish, so that each service below is
+     * either fully started or never was.
+     */
+    if (gDvm.deferredStartThreadStarted) {
+        pthread_join(gDvm.deferredStartHandle, NULL);
+        gDvm.deferredStartThreadStarted = false;
+    }
+
     /*
      * Stop our internal threads.
      */
@@ -1911,6 +2403,20 @@ void dvmShutdown()
 
     /* shut down stdout/stderr conversion */
     dvmStdioConverterShutdown();
+    free(gDvm.stdioForwardFile);
+    gDvm.stdioForwardFile = NULL;
+
+    /* stop sampling, writing out the profile */
+    dvmDisableSamplingProfiler();
+
+    /* write the final counters out */
+    dvmStopMetricsPublisher();
+
+    /* stop sending heap segments to DDM */
+    dvmDdmHeapShutdown();
+
+    /* stop verifying ahead of use */
+    dvmStopBackgroundVerifier();
 
 #ifdef WITH_JIT
     if (gDvm.executionMode == kExecutionModeJit) {
@@ -1934,12 +2440,18 @@ void dvmShutdown()
     dvmJniShutdown();
     dvmStringInternShutdown();
     dvmThreadShutdown();
+    dvmBackgroundVerifyShutdown();
     dvmClassShutdown();
     dvmRegisterMapShutdown();
     dvmInstanceofShutdown();
+    dvmExceptionShutdown();
+    dvmLineNumShutdown();
     dvmInlineNativeShutdown();
     dvmGcShutdown();
     dvmAllocTrackerShutdown();
+    dvmLockProfilerShutdown();
+    dvmSamplingProfilerShutdown();
+    dvmMetricsShutdown();
 
     /* these must happen AFTER dvmClassShutdown has walked through class data */
     dvmNativeShutdown();
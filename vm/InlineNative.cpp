@@ -22,6 +22,22 @@
 
 #include <math.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_VECTOR_CHAR_OPS
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_VECTOR_CHAR_OPS
+#endif
+
+/*
+ * Where we have vector char scans, they beat __memcmp16, which works a
+ * word at a time.
+ */
+#ifdef HAVE_VECTOR_CHAR_OPS
+#undef HAVE__MEMCMP16
+#endif
+
 #ifdef HAVE__MEMCMP16
 /* hand-coded assembly implementation, available on some platforms */
 //#warning "trying memcmp16"
@@ -121,6 +137,79 @@ static bool org_apache_harmony_dalvik_NativeTestTarget_emptyInlineMethod(
  * ===========================================================================
  */
 
+/*
+ * Vector helpers for the String intrinsics.  String contents are
+ * immutable, so unlike arraycopy we don't care how wide the loads are;
+ * we only have to be careful not to read past the end of the run.
+ * Loads may be unaligned, since a String's offset can be anything.
+ */
+
+/*
+ * Return the index of the first position where "s0" and "s1" differ, or
+ * "count" if the runs are equal.
+ */
+static inline int charsMismatch(const u2* s0, const u2* s1, int count)
+{
+    int i = 0;
+
+#if defined(__ARM_NEON__)
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t eq = vceqq_u16(vld1q_u16(s0 + i), vld1q_u16(s1 + i));
+        uint64x2_t eq64 = vreinterpretq_u64_u16(eq);
+        if ((vgetq_lane_u64(eq64, 0) & vgetq_lane_u64(eq64, 1)) != ~0ULL)
+            break;
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= count; i += 8) {
+        __m128i eq = _mm_cmpeq_epi16(
+            _mm_loadu_si128((const __m128i*) (s0 + i)),
+            _mm_loadu_si128((const __m128i*) (s1 + i)));
+        int mask = _mm_movemask_epi8(eq) ^ 0xffff;
+        if (mask != 0)
+            return i + (__builtin_ctz(mask) >> 1);
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (s0[i] != s1[i])
+            break;
+    }
+    return i;
+}
+
+/*
+ * Return the index of the first occurrence of "ch" in "chars", or -1.
+ */
+static inline int charsIndexOf(const u2* chars, int count, u2 ch)
+{
+    int i = 0;
+
+#if defined(__ARM_NEON__)
+    uint16x8_t needle = vdupq_n_u16(ch);
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t eq = vceqq_u16(vld1q_u16(chars + i), needle);
+        uint64x2_t eq64 = vreinterpretq_u64_u16(eq);
+        if ((vgetq_lane_u64(eq64, 0) | vgetq_lane_u64(eq64, 1)) != 0)
+            break;
+    }
+#elif defined(__SSE2__)
+    __m128i needle = _mm_set1_epi16(ch);
+    for (; i + 8 <= count; i += 8) {
+        __m128i eq = _mm_cmpeq_epi16(
+            _mm_loadu_si128((const __m128i*) (chars + i)), needle);
+        int mask = _mm_movemask_epi8(eq);
+        if (mask != 0)
+            return i + (__builtin_ctz(mask) >> 1);
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (chars[i] == ch)
+            return i;
+    }
+    return -1;
+}
+
 /*
  * public char charAt(int index)
  */
@@ -271,16 +360,13 @@ bool javaLangString_compareTo(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
 
 #else
     /*
-     * Straightforward implementation, examining 16 bits at a time.  Compare
-     * the characters that overlap, and if they're all the same then return
-     * the difference in lengths.
+     * Compare the characters that overlap, and if they're all the same
+     * then return the difference in lengths.
      */
-    int i;
-    for (i = 0; i < minCount; i++) {
-        if (thisChars[i] != compChars[i]) {
-            pResult->i = (s4) thisChars[i] - (s4) compChars[i];
-            return true;
-        }
+    int i = charsMismatch(thisChars, compChars, minCount);
+    if (i < minCount) {
+        pResult->i = (s4) thisChars[i] - (s4) compChars[i];
+        return true;
     }
 #endif
 
@@ -373,17 +459,14 @@ bool javaLangString_equals(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
 # endif
 #else
     /*
-     * Straightforward implementation, examining 16 bits at a time.  The
-     * direction of the loop doesn't matter, and starting at the end may
-     * give us an advantage when comparing certain types of strings (e.g.
-     * class names).
-     *
-     * We want to go forward for benchmarks against __memcmp16 so we get a
-     * meaningful comparison when the strings don't match (could also test
-     * with palindromes).
+     * Scanning from the end may give us an advantage when comparing
+     * certain types of strings (e.g. class names), but only a char at a
+     * time; with vector compares a forward scan wins.
      */
+# ifdef HAVE_VECTOR_CHAR_OPS
+    pResult->i = (charsMismatch(thisChars, compChars, thisCount) == thisCount);
+# else
     int i;
-    //for (i = 0; i < thisCount; i++)
     for (i = thisCount-1; i >= 0; --i)
     {
         if (thisChars[i] != compChars[i]) {
@@ -392,6 +475,7 @@ bool javaLangString_equals(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
         }
     }
     pResult->i = true;
+# endif
 #endif
 
     return true;
@@ -466,13 +550,11 @@ static inline int indexOfCommon(Object* strObj, int ch, int start)
     else if (start > count)
         start = count;
 
-#if 0
-    /* 16-bit loop, simple */
-    while (start < count) {
-        if (chars[start] == ch)
-            return start;
-        start++;
-    }
+#ifdef HAVE_VECTOR_CHAR_OPS
+    if ((ch & 0xffff) != ch)
+        return -1;
+    int index = charsIndexOf(chars + start, count - start, ch);
+    return (index < 0) ? -1 : start + index;
 #else
     /* 16-bit loop, slightly better on ARM */
     const u2* ptr = chars + start;
@@ -481,9 +563,9 @@ static inline int indexOfCommon(Object* strObj, int ch, int start)
         if (*ptr++ == ch)
             return (ptr-1) - chars;
     }
-#endif
 
     return -1;
+#endif
 }
 
 /*
@@ -506,6 +588,77 @@ bool javaLangString_fastIndexOf_II(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
     return true;
 }
 
+/*
+ * public int indexOf(String string)
+ *
+ * Find the first character of "string" with a vector scan, then check
+ * the rest of it in place.
+ */
+bool javaLangString_indexOf_String(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    /* null reference check on "this" and the argument */
+    if ((Object*) arg0 == NULL || (Object*) arg1 == NULL) {
+        dvmThrowNullPointerException(NULL);
+        return false;
+    }
+
+    Object* strObj = (Object*) arg0;
+    Object* subObj = (Object*) arg1;
+    ArrayObject* charArray =
+        (ArrayObject*) dvmGetFieldObject(strObj, STRING_FIELDOFF_VALUE);
+    ArrayObject* subArray =
+        (ArrayObject*) dvmGetFieldObject(subObj, STRING_FIELDOFF_VALUE);
+    const u2* chars = ((const u2*)(void*)charArray->contents) +
+        dvmGetFieldInt(strObj, STRING_FIELDOFF_OFFSET);
+    const u2* subChars = ((const u2*)(void*)subArray->contents) +
+        dvmGetFieldInt(subObj, STRING_FIELDOFF_OFFSET);
+    int count = dvmGetFieldInt(strObj, STRING_FIELDOFF_COUNT);
+    int subCount = dvmGetFieldInt(subObj, STRING_FIELDOFF_COUNT);
+
+    pResult->i = -1;
+    if (subCount == 0) {
+        pResult->i = 0;
+        return true;
+    }
+
+    u2 firstChar = subChars[0];
+    int start = 0;
+    int lastStart = count - subCount;
+    while (start <= lastStart) {
+        int index = charsIndexOf(chars + start, lastStart - start + 1,
+            firstChar);
+        if (index < 0)
+            break;
+        start += index;
+        if (charsMismatch(chars + start + 1, subChars + 1, subCount - 1)
+                == subCount - 1)
+        {
+            pResult->i = start;
+            break;
+        }
+        start++;
+    }
+    return true;
+}
+
+/*
+ * public int hashCode()
+ *
+ * Same cached-in-the-object algorithm as the Java version.
+ */
+bool javaLangString_hashCode(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    /* null reference check on "this" */
+    if ((Object*) arg0 == NULL) {
+        dvmThrowNullPointerException(NULL);
+        return false;
+    }
+
+    pResult->i = dvmComputeStringHash((StringObject*) arg0);
+    return true;
+}
 
 /*
  * ===========================================================================
@@ -640,6 +793,282 @@ bool javaLangMath_sin(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
     return true;
 }
 
+/*
+ * public static long min(long, long)
+ */
+bool javaLangMath_min_long(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert64 a, b;
+    a.arg[0] = arg0;
+    a.arg[1] = arg1;
+    b.arg[0] = arg2;
+    b.arg[1] = arg3;
+    pResult->j = (a.ll < b.ll) ? a.ll : b.ll;
+    return true;
+}
+
+/*
+ * public static long max(long, long)
+ */
+bool javaLangMath_max_long(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert64 a, b;
+    a.arg[0] = arg0;
+    a.arg[1] = arg1;
+    b.arg[0] = arg2;
+    b.arg[1] = arg3;
+    pResult->j = (a.ll > b.ll) ? a.ll : b.ll;
+    return true;
+}
+
+/*
+ * The floating-point min and max follow the Java code exactly: a NaN
+ * operand wins, and -0.0 is less than +0.0.
+ */
+
+/*
+ * public static float min(float, float)
+ */
+bool javaLangMath_min_float(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert32 a, b;
+    a.arg = arg0;
+    b.arg = arg1;
+    if (a.ff != a.ff) {
+        pResult->f = a.ff;
+    } else if (a.ff == 0.0f && b.ff == 0.0f && b.arg == 0x80000000) {
+        pResult->f = b.ff;
+    } else {
+        pResult->f = (a.ff <= b.ff) ? a.ff : b.ff;
+    }
+    return true;
+}
+
+/*
+ * public static float max(float, float)
+ */
+bool javaLangMath_max_float(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert32 a, b;
+    a.arg = arg0;
+    b.arg = arg1;
+    if (a.ff != a.ff) {
+        pResult->f = a.ff;
+    } else if (a.ff == 0.0f && b.ff == 0.0f && a.arg == 0x80000000) {
+        pResult->f = b.ff;
+    } else {
+        pResult->f = (a.ff >= b.ff) ? a.ff : b.ff;
+    }
+    return true;
+}
+
+/*
+ * public static double min(double, double)
+ */
+bool javaLangMath_min_double(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert64 a, b;
+    a.arg[0] = arg0;
+    a.arg[1] = arg1;
+    b.arg[0] = arg2;
+    b.arg[1] = arg3;
+    if (a.dd != a.dd) {
+        pResult->d = a.dd;
+    } else if (a.dd == 0.0 && b.dd == 0.0 &&
+               b.ll == (s8) 0x8000000000000000ULL) {
+        pResult->d = b.dd;
+    } else {
+        pResult->d = (a.dd <= b.dd) ? a.dd : b.dd;
+    }
+    return true;
+}
+
+/*
+ * public static double max(double, double)
+ */
+bool javaLangMath_max_double(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert64 a, b;
+    a.arg[0] = arg0;
+    a.arg[1] = arg1;
+    b.arg[0] = arg2;
+    b.arg[1] = arg3;
+    if (a.dd != a.dd) {
+        pResult->d = a.dd;
+    } else if (a.dd == 0.0 && b.dd == 0.0 &&
+               a.ll == (s8) 0x8000000000000000ULL) {
+        pResult->d = b.dd;
+    } else {
+        pResult->d = (a.dd >= b.dd) ? a.dd : b.dd;
+    }
+    return true;
+}
+
+/*
+ * public static double floor(double)
+ */
+bool javaLangMath_floor(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert64 convert;
+    convert.arg[0] = arg0;
+    convert.arg[1] = arg1;
+    pResult->d = floor(convert.dd);
+    return true;
+}
+
+/*
+ * public static double ceil(double)
+ */
+bool javaLangMath_ceil(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert64 convert;
+    convert.arg[0] = arg0;
+    convert.arg[1] = arg1;
+    pResult->d = ceil(convert.dd);
+    return true;
+}
+
+/*
+ * public static double rint(double)
+ *
+ * rint() rounds in the current mode, which is always round-to-nearest-even
+ * in the VM, as Java requires.
+ */
+bool javaLangMath_rint(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert64 convert;
+    convert.arg[0] = arg0;
+    convert.arg[1] = arg1;
+    pResult->d = rint(convert.dd);
+    return true;
+}
+
+/*
+ * public static long round(double)
+ *
+ * (long) floor(d + 0.5), with the saturating Java conversion.
+ */
+bool javaLangMath_round_double(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert64 convert;
+    convert.arg[0] = arg0;
+    convert.arg[1] = arg1;
+    double d = floor(convert.dd + 0.5);
+    if (d != d) {
+        pResult->j = 0;
+    } else if (d >= 9223372036854775807.0) {
+        pResult->j = 0x7fffffffffffffffLL;
+    } else if (d <= -9223372036854775808.0) {
+        pResult->j = (s8) 0x8000000000000000ULL;
+    } else {
+        pResult->j = (s8) d;
+    }
+    return true;
+}
+
+/*
+ * public static int round(float)
+ *
+ * (int) floor(f + 0.5f), with the saturating Java conversion.
+ */
+bool javaLangMath_round_float(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Convert32 convert;
+    convert.arg = arg0;
+    double d = floor((float) (convert.ff + 0.5f));
+    if (d != d) {
+        pResult->i = 0;
+    } else if (d >= 2147483647.0) {
+        pResult->i = 0x7fffffff;
+    } else if (d <= -2147483648.0) {
+        pResult->i = (s4) 0x80000000;
+    } else {
+        pResult->i = (s4) d;
+    }
+    return true;
+}
+
+/*
+ * ===========================================================================
+ *      java.lang.Integer, java.lang.Long
+ * ===========================================================================
+ */
+
+/*
+ * public static int bitCount(int)
+ */
+bool javaLangInteger_bitCount(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    pResult->i = __builtin_popcount(arg0);
+    return true;
+}
+
+/*
+ * public static int numberOfLeadingZeros(int)
+ */
+bool javaLangInteger_numberOfLeadingZeros(u4 arg0, u4 arg1, u4 arg2,
+    u4 arg3, JValue* pResult)
+{
+    pResult->i = (arg0 == 0) ? 32 : __builtin_clz(arg0);
+    return true;
+}
+
+/*
+ * public static int numberOfTrailingZeros(int)
+ */
+bool javaLangInteger_numberOfTrailingZeros(u4 arg0, u4 arg1, u4 arg2,
+    u4 arg3, JValue* pResult)
+{
+    pResult->i = (arg0 == 0) ? 32 : __builtin_ctz(arg0);
+    return true;
+}
+
+/*
+ * public static int reverse(int)
+ */
+bool javaLangInteger_reverse(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    u4 val = arg0;
+    val = ((val >> 1) & 0x55555555) | ((val & 0x55555555) << 1);
+    val = ((val >> 2) & 0x33333333) | ((val & 0x33333333) << 2);
+    val = ((val >> 4) & 0x0f0f0f0f) | ((val & 0x0f0f0f0f) << 4);
+    pResult->i = __builtin_bswap32(val);
+    return true;
+}
+
+/*
+ * public static int reverseBytes(int)
+ */
+bool javaLangInteger_reverseBytes(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    pResult->i = __builtin_bswap32(arg0);
+    return true;
+}
+
+/*
+ * public static int bitCount(long)
+ */
+bool javaLangLong_bitCount(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    pResult->i = __builtin_popcount(arg0) + __builtin_popcount(arg1);
+    return true;
+}
+
 /*
  * ===========================================================================
  *      java.lang.Float
@@ -671,6 +1100,18 @@ bool javaLangFloat_intBitsToFloat(u4 arg0, u4 arg1, u4 arg2, u4 arg,
     return true;
 }
 
+/*
+ * public static boolean isNaN(float)
+ */
+bool javaLangFloat_isNaN(u4 arg0, u4 arg1, u4 arg2, u4 arg,
+    JValue* pResult)
+{
+    Convert32 convert;
+    convert.arg = arg0;
+    pResult->z = (convert.ff != convert.ff);
+    return true;
+}
+
 /*
  * ===========================================================================
  *      java.lang.Double
@@ -707,6 +1148,132 @@ bool javaLangDouble_longBitsToDouble(u4 arg0, u4 arg1, u4 arg2, u4 arg,
     return true;
 }
 
+/*
+ * public static boolean isNaN(double)
+ */
+bool javaLangDouble_isNaN(u4 arg0, u4 arg1, u4 arg2, u4 arg,
+    JValue* pResult)
+{
+    Convert64 convert;
+    convert.arg[0] = arg0;
+    convert.arg[1] = arg1;
+    pResult->z = (convert.dd != convert.dd);
+    return true;
+}
+
+/*
+ * ===========================================================================
+ *      java.lang.Object
+ * ===========================================================================
+ */
+
+/*
+ * private native Object internalClone(Cloneable o)
+ *
+ * Object.clone() has already checked that "this" is Cloneable.  As an
+ * inline op the copy is made without pushing a native frame; the buffer
+ * fast path in dvmMalloc() serves small objects and arrays.
+ */
+bool javaLangObject_internalClone(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    Object* obj = (Object*) arg0;
+
+    if (obj == NULL) {
+        dvmThrowNullPointerException(NULL);
+        return false;
+    }
+    pResult->l = dvmCloneObject(obj, ALLOC_DONT_TRACK);
+    return pResult->l != NULL;
+}
+
+/*
+ * ===========================================================================
+ *      sun.misc.Unsafe
+ * ===========================================================================
+ */
+
+/*
+ * Only the reads fit in four argument words ("this", the object, and the
+ * two halves of the offset).  The CAS and put methods take five to seven
+ * and stay internal natives.  Like those natives, these ignore "this" and
+ * trust the caller with the object and offset.
+ */
+static inline u1* unsafeAddress(u4 obj, u4 offsetLo, u4 offsetHi)
+{
+    Convert64 convert;
+    convert.arg[0] = offsetLo;
+    convert.arg[1] = offsetHi;
+    return ((u1*) obj) + convert.ll;
+}
+
+/*
+ * public native int getInt(Object obj, long offset)
+ */
+bool sunMiscUnsafe_getInt(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    pResult->i = *(s4*) unsafeAddress(arg1, arg2, arg3);
+    return true;
+}
+
+/*
+ * public native int getIntVolatile(Object obj, long offset)
+ */
+bool sunMiscUnsafe_getIntVolatile(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    volatile int32_t* address =
+        (volatile int32_t*) unsafeAddress(arg1, arg2, arg3);
+    pResult->i = android_atomic_acquire_load(address);
+    return true;
+}
+
+/*
+ * public native long getLong(Object obj, long offset)
+ */
+bool sunMiscUnsafe_getLong(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    pResult->j = *(s8*) unsafeAddress(arg1, arg2, arg3);
+    return true;
+}
+
+/*
+ * public native long getLongVolatile(Object obj, long offset)
+ */
+bool sunMiscUnsafe_getLongVolatile(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    volatile int64_t* address =
+        (volatile int64_t*) unsafeAddress(arg1, arg2, arg3);
+    assert((arg2 & 7) == 0);
+    pResult->j = dvmQuasiAtomicRead64(address);
+    return true;
+}
+
+/*
+ * public native Object getObject(Object obj, long offset)
+ */
+bool sunMiscUnsafe_getObject(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    pResult->l = *(Object**) unsafeAddress(arg1, arg2, arg3);
+    return true;
+}
+
+/*
+ * public native Object getObjectVolatile(Object obj, long offset)
+ */
+bool sunMiscUnsafe_getObjectVolatile(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+    JValue* pResult)
+{
+    volatile int32_t* address =
+        (volatile int32_t*) unsafeAddress(arg1, arg2, arg3);
+    pResult->l = (Object*) android_atomic_acquire_load(address);
+    return true;
+}
+
 /*
  * ===========================================================================
  *      Infrastructure
@@ -767,6 +1334,40 @@ const InlineOperation gDvmInlineOpsTable[] = {
     { javaLangMath_min_int, "Ljava/lang/StrictMath;", "min", "(II)I" },
     { javaLangMath_max_int, "Ljava/lang/StrictMath;", "max", "(II)I" },
     { javaLangMath_sqrt, "Ljava/lang/StrictMath;", "sqrt", "(D)D" },
+
+    { javaLangString_indexOf_String, "Ljava/lang/String;", "indexOf", "(Ljava/lang/String;)I" },
+    { javaLangString_hashCode, "Ljava/lang/String;", "hashCode", "()I" },
+
+    { sunMiscUnsafe_getInt, "Lsun/misc/Unsafe;", "getInt", "(Ljava/lang/Object;J)I" },
+    { sunMiscUnsafe_getIntVolatile, "Lsun/misc/Unsafe;", "getIntVolatile", "(Ljava/lang/Object;J)I" },
+    { sunMiscUnsafe_getLong, "Lsun/misc/Unsafe;", "getLong", "(Ljava/lang/Object;J)J" },
+    { sunMiscUnsafe_getLongVolatile, "Lsun/misc/Unsafe;", "getLongVolatile", "(Ljava/lang/Object;J)J" },
+    { sunMiscUnsafe_getObject, "Lsun/misc/Unsafe;", "getObject", "(Ljava/lang/Object;J)Ljava/lang/Object;" },
+    { sunMiscUnsafe_getObjectVolatile, "Lsun/misc/Unsafe;", "getObjectVolatile", "(Ljava/lang/Object;J)Ljava/lang/Object;" },
+
+    { javaLangMath_min_long, "Ljava/lang/Math;", "min", "(JJ)J" },
+    { javaLangMath_max_long, "Ljava/lang/Math;", "max", "(JJ)J" },
+    { javaLangMath_min_float, "Ljava/lang/Math;", "min", "(FF)F" },
+    { javaLangMath_max_float, "Ljava/lang/Math;", "max", "(FF)F" },
+    { javaLangMath_min_double, "Ljava/lang/Math;", "min", "(DD)D" },
+    { javaLangMath_max_double, "Ljava/lang/Math;", "max", "(DD)D" },
+    { javaLangMath_floor, "Ljava/lang/Math;", "floor", "(D)D" },
+    { javaLangMath_ceil, "Ljava/lang/Math;", "ceil", "(D)D" },
+    { javaLangMath_rint, "Ljava/lang/Math;", "rint", "(D)D" },
+    { javaLangMath_round_double, "Ljava/lang/Math;", "round", "(D)J" },
+    { javaLangMath_round_float, "Ljava/lang/Math;", "round", "(F)I" },
+
+    { javaLangInteger_bitCount, "Ljava/lang/Integer;", "bitCount", "(I)I" },
+    { javaLangInteger_numberOfLeadingZeros, "Ljava/lang/Integer;", "numberOfLeadingZeros", "(I)I" },
+    { javaLangInteger_numberOfTrailingZeros, "Ljava/lang/Integer;", "numberOfTrailingZeros", "(I)I" },
+    { javaLangInteger_reverse, "Ljava/lang/Integer;", "reverse", "(I)I" },
+    { javaLangInteger_reverseBytes, "Ljava/lang/Integer;", "reverseBytes", "(I)I" },
+    { javaLangLong_bitCount, "Ljava/lang/Long;", "bitCount", "(J)I" },
+
+    { javaLangFloat_isNaN, "Ljava/lang/Float;", "isNaN", "(F)Z" },
+    { javaLangDouble_isNaN, "Ljava/lang/Double;", "isNaN", "(D)Z" },
+
+    { javaLangObject_internalClone, "Ljava/lang/Object;", "internalClone", "(Ljava/lang/Cloneable;)Ljava/lang/Object;" },
 };
 
 /*
@@ -838,9 +1439,12 @@ Method* dvmFindInlinableMethod(const char* classDescriptor,
     }
 
     /*
-     * Check that the method is appropriate for inlining.
+     * Check that the method is appropriate for inlining.  Private methods
+     * can't be overridden either.
      */
-    if (!dvmIsFinalClass(clazz) && !dvmIsFinalMethod(method)) {
+    if (!dvmIsFinalClass(clazz) && !dvmIsFinalMethod(method) &&
+        !dvmIsPrivateMethod(method))
+    {
         ALOGE("dvmFindInlinableMethod: can't inline non-final method %s.%s",
             clazz->descriptor, method->name);
         return NULL;
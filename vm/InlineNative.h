@@ -87,6 +87,34 @@ enum NativeInlineOps {
     INLINE_STRICT_MATH_MIN_INT = 26,
     INLINE_STRICT_MATH_MAX_INT = 27,
     INLINE_STRICT_MATH_SQRT = 28,
+    INLINE_STRING_INDEXOF_STRING = 29,
+    INLINE_STRING_HASHCODE = 30,
+    INLINE_UNSAFE_GET_INT = 31,
+    INLINE_UNSAFE_GET_INT_VOLATILE = 32,
+    INLINE_UNSAFE_GET_LONG = 33,
+    INLINE_UNSAFE_GET_LONG_VOLATILE = 34,
+    INLINE_UNSAFE_GET_OBJECT = 35,
+    INLINE_UNSAFE_GET_OBJECT_VOLATILE = 36,
+    INLINE_MATH_MIN_LONG = 37,
+    INLINE_MATH_MAX_LONG = 38,
+    INLINE_MATH_MIN_FLOAT = 39,
+    INLINE_MATH_MAX_FLOAT = 40,
+    INLINE_MATH_MIN_DOUBLE = 41,
+    INLINE_MATH_MAX_DOUBLE = 42,
+    INLINE_MATH_FLOOR = 43,
+    INLINE_MATH_CEIL = 44,
+    INLINE_MATH_RINT = 45,
+    INLINE_MATH_ROUND_DOUBLE = 46,
+    INLINE_MATH_ROUND_FLOAT = 47,
+    INLINE_INTEGER_BIT_COUNT = 48,
+    INLINE_INTEGER_NUMBER_OF_LEADING_ZEROS = 49,
+    INLINE_INTEGER_NUMBER_OF_TRAILING_ZEROS = 50,
+    INLINE_INTEGER_REVERSE = 51,
+    INLINE_INTEGER_REVERSE_BYTES = 52,
+    INLINE_LONG_BIT_COUNT = 53,
+    INLINE_FLOAT_IS_NAN = 54,
+    INLINE_DOUBLE_IS_NAN = 55,
+    INLINE_OBJECT_INTERNAL_CLONE = 56,
 };
 
 /*
@@ -149,6 +177,12 @@ bool javaLangString_isEmpty(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
 bool javaLangString_fastIndexOf_II(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
                                    JValue* pResult);
 
+bool javaLangString_indexOf_String(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                                   JValue* pResult);
+
+bool javaLangString_hashCode(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                             JValue* pResult);
+
 bool javaLangMath_abs_int(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
                           JValue* pResult);
 
@@ -176,6 +210,57 @@ bool javaLangMath_cos(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
 bool javaLangMath_sin(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
                       JValue* pResult);
 
+bool javaLangMath_min_long(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                           JValue* pResult);
+
+bool javaLangMath_max_long(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                           JValue* pResult);
+
+bool javaLangMath_min_float(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                            JValue* pResult);
+
+bool javaLangMath_max_float(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                            JValue* pResult);
+
+bool javaLangMath_min_double(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                             JValue* pResult);
+
+bool javaLangMath_max_double(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                             JValue* pResult);
+
+bool javaLangMath_floor(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                        JValue* pResult);
+
+bool javaLangMath_ceil(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                       JValue* pResult);
+
+bool javaLangMath_rint(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                       JValue* pResult);
+
+bool javaLangMath_round_double(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                               JValue* pResult);
+
+bool javaLangMath_round_float(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                              JValue* pResult);
+
+bool javaLangInteger_bitCount(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                              JValue* pResult);
+
+bool javaLangInteger_numberOfLeadingZeros(u4 arg0, u4 arg1, u4 arg2,
+                                          u4 arg3, JValue* pResult);
+
+bool javaLangInteger_numberOfTrailingZeros(u4 arg0, u4 arg1, u4 arg2,
+                                           u4 arg3, JValue* pResult);
+
+bool javaLangInteger_reverse(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                             JValue* pResult);
+
+bool javaLangInteger_reverseBytes(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                                  JValue* pResult);
+
+bool javaLangLong_bitCount(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                           JValue* pResult);
+
 bool javaLangFloat_floatToIntBits(u4 arg0, u4 arg1, u4 arg2, u4 arg,
                                   JValue* pResult);
 
@@ -185,6 +270,12 @@ bool javaLangFloat_floatToRawIntBits(u4 arg0, u4 arg1, u4 arg2, u4 arg,
 bool javaLangFloat_intBitsToFloat(u4 arg0, u4 arg1, u4 arg2, u4 arg,
                                   JValue* pResult);
 
+bool javaLangFloat_isNaN(u4 arg0, u4 arg1, u4 arg2, u4 arg,
+                         JValue* pResult);
+
+bool javaLangDouble_isNaN(u4 arg0, u4 arg1, u4 arg2, u4 arg,
+                          JValue* pResult);
+
 bool javaLangDouble_doubleToLongBits(u4 arg0, u4 arg1, u4 arg2, u4 arg,
                                      JValue* pResult);
 
@@ -197,4 +288,25 @@ bool javaLangDouble_doubleToRawLongBits(u4 arg0, u4 arg1, u4 arg2,
 bool javaLangDouble_longBitsToDouble(u4 arg0, u4 arg1, u4 arg2, u4 arg,
                                      JValue* pResult);
 
+bool javaLangObject_internalClone(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                                  JValue* pResult);
+
+bool sunMiscUnsafe_getInt(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                          JValue* pResult);
+
+bool sunMiscUnsafe_getIntVolatile(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                                  JValue* pResult);
+
+bool sunMiscUnsafe_getLong(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                           JValue* pResult);
+
+bool sunMiscUnsafe_getLongVolatile(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                                   JValue* pResult);
+
+bool sunMiscUnsafe_getObject(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                             JValue* pResult);
+
+bool sunMiscUnsafe_getObjectVolatile(u4 arg0, u4 arg1, u4 arg2, u4 arg3,
+                                     JValue* pResult);
+
 #endif  // DALVIK_INLINENATIVE_H_
@@ -15,21 +15,121 @@
  */
 /*
  * String interning.
+ *
+ * The interned and literal strings are kept in open-addressed tables
+ * of (hash, string) entries with linear probing.  Lookups take no
+ * lock.  A slot only ever goes from empty to holding a string, and from
+ * holding a string to a tombstone, so a probe that reaches an empty
+ * slot has seen every string that could match.  Slots are claimed with
+ * a compare-and-swap on the string, and the hash is stored after it; a
+ * hash of zero just means the entry has to be compared in full.
+ *
+ * Inserting takes the stripe lock of the string's hash.  Both tables
+ * share the stripes, so moving a string from the interned table to the
+ * literal table cannot race with interning an equal string.  Growing a
+ * table takes every stripe.  The slot arrays that growing replaces are
+ * freed at the next garbage collection, when no thread can be in the
+ * middle of a lookup.
  */
 #include "Dalvik.h"
 
 #include <stddef.h>
 
+#define INTERN_TABLE_MIN_CAPACITY 512
+
+#define INTERN_TOMBSTONE ((StringObject*) HASH_TOMBSTONE)
+
+struct InternEntry {
+    u4 hash;
+    StringObject* volatile str;
+};
+
+struct InternSlots {
+    /* The number of entries, a power of two. */
+    size_t capacity;
+
+    /* The next array on the table's list of replaced ones. */
+    InternSlots* next;
+
+    InternEntry entries[1];
+};
+
+struct InternTable {
+    InternSlots* volatile slots;
+
+    /* Entries that hold a string or a tombstone, and those that hold a
+     * string.  Threads holding different stripes update these.
+     */
+    volatile int32_t numUsed;
+    volatile int32_t numLive;
+
+    /* Slot arrays replaced by growing the table, to be freed once no
+     * lookup can still be reading them.
+     */
+    InternSlots* retired;
+};
+
+static InternSlots* allocSlots(size_t capacity)
+{
+    size_t size = offsetof(InternSlots, entries) +
+                  capacity * sizeof(InternEntry);
+    InternSlots* slots = (InternSlots*) calloc(1, size);
+    if (slots != NULL) {
+        slots->capacity = capacity;
+    }
+    return slots;
+}
+
+static InternTable* internTableCreate()
+{
+    InternTable* table = (InternTable*) calloc(1, sizeof(*table));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->slots = allocSlots(INTERN_TABLE_MIN_CAPACITY);
+    if (table->slots == NULL) {
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+static void freeRetiredSlots(InternTable* table)
+{
+    while (table->retired != NULL) {
+        InternSlots* next = table->retired->next;
+        free(table->retired);
+        table->retired = next;
+    }
+}
+
+static void internTableFree(InternTable* table)
+{
+    if (table == NULL) {
+        return;
+    }
+    freeRetiredSlots(table);
+    free(table->slots);
+    free(table);
+}
+
+static pthread_mutex_t* stripeLock(u4 key)
+{
+    return &gDvm.internLocks[key & (INTERN_LOCK_STRIPES - 1)];
+}
+
 /*
  * Prep string interning.
  */
 bool dvmStringInternStartup()
 {
-    dvmInitMutex(&gDvm.internLock);
-    gDvm.internedStrings = dvmHashTableCreate(256, NULL);
+    for (size_t i = 0; i < INTERN_LOCK_STRIPES; i++) {
+        dvmInitMutex(&gDvm.internLocks[i]);
+    }
+    gDvm.internedStrings = internTableCreate();
     if (gDvm.internedStrings == NULL)
         return false;
-    gDvm.literalStrings = dvmHashTableCreate(256, NULL);
+    gDvm.literalStrings = internTableCreate();
     if (gDvm.literalStrings == NULL)
         return false;
     return true;
@@ -43,29 +143,153 @@ bool dvmStringInternStartup()
 void dvmStringInternShutdown()
 {
     if (gDvm.internedStrings != NULL || gDvm.literalStrings != NULL) {
-        dvmDestroyMutex(&gDvm.internLock);
+        for (size_t i = 0; i < INTERN_LOCK_STRIPES; i++) {
+            dvmDestroyMutex(&gDvm.internLocks[i]);
+        }
     }
-    dvmHashTableFree(gDvm.internedStrings);
+    internTableFree(gDvm.internedStrings);
     gDvm.internedStrings = NULL;
-    dvmHashTableFree(gDvm.literalStrings);
+    internTableFree(gDvm.literalStrings);
     gDvm.literalStrings = NULL;
 }
 
-static StringObject* lookupString(HashTable* table, u4 key, StringObject* value)
+static StringObject* loadString(InternEntry* entry)
+{
+    return (StringObject*) android_atomic_acquire_load((int32_t*) &entry->str);
+}
+
+static bool entryMatches(const InternEntry* entry, StringObject* str, u4 key,
+                         StringObject* value)
 {
-    void* entry = dvmHashTableLookup(table, key, (void*)value,
-                                     dvmHashcmpStrings, false);
-    return (StringObject*)entry;
+    u4 hash = entry->hash;
+    return (hash == key || hash == 0) && dvmHashcmpStrings(str, value) == 0;
 }
 
-static StringObject* insertString(HashTable* table, u4 key, StringObject* value)
+/*
+ * Returns the string in the table that equals value, or NULL.  Takes
+ * no lock.
+ */
+static StringObject* lookupString(InternTable* table, u4 key, StringObject* value)
 {
-    if (dvmIsNonMovingObject(value) == false) {
-        value = (StringObject*)dvmCloneObject(value, ALLOC_NON_MOVING);
+    InternSlots* slots =
+        (InternSlots*) android_atomic_acquire_load((int32_t*) &table->slots);
+    size_t mask = slots->capacity - 1;
+    size_t i = key & mask;
+    for (size_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        InternEntry* entry = &slots->entries[i];
+        StringObject* str = loadString(entry);
+        if (str == NULL) {
+            break;
+        }
+        if (str != INTERN_TOMBSTONE && entryMatches(entry, str, key, value)) {
+            return str;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Adds value to the table unless an equal string is already there, and
+ * returns whichever string is.  The caller holds the stripe lock of the
+ * key, so only strings of other stripes can be inserted meanwhile.
+ */
+static StringObject* insertString(InternTable* table, u4 key, StringObject* value)
+{
+    InternSlots* slots = table->slots;
+    size_t mask = slots->capacity - 1;
+    size_t i = key & mask;
+    for (size_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        InternEntry* entry = &slots->entries[i];
+        StringObject* str = loadString(entry);
+        if (str == NULL) {
+            if (android_atomic_release_cas(0, (int32_t) value,
+                                           (int32_t*) &entry->str) != 0) {
+                /* Taken by a string of another stripe. */
+                continue;
+            }
+            entry->hash = key;
+            android_atomic_inc(&table->numUsed);
+            android_atomic_inc(&table->numLive);
+            return value;
+        }
+        if (str != INTERN_TOMBSTONE && entryMatches(entry, str, key, value)) {
+            return str;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Replaces value with a tombstone.  The caller holds the stripe lock of
+ * the key.
+ */
+static void removeString(InternTable* table, u4 key, StringObject* value)
+{
+    InternSlots* slots = table->slots;
+    size_t mask = slots->capacity - 1;
+    size_t i = key & mask;
+    for (size_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        InternEntry* entry = &slots->entries[i];
+        StringObject* str = loadString(entry);
+        if (str == NULL) {
+            break;
+        }
+        if (str == value) {
+            android_atomic_release_store((int32_t) INTERN_TOMBSTONE,
+                                         (int32_t*) &entry->str);
+            android_atomic_dec(&table->numLive);
+            return;
+        }
+    }
+    assert(!"string not in table");
+}
+
+/*
+ * Rebuilds the table without its tombstones once half of its entries
+ * are in use, doubling it if more than a quarter hold strings.  Takes
+ * every stripe lock, so the caller must hold none.
+ */
+static void growIfNeeded(InternTable* table)
+{
+    if ((size_t) table->numUsed * 2 <= table->slots->capacity) {
+        return;
+    }
+    for (size_t i = 0; i < INTERN_LOCK_STRIPES; i++) {
+        dvmLockMutex(&gDvm.internLocks[i]);
+    }
+    InternSlots* old = table->slots;
+    if ((size_t) table->numUsed * 2 > old->capacity) {
+        size_t capacity = old->capacity;
+        if ((size_t) table->numLive * 4 > capacity) {
+            capacity *= 2;
+        }
+        InternSlots* slots = allocSlots(capacity);
+        if (slots != NULL) {
+            size_t mask = capacity - 1;
+            for (size_t i = 0; i < old->capacity; i++) {
+                const InternEntry* entry = &old->entries[i];
+                if (entry->str == NULL || entry->str == INTERN_TOMBSTONE) {
+                    continue;
+                }
+                size_t j = entry->hash & mask;
+                while (slots->entries[j].str != NULL) {
+                    j = (j + 1) & mask;
+                }
+                slots->entries[j].hash = entry->hash;
+                slots->entries[j].str = entry->str;
+            }
+            table->numUsed = table->numLive;
+            old->next = table->retired;
+            table->retired = old;
+            android_atomic_release_store((int32_t) slots,
+                                         (int32_t*) &table->slots);
+        } else {
+            ALOGW("Unable to grow the intern table");
+        }
+    }
+    for (size_t i = INTERN_LOCK_STRIPES; i > 0; i--) {
+        dvmUnlockMutex(&gDvm.internLocks[i - 1]);
     }
-    void* entry = dvmHashTableLookup(table, key, (void*)value,
-                                     dvmHashcmpStrings, true);
-    return (StringObject*)entry;
 }
 
 static StringObject* lookupInternedString(StringObject* strObj, bool isLiteral)
@@ -74,7 +298,27 @@ static StringObject* lookupInternedString(StringObject* strObj, bool isLiteral)
 
     assert(strObj != NULL);
     u4 key = dvmComputeStringHash(strObj);
-    dvmLockMutex(&gDvm.internLock);
+
+    /*
+     * Most strings are already in a table; find those without locking.
+     * A literal lookup that only matches an interned string needs the
+     * lock to move it.
+     */
+    found = lookupString(gDvm.literalStrings, key, strObj);
+    if (found == NULL && !isLiteral) {
+        found = lookupString(gDvm.internedStrings, key, strObj);
+    }
+    if (found != NULL) {
+        return found;
+    }
+
+    if (dvmIsNonMovingObject(strObj) == false) {
+        strObj = (StringObject*)dvmCloneObject(strObj, ALLOC_NON_MOVING);
+    }
+    growIfNeeded(gDvm.literalStrings);
+    growIfNeeded(gDvm.internedStrings);
+    pthread_mutex_t* lock = stripeLock(key);
+    dvmLockMutex(lock);
     if (isLiteral) {
         /*
          * Check the literal table for a match.
@@ -94,11 +338,13 @@ static StringObject* lookupInternedString(StringObject* strObj, bool isLiteral)
             if (interned != NULL) {
                 /*
                  * A match was found in the interned table.  Move the
-                 * matching string to the literal table.
+                 * matching string to the literal table.  It goes into
+                 * the literal table first so that lookups without the
+                 * lock always find it in one of them.
                  */
-                dvmHashTableRemove(gDvm.internedStrings, key, interned);
                 found = insertString(gDvm.literalStrings, key, interned);
                 assert(found == interned);
+                removeString(gDvm.internedStrings, key, interned);
             } else {
                 /*
                  * No match in the literal table or the interned
@@ -122,7 +368,7 @@ static StringObject* lookupInternedString(StringObject* strObj, bool isLiteral)
         }
     }
     assert(found != NULL);
-    dvmUnlockMutex(&gDvm.internLock);
+    dvmUnlockMutex(lock);
     return found;
 }
 
@@ -156,15 +402,34 @@ bool dvmIsWeakInternedString(StringObject* strObj)
     if (gDvm.internedStrings == NULL) {
         return false;
     }
-    dvmLockMutex(&gDvm.internLock);
     u4 key = dvmComputeStringHash(strObj);
     StringObject* found = lookupString(gDvm.internedStrings, key, strObj);
-    dvmUnlockMutex(&gDvm.internLock);
     return found == strObj;
 }
 
 /*
- * Clear white references from the intern table.
+ * Applies the visitor to the location of every string in the table.
+ * Assumes the VM is suspended.
+ */
+void dvmVisitInternTable(InternTable* table, InternVisitor* visitor, void* arg)
+{
+    assert(visitor != NULL);
+    if (table == NULL) {
+        return;
+    }
+    InternSlots* slots = table->slots;
+    for (size_t i = 0; i < slots->capacity; i++) {
+        InternEntry* entry = &slots->entries[i];
+        if (entry->str != NULL && entry->str != INTERN_TOMBSTONE) {
+            (*visitor)((StringObject**) &entry->str, arg);
+        }
+    }
+}
+
+/*
+ * Clear white references from the intern table, and free the slot
+ * arrays that growing the tables left behind.  Assumes the VM is
+ * suspended, so that no thread is in the middle of a lookup.
  */
 void dvmGcDetachDeadInternedStrings(int (*isUnmarkedObject)(void *))
 {
@@ -172,8 +437,20 @@ void dvmGcDetachDeadInternedStrings(int (*isUnmarkedObject)(void *))
      * is called.
      */
     if (gDvm.internedStrings != NULL) {
-        dvmLockMutex(&gDvm.internLock);
-        dvmHashForeachRemove(gDvm.internedStrings, isUnmarkedObject);
-        dvmUnlockMutex(&gDvm.internLock);
+        InternTable* table = gDvm.internedStrings;
+        InternSlots* slots = table->slots;
+        for (size_t i = 0; i < slots->capacity; i++) {
+            InternEntry* entry = &slots->entries[i];
+            StringObject* str = entry->str;
+            if (str != NULL && str != INTERN_TOMBSTONE &&
+                (*isUnmarkedObject)(str)) {
+                entry->str = INTERN_TOMBSTONE;
+                table->numLive--;
+            }
+        }
+        freeRetiredSlots(table);
+    }
+    if (gDvm.literalStrings != NULL) {
+        freeRetiredSlots(gDvm.literalStrings);
     }
 }
@@ -19,11 +19,22 @@
 #ifndef DALVIK_INTERN_H_
 #define DALVIK_INTERN_H_
 
+/*
+ * The number of locks that inserts into the intern tables are spread
+ * over.  Must be a power of two.
+ */
+#define INTERN_LOCK_STRIPES 16
+
+struct InternTable;
+
+typedef void InternVisitor(StringObject** entry, void* arg);
+
 bool dvmStringInternStartup(void);
 void dvmStringInternShutdown(void);
 StringObject* dvmLookupInternedString(StringObject* strObj);
 StringObject* dvmLookupImmortalInternedString(StringObject* strObj);
 bool dvmIsWeakInternedString(StringObject* strObj);
 void dvmGcDetachDeadInternedStrings(int (*isUnmarkedObject)(void *));
+void dvmVisitInternTable(InternTable* table, InternVisitor* visitor, void* arg);
 
 #endif  // DALVIK_INTERN_H_
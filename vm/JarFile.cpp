@@ -177,6 +177,41 @@ bail:
     return result;
 }
 
+/*
+ * If "entry" is stored without compression at a 32-bit aligned offset,
+ * map it straight out of the archive instead of extracting it into the
+ * dalvik-cache.  The DEX is used unoptimized and its classes are verified
+ * at load time.
+ *
+ * Returns "true" on success.  On failure nothing has changed and the
+ * caller should fall back to the usual extract+optimize path.
+ */
+static bool mapStoredEntry(const char* fileName, ZipArchive* pArchive,
+    ZipEntry entry, DvmDex** ppDvmDex)
+{
+    int method;
+    size_t uncompLen;
+    off_t offset;
+
+    if (dexZipGetEntryInfo(pArchive, entry, &method, &uncompLen, NULL,
+            &offset, NULL, NULL) != 0)
+        return false;
+    if (method != kCompressStored || (offset & 3) != 0)
+        return false;
+
+    if (dvmDexFileOpenFromSegment(dexZipGetArchiveFd(pArchive), offset,
+            uncompLen, ppDvmDex) != 0)
+    {
+        ALOGW("Unable to map stored %s in %s, extracting instead",
+            kDexInJarName, fileName);
+        return false;
+    }
+
+    ALOGV("Mapped stored %s in %s at offset %ld",
+        kDexInJarName, fileName, (long) offset);
+    return true;
+}
+
 /*
  * Open a Jar file.  It's okay if it's just a Zip archive without all of
  * the Jar trimmings, but we do insist on finding "classes.dex" inside
@@ -240,6 +275,11 @@ tryArchive:
          * "classes.dex".
          */
         entry = dexZipFindEntry(&archive, kDexInJarName);
+        if (entry != NULL && gDvm.mapStoredDex &&
+            mapStoredEntry(fileName, &archive, entry, &pDvmDex))
+        {
+            goto mapped;
+        }
         if (entry != NULL) {
             bool newFile = false;
 
@@ -341,6 +381,7 @@ tryArchive:
         locked = false;
     }
 
+mapped:
     ALOGV("Successfully opened '%s' in '%s'", kDexInJarName, fileName);
 
     *ppJarFile = (JarFile*) calloc(1, sizeof(JarFile));
@@ -26,7 +26,7 @@
 struct JarFile {
     ZipArchive  archive;
     //MemMapping  map;
-    char*       cacheFileName;
+    char*       cacheFileName;      // NULL if mapped from the archive
     DvmDex*     pDvmDex;
 };
 
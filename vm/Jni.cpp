@@ -19,6 +19,7 @@
  */
 #include "Dalvik.h"
 #include "JniInternal.h"
+#include "JniExt.h"
 #include "ScopedPthreadMutexLock.h"
 #include "UniquePtr.h"
 
@@ -240,7 +241,7 @@ private:
     void operator=(const ScopedJniThreadState&);
 };
 
-#define kGlobalRefsTableInitialSize 512
+#define kGlobalRefsTableInitialSize 128         /* per shard */
 #define kGlobalRefsTableMaxSize     51200       /* arbitrary, must be < 64K */
 #define kGrefWaterInterval          100
 #define kTrackGrefUsage             true
@@ -251,20 +252,25 @@ private:
 #define kPinTableMaxSize            1024
 #define kPinComplainThreshold       10
 
+#define kJniMemberCacheSize         512     /* must be a power of 2 */
+
 bool dvmJniStartup() {
-    if (!gDvm.jniGlobalRefTable.init(kGlobalRefsTableInitialSize,
-                                 kGlobalRefsTableMaxSize,
-                                 kIndirectKindGlobal)) {
-        return false;
-    }
-    if (!gDvm.jniWeakGlobalRefTable.init(kWeakGlobalRefsTableInitialSize,
-                                 kGlobalRefsTableMaxSize,
-                                 kIndirectKindWeakGlobal)) {
-        return false;
+    for (size_t i = 0; i < kIndirectRefShardCount; i++) {
+        if (!gDvm.jniGlobalRefs[i].table.init(kGlobalRefsTableInitialSize,
+                                     kGlobalRefsTableMaxSize,
+                                     kIndirectKindGlobal)) {
+            return false;
+        }
+        if (!gDvm.jniWeakGlobalRefs[i].table.init(kWeakGlobalRefsTableInitialSize,
+                                     kGlobalRefsTableMaxSize,
+                                     kIndirectKindWeakGlobal)) {
+            return false;
+        }
+        dvmInitMutex(&gDvm.jniGlobalRefs[i].lock);
+        dvmInitMutex(&gDvm.jniWeakGlobalRefs[i].lock);
     }
 
-    dvmInitMutex(&gDvm.jniGlobalRefLock);
-    dvmInitMutex(&gDvm.jniWeakGlobalRefLock);
+    dvmInitMutex(&gDvm.jniGlobalRefMarkLock);
     gDvm.jniGlobalRefLoMark = 0;
     gDvm.jniGlobalRefHiMark = kGrefWaterInterval * 2;
 
@@ -274,13 +280,22 @@ bool dvmJniStartup() {
 
     dvmInitMutex(&gDvm.jniPinRefLock);
 
+    gDvm.jniMemberCache = dvmAllocAtomicCache(kJniMemberCacheSize);
+    if (gDvm.jniMemberCache == NULL) {
+        return false;
+    }
+
     return true;
 }
 
 void dvmJniShutdown() {
-    gDvm.jniGlobalRefTable.destroy();
-    gDvm.jniWeakGlobalRefTable.destroy();
+    for (size_t i = 0; i < kIndirectRefShardCount; i++) {
+        gDvm.jniGlobalRefs[i].table.destroy();
+        gDvm.jniWeakGlobalRefs[i].table.destroy();
+    }
     dvmClearReferenceTable(&gDvm.jniPinRefTable);
+    dvmFreeAtomicCache(gDvm.jniMemberCache);
+    gDvm.jniMemberCache = NULL;
 }
 
 /*
@@ -324,10 +339,9 @@ Object* dvmDecodeIndirectRef(Thread* self, jobject jobj) {
         }
     case kIndirectKindGlobal:
         {
-            // TODO: find a way to avoid the mutex activity here
-            IndirectRefTable* pRefTable = &gDvm.jniGlobalRefTable;
-            ScopedPthreadMutexLock lock(&gDvm.jniGlobalRefLock);
-            Object* result = pRefTable->get(jobj);
+            IndirectRefShard* refs = &gDvm.jniGlobalRefs[indirectRefShard(jobj)];
+            ScopedPthreadMutexLock lock(&refs->lock);
+            Object* result = refs->table.get(jobj);
             if (UNLIKELY(result == NULL)) {
                 ALOGE("JNI ERROR (app bug): use of deleted global reference (%p)", jobj);
                 dvmAbort();
@@ -336,10 +350,9 @@ Object* dvmDecodeIndirectRef(Thread* self, jobject jobj) {
         }
     case kIndirectKindWeakGlobal:
         {
-            // TODO: find a way to avoid the mutex activity here
-            IndirectRefTable* pRefTable = &gDvm.jniWeakGlobalRefTable;
-            ScopedPthreadMutexLock lock(&gDvm.jniWeakGlobalRefLock);
-            Object* result = pRefTable->get(jobj);
+            IndirectRefShard* refs = &gDvm.jniWeakGlobalRefs[indirectRefShard(jobj)];
+            ScopedPthreadMutexLock lock(&refs->lock);
+            Object* result = refs->table.get(jobj);
             if (result == kClearedJniWeakGlobal) {
                 result = NULL;
             } else if (UNLIKELY(result == NULL)) {
@@ -428,6 +441,76 @@ static void deleteLocalReference(Thread* self, jobject jobj) {
     }
 }
 
+/*
+ * Returns the shard that global refs made by the current thread go in.
+ * Threads with neighbouring ids use different shards.
+ */
+static u4 currentRefShard() {
+    Thread* self = dvmThreadSelf();
+    if (self == NULL) {
+        return 0;
+    }
+    return self->threadId & (kIndirectRefShardCount - 1);
+}
+
+/*
+ * Add "obj" to the current thread's shard of "shards".  Aborts if the
+ * shard is full.
+ */
+static jobject addToRefShard(IndirectRefShard* shards, Object* obj, const char* descr) {
+    u4 shard = currentRefShard();
+    IndirectRefShard* refs = &shards[shard];
+    ScopedPthreadMutexLock lock(&refs->lock);
+    IndirectRef iref = refs->table.add(IRT_FIRST_SEGMENT, obj);
+    if (iref == NULL) {
+        refs->table.dump(descr);
+        ALOGE("Failed adding to %s ref table (%zd entries)", descr,
+                refs->table.capacity());
+        dvmAbort();
+    }
+    return (jobject) indirectRefInShard(iref, shard);
+}
+
+/*
+ * Remove "jobj" from the shard of "shards" it came from.  A direct pointer
+ * passed in when we work around app JNI bugs could be in any shard.
+ *
+ * Returns "false" if nothing was removed.
+ */
+static bool removeFromRefShard(IndirectRefShard* shards, jobject jobj) {
+    if (indirectRefKind(jobj) != kIndirectKindInvalid) {
+        IndirectRefShard* refs = &shards[indirectRefShard(jobj)];
+        ScopedPthreadMutexLock lock(&refs->lock);
+        return refs->table.remove(IRT_FIRST_SEGMENT, jobj);
+    }
+    for (size_t i = 0; i < kIndirectRefShardCount; i++) {
+        ScopedPthreadMutexLock lock(&shards[i].lock);
+        if (shards[i].table.remove(IRT_FIRST_SEGMENT, jobj)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Returns the #of entries in all global ref shards, holes included.  The
+ * shards are not locked, so the count is only approximate.
+ */
+static int globalRefCapacity() {
+    size_t count = 0;
+    for (size_t i = 0; i < kIndirectRefShardCount; i++) {
+        count += gDvm.jniGlobalRefs[i].table.capacity();
+    }
+    return count;
+}
+
+static void dumpGlobalRefs() {
+    for (size_t i = 0; i < kIndirectRefShardCount; i++) {
+        ScopedPthreadMutexLock lock(&gDvm.jniGlobalRefs[i].lock);
+        gDvm.jniGlobalRefs[i].table.dump("JNI global");
+    }
+}
+
 /*
  * Add a global reference for an object.
  *
@@ -462,7 +545,7 @@ static jobject addGlobalReference(Object* obj) {
     if (false && ((Object*)obj)->clazz == gDvm.classArrayByte) {
         ArrayObject* arrayObj = (ArrayObject*) obj;
         if (arrayObj->length == 8192 /*&&
-            dvmReferenceTableEntries(&gDvm.jniGlobalRefTable) > 400*/)
+            globalRefCapacity() > 400*/)
         {
             ALOGI("Adding global ref on byte array %p (len=%d)",
                 arrayObj, arrayObj->length);
@@ -470,8 +553,6 @@ static jobject addGlobalReference(Object* obj) {
         }
     }
 
-    ScopedPthreadMutexLock lock(&gDvm.jniGlobalRefLock);
-
     /*
      * Throwing an exception on failure is problematic, because JNI code
      * may not be expecting an exception, and things sort of cascade.  We
@@ -481,13 +562,7 @@ static jobject addGlobalReference(Object* obj) {
      * we're either leaking global ref table entries or we're going to
      * run out of space in the GC heap.
      */
-    jobject jobj = (jobject) gDvm.jniGlobalRefTable.add(IRT_FIRST_SEGMENT, obj);
-    if (jobj == NULL) {
-        gDvm.jniGlobalRefTable.dump("JNI global");
-        ALOGE("Failed adding to JNI global ref table (%zd entries)",
-                gDvm.jniGlobalRefTable.capacity());
-        dvmAbort();
-    }
+    jobject jobj = addToRefShard(gDvm.jniGlobalRefs, obj, "JNI global");
 
     LOGVV("GREF add %p  (%s.%s)", obj,
         dvmGetCurrentJNIMethod()->clazz->descriptor,
@@ -495,7 +570,8 @@ static jobject addGlobalReference(Object* obj) {
 
     /* GREF usage tracking; should probably be disabled for production env */
     if (kTrackGrefUsage && gDvm.jniGrefLimit != 0) {
-        int count = gDvm.jniGlobalRefTable.capacity();
+        ScopedPthreadMutexLock lock(&gDvm.jniGlobalRefMarkLock);
+        int count = globalRefCapacity();
         // TODO: adjust for "holes"
         if (count > gDvm.jniGlobalRefHiMark) {
             ALOGD("GREF has increased to %d", count);
@@ -507,7 +583,7 @@ static jobject addGlobalReference(Object* obj) {
                 if (gDvmJni.warnOnly) {
                     ALOGW("Excessive JNI global references (%d)", count);
                 } else {
-                    gDvm.jniGlobalRefTable.dump("JNI global");
+                    dumpGlobalRefs();
                     ALOGE("Excessive JNI global references (%d)", count);
                     dvmAbort();
                 }
@@ -522,15 +598,7 @@ static jobject addWeakGlobalReference(Object* obj) {
         return NULL;
     }
 
-    ScopedPthreadMutexLock lock(&gDvm.jniWeakGlobalRefLock);
-    IndirectRefTable *table = &gDvm.jniWeakGlobalRefTable;
-    jobject jobj = (jobject) table->add(IRT_FIRST_SEGMENT, obj);
-    if (jobj == NULL) {
-        gDvm.jniWeakGlobalRefTable.dump("JNI weak global");
-        ALOGE("Failed adding to JNI weak global ref table (%zd entries)", table->capacity());
-        dvmAbort();
-    }
-    return jobj;
+    return addToRefShard(gDvm.jniWeakGlobalRefs, obj, "JNI weak global");
 }
 
 static void deleteWeakGlobalReference(jobject jobj) {
@@ -538,9 +606,7 @@ static void deleteWeakGlobalReference(jobject jobj) {
         return;
     }
 
-    ScopedPthreadMutexLock lock(&gDvm.jniWeakGlobalRefLock);
-    IndirectRefTable *table = &gDvm.jniWeakGlobalRefTable;
-    if (!table->remove(IRT_FIRST_SEGMENT, jobj)) {
+    if (!removeFromRefShard(gDvm.jniWeakGlobalRefs, jobj)) {
         ALOGW("JNI: DeleteWeakGlobalRef(%p) failed to find entry", jobj);
     }
 }
@@ -557,14 +623,14 @@ static void deleteGlobalReference(jobject jobj) {
         return;
     }
 
-    ScopedPthreadMutexLock lock(&gDvm.jniGlobalRefLock);
-    if (!gDvm.jniGlobalRefTable.remove(IRT_FIRST_SEGMENT, jobj)) {
+    if (!removeFromRefShard(gDvm.jniGlobalRefs, jobj)) {
         ALOGW("JNI: DeleteGlobalRef(%p) failed to find entry", jobj);
         return;
     }
 
     if (kTrackGrefUsage && gDvm.jniGrefLimit != 0) {
-        int count = gDvm.jniGlobalRefTable.capacity();
+        ScopedPthreadMutexLock lock(&gDvm.jniGlobalRefMarkLock);
+        int count = globalRefCapacity();
         // TODO: not quite right, need to subtract holes
         if (count < gDvm.jniGlobalRefLoMark) {
             ALOGD("GREF has decreased to %d", count);
@@ -646,7 +712,7 @@ static void unpinPrimitiveArray(ArrayObject* arrayObj) {
 void dvmDumpJniReferenceTables() {
     Thread* self = dvmThreadSelf();
     self->jniLocalRefTable.dump("JNI local");
-    gDvm.jniGlobalRefTable.dump("JNI global");
+    dumpGlobalRefs();
     dvmDumpReferenceTable(&gDvm.jniPinRefTable, "JNI pinned array");
 }
 
@@ -701,6 +767,32 @@ static void dumpCandidateMethods(ClassObject* clazz, const char* methodName, con
     dumpMethods(clazz->directMethods, clazz->directMethodCount, methodName);
 }
 
+/*
+ * Returns true if every argument of "method" is a primitive or an array
+ * of primitives, and it doesn't return a reference.  Those are the only
+ * types a fast JNI method can be handed without local references.
+ */
+static bool hasFastJniSignature(const Method* method)
+{
+    if (method->shorty[0] == 'L') {
+        return false;
+    }
+
+    DexParameterIterator iterator;
+    dexParameterIteratorInit(&iterator, &method->prototype);
+    const char* descriptor;
+    while ((descriptor = dexParameterIteratorNextDescriptor(&iterator)) != NULL) {
+        if (descriptor[0] == 'L') {
+            return false;
+        }
+        if (descriptor[0] == '[' &&
+                (descriptor[1] == 'L' || descriptor[1] == '[')) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /*
  * Register a method that uses JNI calling conventions.
  */
@@ -711,8 +803,9 @@ static bool dvmRegisterJNIMethod(ClassObject* clazz, const char* methodName,
         return false;
     }
 
-    // If a signature starts with a '!', we take that as a sign that the native code doesn't
-    // need the extra JNI arguments (the JNIEnv* and the jclass).
+    // If a signature starts with a '!', the native code is a leaf that doesn't call back into
+    // the VM.  We call it without leaving THREAD_RUNNING and without a local reference frame,
+    // and pass array arguments as raw pointers to their elements (see dvmCallFastJNIMethod).
     bool fastJni = false;
     if (*signature == '!') {
         fastJni = true;
@@ -751,6 +844,13 @@ static bool dvmRegisterJNIMethod(ClassObject* clazz, const char* methodName,
                     clazz->descriptor, methodName, signature);
             return false;
         }
+        if (!hasFastJniSignature(method)) {
+            // Objects would need local references, which we won't be
+            // creating.
+            ALOGE("fast JNI method %s.%s:%s can only take primitives and primitive arrays",
+                    clazz->descriptor, methodName, signature);
+            return false;
+        }
     }
 
     if (method->nativeFunc != dvmResolveNativeMethod) {
@@ -812,7 +912,12 @@ void dvmUseJNIBridge(Method* method, void* func) {
         }
     }
 
-    DalvikBridgeFunc bridge = gDvmJni.useCheckJni ? dvmCheckCallJNIMethod : dvmCallJNIMethod;
+    DalvikBridgeFunc bridge;
+    if (method->fastJni) {
+        bridge = dvmCallFastJNIMethod;
+    } else {
+        bridge = gDvmJni.useCheckJni ? dvmCheckCallJNIMethod : dvmCallJNIMethod;
+    }
     dvmSetNativeFunc(method, bridge, (const u2*) func);
 }
 
@@ -1089,6 +1194,8 @@ static inline void convertReferenceResult(JNIEnv* env, JValue* pResult,
  */
 void dvmCallJNIMethod(const u4* args, JValue* pResult, const Method* method, Thread* self) {
     u4* modArgs = (u4*) args;
+
+    dvmBumpThreadMetric(self, kThreadMetricJniCalls, 1);
     jclass staticMethodClass = NULL;
 
     u4 accessFlags = method->accessFlags;
@@ -1167,6 +1274,62 @@ void dvmCallJNIMethod(const u4* args, JValue* pResult, const Method* method, Thr
     }
 }
 
+/*
+ * Fast form, for static methods registered with a '!' signature.  These
+ * only take primitives and primitive arrays (checked at registration),
+ * so no local references are needed.  Arrays are passed as pointers to
+ * their first element, or NULL; the array is not copied and can't move.
+ *
+ * We stay in THREAD_RUNNING for the call, so the native code holds off
+ * any suspension until it returns.  It must be short, must not block,
+ * and must not use the JNIEnv* or jclass it is handed (the jclass is
+ * always NULL).
+ */
+void dvmCallFastJNIMethod(const u4* args, JValue* pResult, const Method* method, Thread* self) {
+    u4* modArgs = (u4*) args;
+
+    dvmBumpThreadMetric(self, kThreadMetricJniCalls, 1);
+
+    assert(dvmIsStaticMethod(method) && !dvmIsSynchronizedMethod(method));
+
+    if (!method->noRef) {
+        int idx = 0;
+        const char* shorty = &method->shorty[1];        /* skip return type */
+        while (*shorty != ' ') {
+            switch (*shorty++) {
+            case 'L':
+                if (modArgs[idx] != 0) {
+                    modArgs[idx] = (u4) ((ArrayObject*) modArgs[idx])->contents;
+                }
+                break;
+            case 'D':
+            case 'J':
+                idx++;
+                break;
+            default:
+                /* Z B C S I -- do nothing */
+                break;
+            }
+            idx++;
+        }
+    }
+
+    if (UNLIKELY(method->shouldTrace)) {
+        logNativeMethodEntry(method, args);
+    }
+
+    assert(method->insns != NULL);
+    COMPUTE_STACK_SUM(self);
+    dvmPlatformInvoke(self->jniEnv, NULL,
+            method->jniArgInfo, method->insSize, modArgs, method->shorty,
+            (void*) method->insns, pResult);
+    CHECK_STACK_SUM(self);
+
+    if (UNLIKELY(method->shouldTrace)) {
+        logNativeMethodExit(method, self, *pResult);
+    }
+}
+
 /*
  * ===========================================================================
  *      JNI implementation
@@ -1607,12 +1770,19 @@ static jboolean IsInstanceOf(JNIEnv* env, jobject jobj, jclass jclazz) {
 }
 
 /*
- * Get a method ID for an instance method.
- *
- * While Dalvik bytecode has distinct instructions for virtual, super,
- * static, direct, and interface method invocation, JNI only provides
- * two functions for acquiring a method ID.  This call handles everything
- * but static methods.
+ * The kinds of member we cache lookups for.  Stored in the low bits of the
+ * cache key, so the same name and signature can be cached for each.
+ */
+enum JniMemberKind {
+    kJniInstanceMethod = 0,
+    kJniStaticMethod,
+    kJniInstanceField,
+    kJniStaticField,
+};
+
+/*
+ * Do the uncached lookup of a member, using the JNI rules for each kind.
+ * Returns NULL, without throwing, if no suitable member was found.
  *
  * JNI defines <init> as an instance method, but Dalvik considers it a
  * "direct" method, so we have to special-case it here.
@@ -1620,40 +1790,120 @@ static jboolean IsInstanceOf(JNIEnv* env, jobject jobj, jclass jclazz) {
  * Dalvik also puts all private methods into the "direct" list, so we
  * really need to just search both lists.
  */
+static void* findJniMember(ClassObject* clazz, const char* name,
+    const char* sig, JniMemberKind kind)
+{
+    Method* meth;
+
+    switch (kind) {
+    case kJniInstanceMethod:
+        if (dvmIsInterfaceClass(clazz)) {
+            return dvmFindInterfaceMethodHierByDescriptor(clazz, name, sig);
+        }
+        meth = dvmFindVirtualMethodHierByDescriptor(clazz, name, sig);
+        if (meth == NULL) {
+            /* search private methods and constructors; non-hierarchical */
+            meth = dvmFindDirectMethodByDescriptor(clazz, name, sig);
+        }
+        if (meth != NULL && dvmIsStaticMethod(meth)) {
+            IF_ALOGD() {
+                char* desc = dexProtoCopyMethodDescriptor(&meth->prototype);
+                ALOGD("GetMethodID: not returning static method %s.%s %s",
+                        clazz->descriptor, meth->name, desc);
+                free(desc);
+            }
+            meth = NULL;
+        }
+        return meth;
+    case kJniStaticMethod:
+        meth = dvmFindDirectMethodHierByDescriptor(clazz, name, sig);
+        /* make sure it's static, not virtual+private */
+        if (meth != NULL && !dvmIsStaticMethod(meth)) {
+            IF_ALOGD() {
+                char* desc = dexProtoCopyMethodDescriptor(&meth->prototype);
+                ALOGD("GetStaticMethodID: not returning nonstatic method %s.%s %s",
+                        clazz->descriptor, meth->name, desc);
+                free(desc);
+            }
+            meth = NULL;
+        }
+        return meth;
+    case kJniInstanceField:
+        return dvmFindInstanceFieldHier(clazz, name, sig);
+    case kJniStaticField:
+        return dvmFindStaticFieldHier(clazz, name, sig);
+    }
+    return NULL;
+}
+
+/*
+ * Returns "true" if the cached member "member" really is "name" / "sig".
+ * Different name/signature pairs can share a hash, so a cache hit has to
+ * be confirmed before we hand it out.
+ */
+static bool jniMemberMatches(const void* member, const char* name,
+    const char* sig, JniMemberKind kind)
+{
+    if (kind == kJniInstanceField || kind == kJniStaticField) {
+        const Field* field = (const Field*) member;
+        return strcmp(field->name, name) == 0 &&
+                strcmp(field->signature, sig) == 0;
+    }
+    const Method* meth = (const Method*) member;
+    return strcmp(meth->name, name) == 0 &&
+            dexProtoCompareToDescriptor(&meth->prototype, sig) == 0;
+}
+
+/*
+ * Find a member, consulting gDvm.jniMemberCache first.  Native code tends
+ * to look up the same handful of IDs over and over (often on every call,
+ * rather than caching them in statics), and a miss walks every class in
+ * the hierarchy doing string compares.
+ *
+ * "clazz" must be initialized.  Failed lookups aren't worth remembering;
+ * they end in an exception.
+ */
+static void* lookupJniMember(ClassObject* clazz, const char* name,
+    const char* sig, JniMemberKind kind)
+{
+    u4 hash = dvmComputeUtf8Hash(name) * 31 + dvmComputeUtf8Hash(sig);
+    u4 key = (hash << 2) | kind;
+
+#define ATOMIC_CACHE_CALC findJniMember(clazz, name, sig, kind)
+    void* member = (void*) ATOMIC_CACHE_LOOKUP(gDvm.jniMemberCache,
+                kJniMemberCacheSize, clazz, key);
+#undef ATOMIC_CACHE_CALC
+
+    if (member != NULL && !jniMemberMatches(member, name, sig, kind)) {
+        member = findJniMember(clazz, name, sig, kind);
+    }
+    return member;
+}
+
+/*
+ * Get a method ID for an instance method.
+ *
+ * While Dalvik bytecode has distinct instructions for virtual, super,
+ * static, direct, and interface method invocation, JNI only provides
+ * two functions for acquiring a method ID.  This call handles everything
+ * but static methods.  See findJniMember for the search rules.
+ */
 static jmethodID GetMethodID(JNIEnv* env, jclass jclazz, const char* name, const char* sig) {
     ScopedJniThreadState ts(env);
 
     ClassObject* clazz = (ClassObject*) dvmDecodeIndirectRef(ts.self(), jclazz);
     if (!dvmIsClassInitialized(clazz) && !dvmInitClass(clazz)) {
         assert(dvmCheckException(ts.self()));
-    } else if (dvmIsInterfaceClass(clazz)) {
-        Method* meth = dvmFindInterfaceMethodHierByDescriptor(clazz, name, sig);
-        if (meth == NULL) {
-            dvmThrowExceptionFmt(gDvm.exNoSuchMethodError,
-                "no method with name='%s' signature='%s' in interface %s",
-                name, sig, clazz->descriptor);
-        }
-        return (jmethodID) meth;
-    }
-    Method* meth = dvmFindVirtualMethodHierByDescriptor(clazz, name, sig);
-    if (meth == NULL) {
-        /* search private methods and constructors; non-hierarchical */
-        meth = dvmFindDirectMethodByDescriptor(clazz, name, sig);
-    }
-    if (meth != NULL && dvmIsStaticMethod(meth)) {
-        IF_ALOGD() {
-            char* desc = dexProtoCopyMethodDescriptor(&meth->prototype);
-            ALOGD("GetMethodID: not returning static method %s.%s %s",
-                    clazz->descriptor, meth->name, desc);
-            free(desc);
-        }
-        meth = NULL;
+        return NULL;
     }
+
+    Method* meth = (Method*) lookupJniMember(clazz, name, sig, kJniInstanceMethod);
     if (meth == NULL) {
         dvmThrowExceptionFmt(gDvm.exNoSuchMethodError,
-                "no method with name='%s' signature='%s' in class %s",
-                name, sig, clazz->descriptor);
-    } else {
+                "no method with name='%s' signature='%s' in %s %s",
+                name, sig, dvmIsInterfaceClass(clazz) ? "interface" : "class",
+                clazz->descriptor);
+    } else if (!dvmIsInterfaceClass(clazz)) {
         /*
          * The method's class may not be the same as clazz, but if
          * it isn't this must be a virtual method and the class must
@@ -1677,7 +1927,7 @@ static jfieldID GetFieldID(JNIEnv* env, jclass jclazz, const char* name, const c
         return NULL;
     }
 
-    jfieldID id = (jfieldID) dvmFindInstanceFieldHier(clazz, name, sig);
+    jfieldID id = (jfieldID) lookupJniMember(clazz, name, sig, kJniInstanceField);
     if (id == NULL) {
         dvmThrowExceptionFmt(gDvm.exNoSuchFieldError,
                 "no field with name='%s' signature='%s' in class %s",
@@ -1698,20 +1948,7 @@ static jmethodID GetStaticMethodID(JNIEnv* env, jclass jclazz, const char* name,
         return NULL;
     }
 
-    Method* meth = dvmFindDirectMethodHierByDescriptor(clazz, name, sig);
-
-    /* make sure it's static, not virtual+private */
-    if (meth != NULL && !dvmIsStaticMethod(meth)) {
-        IF_ALOGD() {
-            char* desc = dexProtoCopyMethodDescriptor(&meth->prototype);
-            ALOGD("GetStaticMethodID: not returning nonstatic method %s.%s %s",
-                    clazz->descriptor, meth->name, desc);
-            free(desc);
-        }
-        meth = NULL;
-    }
-
-    jmethodID id = (jmethodID) meth;
+    jmethodID id = (jmethodID) lookupJniMember(clazz, name, sig, kJniStaticMethod);
     if (id == NULL) {
         dvmThrowExceptionFmt(gDvm.exNoSuchMethodError,
                 "no static method with name='%s' signature='%s' in class %s",
@@ -1732,7 +1969,7 @@ static jfieldID GetStaticFieldID(JNIEnv* env, jclass jclazz, const char* name, c
         return NULL;
     }
 
-    jfieldID id = (jfieldID) dvmFindStaticFieldHier(clazz, name, sig);
+    jfieldID id = (jfieldID) lookupJniMember(clazz, name, sig, kJniStaticField);
     if (id == NULL) {
         dvmThrowExceptionFmt(gDvm.exNoSuchFieldError,
                 "no static field with name='%s' signature='%s' in class %s",
@@ -3373,6 +3610,113 @@ void dvmLateEnableCheckedJni() {
     }
 }
 
+/*
+ * ===========================================================================
+ *      Dalvik JNI extensions
+ * ===========================================================================
+ */
+
+/*
+ * Find the array and element width for one region of a batched access,
+ * or raise an exception and return NULL.
+ */
+static ArrayObject* decodeArrayRegion(Thread* self,
+    const DvmJniArrayRegion* region, size_t* pWidth, const char* arrayIdentifier)
+{
+    ArrayObject* arrayObj = (ArrayObject*) dvmDecodeIndirectRef(self, region->array);
+    if (arrayObj == NULL) {
+        dvmThrowNullPointerException("array == null");
+        return NULL;
+    }
+    ClassObject* elementClass = arrayObj->clazz->elementClass;
+    if (arrayObj->clazz->arrayDim != 1 || !dvmIsPrimitiveClass(elementClass)) {
+        dvmThrowIllegalArgumentException("not a primitive array");
+        return NULL;
+    }
+    if (region->start < 0 || region->len < 0 ||
+            region->start + region->len > (int) arrayObj->length) {
+        throwArrayRegionOutOfBounds(arrayObj, region->start, region->len,
+            arrayIdentifier);
+        return NULL;
+    }
+    *pWidth = dvmArrayClassElementWidth(arrayObj->clazz);
+    return arrayObj;
+}
+
+jboolean dvmJniGetArrayRegions(JNIEnv* env, const DvmJniArrayRegion* regions,
+    jsize count)
+{
+    ScopedJniThreadState ts(env);
+    for (jsize i = 0; i < count; i++) {
+        size_t width;
+        ArrayObject* arrayObj = decodeArrayRegion(ts.self(), &regions[i], &width, "src");
+        if (arrayObj == NULL) {
+            return JNI_FALSE;
+        }
+        memcpy(regions[i].buf, (u1*) (void*) arrayObj->contents + regions[i].start * width,
+            regions[i].len * width);
+    }
+    return JNI_TRUE;
+}
+
+jboolean dvmJniSetArrayRegions(JNIEnv* env, const DvmJniArrayRegion* regions,
+    jsize count)
+{
+    ScopedJniThreadState ts(env);
+    for (jsize i = 0; i < count; i++) {
+        size_t width;
+        ArrayObject* arrayObj = decodeArrayRegion(ts.self(), &regions[i], &width, "dst");
+        if (arrayObj == NULL) {
+            return JNI_FALSE;
+        }
+        memcpy((u1*) (void*) arrayObj->contents + regions[i].start * width, regions[i].buf,
+            regions[i].len * width);
+    }
+    return JNI_TRUE;
+}
+
+/*
+ * Objects don't move, so the characters are handed out in place.  The
+ * backing arrays are pinned, like GetStringChars does, but under a
+ * single acquisition of the pin table lock.
+ */
+void dvmJniGetStringsChars(JNIEnv* env, const jstring* strings, jsize count,
+    const jchar** chars, jsize* lengths)
+{
+    ScopedJniThreadState ts(env);
+    ScopedPthreadMutexLock lock(&gDvm.jniPinRefLock);
+    for (jsize i = 0; i < count; i++) {
+        StringObject* strObj = (StringObject*) dvmDecodeIndirectRef(ts.self(), strings[i]);
+        if (!dvmAddToReferenceTable(&gDvm.jniPinRefTable, (Object*) strObj->array())) {
+            dvmDumpReferenceTable(&gDvm.jniPinRefTable, "JNI pinned array");
+            ALOGE("Failed adding to JNI pinned array ref table (%d entries)",
+               (int) dvmReferenceTableEntries(&gDvm.jniPinRefTable));
+            dvmAbort();
+        }
+        if (chars != NULL) {
+            chars[i] = (const jchar*) strObj->chars();
+        }
+        if (lengths != NULL) {
+            lengths[i] = strObj->length();
+        }
+    }
+}
+
+void dvmJniReleaseStringsChars(JNIEnv* env, const jstring* strings, jsize count)
+{
+    ScopedJniThreadState ts(env);
+    ScopedPthreadMutexLock lock(&gDvm.jniPinRefLock);
+    for (jsize i = 0; i < count; i++) {
+        StringObject* strObj = (StringObject*) dvmDecodeIndirectRef(ts.self(), strings[i]);
+        ArrayObject* strChars = strObj->array();
+        if (!dvmRemoveFromReferenceTable(&gDvm.jniPinRefTable,
+                gDvm.jniPinRefTable.table, (Object*) strChars))
+        {
+            ALOGW("JNI: dvmJniReleaseStringsChars(%p) failed to find entry", strChars);
+        }
+    }
+}
+
 /*
  * Not supported.
  */
@@ -3465,6 +3809,19 @@ jint JNI_CreateJavaVM(JavaVM** p_vm, JNIEnv** p_env, void* vm_args) {
                     gDvmJni.forceCopy = true;
                 } else if (strcmp(jniOpt, "logThirdPartyJni") == 0) {
                     gDvmJni.logThirdPartyJni = true;
+                } else if (strcmp(jniOpt, "light") == 0) {
+                    gDvmJni.checkJniLight = true;
+                    gDvmJni.useCheckJni = true;
+                } else if (strncmp(jniOpt, "sample=", 7) == 0) {
+                    char* end;
+                    long interval = strtol(jniOpt + 7, &end, 10);
+                    if (end == jniOpt + 7 || *end != '\0' || interval < 1) {
+                        dvmFprintf(stderr, "ERROR: CreateJavaVM failed: bad -Xjniopts sample interval '%s'\n",
+                                jniOpt + 7);
+                        return JNI_ERR;
+                    }
+                    gDvmJni.checkJniSampleInterval = interval;
+                    gDvmJni.useCheckJni = true;
                 } else {
                     dvmFprintf(stderr, "ERROR: CreateJavaVM failed: unknown -Xjniopts option '%s'\n",
                             jniOpt);
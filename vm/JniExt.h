@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Dalvik extensions to JNI, for native code that makes many small array
+ * and string accesses.  Each call does one thread state transition for
+ * the whole batch instead of one per element of the batch.
+ *
+ * Only depends on jni.h, so native libraries can include it directly.
+ */
+#ifndef DALVIK_JNIEXT_H_
+#define DALVIK_JNIEXT_H_
+
+#include "jni.h"
+
+/*
+ * One region of a primitive array.  "buf" must hold "len" elements of the
+ * array's type.
+ */
+struct DvmJniArrayRegion {
+    jarray  array;
+    jsize   start;
+    jsize   len;
+    void*   buf;
+};
+
+/*
+ * Batched Get<Type>ArrayRegion / Set<Type>ArrayRegion.  The regions are
+ * copied in order; the arrays may be of different primitive types.  On a
+ * bad region an exception is raised, the remaining regions are skipped,
+ * and JNI_FALSE is returned.
+ */
+extern "C" jboolean dvmJniGetArrayRegions(JNIEnv* env,
+    const DvmJniArrayRegion* regions, jsize count);
+extern "C" jboolean dvmJniSetArrayRegions(JNIEnv* env,
+    const DvmJniArrayRegion* regions, jsize count);
+
+/*
+ * Batched GetStringChars.  Fills in "chars" and "lengths" (either may be
+ * NULL) for each string.  The characters are the string's own storage,
+ * never a copy, and stay valid until dvmJniReleaseStringsChars() is
+ * called with the same strings.  They are not NUL-terminated.
+ */
+extern "C" void dvmJniGetStringsChars(JNIEnv* env, const jstring* strings,
+    jsize count, const jchar** chars, jsize* lengths);
+extern "C" void dvmJniReleaseStringsChars(JNIEnv* env,
+    const jstring* strings, jsize count);
+
+#endif  // DALVIK_JNIEXT_H_
@@ -74,6 +74,9 @@ guard the pages on debug builds.  Handy when tracking down corruption.
 /* leave enough space for a length word */
 #define HEADER_EXTRA        4
 
+/* how far past the end of an allocation to make pages accessible */
+#define PROTECT_CHUNK       (64*1024)
+
 /* overload the length word */
 #define LENGTHFLAG_FREE    0x80000000
 #define LENGTHFLAG_RW      0x40000000
@@ -198,6 +201,7 @@ LinearAllocHdr* dvmLinearAllocCreate(Object* classLoader)
         free(pHdr);
         return NULL;
     }
+    pHdr->protOffset = SYSTEM_PAGE_SIZE * 2;
 
     if (ENFORCE_READ_ONLY) {
         /* allocate the per-page ref count */
@@ -250,6 +254,88 @@ void dvmLinearAllocDestroy(Object* classLoader)
     free(pHdr);
 }
 
+/*
+ * Make the pages up to "nextOffset" accessible, along with the next
+ * PROTECT_CHUNK bytes so that most allocations find their pages ready.
+ */
+static void extendAccessible(LinearAllocHdr* pHdr, int nextOffset)
+{
+    dvmLockMutex(&pHdr->lock);
+    int protOffset = pHdr->protOffset;
+    if (nextOffset > protOffset) {
+        int newProtOffset = (nextOffset + PROTECT_CHUNK + SYSTEM_PAGE_SIZE-1)
+                                & ~(SYSTEM_PAGE_SIZE-1);
+        if (newProtOffset > pHdr->mapLength)
+            newProtOffset = pHdr->mapLength;
+
+        LOGVV("---    calling mprotect(start=%d len=%d RW)",
+            protOffset, newProtOffset - protOffset);
+        if (mprotect(pHdr->mapAddr + protOffset, newProtOffset - protOffset,
+                PROT_READ | PROT_WRITE) != 0)
+        {
+            ALOGE("LinearAlloc mprotect (+%d %d) failed: %s",
+                protOffset, newProtOffset - protOffset, strerror(errno));
+            /* we're going to fail soon, might as do it now */
+            dvmAbort();
+        }
+        android_atomic_release_store(newProtOffset, &pHdr->protOffset);
+    }
+    dvmUnlockMutex(&pHdr->lock);
+}
+
+/*
+ * For ENFORCE_READ_ONLY, make the pages of [startOffset, nextOffset)
+ * writable and count the new writer on each.
+ *
+ * We have to page-align the start address, but don't have to make the
+ * length a SYSTEM_PAGE_SIZE multiple (but we do it anyway).
+ *
+ * Note that "startOffset" is not the last *allocated* byte, but rather
+ * the offset of the first *unallocated* byte (which we are about to
+ * write the chunk header to).  "nextOffset" is similar.
+ *
+ * We have to call mprotect even if we've written to this page before,
+ * because it might be read-only.
+ */
+static void makePagesWritable(LinearAllocHdr* pHdr, int startOffset,
+    int nextOffset, size_t size)
+{
+    int firstWriteOff, lastWriteOff;
+    int cc, start, len;
+    int i, end;
+
+    dvmLockMutex(&pHdr->lock);
+
+    firstWriteOff = startOffset & ~(SYSTEM_PAGE_SIZE-1);
+    lastWriteOff = (nextOffset-1) & ~(SYSTEM_PAGE_SIZE-1);
+    LOGVV("---  firstWrite=0x%04x lastWrite=0x%04x",
+        firstWriteOff, lastWriteOff);
+
+    start = firstWriteOff;
+    assert(start <= nextOffset);
+    len = (lastWriteOff - firstWriteOff) + SYSTEM_PAGE_SIZE;
+
+    LOGVV("---    calling mprotect(start=%d len=%d RW)", start, len);
+    cc = mprotect(pHdr->mapAddr + start, len, PROT_READ | PROT_WRITE);
+    if (cc != 0) {
+        ALOGE("LinearAlloc mprotect (+%d %d) failed: %s",
+            start, len, strerror(errno));
+        /* we're going to fail soon, might as do it now */
+        dvmAbort();
+    }
+
+    /* update the ref counts on the now-writable pages */
+    start = firstWriteOff / SYSTEM_PAGE_SIZE;
+    end = lastWriteOff / SYSTEM_PAGE_SIZE;
+
+    LOGVV("---  marking pages %d-%d RW (alloc %d at %p)",
+        start, end, size, pHdr->mapAddr + startOffset + HEADER_EXTRA);
+    for (i = start; i <= end; i++)
+        pHdr->writeRefCount[i]++;
+
+    dvmUnlockMutex(&pHdr->lock);
+}
+
 /*
  * Allocate "size" bytes of storage, associated with a particular class
  * loader.
@@ -257,7 +343,9 @@ void dvmLinearAllocDestroy(Object* classLoader)
  * It's okay for size to be zero.
  *
  * We always leave "curOffset" pointing at the next place where we will
- * store the header that precedes the returned storage.
+ * store the header that precedes the returned storage.  Threads claim
+ * their storage without the lock; it's only taken when pages change
+ * protection.
  *
  * This aborts the VM on failure, so it's not necessary to check for a
  * NULL return value.
@@ -266,7 +354,6 @@ void* dvmLinearAlloc(Object* classLoader, size_t size)
 {
     LinearAllocHdr* pHdr = getHeader(classLoader);
     int startOffset, nextOffset;
-    int lastGoodOff, firstWriteOff, lastWriteOff;
 
 #ifdef DISABLE_LINEAR_ALLOC
     return calloc(1, size);
@@ -275,47 +362,50 @@ void* dvmLinearAlloc(Object* classLoader, size_t size)
     LOGVV("--- LinearAlloc(%p, %d)", classLoader, size);
 
     /*
-     * What we'd like to do is just determine the new end-of-alloc size
-     * and atomic-swap the updated value in.  The trouble is that, the
-     * first time we reach a new page, we need to call mprotect() to
-     * make the page available, and we don't want to call mprotect() on
-     * every allocation.  The troubled situation is:
+     * Claim the space by advancing "curOffset" with a CAS.  The trouble
+     * with that alone is that the first time we reach a new page, we
+     * need to call mprotect() to make the page available:
      *  - thread A allocs across a page boundary, but gets preempted
      *    before mprotect() completes
      *  - thread B allocs within the new page, and doesn't call mprotect()
+     * So pages are made accessible separately, under the lock, and
+     * "protOffset" only moves past them once they are.  Thread B sees
+     * that its space isn't accessible yet, and waits for A on the lock.
      */
-    dvmLockMutex(&pHdr->lock);
-
-    startOffset = pHdr->curOffset;
-    assert(((startOffset + HEADER_EXTRA) & (BLOCK_ALIGN-1)) == 0);
+    do {
+        startOffset = pHdr->curOffset;
+        assert(((startOffset + HEADER_EXTRA) & (BLOCK_ALIGN-1)) == 0);
 
-    /*
-     * Compute the new offset.  The old offset points at the address where
-     * we will store the hidden block header, so we advance past that,
-     * add the size of data they want, add another header's worth so we
-     * know we have room for that, and round up to BLOCK_ALIGN.  That's
-     * the next location where we'll put user data.  We then subtract the
-     * chunk header size off so we're back to the header pointer.
-     *
-     * Examples:
-     *   old=12 size=3 new=((12+(4*2)+3+7) & ~7)-4 = 24-4 --> 20
-     *   old=12 size=5 new=((12+(4*2)+5+7) & ~7)-4 = 32-4 --> 28
-     */
-    nextOffset = ((startOffset + HEADER_EXTRA*2 + size + (BLOCK_ALIGN-1))
-                    & ~(BLOCK_ALIGN-1)) - HEADER_EXTRA;
-    LOGVV("--- old=%d size=%d new=%d", startOffset, size, nextOffset);
-
-    if (nextOffset > pHdr->mapLength) {
         /*
-         * We don't have to abort here.  We could fall back on the system
-         * malloc(), and have our "free" call figure out what to do.  Only
-         * works if the users of these functions actually free everything
-         * they allocate.
+         * Compute the new offset.  The old offset points at the address
+         * where we will store the hidden block header, so we advance past
+         * that, add the size of data they want, add another header's
+         * worth so we know we have room for that, and round up to
+         * BLOCK_ALIGN.  That's the next location where we'll put user
+         * data.  We then subtract the chunk header size off so we're back
+         * to the header pointer.
+         *
+         * Examples:
+         *   old=12 size=3 new=((12+(4*2)+3+7) & ~7)-4 = 24-4 --> 20
+         *   old=12 size=5 new=((12+(4*2)+5+7) & ~7)-4 = 32-4 --> 28
          */
-        ALOGE("LinearAlloc exceeded capacity (%d), last=%d",
-            pHdr->mapLength, (int) size);
-        dvmAbort();
-    }
+        nextOffset = ((startOffset + HEADER_EXTRA*2 + size + (BLOCK_ALIGN-1))
+                        & ~(BLOCK_ALIGN-1)) - HEADER_EXTRA;
+        LOGVV("--- old=%d size=%d new=%d", startOffset, size, nextOffset);
+
+        if (nextOffset > pHdr->mapLength) {
+            /*
+             * We don't have to abort here.  We could fall back on the
+             * system malloc(), and have our "free" call figure out what
+             * to do.  Only works if the users of these functions actually
+             * free everything they allocate.
+             */
+            ALOGE("LinearAlloc exceeded capacity (%d), last=%d",
+                pHdr->mapLength, (int) size);
+            dvmAbort();
+        }
+    } while (android_atomic_release_cas(startOffset, nextOffset,
+                &pHdr->curOffset) != 0);
 
     /*
      * Round up "size" to encompass the entire region, including the 0-7
@@ -326,52 +416,10 @@ void* dvmLinearAlloc(Object* classLoader, size_t size)
     size = nextOffset - (startOffset + HEADER_EXTRA);
     LOGVV("--- (size now %d)", size);
 
-    /*
-     * See if we are starting on or have crossed into a new page.  If so,
-     * call mprotect on the page(s) we're about to write to.  We have to
-     * page-align the start address, but don't have to make the length a
-     * SYSTEM_PAGE_SIZE multiple (but we do it anyway).
-     *
-     * Note that "startOffset" is not the last *allocated* byte, but rather
-     * the offset of the first *unallocated* byte (which we are about to
-     * write the chunk header to).  "nextOffset" is similar.
-     *
-     * If ENFORCE_READ_ONLY is enabled, we have to call mprotect even if
-     * we've written to this page before, because it might be read-only.
-     */
-    lastGoodOff = (startOffset-1) & ~(SYSTEM_PAGE_SIZE-1);
-    firstWriteOff = startOffset & ~(SYSTEM_PAGE_SIZE-1);
-    lastWriteOff = (nextOffset-1) & ~(SYSTEM_PAGE_SIZE-1);
-    LOGVV("---  lastGood=0x%04x firstWrite=0x%04x lastWrite=0x%04x",
-        lastGoodOff, firstWriteOff, lastWriteOff);
-    if (lastGoodOff != lastWriteOff || ENFORCE_READ_ONLY) {
-        int cc, start, len;
-
-        start = firstWriteOff;
-        assert(start <= nextOffset);
-        len = (lastWriteOff - firstWriteOff) + SYSTEM_PAGE_SIZE;
-
-        LOGVV("---    calling mprotect(start=%d len=%d RW)", start, len);
-        cc = mprotect(pHdr->mapAddr + start, len, PROT_READ | PROT_WRITE);
-        if (cc != 0) {
-            ALOGE("LinearAlloc mprotect (+%d %d) failed: %s",
-                start, len, strerror(errno));
-            /* we're going to fail soon, might as do it now */
-            dvmAbort();
-        }
-    }
-
-    /* update the ref counts on the now-writable pages */
     if (ENFORCE_READ_ONLY) {
-        int i, start, end;
-
-        start = firstWriteOff / SYSTEM_PAGE_SIZE;
-        end = lastWriteOff / SYSTEM_PAGE_SIZE;
-
-        LOGVV("---  marking pages %d-%d RW (alloc %d at %p)",
-            start, end, size, pHdr->mapAddr + startOffset + HEADER_EXTRA);
-        for (i = start; i <= end; i++)
-            pHdr->writeRefCount[i]++;
+        makePagesWritable(pHdr, startOffset, nextOffset, size);
+    } else if (nextOffset > android_atomic_acquire_load(&pHdr->protOffset)) {
+        extendAccessible(pHdr, nextOffset);
     }
 
     /* stow the size in the header */
@@ -380,12 +428,6 @@ void* dvmLinearAlloc(Object* classLoader, size_t size)
     else
         *(u4*)(pHdr->mapAddr + startOffset) = size;
 
-    /*
-     * Update data structure.
-     */
-    pHdr->curOffset = nextOffset;
-
-    dvmUnlockMutex(&pHdr->lock);
     return pHdr->mapAddr + startOffset + HEADER_EXTRA;
 }
 
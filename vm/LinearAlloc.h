@@ -31,8 +31,9 @@
  * that first page.
  */
 struct LinearAllocHdr {
-    int     curOffset;          /* offset where next data goes */
-    pthread_mutex_t lock;       /* controls updates to this struct */
+    int     curOffset;          /* offset where next data goes; CAS only */
+    int     protOffset;         /* offset where inaccessible pages start */
+    pthread_mutex_t lock;       /* controls protection changes */
 
     char*   mapAddr;            /* start of mmap()ed region */
     int     mapLength;          /* length of region */
@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Monitor contention profiling.
+ *
+ * Every time a thread has to wait for a monitor, the wait is charged to
+ * an entry keyed on the class of the locked object and the top few
+ * frames of the waiting thread.  Entries keep the number of waits and
+ * the total and longest wait time, so the locks that actually cost
+ * throughput stand out from ones that are merely contended often.
+ *
+ * Waits are only recorded on the contended path, which already blocks,
+ * so the profiler is cheap enough to leave on.  It is enabled with
+ * -Xlockprofile or through DDM, and its data is printed with the thread
+ * dump on SIGQUIT.
+ */
+#include "Dalvik.h"
+
+#include <stdlib.h>
+
+/* number of frames of the waiting stack kept per entry */
+#define kMaxLockProfileStackDepth   4
+
+/* number of entries in the table; must be a power of 2 */
+#define kNumLockProfileEntries      512
+
+/* number of entries printed by dvmDumpLockProfile() */
+#define kNumLockProfileDumpEntries  20
+
+struct LockProfileEntry {
+    const ClassObject* lockClass;   /* NULL if the entry is unused */
+    struct {
+        const Method* method;       /* NULL past the end of the stack */
+        int         pc;             /* current execution offset */
+    } stackElem[kMaxLockProfileStackDepth];
+
+    u4          waitCount;
+    u4          maxWaitUsec;
+    u8          totalWaitUsec;
+};
+
+/*
+ * Initialize a few things.  This gets called early, so keep activity to
+ * a minimum.
+ */
+bool dvmLockProfilerStartup()
+{
+    dvmInitMutex(&gDvm.lockProfileLock);
+
+    if (gDvm.lockProfileAtStartup)
+        return dvmEnableLockProfiler();
+    return true;
+}
+
+/*
+ * Release anything we're holding on to.
+ */
+void dvmLockProfilerShutdown()
+{
+    free(gDvm.lockProfile);
+    gDvm.lockProfile = NULL;
+    dvmDestroyMutex(&gDvm.lockProfileLock);
+}
+
+/*
+ * Enable contention profiling, discarding anything collected before.
+ *
+ * Returns "true" on success.
+ */
+bool dvmEnableLockProfiler()
+{
+    bool result = true;
+    dvmLockMutex(&gDvm.lockProfileLock);
+
+    if (gDvm.lockProfile == NULL) {
+        gDvm.lockProfile = (LockProfileEntry*)
+            malloc(sizeof(LockProfileEntry) * kNumLockProfileEntries);
+        if (gDvm.lockProfile == NULL)
+            result = false;
+    }
+    if (gDvm.lockProfile != NULL) {
+        memset(gDvm.lockProfile, 0,
+            sizeof(LockProfileEntry) * kNumLockProfileEntries);
+        gDvm.lockProfileDropped = 0;
+    }
+
+    dvmUnlockMutex(&gDvm.lockProfileLock);
+    return result;
+}
+
+/*
+ * Disable contention profiling.  Does nothing if it is not enabled.
+ */
+void dvmDisableLockProfiler()
+{
+    dvmLockMutex(&gDvm.lockProfileLock);
+
+    free(gDvm.lockProfile);
+    gDvm.lockProfile = NULL;
+
+    dvmUnlockMutex(&gDvm.lockProfileLock);
+}
+
+/*
+ * Get the top few frames of the waiting thread.
+ */
+static void getStackFrames(Thread* self, LockProfileEntry* pKey)
+{
+    int stackDepth = 0;
+    void* fp = self->interpSave.curFrame;
+
+    while (fp != NULL && stackDepth < kMaxLockProfileStackDepth) {
+        const StackSaveArea* saveArea = SAVEAREA_FROM_FP(fp);
+        const Method* method = saveArea->method;
+
+        if (!dvmIsBreakFrame((u4*) fp)) {
+            pKey->stackElem[stackDepth].method = method;
+            if (dvmIsNativeMethod(method)) {
+                pKey->stackElem[stackDepth].pc = 0;
+            } else {
+                pKey->stackElem[stackDepth].pc =
+                    (int) (saveArea->xtra.currentPc - method->insns);
+            }
+            stackDepth++;
+        }
+        fp = saveArea->prevFrame;
+    }
+}
+
+static u4 hashKey(const LockProfileEntry* pKey)
+{
+    u4 hash = (u4) pKey->lockClass >> 3;
+
+    for (int i = 0; i < kMaxLockProfileStackDepth; i++) {
+        hash = hash * 31 + ((u4) pKey->stackElem[i].method >> 2);
+        hash = hash * 31 + pKey->stackElem[i].pc;
+    }
+    return hash;
+}
+
+static bool sameKey(const LockProfileEntry* a, const LockProfileEntry* b)
+{
+    if (a->lockClass != b->lockClass)
+        return false;
+    for (int i = 0; i < kMaxLockProfileStackDepth; i++) {
+        if (a->stackElem[i].method != b->stackElem[i].method ||
+            a->stackElem[i].pc != b->stackElem[i].pc)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Charge a wait to the entry for this lock class and stack, adding the
+ * entry if needed.  Waits that don't fit in a full table are counted as
+ * dropped.
+ */
+void dvmDoProfileLockContention(Thread* self, const Object* obj, u8 waitUsec)
+{
+    LockProfileEntry key;
+
+    assert(self != NULL);
+    assert(obj != NULL);
+    memset(&key, 0, sizeof(key));
+    key.lockClass = obj->clazz;
+    getStackFrames(self, &key);
+    u4 hash = hashKey(&key);
+
+    dvmLockMutex(&gDvm.lockProfileLock);
+    if (gDvm.lockProfile == NULL) {
+        dvmUnlockMutex(&gDvm.lockProfileLock);
+        return;
+    }
+
+    LockProfileEntry* pEntry = NULL;
+    for (int probe = 0; probe < kNumLockProfileEntries; probe++) {
+        LockProfileEntry* pSlot =
+            &gDvm.lockProfile[(hash + probe) & (kNumLockProfileEntries - 1)];
+        if (pSlot->lockClass == NULL) {
+            *pSlot = key;
+            pEntry = pSlot;
+            break;
+        }
+        if (sameKey(pSlot, &key)) {
+            pEntry = pSlot;
+            break;
+        }
+    }
+
+    if (pEntry != NULL) {
+        pEntry->waitCount++;
+        pEntry->totalWaitUsec += waitUsec;
+        if (waitUsec > pEntry->maxWaitUsec)
+            pEntry->maxWaitUsec = (u4) waitUsec;
+    } else {
+        gDvm.lockProfileDropped++;
+    }
+    dvmUnlockMutex(&gDvm.lockProfileLock);
+}
+
+/*
+ * Sort entries by total wait time, longest first.
+ */
+static int compareEntries(const void* vp1, const void* vp2)
+{
+    const LockProfileEntry* p1 = *(const LockProfileEntry**) vp1;
+    const LockProfileEntry* p2 = *(const LockProfileEntry**) vp2;
+
+    if (p1->totalWaitUsec != p2->totalWaitUsec)
+        return (p1->totalWaitUsec < p2->totalWaitUsec) ? 1 : -1;
+    return 0;
+}
+
+/*
+ * Fill "sorted" with pointers to the used entries, worst first.  Returns
+ * the number of used entries.  Caller must hold lockProfileLock.
+ */
+static int sortEntries(LockProfileEntry** sorted)
+{
+    int count = 0;
+
+    for (int i = 0; i < kNumLockProfileEntries; i++) {
+        if (gDvm.lockProfile[i].lockClass != NULL)
+            sorted[count++] = &gDvm.lockProfile[i];
+    }
+    qsort(sorted, count, sizeof(*sorted), compareEntries);
+    return count;
+}
+
+/*
+ * Print the most contended locks, worst first.
+ */
+void dvmDumpLockProfile(const DebugOutputTarget* target)
+{
+    LockProfileEntry* sorted[kNumLockProfileEntries];
+
+    dvmLockMutex(&gDvm.lockProfileLock);
+    if (gDvm.lockProfile == NULL) {
+        dvmUnlockMutex(&gDvm.lockProfileLock);
+        return;
+    }
+
+    int count = sortEntries(sorted);
+    dvmPrintDebugMessage(target,
+        "LOCK CONTENTION: (%d sites, %u waits dropped)\n",
+        count, gDvm.lockProfileDropped);
+    if (count > kNumLockProfileDumpEntries)
+        count = kNumLockProfileDumpEntries;
+
+    for (int i = 0; i < count; i++) {
+        const LockProfileEntry* pEntry = sorted[i];
+
+        dvmPrintDebugMessage(target,
+            "  %llums total, %u waits, %ums max: %s\n",
+            pEntry->totalWaitUsec / 1000, pEntry->waitCount,
+            pEntry->maxWaitUsec / 1000, pEntry->lockClass->descriptor);
+        for (int j = 0; j < kMaxLockProfileStackDepth; j++) {
+            const Method* method = pEntry->stackElem[j].method;
+            if (method == NULL)
+                break;
+            const char* fileName = dvmGetMethodSourceFile(method);
+            dvmPrintDebugMessage(target, "    at %s.%s(%s:%d)\n",
+                method->clazz->descriptor, method->name,
+                fileName != NULL ? fileName : "unknown",
+                dvmIsNativeMethod(method) ? -2 :
+                    dvmLineNumFromPC(method, pEntry->stackElem[j].pc));
+        }
+    }
+    dvmPrintDebugMessage(target, "\n");
+
+    dvmUnlockMutex(&gDvm.lockProfileLock);
+}
+
+/*
+ * Store a string as a 2-byte big-endian length followed by its
+ * modified UTF-8 bytes.  Returns the number of bytes used.  With a NULL
+ * "buf", just computes the length.
+ */
+static size_t putString(u1* buf, const char* str)
+{
+    size_t len = strlen(str);
+
+    if (len > 0xffff)
+        len = 0xffff;
+    if (buf != NULL) {
+        set2BE(buf, len);
+        memcpy(buf + 2, str, len);
+    }
+    return 2 + len;
+}
+
+/*
+ * Write one entry to "buf", or just compute its size if "buf" is NULL.
+ * See dvmDdmGenerateLockStats() for the layout.
+ */
+static size_t putEntry(u1* buf, const LockProfileEntry* pEntry)
+{
+    size_t len = 0;
+    int depth = 0;
+
+    while (depth < kMaxLockProfileStackDepth &&
+           pEntry->stackElem[depth].method != NULL)
+    {
+        depth++;
+    }
+
+    if (buf != NULL) {
+        set4BE(buf + 0, pEntry->waitCount);
+        set8BE(buf + 4, pEntry->totalWaitUsec);
+        set4BE(buf + 12, pEntry->maxWaitUsec);
+        set1(buf + 16, depth);
+    }
+    len += 17;
+
+    len += putString(buf != NULL ? buf + len : NULL,
+        pEntry->lockClass->descriptor);
+    for (int i = 0; i < depth; i++) {
+        const Method* method = pEntry->stackElem[i].method;
+        int lineNum = dvmIsNativeMethod(method) ? -2 :
+            dvmLineNumFromPC(method, pEntry->stackElem[i].pc);
+
+        len += putString(buf != NULL ? buf + len : NULL,
+            method->clazz->descriptor);
+        len += putString(buf != NULL ? buf + len : NULL, method->name);
+        if (buf != NULL)
+            set4BE(buf + len, lineNum);
+        len += 4;
+    }
+    return len;
+}
+
+/*
+ * Generate the contents of a LOCK chunk, the collected contention data.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) maximum stack depth
+ *  (2b) number of entries
+ *  (4b) waits dropped because the table was full
+ * Then, per entry, worst first:
+ *  (4b) number of waits
+ *  (8b) total wait time, in usec
+ *  (4b) longest wait, in usec
+ *  (1b) stack depth
+ *  (str) class descriptor of the locked object
+ *  per frame, innermost first:
+ *    (str) class descriptor
+ *    (str) method name
+ *    (4b) line number, -1 if unknown or -2 for native methods
+ *
+ * Strings are a 2-byte length followed by modified UTF-8.
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure or if
+ * profiling is disabled.  The caller must call dvmReleaseTrackedAlloc()
+ * on the array.
+ */
+ArrayObject* dvmDdmGenerateLockStats()
+{
+    const int kHeaderLen = 8;
+    LockProfileEntry* sorted[kNumLockProfileEntries];
+
+    /*
+     * Build the data in a native buffer, since allocating on the managed
+     * heap can wait for a GC, which in turn waits for threads that may be
+     * blocked on lockProfileLock.
+     */
+    dvmLockMutex(&gDvm.lockProfileLock);
+    if (gDvm.lockProfile == NULL) {
+        dvmUnlockMutex(&gDvm.lockProfileLock);
+        return NULL;
+    }
+
+    int count = sortEntries(sorted);
+    size_t bufLen = kHeaderLen;
+    for (int i = 0; i < count; i++)
+        bufLen += putEntry(NULL, sorted[i]);
+
+    u1* data = (u1*) malloc(bufLen);
+    if (data == NULL) {
+        dvmUnlockMutex(&gDvm.lockProfileLock);
+        return NULL;
+    }
+    u1* buf = data;
+    set1(buf+0, kHeaderLen);
+    set1(buf+1, kMaxLockProfileStackDepth);
+    set2BE(buf+2, count);
+    set4BE(buf+4, gDvm.lockProfileDropped);
+    buf += kHeaderLen;
+    for (int i = 0; i < count; i++)
+        buf += putEntry(buf, sorted[i]);
+    dvmUnlockMutex(&gDvm.lockProfileLock);
+
+    ArrayObject* arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj != NULL)
+        memcpy(arrayObj->contents, data, bufLen);
+    free(data);
+    return arrayObj;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Monitor contention profiling.
+ */
+#ifndef DALVIK_LOCKPROFILER_H_
+#define DALVIK_LOCKPROFILER_H_
+
+/* initialization */
+bool dvmLockProfilerStartup(void);
+void dvmLockProfilerShutdown(void);
+
+struct LockProfileEntry;
+struct DebugOutputTarget;
+
+/*
+ * Enable contention profiling, discarding anything collected before.
+ */
+bool dvmEnableLockProfiler(void);
+
+/*
+ * Disable contention profiling.  Does nothing if it is not enabled.
+ */
+void dvmDisableLockProfiler(void);
+
+/*
+ * If contention profiling is enabled, charge a wait of "waitUsec" for the
+ * lock of "obj" to the current stack of "self".
+ */
+#define dvmProfileLockContention(_self, _obj, _waitUsec)                    \
+    {                                                                       \
+        if (gDvm.lockProfile != NULL)                                       \
+            dvmDoProfileLockContention(_self, _obj, _waitUsec);             \
+    }
+void dvmDoProfileLockContention(Thread* self, const Object* obj, u8 waitUsec);
+
+/*
+ * Print the most contended locks, worst first.  Prints nothing if
+ * profiling is disabled.
+ */
+void dvmDumpLockProfile(const DebugOutputTarget* target);
+
+/*
+ * Generate a byte[] with the collected contention data for DDM, or NULL
+ * if profiling is disabled.  The caller must call dvmReleaseTrackedAlloc()
+ * on the array.
+ */
+ArrayObject* dvmDdmGenerateLockStats(void);
+
+#endif  // DALVIK_LOCKPROFILER_H_
@@ -25,9 +25,18 @@
 
 #include <stdlib.h>
 #include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct SharedLib;
 
 static void freeSharedLibEntry(void* ptr);
 static void* lookupSharedLibMethod(const Method* method);
+static HashTable* readJniSymbols(const char* pathName, void* handle);
+static void bindLibraryNatives(const SharedLib* pLib);
 
 
 /*
@@ -156,6 +165,8 @@ struct SharedLib {
     pthread_cond_t  onLoadCond;     /* wait for JNI_OnLoad in other thread */
     u4              onLoadThreadId; /* recursive invocation guard */
     OnLoadState     onLoadResult;   /* result of earlier JNI_OnLoad */
+
+    HashTable*      jniSymbols;     /* exported Java_* symbols, or NULL */
 };
 
 /*
@@ -234,6 +245,7 @@ static void freeSharedLibEntry(void* ptr)
      */
     if (false)
         dlclose(pLib->handle);
+    dvmHashTableFree(pLib->jniSymbols);
     free(pLib->pathName);
     free(pLib);
 }
@@ -394,6 +406,7 @@ bool dvmLoadNativeCode(const char* pathName, Object* classLoader,
     pNewEntry = (SharedLib*) calloc(1, sizeof(SharedLib));
     pNewEntry->pathName = strdup(pathName);
     pNewEntry->handle = handle;
+    pNewEntry->jniSymbols = readJniSymbols(pathName, handle);
     pNewEntry->classLoader = classLoader;
     dvmInitMutex(&pNewEntry->onLoadLock);
     pthread_cond_init(&pNewEntry->onLoadCond, NULL);
@@ -460,6 +473,9 @@ bool dvmLoadNativeCode(const char* pathName, Object* classLoader,
             }
         }
 
+        if (result && gDvm.jniEagerBind)
+            bindLibraryNatives(pNewEntry);
+
         if (result)
             pNewEntry->onLoadResult = kOnLoadOkay;
         else
@@ -529,6 +545,7 @@ static void unregisterJNINativeMethods(Method* methods, size_t count)
 
         ALOGD("Unregistering JNI method %s.%s:%s",
             meth->clazz->descriptor, meth->name, meth->shorty);
+        meth->fastJni = false;
         dvmSetNativeFunc(meth, dvmResolveNativeMethod, NULL);
     }
 }
@@ -678,6 +695,292 @@ static char* createMangledSignature(const DexProto* proto)
     return result;
 }
 
+/*
+ * The two names a JNI implementation of a method may be exported under,
+ * with their hashes.  The long name adds the mangled argument types.
+ */
+struct JniNames {
+    char*   shortName;
+    u4      shortHash;
+    char*   longName;
+    u4      longHash;
+};
+
+static void freeJniNames(JniNames* pNames)
+{
+    free(pNames->shortName);
+    free(pNames->longName);
+}
+
+/*
+ * Fill out "*pNames" for "meth".  Returns false if we run out of memory.
+ */
+static bool createJniNames(const Method* meth, JniNames* pNames)
+{
+    char* preMangleCM;
+    char* mangleSig;
+    int len;
+
+    memset(pNames, 0, sizeof(*pNames));
+
+    preMangleCM =
+        createJniNameString(meth->clazz->descriptor, meth->name, &len);
+    if (preMangleCM == NULL)
+        return false;
+    pNames->shortName = mangleString(preMangleCM, len);
+    free(preMangleCM);
+
+    mangleSig = createMangledSignature(&meth->prototype);
+    if (pNames->shortName != NULL && mangleSig != NULL) {
+        pNames->longName = (char*) malloc(strlen(pNames->shortName) +
+            strlen(mangleSig) +3);
+        if (pNames->longName != NULL)
+            sprintf(pNames->longName, "%s__%s", pNames->shortName, mangleSig);
+    }
+    free(mangleSig);
+
+    if (pNames->longName == NULL) {
+        freeJniNames(pNames);
+        return false;
+    }
+    pNames->shortHash = dvmComputeUtf8Hash(pNames->shortName);
+    pNames->longHash = dvmComputeUtf8Hash(pNames->longName);
+    return true;
+}
+
+
+/*
+ * ===========================================================================
+ *      Exported symbol index
+ * ===========================================================================
+ */
+
+/*
+ * The JNI functions a library exports, read from its dynamic symbol table
+ * when it is loaded.  Looking a name up here is a hash probe, where
+ * dlsym() would walk the linker's tables of every library.  The index
+ * only holds the library's own definitions; unlike dlsym() on some
+ * platforms it does not search the library's dependencies.
+ */
+struct JniSymbol {
+    char*   name;
+    void*   func;
+};
+
+#if defined(__LP64__)
+typedef Elf64_Ehdr ElfEhdr;
+typedef Elf64_Shdr ElfShdr;
+typedef Elf64_Sym ElfSym;
+#define ELF_CLASS_NATIVE ELFCLASS64
+#define ELF_SYM_BIND(info) ELF64_ST_BIND(info)
+#define ELF_SYM_TYPE(info) ELF64_ST_TYPE(info)
+#else
+typedef Elf32_Ehdr ElfEhdr;
+typedef Elf32_Shdr ElfShdr;
+typedef Elf32_Sym ElfSym;
+#define ELF_CLASS_NATIVE ELFCLASS32
+#define ELF_SYM_BIND(info) ELF32_ST_BIND(info)
+#define ELF_SYM_TYPE(info) ELF32_ST_TYPE(info)
+#endif
+
+/*
+ * Free up an entry.  (This is a dvmHashTableFree callback.)
+ */
+static void freeJniSymbol(void* ptr)
+{
+    JniSymbol* pSym = (JniSymbol*) ptr;
+
+    free(pSym->name);
+    free(pSym);
+}
+
+/*
+ * (This is a dvmHashTableLookup callback.)
+ *
+ * Find an entry that matches the string.
+ */
+static int hashcmpJniSymbolName(const void* ventry, const void* vname)
+{
+    const JniSymbol* pSym = (const JniSymbol*) ventry;
+
+    return strcmp(pSym->name, (const char*) vname);
+}
+
+/*
+ * (This is a dvmHashTableLookup callback.)
+ *
+ * Find an entry that matches the new entry.
+ */
+static int hashcmpJniSymbol(const void* ventry, const void* vnewEntry)
+{
+    const JniSymbol* pSym = (const JniSymbol*) ventry;
+    const JniSymbol* pNewSym = (const JniSymbol*) vnewEntry;
+
+    return strcmp(pSym->name, pNewSym->name);
+}
+
+/*
+ * Returns true if the "size" bytes at "offset" lie within a file of
+ * "len" bytes.
+ */
+static bool inFile(size_t len, size_t offset, size_t size)
+{
+    return offset <= len && size <= len - offset;
+}
+
+/*
+ * Build the index from the mapped ELF file at "base".  Returns NULL if
+ * the file doesn't look like a library we can read.
+ */
+static HashTable* indexJniSymbols(const u1* base, size_t len, void* handle)
+{
+    const ElfEhdr* pHdr = (const ElfEhdr*) base;
+    if (memcmp(pHdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        pHdr->e_ident[EI_CLASS] != ELF_CLASS_NATIVE ||
+        pHdr->e_shentsize != sizeof(ElfShdr) ||
+        !inFile(len, pHdr->e_shoff, pHdr->e_shnum * sizeof(ElfShdr)))
+    {
+        return NULL;
+    }
+
+    const ElfShdr* pSections = (const ElfShdr*) (base + pHdr->e_shoff);
+    const ElfShdr* pDynSym = NULL;
+    for (int i = 0; i < pHdr->e_shnum; i++) {
+        if (pSections[i].sh_type == SHT_DYNSYM) {
+            pDynSym = &pSections[i];
+            break;
+        }
+    }
+    if (pDynSym == NULL || pDynSym->sh_entsize != sizeof(ElfSym) ||
+        pDynSym->sh_link >= pHdr->e_shnum ||
+        !inFile(len, pDynSym->sh_offset, pDynSym->sh_size))
+    {
+        return NULL;
+    }
+    const ElfShdr* pDynStr = &pSections[pDynSym->sh_link];
+    if (!inFile(len, pDynStr->sh_offset, pDynStr->sh_size))
+        return NULL;
+
+    const ElfSym* pSyms = (const ElfSym*) (base + pDynSym->sh_offset);
+    size_t numSyms = pDynSym->sh_size / sizeof(ElfSym);
+    const char* strings = (const char*) (base + pDynStr->sh_offset);
+    size_t stringsLen = pDynStr->sh_size;
+
+    HashTable* pTable = dvmHashTableCreate(16, freeJniSymbol);
+    if (pTable == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < numSyms; i++) {
+        const ElfSym* pSym = &pSyms[i];
+        int bind = ELF_SYM_BIND(pSym->st_info);
+        if (pSym->st_shndx == SHN_UNDEF ||
+            ELF_SYM_TYPE(pSym->st_info) != STT_FUNC ||
+            (bind != STB_GLOBAL && bind != STB_WEAK) ||
+            pSym->st_name >= stringsLen)
+        {
+            continue;
+        }
+        const char* name = strings + pSym->st_name;
+        if (memchr(name, '\0', stringsLen - pSym->st_name) == NULL ||
+            strncmp(name, "Java_", 5) != 0)
+        {
+            continue;
+        }
+
+        /* let the linker apply the load bias (and any symbol versioning) */
+        void* func = dlsym(handle, name);
+        if (func == NULL)
+            continue;
+
+        JniSymbol* pNewSym = (JniSymbol*) malloc(sizeof(JniSymbol));
+        if (pNewSym == NULL)
+            break;
+        pNewSym->name = strdup(name);
+        pNewSym->func = func;
+        if (pNewSym->name == NULL) {
+            free(pNewSym);
+            break;
+        }
+        void* pActual = dvmHashTableLookup(pTable,
+                dvmComputeUtf8Hash(name), pNewSym, hashcmpJniSymbol, true);
+        if (pActual != pNewSym)
+            freeJniSymbol(pNewSym);
+    }
+
+    return pTable;
+}
+
+/*
+ * Read the exported Java_* symbols of the library at "pathName", which
+ * has been opened as "handle".  Returns NULL if the file can't be read,
+ * in which case lookups in the library fall back to dlsym().
+ */
+static HashTable* readJniSymbols(const char* pathName, void* handle)
+{
+    int fd = open(pathName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(ElfEhdr))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        ALOGV("+++ can't map '%s' to index its symbols", pathName);
+        return NULL;
+    }
+
+    HashTable* pTable = indexJniSymbols((const u1*) map, st.st_size, handle);
+    munmap(map, st.st_size);
+
+    if (pTable != NULL && gDvm.verboseJni) {
+        ALOGI("[Indexed %d JNI symbols in \"%s\"]",
+            dvmHashTableNumEntries(pTable), pathName);
+    }
+    return pTable;
+}
+
+/*
+ * Look up one of the names of a method in a library.
+ */
+static void* findSymbolInLib(const SharedLib* pLib, const char* name, u4 hash)
+{
+    if (pLib->jniSymbols == NULL) {
+        ALOGV("+++ calling dlsym(%s)", name);
+        return dlsym(pLib->handle, name);
+    }
+
+    const JniSymbol* pSym = (const JniSymbol*) dvmHashTableLookup(
+            pLib->jniSymbols, hash, (void*) name, hashcmpJniSymbolName, false);
+    return (pSym != NULL) ? pSym->func : NULL;
+}
+
+/*
+ * Look for both names of a method in a library.  The short name wins.
+ */
+static void* findNamesInLib(const SharedLib* pLib, const JniNames* pNames)
+{
+    void* func = findSymbolInLib(pLib, pNames->shortName, pNames->shortHash);
+    if (func == NULL)
+        func = findSymbolInLib(pLib, pNames->longName, pNames->longHash);
+    if (func != NULL)
+        ALOGV("Found '%s' in '%s'", pNames->shortName, pLib->pathName);
+    return func;
+}
+
+
+/*
+ * ===========================================================================
+ *      Method lookup
+ * ===========================================================================
+ */
+
+struct FindMethodArgs {
+    const Method*   method;
+    const JniNames* names;
+};
+
 /*
  * (This is a dvmHashForeach callback.)
  *
@@ -685,16 +988,11 @@ static char* createMangledSignature(const DexProto* proto)
  *
  * TODO: we may want to skip libraries for which JNI_OnLoad failed.
  */
-static int findMethodInLib(void* vlib, void* vmethod)
+static int findMethodInLib(void* vlib, void* varg)
 {
     const SharedLib* pLib = (const SharedLib*) vlib;
-    const Method* meth = (const Method*) vmethod;
-    char* preMangleCM = NULL;
-    char* mangleCM = NULL;
-    char* mangleSig = NULL;
-    char* mangleCMSig = NULL;
-    void* func = NULL;
-    int len;
+    const FindMethodArgs* pArgs = (const FindMethodArgs*) varg;
+    const Method* meth = pArgs->method;
 
     if (meth->clazz->classLoader != pLib->classLoader) {
         ALOGV("+++ not scanning '%s' for '%s' (wrong CL)",
@@ -703,60 +1001,118 @@ static int findMethodInLib(void* vlib, void* vmethod)
     } else
         ALOGV("+++ scanning '%s' for '%s'", pLib->pathName, meth->name);
 
-    /*
-     * First, we try it without the signature.
-     */
-    preMangleCM =
-        createJniNameString(meth->clazz->descriptor, meth->name, &len);
-    if (preMangleCM == NULL)
-        goto bail;
+    return (int) findNamesInLib(pLib, pArgs->names);
+}
+
+/*
+ * See if the requested method lives in any of the currently-loaded
+ * shared libraries.  We do this by checking each of them for the expected
+ * method signature.  The names are mangled once, not once per library.
+ */
+static void* lookupSharedLibMethod(const Method* method)
+{
+    if (gDvm.nativeLibs == NULL) {
+        ALOGE("Unexpected init state: nativeLibs not ready");
+        dvmAbort();
+    }
 
-    mangleCM = mangleString(preMangleCM, len);
-    if (mangleCM == NULL)
-        goto bail;
+    JniNames names;
+    if (!createJniNames(method, &names))
+        return NULL;
 
-    ALOGV("+++ calling dlsym(%s)", mangleCM);
-    func = dlsym(pLib->handle, mangleCM);
-    if (func == NULL) {
-        mangleSig =
-            createMangledSignature(&meth->prototype);
-        if (mangleSig == NULL)
-            goto bail;
+    FindMethodArgs args = { method, &names };
+    void* func = (void*) dvmHashForeach(gDvm.nativeLibs, findMethodInLib,
+        (void*) &args);
+    freeJniNames(&names);
+    return func;
+}
 
-        mangleCMSig = (char*) malloc(strlen(mangleCM) + strlen(mangleSig) +3);
-        if (mangleCMSig == NULL)
-            goto bail;
+/*
+ * Bind the not-yet-resolved JNI methods in "methods" that "pLib"
+ * implements.  Returns the number bound.
+ */
+static int bindNativeMethods(const SharedLib* pLib, Method* methods,
+    size_t count)
+{
+    int numBound = 0;
 
-        sprintf(mangleCMSig, "%s__%s", mangleCM, mangleSig);
+    for (size_t i = 0; i < count; i++) {
+        Method* meth = &methods[i];
+        if (!dvmIsNativeMethod(meth) || dvmIsAbstractMethod(meth))
+            continue;
+        if (meth->nativeFunc != dvmResolveNativeMethod)
+            continue;       /* registered, or already resolved */
+
+        /*
+         * A static method can be called before its class is initialized;
+         * dvmResolveNativeMethod takes care of that, so leave it those.
+         * Internal natives are resolved there too, and take precedence.
+         */
+        if (dvmIsStaticMethod(meth) && !dvmIsClassInitialized(meth->clazz))
+            continue;
+        if (dvmLookupInternalNativeMethod(meth) != NULL)
+            continue;
+
+        JniNames names;
+        if (!createJniNames(meth, &names))
+            continue;
+        void* func = findNamesInLib(pLib, &names);
+        freeJniNames(&names);
 
-        ALOGV("+++ calling dlsym(%s)", mangleCMSig);
-        func = dlsym(pLib->handle, mangleCMSig);
         if (func != NULL) {
-            ALOGV("Found '%s' with dlsym", mangleCMSig);
+            dvmUseJNIBridge(meth, func);
+            numBound++;
         }
-    } else {
-        ALOGV("Found '%s' with dlsym", mangleCM);
     }
+    return numBound;
+}
 
-bail:
-    free(preMangleCM);
-    free(mangleCM);
-    free(mangleSig);
-    free(mangleCMSig);
-    return (int) func;
+struct BindArgs {
+    const SharedLib*    pLib;
+    int                 numBound;
+};
+
+/*
+ * (This is a dvmHashForeach callback.)
+ */
+static int bindClassNatives(void* vclazz, void* varg)
+{
+    ClassObject* clazz = (ClassObject*) vclazz;
+    BindArgs* pArgs = (BindArgs*) varg;
+
+    if (clazz->classLoader != pArgs->pLib->classLoader ||
+        !dvmIsClassLinked(clazz))
+    {
+        return 0;
+    }
+    pArgs->numBound += bindNativeMethods(pArgs->pLib, clazz->directMethods,
+        clazz->directMethodCount);
+    pArgs->numBound += bindNativeMethods(pArgs->pLib, clazz->virtualMethods,
+        clazz->virtualMethodCount);
+    return 0;
 }
 
 /*
- * See if the requested method lives in any of the currently-loaded
- * shared libraries.  We do this by checking each of them for the expected
- * method signature.
+ * With -Xjnibind:eager, bind the JNI methods of every loaded class of the
+ * library's class loader in one pass over the library's symbol index,
+ * instead of looking each up on its first call.  Classes loaded later
+ * still resolve lazily.
  */
-static void* lookupSharedLibMethod(const Method* method)
+static void bindLibraryNatives(const SharedLib* pLib)
 {
-    if (gDvm.nativeLibs == NULL) {
-        ALOGE("Unexpected init state: nativeLibs not ready");
-        dvmAbort();
+    if (pLib->jniSymbols == NULL ||
+        dvmHashTableNumEntries(pLib->jniSymbols) == 0)
+    {
+        return;
+    }
+
+    BindArgs args = { pLib, 0 };
+    dvmHashTableLock(gDvm.loadedClasses);
+    dvmHashForeach(gDvm.loadedClasses, bindClassNatives, &args);
+    dvmHashTableUnlock(gDvm.loadedClasses);
+
+    if (gDvm.verboseJni) {
+        ALOGI("[Bound %d of %d JNI symbols in \"%s\"]", args.numBound,
+            dvmHashTableNumEntries(pLib->jniSymbols), pLib->pathName);
     }
-    return (void*) dvmHashForeach(gDvm.nativeLibs, findMethodInLib,
-        (void*) method);
 }
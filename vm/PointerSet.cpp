@@ -15,16 +15,35 @@
  */
 /*
  * Maintain an expanding set of unique pointer values.
+ *
+ * Small sets are a sorted array searched with a binary search.  Once a
+ * set grows past kHashThreshold entries, an open-addressed hash table of
+ * the same pointers is kept alongside the array, so that adding and
+ * looking up pointers no longer costs a memmove or a search.  New
+ * entries are then appended to the array, and the array is sorted again
+ * the next time a caller asks for an index or walks the set in order.
  */
 #include "Dalvik.h"
 
+#include <stdlib.h>
+
+/* Sets larger than this get a hash table */
+static const u4 kHashThreshold = 32;
+
 /*
- * Sorted, expanding list of pointers.
+ * Expanding list of pointers, sorted unless "sorted" is false.  With a
+ * hash table, NULL marks an empty slot, so the NULL pointer itself is
+ * recorded by "hasNull".
  */
 struct PointerSet {
-    u2          alloc;
-    u2          count;
+    u4          alloc;
+    u4          count;
     const void** list;
+    bool        sorted;
+
+    u4          tableSize;      /* power of 2, or 0 without a table */
+    const void** table;
+    bool        hasNull;
 };
 
 /*
@@ -34,7 +53,7 @@ struct PointerSet {
 static bool verifySorted(PointerSet* pSet)
 {
     const void* last = NULL;
-    int i;
+    u4 i;
 
     for (i = 0; i < pSet->count; i++) {
         const void* cur = pSet->list[i];
@@ -47,6 +66,108 @@ static bool verifySorted(PointerSet* pSet)
 }
 #endif
 
+static inline u4 hashPointer(const void* ptr, u4 tableSize)
+{
+    return (((u4)(uintptr_t) ptr >> 2) * 2654435761u) & (tableSize - 1);
+}
+
+/*
+ * Returns the slot that holds "ptr", or the empty slot where it would go.
+ */
+static u4 findSlot(const PointerSet* pSet, const void* ptr)
+{
+    u4 mask = pSet->tableSize - 1;
+    u4 idx = hashPointer(ptr, pSet->tableSize);
+    while (pSet->table[idx] != NULL && pSet->table[idx] != ptr)
+        idx = (idx + 1) & mask;
+    return idx;
+}
+
+static void tableInsert(PointerSet* pSet, const void* ptr)
+{
+    if (ptr == NULL) {
+        pSet->hasNull = true;
+        return;
+    }
+    u4 idx = findSlot(pSet, ptr);
+    assert(pSet->table[idx] == NULL);
+    pSet->table[idx] = ptr;
+}
+
+/*
+ * Remove "ptr" from the hash table, moving later entries of its probe
+ * sequence back so that no lookup runs into the hole.
+ */
+static void tableRemove(PointerSet* pSet, const void* ptr)
+{
+    if (ptr == NULL) {
+        pSet->hasNull = false;
+        return;
+    }
+    u4 mask = pSet->tableSize - 1;
+    u4 hole = findSlot(pSet, ptr);
+    assert(pSet->table[hole] == ptr);
+    pSet->table[hole] = NULL;
+    for (u4 idx = (hole + 1) & mask; pSet->table[idx] != NULL;
+         idx = (idx + 1) & mask) {
+        u4 home = hashPointer(pSet->table[idx], pSet->tableSize);
+        /* leave it if its home lies cyclically in (hole, idx] */
+        if (((idx - home) & mask) < ((idx - hole) & mask)) {
+            continue;
+        }
+        pSet->table[hole] = pSet->table[idx];
+        pSet->table[idx] = NULL;
+        hole = idx;
+    }
+}
+
+/*
+ * (Re)build the hash table from the list, sized to stay under half full
+ * as the list fills its current allocation.
+ */
+static void rebuildTable(PointerSet* pSet)
+{
+    u4 size = 2 * kHashThreshold;
+    while (size < 2 * pSet->alloc)
+        size *= 2;
+    if (size != pSet->tableSize) {
+        free(pSet->table);
+        pSet->table = (const void**) malloc(size * sizeof(void*));
+        if (pSet->table == NULL) {
+            ALOGE("Failed expanding ptr set table (size=%d)", size);
+            dvmAbort();
+        }
+        pSet->tableSize = size;
+    }
+    memset(pSet->table, 0, size * sizeof(void*));
+    pSet->hasNull = false;
+    for (u4 i = 0; i < pSet->count; i++)
+        tableInsert(pSet, pSet->list[i]);
+}
+
+static int comparePointers(const void* a, const void* b)
+{
+    const void* pa = *(const void* const*) a;
+    const void* pb = *(const void* const*) b;
+    return (pa < pb) ? -1 : (pa > pb) ? 1 : 0;
+}
+
+/*
+ * Sort the list if entries were appended to it out of order.  Sorting
+ * does not change the contents of the set, so it is allowed on a const
+ * set.
+ */
+static void ensureSorted(const PointerSet* pSet)
+{
+    if (!pSet->sorted) {
+        PointerSet* mutableSet = const_cast<PointerSet*>(pSet);
+        qsort(mutableSet->list, mutableSet->count, sizeof(void*),
+            comparePointers);
+        mutableSet->sorted = true;
+    }
+    assert(verifySorted(const_cast<PointerSet*>(pSet)));
+}
+
 /*
  * Allocate a new PointerSet.
  *
@@ -56,6 +177,7 @@ PointerSet* dvmPointerSetAlloc(int initialSize)
 {
     PointerSet* pSet = (PointerSet*)calloc(1, sizeof(PointerSet));
     if (pSet != NULL) {
+        pSet->sorted = true;
         if (initialSize > 0) {
             pSet->list = (const void**)malloc(sizeof(void*) * initialSize);
             if (pSet->list == NULL) {
@@ -81,6 +203,7 @@ void dvmPointerSetFree(PointerSet* pSet)
         free(pSet->list);
         pSet->list = NULL;
     }
+    free(pSet->table);
     free(pSet);
 }
 
@@ -90,6 +213,11 @@ void dvmPointerSetFree(PointerSet* pSet)
 void dvmPointerSetClear(PointerSet* pSet)
 {
     pSet->count = 0;
+    pSet->sorted = true;
+    if (pSet->table != NULL) {
+        memset(pSet->table, 0, pSet->tableSize * sizeof(void*));
+        pSet->hasNull = false;
+    }
 }
 
 /*
@@ -105,6 +233,7 @@ int dvmPointerSetGetCount(const PointerSet* pSet)
  */
 const void* dvmPointerSetGetEntry(const PointerSet* pSet, int i)
 {
+    ensureSorted(pSet);
     return pSet->list[i];
 }
 
@@ -116,10 +245,15 @@ const void* dvmPointerSetGetEntry(const PointerSet* pSet, int i)
  */
 bool dvmPointerSetAddEntry(PointerSet* pSet, const void* ptr)
 {
-    int nearby;
+    int nearby = 0;
 
-    if (dvmPointerSetHas(pSet, ptr, &nearby))
+    if (pSet->table != NULL) {
+        if (ptr == NULL ? pSet->hasNull :
+                pSet->table[findSlot(pSet, ptr)] == ptr)
+            return false;
+    } else if (dvmPointerSetHas(pSet, ptr, &nearby)) {
         return false;
+    }
 
     /* ensure we have space to add one more */
     if (pSet->count == pSet->alloc) {
@@ -137,6 +271,17 @@ bool dvmPointerSetAddEntry(PointerSet* pSet, const void* ptr)
             dvmAbort();
         }
         pSet->list = newList;
+        if (pSet->table != NULL)
+            rebuildTable(pSet);
+    }
+
+    if (pSet->table != NULL) {
+        /* append; the list is sorted again when someone needs the order */
+        if (pSet->count != 0 && ptr < pSet->list[pSet->count-1])
+            pSet->sorted = false;
+        pSet->list[pSet->count++] = ptr;
+        tableInsert(pSet, ptr);
+        return true;
     }
 
     if (pSet->count == 0) {
@@ -163,7 +308,7 @@ bool dvmPointerSetAddEntry(PointerSet* pSet, const void* ptr)
         /*
          * Move existing values, if necessary.
          */
-        if (nearby != pSet->count) {
+        if (nearby != (int) pSet->count) {
             /* shift up */
             memmove(&pSet->list[nearby+1], &pSet->list[nearby],
                 (pSet->count - nearby) * sizeof(pSet->list[0]));
@@ -173,6 +318,9 @@ bool dvmPointerSetAddEntry(PointerSet* pSet, const void* ptr)
     pSet->list[nearby] = ptr;
     pSet->count++;
 
+    if (pSet->count > kHashThreshold)
+        rebuildTable(pSet);
+
     assert(verifySorted(pSet));
     return true;
 }
@@ -187,7 +335,7 @@ bool dvmPointerSetRemoveEntry(PointerSet* pSet, const void* ptr)
     if (!dvmPointerSetHas(pSet, ptr, &where))
         return false;
 
-    if (where != pSet->count-1) {
+    if (where != (int) pSet->count-1) {
         /* shift down */
         memmove(&pSet->list[where], &pSet->list[where+1],
             (pSet->count-1 - where) * sizeof(pSet->list[0]));
@@ -195,6 +343,8 @@ bool dvmPointerSetRemoveEntry(PointerSet* pSet, const void* ptr)
 
     pSet->count--;
     pSet->list[pSet->count] = (const void*) 0xdecadead;     // debug
+    if (pSet->table != NULL)
+        tableRemove(pSet, ptr);
     return true;
 }
 
@@ -206,6 +356,15 @@ bool dvmPointerSetHas(const PointerSet* pSet, const void* ptr, int* pIndex)
 {
     int hi, lo, mid;
 
+    if (pSet->table != NULL) {
+        bool found = (ptr == NULL) ? pSet->hasNull :
+            pSet->table[findSlot(pSet, ptr)] == ptr;
+        if (pIndex == NULL || !found)
+            return found;
+        /* fall through to find the index */
+    }
+    ensureSorted(pSet);
+
     lo = mid = 0;
     hi = pSet->count-1;
 
@@ -237,9 +396,11 @@ bool dvmPointerSetHas(const PointerSet* pSet, const void* ptr, int* pIndex)
  */
 void dvmPointerSetIntersect(PointerSet* pSet, const void** ptrArray, int count)
 {
-    int i, j;
+    u4 i, kept;
+    int j;
 
-    for (i = 0; i < pSet->count; i++) {
+    ensureSorted(pSet);
+    for (i = kept = 0; i < pSet->count; i++) {
         for (j = 0; j < count; j++) {
             if (pSet->list[i] == ptrArray[j]) {
                 /* match, keep this one */
@@ -247,18 +408,15 @@ void dvmPointerSetIntersect(PointerSet* pSet, const void** ptrArray, int count)
             }
         }
 
-        if (j == count) {
-            /* no match, remove entry */
-            if (i != pSet->count-1) {
-                /* shift down */
-                memmove(&pSet->list[i], &pSet->list[i+1],
-                    (pSet->count-1 - i) * sizeof(pSet->list[0]));
-            }
+        if (j != count)
+            pSet->list[kept++] = pSet->list[i];
+    }
 
-            pSet->count--;
-            pSet->list[pSet->count] = (const void*) 0xdecadead;     // debug
-            i--;        /* adjust loop counter */
-        }
+    if (kept != pSet->count) {
+        pSet->count = kept;
+        pSet->list[pSet->count] = (const void*) 0xdecadead;     // debug
+        if (pSet->table != NULL)
+            rebuildTable(pSet);
     }
 }
 
@@ -268,7 +426,8 @@ void dvmPointerSetIntersect(PointerSet* pSet, const void** ptrArray, int count)
 void dvmPointerSetDump(const PointerSet* pSet)
 {
     ALOGI("PointerSet %p", pSet);
-    int i;
+    ensureSorted(pSet);
+    u4 i;
     for (i = 0; i < pSet->count; i++)
         ALOGI(" %2d: %p", i, pSet->list[i]);
 }
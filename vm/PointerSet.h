@@ -14,8 +14,8 @@
  * limitations under the License.
  */
 /*
- * Maintain an expanding set of unique pointer values.  The set is
- * kept in sorted order.
+ * Maintain an expanding set of unique pointer values.  Indices and
+ * iteration follow sorted order; large sets are hashed internally.
  */
 #ifndef DALVIK_POINTERSET_H_
 #define DALVIK_POINTERSET_H_
@@ -78,6 +78,12 @@
 
 #define FILL_PATTERN        0xeeeeeeee
 
+/*
+ * Threads claim this many records of the buffer at a time, and fill them
+ * without further atomic operations.
+ */
+#define TRACE_CHUNK_RECORDS 256
+
 
 /*
  * Returns true if the thread CPU clock should be used.
@@ -441,6 +447,9 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
     }
     state->curOffset = TRACE_HEADER_LEN;
 
+    /* invalidate the chunks threads were given by an earlier trace */
+    state->generation++;
+
     /*
      * Set the "enabled" flag.  Once we do this, threads will wait to be
      * signaled before exiting, so we have to make sure we wake them up.
@@ -587,16 +596,18 @@ void dvmMethodTraceStop()
         dvmStopAllocCounting();
 
     /*
-     * It's possible under some circumstances for a thread to have advanced
-     * the data pointer but not written the method value.  It's possible
-     * (though less likely) for the data pointer to be advanced, or partial
-     * data written, while we're doing work here.
+     * Threads are handed the buffer in chunks, so every thread that traced
+     * leaves the unused tail of its last chunk behind, and a thread may
+     * have claimed a record but not written the method value yet.  It's
+     * possible (though less likely) for partial data to be written while
+     * we're doing work here.
      *
      * To avoid seeing partially-written data, we grab state->curOffset here,
      * and use our local copy from here on.  We then scan through what's
-     * already written.  If we see the fill pattern in what should be the
-     * method pointer, we cut things off early.  (If we don't, we'll fail
-     * when we dereference the pointer.)
+     * already written, squeezing out every record that still has the fill
+     * pattern in what should be the method pointer.  (If we don't, we'll
+     * fail when we dereference the pointer.)  Records of each thread stay
+     * in order, which is all the trace format needs.
      *
      * There's a theoretical possibility of interrupting another thread
      * after it has partially written the method pointer, in which case
@@ -612,21 +623,24 @@ void dvmMethodTraceStop()
     if (finalCurOffset > TRACE_HEADER_LEN) {
         u4 fillVal = METHOD_ID(FILL_PATTERN);
         u1* scanPtr = state->buf + TRACE_HEADER_LEN;
+        u1* scanEnd = state->buf + finalCurOffset;
+        u1* outPtr = scanPtr;
 
-        while (scanPtr < state->buf + finalCurOffset) {
+        while (scanPtr < scanEnd) {
             u4 methodVal = scanPtr[2] | (scanPtr[3] << 8) | (scanPtr[4] << 16)
                         | (scanPtr[5] << 24);
-            if (METHOD_ID(methodVal) == fillVal) {
-                u1* scanBase = state->buf + TRACE_HEADER_LEN;
-                ALOGW("Found unfilled record at %d (of %d)",
-                    (scanPtr - scanBase) / recordSize,
-                    (finalCurOffset - TRACE_HEADER_LEN) / recordSize);
-                finalCurOffset = scanPtr - state->buf;
-                break;
+            if (METHOD_ID(methodVal) != fillVal) {
+                if (outPtr != scanPtr)
+                    memmove(outPtr, scanPtr, recordSize);
+                outPtr += recordSize;
             }
 
             scanPtr += recordSize;
         }
+
+        ALOGV("Squeezed out %d unfilled records",
+            (scanEnd - outPtr) / recordSize);
+        finalCurOffset = outPtr - state->buf;
     }
 
     ALOGI("TRACE STOPPED%s: writing %d records",
@@ -755,26 +769,42 @@ void dvmMethodTraceAdd(Thread* self, const Method* method, int action)
 #endif
 
     /*
-     * Advance "curOffset" atomically.
+     * If this thread has used up its chunk of the buffer (or has none for
+     * this trace), advance "curOffset" atomically to claim another.  A
+     * shared atomic per record had every tracing thread fighting over
+     * one cache line.
      */
-    do {
-        oldOffset = state->curOffset;
-        newOffset = oldOffset + state->recordSize;
-        if (newOffset > state->bufferSize) {
-            state->overflow = true;
-            return;
-        }
-    } while (android_atomic_release_cas(oldOffset, newOffset,
-            &state->curOffset) != 0);
+    size_t recordSize = state->recordSize;
+    if (self->traceGeneration != state->generation ||
+        self->traceChunkPtr + recordSize > self->traceChunkEnd)
+    {
+        do {
+            oldOffset = state->curOffset;
+            int avail = (state->bufferSize - oldOffset) / (int) recordSize;
+            if (avail <= 0) {
+                state->overflow = true;
+                return;
+            }
+            if (avail > TRACE_CHUNK_RECORDS)
+                avail = TRACE_CHUNK_RECORDS;
+            newOffset = oldOffset + avail * recordSize;
+        } while (android_atomic_release_cas(oldOffset, newOffset,
+                &state->curOffset) != 0);
+
+        self->traceChunkPtr = state->buf + oldOffset;
+        self->traceChunkEnd = state->buf + newOffset;
+        self->traceGeneration = state->generation;
+    }
 
     //assert(METHOD_ACTION((u4) method) == 0);
 
     methodVal = METHOD_COMBINE((u4) method, action);
 
     /*
-     * Write data into "oldOffset".
+     * Write data into the next record of our chunk.
      */
-    ptr = state->buf + oldOffset;
+    ptr = self->traceChunkPtr;
+    self->traceChunkPtr += recordSize;
     *ptr++ = (u1) self->threadId;
     *ptr++ = (u1) (self->threadId >> 8);
     *ptr++ = (u1) methodVal;
@@ -996,6 +1026,7 @@ void dvmStopInstructionCounting()
 void dvmStartAllocCounting()
 {
     gDvm.allocProf.enabled = true;
+    dvmRetireAllocBuffers();
 }
 
 /*
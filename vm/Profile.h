@@ -46,7 +46,8 @@ struct MethodTraceState {
 
     int     traceEnabled;
     u1*     buf;
-    volatile int curOffset;
+    volatile int curOffset;     /* end of the last chunk handed out */
+    int     generation;         /* bumped for every trace started */
     u8      startWhen;
     int     overflow;
 
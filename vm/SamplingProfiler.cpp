@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sampling method profiling.
+ *
+ * Method tracing instruments every call, which slows the app down too
+ * much to use on anything but a development build.  Here, a thread wakes
+ * up at a fixed interval, briefly suspends the VM, and copies the top
+ * frames of every thread that is running (or off in native code).  The
+ * copies are charged to entries keyed on the stack once the VM has been
+ * resumed, so the pause is only as long as the stack walks.
+ *
+ * The cost is one suspend-all per interval; at the default 10ms that is
+ * well under the overhead of method tracing.  It is enabled with
+ * -Xsampleprofile.  The busiest stacks are printed with the thread dump
+ * on SIGQUIT, and all of them are written in "folded" form (one line per
+ * stack, frames outermost first separated by ';', then the sample count)
+ * to the -Xsampleprofilefile file when sampling stops.
+ */
+#include "Dalvik.h"
+
+#include <stdlib.h>
+
+/* number of frames kept per sample, innermost first */
+#define kMaxSampleStackDepth        16
+
+/* number of entries in the table; must be a power of 2 */
+#define kNumSampleEntries           2048
+
+/* number of entries printed by dvmDumpSamplingProfile() */
+#define kNumSampleDumpEntries       10
+
+/* number of threads sampled per tick */
+#define kMaxSampledThreads          64
+
+/* default interval between samples */
+#define kDefaultSampleIntervalUsec  10000
+
+struct SampleProfileEntry {
+    u4          depth;              /* 0 if the entry is unused */
+    u4          count;
+    const Method* method[kMaxSampleStackDepth];
+};
+
+/*
+ * Initialize a few things.  This gets called early, so keep activity to
+ * a minimum.  The sampling thread itself is started after the zygote
+ * fork (see dvmInitAfterZygote).
+ */
+bool dvmSamplingProfilerStartup()
+{
+    dvmInitMutex(&gDvm.sampleProfileLock);
+    pthread_cond_init(&gDvm.sampleProfileCond, NULL);
+    if (gDvm.sampleIntervalUsec <= 0)
+        gDvm.sampleIntervalUsec = kDefaultSampleIntervalUsec;
+    return true;
+}
+
+/*
+ * Release anything we're holding on to.
+ */
+void dvmSamplingProfilerShutdown()
+{
+    dvmDisableSamplingProfiler();
+    free(gDvm.sampleProfileFile);
+    gDvm.sampleProfileFile = NULL;
+    pthread_cond_destroy(&gDvm.sampleProfileCond);
+    dvmDestroyMutex(&gDvm.sampleProfileLock);
+}
+
+/*
+ * Copy the top frames of "thread" into "pEntry".
+ */
+static void getStackFrames(const Thread* thread, SampleProfileEntry* pEntry)
+{
+    u4 depth = 0;
+    void* fp = thread->interpSave.curFrame;
+
+    while (fp != NULL && depth < kMaxSampleStackDepth) {
+        const StackSaveArea* saveArea = SAVEAREA_FROM_FP(fp);
+
+        if (!dvmIsBreakFrame((u4*) fp))
+            pEntry->method[depth++] = saveArea->method;
+        fp = saveArea->prevFrame;
+    }
+    pEntry->depth = depth;
+}
+
+/*
+ * Suspend the VM and take one sample of every thread that is running.
+ * Returns the number of samples stored in "samples".
+ */
+static int takeSamples(Thread* self, SampleProfileEntry* samples)
+{
+    int count = 0;
+
+    dvmSuspendAllThreads(SUSPEND_FOR_STACK_DUMP);
+    dvmLockThreadList(self);
+
+    for (Thread* thread = gDvm.threadList; thread != NULL;
+         thread = thread->next)
+    {
+        if (thread == self)
+            continue;
+
+        /* a running thread that was stopped for us shows as suspended */
+        ThreadStatus status = thread->status;
+        if (status != THREAD_RUNNING && status != THREAD_SUSPENDED &&
+            status != THREAD_NATIVE)
+        {
+            continue;
+        }
+        if (count == kMaxSampledThreads) {
+            gDvm.sampleProfileDropped++;
+            continue;
+        }
+
+        getStackFrames(thread, &samples[count]);
+        if (samples[count].depth != 0)
+            count++;
+    }
+
+    dvmUnlockThreadList();
+    dvmResumeAllThreads(SUSPEND_FOR_STACK_DUMP);
+    return count;
+}
+
+static u4 hashKey(const SampleProfileEntry* pKey)
+{
+    u4 hash = pKey->depth;
+
+    for (u4 i = 0; i < pKey->depth; i++)
+        hash = hash * 31 + ((u4) pKey->method[i] >> 2);
+    return hash;
+}
+
+static bool sameKey(const SampleProfileEntry* a, const SampleProfileEntry* b)
+{
+    if (a->depth != b->depth)
+        return false;
+    for (u4 i = 0; i < a->depth; i++) {
+        if (a->method[i] != b->method[i])
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Charge a sample to the entry for its stack, adding the entry if needed.
+ * Samples that don't fit in a full table are counted as dropped.  Caller
+ * must hold sampleProfileLock.
+ */
+static void recordSample(const SampleProfileEntry* pKey)
+{
+    u4 hash = hashKey(pKey);
+
+    gDvm.sampleProfileSamples++;
+    for (int probe = 0; probe < kNumSampleEntries; probe++) {
+        SampleProfileEntry* pSlot =
+            &gDvm.sampleProfile[(hash + probe) & (kNumSampleEntries - 1)];
+        if (pSlot->depth == 0) {
+            *pSlot = *pKey;
+            pSlot->count = 1;
+            return;
+        }
+        if (sameKey(pSlot, pKey)) {
+            pSlot->count++;
+            return;
+        }
+    }
+    gDvm.sampleProfileDropped++;
+}
+
+/*
+ * Body of the sampling thread.
+ *
+ * The thread sleeps in VMWAIT, and doesn't hold sampleProfileLock while
+ * it is running, so a suspend-all from somebody else (e.g. the signal
+ * catcher, which then wants the lock to print the profile) can't wedge
+ * against it.
+ */
+static void* samplingThreadStart(void* arg)
+{
+    Thread* self = dvmThreadSelf();
+    SampleProfileEntry* samples = (SampleProfileEntry*)
+        malloc(sizeof(SampleProfileEntry) * kMaxSampledThreads);
+
+    UNUSED_PARAMETER(arg);
+    if (samples == NULL) {
+        ALOGE("Unable to allocate sampling buffer");
+        return NULL;
+    }
+
+    dvmChangeStatus(self, THREAD_VMWAIT);
+    for (;;) {
+        dvmLockMutex(&gDvm.sampleProfileLock);
+        if (!gDvm.haltSampling) {
+            int usec = gDvm.sampleIntervalUsec;
+            dvmRelativeCondWait(&gDvm.sampleProfileCond,
+                &gDvm.sampleProfileLock, usec / 1000, (usec % 1000) * 1000);
+        }
+        bool halt = gDvm.haltSampling;
+        dvmUnlockMutex(&gDvm.sampleProfileLock);
+        if (halt)
+            break;
+
+        dvmChangeStatus(self, THREAD_RUNNING);
+        int count = takeSamples(self, samples);
+        dvmChangeStatus(self, THREAD_VMWAIT);
+
+        dvmLockMutex(&gDvm.sampleProfileLock);
+        for (int i = 0; i < count; i++)
+            recordSample(&samples[i]);
+        dvmUnlockMutex(&gDvm.sampleProfileLock);
+    }
+
+    free(samples);
+    return NULL;
+}
+
+/*
+ * Start sampling, discarding anything collected before.
+ *
+ * Returns "true" on success.
+ */
+bool dvmEnableSamplingProfiler(int intervalUsec)
+{
+    assert(!gDvm.zygote);
+
+    dvmDisableSamplingProfiler();
+
+    dvmLockMutex(&gDvm.sampleProfileLock);
+    gDvm.sampleProfile = (SampleProfileEntry*)
+        calloc(kNumSampleEntries, sizeof(SampleProfileEntry));
+    if (gDvm.sampleProfile == NULL) {
+        dvmUnlockMutex(&gDvm.sampleProfileLock);
+        return false;
+    }
+    gDvm.sampleProfileSamples = 0;
+    gDvm.sampleProfileDropped = 0;
+    if (intervalUsec > 0)
+        gDvm.sampleIntervalUsec = intervalUsec;
+    gDvm.haltSampling = false;
+    dvmUnlockMutex(&gDvm.sampleProfileLock);
+
+    if (!dvmCreateInternalThread(&gDvm.samplingThreadHandle,
+            "Sampling Profiler", samplingThreadStart, NULL))
+    {
+        ALOGW("Unable to create sampling profiler thread");
+        dvmLockMutex(&gDvm.sampleProfileLock);
+        free(gDvm.sampleProfile);
+        gDvm.sampleProfile = NULL;
+        dvmUnlockMutex(&gDvm.sampleProfileLock);
+        return false;
+    }
+    gDvm.samplingThreadStarted = true;
+    ALOGI("Sampling profiler started (%dus interval)",
+        gDvm.sampleIntervalUsec);
+    return true;
+}
+
+/*
+ * Write every entry in folded form.  Caller must hold sampleProfileLock.
+ */
+static void writeFoldedStacks(FILE* fp)
+{
+    for (int i = 0; i < kNumSampleEntries; i++) {
+        const SampleProfileEntry* pEntry = &gDvm.sampleProfile[i];
+        if (pEntry->depth == 0)
+            continue;
+
+        /* outermost frame first */
+        for (int j = pEntry->depth - 1; j >= 0; j--) {
+            const Method* method = pEntry->method[j];
+            fprintf(fp, "%s.%s%s", method->clazz->descriptor, method->name,
+                j != 0 ? ";" : "");
+        }
+        fprintf(fp, " %u\n", pEntry->count);
+    }
+}
+
+/*
+ * Stop sampling.  Does nothing if it is not enabled.
+ */
+void dvmDisableSamplingProfiler()
+{
+    if (!gDvm.samplingThreadStarted)
+        return;
+
+    dvmLockMutex(&gDvm.sampleProfileLock);
+    gDvm.haltSampling = true;
+    dvmSignalCond(&gDvm.sampleProfileCond);
+    dvmUnlockMutex(&gDvm.sampleProfileLock);
+
+    Thread* self = dvmThreadSelf();
+    ThreadStatus oldStatus = THREAD_UNDEFINED;
+    if (self != NULL)
+        oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    pthread_join(gDvm.samplingThreadHandle, NULL);
+    if (self != NULL)
+        dvmChangeStatus(self, oldStatus);
+    gDvm.samplingThreadStarted = false;
+
+    dvmLockMutex(&gDvm.sampleProfileLock);
+    ALOGI("Sampling profiler stopped: %u samples, %u dropped",
+        gDvm.sampleProfileSamples, gDvm.sampleProfileDropped);
+    if (gDvm.sampleProfileFile != NULL) {
+        FILE* fp = fopen(gDvm.sampleProfileFile, "w");
+        if (fp == NULL) {
+            ALOGW("Unable to open sample profile file '%s': %s",
+                gDvm.sampleProfileFile, strerror(errno));
+        } else {
+            writeFoldedStacks(fp);
+            fclose(fp);
+        }
+    }
+    free(gDvm.sampleProfile);
+    gDvm.sampleProfile = NULL;
+    dvmUnlockMutex(&gDvm.sampleProfileLock);
+}
+
+/*
+ * Sort entries by sample count, highest first.
+ */
+static int compareEntries(const void* vp1, const void* vp2)
+{
+    const SampleProfileEntry* p1 = *(const SampleProfileEntry**) vp1;
+    const SampleProfileEntry* p2 = *(const SampleProfileEntry**) vp2;
+
+    if (p1->count != p2->count)
+        return (p1->count < p2->count) ? 1 : -1;
+    return 0;
+}
+
+/*
+ * Print the most frequently sampled stacks, busiest first.
+ */
+void dvmDumpSamplingProfile(const DebugOutputTarget* target)
+{
+    dvmLockMutex(&gDvm.sampleProfileLock);
+    if (gDvm.sampleProfile == NULL) {
+        dvmUnlockMutex(&gDvm.sampleProfileLock);
+        return;
+    }
+
+    SampleProfileEntry** sorted = (SampleProfileEntry**)
+        malloc(sizeof(SampleProfileEntry*) * kNumSampleEntries);
+    if (sorted == NULL) {
+        dvmUnlockMutex(&gDvm.sampleProfileLock);
+        return;
+    }
+
+    int count = 0;
+    for (int i = 0; i < kNumSampleEntries; i++) {
+        if (gDvm.sampleProfile[i].depth != 0)
+            sorted[count++] = &gDvm.sampleProfile[i];
+    }
+    qsort(sorted, count, sizeof(*sorted), compareEntries);
+
+    dvmPrintDebugMessage(target,
+        "SAMPLED STACKS: (%d stacks, %u samples, %u dropped)\n",
+        count, gDvm.sampleProfileSamples, gDvm.sampleProfileDropped);
+    if (count > kNumSampleDumpEntries)
+        count = kNumSampleDumpEntries;
+
+    for (int i = 0; i < count; i++) {
+        const SampleProfileEntry* pEntry = sorted[i];
+        u4 total = gDvm.sampleProfileSamples;
+
+        dvmPrintDebugMessage(target, "  %u samples (%u%%)\n", pEntry->count,
+            total != 0 ? (u4) ((u8) pEntry->count * 100 / total) : 0);
+        for (u4 j = 0; j < pEntry->depth; j++) {
+            const Method* method = pEntry->method[j];
+            dvmPrintDebugMessage(target, "    at %s.%s\n",
+                method->clazz->descriptor, method->name);
+        }
+    }
+    dvmPrintDebugMessage(target, "\n");
+
+    free(sorted);
+    dvmUnlockMutex(&gDvm.sampleProfileLock);
+}
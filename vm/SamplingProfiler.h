@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sampling method profiler.
+ */
+#ifndef DALVIK_SAMPLINGPROFILER_H_
+#define DALVIK_SAMPLINGPROFILER_H_
+
+/* initialization */
+bool dvmSamplingProfilerStartup(void);
+void dvmSamplingProfilerShutdown(void);
+
+struct SampleProfileEntry;
+struct DebugOutputTarget;
+
+/*
+ * Start sampling every "intervalUsec" microseconds, discarding anything
+ * collected before.  Must not be called in the zygote.
+ */
+bool dvmEnableSamplingProfiler(int intervalUsec);
+
+/*
+ * Stop sampling, and write the collected stacks to the file named by
+ * -Xsampleprofilefile, if any.  Does nothing if sampling is not enabled.
+ */
+void dvmDisableSamplingProfiler(void);
+
+/*
+ * Print the most frequently sampled stacks.  Prints nothing if sampling
+ * is disabled.
+ */
+void dvmDumpSamplingProfile(const DebugOutputTarget* target);
+
+#endif  // DALVIK_SAMPLINGPROFILER_H_
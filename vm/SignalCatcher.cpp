@@ -95,6 +95,17 @@ bail:
         close(fd);
 }
 
+/*
+ * Dump all threads, stopping them all first unless we were asked not to.
+ */
+static void dumpAllThreads(const DebugOutputTarget* target)
+{
+    if (gDvm.nonStopStackDump)
+        dvmDumpAllThreadsNonStop(target);
+    else
+        dvmDumpAllThreadsEx(target, true);
+}
+
 /*
  * Dump the stack traces for all threads to the supplied file, putting
  * a timestamp header on it.
@@ -120,10 +131,91 @@ static void logThreadStacks(FILE* fp)
         ptm->tm_hour, ptm->tm_min, ptm->tm_sec);
     printProcessName(&target);
     dvmPrintDebugMessage(&target, "\n");
-    dvmDumpAllThreadsEx(&target, true);
+    dumpAllThreads(&target);
+    dvmDumpGcPhaseHistograms(&target);
     fprintf(fp, "----- end %d -----\n", pid);
 }
 
+/*
+ * Append "traceBuf" to the stack trace file "fileName" and free it.
+ */
+static void writeStackTraceFile(const char* fileName, char* traceBuf,
+    size_t traceLen)
+{
+    /*
+     * Open the stack trace output file, creating it if necessary.  It
+     * needs to be world-writable so other processes can write to it.
+     */
+    int fd = open(fileName, O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if (fd < 0) {
+        ALOGE("Unable to open stack trace file '%s': %s",
+            fileName, strerror(errno));
+    } else {
+        ssize_t actual = write(fd, traceBuf, traceLen);
+        if (actual != (ssize_t) traceLen) {
+            ALOGE("Failed to write stack traces to %s (%d of %zd): %s",
+                fileName, (int) actual, traceLen,
+                strerror(errno));
+        } else {
+            ALOGI("Wrote stack traces to '%s'", fileName);
+        }
+        close(fd);
+    }
+
+    free(traceBuf);
+}
+
+struct StackTraceWrite {
+    char*   fileName;
+    char*   traceBuf;
+    size_t  traceLen;
+};
+
+static void* stackTraceWriterThreadStart(void* arg)
+{
+    StackTraceWrite* req = (StackTraceWrite*) arg;
+    writeStackTraceFile(req->fileName, req->traceBuf, req->traceLen);
+    free(req->fileName);
+    free(req);
+    return NULL;
+}
+
+/*
+ * Write "traceBuf" out on a thread of its own, so slow disk I/O doesn't
+ * keep us from the next signal.  The thread doesn't touch the VM.  The
+ * zygote has to stay single-threaded, so it writes the file itself, as
+ * do we if the thread can't be started.
+ */
+static void writeStackTraceFileAsync(char* traceBuf, size_t traceLen)
+{
+    StackTraceWrite* req = NULL;
+    if (!gDvm.zygote)
+        req = (StackTraceWrite*) malloc(sizeof(*req));
+    if (req != NULL) {
+        /* our own copy of the name, which the VM frees at shutdown */
+        req->fileName = strdup(gDvm.stackTraceFile);
+        req->traceBuf = traceBuf;
+        req->traceLen = traceLen;
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_t handle;
+        int cc = pthread_create(&handle, &attr, stackTraceWriterThreadStart,
+            req);
+        pthread_attr_destroy(&attr);
+        if (cc == 0)
+            return;
+        ALOGW("Unable to start stack trace writer: %s", strerror(cc));
+        free(req->fileName);
+        free(req);
+    }
+
+    ThreadStatus oldStatus = dvmChangeStatus(dvmThreadSelf(), THREAD_VMWAIT);
+    writeStackTraceFile(gDvm.stackTraceFile, traceBuf, traceLen);
+    dvmChangeStatus(dvmThreadSelf(), oldStatus);
+}
+
 
 /*
  * Respond to a SIGQUIT by dumping the thread stacks.  Optionally dump
@@ -136,14 +228,20 @@ static void logThreadStacks(FILE* fp)
  * before doing the file write, so we don't stall the VM if disk I/O is
  * bottlenecked.
  *
+ * With -Xstackdump:nonstop the threads are not all stopped at once; each
+ * one is held only while its Java stack is copied, everything else is
+ * gathered afterwards, and the trace file is written on another thread.
+ *
  * If JIT tuning is compiled in, dump compiler stats as well.
  */
 static void handleSigQuit()
 {
     char* traceBuf = NULL;
     size_t traceLen;
+    bool nonStop = gDvm.nonStopStackDump;
 
-    dvmSuspendAllThreads(SUSPEND_FOR_STACK_DUMP);
+    if (!nonStop)
+        dvmSuspendAllThreads(SUSPEND_FOR_STACK_DUMP);
 
     dvmDumpLoaderStats("sig");
 
@@ -151,7 +249,8 @@ static void handleSigQuit()
         /* just dump to log */
         DebugOutputTarget target;
         dvmCreateLogOutputTarget(&target, ANDROID_LOG_INFO, LOG_TAG);
-        dvmDumpAllThreadsEx(&target, true);
+        dumpAllThreads(&target);
+        dvmDumpGcPhaseHistograms(&target);
     } else {
         /* write to memory buffer */
         FILE* memfp = open_memstream(&traceBuf, &traceLen);
@@ -171,37 +270,32 @@ static void handleSigQuit()
 
     if (false) dvmDumpTrackedAllocations(true);
 
-    dvmResumeAllThreads(SUSPEND_FOR_STACK_DUMP);
+    if (!nonStop)
+        dvmResumeAllThreads(SUSPEND_FOR_STACK_DUMP);
 
-    if (traceBuf != NULL) {
-        /*
-         * We don't know how long it will take to do the disk I/O, so put us
-         * into VMWAIT for the duration.
-         */
-        ThreadStatus oldStatus = dvmChangeStatus(dvmThreadSelf(), THREAD_VMWAIT);
+    /*
+     * The histogram does its own suspend, with the heap lock taken
+     * first like the GC, so it can't be done with the threads above.
+     */
+    if (gDvm.heapHistogramOnSigQuit) {
+        DebugOutputTarget target;
+        dvmCreateLogOutputTarget(&target, ANDROID_LOG_INFO, LOG_TAG);
+        dvmDumpHeapHistogram(&target, false);
+    }
 
-        /*
-         * Open the stack trace output file, creating it if necessary.  It
-         * needs to be world-writable so other processes can write to it.
-         */
-        int fd = open(gDvm.stackTraceFile, O_WRONLY | O_APPEND | O_CREAT, 0666);
-        if (fd < 0) {
-            ALOGE("Unable to open stack trace file '%s': %s",
-                gDvm.stackTraceFile, strerror(errno));
+    if (traceBuf != NULL) {
+        if (nonStop) {
+            writeStackTraceFileAsync(traceBuf, traceLen);
         } else {
-            ssize_t actual = write(fd, traceBuf, traceLen);
-            if (actual != (ssize_t) traceLen) {
-                ALOGE("Failed to write stack traces to %s (%d of %zd): %s",
-                    gDvm.stackTraceFile, (int) actual, traceLen,
-                    strerror(errno));
-            } else {
-                ALOGI("Wrote stack traces to '%s'", gDvm.stackTraceFile);
-            }
-            close(fd);
+            /*
+             * We don't know how long it will take to do the disk I/O, so
+             * put us into VMWAIT for the duration.
+             */
+            ThreadStatus oldStatus =
+                dvmChangeStatus(dvmThreadSelf(), THREAD_VMWAIT);
+            writeStackTraceFile(gDvm.stackTraceFile, traceBuf, traceLen);
+            dvmChangeStatus(dvmThreadSelf(), oldStatus);
         }
-
-        free(traceBuf);
-        dvmChangeStatus(dvmThreadSelf(), oldStatus);
     }
 }
 
@@ -16,6 +16,10 @@
 /*
  * Thread that reads from stdout/stderr and converts them to log messages.
  * (Sort of a hack.)
+ *
+ * The complete lines from one read go out together, as one log entry or,
+ * with -Xstdioforward, as one write to a file or descriptor.
+ * -Xstdiorate caps the number of lines passed on per second.
  */
 #include "Dalvik.h"
 
@@ -23,24 +27,99 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 
 #define kFilenoStdout   1
 #define kFilenoStderr   2
 
-#define kMaxLine    512
+/* longest line we pass on in one piece; longer ones are cut */
+#define kMaxLine    1024
+
+/* pending input per stream */
+#define kBufferSize 8192
+
+/*
+ * Most text sent in one go.  Lines are joined with '\n' into a single
+ * log entry, so this has to stay under the logger's payload limit.
+ */
+#define kMaxBatch   4000
 
 /*
  * Hold some data.
  */
 struct BufferedData {
-    char    buf[kMaxLine+1];
+    char    buf[kBufferSize];
+    int     count;
+};
+
+/*
+ * Complete lines waiting to be sent, each ending in '\n'.
+ */
+struct OutputBatch {
+    char    buf[kMaxBatch];
     int     count;
 };
 
+/*
+ * Lines let through in the current one-second window.
+ */
+struct RateLimit {
+    u4      windowStart;
+    int     lines;
+    int     dropped;
+};
+
+/* where the lines go; -1 for the log */
+static int forwardFd = -1;
+static bool forwardIsSocket;
+
 // fwd
 static void* stdioConverterThreadStart(void* arg);
-static bool readAndLog(int fd, BufferedData* data, const char* tag);
+static bool readAndLog(int fd, BufferedData* data, OutputBatch* batch,
+    RateLimit* limit, const char* tag);
+
+
+/*
+ * Set up forwarding to a file or a descriptor, if one was requested.
+ * The descriptor can be a socket.  Falls back to the log on failure.
+ */
+static void openForwardFd()
+{
+    if (gDvm.stdioForwardFile != NULL) {
+        forwardFd = open(gDvm.stdioForwardFile,
+            O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if (forwardFd < 0) {
+            ALOGW("Unable to open stdio forward file '%s': %s",
+                gDvm.stdioForwardFile, strerror(errno));
+        }
+    } else if (gDvm.stdioForwardFd >= 0) {
+        if (gDvm.stdioForwardFd == kFilenoStdout ||
+            gDvm.stdioForwardFd == kFilenoStderr)
+        {
+            ALOGW("Can't forward stdio to fd %d", gDvm.stdioForwardFd);
+        } else if (fcntl(gDvm.stdioForwardFd, F_GETFD) < 0) {
+            ALOGW("Bad stdio forward fd %d: %s", gDvm.stdioForwardFd,
+                strerror(errno));
+        } else {
+            forwardFd = gDvm.stdioForwardFd;
+        }
+    }
+
+    struct stat st;
+    forwardIsSocket = (forwardFd >= 0 && fstat(forwardFd, &st) == 0 &&
+        S_ISSOCK(st.st_mode));
+}
 
+/*
+ * Stop forwarding.  We only close what we opened.
+ */
+static void closeForwardFd()
+{
+    if (forwardFd >= 0 && gDvm.stdioForwardFile != NULL)
+        close(forwardFd);
+    forwardFd = -1;
+}
 
 /*
  * Crank up the stdout/stderr converter thread.
@@ -51,6 +130,8 @@ bool dvmStdioConverterStartup()
 {
     gDvm.haltStdioConverter = false;
 
+    openForwardFd();
+
     dvmInitMutex(&gDvm.stdioConverterLock);
     pthread_cond_init(&gDvm.stdioConverterCond, NULL);
 
@@ -141,11 +222,15 @@ static void* stdioConverterThreadStart(void* arg)
     dvmChangeStatus(NULL, THREAD_VMWAIT);
 
     /*
-     * Allocate read buffers.
+     * Allocate read buffers.  The rate limit is shared by both streams.
      */
     BufferedData* stdoutData = new BufferedData;
     BufferedData* stderrData = new BufferedData;
-    stdoutData->count = stderrData->count = 0;
+    OutputBatch* batch = new OutputBatch;
+    stdoutData->count = stderrData->count = batch->count = 0;
+    RateLimit limit;
+    limit.windowStart = dvmGetRelativeTimeMsec();
+    limit.lines = limit.dropped = 0;
 
     /*
      * Read until shutdown time.
@@ -172,12 +257,12 @@ static void* stdioConverterThreadStart(void* arg)
         } else {
             bool err = false;
             if (FD_ISSET(gDvm.stdoutPipe[0], &readfds)) {
-                err |= !readAndLog(gDvm.stdoutPipe[0], stdoutData,
-                    "stdout");
+                err |= !readAndLog(gDvm.stdoutPipe[0], stdoutData, batch,
+                    &limit, "stdout");
             }
             if (FD_ISSET(gDvm.stderrPipe[0], &readfds)) {
-                err |= !readAndLog(gDvm.stderrPipe[0], stderrData,
-                    "stderr");
+                err |= !readAndLog(gDvm.stderrPipe[0], stderrData, batch,
+                    &limit, "stderr");
             }
 
             /* probably EOF; give up */
@@ -193,46 +278,160 @@ static void* stdioConverterThreadStart(void* arg)
 
     delete stdoutData;
     delete stderrData;
+    delete batch;
+    closeForwardFd();
 
     /* change back for shutdown sequence */
     dvmChangeStatus(NULL, THREAD_RUNNING);
     return NULL;
 }
 
+/*
+ * Write "count" bytes to the forward descriptor.  Sockets are written
+ * with MSG_NOSIGNAL so a closed peer doesn't kill the process.
+ */
+static bool writeForward(const char* buf, int count)
+{
+    while (count > 0) {
+        ssize_t actual;
+        if (forwardIsSocket)
+            actual = send(forwardFd, buf, count, MSG_NOSIGNAL);
+        else
+            actual = write(forwardFd, buf, count);
+        if (actual < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buf += actual;
+        count -= actual;
+    }
+    return true;
+}
+
+/*
+ * Send the lines in "batch" as a single log entry, or with a single
+ * write to the forward descriptor.  If forwarding fails we go back to
+ * the log for good.
+ */
+static void flushBatch(OutputBatch* batch, const char* tag)
+{
+    if (batch->count == 0)
+        return;
+
+    if (forwardFd >= 0 && !writeForward(batch->buf, batch->count)) {
+        ALOGW("stdio forwarding failed (%s); logging instead",
+            strerror(errno));
+        closeForwardFd();
+    }
+    if (forwardFd < 0) {
+        /* drop the last '\n'; the logger ends the entry itself */
+        batch->buf[batch->count-1] = '\0';
+        ALOG(LOG_INFO, tag, "%s", batch->buf);
+    }
+    batch->count = 0;
+}
+
+/*
+ * Returns true if one more line fits in the rate limit.  Says how many
+ * were dropped once a window that dropped some is over.
+ */
+static bool checkRateLimit(RateLimit* limit, OutputBatch* batch,
+    const char* tag)
+{
+    if (gDvm.stdioRateLimit <= 0)
+        return true;
+
+    u4 now = dvmGetRelativeTimeMsec();
+    if (now - limit->windowStart >= 1000) {
+        if (limit->dropped != 0) {
+            flushBatch(batch, tag);
+            ALOG(LOG_WARN, tag, "dropped %d lines over the limit of %d/sec",
+                limit->dropped, gDvm.stdioRateLimit);
+        }
+        limit->windowStart = now;
+        limit->lines = limit->dropped = 0;
+    }
+    if (limit->lines >= gDvm.stdioRateLimit) {
+        limit->dropped++;
+        return false;
+    }
+    limit->lines++;
+    return true;
+}
+
+/*
+ * Add the "len" characters at "line" to "batch", sending what's there
+ * first if it won't fit.  "truncated" marks a line that was cut short.
+ */
+static void addLine(OutputBatch* batch, RateLimit* limit, const char* tag,
+    const char* line, int len, bool truncated)
+{
+    if (!checkRateLimit(limit, batch, tag))
+        return;
+
+    if (len > kMaxLine) {
+        len = kMaxLine;
+        truncated = true;
+    }
+
+    /* "<tag>: " for the file, the '!' and the '\n' */
+    int prefixLen = (forwardFd >= 0) ? strlen(tag) + 2 : 0;
+    int need = prefixLen + len + (truncated ? 1 : 0) + 1;
+    if (batch->count + need > kMaxBatch)
+        flushBatch(batch, tag);
+
+    char* cp = batch->buf + batch->count;
+    if (prefixLen != 0) {
+        memcpy(cp, tag, prefixLen - 2);
+        memcpy(cp + prefixLen - 2, ": ", 2);
+        cp += prefixLen;
+    }
+    memcpy(cp, line, len);
+    cp += len;
+    if (truncated)
+        *cp++ = '!';
+    *cp++ = '\n';
+    batch->count = cp - batch->buf;
+}
+
 /*
  * Data is pending on "fd".  Read as much as will fit in "data", then
- * write out any full lines and compact "data".
+ * pass on any full lines in one batch and compact "data".
  */
-static bool readAndLog(int fd, BufferedData* data, const char* tag)
+static bool readAndLog(int fd, BufferedData* data, OutputBatch* batch,
+    RateLimit* limit, const char* tag)
 {
     ssize_t actual;
     size_t want;
 
-    assert(data->count < kMaxLine);
+    assert(data->count < kBufferSize);
 
-    want = kMaxLine - data->count;
+    want = kBufferSize - data->count;
     actual = read(fd, data->buf + data->count, want);
     if (actual <= 0) {
         ALOGW("read %s: (%d,%d) failed (%d): %s",
             tag, fd, want, (int)actual, strerror(errno));
         return false;
-    } else {
-        //ALOGI("read %s: %d at %d", tag, actual, data->count);
     }
     data->count += actual;
 
     /*
-     * Got more data, look for an EOL.  We expect LF or CRLF, but will
-     * try to handle a standalone CR.
+     * Got more data, look for EOLs.  We expect LF or CRLF, but will try
+     * to handle a standalone CR.  A CR at the very end of the data stays
+     * in the buffer until we know what follows it.
      */
-    char* cp = data->buf;
+    const char* end = data->buf + data->count;
     const char* start = data->buf;
-    int i = data->count;
-    for (i = data->count; i > 0; i--, cp++) {
-        if (*cp == '\n' || (*cp == '\r' && i != 0 && *(cp+1) != '\n')) {
-            *cp = '\0';
-            //ALOGW("GOT %d at %d '%s'", cp - start, start - data->buf, start);
-            ALOG(LOG_INFO, tag, "%s", start);
+    for (const char* cp = data->buf; cp < end; cp++) {
+        if (*cp == '\n') {
+            int len = cp - start;
+            if (len > 0 && *(cp-1) == '\r')
+                len--;
+            addLine(batch, limit, tag, start, len, false);
+            start = cp+1;
+        } else if (*cp == '\r' && cp+1 < end && *(cp+1) != '\n') {
+            addLine(batch, limit, tag, start, cp - start, false);
             start = cp+1;
         }
     }
@@ -240,27 +439,22 @@ static bool readAndLog(int fd, BufferedData* data, const char* tag)
     /*
      * See if we overflowed.  If so, cut it off.
      */
-    if (start == data->buf && data->count == kMaxLine) {
-        data->buf[kMaxLine] = '\0';
-        ALOG(LOG_INFO, tag, "%s!", start);
-        start = cp + kMaxLine;
+    if (start == data->buf && data->count == kBufferSize) {
+        addLine(batch, limit, tag, start, data->count, true);
+        start = end;
     }
 
+    flushBatch(batch, tag);
+
     /*
      * Update "data" if we consumed some output.  If there's anything left
      * in the buffer, it's because we didn't see an EOL and need to keep
      * reading until we see one.
      */
     if (start != data->buf) {
-        if (start >= data->buf + data->count) {
-            /* consumed all available */
-            data->count = 0;
-        } else {
-            /* some left over */
-            int remaining = data->count - (start - data->buf);
-            memmove(data->buf, start, remaining);
-            data->count = remaining;
-        }
+        int remaining = end - start;
+        memmove(data->buf, start, remaining);
+        data->count = remaining;
     }
 
     return true;
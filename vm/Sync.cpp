@@ -15,6 +15,7 @@
  */
 
 #include "Dalvik.h"
+#include "alloc/HeapSource.h"
 
 #include <fcntl.h>
 #include <stdlib.h>
@@ -43,8 +44,15 @@
  * lock encodes its state.  When cleared, the lock is in the "thin"
  * state and its bits are formatted as follows:
  *
- *    [31 ---- 19] [18 ---- 3] [2 ---- 1] [0]
- *     lock count   thread id  hash state  0
+ *    [31] [30 ---- 19] [18 ---- 3] [2 ---- 1] [0]
+ *    bias  lock count   thread id  hash state  0
+ *
+ * A thin lock may be biased to the first thread that acquires it.  While
+ * the bias bit is set only the owning thread writes the lock word, so it
+ * takes and releases the lock with ordinary loads and stores, and the
+ * count field holds how often the lock is held rather than the recursion
+ * depth.  Another thread that wants the lock must first revoke the bias,
+ * which it does with the owner suspended.
  *
  * When set, the lock is in the "fat" state and its bits are formatted
  * as follows:
@@ -69,12 +77,29 @@
  *
  * TODO: the various members of monitor are not SMP-safe.
  */
+/*
+ * FIFO queue of threads, linked through Thread.waitNext/waitPrev.  A
+ * thread is on at most one queue at a time and points back at it from
+ * Thread.waitQueue.  Guarded by the monitor's pthread mutex.
+ */
+struct WaitQueue {
+    Thread*     head;
+    Thread*     tail;
+};
+
 struct Monitor {
     Thread*     owner;          /* which thread currently owns the lock? */
     int         lockCount;      /* owner's recursive lock depth */
     Object*     obj;            /* what object are we part of [debug only] */
 
-    Thread*     waitSet;	/* threads currently waiting on this monitor */
+    WaitQueue   waitSet;        /* threads currently waiting on this monitor */
+
+    /*
+     * Threads that have been notified but not yet woken.  Rather than
+     * waking them all at once, only to have them block on the monitor
+     * we hold, one is woken each time the monitor is released.
+     */
+    WaitQueue   entrySet;
 
     pthread_mutex_t lock;
 
@@ -86,8 +111,31 @@ struct Monitor {
      */
     const Method* ownerMethod;
     u4 ownerPc;
+
+    /*
+     * How many times a contender retries the mutex before blocking.
+     * Doubled when a spin succeeds and halved when it fails, so it
+     * tracks how long this monitor is usually held.
+     */
+    u4 spinLimit;
+
+    /*
+     * Threads blocked on, spinning on or waiting in this monitor.  They
+     * hold a pointer to it that isn't in the lock word, so it must not
+     * be deflated while this is non-zero.
+     */
+    int32_t contenders;
+
+    /* set when a thread had to wait since the last deflation pass */
+    bool contended;
 };
 
+/*
+ * Bounds on Monitor.spinLimit.
+ */
+#define MONITOR_SPIN_MIN    16
+#define MONITOR_SPIN_MAX    1024
+
 
 /*
  * Create and initialize a monitor.
@@ -107,6 +155,8 @@ Monitor* dvmCreateMonitor(Object* obj)
     }
     mon->obj = obj;
     dvmInitMutex(&mon->lock);
+    mon->spinLimit = MONITOR_SPIN_MIN;
+    mon->contended = true;
 
     /* replace the head of the list with the new monitor */
     do {
@@ -144,6 +194,29 @@ Object* dvmGetMonitorObject(Monitor* mon)
         return mon->obj;
 }
 
+/*
+ * Returns true if the thin lock word "thin" is held by thread "threadId".
+ * A biased lock is only held while its hold count is non-zero.
+ */
+static bool thinLockHeldBy(u4 thin, u4 threadId)
+{
+    if (LW_LOCK_OWNER(thin) != threadId) {
+        return false;
+    }
+    return (thin & LW_LOCK_BIASED) == 0 || LW_LOCK_COUNT(thin) != 0;
+}
+
+/*
+ * Converts a biased lock word that is held into the ordinary thin lock
+ * word with the same owner and recursion depth.
+ */
+static u4 unbiasLock(u4 thin)
+{
+    assert((thin & LW_LOCK_BIASED) != 0);
+    assert(LW_LOCK_COUNT(thin) != 0);
+    return (thin & ~LW_LOCK_BIASED) - (1 << LW_LOCK_COUNT_SHIFT);
+}
+
 /*
  * Returns the thread id of the thread owning the given lock.
  */
@@ -159,7 +232,8 @@ static u4 lockOwner(Object* obj)
      */
     lock = obj->lock;
     if (LW_SHAPE(lock) == LW_SHAPE_THIN) {
-        return LW_LOCK_OWNER(lock);
+        return thinLockHeldBy(lock, LW_LOCK_OWNER(lock)) ?
+            LW_LOCK_OWNER(lock) : 0;
     } else {
         owner = LW_MONITOR(lock)->owner;
         return owner ? owner->threadId : 0;
@@ -244,6 +318,50 @@ void dvmSweepMonitorList(Monitor** mon, int (*isUnmarkedObject)(void*))
     *mon = handle.next;
 }
 
+/*
+ * Returns monitors that nobody has contended for since the last pass
+ * to thin-lock state and frees them.  Called with all threads suspended,
+ * after the unmarked monitors have been swept.  A suspended thread isn't
+ * in the middle of examining a lock word, so an unowned monitor with no
+ * contenders and no waiters is only reachable through its object's lock.
+ */
+void dvmDeflateMonitorList(Monitor** mon)
+{
+    Monitor handle;
+    Monitor *prev, *curr;
+    Object *obj;
+    u4 hashState;
+
+    assert(mon != NULL);
+    prev = &handle;
+    prev->next = curr = *mon;
+    while (curr != NULL) {
+        obj = curr->obj;
+        if (obj != NULL && !curr->contended && curr->owner == NULL &&
+            curr->waitSet.head == NULL && curr->entrySet.head == NULL &&
+            curr->contenders == 0) {
+            assert(LW_MONITOR(obj->lock) == curr);
+            hashState = obj->lock & (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT);
+            prev->next = curr->next;
+            freeMonitor(curr);
+            obj->lock = hashState | LW_SHAPE_THIN;
+            curr = prev->next;
+        } else {
+            curr->contended = false;
+            prev = curr;
+            curr = curr->next;
+        }
+    }
+    *mon = handle.next;
+}
+
+void dvmMoveMonitor(Object* obj)
+{
+    assert(obj != NULL);
+    assert(LW_SHAPE(obj->lock) == LW_SHAPE_FAT);
+    LW_MONITOR(obj->lock)->obj = obj;
+}
+
 static char *logWriteInt(char *dst, int value)
 {
     *dst++ = EVENT_TYPE_INT;
@@ -344,6 +462,43 @@ static void logContentionEvent(Thread *self, u4 waitMs, u4 samplePercent,
 /*
  * Lock a monitor.
  */
+/*
+ * Spin on a contended monitor for a while, hoping the owner releases
+ * it before we would have to block on the mutex.  Stops early
+ * once the owner is no longer running, because then it won't be
+ * releasing the lock soon.
+ *
+ * Reading the owner's status without the thread list lock is racy, but the
+ * result is only a hint: the owner can't exit while it holds the
+ * monitor, and a stale read just ends the spin early or late.
+ *
+ * Returns "true" if we acquired the mutex.
+ */
+static bool spinOnMonitor(Monitor* mon)
+{
+    if (ANDROID_SMP == 0) {
+        return false;
+    }
+
+    u4 limit = mon->spinLimit;
+    for (u4 i = 0; i < limit; i++) {
+        Thread* owner = mon->owner;
+        if (owner != NULL && owner->status != THREAD_RUNNING) {
+            break;
+        }
+        if (dvmTryLockMutex(&mon->lock) == 0) {
+            if (limit < MONITOR_SPIN_MAX) {
+                mon->spinLimit = limit * 2;
+            }
+            return true;
+        }
+    }
+    if (limit > MONITOR_SPIN_MIN) {
+        mon->spinLimit = limit / 2;
+    }
+    return false;
+}
+
 static void lockMonitor(Thread* self, Monitor* mon)
 {
     ThreadStatus oldStatus;
@@ -354,10 +509,17 @@ static void lockMonitor(Thread* self, Monitor* mon)
         mon->lockCount++;
         return;
     }
-    if (dvmTryLockMutex(&mon->lock) != 0) {
+    bool contended = (dvmTryLockMutex(&mon->lock) != 0);
+    if (contended) {
+        android_atomic_inc(&mon->contenders);
+        mon->contended = true;
+        dvmBumpThreadMetric(self, kThreadMetricMonitorContended, 1);
+    }
+    if (contended && !spinOnMonitor(mon)) {
         oldStatus = dvmChangeStatus(self, THREAD_MONITOR);
         waitThreshold = gDvm.lockProfThreshold;
-        if (waitThreshold) {
+        bool profile = (gDvm.lockProfile != NULL && mon->obj != NULL);
+        if (waitThreshold || profile) {
             waitStart = dvmGetRelativeTimeUsec();
         }
 
@@ -365,10 +527,13 @@ static void lockMonitor(Thread* self, Monitor* mon)
         u4 currentOwnerPc = mon->ownerPc;
 
         dvmLockMutex(&mon->lock);
-        if (waitThreshold) {
+        if (waitThreshold || profile) {
             waitEnd = dvmGetRelativeTimeUsec();
         }
         dvmChangeStatus(self, oldStatus);
+        if (profile) {
+            dvmProfileLockContention(self, mon->obj, waitEnd - waitStart);
+        }
         if (waitThreshold) {
             waitMs = (waitEnd - waitStart) / 1000;
             if (waitMs >= waitThreshold) {
@@ -391,6 +556,9 @@ static void lockMonitor(Thread* self, Monitor* mon)
             }
         }
     }
+    if (contended) {
+        android_atomic_dec(&mon->contenders);
+    }
     mon->owner = self;
     assert(mon->lockCount == 0);
 
@@ -416,7 +584,6 @@ static void lockMonitor(Thread* self, Monitor* mon)
  *
  * Returns "true" on success.
  */
-#ifdef WITH_COPYING_GC
 static bool tryLockMonitor(Thread* self, Monitor* mon)
 {
     if (mon->owner == self) {
@@ -432,8 +599,97 @@ static bool tryLockMonitor(Thread* self, Monitor* mon)
         }
     }
 }
+
+/*
+ * Checks a wait queue for broken links.  Returns 0 if the list is
+ * consistent.  Otherwise, returns 1.  Used only by asserts.
+ */
+#ifndef NDEBUG
+static int waitQueueCheck(const WaitQueue *queue)
+{
+    const Thread *elt, *prev;
+
+    assert(queue != NULL);
+    prev = NULL;
+    for (elt = queue->head; elt != NULL; elt = elt->waitNext) {
+        if (elt->waitPrev != prev || elt->waitQueue != queue) return 1;
+        prev = elt;
+    }
+    return (queue->tail == prev) ? 0 : 1;
+}
 #endif
 
+/*
+ * Links a thread onto the tail of a monitor wait queue.  The monitor
+ * lock must be held by the caller of this routine.
+ */
+static void waitQueueAppend(WaitQueue *queue, Thread *thread)
+{
+    assert(queue != NULL);
+    assert(thread != NULL);
+    assert(thread->waitQueue == NULL);
+    assert(thread->waitNext == NULL && thread->waitPrev == NULL);
+    assert(waitQueueCheck(queue) == 0);
+    thread->waitPrev = queue->tail;
+    if (queue->tail == NULL) {
+        queue->head = thread;
+    } else {
+        queue->tail->waitNext = thread;
+    }
+    queue->tail = thread;
+    thread->waitQueue = queue;
+}
+
+/*
+ * Unlinks a thread from whichever wait queue it is on, if any.  The
+ * monitor lock must be held by the caller of this routine.
+ */
+static void waitQueueRemove(Thread *thread)
+{
+    WaitQueue *queue;
+
+    assert(thread != NULL);
+    queue = thread->waitQueue;
+    if (queue == NULL) {
+        return;
+    }
+    assert(waitQueueCheck(queue) == 0);
+    if (thread->waitPrev == NULL) {
+        queue->head = thread->waitNext;
+    } else {
+        thread->waitPrev->waitNext = thread->waitNext;
+    }
+    if (thread->waitNext == NULL) {
+        queue->tail = thread->waitPrev;
+    } else {
+        thread->waitNext->waitPrev = thread->waitPrev;
+    }
+    thread->waitNext = thread->waitPrev = NULL;
+    thread->waitQueue = NULL;
+}
+
+/*
+ * Wakes the first notified thread that is still waiting, if any.
+ * Called with the monitor lock held, just before the monitor is
+ * released.
+ */
+static void wakeNextEntrant(Monitor *mon)
+{
+    Thread *thread;
+
+    while ((thread = mon->entrySet.head) != NULL) {
+        waitQueueRemove(thread);
+        dvmLockMutex(&thread->waitMutex);
+        /* Check to see if the thread is still waiting. */
+        if (thread->waitMonitor != NULL) {
+            pthread_cond_signal(&thread->waitCond);
+            dvmUnlockMutex(&thread->waitMutex);
+            return;
+        }
+        dvmUnlockMutex(&thread->waitMutex);
+    }
+}
+
 /*
  * Unlock a monitor.
  *
@@ -452,6 +708,7 @@ static bool unlockMonitor(Thread* self, Monitor* mon)
             mon->owner = NULL;
             mon->ownerMethod = NULL;
             mon->ownerPc = 0;
+            wakeNextEntrant(mon);
             dvmUnlockMutex(&mon->lock);
         } else {
             mon->lockCount--;
@@ -468,85 +725,6 @@ static bool unlockMonitor(Thread* self, Monitor* mon)
     return true;
 }
 
-/*
- * Checks the wait set for circular structure.  Returns 0 if the list
- * is not circular.  Otherwise, returns 1.  Used only by asserts.
- */
-#ifndef NDEBUG
-static int waitSetCheck(Monitor *mon)
-{
-    Thread *fast, *slow;
-    size_t n;
-
-    assert(mon != NULL);
-    fast = slow = mon->waitSet;
-    n = 0;
-    for (;;) {
-        if (fast == NULL) return 0;
-        if (fast->waitNext == NULL) return 0;
-        if (fast == slow && n > 0) return 1;
-        n += 2;
-        fast = fast->waitNext->waitNext;
-        slow = slow->waitNext;
-    }
-}
-#endif
-
-/*
- * Links a thread into a monitor's wait set.  The monitor lock must be
- * held by the caller of this routine.
- */
-static void waitSetAppend(Monitor *mon, Thread *thread)
-{
-    Thread *elt;
-
-    assert(mon != NULL);
-    assert(mon->owner == dvmThreadSelf());
-    assert(thread != NULL);
-    assert(thread->waitNext == NULL);
-    assert(waitSetCheck(mon) == 0);
-    if (mon->waitSet == NULL) {
-        mon->waitSet = thread;
-        return;
-    }
-    elt = mon->waitSet;
-    while (elt->waitNext != NULL) {
-        elt = elt->waitNext;
-    }
-    elt->waitNext = thread;
-}
-
-/*
- * Unlinks a thread from a monitor's wait set.  The monitor lock must
- * be held by the caller of this routine.
- */
-static void waitSetRemove(Monitor *mon, Thread *thread)
-{
-    Thread *elt;
-
-    assert(mon != NULL);
-    assert(mon->owner == dvmThreadSelf());
-    assert(thread != NULL);
-    assert(waitSetCheck(mon) == 0);
-    if (mon->waitSet == NULL) {
-        return;
-    }
-    if (mon->waitSet == thread) {
-        mon->waitSet = thread->waitNext;
-        thread->waitNext = NULL;
-        return;
-    }
-    elt = mon->waitSet;
-    while (elt->waitNext != NULL) {
-        if (elt->waitNext == thread) {
-            elt->waitNext = thread->waitNext;
-            thread->waitNext = NULL;
-            return;
-        }
-        elt = elt->waitNext;
-    }
-}
-
 /*
  * Converts the given relative waiting time into an absolute time.
  */
@@ -663,7 +841,9 @@ static void waitMonitor(Thread* self, Monitor* mon, s8 msec, s4 nsec,
      * the monitor.  Aside from that, the order of member updates is
      * not order sensitive as we hold the pthread mutex.
      */
-    waitSetAppend(mon, self);
+    waitQueueAppend(&mon->waitSet, self);
+    android_atomic_inc(&mon->contenders);
+    mon->contended = true;
     int prevLockCount = mon->lockCount;
     mon->lockCount = 0;
     mon->owner = NULL;
@@ -708,6 +888,7 @@ static void waitMonitor(Thread* self, Monitor* mon, s8 msec, s4 nsec,
      * Release the monitor lock and wait for a notification or
      * a timeout to occur.
      */
+    wakeNextEntrant(mon);
     dvmUnlockMutex(&mon->lock);
 
     if (!timed) {
@@ -735,16 +916,17 @@ static void waitMonitor(Thread* self, Monitor* mon, s8 msec, s4 nsec,
 
 done:
     /*
-     * We remove our thread from wait set after restoring the count
-     * and owner fields so the subroutine can check that the calling
-     * thread owns the monitor. Aside from that, the order of member
-     * updates is not order sensitive as we hold the pthread mutex.
+     * Restore the count and owner fields, and take our thread off the
+     * wait set or entry set if a notification didn't already.  The
+     * order of member updates is not order sensitive as we hold the
+     * pthread mutex.
      */
     mon->owner = self;
     mon->lockCount = prevLockCount;
+    android_atomic_dec(&mon->contenders);
     mon->ownerMethod = savedMethod;
     mon->ownerPc = savedPc;
-    waitSetRemove(mon, self);
+    waitQueueRemove(self);
 
     /* set self->status back to THREAD_RUNNING, and self-suspend if needed */
     dvmChangeStatus(self, THREAD_RUNNING);
@@ -780,19 +962,20 @@ static void notifyMonitor(Thread* self, Monitor* mon)
             "object not locked by thread before notify()");
         return;
     }
-    /* Signal the first waiting thread in the wait set. */
-    while (mon->waitSet != NULL) {
-        thread = mon->waitSet;
-        mon->waitSet = thread->waitNext;
-        thread->waitNext = NULL;
+    /*
+     * Move the first waiting thread in the wait set to the entry set.
+     * It is woken when we release the monitor.
+     */
+    while ((thread = mon->waitSet.head) != NULL) {
+        waitQueueRemove(thread);
         dvmLockMutex(&thread->waitMutex);
         /* Check to see if the thread is still waiting. */
-        if (thread->waitMonitor != NULL) {
-            pthread_cond_signal(&thread->waitCond);
-            dvmUnlockMutex(&thread->waitMutex);
+        bool waiting = (thread->waitMonitor != NULL);
+        dvmUnlockMutex(&thread->waitMutex);
+        if (waiting) {
+            waitQueueAppend(&mon->entrySet, thread);
             return;
         }
-        dvmUnlockMutex(&thread->waitMutex);
     }
 }
 
@@ -812,17 +995,16 @@ static void notifyAllMonitor(Thread* self, Monitor* mon)
             "object not locked by thread before notifyAll()");
         return;
     }
-    /* Signal all threads in the wait set. */
-    while (mon->waitSet != NULL) {
-        thread = mon->waitSet;
-        mon->waitSet = thread->waitNext;
-        thread->waitNext = NULL;
-        dvmLockMutex(&thread->waitMutex);
-        /* Check to see if the thread is still waiting. */
-        if (thread->waitMonitor != NULL) {
-            pthread_cond_signal(&thread->waitCond);
-        }
-        dvmUnlockMutex(&thread->waitMutex);
+    /*
+     * Move the whole wait set to the entry set.  The threads are woken
+     * one at a time as the monitor is released, instead of all at once
+     * only to queue up on the monitor's mutex.  Threads that stopped
+     * waiting on their own (timeout, interrupt) take themselves off the
+     * entry set, so they can move with the others.
+     */
+    while ((thread = mon->waitSet.head) != NULL) {
+        waitQueueRemove(thread);
+        waitQueueAppend(&mon->entrySet, thread);
     }
 }
 
@@ -851,6 +1033,64 @@ static void inflateMonitor(Thread *self, Object *obj)
     android_atomic_release_store(thin, (int32_t *)&obj->lock);
 }
 
+/*
+ * Rewrites a biased lock word.  Runs as a checkpoint of the owner, or
+ * directly if the owner has exited.  A held lock becomes an ordinary
+ * thin lock of its owner.  An unheld one is inflated to an unowned
+ * monitor, so that a lock shared between threads isn't biased again
+ * until the monitor is deflated.
+ */
+static void revokeBiasCheckpoint(Thread* owner, void* arg)
+{
+    Object* obj = (Object*) arg;
+    volatile u4 *lw = &obj->lock;
+    u4 lock = *lw;
+
+    /* The owner may have removed the bias itself before it stopped. */
+    if (LW_SHAPE(lock) == LW_SHAPE_THIN && (lock & LW_LOCK_BIASED) != 0) {
+        if (LW_LOCK_COUNT(lock) != 0) {
+            lock = unbiasLock(lock);
+        } else {
+            Monitor* mon = dvmCreateMonitor(obj);
+            lock &= LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT;
+            lock |= (u4)mon | LW_SHAPE_FAT;
+        }
+        android_atomic_release_store(lock, (int32_t *)lw);
+        ALOGV("revoked bias of lock %p", lw);
+    }
+}
+
+/*
+ * Takes away the bias of a thin lock that is biased to another thread.
+ * The owner updates a biased lock word without atomics, so the word is
+ * rewritten in a checkpoint, while the owner is at a safe point.
+ *
+ * The thread list lock also keeps the owner's thread id from being
+ * reused if the owner has exited.
+ */
+static void revokeBias(Thread* self, Object* obj)
+{
+    volatile u4 *lw = &obj->lock;
+    Thread* owner;
+    u4 lock;
+
+    dvmLockThreadList(self);
+    lock = *lw;
+    if (LW_SHAPE(lock) != LW_SHAPE_THIN || (lock & LW_LOCK_BIASED) == 0) {
+        /* Another thread revoked it while we waited for the list lock. */
+        dvmUnlockThreadList();
+        return;
+    }
+    owner = dvmGetThreadByThreadId(LW_LOCK_OWNER(lock));
+    assert(owner != self);
+    if (owner != NULL) {
+        dvmRunCheckpoint(owner, revokeBiasCheckpoint, obj);
+    } else {
+        revokeBiasCheckpoint(NULL, obj);
+    }
+    dvmUnlockThreadList();
+}
+
 /*
  * Implements monitorenter for "synchronized" stuff.
  *
@@ -878,6 +1118,31 @@ retry:
          * The lock is a thin lock.  The owner field is used to
          * determine the acquire method, ordered by cost.
          */
+        if ((thin & LW_LOCK_BIASED) != 0) {
+            if (LW_LOCK_OWNER(thin) != threadId) {
+                /*
+                 * The lock is biased to another thread.  Take the
+                 * bias away and try again.
+                 */
+                revokeBias(self, obj);
+                goto retry;
+            }
+            if (LW_LOCK_COUNT(thin) < LW_LOCK_COUNT_MASK) {
+                /*
+                 * The lock is biased to the calling thread.  No other
+                 * thread writes the lock word, so count the hold with
+                 * a plain store.
+                 */
+                *thinp = thin + (1 << LW_LOCK_COUNT_SHIFT);
+                return;
+            }
+            /*
+             * The hold count is full.  Drop the bias and let the
+             * recursive acquire below inflate the lock.
+             */
+            *thinp = unbiasLock(thin);
+            goto retry;
+        }
         if (LW_LOCK_OWNER(thin) == threadId) {
             /*
              * The calling thread owns the lock.  Increment the
@@ -900,6 +1165,9 @@ retry:
              * will have tried this before calling out to the VM.
              */
             newThin = thin | (threadId << LW_LOCK_OWNER_SHIFT);
+            if (gDvm.biasedLocking) {
+                newThin |= LW_LOCK_BIASED | (1 << LW_LOCK_COUNT_SHIFT);
+            }
             if (android_atomic_acquire_cas(thin, newThin,
                     (int32_t*)thinp) != 0) {
                 /*
@@ -914,7 +1182,10 @@ retry:
              * The lock is owned by another thread.  Notify the VM
              * that we are about to wait.
              */
+            dvmBumpThreadMetric(self, kThreadMetricMonitorContended, 1);
             oldStatus = dvmChangeStatus(self, THREAD_MONITOR);
+            u8 waitStart = (gDvm.lockProfile != NULL) ?
+                dvmGetRelativeTimeUsec() : 0;
             /*
              * Spin until the thin lock is released or inflated.
              */
@@ -925,7 +1196,16 @@ retry:
                  * Check the shape of the lock word.  Another thread
                  * may have inflated the lock while we were waiting.
                  */
-                if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
+                if (LW_SHAPE(thin) == LW_SHAPE_THIN &&
+                    (thin & LW_LOCK_BIASED) != 0) {
+                    /*
+                     * The lock was released and biased by another
+                     * thread.  Let the VM know we are no longer
+                     * waiting and try again, which revokes the bias.
+                     */
+                    dvmChangeStatus(self, oldStatus);
+                    goto retry;
+                } else if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
                     if (LW_LOCK_OWNER(thin) == 0) {
                         /*
                          * The lock has been released.  Install the
@@ -983,6 +1263,10 @@ retry:
              * we are no longer waiting.
              */
             dvmChangeStatus(self, oldStatus);
+            if (waitStart != 0) {
+                dvmProfileLockContention(self, obj,
+                    dvmGetRelativeTimeUsec() - waitStart);
+            }
             /*
              * Fatten the lock.
              */
@@ -1020,7 +1304,18 @@ bool dvmUnlockObject(Thread* self, Object *obj)
          * The lock is thin.  We must ensure that the lock is owned
          * by the given thread before unlocking it.
          */
-        if (LW_LOCK_OWNER(thin) == self->threadId) {
+        if ((thin & LW_LOCK_BIASED) != 0) {
+            if (!thinLockHeldBy(thin, self->threadId)) {
+                dvmThrowIllegalMonitorStateException(
+                    "unlock of unowned monitor");
+                return false;
+            }
+            /*
+             * The lock is biased to us and stays biased once
+             * released, so just drop the hold count.
+             */
+            obj->lock = thin - (1 << LW_LOCK_COUNT_SHIFT);
+        } else if (LW_LOCK_OWNER(thin) == self->threadId) {
             /*
              * We are the lock owner.  It is safe to update the lock
              * without CAS as lock ownership guards the lock itself.
@@ -1078,11 +1373,14 @@ void dvmObjectWait(Thread* self, Object *obj, s8 msec, s4 nsec,
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /* Make sure that 'self' holds the lock.
          */
-        if (LW_LOCK_OWNER(thin) != self->threadId) {
+        if (!thinLockHeldBy(thin, self->threadId)) {
             dvmThrowIllegalMonitorStateException(
                 "object not locked by thread before wait()");
             return;
         }
+        if ((thin & LW_LOCK_BIASED) != 0) {
+            obj->lock = unbiasLock(thin);
+        }
 
         /* This thread holds the lock.  We need to fatten the lock
          * so 'self' can block on it.  Don't update the object lock
@@ -1109,7 +1407,7 @@ void dvmObjectNotify(Thread* self, Object *obj)
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /* Make sure that 'self' holds the lock.
          */
-        if (LW_LOCK_OWNER(thin) != self->threadId) {
+        if (!thinLockHeldBy(thin, self->threadId)) {
             dvmThrowIllegalMonitorStateException(
                 "object not locked by thread before notify()");
             return;
@@ -1137,7 +1435,7 @@ void dvmObjectNotifyAll(Thread* self, Object *obj)
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /* Make sure that 'self' holds the lock.
          */
-        if (LW_LOCK_OWNER(thin) != self->threadId) {
+        if (!thinLockHeldBy(thin, self->threadId)) {
             dvmThrowIllegalMonitorStateException(
                 "object not locked by thread before notifyAll()");
             return;
@@ -1219,14 +1517,13 @@ void dvmThreadInterrupt(Thread* thread)
     dvmUnlockMutex(&thread->waitMutex);
 }
 
-#ifndef WITH_COPYING_GC
-u4 dvmIdentityHashCode(Object *obj)
-{
-    return (u4)obj;
-}
-#else
 /*
  * Returns the identity hash code of the given object.
+ *
+ * The hash code is derived from the object address, so the hash state
+ * of the object is recorded in its lock word whenever the collector may
+ * move objects.  The collector never moves an object that has been
+ * hashed without relocating its hash code.
  */
 u4 dvmIdentityHashCode(Object *obj)
 {
@@ -1241,6 +1538,14 @@ u4 dvmIdentityHashCode(Object *obj)
          */
         return 0;
     }
+#ifndef WITH_COPYING_GC
+    if (!gDvm.idleCompaction) {
+        /*
+         * Objects never move, there is no need to track the hash state.
+         */
+        return (u4)obj >> 3;
+    }
+#endif
     lw = &obj->lock;
 retry:
     hashState = LW_HASH_STATE(*lw);
@@ -1260,17 +1565,38 @@ retry:
         assert(!dvmIsClassObject(obj));
         if (IS_CLASS_FLAG_SET(obj->clazz, CLASS_ISARRAY)) {
             size = dvmArrayObjectSize((ArrayObject *)obj);
-            size = (size + 2) & ~2;
+            size = (size + 3) & ~3;
         } else {
             size = obj->clazz->objectSize;
         }
         return *(u4 *)(((char *)obj) + size);
     } else if (hashState == LW_HASH_STATE_UNHASHED) {
+        if (dvmHeapSourceIsInZygoteHeap(obj)) {
+            /*
+             * Objects in the zygote heap never move, so the address
+             * will do without recording the hash state.  Writing the
+             * lock word would dirty a page shared with the zygote.
+             */
+            return (u4)obj >> 3;
+        }
         /*
          * The object has never been hashed.  Change the hash state to
          * hashed and use the raw object address.
          */
         self = dvmThreadSelf();
+        lock = *lw;
+        if (LW_SHAPE(lock) == LW_SHAPE_THIN &&
+            (lock & LW_LOCK_BIASED) != 0) {
+            if (LW_LOCK_OWNER(lock) != self->threadId) {
+                revokeBias(self, obj);
+                goto retry;
+            }
+            /*
+             * The lock is biased to us, so nobody else writes it.
+             */
+            *lw |= (LW_HASH_STATE_HASHED << LW_HASH_STATE_SHIFT);
+            return (u4)obj >> 3;
+        }
         if (self->threadId == lockOwner(obj)) {
             /*
              * We already own the lock so we can update the hash state
@@ -1328,16 +1654,10 @@ retry:
             owner = LW_LOCK_OWNER(lock);
             assert(owner != self->threadId);
             /*
-             * If the lock has no owner do not bother scanning the
-             * thread list and fall through to the failure handler.
+             * If the lock has no owner this returns NULL and we fall
+             * through to the failure handler.
              */
-            thread = owner ? gDvm.threadList : NULL;
-            while (thread != NULL) {
-                if (thread->threadId == owner) {
-                    break;
-                }
-                thread = thread->next;
-            }
+            thread = dvmGetThreadByThreadId(owner);
         } else {
             thread = LW_MONITOR(lock)->owner;
         }
@@ -1375,4 +1695,3 @@ retry:
     dvmAbort();
     return 0;  /* Quiet the compiler. */
 }
-#endif  /* WITH_COPYING_GC */
@@ -59,10 +59,17 @@
  * Lock recursion count field.  Contains a count of the numer of times
  * a lock has been recursively acquired.
  */
-#define LW_LOCK_COUNT_MASK 0x1fff
+#define LW_LOCK_COUNT_MASK 0xfff
 #define LW_LOCK_COUNT_SHIFT 19
 #define LW_LOCK_COUNT(x) (((x) >> LW_LOCK_COUNT_SHIFT) & LW_LOCK_COUNT_MASK)
 
+/*
+ * Lock bias field.  When set on a thin lock, the lock is biased to the
+ * thread in the owner field and the count field holds the number of
+ * times that thread currently holds it, which may be zero.
+ */
+#define LW_LOCK_BIASED 0x80000000
+
 struct Object;
 struct Monitor;
 struct Thread;
@@ -117,6 +124,18 @@ Monitor* dvmCreateMonitor(Object* obj);
  */
 void dvmSweepMonitorList(Monitor** mon, int (*isUnmarkedObject)(void*));
 
+/*
+ * Returns idle monitors to thin-lock state and frees them.  All threads
+ * must be suspended.
+ */
+void dvmDeflateMonitorList(Monitor** mon);
+
+/*
+ * Points the fat lock of an object the collector has just moved at
+ * the object's new address.
+ */
+void dvmMoveMonitor(Object* obj);
+
 /* free monitor list */
 void dvmFreeMonitorList(void);
 
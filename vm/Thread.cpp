@@ -18,6 +18,7 @@
  * Thread support.
  */
 #include "Dalvik.h"
+#include "alloc/HeapSource.h"
 #include "os/os.h"
 
 #include <stdlib.h>
@@ -32,6 +33,7 @@
 
 #ifdef HAVE_ANDROID_OS
 #include <dirent.h>
+#include <cutils/open_memstream.h>
 #endif
 
 #if defined(HAVE_PRCTL)
@@ -229,11 +231,15 @@ Some other concerns with flinging signals around:
 #define kMaxThreadId        ((1 << 16) - 1)
 #define kMainThreadId       1
 
+/* how many interpreter stacks to keep for reuse */
+#define kMaxPooledInterpStacks  8
+
 
 static Thread* allocThread(int interpStackSize);
 static bool prepareThread(Thread* thread);
 static void setThreadSelf(Thread* thread);
 static void unlinkThread(Thread* thread);
+static void setThreadIdEntry(u4 threadId, Thread* thread);
 static void freeThread(Thread* thread);
 static void assignThreadId(Thread* thread);
 static bool createFakeEntryFrame(Thread* thread);
@@ -270,6 +276,8 @@ bool dvmThreadStartup()
     dvmInitMutex(&gDvm._threadSuspendLock);
     dvmInitMutex(&gDvm.threadSuspendCountLock);
     pthread_cond_init(&gDvm.threadSuspendCountCond, NULL);
+    pthread_cond_init(&gDvm.threadSuspendAckCond, NULL);
+    dvmInitMutex(&gDvm.interpStackPoolLock);
 
     /*
      * Dedicated monitor for Thread.sleep().
@@ -295,6 +303,7 @@ bool dvmThreadStartup()
      */
     prepareThread(thread);
     gDvm.threadList = thread;
+    setThreadIdEntry(thread->threadId, thread);
 
 #ifdef COUNT_PRECISE_METHODS
     gDvm.preciseMethods = dvmPointerSetAlloc(200);
@@ -321,6 +330,15 @@ void dvmThreadShutdown()
 
     dvmFreeBitVector(gDvm.threadIdMap);
 
+#ifndef MALLOC_INTERP_STACK
+    while (gDvm.interpStackPool != NULL) {
+        u1* stackBottom = gDvm.interpStackPool;
+        gDvm.interpStackPool = *(u1**) stackBottom;
+        munmap(stackBottom, gDvm.stackSize);
+    }
+    gDvm.interpStackPoolCount = 0;
+#endif
+
     dvmFreeMonitorList();
 
     pthread_key_delete(gDvm.pthreadKeySelf);
@@ -351,6 +369,19 @@ static inline void unlockThreadSuspendCount()
     dvmUnlockMutex(&gDvm.threadSuspendCountLock);
 }
 
+/*
+ * Wake up a thread waiting in waitForThreadSuspend() for us to stop
+ * running.  Only needed if a suspend is pending.
+ */
+static void signalSuspendAck(Thread* self)
+{
+    if (self->suspendCount != 0) {
+        lockThreadSuspendCount();
+        dvmBroadcastCond(&gDvm.threadSuspendAckCond);
+        unlockThreadSuspendCount();
+    }
+}
+
 /*
  * Grab the thread list global lock.
  *
@@ -383,6 +414,10 @@ void dvmLockThreadList(Thread* self)
     if (self != NULL) {
         oldStatus = self->status;
         self->status = THREAD_VMWAIT;
+        if (oldStatus == THREAD_RUNNING) {
+            /* the thread doing a suspend-all may be holding the list lock */
+            signalSuspendAck(self);
+        }
     } else {
         /* happens during VM shutdown */
         oldStatus = THREAD_UNDEFINED;  // shut up gcc
@@ -802,6 +837,52 @@ bool dvmPrepMainThread()
  *
  * Does not create any objects, just stuff on the system (malloc) heap.
  */
+#ifndef MALLOC_INTERP_STACK
+/*
+ * Get an interpreter stack of the requested size from the pool.  Returns
+ * NULL if there isn't one.
+ */
+static u1* takePooledInterpStack(int interpStackSize)
+{
+    u1* stackBottom = NULL;
+
+    if ((size_t) interpStackSize != gDvm.stackSize)
+        return NULL;
+
+    dvmLockMutex(&gDvm.interpStackPoolLock);
+    if (gDvm.interpStackPool != NULL) {
+        stackBottom = gDvm.interpStackPool;
+        gDvm.interpStackPool = *(u1**) stackBottom;
+        gDvm.interpStackPoolCount--;
+    }
+    dvmUnlockMutex(&gDvm.interpStackPoolLock);
+    return stackBottom;
+}
+
+/*
+ * Offer an interpreter stack to the pool.  The pages are given back to
+ * the kernel, which keeps the mapping but will zero-fill them again on
+ * first touch.  Returns false if the stack wasn't taken.
+ */
+static bool poolInterpStack(u1* stackBottom, int interpStackSize)
+{
+    if ((size_t) interpStackSize != gDvm.stackSize)
+        return false;
+
+    madvise(stackBottom, interpStackSize, MADV_DONTNEED);
+
+    dvmLockMutex(&gDvm.interpStackPoolLock);
+    bool pooled = (gDvm.interpStackPoolCount < kMaxPooledInterpStacks);
+    if (pooled) {
+        *(u1**) stackBottom = gDvm.interpStackPool;
+        gDvm.interpStackPool = stackBottom;
+        gDvm.interpStackPoolCount++;
+    }
+    dvmUnlockMutex(&gDvm.interpStackPoolLock);
+    return pooled;
+}
+#endif
+
 static Thread* allocThread(int interpStackSize)
 {
     Thread* thread;
@@ -843,8 +924,11 @@ static Thread* allocThread(int interpStackSize)
     }
     memset(stackBottom, 0xc5, interpStackSize);     // stop valgrind complaints
 #else
-    stackBottom = (u1*) mmap(NULL, interpStackSize, PROT_READ | PROT_WRITE,
-        MAP_PRIVATE | MAP_ANON, -1, 0);
+    stackBottom = takePooledInterpStack(interpStackSize);
+    if (stackBottom == NULL) {
+        stackBottom = (u1*) mmap(NULL, interpStackSize,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    }
     if (stackBottom == MAP_FAILED) {
 #if defined(WITH_SELF_VERIFICATION)
         dvmSelfVerificationShadowSpaceFree(thread);
@@ -871,6 +955,8 @@ static Thread* allocThread(int interpStackSize)
     /* One-time setup for interpreter/JIT state */
     dvmInitInterpreterState(thread);
 
+    thread->metrics = dvmMetricsAcquireBlock();
+
     return thread;
 }
 
@@ -963,6 +1049,33 @@ static void unlinkThread(Thread* thread)
     if (thread->next != NULL)
         thread->next->prev = thread->prev;
     thread->prev = thread->next = NULL;
+    setThreadIdEntry(thread->threadId, NULL);
+}
+
+/*
+ * Enter a thread in the thread ID table, or remove it if "thread" is
+ * NULL.  Caller must hold gDvm.threadListLock.
+ *
+ * Lookups read the table without locks, so chunks are fully built before
+ * they're published and are never freed.
+ */
+static void setThreadIdEntry(u4 threadId, Thread* thread)
+{
+    assert(threadId != 0 && threadId <= kMaxThreadId);
+
+    Thread*** pChunk = &gDvm.threadIdTable[threadId >> THREAD_ID_CHUNK_SHIFT];
+    Thread** chunk = *pChunk;
+    if (chunk == NULL) {
+        chunk = (Thread**) calloc(THREAD_ID_CHUNK_SIZE, sizeof(Thread*));
+        if (chunk == NULL) {
+            ALOGE("Unable to allocate thread ID table chunk");
+            dvmAbort();
+        }
+        android_atomic_release_store((int32_t) chunk,
+            (volatile int32_t*) pChunk);
+    }
+    android_atomic_release_store((int32_t) thread,
+        (volatile int32_t*) &chunk[threadId & (THREAD_ID_CHUNK_SIZE - 1)]);
 }
 
 /*
@@ -984,8 +1097,11 @@ static void freeThread(Thread* thread)
 #ifdef MALLOC_INTERP_STACK
         free(interpStackBottom);
 #else
-        if (munmap(interpStackBottom, thread->interpStackSize) != 0)
+        if (!poolInterpStack(interpStackBottom, thread->interpStackSize) &&
+            munmap(interpStackBottom, thread->interpStackSize) != 0)
+        {
             ALOGW("munmap(thread stack) failed");
+        }
 #endif
     }
 
@@ -997,6 +1113,10 @@ static void freeThread(Thread* thread)
 #if defined(WITH_SELF_VERIFICATION)
     dvmSelfVerificationShadowSpaceFree(thread);
 #endif
+#if defined(WITH_JIT)
+    free(thread->jitProfTable);
+#endif
+    dvmMetricsReleaseBlock(thread->metrics);
     free(thread);
 }
 
@@ -1410,6 +1530,7 @@ bool dvmCreateInterpThread(Object* threadObj, int reqStackSize)
         newThread->next->prev = newThread;
     newThread->prev = gDvm.threadList;
     gDvm.threadList->next = newThread;
+    setThreadIdEntry(newThread->threadId, newThread);
 
     /* Add any existing global modes to the interpBreak control */
     dvmInitializeInterpBreak(newThread);
@@ -1821,6 +1942,7 @@ bool dvmAttachCurrentThread(const JavaVMAttachArgs* pArgs, bool isDaemon)
         self->next->prev = self;
     self->prev = gDvm.threadList;
     gDvm.threadList->next = self;
+    setThreadIdEntry(self->threadId, self);
     if (!isDaemon)
         gDvm.nonDaemonThreadCount++;
 
@@ -2089,6 +2211,16 @@ void dvmDetachCurrentThread()
     dvmReleaseTrackedAlloc(vmThread, self);
     vmThread = NULL;
 
+    /*
+     * Give back whatever is left in our allocation buffers.  The GC
+     * would only find the slots on the thread list, which we are
+     * about to leave.  An arena we never ended is left to the GC.
+     */
+    dvmLockHeap();
+    dvmHeapSourceRetireTlabs(self);
+    dvmHeapSourceCloseArena(self, false);
+    dvmUnlockHeap();
+
     /*
      * We're done manipulating objects, so it's okay if the GC runs in
      * parallel with us from here out.  It's important to do this if
@@ -2193,6 +2325,104 @@ void dvmSuspendThread(Thread* thread)
     waitForThreadSuspend(dvmThreadSelf(), thread);
 }
 
+/*
+ * A checkpoint request, owned by the requesting thread.  The target's
+ * "checkpoint" pointer and "done" are guarded by threadSuspendCountLock.
+ */
+struct Checkpoint {
+    CheckpointFunc  func;
+    void*           arg;
+    bool            done;
+};
+
+/*
+ * Run a pending checkpoint on ourselves.  Called from the suspend check
+ * with the suspend count lock held; the lock is released while the
+ * checkpoint function runs.
+ *
+ * The request holds one suspend count, which we drop when done.
+ */
+static void runPendingCheckpoint(Thread* self)
+{
+    Checkpoint* cp = self->checkpoint;
+    if (cp == NULL)
+        return;
+
+    self->checkpoint = NULL;
+    unlockThreadSuspendCount();
+    (*cp->func)(self, cp->arg);
+    lockThreadSuspendCount();
+
+    dvmAddToSuspendCounts(self, -1, 0);
+    cp->done = true;
+    dvmBroadcastCond(&gDvm.threadSuspendAckCond);
+}
+
+/*
+ * Run a function against one thread at its next safe point.
+ *
+ * We raise the target's suspend count so that it polls at its next safe
+ * point, and so that it can't return to RUNNING behind our back once it
+ * has stopped.  Whichever side sees the request first runs it: the target
+ * in fullSuspendCheck() if it's still running managed code, or us if it
+ * has left THREAD_RUNNING.
+ */
+void dvmRunCheckpoint(Thread* thread, CheckpointFunc func, void* arg)
+{
+    Thread* self = dvmThreadSelf();
+
+    assert(thread != NULL);
+    if (thread == self) {
+        (*func)(self, arg);
+        return;
+    }
+
+    Checkpoint cp;
+    cp.func = func;
+    cp.arg = arg;
+    cp.done = false;
+
+    lockThreadSuspendCount();
+    assert(thread->checkpoint == NULL);
+    thread->checkpoint = &cp;
+    dvmAddToSuspendCounts(thread, 1, 0);
+
+    const u8 kWarnUsec = 1000*1000;
+    u8 startWhen = dvmGetRelativeTimeUsec();
+    bool complained = false;
+    while (!cp.done) {
+        if (thread->checkpoint == &cp && thread->status != THREAD_RUNNING) {
+            thread->checkpoint = NULL;
+            unlockThreadSuspendCount();
+            (*func)(thread, arg);
+            lockThreadSuspendCount();
+
+            dvmAddToSuspendCounts(thread, -1, 0);
+            if (thread->suspendCount == 0)
+                dvmBroadcastCond(&gDvm.threadSuspendCountCond);
+            cp.done = true;
+            break;
+        }
+
+        /* the 5ms limit catches stops that don't signal */
+        dvmRelativeCondWait(&gDvm.threadSuspendAckCond,
+            &gDvm.threadSuspendCountLock, 5, 0);
+
+        if (!complained &&
+            dvmGetRelativeTimeUsec() - startWhen > kWarnUsec)
+        {
+            ALOGW("threadid=%d: still waiting for checkpoint on threadid=%d",
+                self->threadId, thread->threadId);
+            complained = true;
+        }
+    }
+    unlockThreadSuspendCount();
+
+    LOG_THREAD("threadid=%d: checkpoint on threadid=%d took %lluus",
+        self->threadId, thread->threadId,
+        dvmGetRelativeTimeUsec() - startWhen);
+}
+
 /*
  * Reduce the suspend count of a thread.  If it hits zero, tell it to
  * resume.
@@ -2255,6 +2485,7 @@ void dvmSuspendSelf(bool jdwpActivity)
      */
     assert(self->suspendCount > 0);
     self->status = THREAD_SUSPENDED;
+    dvmBroadcastCond(&gDvm.threadSuspendAckCond);
     LOG_THREAD("threadid=%d: self-suspending (dbg)", self->threadId);
 
     /*
@@ -2420,6 +2651,34 @@ void dvmResetThreadPriority(Thread* thread, int changeFlags,
  */
 #define FIRST_SLEEP (250*1000)    /* 0.25s */
 #define MORE_SLEEP  (750*1000)    /* 0.75s */
+
+/*
+ * Wait until "thread" stops running, or until "maxWait" usec have passed
+ * since "startWhen".  Threads that see their pending suspend broadcast
+ * threadSuspendAckCond as they stop, so we normally wake as soon as that
+ * happens.  A thread that leaves RUNNING without seeing the new count
+ * doesn't broadcast, so we also look again every few milliseconds.
+ *
+ * Returns "false" if the time limit was exceeded.
+ */
+static bool waitForSuspendAck(Thread* thread, int maxWait, u8 startWhen)
+{
+    const int kRecheckMsec = 5;
+    bool result = true;
+
+    lockThreadSuspendCount();
+    while (thread->status == THREAD_RUNNING) {
+        if (dvmGetRelativeTimeUsec() >= startWhen + maxWait) {
+            result = false;
+            break;
+        }
+        dvmRelativeCondWait(&gDvm.threadSuspendAckCond,
+            &gDvm.threadSuspendCountLock, kRecheckMsec, 0);
+    }
+    unlockThreadSuspendCount();
+    return result;
+}
+
 static void waitForThreadSuspend(Thread* self, Thread* thread)
 {
     const int kMaxRetries = 10;
@@ -2467,10 +2726,11 @@ static void waitForThreadSuspend(Thread* self, Thread* thread)
 #endif
 
         /*
-         * Sleep briefly.  The iterative sleep call returns false if we've
-         * exceeded the total time limit for this round of sleeping.
+         * Wait for the thread to stop.  This returns false if we've
+         * exceeded the total time limit for this round of waiting.
          */
-        if (!dvmIterativeSleep(sleepIter++, spinSleepTime, startWhen)) {
+        sleepIter++;
+        if (!waitForSuspendAck(thread, spinSleepTime, startWhen)) {
             if (spinSleepTime != FIRST_SLEEP) {
                 ALOGW("threadid=%d: spin on suspend #%d threadid=%d (pcf=%d)",
                     self->threadId, retryCount,
@@ -2551,6 +2811,7 @@ void dvmSuspendAllThreads(SuspendCause why)
      * We keep the lock until all other threads are suspended.
      */
     lockThreadSuspend("susp-all", why);
+    u8 startWhen = dvmGetRelativeTimeUsec();
 
     LOG_THREAD("threadid=%d: SuspendAll starting", self->threadId);
 
@@ -2615,6 +2876,14 @@ void dvmSuspendAllThreads(SuspendCause why)
             thread->suspendCount, thread->dbgSuspendCount);
     }
 
+    /* the thread suspend lock serializes updates */
+    u4 elapsed = (u4) (dvmGetRelativeTimeUsec() - startWhen);
+    SuspendStats* stats = &gDvm.suspendStats[why];
+    stats->count++;
+    stats->totalUsec += elapsed;
+    if (elapsed > stats->maxUsec)
+        stats->maxUsec = elapsed;
+
     dvmUnlockThreadList();
     unlockThreadSuspend();
 
@@ -2845,11 +3114,15 @@ static bool fullSuspendCheck(Thread* self)
      */
     lockThreadSuspendCount();   /* grab gDvm.threadSuspendCountLock */
 
+    /* handle a checkpoint first; that may be all the count was for */
+    runPendingCheckpoint(self);
+
     bool needSuspend = (self->suspendCount != 0);
     if (needSuspend) {
         LOG_THREAD("threadid=%d: self-suspending", self->threadId);
         ThreadStatus oldStatus = self->status;      /* should be RUNNING */
         self->status = THREAD_SUSPENDED;
+        dvmBroadcastCond(&gDvm.threadSuspendAckCond);
 
         while (self->suspendCount != 0) {
             /*
@@ -2965,7 +3238,8 @@ ThreadStatus dvmChangeStatus(Thread* self, ThreadStatus newStatus)
         }
     } else {
         /*
-         * Not changing to THREAD_RUNNING.  No additional work required.
+         * Not changing to THREAD_RUNNING.  If a suspend is pending, let
+         * the suspending thread know right away.
          *
          * We use a releasing store to ensure that, if we were RUNNING,
          * any updates we previously made to objects on the managed heap
@@ -2975,6 +3249,9 @@ ThreadStatus dvmChangeStatus(Thread* self, ThreadStatus newStatus)
         volatile void* raw = reinterpret_cast<volatile void*>(&self->status);
         volatile int32_t* addr = reinterpret_cast<volatile int32_t*>(raw);
         android_atomic_release_store(newStatus, addr);
+        if (oldStatus == THREAD_RUNNING) {
+            signalSuspendAck(self);
+        }
     }
 
     return oldStatus;
@@ -3063,19 +3340,24 @@ Thread* dvmGetThreadByHandle(pthread_t handle)
 }
 
 /*
- * Given a threadId, return the associated Thread*.
- * Caller must hold the thread list lock.
+ * Given a threadId, return the associated Thread*.  The lookup doesn't
+ * take any locks; the caller must hold the thread list lock to keep the
+ * thread from exiting while it's being used.
  *
  * Returns NULL if the thread was not found.
  */
 Thread* dvmGetThreadByThreadId(u4 threadId)
 {
-    Thread* thread;
-    for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
-        if (thread->threadId == threadId)
-            break;
-    }
-    return thread;
+    if (threadId == 0 || threadId > kMaxThreadId)
+        return NULL;
+
+    Thread*** pChunk = &gDvm.threadIdTable[threadId >> THREAD_ID_CHUNK_SHIFT];
+    Thread** chunk = (Thread**)
+        android_atomic_acquire_load((volatile int32_t*) pChunk);
+    if (chunk == NULL)
+        return NULL;
+    return (Thread*) android_atomic_acquire_load(
+        (volatile int32_t*) &chunk[threadId & (THREAD_ID_CHUNK_SIZE - 1)]);
 }
 
 void dvmChangeThreadPriority(Thread* thread, int newPriority)
@@ -3455,12 +3737,46 @@ void dvmDumpAllThreads(bool grabLock)
  * If "grabLock" is true, we grab the thread lock list.  This is important
  * to do unless the caller already holds the lock.
  */
-void dvmDumpAllThreadsEx(const DebugOutputTarget* target, bool grabLock)
-{
-    Thread* thread;
+/*
+ * What the non-stop dump keeps of a thread.  Everything is copied, so the
+ * Thread can go away once the thread list is unlocked; "thread" and
+ * "threadObj" are only printed.
+ */
+struct ThreadSnapshot {
+    char*           threadName;
+    char*           groupName;
+    bool            isDaemon;
+    int             priority;
+    u4              threadId;
+    ThreadStatus    status;
+    bool            inJitCodeCache;
+    int             suspendCount;
+    int             dbgSuspendCount;
+    Object*         threadObj;
+    Thread*         thread;
+    pid_t           systemTid;
+    int             handle;
+    char*           stack;          /* formatted Java stack */
+    size_t          stackLen;
+};
 
+/*
+ * Print the suspend statistics and the state of the global locks.
+ */
+static void dumpThreadListHeader(const DebugOutputTarget* target)
+{
     dvmPrintDebugMessage(target, "DALVIK THREADS:\n");
 
+    for (int i = SUSPEND_NOT + 1; i < SUSPEND_NUM_CAUSES; i++) {
+        const SuspendStats* stats = &gDvm.suspendStats[i];
+        if (stats->count == 0)
+            continue;
+        dvmPrintDebugMessage(target,
+            "(suspend-all %s: %u times, avg %lluus, max %uus to safepoint)\n",
+            getSuspendCauseStr((SuspendCause) i), stats->count,
+            stats->totalUsec / stats->count, stats->maxUsec);
+    }
+
 #ifdef HAVE_ANDROID_OS
     dvmPrintDebugMessage(target,
         "(mutexes: tll=%x tsl=%x tscl=%x ghl=%x)\n\n",
@@ -3469,20 +3785,16 @@ void dvmDumpAllThreadsEx(const DebugOutputTarget* target, bool grabLock)
         gDvm.threadSuspendCountLock.value,
         gDvm.gcHeapLock.value);
 #endif
+}
 
-    if (grabLock)
-        dvmLockThreadList(dvmThreadSelf());
-
-    thread = gDvm.threadList;
-    while (thread != NULL) {
-        dvmDumpThreadEx(target, thread, false);
-
-        /* verify link */
-        assert(thread->next == NULL || thread->next->prev == thread);
-
-        thread = thread->next;
-    }
-
+/*
+ * Dump the threads in /proc that aren't Dalvik threads.  The Dalvik ones
+ * are those in "snapshots" or, if that is NULL, in the thread list, which
+ * must be locked.
+ */
+static void dumpNativeThreads(const DebugOutputTarget* target,
+    const ThreadSnapshot* snapshots, int count)
+{
 #ifdef HAVE_ANDROID_OS
     char path[64];
     snprintf(path, sizeof(path), "/proc/%d/task", getpid());
@@ -3494,7 +3806,17 @@ void dvmDumpAllThreadsEx(const DebugOutputTarget* target, bool grabLock)
         while ((entry = readdir(d)) != NULL) {
             char* end;
             pid_t tid = strtol(entry->d_name, &end, 10);
-            if (!*end && !isDalvikThread(tid)) {
+            if (*end)
+                continue;
+
+            bool isDalvik = false;
+            if (snapshots == NULL) {
+                isDalvik = isDalvikThread(tid);
+            } else {
+                for (int i = 0; i < count && !isDalvik; i++)
+                    isDalvik = (snapshots[i].systemTid == tid);
+            }
+            if (!isDalvik) {
                 if (first) {
                     dvmPrintDebugMessage(target, "NATIVE THREADS:\n");
                     first = false;
@@ -3505,11 +3827,207 @@ void dvmDumpAllThreadsEx(const DebugOutputTarget* target, bool grabLock)
         closedir(d);
     }
 #endif
+}
+
+void dvmDumpAllThreadsEx(const DebugOutputTarget* target, bool grabLock)
+{
+    Thread* thread;
+
+    dumpThreadListHeader(target);
+
+    if (grabLock)
+        dvmLockThreadList(dvmThreadSelf());
+
+    thread = gDvm.threadList;
+    while (thread != NULL) {
+        dvmDumpThreadEx(target, thread, false);
+
+        /* verify link */
+        assert(thread->next == NULL || thread->next->prev == thread);
+
+        thread = thread->next;
+    }
+
+    dvmDumpLockProfile(target);
+    dvmDumpSamplingProfile(target);
+#if defined(WITH_JIT)
+    dvmDumpJitTraceSamples(target);
+#endif
+
+    dumpNativeThreads(target, NULL, 0);
 
     if (grabLock)
         dvmUnlockThreadList();
 }
 
+/*
+ * Take the snapshot of a thread's Java stack.  Runs at the thread's safe
+ * point, on the thread itself or on the dumping thread.
+ */
+static void snapshotStackCheckpoint(Thread* thread, void* arg)
+{
+    ThreadSnapshot* snap = (ThreadSnapshot*) arg;
+
+    snap->status = thread->status;
+    FILE* fp = open_memstream(&snap->stack, &snap->stackLen);
+    if (fp == NULL) {
+        snap->stack = NULL;
+        return;
+    }
+    DebugOutputTarget target;
+    dvmCreateFileOutputTarget(&target, fp);
+    dvmDumpThreadStack(&target, thread);
+    fclose(fp);
+}
+
+/*
+ * Copy what we print about "thread" into "snap".  Returns false if the
+ * thread is still attaching.  The thread list must be locked.
+ */
+static bool snapshotThread(ThreadSnapshot* snap, Thread* thread)
+{
+    Object* threadObj = thread->threadObj;
+    if (threadObj == NULL)
+        return false;
+    dvmAddTrackedAlloc(threadObj, NULL);
+
+    StringObject* nameStr = (StringObject*) dvmGetFieldObject(threadObj,
+                gDvm.offJavaLangThread_name);
+    snap->threadName = dvmCreateCstrFromString(nameStr);
+    snap->priority = dvmGetFieldInt(threadObj, gDvm.offJavaLangThread_priority);
+    snap->isDaemon =
+        dvmGetFieldBoolean(threadObj, gDvm.offJavaLangThread_daemon);
+    Object* groupObj = (Object*) dvmGetFieldObject(threadObj,
+                gDvm.offJavaLangThread_group);
+    if (groupObj != NULL) {
+        nameStr = (StringObject*)
+            dvmGetFieldObject(groupObj, gDvm.offJavaLangThreadGroup_name);
+        snap->groupName = dvmCreateCstrFromString(nameStr);
+    }
+    if (snap->groupName == NULL)
+        snap->groupName = strdup("(null; initializing?)");
+
+    snap->threadId = thread->threadId;
+    snap->threadObj = threadObj;
+    snap->thread = thread;
+    snap->systemTid = thread->systemTid;
+    snap->handle = (int) thread->handle;
+#if defined(WITH_JIT)
+    snap->inJitCodeCache = (thread->inJitCodeCache != NULL);
+#endif
+
+    /* the counts include our own checkpoint while it runs */
+    snap->suspendCount = thread->suspendCount;
+    snap->dbgSuspendCount = thread->dbgSuspendCount;
+    dvmRunCheckpoint(thread, snapshotStackCheckpoint, snap);
+
+    dvmReleaseTrackedAlloc(threadObj, NULL);
+    return true;
+}
+
+/*
+ * Print a thread from its snapshot, reading /proc and unwinding the native
+ * stack now.  The thread may have moved on, or exited, since the snapshot.
+ */
+static void dumpThreadSnapshot(const DebugOutputTarget* target,
+    const ThreadSnapshot* snap)
+{
+    SchedulerStats schedStats;
+    getSchedulerStats(&schedStats, snap->systemTid);
+
+    dvmPrintDebugMessage(target,
+        "\"%s\"%s prio=%d tid=%d %s%s\n",
+        snap->threadName, snap->isDaemon ? " daemon" : "",
+        snap->priority, snap->threadId, dvmGetThreadStatusStr(snap->status),
+        snap->inJitCodeCache ? " JIT" : "");
+    dvmPrintDebugMessage(target,
+        "  | group=\"%s\" sCount=%d dsCount=%d obj=%p self=%p\n",
+        snap->groupName, snap->suspendCount, snap->dbgSuspendCount,
+        snap->threadObj, snap->thread);
+    dvmPrintDebugMessage(target,
+        "  | sysTid=%d nice=%d sched=%d/%d cgrp=%s handle=%d\n",
+        snap->systemTid, getpriority(PRIO_PROCESS, snap->systemTid),
+        schedStats.policy, schedStats.priority, schedStats.group,
+        snap->handle);
+
+    dumpSchedStat(target, snap->systemTid);
+
+    if (snap->status == THREAD_NATIVE || snap->status == THREAD_VMWAIT) {
+        dvmDumpNativeStack(target, snap->systemTid);
+    }
+
+    if (snap->stack != NULL) {
+        dvmPrintDebugMessage(target, "%.*s", (int) snap->stackLen, snap->stack);
+    }
+
+    dvmPrintDebugMessage(target, "\n");
+}
+
+/*
+ * Like dvmDumpAllThreadsEx(), but without stopping the world.  Each
+ * thread's Java stack is copied at its own safe point through a
+ * checkpoint, so a thread only waits while its own stack is copied, and
+ * the /proc reads and native unwinding happen after every thread has
+ * been let go.  The result is not a consistent picture of one instant.
+ *
+ * Call with the thread list unlocked and no threads suspended.
+ */
+void dvmDumpAllThreadsNonStop(const DebugOutputTarget* target)
+{
+    Thread* self = dvmThreadSelf();
+
+    dvmLockThreadList(self);
+
+    int count = 0;
+    for (Thread* thread = gDvm.threadList; thread != NULL;
+         thread = thread->next)
+    {
+        count++;
+    }
+    ThreadSnapshot* snapshots =
+        (ThreadSnapshot*) calloc(count, sizeof(ThreadSnapshot));
+    if (snapshots == NULL) {
+        dvmUnlockThreadList();
+        dvmPrintDebugMessage(target, "DALVIK THREADS: (out of memory)\n");
+        return;
+    }
+
+    int numSnapshots = 0;
+    for (Thread* thread = gDvm.threadList; thread != NULL;
+         thread = thread->next)
+    {
+        if (snapshotThread(&snapshots[numSnapshots], thread))
+            numSnapshots++;
+    }
+
+    dvmUnlockThreadList();
+
+    /* the slow part; don't hold up a GC while doing it */
+    ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    dumpThreadListHeader(target);
+    for (int i = 0; i < numSnapshots; i++) {
+        dumpThreadSnapshot(target, &snapshots[i]);
+    }
+    dvmChangeStatus(self, oldStatus);
+
+    dvmDumpLockProfile(target);
+    dvmDumpSamplingProfile(target);
+#if defined(WITH_JIT)
+    dvmDumpJitTraceSamples(target);
+#endif
+
+    oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    dumpNativeThreads(target, snapshots, numSnapshots);
+    dvmChangeStatus(self, oldStatus);
+
+    for (int i = 0; i < numSnapshots; i++) {
+        free(snapshots[i].threadName);
+        free(snapshots[i].groupName);
+        free(snapshots[i].stack);
+    }
+    free(snapshots);
+}
+
 /*
  * Nuke the target thread from orbit.
  *
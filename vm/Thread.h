@@ -22,10 +22,14 @@
 
 #include "jni.h"
 #include "interp/InterpState.h"
+#include "alloc/Tlab.h"
 
 #include <errno.h>
 #include <cutils/sched_policy.h>
 
+struct HeapArena;
+struct VmMetricsBlock;
+
 #if defined(CHECK_MUTEX) && !defined(__USE_UNIX98)
 /* glibc lacks this unless you #define __USE_UNIX98 */
 int pthread_mutexattr_settype(pthread_mutexattr_t *attr, int type);
@@ -202,6 +206,18 @@ struct Thread {
     const Method*     methodToCall;
 #endif
 
+    /*
+     * always-on counters; never NULL, see dvmMetricsAcquireBlock().
+     * The allocation fast path in the interpreter bumps them.
+     */
+    VmMetricsBlock* metrics;
+
+    /*
+     * thread-local allocation buffers; refilled under the heap lock, and
+     * handed out from inline in the interpreter and JIT code too
+     */
+    Tlab        tlabs[TLAB_NUM_SIZE_CLASSES];
+
     /* JNI local reference tracking */
     IndirectRefTable jniLocalRefTable;
 
@@ -215,9 +231,12 @@ struct Thread {
     const u2*   currTraceHead;  // Start of the trace we're building
     const u2*   currRunHead;    // Start of run we're building
     int         currRunLen;     // Length of run in 16-bit words
+    int         traceBranches;  // Conditional branches the trace went through
     const u2*   lastPC;         // Stage the PC for the threaded interpreter
     const Method*  traceMethod; // Starting method of current trace
     intptr_t    threshFilter[JIT_TRACE_THRESH_FILTER_SIZE];
+    unsigned char* jitProfTable;    // Private trace head counters, or NULL
+    u4          jitProfDecayTime;   // Last decay of jitProfTable, in msec
     JitTraceRun trace[MAX_JIT_RUN_LEN];
 #endif
 
@@ -261,8 +280,10 @@ struct Thread {
     /* guarded by waitMutex */
     bool        interrupted;
 
-    /* links to the next thread in the wait set this thread is part of */
+    /* links in the monitor wait queue this thread is on, if any */
     struct Thread*     waitNext;
+    struct Thread*     waitPrev;
+    struct WaitQueue*  waitQueue;
 
     /* object to sleep on while we are waiting for a monitor */
     pthread_cond_t     waitCond;
@@ -287,9 +308,22 @@ struct Thread {
     bool        cpuClockBaseSet;
     u8          cpuClockBase;
 
+    /* method trace records go here until the chunk is used up */
+    u1*         traceChunkPtr;
+    u1*         traceChunkEnd;
+    int         traceGeneration;    /* trace the chunk belongs to */
+
+    /* bytes left until the alloc tracker takes the next sample */
+    int         allocSampleBytesLeft;
+    u4          allocSampleSeed;
+
     /* memory allocation profiling state */
     AllocProfState allocProf;
 
+    /* arena that this thread's objects come from, or NULL; see
+     * dvmBeginHeapArena() */
+    HeapArena*  heapArena;
+
 #ifdef WITH_JNI_STACK_CHECK
     u4          stackCrc;
 #endif
@@ -304,6 +338,9 @@ struct Thread {
     SafePointCallback callback;
     void*             callbackArg;
 
+    /* pending checkpoint request; guarded by threadSuspendCountLock */
+    struct Checkpoint* checkpoint;
+
 #if defined(ARCH_IA32) && defined(WITH_JIT)
     u4 spillRegion[MAX_SPILL_JIT_IA];
 #endif
@@ -364,6 +401,17 @@ enum SuspendCause {
     SUSPEND_FOR_CC_RESET,    // code-cache reset
     SUSPEND_FOR_REFRESH,     // Reload data cached in interpState
 #endif
+    SUSPEND_NUM_CAUSES       // must be last
+};
+
+/*
+ * Time-to-safepoint statistics for one suspension cause, measured from
+ * the raise of the suspend counts until every thread has stopped.
+ */
+struct SuspendStats {
+    u4      count;
+    u4      maxUsec;
+    u8      totalUsec;
 };
 void dvmSuspendThread(Thread* thread);
 void dvmSuspendSelf(bool jdwpActivity);
@@ -372,6 +420,21 @@ void dvmSuspendAllThreads(SuspendCause why);
 void dvmResumeAllThreads(SuspendCause why);
 void dvmUndoDebuggerSuspensions(void);
 
+/*
+ * Run "func" against a single thread at its next safe point, without
+ * stopping any other thread.  If the target is executing managed code
+ * the function runs on the target itself, from its next suspend check;
+ * if it is already stopped (native code, waiting, suspended) the calling
+ * thread runs it on the target's behalf and keeps it from resuming until
+ * the function returns.  Either way, the target's interpreted stack is
+ * stable while "func" runs.  Returns after "func" has completed.
+ *
+ * Grab threadListLock before calling, and don't try to take it, suspend
+ * threads, or start a checkpoint from "func".
+ */
+typedef void (*CheckpointFunc)(Thread* thread, void* arg);
+void dvmRunCheckpoint(Thread* thread, CheckpointFunc func, void* arg);
+
 /*
  * Check suspend state.  Grab threadListLock before calling.
  */
@@ -522,13 +585,19 @@ Thread* dvmGetThreadFromThreadObject(Object* vmThreadObj);
 Thread* dvmGetThreadByHandle(pthread_t handle);
 
 /*
- * Given a thread ID, return the associated Thread*.
- * Caller must hold the thread list lock.
+ * Given a thread ID, return the associated Thread*.  This is a table
+ * lookup that doesn't take any locks, but the caller must hold the
+ * thread list lock if it uses the Thread afterwards.
  *
  * Returns NULL if the thread was not found.
  */
 Thread* dvmGetThreadByThreadId(u4 threadId);
 
+/* thread ID table geometry; IDs are 16 bits */
+#define THREAD_ID_CHUNK_SHIFT   8
+#define THREAD_ID_CHUNK_SIZE    (1 << THREAD_ID_CHUNK_SHIFT)
+#define THREAD_ID_CHUNKS        (1 << (16 - THREAD_ID_CHUNK_SHIFT))
+
 /*
  * Sleep in a thread.  Returns when the sleep timer returns or the thread
  * is interrupted.
@@ -597,6 +666,13 @@ void dvmDumpThreadEx(const DebugOutputTarget* target, Thread* thread,
 void dvmDumpAllThreads(bool grabLock);
 void dvmDumpAllThreadsEx(const DebugOutputTarget* target, bool grabLock);
 
+/*
+ * Debug: dump all threads without suspending them all at once.  Each
+ * thread's stack is copied at its next safe point and printed after the
+ * thread has been let go.
+ */
+void dvmDumpAllThreadsNonStop(const DebugOutputTarget* target);
+
 /*
  * Debug: kill a thread to get a debuggerd stack trace.  Leaves the VM
  * in an uncertain state.
@@ -58,7 +58,9 @@ static StringObject* makeStringObject(u4 charsLength, ArrayObject** pChars)
         return NULL;
     }
 
-    ArrayObject* chars = dvmAllocPrimitiveArray('C', charsLength, ALLOC_DEFAULT);
+    /* Every caller fills in all of the characters. */
+    ArrayObject* chars = dvmAllocPrimitiveArray('C', charsLength,
+                                                ALLOC_UNINITIALIZED);
     if (chars == NULL) {
         dvmReleaseTrackedAlloc(result, NULL);
         return NULL;
@@ -101,36 +103,63 @@ u4 dvmComputeUtf8Hash(const char* utf8Str)
  * The value returned is the number of characters, which may or may not
  * be the same as the number of bytes.
  *
- * (If this needs optimizing, try: mask against 0xa0, shift right 5,
- * get increment {1-3} from table of 8 values.)
+ * Runs of ASCII are counted a block at a time; after each, at least one
+ * block's worth of bytes is decoded singly before trying again, so short
+ * and non-ASCII strings don't pay for a failed block test per character.
  */
 size_t dvmUtf8Len(const char* utf8Str)
 {
     size_t len = 0;
     int ic;
 
-    while ((ic = *utf8Str++) != '\0') {
-        len++;
-        if ((ic & 0x80) != 0) {
-            /* two- or three-byte encoding */
-            utf8Str++;
-            if ((ic & 0x20) != 0) {
-                /* three-byte encoding */
+    for (;;) {
+        size_t ascii = dexUtf8AsciiSpan(utf8Str, dexUtf8ScanLimit(utf8Str));
+        len += ascii;
+        utf8Str += ascii;
+
+        const char* blockEnd = utf8Str + kDexUtfBlockLen;
+        while (utf8Str < blockEnd) {
+            if ((ic = *utf8Str++) == '\0')
+                return len;
+            len++;
+            if ((ic & 0x80) != 0) {
+                /* two- or three-byte encoding */
                 utf8Str++;
+                if ((ic & 0x20) != 0) {
+                    /* three-byte encoding */
+                    utf8Str++;
+                }
             }
         }
     }
-
-    return len;
 }
 
 /*
- * Convert a "modified" UTF-8 string to UTF-16.
+ * Convert a "modified" UTF-8 string to UTF-16.  ASCII is widened a block
+ * at a time, as in dvmUtf8Len().
  */
 void dvmConvertUtf8ToUtf16(u2* utf16Str, const char* utf8Str)
 {
-    while (*utf8Str != '\0')
-        *utf16Str++ = dexGetUtf16FromUtf8(&utf8Str);
+    for (;;) {
+        size_t ascii = dexUtf8WidenAscii(utf16Str, utf8Str,
+            dexUtf8ScanLimit(utf8Str));
+        utf16Str += ascii;
+        utf8Str += ascii;
+
+        const char* blockEnd = utf8Str + kDexUtfBlockLen;
+        while (utf8Str < blockEnd) {
+            /* nearly everything we convert is ASCII; widen it directly */
+            unsigned int ic = (u1) *utf8Str;
+            if (ic == '\0') {
+                return;
+            } else if (ic < 0x80) {
+                *utf16Str++ = ic;
+                utf8Str++;
+            } else {
+                *utf16Str++ = dexGetUtf16FromUtf8(&utf8Str);
+            }
+        }
+    }
 }
 
 /*
@@ -198,12 +227,27 @@ static inline u4 computeUtf16Hash(const u2* utf16Str, size_t len)
 {
     u4 hash = 0;
 
+    /*
+     * Four chars at a time, folding in powers of 31 (923521 = 31^4), so
+     * the multiplies aren't all one serial dependency chain.
+     */
+    while (len >= 4) {
+        hash = hash * 923521 + (u4) utf16Str[0] * 29791 +
+            (u4) utf16Str[1] * 961 + (u4) utf16Str[2] * 31 + utf16Str[3];
+        utf16Str += 4;
+        len -= 4;
+    }
     while (len--)
         hash = hash * 31 + *utf16Str++;
 
     return hash;
 }
 
+u4 dvmComputeUtf16Hash(const u2* utf16Str, size_t len)
+{
+    return computeUtf16Hash(utf16Str, len);
+}
+
 u4 dvmComputeStringHash(StringObject* strObj) {
     int hashCode = dvmGetFieldInt(strObj, STRING_FIELDOFF_HASHCODE);
     if (hashCode != 0) {
@@ -262,6 +306,15 @@ StringObject* dvmCreateStringFromUnicode(const u2* unichars, int len)
     /* We allow a NULL pointer if the length is zero. */
     assert(len == 0 || unichars != NULL);
 
+    return dvmCreateStringFromUnicodeAndHash(unichars, len,
+        computeUtf16Hash(unichars, len));
+}
+
+StringObject* dvmCreateStringFromUnicodeAndHash(const u2* unichars, int len,
+    u4 hashCode)
+{
+    assert(len == 0 || unichars != NULL);
+
     ArrayObject* chars;
     StringObject* newObj = makeStringObject(len, &chars);
     if (newObj == NULL) {
@@ -270,7 +323,6 @@ StringObject* dvmCreateStringFromUnicode(const u2* unichars, int len)
 
     if (len > 0) memcpy(chars->contents, unichars, len * sizeof(u2));
 
-    u4 hashCode = computeUtf16Hash((u2*)(void*)chars->contents, len);
     dvmSetFieldInt((Object*)newObj, STRING_FIELDOFF_HASHCODE, hashCode);
 
     return newObj;
@@ -59,6 +59,11 @@ u4 dvmComputeUtf8Hash(const char* str);
  */
 u4 dvmComputeStringHash(StringObject* strObj);
 
+/*
+ * Hash function for UTF-16 data, the same as String.hashCode().
+ */
+u4 dvmComputeUtf16Hash(const u2* utf16Str, size_t len);
+
 /*
  * Create a java.lang.String[] from a vector of C++ strings.
  *
@@ -117,6 +122,13 @@ void dvmConvertUtf8ToUtf16(u2* utf16Str, const char* utf8Str);
  */
 StringObject* dvmCreateStringFromUnicode(const u2* unichars, int len);
 
+/*
+ * Same as dvmCreateStringFromUnicode(), for a caller that already has
+ * the hash code of the contents.
+ */
+StringObject* dvmCreateStringFromUnicodeAndHash(const u2* unichars, int len,
+    u4 hashCode);
+
 /*
  * Create a UTF-8 C string from a java/lang/String.  Caller must free
  * the result.
@@ -0,0 +1,598 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Always-on VM counters.
+ *
+ * The loader, JIT and heap stats dumps are compiled out of release builds
+ * or only printed at shutdown, so there is nothing a monitoring agent can
+ * poll.  The counters here are kept in every build:
+ *
+ *  - Hot-path events (allocations, JNI calls, contended monitors, class
+ *    initialization) go in a block owned by the thread that caused them.
+ *    A bump is a plain add to memory nobody else writes.
+ *  - The collector's counters are written under the heap lock it already
+ *    holds.
+ *  - Class loading and JIT counters that the VM already keeps are read
+ *    where they are.
+ *
+ * Readers add up every block without taking a lock, so a scrape doesn't
+ * stall the threads it measures.  The totals are available from
+ * VMDebug.getVmMetrics(long[]) and, as a VMMT chunk payload, from
+ * DdmVmInternal.getVmMetrics().  With -Xmetricsfile:<path>, a thread also
+ * copies them out to a shared file, "<path>.<pid>", every
+ * -Xmetricsinterval milliseconds, which an agent can mmap and read as
+ * often as it likes without the process doing any work.
+ *
+ * A thread's own counts are its block's counts less the "base" recorded
+ * when it got the block, so each thread's allocation can be read on its
+ * own.  With -Xloaderaccounting, which is on by default, marking also
+ * charges every live object it scans to a counter in its class, and
+ * once marking is done those are added up per class loader.  The class
+ * and its counter are already in the cache when an object is scanned,
+ * so this costs an add per object.
+ */
+#include "Dalvik.h"
+#include "alloc/HeapInternal.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* default interval between updates of the metrics file */
+#define kDefaultMetricsIntervalMsec 1000
+
+/* "DVMM", as a native-endian word */
+#define kMetricsFileMagic           0x4d4d5644
+#define kMetricsFileVersion         1
+
+/*
+ * Layout of the metrics file.  Everything is in native byte order.
+ *
+ * "seq" is odd while the publisher is updating the values; a reader
+ * copies "updateUsec" and the values, and retries if "seq" was odd or
+ * changed in between.  The counter names follow the values, each
+ * terminated by a NUL, in the same order.
+ */
+struct MetricsFileHeader {
+    u4              magic;
+    u4              version;
+    u4              count;          /* number of values */
+    volatile u4     seq;
+    u8              updateUsec;     /* wall clock time of the last update */
+    u8              values[kVmMetricCount];
+};
+
+static const char* gMetricNames[kVmMetricCount] = {
+    "alloc-objects",
+    "alloc-bytes",
+    "gc-count",
+    "gc-concurrent-count",
+    "gc-pause-ms",
+    "gc-total-ms",
+    "gc-objects-freed",
+    "gc-bytes-freed",
+    "heap-allocated",
+    "heap-footprint",
+    "classes-loaded",
+    "class-inits",
+    "monitor-contended",
+    "jni-calls",
+    "jit-compiled",
+    "jit-failed",
+    "jit-code-bytes",
+    "threads",
+    "finalizers-enqueued",
+    "finalizers-pending",
+    "finalizer-bytes-pending",
+    "huge-page-bytes",
+};
+
+/*
+ * Initialize a few things.  This gets called early, so keep activity to
+ * a minimum.  Counter blocks may be handed out before this runs.
+ */
+bool dvmMetricsStartup()
+{
+    dvmInitMutex(&gDvm.metricsLock);
+    pthread_cond_init(&gDvm.metricsCond, NULL);
+    if (gDvm.metricsIntervalMsec <= 0)
+        gDvm.metricsIntervalMsec = kDefaultMetricsIntervalMsec;
+    return true;
+}
+
+/*
+ * Release anything we're holding on to.  All threads are gone by now.
+ */
+void dvmMetricsShutdown()
+{
+    dvmStopMetricsPublisher();
+
+    VmMetricsBlock* block = gDvm.metricsBlocks;
+    while (block != NULL) {
+        VmMetricsBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    gDvm.metricsBlocks = NULL;
+
+    free(gDvm.loaderUsage);
+    gDvm.loaderUsage = NULL;
+    gDvm.loaderUsageCount = 0;
+
+    free(gDvm.metricsFile);
+    gDvm.metricsFile = NULL;
+    pthread_cond_destroy(&gDvm.metricsCond);
+    dvmDestroyMutex(&gDvm.metricsLock);
+}
+
+/*
+ * Get a counter block for a new thread, reusing one whose thread has
+ * exited if we can.
+ */
+VmMetricsBlock* dvmMetricsAcquireBlock()
+{
+    for (VmMetricsBlock* block = gDvm.metricsBlocks; block != NULL;
+         block = block->next)
+    {
+        if (block->inUse == 0 &&
+            android_atomic_acquire_cas(0, 1, &block->inUse) == 0)
+        {
+            memcpy(block->base, block->counts, sizeof(block->base));
+            return block;
+        }
+    }
+
+    VmMetricsBlock* block = (VmMetricsBlock*) calloc(1, sizeof(*block));
+    if (block == NULL) {
+        ALOGW("Unable to allocate metrics block; sharing the overflow block");
+        return &gDvm.metricsOverflow;
+    }
+    block->inUse = 1;
+
+    /* push it; readers may be walking the list as we do this */
+    VmMetricsBlock* head;
+    do {
+        head = gDvm.metricsBlocks;
+        block->next = head;
+    } while (android_atomic_release_cas((int32_t) head, (int32_t) block,
+                 (volatile int32_t*) &gDvm.metricsBlocks) != 0);
+    return block;
+}
+
+/*
+ * Give back the block of an exiting thread.
+ */
+void dvmMetricsReleaseBlock(VmMetricsBlock* block)
+{
+    if (block == NULL || block == &gDvm.metricsOverflow)
+        return;
+    android_atomic_release_store(0, &block->inUse);
+}
+
+/*
+ * Returns one of a thread's counters, counting from when it started.
+ */
+u8 dvmGetThreadMetric(const Thread* thread, VmThreadMetric metric)
+{
+    const VmMetricsBlock* block = thread->metrics;
+    return block->counts[metric] - block->base[metric];
+}
+
+/*
+ * Record the outcome of a collection.
+ */
+void dvmMetricsRecordGc(bool concurrent, u4 pauseMsec, u4 totalMsec,
+    size_t objectsFreed, size_t bytesFreed, size_t allocated,
+    size_t footprint)
+{
+    VmGcMetrics* gcm = &gDvm.gcMetrics;
+
+    gcm->count++;
+    if (concurrent)
+        gcm->concurrentCount++;
+    gcm->pauseMsec += pauseMsec;
+    gcm->totalMsec += totalMsec;
+    gcm->objectsFreed += objectsFreed;
+    gcm->bytesFreed += bytesFreed;
+    gcm->allocated = allocated;
+    gcm->footprint = footprint;
+}
+
+/*
+ * Record the state of the finalizer backlog.
+ */
+void dvmMetricsRecordFinalizers(size_t enqueued, size_t pending,
+    size_t pendingBytes)
+{
+    VmGcMetrics* gcm = &gDvm.gcMetrics;
+
+    gcm->finalizersEnqueued += enqueued;
+    gcm->finalizersPending = pending;
+    gcm->finalizerBytesPending = pendingBytes;
+}
+
+/*
+ * Record the huge page usage.
+ */
+void dvmMetricsRecordHugePages(size_t bytes)
+{
+    gDvm.gcMetrics.hugePageBytes = bytes;
+}
+
+static u4 hashLoader(const Object* loader)
+{
+    return (u4) loader >> 3;
+}
+
+static int compareLoaderUsage(const void* tableItem, const void* looseItem)
+{
+    const VmLoaderUsage* tab = (const VmLoaderUsage*) tableItem;
+    const VmLoaderUsage* loose = (const VmLoaderUsage*) looseItem;
+    return tab->loader != loose->loader;
+}
+
+/*
+ * Charge one class's live objects to its loader's entry, and clear the
+ * class counters for the next collection.
+ */
+static int addClassUsage(void* data, void* arg)
+{
+    ClassObject* clazz = (ClassObject*) data;
+    HashTable* loaders = (HashTable*) arg;
+
+    clazz->lastLiveObjects = clazz->gcLiveObjects;
+    clazz->lastLiveBytes = clazz->gcLiveBytes;
+    if (clazz->gcLiveObjects == 0)
+        return 0;
+
+    VmLoaderUsage key;
+    key.loader = clazz->classLoader;
+    u4 hash = hashLoader(key.loader);
+    VmLoaderUsage* usage = (VmLoaderUsage*)
+        dvmHashTableLookup(loaders, hash, &key, compareLoaderUsage, false);
+    if (usage == NULL) {
+        usage = (VmLoaderUsage*) calloc(1, sizeof(*usage));
+        if (usage != NULL) {
+            usage->loader = key.loader;
+            dvmHashTableLookup(loaders, hash, usage, compareLoaderUsage, true);
+        }
+    }
+    if (usage != NULL) {
+        usage->liveObjects += clazz->gcLiveObjects;
+        usage->liveBytes += clazz->gcLiveBytes;
+    }
+    clazz->gcLiveObjects = 0;
+    clazz->gcLiveBytes = 0;
+    return 0;
+}
+
+/*
+ * Fold the class counters that marking filled in into the loader table.
+ */
+void dvmMetricsRecordLoaderUsage()
+{
+    HashTable* loaders = dvmHashTableCreate(16, free);
+    if (loaders == NULL)
+        return;
+    dvmHashForeach(gDvm.loadedClasses, addClassUsage, loaders);
+    gDvm.liveCountGcs++;
+
+    size_t count = dvmHashTableNumEntries(loaders);
+    VmLoaderUsage* table =
+        (VmLoaderUsage*) malloc(MAX(count, 1) * sizeof(VmLoaderUsage));
+    if (table == NULL) {
+        ALOGW("Unable to allocate class loader usage table");
+    } else {
+        HashIter iter;
+        size_t i = 0;
+        for (dvmHashIterBegin(loaders, &iter); !dvmHashIterDone(&iter);
+             dvmHashIterNext(&iter))
+        {
+            table[i++] = *(VmLoaderUsage*) dvmHashIterData(&iter);
+        }
+        assert(i == count);
+
+        free(gDvm.loaderUsage);
+        gDvm.loaderUsage = table;
+        gDvm.loaderUsageCount = count;
+    }
+    dvmHashTableFree(loaders);
+}
+
+/*
+ * Forget the loaders that were collected.  Collections that don't count,
+ * like young ones, leave the table in place, so it may outlive a loader.
+ */
+void dvmMetricsSweepLoaderUsage(int (*isDead)(void* obj))
+{
+    VmLoaderUsage* table = gDvm.loaderUsage;
+    size_t count = 0;
+    for (size_t i = 0; i < gDvm.loaderUsageCount; i++) {
+        if (table[i].loader != NULL && isDead(table[i].loader))
+            continue;
+        table[count++] = table[i];
+    }
+    gDvm.loaderUsageCount = count;
+}
+
+/*
+ * Copy the loader table out under the heap lock.
+ */
+VmLoaderUsage* dvmCopyLoaderUsage(size_t* pCount)
+{
+    Thread* self = dvmThreadSelf();
+    VmLoaderUsage* usage = NULL;
+    size_t count = 0;
+
+    dvmLockHeap();
+    if (gDvm.loaderUsageCount > 0) {
+        usage = (VmLoaderUsage*)
+            malloc(gDvm.loaderUsageCount * sizeof(VmLoaderUsage));
+    }
+    if (usage != NULL) {
+        count = gDvm.loaderUsageCount;
+        memcpy(usage, gDvm.loaderUsage, count * sizeof(VmLoaderUsage));
+        for (size_t i = 0; i < count; i++) {
+            if (usage[i].loader != NULL)
+                dvmAddTrackedAlloc(usage[i].loader, self);
+        }
+    }
+    dvmUnlockHeap();
+
+    *pCount = count;
+    return usage;
+}
+
+void dvmFreeLoaderUsage(VmLoaderUsage* usage, size_t count)
+{
+    Thread* self = dvmThreadSelf();
+
+    for (size_t i = 0; i < count; i++) {
+        if (usage[i].loader != NULL)
+            dvmReleaseTrackedAlloc(usage[i].loader, self);
+    }
+    free(usage);
+}
+
+/*
+ * Add up the per-thread blocks and fill in the rest from where the VM
+ * keeps it.
+ */
+void dvmGetVmMetrics(u8* values)
+{
+    u8 threadTotals[kThreadMetricCount];
+    u8 numBlocks = 0;
+
+    for (int i = 0; i < kThreadMetricCount; i++)
+        threadTotals[i] = gDvm.metricsOverflow.counts[i];
+    VmMetricsBlock* block = (VmMetricsBlock*)
+        android_atomic_acquire_load((volatile int32_t*) &gDvm.metricsBlocks);
+    for ( ; block != NULL; block = block->next) {
+        for (int i = 0; i < kThreadMetricCount; i++)
+            threadTotals[i] += block->counts[i];
+        if (block->inUse)
+            numBlocks++;
+    }
+
+    const VmGcMetrics* gcm = &gDvm.gcMetrics;
+    values[kVmMetricAllocObjects] = threadTotals[kThreadMetricAllocObjects];
+    values[kVmMetricAllocBytes] = threadTotals[kThreadMetricAllocBytes];
+    values[kVmMetricGcCount] = gcm->count;
+    values[kVmMetricGcConcurrentCount] = gcm->concurrentCount;
+    values[kVmMetricGcPauseMsec] = gcm->pauseMsec;
+    values[kVmMetricGcTotalMsec] = gcm->totalMsec;
+    values[kVmMetricGcObjectsFreed] = gcm->objectsFreed;
+    values[kVmMetricGcBytesFreed] = gcm->bytesFreed;
+    values[kVmMetricHeapAllocated] = gcm->allocated;
+    values[kVmMetricHeapFootprint] = gcm->footprint;
+    values[kVmMetricClassesLoaded] = gDvm.numLoadedClasses;
+    values[kVmMetricClassInits] = threadTotals[kThreadMetricClassInits];
+    values[kVmMetricMonitorContended] =
+        threadTotals[kThreadMetricMonitorContended];
+    values[kVmMetricJniCalls] = threadTotals[kThreadMetricJniCalls];
+#if defined(WITH_JIT)
+    /* written under compilerLock; a racy read is fine for a counter */
+    values[kVmMetricJitCompiled] = gDvmJit.telemetry.numCompiled;
+    values[kVmMetricJitFailed] = gDvmJit.telemetry.numFailed;
+    values[kVmMetricJitCodeBytes] = gDvmJit.telemetry.codeBytes;
+#else
+    values[kVmMetricJitCompiled] = 0;
+    values[kVmMetricJitFailed] = 0;
+    values[kVmMetricJitCodeBytes] = 0;
+#endif
+    values[kVmMetricThreads] = numBlocks;
+    values[kVmMetricFinalizersEnqueued] = gcm->finalizersEnqueued;
+    values[kVmMetricFinalizersPending] = gcm->finalizersPending;
+    values[kVmMetricFinalizerBytesPending] = gcm->finalizerBytesPending;
+    values[kVmMetricHugePageBytes] = gcm->hugePageBytes;
+}
+
+/*
+ * Returns a short name for the counter.
+ */
+const char* dvmVmMetricName(VmMetric metric)
+{
+    assert(metric >= 0 && metric < kVmMetricCount);
+    return gMetricNames[metric];
+}
+
+/*
+ * Create the metrics file and map it.  Returns NULL on failure.
+ */
+static MetricsFileHeader* mapMetricsFile(size_t* pLen)
+{
+    char fileName[PATH_MAX];
+    snprintf(fileName, sizeof(fileName), "%s.%d", gDvm.metricsFile,
+        (int) getpid());
+
+    size_t len = sizeof(MetricsFileHeader);
+    for (int i = 0; i < kVmMetricCount; i++)
+        len += strlen(gMetricNames[i]) + 1;
+
+    int fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ALOGW("Unable to create metrics file '%s': %s", fileName,
+            strerror(errno));
+        return NULL;
+    }
+    if (ftruncate(fd, len) != 0) {
+        ALOGW("Unable to size metrics file '%s': %s", fileName,
+            strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    void* addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        ALOGW("Unable to map metrics file '%s': %s", fileName,
+            strerror(errno));
+        return NULL;
+    }
+
+    MetricsFileHeader* page = (MetricsFileHeader*) addr;
+    char* names = (char*) (page + 1);
+    for (int i = 0; i < kVmMetricCount; i++) {
+        strcpy(names, gMetricNames[i]);
+        names += strlen(gMetricNames[i]) + 1;
+    }
+    page->version = kMetricsFileVersion;
+    page->count = kVmMetricCount;
+    page->seq = 0;
+    ANDROID_MEMBAR_STORE();
+    page->magic = kMetricsFileMagic;
+
+    *pLen = len;
+    return page;
+}
+
+/*
+ * Copy the counters out to the file, under the sequence count.
+ */
+static void publishMetrics(MetricsFileHeader* page)
+{
+    u8 values[kVmMetricCount];
+    struct timeval tv;
+
+    dvmGetVmMetrics(values);
+    gettimeofday(&tv, NULL);
+
+    u4 seq = page->seq;
+    android_atomic_release_store(seq + 1, (volatile int32_t*) &page->seq);
+    ANDROID_MEMBAR_STORE();
+    page->updateUsec = (u8) tv.tv_sec * 1000000 + tv.tv_usec;
+    memcpy(page->values, values, sizeof(values));
+    android_atomic_release_store(seq + 2, (volatile int32_t*) &page->seq);
+}
+
+static void* metricsThreadStart(void* arg)
+{
+    Thread* self = dvmThreadSelf();
+    MetricsFileHeader* page = (MetricsFileHeader*) arg;
+
+    /* the counters are read without suspending anyone */
+    dvmChangeStatus(self, THREAD_VMWAIT);
+    for (;;) {
+        publishMetrics(page);
+
+        dvmLockMutex(&gDvm.metricsLock);
+        if (!gDvm.haltMetrics) {
+            int msec = gDvm.metricsIntervalMsec;
+            dvmRelativeCondWait(&gDvm.metricsCond, &gDvm.metricsLock,
+                msec, 0);
+        }
+        bool halt = gDvm.haltMetrics;
+        dvmUnlockMutex(&gDvm.metricsLock);
+        if (halt)
+            break;
+    }
+
+    /* one last update, so the file ends with the final totals */
+    publishMetrics(page);
+    return NULL;
+}
+
+/*
+ * Start the metrics publisher, if -Xmetricsfile was given.
+ *
+ * The counters inherited from the zygote say nothing about this process,
+ * so they're cleared first, whether or not the thread is started.
+ */
+bool dvmStartMetricsPublisher()
+{
+    assert(!gDvm.zygote);
+
+    /* a count that races with this is lost, which is harmless */
+    memset(&gDvm.gcMetrics, 0, sizeof(gDvm.gcMetrics));
+    memset(gDvm.metricsOverflow.counts, 0,
+        sizeof(gDvm.metricsOverflow.counts));
+    for (VmMetricsBlock* block = gDvm.metricsBlocks; block != NULL;
+         block = block->next)
+    {
+        memset(block->counts, 0, sizeof(block->counts));
+    }
+
+    if (gDvm.metricsFile == NULL)
+        return true;
+
+    size_t len;
+    MetricsFileHeader* page = mapMetricsFile(&len);
+    if (page == NULL)
+        return false;
+
+    gDvm.haltMetrics = false;
+    if (!dvmCreateInternalThread(&gDvm.metricsThreadHandle,
+            "Metrics Publisher", metricsThreadStart, page))
+    {
+        ALOGW("Unable to create metrics publisher thread");
+        munmap(page, len);
+        return false;
+    }
+    gDvm.metricsPage = page;
+    gDvm.metricsPageLen = len;
+    gDvm.metricsThreadStarted = true;
+    return true;
+}
+
+/*
+ * Stop the publisher thread.  The file is left behind with the final
+ * values in it.
+ */
+void dvmStopMetricsPublisher()
+{
+    if (!gDvm.metricsThreadStarted)
+        return;
+
+    dvmLockMutex(&gDvm.metricsLock);
+    gDvm.haltMetrics = true;
+    dvmSignalCond(&gDvm.metricsCond);
+    dvmUnlockMutex(&gDvm.metricsLock);
+
+    Thread* self = dvmThreadSelf();
+    ThreadStatus oldStatus = THREAD_UNDEFINED;
+    if (self != NULL)
+        oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    pthread_join(gDvm.metricsThreadHandle, NULL);
+    if (self != NULL)
+        dvmChangeStatus(self, oldStatus);
+    gDvm.metricsThreadStarted = false;
+
+    munmap(gDvm.metricsPage, gDvm.metricsPageLen);
+    gDvm.metricsPage = NULL;
+}
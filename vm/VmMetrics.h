@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Always-on VM counters, cheap enough to leave enabled and to read often.
+ */
+#ifndef DALVIK_VMMETRICS_H_
+#define DALVIK_VMMETRICS_H_
+
+/*
+ * Counters that every thread bumps for itself.  Only the owning thread
+ * writes its block, with plain stores; readers add up every block.
+ */
+enum VmThreadMetric {
+    kThreadMetricAllocObjects = 0,  /* objects allocated */
+    kThreadMetricAllocBytes,        /* bytes requested by those objects */
+    kThreadMetricClassInits,        /* classes this thread initialized */
+    kThreadMetricMonitorContended,  /* monitor acquisitions that waited */
+    kThreadMetricJniCalls,          /* calls into native methods */
+    kThreadMetricCount
+};
+
+/*
+ * A block of per-thread counters.  Blocks live on a list that only ever
+ * grows, and a block is handed to a new thread once its old owner exits,
+ * so totals never go backwards and readers never need a lock.  "base"
+ * holds the counts the block had when its current owner got it.
+ */
+struct VmMetricsBlock {
+    u8              counts[kThreadMetricCount];
+    u8              base[kThreadMetricCount];
+    VmMetricsBlock* next;
+    volatile int32_t inUse;
+};
+
+/*
+ * The exported counters, in the order they are reported.
+ */
+enum VmMetric {
+    kVmMetricAllocObjects = 0,
+    kVmMetricAllocBytes,
+    kVmMetricGcCount,               /* collections of any kind */
+    kVmMetricGcConcurrentCount,     /* ...of which were concurrent */
+    kVmMetricGcPauseMsec,           /* time mutators were stopped */
+    kVmMetricGcTotalMsec,           /* time from start to end of each GC */
+    kVmMetricGcObjectsFreed,
+    kVmMetricGcBytesFreed,
+    kVmMetricHeapAllocated,         /* bytes allocated after the last GC */
+    kVmMetricHeapFootprint,         /* heap footprint after the last GC */
+    kVmMetricClassesLoaded,
+    kVmMetricClassInits,
+    kVmMetricMonitorContended,
+    kVmMetricJniCalls,
+    kVmMetricJitCompiled,           /* translations; 0 without the JIT */
+    kVmMetricJitFailed,
+    kVmMetricJitCodeBytes,
+    kVmMetricThreads,               /* counter blocks in use */
+    kVmMetricFinalizersEnqueued,    /* objects handed to the finalizer */
+    kVmMetricFinalizersPending,     /* ...whose finalizer has not run */
+    kVmMetricFinalizerBytesPending, /* heap bytes those objects hold */
+    kVmMetricHugePageBytes,         /* heap and JIT memory in huge pages */
+    kVmMetricCount
+};
+
+/*
+ * The live heap usage of the objects of one class loader, as of the last
+ * collection that was neither young nor run with the copying collector.
+ * Instances are charged to the loader of their class, and class objects
+ * to their own defining loader.  A NULL loader is the boot class path.
+ * Objects in the zygote heap are not counted.
+ */
+struct VmLoaderUsage {
+    Object*     loader;
+    u8          liveObjects;
+    u8          liveBytes;
+};
+
+/*
+ * Counters kept by the collector.  Written under the heap lock.
+ */
+struct VmGcMetrics {
+    u8          count;
+    u8          concurrentCount;
+    u8          pauseMsec;
+    u8          totalMsec;
+    u8          objectsFreed;
+    u8          bytesFreed;
+    u8          allocated;
+    u8          footprint;
+    u8          finalizersEnqueued;
+    u8          finalizersPending;
+    u8          finalizerBytesPending;
+    u8          hugePageBytes;
+};
+
+/* initialization */
+bool dvmMetricsStartup(void);
+void dvmMetricsShutdown(void);
+
+/*
+ * Get a counter block for a new thread.  Never returns NULL; if memory is
+ * short the thread shares an overflow block and may lose a few counts.
+ */
+VmMetricsBlock* dvmMetricsAcquireBlock(void);
+
+/*
+ * Give back the block of an exiting thread.  The counts stay in it.
+ */
+void dvmMetricsReleaseBlock(VmMetricsBlock* block);
+
+/*
+ * Bump one of the calling thread's counters.
+ */
+INLINE void dvmBumpThreadMetric(Thread* self, VmThreadMetric metric, u8 n)
+{
+    self->metrics->counts[metric] += n;
+}
+
+/*
+ * Returns the value of one of "thread"'s counters since the thread
+ * started.  Threads sharing the overflow block see each other's counts.
+ * Only exact for the calling thread or a thread that is suspended.
+ */
+u8 dvmGetThreadMetric(const Thread* thread, VmThreadMetric metric);
+
+/*
+ * Record the outcome of a collection.  Caller must hold the heap lock.
+ */
+void dvmMetricsRecordGc(bool concurrent, u4 pauseMsec, u4 totalMsec,
+    size_t objectsFreed, size_t bytesFreed, size_t allocated,
+    size_t footprint);
+
+/*
+ * Record the finalizer backlog: "enqueued" more objects were handed to
+ * the finalizer, and "pending" objects holding "pendingBytes" are still
+ * waiting.  Caller must hold the heap lock.
+ */
+void dvmMetricsRecordFinalizers(size_t enqueued, size_t pending,
+    size_t pendingBytes);
+
+/*
+ * Record how much of the heap, card table, mark stack and JIT code cache
+ * is backed by huge pages.  Caller must hold the heap lock.
+ */
+void dvmMetricsRecordHugePages(size_t bytes);
+
+/*
+ * Gather the live bytes that marking charged to each class into a
+ * per-loader table, keeping a copy of the class counters in the class and
+ * clearing them for the next collection.  Called once marking is
+ * complete, with the heap lock held and all threads suspended.
+ */
+void dvmMetricsRecordLoaderUsage(void);
+
+/*
+ * Drop the loaders that "isDead" reports as collected from the table.
+ * Called while system weaks are swept.
+ */
+void dvmMetricsSweepLoaderUsage(int (*isDead)(void* obj));
+
+/*
+ * Returns a copy of the per-loader table, with its length in "*pCount",
+ * or NULL with a count of 0 if it is empty or memory is short.  The
+ * calling thread holds tracked references to the loaders until the copy
+ * is passed to dvmFreeLoaderUsage().
+ */
+VmLoaderUsage* dvmCopyLoaderUsage(size_t* pCount);
+void dvmFreeLoaderUsage(VmLoaderUsage* usage, size_t count);
+
+/*
+ * Fill "values" with the current value of all kVmMetricCount counters.
+ * Takes no locks.  On 32-bit systems a counter that is being written
+ * while it is read can come back torn, so consumers should treat a
+ * counter that goes backwards as noise.
+ */
+void dvmGetVmMetrics(u8* values);
+
+/*
+ * Returns a short name for the counter.
+ */
+const char* dvmVmMetricName(VmMetric metric);
+
+/*
+ * Start the thread that copies the counters to the -Xmetricsfile page.
+ * Does nothing if no file was given.  Must not be called in the zygote.
+ */
+bool dvmStartMetricsPublisher(void);
+
+/*
+ * Stop the publisher thread, if it is running.
+ */
+void dvmStopMetricsPublisher(void);
+
+#endif  // DALVIK_VMMETRICS_H_
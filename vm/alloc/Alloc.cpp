@@ -20,6 +20,7 @@
 #include "alloc/Heap.h"
 #include "alloc/HeapInternal.h"
 #include "alloc/HeapSource.h"
+#include "alloc/Verify.h"
 
 /*
  * Initialize the GC universe.
@@ -219,7 +220,8 @@ Object* dvmCloneObject(Object* obj, int flags)
         size = clazz->objectSize;
     }
 
-    Object* copy = (Object*)dvmMalloc(size, flags);
+    /* Everything past the header is copied before we can be suspended. */
+    Object* copy = (Object*)dvmMalloc(size, flags | ALLOC_UNINITIALIZED);
     if (copy == NULL)
         return NULL;
 
@@ -305,6 +307,71 @@ void dvmCollectGarbage()
     dvmUnlockHeap();
 }
 
+/*
+ * Makes the objects that the current thread allocates come from an
+ * arena of their own, until dvmEndHeapArena().
+ */
+bool dvmBeginHeapArena()
+{
+    Thread *self = dvmThreadSelf();
+    dvmLockHeap();
+    bool opened = dvmHeapSourceOpenArena(self);
+    if (opened) {
+        /* keep the inline fast paths from handing out buffer slots */
+        dvmHeapSourceRetireTlabs(self);
+    }
+    dvmUnlockHeap();
+    return opened;
+}
+
+/*
+ * Empties every thread's allocation buffers, so that allocations take
+ * the slow path again.  Called when allocation counting or tracking is
+ * turned on, after which dvmMalloc() stops refilling them.  The caller
+ * must not hold any lock an allocating thread may wait for.
+ */
+void dvmRetireAllocBuffers()
+{
+    if (!gDvm.useTlabs) {
+        return;
+    }
+    dvmLockHeap();
+    dvmWaitForConcurrentGcToComplete();
+    dvmSuspendAllThreads(SUSPEND_FOR_GC);
+    dvmHeapSourceRetireAllTlabs();
+    dvmResumeAllThreads(SUSPEND_FOR_GC);
+    dvmUnlockHeap();
+}
+
+/*
+ * Ends the current thread's arena.  If nothing refers to its objects
+ * any more, they are dropped and their storage goes back to the system
+ * at once; otherwise they are left for the garbage collector.  Returns
+ * true if the arena was released.
+ */
+bool dvmEndHeapArena()
+{
+    Thread *self = dvmThreadSelf();
+    uintptr_t base, limit;
+    bool released = false;
+
+    dvmLockHeap();
+    dvmWaitForConcurrentGcToComplete();
+    if (dvmHeapSourceGetArenaBounds(self, &base, &limit)) {
+        dvmSuspendAllThreads(SUSPEND_FOR_GC);
+        dvmHeapSourceRetireAllTlabs();
+        released = dvmHeapSourceCanReleaseArena(self) &&
+                   dvmVerifyNoReferencesInto((void *)base, (void *)limit);
+        if (released) {
+            dvmHeapSweepSystemWeaksInRange((void *)base, (void *)limit);
+        }
+        dvmHeapSourceCloseArena(self, released);
+        dvmResumeAllThreads(SUSPEND_FOR_GC);
+    }
+    dvmUnlockHeap();
+    return released;
+}
+
 struct CountContext {
     const ClassObject *clazz;
     size_t count;
@@ -26,6 +26,8 @@ enum {
     ALLOC_DEFAULT = 0x00,
     ALLOC_DONT_TRACK = 0x01,  /* don't add to internal tracking list */
     ALLOC_NON_MOVING = 0x02,
+    ALLOC_NO_REFERENCES = 0x04,  /* object never holds a reference */
+    ALLOC_UNINITIALIZED = 0x08,  /* caller overwrites it; don't zero */
 };
 
 /*
@@ -124,6 +126,27 @@ void dvmSetTargetHeapUtilization(float newTarget);
  */
 void dvmCollectGarbage(void);
 
+/*
+ * Gives the current thread an arena for the objects it allocates from
+ * now on, so that they can be dropped all at once by dvmEndHeapArena().
+ * Returns false if no arena is available.
+ */
+bool dvmBeginHeapArena(void);
+
+/*
+ * Ends the current thread's arena.  Returns true if its objects were
+ * unreachable and were freed at once, false if they were left for the
+ * garbage collector.
+ */
+bool dvmEndHeapArena(void);
+
+/*
+ * Empties the allocation buffers of all threads.  Used when allocation
+ * counting or tracking starts, since allocations served from a buffer
+ * are neither counted nor tracked.
+ */
+void dvmRetireAllocBuffers(void);
+
 /*
  * Returns a count of the direct instances of a class.
  */
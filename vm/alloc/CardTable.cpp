@@ -20,6 +20,7 @@
 #include "alloc/HeapBitmap.h"
 #include "alloc/HeapBitmapInlines.h"
 #include "alloc/HeapSource.h"
+#include "alloc/HugePages.h"
 #include "alloc/Visit.h"
 
 /*
@@ -30,7 +31,8 @@
  * The heap is divided into "cards" of GC_CARD_SIZE bytes, as
  * determined by GC_CARD_SHIFT. The card table contains one byte of
  * data per card, to be used by the GC. The value of the byte will be
- * one of GC_CARD_CLEAN or GC_CARD_DIRTY.
+ * one of GC_CARD_CLEAN or GC_CARD_DIRTY, or GC_CARD_AGED while a
+ * concurrent GC is precleaning the table.
  *
  * After any store of a non-NULL object pointer into a heap object,
  * code is obliged to mark the card dirty. The setters in
@@ -61,8 +63,8 @@ bool dvmCardTableStartup(size_t heapMaximumSize, size_t growthLimit)
     /* Set up the card table */
     length = heapMaximumSize / GC_CARD_SIZE;
     /* Allocate an extra 256 bytes to allow fixed low-byte of base */
-    allocBase = dvmAllocRegion(length + 0x100, PROT_READ | PROT_WRITE,
-                            "dalvik-card-table");
+    allocBase = dvmAllocHugeRegion(length + 0x100, PROT_READ | PROT_WRITE,
+                                   "dalvik-card-table", false);
     if (allocBase == NULL) {
         return false;
     }
@@ -92,7 +94,8 @@ bool dvmCardTableStartup(size_t heapMaximumSize, size_t growthLimit)
 void dvmCardTableShutdown()
 {
     gDvm.biasedCardTableBase = NULL;
-    munmap(gDvm.gcHeap->cardTableBase, gDvm.gcHeap->cardTableLength);
+    dvmFreeHugeRegion(gDvm.gcHeap->cardTableBase,
+                      gDvm.gcHeap->cardTableLength);
 }
 
 void dvmClearCardTable()
@@ -135,6 +138,7 @@ void dvmClearCardTable()
      * on request will be expanded to the heap maximum.
      */
     assert(gDvm.gcHeap->cardTableBase != NULL);
+    gDvm.gcHeap->cardTableClears++;
 
 #if 1
     // zero out cards with memset(), using liveBits as an estimate
@@ -146,6 +150,14 @@ void dvmClearCardTable()
     }
 
     memset(gDvm.gcHeap->cardTableBase, GC_CARD_CLEAN, maxLiveCard);
+
+    // the arenas lie past the growth limit
+    uintptr_t arenaBase, arenaMax;
+    if (dvmHeapSourceGetArenaRegion(&arenaBase, &arenaMax)) {
+        u1 *first = dvmCardFromAddr((void *)arenaBase);
+        u1 *last = dvmCardFromAddr((void *)arenaMax);
+        memset(first, GC_CARD_CLEAN, last - first + 1);
+    }
 #else
     // zero out cards with madvise(), discarding all pages in the card table
     madvise(gDvm.gcHeap->cardTableBase, gDvm.gcHeap->cardTableLength,
@@ -153,6 +165,86 @@ void dvmClearCardTable()
 #endif
 }
 
+/*
+ * Returns a word with the high bit set in every byte of "word" that
+ * equals "value", and all other bits clear.
+ */
+static u4 matchCardBytes(u4 word, u1 value)
+{
+    u4 x = word ^ (value * 0x01010101u);
+    u4 nonzero = ((x & 0x7f7f7f7fu) + 0x7f7f7f7fu) | x;
+    return ~nonzero & 0x80808080u;
+}
+
+/*
+ * Returns a word with every byte that lies within [first, last) set,
+ * for a word of the table that straddles either end of the range.
+ */
+static u4 rangeMask(const u1 *word, const u1 *first, const u1 *last)
+{
+    union {
+        u4 word;
+        u1 bytes[sizeof(u4)];
+    } mask;
+    for (size_t i = 0; i < sizeof(u4); ++i) {
+        const u1 *card = word + i;
+        mask.bytes[i] = (card >= first && card < last) ? 0xff : 0;
+    }
+    return mask.word;
+}
+
+/*
+ * Rewrites the cards in [first, last) that hold "from" to hold "to", a
+ * word at a time, and returns how many were rewritten.  Runs of clean
+ * cards, which is most of the table, are skipped four words at a time.
+ * The write barrier stores card bytes without any synchronization, so
+ * every word is updated with a compare-and-swap: a card that a mutator
+ * dirties while we work is never lost.
+ */
+static size_t transformCards(u1 *first, u1 *last, u1 from, u1 to)
+{
+    assert(from != GC_CARD_CLEAN);
+    size_t count = 0;
+    u4 *word = (u4 *)ALIGN_DOWN(first, sizeof(u4));
+    u4 *end = (u4 *)ALIGN_UP(last, sizeof(u4));
+    while (word < end) {
+        if (word + 4 <= end && (word[0] | word[1] | word[2] | word[3]) == 0) {
+            word += 4;
+            continue;
+        }
+        u4 mask = ~0u;
+        if ((u1 *)word < first || (u1 *)(word + 1) > last) {
+            mask = rangeMask((const u1 *)word, first, last);
+        }
+        for (;;) {
+            u4 old = *(volatile u4 *)word;
+            u4 match = matchCardBytes(old, from) & mask;
+            if (match == 0) {
+                break;
+            }
+            u4 bytes = (match >> 7) * 0xff;
+            u4 updated = (old & ~bytes) | ((to * 0x01010101u) & bytes);
+            if (android_atomic_release_cas((int32_t)old, (int32_t)updated,
+                                           (volatile int32_t *)word) == 0) {
+                count += __builtin_popcount(match);
+                break;
+            }
+        }
+        ++word;
+    }
+    return count;
+}
+
+size_t dvmAgeCards(u1 *first, u1 *last)
+{
+    return transformCards(first, last, GC_CARD_DIRTY, GC_CARD_AGED);
+}
+
+void dvmCleanAgedCards(u1 *first, u1 *last)
+{
+    transformCards(first, last, GC_CARD_AGED, GC_CARD_CLEAN);
+}
+
 /*
  * Returns true iff the address is within the bounds of the card table.
  */
@@ -160,7 +252,7 @@ bool dvmIsValidCard(const u1 *cardAddr)
 {
     GcHeap *h = gDvm.gcHeap;
     u1* begin = h->cardTableBase + h->cardTableOffset;
-    u1* end = &begin[h->cardTableLength];
+    u1* end = &begin[h->cardTableMaxLength];
     return cardAddr >= begin && cardAddr < end;
 }
 
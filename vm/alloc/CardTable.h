@@ -27,6 +27,8 @@
 #define GC_CARD_SIZE (1 << GC_CARD_SHIFT)
 #define GC_CARD_CLEAN 0
 #define GC_CARD_DIRTY 0x70
+/* Dirty before the concurrent precleaning pass began; see dvmAgeCards */
+#define GC_CARD_AGED (GC_CARD_DIRTY - 1)
 
 /*
  * Initializes the card table; must be called before any other
@@ -44,6 +46,19 @@ void dvmCardTableShutdown(void);
  */
 void dvmClearCardTable(void);
 
+/*
+ * Turns the dirty cards in [first, last) into aged cards, and returns
+ * how many there were.  Safe to call while mutators dirty cards.
+ */
+size_t dvmAgeCards(u1 *first, u1 *last);
+
+/*
+ * Turns the aged cards in [first, last) clean, leaving alone the cards
+ * dirtied again since they were aged.  Safe to call while mutators
+ * dirty cards.
+ */
+void dvmCleanAgedCards(u1 *first, u1 *last);
+
 /*
  * Returns the address of the relevent byte in the card table, given
  * an address on the heap.
@@ -21,9 +21,11 @@
 #include "Dalvik.h"
 #include "alloc/Heap.h"
 #include "alloc/HeapBitmap.h"
+#include "alloc/HeapBitmapInlines.h"
 #include "alloc/HeapInternal.h"
 #include "alloc/HeapSource.h"
 #include "alloc/Verify.h"
+#include "alloc/Visit.h"
 
 /*
  * A "mostly copying", generational, garbage collector.
@@ -96,6 +98,15 @@
  * The block scheme allows us to use VM page faults to maintain a
  * write barrier.  Consider having a special leaf state for a page.
  *
+ * This collector replaces the mark-sweep collector when the VM is
+ * built with WITH_COPYING_GC and runs the same dvmCollectGarbageInternal()
+ * sequence with every thread suspended throughout.  Marking the roots
+ * flips the spaces and promotes the blocks of every object a root
+ * other than an interpreted stack slot refers to, since native code
+ * holds raw pointers to those.  Scanning the marked objects scavenges
+ * the precise stack slots and the block queue.  Swapping the bitmaps
+ * releases from-space, and sweeping only reports what was released.
+ *
  * Bibliography:
  *
  * C. J. Cheney. 1970. A non-recursive list compacting
@@ -230,7 +241,21 @@ struct HeapSource {
      */
     size_t currentSize;
 
+    /*
+     * The number of bytes the heap may use, half of which can be
+     * allocated between collections.  Starts out as the -XX:HeapGrowthLimit
+     * value and is raised to the maximumSize by dvmClearGrowthLimit().
+     */
+    size_t growthLimit;
+
     size_t bytesAllocated;
+
+    /* The value of bytesAllocated when the current collection began. */
+    size_t bytesAllocatedBefore;
+
+    /* What releasing from-space reclaimed during the last collection. */
+    size_t objectsFreed;
+    size_t bytesFreed;
 };
 
 static unsigned long alignDown(unsigned long x, unsigned long n)
@@ -300,13 +325,14 @@ static void *allocateBlocks(HeapSource *heapSource, size_t blocks)
     /* Check underflow. */
     assert(blocks != 0);
     /* Check overflow. */
-    if (allocBlocks + blocks > totalBlocks / 2) {
+    if (allocBlocks + blocks > heapSource->growthLimit / BLOCK_SIZE / 2) {
         return NULL;
     }
     /* Scan block map. */
     for (size_t i = 0; i < totalBlocks; ++i) {
         /* Check fit. */
-        for (size_t j = 0; j < blocks; ++j) { /* runs over totalBlocks */
+        size_t j;
+        for (j = 0; j < blocks && i + j < totalBlocks; ++j) {
             if (heapSource->blockSpace[i+j] != BLOCK_FREE) {
                 break;
             }
@@ -349,7 +375,7 @@ static void *allocateBlocks(HeapSource *heapSource, size_t blocks)
 static size_t addressToBlock(const HeapSource *heapSource, const void *addr)
 {
     assert(heapSource != NULL);
-    assert(isValidAddress(heapSource, addr));
+    assert(isValidAddress(heapSource, (const u1 *)addr));
     return (((uintptr_t)addr) >> BLOCK_SHIFT) - heapSource->baseBlock;
 }
 
@@ -363,40 +389,55 @@ static u1 *blockToAddress(const HeapSource *heapSource, size_t block)
     return addr;
 }
 
-static void clearBlock(HeapSource *heapSource, size_t block)
+/*
+ * Releases a block and returns the number of objects that started in
+ * it.
+ */
+static size_t clearBlock(HeapSource *heapSource, size_t block)
 {
     assert(heapSource != NULL);
     assert(block < heapSource->totalBlocks);
     u1 *addr = heapSource->blockBase + block*BLOCK_SIZE;
+    size_t count = 0;
     memset(addr, 0xCC, BLOCK_SIZE);
-    for (size_t i = 0; i < BLOCK_SIZE; i += 8) {
-        dvmHeapBitmapClearObjectBit(&heapSource->allocBits, addr + i);
+    for (size_t i = 0; i < BLOCK_SIZE; i += ALLOC_ALIGNMENT) {
+        if (dvmHeapBitmapIsObjectBitSet(&heapSource->allocBits, addr + i)) {
+            dvmHeapBitmapClearObjectBit(&heapSource->allocBits, addr + i);
+            ++count;
+        }
     }
+    return count;
 }
 
-static void clearFromSpace(HeapSource *heapSource)
+/*
+ * Releases every from-space block and returns the number of objects
+ * that were in them.
+ */
+static size_t clearFromSpace(HeapSource *heapSource)
 {
     assert(heapSource != NULL);
     size_t i = 0;
     size_t count = 0;
+    size_t numObjects = 0;
     while (i < heapSource->totalBlocks) {
         if (heapSource->blockSpace[i] != BLOCK_FROM_SPACE) {
             ++i;
             continue;
         }
         heapSource->blockSpace[i] = BLOCK_FREE;
-        clearBlock(heapSource, i);
+        numObjects += clearBlock(heapSource, i);
         ++i;
         ++count;
         while (i < heapSource->totalBlocks &&
                heapSource->blockSpace[i] == BLOCK_CONTINUED) {
             heapSource->blockSpace[i] = BLOCK_FREE;
-            clearBlock(heapSource, i);
+            numObjects += clearBlock(heapSource, i);
             ++i;
             ++count;
         }
     }
     LOG_SCAV("freed %zu blocks (%zu bytes)", count, count*BLOCK_SIZE);
+    return numObjects;
 }
 
 /*
@@ -430,42 +471,65 @@ static void promoteBlockByAddr(HeapSource *heapSource, const void *addr)
         // LOG_PROM("promoting block %zu %d @ %p", block, heapSource->blockSpace[block], obj);
         heapSource->blockSpace[block] = BLOCK_TO_SPACE;
         enqueueBlock(heapSource, block);
-        /* TODO(cshapiro): count continued blocks?*/
         heapSource->allocBlocks += 1;
+        /*
+         * The objects stay where they are, so they count as allocated
+         * again.  Promotion happens before anything is transported,
+         * so every header in the block is still intact.
+         */
+        u1 *base = blockToAddress(heapSource, block);
+        for (size_t i = 0; i < BLOCK_SIZE; i += ALLOC_ALIGNMENT) {
+            if (dvmHeapBitmapIsObjectBitSet(&heapSource->allocBits, base + i)) {
+                Object *obj = (Object *)(base + i);
+                heapSource->bytesAllocated +=
+                    alignUp(objectSize(obj), ALLOC_ALIGNMENT);
+            }
+        }
+        /* A large object keeps its continued blocks. */
+        for (size_t i = block + 1; i < heapSource->totalBlocks &&
+             heapSource->blockSpace[i] == BLOCK_CONTINUED; ++i) {
+            heapSource->allocBlocks += 1;
+        }
     } else {
         // LOG_PROM("NOT promoting block %zu %d @ %p", block, heapSource->blockSpace[block], obj);
     }
 }
 
-GcHeap *dvmHeapSourceStartup(size_t startSize, size_t absoluteMaxSize)
+GcHeap *dvmHeapSourceStartup(size_t startSize, size_t maximumSize,
+                             size_t growthLimit)
 {
     GcHeap* gcHeap;
     HeapSource *heapSource;
 
-    assert(startSize <= absoluteMaxSize);
+    assert(startSize <= maximumSize);
+    assert(growthLimit <= maximumSize);
 
-    heapSource = calloc(1, sizeof(*heapSource));
+    heapSource = (HeapSource *)calloc(1, sizeof(*heapSource));
     assert(heapSource != NULL);
 
     heapSource->minimumSize = alignUp(startSize, BLOCK_SIZE);
-    heapSource->maximumSize = alignUp(absoluteMaxSize, BLOCK_SIZE);
+    heapSource->maximumSize = alignUp(maximumSize, BLOCK_SIZE);
+    heapSource->growthLimit = alignUp(growthLimit, BLOCK_SIZE);
 
     heapSource->currentSize = heapSource->maximumSize;
 
     /* Allocate underlying storage for blocks. */
-    heapSource->blockBase = virtualAlloc(heapSource->maximumSize);
-    assert(heapSource->blockBase != NULL);
+    heapSource->blockBase = (u1 *)virtualAlloc(heapSource->maximumSize);
+    if (heapSource->blockBase == NULL) {
+        free(heapSource);
+        return NULL;
+    }
     heapSource->baseBlock = (uintptr_t) heapSource->blockBase >> BLOCK_SHIFT;
     heapSource->limitBlock = ((uintptr_t) heapSource->blockBase + heapSource->maximumSize) >> BLOCK_SHIFT;
 
     heapSource->allocBlocks = 0;
     heapSource->totalBlocks = (heapSource->limitBlock - heapSource->baseBlock);
 
-    assert(heapSource->totalBlocks = heapSource->maximumSize / BLOCK_SIZE);
+    assert(heapSource->totalBlocks == heapSource->maximumSize / BLOCK_SIZE);
 
     {
         size_t size = sizeof(heapSource->blockQueue[0]);
-        heapSource->blockQueue = malloc(heapSource->totalBlocks*size);
+        heapSource->blockQueue = (size_t *)malloc(heapSource->totalBlocks*size);
         assert(heapSource->blockQueue != NULL);
         memset(heapSource->blockQueue, 0xCC, heapSource->totalBlocks*size);
         heapSource->queueHead = QUEUE_TAIL;
@@ -474,7 +538,7 @@ GcHeap *dvmHeapSourceStartup(size_t startSize, size_t absoluteMaxSize)
     /* Byte indicating space residence or free status of block. */
     {
         size_t size = sizeof(heapSource->blockSpace[0]);
-        heapSource->blockSpace = calloc(1, heapSource->totalBlocks*size);
+        heapSource->blockSpace = (char *)calloc(1, heapSource->totalBlocks*size);
         assert(heapSource->blockSpace != NULL);
     }
 
@@ -484,10 +548,10 @@ GcHeap *dvmHeapSourceStartup(size_t startSize, size_t absoluteMaxSize)
                       "blockBase");
 
     /* Initialize allocation pointers. */
-    heapSource->allocPtr = allocateBlocks(heapSource, 1);
+    heapSource->allocPtr = (u1 *)allocateBlocks(heapSource, 1);
     heapSource->allocLimit = heapSource->allocPtr + BLOCK_SIZE;
 
-    gcHeap = calloc(1, sizeof(*gcHeap));
+    gcHeap = (GcHeap *)calloc(1, sizeof(*gcHeap));
     assert(gcHeap != NULL);
     gcHeap->heapSource = heapSource;
 
@@ -504,16 +568,20 @@ bool dvmHeapSourceStartupAfterZygote()
     return true;
 }
 
+/*
+ * There is a single space, so the zygote's objects are not kept
+ * apart from the ones its children allocate.
+ */
 bool dvmHeapSourceStartupBeforeFork()
 {
-    assert(!"implemented");
-    return false;
+    return true;
 }
 
 void dvmHeapSourceShutdown(GcHeap **gcHeap)
 {
     if (*gcHeap == NULL || (*gcHeap)->heapSource == NULL)
         return;
+    dvmHeapBitmapDelete(&(*gcHeap)->heapSource->allocBits);
     free((*gcHeap)->heapSource->blockQueue);
     free((*gcHeap)->heapSource->blockSpace);
     virtualFree((*gcHeap)->heapSource->blockBase,
@@ -524,6 +592,22 @@ void dvmHeapSourceShutdown(GcHeap **gcHeap)
     *gcHeap = NULL;
 }
 
+void *dvmHeapSourceGetBase()
+{
+    return gDvm.gcHeap->heapSource->blockBase;
+}
+
+size_t dvmHeapSourceGetReservedLength()
+{
+    return gDvm.gcHeap->heapSource->maximumSize;
+}
+
+void *dvmHeapSourceGetLimit()
+{
+    HeapSource *heapSource = gDvm.gcHeap->heapSource;
+    return heapSource->blockBase + heapSource->maximumSize;
+}
+
 size_t dvmHeapSourceGetValue(HeapSourceValueSpec spec,
                              size_t perHeapStats[],
                              size_t arrayLen)
@@ -537,7 +621,7 @@ size_t dvmHeapSourceGetValue(HeapSourceValueSpec spec,
         value = heapSource->maximumSize;
         break;
     case HS_ALLOWED_FOOTPRINT:
-        value = heapSource->maximumSize;
+        value = heapSource->growthLimit;
         break;
     case HS_BYTES_ALLOCATED:
         value = heapSource->bytesAllocated;
@@ -555,14 +639,24 @@ size_t dvmHeapSourceGetValue(HeapSourceValueSpec spec,
     return value;
 }
 
-/*
- * Performs a shallow copy of the allocation bitmap into the given
- * vector of heap bitmaps.
- */
-void dvmHeapSourceGetObjectBitmaps(HeapBitmap objBits[], HeapBitmap markBits[],
-                                   size_t numHeaps)
+void dvmHeapSourceGetRegions(uintptr_t *base, uintptr_t *max, size_t numHeaps)
 {
-    assert(!"implemented");
+    HeapSource *heapSource = gDvm.gcHeap->heapSource;
+
+    assert(numHeaps == 1);
+    base[0] = (uintptr_t)heapSource->blockBase;
+    max[0] = MIN((uintptr_t)heapSource->blockBase + heapSource->maximumSize - 1,
+                 heapSource->allocBits.max);
+}
+
+bool dvmHeapSourceGetLargeObjectRegion(uintptr_t *base, uintptr_t *max)
+{
+    return false;
+}
+
+bool dvmHeapSourceGetArenaRegion(uintptr_t *base, uintptr_t *max)
+{
+    return false;
 }
 
 HeapBitmap *dvmHeapSourceGetLiveBits()
@@ -570,6 +664,50 @@ HeapBitmap *dvmHeapSourceGetLiveBits()
     return &gDvm.gcHeap->heapSource->allocBits;
 }
 
+/*
+ * Objects are marked by moving them to to-space; there is no mark
+ * bitmap.
+ */
+HeapBitmap *dvmHeapSourceGetMarkBits()
+{
+    return NULL;
+}
+
+/*
+ * Called once the trace is complete.  Everything reachable is now in
+ * to-space, so this is where the live set changes over: the blocks
+ * left in from-space are released and their allocation bits cleared.
+ */
+void dvmHeapSourceSwapBitmaps()
+{
+    HeapSource *heapSource = gDvm.gcHeap->heapSource;
+
+    heapSource->objectsFreed = clearFromSpace(heapSource);
+    heapSource->bytesFreed = 0;
+    if (heapSource->bytesAllocatedBefore > heapSource->bytesAllocated) {
+        heapSource->bytesFreed =
+            heapSource->bytesAllocatedBefore - heapSource->bytesAllocated;
+    }
+}
+
+void dvmHeapSourceZeroMarkBitmap()
+{
+    /* do nothing */
+}
+
+/*
+ * There is no zygote space, so no object is ever immune.
+ */
+void dvmMarkImmuneObjects(const char *immuneLimit)
+{
+    assert(immuneLimit == NULL);
+}
+
+void *dvmHeapSourceGetImmuneLimit(bool isPartial)
+{
+    return NULL;
+}
+
 /*
  * Allocate the specified number of bytes from the heap.  The
  * allocation cursor points into a block of free storage.  If the
@@ -580,7 +718,7 @@ HeapBitmap *dvmHeapSourceGetLiveBits()
  * the allocation is larger than a block we must allocate from a span
  * of contiguous blocks.
  */
-void *dvmHeapSourceAlloc(size_t length)
+void *dvmHeapSourceAlloc(size_t length, bool zero)
 {
     HeapSource *heapSource;
     unsigned char *addr;
@@ -605,7 +743,7 @@ void *dvmHeapSourceAlloc(size_t length)
 
     /* Try allocating in a new block. */
     if (aligned <= BLOCK_SIZE) {
-        addr =  allocateBlocks(heapSource, 1);
+        addr = (u1 *)allocateBlocks(heapSource, 1);
         if (addr != NULL) {
             heapSource->allocLimit = addr + BLOCK_SIZE;
             heapSource->allocPtr = addr + aligned;
@@ -619,7 +757,7 @@ void *dvmHeapSourceAlloc(size_t length)
     /* Try allocating in a span of blocks. */
     blocks = alignUp(aligned, BLOCK_SIZE) / BLOCK_SIZE;
 
-    addr = allocateBlocks(heapSource, blocks);
+    addr = (u1 *)allocateBlocks(heapSource, blocks);
     /* Propagate failure upward. */
     if (addr != NULL) {
         heapSource->bytesAllocated += aligned;
@@ -629,13 +767,81 @@ void *dvmHeapSourceAlloc(size_t length)
     return addr;
 }
 
-void *dvmHeapSourceAllocAndGrow(size_t size)
+void *dvmHeapSourceAllocAndGrow(size_t size, bool zero)
+{
+    return dvmHeapSourceAlloc(size, zero);
+}
+
+/*
+ * Large objects are copied like any other; there is no separate space
+ * for them.
+ */
+void *dvmHeapSourceAllocLarge(size_t size, bool grow)
+{
+    return dvmHeapSourceAlloc(size, true);
+}
+
+/*
+ * Thread-local allocation buffers hand out dlmalloc chunks; allocation
+ * here is already a pointer bump, so callers always take the regular
+ * path.
+ */
+void *dvmHeapSourceRefillTlab(Thread *self, size_t n)
+{
+    return NULL;
+}
+
+void dvmHeapSourceRetireTlabs(Thread *self)
+{
+    /* do nothing */
+}
+
+void dvmHeapSourceRetireAllTlabs()
+{
+    /* do nothing */
+}
+
+/*
+ * Objects move between the semispaces, so there is nothing an arena
+ * could hold on to.
+ */
+bool dvmHeapSourceOpenArena(Thread *self)
+{
+    return false;
+}
+
+void *dvmHeapSourceArenaAlloc(Thread *self, size_t n)
+{
+    return NULL;
+}
+
+bool dvmHeapSourceGetArenaBounds(const Thread *self, uintptr_t *base,
+                                 uintptr_t *limit)
+{
+    return false;
+}
+
+bool dvmHeapSourceCanReleaseArena(const Thread *self)
+{
+    return false;
+}
+
+void dvmHeapSourceCloseArena(Thread *self, bool release)
+{
+    /* do nothing */
+}
+
+/*
+ * Storage is only ever reclaimed a space at a time.
+ */
+size_t dvmHeapSourceFreeList(size_t numPtrs, void **ptrs)
 {
-    return dvmHeapSourceAlloc(size);
+    assert(!"implemented");
+    return 0;
 }
 
 /* TODO: refactor along with dvmHeapSourceAlloc */
-void *allocateGray(size_t size)
+static void *allocateGray(size_t size)
 {
     HeapSource *heapSource;
     void *addr;
@@ -643,7 +849,7 @@ void *allocateGray(size_t size)
 
     /* TODO: add a check that we are in a GC. */
     heapSource = gDvm.gcHeap->heapSource;
-    addr = dvmHeapSourceAlloc(size);
+    addr = dvmHeapSourceAlloc(size, true);
     assert(addr != NULL);
     block = addressToBlock(heapSource, (const u1 *)addr);
     if (heapSource->queueHead == QUEUE_TAIL) {
@@ -664,6 +870,14 @@ bool dvmHeapSourceContainsAddress(const void *ptr)
     return dvmHeapBitmapCoversAddress(&heapSource->allocBits, ptr);
 }
 
+/*
+ * There is no zygote heap; every object may move.
+ */
+bool dvmHeapSourceIsInZygoteHeap(const void *ptr)
+{
+    return false;
+}
+
 /*
  * Returns true if the given address is within the heap and points to
  * the header of a live object.
@@ -682,22 +896,34 @@ bool dvmHeapSourceContains(const void *addr)
     }
 }
 
-bool dvmHeapSourceGetPtrFlag(const void *ptr, HeapSourcePtrFlag flag)
+bool dvmIsZygoteObject(const Object* obj)
 {
-    assert(!"implemented");
     return false;
 }
 
 size_t dvmHeapSourceChunkSize(const void *ptr)
 {
-    assert(!"implemented");
-    return 0;
+    assert(dvmHeapSourceContains(ptr));
+    return alignUp(objectSize((const Object *)ptr), ALLOC_ALIGNMENT);
 }
 
 size_t dvmHeapSourceFootprint()
 {
-    assert(!"implemented");
-    return 0;
+    return gDvm.gcHeap->heapSource->maximumSize;
+}
+
+size_t dvmHeapSourceGetMaximumSize()
+{
+    return gDvm.gcHeap->heapSource->growthLimit;
+}
+
+void dvmClearGrowthLimit()
+{
+    dvmLockHeap();
+    HeapSource *heapSource = gDvm.gcHeap->heapSource;
+    gDvm.gcHeap->cardTableLength = gDvm.gcHeap->cardTableMaxLength;
+    heapSource->growthLimit = heapSource->maximumSize;
+    dvmUnlockHeap();
 }
 
 /*
@@ -731,41 +957,53 @@ void dvmHeapSourceGrowForUtilization()
     /* do nothing */
 }
 
-void dvmHeapSourceWalk(void(*callback)(void* start, void* end,
-                                       size_t used_bytes, void* arg),
-                       void *arg)
+void dvmHeapSourceRecordGcTimes(u4 startMsec, u4 totalMsec, u4 maxPauseMsec,
+                                bool isConcurrent)
 {
-    assert(!"implemented");
+    /* do nothing */
 }
 
-size_t dvmHeapSourceGetNumHeaps()
-{
-    return 1;
-}
+struct WalkContext {
+    void (*callback)(void* start, void* end, size_t used_bytes, void* arg);
+    void *arg;
+};
 
-bool dvmTrackExternalAllocation(size_t n)
+static void walkBitmapCallback(Object *obj, void *arg)
 {
-    /* do nothing */
-    return true;
+    WalkContext *ctx = (WalkContext *)arg;
+    size_t size = alignUp(objectSize(obj), ALLOC_ALIGNMENT);
+    (*ctx->callback)(obj, (u1 *)obj + size, size, ctx->arg);
 }
 
-void dvmTrackExternalFree(size_t n)
+/*
+ * Passes every allocated object to the callback.  Free space is not
+ * reported; callers infer it from the gaps.
+ */
+void dvmHeapSourceWalk(void(*callback)(void* start, void* end,
+                                       size_t used_bytes, void* arg),
+                       void *arg)
 {
-    /* do nothing */
+    WalkContext ctx;
+    ctx.callback = callback;
+    ctx.arg = arg;
+    dvmHeapBitmapWalk(&gDvm.gcHeap->heapSource->allocBits,
+                      walkBitmapCallback, &ctx);
+    (*callback)(NULL, NULL, 0, arg);  // Indicate end of a heap.
 }
 
-size_t dvmGetExternalBytesAllocated()
+size_t dvmHeapSourceGetNumHeaps()
 {
-    assert(!"implemented");
-    return 0;
+    return 1;
 }
 
-void dvmHeapSourceFlip()
+static void flipSpaces()
 {
     HeapSource *heapSource = gDvm.gcHeap->heapSource;
 
     /* Reset the block queue. */
     heapSource->allocBlocks = 0;
+    heapSource->bytesAllocatedBefore = heapSource->bytesAllocated;
+    heapSource->bytesAllocated = 0;
     heapSource->queueSize = 0;
     heapSource->queueHead = QUEUE_TAIL;
 
@@ -829,8 +1067,8 @@ static void pinObject(const Object *obj)
 static size_t sumHeapBitmap(const HeapBitmap *bitmap)
 {
     size_t sum = 0;
-    for (size_t i = 0; i < bitmap->bitsLen >> 2; ++i) {
-        sum += CLZ(bitmap->bits[i]);
+    for (size_t i = 0; i < bitmap->bitsLen / sizeof(bitmap->bits[0]); ++i) {
+        sum += __builtin_popcountl(bitmap->bits[i]);
     }
     return sum;
 }
@@ -854,17 +1092,16 @@ static void* getForward(const void *fromObj)
     return (void *)((uintptr_t)fromObj & ~0x1);
 }
 
-/* Beware, uses the same encoding as a forwarding pointers! */
-static int isPermanentString(const StringObject *obj) {
-    return (uintptr_t)obj & 0x1;
-}
-
-static void* getPermanentString(const StringObject *obj)
+/*
+ * Returns true if the object is in from-space and has not been
+ * transported, i.e. it is unreachable once the trace is complete.
+ */
+static bool isWhite(const Object *obj)
 {
-    return (void *)((uintptr_t)obj & ~0x1);
+    assert(obj != NULL);
+    return fromSpaceContains(obj) && !isForward(obj->clazz);
 }
 
-
 /*
  * Scavenging and transporting routines follow.  A transporter grays
  * an object.  A scavenger blackens an object.  We define these
@@ -879,9 +1116,9 @@ static void scavengeClassObject(ClassObject *obj)
 {
     LOG_SCAV("scavengeClassObject(obj=%p)", obj);
     assert(obj != NULL);
-    assert(obj->obj.clazz != NULL);
-    assert(obj->obj.clazz->descriptor != NULL);
-    assert(!strcmp(obj->obj.clazz->descriptor, "Ljava/lang/Class;"));
+    assert(obj->clazz != NULL);
+    assert(obj->clazz->descriptor != NULL);
+    assert(!strcmp(obj->clazz->descriptor, "Ljava/lang/Class;"));
     assert(obj->descriptor != NULL);
     LOG_SCAV("scavengeClassObject: descriptor='%s',vtableCount=%zu",
              obj->descriptor, obj->vtableCount);
@@ -891,20 +1128,26 @@ static void scavengeClassObject(ClassObject *obj)
     if (IS_CLASS_FLAG_SET(obj, CLASS_ISARRAY)) {
         scavengeReference((Object **)(void *)&obj->elementClass);
     }
-    /* Scavenge the superclass. */
-    scavengeReference((Object **)(void *)&obj->super);
+    /* Scavenge the superclass, unless it is still a dex index. */
+    if (obj->status > CLASS_IDX) {
+        scavengeReference((Object **)(void *)&obj->super);
+    }
     /* Scavenge the class loader. */
     scavengeReference(&obj->classLoader);
+    /* Scavenge the reflection object cache. */
+    scavengeReference((Object **)(void *)&obj->reflectCache);
     /* Scavenge static fields. */
     for (int i = 0; i < obj->sfieldCount; ++i) {
-        char ch = obj->sfields[i].field.signature[0];
+        char ch = obj->sfields[i].signature[0];
         if (ch == '[' || ch == 'L') {
             scavengeReference((Object **)(void *)&obj->sfields[i].value.l);
         }
     }
     /* Scavenge interface class objects. */
-    for (int i = 0; i < obj->interfaceCount; ++i) {
-        scavengeReference((Object **) &obj->interfaces[i]);
+    if (obj->status > CLASS_IDX) {
+        for (int i = 0; i < obj->interfaceCount; ++i) {
+            scavengeReference((Object **) &obj->interfaces[i]);
+        }
     }
 }
 
@@ -917,12 +1160,12 @@ static size_t scavengeArrayObject(ArrayObject *array)
     /* Scavenge the class object. */
     assert(toSpaceContains(array));
     assert(array != NULL);
-    assert(array->obj.clazz != NULL);
+    assert(array->clazz != NULL);
     scavengeReference((Object **) array);
     size_t length = dvmArrayObjectSize(array);
     /* Scavenge the array contents. */
-    if (IS_CLASS_FLAG_SET(array->obj.clazz, CLASS_ISOBJECTARRAY)) {
-        Object **contents = (Object **)array->contents;
+    if (IS_CLASS_FLAG_SET(array->clazz, CLASS_ISOBJECTARRAY)) {
+        Object **contents = (Object **)(void *)array->contents;
         for (size_t i = 0; i < array->length; ++i) {
             scavengeReference(&contents[i]);
         }
@@ -940,20 +1183,26 @@ static int getReferenceFlags(const Object *obj)
 
     flags = CLASS_ISREFERENCE |
             CLASS_ISWEAKREFERENCE |
+            CLASS_ISFINALIZERREFERENCE |
             CLASS_ISPHANTOMREFERENCE;
     return GET_CLASS_FLAG_GROUP(obj->clazz, flags);
 }
 
-static int isSoftReference(const Object *obj)
+static bool isSoftReference(const Object *obj)
 {
     return getReferenceFlags(obj) == CLASS_ISREFERENCE;
 }
 
-static int isWeakReference(const Object *obj)
+static bool isWeakReference(const Object *obj)
 {
     return getReferenceFlags(obj) & CLASS_ISWEAKREFERENCE;
 }
 
+static bool isFinalizerReference(const Object *obj)
+{
+    return getReferenceFlags(obj) & CLASS_ISFINALIZERREFERENCE;
+}
+
 #ifndef NDEBUG
 static bool isPhantomReference(const Object *obj)
 {
@@ -962,29 +1211,56 @@ static bool isPhantomReference(const Object *obj)
 #endif
 
 /*
- * Returns true if the reference was registered with a reference queue
- * but has not yet been appended to it.
+ * Adds a reference to the tail of a circular queue of references.
  */
-static bool isReferenceEnqueuable(const Object *ref)
+static void enqueuePendingReference(Object *ref, Object **list)
 {
-    Object *queue, *queueNext;
+    assert(ref != NULL);
+    assert(list != NULL);
+    size_t offset = gDvm.offJavaLangRefReference_pendingNext;
+    if (*list == NULL) {
+        dvmSetFieldObject(ref, offset, ref);
+        *list = ref;
+    } else {
+        Object *head = dvmGetFieldObject(*list, offset);
+        dvmSetFieldObject(ref, offset, head);
+        dvmSetFieldObject(*list, offset, ref);
+    }
+}
 
-    queue = dvmGetFieldObject(ref, gDvm.offJavaLangRefReference_queue);
-    queueNext = dvmGetFieldObject(ref, gDvm.offJavaLangRefReference_queueNext);
-    if (queue == NULL || queueNext != NULL) {
-        /*
-         * There is no queue, or the reference has already
-         * been enqueued.  The Reference.enqueue() method
-         * will do nothing even if we call it.
-         */
-        return false;
+/*
+ * Removes the reference at the head of a circular queue of
+ * references.
+ */
+static Object *dequeuePendingReference(Object **list)
+{
+    assert(list != NULL);
+    assert(*list != NULL);
+    size_t offset = gDvm.offJavaLangRefReference_pendingNext;
+    Object *head = dvmGetFieldObject(*list, offset);
+    Object *ref;
+    if (*list == head) {
+        ref = *list;
+        *list = NULL;
+    } else {
+        Object *next = dvmGetFieldObject(head, offset);
+        dvmSetFieldObject(*list, offset, next);
+        ref = head;
     }
+    dvmSetFieldObject(ref, offset, NULL);
+    return ref;
+}
 
-    /*
-     * We need to call enqueue(), but if we called it from
-     * here we'd probably deadlock.  Schedule a call.
-     */
-    return true;
+/*
+ * Returns true if the reference was registered with a reference queue
+ * and has not yet been enqueued.
+ */
+static bool isEnqueuable(const Object *ref)
+{
+    assert(ref != NULL);
+    Object *queue = dvmGetFieldObject(ref, gDvm.offJavaLangRefReference_queue);
+    Object *queueNext = dvmGetFieldObject(ref, gDvm.offJavaLangRefReference_queueNext);
+    return queue != NULL && queueNext == NULL;
 }
 
 /*
@@ -995,10 +1271,7 @@ static void enqueueReference(Object *ref)
     assert(ref != NULL);
     assert(dvmGetFieldObject(ref, gDvm.offJavaLangRefReference_queue) != NULL);
     assert(dvmGetFieldObject(ref, gDvm.offJavaLangRefReference_queueNext) == NULL);
-    if (!dvmHeapAddRefToLargeTable(&gDvm.gcHeap->referenceOperations, ref)) {
-        ALOGE("no room for any more reference operations");
-        dvmAbort();
-    }
+    enqueuePendingReference(ref, &gDvm.gcHeap->clearedReferences);
 }
 
 /*
@@ -1010,92 +1283,74 @@ static void clearReference(Object *obj)
 }
 
 /*
- * Clears reference objects with white referents.
+ * Returns the referent of a pending reference.  A referent that has
+ * been transported since the reference was discovered is snapped to
+ * its new address first.
  */
-void clearWhiteReferences(Object **list)
+static Object *getReferent(Object *ref)
 {
-    size_t referentOffset, queueNextOffset;
-    bool doSignal;
+    JValue *field = dvmFieldPtr(ref, gDvm.offJavaLangRefReference_referent);
+    Object *referent = field->l;
+    if (referent != NULL && fromSpaceContains(referent) &&
+        isForward(referent->clazz)) {
+        field->l = referent = (Object *)getForward(referent->clazz);
+    }
+    return referent;
+}
 
-    queueNextOffset = gDvm.offJavaLangRefReference_queueNext;
-    referentOffset = gDvm.offJavaLangRefReference_referent;
-    doSignal = false;
+/*
+ * Clears reference objects with white referents.  Cleared
+ * references registered to a reference queue are scheduled for
+ * appending by the reference queue daemon.
+ */
+static void clearWhiteReferences(Object **list)
+{
+    assert(list != NULL);
     while (*list != NULL) {
-        Object *ref = *list;
-        JValue *field = dvmFieldPtr(ref, referentOffset);
-        Object *referent = field->l;
-        *list = dvmGetFieldObject(ref, queueNextOffset);
-        dvmSetFieldObject(ref, queueNextOffset, NULL);
-        assert(referent != NULL);
-        if (isForward(referent->clazz)) {
-            field->l = referent = getForward(referent->clazz);
-            continue;
-        }
-        if (fromSpaceContains(referent)) {
+        Object *ref = dequeuePendingReference(list);
+        Object *referent = getReferent(ref);
+        if (referent != NULL && isWhite(referent)) {
             /* Referent is white, clear it. */
             clearReference(ref);
-            if (isReferenceEnqueuable(ref)) {
+            if (isEnqueuable(ref)) {
                 enqueueReference(ref);
-                doSignal = true;
             }
         }
     }
-    /*
-     * If we cleared a reference with a reference queue we must notify
-     * the heap worker to append the reference.
-     */
-    if (doSignal) {
-        dvmSignalHeapWorker(false);
-    }
     assert(*list == NULL);
 }
 
 /*
  * Blackens referents subject to the soft reference preservation
- * policy.
+ * policy.  References with a black referent are removed from the
+ * list.
  */
-void preserveSoftReferences(Object **list)
+static void preserveSomeSoftReferences(Object **list)
 {
-    Object *ref;
-    Object *prev, *next;
-    size_t referentOffset, queueNextOffset;
-    unsigned counter;
-    bool white;
-
-    queueNextOffset = gDvm.offJavaLangRefReference_queueNext;
-    referentOffset = gDvm.offJavaLangRefReference_referent;
-    counter = 0;
-    prev = next = NULL;
-    ref = *list;
-    while (ref != NULL) {
-        JValue *field = dvmFieldPtr(ref, referentOffset);
-        Object *referent = field->l;
-        next = dvmGetFieldObject(ref, queueNextOffset);
-        assert(referent != NULL);
-        if (isForward(referent->clazz)) {
-            /* Referent is black. */
-            field->l = referent = getForward(referent->clazz);
-            white = false;
-        } else {
-            white = fromSpaceContains(referent);
+    assert(list != NULL);
+    size_t referentOffset = gDvm.offJavaLangRefReference_referent;
+    Object *clear = NULL;
+    size_t counter = 0;
+    while (*list != NULL) {
+        Object *ref = dequeuePendingReference(list);
+        Object *referent = getReferent(ref);
+        if (referent == NULL) {
+            /* Referent was cleared by the user during marking. */
+            continue;
         }
-        if (!white && ((++counter) & 1)) {
+        bool white = isWhite(referent);
+        if (white && ((++counter) & 1)) {
             /* Referent is white and biased toward saving, gray it. */
-            scavengeReference((Object **)(void *)&field->l);
-            white = true;
+            JValue *field = dvmFieldPtr(ref, referentOffset);
+            scavengeReference(&field->l);
+            white = false;
         }
         if (white) {
-            /* Referent is black, unlink it. */
-            if (prev != NULL) {
-                dvmSetFieldObject(ref, queueNextOffset, NULL);
-                dvmSetFieldObject(prev, queueNextOffset, next);
-            }
-        } else {
-            /* Referent is white, skip over it. */
-            prev = ref;
+            /* Referent is white, queue it for clearing. */
+            enqueuePendingReference(ref, &clear);
         }
-        ref = next;
     }
+    *list = clear;
     /*
      * Restart the trace with the newly gray references added to the
      * root set.
@@ -1103,140 +1358,67 @@ void preserveSoftReferences(Object **list)
     scavengeBlockQueue();
 }
 
-void processFinalizableReferences()
+/*
+ * Enqueues finalizer references with white referents.  White
+ * referents are transported, moved to the zombie field, and the
+ * referent field is cleared.
+ */
+static void enqueueFinalizerReferences(Object **list)
 {
-    HeapRefTable newPendingRefs;
-    LargeHeapRefTable *finRefs = gDvm.gcHeap->finalizableRefs;
-    Object **ref;
-    Object **lastRef;
-    size_t totalPendCount;
-
-    /*
-     * All strongly, reachable objects are black.
-     * Any white finalizable objects need to be finalized.
-     */
-
-    /* Create a table that the new pending refs will
-     * be added to.
-     */
-    if (!dvmHeapInitHeapRefTable(&newPendingRefs)) {
-        //TODO: mark all finalizable refs and hope that
-        //      we can schedule them next time.  Watch out,
-        //      because we may be expecting to free up space
-        //      by calling finalizers.
-        LOG_REF("no room for pending finalizations");
-        dvmAbort();
-    }
-
-    /*
-     * Walk through finalizableRefs and move any white references to
-     * the list of new pending refs.
-     */
-    totalPendCount = 0;
-    while (finRefs != NULL) {
-        Object **gapRef;
-        size_t newPendCount = 0;
-
-        gapRef = ref = finRefs->refs.table;
-        lastRef = finRefs->refs.nextEntry;
-        while (ref < lastRef) {
-            if (fromSpaceContains(*ref)) {
-                if (!dvmHeapAddToHeapRefTable(&newPendingRefs, *ref)) {
-                    //TODO: add the current table and allocate
-                    //      a new, smaller one.
-                    LOG_REF("no room for any more pending finalizations: %zd",
-                            dvmHeapNumHeapRefTableEntries(&newPendingRefs));
-                    dvmAbort();
-                }
-                newPendCount++;
-            } else {
-                /* This ref is black, so will remain on finalizableRefs.
-                 */
-                if (newPendCount > 0) {
-                    /* Copy it up to fill the holes.
-                     */
-                    *gapRef++ = *ref;
-                } else {
-                    /* No holes yet; don't bother copying.
-                     */
-                    gapRef++;
-                }
-            }
-            ref++;
+    assert(list != NULL);
+    size_t referentOffset = gDvm.offJavaLangRefReference_referent;
+    size_t zombieOffset = gDvm.offJavaLangRefFinalizerReference_zombie;
+    bool hasEnqueued = false;
+    while (*list != NULL) {
+        Object *ref = dequeuePendingReference(list);
+        Object *referent = getReferent(ref);
+        if (referent != NULL && isWhite(referent)) {
+            JValue *field = dvmFieldPtr(ref, referentOffset);
+            scavengeReference(&field->l);
+            /* If the referent is non-null the reference must queuable. */
+            assert(isEnqueuable(ref));
+            dvmSetFieldObject(ref, zombieOffset, field->l);
+            clearReference(ref);
+            enqueueReference(ref);
+            hasEnqueued = true;
         }
-        finRefs->refs.nextEntry = gapRef;
-        //TODO: if the table is empty when we're done, free it.
-        totalPendCount += newPendCount;
-        finRefs = finRefs->next;
-    }
-    LOG_REF("%zd finalizers triggered.", totalPendCount);
-    if (totalPendCount == 0) {
-        /* No objects required finalization.
-         * Free the empty temporary table.
-         */
-        dvmClearReferenceTable(&newPendingRefs);
-        return;
-    }
-
-    /* Add the new pending refs to the main list.
-     */
-    if (!dvmHeapAddTableToLargeTable(&gDvm.gcHeap->pendingFinalizationRefs,
-                &newPendingRefs))
-    {
-        LOG_REF("can't insert new pending finalizations");
-        dvmAbort();
     }
-
-    //TODO: try compacting the main list with a memcpy loop
-
-    /* Blacken the refs we just moved; we don't want them or their
-     * children to get swept yet.
-     */
-    ref = newPendingRefs.table;
-    lastRef = newPendingRefs.nextEntry;
-    assert(ref < lastRef);
-    HPROF_SET_GC_SCAN_STATE(HPROF_ROOT_FINALIZING, 0);
-    while (ref < lastRef) {
-        scavengeReference(ref);
-        ref++;
+    if (hasEnqueued) {
+        scavengeBlockQueue();
     }
-    HPROF_CLEAR_GC_SCAN_STATE();
-    scavengeBlockQueue();
-    dvmSignalHeapWorker(false);
+    assert(*list == NULL);
 }
 
 /*
- * If a reference points to from-space and has been forwarded, we snap
- * the pointer to its new to-space address.  If the reference points
- * to an unforwarded from-space address we must enqueue the reference
- * for later processing.  TODO: implement proper reference processing
- * and move the referent scavenging elsewhere.
+ * If the referent of a reference object has not been transported,
+ * put the reference on the matching list in the gcHeap for
+ * processing once the trace is complete.  The referent field is not
+ * among the reference fields of the class, so scavengeDataObject()
+ * has left it alone.
  */
 static void scavengeReferenceObject(Object *obj)
 {
-    Object *referent;
-    Object **queue;
-    size_t referentOffset, queueNextOffset;
-
     assert(obj != NULL);
     LOG_SCAV("scavengeReferenceObject(obj=%p),'%s'", obj, obj->clazz->descriptor);
     scavengeDataObject(obj);
-    referentOffset = gDvm.offJavaLangRefReference_referent;
-    referent = dvmGetFieldObject(obj, referentOffset);
-    if (referent == NULL || toSpaceContains(referent)) {
+    GcHeap *gcHeap = gDvm.gcHeap;
+    Object *pending = dvmGetFieldObject(obj, gDvm.offJavaLangRefReference_pendingNext);
+    Object *referent = getReferent(obj);
+    if (pending != NULL || referent == NULL || !isWhite(referent)) {
         return;
     }
+    Object **list;
     if (isSoftReference(obj)) {
-        queue = &gDvm.gcHeap->softReferences;
+        list = &gcHeap->softReferences;
     } else if (isWeakReference(obj)) {
-        queue = &gDvm.gcHeap->weakReferences;
+        list = &gcHeap->weakReferences;
+    } else if (isFinalizerReference(obj)) {
+        list = &gcHeap->finalizerReferences;
     } else {
         assert(isPhantomReference(obj));
-        queue = &gDvm.gcHeap->phantomReferences;
+        list = &gcHeap->phantomReferences;
     }
-    queueNextOffset = gDvm.offJavaLangRefReference_queueNext;
-    dvmSetFieldObject(obj, queueNextOffset, *queue);
-    *queue = obj;
+    enqueuePendingReference(obj, list);
     LOG_SCAV("scavengeReferenceObject: enqueueing %p", obj);
 }
 
@@ -1285,35 +1467,36 @@ static Object *transportObject(const Object *fromObj)
                   gDvm.gcHeap->heapSource->allocBlocks);
     assert(fromObj != NULL);
     assert(fromSpaceContains(fromObj));
+    /*
+     * If the object has been hashed and moved before, its hash code
+     * is part of its size and is copied along with the instance data.
+     */
     allocSize = copySize = objectSize(fromObj);
-    if (LW_HASH_STATE(fromObj->lock) != LW_HASH_STATE_UNHASHED) {
+    if (LW_HASH_STATE(fromObj->lock) == LW_HASH_STATE_HASHED) {
         /*
-         * The object has been hashed or hashed and moved.  We must
-         * reserve an additional word for a hash code.
+         * The object has had its hash code exposed.  We must reserve
+         * an additional, naturally aligned word for it.
          */
-        allocSize += sizeof(u4);
-    }
-    if (LW_HASH_STATE(fromObj->lock) == LW_HASH_STATE_HASHED_AND_MOVED) {
-        /*
-         * The object has its hash code allocated.  Ensure the hash
-         * code is copied along with the instance data.
-         */
-        copySize += sizeof(u4);
+        allocSize = alignUp(copySize, sizeof(u4)) + sizeof(u4);
     }
     /* TODO(cshapiro): don't copy, re-map large data objects. */
     assert(copySize <= allocSize);
-    toObj = allocateGray(allocSize);
+    toObj = (Object *)allocateGray(allocSize);
     assert(toObj != NULL);
     assert(toSpaceContains(toObj));
     memcpy(toObj, fromObj, copySize);
     if (LW_HASH_STATE(fromObj->lock) == LW_HASH_STATE_HASHED) {
         /*
-         * The object has had its hash code exposed.  Append it to the
-         * instance and set a bit so we know to look for it there.
+         * Append the hash code to the instance and set a bit so we
+         * know to look for it there.
          */
-        *(u4 *)(((char *)toObj) + copySize) = (u4)fromObj >> 3;
+        *(u4 *)(((char *)toObj) + alignUp(copySize, sizeof(u4))) = (u4)fromObj >> 3;
         toObj->lock |= LW_HASH_STATE_HASHED_AND_MOVED << LW_HASH_STATE_SHIFT;
     }
+    if (LW_SHAPE(toObj->lock) == LW_SHAPE_FAT) {
+        /* The monitor must follow the object. */
+        dvmMoveMonitor(toObj);
+    }
     LOG_TRAN("transportObject: from %p/%zu to %p/%zu (%zu,%zu) %s",
              fromObj, addressToBlock(gDvm.gcHeap->heapSource,fromObj),
              toObj, addressToBlock(gDvm.gcHeap->heapSource,toObj),
@@ -1347,8 +1530,6 @@ static void scavengeReference(Object **obj)
 
     if (*obj == NULL) return;
 
-    assert(dvmIsValidObject(*obj));
-
     /* The entire block is black. */
     if (toSpaceContains(*obj)) {
         LOG_SCAV("scavengeReference skipping pinned object @ %p", *obj);
@@ -1365,6 +1546,7 @@ static void scavengeReference(Object **obj)
         *obj = (Object *)getForward(clazz);
         return;
     }
+    assert(dvmIsValidObject(*obj));
     fromObj = *obj;
     if (clazz == NULL) {
         // LOG_SCAV("scavangeReference %p has a NULL class object", fromObj);
@@ -1403,335 +1585,30 @@ static void scavengeObject(Object *obj)
  * External root scavenging routines.
  */
 
-static void pinHashTableEntries(HashTable *table)
-{
-    LOG_PIN(">>> pinHashTableEntries(table=%p)", table);
-    if (table == NULL) {
-        return;
-    }
-    dvmHashTableLock(table);
-    for (int i = 0; i < table->tableSize; ++i) {
-        HashEntry *entry = &table->pEntries[i];
-        void *obj = entry->data;
-        if (obj == NULL || obj == HASH_TOMBSTONE) {
-            continue;
-        }
-        pinObject(entry->data);
-    }
-    dvmHashTableUnlock(table);
-    LOG_PIN("<<< pinHashTableEntries(table=%p)", table);
-}
-
-static void pinPrimitiveClasses()
-{
-    size_t length = ARRAYSIZE(gDvm.primitiveClass);
-    for (size_t i = 0; i < length; i++) {
-        if (gDvm.primitiveClass[i] != NULL) {
-            pinObject((Object *)gDvm.primitiveClass[i]);
-        }
-    }
-}
-
 /*
- * Scavenge interned strings.  Permanent interned strings will have
- * been pinned and are therefore ignored.  Non-permanent strings that
- * have been forwarded are snapped.  All other entries are removed.
+ * Pins the objects the VM refers to from places other than the
+ * interpreted stacks.  Native code, and the VM itself, may hold raw
+ * pointers to any of them, so they cannot be moved.
  */
-static void scavengeInternedStrings()
-{
-    HashTable *table = gDvm.internedStrings;
-    if (table == NULL) {
-        return;
-    }
-    dvmHashTableLock(table);
-    for (int i = 0; i < table->tableSize; ++i) {
-        HashEntry *entry = &table->pEntries[i];
-        Object *obj = (Object *)entry->data;
-        if (obj == NULL || obj == HASH_TOMBSTONE) {
-            continue;
-        } else if (!isPermanentString((StringObject *)obj)) {
-            // LOG_SCAV("entry->data=%p", entry->data);
-            LOG_SCAV(">>> string obj=%p", entry->data);
-            /* TODO(cshapiro): detach white string objects */
-            scavengeReference((Object **)(void *)&entry->data);
-            LOG_SCAV("<<< string obj=%p", entry->data);
-        }
-    }
-    dvmHashTableUnlock(table);
-}
-
-static void pinInternedStrings()
+static void pinRootVisitor(void *addr, u4 threadId, RootType type, void *arg)
 {
-    HashTable *table = gDvm.internedStrings;
-    if (table == NULL) {
-        return;
+    assert(addr != NULL);
+    Object *obj = *(Object **)addr;
+    if (obj != NULL && type != ROOT_JAVA_FRAME) {
+        pinObject(obj);
     }
-    dvmHashTableLock(table);
-    for (int i = 0; i < table->tableSize; ++i) {
-        HashEntry *entry = &table->pEntries[i];
-        Object *obj = (Object *)entry->data;
-        if (obj == NULL || obj == HASH_TOMBSTONE) {
-            continue;
-        } else if (isPermanentString((StringObject *)obj)) {
-            obj = (Object *)getPermanentString((StringObject*)obj);
-            LOG_PROM(">>> pin string obj=%p", obj);
-            pinObject(obj);
-            LOG_PROM("<<< pin string obj=%p", obj);
-        }
-     }
-    dvmHashTableUnlock(table);
 }
 
 /*
- * At present, reference tables contain references that must not be
- * moved by the collector.  Instead of scavenging each reference in
- * the table we pin each referenced object.
+ * Grays every root.  Pinned roots are already in to-space, so this
+ * only transports objects that are referred to solely from the
+ * precise slots of interpreted frames.
  */
-static void pinReferenceTable(const ReferenceTable *table)
+static void scavengeRootVisitor(void *addr, u4 threadId, RootType type,
+                                void *arg)
 {
-    assert(table != NULL);
-    assert(table->table != NULL);
-    assert(table->nextEntry != NULL);
-    for (Object **entry = table->table; entry < table->nextEntry; ++entry) {
-        assert(entry != NULL);
-        assert(!isForward(*entry));
-        pinObject(*entry);
-    }
-}
-
-static void scavengeLargeHeapRefTable(LargeHeapRefTable *table)
-{
-    for (; table != NULL; table = table->next) {
-        Object **ref = table->refs.table;
-        for (; ref < table->refs.nextEntry; ++ref) {
-            scavengeReference(ref);
-        }
-    }
-}
-
-/* This code was copied from Thread.c */
-static void scavengeThreadStack(Thread *thread)
-{
-    const u4 *framePtr;
-#if WITH_EXTRA_GC_CHECKS > 1
-    bool first = true;
-#endif
-
-    framePtr = (const u4 *)thread->interpSave.curFrame;
-    while (framePtr != NULL) {
-        const StackSaveArea *saveArea;
-        const Method *method;
-
-        saveArea = SAVEAREA_FROM_FP(framePtr);
-        method = saveArea->method;
-        if (method != NULL && !dvmIsNativeMethod(method)) {
-#ifdef COUNT_PRECISE_METHODS
-            /* the GC is running, so no lock required */
-            if (dvmPointerSetAddEntry(gDvm.preciseMethods, method))
-                LOG_SCAV("PGC: added %s.%s %p",
-                             method->clazz->descriptor, method->name, method);
-#endif
-#if WITH_EXTRA_GC_CHECKS > 1
-            /*
-             * May also want to enable the memset() in the "invokeMethod"
-             * goto target in the portable interpreter.  That sets the stack
-             * to a pattern that makes referring to uninitialized data
-             * very obvious.
-             */
-
-            if (first) {
-                /*
-                 * First frame, isn't native, check the "alternate" saved PC
-                 * as a sanity check.
-                 *
-                 * It seems like we could check the second frame if the first
-                 * is native, since the PCs should be the same.  It turns out
-                 * this doesn't always work.  The problem is that we could
-                 * have calls in the sequence:
-                 *   interp method #2
-                 *   native method
-                 *   interp method #1
-                 *
-                 * and then GC while in the native method after returning
-                 * from interp method #2.  The currentPc on the stack is
-                 * for interp method #1, but thread->currentPc2 is still
-                 * set for the last thing interp method #2 did.
-                 *
-                 * This can also happen in normal execution:
-                 * - sget-object on not-yet-loaded class
-                 * - class init updates currentPc2
-                 * - static field init is handled by parsing annotations;
-                 *   static String init requires creation of a String object,
-                 *   which can cause a GC
-                 *
-                 * Essentially, any pattern that involves executing
-                 * interpreted code and then causes an allocation without
-                 * executing instructions in the original method will hit
-                 * this.  These are rare enough that the test still has
-                 * some value.
-                 */
-                if (saveArea->xtra.currentPc != thread->currentPc2) {
-                    ALOGW("PGC: savedPC(%p) != current PC(%p), %s.%s ins=%p",
-                        saveArea->xtra.currentPc, thread->currentPc2,
-                        method->clazz->descriptor, method->name, method->insns);
-                    if (saveArea->xtra.currentPc != NULL)
-                        ALOGE("  pc inst = 0x%04x", *saveArea->xtra.currentPc);
-                    if (thread->currentPc2 != NULL)
-                        ALOGE("  pc2 inst = 0x%04x", *thread->currentPc2);
-                    dvmDumpThread(thread, false);
-                }
-            } else {
-                /*
-                 * It's unusual, but not impossible, for a non-first frame
-                 * to be at something other than a method invocation.  For
-                 * example, if we do a new-instance on a nonexistent class,
-                 * we'll have a lot of class loader activity on the stack
-                 * above the frame with the "new" operation.  Could also
-                 * happen while we initialize a Throwable when an instruction
-                 * fails.
-                 *
-                 * So there's not much we can do here to verify the PC,
-                 * except to verify that it's a GC point.
-                 */
-            }
-            assert(saveArea->xtra.currentPc != NULL);
-#endif
-
-            const RegisterMap* pMap;
-            const u1* regVector;
-
-            Method* nonConstMethod = (Method*) method;  // quiet gcc
-            pMap = dvmGetExpandedRegisterMap(nonConstMethod);
-
-            //LOG_SCAV("PGC: %s.%s", method->clazz->descriptor, method->name);
-
-            if (pMap != NULL) {
-                /* found map, get registers for this address */
-                int addr = saveArea->xtra.currentPc - method->insns;
-                regVector = dvmRegisterMapGetLine(pMap, addr);
-                /*
-                if (regVector == NULL) {
-                    LOG_SCAV("PGC: map but no entry for %s.%s addr=0x%04x",
-                                 method->clazz->descriptor, method->name, addr);
-                } else {
-                    LOG_SCAV("PGC: found map for %s.%s 0x%04x (t=%d)",
-                                 method->clazz->descriptor, method->name, addr,
-                                 thread->threadId);
-                }
-                */
-            } else {
-                /*
-                 * No map found.  If precise GC is disabled this is
-                 * expected -- we don't create pointers to the map data even
-                 * if it's present -- but if it's enabled it means we're
-                 * unexpectedly falling back on a conservative scan, so it's
-                 * worth yelling a little.
-                 */
-                if (gDvm.preciseGc) {
-                    LOG_SCAV("PGC: no map for %s.%s", method->clazz->descriptor, method->name);
-                }
-                regVector = NULL;
-            }
-            if (regVector == NULL) {
-                /*
-                 * There are no roots to scavenge.  Skip over the entire frame.
-                 */
-                framePtr += method->registersSize;
-            } else {
-                /*
-                 * Precise scan.  v0 is at the lowest address on the
-                 * interpreted stack, and is the first bit in the register
-                 * vector, so we can walk through the register map and
-                 * memory in the same direction.
-                 *
-                 * A '1' bit indicates a live reference.
-                 */
-                u2 bits = 1 << 1;
-                for (int i = method->registersSize - 1; i >= 0; i--) {
-                    u4 rval = *framePtr;
-
-                    bits >>= 1;
-                    if (bits == 1) {
-                        /* set bit 9 so we can tell when we're empty */
-                        bits = *regVector++ | 0x0100;
-                    }
-
-                    if (rval != 0 && (bits & 0x01) != 0) {
-                        /*
-                         * Non-null, register marked as live reference.  This
-                         * should always be a valid object.
-                         */
-#if WITH_EXTRA_GC_CHECKS > 0
-                        if ((rval & 0x3) != 0 || !dvmIsValidObject((Object*) rval)) {
-                            /* this is very bad */
-                            ALOGE("PGC: invalid ref in reg %d: 0x%08x",
-                                method->registersSize-1 - i, rval);
-                        } else
-#endif
-                        {
-
-                            // LOG_SCAV("stack reference %u@%p", *framePtr, framePtr);
-                            /* dvmMarkObjectNonNull((Object *)rval); */
-                            scavengeReference((Object **) framePtr);
-                        }
-                    } else {
-                        /*
-                         * Null or non-reference, do nothing at all.
-                         */
-#if WITH_EXTRA_GC_CHECKS > 1
-                        if (dvmIsValidObject((Object*) rval)) {
-                            /* this is normal, but we feel chatty */
-                            ALOGD("PGC: ignoring valid ref in reg %d: 0x%08x",
-                                 method->registersSize-1 - i, rval);
-                        }
-#endif
-                    }
-                    ++framePtr;
-                }
-                dvmReleaseRegisterMapLine(pMap, regVector);
-            }
-        }
-        /* else this is a break frame and there is nothing to gray, or
-         * this is a native method and the registers are just the "ins",
-         * copied from various registers in the caller's set.
-         */
-
-#if WITH_EXTRA_GC_CHECKS > 1
-        first = false;
-#endif
-
-        /* Don't fall into an infinite loop if things get corrupted.
-         */
-        assert((uintptr_t)saveArea->prevFrame > (uintptr_t)framePtr ||
-               saveArea->prevFrame == NULL);
-        framePtr = saveArea->prevFrame;
-    }
-}
-
-static void scavengeThread(Thread *thread)
-{
-    // LOG_SCAV("scavengeThread(thread=%p)", thread);
-
-    // LOG_SCAV("Scavenging threadObj=%p", thread->threadObj);
-    scavengeReference(&thread->threadObj);
-
-    // LOG_SCAV("Scavenging exception=%p", thread->exception);
-    scavengeReference(&thread->exception);
-
-    scavengeThreadStack(thread);
-}
-
-static void scavengeThreadList()
-{
-    Thread *thread;
-
-    dvmLockThreadList(dvmThreadSelf());
-    thread = gDvm.threadList;
-    while (thread) {
-        scavengeThread(thread);
-        thread = thread->next;
-    }
-    dvmUnlockThreadList();
+    assert(addr != NULL);
+    scavengeReference((Object **)addr);
 }
 
 static void pinThreadStack(const Thread *thread)
@@ -1744,7 +1621,7 @@ static void pinThreadStack(const Thread *thread)
 
     saveArea = NULL;
     framePtr = (const u4 *)thread->interpSave.curFrame;
-    for (; framePtr != NULL; framePtr = saveArea->prevFrame) {
+    for (; framePtr != NULL; framePtr = (const u4 *)saveArea->prevFrame) {
         saveArea = SAVEAREA_FROM_FP(framePtr);
         method = (Method *)saveArea->method;
         if (method != NULL && dvmIsNativeMethod(method)) {
@@ -1765,9 +1642,10 @@ static void pinThreadStack(const Thread *thread)
             LOG_PIN("+++ native scan %s.%s",
                     method->clazz->descriptor, method->name);
             assert(method->registersSize == method->insSize);
+            const u4 *ins = framePtr;
             if (!dvmIsStaticMethod(method)) {
                 /* grab the "this" pointer */
-                obj = (Object *)*framePtr++;
+                obj = (Object *)*ins++;
                 if (obj == NULL) {
                     /*
                      * This can happen for the "fake" entry frame inserted
@@ -1782,10 +1660,10 @@ static void pinThreadStack(const Thread *thread)
                 }
             }
             shorty = method->shorty+1;      // skip return value
-            for (int i = method->registersSize - 1; i >= 0; i--, framePtr++) {
-                switch (*shorty++) {
+            for (; *shorty != '\0'; ++shorty, ++ins) {
+                switch (*shorty) {
                 case 'L':
-                    obj = (Object *)*framePtr;
+                    obj = (Object *)*ins;
                     if (obj != NULL) {
                         assert(dvmIsValidObject(obj));
                         pinObject(obj);
@@ -1793,24 +1671,17 @@ static void pinThreadStack(const Thread *thread)
                     break;
                 case 'D':
                 case 'J':
-                    framePtr++;
+                    ++ins;
                     break;
                 default:
                     /* 32-bit non-reference value */
-                    obj = (Object *)*framePtr;          // debug, remove
-                    if (dvmIsValidObject(obj)) {        // debug, remove
-                        /* if we see a lot of these, our scan might be off */
-                        LOG_PIN("+++ did NOT pin obj %p", obj);
-                    }
                     break;
                 }
             }
-        } else if (method != NULL && !dvmIsNativeMethod(method)) {
+        } else if (method != NULL) {
             const RegisterMap* pMap = dvmGetExpandedRegisterMap(method);
             const u1* regVector = NULL;
 
-            ALOGI("conservative : %s.%s", method->clazz->descriptor, method->name);
-
             if (pMap != NULL) {
                 int addr = saveArea->xtra.currentPc - method->insns;
                 regVector = dvmRegisterMapGetLine(pMap, addr);
@@ -1818,13 +1689,19 @@ static void pinThreadStack(const Thread *thread)
             if (regVector == NULL) {
                 /*
                  * No register info for this frame, conservatively pin.
+                 * The root visitor treats frames the same way, so this
+                 * keeps it from moving anything these slots refer to.
                  */
+                LOG_PIN("conservative : %s.%s",
+                        method->clazz->descriptor, method->name);
                 for (int i = 0; i < method->registersSize; ++i) {
                     u4 regValue = framePtr[i];
                     if (regValue != 0 && (regValue & 0x3) == 0 && dvmIsValidObject((Object *)regValue)) {
                         pinObject((Object *)regValue);
                     }
                 }
+            } else {
+                dvmReleaseRegisterMapLine(pMap, regVector);
             }
         }
         /*
@@ -1835,27 +1712,6 @@ static void pinThreadStack(const Thread *thread)
     }
 }
 
-static void pinThread(const Thread *thread)
-{
-    assert(thread != NULL);
-    LOG_PIN("pinThread(thread=%p)", thread);
-
-    LOG_PIN("Pin native method arguments");
-    pinThreadStack(thread);
-
-    LOG_PIN("Pin internalLocalRefTable");
-    pinReferenceTable(&thread->internalLocalRefTable);
-
-    LOG_PIN("Pin jniLocalRefTable");
-    pinReferenceTable(&thread->jniLocalRefTable);
-
-    /* Can the check be pushed into the promote routine? */
-    if (thread->jniMonitorRefTable.table) {
-        LOG_PIN("Pin jniMonitorRefTable");
-        pinReferenceTable(&thread->jniMonitorRefTable);
-    }
-}
-
 static void pinThreadList()
 {
     Thread *thread;
@@ -1863,7 +1719,8 @@ static void pinThreadList()
     dvmLockThreadList(dvmThreadSelf());
     thread = gDvm.threadList;
     while (thread) {
-        pinThread(thread);
+        LOG_PIN("pinThread(thread=%p)", thread);
+        pinThreadStack(thread);
         thread = thread->next;
     }
     dvmUnlockThreadList();
@@ -1915,6 +1772,10 @@ static void scavengeBlock(HeapSource *heapSource, size_t block)
     }
 }
 
+/*
+ * Returns the size of an object, including the hash code that was
+ * appended to it when it was moved after having been hashed.
+ */
 static size_t objectSize(const Object *obj)
 {
     size_t size;
@@ -1930,7 +1791,7 @@ static size_t objectSize(const Object *obj)
         size = obj->clazz->objectSize;
     }
     if (LW_HASH_STATE(obj->lock) == LW_HASH_STATE_HASHED_AND_MOVED) {
-        size += sizeof(u4);
+        size = alignUp(size, sizeof(u4)) + sizeof(u4);
     }
     return size;
 }
@@ -1962,7 +1823,7 @@ static void verifyBlock(HeapSource *heapSource, size_t block)
             cursor += size;
         } else {
             /* Check for padding. */
-            while (*(unsigned long *)cursor == 0) {
+            while (*(u4 *)cursor == 0) {
                 cursor += 4;
                 if (cursor == end) break;
             }
@@ -2060,10 +1921,29 @@ void describeHeap()
  * ambiguous references.  The third phase is tracing from the stacks,
  * registers and various globals.  Lastly, a verification of the heap
  * is performed.  The last phase should be optional.
+ *
+ * The phases map onto the mark-sweep interface of MarkSweep.h, and
+ * dvmCollectGarbageInternal() keeps every thread suspended for the
+ * whole collection.
+ */
+
+bool dvmHeapBeginMarkStep(bool isPartial, bool isYoung)
+{
+    assert(!isPartial);
+    assert(!isYoung);
+    memset(&gDvm.gcHeap->referenceStats, 0,
+           sizeof(gDvm.gcHeap->referenceStats));
+    memset(&gDvm.gcHeap->cardStats, 0, sizeof(gDvm.gcHeap->cardStats));
+    return true;
+}
+
+/*
+ * Flips the spaces and promotes the blocks of every object that must
+ * stay where it is.
  */
-void dvmScavengeRoots()  /* Needs a new name badly */
+void dvmHeapMarkRootSet()
 {
-    GcHeap *gcHeap;
+    HeapSource *heapSource = gDvm.gcHeap->heapSource;
 
     {
         size_t alloc, unused, total;
@@ -2073,162 +1953,279 @@ void dvmScavengeRoots()  /* Needs a new name badly */
                      alloc, unused, total);
     }
 
-    gcHeap = gDvm.gcHeap;
-    dvmHeapSourceFlip();
+    flipSpaces();
 
     /*
      * Promote blocks with stationary objects.
      */
+    dvmVisitRoots(pinRootVisitor, NULL);
     pinThreadList();
-    pinReferenceTable(&gDvm.jniGlobalRefTable);
-    pinReferenceTable(&gDvm.jniPinRefTable);
-    pinHashTableEntries(gDvm.loadedClasses);
-    pinHashTableEntries(gDvm.dbgRegistry);
-    pinPrimitiveClasses();
-    pinInternedStrings();
-
-    // describeBlocks(gcHeap->heapSource);
 
     /*
      * Create first, open new-space page right here.
      */
 
     /* Reset allocation to an unallocated block. */
-    gDvm.gcHeap->heapSource->allocPtr = allocateBlocks(gDvm.gcHeap->heapSource, 1);
-    gDvm.gcHeap->heapSource->allocLimit = gDvm.gcHeap->heapSource->allocPtr + BLOCK_SIZE;
+    heapSource->allocPtr = (u1 *)allocateBlocks(heapSource, 1);
+    heapSource->allocLimit = heapSource->allocPtr + BLOCK_SIZE;
     /*
      * Hack: promote the empty block allocated above.  If the
      * promotions that occurred above did not actually gray any
      * objects, the block queue may be empty.  We must force a
      * promotion to be safe.
      */
-    promoteBlockByAddr(gDvm.gcHeap->heapSource, gDvm.gcHeap->heapSource->allocPtr);
-
-    /*
-     * Scavenge blocks and relocate movable objects.
-     */
-
-    LOG_SCAV("Scavenging gDvm.threadList");
-    scavengeThreadList();
-
-    LOG_SCAV("Scavenging gDvm.gcHeap->referenceOperations");
-    scavengeLargeHeapRefTable(gcHeap->referenceOperations);
+    promoteBlockByAddr(heapSource, heapSource->allocPtr);
+}
 
-    LOG_SCAV("Scavenging gDvm.gcHeap->pendingFinalizationRefs");
-    scavengeLargeHeapRefTable(gcHeap->pendingFinalizationRefs);
+void dvmHeapMarkYoungRootSet()
+{
+    dvmHeapMarkRootSet();
+}
 
-    LOG_SCAV("Scavenging random global stuff");
-    scavengeReference(&gDvm.outOfMemoryObj);
-    scavengeReference(&gDvm.internalErrorObj);
-    scavengeReference(&gDvm.noClassDefFoundErrorObj);
+/*
+ * The copying collector never runs concurrently with the mutators,
+ * so the roots never need to be revisited.
+ */
+void dvmHeapReMarkRootSet()
+{
+    assert(!"implemented");
+}
 
-    // LOG_SCAV("Scavenging gDvm.internedString");
-    scavengeInternedStrings();
+/*
+ * Scavenges the roots and then everything reachable from them.
+ */
+void dvmHeapScanMarkedObjects()
+{
+    LOG_SCAV("Scavenging the roots");
+    dvmVisitRoots(scavengeRootVisitor, NULL);
+    scavengeBlockQueue();
+    LOG_SCAV("New space scavenge has completed.");
+}
 
-    LOG_SCAV("Root scavenge has completed.");
+void dvmHeapScanYoungObjects()
+{
+    dvmHeapScanMarkedObjects();
+}
 
-    scavengeBlockQueue();
+void dvmHeapPrecleanCards()
+{
+    assert(!"implemented");
+}
 
-    // LOG_SCAV("Re-snap global class pointers.");
-    // scavengeGlobals();
+void dvmHeapReScanMarkedObjects()
+{
+    assert(!"implemented");
+}
 
-    LOG_SCAV("New space scavenge has completed.");
+void dvmHeapPreserveSoftReferences(Object **softReferences,
+                                   Object **weakReferences)
+{
+    assert(!"implemented");
+}
 
+/*
+ * Process reference class instances and schedule finalizations.
+ */
+void dvmHeapProcessReferences(Object **softReferences, bool clearSoftRefs,
+                              Object **weakReferences,
+                              Object **finalizerReferences,
+                              Object **phantomReferences)
+{
+    assert(softReferences != NULL);
+    assert(weakReferences != NULL);
+    assert(finalizerReferences != NULL);
+    assert(phantomReferences != NULL);
     /*
-     * Process reference objects in strength order.
+     * Unless we are in the zygote or required to clear soft
+     * references with white references, preserve some white
+     * referents.
+     */
+    if (!gDvm.zygote && !clearSoftRefs) {
+        LOG_REF("Processing soft references...");
+        preserveSomeSoftReferences(softReferences);
+    }
+    /*
+     * Clear all remaining soft and weak references with white
+     * referents.
      */
-
-    LOG_REF("Processing soft references...");
-    preserveSoftReferences(&gDvm.gcHeap->softReferences);
-    clearWhiteReferences(&gDvm.gcHeap->softReferences);
-
     LOG_REF("Processing weak references...");
-    clearWhiteReferences(&gDvm.gcHeap->weakReferences);
-
+    clearWhiteReferences(softReferences);
+    clearWhiteReferences(weakReferences);
+    /*
+     * Preserve all white objects with finalize methods and schedule
+     * them for finalization.
+     */
     LOG_REF("Finding finalizations...");
-    processFinalizableReferences();
-
-    LOG_REF("Processing f-reachable soft references...");
-    clearWhiteReferences(&gDvm.gcHeap->softReferences);
-
-    LOG_REF("Processing f-reachable weak references...");
-    clearWhiteReferences(&gDvm.gcHeap->weakReferences);
-
+    enqueueFinalizerReferences(finalizerReferences);
+    /*
+     * Clear all f-reachable soft and weak references with white
+     * referents.
+     */
+    LOG_REF("Processing f-reachable soft and weak references...");
+    clearWhiteReferences(softReferences);
+    clearWhiteReferences(weakReferences);
+    /*
+     * Clear all phantom references with white referents.
+     */
     LOG_REF("Processing phantom references...");
-    clearWhiteReferences(&gDvm.gcHeap->phantomReferences);
-
+    clearWhiteReferences(phantomReferences);
     /*
-     * Verify the stack and heap.
+     * At this point all reference lists should be empty.
      */
-    dvmVerifyRoots();
-    verifyNewSpace();
+    assert(*softReferences == NULL);
+    assert(*weakReferences == NULL);
+    assert(*finalizerReferences == NULL);
+    assert(*phantomReferences == NULL);
+}
 
-    //describeBlocks(gcHeap->heapSource);
+/*
+ * This object is an instance of a class that overrides finalize().  Mark
+ * it as finalizable.
+ *
+ * This is called when Object.<init> completes normally.  It's also
+ * called for clones of finalizable objects.
+ */
+void dvmSetFinalizable(Object *obj)
+{
+    assert(obj != NULL);
+    Thread *self = dvmThreadSelf();
+    assert(self != NULL);
+    Method *meth = gDvm.methJavaLangRefFinalizerReferenceAdd;
+    assert(meth != NULL);
+    JValue unusedResult;
+    dvmCallMethod(self, meth, NULL, &unusedResult, obj);
+}
 
-    clearFromSpace(gcHeap->heapSource);
+/*
+ * Pushes a list of cleared references out to the managed heap.
+ */
+void dvmEnqueueClearedReferences(Object **cleared)
+{
+    assert(cleared != NULL);
+    if (*cleared != NULL) {
+        Thread *self = dvmThreadSelf();
+        assert(self != NULL);
+        Method *meth = gDvm.methJavaLangRefReferenceQueueAdd;
+        assert(meth != NULL);
+        JValue unused;
+        Object *reference = *cleared;
+        dvmCallMethod(self, meth, NULL, &unused, reference);
+        *cleared = NULL;
+    }
+}
 
-    {
-        size_t alloc, rem, total;
+/*
+ * Returns true if the object was left behind in from-space.  Must
+ * only be called once every weak entry has been snapped to the new
+ * address of its object.
+ */
+static int isUnreachableObject(void *obj)
+{
+    return fromSpaceContains(obj);
+}
 
-        room(&alloc, &rem, &total);
-        LOG_SCAV("AFTER GC: %zu alloc, %zu free, %zu total.", alloc, rem, total);
+static void scavengeInternedString(StringObject **entry, void *arg)
+{
+    Object *obj = (Object *)*entry;
+    if (fromSpaceContains(obj) && isForward(obj->clazz)) {
+        *entry = (StringObject *)getForward(obj->clazz);
     }
 }
 
 /*
- * Interface compatibility routines.
+ * Snaps the interned strings that were transported during the trace.
+ * Permanent interned strings are roots and have been pinned.
  */
+static void scavengeInternedStrings()
+{
+    dvmVisitInternTable(gDvm.internedStrings, scavengeInternedString, NULL);
+}
 
-void dvmClearWhiteRefs(Object **list)
+static void sweepWeakJniGlobals()
 {
-    /* do nothing */
-    assert(*list == NULL);
+    for (size_t i = 0; i < kIndirectRefShardCount; i++) {
+        IndirectRefTable* table = &gDvm.jniWeakGlobalRefs[i].table;
+        typedef IndirectRefTable::iterator It; // TODO: C++0x auto
+        for (It it = table->begin(), end = table->end(); it != end; ++it) {
+            Object** entry = *it;
+            if (!fromSpaceContains(*entry)) {
+                continue;
+            }
+            if (isForward((*entry)->clazz)) {
+                *entry = (Object *)getForward((*entry)->clazz);
+            } else {
+                *entry = kClearedJniWeakGlobal;
+            }
+        }
+    }
 }
 
-void dvmHandleSoftRefs(Object **list)
+/*
+ * Process all the internal system structures that behave like
+ * weakly-held objects.  Monitors have followed their objects as they
+ * were transported.
+ */
+void dvmHeapSweepSystemWeaks()
 {
-    /* do nothing */
-    assert(*list == NULL);
+    scavengeInternedStrings();
+    dvmGcDetachDeadInternedStrings(isUnreachableObject);
+    dvmSweepMonitorList(&gDvm.monitorList, isUnreachableObject);
+    sweepWeakJniGlobals();
+    dvmFreeRetiredClassTableMemory();
 }
 
-bool dvmHeapBeginMarkStep(GcMode mode)
+/*
+ * From-space was released when the bitmaps were "swapped"; report
+ * what that reclaimed.
+ */
+void dvmHeapSweepUnmarkedObjects(bool isPartial, bool isConcurrent,
+                                 size_t *numObjects, size_t *numBytes)
 {
-    /* do nothing */
-    return true;
+    HeapSource *heapSource = gDvm.gcHeap->heapSource;
+
+    assert(!isConcurrent);
+    *numObjects = heapSource->objectsFreed;
+    *numBytes = heapSource->bytesFreed;
 }
 
 void dvmHeapFinishMarkStep()
 {
-    /* do nothing */
+    if (gDvm.postVerify) {
+        verifyNewSpace();
+    }
+
+    {
+        size_t alloc, rem, total;
+
+        room(&alloc, &rem, &total);
+        LOG_SCAV("AFTER GC: %zu alloc, %zu free, %zu total.", alloc, rem, total);
+    }
 }
 
-void dvmHeapMarkRootSet()
+/*
+ * Nothing is left for the allocator to reclaim after a collection, so
+ * a lazy sweep never has any work.
+ */
+void dvmHeapBeginLazySweep(bool isPartial)
 {
     /* do nothing */
 }
 
-void dvmHeapScanMarkedObjects()
+bool dvmHeapIsLazySweepPending()
 {
-    dvmScavengeRoots();
+    return false;
 }
 
-void dvmHeapScheduleFinalizations()
+bool dvmHeapSweepLazily()
 {
-    /* do nothing */
+    return false;
 }
 
-void dvmHeapSweepUnmarkedObjects(GcMode mode, int *numFreed, size_t *sizeFreed)
+void dvmHeapFinishLazySweep()
 {
-    *numFreed = 0;
-    *sizeFreed = 0;
     /* do nothing */
 }
 
-void dvmMarkDirtyObjects()
-{
-    assert(!"implemented");
-}
-
 void dvmHeapSourceThreadShutdown()
 {
     /* do nothing */
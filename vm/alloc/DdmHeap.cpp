@@ -15,12 +15,29 @@
  */
 /*
  * DDM-related heap functions
+ *
+ * Walking the whole heap for HPSG after every GC gets expensive with a
+ * large heap, so a client can ask for changes only.  The heap is split
+ * into regions of DELTA_REGION_SIZE bytes and the live bitmap is kept as
+ * it was at the last report.  A report then describes just the regions
+ * whose live bits differ, along with any neighbours that an object runs
+ * into, and the objects on them are found from the bitmap rather than
+ * by walking the heap.  The client starts from an empty heap and applies
+ * each report on top of what it has.  A chunk that is freed and reused
+ * for an object of the same size before the next report keeps the kind
+ * of its old object.
+ *
+ * In that mode the chunks are queued, outside the GC's own work, for a
+ * sender thread to write to the debugger, so a slow connection doesn't
+ * hold up the collector.  Finding the changed objects still needs the
+ * heap lock, since the allocator may reuse anything it frees.
  */
 #include <sys/time.h>
 #include <time.h>
 
 #include "Dalvik.h"
 #include "alloc/Heap.h"
+#include "alloc/HeapBitmap.h"
 #include "alloc/HeapInternal.h"
 #include "alloc/DdmHeap.h"
 #include "alloc/DlMalloc.h"
@@ -183,10 +200,187 @@ struct HeapChunkContext {
     int type;
     bool merge;
     bool needHeader;
+    bool queue;         /* hand chunks to the sender thread */
 };
 
 #define ALLOCATION_UNIT_SIZE 8
 
+/*
+ * Heap bytes per region when reporting changes.  Their live bits must
+ * fill a whole number of bitmap words.
+ */
+#define DELTA_REGION_SIZE   4096
+#define DELTA_REGION_WORDS  \
+    (DELTA_REGION_SIZE / HB_OBJECT_ALIGNMENT / HB_BITS_PER_WORD)
+
+/*
+ * The heap as of the last report of changes.  "crossed" has a bit for
+ * each region that an object ran off the end of.
+ */
+struct SegmentDeltaState {
+    unsigned long *bits;
+    u4 *crossed;
+    size_t numRegions;
+    uintptr_t max;
+};
+
+static SegmentDeltaState gDelta;
+
+/*
+ * Chunks waiting for the sender thread, oldest first.
+ */
+struct QueuedChunk {
+    QueuedChunk *next;
+    int type;
+    size_t len;
+    u1 data[1];
+};
+
+/* Don't start a report while this much is still waiting to be sent */
+#define kMaxQueuedBytes     (1024 * 1024)
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    QueuedChunk *head;
+    QueuedChunk **tail;
+    size_t queuedBytes;
+    bool halt;
+    bool started;
+    pthread_t handle;
+} gSender;
+
+/*
+ * Sends a chunk to the DDM server, or leaves it for the sender thread.
+ */
+static void sendChunk(int type, size_t len, const u1 *buf, bool queue)
+{
+    if (!queue) {
+        dvmDbgDdmSendChunk(type, len, buf);
+        return;
+    }
+
+    QueuedChunk *chunk = (QueuedChunk *)malloc(sizeof(QueuedChunk) + len);
+    if (chunk == NULL) {
+        ALOGW("Unable to queue DDM chunk (%zd bytes)", len);
+        return;
+    }
+    chunk->next = NULL;
+    chunk->type = type;
+    chunk->len = len;
+    memcpy(chunk->data, buf, len);
+
+    dvmLockMutex(&gSender.lock);
+    *gSender.tail = chunk;
+    gSender.tail = &chunk->next;
+    gSender.queuedBytes += len;
+    dvmSignalCond(&gSender.cond);
+    dvmUnlockMutex(&gSender.lock);
+}
+
+static void freeChunkList(QueuedChunk *chunk)
+{
+    while (chunk != NULL) {
+        QueuedChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+static void *segmentSenderThreadStart(void *arg)
+{
+    UNUSED_PARAMETER(arg);
+
+    dvmChangeStatus(dvmThreadSelf(), THREAD_VMWAIT);
+    dvmLockMutex(&gSender.lock);
+    while (!gSender.halt) {
+        if (gSender.head == NULL) {
+            dvmWaitCond(&gSender.cond, &gSender.lock);
+            continue;
+        }
+        QueuedChunk *list = gSender.head;
+        gSender.head = NULL;
+        gSender.tail = &gSender.head;
+        gSender.queuedBytes = 0;
+        dvmUnlockMutex(&gSender.lock);
+
+        for (QueuedChunk *chunk = list; chunk != NULL; chunk = chunk->next) {
+            dvmDbgDdmSendChunk(chunk->type, chunk->len, chunk->data);
+        }
+        freeChunkList(list);
+
+        dvmLockMutex(&gSender.lock);
+    }
+    freeChunkList(gSender.head);
+    gSender.head = NULL;
+    gSender.tail = &gSender.head;
+    dvmUnlockMutex(&gSender.lock);
+    return NULL;
+}
+
+/*
+ * Starts the sender thread if it isn't running.  Must not be called with
+ * the heap lock held, since the new thread allocates as it attaches.
+ * Returns false if there is no thread, which means chunks are sent as
+ * they are made.
+ */
+static bool startSegmentSender()
+{
+    if (gSender.started) {
+        return true;
+    }
+    if (gDvm.zygote) {
+        return false;
+    }
+    dvmInitMutex(&gSender.lock);
+    pthread_cond_init(&gSender.cond, NULL);
+    gSender.head = NULL;
+    gSender.tail = &gSender.head;
+    gSender.halt = false;
+    if (!dvmCreateInternalThread(&gSender.handle, "DDM Heap Sender",
+            segmentSenderThreadStart, NULL)) {
+        ALOGW("Unable to start DDM heap sender thread");
+        pthread_cond_destroy(&gSender.cond);
+        dvmDestroyMutex(&gSender.lock);
+        return false;
+    }
+    gSender.started = true;
+    return true;
+}
+
+/*
+ * Stops the sender thread, dropping whatever it hasn't sent, and frees the
+ * state kept for reporting changes.
+ */
+void dvmDdmHeapShutdown()
+{
+    free(gDelta.bits);
+    free(gDelta.crossed);
+    memset(&gDelta, 0, sizeof(gDelta));
+
+    if (!gSender.started) {
+        return;
+    }
+
+    dvmLockMutex(&gSender.lock);
+    gSender.halt = true;
+    dvmSignalCond(&gSender.cond);
+    dvmUnlockMutex(&gSender.lock);
+
+    Thread *self = dvmThreadSelf();
+    ThreadStatus oldStatus = THREAD_UNDEFINED;
+    if (self != NULL) {
+        oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    }
+    pthread_join(gSender.handle, NULL);
+    if (self != NULL) {
+        dvmChangeStatus(self, oldStatus);
+    }
+    gSender.started = false;
+    pthread_cond_destroy(&gSender.cond);
+    dvmDestroyMutex(&gSender.lock);
+}
+
 static void flush_hpsg_chunk(HeapChunkContext *ctx)
 {
     /* Patch the "length of piece" field.
@@ -197,7 +391,7 @@ static void flush_hpsg_chunk(HeapChunkContext *ctx)
 
     /* Send the chunk.
      */
-    dvmDbgDdmSendChunk(ctx->type, ctx->p - ctx->buf, ctx->buf);
+    sendChunk(ctx->type, ctx->p - ctx->buf, ctx->buf, ctx->queue);
 
     /* Reset the context.
      */
@@ -265,6 +459,44 @@ static void append_chunk(HeapChunkContext *ctx, u1 state, void* ptr, size_t leng
     *ctx->p++ = length - 1;
 }
 
+/*
+ * Returns the HPSG state of a live object.
+ */
+static u1 objectState(const Object *obj)
+{
+    ClassObject *clazz = obj->clazz;
+    if (clazz == NULL) {
+        /* The object was probably just created
+         * but hasn't been initialized yet.
+         */
+        return HPSG_STATE(SOLIDITY_HARD, KIND_OBJECT);
+    } else if (dvmIsTheClassClass(clazz)) {
+        return HPSG_STATE(SOLIDITY_HARD, KIND_CLASS_OBJECT);
+    } else if (IS_CLASS_FLAG_SET(clazz, CLASS_ISARRAY)) {
+        if (IS_CLASS_FLAG_SET(clazz, CLASS_ISOBJECTARRAY)) {
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_4);
+        }
+        switch (clazz->elementClass->primitiveType) {
+        case PRIM_BOOLEAN:
+        case PRIM_BYTE:
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_1);
+        case PRIM_CHAR:
+        case PRIM_SHORT:
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_2);
+        case PRIM_INT:
+        case PRIM_FLOAT:
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_4);
+        case PRIM_DOUBLE:
+        case PRIM_LONG:
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_8);
+        default:
+            assert(!"Unknown GC heap object type");
+            return HPSG_STATE(SOLIDITY_HARD, KIND_UNKNOWN);
+        }
+    }
+    return HPSG_STATE(SOLIDITY_HARD, KIND_OBJECT);
+}
+
 /*
  * Called by dlmalloc_inspect_all. If used_bytes != 0 then start is
  * the start of a malloc-ed piece of memory of size used_bytes. If
@@ -324,44 +556,7 @@ static void heap_chunk_callback(void* start, void* end, size_t used_bytes,
 //TODO: if ctx.merge, see if this chunk is different from the last chunk.
 //      If it's the same, we should combine them.
     if (!native && dvmIsValidObject(obj)) {
-        ClassObject *clazz = obj->clazz;
-        if (clazz == NULL) {
-            /* The object was probably just created
-             * but hasn't been initialized yet.
-             */
-            state = HPSG_STATE(SOLIDITY_HARD, KIND_OBJECT);
-        } else if (dvmIsTheClassClass(clazz)) {
-            state = HPSG_STATE(SOLIDITY_HARD, KIND_CLASS_OBJECT);
-        } else if (IS_CLASS_FLAG_SET(clazz, CLASS_ISARRAY)) {
-            if (IS_CLASS_FLAG_SET(clazz, CLASS_ISOBJECTARRAY)) {
-                state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_4);
-            } else {
-                switch (clazz->elementClass->primitiveType) {
-                case PRIM_BOOLEAN:
-                case PRIM_BYTE:
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_1);
-                    break;
-                case PRIM_CHAR:
-                case PRIM_SHORT:
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_2);
-                    break;
-                case PRIM_INT:
-                case PRIM_FLOAT:
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_4);
-                    break;
-                case PRIM_DOUBLE:
-                case PRIM_LONG:
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_8);
-                    break;
-                default:
-                    assert(!"Unknown GC heap object type");
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_UNKNOWN);
-                    break;
-                }
-            }
-        } else {
-            state = HPSG_STATE(SOLIDITY_HARD, KIND_OBJECT);
-        }
+        state = objectState(obj);
     } else {
         obj = NULL; // it's not actually an object
         state = HPSG_STATE(SOLIDITY_HARD, KIND_NATIVE);
@@ -378,6 +573,9 @@ enum HpsgWhen {
 enum HpsgWhat {
     HPSG_WHAT_MERGED_OBJECTS = 0,
     HPSG_WHAT_DISTINCT_OBJECTS = 1,
+    /* Only the regions that changed since the last report */
+    HPSG_WHAT_MERGED_CHANGES = 2,
+    HPSG_WHAT_DISTINCT_CHANGES = 3,
 };
 
 /*
@@ -423,6 +621,181 @@ static void walkHeap(bool merge, bool native)
     free(ctx.buf);
 }
 
+static bool isRegionCrossed(size_t region)
+{
+    return (gDelta.crossed[region / 32] >> (region % 32)) & 1;
+}
+
+static void setRegionCrossed(size_t region, bool crossed)
+{
+    if (crossed) {
+        gDelta.crossed[region / 32] |= 1u << (region % 32);
+    } else {
+        gDelta.crossed[region / 32] &= ~(1u << (region % 32));
+    }
+}
+
+static bool isRegionChanged(const HeapBitmap *live, size_t region)
+{
+    size_t i = region * DELTA_REGION_WORDS;
+    return memcmp(&live->bits[i], &gDelta.bits[i],
+                  DELTA_REGION_WORDS * sizeof(unsigned long)) != 0;
+}
+
+/*
+ * Allocates the saved state on the first report of changes.  Returns
+ * false if memory is short.
+ */
+static bool initDeltaState(const HeapBitmap *live)
+{
+    if (gDelta.bits != NULL) {
+        return true;
+    }
+    size_t numRegions =
+        live->allocLen / (DELTA_REGION_WORDS * sizeof(unsigned long));
+    gDelta.bits = (unsigned long *)calloc(numRegions * DELTA_REGION_WORDS,
+                                          sizeof(unsigned long));
+    gDelta.crossed = (u4 *)calloc((numRegions + 31) / 32, sizeof(u4));
+    if (gDelta.bits == NULL || gDelta.crossed == NULL) {
+        ALOGW("Unable to allocate state for DDM heap changes");
+        free(gDelta.bits);
+        free(gDelta.crossed);
+        memset(&gDelta, 0, sizeof(gDelta));
+        return false;
+    }
+    gDelta.numRegions = numRegions;
+    gDelta.max = 0;
+    return true;
+}
+
+/*
+ * Describes the live objects and the free space in the run of regions
+ * that starts at "first".  The run goes on for as long as the next
+ * region has changed too or an object, old or new, runs into it.  Saves
+ * the state of the regions described, and returns the index of the
+ * region after the run.
+ */
+static size_t appendRegionRun(HeapChunkContext *ctx, const HeapBitmap *live,
+                              size_t first)
+{
+    const unsigned long highBit = 1UL << (HB_BITS_PER_WORD - 1);
+    uintptr_t pos = live->base + first * DELTA_REGION_SIZE;
+    uintptr_t pending = 0;      /* an object not described yet */
+    size_t pendingLen = 0;
+    size_t region = first;
+
+    for (;;) {
+        size_t start = region * DELTA_REGION_WORDS;
+        for (size_t i = start; i < start + DELTA_REGION_WORDS; ++i) {
+            unsigned long word = live->bits[i];
+            uintptr_t ptrBase = HB_INDEX_TO_OFFSET(i) + live->base;
+            while (word != 0) {
+                const int shift = CLZ(word);
+                uintptr_t obj = ptrBase + shift * HB_OBJECT_ALIGNMENT;
+                word &= ~(highBit >> shift);
+
+                /* The chunk of the last object ends where this one starts
+                 * if not sooner; objects packed in a slot run have no
+                 * header of their own.
+                 */
+                if (pending != 0) {
+                    size_t len = MIN(pendingLen, obj - pending);
+                    append_chunk(ctx, objectState((Object *)pending),
+                                 (void *)pending, len);
+                    pos = pending + len;
+                }
+                if (obj > pos) {
+                    append_chunk(ctx, HPSG_STATE(SOLIDITY_FREE, 0),
+                                 (void *)pos, obj - pos);
+                    pos = obj;
+                }
+                pending = obj;
+                pendingLen = dvmHeapSourceChunkSize((void *)obj) +
+                             HEAP_SOURCE_CHUNK_OVERHEAD;
+            }
+        }
+        memcpy(&gDelta.bits[start], &live->bits[start],
+               DELTA_REGION_WORDS * sizeof(unsigned long));
+
+        uintptr_t regionEnd = live->base + (region + 1) * DELTA_REGION_SIZE;
+        bool crossed = pending != 0 && pending + pendingLen > regionEnd;
+        bool wasCrossed = isRegionCrossed(region);
+        setRegionCrossed(region, crossed);
+        ++region;
+        if (region == gDelta.numRegions ||
+            !(crossed || wasCrossed || isRegionChanged(live, region))) {
+            break;
+        }
+    }
+
+    uintptr_t runEnd = live->base + region * DELTA_REGION_SIZE;
+    if (pending != 0) {
+        append_chunk(ctx, objectState((Object *)pending), (void *)pending,
+                     pendingLen);
+        pos = pending + pendingLen;
+    }
+    if (runEnd > pos) {
+        append_chunk(ctx, HPSG_STATE(SOLIDITY_FREE, 0), (void *)pos,
+                     runEnd - pos);
+    }
+
+    /* The next run is somewhere else, so it needs a header of its own. */
+    if (!ctx->needHeader) {
+        flush_hpsg_chunk(ctx);
+    }
+    return region;
+}
+
+/*
+ * Sends HPSG or HPSO chunks for the regions of the heap that changed
+ * since the last call.
+ */
+static void walkHeapChanges(bool merge, bool queue)
+{
+    HeapBitmap *live = dvmHeapSourceGetLiveBits();
+    HeapChunkContext ctx;
+
+    if (!initDeltaState(live)) {
+        return;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.bufLen = HPSx_CHUNK_SIZE;
+    ctx.buf = (u1 *)malloc(ctx.bufLen);
+    if (ctx.buf == NULL) {
+        return;
+    }
+    ctx.merge = merge;
+    ctx.type = merge ? CHUNK_TYPE("HPSG") : CHUNK_TYPE("HPSO");
+    ctx.p = ctx.buf;
+    ctx.needHeader = true;
+    ctx.queue = queue;
+
+    /* Regions past the highest object, then or now, can't have changed. */
+    uintptr_t max = MAX(live->max, gDelta.max);
+    size_t limit = 0;
+    if (max >= live->base) {
+        limit = MIN(gDelta.numRegions,
+                    (max - live->base) / DELTA_REGION_SIZE + 1);
+    }
+    size_t region = 0;
+    while (region < limit) {
+        if (!isRegionChanged(live, region)) {
+            ++region;
+            continue;
+        }
+        /* Back up to the start of any object that runs into it. */
+        size_t first = region;
+        while (first > 0 && isRegionCrossed(first - 1)) {
+            --first;
+        }
+        region = appendRegionRun(&ctx, live, first);
+    }
+    gDelta.max = live->max;
+
+    free(ctx.buf);
+}
+
 void dvmDdmSendHeapSegments(bool shouldLock, bool native)
 {
     u1 heapId[sizeof(u4)];
@@ -452,29 +825,52 @@ void dvmDdmSendHeapSegments(bool shouldLock, bool native)
 
     /* Figure out what kind of chunks we'll be sending.
      */
+    bool changes = false;
     if (what == HPSG_WHAT_MERGED_OBJECTS) {
         merge = true;
     } else if (what == HPSG_WHAT_DISTINCT_OBJECTS) {
         merge = false;
+    } else if (what == HPSG_WHAT_MERGED_CHANGES && !native) {
+        merge = changes = true;
+    } else if (what == HPSG_WHAT_DISTINCT_CHANGES && !native) {
+        merge = false;
+        changes = true;
     } else {
         assert(!"bad HPSG.what value");
         return;
     }
 
+    /* Changes go out through the sender thread if there is one.  If it
+     * has fallen behind, skip this report; the next one covers what
+     * changed since the last one that was made.
+     */
+    bool queue = changes && gSender.started;
+    if (queue && gSender.queuedBytes > kMaxQueuedBytes) {
+        LOGD_HEAP("DDM heap sender is behind; skipping HPSG report");
+        if (shouldLock) {
+            dvmUnlockHeap();
+        }
+        return;
+    }
+
     /* First, send a heap start chunk.
      */
     set4BE(heapId, DEFAULT_HEAP_ID);
-    dvmDbgDdmSendChunk(native ? CHUNK_TYPE("NHST") : CHUNK_TYPE("HPST"),
-        sizeof(u4), heapId);
+    sendChunk(native ? CHUNK_TYPE("NHST") : CHUNK_TYPE("HPST"),
+        sizeof(u4), heapId, queue);
 
     /* Send a series of heap segment chunks.
      */
-    walkHeap(merge, native);
+    if (changes) {
+        walkHeapChanges(merge, queue);
+    } else {
+        walkHeap(merge, native);
+    }
 
     /* Finally, send a heap end chunk.
      */
-    dvmDbgDdmSendChunk(native ? CHUNK_TYPE("NHEN") : CHUNK_TYPE("HPEN"),
-        sizeof(u4), heapId);
+    sendChunk(native ? CHUNK_TYPE("NHEN") : CHUNK_TYPE("HPEN"),
+        sizeof(u4), heapId, queue);
 
     if (shouldLock) {
         dvmUnlockHeap();
@@ -494,19 +890,38 @@ bool dvmDdmHandleHpsgNhsgChunk(int when, int what, bool native)
         return false;
     }
 
+    bool changes = false;
     switch (what) {
     case HPSG_WHAT_MERGED_OBJECTS:
     case HPSG_WHAT_DISTINCT_OBJECTS:
         break;
+    case HPSG_WHAT_MERGED_CHANGES:
+    case HPSG_WHAT_DISTINCT_CHANGES:
+        if (!native) {
+            changes = true;
+            break;
+        }
+        /* fall through */
     default:
         ALOGI("%s(): bad what value 0x%08x", __func__, what);
         return false;
     }
 
+    /* The thread can't be started with the heap locked. */
+    if (changes && when != HPSG_WHEN_NEVER) {
+        startSegmentSender();
+    }
+
     if (dvmLockHeap()) {
         if (!native) {
             gDvm.gcHeap->ddmHpsgWhen = when;
             gDvm.gcHeap->ddmHpsgWhat = what;
+            /* The client starts over from an empty heap. */
+            if (changes) {
+                free(gDelta.bits);
+                free(gDelta.crossed);
+                memset(&gDelta, 0, sizeof(gDelta));
+            }
         } else {
             gDvm.gcHeap->ddmNhsgWhen = when;
             gDvm.gcHeap->ddmNhsgWhat = what;
@@ -29,7 +29,9 @@ void dvmDdmSendHeapInfo(int reason, bool shouldLock);
 /*
  * Walks through the heap and sends a series of
  * HPST/NHST, HPSG/HPSO/NHSG, and HPEN/NHEN chunks that describe
- * the contents of the GC or native heap.
+ * the contents of the GC or native heap.  If the client asked for
+ * changes, only the parts of the GC heap that changed since the last
+ * report are described, and the chunks may be sent from another thread.
  *
  * @param shouldLock If true, grab the heap lock.  If false,
  *                   the heap lock must already be held.
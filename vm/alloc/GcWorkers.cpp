@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Dalvik.h"
+#include "alloc/GcWorkers.h"
+
+struct GcWorkerPool {
+    /* number of helper threads, not counting the caller of Run() */
+    size_t numHelpers;
+    pthread_t threads[GC_MAX_WORKERS - 1];
+
+    pthread_mutex_t lock;
+    pthread_cond_t startCond;
+    pthread_cond_t doneCond;
+
+    /* the work currently being handed out */
+    GcWorkerFunc *func;
+    void *arg;
+
+    /* bumped each time Run() hands out new work */
+    unsigned int generation;
+
+    /* helpers that have not yet finished the current work */
+    size_t pending;
+
+    bool shutdown;
+};
+
+static GcWorkerPool gPool;
+
+static void *gcWorkerThread(void *arg)
+{
+    size_t index = (size_t)arg;
+    unsigned int seen = 0;
+
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+    dvmLockMutex(&gPool.lock);
+    for (;;) {
+        while (!gPool.shutdown && gPool.generation == seen) {
+            dvmWaitCond(&gPool.startCond, &gPool.lock);
+        }
+        if (gPool.shutdown) {
+            break;
+        }
+        seen = gPool.generation;
+        GcWorkerFunc *func = gPool.func;
+        void *funcArg = gPool.arg;
+        dvmUnlockMutex(&gPool.lock);
+        (*func)(index, funcArg);
+        dvmLockMutex(&gPool.lock);
+        assert(gPool.pending > 0);
+        if (--gPool.pending == 0) {
+            dvmSignalCond(&gPool.doneCond);
+        }
+    }
+    dvmUnlockMutex(&gPool.lock);
+    dvmChangeStatus(NULL, THREAD_RUNNING);
+    return NULL;
+}
+
+bool dvmGcWorkersStartup(size_t count)
+{
+    assert(!gDvm.zygote);
+    assert(gPool.numHelpers == 0);
+    dvmInitMutex(&gPool.lock);
+    pthread_cond_init(&gPool.startCond, NULL);
+    pthread_cond_init(&gPool.doneCond, NULL);
+    gPool.shutdown = false;
+    if (count > GC_MAX_WORKERS) {
+        count = GC_MAX_WORKERS;
+    }
+    for (size_t i = 1; i < count; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "GC Worker %zd", i);
+        if (!dvmCreateInternalThread(&gPool.threads[i - 1], name,
+                                     gcWorkerThread, (void *)i)) {
+            ALOGE("Unable to create GC worker thread %zd", i);
+            dvmGcWorkersShutdown();
+            return false;
+        }
+        gPool.numHelpers = i;
+    }
+    return true;
+}
+
+void dvmGcWorkersShutdown()
+{
+    if (gPool.numHelpers == 0) {
+        return;
+    }
+    dvmLockMutex(&gPool.lock);
+    gPool.shutdown = true;
+    dvmBroadcastCond(&gPool.startCond);
+    dvmUnlockMutex(&gPool.lock);
+    for (size_t i = 0; i < gPool.numHelpers; ++i) {
+        pthread_join(gPool.threads[i], NULL);
+    }
+    gPool.numHelpers = 0;
+}
+
+size_t dvmGcWorkerCount()
+{
+    return gPool.numHelpers + 1;
+}
+
+void dvmGcWorkersRun(GcWorkerFunc *func, void *arg)
+{
+    assert(func != NULL);
+    if (gPool.numHelpers == 0) {
+        (*func)(0, arg);
+        return;
+    }
+    dvmLockMutex(&gPool.lock);
+    assert(gPool.pending == 0);
+    gPool.func = func;
+    gPool.arg = arg;
+    gPool.pending = gPool.numHelpers;
+    ++gPool.generation;
+    dvmBroadcastCond(&gPool.startCond);
+    dvmUnlockMutex(&gPool.lock);
+
+    (*func)(0, arg);
+
+    dvmLockMutex(&gPool.lock);
+    while (gPool.pending > 0) {
+        dvmWaitCond(&gPool.doneCond, &gPool.lock);
+    }
+    dvmUnlockMutex(&gPool.lock);
+}
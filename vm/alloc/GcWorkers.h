@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A small pool of helper threads that the garbage collector can hand a
+ * unit of work to.  The helpers are internal VM threads that park in
+ * THREAD_VMWAIT, so they never hold up a thread suspension; they only
+ * run while the thread that issued dvmGcWorkersRun() is waiting for
+ * them.
+ */
+#ifndef DALVIK_ALLOC_GCWORKERS_H_
+#define DALVIK_ALLOC_GCWORKERS_H_
+
+/*
+ * Upper bound on the number of threads, including the caller, that a
+ * single dvmGcWorkersRun() call is spread across.
+ */
+#define GC_MAX_WORKERS 8
+
+/*
+ * Work function.  "index" is in [0, dvmGcWorkerCount()); the caller of
+ * dvmGcWorkersRun() always runs as index 0.
+ */
+typedef void GcWorkerFunc(size_t index, void *arg);
+
+/*
+ * Starts enough helper threads to spread work across "count" threads,
+ * including the caller.  A count of 0 or 1 starts no helpers.  Must not
+ * be called in zygote mode, which has to stay single threaded.
+ */
+bool dvmGcWorkersStartup(size_t count);
+
+/*
+ * Stops and joins all helper threads.
+ */
+void dvmGcWorkersShutdown(void);
+
+/*
+ * Returns the number of threads that execute a dvmGcWorkersRun() call,
+ * including the caller.  Returns 1 if there are no helper threads.
+ */
+size_t dvmGcWorkerCount(void);
+
+/*
+ * Runs "func" on the calling thread and on every helper thread, and
+ * returns once all of them have returned.  Calls must not be nested.
+ */
+void dvmGcWorkersRun(GcWorkerFunc *func, void *arg);
+
+#endif  // DALVIK_ALLOC_GCWORKERS_H_
@@ -22,7 +22,9 @@
 #include "alloc/Heap.h"
 #include "alloc/HeapInternal.h"
 #include "alloc/DdmHeap.h"
+#include "alloc/GcWorkers.h"
 #include "alloc/HeapSource.h"
+#include "alloc/HugePages.h"
 #include "alloc/MarkSweep.h"
 #include "os/os.h"
 
@@ -31,8 +33,15 @@
 #include <limits.h>
 #include <errno.h>
 
+/* Size limits of the table of finalizations not yet run.  References
+ * that do not fit are finalized as usual but are not counted.
+ */
+static const int kPendingFinalizationsInitial = 256;
+static const int kPendingFinalizationsMax = 1024 * 1024;
+
 static const GcSpec kGcForMallocSpec = {
     true,  /* isPartial */
+    false,  /* isYoung */
     false,  /* isConcurrent */
     true,  /* doPreserve */
     "GC_FOR_ALLOC"
@@ -40,8 +49,19 @@ static const GcSpec kGcForMallocSpec = {
 
 const GcSpec *GC_FOR_MALLOC = &kGcForMallocSpec;
 
+static const GcSpec kGcYoungSpec = {
+    true,  /* isPartial */
+    true,  /* isYoung */
+    false,  /* isConcurrent */
+    true,  /* doPreserve */
+    "GC_YOUNG"
+};
+
+const GcSpec *GC_YOUNG = &kGcYoungSpec;
+
 static const GcSpec kGcConcurrentSpec  = {
     true,  /* isPartial */
+    false,  /* isYoung */
     true,  /* isConcurrent */
     true,  /* doPreserve */
     "GC_CONCURRENT"
@@ -51,6 +71,7 @@ const GcSpec *GC_CONCURRENT = &kGcConcurrentSpec;
 
 static const GcSpec kGcExplicitSpec = {
     false,  /* isPartial */
+    false,  /* isYoung */
     true,  /* isConcurrent */
     true,  /* doPreserve */
     "GC_EXPLICIT"
@@ -60,6 +81,7 @@ const GcSpec *GC_EXPLICIT = &kGcExplicitSpec;
 
 static const GcSpec kGcBeforeOomSpec = {
     false,  /* isPartial */
+    false,  /* isYoung */
     false,  /* isConcurrent */
     false,  /* doPreserve */
     "GC_BEFORE_OOM"
@@ -67,6 +89,22 @@ static const GcSpec kGcBeforeOomSpec = {
 
 const GcSpec *GC_BEFORE_OOM = &kGcBeforeOomSpec;
 
+static GcKind gcKindForSpec(const GcSpec *spec)
+{
+    if (spec == GC_FOR_MALLOC) {
+        return kGcKindForMalloc;
+    } else if (spec == GC_YOUNG) {
+        return kGcKindYoung;
+    } else if (spec == GC_CONCURRENT) {
+        return kGcKindConcurrent;
+    } else if (spec == GC_EXPLICIT) {
+        return kGcKindExplicit;
+    } else {
+        assert(spec == GC_BEFORE_OOM);
+        return kGcKindBeforeOom;
+    }
+}
+
 /*
  * Initialize the GC heap.
  *
@@ -80,6 +118,18 @@ bool dvmHeapStartup()
         gDvm.heapGrowthLimit = gDvm.heapMaximumSize;
     }
 
+#ifdef WITH_COPYING_GC
+    if (!gDvm.copyingGc) {
+        LOGE_HEAP("-Xgc:nocopying is not supported by this VM");
+        return false;
+    }
+#else
+    if (gDvm.copyingGc) {
+        LOGE_HEAP("-Xgc:copying requires a VM built with WITH_COPYING_GC");
+        return false;
+    }
+#endif
+
     gcHeap = dvmHeapSourceStartup(gDvm.heapStartingSize,
                                   gDvm.heapMaximumSize,
                                   gDvm.heapGrowthLimit);
@@ -91,13 +141,25 @@ bool dvmHeapStartup()
     gcHeap->ddmHpsgWhat = 0;
     gcHeap->ddmNhsgWhen = 0;
     gcHeap->ddmNhsgWhat = 0;
+    memset(gcHeap->phaseHistograms, 0, sizeof(gcHeap->phaseHistograms));
+    gcHeap->gcEventCount = 0;
+    dvmInitMutex(&gcHeap->phaseLock);
     gDvm.gcHeap = gcHeap;
 
     /* Set up the lists we'll use for cleared reference objects.
      */
     gcHeap->clearedReferences = NULL;
 
-    if (!dvmCardTableStartup(gDvm.heapMaximumSize, gDvm.heapGrowthLimit)) {
+    if (!dvmInitReferenceTable(&gcHeap->pendingFinalizations,
+                               kPendingFinalizationsInitial,
+                               kPendingFinalizationsMax)) {
+        LOGE_HEAP("pending finalization table startup failed.");
+        return false;
+    }
+    gcHeap->pendingFinalizerBytes = 0;
+
+    if (!dvmCardTableStartup(dvmHeapSourceGetReservedLength(),
+                             gDvm.heapGrowthLimit)) {
         LOGE_HEAP("card table startup failed.");
         return false;
     }
@@ -107,6 +169,17 @@ bool dvmHeapStartup()
 
 bool dvmHeapStartupAfterZygote()
 {
+    size_t numWorkers = gDvm.parallelGcThreads;
+    if (numWorkers == 0) {
+        long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        numWorkers = (numCpus > 0) ? numCpus : 1;
+    }
+    if (!dvmGcWorkersStartup(numWorkers)) {
+        /* Not fatal; marking stays on a single thread. */
+        ALOGW("Parallel marking disabled");
+    }
+    /* The zygote's collections say nothing about this process. */
+    dvmResetGcPhaseHistograms();
     return dvmHeapSourceStartupAfterZygote();
 }
 
@@ -115,6 +188,8 @@ void dvmHeapShutdown()
 //TODO: make sure we're locked
     if (gDvm.gcHeap != NULL) {
         dvmCardTableShutdown();
+        dvmClearReferenceTable(&gDvm.gcHeap->pendingFinalizations);
+        pthread_mutex_destroy(&gDvm.gcHeap->phaseLock);
         /* Destroy the heap.  Any outstanding pointers will point to
          * unmapped memory (unless/until someone else maps it).  This
          * frees gDvm.gcHeap as a side-effect.
@@ -129,6 +204,7 @@ void dvmHeapShutdown()
 void dvmHeapThreadShutdown()
 {
     dvmHeapSourceThreadShutdown();
+    dvmGcWorkersShutdown();
 }
 
 /*
@@ -173,9 +249,75 @@ static void gcForMalloc(bool clearSoftReferences)
     dvmCollectGarbageInternal(spec);
 }
 
+/*
+ * Runs a young collection if generational collection is enabled and
+ * the last GC left the survivors it needs behind.  Returns false if no
+ * collection was run.
+ */
+static bool gcYoungForMalloc()
+{
+    if (!gDvm.generationalGc || !gDvm.gcHeap->markBitsSticky) {
+        return false;
+    }
+    if (gDvm.allocProf.enabled) {
+        Thread* self = dvmThreadSelf();
+        gDvm.allocProf.gcCount++;
+        if (self != NULL) {
+            self->allocProf.gcCount++;
+        }
+    }
+    dvmCollectGarbageInternal(GC_YOUNG);
+    return true;
+}
+
+/*
+ * Returns true if an allocation belongs in the large object space.
+ */
+static bool isLargeAllocation(size_t size, int flags)
+{
+    return (flags & ALLOC_NO_REFERENCES) != 0 &&
+           gDvm.largeObjectThreshold != 0 &&
+           size >= gDvm.largeObjectThreshold;
+}
+
+/*
+ * Allocates from the heap source, or from its large object space if
+ * the dvmMalloc() flags put the object there.
+ */
+static void *heapSourceAlloc(size_t size, int flags)
+{
+    if (isLargeAllocation(size, flags)) {
+        return dvmHeapSourceAllocLarge(size, false);
+    }
+    return dvmHeapSourceAlloc(size, (flags & ALLOC_UNINITIALIZED) == 0);
+}
+
+static void *heapSourceAllocAndGrow(size_t size, int flags)
+{
+    if (isLargeAllocation(size, flags)) {
+        return dvmHeapSourceAllocLarge(size, true);
+    }
+    return dvmHeapSourceAllocAndGrow(size,
+                                     (flags & ALLOC_UNINITIALIZED) == 0);
+}
+
+/*
+ * Like heapSourceAlloc(), but if the last GC was swept lazily,
+ * reclaims its garbage a stripe at a time until the allocation
+ * succeeds or there is nothing left to reclaim.
+ */
+static void *allocSweepingLazily(size_t size, int flags)
+{
+    void *ptr = heapSourceAlloc(size, flags);
+    while (ptr == NULL && dvmHeapSweepLazily()) {
+        ptr = heapSourceAlloc(size, flags);
+    }
+    return ptr;
+}
+
 /* Try as hard as possible to allocate some memory.
  */
-static void *tryMalloc(size_t size)
+static void *tryMalloc(size_t size, int flags)
 {
     void *ptr;
 
@@ -189,7 +331,7 @@ static void *tryMalloc(size_t size)
 //    DeflateTest allocs a bunch of ~128k buffers w/in 0-5 allocs of each other
 //      (or, at least, there are only 0-5 objects swept each time)
 
-    ptr = dvmHeapSourceAlloc(size);
+    ptr = allocSweepingLazily(size, flags);
     if (ptr != NULL) {
         return ptr;
     }
@@ -207,11 +349,18 @@ static void *tryMalloc(size_t size)
     } else {
       /*
        * Try a foreground GC since a concurrent GC is not currently running.
+       * Most garbage is young, so try collecting only that first.
        */
+      if (gcYoungForMalloc()) {
+          ptr = allocSweepingLazily(size, flags);
+          if (ptr != NULL) {
+              return ptr;
+          }
+      }
       gcForMalloc(false);
     }
 
-    ptr = dvmHeapSourceAlloc(size);
+    ptr = allocSweepingLazily(size, flags);
     if (ptr != NULL) {
         return ptr;
     }
@@ -219,7 +368,7 @@ static void *tryMalloc(size_t size)
     /* Even that didn't work;  this is an exceptional state.
      * Try harder, growing the heap if necessary.
      */
-    ptr = dvmHeapSourceAllocAndGrow(size);
+    ptr = heapSourceAllocAndGrow(size, flags);
     if (ptr != NULL) {
         size_t newHeapSize;
 
@@ -243,7 +392,8 @@ static void *tryMalloc(size_t size)
     LOGI_HEAP("Forcing collection of SoftReferences for %zu-byte allocation",
             size);
     gcForMalloc(true);
-    ptr = dvmHeapSourceAllocAndGrow(size);
+    dvmHeapFinishLazySweep();
+    ptr = heapSourceAllocAndGrow(size, flags);
     if (ptr != NULL) {
         return ptr;
     }
@@ -307,6 +457,18 @@ static void throwOOME()
     }
 }
 
+/*
+ * Returns true if allocation buffers may be handed out and refilled.
+ * Allocation profiling keeps its counters under the heap lock, and the
+ * inline fast paths in the interpreter and JIT code neither count nor
+ * track, so both turn the buffers off; see dvmRetireAllocBuffers().
+ */
+static bool tlabsAllowed()
+{
+    return gDvm.useTlabs && !gDvm.allocProf.enabled &&
+           gDvm.allocRecords == NULL;
+}
+
 /*
  * Allocate storage on the GC heap.  We guarantee 8-byte alignment.
  *
@@ -326,6 +488,18 @@ static void throwOOME()
  * be part of the root set immediately) or we can't (because this allocation
  * is for a brand new thread).
  *
+ * Use ALLOC_NO_REFERENCES for objects that will never hold a reference,
+ * which lets large ones go in the large object space.
+ *
+ * Use ALLOC_UNINITIALIZED when the caller stores every byte past the
+ * object header before anything can look at the object, so that its
+ * memory need not be zeroed first.  References must be stored before the caller
+ * reaches a GC safe point.  The header always comes back zeroed.
+ *
+ * While the calling thread has an arena (see dvmBeginHeapArena()), its
+ * objects come from the arena unless ALLOC_NON_MOVING is given or the
+ * arena is full.
+ *
  * Returns NULL and throws an exception on failure.
  *
  * TODO: don't do a GC if the debugger thinks all threads are suspended
@@ -334,11 +508,45 @@ void* dvmMalloc(size_t size, int flags)
 {
     void *ptr;
 
+    /* Small objects come from the calling thread's allocation buffer
+     * without taking the heap lock.
+     */
+    Thread* self = NULL;
+    bool useTlab = size <= TLAB_MAX_OBJECT_SIZE && tlabsAllowed();
+    if (useTlab || gDvm.arenaSpaceSize != 0) {
+        self = dvmThreadSelf();
+    }
+    bool useArena = self != NULL && self->heapArena != NULL &&
+                    (flags & ALLOC_NON_MOVING) == 0;
+    if (self == NULL || useArena) {
+        useTlab = false;
+    }
+    if (useTlab) {
+        ptr = dvmTlabAlloc(self->tlabs, size);
+        if (ptr != NULL) {
+            dvmBumpThreadMetric(self, kThreadMetricAllocObjects, 1);
+            dvmBumpThreadMetric(self, kThreadMetricAllocBytes, size);
+            if ((flags & ALLOC_DONT_TRACK) == 0) {
+                dvmAddTrackedAlloc((Object*)ptr, NULL);
+            }
+            return ptr;
+        }
+    }
+
     dvmLockHeap();
 
     /* Try as hard as possible to allocate some memory.
      */
-    ptr = tryMalloc(size);
+    ptr = NULL;
+    if (useArena) {
+        ptr = dvmHeapSourceArenaAlloc(self, size);
+    }
+    if (ptr == NULL && useTlab && tlabsAllowed()) {
+        ptr = dvmHeapSourceRefillTlab(self, size);
+    }
+    if (ptr == NULL) {
+        ptr = tryMalloc(size, flags);
+    }
     if (ptr != NULL) {
         /* We've got the memory.
          */
@@ -369,6 +577,14 @@ void* dvmMalloc(size_t size, int flags)
     dvmUnlockHeap();
 
     if (ptr != NULL) {
+        if (self == NULL) {
+            self = dvmThreadSelf();
+        }
+        if (self != NULL) {
+            dvmBumpThreadMetric(self, kThreadMetricAllocObjects, 1);
+            dvmBumpThreadMetric(self, kThreadMetricAllocBytes, size);
+        }
+
         /*
          * If caller hasn't asked us not to track it, add it to the
          * internal tracking list.
@@ -423,6 +639,59 @@ static void verifyRootsAndHeap()
     dvmVerifyBitmap(dvmHeapSourceGetLiveBits());
 }
 
+/*
+ * Formats the reference counts of a GC as cleared/found per kind,
+ * followed by the time spent on references while the mutators were
+ * running and while they were suspended.  Empty if no reference with
+ * a white referent was found.
+ */
+static void formatReferenceStats(const GcReferenceStats *stats,
+                                 char *buf, size_t len)
+{
+    size_t found = 0;
+    for (size_t i = 0; i < GC_REF_KINDS; ++i) {
+        found += stats->found[i];
+    }
+    if (found == 0) {
+        buf[0] = '\0';
+        return;
+    }
+    snprintf(buf, len,
+             ", refs soft %zd/%zd weak %zd/%zd finalizer %zd/%zd"
+             " phantom %zd/%zd %ums+%ums",
+             stats->cleared[GC_REF_SOFT], stats->found[GC_REF_SOFT],
+             stats->cleared[GC_REF_WEAK], stats->found[GC_REF_WEAK],
+             stats->cleared[GC_REF_FINALIZER], stats->found[GC_REF_FINALIZER],
+             stats->cleared[GC_REF_PHANTOM], stats->found[GC_REF_PHANTOM],
+             stats->concurrentMsec, stats->pausedMsec);
+}
+
+/*
+ * Formats the number of cards rescanned by a GC, and the bytes of the
+ * objects on them, as paused/concurrent.  Empty if no card was dirty.
+ */
+static void formatCardStats(const GcCardStats *stats, char *buf, size_t len)
+{
+    if (stats->dirtyCards == 0 && stats->precleanedCards == 0) {
+        buf[0] = '\0';
+        return;
+    }
+    snprintf(buf, len, ", cards %zd/%zdK precleaned %zd/%zdK",
+             stats->dirtyCards, stats->dirtyBytes / 1024,
+             stats->precleanedCards, stats->precleanedBytes / 1024);
+}
+
+/*
+ * Adds the time since "start" to the histogram of a GC phase, and
+ * returns the current time for the start of the next phase.
+ */
+static u8 recordPhase(GcPhase phase, u8 start)
+{
+    u8 now = dvmGetRelativeTimeUsec();
+    dvmRecordGcPhaseTime(phase, now - start);
+    return now;
+}
+
 /*
  * Initiate garbage collection.
  *
@@ -447,6 +716,7 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
     size_t currAllocated, currFootprint;
     size_t percentFree;
     int oldThreadPriority = INT_MAX;
+    u8 phaseStart;
 
     /* The heap lock must be held.
      */
@@ -458,9 +728,41 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
 
     gcHeap->gcRunning = true;
 
+#ifdef WITH_COPYING_GC
+    /*
+     * The copying collector moves objects, so the mutators must stay
+     * suspended throughout, and it always collects the whole heap.
+     */
+    GcSpec copyingSpec = *spec;
+    copyingSpec.isPartial = false;
+    copyingSpec.isYoung = false;
+    copyingSpec.isConcurrent = false;
+    spec = &copyingSpec;
+#endif
+
+    phaseStart = dvmGetRelativeTimeUsec();
     rootStart = dvmGetRelativeTimeMsec();
     dvmSuspendAllThreads(SUSPEND_FOR_GC);
 
+    /*
+     * Unused allocation buffer slots are marked live but are not
+     * reachable; give them back before anything looks at the bitmaps.
+     */
+    dvmHeapSourceRetireAllTlabs();
+
+    /*
+     * The mark bits are still in use if the last GC was swept lazily.
+     */
+    dvmHeapFinishLazySweep();
+
+    /*
+     * The reflection object caches are only worth keeping while there
+     * is room for them.
+     */
+    if (!spec->doPreserve) {
+        dvmClearReflectCaches();
+    }
+
     /*
      * If we are not marking concurrently raise the priority of the
      * thread performing the garbage collection.
@@ -477,7 +779,7 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
 
     /* Set up the marking context.
      */
-    if (!dvmHeapBeginMarkStep(spec->isPartial)) {
+    if (!dvmHeapBeginMarkStep(spec->isPartial, spec->isYoung)) {
         LOGE_HEAP("dvmHeapBeginMarkStep failed; aborting");
         dvmAbort();
     }
@@ -485,7 +787,11 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
     /* Mark the set of objects that are strongly reachable from the roots.
      */
     LOGD_HEAP("Marking...");
-    dvmHeapMarkRootSet();
+    if (spec->isYoung) {
+        dvmHeapMarkYoungRootSet();
+    } else {
+        dvmHeapMarkRootSet();
+    }
 
     /* dvmHeapScanMarkedObjects() will build the lists of known
      * instances of the Reference classes.
@@ -500,19 +806,49 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
         /*
          * Resume threads while tracing from the roots.  We unlock the
          * heap to allow mutator threads to allocate from free space.
+         * With card aging the stale cards are cleaned after the trace,
+         * while the mutators run, instead.
          */
-        dvmClearCardTable();
+        if (!gDvm.cardAging) {
+            dvmClearCardTable();
+        }
         dvmUnlockHeap();
         dvmResumeAllThreads(SUSPEND_FOR_GC);
         rootEnd = dvmGetRelativeTimeMsec();
     }
+    phaseStart = recordPhase(kGcPhaseMarkRoots, phaseStart);
 
     /* Recursively mark any objects that marked objects point to strongly.
      * If we're not collecting soft references, soft-reachable
      * objects will also be marked.
      */
     LOGD_HEAP("Recursing...");
-    dvmHeapScanMarkedObjects();
+    if (spec->isYoung) {
+        dvmHeapScanYoungObjects();
+    } else {
+        dvmHeapScanMarkedObjects();
+    }
+
+    if (spec->isConcurrent && spec->doPreserve && !gDvm.zygote) {
+        /*
+         * Preserving soft referents only ever marks more objects, so
+         * it, and the tracing it leads to, can be done before the
+         * final suspension.
+         */
+        u4 refStart = dvmGetRelativeTimeMsec();
+        dvmHeapPreserveSoftReferences(&gcHeap->softReferences,
+                                      &gcHeap->weakReferences);
+        gcHeap->referenceStats.concurrentMsec =
+            dvmGetRelativeTimeMsec() - refStart;
+    }
+    if (spec->isConcurrent && gDvm.cardAging) {
+        /*
+         * Rescan what the mutators dirtied during the trace, so that
+         * the final pause is left with the cards dirtied after this.
+         */
+        dvmHeapPrecleanCards();
+    }
+    phaseStart = recordPhase(kGcPhaseMark, phaseStart);
 
     if (spec->isConcurrent) {
         /*
@@ -522,6 +858,11 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
         dirtyStart = dvmGetRelativeTimeMsec();
         dvmLockHeap();
         dvmSuspendAllThreads(SUSPEND_FOR_GC);
+        /*
+         * Mutators may have refilled their allocation buffers while we
+         * were tracing.  Their unused slots would otherwise be swept.
+         */
+        dvmHeapSourceRetireAllTlabs();
         /*
          * As no barrier intercepts root updates, we conservatively
          * assume all roots may be gray and re-mark them.
@@ -539,17 +880,28 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
          * heap objects dirtied during the concurrent mark.
          */
         dvmHeapReScanMarkedObjects();
+        phaseStart = recordPhase(kGcPhaseRemark, phaseStart);
     }
 
     /*
      * All strongly-reachable objects have now been marked.  Process
      * weakly-reachable objects discovered while tracing.
      */
+    u4 refStart = dvmGetRelativeTimeMsec();
     dvmHeapProcessReferences(&gcHeap->softReferences,
                              spec->doPreserve == false,
                              &gcHeap->weakReferences,
                              &gcHeap->finalizerReferences,
                              &gcHeap->phantomReferences);
+    gcHeap->referenceStats.pausedMsec = dvmGetRelativeTimeMsec() - refStart;
+    phaseStart = recordPhase(kGcPhaseReferences, phaseStart);
+
+    /*
+     * Marking is done, so the classes hold this collection's live counts.
+     */
+    if (gcHeap->markContext.countLive) {
+        dvmMetricsRecordLoaderUsage();
+    }
 
 #if defined(WITH_JIT)
     /*
@@ -565,6 +917,7 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
 
     LOGD_HEAP("Sweeping...");
 
+    phaseStart = dvmGetRelativeTimeUsec();
     dvmHeapSweepSystemWeaks();
 
     /*
@@ -579,28 +932,54 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
         verifyRootsAndHeap();
     }
 
+    if (gDvm.lazySweep) {
+        /*
+         * Leave the unmarked objects for the allocator to reclaim on
+         * demand.  This must be set up before the heap is unlocked.
+         */
+        dvmHeapBeginLazySweep(spec->isPartial);
+        numObjectsFreed = numBytesFreed = 0;
+    }
+
     if (spec->isConcurrent) {
         dvmUnlockHeap();
         dvmResumeAllThreads(SUSPEND_FOR_GC);
         dirtyEnd = dvmGetRelativeTimeMsec();
     }
-    dvmHeapSweepUnmarkedObjects(spec->isPartial, spec->isConcurrent,
-                                &numObjectsFreed, &numBytesFreed);
+    if (!gDvm.lazySweep) {
+        dvmHeapSweepUnmarkedObjects(spec->isPartial, spec->isConcurrent,
+                                    &numObjectsFreed, &numBytesFreed);
+    }
     LOGD_HEAP("Cleaning up...");
     dvmHeapFinishMarkStep();
+    recordPhase(kGcPhaseSweep, phaseStart);
     if (spec->isConcurrent) {
         dvmLockHeap();
     }
 
     LOGD_HEAP("Done.");
 
+    u4 now = dvmGetRelativeTimeMsec();
+    if (spec->isConcurrent) {
+        dvmHeapSourceRecordGcTimes(rootStart, now - rootStart,
+                                   MAX(rootEnd - rootStart,
+                                       dirtyEnd - dirtyStart),
+                                   true);
+    } else {
+        dvmHeapSourceRecordGcTimes(rootStart, now - rootStart,
+                                   now - rootStart, false);
+    }
+
     /* Now's a good time to adjust the heap size, since
      * we know what our utilization is.
      *
      * This doesn't actually resize any memory;
      * it just lets the heap grow more when necessary.
+     * A lazy sweep does this once it has reclaimed everything.
      */
-    dvmHeapSourceGrowForUtilization();
+    if (!dvmHeapIsLazySweepPending()) {
+        dvmHeapSourceGrowForUtilization();
+    }
 
     currAllocated = dvmHeapSourceGetValue(HS_BYTES_ALLOCATED, NULL, 0);
     currFootprint = dvmHeapSourceGetValue(HS_FOOTPRINT, NULL, 0);
@@ -639,29 +1018,53 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
 
     gcEnd = dvmGetRelativeTimeMsec();
     percentFree = 100 - (size_t)(100.0f * (float)currAllocated / currFootprint);
+    char refs[128];
+    formatReferenceStats(&gcHeap->referenceStats, refs, sizeof(refs));
+    char cards[64];
+    formatCardStats(&gcHeap->cardStats, cards, sizeof(cards));
     if (!spec->isConcurrent) {
         u4 markSweepTime = dirtyEnd - rootStart;
         u4 gcTime = gcEnd - rootStart;
         bool isSmall = numBytesFreed > 0 && numBytesFreed < 1024;
-        ALOGD("%s freed %s%zdK, %d%% free %zdK/%zdK, paused %ums, total %ums",
+        ALOGD("%s freed %s%zdK, %d%% free %zdK/%zdK, paused %ums, total %ums%s%s",
              spec->reason,
              isSmall ? "<" : "",
              numBytesFreed ? MAX(numBytesFreed / 1024, 1) : 0,
              percentFree,
              currAllocated / 1024, currFootprint / 1024,
-             markSweepTime, gcTime);
+             markSweepTime, gcTime, cards, refs);
     } else {
         u4 rootTime = rootEnd - rootStart;
         u4 dirtyTime = dirtyEnd - dirtyStart;
         u4 gcTime = gcEnd - rootStart;
         bool isSmall = numBytesFreed > 0 && numBytesFreed < 1024;
-        ALOGD("%s freed %s%zdK, %d%% free %zdK/%zdK, paused %ums+%ums, total %ums",
+        ALOGD("%s freed %s%zdK, %d%% free %zdK/%zdK, paused %ums+%ums, total %ums%s%s",
              spec->reason,
              isSmall ? "<" : "",
              numBytesFreed ? MAX(numBytesFreed / 1024, 1) : 0,
              percentFree,
              currAllocated / 1024, currFootprint / 1024,
-             rootTime, dirtyTime, gcTime);
+             rootTime, dirtyTime, gcTime, cards, refs);
+    }
+    GcEvent event;
+    event.startMsec = rootStart;
+    event.kind = gcKindForSpec(spec);
+    if (!spec->isConcurrent) {
+        event.pauseMsec = dirtyEnd - rootStart;
+    } else {
+        event.pauseMsec = (rootEnd - rootStart) + (dirtyEnd - dirtyStart);
+    }
+    event.totalMsec = gcEnd - rootStart;
+    event.bytesFreed = numBytesFreed;
+    event.allocated = currAllocated;
+    event.footprint = currFootprint;
+    dvmRecordGcEvent(&event);
+    dvmMetricsRecordGc(spec->isConcurrent, event.pauseMsec, event.totalMsec,
+                       numObjectsFreed, numBytesFreed, currAllocated,
+                       currFootprint);
+    if (gDvm.hugePageMode != kHugePagesNone) {
+        /* Reads /proc/self/smaps, so only paid for when asked for. */
+        dvmMetricsRecordHugePages(dvmHugePagesResidentBytes());
     }
     if (gcHeap->ddmHpifWhen != 0) {
         LOGD_HEAP("Sending VM heap info to DDM");
@@ -22,6 +22,8 @@
 struct GcSpec {
   /* If true, only the application heap is threatened. */
   bool isPartial;
+  /* If true, only objects allocated since the last GC are threatened. */
+  bool isYoung;
   /* If true, the trace is run concurrently with the mutator. */
   bool isConcurrent;
   /* Toggles for the soft reference clearing policy. */
@@ -33,6 +35,9 @@ struct GcSpec {
 /* Not enough space for an "ordinary" Object to be allocated. */
 extern const GcSpec *GC_FOR_MALLOC;
 
+/* Collects only the objects allocated since the last GC. */
+extern const GcSpec *GC_YOUNG;
+
 /* Automatic GC triggered by exceeding a heap occupancy threshold. */
 extern const GcSpec *GC_CONCURRENT;
 
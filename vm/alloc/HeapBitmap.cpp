@@ -18,6 +18,12 @@
 #include "HeapBitmap.h"
 #include <sys/mman.h>   /* for PROT_* */
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*
  * Initialize a HeapBitmap so that it points to a bitmap large
  * enough to cover a heap at <base> of <maxSize> bytes, where
@@ -74,6 +80,20 @@ void dvmHeapBitmapZero(HeapBitmap *hb)
     }
 }
 
+void dvmHeapBitmapClearRange(HeapBitmap *hb, uintptr_t base, size_t length)
+{
+    assert(hb != NULL);
+    assert(base >= hb->base);
+    assert(HB_INDEX_TO_OFFSET(HB_OFFSET_TO_INDEX(base - hb->base)) ==
+           base - hb->base);
+    assert(HB_INDEX_TO_OFFSET(HB_OFFSET_TO_INDEX(length)) == length);
+
+    size_t index = HB_OFFSET_TO_INDEX(base - hb->base);
+    assert(index * sizeof(*hb->bits) + HB_OFFSET_TO_BYTE_INDEX(length) <=
+           hb->allocLen);
+    memset(hb->bits + index, 0, HB_OFFSET_TO_BYTE_INDEX(length));
+}
+
 /*
  * Return true iff <obj> is within the range of pointers that this
  * bitmap could potentially cover, even if a bit has not been set
@@ -90,6 +110,114 @@ bool dvmHeapBitmapCoversAddress(const HeapBitmap *hb, const void *obj)
     return false;
 }
 
+/*
+ * The mark and live bitmaps are mostly long runs of zero words.  The
+ * walks skip over them a block of HB_SKIP_WORDS words at a time, using
+ * NEON or SSE2 where available, before looking at single words.
+ */
+#define HB_SKIP_BYTES 64
+#define HB_SKIP_WORDS (HB_SKIP_BYTES / sizeof(unsigned long))
+
+/*
+ * Returns true iff every word of the block at <bits> is zero.
+ */
+static inline bool isZeroBlock(const unsigned long *bits)
+{
+#if defined(__ARM_NEON__)
+    const uint32_t *p = (const uint32_t *)bits;
+    uint32x4_t v = vorrq_u32(vorrq_u32(vld1q_u32(p), vld1q_u32(p + 4)),
+                             vorrq_u32(vld1q_u32(p + 8), vld1q_u32(p + 12)));
+    uint32x2_t w = vorr_u32(vget_low_u32(v), vget_high_u32(v));
+    return (vget_lane_u32(w, 0) | vget_lane_u32(w, 1)) == 0;
+#elif defined(__SSE2__)
+    const __m128i *p = (const __m128i *)bits;
+    __m128i v = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p),
+                                          _mm_loadu_si128(p + 1)),
+                             _mm_or_si128(_mm_loadu_si128(p + 2),
+                                          _mm_loadu_si128(p + 3)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0xffff;
+#else
+    unsigned long v = 0;
+    for (size_t i = 0; i < HB_SKIP_WORDS; ++i) {
+        v |= bits[i];
+    }
+    return v == 0;
+#endif
+}
+
+/*
+ * Returns true iff <live> & ~<mark> is zero for every word of the
+ * blocks at <live> and <mark>.
+ */
+static inline bool isGarbageFreeBlock(const unsigned long *live,
+                                      const unsigned long *mark)
+{
+#if defined(__ARM_NEON__)
+    const uint32_t *l = (const uint32_t *)live;
+    const uint32_t *m = (const uint32_t *)mark;
+    uint32x4_t v = vorrq_u32(
+        vorrq_u32(vbicq_u32(vld1q_u32(l), vld1q_u32(m)),
+                  vbicq_u32(vld1q_u32(l + 4), vld1q_u32(m + 4))),
+        vorrq_u32(vbicq_u32(vld1q_u32(l + 8), vld1q_u32(m + 8)),
+                  vbicq_u32(vld1q_u32(l + 12), vld1q_u32(m + 12))));
+    uint32x2_t w = vorr_u32(vget_low_u32(v), vget_high_u32(v));
+    return (vget_lane_u32(w, 0) | vget_lane_u32(w, 1)) == 0;
+#elif defined(__SSE2__)
+    const __m128i *l = (const __m128i *)live;
+    const __m128i *m = (const __m128i *)mark;
+    __m128i v = _mm_or_si128(
+        _mm_or_si128(_mm_andnot_si128(_mm_loadu_si128(m),
+                                      _mm_loadu_si128(l)),
+                     _mm_andnot_si128(_mm_loadu_si128(m + 1),
+                                      _mm_loadu_si128(l + 1))),
+        _mm_or_si128(_mm_andnot_si128(_mm_loadu_si128(m + 2),
+                                      _mm_loadu_si128(l + 2)),
+                     _mm_andnot_si128(_mm_loadu_si128(m + 3),
+                                      _mm_loadu_si128(l + 3))));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0xffff;
+#else
+    unsigned long v = 0;
+    for (size_t i = 0; i < HB_SKIP_WORDS; ++i) {
+        v |= live[i] & ~mark[i];
+    }
+    return v == 0;
+#endif
+}
+
+/*
+ * Returns the index of the first non-zero word of <bits> in [i, end],
+ * or end + 1 if there is none.
+ */
+static inline size_t skipZeroWords(const unsigned long *bits, size_t i,
+                                   size_t end)
+{
+    while (i + HB_SKIP_WORDS <= end + 1 && isZeroBlock(&bits[i])) {
+        i += HB_SKIP_WORDS;
+    }
+    while (i <= end && bits[i] == 0) {
+        ++i;
+    }
+    return i;
+}
+
+/*
+ * Returns the index of the first word in [i, end] with a bit set in
+ * <live> but not in <mark>, or end + 1 if there is none.
+ */
+static inline size_t skipGarbageFreeWords(const unsigned long *live,
+                                          const unsigned long *mark,
+                                          size_t i, size_t end)
+{
+    while (i + HB_SKIP_WORDS <= end + 1 &&
+           isGarbageFreeBlock(&live[i], &mark[i])) {
+        i += HB_SKIP_WORDS;
+    }
+    while (i <= end && (live[i] & ~mark[i]) == 0) {
+        ++i;
+    }
+    return i;
+}
+
 /*
  * Visits set bits in address order.  The callback is not permitted to
  * change the bitmap bits or max during the traversal.
@@ -100,18 +228,18 @@ void dvmHeapBitmapWalk(const HeapBitmap *bitmap, BitmapCallback *callback,
     assert(bitmap != NULL);
     assert(bitmap->bits != NULL);
     assert(callback != NULL);
+    const unsigned long *bits = bitmap->bits;
     uintptr_t end = HB_OFFSET_TO_INDEX(bitmap->max - bitmap->base);
-    for (uintptr_t i = 0; i <= end; ++i) {
-        unsigned long word = bitmap->bits[i];
-        if (UNLIKELY(word != 0)) {
-            unsigned long highBit = 1 << (HB_BITS_PER_WORD - 1);
-            uintptr_t ptrBase = HB_INDEX_TO_OFFSET(i) + bitmap->base;
-            while (word != 0) {
-                const int shift = CLZ(word);
-                Object* obj = (Object *)(ptrBase + shift * HB_OBJECT_ALIGNMENT);
-                (*callback)(obj, arg);
-                word &= ~(highBit >> shift);
-            }
+    for (uintptr_t i = skipZeroWords(bits, 0, end); i <= end;
+         i = skipZeroWords(bits, i + 1, end)) {
+        unsigned long word = bits[i];
+        unsigned long highBit = 1 << (HB_BITS_PER_WORD - 1);
+        uintptr_t ptrBase = HB_INDEX_TO_OFFSET(i) + bitmap->base;
+        while (word != 0) {
+            const int shift = CLZ(word);
+            Object* obj = (Object *)(ptrBase + shift * HB_OBJECT_ALIGNMENT);
+            (*callback)(obj, arg);
+            word &= ~(highBit >> shift);
         }
     }
 }
@@ -134,22 +262,22 @@ void dvmHeapBitmapScanWalk(HeapBitmap *bitmap,
     assert(bitmap != NULL);
     assert(bitmap->bits != NULL);
     assert(callback != NULL);
+    const unsigned long *bits = bitmap->bits;
     uintptr_t end = HB_OFFSET_TO_INDEX(bitmap->max - bitmap->base);
     uintptr_t i;
-    for (i = 0; i <= end; ++i) {
-        unsigned long word = bitmap->bits[i];
-        if (UNLIKELY(word != 0)) {
-            unsigned long highBit = 1 << (HB_BITS_PER_WORD - 1);
-            uintptr_t ptrBase = HB_INDEX_TO_OFFSET(i) + bitmap->base;
-            void *finger = (void *)(HB_INDEX_TO_OFFSET(i + 1) + bitmap->base);
-            while (word != 0) {
-                const int shift = CLZ(word);
-                Object *obj = (Object *)(ptrBase + shift * HB_OBJECT_ALIGNMENT);
-                (*callback)(obj, finger, arg);
-                word &= ~(highBit >> shift);
-            }
-            end = HB_OFFSET_TO_INDEX(bitmap->max - bitmap->base);
+    for (i = skipZeroWords(bits, 0, end); i <= end;
+         i = skipZeroWords(bits, i + 1, end)) {
+        unsigned long word = bits[i];
+        unsigned long highBit = 1 << (HB_BITS_PER_WORD - 1);
+        uintptr_t ptrBase = HB_INDEX_TO_OFFSET(i) + bitmap->base;
+        void *finger = (void *)(HB_INDEX_TO_OFFSET(i + 1) + bitmap->base);
+        while (word != 0) {
+            const int shift = CLZ(word);
+            Object *obj = (Object *)(ptrBase + shift * HB_OBJECT_ALIGNMENT);
+            (*callback)(obj, finger, arg);
+            word &= ~(highBit >> shift);
         }
+        end = HB_OFFSET_TO_INDEX(bitmap->max - bitmap->base);
     }
 }
 
@@ -185,22 +313,21 @@ void dvmHeapBitmapSweepWalk(const HeapBitmap *liveHb, const HeapBitmap *markHb,
     size_t end = HB_OFFSET_TO_INDEX(max - liveHb->base);
     unsigned long *live = liveHb->bits;
     unsigned long *mark = markHb->bits;
-    for (size_t i = start; i <= end; i++) {
+    for (size_t i = skipGarbageFreeWords(live, mark, start, end); i <= end;
+         i = skipGarbageFreeWords(live, mark, i + 1, end)) {
         unsigned long garbage = live[i] & ~mark[i];
-        if (UNLIKELY(garbage != 0)) {
-            unsigned long highBit = 1 << (HB_BITS_PER_WORD - 1);
-            uintptr_t ptrBase = HB_INDEX_TO_OFFSET(i) + liveHb->base;
-            while (garbage != 0) {
-                int shift = CLZ(garbage);
-                garbage &= ~(highBit >> shift);
-                *pb++ = (void *)(ptrBase + shift * HB_OBJECT_ALIGNMENT);
-            }
-            /* Make sure that there are always enough slots available */
-            /* for an entire word of 1s. */
-            if (pb >= &pointerBuf[NELEM(pointerBuf) - HB_BITS_PER_WORD]) {
-                (*callback)(pb - pointerBuf, pointerBuf, callbackArg);
-                pb = pointerBuf;
-            }
+        unsigned long highBit = 1 << (HB_BITS_PER_WORD - 1);
+        uintptr_t ptrBase = HB_INDEX_TO_OFFSET(i) + liveHb->base;
+        while (garbage != 0) {
+            int shift = CLZ(garbage);
+            garbage &= ~(highBit >> shift);
+            *pb++ = (void *)(ptrBase + shift * HB_OBJECT_ALIGNMENT);
+        }
+        /* Make sure that there are always enough slots available */
+        /* for an entire word of 1s. */
+        if (pb >= &pointerBuf[NELEM(pointerBuf) - HB_BITS_PER_WORD]) {
+            (*callback)(pb - pointerBuf, pointerBuf, callbackArg);
+            pb = pointerBuf;
         }
     }
     if (pb > pointerBuf) {
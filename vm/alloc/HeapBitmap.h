@@ -96,6 +96,13 @@ void dvmHeapBitmapDelete(HeapBitmap *hb);
  */
 void dvmHeapBitmapZero(HeapBitmap *hb);
 
+/*
+ * Clears the bits of the <length> bytes at <base>, which must both be
+ * multiples of the bytes covered by a word of the bitmap.  Leaves max
+ * alone.
+ */
+void dvmHeapBitmapClearRange(HeapBitmap *hb, uintptr_t base, size_t length);
+
 /*
  * Returns true if the address range of the bitmap covers the object
  * address.
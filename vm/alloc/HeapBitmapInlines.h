@@ -18,6 +18,7 @@
 #define DALVIK_HEAP_BITMAPINLINES_H_
 
 static unsigned long dvmHeapBitmapSetAndReturnObjectBit(HeapBitmap *hb, const void *obj) __attribute__((used));
+static unsigned long dvmHeapBitmapAtomicSetAndReturnObjectBit(HeapBitmap *hb, const void *obj) __attribute__((used));
 static void dvmHeapBitmapSetObjectBit(HeapBitmap *hb, const void *obj) __attribute__((used));
 static void dvmHeapBitmapClearObjectBit(HeapBitmap *hb, const void *obj) __attribute__((used));
 
@@ -66,6 +67,38 @@ static unsigned long dvmHeapBitmapSetAndReturnObjectBit(HeapBitmap *hb,
     return _heapBitmapModifyObjectBit(hb, obj, true, true);
 }
 
+/*
+ * Like dvmHeapBitmapSetAndReturnObjectBit(), but may be called by
+ * several threads setting bits in the same bitmap at once.  Exactly one
+ * of the threads racing to set a given bit sees a zero return value.
+ *
+ * Like HB_OFFSET_TO_MASK, this assumes 32-bit bitmap words.
+ */
+static unsigned long dvmHeapBitmapAtomicSetAndReturnObjectBit(HeapBitmap *hb,
+                                                              const void *obj)
+{
+    const uintptr_t offset = (uintptr_t)obj - hb->base;
+    const size_t index = HB_OFFSET_TO_INDEX(offset);
+    const unsigned long mask = HB_OFFSET_TO_MASK(offset);
+    volatile int32_t *word = (volatile int32_t *)(hb->bits + index);
+
+    assert(hb->bits != NULL);
+    assert((uintptr_t)obj >= hb->base);
+    assert(index < hb->bitsLen / sizeof(*hb->bits));
+    if ((*word & mask) != 0) {
+        /* Already set; skip the atomic operations. */
+        return mask;
+    }
+    uintptr_t max;
+    while ((uintptr_t)obj > (max = hb->max)) {
+        if (android_atomic_release_cas((int32_t)max, (int32_t)obj,
+                                       (volatile int32_t *)&hb->max) == 0) {
+            break;
+        }
+    }
+    return (unsigned long)android_atomic_or((int32_t)mask, word) & mask;
+}
+
 /*
  * Sets the bit corresponding to <obj>, and widens the range of seen
  * pointers if necessary.  Does no range checking.
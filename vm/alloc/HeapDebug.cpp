@@ -16,6 +16,7 @@
 
 #include "Dalvik.h"
 #include "HeapSource.h"
+#include "HeapInternal.h"
 
 int dvmGetHeapDebugInfo(HeapDebugInfoType info)
 {
@@ -30,3 +31,142 @@ int dvmGetHeapDebugInfo(HeapDebugInfoType info)
         return -1;
     }
 }
+
+static const char* kGcPhaseNames[kGcPhaseCount] = {
+    "mark-roots", "mark", "remark", "references", "sweep", "trim"
+};
+
+const char* dvmGcPhaseName(GcPhase phase)
+{
+    assert(phase >= 0 && phase < kGcPhaseCount);
+    return kGcPhaseNames[phase];
+}
+
+static size_t phaseBucket(u8 usec)
+{
+    size_t bucket = 0;
+    while (usec != 0 && bucket < GC_PHASE_HISTOGRAM_BUCKETS - 1) {
+        usec >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void dvmRecordGcPhaseTime(GcPhase phase, u8 usec)
+{
+    assert(phase >= 0 && phase < kGcPhaseCount);
+    GcHeap *gcHeap = gDvm.gcHeap;
+    if (gcHeap == NULL) {
+        return;
+    }
+    u4 clipped = usec > 0xffffffff ? 0xffffffff : (u4)usec;
+    dvmLockMutex(&gcHeap->phaseLock);
+    GcPhaseHistogram *hist = &gcHeap->phaseHistograms[phase];
+    hist->count++;
+    hist->totalUsec += usec;
+    if (clipped > hist->maxUsec) {
+        hist->maxUsec = clipped;
+    }
+    hist->buckets[phaseBucket(usec)]++;
+    dvmUnlockMutex(&gcHeap->phaseLock);
+}
+
+void dvmGetGcPhaseHistograms(GcPhaseHistogram* histograms)
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    if (gcHeap == NULL) {
+        memset(histograms, 0, kGcPhaseCount * sizeof(*histograms));
+        return;
+    }
+    dvmLockMutex(&gcHeap->phaseLock);
+    memcpy(histograms, gcHeap->phaseHistograms,
+           sizeof(gcHeap->phaseHistograms));
+    dvmUnlockMutex(&gcHeap->phaseLock);
+}
+
+void dvmResetGcPhaseHistograms()
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    if (gcHeap == NULL) {
+        return;
+    }
+    dvmLockMutex(&gcHeap->phaseLock);
+    memset(gcHeap->phaseHistograms, 0, sizeof(gcHeap->phaseHistograms));
+    dvmUnlockMutex(&gcHeap->phaseLock);
+}
+
+void dvmRecordGcEvent(GcEvent* event)
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    if (gcHeap == NULL) {
+        return;
+    }
+    dvmLockMutex(&gcHeap->phaseLock);
+    event->seq = gcHeap->gcEventCount;
+    gcHeap->gcEvents[gcHeap->gcEventCount % GC_EVENT_LOG_SIZE] = *event;
+    gcHeap->gcEventCount++;
+    dvmUnlockMutex(&gcHeap->phaseLock);
+}
+
+size_t dvmGetGcEvents(GcEvent* events, size_t maxEvents)
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    if (gcHeap == NULL) {
+        return 0;
+    }
+    dvmLockMutex(&gcHeap->phaseLock);
+    size_t total = gcHeap->gcEventCount;
+    size_t count = MIN(MIN(total, (size_t)GC_EVENT_LOG_SIZE), maxEvents);
+    for (size_t i = 0; i < count; ++i) {
+        size_t seq = total - count + i;
+        events[i] = gcHeap->gcEvents[seq % GC_EVENT_LOG_SIZE];
+    }
+    dvmUnlockMutex(&gcHeap->phaseLock);
+    return count;
+}
+
+void dvmResetGcEvents()
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    if (gcHeap == NULL) {
+        return;
+    }
+    dvmLockMutex(&gcHeap->phaseLock);
+    gcHeap->gcEventCount = 0;
+    dvmUnlockMutex(&gcHeap->phaseLock);
+}
+
+void dvmDumpGcPhaseHistograms(const DebugOutputTarget* target)
+{
+    GcPhaseHistogram histograms[kGcPhaseCount];
+    dvmGetGcPhaseHistograms(histograms);
+
+    dvmPrintDebugMessage(target, "GC phase times (usec):\n");
+    for (int i = 0; i < kGcPhaseCount; ++i) {
+        const GcPhaseHistogram *hist = &histograms[i];
+        if (hist->count == 0) {
+            continue;
+        }
+        dvmPrintDebugMessage(target,
+            "  %-10s count=%u total=%llu avg=%llu max=%u\n",
+            dvmGcPhaseName((GcPhase)i), hist->count,
+            hist->totalUsec, hist->totalUsec / hist->count, hist->maxUsec);
+
+        /* Only the buckets that were hit, as "<limit:count". */
+        char buf[GC_PHASE_HISTOGRAM_BUCKETS * 24];
+        size_t len = 0;
+        for (size_t j = 0; j < GC_PHASE_HISTOGRAM_BUCKETS; ++j) {
+            if (hist->buckets[j] == 0) {
+                continue;
+            }
+            if (j == GC_PHASE_HISTOGRAM_BUCKETS - 1) {
+                len += snprintf(buf + len, sizeof(buf) - len, " >=%u:%u",
+                                1u << (j - 1), hist->buckets[j]);
+            } else {
+                len += snprintf(buf + len, sizeof(buf) - len, " <%u:%u",
+                                1u << j, hist->buckets[j]);
+            }
+        }
+        dvmPrintDebugMessage(target, "   %s\n", buf);
+    }
+}
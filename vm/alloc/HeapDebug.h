@@ -29,4 +29,106 @@ enum HeapDebugInfoType {
  */
 int dvmGetHeapDebugInfo(HeapDebugInfoType info);
 
+/*
+ * The phases of a garbage collection that are timed separately.
+ */
+enum GcPhase {
+    kGcPhaseMarkRoots = 0,      /* suspending threads and marking roots */
+    kGcPhaseMark = 1,           /* tracing from the roots */
+    kGcPhaseRemark = 2,         /* re-marking dirty cards, concurrent only */
+    kGcPhaseReferences = 3,     /* processing soft, weak and phantom refs */
+    kGcPhaseSweep = 4,          /* sweeping, or setting up a lazy sweep */
+    kGcPhaseTrim = 5,           /* returning free pages to the system */
+    kGcPhaseCount = 6
+};
+
+/*
+ * Bucket 0 of a histogram counts phases that took less than a
+ * microsecond, and bucket i counts those that took [2^(i-1), 2^i)
+ * microseconds.  The last bucket also counts anything longer.
+ */
+#define GC_PHASE_HISTOGRAM_BUCKETS 24
+
+struct GcPhaseHistogram {
+    u4 count;
+    u8 totalUsec;
+    u4 maxUsec;
+    u4 buckets[GC_PHASE_HISTOGRAM_BUCKETS];
+};
+
+/*
+ * Adds one run of a phase that took "usec" microseconds.
+ */
+void dvmRecordGcPhaseTime(GcPhase phase, u8 usec);
+
+/*
+ * Copies the histograms of all kGcPhaseCount phases into "histograms".
+ */
+void dvmGetGcPhaseHistograms(GcPhaseHistogram* histograms);
+
+/*
+ * Clears the histograms of all phases.
+ */
+void dvmResetGcPhaseHistograms(void);
+
+/*
+ * Returns a short name for the phase.
+ */
+const char* dvmGcPhaseName(GcPhase phase);
+
+/*
+ * Prints the histograms of all phases that have run at least once.
+ */
+void dvmDumpGcPhaseHistograms(const DebugOutputTarget* target);
+
+/*
+ * What a collection was run for, i.e. which GcSpec it used.
+ */
+enum GcKind {
+    kGcKindForMalloc = 0,
+    kGcKindYoung = 1,
+    kGcKindConcurrent = 2,
+    kGcKindExplicit = 3,
+    kGcKindBeforeOom = 4,
+    kGcKindCount = 5
+};
+
+/*
+ * One collection, as kept in the GC event log.  Concurrent collections
+ * pause twice; pauseMsec is the sum.
+ */
+struct GcEvent {
+    u4 seq;                     /* position in the log since the last reset */
+    u4 startMsec;               /* low bits of dvmGetRelativeTimeMsec() */
+    u4 kind;                    /* a GcKind */
+    u4 pauseMsec;
+    u4 totalMsec;
+    size_t bytesFreed;
+    size_t allocated;           /* bytes allocated afterwards */
+    size_t footprint;           /* heap footprint afterwards */
+};
+
+/*
+ * The log keeps the most recent GC_EVENT_LOG_SIZE collections.
+ */
+#define GC_EVENT_LOG_SIZE 512
+
+/*
+ * Appends a collection to the log, dropping the oldest if it is full.
+ * Fills in event->seq.
+ */
+void dvmRecordGcEvent(GcEvent* event);
+
+/*
+ * Copies up to "maxEvents" of the logged collections into "events",
+ * oldest first, and returns how many were copied.  If the log holds more
+ * than "maxEvents", the most recent ones are copied.
+ */
+size_t dvmGetGcEvents(GcEvent* events, size_t maxEvents);
+
+/*
+ * Empties the GC event log.
+ */
+void dvmResetGcEvents(void);
+
 #endif  // DALVIK_HEAPDEBUG_H_
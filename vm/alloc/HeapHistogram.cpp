@@ -0,0 +1,916 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per-class heap histogram: instance count, live bytes and, optionally,
+ * an estimate of the bytes each class keeps alive.
+ *
+ * This is meant for finding memory growth without taking an hprof dump.
+ * It walks the live bitmap once and keeps one entry per class, so it
+ * runs in a fraction of the time and memory of a dump.
+ *
+ * The retained size is approximated from reference counts rather than
+ * a dominator tree.  A first pass counts the references to each object,
+ * saturating at two, in a pair of side bitmaps; roots count as a
+ * reference too.  An object with exactly one referrer is dominated by
+ * it, so an object retains its own size plus that of every object it
+ * reaches along a chain of singly-referenced objects.  That is a lower
+ * bound on the true retained size: objects shared only within a
+ * subtree, like the entries of a map, are not charged to the map.  The
+ * chains are followed kMaxOwnedDepth deep, and the referents of
+ * java.lang.ref.Reference objects are never charged to the Reference.
+ *
+ * For slow leaks there is also a snapshot of the per-class counts that
+ * marking keeps when -Xloaderaccounting is on.  Saving it only copies
+ * what the last full collection counted, so it costs no heap walk, and
+ * a later diff lists the classes that grew the most since.  On request
+ * the diff includes paths from a root to a few sampled instances of
+ * each class.  Those are found backwards, one heap walk per step, by
+ * looking for a referrer that wasn't tried yet and backing up when there
+ * is none; they are not the shortest paths, and objects allocated since
+ * the last collection may show up on them.  Referents of
+ * java.lang.ref.Reference objects are not followed.
+ */
+#include "Dalvik.h"
+#include "alloc/HeapBitmap.h"
+#include "alloc/HeapBitmapInlines.h"
+#include "alloc/HeapSource.h"
+#include "alloc/Visit.h"
+
+#include <stdlib.h>
+
+/* how far to follow chains of singly-referenced objects */
+#define kMaxOwnedDepth              8
+
+/* number of entries printed by dvmDumpHeapHistogram() */
+#define kNumHistogramDumpEntries    40
+
+/* instances per class that the snapshot diff finds root paths for */
+#define kNumSamplePaths             3
+
+/* heap walks allowed per path, and the longest path reported */
+#define kMaxPathSteps               48
+#define kMaxPathLength              24
+
+struct HeapHistogramEntry {
+    const ClassObject* clazz;
+    u4          instances;
+    u8          shallowBytes;
+    u8          retainedBytes;
+};
+
+struct HistogramContext {
+    HashTable*  classes;            /* HeapHistogramEntry, keyed by class */
+    HeapHistogramEntry* lastEntry;  /* one-entry lookup cache */
+    bool        retained;
+    bool        failed;             /* ran out of memory */
+
+    /* an object's bit is set in "once" when it is referenced at all, and
+     * in "many" as well when it is referenced more than once */
+    HeapBitmap  onceBits;
+    HeapBitmap  manyBits;
+
+    /* the referent slot of the Reference being scanned, if any */
+    Object**    skipSlot;
+    u8          ownedBytes;
+    int         ownedDepth;
+};
+
+static int compareClassEntry(const void* tableItem, const void* looseItem)
+{
+    return ((const HeapHistogramEntry*) tableItem)->clazz !=
+        ((const HeapHistogramEntry*) looseItem)->clazz;
+}
+
+/*
+ * Find the entry for "clazz", adding it if needed.  Returns NULL if we
+ * ran out of memory.
+ */
+static HeapHistogramEntry* findEntry(HistogramContext* ctx,
+    const ClassObject* clazz)
+{
+    if (ctx->lastEntry != NULL && ctx->lastEntry->clazz == clazz)
+        return ctx->lastEntry;
+
+    HeapHistogramEntry key;
+    key.clazz = clazz;
+    u4 hash = (u4) clazz >> 3;
+    HeapHistogramEntry* pEntry = (HeapHistogramEntry*)
+        dvmHashTableLookup(ctx->classes, hash, &key, compareClassEntry, false);
+    if (pEntry == NULL) {
+        pEntry = (HeapHistogramEntry*) calloc(1, sizeof(*pEntry));
+        if (pEntry == NULL) {
+            ctx->failed = true;
+            return NULL;
+        }
+        pEntry->clazz = clazz;
+        dvmHashTableLookup(ctx->classes, hash, pEntry, compareClassEntry,
+            true);
+    }
+    ctx->lastEntry = pEntry;
+    return pEntry;
+}
+
+/*
+ * Count one more reference to "obj".
+ */
+static void countReference(HistogramContext* ctx, const Object* obj)
+{
+    if (obj == NULL || !dvmHeapBitmapCoversAddress(&ctx->onceBits, obj))
+        return;
+    if (dvmHeapBitmapSetAndReturnObjectBit(&ctx->onceBits, obj))
+        dvmHeapBitmapSetObjectBit(&ctx->manyBits, obj);
+}
+
+static void countRootVisitor(void* addr, u4 threadId, RootType type,
+    void* arg)
+{
+    countReference((HistogramContext*) arg, *(Object**) addr);
+}
+
+static void countFieldVisitor(void* addr, void* arg)
+{
+    countReference((HistogramContext*) arg, *(Object**) addr);
+}
+
+static void countReferencesCallback(Object* obj, void* arg)
+{
+    dvmVisitObject(countFieldVisitor, obj, arg);
+}
+
+/*
+ * Whether "obj" is referenced exactly once.
+ */
+static bool isSinglyReferenced(const HistogramContext* ctx, const Object* obj)
+{
+    return dvmHeapBitmapIsObjectBitSet(&ctx->onceBits, obj) != 0 &&
+        dvmHeapBitmapIsObjectBitSet(&ctx->manyBits, obj) == 0;
+}
+
+static void addOwned(HistogramContext* ctx, Object* obj);
+
+static void ownedFieldVisitor(void* addr, void* arg)
+{
+    HistogramContext* ctx = (HistogramContext*) arg;
+    Object* ref = *(Object**) addr;
+
+    if (ref == NULL || (Object**) addr == ctx->skipSlot)
+        return;
+    if (!dvmHeapBitmapCoversAddress(&ctx->onceBits, ref) ||
+        !isSinglyReferenced(ctx, ref))
+    {
+        return;
+    }
+    ctx->ownedBytes += dvmHeapSourceChunkSize(ref);
+    if (ctx->ownedDepth < kMaxOwnedDepth)
+        addOwned(ctx, ref);
+}
+
+/*
+ * Add the sizes of the objects only "obj" refers to, and of the objects
+ * only they refer to, and so on, to ctx->ownedBytes.
+ */
+static void addOwned(HistogramContext* ctx, Object* obj)
+{
+    Object** savedSkip = ctx->skipSlot;
+
+    ctx->skipSlot = NULL;
+    if (!dvmIsClassObject(obj) &&
+        IS_CLASS_FLAG_SET(obj->clazz, CLASS_ISREFERENCE))
+    {
+        ctx->skipSlot = (Object**)
+            BYTE_OFFSET(obj, gDvm.offJavaLangRefReference_referent);
+    }
+    ctx->ownedDepth++;
+    dvmVisitObject(ownedFieldVisitor, obj, ctx);
+    ctx->ownedDepth--;
+    ctx->skipSlot = savedSkip;
+}
+
+static void histogramCallback(Object* obj, void* arg)
+{
+    HistogramContext* ctx = (HistogramContext*) arg;
+
+    if (obj->clazz == NULL || ctx->failed)
+        return;
+    HeapHistogramEntry* pEntry = findEntry(ctx, obj->clazz);
+    if (pEntry == NULL)
+        return;
+
+    size_t size = dvmHeapSourceChunkSize(obj);
+    pEntry->instances++;
+    pEntry->shallowBytes += size;
+    if (ctx->retained) {
+        ctx->ownedBytes = 0;
+        addOwned(ctx, obj);
+        pEntry->retainedBytes += size + ctx->ownedBytes;
+    }
+}
+
+/*
+ * Sort by live bytes, largest first.
+ */
+static int compareShallowBytes(const void* vp1, const void* vp2)
+{
+    const HeapHistogramEntry* p1 = (const HeapHistogramEntry*) vp1;
+    const HeapHistogramEntry* p2 = (const HeapHistogramEntry*) vp2;
+
+    if (p1->shallowBytes != p2->shallowBytes)
+        return (p1->shallowBytes < p2->shallowBytes) ? 1 : -1;
+    return 0;
+}
+
+/*
+ * Walk the heap with all threads suspended, and return a new array of
+ * the entries, largest first, with "*pCount" set.  Returns NULL on
+ * failure.
+ */
+static HeapHistogramEntry* buildHistogram(bool retained, size_t* pCount)
+{
+    HistogramContext ctx;
+    HeapHistogramEntry* result = NULL;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.retained = retained;
+    ctx.classes = dvmHashTableCreate(512, free);
+    if (ctx.classes == NULL)
+        return NULL;
+
+    dvmLockHeap();
+    dvmSuspendAllThreads(SUSPEND_FOR_HPROF);
+    /* Don't report unused allocation buffer slots as objects. */
+    dvmHeapSourceRetireAllTlabs();
+
+    HeapBitmap* liveBits = dvmHeapSourceGetLiveBits();
+    if (retained) {
+        void* base = dvmHeapSourceGetBase();
+        size_t length = dvmHeapSourceGetReservedLength();
+        if (!dvmHeapBitmapInit(&ctx.onceBits, base, length,
+                "dalvik-histogram-once"))
+        {
+            ctx.failed = true;
+        } else if (!dvmHeapBitmapInit(&ctx.manyBits, base, length,
+                       "dalvik-histogram-many"))
+        {
+            dvmHeapBitmapDelete(&ctx.onceBits);
+            ctx.failed = true;
+        } else {
+            dvmVisitRoots(countRootVisitor, &ctx);
+            dvmHeapBitmapWalk(liveBits, countReferencesCallback, &ctx);
+        }
+    }
+    if (!ctx.failed)
+        dvmHeapBitmapWalk(liveBits, histogramCallback, &ctx);
+
+    dvmResumeAllThreads(SUSPEND_FOR_HPROF);
+    dvmUnlockHeap();
+
+    if (retained && ctx.onceBits.bits != NULL) {
+        dvmHeapBitmapDelete(&ctx.onceBits);
+        dvmHeapBitmapDelete(&ctx.manyBits);
+    }
+
+    if (!ctx.failed) {
+        size_t count = dvmHashTableNumEntries(ctx.classes);
+        result = (HeapHistogramEntry*) malloc(sizeof(*result) * (count + 1));
+        if (result != NULL) {
+            size_t i = 0;
+            HashIter iter;
+            for (dvmHashIterBegin(ctx.classes, &iter);
+                 !dvmHashIterDone(&iter); dvmHashIterNext(&iter))
+            {
+                result[i++] = *(HeapHistogramEntry*) dvmHashIterData(&iter);
+            }
+            qsort(result, count, sizeof(*result), compareShallowBytes);
+            *pCount = count;
+        }
+    }
+    dvmHashTableFree(ctx.classes);
+    if (result == NULL)
+        ALOGW("heap histogram: out of memory");
+    return result;
+}
+
+/*
+ * Print the classes with the most live bytes.
+ */
+void dvmDumpHeapHistogram(const DebugOutputTarget* target, bool retained)
+{
+    size_t count;
+    HeapHistogramEntry* entries = buildHistogram(retained, &count);
+    if (entries == NULL)
+        return;
+
+    u4 totalInstances = 0;
+    u8 totalBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        totalInstances += entries[i].instances;
+        totalBytes += entries[i].shallowBytes;
+    }
+
+    dvmPrintDebugMessage(target,
+        "HEAP HISTOGRAM: (%zd classes, %u objects, %lluKB)\n",
+        count, totalInstances, (totalBytes + 1023) / 1024);
+    if (retained) {
+        dvmPrintDebugMessage(target,
+            "  %10s %12s %12s  %s\n", "objects", "bytes", "retained",
+            "class");
+    } else {
+        dvmPrintDebugMessage(target,
+            "  %10s %12s  %s\n", "objects", "bytes", "class");
+    }
+    if (count > kNumHistogramDumpEntries)
+        count = kNumHistogramDumpEntries;
+    for (size_t i = 0; i < count; i++) {
+        const HeapHistogramEntry* pEntry = &entries[i];
+        if (retained) {
+            dvmPrintDebugMessage(target, "  %10u %12llu %12llu  %s\n",
+                pEntry->instances, pEntry->shallowBytes,
+                pEntry->retainedBytes, pEntry->clazz->descriptor);
+        } else {
+            dvmPrintDebugMessage(target, "  %10u %12llu  %s\n",
+                pEntry->instances, pEntry->shallowBytes,
+                pEntry->clazz->descriptor);
+        }
+    }
+    dvmPrintDebugMessage(target, "\n");
+
+    free(entries);
+}
+
+/*
+ * Generate the contents of an HHST chunk, the histogram of live classes.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) flags; bit 0 is set if retained sizes were computed
+ *  (4b) number of entries
+ * Then, per class, most live bytes first:
+ *  (4b) number of instances
+ *  (8b) live bytes
+ *  (8b) approximate retained bytes, or 0
+ *  (str) class descriptor
+ *
+ * Strings are a 2-byte length followed by modified UTF-8.
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure.  The
+ * caller must call dvmReleaseTrackedAlloc() on the array.
+ */
+ArrayObject* dvmDdmGenerateHeapHistogram(bool retained)
+{
+    const int kHeaderLen = 6;
+    const int kEntryLen = 20;
+
+    size_t count;
+    HeapHistogramEntry* entries = buildHistogram(retained, &count);
+    if (entries == NULL)
+        return NULL;
+
+    size_t bufLen = kHeaderLen;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(entries[i].clazz->descriptor);
+        bufLen += kEntryLen + 2 + (len > 0xffff ? 0xffff : len);
+    }
+
+    ArrayObject* arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj == NULL) {
+        free(entries);
+        return NULL;
+    }
+
+    u1* buf = (u1*) arrayObj->contents;
+    set1(buf+0, kHeaderLen);
+    set1(buf+1, retained ? 1 : 0);
+    set4BE(buf+2, count);
+    buf += kHeaderLen;
+    for (size_t i = 0; i < count; i++) {
+        const HeapHistogramEntry* pEntry = &entries[i];
+        size_t len = strlen(pEntry->clazz->descriptor);
+        if (len > 0xffff)
+            len = 0xffff;
+
+        set4BE(buf+0, pEntry->instances);
+        set8BE(buf+4, pEntry->shallowBytes);
+        set8BE(buf+12, pEntry->retainedBytes);
+        set2BE(buf+20, len);
+        memcpy(buf+22, pEntry->clazz->descriptor, len);
+        buf += kEntryLen + 2 + len;
+    }
+    assert(buf == (u1*) arrayObj->contents + bufLen);
+
+    free(entries);
+    return arrayObj;
+}
+
+/*
+ * The class counts saved by dvmSaveClassSnapshot(), sorted by class.
+ * Class objects never move or go away, so they can be kept as keys.
+ * Guarded by the heap lock.
+ */
+struct ClassSnapshotEntry {
+    const ClassObject* clazz;
+    u4          liveObjects;
+    u4          liveBytes;
+};
+
+static ClassSnapshotEntry* gSnapshot;
+static size_t gSnapshotCount;
+static u4 gSnapshotGc;
+
+struct ClassGrowthEntry {
+    const ClassObject* clazz;
+    u4          instances;
+    u8          liveBytes;
+    s4          instanceGrowth;
+    s8          byteGrowth;
+    int         numPaths;
+    std::string paths[kNumSamplePaths];
+};
+
+struct SnapshotContext {
+    ClassSnapshotEntry* entries;
+    size_t      count;
+    size_t      maxCount;
+};
+
+static int compareSnapshotClass(const void* vp1, const void* vp2)
+{
+    const ClassObject* c1 = ((const ClassSnapshotEntry*) vp1)->clazz;
+    const ClassObject* c2 = ((const ClassSnapshotEntry*) vp2)->clazz;
+    return (c1 < c2) ? -1 : (c1 > c2);
+}
+
+static int addSnapshotEntry(void* data, void* arg)
+{
+    const ClassObject* clazz = (const ClassObject*) data;
+    SnapshotContext* ctx = (SnapshotContext*) arg;
+
+    if (clazz->lastLiveObjects != 0 && ctx->count < ctx->maxCount) {
+        ClassSnapshotEntry* pEntry = &ctx->entries[ctx->count++];
+        pEntry->clazz = clazz;
+        pEntry->liveObjects = clazz->lastLiveObjects;
+        pEntry->liveBytes = clazz->lastLiveBytes;
+    }
+    return 0;
+}
+
+/*
+ * Copy the counts of the last counted collection into a new array, sorted
+ * by class.  Caller holds the heap lock.
+ */
+static ClassSnapshotEntry* copyClassCounts(size_t* pCount)
+{
+    SnapshotContext ctx;
+
+    dvmHashTableLock(gDvm.loadedClasses);
+    ctx.maxCount = dvmHashTableNumEntries(gDvm.loadedClasses);
+    ctx.count = 0;
+    ctx.entries = (ClassSnapshotEntry*)
+        malloc(MAX(ctx.maxCount, 1) * sizeof(ClassSnapshotEntry));
+    if (ctx.entries != NULL)
+        dvmHashForeach(gDvm.loadedClasses, addSnapshotEntry, &ctx);
+    dvmHashTableUnlock(gDvm.loadedClasses);
+
+    if (ctx.entries != NULL) {
+        qsort(ctx.entries, ctx.count, sizeof(ClassSnapshotEntry),
+            compareSnapshotClass);
+    }
+    *pCount = ctx.count;
+    return ctx.entries;
+}
+
+bool dvmSaveClassSnapshot()
+{
+    bool result = false;
+
+    dvmLockHeap();
+    if (gDvm.liveCountGcs == 0) {
+        ALOGW("class snapshot: no collection has counted the heap yet");
+    } else {
+        size_t count;
+        ClassSnapshotEntry* entries = copyClassCounts(&count);
+        if (entries == NULL) {
+            ALOGW("class snapshot: out of memory");
+        } else {
+            free(gSnapshot);
+            gSnapshot = entries;
+            gSnapshotCount = count;
+            gSnapshotGc = gDvm.liveCountGcs;
+            result = true;
+        }
+    }
+    dvmUnlockHeap();
+    return result;
+}
+
+/*
+ * Sort by growth in live bytes, largest first.
+ */
+static int compareByteGrowth(const void* vp1, const void* vp2)
+{
+    const ClassGrowthEntry* p1 = (const ClassGrowthEntry*) vp1;
+    const ClassGrowthEntry* p2 = (const ClassGrowthEntry*) vp2;
+
+    if (p1->byteGrowth != p2->byteGrowth)
+        return (p1->byteGrowth < p2->byteGrowth) ? 1 : -1;
+    return 0;
+}
+
+/*
+ * State for finding a path from a root to an object.
+ */
+struct RootPathContext {
+    HeapBitmap  rootBits;           /* objects referenced by a root */
+    HeapBitmap  triedBits;          /* objects that were on a path */
+    const Object* target;
+    Object*     referrer;           /* an untried object that refers to it */
+    RootType    rootType;
+
+    /* instances of the class being sampled */
+    const ClassObject* clazz;
+    Object*     samples[kNumSamplePaths];
+    u4          numSeen;
+};
+
+static void markRootVisitor(void* addr, u4 threadId, RootType type,
+    void* arg)
+{
+    RootPathContext* ctx = (RootPathContext*) arg;
+    Object* obj = *(Object**) addr;
+
+    if (obj != NULL && dvmHeapBitmapCoversAddress(&ctx->rootBits, obj))
+        dvmHeapBitmapSetObjectBit(&ctx->rootBits, obj);
+}
+
+static void rootTypeVisitor(void* addr, u4 threadId, RootType type,
+    void* arg)
+{
+    RootPathContext* ctx = (RootPathContext*) arg;
+
+    if (*(Object**) addr == ctx->target && ctx->rootType == ROOT_UNKNOWN)
+        ctx->rootType = type;
+}
+
+struct ReferrerScan {
+    RootPathContext* ctx;
+    Object*     obj;
+    Object**    skipSlot;
+};
+
+static void referrerFieldVisitor(void* addr, void* arg)
+{
+    ReferrerScan* scan = (ReferrerScan*) arg;
+
+    if (*(Object**) addr == scan->ctx->target &&
+        (Object**) addr != scan->skipSlot)
+    {
+        scan->ctx->referrer = scan->obj;
+    }
+}
+
+static void findReferrerCallback(Object* obj, void* arg)
+{
+    RootPathContext* ctx = (RootPathContext*) arg;
+
+    if (ctx->referrer != NULL || obj->clazz == NULL ||
+        dvmHeapBitmapIsObjectBitSet(&ctx->triedBits, obj))
+    {
+        return;
+    }
+    ReferrerScan scan;
+    scan.ctx = ctx;
+    scan.obj = obj;
+    scan.skipSlot = NULL;
+    if (!dvmIsClassObject(obj) &&
+        IS_CLASS_FLAG_SET(obj->clazz, CLASS_ISREFERENCE))
+    {
+        scan.skipSlot = (Object**)
+            BYTE_OFFSET(obj, gDvm.offJavaLangRefReference_referent);
+    }
+    dvmVisitObject(referrerFieldVisitor, obj, &scan);
+}
+
+static void sampleInstanceCallback(Object* obj, void* arg)
+{
+    RootPathContext* ctx = (RootPathContext*) arg;
+
+    if (obj->clazz != ctx->clazz)
+        return;
+    /* keep a uniform sample of the instances seen so far */
+    u4 slot = ctx->numSeen++;
+    if (slot >= kNumSamplePaths)
+        slot = (u4) rand() % ctx->numSeen;
+    if (slot < kNumSamplePaths)
+        ctx->samples[slot] = obj;
+}
+
+static const char* rootTypeName(RootType type)
+{
+    switch (type) {
+    case ROOT_JNI_GLOBAL:       return "jni-global";
+    case ROOT_JNI_LOCAL:        return "jni-local";
+    case ROOT_JAVA_FRAME:       return "java-frame";
+    case ROOT_NATIVE_STACK:     return "native-stack";
+    case ROOT_STICKY_CLASS:     return "sticky-class";
+    case ROOT_THREAD_BLOCK:     return "thread-block";
+    case ROOT_MONITOR_USED:     return "monitor-used";
+    case ROOT_THREAD_OBJECT:    return "thread-object";
+    case ROOT_INTERNED_STRING:  return "interned-string";
+    case ROOT_DEBUGGER:         return "debugger";
+    case ROOT_VM_INTERNAL:      return "vm-internal";
+    case ROOT_JNI_MONITOR:      return "jni-monitor";
+    default:                    return "unknown";
+    }
+}
+
+/*
+ * Describe a path from a root to "obj", as the types of the objects on
+ * it starting from the root.  Returns an empty string if none was found
+ * in time.
+ */
+static std::string findRootPath(RootPathContext* ctx, Object* obj)
+{
+    Object* path[kMaxPathLength];
+    size_t depth = 0;
+
+    path[depth++] = obj;
+    dvmHeapBitmapSetObjectBit(&ctx->triedBits, obj);
+    for (int steps = 0; depth > 0; steps++) {
+        Object* cur = path[depth - 1];
+        if (dvmHeapBitmapIsObjectBitSet(&ctx->rootBits, cur))
+            break;
+        if (steps == kMaxPathSteps)
+            return "";
+
+        ctx->target = cur;
+        ctx->referrer = NULL;
+        dvmHeapBitmapWalk(dvmHeapSourceGetLiveBits(), findReferrerCallback,
+            ctx);
+        if (ctx->referrer == NULL) {
+            depth--;
+            continue;
+        }
+        dvmHeapBitmapSetObjectBit(&ctx->triedBits, ctx->referrer);
+        if (depth < kMaxPathLength)
+            path[depth++] = ctx->referrer;
+    }
+    if (depth == 0)
+        return "";
+
+    ctx->target = path[depth - 1];
+    ctx->rootType = ROOT_UNKNOWN;
+    dvmVisitRoots(rootTypeVisitor, ctx);
+
+    std::string result = "root ";
+    result += rootTypeName(ctx->rootType);
+    while (depth > 0) {
+        result += " -> ";
+        result += dvmHumanReadableType(path[--depth]);
+    }
+    return result;
+}
+
+/*
+ * Find the paths for the classes in "entries".  Suspends all threads.
+ */
+static void findSamplePaths(ClassGrowthEntry* entries, size_t count)
+{
+    RootPathContext ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    dvmLockHeap();
+    dvmSuspendAllThreads(SUSPEND_FOR_HPROF);
+    dvmHeapSourceRetireAllTlabs();
+
+    HeapBitmap* liveBits = dvmHeapSourceGetLiveBits();
+    void* base = dvmHeapSourceGetBase();
+    size_t length = dvmHeapSourceGetReservedLength();
+    if (!dvmHeapBitmapInit(&ctx.rootBits, base, length,
+            "dalvik-snapshot-roots"))
+    {
+        ALOGW("class snapshot: out of memory for root paths");
+    } else if (!dvmHeapBitmapInit(&ctx.triedBits, base, length,
+                   "dalvik-snapshot-tried"))
+    {
+        ALOGW("class snapshot: out of memory for root paths");
+        dvmHeapBitmapDelete(&ctx.rootBits);
+    } else {
+        dvmVisitRoots(markRootVisitor, &ctx);
+        for (size_t i = 0; i < count; i++) {
+            ctx.clazz = entries[i].clazz;
+            ctx.numSeen = 0;
+            dvmHeapBitmapWalk(liveBits, sampleInstanceCallback, &ctx);
+            int numSamples = MIN(ctx.numSeen, kNumSamplePaths);
+            for (int j = 0; j < numSamples; j++) {
+                /* paths may share objects, but not dead ends */
+                dvmHeapBitmapZero(&ctx.triedBits);
+                std::string path = findRootPath(&ctx, ctx.samples[j]);
+                if (!path.empty())
+                    entries[i].paths[entries[i].numPaths++] = path;
+            }
+        }
+        dvmHeapBitmapDelete(&ctx.rootBits);
+        dvmHeapBitmapDelete(&ctx.triedBits);
+    }
+
+    dvmResumeAllThreads(SUSPEND_FOR_HPROF);
+    dvmUnlockHeap();
+}
+
+/*
+ * Compare the last counted collection against the saved snapshot.
+ * Returns a new array of the "maxCount" classes that grew the most,
+ * largest growth first, with "*pCount" set and the number of collections
+ * in between in "*pGcs".  Returns NULL if there is no snapshot or memory
+ * is short.  Free the result with delete[].
+ */
+static ClassGrowthEntry* diffClassSnapshot(size_t maxCount, bool paths,
+    size_t* pCount, u4* pGcs)
+{
+    ClassGrowthEntry* result = NULL;
+    ClassGrowthEntry* growth = NULL;
+    size_t count = 0;
+
+    dvmLockHeap();
+    if (gSnapshot == NULL) {
+        ALOGW("class snapshot: no snapshot was saved");
+        dvmUnlockHeap();
+        return NULL;
+    }
+    size_t numClasses;
+    ClassSnapshotEntry* now = copyClassCounts(&numClasses);
+    *pGcs = gDvm.liveCountGcs - gSnapshotGc;
+    if (now != NULL)
+        growth = new ClassGrowthEntry[MAX(numClasses, 1)];
+    for (size_t i = 0; growth != NULL && i < numClasses; i++) {
+        const ClassSnapshotEntry* before = (const ClassSnapshotEntry*)
+            bsearch(&now[i], gSnapshot, gSnapshotCount,
+                sizeof(ClassSnapshotEntry), compareSnapshotClass);
+        s8 byteGrowth = (s8) now[i].liveBytes;
+        s4 instanceGrowth = (s4) now[i].liveObjects;
+        if (before != NULL) {
+            byteGrowth -= before->liveBytes;
+            instanceGrowth -= before->liveObjects;
+        }
+        if (byteGrowth <= 0)
+            continue;
+        ClassGrowthEntry* pEntry = &growth[count++];
+        pEntry->clazz = now[i].clazz;
+        pEntry->instances = now[i].liveObjects;
+        pEntry->liveBytes = now[i].liveBytes;
+        pEntry->instanceGrowth = instanceGrowth;
+        pEntry->byteGrowth = byteGrowth;
+        pEntry->numPaths = 0;
+    }
+    dvmUnlockHeap();
+    free(now);
+
+    if (growth == NULL) {
+        ALOGW("class snapshot: out of memory");
+        return NULL;
+    }
+    qsort(growth, count, sizeof(ClassGrowthEntry), compareByteGrowth);
+    if (count > maxCount)
+        count = maxCount;
+    result = new ClassGrowthEntry[MAX(count, 1)];
+    for (size_t i = 0; i < count; i++)
+        result[i] = growth[i];
+    delete[] growth;
+
+    if (paths && count > 0)
+        findSamplePaths(result, count);
+    *pCount = count;
+    return result;
+}
+
+/*
+ * Print the classes that grew the most since the saved snapshot.
+ */
+void dvmDumpClassSnapshotDiff(const DebugOutputTarget* target,
+    size_t maxCount, bool paths)
+{
+    size_t count;
+    u4 gcs;
+    ClassGrowthEntry* entries =
+        diffClassSnapshot(maxCount, paths, &count, &gcs);
+    if (entries == NULL)
+        return;
+
+    dvmPrintDebugMessage(target,
+        "CLASS SNAPSHOT DIFF: (%zd classes grew over %u collections)\n",
+        count, gcs);
+    dvmPrintDebugMessage(target, "  %10s %12s %10s %12s  %s\n",
+        "+objects", "+bytes", "objects", "bytes", "class");
+    for (size_t i = 0; i < count; i++) {
+        const ClassGrowthEntry* pEntry = &entries[i];
+        dvmPrintDebugMessage(target, "  %+10d %+12lld %10u %12llu  %s\n",
+            pEntry->instanceGrowth, pEntry->byteGrowth, pEntry->instances,
+            pEntry->liveBytes, pEntry->clazz->descriptor);
+        for (int j = 0; j < pEntry->numPaths; j++) {
+            dvmPrintDebugMessage(target, "      %s\n",
+                pEntry->paths[j].c_str());
+        }
+    }
+    dvmPrintDebugMessage(target, "\n");
+
+    delete[] entries;
+}
+
+/*
+ * Generate the contents of an HSDF chunk, the classes that grew the most
+ * since the saved snapshot.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) flags; bit 0 is set if root paths were looked for
+ *  (4b) number of collections since the snapshot
+ *  (4b) number of entries
+ * Then, per class, most growth first:
+ *  (4b) number of instances
+ *  (4b) growth in instances, signed
+ *  (8b) live bytes
+ *  (8b) growth in live bytes
+ *  (str) class descriptor
+ *  (2b) number of root paths
+ *  (str) root path, repeated
+ *
+ * A root path names the kind of root, then the types of the objects from
+ * the root down to the instance, like
+ * "root jni-global -> java.util.HashMap -> ... -> com.example.Foo".
+ *
+ * Strings are a 2-byte length followed by modified UTF-8.
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure.  The
+ * caller must call dvmReleaseTrackedAlloc() on the array.
+ */
+ArrayObject* dvmDdmGenerateClassSnapshotDiff(size_t maxCount, bool paths)
+{
+    const int kHeaderLen = 10;
+    const int kEntryLen = 24;
+
+    size_t count;
+    u4 gcs;
+    ClassGrowthEntry* entries =
+        diffClassSnapshot(maxCount, paths, &count, &gcs);
+    if (entries == NULL)
+        return NULL;
+
+    size_t bufLen = kHeaderLen;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(entries[i].clazz->descriptor);
+        bufLen += kEntryLen + 2 + MIN(len, 0xffff) + 2;
+        for (int j = 0; j < entries[i].numPaths; j++)
+            bufLen += 2 + MIN(entries[i].paths[j].size(), 0xffff);
+    }
+
+    ArrayObject* arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj == NULL) {
+        delete[] entries;
+        return NULL;
+    }
+
+    u1* buf = (u1*) arrayObj->contents;
+    set1(buf+0, kHeaderLen);
+    set1(buf+1, paths ? 1 : 0);
+    set4BE(buf+2, gcs);
+    set4BE(buf+6, count);
+    buf += kHeaderLen;
+    for (size_t i = 0; i < count; i++) {
+        const ClassGrowthEntry* pEntry = &entries[i];
+        size_t len = MIN(strlen(pEntry->clazz->descriptor), 0xffff);
+
+        set4BE(buf+0, pEntry->instances);
+        set4BE(buf+4, pEntry->instanceGrowth);
+        set8BE(buf+8, pEntry->liveBytes);
+        set8BE(buf+16, pEntry->byteGrowth);
+        set2BE(buf+24, len);
+        memcpy(buf+26, pEntry->clazz->descriptor, len);
+        buf += kEntryLen + 2 + len;
+
+        set2BE(buf, pEntry->numPaths);
+        buf += 2;
+        for (int j = 0; j < pEntry->numPaths; j++) {
+            len = MIN(pEntry->paths[j].size(), 0xffff);
+            set2BE(buf, len);
+            memcpy(buf+2, pEntry->paths[j].data(), len);
+            buf += 2 + len;
+        }
+    }
+    assert(buf == (u1*) arrayObj->contents + bufLen);
+
+    delete[] entries;
+    return arrayObj;
+}
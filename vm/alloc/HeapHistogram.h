@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per-class heap histogram.
+ */
+#ifndef DALVIK_ALLOC_HEAPHISTOGRAM_H_
+#define DALVIK_ALLOC_HEAPHISTOGRAM_H_
+
+struct DebugOutputTarget;
+
+/*
+ * Print the classes with the most live bytes.  If "retained" is set,
+ * also approximate the bytes each class keeps alive, which takes an
+ * extra pass over the heap.  Suspends all threads for the walk.
+ */
+void dvmDumpHeapHistogram(const DebugOutputTarget* target, bool retained);
+
+/*
+ * Generate a byte[] with the histogram of every live class for DDM, or
+ * NULL on failure.  The caller must call dvmReleaseTrackedAlloc() on the
+ * array.
+ */
+ArrayObject* dvmDdmGenerateHeapHistogram(bool retained);
+
+/*
+ * Save the per-class live counts of the last collection that took them
+ * (see -Xloaderaccounting) as the baseline for later diffs.  Returns
+ * false if no collection has counted the heap yet.
+ */
+bool dvmSaveClassSnapshot(void);
+
+/*
+ * Print the "maxCount" classes whose live bytes grew the most between the
+ * saved snapshot and the last counted collection.  If "paths" is set,
+ * also print paths from a root to a few sampled instances of each, which
+ * suspends all threads for a number of heap walks.
+ */
+void dvmDumpClassSnapshotDiff(const DebugOutputTarget* target,
+    size_t maxCount, bool paths);
+
+/*
+ * Generate a byte[] with the same diff for DDM, or NULL on failure.  The
+ * caller must call dvmReleaseTrackedAlloc() on the array.
+ */
+ArrayObject* dvmDdmGenerateClassSnapshotDiff(size_t maxCount, bool paths);
+
+#endif  // DALVIK_ALLOC_HEAPHISTOGRAM_H_
@@ -40,6 +40,38 @@ struct GcHeap {
      */
     Object *clearedReferences;
 
+    /* The finalizer references enqueued by a GC whose finalizer has not
+     * run yet, and the heap bytes their referents hold.  Entries are
+     * pruned during every GC's final pause, and by allocating threads
+     * that find the backlog over -XX:MaxPendingFinalizers, both with
+     * the heap lock held.  The references are not roots.
+     */
+    ReferenceTable pendingFinalizations;
+    size_t pendingFinalizerBytes;
+
+    /* Counts and timings of the reference processing of the current
+     * GC.  Reset by dvmHeapBeginMarkStep().
+     */
+    GcReferenceStats referenceStats;
+
+    /* Cards scanned by the current GC.  Reset by dvmHeapBeginMarkStep().
+     */
+    GcCardStats cardStats;
+
+    /* How long each phase of every GC so far has taken.  Guarded by
+     * phaseLock rather than the heap lock so that the histograms can be
+     * read while a GC is running.
+     */
+    GcPhaseHistogram phaseHistograms[kGcPhaseCount];
+    pthread_mutex_t phaseLock;
+
+    /* The most recent collections, as a ring.  gcEventCount is the
+     * number recorded since the last reset, so the next slot is
+     * gcEventCount % GC_EVENT_LOG_SIZE.  Guarded by phaseLock.
+     */
+    GcEvent gcEvents[GC_EVENT_LOG_SIZE];
+    size_t gcEventCount;
+
     /* The current state of the mark step.
      * Only valid during a GC.
      */
@@ -51,10 +83,21 @@ struct GcHeap {
     size_t cardTableMaxLength;
     size_t cardTableOffset;
 
+    /* The number of times the card table has been cleared.  Cards
+     * only record every store made since the last clearing.
+     */
+    u4 cardTableClears;
+
     /* Is the GC running?  Used to avoid recursive calls to GC.
      */
     bool gcRunning;
 
+    /* Do the mark bits hold the survivors of the last GC?  Only with
+     * generational collection, where they are the old generation of
+     * the next young collection.
+     */
+    bool markBitsSticky;
+
     /*
      * Debug control values
      */
@@ -27,10 +27,16 @@
 #include "alloc/HeapSource.h"
 #include "alloc/HeapBitmap.h"
 #include "alloc/HeapBitmapInlines.h"
+#include "alloc/HugePages.h"
+#include "alloc/LargeObjectSpace.h"
+#include "alloc/SlotRuns.h"
+#include "alloc/Visit.h"
 
 static void snapIdealFootprint();
+static size_t getSoftFootprint(bool includeActive);
 static void setIdealFootprint(size_t max);
 static size_t getMaximumSize(const HeapSource *hs);
+static void compactHeap();
 static void trimHeaps();
 
 #define HEAP_UTILIZATION_MAX        1024
@@ -40,6 +46,11 @@ static void trimHeaps();
  */
 #define HEAP_TRIM_IDLE_TIME_MS (5 * 1000)
 
+/* Idle compaction is skipped unless at least this many bytes of the
+ * active heap's footprint are not in use.
+ */
+#define HEAP_COMPACT_MIN_FREE (512 * 1024)
+
 /* Start a concurrent collection when free memory falls under this
  * many bytes.
  */
@@ -50,6 +61,28 @@ static void trimHeaps();
  */
 #define CONCURRENT_MIN_FREE (CONCURRENT_START + (128 << 10))
 
+/* The allocation rate used to predict when the heap fills up is
+ * sampled each time this many bytes have been allocated.
+ */
+#define ALLOC_RATE_SAMPLE_BYTES (64 << 10)
+
+/* Bounds on the percentage by which the pause target scales the free
+ * space that the target utilization asks for.
+ */
+#define HEADROOM_SCALE_MIN 100
+#define HEADROOM_SCALE_MAX 400
+
+/* The size of the large object space, when there is one, as a
+ * fraction of the maximum heap size.
+ */
+#define LARGE_OBJECT_SPACE_FRACTION 2
+
+/* The size of each arena, and the number of bytes in front of each
+ * arena object that hold the size of its chunk.
+ */
+#define HEAP_ARENA_SIZE (1024 * 1024)
+#define HEAP_ARENA_CHUNK_OVERHEAD HB_OBJECT_ALIGNMENT
+
 #define HS_BOILERPLATE() \
     do { \
         assert(gDvm.gcHeap != NULL); \
@@ -96,6 +129,42 @@ struct Heap {
      * allocations requested via dvmHeapSourceMorecore.
      */
     char *brk;
+
+    /*
+     * Runs of slots for small objects, carved out of the mspace, or
+     * NULL if small objects come from the mspace directly.
+     */
+    SlotRuns *runs;
+};
+
+/*
+ * A part of the arena space whose objects are bump allocated for a
+ * single thread.  Each chunk starts with its size.  The objects are
+ * swept like any other, but their storage only goes back to the system
+ * as a whole: when the owner ends the arena and nothing refers into
+ * it, or else when the last of the objects has been swept.
+ */
+struct HeapArena {
+    char *base;
+
+    /* The next free byte, or NULL if the arena is not in use.
+     */
+    char *top;
+
+    /* The thread allocating from the arena, or NULL once the arena
+     * has been handed over to the garbage collector.
+     */
+    Thread *owner;
+
+    /* The objects of the arena that have not been swept, and the
+     * bytes of their chunks.
+     */
+    size_t numObjects;
+    size_t numBytes;
+
+    /* The card table clearing count when the arena was begun.
+     */
+    u4 cardTableClears;
 };
 
 struct HeapSource {
@@ -143,6 +212,29 @@ struct HeapSource {
      */
     size_t maxFree;
 
+    /* Measurements of recent collections for the goal-driven sizing
+     * policy; see dvmHeapSourceRecordGcTimes().  The averages give the
+     * latest collection a weight of one quarter.
+     */
+    size_t bytesSinceGc;
+    u4 lastGcStartMsec;
+    size_t allocBytesPerMsec;
+    u4 gcMsec;
+
+    /* The percentage by which the free space is scaled to keep pauses
+     * under -XX:MaxGCPauseMillis.
+     */
+    u4 headroomScale;
+
+    /* The bytes allocated since the current allocation rate sample
+     * began, a rolling average of the recent samples, and the length
+     * of the last concurrent collection.  See isExhaustionNear().
+     */
+    size_t sampleBytes;
+    u4 sampleStartMsec;
+    size_t recentBytesPerMsec;
+    u4 concurrentGcMsec;
+
     /* The heaps; heaps[0] is always the active heap,
      * which new objects should be allocated from.
      */
@@ -166,6 +258,21 @@ struct HeapSource {
      */
     size_t heapLength;
 
+    /*
+     * The space for large objects without references at the end of
+     * the reservation, or NULL.  Its objects are accounted to the
+     * active heap.
+     */
+    LargeObjectSpace *largeObjects;
+
+    /*
+     * The arenas at the very end of the reservation, or NULL.  Their
+     * objects are accounted to the active heap.
+     */
+    HeapArena *arenas;
+    size_t numArenas;
+    char *arenaBase;
+
     /*
      * The live object bitmap.
      */
@@ -257,6 +364,97 @@ static Heap *ptr2heap(const HeapSource *hs, const void *ptr)
     return NULL;
 }
 
+/*
+ * Returns true iff <ptr> lies within the large object space.
+ */
+static bool isInLargeObjectSpace(const HeapSource *hs, const void *ptr)
+{
+    return hs->largeObjects != NULL &&
+           dvmLargeObjectSpaceContains(hs->largeObjects, ptr);
+}
+
+/*
+ * Returns the number of bytes that the large object space adds to the
+ * footprint of <heap>.
+ */
+static size_t largeObjectFootprint(const HeapSource *hs, const Heap *heap)
+{
+    if (hs->largeObjects == NULL || heap != hs->heaps) {
+        return 0;
+    }
+    return dvmLargeObjectSpaceFootprint(hs->largeObjects);
+}
+
+/*
+ * Returns the arena that <ptr> lies in, whether or not the arena is in
+ * use, or NULL.
+ */
+static HeapArena *ptr2arena(const HeapSource *hs, const void *ptr)
+{
+    if (hs->arenas == NULL || (const char *)ptr < hs->arenaBase) {
+        return NULL;
+    }
+    size_t index = ((const char *)ptr - hs->arenaBase) / HEAP_ARENA_SIZE;
+    if (index >= hs->numArenas) {
+        return NULL;
+    }
+    return &hs->arenas[index];
+}
+
+/*
+ * Returns the number of bytes that the arenas add to the footprint of
+ * <heap>.
+ */
+static size_t arenaFootprint(const HeapSource *hs, const Heap *heap)
+{
+    if (hs->arenas == NULL || heap != hs->heaps) {
+        return 0;
+    }
+    size_t footprint = 0;
+    for (size_t i = 0; i < hs->numArenas; i++) {
+        const HeapArena *arena = &hs->arenas[i];
+        if (arena->top != NULL) {
+            footprint += ALIGN_UP_TO_PAGE_SIZE(arena->top - arena->base);
+        }
+    }
+    return footprint;
+}
+
+/*
+ * Returns the number of bytes an object takes up in its heap.  A slot
+ * of a run has no chunk header, a large object takes up whole pages,
+ * and an arena chunk holds its own size.
+ */
+static size_t chunkFootprint(const Heap *heap, const void *ptr)
+{
+    HeapSource *hs = gDvm.gcHeap->heapSource;
+    if (isInLargeObjectSpace(hs, ptr)) {
+        return dvmLargeObjectSpaceChunkSize(hs->largeObjects, ptr);
+    }
+    if (ptr2arena(hs, ptr) != NULL) {
+        return *(const size_t *)((const char *)ptr - HEAP_ARENA_CHUNK_OVERHEAD);
+    }
+    if (heap->runs != NULL) {
+        size_t slotSize = dvmSlotRunsSlotSize(heap->runs, ptr);
+        if (slotSize != 0) {
+            return slotSize;
+        }
+    }
+    return mspace_usable_size(ptr) + HEAP_SOURCE_CHUNK_OVERHEAD;
+}
+
+/*
+ * Gives the storage of an object back to the active heap.
+ */
+static void freeChunk(Heap *heap, void *ptr)
+{
+    if (heap->runs != NULL && dvmSlotRunsSlotSize(heap->runs, ptr) != 0) {
+        dvmSlotRunsFree(heap->runs, ptr);
+    } else {
+        mspace_free(heap->msp, ptr);
+    }
+}
+
 /*
  * Functions to update heapSource->bytesAllocated when an object
  * is allocated or freed.  mspace_usable_size() will give
@@ -267,20 +465,26 @@ static Heap *ptr2heap(const HeapSource *hs, const void *ptr)
  */
 static void countAllocation(Heap *heap, const void *ptr)
 {
-    assert(heap->bytesAllocated < mspace_footprint(heap->msp));
+    HeapSource* hs = gDvm.gcHeap->heapSource;
+    assert(heap->bytesAllocated <
+           mspace_footprint(heap->msp) + largeObjectFootprint(hs, heap) +
+           arenaFootprint(hs, heap));
 
-    heap->bytesAllocated += mspace_usable_size(ptr) +
-            HEAP_SOURCE_CHUNK_OVERHEAD;
+    size_t bytes = chunkFootprint(heap, ptr);
+    heap->bytesAllocated += bytes;
     heap->objectsAllocated++;
-    HeapSource* hs = gDvm.gcHeap->heapSource;
+    hs->bytesSinceGc += bytes;
+    hs->sampleBytes += bytes;
     dvmHeapBitmapSetObjectBit(&hs->liveBits, ptr);
 
-    assert(heap->bytesAllocated < mspace_footprint(heap->msp));
+    assert(heap->bytesAllocated <
+           mspace_footprint(heap->msp) + largeObjectFootprint(hs, heap) +
+           arenaFootprint(hs, heap));
 }
 
 static void countFree(Heap *heap, const void *ptr, size_t *numBytes)
 {
-    size_t delta = mspace_usable_size(ptr) + HEAP_SOURCE_CHUNK_OVERHEAD;
+    size_t delta = chunkFootprint(heap, ptr);
     assert(delta > 0);
     if (delta < heap->bytesAllocated) {
         heap->bytesAllocated -= delta;
@@ -355,6 +559,26 @@ void* dvmHeapSourceMorecore(void* mspace, intptr_t increment)
 }
 
 const size_t kInitialMorecoreStart = SYSTEM_PAGE_SIZE;
+/*
+ * Sets up the small object runs of a heap, if they are enabled.  The
+ * run table covers the rest of the reservation up to the large object
+ * space, since the limit of the heap may be raised later.
+ */
+static bool createSlotRuns(HeapSource *hs, Heap *heap)
+{
+    if (!gDvm.useSlotRuns) {
+        return true;
+    }
+    char *limit = hs->heapBase + ALIGN_UP_TO_PAGE_SIZE(hs->maximumSize);
+    size_t length = limit - heap->base;
+    heap->runs = dvmSlotRunsCreate(heap->msp, heap->base, length);
+    if (heap->runs == NULL) {
+        LOGE_HEAP("Can't create small object runs");
+        return false;
+    }
+    return true;
+}
+
 /*
  * Add the initial heap.  Returns false if the initial heap was
  * already added to the heap source.
@@ -372,6 +596,9 @@ static bool addInitialHeap(HeapSource *hs, mspace msp, size_t maximumSize)
     hs->heaps[0].base = hs->heapBase;
     hs->heaps[0].limit = hs->heapBase + maximumSize;
     hs->heaps[0].brk = hs->heapBase + kInitialMorecoreStart;
+    if (!createSlotRuns(hs, &hs->heaps[0])) {
+        return false;
+    }
     hs->numHeaps = 1;
     return true;
 }
@@ -418,6 +645,10 @@ static bool addNewHeap(HeapSource *hs)
     if (heap.msp == NULL) {
         return false;
     }
+    if (!createSlotRuns(hs, &heap)) {
+        destroy_mspace(heap.msp);
+        return false;
+    }
 
     /* Don't let the soon-to-be-old heap grow any further.
      */
@@ -466,6 +697,11 @@ static void *gcDaemonThread(void* arg)
         if (!gDvm.gcHeap->gcRunning) {
             dvmChangeStatus(NULL, THREAD_RUNNING);
             if (trim) {
+                /* Garbage left by a lazy sweep pins its pages. */
+                dvmHeapFinishLazySweep();
+                if (gDvm.idleCompaction) {
+                    compactHeap();
+                }
                 trimHeaps();
                 gHs->gcThreadTrimNeeded = false;
             } else {
@@ -515,7 +751,8 @@ static bool allocMarkStack(GcMarkStack *stack, size_t maximumSize)
     assert(stack != NULL);
     stack->length = maximumSize * sizeof(Object*) /
         (sizeof(Object) + HEAP_SOURCE_CHUNK_OVERHEAD);
-    addr = dvmAllocRegion(stack->length, PROT_READ | PROT_WRITE, name);
+    addr = dvmAllocHugeRegion(stack->length, PROT_READ | PROT_WRITE, name,
+                              false);
     if (addr == NULL) {
         return false;
     }
@@ -529,7 +766,7 @@ static bool allocMarkStack(GcMarkStack *stack, size_t maximumSize)
 static void freeMarkStack(GcMarkStack *stack)
 {
     assert(stack != NULL);
-    munmap(stack->base, stack->length);
+    dvmFreeHugeRegion(stack->base, stack->length);
     memset(stack, 0, sizeof(*stack));
 }
 
@@ -545,6 +782,8 @@ GcHeap* dvmHeapSourceStartup(size_t startSize, size_t maximumSize,
     HeapSource *hs;
     mspace msp;
     size_t length;
+    size_t largeObjectsLength = 0;
+    size_t arenasLength = 0;
     void *base;
 
     assert(gHs == NULL);
@@ -557,10 +796,17 @@ GcHeap* dvmHeapSourceStartup(size_t startSize, size_t maximumSize,
 
     /*
      * Allocate a contiguous region of virtual memory to subdivided
-     * among the heaps managed by the garbage collector.
+     * among the heaps managed by the garbage collector, followed by
+     * the large object space and the arenas if there are any.
      */
     length = ALIGN_UP_TO_PAGE_SIZE(maximumSize);
-    base = dvmAllocRegion(length, PROT_NONE, "dalvik-heap");
+    if (gDvm.largeObjectThreshold != 0) {
+        largeObjectsLength =
+            ALIGN_UP_TO_PAGE_SIZE(maximumSize / LARGE_OBJECT_SPACE_FRACTION);
+    }
+    arenasLength = gDvm.arenaSpaceSize / HEAP_ARENA_SIZE * HEAP_ARENA_SIZE;
+    length += largeObjectsLength + arenasLength;
+    base = dvmAllocHugeRegion(length, PROT_NONE, "dalvik-heap", false);
     if (base == NULL) {
         return NULL;
     }
@@ -589,6 +835,8 @@ GcHeap* dvmHeapSourceStartup(size_t startSize, size_t maximumSize,
     hs->targetUtilization = gDvm.heapTargetUtilization * HEAP_UTILIZATION_MAX;
     hs->minFree = gDvm.heapMinFree;
     hs->maxFree = gDvm.heapMaxFree;
+    hs->headroomScale = HEADROOM_SCALE_MIN;
+    hs->sampleStartMsec = dvmGetRelativeTimeMsec();
     hs->startSize = startSize;
     hs->maximumSize = maximumSize;
     hs->growthLimit = growthLimit;
@@ -613,19 +861,47 @@ GcHeap* dvmHeapSourceStartup(size_t startSize, size_t maximumSize,
         LOGE_HEAP("Can't add initial heap");
         goto fail;
     }
+    if (largeObjectsLength != 0) {
+        hs->largeObjects = dvmLargeObjectSpaceCreate(
+            hs->heapBase + length - arenasLength - largeObjectsLength,
+            largeObjectsLength);
+        if (hs->largeObjects == NULL) {
+            LOGE_HEAP("Can't create large object space");
+            goto fail;
+        }
+    }
+    if (arenasLength != 0) {
+        hs->numArenas = arenasLength / HEAP_ARENA_SIZE;
+        hs->arenaBase = hs->heapBase + length - arenasLength;
+        hs->arenas = (HeapArena *)calloc(hs->numArenas, sizeof(HeapArena));
+        if (hs->arenas == NULL) {
+            LOGE_HEAP("Can't create arenas");
+            dvmLargeObjectSpaceDestroy(hs->largeObjects);
+            goto fail;
+        }
+        for (size_t i = 0; i < hs->numArenas; i++) {
+            hs->arenas[i].base = hs->arenaBase + i * HEAP_ARENA_SIZE;
+        }
+    }
     if (!dvmHeapBitmapInit(&hs->liveBits, base, length, "dalvik-bitmap-1")) {
         LOGE_HEAP("Can't create liveBits");
+        free(hs->arenas);
+        dvmLargeObjectSpaceDestroy(hs->largeObjects);
         goto fail;
     }
     if (!dvmHeapBitmapInit(&hs->markBits, base, length, "dalvik-bitmap-2")) {
         LOGE_HEAP("Can't create markBits");
         dvmHeapBitmapDelete(&hs->liveBits);
+        free(hs->arenas);
+        dvmLargeObjectSpaceDestroy(hs->largeObjects);
         goto fail;
     }
     if (!allocMarkStack(&gcHeap->markContext.stack, hs->maximumSize)) {
         ALOGE("Can't create markStack");
         dvmHeapBitmapDelete(&hs->markBits);
         dvmHeapBitmapDelete(&hs->liveBits);
+        free(hs->arenas);
+        dvmLargeObjectSpaceDestroy(hs->largeObjects);
         goto fail;
     }
     gcHeap->markContext.bitmap = &hs->markBits;
@@ -635,12 +911,19 @@ GcHeap* dvmHeapSourceStartup(size_t startSize, size_t maximumSize,
     return gcHeap;
 
 fail:
-    munmap(base, length);
+    dvmFreeHugeRegion(base, length);
     return NULL;
 }
 
 bool dvmHeapSourceStartupAfterZygote()
 {
+    HeapSource *hs = gHs; // use a local to avoid the implicit "volatile"
+
+    /* The last heap is the one the zygote allocated in before its first
+     * fork, and its pages are still shared with every child.
+     */
+    const Heap *shared = &hs->heaps[hs->numHeaps - 1];
+    dvmHugePagesStartupAfterZygote(shared->base, shared->limit);
     return gDvm.concurrentMarkSweep ? gcDaemonStartup() : true;
 }
 
@@ -660,6 +943,19 @@ bool dvmHeapSourceStartupBeforeFork()
     assert(gDvm.zygote);
 
     if (!gDvm.newZygoteHeapAllocated) {
+        /* Allocation buffers are carved from the active heap, which is
+         * about to become the zygote heap.
+         */
+        dvmHeapSourceRetireAllTlabs();
+        dvmHeapFinishLazySweep();
+        /* Pack the live objects down before the heap is frozen, so the
+         * holes left between them don't keep whole pages in every child.
+         */
+        if (gDvm.zygoteCompaction) {
+            dvmLockHeap();
+            compactHeap();
+            dvmUnlockHeap();
+        }
        /* Ensure heaps are trimmed to minimize footprint pre-fork.
         */
         trimHeaps();
@@ -690,10 +986,15 @@ void dvmHeapSourceShutdown(GcHeap **gcHeap)
     assert(gcHeap != NULL);
     if (*gcHeap != NULL && (*gcHeap)->heapSource != NULL) {
         HeapSource *hs = (*gcHeap)->heapSource;
+        for (size_t i = 0; i < hs->numHeaps; i++) {
+            dvmSlotRunsDestroy(hs->heaps[i].runs);
+        }
+        dvmLargeObjectSpaceDestroy(hs->largeObjects);
+        free(hs->arenas);
         dvmHeapBitmapDelete(&hs->liveBits);
         dvmHeapBitmapDelete(&hs->markBits);
         freeMarkStack(&(*gcHeap)->markContext.stack);
-        munmap(hs->heapBase, hs->heapLength);
+        dvmFreeHugeRegion(hs->heapBase, hs->heapLength);
         free(hs);
         gHs = NULL;
         free(*gcHeap);
@@ -709,6 +1010,14 @@ void *dvmHeapSourceGetBase()
     return gHs->heapBase;
 }
 
+/*
+ * Gets the length of the allocation for the HeapSource.
+ */
+size_t dvmHeapSourceGetReservedLength()
+{
+    return gHs->heapLength;
+}
+
 /*
  * Returns a high water mark, between base and limit all objects must have been
  * allocated.
@@ -751,6 +1060,7 @@ size_t dvmHeapSourceGetValue(HeapSourceValueSpec spec, size_t perHeapStats[],
         case HS_FOOTPRINT:
             value = heap->brk - heap->base;
             assert(value == mspace_footprint(heap->msp));
+            value += largeObjectFootprint(hs, heap) + arenaFootprint(hs, heap);
             break;
         case HS_ALLOWED_FOOTPRINT:
             value = mspace_footprint_limit(heap->msp);
@@ -786,6 +1096,35 @@ void dvmHeapSourceGetRegions(uintptr_t *base, uintptr_t *max, size_t numHeaps)
     }
 }
 
+bool dvmHeapSourceGetLargeObjectRegion(uintptr_t *base, uintptr_t *max)
+{
+    HeapSource *hs = gHs;
+
+    HS_BOILERPLATE();
+
+    if (hs->largeObjects == NULL) {
+        return false;
+    }
+    uintptr_t limit;
+    dvmLargeObjectSpaceGetBounds(hs->largeObjects, base, &limit);
+    *max = MIN(limit - 1, hs->markBits.max);
+    return true;
+}
+
+bool dvmHeapSourceGetArenaRegion(uintptr_t *base, uintptr_t *max)
+{
+    HeapSource *hs = gHs;
+
+    HS_BOILERPLATE();
+
+    if (hs->arenas == NULL) {
+        return false;
+    }
+    *base = (uintptr_t)hs->arenaBase;
+    *max = (uintptr_t)hs->arenaBase + hs->numArenas * HEAP_ARENA_SIZE - 1;
+    return true;
+}
+
 /*
  * Get the bitmap representing all live objects.
  */
@@ -858,9 +1197,95 @@ void dvmMarkImmuneObjects(const char *immuneLimit)
 }
 
 /*
- * Allocates <n> bytes of zeroed data.
+ * Returns true if, at the recent allocation rate, the active heap will
+ * reach its allocation limit before a concurrent collection as long as
+ * the last one, plus half again as a margin, could finish.  Bursts of
+ * allocation thus start the collection before the static threshold
+ * is crossed.  Takes a new rate sample when one is due.
  */
-void* dvmHeapSourceAlloc(size_t n)
+static bool isExhaustionNear(HeapSource *hs, const Heap *heap)
+{
+    if (hs->sampleBytes >= ALLOC_RATE_SAMPLE_BYTES) {
+        u4 now = dvmGetRelativeTimeMsec();
+        u4 elapsed = MAX(now - hs->sampleStartMsec, 1);
+        size_t rate = hs->sampleBytes / elapsed;
+        hs->recentBytesPerMsec = (hs->recentBytesPerMsec + rate) / 2;
+        hs->sampleBytes = 0;
+        hs->sampleStartMsec = now;
+    }
+    if (heap->concurrentStartBytes == SIZE_MAX ||
+        hs->concurrentGcMsec == 0 || hs->recentBytesPerMsec == 0) {
+        return false;
+    }
+    size_t limit = getAllocLimit(hs);
+    if (heap->bytesAllocated >= limit) {
+        return true;
+    }
+    size_t msecToExhaustion =
+        (limit - heap->bytesAllocated) / hs->recentBytesPerMsec;
+    return msecToExhaustion < (size_t)hs->concurrentGcMsec * 3 / 2;
+}
+
+/*
+ * Wakes up the GC daemon if the active heap has crossed its
+ * concurrent collection threshold or is predicted to fill up before
+ * a concurrent collection started later could finish.
+ */
+static void checkConcurrentStart(HeapSource *hs, Heap *heap)
+{
+    if (gDvm.gcHeap->gcRunning || !hs->hasGcThread) {
+        /*
+         * The garbage collector thread is already running or has yet
+         * to be started.  Do nothing.
+         */
+        return;
+    }
+    if (dvmHeapIsLazySweepPending()) {
+        /*
+         * bytesAllocated still counts the garbage that the allocator
+         * is reclaiming on demand, and the threshold is recomputed
+         * once the sweep is done.
+         */
+        return;
+    }
+    if (heap->bytesAllocated > heap->concurrentStartBytes ||
+        isExhaustionNear(hs, heap)) {
+        /*
+         * We have exceeded the allocation threshold, or soon will.
+         * Wake up the garbage collector.
+         */
+        dvmSignalCond(&gHs->gcThreadCond);
+    }
+}
+
+/*
+ * Clears the <n> bytes at <ptr>, just carved out of the active heap's
+ * mspace, that may hold stale data.  If the allocation had the mspace
+ * grow its footprint from <oldBrk> to <newBrk>, the chunk was split off
+ * the top and whatever lies at or past <oldBrk> is fresh from
+ * dvmHeapSourceMorecore(): pages that were never touched or were given
+ * back with madvise(), and read as zeroes either way.  dlmalloc writes
+ * its own bookkeeping there only outside the chunk.  Without <zero>
+ * only the object header is cleared.
+ */
+static void clearChunk(void *ptr, size_t n, const char *oldBrk,
+                       const char *newBrk, bool zero)
+{
+    size_t length = n;
+    if (!zero) {
+        length = MIN(n, OFFSETOF_MEMBER(ArrayObject, contents));
+    } else if (newBrk > oldBrk && (const char *)ptr < oldBrk) {
+        length = MIN(n, (size_t)(oldBrk - (const char *)ptr));
+    } else if (newBrk > oldBrk) {
+        length = 0;
+    }
+    memset(ptr, 0, length);
+}
+
+/*
+ * Allocates <n> bytes of data, zeroed unless <zero> is false.
+ */
+void* dvmHeapSourceAlloc(size_t n, bool zero)
 {
     HS_BOILERPLATE();
 
@@ -875,35 +1300,162 @@ void* dvmHeapSourceAlloc(size_t n)
                   FRACTIONAL_MB(hs->softLimit), n);
         return NULL;
     }
-    void* ptr = mspace_calloc(heap->msp, 1, n);
+    void* ptr = NULL;
+    if (heap->runs != NULL) {
+        ptr = dvmSlotRunsAlloc(heap->runs, n);
+    }
     if (ptr == NULL) {
-        return NULL;
+        const char *oldBrk = heap->brk;
+        ptr = mspace_malloc(heap->msp, n);
+        if (ptr == NULL) {
+            return NULL;
+        }
+        clearChunk(ptr, n, oldBrk, heap->brk, zero);
     }
     countAllocation(heap, ptr);
-    /*
-     * Check to see if a concurrent GC should be initiated.
+    checkConcurrentStart(hs, heap);
+    return ptr;
+}
+
+/*
+ * Gives the unused slots of an allocation buffer back to the heap it
+ * was carved from and leaves the buffer empty.
+ */
+static void retireTlab(HeapSource *hs, Tlab *tlab)
+{
+    if (tlab->top != NULL && tlab->top < tlab->end) {
+        Heap *heap = ptr2heap(hs, tlab->top);
+        assert(heap != NULL);
+        size_t numBytes = 0;
+        for (char *ptr = tlab->top; ptr < tlab->end; ptr += tlab->stride) {
+            countFree(heap, ptr, &numBytes);
+            // As in dvmHeapSourceFreeList, only give memory back to
+            // the active heap's mspace.
+            if (heap == hs->heaps) {
+                freeChunk(heap, ptr);
+            }
+        }
+    }
+    memset(tlab, 0, sizeof(*tlab));
+}
+
+/*
+ * Fills an allocation buffer with adjacent free slots of a small object
+ * run, and returns the first of them.
+ */
+static void* refillTlabFromRuns(HeapSource *hs, Heap *heap, Tlab *tlab,
+                                size_t slotSize)
+{
+    size_t maxSlots = TLAB_BUFFER_BYTES / slotSize;
+    if (maxSlots > TLAB_MAX_SLOTS) {
+        maxSlots = TLAB_MAX_SLOTS;
+    }
+    if (heap->bytesAllocated + maxSlots * slotSize > hs->softLimit) {
+        return NULL;
+    }
+    void *first;
+    size_t numSlots = dvmSlotRunsAllocAdjacent(heap->runs, slotSize,
+                                               maxSlots, &first);
+    if (numSlots == 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < numSlots; i++) {
+        countAllocation(heap, (char *)first + i * slotSize);
+    }
+    if (numSlots > 1) {
+        tlab->stride = slotSize;
+        tlab->top = (char *)first + slotSize;
+        tlab->end = (char *)first + numSlots * slotSize;
+    }
+    checkConcurrentStart(hs, heap);
+    return first;
+}
+
+/*
+ * Carves a fresh allocation buffer for objects of <n> bytes out of
+ * the active heap and returns its first slot.
+ *
+ * The slots come from a single mspace_independent_calloc() call, or
+ * from a single small object run, so they are adjacent, zeroed, equally
+ * spaced and individually freeable.
+ * They are all counted as allocated and marked live up front, which is
+ * what lets the owning thread hand them out without the heap lock.
+ */
+void* dvmHeapSourceRefillTlab(Thread *self, size_t n)
+{
+    HS_BOILERPLATE();
+
+    if (n == 0 || n > TLAB_MAX_OBJECT_SIZE) {
+        return NULL;
+    }
+    HeapSource *hs = gHs;
+    Heap* heap = hs2heap(hs);
+    size_t sizeClass = dvmTlabSizeClass(n);
+    Tlab *tlab = &self->tlabs[sizeClass];
+    retireTlab(hs, tlab);
+
+    /* Every slot must be able to hold the largest size in its class.
      */
-    if (gDvm.gcHeap->gcRunning || !hs->hasGcThread) {
-        /*
-         * The garbage collector thread is already running or has yet
-         * to be started.  Do nothing.
-         */
-        return ptr;
+    size_t slotSize = (sizeClass + 1) << TLAB_SIZE_CLASS_SHIFT;
+    if (heap->runs != NULL && slotSize <= SLOT_RUN_MAX_OBJECT_SIZE) {
+        return refillTlabFromRuns(hs, heap, tlab, slotSize);
     }
-    if (heap->bytesAllocated > heap->concurrentStartBytes) {
+    size_t numSlots =
+            TLAB_BUFFER_BYTES / (slotSize + HEAP_SOURCE_CHUNK_OVERHEAD);
+    if (numSlots > TLAB_MAX_SLOTS) {
+        numSlots = TLAB_MAX_SLOTS;
+    }
+    if (heap->bytesAllocated +
+            numSlots * (slotSize + HEAP_SOURCE_CHUNK_OVERHEAD) > hs->softLimit) {
         /*
-         * We have exceeded the allocation threshold.  Wake up the
-         * garbage collector.
+         * Let the caller fall back to a single allocation so that the
+         * soft limit is enforced exactly.
          */
-        dvmSignalCond(&gHs->gcThreadCond);
+        return NULL;
     }
-    return ptr;
+    void *slots[TLAB_MAX_SLOTS];
+    if (mspace_independent_calloc(heap->msp, numSlots, slotSize,
+                                  slots) == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < numSlots; i++) {
+        countAllocation(heap, slots[i]);
+    }
+    if (numSlots > 1) {
+        tlab->stride = (char *)slots[1] - (char *)slots[0];
+        tlab->top = (char *)slots[1];
+        tlab->end = (char *)slots[0] + numSlots * tlab->stride;
+    }
+    checkConcurrentStart(hs, heap);
+    return slots[0];
+}
+
+void dvmHeapSourceRetireTlabs(Thread *self)
+{
+    HS_BOILERPLATE();
+
+    for (size_t i = 0; i < TLAB_NUM_SIZE_CLASSES; i++) {
+        retireTlab(gHs, &self->tlabs[i]);
+    }
+}
+
+void dvmHeapSourceRetireAllTlabs()
+{
+    HS_BOILERPLATE();
+
+    dvmLockThreadList(dvmThreadSelf());
+    for (Thread *thread = gDvm.threadList; thread != NULL;
+         thread = thread->next) {
+        dvmHeapSourceRetireTlabs(thread);
+    }
+    dvmUnlockThreadList();
 }
 
 /* Remove any hard limits, try to allocate, and shrink back down.
  * Last resort when trying to allocate an object.
  */
-static void* heapAllocAndGrow(HeapSource *hs, Heap *heap, size_t n)
+static void* heapAllocAndGrow(HeapSource *hs, Heap *heap, size_t n,
+                              bool zero)
 {
     /* Grow as much as possible, but don't let the real footprint
      * go over the absolute max.
@@ -911,7 +1463,7 @@ static void* heapAllocAndGrow(HeapSource *hs, Heap *heap, size_t n)
     size_t max = heap->maximumSize;
 
     mspace_set_footprint_limit(heap->msp, max);
-    void* ptr = dvmHeapSourceAlloc(n);
+    void* ptr = dvmHeapSourceAlloc(n, zero);
 
     /* Shrink back down as small as possible.  Our caller may
      * readjust max_allowed to a more appropriate value.
@@ -922,16 +1474,16 @@ static void* heapAllocAndGrow(HeapSource *hs, Heap *heap, size_t n)
 }
 
 /*
- * Allocates <n> bytes of zeroed data, growing as much as possible
- * if necessary.
+ * Allocates <n> bytes of data, zeroed unless <zero> is false, growing
+ * as much as possible if necessary.
  */
-void* dvmHeapSourceAllocAndGrow(size_t n)
+void* dvmHeapSourceAllocAndGrow(size_t n, bool zero)
 {
     HS_BOILERPLATE();
 
     HeapSource *hs = gHs;
     Heap* heap = hs2heap(hs);
-    void* ptr = dvmHeapSourceAlloc(n);
+    void* ptr = dvmHeapSourceAlloc(n, zero);
     if (ptr != NULL) {
         return ptr;
     }
@@ -942,7 +1494,7 @@ void* dvmHeapSourceAllocAndGrow(size_t n)
          * see if we can allocate without actually growing.
          */
         hs->softLimit = SIZE_MAX;
-        ptr = dvmHeapSourceAlloc(n);
+        ptr = dvmHeapSourceAlloc(n, zero);
         if (ptr != NULL) {
             /* Removing the soft limit worked;  fix things up to
              * reflect the new effective ideal size.
@@ -956,7 +1508,7 @@ void* dvmHeapSourceAllocAndGrow(size_t n)
     /* We're not soft-limited.  Grow the heap to satisfy the request.
      * If this call fails, no footprints will have changed.
      */
-    ptr = heapAllocAndGrow(hs, heap, n);
+    ptr = heapAllocAndGrow(hs, heap, n, zero);
     if (ptr != NULL) {
         /* The allocation succeeded.  Fix up the ideal size to
          * reflect any footprint modifications that had to happen.
@@ -971,12 +1523,203 @@ void* dvmHeapSourceAllocAndGrow(size_t n)
     return ptr;
 }
 
+/*
+ * Allocates <n> bytes of zeroed data for an object without references
+ * from the large object space.  The objects count against the budget
+ * of the active heap: without <grow> the allocation fails if it would
+ * take the heap past its ideal size, with it only if it would take the
+ * heap past its maximum size.  Falls back to the active heap if there
+ * is no large object space or it has no room.
+ */
+void* dvmHeapSourceAllocLarge(size_t n, bool grow)
+{
+    HS_BOILERPLATE();
+
+    HeapSource *hs = gHs;
+    Heap* heap = hs2heap(hs);
+    if (hs->largeObjects == NULL || gDvm.zygote) {
+        /* Keep the zygote's objects where they can be shared. */
+        return grow ? dvmHeapSourceAllocAndGrow(n, true)
+                    : dvmHeapSourceAlloc(n, true);
+    }
+    if (grow) {
+        if (heap->bytesAllocated + n > heap->maximumSize) {
+            return NULL;
+        }
+    } else if (getSoftFootprint(true) + n > hs->idealSize) {
+        LOGV_HEAP("idealSize of %zd.%03zdMB hit for %zd-byte allocation",
+                  FRACTIONAL_MB(hs->idealSize), n);
+        return NULL;
+    }
+    void* ptr = dvmLargeObjectSpaceAlloc(hs->largeObjects, n);
+    if (ptr == NULL) {
+        return grow ? dvmHeapSourceAllocAndGrow(n, true)
+                    : dvmHeapSourceAlloc(n, true);
+    }
+    countAllocation(heap, ptr);
+    if (grow && getSoftFootprint(true) > hs->idealSize) {
+        snapIdealFootprint();
+    }
+    checkConcurrentStart(hs, heap);
+    return ptr;
+}
+
+/*
+ * Gives the used pages of an arena back to the system and makes the
+ * arena available again.  Its objects have already been uncounted and
+ * their bits cleared.
+ */
+static void freeArena(HeapArena *arena)
+{
+    assert(arena->top != NULL);
+    assert(arena->numObjects == 0);
+    size_t length = ALIGN_UP_TO_PAGE_SIZE(arena->top - arena->base);
+    if (length != 0) {
+        u1 *first = dvmCardFromAddr(arena->base);
+        u1 *last = dvmCardFromAddr(arena->base + length - 1);
+        memset(first, GC_CARD_CLEAN, last - first + 1);
+        madvise(arena->base, length, MADV_DONTNEED);
+    }
+    mprotect(arena->base, HEAP_ARENA_SIZE, PROT_NONE);
+    arena->top = NULL;
+    arena->owner = NULL;
+    arena->numBytes = 0;
+}
+
+bool dvmHeapSourceOpenArena(Thread *self)
+{
+    HS_BOILERPLATE();
+
+    HeapSource *hs = gHs;
+    if (hs->arenas == NULL || gDvm.zygote || self->heapArena != NULL) {
+        return false;
+    }
+    HeapArena *arena = NULL;
+    for (size_t i = 0; i < hs->numArenas; i++) {
+        if (hs->arenas[i].top == NULL) {
+            arena = &hs->arenas[i];
+            break;
+        }
+    }
+    if (arena == NULL) {
+        return false;
+    }
+    if (mprotect(arena->base, HEAP_ARENA_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        ALOGW("Unable to map arena: %s", strerror(errno));
+        return false;
+    }
+    arena->top = arena->base;
+    arena->owner = self;
+    arena->numObjects = 0;
+    arena->numBytes = 0;
+    arena->cardTableClears = gDvm.gcHeap->cardTableClears;
+    self->heapArena = arena;
+    return true;
+}
+
+/*
+ * Allocates <n> bytes of zeroed data from self's arena.  Returns NULL
+ * if the arena is full or the allocation would take the heap past its
+ * ideal size.
+ */
+void *dvmHeapSourceArenaAlloc(Thread *self, size_t n)
+{
+    HS_BOILERPLATE();
+
+    HeapSource *hs = gHs;
+    HeapArena *arena = self->heapArena;
+    assert(arena != NULL && arena->owner == self);
+    size_t chunk = ALIGN_UP(n + HEAP_ARENA_CHUNK_OVERHEAD, HB_OBJECT_ALIGNMENT);
+    if (chunk < n ||
+        chunk > (size_t)(arena->base + HEAP_ARENA_SIZE - arena->top)) {
+        return NULL;
+    }
+    if (getSoftFootprint(true) + chunk > hs->idealSize) {
+        LOGV_HEAP("idealSize of %zd.%03zdMB hit for %zd-byte allocation",
+                  FRACTIONAL_MB(hs->idealSize), n);
+        return NULL;
+    }
+    /* Pages that were discarded or never touched read as zeroes. */
+    *(size_t *)arena->top = chunk;
+    void *ptr = arena->top + HEAP_ARENA_CHUNK_OVERHEAD;
+    arena->top += chunk;
+    arena->numObjects++;
+    arena->numBytes += chunk;
+    Heap *heap = hs2heap(hs);
+    countAllocation(heap, ptr);
+    checkConcurrentStart(hs, heap);
+    return ptr;
+}
+
+bool dvmHeapSourceGetArenaBounds(const Thread *self, uintptr_t *base,
+                                 uintptr_t *limit)
+{
+    HS_BOILERPLATE();
+
+    const HeapArena *arena = self->heapArena;
+    if (arena == NULL) {
+        return false;
+    }
+    *base = (uintptr_t)arena->base;
+    *limit = (uintptr_t)arena->base + HEAP_ARENA_SIZE;
+    return true;
+}
+
+bool dvmHeapSourceCanReleaseArena(const Thread *self)
+{
+    HS_BOILERPLATE();
+
+    const HeapArena *arena = self->heapArena;
+    return arena != NULL &&
+           arena->cardTableClears == gDvm.gcHeap->cardTableClears;
+}
+
+void dvmHeapSourceCloseArena(Thread *self, bool release)
+{
+    HS_BOILERPLATE();
+
+    HeapSource *hs = gHs;
+    HeapArena *arena = self->heapArena;
+    if (arena == NULL) {
+        return;
+    }
+    self->heapArena = NULL;
+    arena->owner = NULL;
+    if (release) {
+        Heap *heap = hs2heap(hs);
+        heap->bytesAllocated -= MIN(arena->numBytes, heap->bytesAllocated);
+        heap->objectsAllocated -= MIN(arena->numObjects,
+                                      heap->objectsAllocated);
+        size_t length = ALIGN_UP_TO_PAGE_SIZE(arena->top - arena->base);
+        dvmHeapBitmapClearRange(&hs->liveBits, (uintptr_t)arena->base, length);
+        dvmHeapBitmapClearRange(&hs->markBits, (uintptr_t)arena->base, length);
+        arena->numObjects = 0;
+    }
+    if (arena->numObjects == 0) {
+        freeArena(arena);
+    }
+}
+
 /*
  * Frees the first numPtrs objects in the ptrs list and returns the
  * amount of reclaimed storage. The list must contain addresses all in
  * the same mspace, and must be in increasing order. This implies that
  * there are no duplicates, and no entries are NULL.
  */
+/*
+ * The sweep runs after the bitmaps are swapped, so the mark bits are
+ * the previous live bits.  Clearing the bits of the swept objects
+ * leaves exactly the survivors, which generational collection keeps as
+ * the old generation.  Stripes of a parallel sweep never share a
+ * bitmap word, so this does not race with the other sweeping threads.
+ */
+static void clearSweptMarkBits(size_t numPtrs, void **ptrs)
+{
+    for (size_t i = 0; i < numPtrs; i++) {
+        dvmHeapBitmapClearObjectBit(&gHs->markBits, ptrs[i]);
+    }
+}
+
 size_t dvmHeapSourceFreeList(size_t numPtrs, void **ptrs)
 {
     HS_BOILERPLATE();
@@ -987,8 +1730,42 @@ size_t dvmHeapSourceFreeList(size_t numPtrs, void **ptrs)
 
     assert(ptrs != NULL);
     assert(*ptrs != NULL);
-    Heap* heap = ptr2heap(gHs, *ptrs);
     size_t numBytes = 0;
+    if (isInLargeObjectSpace(gHs, *ptrs)) {
+        // Large objects are accounted to the active heap, but their
+        // pages go straight back to the system.
+        Heap* heap = gHs->heaps;
+        for (size_t i = 0; i < numPtrs; i++) {
+            assert(isInLargeObjectSpace(gHs, ptrs[i]));
+            countFree(heap, ptrs[i], &numBytes);
+            dvmLargeObjectSpaceFree(gHs->largeObjects, ptrs[i]);
+        }
+        if (gDvm.generationalGc) {
+            clearSweptMarkBits(numPtrs, ptrs);
+        }
+        return numBytes;
+    }
+    if (ptr2arena(gHs, *ptrs) != NULL) {
+        // Arena objects are accounted to the active heap too, and an
+        // arena goes back to the system once its owner is done with
+        // it and the last of its objects is swept.
+        Heap* heap = gHs->heaps;
+        for (size_t i = 0; i < numPtrs; i++) {
+            HeapArena *arena = ptr2arena(gHs, ptrs[i]);
+            assert(arena != NULL && arena->numObjects > 0);
+            size_t bytes = numBytes;
+            countFree(heap, ptrs[i], &numBytes);
+            arena->numBytes -= MIN(numBytes - bytes, arena->numBytes);
+            if (--arena->numObjects == 0 && arena->owner == NULL) {
+                freeArena(arena);
+            }
+        }
+        if (gDvm.generationalGc) {
+            clearSweptMarkBits(numPtrs, ptrs);
+        }
+        return numBytes;
+    }
+    Heap* heap = ptr2heap(gHs, *ptrs);
     if (heap != NULL) {
         mspace msp = heap->msp;
         // Calling mspace_free on shared heaps disrupts sharing too
@@ -1002,8 +1779,24 @@ size_t dvmHeapSourceFreeList(size_t numPtrs, void **ptrs)
                 assert(ptr2heap(gHs, ptrs[i]) == heap);
                 countFree(heap, ptrs[i], &numBytes);
             }
+            if (gDvm.generationalGc) {
+                clearSweptMarkBits(numPtrs, ptrs);
+            }
+            // Slots go back to their runs, which needs no dlmalloc
+            // call; the rest are bulk freed.
+            size_t numChunks = numPtrs;
+            if (heap->runs != NULL) {
+                numChunks = 0;
+                for (size_t i = 0; i < numPtrs; i++) {
+                    if (dvmSlotRunsSlotSize(heap->runs, ptrs[i]) != 0) {
+                        dvmSlotRunsFree(heap->runs, ptrs[i]);
+                    } else {
+                        ptrs[numChunks++] = ptrs[i];
+                    }
+                }
+            }
             // Bulk free ptrs.
-            mspace_bulk_free(msp, ptrs, numPtrs);
+            mspace_bulk_free(msp, ptrs, numChunks);
         } else {
             // This is not an 'active heap'. Only do the accounting.
             for (size_t i = 0; i < numPtrs; i++) {
@@ -1011,6 +1804,9 @@ size_t dvmHeapSourceFreeList(size_t numPtrs, void **ptrs)
                 assert(ptr2heap(gHs, ptrs[i]) == heap);
                 countFree(heap, ptrs[i], &numBytes);
             }
+            if (gDvm.generationalGc) {
+                clearSweptMarkBits(numPtrs, ptrs);
+            }
         }
     }
     return numBytes;
@@ -1023,9 +1819,25 @@ bool dvmHeapSourceContainsAddress(const void *ptr)
 {
     HS_BOILERPLATE();
 
+    if (isInLargeObjectSpace(gHs, ptr) || ptr2arena(gHs, ptr) != NULL) {
+        return true;
+    }
     return (dvmHeapSourceGetBase() <= ptr) && (ptr <= dvmHeapSourceGetLimit());
 }
 
+/*
+ * Returns true iff <ptr> is in a heap that was split off by the zygote.
+ * Those heaps sit below the active heap and their objects never move.
+ */
+bool dvmHeapSourceIsInZygoteHeap(const void *ptr)
+{
+    HS_BOILERPLATE();
+
+    HeapSource *hs = gHs;
+    return hs->heapBase <= (const char *)ptr &&
+           (const char *)ptr < hs2heap(hs)->base;
+}
+
 /*
  * Returns true iff <ptr> was allocated from the heap source.
  */
@@ -1068,8 +1880,20 @@ size_t dvmHeapSourceChunkSize(const void *ptr)
 {
     HS_BOILERPLATE();
 
+    if (isInLargeObjectSpace(gHs, ptr)) {
+        return dvmLargeObjectSpaceChunkSize(gHs->largeObjects, ptr);
+    }
+    if (ptr2arena(gHs, ptr) != NULL) {
+        return chunkFootprint(gHs->heaps, ptr) - HEAP_ARENA_CHUNK_OVERHEAD;
+    }
     Heap* heap = ptr2heap(gHs, ptr);
     if (heap != NULL) {
+        if (heap->runs != NULL) {
+            size_t slotSize = dvmSlotRunsSlotSize(heap->runs, ptr);
+            if (slotSize != 0) {
+                return slotSize;
+            }
+        }
         return mspace_usable_size(ptr);
     }
     return 0;
@@ -1086,7 +1910,8 @@ size_t dvmHeapSourceFootprint()
     HS_BOILERPLATE();
 
 //TODO: include size of bitmaps?
-    return oldHeapOverhead(gHs, true);
+    return oldHeapOverhead(gHs, true) + largeObjectFootprint(gHs, gHs->heaps) +
+           arenaFootprint(gHs, gHs->heaps);
 }
 
 static size_t getMaximumSize(const HeapSource *hs)
@@ -1282,9 +2107,95 @@ static size_t getUtilizationTarget(const HeapSource* hs, size_t liveSize)
     return targetSize;
 }
 
+/*
+ * Returns the ideal size of the active heap for the given live set
+ * under the goal given on the command line, if any.  A GC time goal
+ * sizes the free space from the measured allocation rate and
+ * collection length; a pause goal scales the utilization target.
+ */
+static size_t getGoalTarget(const HeapSource* hs, size_t liveSize)
+{
+    size_t targetSize = getUtilizationTarget(hs, liveSize);
+    if (gDvm.gcTimePercent != 0) {
+        if (hs->allocBytesPerMsec == 0 || hs->gcMsec == 0) {
+            return targetSize;
+        }
+        /* Collections that take gcMsec spend the goal's share of the
+         * time collecting if the free space lasts for
+         * gcMsec * (100 - percent) / percent of allocation.
+         */
+        u4 percent = gDvm.gcTimePercent;
+        u8 freeBytes = (u8)hs->allocBytesPerMsec * hs->gcMsec *
+                       (100 - percent) / percent;
+        freeBytes = MAX(freeBytes, hs->minFree);
+        targetSize = liveSize + MIN(freeBytes, hs->maximumSize);
+    } else if (gDvm.gcPauseTargetMs != 0) {
+        u8 freeBytes = (u8)(targetSize - liveSize) * hs->headroomScale / 100;
+        targetSize = liveSize + MIN(freeBytes, hs->maximumSize);
+    }
+    return targetSize;
+}
+
+/*
+ * Returns how many bytes before the allocation limit a concurrent
+ * collection should start.  With a goal, that is enough for what the
+ * mutators allocate during an average collection, twice over, so that
+ * they are not stopped by a collection for allocation.
+ */
+static size_t getConcurrentHeadroom(const HeapSource* hs, size_t freeBytes)
+{
+    if (gDvm.gcPauseTargetMs == 0 && gDvm.gcTimePercent == 0) {
+        return CONCURRENT_START;
+    }
+    u8 headroom = (u8)hs->allocBytesPerMsec * hs->gcMsec * 2;
+    headroom = MIN(headroom, freeBytes / 2);
+    return MAX(headroom, CONCURRENT_START);
+}
+
+void dvmHeapSourceRecordGcTimes(u4 startMsec, u4 totalMsec, u4 maxPauseMsec,
+                                bool isConcurrent)
+{
+    HS_BOILERPLATE();
+
+    HeapSource *hs = gHs;
+    if (hs->lastGcStartMsec != 0 && startMsec > hs->lastGcStartMsec) {
+        size_t rate = hs->bytesSinceGc / (startMsec - hs->lastGcStartMsec);
+        if (hs->allocBytesPerMsec == 0) {
+            hs->allocBytesPerMsec = rate;
+        } else {
+            hs->allocBytesPerMsec = (3 * hs->allocBytesPerMsec + rate) / 4;
+        }
+    }
+    hs->lastGcStartMsec = startMsec;
+    hs->bytesSinceGc = 0;
+    if (hs->gcMsec == 0) {
+        hs->gcMsec = totalMsec;
+    } else {
+        hs->gcMsec = (3 * hs->gcMsec + totalMsec) / 4;
+    }
+    if (isConcurrent) {
+        hs->concurrentGcMsec = MAX(totalMsec, 1);
+    }
+    u4 target = gDvm.gcPauseTargetMs;
+    if (target == 0) {
+        return;
+    }
+    if (maxPauseMsec > target && !isConcurrent) {
+        /* The mutators ran out of room before a concurrent collection
+         * could finish, so leave them more.
+         */
+        hs->headroomScale = MIN(hs->headroomScale * 5 / 4,
+                                HEADROOM_SCALE_MAX);
+    } else if (maxPauseMsec < target / 2) {
+        hs->headroomScale = MAX(hs->headroomScale * 9 / 10,
+                                HEADROOM_SCALE_MIN);
+    }
+}
+
 /*
  * Given the current contents of the active heap, increase the allowed
- * heap footprint to match the target utilization ratio.  This
+ * heap footprint to match the target utilization ratio, or the goal
+ * from -XX:MaxGCPauseMillis or -XX:GCTimePercent.  This
  * should only be called immediately after a full mark/sweep.
  */
 void dvmHeapSourceGrowForUtilization()
@@ -1302,9 +2213,17 @@ void dvmHeapSourceGrowForUtilization()
      * because they may be full of objects that aren't actually
      * in the working set.  Just look at the allocated size of
      * the current heap.
+     *
+     * Objects waiting for their finalizer will be gone after the next
+     * GC or so, so they are not part of the live set that the headroom
+     * is scaled by; they only get the room they occupy now.
      */
     size_t currentHeapUsed = heap->bytesAllocated;
-    size_t targetHeapSize = getUtilizationTarget(hs, currentHeapUsed);
+    size_t pendingFinalizerBytes =
+        MIN(gDvm.gcHeap->pendingFinalizerBytes, currentHeapUsed);
+    size_t targetHeapSize =
+        getGoalTarget(hs, currentHeapUsed - pendingFinalizerBytes) +
+        pendingFinalizerBytes;
 
     /* The ideal size includes the old heaps; add overhead so that
      * it can be immediately subtracted again in setIdealFootprint().
@@ -1319,10 +2238,279 @@ void dvmHeapSourceGrowForUtilization()
         /* Not enough free memory to allow a concurrent GC. */
         heap->concurrentStartBytes = SIZE_MAX;
     } else {
-        heap->concurrentStartBytes = freeBytes - CONCURRENT_START;
+        size_t unused = freeBytes - MIN(currentHeapUsed, freeBytes);
+        heap->concurrentStartBytes =
+            freeBytes - getConcurrentHeadroom(hs, unused);
+    }
+}
+
+/*
+ * Idle compaction.  Objects near the top of the active heap, the only
+ * heap that is not shared with the zygote, are evacuated into free
+ * chunks at lower addresses so that trimHeaps() finds a larger
+ * wilderness chunk to give back.  Objects are moved while every other
+ * thread is suspended.
+ *
+ * Objects that VM or native code may hold a raw pointer to are pinned
+ * rather than moved: everything referenced from the root set or from
+ * the weak interned string and weak global tables, the arguments of
+ * native methods, class objects, and objects with a non-zero lock
+ * word, which covers locked, inflated and hashed objects.  This means
+ * no root ever has to be updated; only the references held by other
+ * objects, including those in the zygote heap, are.
+ */
+struct CompactContext {
+    /* objects that must not move */
+    HeapBitmap pinBits;
+
+    /* the old copies of the objects being moved */
+    Object **moved;
+    size_t numMoved;
+    size_t maxMoved;
+
+    /* objects at or above this address are moved, if possible */
+    const char *threshold;
+    const char *limit;
+};
+
+/*
+ * An evacuated object keeps a tagged pointer to its new copy in its
+ * class pointer until the references to it have been updated.
+ */
+static bool isForwarded(const Object *obj)
+{
+    return ((uintptr_t)obj->clazz & 0x1) != 0;
+}
+
+static Object *getForward(const Object *obj)
+{
+    return (Object *)((uintptr_t)obj->clazz & ~(uintptr_t)0x1);
+}
+
+static void setForward(Object *obj, const Object *forward)
+{
+    obj->clazz = (ClassObject *)((uintptr_t)forward | 0x1);
+}
+
+static size_t objectSize(const Object *obj)
+{
+    if (IS_CLASS_FLAG_SET(obj->clazz, CLASS_ISARRAY)) {
+        return dvmArrayObjectSize((const ArrayObject *)obj);
+    }
+    return obj->clazz->objectSize;
+}
+
+static void pinObject(CompactContext *ctx, const Object *obj)
+{
+    if (obj != NULL && dvmHeapBitmapCoversAddress(&ctx->pinBits, obj)) {
+        dvmHeapBitmapSetObjectBit(&ctx->pinBits, obj);
+    }
+}
+
+static void pinRootVisitor(void *addr, u4 threadId, RootType type, void *arg)
+{
+    pinObject((CompactContext *)arg, *(Object **)addr);
+}
+
+/*
+ * The arguments of native methods are not roots, but the native code
+ * holds them as raw pointers.  Scan them conservatively.
+ */
+static void pinNativeArguments(CompactContext *ctx)
+{
+    dvmLockThreadList(dvmThreadSelf());
+    for (Thread *thread = gDvm.threadList; thread != NULL;
+         thread = thread->next) {
+        const StackSaveArea *saveArea;
+        for (const u4 *fp = (const u4 *)thread->interpSave.curFrame;
+             fp != NULL;
+             fp = (const u4 *)saveArea->prevFrame) {
+            saveArea = SAVEAREA_FROM_FP(fp);
+            const Method *method = saveArea->method;
+            if (method == NULL || !dvmIsNativeMethod(method)) {
+                continue;
+            }
+            for (size_t i = 0; i < method->insSize; ++i) {
+                if (dvmIsValidObject((Object *)fp[i])) {
+                    pinObject(ctx, (Object *)fp[i]);
+                }
+            }
+        }
+    }
+    dvmUnlockThreadList();
+}
+
+static void pinInternedString(StringObject **entry, void *arg)
+{
+    pinObject((CompactContext *)arg, (Object *)*entry);
+}
+
+/*
+ * Weakly held objects are found by address, pin them too.
+ */
+static void pinWeakReferences(CompactContext *ctx)
+{
+    dvmVisitInternTable(gDvm.internedStrings, pinInternedString, ctx);
+
+    for (size_t i = 0; i < kIndirectRefShardCount; i++) {
+        IndirectRefShard *refs = &gDvm.jniWeakGlobalRefs[i];
+        dvmLockMutex(&refs->lock);
+        typedef IndirectRefTable::iterator It; // TODO: C++0x auto
+        for (It it = refs->table.begin(), end = refs->table.end(); it != end; ++it) {
+            pinObject(ctx, **it);
+        }
+        dvmUnlockMutex(&refs->lock);
+    }
+}
+
+static bool isMovable(const CompactContext *ctx, const Object *obj)
+{
+    return obj->lock == 0 &&
+           !dvmIsClassObject(obj) &&
+           !dvmHeapBitmapIsObjectBitSet(&ctx->pinBits, obj);
+}
+
+/*
+ * Collects the movable objects above the threshold.
+ */
+static void findMovableCallback(Object *obj, void *arg)
+{
+    CompactContext *ctx = (CompactContext *)arg;
+    if ((char *)obj < ctx->threshold || (char *)obj >= ctx->limit ||
+        !isMovable(ctx, obj)) {
+        return;
+    }
+    if (ctx->numMoved == ctx->maxMoved) {
+        size_t maxMoved = ctx->maxMoved ? 2 * ctx->maxMoved : 1024;
+        Object **moved = (Object **)realloc(ctx->moved,
+                                            maxMoved * sizeof(Object *));
+        if (moved == NULL) {
+            return;
+        }
+        ctx->moved = moved;
+        ctx->maxMoved = maxMoved;
+    }
+    ctx->moved[ctx->numMoved++] = obj;
+}
+
+static void updateReferenceVisitor(void *addr, void *arg)
+{
+    Object *obj = *(Object **)addr;
+    if (obj != NULL && isForwarded(obj)) {
+        *(Object **)addr = getForward(obj);
+    }
+}
+
+static void updateObjectCallback(Object *obj, void *arg)
+{
+    /* The old copies are freed once all references are updated. */
+    if (!isForwarded(obj)) {
+        dvmVisitObject(updateReferenceVisitor, obj, arg);
     }
 }
 
+/*
+ * Evacuates what it can from the top of the active heap.  Must be
+ * called with the heap lock held and no garbage collection running.
+ * Used when idle and, in the zygote, right before the active heap
+ * becomes the shared zygote heap.
+ */
+static void compactHeap()
+{
+    HS_BOILERPLATE();
+
+    HeapSource *hs = gHs;
+    Heap *heap = hs2heap(hs);
+    size_t footprint = mspace_footprint(heap->msp);
+    size_t bytesAllocated = heap->bytesAllocated;
+    if (hs->largeObjects != NULL) {
+        /* Large objects are accounted to the heap but never move. */
+        size_t largeBytes = dvmLargeObjectSpaceFootprint(hs->largeObjects);
+        bytesAllocated -= MIN(largeBytes, bytesAllocated);
+    }
+    for (size_t i = 0; i < hs->numArenas; i++) {
+        /* So are arena objects. */
+        bytesAllocated -= MIN(hs->arenas[i].numBytes, bytesAllocated);
+    }
+    if (footprint < bytesAllocated + HEAP_COMPACT_MIN_FREE) {
+        return;
+    }
+
+    u8 startTime = dvmGetRelativeTimeUsec();
+    dvmSuspendAllThreads(SUSPEND_FOR_GC);
+    dvmHeapSourceRetireAllTlabs();
+
+    CompactContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    if (!dvmHeapBitmapInit(&ctx.pinBits, heap->base, heap->limit - heap->base,
+                           "dalvik-pin-bitmap")) {
+        dvmResumeAllThreads(SUSPEND_FOR_GC);
+        return;
+    }
+    dvmVisitRoots(pinRootVisitor, &ctx);
+    pinNativeArguments(&ctx);
+    pinWeakReferences(&ctx);
+
+    /*
+     * If the live objects were packed tightly they would all fit below
+     * the threshold.  Look for room for the objects above it.
+     */
+    ctx.threshold = heap->base + bytesAllocated;
+    ctx.limit = heap->limit;
+    dvmHeapBitmapWalk(&hs->liveBits, findMovableCallback, &ctx);
+
+    size_t numMoved = 0;
+    size_t bytesMoved = 0;
+    for (size_t i = 0; i < ctx.numMoved; ++i) {
+        Object *obj = ctx.moved[i];
+        size_t size = objectSize(obj);
+        void *ptr = NULL;
+        if (heap->runs != NULL) {
+            ptr = dvmSlotRunsAlloc(heap->runs, size);
+        }
+        if (ptr == NULL) {
+            ptr = mspace_malloc(heap->msp, size);
+        }
+        if (ptr == NULL || ptr > (void *)obj) {
+            /* No lower hole fits this object, leave it where it is. */
+            if (ptr != NULL) {
+                freeChunk(heap, ptr);
+            }
+            continue;
+        }
+        countAllocation(heap, ptr);
+        memcpy(ptr, obj, size);
+        setForward(obj, (Object *)ptr);
+        ctx.moved[numMoved++] = obj;
+        bytesMoved += size;
+    }
+
+    if (numMoved > 0) {
+        dvmHeapBitmapWalk(&hs->liveBits, updateObjectCallback, NULL);
+        size_t bytesFreed = 0;
+        for (size_t i = 0; i < numMoved; ++i) {
+            countFree(heap, ctx.moved[i], &bytesFreed);
+            freeChunk(heap, ctx.moved[i]);
+        }
+        /*
+         * The survivors kept for the next young collection are recorded
+         * by address; start over with a full collection instead.
+         */
+        if (gDvm.gcHeap->markBitsSticky) {
+            dvmHeapSourceZeroMarkBitmap();
+            gDvm.gcHeap->markBitsSticky = false;
+        }
+    }
+
+    free(ctx.moved);
+    dvmHeapBitmapDelete(&ctx.pinBits);
+    dvmResumeAllThreads(SUSPEND_FOR_GC);
+
+    LOGD_HEAP("compacted %zd objects (%zd bytes) in %ums",
+            numMoved, bytesMoved,
+            (u4)((dvmGetRelativeTimeUsec() - startTime) / 1000));
+}
+
 /*
  * Return free pages to the system.
  * TODO: move this somewhere else, especially the native heap part.
@@ -1338,6 +2526,10 @@ static void releasePagesInRange(void* start, void* end, size_t used_bytes,
          */
         start = (void *)ALIGN_UP_TO_PAGE_SIZE(start);
         end = (void *)((size_t)end & ~(SYSTEM_PAGE_SIZE - 1));
+        /* Free chunks aren't assumed to be zero, so pages that are part
+         * of a huge page can stay.
+         */
+        dvmHugePagesNarrowRange(&start, &end);
         if (end > start) {
             size_t length = (char *)end - (char *)start;
             madvise(start, length, MADV_DONTNEED);
@@ -1354,6 +2546,7 @@ static void trimHeaps()
     HS_BOILERPLATE();
 
     HeapSource *hs = gHs;
+    u8 start = dvmGetRelativeTimeUsec();
     size_t heapBytes = 0;
     for (size_t i = 0; i < hs->numHeaps; i++) {
         Heap *heap = &hs->heaps[i];
@@ -1369,11 +2562,41 @@ static void trimHeaps()
     dlmalloc_trim(0);
     size_t nativeBytes = 0;
     dlmalloc_inspect_all(releasePagesInRange, &nativeBytes);
+    dvmRecordGcPhaseTime(kGcPhaseTrim, dvmGetRelativeTimeUsec() - start);
 
     LOGD_HEAP("madvised %zd (GC) + %zd (native) = %zd total bytes",
             heapBytes, nativeBytes, heapBytes + nativeBytes);
 }
 
+struct WalkContext {
+    const Heap *heap;
+    void (*callback)(void* start, void* end, size_t used_bytes, void* arg);
+    void *arg;
+};
+
+/*
+ * Reports each slot of a small object run as a chunk of its own, so
+ * that the callback sees objects rather than runs.
+ */
+static void walkRunsCallback(void* start, void* end, size_t used_bytes,
+                             void* arg)
+{
+    WalkContext *ctx = (WalkContext *)arg;
+    size_t slotSize = 0;
+    if (used_bytes != 0) {
+        slotSize = dvmSlotRunsSlotSize(ctx->heap->runs, start);
+    }
+    if (slotSize == 0) {
+        ctx->callback(start, end, used_bytes, ctx->arg);
+        return;
+    }
+    char *slot = (char *)start;
+    for (; slot + slotSize <= (char *)start + SLOT_RUN_SIZE; slot += slotSize) {
+        bool live = dvmHeapBitmapIsObjectBitSet(&gHs->liveBits, slot);
+        ctx->callback(slot, slot + slotSize, live ? slotSize : 0, ctx->arg);
+    }
+}
+
 /*
  * Walks over the heap source and passes every allocated and
  * free chunk to the callback.
@@ -1389,9 +2612,37 @@ void dvmHeapSourceWalk(void(*callback)(void* start, void* end,
 //TODO: do this in address order
     HeapSource *hs = gHs;
     for (size_t i = hs->numHeaps; i > 0; --i) {
-        mspace_inspect_all(hs->heaps[i-1].msp, callback, arg);
+        Heap *heap = &hs->heaps[i-1];
+        if (heap->runs != NULL) {
+            WalkContext ctx = { heap, callback, arg };
+            mspace_inspect_all(heap->msp, walkRunsCallback, &ctx);
+        } else {
+            mspace_inspect_all(heap->msp, callback, arg);
+        }
         callback(NULL, NULL, 0, arg);  // Indicate end of a heap.
     }
+    if (hs->largeObjects != NULL) {
+        dvmLargeObjectSpaceWalk(hs->largeObjects, callback, arg);
+        callback(NULL, NULL, 0, arg);
+    }
+    if (hs->arenas != NULL) {
+        for (size_t i = 0; i < hs->numArenas; i++) {
+            const HeapArena *arena = &hs->arenas[i];
+            if (arena->top == NULL) {
+                continue;
+            }
+            char *chunk = arena->base;
+            while (chunk < arena->top) {
+                size_t size = *(size_t *)chunk;
+                char *ptr = chunk + HEAP_ARENA_CHUNK_OVERHEAD;
+                bool live = dvmHeapBitmapIsObjectBitSet(&hs->liveBits, ptr);
+                callback(ptr, chunk + size,
+                         live ? size - HEAP_ARENA_CHUNK_OVERHEAD : 0, arg);
+                chunk += size;
+            }
+        }
+        callback(NULL, NULL, 0, arg);
+    }
 }
 
 /*
@@ -76,6 +76,19 @@ void dvmHeapSourceShutdown(GcHeap **gcHeap);
  */
 void dvmHeapSourceGetRegions(uintptr_t *base, uintptr_t *max, size_t numHeaps);
 
+/*
+ * Returns the base and inclusive max addresses of the large object
+ * space like dvmHeapSourceGetRegions(), or false if there is none.
+ */
+bool dvmHeapSourceGetLargeObjectRegion(uintptr_t *base, uintptr_t *max);
+
+/*
+ * Returns the base and inclusive max addresses of the arena space, or
+ * false if there is none.  Unlike the other regions, the range is not
+ * clipped to the mark bitmap.
+ */
+bool dvmHeapSourceGetArenaRegion(uintptr_t *base, uintptr_t *max);
+
 /*
  * Get the bitmap representing all live objects.
  */
@@ -92,8 +105,14 @@ HeapBitmap *dvmHeapSourceGetMarkBits(void);
 void *dvmHeapSourceGetBase(void);
 
 /*
- * Returns a high water mark, between base and limit all objects must have been
- * allocated.
+ * Gets the length of the allocation for the HeapSource, which covers
+ * the large object space as well as the heaps.
+ */
+size_t dvmHeapSourceGetReservedLength(void);
+
+/*
+ * Returns a high water mark, between base and limit all objects outside
+ * the large object space must have been allocated.
  */
 void *dvmHeapSourceGetLimit(void);
 
@@ -105,15 +124,81 @@ size_t dvmHeapSourceGetValue(HeapSourceValueSpec spec,
                              size_t perHeapStats[], size_t arrayLen);
 
 /*
- * Allocates <n> bytes of zeroed data.
+ * Allocates <n> bytes of data, zeroed unless <zero> is false; the
+ * object header is cleared either way.
+ */
+void *dvmHeapSourceAlloc(size_t n, bool zero);
+
+/*
+ * Like dvmHeapSourceAlloc(), but grows up to absoluteMaxSize if
+ * necessary.
+ */
+void *dvmHeapSourceAllocAndGrow(size_t n, bool zero);
+
+/*
+ * Allocates <n> bytes of zeroed data for an object that holds no
+ * references, preferring the large object space over the heap.  With
+ * <grow>, behaves like dvmHeapSourceAllocAndGrow(), otherwise like
+ * dvmHeapSourceAlloc().
+ */
+void *dvmHeapSourceAllocLarge(size_t n, bool grow);
+
+/*
+ * Refills self's allocation buffer for objects of <n> bytes from the
+ * active heap and returns the first slot, or NULL if <n> is not a
+ * small-object size or the heap cannot satisfy the refill without
+ * growing.  The caller must hold the heap lock.
+ */
+void *dvmHeapSourceRefillTlab(Thread *self, size_t n);
+
+/*
+ * Returns the unused slots of self's allocation buffers to the heap.
+ * The caller must hold the heap lock.
  */
-void *dvmHeapSourceAlloc(size_t n);
+void dvmHeapSourceRetireTlabs(Thread *self);
 
 /*
- * Allocates <n> bytes of zeroed data, growing up to absoluteMaxSize
- * if necessary.
+ * Returns the unused slots of every thread's allocation buffers to
+ * the heap.  The caller must hold the heap lock, and all other
+ * threads must be suspended or otherwise unable to allocate.
  */
-void *dvmHeapSourceAllocAndGrow(size_t n);
+void dvmHeapSourceRetireAllTlabs(void);
+
+/*
+ * Gives self an arena of its own.  Returns false if there is no free
+ * arena, arenas are disabled, or self already has one.  The caller
+ * must hold the heap lock.
+ */
+bool dvmHeapSourceOpenArena(Thread *self);
+
+/*
+ * Allocates <n> bytes of zeroed data from self's arena, or returns
+ * NULL if it has no room.  The caller must hold the heap lock.
+ */
+void *dvmHeapSourceArenaAlloc(Thread *self, size_t n);
+
+/*
+ * Returns the first address of self's arena and the address one past
+ * the last one, or false if self has no arena.
+ */
+bool dvmHeapSourceGetArenaBounds(const Thread *self, uintptr_t *base,
+                                 uintptr_t *limit);
+
+/*
+ * Returns true if the card table has not been cleared since self's
+ * arena was opened, so that its cards still record every store of a
+ * reference into it.
+ */
+bool dvmHeapSourceCanReleaseArena(const Thread *self);
+
+/*
+ * Takes self's arena away.  With <release>, its objects are dropped
+ * and its pages go back to the system at once; the caller has made
+ * sure that nothing refers to them.  Otherwise the objects are left
+ * for the garbage collector, and the pages go back once the last of
+ * them is swept.  The caller must hold the heap lock.
+ */
+void dvmHeapSourceCloseArena(Thread *self, bool release);
 
 /*
  * Frees the first numPtrs objects in the ptrs list and returns the
@@ -133,6 +218,12 @@ bool dvmHeapSourceContains(const void *ptr);
  */
 bool dvmHeapSourceContainsAddress(const void *ptr);
 
+/*
+ * Returns true iff <ptr> is in the heap the zygote shares with its
+ * children.  Objects there never move.
+ */
+bool dvmHeapSourceIsInZygoteHeap(const void *ptr);
+
 /*
  * Returns the number of usable bytes in an allocated chunk; the size
  * may be larger than the size passed to dvmHeapSourceAlloc().
@@ -158,6 +249,15 @@ size_t dvmHeapSourceGetIdealFootprint(void);
  */
 void dvmHeapSourceGrowForUtilization(void);
 
+/*
+ * Records when the collection that is finishing started, how long it
+ * took, and the longest time it kept the mutators suspended.  The
+ * goal-driven sizing in dvmHeapSourceGrowForUtilization() works from
+ * these.  The caller must hold the heap lock.
+ */
+void dvmHeapSourceRecordGcTimes(u4 startMsec, u4 totalMsec, u4 maxPauseMsec,
+                                bool isConcurrent);
+
 /*
  * Walks over the heap source and passes every allocated and
  * free chunk to the callback.
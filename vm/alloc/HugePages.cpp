@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "Dalvik.h"
+#include "alloc/HugePages.h"
+
+/* Lets an anonymous mapping carry a name in /proc/<pid>/maps. */
+#ifndef PR_SET_VMA
+#define PR_SET_VMA              0x53564d41
+#define PR_SET_VMA_ANON_NAME    0
+#endif
+
+/* used if /proc/meminfo doesn't say */
+#define kDefaultHugePageSize    (2 * 1024 * 1024)
+
+/* the heap, card table, mark stack and code cache, with room to spare */
+#define kMaxHugeRegions         8
+
+struct HugeRegion {
+    char *base;                 /* NULL if the slot is free */
+    size_t length;
+    bool explicitPages;         /* from the hugetlbfs pool */
+    bool advised;               /* marked MADV_HUGEPAGE */
+    bool deferred;              /* to be marked after the zygote forks */
+};
+
+/*
+ * The regions are set up by the main thread and the compiler thread and
+ * read during collections, always under this lock.
+ */
+static pthread_mutex_t gRegionLock = PTHREAD_MUTEX_INITIALIZER;
+static HugeRegion gRegions[kMaxHugeRegions];
+
+/* 0 until the first region is allocated */
+static size_t gHugePageSize;
+static bool gTransparentAvailable;
+
+/* the part of the heap still shared with the zygote, in whole huge pages */
+static uintptr_t gSharedStart;
+static uintptr_t gSharedEnd;
+
+/*
+ * Returns the size of the pages MAP_HUGETLB hands out.  Transparent huge
+ * pages are the same size on every configuration we run on.
+ */
+static size_t readHugePageSize()
+{
+    size_t size = 0;
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (fp != NULL) {
+        char line[128];
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            unsigned long kb;
+            if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+                size = kb * 1024;
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    return (size != 0) ? size : kDefaultHugePageSize;
+}
+
+/*
+ * Returns "true" if the kernel will honor MADV_HUGEPAGE, which it does
+ * unless transparent huge pages are compiled out or set to "never".
+ */
+static bool readTransparentAvailable()
+{
+#ifdef MADV_HUGEPAGE
+    char buf[64];
+    int fd = open("/sys/kernel/mm/transparent_hugepage/enabled", O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t count = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf) - 1));
+    close(fd);
+    if (count <= 0) {
+        return false;
+    }
+    buf[count] = '\0';
+    return strstr(buf, "[never]") == NULL;
+#else
+    return false;
+#endif
+}
+
+static void probeLocked()
+{
+    if (gHugePageSize != 0) {
+        return;
+    }
+    gHugePageSize = readHugePageSize();
+    gTransparentAvailable = readTransparentAvailable();
+    if (!gTransparentAvailable) {
+        ALOGW("Transparent huge pages are not available%s",
+             gDvm.hugePageMode == kHugePagesExplicit ?
+                 "; only the JIT code cache can use huge pages" : "");
+    }
+}
+
+static HugeRegion *findRegionLocked(const void *addr)
+{
+    for (size_t i = 0; i < kMaxHugeRegions; i++) {
+        HugeRegion *region = &gRegions[i];
+        if (region->base != NULL && (const char *)addr >= region->base &&
+            (const char *)addr < region->base + region->length) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+static bool adviseRange(void *start, size_t length, bool huge)
+{
+#ifdef MADV_HUGEPAGE
+    if (madvise(start, length, huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) == 0) {
+        return true;
+    }
+    ALOGW("madvise(%p, %zd, %s) failed: %s", start, length,
+         huge ? "MADV_HUGEPAGE" : "MADV_NOHUGEPAGE", strerror(errno));
+#endif
+    return false;
+}
+
+/*
+ * Maps "length" bytes, which must be a multiple of the huge page size,
+ * from the hugetlbfs pool.  Without MAP_NORESERVE the pages are reserved
+ * now, so the mapping fails at once if the pool is short instead of
+ * raising SIGBUS on a later fault.
+ */
+static void *mapExplicit(size_t length, int prot)
+{
+#ifdef MAP_HUGETLB
+    void *base = mmap(NULL, length, prot,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    return (base != MAP_FAILED) ? base : NULL;
+#else
+    errno = ENOSYS;
+    return NULL;
+#endif
+}
+
+/*
+ * Maps "length" bytes, a page multiple, at an address aligned to the huge
+ * page size so that every whole huge page of it can be collapsed.
+ */
+static void *mapAligned(size_t length, int prot)
+{
+    size_t mask = gHugePageSize - 1;
+    char *raw = (char *)mmap(NULL, length + gHugePageSize, prot,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char *base = (char *)(((uintptr_t)raw + mask) & ~mask);
+    char *rawEnd = raw + length + gHugePageSize;
+    if (base > raw) {
+        munmap(raw, base - raw);
+    }
+    if (rawEnd > base + length) {
+        munmap(base + length, rawEnd - (base + length));
+    }
+    return base;
+}
+
+void *dvmAllocHugeRegion(size_t size, int prot, const char *name,
+                         bool allowExplicit)
+{
+    if (gDvm.hugePageMode == kHugePagesNone) {
+        return dvmAllocRegion(size, prot, name);
+    }
+
+    pthread_mutex_lock(&gRegionLock);
+    probeLocked();
+    HugeRegion *region = NULL;
+    for (size_t i = 0; i < kMaxHugeRegions && region == NULL; i++) {
+        if (gRegions[i].base == NULL) {
+            region = &gRegions[i];
+        }
+    }
+    if (region == NULL) {
+        pthread_mutex_unlock(&gRegionLock);
+        ALOGW("Too many huge page regions; '%s' uses small pages", name);
+        return dvmAllocRegion(size, prot, name);
+    }
+
+    size_t length = ALIGN_UP_TO_PAGE_SIZE(size);
+    char *base = NULL;
+    bool explicitPages = false;
+
+    /*
+     * A child's first write to a private hugetlbfs page shared with the
+     * zygote copies it into a page from the pool, and an empty pool
+     * kills the child, so the zygote never takes pages from it.
+     */
+    if (allowExplicit && gDvm.hugePageMode == kHugePagesExplicit &&
+        !gDvm.zygote) {
+        size_t hugeLength = (size + gHugePageSize - 1) & ~(gHugePageSize - 1);
+        base = (char *)mapExplicit(hugeLength, prot);
+        if (base != NULL) {
+            length = hugeLength;
+            explicitPages = true;
+        } else {
+            ALOGW("No explicit huge pages for %zd-byte region '%s' (%s)",
+                 hugeLength, name, strerror(errno));
+        }
+    }
+    if (base == NULL) {
+        if (!gTransparentAvailable) {
+            pthread_mutex_unlock(&gRegionLock);
+            return dvmAllocRegion(size, prot, name);
+        }
+        base = (char *)mapAligned(length, prot);
+        if (base == NULL) {
+            pthread_mutex_unlock(&gRegionLock);
+            return NULL;
+        }
+    }
+
+    region->base = base;
+    region->length = length;
+    region->explicitPages = explicitPages;
+    region->advised = false;
+    region->deferred = false;
+    if (!explicitPages) {
+        if (gDvm.zygote) {
+            /* Keep khugepaged off it even if THP is set to "always". */
+            adviseRange(base, length, false);
+            region->deferred = true;
+        } else {
+            region->advised = adviseRange(base, length, true);
+        }
+    }
+    pthread_mutex_unlock(&gRegionLock);
+
+    /*
+     * Only kernels with the Android patches can name an anonymous mapping,
+     * and they keep the pointer rather than a copy, so "name" has to be a
+     * literal.  Failure only means the maps file shows no name.
+     */
+    prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, (unsigned long)base, length,
+          (unsigned long)name);
+
+    ALOGV("Mapped '%s' at %p, %zd bytes, %s", name, base, length,
+         explicitPages ? "explicit huge pages" :
+             region->deferred ? "transparent huge pages after fork" :
+                 "transparent huge pages");
+    return base;
+}
+
+void dvmFreeHugeRegion(void *base, size_t size)
+{
+    size_t length = size;
+
+    pthread_mutex_lock(&gRegionLock);
+    HugeRegion *region = findRegionLocked(base);
+    if (region != NULL && region->base == base) {
+        length = region->length;
+        memset(region, 0, sizeof(*region));
+    }
+    pthread_mutex_unlock(&gRegionLock);
+    munmap(base, length);
+}
+
+size_t dvmHugeRegionPageSize(const void *addr)
+{
+    size_t pageSize = SYSTEM_PAGE_SIZE;
+
+    if (gDvm.hugePageMode == kHugePagesNone) {
+        return pageSize;
+    }
+    pthread_mutex_lock(&gRegionLock);
+    const HugeRegion *region = findRegionLocked(addr);
+    if (region != NULL && (region->explicitPages || region->advised)) {
+        pageSize = gHugePageSize;
+    }
+    pthread_mutex_unlock(&gRegionLock);
+    return pageSize;
+}
+
+size_t dvmHugePageSize()
+{
+    if (gDvm.hugePageMode == kHugePagesNone) {
+        return 0;
+    }
+    pthread_mutex_lock(&gRegionLock);
+    probeLocked();
+    size_t size = gHugePageSize;
+    pthread_mutex_unlock(&gRegionLock);
+    return size;
+}
+
+void dvmHugePagesNarrowRange(void **pStart, void **pEnd)
+{
+    if (gDvm.hugePageMode == kHugePagesNone) {
+        return;
+    }
+    uintptr_t start = (uintptr_t)*pStart;
+    uintptr_t end = (uintptr_t)*pEnd;
+
+    pthread_mutex_lock(&gRegionLock);
+    const HugeRegion *region = findRegionLocked(*pStart);
+    if (region != NULL && region->advised &&
+        !(start >= gSharedStart && start < gSharedEnd)) {
+        uintptr_t mask = gHugePageSize - 1;
+        start = (start + mask) & ~mask;
+        end &= ~mask;
+        *pStart = (void *)start;
+        *pEnd = (void *)(end > start ? end : start);
+    }
+    pthread_mutex_unlock(&gRegionLock);
+}
+
+void dvmHugePagesStartupAfterZygote(const void *sharedStart,
+                                    const void *sharedEnd)
+{
+    if (gDvm.hugePageMode == kHugePagesNone) {
+        return;
+    }
+
+    pthread_mutex_lock(&gRegionLock);
+    bool anyDeferred = false;
+    for (size_t i = 0; i < kMaxHugeRegions; i++) {
+        anyDeferred |= (gRegions[i].base != NULL && gRegions[i].deferred);
+    }
+    if (!anyDeferred) {
+        /* Not forked from a zygote; nothing is shared. */
+        pthread_mutex_unlock(&gRegionLock);
+        return;
+    }
+    uintptr_t mask = gHugePageSize - 1;
+    gSharedStart = (uintptr_t)sharedStart & ~mask;
+    gSharedEnd = ((uintptr_t)sharedEnd + mask) & ~mask;
+    for (size_t i = 0; i < kMaxHugeRegions; i++) {
+        HugeRegion *region = &gRegions[i];
+        if (region->base == NULL || !region->deferred) {
+            continue;
+        }
+        uintptr_t start = (uintptr_t)region->base;
+        uintptr_t end = start + region->length;
+        bool advised = true;
+        if (gSharedStart < end && gSharedEnd > start) {
+            if (gSharedStart > start) {
+                advised &= adviseRange((void *)start, gSharedStart - start,
+                                       true);
+            }
+            if (end > gSharedEnd) {
+                advised &= adviseRange((void *)gSharedEnd, end - gSharedEnd,
+                                       true);
+            }
+        } else {
+            advised = adviseRange(region->base, region->length, true);
+        }
+        region->deferred = false;
+        region->advised = advised;
+    }
+    pthread_mutex_unlock(&gRegionLock);
+}
+
+size_t dvmHugePagesResidentBytes()
+{
+    if (gDvm.hugePageMode == kHugePagesNone) {
+        return 0;
+    }
+
+    HugeRegion regions[kMaxHugeRegions];
+    pthread_mutex_lock(&gRegionLock);
+    memcpy(regions, gRegions, sizeof(regions));
+    pthread_mutex_unlock(&gRegionLock);
+
+    /* Pool pages are reserved when they are mapped. */
+    size_t total = 0;
+    for (size_t i = 0; i < kMaxHugeRegions; i++) {
+        if (regions[i].base != NULL && regions[i].explicitPages) {
+            total += regions[i].length;
+        }
+    }
+
+    FILE *fp = fopen("/proc/self/smaps", "r");
+    if (fp == NULL) {
+        return total;
+    }
+    char line[PATH_MAX + 128];
+    bool counting = false;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        unsigned long start, end, kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            /* A region may have been split up by mprotect. */
+            counting = false;
+            for (size_t i = 0; i < kMaxHugeRegions; i++) {
+                const HugeRegion *region = &regions[i];
+                if (region->base != NULL && !region->explicitPages &&
+                    start >= (uintptr_t)region->base &&
+                    start < (uintptr_t)region->base + region->length) {
+                    counting = true;
+                    break;
+                }
+            }
+        } else if (counting &&
+                   sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            total += kb * 1024;
+        }
+    }
+    fclose(fp);
+    return total;
+}
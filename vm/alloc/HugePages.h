@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Huge-page backing for the VM's large, long-lived regions.
+ *
+ * With -Xhugepages:transparent a region is an anonymous mapping aligned
+ * to the huge page size and marked MADV_HUGEPAGE, so the kernel can back
+ * it with transparent huge pages as it is touched.  With
+ * -Xhugepages:explicit the regions that ask for it come from the
+ * hugetlbfs pool instead, and fall back to transparent huge pages if the
+ * pool is empty.  Everything else behaves as with -Xhugepages:transparent.
+ *
+ * In the zygote no region is marked until after the fork: the pages the
+ * zygote leaves behind are shared copy-on-write with every child, and a
+ * huge page would be copied, or collapsed by khugepaged, as a whole.
+ * Each child marks its regions in dvmHugePagesStartupAfterZygote(),
+ * leaving out the part of the heap the zygote still shares.
+ */
+#ifndef DALVIK_ALLOC_HUGEPAGES_H_
+#define DALVIK_ALLOC_HUGEPAGES_H_
+
+/*
+ * Allocates a zero-filled region of "size" bytes, like dvmAllocRegion(),
+ * that may be backed by huge pages.  If "allowExplicit" is set the region
+ * may come from the hugetlbfs pool; such a region can only be mprotect()ed
+ * in whole huge pages.  Uses dvmAllocRegion() with -Xhugepages:none.
+ * Returns NULL on failure.
+ */
+void *dvmAllocHugeRegion(size_t size, int prot, const char *name,
+                         bool allowExplicit);
+
+/*
+ * Unmaps a region returned by dvmAllocHugeRegion().  "size" is the size
+ * that was asked for.
+ */
+void dvmFreeHugeRegion(void *base, size_t size);
+
+/*
+ * Returns the page size backing the region holding "addr": the huge page
+ * size if the region came from the hugetlbfs pool or is marked for
+ * transparent huge pages, else SYSTEM_PAGE_SIZE.
+ */
+size_t dvmHugeRegionPageSize(const void *addr);
+
+/*
+ * Returns the huge page size, or 0 if huge pages are off.
+ */
+size_t dvmHugePageSize(void);
+
+/*
+ * Narrows [*pStart, *pEnd) to whole huge pages if it lies in a region
+ * marked for transparent huge pages.  Returning part of a huge page to the
+ * system splits it, and khugepaged will soon collapse it again, so a
+ * caller trimming a range it does not need read back as zeroes is better
+ * off leaving the partial huge pages alone.  Leaves ranges elsewhere as
+ * they are.
+ */
+void dvmHugePagesNarrowRange(void **pStart, void **pEnd);
+
+/*
+ * Marks the regions the zygote deferred, leaving out the huge pages
+ * overlapping [sharedStart, sharedEnd), the part of the heap that is still
+ * shared with the zygote.  Called in a process that was forked from the
+ * zygote, before it allocates.
+ */
+void dvmHugePagesStartupAfterZygote(const void *sharedStart,
+                                    const void *sharedEnd);
+
+/*
+ * Returns the number of bytes of the regions that are backed by huge
+ * pages: all of each region from the hugetlbfs pool, and the
+ * AnonHugePages of the others.  Reads /proc/self/smaps.
+ */
+size_t dvmHugePagesResidentBytes(void);
+
+#endif  // DALVIK_ALLOC_HUGEPAGES_H_
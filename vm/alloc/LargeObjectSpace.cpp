@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+
+#include "Dalvik.h"
+#include "alloc/LargeObjectSpace.h"
+
+struct LargeObjectSpace {
+    char *base;
+    size_t numPages;
+
+    /* The number of pages of the object starting at each page, or 0. */
+    u4 *pages;
+
+    /* The number of pages that belong to objects. */
+    size_t pagesInUse;
+};
+
+LargeObjectSpace *dvmLargeObjectSpaceCreate(void *base, size_t length)
+{
+    assert(((uintptr_t)base & (SYSTEM_PAGE_SIZE - 1)) == 0);
+    assert((length & (SYSTEM_PAGE_SIZE - 1)) == 0);
+    LargeObjectSpace *los = (LargeObjectSpace *)calloc(1, sizeof(*los));
+    if (los == NULL) {
+        return NULL;
+    }
+    los->base = (char *)base;
+    los->numPages = length / SYSTEM_PAGE_SIZE;
+    los->pages = (u4 *)calloc(los->numPages, sizeof(u4));
+    if (los->pages == NULL) {
+        free(los);
+        return NULL;
+    }
+    return los;
+}
+
+void dvmLargeObjectSpaceDestroy(LargeObjectSpace *los)
+{
+    if (los == NULL) {
+        return;
+    }
+    free(los->pages);
+    free(los);
+}
+
+/*
+ * Returns the index of the first run of "count" free pages, or
+ * numPages if there is none.  Only the first page of an object has a
+ * table entry, so any page with an entry ends a free run, and the
+ * search resumes after the object.
+ */
+static size_t findFreePages(const LargeObjectSpace *los, size_t count)
+{
+    size_t i = 0;
+    while (i + count <= los->numPages) {
+        size_t j = i;
+        while (j < i + count && los->pages[j] == 0) {
+            ++j;
+        }
+        if (j == i + count) {
+            return i;
+        }
+        i = j + los->pages[j];
+    }
+    return los->numPages;
+}
+
+void *dvmLargeObjectSpaceAlloc(LargeObjectSpace *los, size_t n)
+{
+    size_t count = ALIGN_UP_TO_PAGE_SIZE(n) / SYSTEM_PAGE_SIZE;
+    if (count == 0 || count > los->numPages - los->pagesInUse) {
+        return NULL;
+    }
+    size_t index = findFreePages(los, count);
+    if (index == los->numPages) {
+        return NULL;
+    }
+    char *ptr = los->base + index * SYSTEM_PAGE_SIZE;
+    if (mprotect(ptr, count * SYSTEM_PAGE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        ALOGW("Unable to map %zd large object pages: %s",
+              count, strerror(errno));
+        return NULL;
+    }
+    /* Pages that were discarded or never touched read as zeroes. */
+    los->pages[index] = count;
+    los->pagesInUse += count;
+    return ptr;
+}
+
+void dvmLargeObjectSpaceFree(LargeObjectSpace *los, void *ptr)
+{
+    assert(dvmLargeObjectSpaceContains(los, ptr));
+    size_t index = ((char *)ptr - los->base) / SYSTEM_PAGE_SIZE;
+    size_t count = los->pages[index];
+    assert(count != 0);
+    assert(los->base + index * SYSTEM_PAGE_SIZE == ptr);
+    madvise(ptr, count * SYSTEM_PAGE_SIZE, MADV_DONTNEED);
+    mprotect(ptr, count * SYSTEM_PAGE_SIZE, PROT_NONE);
+    los->pages[index] = 0;
+    los->pagesInUse -= count;
+}
+
+bool dvmLargeObjectSpaceContains(const LargeObjectSpace *los, const void *ptr)
+{
+    return (const char *)ptr >= los->base &&
+           (const char *)ptr < los->base + los->numPages * SYSTEM_PAGE_SIZE;
+}
+
+size_t dvmLargeObjectSpaceChunkSize(const LargeObjectSpace *los,
+                                    const void *ptr)
+{
+    if (!dvmLargeObjectSpaceContains(los, ptr)) {
+        return 0;
+    }
+    size_t offset = (const char *)ptr - los->base;
+    if ((offset & (SYSTEM_PAGE_SIZE - 1)) != 0) {
+        return 0;
+    }
+    return los->pages[offset / SYSTEM_PAGE_SIZE] * SYSTEM_PAGE_SIZE;
+}
+
+size_t dvmLargeObjectSpaceFootprint(const LargeObjectSpace *los)
+{
+    return los->pagesInUse * SYSTEM_PAGE_SIZE;
+}
+
+void dvmLargeObjectSpaceGetBounds(const LargeObjectSpace *los,
+                                  uintptr_t *base, uintptr_t *limit)
+{
+    *base = (uintptr_t)los->base;
+    *limit = (uintptr_t)los->base + los->numPages * SYSTEM_PAGE_SIZE;
+}
+
+void dvmLargeObjectSpaceWalk(const LargeObjectSpace *los,
+                             void (*callback)(void* start, void* end,
+                                              size_t used_bytes, void* arg),
+                             void *arg)
+{
+    size_t i = 0;
+    while (i < los->numPages) {
+        char *start = los->base + i * SYSTEM_PAGE_SIZE;
+        size_t count = los->pages[i];
+        if (count != 0) {
+            size_t length = count * SYSTEM_PAGE_SIZE;
+            callback(start, start + length, length, arg);
+            i += count;
+            continue;
+        }
+        size_t j = i;
+        while (j < los->numPages && los->pages[j] == 0) {
+            ++j;
+        }
+        callback(start, los->base + j * SYSTEM_PAGE_SIZE, 0, arg);
+        i = j;
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A space for large objects that hold no references.
+ *
+ * The space is a page-aligned part of the heap source's virtual memory
+ * reservation that starts out inaccessible.  Each object gets a run of
+ * pages of its own that is made accessible when the object is
+ * allocated, and is discarded and made inaccessible again when the
+ * object is freed, so a large object never fragments an mspace and
+ * its pages go straight back to the system.  Objects are never moved.
+ * The number of pages of each object is kept outside the space, in a
+ * table indexed by page, which holds zero for every page that does not
+ * start an object.
+ *
+ * Because the space is inside the reservation, its objects are covered
+ * by the live and mark bitmaps and the card table like any other.
+ * None of this is thread safe; callers hold the heap lock.
+ */
+#ifndef DALVIK_ALLOC_LARGEOBJECTSPACE_H_
+#define DALVIK_ALLOC_LARGEOBJECTSPACE_H_
+
+struct LargeObjectSpace;
+
+/*
+ * Creates a space covering [base, base + length), which must be page
+ * aligned and inaccessible.  Returns NULL on failure.
+ */
+LargeObjectSpace *dvmLargeObjectSpaceCreate(void *base, size_t length);
+
+/*
+ * Frees the page table.  The pages themselves belong to the caller's
+ * reservation and are left alone.
+ */
+void dvmLargeObjectSpaceDestroy(LargeObjectSpace *los);
+
+/*
+ * Returns zeroed pages for an object of "n" bytes, or NULL if there is
+ * no free run of pages long enough.
+ */
+void *dvmLargeObjectSpaceAlloc(LargeObjectSpace *los, size_t n);
+
+/*
+ * Gives the pages of the object at "ptr" back to the system.
+ */
+void dvmLargeObjectSpaceFree(LargeObjectSpace *los, void *ptr);
+
+/*
+ * Returns true iff "ptr" lies within the space, whether or not it
+ * points to an object.
+ */
+bool dvmLargeObjectSpaceContains(const LargeObjectSpace *los, const void *ptr);
+
+/*
+ * Returns the number of bytes in the pages of the object at "ptr", or
+ * 0 if no object starts at "ptr".
+ */
+size_t dvmLargeObjectSpaceChunkSize(const LargeObjectSpace *los,
+                                    const void *ptr);
+
+/*
+ * Returns the number of bytes in the pages of all objects.
+ */
+size_t dvmLargeObjectSpaceFootprint(const LargeObjectSpace *los);
+
+/*
+ * Returns the first address in the space and the address one past the
+ * last one.
+ */
+void dvmLargeObjectSpaceGetBounds(const LargeObjectSpace *los,
+                                  uintptr_t *base, uintptr_t *limit);
+
+/*
+ * Passes every object, and every run of free pages with a used_bytes
+ * of 0, to the callback in address order.
+ */
+void dvmLargeObjectSpaceWalk(const LargeObjectSpace *los,
+                             void (*callback)(void* start, void* end,
+                                              size_t used_bytes, void* arg),
+                             void *arg);
+
+#endif  // DALVIK_ALLOC_LARGEOBJECTSPACE_H_
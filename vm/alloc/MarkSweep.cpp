@@ -16,6 +16,7 @@
 
 #include "Dalvik.h"
 #include "alloc/CardTable.h"
+#include "alloc/GcWorkers.h"
 #include "alloc/HeapBitmap.h"
 #include "alloc/HeapBitmapInlines.h"
 #include "alloc/HeapInternal.h"
@@ -25,6 +26,7 @@
 #include <limits.h>     // for ULONG_MAX
 #include <sys/mman.h>   // for madvise(), mmap()
 #include <errno.h>
+#include <sched.h>      // for sched_yield()
 
 typedef unsigned long Word;
 const size_t kWordSize = sizeof(Word);
@@ -86,15 +88,187 @@ static const Object *markStackPop(GcMarkStack *stack)
     return *stack->top;
 }
 
-bool dvmHeapBeginMarkStep(bool isPartial)
+/*
+ * Parallel marking.
+ *
+ * Each marking thread owns a fixed-size work-stealing deque of gray
+ * objects.  The owner pushes and pops at the bottom without locking,
+ * idle threads steal from the top.  A thread whose deque is full
+ * spills onto the shared mark stack, which is guarded by a mutex and
+ * drained back into the deques in batches.  Mark bits are set with an
+ * atomic test-and-set so that every object is pushed, and therefore
+ * scanned, exactly once.
+ *
+ * Parallel marking does not use the finger.  The roots are pushed on
+ * the shared mark stack instead of being found by a bitmap walk, and
+ * the bits of the immune region, which do not change during marking,
+ * are split into stripes that the threads claim one at a time.
+ */
+#define MARK_DEQUE_SIZE     (8 * 1024)  /* must be a power of two */
+#define MARK_OVERFLOW_BATCH 64
+#define MARK_STRIPE_WORDS   256
+
+struct GcMarkDeque {
+    volatile int32_t top;
+    volatile int32_t bottom;
+    const Object *slots[MARK_DEQUE_SIZE];
+};
+
+struct GcParallelMark;
+
+struct GcMarkWorker {
+    GcMarkContext ctx;
+    GcParallelMark *pm;
+    GcMarkDeque deque;
+};
+
+struct GcParallelMark {
+    /* The shared context.  Its stack holds objects that overflowed. */
+    GcMarkContext *ctx;
+
+    /* Guards the shared stack and the gcHeap reference lists. */
+    pthread_mutex_t lock;
+
+    /* Number of objects on the shared stack. */
+    volatile int32_t overflowCount;
+
+    /* Next immune stripe to claim, and the number of stripes. */
+    volatile int32_t nextStripe;
+    int32_t numStripes;
+
+    /* Number of threads that have run out of work. */
+    volatile int32_t idle;
+
+    size_t numWorkers;
+    GcMarkWorker *workers;
+};
+
+static GcMarkWorker *gMarkWorkers;
+
+/*
+ * Pushes an object on the bottom of the owner's deque.  Returns false
+ * if the deque is full.
+ */
+static bool markDequePush(GcMarkDeque *deque, const Object *obj)
 {
-    GcMarkContext *ctx = &gDvm.gcHeap->markContext;
+    int32_t bottom = deque->bottom;
+    int32_t top = android_atomic_acquire_load(&deque->top);
+    if (bottom - top >= MARK_DEQUE_SIZE) {
+        return false;
+    }
+    deque->slots[bottom & (MARK_DEQUE_SIZE - 1)] = obj;
+    android_atomic_release_store(bottom + 1, &deque->bottom);
+    return true;
+}
+
+/*
+ * Pops an object from the bottom of the owner's deque.  Returns NULL
+ * if the deque is empty or the last object was stolen.
+ */
+static const Object *markDequePop(GcMarkDeque *deque)
+{
+    int32_t bottom = deque->bottom - 1;
+    deque->bottom = bottom;
+    ANDROID_MEMBAR_FULL();
+    int32_t top = deque->top;
+    if (top > bottom) {
+        deque->bottom = top;
+        return NULL;
+    }
+    const Object *obj = deque->slots[bottom & (MARK_DEQUE_SIZE - 1)];
+    if (top == bottom) {
+        /* Last object; race any thieves for it. */
+        if (android_atomic_release_cas(top, top + 1, &deque->top) != 0) {
+            obj = NULL;
+        }
+        deque->bottom = top + 1;
+    }
+    return obj;
+}
+
+/*
+ * Steals an object from the top of another thread's deque.  Returns
+ * NULL if the deque is empty or another thread won the race.
+ */
+static const Object *markDequeSteal(GcMarkDeque *deque)
+{
+    int32_t top = android_atomic_acquire_load(&deque->top);
+    ANDROID_MEMBAR_FULL();
+    int32_t bottom = android_atomic_acquire_load(&deque->bottom);
+    if (top >= bottom) {
+        return NULL;
+    }
+    const Object *obj = deque->slots[top & (MARK_DEQUE_SIZE - 1)];
+    if (android_atomic_release_cas(top, top + 1, &deque->top) != 0) {
+        return NULL;
+    }
+    return obj;
+}
+
+static bool markDequeIsEmpty(const GcMarkDeque *deque)
+{
+    return deque->bottom <= deque->top;
+}
+
+/*
+ * Pushes a newly marked object on a marking thread's deque, or on the
+ * shared stack if the deque is full.
+ */
+static void markWorkerPush(GcMarkWorker *worker, const Object *obj)
+{
+    if (!markDequePush(&worker->deque, obj)) {
+        GcParallelMark *pm = worker->pm;
+        dvmLockMutex(&pm->lock);
+        markStackPush(&pm->ctx->stack, obj);
+        android_atomic_inc(&pm->overflowCount);
+        dvmUnlockMutex(&pm->lock);
+    }
+}
+
+/*
+ * Allocates the per-thread marking state on first use.  Returns false
+ * if marking has to fall back to a single thread.
+ */
+static bool initMarkWorkers()
+{
+    if (gMarkWorkers == NULL) {
+        gMarkWorkers = (GcMarkWorker *)calloc(GC_MAX_WORKERS,
+                                              sizeof(GcMarkWorker));
+        if (gMarkWorkers == NULL) {
+            ALOGW("Unable to allocate parallel marking state");
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Sets up the mark step.  A young collection starts from the mark bits
+ * left by the last GC, which hold its survivors; any other collection
+ * starts from clear mark bits.
+ */
+bool dvmHeapBeginMarkStep(bool isPartial, bool isYoung)
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    GcMarkContext *ctx = &gcHeap->markContext;
 
+    assert(!isYoung || (isPartial && gcHeap->markBitsSticky));
+    if (!isYoung && gcHeap->markBitsSticky) {
+        dvmHeapSourceZeroMarkBitmap();
+        gcHeap->markBitsSticky = false;
+    }
     if (!createMarkStack(&ctx->stack)) {
         return false;
     }
+    memset(&gcHeap->referenceStats, 0, sizeof(gcHeap->referenceStats));
+    memset(&gcHeap->cardStats, 0, sizeof(gcHeap->cardStats));
     ctx->finger = NULL;
     ctx->immuneLimit = (char*)dvmHeapSourceGetImmuneLimit(isPartial);
+    ctx->parallel = dvmGcWorkerCount() > 1 && initMarkWorkers();
+    ctx->worker = NULL;
+    /* a young collection does not scan the survivors */
+    ctx->countLive = gDvm.loaderAccounting && !isYoung;
+    ctx->countBase = (char*)dvmHeapSourceGetImmuneLimit(true);
     return true;
 }
 
@@ -113,6 +287,12 @@ static void markObjectNonNull(const Object *obj, GcMarkContext *ctx,
         assert(isMarked(obj, ctx));
         return;
     }
+    if (ctx->worker != NULL) {
+        if (!dvmHeapBitmapAtomicSetAndReturnObjectBit(ctx->bitmap, obj)) {
+            markWorkerPush(ctx->worker, obj);
+        }
+        return;
+    }
     if (!setAndReturnMarkBit(ctx, obj)) {
         /* This object was not previously marked.
          */
@@ -137,6 +317,38 @@ static void markObject(const Object *obj, GcMarkContext *ctx)
     }
 }
 
+/*
+ * Marking mostly waits on cache misses: on the header and class of
+ * each object popped off the mark stack, and on the mark bits of the
+ * objects it refers to.  processMarkStack() passes popped objects
+ * through a FIFO of this many entries, prefetching each object as it
+ * goes in and the class of the next one just before an object is
+ * scanned.
+ */
+#define MARK_PREFETCH_FIFO_SIZE 8  /* must be a power of two */
+
+/*
+ * Reference arrays longer than this prefetch the mark bits of the
+ * element this far ahead of the one being marked.
+ */
+#define MARK_ARRAY_PREFETCH_DISTANCE 16
+
+/*
+ * Prefetches the mark bitmap word of an object, which marking is
+ * about to set.
+ */
+static void prefetchMarkBit(const Object *obj, const GcMarkContext *ctx)
+{
+    if (obj != NULL) {
+        const HeapBitmap *bitmap = ctx->bitmap;
+        uintptr_t offset = (uintptr_t)obj - bitmap->base;
+        __builtin_prefetch(&bitmap->bits[HB_OFFSET_TO_INDEX(offset)], 1);
+    }
+}
+
+static void rootReMarkObjectVisitor(void *addr, u4 thread, RootType type,
+                                    void *arg);
+
 /*
  * Callback applied to root references during the initial root
  * marking.  Marks white objects but does not push them on the mark
@@ -180,9 +392,56 @@ static void rootMarkObjectVisitor(void *addr, u4 thread, RootType type,
  */
 void dvmHeapMarkRootSet()
 {
-    GcHeap *gcHeap = gDvm.gcHeap;
-    dvmMarkImmuneObjects(gcHeap->markContext.immuneLimit);
-    dvmVisitRoots(rootMarkObjectVisitor, &gcHeap->markContext);
+    GcMarkContext *ctx = &gDvm.gcHeap->markContext;
+    dvmMarkImmuneObjects(ctx->immuneLimit);
+    if (ctx->parallel) {
+        /*
+         * Parallel marking starts from the mark stack rather than a
+         * bitmap walk, so push the roots as they are grayed.
+         */
+        ctx->finger = (void *)ULONG_MAX;
+        dvmVisitRoots(rootReMarkObjectVisitor, ctx);
+        ctx->finger = NULL;
+    } else {
+        dvmVisitRoots(rootMarkObjectVisitor, ctx);
+    }
+}
+
+/*
+ * Callback applied to root references at the start of a young
+ * collection.  Marks white objects and pushes them on the mark stack.
+ * Class roots are pushed even if they are old, since class loading and
+ * linking store into class objects without a write barrier.
+ */
+static void rootMarkYoungObjectVisitor(void *addr, u4 thread, RootType type,
+                                       void *arg)
+{
+    assert(addr != NULL);
+    assert(arg != NULL);
+    Object *obj = *(Object **)addr;
+    GcMarkContext *ctx = (GcMarkContext *)arg;
+    if (obj == NULL) {
+        return;
+    }
+    if (type == ROOT_STICKY_CLASS && isMarked(obj, ctx)) {
+        markStackPush(&ctx->stack, obj);
+    } else {
+        markObjectNonNull(obj, ctx, true);
+    }
+}
+
+/*
+ * Marks the roots of a young collection.  The objects that survived
+ * the last GC are already marked and are treated as the old
+ * generation.  Old-to-young references are found through the card
+ * table by dvmHeapScanYoungObjects().
+ */
+void dvmHeapMarkYoungRootSet()
+{
+    GcMarkContext *ctx = &gDvm.gcHeap->markContext;
+    dvmMarkImmuneObjects(ctx->immuneLimit);
+    ctx->finger = (void *)ULONG_MAX;
+    dvmVisitRoots(rootMarkYoungObjectVisitor, ctx);
 }
 
 /*
@@ -289,6 +548,7 @@ static void scanClassObject(const Object *obj, GcMarkContext *ctx)
         markObject((const Object *)asClass->super, ctx);
     }
     markObject((const Object *)asClass->classLoader, ctx);
+    markObject((const Object *)asClass->reflectCache, ctx);
     scanFields(obj, ctx);
     scanStaticFields(asClass, ctx);
     if (asClass->status > CLASS_IDX) {
@@ -309,7 +569,19 @@ static void scanArrayObject(const Object *obj, GcMarkContext *ctx)
     if (IS_CLASS_FLAG_SET(obj->clazz, CLASS_ISOBJECTARRAY)) {
         const ArrayObject *array = (const ArrayObject *)obj;
         const Object **contents = (const Object **)(void *)array->contents;
-        for (size_t i = 0; i < array->length; ++i) {
+        size_t length = array->length;
+        const size_t distance = MARK_ARRAY_PREFETCH_DISTANCE;
+        size_t i = 0;
+        if (length > distance) {
+            for (size_t j = 0; j < distance; ++j) {
+                prefetchMarkBit(contents[j], ctx);
+            }
+            for (; i + distance < length; ++i) {
+                prefetchMarkBit(contents[i + distance], ctx);
+                markObject(contents[i], ctx);
+            }
+        }
+        for (; i < length; ++i) {
             markObject(contents[i], ctx);
         }
     }
@@ -359,6 +631,23 @@ static bool isPhantomReference(const Object *obj)
     return referenceClassFlags(obj) & CLASS_ISPHANTOMREFERENCE;
 }
 
+/*
+ * Returns the kind of a reference object.
+ */
+static GcReferenceKind referenceKind(const Object *obj)
+{
+    if (isSoftReference(obj)) {
+        return GC_REF_SOFT;
+    } else if (isWeakReference(obj)) {
+        return GC_REF_WEAK;
+    } else if (isFinalizerReference(obj)) {
+        return GC_REF_FINALIZER;
+    } else {
+        assert(isPhantomReference(obj));
+        return GC_REF_PHANTOM;
+    }
+}
+
 /*
  * Adds a reference to the tail of a circular queue of references.
  */
@@ -417,18 +706,25 @@ static void delayReferenceReferent(Object *obj, GcMarkContext *ctx)
     Object *pending = dvmGetFieldObject(obj, pendingNextOffset);
     Object *referent = dvmGetFieldObject(obj, referentOffset);
     if (pending == NULL && referent != NULL && !isMarked(referent, ctx)) {
+        GcReferenceKind kind = referenceKind(obj);
         Object **list = NULL;
-        if (isSoftReference(obj)) {
-            list = &gcHeap->softReferences;
-        } else if (isWeakReference(obj)) {
-            list = &gcHeap->weakReferences;
-        } else if (isFinalizerReference(obj)) {
-            list = &gcHeap->finalizerReferences;
-        } else if (isPhantomReference(obj)) {
-            list = &gcHeap->phantomReferences;
+        switch (kind) {
+        case GC_REF_SOFT:      list = &gcHeap->softReferences; break;
+        case GC_REF_WEAK:      list = &gcHeap->weakReferences; break;
+        case GC_REF_FINALIZER: list = &gcHeap->finalizerReferences; break;
+        case GC_REF_PHANTOM:   list = &gcHeap->phantomReferences; break;
+        default:               break;
         }
         assert(list != NULL);
-        enqueuePendingReference(obj, list);
+        if (ctx->worker != NULL) {
+            dvmLockMutex(&ctx->worker->pm->lock);
+            enqueuePendingReference(obj, list);
+            gcHeap->referenceStats.found[kind]++;
+            dvmUnlockMutex(&ctx->worker->pm->lock);
+        } else {
+            enqueuePendingReference(obj, list);
+            gcHeap->referenceStats.found[kind]++;
+        }
     }
 }
 
@@ -451,7 +747,7 @@ static void scanDataObject(const Object *obj, GcMarkContext *ctx)
  * Scans an object reference.  Determines the type of the reference
  * and dispatches to a specialized scanning routine.
  */
-static void scanObject(const Object *obj, GcMarkContext *ctx)
+static void scanObjectFields(const Object *obj, GcMarkContext *ctx)
 {
     assert(obj != NULL);
     assert(obj->clazz != NULL);
@@ -464,6 +760,234 @@ static void scanObject(const Object *obj, GcMarkContext *ctx)
     }
 }
 
+static size_t objectSize(const Object *obj)
+{
+    assert(dvmIsValidObject(obj));
+    assert(dvmIsValidObject((Object *)obj->clazz));
+    if (IS_CLASS_FLAG_SET(obj->clazz, CLASS_ISARRAY)) {
+        return dvmArrayObjectSize((ArrayObject *)obj);
+    } else if (obj->clazz == gDvm.classJavaLangClass) {
+        return dvmClassObjectSize((ClassObject *)obj);
+    } else {
+        return obj->clazz->objectSize;
+    }
+}
+
+/*
+ * Charges a live object to its class for the class loader accounting.
+ * A class object is charged to itself, so that its loader pays for it.
+ * Objects in the zygote heap are shared by every process and are left
+ * out so that full and partial collections agree.
+ */
+static void countLiveObject(const Object *obj, GcMarkContext *ctx)
+{
+    if ((const char *)obj < ctx->countBase) {
+        return;
+    }
+    ClassObject *clazz = obj->clazz;
+    if (clazz == gDvm.classJavaLangClass) {
+        clazz = (ClassObject *)obj;
+    }
+    size_t size = objectSize(obj);
+    if (ctx->worker != NULL) {
+        android_atomic_inc((volatile int32_t *)&clazz->gcLiveObjects);
+        android_atomic_add(size, (volatile int32_t *)&clazz->gcLiveBytes);
+    } else {
+        clazz->gcLiveObjects++;
+        clazz->gcLiveBytes += size;
+    }
+}
+
+/*
+ * Scans a gray object for the first and only time in this collection.
+ * Rescans of objects on dirty cards go to scanObjectFields() directly
+ * so that each object is counted once.
+ */
+static void scanObject(const Object *obj, GcMarkContext *ctx)
+{
+    if (ctx->countLive) {
+        countLiveObject(obj, ctx);
+    }
+    scanObjectFields(obj, ctx);
+}
+
+/*
+ * Moves a batch of objects from the shared stack onto an empty deque.
+ * Returns false if the shared stack was empty.
+ */
+static bool refillFromOverflow(GcParallelMark *pm, GcMarkWorker *worker)
+{
+    if (android_atomic_acquire_load(&pm->overflowCount) == 0) {
+        return false;
+    }
+    GcMarkStack *stack = &pm->ctx->stack;
+    int32_t count = 0;
+    dvmLockMutex(&pm->lock);
+    while (count < MARK_OVERFLOW_BATCH && stack->top > stack->base) {
+        bool pushed = markDequePush(&worker->deque, markStackPop(stack));
+        assert(pushed);
+        (void)pushed;
+        ++count;
+    }
+    android_atomic_add(-count, &pm->overflowCount);
+    dvmUnlockMutex(&pm->lock);
+    return count > 0;
+}
+
+/*
+ * Claims the next unscanned stripe of the immune region and scans the
+ * objects marked in it.  Returns false if no stripes are left.
+ */
+static bool scanImmuneStripe(GcParallelMark *pm, GcMarkContext *ctx)
+{
+    if (pm->nextStripe >= pm->numStripes) {
+        return false;
+    }
+    int32_t stripe = android_atomic_inc(&pm->nextStripe);
+    if (stripe >= pm->numStripes) {
+        return false;
+    }
+    const HeapBitmap *bitmap = ctx->bitmap;
+    size_t end = HB_OFFSET_TO_INDEX((uintptr_t)ctx->immuneLimit - bitmap->base);
+    size_t start = stripe * MARK_STRIPE_WORDS;
+    end = MIN(end, start + MARK_STRIPE_WORDS);
+    unsigned long highBit = 1 << (HB_BITS_PER_WORD - 1);
+    for (size_t i = start; i < end; ++i) {
+        unsigned long word = bitmap->bits[i];
+        uintptr_t ptrBase = HB_INDEX_TO_OFFSET(i) + bitmap->base;
+        while (word != 0) {
+            const int shift = CLZ(word);
+            scanObject((Object *)(ptrBase + shift * HB_OBJECT_ALIGNMENT), ctx);
+            word &= ~(highBit >> shift);
+        }
+    }
+    return true;
+}
+
+/*
+ * Steals an object from any other marking thread.
+ */
+static const Object *stealGrayObject(GcParallelMark *pm, size_t index)
+{
+    for (size_t i = 1; i < pm->numWorkers; ++i) {
+        GcMarkWorker *victim = &pm->workers[(index + i) % pm->numWorkers];
+        const Object *obj = markDequeSteal(&victim->deque);
+        if (obj != NULL) {
+            return obj;
+        }
+    }
+    return NULL;
+}
+
+static bool hasGrayObjects(const GcParallelMark *pm)
+{
+    if (pm->overflowCount != 0) {
+        return true;
+    }
+    for (size_t i = 0; i < pm->numWorkers; ++i) {
+        if (!markDequeIsEmpty(&pm->workers[i].deque)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Called by a marking thread that found no work.  Returns true when
+ * gray objects show up again, or false once every thread is idle,
+ * which means that marking is complete.  An idle thread holds no gray
+ * objects, so when all of them are idle no new ones can appear.
+ */
+static bool awaitGrayObjects(GcParallelMark *pm)
+{
+    android_atomic_inc(&pm->idle);
+    for (;;) {
+        if (android_atomic_acquire_load(&pm->idle) == (int32_t)pm->numWorkers) {
+            return false;
+        }
+        if (hasGrayObjects(pm)) {
+            android_atomic_dec(&pm->idle);
+            return true;
+        }
+        sched_yield();
+    }
+}
+
+static void parallelMarkWorker(size_t index, void *arg)
+{
+    GcParallelMark *pm = (GcParallelMark *)arg;
+    GcMarkWorker *worker = &pm->workers[index];
+    GcMarkContext *ctx = &worker->ctx;
+    for (;;) {
+        const Object *obj;
+        while ((obj = markDequePop(&worker->deque)) != NULL) {
+            scanObject(obj, ctx);
+        }
+        if (refillFromOverflow(pm, worker) || scanImmuneStripe(pm, ctx)) {
+            continue;
+        }
+        obj = stealGrayObject(pm, index);
+        if (obj != NULL) {
+            scanObject(obj, ctx);
+        } else if (!awaitGrayObjects(pm)) {
+            break;
+        }
+    }
+}
+
+/*
+ * Blackens everything reachable from the objects on the mark stack,
+ * and from the immune region if scanImmune is set, using all of the
+ * GC worker threads.
+ */
+static void parallelMark(GcMarkContext *ctx, bool scanImmune)
+{
+    GcParallelMark pm;
+    GcMarkStack *stack = &ctx->stack;
+
+    memset(&pm, 0, sizeof(pm));
+    pm.ctx = ctx;
+    pm.numWorkers = dvmGcWorkerCount();
+    pm.workers = gMarkWorkers;
+    dvmInitMutex(&pm.lock);
+    if (scanImmune && ctx->immuneLimit != NULL) {
+        size_t words = HB_OFFSET_TO_INDEX((uintptr_t)ctx->immuneLimit -
+                                          ctx->bitmap->base);
+        pm.numStripes = (words + MARK_STRIPE_WORDS - 1) / MARK_STRIPE_WORDS;
+    }
+    for (size_t i = 0; i < pm.numWorkers; ++i) {
+        GcMarkWorker *worker = &pm.workers[i];
+        memset(&worker->ctx, 0, sizeof(worker->ctx));
+        worker->ctx.bitmap = ctx->bitmap;
+        worker->ctx.immuneLimit = ctx->immuneLimit;
+        worker->ctx.finger = (void *)ULONG_MAX;
+        worker->ctx.worker = worker;
+        worker->ctx.countLive = ctx->countLive;
+        worker->ctx.countBase = ctx->countBase;
+        worker->pm = &pm;
+        worker->deque.top = 0;
+        worker->deque.bottom = 0;
+    }
+
+    /*
+     * Deal the gray objects out to the deques.  Whatever does not fit
+     * stays on the shared stack.
+     */
+    for (size_t i = 0; stack->top > stack->base; ++i) {
+        GcMarkDeque *deque = &pm.workers[i % pm.numWorkers].deque;
+        if (deque->bottom == MARK_DEQUE_SIZE) {
+            break;
+        }
+        deque->slots[deque->bottom++] = markStackPop(stack);
+    }
+    pm.overflowCount = stack->top - stack->base;
+
+    dvmGcWorkersRun(parallelMarkWorker, &pm);
+
+    assert(stack->top == stack->base);
+    dvmDestroyMutex(&pm.lock);
+}
+
 /*
  * Scan anything that's on the mark stack.  We can't use the bitmaps
  * anymore, so use a finger that points past the end of them.
@@ -474,22 +998,29 @@ static void processMarkStack(GcMarkContext *ctx)
     assert(ctx->finger == (void *)ULONG_MAX);
     assert(ctx->stack.top >= ctx->stack.base);
     GcMarkStack *stack = &ctx->stack;
-    while (stack->top > stack->base) {
-        const Object *obj = markStackPop(stack);
-        scanObject(obj, ctx);
+    if (ctx->parallel && stack->top > stack->base) {
+        parallelMark(ctx, false);
+        return;
     }
-}
-
-static size_t objectSize(const Object *obj)
-{
-    assert(dvmIsValidObject(obj));
-    assert(dvmIsValidObject((Object *)obj->clazz));
-    if (IS_CLASS_FLAG_SET(obj->clazz, CLASS_ISARRAY)) {
-        return dvmArrayObjectSize((ArrayObject *)obj);
-    } else if (obj->clazz == gDvm.classJavaLangClass) {
-        return dvmClassObjectSize((ClassObject *)obj);
-    } else {
-        return obj->clazz->objectSize;
+    const Object *fifo[MARK_PREFETCH_FIFO_SIZE];
+    size_t head = 0, count = 0;
+    for (;;) {
+        while (count < MARK_PREFETCH_FIFO_SIZE && stack->top > stack->base) {
+            const Object *obj = markStackPop(stack);
+            __builtin_prefetch(obj);
+            fifo[(head + count) & (MARK_PREFETCH_FIFO_SIZE - 1)] = obj;
+            ++count;
+        }
+        if (count == 0) {
+            break;
+        }
+        const Object *obj = fifo[head];
+        head = (head + 1) & (MARK_PREFETCH_FIFO_SIZE - 1);
+        --count;
+        if (count > 0) {
+            __builtin_prefetch(fifo[head]->clazz);
+        }
+        scanObject(obj, ctx);
     }
 }
 
@@ -514,18 +1045,22 @@ static Object *nextGrayObject(const u1 *base, const u1 *limit,
 /*
  * Scans range of dirty cards between start and end.  A range of dirty
  * cards is composed consecutively dirty cards or dirty cards spanned
- * by a gray object.  Returns the address of a clean card if the scan
- * reached a clean card or NULL if the scan reached the end.
+ * by a gray object; "value" is the card value taken as dirty.  Returns
+ * the address of a clean card if the scan reached a clean card or NULL
+ * if the scan reached the end.  Adds the cards and the bytes of the
+ * objects scanned to the counts.
  */
-const u1 *scanDirtyCards(const u1 *start, const u1 *end,
-                         GcMarkContext *ctx)
+static const u1 *scanDirtyCards(const u1 *start, const u1 *end, u1 value,
+                                GcMarkContext *ctx, size_t *numCards,
+                                size_t *numBytes)
 {
     const HeapBitmap *markBits = ctx->bitmap;
     const u1 *card = start, *prevAddr = NULL;
     while (card < end) {
-        if (*card != GC_CARD_DIRTY) {
+        if (*card != value) {
             return card;
         }
+        ++*numCards;
         const u1 *ptr = prevAddr ? prevAddr : (u1*)dvmAddrFromCard(card);
         const u1 *limit = ptr + GC_CARD_SIZE;
         while (ptr < limit) {
@@ -533,8 +1068,10 @@ const u1 *scanDirtyCards(const u1 *start, const u1 *end,
             if (obj == NULL) {
                 break;
             }
-            scanObject(obj, ctx);
-            ptr = (u1*)obj + ALIGN_UP(objectSize(obj), HB_OBJECT_ALIGNMENT);
+            scanObjectFields(obj, ctx);
+            size_t size = objectSize(obj);
+            *numBytes += size;
+            ptr = (u1*)obj + ALIGN_UP(size, HB_OBJECT_ALIGNMENT);
         }
         if (ptr < limit) {
             /* Ended within the current card, advance to the next card. */
@@ -550,25 +1087,24 @@ const u1 *scanDirtyCards(const u1 *start, const u1 *end,
 }
 
 /*
- * Blackens gray objects found on dirty cards.
+ * Blackens gray objects found on the cards in [base, limit) that hold
+ * "value".  memchr() skips the clean runs in between many bytes at a
+ * time.
  */
-static void scanGrayObjects(GcMarkContext *ctx)
+static void scanGrayCards(const u1 *base, const u1 *limit, u1 value,
+                          GcMarkContext *ctx, size_t *numCards,
+                          size_t *numBytes)
 {
-    GcHeap *h = gDvm.gcHeap;
-    const u1 *base, *limit, *ptr, *dirty;
-
-    base = &h->cardTableBase[0];
-    limit = dvmCardFromAddr((u1 *)dvmHeapSourceGetLimit());
-    assert(limit <= &h->cardTableBase[h->cardTableLength]);
+    const u1 *ptr, *dirty;
 
     ptr = base;
     for (;;) {
-        dirty = (const u1 *)memchr(ptr, GC_CARD_DIRTY, limit - ptr);
+        dirty = (const u1 *)memchr(ptr, value, limit - ptr);
         if (dirty == NULL) {
             break;
         }
-        assert((dirty > ptr) && (dirty < limit));
-        ptr = scanDirtyCards(dirty, limit, ctx);
+        assert((dirty >= ptr) && (dirty < limit));
+        ptr = scanDirtyCards(dirty, limit, value, ctx, numCards, numBytes);
         if (ptr == NULL) {
             break;
         }
@@ -576,6 +1112,44 @@ static void scanGrayObjects(GcMarkContext *ctx)
     }
 }
 
+/*
+ * Finds the [base, limit) ranges of the cards that cover the heaps and
+ * the arena space, which lies past the end of the heaps.  Returns the
+ * number of ranges.
+ */
+static size_t getCardRanges(u1 *bases[2], u1 *limits[2])
+{
+    GcHeap *h = gDvm.gcHeap;
+    size_t count = 0;
+    bases[count] = &h->cardTableBase[0];
+    limits[count] = dvmCardFromAddr((u1 *)dvmHeapSourceGetLimit());
+    assert(limits[count] <= &h->cardTableBase[h->cardTableLength]);
+    ++count;
+
+    uintptr_t arenaBase, arenaMax;
+    if (dvmHeapSourceGetArenaRegion(&arenaBase, &arenaMax)) {
+        bases[count] = dvmCardFromAddr((u1 *)arenaBase);
+        limits[count] = dvmCardFromAddr((u1 *)arenaMax) + 1;
+        assert(limits[count] <= &h->cardTableBase[h->cardTableLength]);
+        ++count;
+    }
+    return count;
+}
+
+/*
+ * Blackens gray objects found on dirty cards.
+ */
+static void scanGrayObjects(GcMarkContext *ctx)
+{
+    GcCardStats *stats = &gDvm.gcHeap->cardStats;
+    u1 *bases[2], *limits[2];
+    size_t count = getCardRanges(bases, limits);
+    for (size_t i = 0; i < count; ++i) {
+        scanGrayCards(bases[i], limits[i], GC_CARD_DIRTY, ctx,
+                      &stats->dirtyCards, &stats->dirtyBytes);
+    }
+}
+
 /*
  * Callback for scanning each object in the bitmap.  The finger is set
  * to the address corresponding to the lowest address in the next word
@@ -598,6 +1172,14 @@ void dvmHeapScanMarkedObjects(void)
 
     assert(ctx->finger == NULL);
 
+    if (ctx->parallel) {
+        /* dvmHeapMarkRootSet() left the roots on the mark stack.
+         */
+        ctx->finger = (void *)ULONG_MAX;
+        parallelMark(ctx, true);
+        return;
+    }
+
     /* The bitmaps currently have bits set for the root set.
      * Walk across the bitmaps and scan each object.
      */
@@ -611,6 +1193,73 @@ void dvmHeapScanMarkedObjects(void)
     processMarkStack(ctx);
 }
 
+/*
+ * Marks all young objects reachable from the roots or from old objects
+ * on dirty cards.  Every store of a young reference into an old object
+ * has dirtied a card since the last GC.  The world is suspended, so
+ * the cards are cleared once they are scanned: the young objects they
+ * lead to become old themselves.
+ */
+void dvmHeapScanYoungObjects()
+{
+    GcMarkContext *ctx = &gDvm.gcHeap->markContext;
+
+    assert(ctx->finger == (void *)ULONG_MAX);
+    scanGrayObjects(ctx);
+    dvmClearCardTable();
+    processMarkStack(ctx);
+}
+
+/*
+ * Rescans the objects on the cards dirtied so far, with the mutators
+ * running, so that the final pause of a concurrent GC only has to look
+ * at the cards dirtied after this.  Replaces clearing the card table
+ * in the initial pause.
+ *
+ * The dirty cards are aged first.  A store made after that dirties its
+ * card again, and is left for dvmHeapReScanMarkedObjects().  A brief
+ * suspension then makes the references stored before the aging visible
+ * to us; only the card store of the write barrier is ordered after the
+ * reference store, not the other way around.  Once the objects on the
+ * aged cards are rescanned, the cards that are still aged are cleaned.
+ */
+void dvmHeapPrecleanCards()
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    GcMarkContext *ctx = &gcHeap->markContext;
+    GcCardStats *stats = &gcHeap->cardStats;
+
+    assert(ctx->finger == (void *)ULONG_MAX);
+    u1 *bases[2], *limits[2];
+    size_t count = getCardRanges(bases, limits);
+    size_t aged = 0;
+    for (size_t i = 0; i < count; ++i) {
+        aged += dvmAgeCards(bases[i], limits[i]);
+    }
+    if (aged == 0) {
+        return;
+    }
+
+    dvmLockHeap();
+    dvmSuspendAllThreads(SUSPEND_FOR_GC);
+    /*
+     * Cards are about to be cleaned, so open arenas can no longer
+     * trust them to record every store made into their objects.
+     */
+    gcHeap->cardTableClears++;
+    dvmResumeAllThreads(SUSPEND_FOR_GC);
+    dvmUnlockHeap();
+
+    for (size_t i = 0; i < count; ++i) {
+        scanGrayCards(bases[i], limits[i], GC_CARD_AGED, ctx,
+                      &stats->precleanedCards, &stats->precleanedBytes);
+    }
+    processMarkStack(ctx);
+    for (size_t i = 0; i < count; ++i) {
+        dvmCleanAgedCards(bases[i], limits[i]);
+    }
+}
+
 void dvmHeapReScanMarkedObjects()
 {
     GcMarkContext *ctx = &gDvm.gcHeap->markContext;
@@ -662,9 +1311,11 @@ static void enqueueReference(Object *ref)
  * Walks the reference list marking any references subject to the
  * reference clearing policy.  References with a black referent are
  * removed from the list.  References with white referents biased
- * toward saving are blackened and also removed from the list.
+ * toward saving are blackened and also removed from the list.  The
+ * remaining references, whose referents are white, are moved to the
+ * "white" list, which may be the same list.
  */
-static void preserveSomeSoftReferences(Object **list)
+static void preserveSomeSoftReferences(Object **list, Object **white)
 {
     assert(list != NULL);
     GcMarkContext *ctx = &gDvm.gcHeap->markContext;
@@ -689,7 +1340,9 @@ static void preserveSomeSoftReferences(Object **list)
             enqueuePendingReference(ref, &clear);
         }
     }
-    *list = clear;
+    while (clear != NULL) {
+        enqueuePendingReference(dequeuePendingReference(&clear), white);
+    }
     /*
      * Restart the mark with the newly black references added to the
      * root set.
@@ -716,6 +1369,7 @@ static void clearWhiteReferences(Object **list)
             if (isEnqueuable(ref)) {
                 enqueueReference(ref);
             }
+            gDvm.gcHeap->referenceStats.cleared[referenceKind(ref)]++;
         }
     }
     assert(*list == NULL);
@@ -743,6 +1397,8 @@ static void enqueueFinalizerReferences(Object **list)
             dvmSetFieldObject(ref, zombieOffset, referent);
             clearReference(ref);
             enqueueReference(ref);
+            dvmAddToReferenceTable(&gDvm.gcHeap->pendingFinalizations, ref);
+            gDvm.gcHeap->referenceStats.cleared[GC_REF_FINALIZER]++;
             hasEnqueued = true;
         }
     }
@@ -752,6 +1408,71 @@ static void enqueueFinalizerReferences(Object **list)
     assert(*list == NULL);
 }
 
+/*
+ * Drops the references whose finalizer has run, which have had their
+ * zombie field cleared, from the pending finalization table and sums
+ * the sizes of the referents that are left.  During a GC "ctx" is the
+ * mark context and unmarked references are dropped too, as they are
+ * about to be swept.  Between collections "ctx" is NULL; every entry
+ * survived the last GC and is still a valid object.  Caller must hold
+ * the heap lock.
+ */
+static void updatePendingFinalizations(const GcMarkContext *ctx)
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    ReferenceTable *table = &gcHeap->pendingFinalizations;
+    size_t zombieOffset = gDvm.offJavaLangRefFinalizerReference_zombie;
+    size_t bytes = 0;
+    Object **dst = table->table;
+    for (Object **src = table->table; src < table->nextEntry; ++src) {
+        Object *ref = *src;
+        if (ctx != NULL && ref >= (Object *)ctx->immuneLimit &&
+            !isMarked(ref, ctx)) {
+            continue;
+        }
+        Object *zombie = dvmGetFieldObject(ref, zombieOffset);
+        if (zombie == NULL) {
+            continue;
+        }
+        bytes += dvmObjectSizeInHeap(zombie);
+        *dst++ = ref;
+    }
+    table->nextEntry = dst;
+    gcHeap->pendingFinalizerBytes = bytes;
+}
+
+/*
+ * Slows down a thread that creates finalizable objects while more than
+ * -XX:MaxPendingFinalizers finalizations are waiting to run, so that
+ * the finalizer daemon can catch up before the backlog grows further.
+ * The wait is bounded so that a stuck finalizer cannot stall the
+ * allocating thread for good.
+ */
+static void throttleFinalizableAllocation(Thread *self)
+{
+    enum { kBackoffTries = 10, kBackoffUsec = 1000 };
+    GcHeap *gcHeap = gDvm.gcHeap;
+    size_t limit = gDvm.maxPendingFinalizers;
+    /* Unlocked peek; a stale count only delays or skips one wait. */
+    if (limit == 0 ||
+        dvmReferenceTableEntries(&gcHeap->pendingFinalizations) <= limit) {
+        return;
+    }
+    for (int i = 0; i < kBackoffTries; ++i) {
+        ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+        usleep(kBackoffUsec);
+        dvmChangeStatus(self, oldStatus);
+        dvmLockHeap();
+        updatePendingFinalizations(NULL);
+        size_t pending = dvmReferenceTableEntries(&gcHeap->pendingFinalizations);
+        dvmMetricsRecordFinalizers(0, pending, gcHeap->pendingFinalizerBytes);
+        dvmUnlockHeap();
+        if (pending <= limit) {
+            break;
+        }
+    }
+}
+
 /*
  * This object is an instance of a class that overrides finalize().  Mark
  * it as finalizable.
@@ -764,12 +1485,30 @@ void dvmSetFinalizable(Object *obj)
     assert(obj != NULL);
     Thread *self = dvmThreadSelf();
     assert(self != NULL);
+    throttleFinalizableAllocation(self);
     Method *meth = gDvm.methJavaLangRefFinalizerReferenceAdd;
     assert(meth != NULL);
     JValue unusedResult;
     dvmCallMethod(self, meth, NULL, &unusedResult, obj);
 }
 
+/*
+ * Preserves some soft referents while the mutators are running, after
+ * the concurrent mark.  Marking more objects than strictly necessary
+ * is always safe, and the objects traced from the preserved referents
+ * are on dirty cards if a mutator changes them, so the final pause only
+ * has to deal with the references discovered after this point.  The
+ * soft references left for clearing are moved to the weak list, where
+ * they are subject to the same processing as weak references.
+ */
+void dvmHeapPreserveSoftReferences(Object **softReferences,
+                                   Object **weakReferences)
+{
+    assert(softReferences != NULL);
+    assert(weakReferences != NULL);
+    preserveSomeSoftReferences(softReferences, weakReferences);
+}
+
 /*
  * Process reference class instances and schedule finalizations.
  */
@@ -788,7 +1527,7 @@ void dvmHeapProcessReferences(Object **softReferences, bool clearSoftRefs,
      * referents.
      */
     if (!gDvm.zygote && !clearSoftRefs) {
-        preserveSomeSoftReferences(softReferences);
+        preserveSomeSoftReferences(softReferences, softReferences);
     }
     /*
      * Clear all remaining soft and weak references with white
@@ -811,6 +1550,15 @@ void dvmHeapProcessReferences(Object **softReferences, bool clearSoftRefs,
      * Clear all phantom references with white referents.
      */
     clearWhiteReferences(phantomReferences);
+    /*
+     * Forget the finalizations that have run and count the backlog,
+     * including the references just enqueued.
+     */
+    GcHeap *gcHeap = gDvm.gcHeap;
+    updatePendingFinalizations(&gcHeap->markContext);
+    dvmMetricsRecordFinalizers(gcHeap->referenceStats.cleared[GC_REF_FINALIZER],
+                               dvmReferenceTableEntries(&gcHeap->pendingFinalizations),
+                               gcHeap->pendingFinalizerBytes);
     /*
      * At this point all reference lists should be empty.
      */
@@ -838,13 +1586,32 @@ void dvmEnqueueClearedReferences(Object **cleared)
     }
 }
 
+/*
+ * Called once every unmarked object has been swept.  The sweep also
+ * clears the bits of the swept objects in the previous live bits, the
+ * current mark bits, so with generational collection those now hold
+ * exactly the survivors and are kept for the next young collection.
+ */
+static void finishSweep()
+{
+    if (gDvm.generationalGc) {
+        gDvm.gcHeap->markBitsSticky = true;
+    } else {
+        dvmHeapSourceZeroMarkBitmap();
+    }
+}
+
 void dvmHeapFinishMarkStep()
 {
     GcMarkContext *ctx = &gDvm.gcHeap->markContext;
 
-    /* The mark bits are now not needed.
+    /* The mark bits are now not needed, unless a lazy sweep still
+     * has to compare them against the live bits or they are kept for
+     * the next young collection.
      */
-    dvmHeapSourceZeroMarkBitmap();
+    if (!dvmHeapIsLazySweepPending()) {
+        finishSweep();
+    }
 
     /* Clean up everything else associated with the marking process.
      */
@@ -857,6 +1624,10 @@ struct SweepContext {
     size_t numObjects;
     size_t numBytes;
     bool isConcurrent;
+    /* Serializes frees between sweeping threads when the heap lock
+     * is held on their behalf; NULL when sweeping on one thread.
+     */
+    pthread_mutex_t *lock;
 };
 
 static void sweepBitmapCallback(size_t numPtrs, void **ptrs, void *arg)
@@ -865,11 +1636,109 @@ static void sweepBitmapCallback(size_t numPtrs, void **ptrs, void *arg)
     SweepContext *ctx = (SweepContext *)arg;
     if (ctx->isConcurrent) {
         dvmLockHeap();
+    } else if (ctx->lock != NULL) {
+        dvmLockMutex(ctx->lock);
     }
     ctx->numBytes += dvmHeapSourceFreeList(numPtrs, ptrs);
     ctx->numObjects += numPtrs;
     if (ctx->isConcurrent) {
         dvmUnlockHeap();
+    } else if (ctx->lock != NULL) {
+        dvmUnlockMutex(ctx->lock);
+    }
+}
+
+/*
+ * The sweep divides the heaps into stripes of this many bytes.  The
+ * parallel sweep hands them out to the GC worker threads, the lazy
+ * sweep reclaims them one at a time.  Heap bases are page aligned, so
+ * every stripe starts on a bitmap word boundary.
+ */
+#define SWEEP_STRIPE_SIZE (256 * 1024)
+
+/*
+ * The heaps to sweep, followed by the large object space and the arena
+ * space if there are any.  Neither of those is ever immune.
+ */
+struct SweepRegions {
+    size_t numRegions;
+    uintptr_t base[HEAP_SOURCE_MAX_HEAP_COUNT + 2];
+    uintptr_t max[HEAP_SOURCE_MAX_HEAP_COUNT + 2];
+};
+
+static void getSweepRegions(bool isPartial, SweepRegions *regions)
+{
+    size_t numHeaps = dvmHeapSourceGetNumHeaps();
+    dvmHeapSourceGetRegions(regions->base, regions->max, numHeaps);
+    if (isPartial) {
+        assert((uintptr_t)gDvm.gcHeap->markContext.immuneLimit == regions->base[0]);
+        regions->numRegions = 1;
+    } else {
+        regions->numRegions = numHeaps;
+    }
+    size_t i = regions->numRegions;
+    if (dvmHeapSourceGetLargeObjectRegion(&regions->base[i],
+                                          &regions->max[i])) {
+        regions->numRegions++;
+    }
+    i = regions->numRegions;
+    if (dvmHeapSourceGetArenaRegion(&regions->base[i], &regions->max[i])) {
+        regions->max[i] = MIN(regions->max[i], dvmHeapSourceGetMarkBits()->max);
+        regions->numRegions++;
+    }
+}
+
+/*
+ * Finds the address range of the given stripe, numbering the stripes
+ * of all heaps consecutively starting with the active heap.  Returns
+ * false if there is no such stripe.
+ */
+static bool getSweepStripe(const SweepRegions *regions, size_t stripe,
+                           uintptr_t *start, uintptr_t *end)
+{
+    for (size_t i = 0; i < regions->numRegions; ++i) {
+        if (regions->max[i] < regions->base[i]) {
+            /* Nothing was ever allocated in this region. */
+            continue;
+        }
+        size_t numStripes =
+            (regions->max[i] - regions->base[i]) / SWEEP_STRIPE_SIZE + 1;
+        if (stripe < numStripes) {
+            *start = regions->base[i] + stripe * SWEEP_STRIPE_SIZE;
+            *end = MIN(*start + SWEEP_STRIPE_SIZE - 1, regions->max[i]);
+            return true;
+        }
+        stripe -= numStripes;
+    }
+    return false;
+}
+
+static void sweepStripe(uintptr_t start, uintptr_t end, SweepContext *ctx)
+{
+    /* The bitmaps have been swapped. */
+    HeapBitmap *prevLive = dvmHeapSourceGetMarkBits();
+    HeapBitmap *prevMark = dvmHeapSourceGetLiveBits();
+    dvmHeapBitmapSweepWalk(prevLive, prevMark, start, end,
+                           sweepBitmapCallback, ctx);
+}
+
+struct GcParallelSweep {
+    SweepRegions regions;
+    volatile int32_t nextStripe;
+    pthread_mutex_t lock;
+    SweepContext ctx[GC_MAX_WORKERS];
+};
+
+static void parallelSweepWorker(size_t index, void *arg)
+{
+    GcParallelSweep *ps = (GcParallelSweep *)arg;
+    uintptr_t start, end;
+    for (;;) {
+        int32_t stripe = android_atomic_inc(&ps->nextStripe);
+        if (!getSweepStripe(&ps->regions, stripe, &start, &end)) {
+            break;
+        }
+        sweepStripe(start, end, &ps->ctx[index]);
     }
 }
 
@@ -882,15 +1751,16 @@ static int isUnmarkedObject(void *obj)
     return !isMarked((Object *)obj, &gDvm.gcHeap->markContext);
 }
 
-static void sweepWeakJniGlobals()
+static void sweepWeakJniGlobals(int (*isDead)(void *))
 {
-    IndirectRefTable* table = &gDvm.jniWeakGlobalRefTable;
-    GcMarkContext* ctx = &gDvm.gcHeap->markContext;
-    typedef IndirectRefTable::iterator It; // TODO: C++0x auto
-    for (It it = table->begin(), end = table->end(); it != end; ++it) {
-        Object** entry = *it;
-        if (!isMarked(*entry, ctx)) {
-            *entry = kClearedJniWeakGlobal;
+    for (size_t i = 0; i < kIndirectRefShardCount; i++) {
+        IndirectRefTable* table = &gDvm.jniWeakGlobalRefs[i].table;
+        typedef IndirectRefTable::iterator It; // TODO: C++0x auto
+        for (It it = table->begin(), end = table->end(); it != end; ++it) {
+            Object** entry = *it;
+            if (isDead(*entry)) {
+                *entry = kClearedJniWeakGlobal;
+            }
         }
     }
 }
@@ -903,7 +1773,34 @@ void dvmHeapSweepSystemWeaks()
 {
     dvmGcDetachDeadInternedStrings(isUnmarkedObject);
     dvmSweepMonitorList(&gDvm.monitorList, isUnmarkedObject);
-    sweepWeakJniGlobals();
+    dvmDeflateMonitorList(&gDvm.monitorList);
+    sweepWeakJniGlobals(isUnmarkedObject);
+    dvmMetricsSweepLoaderUsage(isUnmarkedObject);
+    dvmFreeRetiredClassTableMemory();
+}
+
+/* The range being dropped by dvmHeapSweepSystemWeaksInRange(). */
+static const void *gWeakRangeBase;
+static const void *gWeakRangeLimit;
+
+static int isObjectInWeakRange(void *obj)
+{
+    return obj >= gWeakRangeBase && obj < gWeakRangeLimit;
+}
+
+/*
+ * Like dvmHeapSweepSystemWeaks(), but treats the objects in [base,
+ * limit) as the dead ones and leaves the rest alone.  The caller holds
+ * the heap lock with all threads suspended.
+ */
+void dvmHeapSweepSystemWeaksInRange(const void *base, const void *limit)
+{
+    gWeakRangeBase = base;
+    gWeakRangeLimit = limit;
+    dvmGcDetachDeadInternedStrings(isObjectInWeakRange);
+    dvmSweepMonitorList(&gDvm.monitorList, isObjectInWeakRange);
+    sweepWeakJniGlobals(isObjectInWeakRange);
+    dvmMetricsSweepLoaderUsage(isObjectInWeakRange);
 }
 
 /*
@@ -913,32 +1810,106 @@ void dvmHeapSweepSystemWeaks()
 void dvmHeapSweepUnmarkedObjects(bool isPartial, bool isConcurrent,
                                  size_t *numObjects, size_t *numBytes)
 {
-    uintptr_t base[HEAP_SOURCE_MAX_HEAP_COUNT];
-    uintptr_t max[HEAP_SOURCE_MAX_HEAP_COUNT];
-    SweepContext ctx;
-    HeapBitmap *prevLive, *prevMark;
-    size_t numHeaps, numSweepHeaps;
+    GcParallelSweep ps;
+    size_t numWorkers = dvmGcWorkerCount();
+
+    memset(&ps, 0, sizeof(ps));
+    getSweepRegions(isPartial, &ps.regions);
+    dvmInitMutex(&ps.lock);
+    for (size_t i = 0; i < numWorkers; ++i) {
+        ps.ctx[i].isConcurrent = isConcurrent;
+        ps.ctx[i].lock = (numWorkers > 1) ? &ps.lock : NULL;
+    }
+    dvmGcWorkersRun(parallelSweepWorker, &ps);
+    dvmDestroyMutex(&ps.lock);
 
-    numHeaps = dvmHeapSourceGetNumHeaps();
-    dvmHeapSourceGetRegions(base, max, numHeaps);
-    if (isPartial) {
-        assert((uintptr_t)gDvm.gcHeap->markContext.immuneLimit == base[0]);
-        numSweepHeaps = 1;
-    } else {
-        numSweepHeaps = numHeaps;
-    }
-    ctx.numObjects = ctx.numBytes = 0;
-    ctx.isConcurrent = isConcurrent;
-    prevLive = dvmHeapSourceGetMarkBits();
-    prevMark = dvmHeapSourceGetLiveBits();
-    for (size_t i = 0; i < numSweepHeaps; ++i) {
-        dvmHeapBitmapSweepWalk(prevLive, prevMark, base[i], max[i],
-                               sweepBitmapCallback, &ctx);
-    }
-    *numObjects = ctx.numObjects;
-    *numBytes = ctx.numBytes;
+    *numObjects = *numBytes = 0;
+    for (size_t i = 0; i < numWorkers; ++i) {
+        *numObjects += ps.ctx[i].numObjects;
+        *numBytes += ps.ctx[i].numBytes;
+    }
     if (gDvm.allocProf.enabled) {
-        gDvm.allocProf.freeCount += ctx.numObjects;
-        gDvm.allocProf.freeSize += ctx.numBytes;
+        gDvm.allocProf.freeCount += *numObjects;
+        gDvm.allocProf.freeSize += *numBytes;
+    }
+}
+
+/*
+ * State of a lazy sweep.  Only accessed with the heap lock held.
+ */
+struct GcLazySweep {
+    bool pending;
+    SweepRegions regions;
+    size_t nextStripe;
+    size_t numObjects;
+    size_t numBytes;
+};
+
+static GcLazySweep gLazySweep;
+
+/*
+ * Leaves the unmarked objects in place after a collection.  The
+ * allocator reclaims them a stripe at a time with dvmHeapSweepLazily()
+ * when it runs out of room, and the next collection reclaims whatever
+ * is left before it starts marking.  The mark bits are kept until the
+ * sweep is complete.  Assumes the bitmaps have been swapped.
+ */
+void dvmHeapBeginLazySweep(bool isPartial)
+{
+    assert(!gLazySweep.pending);
+    getSweepRegions(isPartial, &gLazySweep.regions);
+    gLazySweep.nextStripe = 0;
+    gLazySweep.numObjects = 0;
+    gLazySweep.numBytes = 0;
+    gLazySweep.pending = true;
+}
+
+bool dvmHeapIsLazySweepPending()
+{
+    return gLazySweep.pending;
+}
+
+/*
+ * Reclaims the next stripe of a pending lazy sweep.  Once the last one
+ * is reclaimed the mark bits are cleared and the heap is resized for
+ * the new utilization.  Returns false if no sweep was pending.
+ */
+bool dvmHeapSweepLazily()
+{
+    if (!gLazySweep.pending) {
+        return false;
+    }
+    uintptr_t start, end;
+    if (getSweepStripe(&gLazySweep.regions, gLazySweep.nextStripe,
+                       &start, &end)) {
+        SweepContext ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        sweepStripe(start, end, &ctx);
+        gLazySweep.numObjects += ctx.numObjects;
+        gLazySweep.numBytes += ctx.numBytes;
+        ++gLazySweep.nextStripe;
+    }
+    if (!getSweepStripe(&gLazySweep.regions, gLazySweep.nextStripe,
+                        &start, &end)) {
+        LOGD_HEAP("Lazy sweep freed %zd objects, %zd bytes",
+                  gLazySweep.numObjects, gLazySweep.numBytes);
+        if (gDvm.allocProf.enabled) {
+            gDvm.allocProf.freeCount += gLazySweep.numObjects;
+            gDvm.allocProf.freeSize += gLazySweep.numBytes;
+        }
+        gLazySweep.pending = false;
+        finishSweep();
+        dvmHeapSourceGrowForUtilization();
+    }
+    return true;
+}
+
+/*
+ * Reclaims everything left by a pending lazy sweep.
+ */
+void dvmHeapFinishLazySweep()
+{
+    while (gLazySweep.pending) {
+        dvmHeapSweepLazily();
     }
 }
@@ -37,6 +37,8 @@ struct GcMarkStack {
     size_t length;
 };
 
+struct GcMarkWorker;
+
 /* This is declared publicly so that it can be included in gDvm.gcHeap.
  */
 struct GcMarkContext {
@@ -44,21 +46,67 @@ struct GcMarkContext {
     GcMarkStack stack;
     const char *immuneLimit;
     const void *finger;   // only used while scanning/recursing.
+    bool parallel;        // mark with the GC worker threads this cycle.
+    GcMarkWorker *worker; // set only on a parallel marking thread's copy.
+    bool countLive;       // charge scanned objects to their class.
+    const char *countBase; // ...if they are at or above this address.
+};
+
+/* The kinds of reference the collector discovers while tracing.
+ */
+enum GcReferenceKind {
+    GC_REF_SOFT,
+    GC_REF_WEAK,
+    GC_REF_FINALIZER,
+    GC_REF_PHANTOM,
+    GC_REF_KINDS
+};
+
+/* Reference processing statistics of the current GC, for the log line.
+ * A reference is found when it is discovered with a white referent;
+ * finalizer references are "cleared" when they are enqueued.
+ */
+struct GcReferenceStats {
+    size_t found[GC_REF_KINDS];
+    size_t cleared[GC_REF_KINDS];
+    u4 concurrentMsec;
+    u4 pausedMsec;
+};
+
+/* Card scanning statistics of the current GC, for the log line.  The
+ * precleaned cards were rescanned while the mutators were running, the
+ * dirty cards while they were suspended.
+ */
+struct GcCardStats {
+    size_t precleanedCards;
+    size_t precleanedBytes;
+    size_t dirtyCards;
+    size_t dirtyBytes;
 };
 
-bool dvmHeapBeginMarkStep(bool isPartial);
+bool dvmHeapBeginMarkStep(bool isPartial, bool isYoung);
 void dvmHeapMarkRootSet(void);
+void dvmHeapMarkYoungRootSet(void);
 void dvmHeapReMarkRootSet(void);
 void dvmHeapScanMarkedObjects(void);
+void dvmHeapScanYoungObjects(void);
+void dvmHeapPrecleanCards(void);
 void dvmHeapReScanMarkedObjects(void);
+void dvmHeapPreserveSoftReferences(Object **softReferences,
+                                   Object **weakReferences);
 void dvmHeapProcessReferences(Object **softReferences, bool clearSoftRefs,
                               Object **weakReferences,
                               Object **finalizerReferences,
                               Object **phantomReferences);
 void dvmHeapFinishMarkStep(void);
 void dvmHeapSweepSystemWeaks(void);
+void dvmHeapSweepSystemWeaksInRange(const void *base, const void *limit);
 void dvmHeapSweepUnmarkedObjects(bool isPartial, bool isConcurrent,
                                  size_t *numObjects, size_t *numBytes);
+void dvmHeapBeginLazySweep(bool isPartial);
+bool dvmHeapIsLazySweepPending(void);
+bool dvmHeapSweepLazily(void);
+void dvmHeapFinishLazySweep(void);
 void dvmEnqueueClearedReferences(Object **references);
 
 #endif  // DALVIK_ALLOC_MARK_SWEEP_H_
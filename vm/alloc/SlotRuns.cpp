@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Dalvik.h"
+#include "alloc/SlotRuns.h"
+
+#define SLOT_RUN_MAX_SLOTS    (SLOT_RUN_SIZE >> SLOT_RUN_SIZE_CLASS_SHIFT)
+#define SLOT_RUN_BITMAP_WORDS (SLOT_RUN_MAX_SLOTS / 32)
+
+struct SlotRun {
+    char *base;
+    size_t slotSize;
+    size_t numSlots;
+    size_t numFree;
+
+    /* Neighbours on the list of runs of this size class that have free
+     * slots.
+     */
+    SlotRun *prev;
+    SlotRun *next;
+
+    /* One bit per slot, set if the slot is in use.  The bits past the
+     * last slot are always set.
+     */
+    u4 inUse[SLOT_RUN_BITMAP_WORDS];
+};
+
+struct SlotRuns {
+    mspace msp;
+
+    /* The start of the heap rounded down to a run boundary. */
+    uintptr_t base;
+
+    /* The run, if any, of each SLOT_RUN_SIZE-aligned part of the heap. */
+    SlotRun **table;
+    size_t tableLength;
+
+    /* The runs with free slots, by size class.  Allocation always
+     * takes from the head.
+     */
+    SlotRun *partial[SLOT_RUN_NUM_SIZE_CLASSES];
+};
+
+SlotRuns *dvmSlotRunsCreate(mspace msp, const void *base, size_t length)
+{
+    SlotRuns *runs = (SlotRuns *)calloc(1, sizeof(*runs));
+    if (runs == NULL) {
+        return NULL;
+    }
+    runs->msp = msp;
+    runs->base = (uintptr_t)base & ~(uintptr_t)(SLOT_RUN_SIZE - 1);
+    uintptr_t limit = (uintptr_t)base + length;
+    runs->tableLength = (limit - runs->base + SLOT_RUN_SIZE - 1)
+            >> SLOT_RUN_SHIFT;
+    runs->table = (SlotRun **)calloc(runs->tableLength, sizeof(SlotRun *));
+    if (runs->table == NULL) {
+        free(runs);
+        return NULL;
+    }
+    return runs;
+}
+
+void dvmSlotRunsDestroy(SlotRuns *runs)
+{
+    if (runs == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < runs->tableLength; ++i) {
+        free(runs->table[i]);
+    }
+    free(runs->table);
+    free(runs);
+}
+
+static SlotRun *findRun(const SlotRuns *runs, const void *ptr)
+{
+    if ((uintptr_t)ptr < runs->base) {
+        return NULL;
+    }
+    size_t index = ((uintptr_t)ptr - runs->base) >> SLOT_RUN_SHIFT;
+    if (index >= runs->tableLength) {
+        return NULL;
+    }
+    return runs->table[index];
+}
+
+static void pushPartial(SlotRuns *runs, size_t sizeClass, SlotRun *run)
+{
+    run->prev = NULL;
+    run->next = runs->partial[sizeClass];
+    if (run->next != NULL) {
+        run->next->prev = run;
+    }
+    runs->partial[sizeClass] = run;
+}
+
+static void unlinkPartial(SlotRuns *runs, size_t sizeClass, SlotRun *run)
+{
+    if (run->prev != NULL) {
+        run->prev->next = run->next;
+    } else {
+        assert(runs->partial[sizeClass] == run);
+        runs->partial[sizeClass] = run->next;
+    }
+    if (run->next != NULL) {
+        run->next->prev = run->prev;
+    }
+    run->prev = run->next = NULL;
+}
+
+/*
+ * Carves a new run for a size class out of the mspace and puts it at
+ * the head of the partial list.
+ */
+static SlotRun *newRun(SlotRuns *runs, size_t sizeClass)
+{
+    void *mem = mspace_memalign(runs->msp, SLOT_RUN_SIZE, SLOT_RUN_SIZE);
+    if (mem == NULL) {
+        return NULL;
+    }
+    size_t index = ((uintptr_t)mem - runs->base) >> SLOT_RUN_SHIFT;
+    SlotRun *run = NULL;
+    if (index < runs->tableLength) {
+        run = (SlotRun *)calloc(1, sizeof(*run));
+    }
+    if (run == NULL) {
+        mspace_free(runs->msp, mem);
+        return NULL;
+    }
+    assert(((uintptr_t)mem & (SLOT_RUN_SIZE - 1)) == 0);
+    run->base = (char *)mem;
+    run->slotSize = (sizeClass + 1) << SLOT_RUN_SIZE_CLASS_SHIFT;
+    run->numSlots = SLOT_RUN_SIZE / run->slotSize;
+    run->numFree = run->numSlots;
+    for (size_t i = run->numSlots; i < SLOT_RUN_MAX_SLOTS; ++i) {
+        run->inUse[i / 32] |= 1u << (i % 32);
+    }
+    runs->table[index] = run;
+    pushPartial(runs, sizeClass, run);
+    return run;
+}
+
+static bool isInUse(const SlotRun *run, size_t slot)
+{
+    return (run->inUse[slot / 32] & (1u << (slot % 32))) != 0;
+}
+
+static void setInUse(SlotRun *run, size_t slot)
+{
+    run->inUse[slot / 32] |= 1u << (slot % 32);
+}
+
+/*
+ * Returns the index of the first free slot of a run that is known to
+ * have one.
+ */
+static size_t firstFreeSlot(const SlotRun *run)
+{
+    for (size_t i = 0; i < SLOT_RUN_BITMAP_WORDS; ++i) {
+        u4 bits = ~run->inUse[i];
+        if (bits != 0) {
+            return i * 32 + __builtin_ctz(bits);
+        }
+    }
+    assert(!"no free slot");
+    return 0;
+}
+
+size_t dvmSlotRunsAllocAdjacent(SlotRuns *runs, size_t n, size_t maxSlots,
+                                void **first)
+{
+    assert(first != NULL);
+    if (n == 0 || n > SLOT_RUN_MAX_OBJECT_SIZE || maxSlots == 0) {
+        return 0;
+    }
+    size_t sizeClass = (n - 1) >> SLOT_RUN_SIZE_CLASS_SHIFT;
+    SlotRun *run = runs->partial[sizeClass];
+    if (run == NULL) {
+        run = newRun(runs, sizeClass);
+        if (run == NULL) {
+            return 0;
+        }
+    }
+    assert(run->numFree > 0);
+    size_t slot = firstFreeSlot(run);
+    size_t count = 0;
+    while (count < maxSlots && slot + count < run->numSlots &&
+           !isInUse(run, slot + count)) {
+        setInUse(run, slot + count);
+        ++count;
+    }
+    run->numFree -= count;
+    if (run->numFree == 0) {
+        unlinkPartial(runs, sizeClass, run);
+    }
+    *first = run->base + slot * run->slotSize;
+    memset(*first, 0, count * run->slotSize);
+    return count;
+}
+
+void *dvmSlotRunsAlloc(SlotRuns *runs, size_t n)
+{
+    void *ptr;
+    if (dvmSlotRunsAllocAdjacent(runs, n, 1, &ptr) == 0) {
+        return NULL;
+    }
+    return ptr;
+}
+
+size_t dvmSlotRunsSlotSize(const SlotRuns *runs, const void *ptr)
+{
+    const SlotRun *run = findRun(runs, ptr);
+    return run != NULL ? run->slotSize : 0;
+}
+
+void dvmSlotRunsFree(SlotRuns *runs, void *ptr)
+{
+    SlotRun *run = findRun(runs, ptr);
+    assert(run != NULL);
+    size_t slot = ((char *)ptr - run->base) / run->slotSize;
+    assert(run->base + slot * run->slotSize == ptr);
+    assert(isInUse(run, slot));
+    run->inUse[slot / 32] &= ~(1u << (slot % 32));
+    size_t sizeClass = (run->slotSize >> SLOT_RUN_SIZE_CLASS_SHIFT) - 1;
+    if (run->numFree++ == 0) {
+        pushPartial(runs, sizeClass, run);
+    }
+    if (run->numFree == run->numSlots && runs->partial[sizeClass] != run) {
+        /* Keep the run being allocated from, give back the others. */
+        unlinkPartial(runs, sizeClass, run);
+        runs->table[((uintptr_t)run->base - runs->base) >> SLOT_RUN_SHIFT] =
+                NULL;
+        mspace_free(runs->msp, run->base);
+        free(run);
+    }
+}
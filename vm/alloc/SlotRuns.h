@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs of equally sized slots for small objects.
+ *
+ * A run is an aligned SLOT_RUN_SIZE-byte chunk of a heap's mspace that
+ * is divided into slots of a single size class.  Slots carry no
+ * dlmalloc header.  The size class of a run and which of its slots are
+ * in use are kept outside the heap, in a table indexed by the offset of
+ * the run from the start of the heap, so finding the run of a pointer
+ * is a shift and a load.  Allocating a slot finds the first clear bit
+ * of the run's in-use bitmap and freeing one clears its bit; neither
+ * touches dlmalloc.  A run goes back to the mspace once all of its
+ * slots are free.
+ *
+ * Slots are objects like any other as far as the rest of the heap
+ * source is concerned: they are marked in the live bitmap and are
+ * swept through dvmHeapSourceFreeList().  None of this is thread safe;
+ * callers hold the heap lock.
+ */
+#ifndef DALVIK_ALLOC_SLOTRUNS_H_
+#define DALVIK_ALLOC_SLOTRUNS_H_
+
+#include "alloc/DlMalloc.h"
+
+/*
+ * Size and alignment of a run.
+ */
+#define SLOT_RUN_SHIFT 13
+#define SLOT_RUN_SIZE  (1 << SLOT_RUN_SHIFT)
+
+/*
+ * Requests of at most this many bytes are served from runs.  Size
+ * classes are 8 bytes apart, matching the heap's object alignment.
+ */
+#define SLOT_RUN_MAX_OBJECT_SIZE 64
+#define SLOT_RUN_SIZE_CLASS_SHIFT 3
+#define SLOT_RUN_NUM_SIZE_CLASSES \
+        (SLOT_RUN_MAX_OBJECT_SIZE >> SLOT_RUN_SIZE_CLASS_SHIFT)
+
+struct SlotRuns;
+
+/*
+ * Creates the run table for a heap whose mspace is "msp" and whose
+ * addresses lie in [base, base + length).  Returns NULL on failure.
+ */
+SlotRuns *dvmSlotRunsCreate(mspace msp, const void *base, size_t length);
+
+/*
+ * Frees the run table.  The runs themselves are left in the mspace.
+ */
+void dvmSlotRunsDestroy(SlotRuns *runs);
+
+/*
+ * Returns a zeroed slot big enough for "n" bytes, or NULL if "n" is too
+ * large or no run can be carved out of the mspace.
+ */
+void *dvmSlotRunsAlloc(SlotRuns *runs, size_t n);
+
+/*
+ * Like dvmSlotRunsAlloc(), but hands out up to "maxSlots" zeroed slots
+ * that are adjacent in a single run.  Returns the number of slots, the
+ * first of which is stored in "first"; the slots are
+ * dvmSlotRunsSlotSize() bytes apart.
+ */
+size_t dvmSlotRunsAllocAdjacent(SlotRuns *runs, size_t n, size_t maxSlots,
+                                void **first);
+
+/*
+ * Returns the size of the slot holding "ptr", or 0 if "ptr" is not in
+ * a run.
+ */
+size_t dvmSlotRunsSlotSize(const SlotRuns *runs, const void *ptr);
+
+/*
+ * Returns the slot "ptr" to its run.  The caller has checked that
+ * "ptr" is in a run.
+ */
+void dvmSlotRunsFree(SlotRuns *runs, void *ptr);
+
+#endif  // DALVIK_ALLOC_SLOTRUNS_H_
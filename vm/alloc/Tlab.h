@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Thread-local allocation buffers.
+ *
+ * Each thread keeps one buffer per small-object size class.  A buffer
+ * is a run of equally sized, adjacent chunks carved out of the active
+ * heap with a single mspace_independent_calloc() call, so that every
+ * slot is an ordinary dlmalloc chunk that can be swept, walked and
+ * freed individually.  Handing out a slot is a pointer bump that
+ * requires neither the heap lock nor an atomic operation; the heap
+ * lock is only taken to refill or to retire a buffer.
+ *
+ * All slots of a buffer are accounted for (bytesAllocated,
+ * objectsAllocated and the live bitmap) when the buffer is refilled.
+ * Slots that were never handed out are given back when the buffer is
+ * retired, which the GC does for every thread while the world is
+ * suspended and before it looks at the live bitmap.
+ */
+#ifndef DALVIK_ALLOC_TLAB_H_
+#define DALVIK_ALLOC_TLAB_H_
+
+#include <stddef.h>
+
+/*
+ * Requests of at most this many bytes are served from a buffer.
+ */
+#define TLAB_MAX_OBJECT_SIZE 96
+
+/*
+ * Size classes are 8 bytes apart, matching the heap's object alignment.
+ */
+#define TLAB_SIZE_CLASS_SHIFT 3
+#define TLAB_NUM_SIZE_CLASSES (TLAB_MAX_OBJECT_SIZE >> TLAB_SIZE_CLASS_SHIFT)
+
+/*
+ * Approximate number of bytes carved out of the heap per refill, and
+ * an upper bound on the number of slots in a single buffer.
+ */
+#define TLAB_BUFFER_BYTES (2 * 1024)
+#define TLAB_MAX_SLOTS    128
+
+struct Tlab {
+    /* next slot to hand out, or NULL if the buffer is empty */
+    char*       top;
+
+    /* one stride past the last slot, or NULL if the buffer is empty, so
+     * the inline fast paths only need to check top < end */
+    char*       end;
+
+    /* distance in bytes between adjacent slots */
+    size_t      stride;
+};
+
+/*
+ * Returns the size class index for an allocation of "size" bytes.
+ * The caller must ensure 0 < size <= TLAB_MAX_OBJECT_SIZE.
+ */
+INLINE size_t dvmTlabSizeClass(size_t size)
+{
+    return (size - 1) >> TLAB_SIZE_CLASS_SHIFT;
+}
+
+/*
+ * Lock-free fast path: hand out the next zeroed slot from the buffer
+ * matching "size", or return NULL if the size is not eligible or the
+ * buffer is exhausted.  Must only be called by the thread owning
+ * "tlabs".
+ */
+INLINE void* dvmTlabAlloc(Tlab* tlabs, size_t size)
+{
+    if (size == 0 || size > TLAB_MAX_OBJECT_SIZE) {
+        return NULL;
+    }
+    Tlab* tlab = &tlabs[dvmTlabSizeClass(size)];
+    char* ptr = tlab->top;
+    if (ptr == NULL || ptr >= tlab->end) {
+        return NULL;
+    }
+    tlab->top = ptr + tlab->stride;
+    return ptr;
+}
+
+#endif  // DALVIK_ALLOC_TLAB_H_
@@ -16,6 +16,7 @@
 
 #include "Dalvik.h"
 #include "alloc/HeapBitmap.h"
+#include "alloc/HeapBitmapInlines.h"
 #include "alloc/HeapSource.h"
 #include "alloc/Verify.h"
 #include "alloc/Visit.h"
@@ -148,3 +149,86 @@ void dvmVerifyRoots()
 {
     dvmVisitRoots(verifyRootReference, NULL);
 }
+
+struct EscapeContext {
+    const void *base;
+    const void *limit;
+    bool escaped;
+};
+
+/*
+ * Visitor applied to each reference field when searching for
+ * references into a range.  Flags the context when one is found.
+ */
+static void escapeVisitor(void *addr, void *arg)
+{
+    EscapeContext *ctx = (EscapeContext *)arg;
+    const void *obj = *(const void **)addr;
+    if (obj >= ctx->base && obj < ctx->limit) {
+        ctx->escaped = true;
+    }
+}
+
+/*
+ * Visitor applied to each root when searching for references into a
+ * range.  The static fields of classes are stored into without dirtying
+ * a card while they are being linked, so they are checked here too.
+ */
+static void escapeRootVisitor(void *addr, u4 threadId, RootType type,
+                              void *arg)
+{
+    escapeVisitor(addr, arg);
+    Object *obj = *(Object **)addr;
+    if (type == ROOT_STICKY_CLASS && obj != NULL) {
+        dvmVisitObject(escapeVisitor, obj, arg);
+    }
+}
+
+/*
+ * Checks the objects that start on the dirty cards in [first, last).
+ */
+static void escapeCardScan(const u1 *first, const u1 *last,
+                           EscapeContext *ctx)
+{
+    HeapBitmap *liveBits = dvmHeapSourceGetLiveBits();
+    const u1 *card = first;
+    while (!ctx->escaped) {
+        card = (const u1 *)memchr(card, GC_CARD_DIRTY, last - card);
+        if (card == NULL) {
+            break;
+        }
+        const u1 *ptr = (const u1 *)dvmAddrFromCard(card);
+        if (ptr < ctx->base || ptr >= ctx->limit) {
+            const u1 *end = ptr + GC_CARD_SIZE;
+            for (; ptr < end; ptr += HB_OBJECT_ALIGNMENT) {
+                if (dvmHeapBitmapIsObjectBitSet(liveBits, ptr) &&
+                    ((const Object *)ptr)->clazz != NULL) {
+                    dvmVisitObject(escapeVisitor, (Object *)ptr, ctx);
+                }
+            }
+        }
+        ++card;
+    }
+}
+
+/*
+ * Returns true if no root and no object outside [base, limit) refers
+ * to an object inside it.  Only objects on dirty cards are looked at,
+ * so the card table must not have been cleared since the first object
+ * in the range was allocated.  Assumes the VM is suspended.
+ */
+bool dvmVerifyNoReferencesInto(const void *base, const void *limit)
+{
+    EscapeContext ctx = { base, limit, false };
+    dvmVisitRoots(escapeRootVisitor, &ctx);
+    if (!ctx.escaped) {
+        const u1 *last = dvmCardFromAddr(dvmHeapSourceGetLimit());
+        escapeCardScan(dvmCardFromAddr(dvmHeapSourceGetBase()), last, &ctx);
+    }
+    uintptr_t arenaBase, arenaMax;
+    if (!ctx.escaped && dvmHeapSourceGetArenaRegion(&arenaBase, &arenaMax)) {
+        escapeCardScan(dvmCardFromAddr((void *)arenaBase),
+                       dvmCardFromAddr((void *)arenaMax) + 1, &ctx);
+    }
+    return !ctx.escaped;
+}
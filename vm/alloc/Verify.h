@@ -33,4 +33,11 @@ void dvmVerifyBitmap(const HeapBitmap *bitmap);
  */
 void dvmVerifyRoots(void);
 
+/*
+ * Returns true if nothing outside [base, limit) refers to an object
+ * inside it, judging by the roots and the dirty cards.  Assumes the VM
+ * is suspended.
+ */
+bool dvmVerifyNoReferencesInto(const void *base, const void *limit);
+
 #endif  // DALVIK_ALLOC_VERIFY_H_
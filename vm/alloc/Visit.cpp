@@ -41,13 +41,24 @@ static void visitHashTable(RootVisitor *visitor, HashTable *table,
     dvmHashTableLock(table);
     for (int i = 0; i < table->tableSize; ++i) {
         HashEntry *entry = &table->pEntries[i];
-        if (entry->data != NULL && entry->data != HASH_TOMBSTONE) {
+        if (entry->data != NULL) {
             (*visitor)(&entry->data, 0, type, arg);
         }
     }
     dvmHashTableUnlock(table);
 }
 
+struct InternRootContext {
+    RootVisitor *visitor;
+    void *arg;
+};
+
+static void visitInternEntry(StringObject **entry, void *arg)
+{
+    InternRootContext *ctx = (InternRootContext *)arg;
+    (*ctx->visitor)(entry, 0, ROOT_INTERNED_STRING, ctx->arg);
+}
+
 /*
  * Visits all entries in the reference table.
  */
@@ -86,6 +97,12 @@ static void visitThreadStack(RootVisitor *visitor, Thread *thread, void *arg)
     assert(thread != NULL);
     u4 threadId = thread->threadId;
     const StackSaveArea *saveArea;
+    /*
+     * Deep stacks are mostly recursion, so remember the map of the
+     * previous frame's method rather than looking it up again.
+     */
+    const Method *lastMethod = NULL;
+    const RegisterMap *lastMap = NULL;
     for (u4 *fp = (u4 *)thread->interpSave.curFrame;
          fp != NULL;
          fp = (u4 *)saveArea->prevFrame) {
@@ -93,7 +110,11 @@ static void visitThreadStack(RootVisitor *visitor, Thread *thread, void *arg)
         saveArea = SAVEAREA_FROM_FP(fp);
         method = (Method *)saveArea->method;
         if (method != NULL && !dvmIsNativeMethod(method)) {
-            const RegisterMap* pMap = dvmGetExpandedRegisterMap(method);
+            if (method != lastMethod) {
+                lastMap = dvmGetExpandedRegisterMap(method);
+                lastMethod = method;
+            }
+            const RegisterMap* pMap = lastMap;
             const u1* regVector = NULL;
             if (pMap != NULL) {
                 /* found map, get registers for this address */
@@ -118,16 +139,19 @@ static void visitThreadStack(RootVisitor *visitor, Thread *thread, void *arg)
                  * register vector, so we can walk through the
                  * register map and memory in the same direction.
                  *
-                 * A '1' bit indicates a live reference.
+                 * A '1' bit indicates a live reference.  Most registers
+                 * don't hold references, so whole bytes of the vector
+                 * are skipped when they are zero.
                  */
-                u2 bits = 1 << 1;
-                for (size_t i = 0; i < method->registersSize; ++i) {
-                    bits >>= 1;
-                    if (bits == 1) {
-                        /* set bit 9 so we can tell when we're empty */
-                        bits = *regVector++ | 0x0100;
-                    }
-                    if ((bits & 0x1) != 0) {
+                const u1* line = regVector;
+                size_t registersSize = method->registersSize;
+                for (size_t base = 0; base < registersSize; base += 8) {
+                    u1 bits = *line++;
+                    for (size_t i = base; bits != 0 && i < registersSize;
+                         ++i, bits >>= 1) {
+                        if ((bits & 0x1) == 0) {
+                            continue;
+                        }
                         /*
                          * Register is marked as live, it's a valid root.
                          */
@@ -135,7 +159,7 @@ static void visitThreadStack(RootVisitor *visitor, Thread *thread, void *arg)
                         if (fp[i] != 0 && !dvmIsValidObject((Object *)fp[i])) {
                             /* this is very bad */
                             ALOGE("PGC: invalid ref in reg %d: %#x",
-                                 method->registersSize - 1 - i, fp[i]);
+                                 registersSize - 1 - i, fp[i]);
                             ALOGE("PGC: %s.%s addr %#x",
                                  method->clazz->descriptor, method->name,
                                  saveArea->xtra.currentPc - method->insns);
@@ -217,12 +241,14 @@ void dvmVisitRoots(RootVisitor *visitor, void *arg)
     if (gDvm.dbgRegistry != NULL) {
         visitHashTable(visitor, gDvm.dbgRegistry, ROOT_DEBUGGER, arg);
     }
-    if (gDvm.literalStrings != NULL) {
-        visitHashTable(visitor, gDvm.literalStrings, ROOT_INTERNED_STRING, arg);
+    InternRootContext internCtx = { visitor, arg };
+    dvmVisitInternTable(gDvm.literalStrings, visitInternEntry, &internCtx);
+    for (size_t i = 0; i < kIndirectRefShardCount; i++) {
+        IndirectRefShard *refs = &gDvm.jniGlobalRefs[i];
+        dvmLockMutex(&refs->lock);
+        visitIndirectRefTable(visitor, &refs->table, 0, ROOT_JNI_GLOBAL, arg);
+        dvmUnlockMutex(&refs->lock);
     }
-    dvmLockMutex(&gDvm.jniGlobalRefLock);
-    visitIndirectRefTable(visitor, &gDvm.jniGlobalRefTable, 0, ROOT_JNI_GLOBAL, arg);
-    dvmUnlockMutex(&gDvm.jniGlobalRefLock);
     dvmLockMutex(&gDvm.jniPinRefLock);
     visitReferenceTable(visitor, &gDvm.jniPinRefTable, 0, ROOT_VM_INTERNAL, arg);
     dvmUnlockMutex(&gDvm.jniPinRefLock);
@@ -97,6 +97,7 @@ static void visitClassObject(Visitor *visitor, Object *obj, void *arg)
         (*visitor)(&asClass->super, arg);
     }
     (*visitor)(&asClass->classLoader, arg);
+    (*visitor)(&asClass->reflectCache, arg);
     visitFields(visitor, obj, arg);
     visitStaticFields(visitor, asClass, arg);
     if (asClass->status > CLASS_IDX) {
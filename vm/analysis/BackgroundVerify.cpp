@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Background verification.
+ *
+ * A class that dexopt couldn't verify -- usually because something it
+ * refers to wasn't available when the DEX file was optimized -- is
+ * verified by dvmInitClass on first use, which stalls whichever thread
+ * gets there first.  With -Xverifyopt:background, classes like that are
+ * queued when they are linked, and a low-priority thread verifies them
+ * in the order they were loaded.
+ *
+ * The thread takes the class's lock and goes through dvmLateVerifyClass,
+ * just as dvmInitClass would, so a class is verified exactly once and a
+ * thread that wants it while it is being verified simply waits.  If the
+ * class fails, it is marked erroneous with its verifyErrorClass set, and
+ * the first thread to use it gets the VerifyError.
+ *
+ * Nothing is queued in the zygote, whose unverified classes would
+ * otherwise be verified, and their pages dirtied, in every process.
+ */
+
+#include "Dalvik.h"
+
+static pthread_mutex_t queueLock;
+static pthread_cond_t queueCond;
+static ClassObject** queue;         /* entries [queueHead, queueTail) */
+static size_t queueHead;
+static size_t queueTail;
+static size_t queueAlloc;
+static bool haltVerifier;
+
+static bool verifierStarted;
+static pthread_t verifierHandle;
+
+bool dvmBackgroundVerifyStartup()
+{
+    dvmInitMutex(&queueLock);
+    pthread_cond_init(&queueCond, NULL);
+    return true;
+}
+
+void dvmBackgroundVerifyShutdown()
+{
+    dvmStopBackgroundVerifier();
+    free(queue);
+    queue = NULL;
+    queueHead = queueTail = queueAlloc = 0;
+}
+
+/*
+ * Append to the queue, sliding the live entries down or growing the
+ * array if it is full.  Caller holds queueLock.
+ */
+static bool appendToQueue(ClassObject* clazz)
+{
+    if (queueTail == queueAlloc) {
+        if (queueHead > 0) {
+            memmove(queue, queue + queueHead,
+                (queueTail - queueHead) * sizeof(ClassObject*));
+            queueTail -= queueHead;
+            queueHead = 0;
+        } else {
+            size_t newAlloc = (queueAlloc == 0) ? 64 : queueAlloc * 2;
+            ClassObject** newQueue = (ClassObject**)
+                realloc(queue, newAlloc * sizeof(ClassObject*));
+            if (newQueue == NULL)
+                return false;
+            queue = newQueue;
+            queueAlloc = newAlloc;
+        }
+    }
+    queue[queueTail++] = clazz;
+    return true;
+}
+
+void dvmQueueBackgroundVerify(ClassObject* clazz)
+{
+    if (!gDvm.backgroundVerify || gDvm.zygote || gDvm.optimizing)
+        return;
+    if (!dvmLateVerifyNeeded(clazz))
+        return;
+
+    /* classes are never unloaded, so the pointer stays good */
+    dvmLockMutex(&queueLock);
+    if (appendToQueue(clazz))
+        pthread_cond_signal(&queueCond);
+    dvmUnlockMutex(&queueLock);
+}
+
+/*
+ * Verify "clazz" unless somebody already has.
+ */
+static void verifyQueuedClass(Thread* self, ClassObject* clazz)
+{
+    dvmLockObject(self, (Object*) clazz);
+    if (clazz->status == CLASS_RESOLVED) {
+        ALOGV("+++ background verify on %s", clazz->descriptor);
+        if (!dvmLateVerifyClass(clazz)) {
+            /* the class remembers the failure for its first user */
+            ALOGV("+++ background verify of %s failed", clazz->descriptor);
+        }
+    }
+    dvmUnlockObject(self, (Object*) clazz);
+
+    /* resolving what the class refers to can leave exceptions behind */
+    dvmClearException(self);
+}
+
+static void* verifierThreadStart(void* arg)
+{
+    Thread* self = dvmThreadSelf();
+
+    dvmChangeThreadPriority(self, THREAD_MIN_PRIORITY);
+
+    for (;;) {
+        dvmChangeStatus(self, THREAD_VMWAIT);
+        dvmLockMutex(&queueLock);
+        while (queueHead == queueTail && !haltVerifier)
+            dvmWaitCond(&queueCond, &queueLock);
+        if (haltVerifier) {
+            dvmUnlockMutex(&queueLock);
+            break;
+        }
+        ClassObject* clazz = queue[queueHead++];
+        if (queueHead == queueTail)
+            queueHead = queueTail = 0;
+        dvmUnlockMutex(&queueLock);
+
+        dvmChangeStatus(self, THREAD_RUNNING);
+        verifyQueuedClass(self, clazz);
+    }
+
+    return NULL;
+}
+
+/*
+ * Start the verifier thread, if -Xverifyopt:background is in effect.
+ */
+bool dvmStartBackgroundVerifier()
+{
+    assert(!gDvm.zygote);
+
+    if (!gDvm.backgroundVerify || gDvm.classVerifyMode == VERIFY_MODE_NONE)
+        return true;
+
+    haltVerifier = false;
+    if (!dvmCreateInternalThread(&verifierHandle, "Background Verifier",
+            verifierThreadStart, NULL))
+    {
+        ALOGW("Unable to create background verifier thread");
+        return false;
+    }
+    verifierStarted = true;
+    return true;
+}
+
+/*
+ * Stop the verifier thread.  Whatever is still queued gets verified on
+ * first use, as usual.
+ */
+void dvmStopBackgroundVerifier()
+{
+    if (!verifierStarted)
+        return;
+
+    dvmLockMutex(&queueLock);
+    haltVerifier = true;
+    pthread_cond_signal(&queueCond);
+    dvmUnlockMutex(&queueLock);
+
+    Thread* self = dvmThreadSelf();
+    ThreadStatus oldStatus = THREAD_UNDEFINED;
+    if (self != NULL)
+        oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    pthread_join(verifierHandle, NULL);
+    if (self != NULL)
+        dvmChangeStatus(self, oldStatus);
+    verifierStarted = false;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Verification of classes that dexopt couldn't verify, ahead of first use.
+ */
+#ifndef DALVIK_BACKGROUNDVERIFY_H_
+#define DALVIK_BACKGROUNDVERIFY_H_
+
+/* initialization */
+bool dvmBackgroundVerifyStartup(void);
+void dvmBackgroundVerifyShutdown(void);
+
+/*
+ * Note a newly linked class that still has to be verified.  Does nothing
+ * if background verification is off, or in the zygote or dexopt.
+ */
+void dvmQueueBackgroundVerify(ClassObject* clazz);
+
+/*
+ * Start the thread that verifies the queued classes.  Must not be called
+ * in the zygote.
+ */
+bool dvmStartBackgroundVerifier(void);
+
+/*
+ * Stop the verifier thread, if it is running.
+ */
+void dvmStopBackgroundVerifier(void);
+
+#endif  // DALVIK_BACKGROUNDVERIFY_H_
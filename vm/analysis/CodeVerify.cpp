@@ -100,6 +100,15 @@ typedef struct RegisterTable {
      * data (RegType array, MonitorEntries array, monitor stack).
      */
     void*       lineAlloc;
+
+    /*
+     * Number of instructions with the "changed" flag set, and a lower
+     * bound on the address of the first one.  These let the main loop
+     * stop without a final scan of the flags, and resume scanning from
+     * the first pending instruction rather than from the top.
+     */
+    int         changedCount;
+    int         lowestChanged;
 } RegisterTable;
 
 
@@ -121,6 +130,33 @@ static void dumpRegTypes(const VerifierData* vdata, \
     const RegisterLine* registerLine, int addr, const char* addrName,
     const UninitInstanceMap* uninitMap, int displayFlags);
 
+/*
+ * Set the "changed" flag on an instruction, keeping the pending count
+ * and lowest-address hint in the register table up to date.
+ */
+static inline void markInsnChanged(InsnFlags* insnFlags,
+    RegisterTable* regTable, int addr)
+{
+    if (!dvmInsnIsChanged(insnFlags, addr)) {
+        dvmInsnSetChanged(insnFlags, addr, true);
+        regTable->changedCount++;
+        if (addr < regTable->lowestChanged)
+            regTable->lowestChanged = addr;
+    }
+}
+
+/*
+ * Clear the "changed" flag on an instruction.
+ */
+static inline void clearInsnChanged(InsnFlags* insnFlags,
+    RegisterTable* regTable, int addr)
+{
+    if (dvmInsnIsChanged(insnFlags, addr)) {
+        dvmInsnSetChanged(insnFlags, addr, false);
+        regTable->changedCount--;
+    }
+}
+
 /* bit values for dumpRegTypes() "displayFlags" */
 enum {
     DRT_SIMPLE          = 0,
@@ -2594,7 +2630,7 @@ static bool updateRegisters(const Method* meth, InsnFlags* insnFlags,
          */
         LOGVV("COPY into 0x%04x", nextInsn);
         copyLineToTable(regTable, nextInsn, workLine);
-        dvmInsnSetChanged(insnFlags, nextInsn, true);
+        markInsnChanged(insnFlags, regTable, nextInsn);
 #ifdef VERIFIER_STATS
         gDvm.verifierStats.copyRegCount++;
 #endif
@@ -2655,7 +2691,7 @@ static bool updateRegisters(const Method* meth, InsnFlags* insnFlags,
 #endif
 
         if (changed)
-            dvmInsnSetChanged(insnFlags, nextInsn, true);
+            markInsnChanged(insnFlags, regTable, nextInsn);
     }
 
     return true;
@@ -3034,8 +3070,15 @@ static bool initRegisterTable(const VerifierData* vdata,
      * indirection.
      */
     regTable->insnRegCountPlus = meth->registersSize + kExtraRegs;
-    regTable->registerLines =
-        (RegisterLine*) calloc(insnsSize, sizeof(RegisterLine));
+    if (vdata->scratch != NULL) {
+        regTable->registerLines = (RegisterLine*) dvmGetVerifierScratch(
+            &vdata->scratch->registerLines,
+            &vdata->scratch->registerLinesSize,
+            insnsSize * sizeof(RegisterLine));
+    } else {
+        regTable->registerLines =
+            (RegisterLine*) calloc(insnsSize, sizeof(RegisterLine));
+    }
     if (regTable->registerLines == NULL)
         return false;
 
@@ -3095,16 +3138,28 @@ static bool initRegisterTable(const VerifierData* vdata,
 
     size_t spacePerEntry = regTypeSize +
         (trackMonitors ? monEntSize + stackSize : 0);
-    regTable->lineAlloc = calloc(interestingCount, spacePerEntry);
+    if (vdata->scratch != NULL) {
+        regTable->lineAlloc = dvmGetVerifierScratch(
+            &vdata->scratch->lineAlloc, &vdata->scratch->lineAllocSize,
+            interestingCount * spacePerEntry);
+    } else {
+        regTable->lineAlloc = calloc(interestingCount, spacePerEntry);
+    }
     if (regTable->lineAlloc == NULL)
         return false;
 
-#ifdef VERIFIER_STATS
     size_t totalSpace = interestingCount * spacePerEntry +
         insnsSize * sizeof(RegisterLine);
+#ifdef VERIFIER_STATS
+    gDvm.verifierStats.totalAlloc += totalSpace;
     if (gDvm.verifierStats.biggestAlloc < totalSpace)
         gDvm.verifierStats.biggestAlloc = totalSpace;
 #endif
+    if (dvmWantVerboseVerification(meth)) {
+        ALOGI("VFY: %s.%s register table: %d of %d lines stored, %zd bytes",
+            meth->clazz->descriptor, meth->name, interestingCount,
+            insnsSize, totalSpace);
+    }
 
     /*
      * Populate the sparse register line table.
@@ -3548,11 +3603,44 @@ bool dvmVerifyCodeFlow(VerifierData* vdata)
 
 bail:
     freeRegisterLineInnards(vdata);
-    free(regTable.registerLines);
-    free(regTable.lineAlloc);
+    if (vdata->scratch == NULL) {
+        free(regTable.registerLines);
+        free(regTable.lineAlloc);
+    }
     return result;
 }
 
+/*
+ * Get zeroed scratch storage, growing the buffer if it's too small.
+ */
+void* dvmGetVerifierScratch(void** pBuf, size_t* pBufSize, size_t size)
+{
+    if (size > *pBufSize) {
+        /* grow generously so a run of slightly larger methods is cheap */
+        size_t newSize = size + size / 2;
+        void* newBuf = malloc(newSize);
+        if (newBuf == NULL)
+            return NULL;
+        free(*pBuf);
+        *pBuf = newBuf;
+        *pBufSize = newSize;
+    }
+
+    memset(*pBuf, 0, size);
+    return *pBuf;
+}
+
+/*
+ * Free the buffers held by "scratch".
+ */
+void dvmFreeVerifierScratch(VerifierScratch* scratch)
+{
+    free(scratch->insnFlags);
+    free(scratch->registerLines);
+    free(scratch->lineAlloc);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
 /*
  * Grind through the instructions.
  *
@@ -3616,7 +3704,9 @@ static bool doCodeVerification(VerifierData* vdata, RegisterTable* regTable)
     /*
      * Begin by marking the first instruction as "changed".
      */
-    dvmInsnSetChanged(insnFlags, 0, true);
+    regTable->changedCount = 0;
+    regTable->lowestChanged = insnsSize;
+    markInsnChanged(insnFlags, regTable, 0);
 
     if (dvmWantVerboseVerification(meth)) {
         IF_ALOGI() {
@@ -3638,10 +3728,10 @@ static bool doCodeVerification(VerifierData* vdata, RegisterTable* regTable)
     /*
      * Continue until no instructions are marked "changed".
      */
-    while (true) {
+    while (regTable->changedCount != 0) {
         /*
          * Find the first marked one.  Use "startGuess" as a way to find
-         * one quickly.
+         * one quickly; it's usually the next instruction.
          */
         for (insnIdx = startGuess; insnIdx < insnsSize; insnIdx++) {
             if (dvmInsnIsChanged(insnFlags, insnIdx))
@@ -3649,14 +3739,19 @@ static bool doCodeVerification(VerifierData* vdata, RegisterTable* regTable)
         }
 
         if (insnIdx == insnsSize) {
-            if (startGuess != 0) {
-                /* try again, starting from the top */
-                startGuess = 0;
-                continue;
-            } else {
-                /* all flags are clear */
-                break;
+            /*
+             * Try again from the first pending instruction.  Nothing below
+             * "lowestChanged" is marked, so there's no need to start at
+             * the top.  We know at least one flag is still set.
+             */
+            for (insnIdx = regTable->lowestChanged; insnIdx < insnsSize;
+                insnIdx++)
+            {
+                if (dvmInsnIsChanged(insnFlags, insnIdx))
+                    break;
             }
+            assert(insnIdx < insnsSize);
+            regTable->lowestChanged = insnIdx;
         }
 
         /*
@@ -3713,7 +3808,7 @@ static bool doCodeVerification(VerifierData* vdata, RegisterTable* regTable)
          * Clear "changed" and mark as visited.
          */
         dvmInsnSetVisited(insnFlags, insnIdx, true);
-        dvmInsnSetChanged(insnFlags, insnIdx, false);
+        clearInsnChanged(insnFlags, regTable, insnIdx);
     }
 
     if (DEAD_CODE_SCAN && !IS_METHOD_FLAG_SET(meth, METHOD_ISWRITABLE)) {
@@ -5889,7 +5984,7 @@ sput_1nr_common:
              * so we don't know what the prior state was.  We have to
              * assume that something has changed and re-evaluate it.
              */
-            dvmInsnSetChanged(insnFlags, insnIdx+insnWidth, true);
+            markInsnChanged(insnFlags, regTable, insnIdx+insnWidth);
         }
     }
 
@@ -155,6 +155,25 @@ struct UninitInstanceMap {
 #define kUninitThisArgAddr  (-1)
 #define kUninitThisArgSlot  0
 
+/*
+ * Scratch storage carried from one method to the next while verifying a
+ * class.  Rather than calloc()ing and freeing the per-method tables for
+ * every method, we keep the largest buffers seen so far and zero the part
+ * we need.  Classes with thousands of small generated methods spend a
+ * surprising amount of time in the allocator otherwise.
+ *
+ * The buffers are owned by whoever set up the VerifierScratch, which must
+ * not be shared between threads.
+ */
+struct VerifierScratch {
+    void*   insnFlags;
+    size_t  insnFlagsSize;
+    void*   registerLines;
+    size_t  registerLinesSize;
+    void*   lineAlloc;
+    size_t  lineAllocSize;
+};
+
 /*
  * Various bits of data used by the verifier and register map generator.
  */
@@ -207,6 +226,12 @@ struct VerifierData {
      * for liveness analysis.
      */
     VfyBasicBlock** basicBlocks;
+
+    /*
+     * Reusable buffers for the tables above, or NULL to allocate them
+     * fresh for this method.
+     */
+    VerifierScratch* scratch;
 };
 
 
@@ -329,4 +354,15 @@ void dvmFreeUninitInstanceMap(UninitInstanceMap* uninitMap);
  */
 bool dvmVerifyCodeFlow(VerifierData* vdata);
 
+/*
+ * Get "size" bytes of zeroed storage from a scratch buffer, growing it if
+ * necessary.  Returns NULL on allocation failure.
+ */
+void* dvmGetVerifierScratch(void** pBuf, size_t* pBufSize, size_t size);
+
+/*
+ * Release the buffers held by a VerifierScratch.
+ */
+void dvmFreeVerifierScratch(VerifierScratch* scratch);
+
 #endif  // DALVIK_CODEVERIFY_H_
@@ -25,6 +25,8 @@
  * more rigorously structured.
  */
 #include "Dalvik.h"
+#include "libdex/Adler32.h"
+#include "libdex/DexClass.h"
 #include "libdex/OptInvocation.h"
 #include "analysis/RegisterMap.h"
 #include "analysis/Optimize.h"
@@ -43,11 +45,13 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
-#include <zlib.h>
 
 /* fwd */
 static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
-    DexClassLookup** ppClassLookup, DvmDex** ppDvmDex);
+    DexClassLookup** ppClassLookup, u4** ppResolveProfile,
+    u4* pResolveProfileCount, DvmDex** ppDvmDex);
+static bool findCoreClasses(void);
+static u4* createResolveProfile(const DvmDex* pDvmDex, u4* pCount);
 static bool loadAllClasses(DvmDex* pDvmDex);
 static void verifyAndOptimizeClasses(DexFile* pDexFile, bool doVerify,
     bool doOpt);
@@ -55,7 +59,13 @@ static void verifyAndOptimizeClass(DexFile* pDexFile, ClassObject* clazz,
     const DexClassDef* pClassDef, bool doVerify, bool doOpt);
 static void updateChecksum(u1* addr, int len, DexHeader* pHeader);
 static int writeDependencies(int fd, u4 modWhen, u4 crc);
+static u4* computeTypeIdHashes(const DexFile* pDexFile);
+static DexStringLiterals* createStringLiterals(const DexFile* pDexFile,
+    u4* pSize);
 static bool writeOptData(int fd, const DexClassLookup* pClassLookup,\
+    const DexClassPerfectHash* pClassHash, const u4* pTypeIdHashes,\
+    u4 typeIdsSize, const u4* pResolveProfile, u4 resolveProfileCount,\
+    const DexStringLiterals* pStringLiterals, u4 stringLiteralsSize,\
     const RegisterMapBuilder* pRegMapBuilder);
 static bool computeFileChecksum(int fd, off_t start, size_t length, u4* pSum);
 
@@ -528,6 +538,13 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
     const char* fileName, u4 modWhen, u4 crc, bool isBootstrap)
 {
     DexClassLookup* pClassLookup = NULL;
+    DexClassPerfectHash* pClassHash = NULL;
+    u4* pTypeIdHashes = NULL;
+    u4 typeIdsSize = 0;
+    u4* pResolveProfile = NULL;
+    u4 resolveProfileCount = 0;
+    DexStringLiterals* pStringLiterals = NULL;
+    u4 stringLiteralsSize = 0;
     RegisterMapBuilder* pRegMapBuilder = NULL;
 
     assert(gDvm.optimizing);
@@ -600,7 +617,8 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
          * This creates the class lookup table as part of doing the processing.
          */
         success = rewriteDex(((u1*) mapAddr) + dexOffset, dexLength,
-                    doVerify, doOpt, &pClassLookup, NULL);
+                    doVerify, doOpt, &pClassLookup, &pResolveProfile,
+                    &resolveProfileCount, NULL);
 
         if (success) {
             DvmDex* pDvmDex = NULL;
@@ -623,6 +641,26 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
                     }
                 }
 
+                /*
+                 * The perfect hash is optional; without it, lookups just
+                 * probe the class lookup table.
+                 */
+                pClassHash = dexCreateClassPerfectHash(pDvmDex->pDexFile);
+
+                /*
+                 * Hash every type descriptor the way dvmLookupClass does,
+                 * so resolution at run time doesn't have to.
+                 */
+                typeIdsSize = pDvmDex->pHeader->typeIdsSize;
+                pTypeIdHashes = computeTypeIdHashes(pDvmDex->pDexFile);
+
+                /*
+                 * Decode and hash the const-string literals, so the VM
+                 * can create the String objects straight from them.
+                 */
+                pStringLiterals = createStringLiterals(pDvmDex->pDexFile,
+                    &stringLiteralsSize);
+
                 DexHeader* pHeader = (DexHeader*)pDvmDex->pHeader;
                 updateChecksum(dexAddr, dexLength, pHeader);
 
@@ -693,7 +731,10 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
     /*
      * Append any optimized pre-computed data structures.
      */
-    if (!writeOptData(fd, pClassLookup, pRegMapBuilder)) {
+    if (!writeOptData(fd, pClassLookup, pClassHash, pTypeIdHashes,
+            typeIdsSize, pResolveProfile, resolveProfileCount,
+            pStringLiterals, stringLiteralsSize, pRegMapBuilder))
+    {
         ALOGW("Failed writing opt data");
         goto bail;
     }
@@ -743,6 +784,10 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
 bail:
     dvmFreeRegisterMapBuilder(pRegMapBuilder);
     free(pClassLookup);
+    free(pClassHash);
+    free(pTypeIdHashes);
+    free(pResolveProfile);
+    free(pStringLiterals);
     return result;
 }
 
@@ -768,11 +813,14 @@ bool dvmPrepareDexInMemory(u1* addr, size_t len, DvmDex** ppDvmDex)
      * also need to be changed, or we will try to verify the class twice,
      * and possibly reject it when optimized opcodes are encountered.)
      */
-    if (!rewriteDex(addr, len, false, false, &pClassLookup, ppDvmDex)) {
+    if (!rewriteDex(addr, len, false, false, &pClassLookup, NULL, NULL,
+            ppDvmDex))
+    {
         return false;
     }
 
     (*ppDvmDex)->pDexFile->pClassLookup = pClassLookup;
+    (*ppDvmDex)->pOwnedClassLookup = pClassLookup;
 
     return true;
 }
@@ -788,11 +836,16 @@ bool dvmPrepareDexInMemory(u1* addr, size_t len, DvmDex** ppDvmDex)
  * If "ppClassLookup" is non-NULL, a pointer to a newly-allocated
  * DexClassLookup will be returned on success.
  *
+ * If "ppResolveProfile" is non-NULL, a newly-allocated list of the type
+ * IDs that were resolved while verifying and optimizing is returned on
+ * success (NULL if there were none).
+ *
  * If "ppDvmDex" is non-NULL, a newly-allocated DvmDex struct will be
  * returned on success.
  */
 static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
-    DexClassLookup** ppClassLookup, DvmDex** ppDvmDex)
+    DexClassLookup** ppClassLookup, u4** ppResolveProfile,
+    u4* pResolveProfileCount, DvmDex** ppDvmDex)
 {
     DexClassLookup* pClassLookup = NULL;
     u8 prepWhen, loadWhen, verifyOptWhen;
@@ -876,6 +929,11 @@ static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
         (int) (verifyOptWhen - loadWhen) / 1000,
         gDvm.pBootLoaderAlloc->curOffset);
 
+    if (ppResolveProfile != NULL) {
+        *ppResolveProfile = createResolveProfile(pDvmDex,
+            pResolveProfileCount);
+    }
+
     result = true;
 
 bail:
@@ -931,30 +989,7 @@ static bool loadAllClasses(DvmDex* pDvmDex)
 
     dvmSetBootPathExtraDex(pDvmDex);
 
-    /*
-     * At this point, it is safe -- and necessary! -- to look up the
-     * VM's required classes and members, even when what we are in the
-     * process of processing is the core library that defines these
-     * classes itself. (The reason it is necessary is that in the act
-     * of initializing the class Class, below, the system will end up
-     * referring to many of the class references that got set up by
-     * this call.)
-     */
-    if (!dvmFindRequiredClassesAndMembers()) {
-        return false;
-    }
-
-    /*
-     * We have some circularity issues with Class and Object that are
-     * most easily avoided by ensuring that Object is never the first
-     * thing we try to find-and-initialize. The call to
-     * dvmFindSystemClass() here takes care of that situation. (We
-     * only need to do this when loading classes from the DEX file
-     * that contains Object, and only when Object comes first in the
-     * list, but it costs very little to do it in all cases.)
-     */
-    if (!dvmInitClass(gDvm.classJavaLangClass)) {
-        ALOGE("ERROR: failed to initialize the class Class!");
+    if (!findCoreClasses()) {
         return false;
     }
 
@@ -993,9 +1028,74 @@ static bool loadAllClasses(DvmDex* pDvmDex)
     return true;
 }
 
+/*
+ * Look up the VM's required classes and members and initialize the class
+ * Class.  Only done once per process, so if dvmPreloadForDexOpt() did it
+ * before a fork the work is shared.
+ */
+static bool findCoreClasses(void)
+{
+    static bool coreClassesFound = false;
+
+    if (coreClassesFound) {
+        return true;
+    }
+
+    /*
+     * At this point, it is safe -- and necessary! -- to look up the
+     * VM's required classes and members, even when what we are in the
+     * process of processing is the core library that defines these
+     * classes itself. (The reason it is necessary is that in the act
+     * of initializing the class Class, below, the system will end up
+     * referring to many of the class references that got set up by
+     * this call.)
+     */
+    if (!dvmFindRequiredClassesAndMembers()) {
+        return false;
+    }
+
+    /*
+     * We have some circularity issues with Class and Object that are
+     * most easily avoided by ensuring that Object is never the first
+     * thing we try to find-and-initialize. The call to
+     * dvmFindSystemClass() here takes care of that situation. (We
+     * only need to do this when loading classes from the DEX file
+     * that contains Object, and only when Object comes first in the
+     * list, but it costs very little to do it in all cases.)
+     */
+    if (!dvmInitClass(gDvm.classJavaLangClass)) {
+        ALOGE("ERROR: failed to initialize the class Class!");
+        return false;
+    }
+
+    coreClassesFound = true;
+    return true;
+}
+
+/*
+ * Get the classes every optimization needs ready once, so that the
+ * processes dexopt forks for a batch of non-bootstrap files share them.
+ */
+bool dvmPreloadForDexOpt(void)
+{
+    assert(gDvm.optimizing);
+    return findCoreClasses();
+}
+
 /*
  * Verify and/or optimize all classes that were successfully loaded from
  * this DEX file.
+ *
+ * This is done on a single thread.  The per-class work is mostly
+ * independent (each class rewrites only its own code, and the resolved
+ * caches it fills are idempotent), but the verifier and optimizer look up
+ * and create classes and raise exceptions, all of which need a fully
+ * attached VM Thread.  dexopt never gets far enough through startup to
+ * create such threads (internal threads need java.lang.Thread and the
+ * system ThreadGroup), and there is no thread-suspension story for a GC
+ * triggered by one worker while others are mid-verify.  Spreading this
+ * across cores would mean first teaching dexopt to attach lightweight
+ * worker threads.
  */
 static void verifyAndOptimizeClasses(DexFile* pDexFile, bool doVerify,
     bool doOpt)
@@ -1034,6 +1134,7 @@ static void verifyAndOptimizeClasses(DexFile* pDexFile, bool doVerify,
     ALOGI(" ...that caused changes  : %u", gDvm.verifierStats.mergeRegChanged);
     ALOGI(" uninit searches         : %u", gDvm.verifierStats.uninitSearches);
     ALOGI(" max memory required     : %u", gDvm.verifierStats.biggestAlloc);
+    ALOGI(" total memory required   : %u", gDvm.verifierStats.totalAlloc);
 #endif
 }
 
@@ -1471,6 +1572,175 @@ static bool writeChunk(int fd, u4 type, const void* data, size_t size)
     return true;
 }
 
+/*
+ * Record which type IDs ended up in the resolved-class table while we
+ * verified and optimized.  These are the dependencies the code is known
+ * to need, so they are what dvmStartPreResolve() resolves ahead of time.
+ * Primitive types are cheap to find and left out.
+ *
+ * Returns newly-allocated storage, or NULL if there's nothing to record.
+ */
+static u4* createResolveProfile(const DvmDex* pDvmDex, u4* pCount)
+{
+    u4 typeIdsSize = pDvmDex->pHeader->typeIdsSize;
+    u4 count = 0;
+
+    *pCount = 0;
+    for (u4 i = 0; i < typeIdsSize; i++) {
+        const ClassObject* clazz = pDvmDex->pResClasses[i];
+        if (clazz != NULL && !dvmIsPrimitiveClass(clazz))
+            count++;
+    }
+    if (count == 0)
+        return NULL;
+
+    u4* profile = (u4*) malloc(count * sizeof(u4));
+    if (profile == NULL)
+        return NULL;
+    count = 0;
+    for (u4 i = 0; i < typeIdsSize; i++) {
+        const ClassObject* clazz = pDvmDex->pResClasses[i];
+        if (clazz != NULL && !dvmIsPrimitiveClass(clazz))
+            profile[count++] = i;
+    }
+
+    ALOGV("DexOpt: resolve profile has %u of %u types", count, typeIdsSize);
+    *pCount = count;
+    return profile;
+}
+
+/*
+ * Compute the VM's UTF-8 hash of every type descriptor.
+ *
+ * Returns newly-allocated storage, or NULL on allocation failure (the
+ * hashes are optional).
+ */
+static u4* computeTypeIdHashes(const DexFile* pDexFile)
+{
+    u4 count = pDexFile->pHeader->typeIdsSize;
+    u4* hashes = (u4*) malloc(count * sizeof(u4) + 1);
+    if (hashes == NULL)
+        return NULL;
+
+    for (u4 i = 0; i < count; i++)
+        hashes[i] = dvmComputeUtf8Hash(dexStringByTypeIdx(pDexFile, i));
+    return hashes;
+}
+
+/*
+ * Note the string index of every const-string in "pCode" in "used".
+ */
+static void markConstStrings(const DexCode* pCode, u1* used, u4 stringIdsSize)
+{
+    const u2* insns = pCode->insns;
+    const u2* end = insns + pCode->insnsSize;
+    while (insns < end) {
+        Opcode opcode = dexOpcodeFromCodeUnit(*insns);
+        u4 stringIdx;
+        if (opcode == OP_CONST_STRING) {
+            stringIdx = insns[1];
+        } else if (opcode == OP_CONST_STRING_JUMBO) {
+            stringIdx = insns[1] | ((u4) insns[2] << 16);
+        } else {
+            stringIdx = stringIdsSize;
+        }
+        if (stringIdx < stringIdsSize)
+            used[stringIdx] = 1;
+
+        size_t width = dexGetWidthFromInstruction(insns);
+        if (width == 0)
+            break;
+        insns += width;
+    }
+}
+
+/*
+ * Build the UTF-16 contents and String.hashCode() of every string that a
+ * const-string instruction loads.  These are the strings that
+ * dvmResolveString() would otherwise decode from MUTF-8 and hash in
+ * every process.
+ *
+ * Returns newly-allocated storage, or NULL if there are no literals or
+ * on allocation failure (the literals are optional).
+ */
+static DexStringLiterals* createStringLiterals(const DexFile* pDexFile,
+    u4* pSize)
+{
+    u4 stringIdsSize = pDexFile->pHeader->stringIdsSize;
+    u1* used = (u1*) calloc(stringIdsSize + 1, 1);
+    if (used == NULL)
+        return NULL;
+
+    u4 classDefsSize = pDexFile->pHeader->classDefsSize;
+    for (u4 i = 0; i < classDefsSize; i++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, i);
+        if (dexGetClassData(pDexFile, pClassDef) == NULL)
+            continue;
+        DexClassData* pClassData = dexReadClassData(pDexFile, pClassDef);
+        if (pClassData == NULL)
+            continue;
+
+        u4 numMethods = pClassData->header.directMethodsSize +
+            pClassData->header.virtualMethodsSize;
+        for (u4 j = 0; j < numMethods; j++) {
+            const DexMethod* pMethod =
+                (j < pClassData->header.directMethodsSize) ?
+                &pClassData->directMethods[j] :
+                &pClassData->virtualMethods[j -
+                    pClassData->header.directMethodsSize];
+            const DexCode* pCode = dexGetCode(pDexFile, pMethod);
+            if (pCode != NULL)
+                markConstStrings(pCode, used, stringIdsSize);
+        }
+        free(pClassData);
+    }
+
+    u4 count = 0;
+    u4 charsCount = 0;
+    for (u4 i = 0; i < stringIdsSize; i++) {
+        if (used[i]) {
+            u4 utf16Size;
+            dexStringAndSizeById(pDexFile, i, &utf16Size);
+            count++;
+            charsCount += utf16Size;
+        }
+    }
+
+    DexStringLiterals* pLiterals = NULL;
+    if (count != 0) {
+        pLiterals = (DexStringLiterals*)
+            malloc(dexStringLiteralsSize(count, charsCount));
+    }
+    if (pLiterals == NULL) {
+        free(used);
+        return NULL;
+    }
+
+    pLiterals->count = count;
+    pLiterals->charsCount = charsCount;
+    u2* chars = (u2*) dexStringLiteralChars(pLiterals);
+    u4 charsOff = 0;
+    DexStringLiteral* pEntry = pLiterals->entries;
+    for (u4 i = 0; i < stringIdsSize; i++) {
+        if (!used[i])
+            continue;
+        u4 utf16Size;
+        const char* utf8 = dexStringAndSizeById(pDexFile, i, &utf16Size);
+        dvmConvertUtf8ToUtf16(chars + charsOff, utf8);
+        pEntry->stringIdx = i;
+        pEntry->hash = dvmComputeUtf16Hash(chars + charsOff, utf16Size);
+        pEntry->charsOff = charsOff;
+        pEntry->length = utf16Size;
+        charsOff += utf16Size;
+        pEntry++;
+    }
+    free(used);
+
+    ALOGV("DexOpt: %u string literals, %u chars", count, charsCount);
+    *pSize = dexStringLiteralsSize(count, charsCount);
+    return pLiterals;
+}
+
 /*
  * Write opt data.
  *
@@ -1480,6 +1750,9 @@ static bool writeChunk(int fd, u4 type, const void* data, size_t size)
  * so it can be used directly when the file is mapped for reading.
  */
 static bool writeOptData(int fd, const DexClassLookup* pClassLookup,
+    const DexClassPerfectHash* pClassHash, const u4* pTypeIdHashes,
+    u4 typeIdsSize, const u4* pResolveProfile, u4 resolveProfileCount,
+    const DexStringLiterals* pStringLiterals, u4 stringLiteralsSize,
     const RegisterMapBuilder* pRegMapBuilder)
 {
     /* pre-computed class lookup hash table */
@@ -1489,6 +1762,42 @@ static bool writeOptData(int fd, const DexClassLookup* pClassLookup,
         return false;
     }
 
+    /* perfect hash over the same classes (optional) */
+    if (pClassHash != NULL) {
+        if (!writeChunk(fd, (u4) kDexChunkClassPerfectHash,
+                pClassHash, pClassHash->size))
+        {
+            return false;
+        }
+    }
+
+    /* descriptor hashes for every type ID (optional) */
+    if (pTypeIdHashes != NULL) {
+        if (!writeChunk(fd, (u4) kDexChunkTypeIdHashes,
+                pTypeIdHashes, typeIdsSize * sizeof(u4)))
+        {
+            return false;
+        }
+    }
+
+    /* classes resolved while optimizing, for pre-resolution (optional) */
+    if (pResolveProfile != NULL && resolveProfileCount != 0) {
+        if (!writeChunk(fd, (u4) kDexChunkResolveProfile,
+                pResolveProfile, resolveProfileCount * sizeof(u4)))
+        {
+            return false;
+        }
+    }
+
+    /* decoded const-string literals (optional) */
+    if (pStringLiterals != NULL) {
+        if (!writeChunk(fd, (u4) kDexChunkStringLiterals,
+                pStringLiterals, stringLiteralsSize))
+        {
+            return false;
+        }
+    }
+
     /* register maps (optional) */
     if (pRegMapBuilder != NULL) {
         if (!writeChunk(fd, (u4) kDexChunkRegisterMaps,
@@ -1517,7 +1826,7 @@ static bool computeFileChecksum(int fd, off_t start, size_t length, u4* pSum)
 {
     unsigned char readBuf[8192];
     ssize_t actual;
-    uLong adler;
+    u4 adler;
 
     if (lseek(fd, start, SEEK_SET) != start) {
         ALOGE("Unable to seek to start of checksum area (%ld): %s",
@@ -1525,7 +1834,7 @@ static bool computeFileChecksum(int fd, off_t start, size_t length, u4* pSum)
         return false;
     }
 
-    adler = adler32(0L, Z_NULL, 0);
+    adler = kDexAdler32Init;
 
     while (length != 0) {
         size_t wanted = (length < sizeof(readBuf)) ? length : sizeof(readBuf);
@@ -1536,7 +1845,7 @@ static bool computeFileChecksum(int fd, off_t start, size_t length, u4* pSum)
             return false;
         }
 
-        adler = adler32(adler, readBuf, actual);
+        adler = dexAdler32(adler, readBuf, actual);
 
         length -= actual;
     }
@@ -1555,9 +1864,8 @@ static void updateChecksum(u1* addr, int len, DexHeader* pHeader)
     /*
      * Rewrite the checksum.  We leave the SHA-1 signature alone.
      */
-    uLong adler = adler32(0L, Z_NULL, 0);
     const int nonSum = sizeof(pHeader->magic) + sizeof(pHeader->checksum);
 
-    adler = adler32(adler, addr + nonSum, len - nonSum);
-    pHeader->checksum = adler;
+    pHeader->checksum = dexAdler32(kDexAdler32Init, addr + nonSum,
+        len - nonSum);
 }
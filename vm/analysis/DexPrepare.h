@@ -123,6 +123,13 @@ bool dvmOptimizeDexFile(int fd, off_t dexOffset, long dexLen,
 bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
     const char* fileName, u4 modWhen, u4 crc, bool isBootstrap);
 
+/*
+ * Look up the classes every optimization needs before any DEX file is
+ * processed, so that processes forked afterwards share them.  Only valid
+ * when none of the files to be optimized is on the boot class path.
+ */
+bool dvmPreloadForDexOpt(void);
+
 /*
  * Prepare DEX data that is only available to the VM as in-memory data.
  */
@@ -24,7 +24,7 @@
 
 
 /* fwd */
-static bool verifyMethod(Method* meth);
+static bool verifyMethod(Method* meth, VerifierScratch* scratch);
 static bool verifyInstructions(VerifierData* vdata);
 
 
@@ -39,6 +39,8 @@ static bool verifyInstructions(VerifierData* vdata);
  */
 bool dvmVerifyClass(ClassObject* clazz)
 {
+    VerifierScratch scratch;
+    bool result = false;
     int i;
 
     if (dvmIsClassVerified(clazz)) {
@@ -46,20 +48,27 @@ bool dvmVerifyClass(ClassObject* clazz)
         return true;
     }
 
+    /* per-method tables are recycled across the whole class */
+    memset(&scratch, 0, sizeof(scratch));
+
     for (i = 0; i < clazz->directMethodCount; i++) {
-        if (!verifyMethod(&clazz->directMethods[i])) {
+        if (!verifyMethod(&clazz->directMethods[i], &scratch)) {
             LOG_VFY("Verifier rejected class %s", clazz->descriptor);
-            return false;
+            goto bail;
         }
     }
     for (i = 0; i < clazz->virtualMethodCount; i++) {
-        if (!verifyMethod(&clazz->virtualMethods[i])) {
+        if (!verifyMethod(&clazz->virtualMethods[i], &scratch)) {
             LOG_VFY("Verifier rejected class %s", clazz->descriptor);
-            return false;
+            goto bail;
         }
     }
 
-    return true;
+    result = true;
+
+bail:
+    dvmFreeVerifierScratch(&scratch);
+    return result;
 }
 
 
@@ -232,7 +241,7 @@ static bool scanTryCatchBlocks(const Method* meth, InsnFlags* insnFlags)
  * - each instruction follows the last
  * - last byte of last instruction is at (code_length-1)
  */
-static bool verifyMethod(Method* meth)
+static bool verifyMethod(Method* meth, VerifierScratch* scratch)
 {
     bool result = false;
 
@@ -251,6 +260,7 @@ static bool verifyMethod(Method* meth)
     vdata.insnFlags = NULL;
     vdata.uninitMap = NULL;
     vdata.basicBlocks = NULL;
+    vdata.scratch = scratch;
 
     /*
      * If there aren't any instructions, make sure that's expected, then
@@ -280,11 +290,9 @@ static bool verifyMethod(Method* meth)
 
     /*
      * Allocate and populate an array to hold instruction data.
-     *
-     * TODO: Consider keeping a reusable pre-allocated array sitting
-     * around for smaller methods.
      */
-    vdata.insnFlags = (InsnFlags*) calloc(vdata.insnsSize, sizeof(InsnFlags));
+    vdata.insnFlags = (InsnFlags*) dvmGetVerifierScratch(&scratch->insnFlags,
+        &scratch->insnFlagsSize, vdata.insnsSize * sizeof(InsnFlags));
     if (vdata.insnFlags == NULL)
         goto bail;
 
@@ -334,7 +342,6 @@ success:
 bail:
     dvmFreeVfyBasicBlocks(&vdata);
     dvmFreeUninitInstanceMap(vdata.uninitMap);
-    free(vdata.insnFlags);
     return result;
 }
 
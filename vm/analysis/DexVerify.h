@@ -43,6 +43,7 @@ struct VerifierStats {
     size_t mergeRegChanged;    /* calls from updateRegisters->merge, changed */
     size_t uninitSearches;     /* times we've had to search the uninit table */
     size_t biggestAlloc;       /* largest RegisterLine table alloc */
+    size_t totalAlloc;         /* sum of all RegisterLine table allocs */
 };
 
 /*
@@ -47,6 +47,8 @@ static bool rewriteExecuteInline(Method* method, u2* insns,
     MethodType methodType);
 static bool rewriteExecuteInlineRange(Method* method, u2* insns,
     MethodType methodType);
+static bool inlineTrivialCall(Method* method, u2* insns, u4 insnsSize,
+    MethodType methodType);
 static void rewriteReturnVoid(Method* method, u2* insns);
 static bool needsReturnBarrier(Method* method);
 
@@ -142,6 +144,15 @@ void dvmOptimizeClass(ClassObject* clazz, bool essentialOnly)
  *
  * Instead, we give it our best effort, and hope for the best.  For 100%
  * reliability, only optimize a class after verification succeeds.
+ *
+ * NOTE: opcode pairs (const/4 + if-*, iget-quick + return, ...) are not
+ * fused into superinstructions here.  Only 10 opcode values are unused,
+ * and each one claimed would need handlers in every mterp config
+ * (a "c" stub on ARM would cost more than the dispatch it saves), decoding
+ * in InstrUtils and the JIT front end, and a new odex version since the
+ * rewritten code is written back to the optimized dex file.  The second
+ * instruction would also have to stay in place for branches that target
+ * it, so a fused handler only saves one dispatch.
  */
 static void optimizeMethod(Method* method, bool essentialOnly)
 {
@@ -199,11 +210,15 @@ static void optimizeMethod(Method* method, bool essentialOnly)
          */
         switch (opc) {
         case OP_IGET:
+            quickOpc = OP_IGET_QUICK;
+            if (forSmp)
+                volatileOpc = OP_IGET_VOLATILE;
+            goto rewrite_inst_field;
         case OP_IGET_BOOLEAN:
         case OP_IGET_BYTE:
         case OP_IGET_CHAR:
         case OP_IGET_SHORT:
-            quickOpc = OP_IGET_QUICK;
+            /* packed sub-word fields can't use the 32-bit quick form */
             if (forSmp)
                 volatileOpc = OP_IGET_VOLATILE;
             goto rewrite_inst_field;
@@ -217,11 +232,14 @@ static void optimizeMethod(Method* method, bool essentialOnly)
                 volatileOpc = OP_IGET_OBJECT_VOLATILE;
             goto rewrite_inst_field;
         case OP_IPUT:
+            quickOpc = OP_IPUT_QUICK;
+            if (forSmp)
+                volatileOpc = OP_IPUT_VOLATILE;
+            goto rewrite_inst_field;
         case OP_IPUT_BOOLEAN:
         case OP_IPUT_BYTE:
         case OP_IPUT_CHAR:
         case OP_IPUT_SHORT:
-            quickOpc = OP_IPUT_QUICK;
             if (forSmp)
                 volatileOpc = OP_IPUT_VOLATILE;
             goto rewrite_inst_field;
@@ -279,7 +297,7 @@ rewrite_static_field:
         case OP_INVOKE_DIRECT:
         case OP_INVOKE_DIRECT_RANGE:
             if (!rewriteInvokeObjectInit(method, insns)) {
-                /* may want to try execute-inline, below */
+                /* may want to try execute-inline or inlining, below */
                 matched = false;
             }
             break;
@@ -296,12 +314,23 @@ rewrite_static_field:
         /*
          * non-essential substitutions:
          *  invoke-{virtual,direct,static}[/range] --> execute-inline
+         *  invoke-{virtual,direct,static} --> body of a trivial method
          *  invoke-{virtual,super}[/range] --> invoke-*-quick
+         *
+         * An inlined call can be shorter than the invoke it replaced, so
+         * the width is fetched again.  The rest of the old sequence is
+         * filled with nops, which the loop steps over.
          */
         if (!matched && !essentialOnly) {
             switch (opc) {
             case OP_INVOKE_VIRTUAL:
-                if (!rewriteExecuteInline(method, insns, METHOD_VIRTUAL)) {
+                if (rewriteExecuteInline(method, insns, METHOD_VIRTUAL))
+                    break;
+                if (inlineTrivialCall(method, insns, insnsSize,
+                        METHOD_VIRTUAL))
+                {
+                    width = dexGetWidthFromInstruction(insns);
+                } else {
                     rewriteVirtualInvoke(method, insns,
                         OP_INVOKE_VIRTUAL_QUICK);
                 }
@@ -319,13 +348,19 @@ rewrite_static_field:
                 rewriteVirtualInvoke(method, insns, OP_INVOKE_SUPER_QUICK_RANGE);
                 break;
             case OP_INVOKE_DIRECT:
-                rewriteExecuteInline(method, insns, METHOD_DIRECT);
+                if (rewriteExecuteInline(method, insns, METHOD_DIRECT))
+                    break;
+                if (inlineTrivialCall(method, insns, insnsSize, METHOD_DIRECT))
+                    width = dexGetWidthFromInstruction(insns);
                 break;
             case OP_INVOKE_DIRECT_RANGE:
                 rewriteExecuteInlineRange(method, insns, METHOD_DIRECT);
                 break;
             case OP_INVOKE_STATIC:
-                rewriteExecuteInline(method, insns, METHOD_STATIC);
+                if (rewriteExecuteInline(method, insns, METHOD_STATIC))
+                    break;
+                if (inlineTrivialCall(method, insns, insnsSize, METHOD_STATIC))
+                    width = dexGetWidthFromInstruction(insns);
                 break;
             case OP_INVOKE_STATIC_RANGE:
                 rewriteExecuteInlineRange(method, insns, METHOD_STATIC);
@@ -929,6 +964,8 @@ static void rewriteVirtualInvoke(Method* method, u2* insns, Opcode newOpc)
  *
  * TODO: verifier should ensure Object.<init> contains only return-void,
  * and issue a warning if not.
+ *
+ * Returns "true" if we replace it.
  */
 static bool rewriteInvokeObjectInit(Method* method, u2* insns)
 {
@@ -967,9 +1004,10 @@ static bool rewriteInvokeObjectInit(Method* method, u2* insns)
 
         LOGVV("DexOpt: replaced Object.<init> in %s.%s",
             method->clazz->descriptor, method->name);
+        return true;
     }
 
-    return true;
+    return false;
 }
 
 /*
@@ -1132,6 +1170,352 @@ static bool rewriteExecuteInlineRange(Method* method, u2* insns,
     return false;
 }
 
+/*
+ * Get the byte offset of the field accessed by the iget/iput in the body
+ * of "callee" at "insn".  The body may already have been quickened.
+ *
+ * Returns -1 if the field can't be accessed with a -quick instruction.
+ */
+static int inlinedFieldOffset(const Method* callee, const u2* insn,
+    bool quickened)
+{
+    if (quickened)
+        return insn[1];
+
+    InstField* instField =
+        dvmOptResolveInstField(callee->clazz, insn[1], NULL);
+    if (instField == NULL || dvmIsVolatileField(instField) ||
+        instField->byteOffset >= 65536)
+    {
+        return -1;
+    }
+    return instField->byteOffset;
+}
+
+/*
+ * Inline a getter:
+ *   invoke-{virtual,direct} {vX}, meth ; move-result* vY
+ *     --> iget*-quick vY, vX, off ; nop ; nop
+ *
+ * The body must be "iget* v0, this, field ; return* v0".  Getters of
+ * sub-word fields are left alone, since those fields may be packed and
+ * the -quick forms always move 32 bits.
+ */
+static bool inlineGetter(Method* method, u2* insns, u4 insnsSize,
+    const Method* callee)
+{
+    const u2* body = callee->insns;
+    Opcode quickOpc, returnOpc, moveResultOpc;
+    bool quickened = false;
+
+    switch (dexOpcodeFromCodeUnit(body[0])) {
+    case OP_IGET_QUICK:
+        quickened = true;
+        /* fall through */
+    case OP_IGET:
+        quickOpc = OP_IGET_QUICK;
+        returnOpc = OP_RETURN;
+        moveResultOpc = OP_MOVE_RESULT;
+        break;
+    case OP_IGET_WIDE_QUICK:
+        quickened = true;
+        /* fall through */
+    case OP_IGET_WIDE:
+        quickOpc = OP_IGET_WIDE_QUICK;
+        returnOpc = OP_RETURN_WIDE;
+        moveResultOpc = OP_MOVE_RESULT_WIDE;
+        break;
+    case OP_IGET_OBJECT_QUICK:
+        quickened = true;
+        /* fall through */
+    case OP_IGET_OBJECT:
+        quickOpc = OP_IGET_OBJECT_QUICK;
+        returnOpc = OP_RETURN_OBJECT;
+        moveResultOpc = OP_MOVE_RESULT_OBJECT;
+        break;
+    default:
+        return false;
+    }
+
+    u2 valueReg = (body[0] >> 8) & 0x0f;
+    u2 objReg = body[0] >> 12;
+    if (callee->insSize != 1 || objReg != callee->registersSize - 1 ||
+        dexOpcodeFromCodeUnit(body[2]) != returnOpc ||
+        (body[2] >> 8) != valueReg)
+    {
+        return false;
+    }
+
+    /* the result must be moved to a register iget*-quick can name */
+    if (insnsSize < 4 || dexOpcodeFromCodeUnit(insns[3]) != moveResultOpc)
+        return false;
+    u2 resultReg = insns[3] >> 8;
+    if (resultReg > 0x0f)
+        return false;
+
+    int offset = inlinedFieldOffset(callee, body, quickened);
+    if (offset < 0)
+        return false;
+
+    u2 thisReg = insns[2] & 0x0f;
+    dvmUpdateCodeUnit(method, insns,
+        (thisReg << 12) | (resultReg << 8) | (u2) quickOpc);
+    dvmUpdateCodeUnit(method, insns+1, (u2) offset);
+    dvmUpdateCodeUnit(method, insns+2, OP_NOP);
+    dvmUpdateCodeUnit(method, insns+3, OP_NOP);
+    return true;
+}
+
+/*
+ * Inline a setter:
+ *   invoke-{virtual,direct} {vX, vY[, vY+1]}, meth
+ *     --> iput*-quick vY, vX, off ; nop
+ *
+ * The body must be "iput* value, this, field ; return-void".
+ */
+static bool inlineSetter(Method* method, u2* insns, const Method* callee)
+{
+    const u2* body = callee->insns;
+    Opcode quickOpc;
+    bool quickened = false;
+    int width = 1;
+
+    switch (dexOpcodeFromCodeUnit(body[0])) {
+    case OP_IPUT_QUICK:
+        quickened = true;
+        /* fall through */
+    case OP_IPUT:
+        quickOpc = OP_IPUT_QUICK;
+        break;
+    case OP_IPUT_WIDE_QUICK:
+        quickened = true;
+        /* fall through */
+    case OP_IPUT_WIDE:
+        quickOpc = OP_IPUT_WIDE_QUICK;
+        width = 2;
+        break;
+    case OP_IPUT_OBJECT_QUICK:
+        quickened = true;
+        /* fall through */
+    case OP_IPUT_OBJECT:
+        quickOpc = OP_IPUT_OBJECT_QUICK;
+        break;
+    default:
+        return false;
+    }
+
+    Opcode returnOpc = dexOpcodeFromCodeUnit(body[2]);
+    u2 thisIn = callee->registersSize - callee->insSize;
+    if (callee->insSize != 1 + width || (body[0] >> 12) != thisIn ||
+        ((body[0] >> 8) & 0x0f) != thisIn + 1 ||
+        (returnOpc != OP_RETURN_VOID && returnOpc != OP_RETURN_VOID_BARRIER))
+    {
+        return false;
+    }
+
+    int offset = inlinedFieldOffset(callee, body, quickened);
+    if (offset < 0)
+        return false;
+
+    u2 thisReg = insns[2] & 0x0f;
+    u2 valueReg = (insns[2] >> 4) & 0x0f;
+    dvmUpdateCodeUnit(method, insns,
+        (thisReg << 12) | (valueReg << 8) | (u2) quickOpc);
+    dvmUpdateCodeUnit(method, insns+1, (u2) offset);
+    dvmUpdateCodeUnit(method, insns+2, OP_NOP);
+    return true;
+}
+
+/*
+ * Inline a static method that returns a constant:
+ *   invoke-static {}, meth ; move-result[-object] vY
+ *     --> const/16 vY, #+lit ; nop ; nop
+ *     --> const vY, #+lit ; nop
+ *
+ * The call would initialize the method's class, so this is only done
+ * when the caller's class is that class or a subclass of it, which
+ * guarantees that the initialization has already started.
+ */
+static bool inlineConstant(Method* method, u2* insns, u4 insnsSize,
+    const Method* callee)
+{
+    const u2* body = callee->insns;
+    u4 bodySize = dvmGetMethodInsnsSize(callee);
+    u4 constWidth;
+    u2 constReg;
+    s4 value;
+
+    if (callee->clazz != method->clazz &&
+        !dvmIsSubClass(method->clazz, callee->clazz))
+    {
+        return false;
+    }
+
+    switch (dexOpcodeFromCodeUnit(body[0])) {
+    case OP_CONST_4:
+        constReg = (body[0] >> 8) & 0x0f;
+        value = (s4) (body[0] << 16) >> 28;
+        constWidth = 1;
+        break;
+    case OP_CONST_16:
+        constReg = body[0] >> 8;
+        value = (s2) body[1];
+        constWidth = 2;
+        break;
+    case OP_CONST_HIGH16:
+        constReg = body[0] >> 8;
+        value = (s4) body[1] << 16;
+        constWidth = 2;
+        break;
+    case OP_CONST:
+        constReg = body[0] >> 8;
+        value = body[1] | ((s4) body[2] << 16);
+        constWidth = 3;
+        break;
+    default:
+        return false;
+    }
+
+    if (bodySize != constWidth + 1 || (body[constWidth] >> 8) != constReg)
+        return false;
+
+    Opcode moveResultOpc;
+    switch (dexOpcodeFromCodeUnit(body[constWidth])) {
+    case OP_RETURN:
+        moveResultOpc = OP_MOVE_RESULT;
+        break;
+    case OP_RETURN_OBJECT:
+        if (value != 0)
+            return false;
+        moveResultOpc = OP_MOVE_RESULT_OBJECT;
+        break;
+    default:
+        return false;
+    }
+
+    if (insnsSize < 4 || dexOpcodeFromCodeUnit(insns[3]) != moveResultOpc)
+        return false;
+    u2 resultReg = insns[3] >> 8;
+
+    if (value == (s2) value) {
+        dvmUpdateCodeUnit(method, insns, (resultReg << 8) | OP_CONST_16);
+        dvmUpdateCodeUnit(method, insns+1, (u2) value);
+        dvmUpdateCodeUnit(method, insns+2, OP_NOP);
+    } else {
+        dvmUpdateCodeUnit(method, insns, (resultReg << 8) | OP_CONST);
+        dvmUpdateCodeUnit(method, insns+1, (u2) value);
+        dvmUpdateCodeUnit(method, insns+2, (u2) ((u4) value >> 16));
+    }
+    dvmUpdateCodeUnit(method, insns+3, OP_NOP);
+    return true;
+}
+
+/*
+ * Inline a constructor that only calls Object.<init>:
+ *   invoke-direct {vX}, Foo.<init> --> invoke-object-init/range {vX}
+ *
+ * The method reference is kept, so the debugger path of
+ * invoke-object-init/range still runs the real constructor.  That path
+ * marks the object finalizable before the constructor does it again, so
+ * this is limited to final classes that aren't finalizable, where the
+ * target is known not to be.
+ */
+static bool inlineEmptyInit(Method* method, u2* insns, const Method* callee)
+{
+    const u2* body = callee->insns;
+    u2 thisIn = callee->registersSize - 1;
+
+    if (!dvmIsFinalClass(callee->clazz) ||
+        IS_CLASS_FLAG_SET(callee->clazz, CLASS_ISFINALIZABLE) ||
+        callee->insSize != 1 || dvmGetMethodInsnsSize(callee) != 4)
+    {
+        return false;
+    }
+
+    if (body[0] == (OP_INVOKE_OBJECT_INIT_RANGE | 0x100)) {
+        if (body[2] != thisIn)
+            return false;
+    } else if (body[0] == (OP_INVOKE_DIRECT | 0x1000)) {
+        if ((body[2] & 0x0f) != thisIn)
+            return false;
+        Method* superInit = dvmOptResolveMethod(callee->clazz, body[1],
+            METHOD_DIRECT, NULL);
+        if (superInit == NULL ||
+            superInit->clazz != gDvm.classJavaLangObject ||
+            dvmCompareNameDescriptorAndMethod("<init>", "()V",
+                superInit) != 0)
+        {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    Opcode returnOpc = dexOpcodeFromCodeUnit(body[3]);
+    if (returnOpc != OP_RETURN_VOID && returnOpc != OP_RETURN_VOID_BARRIER)
+        return false;
+
+    u2 thisReg = insns[2] & 0x0f;
+    dvmUpdateCodeUnit(method, insns, OP_INVOKE_OBJECT_INIT_RANGE | 0x100);
+    dvmUpdateCodeUnit(method, insns+2, thisReg);
+    return true;
+}
+
+/*
+ * Replace a non-range invoke-virtual, invoke-direct, or invoke-static of a
+ * trivial method with the method's body: getters and setters of one
+ * instance field, static methods that return a constant, and constructors
+ * that do nothing but call Object.<init>.  The replacement is never longer
+ * than the invoke and its move-result, and the rest is padded with nops.
+ *
+ * The callee must be known at this point, so virtual calls are only
+ * inlined when the target is final or in a final class.  Field offsets
+ * and method bodies from other DEX files are baked in, as they already
+ * are for -quick instructions and vtable indices, so the usual dependency
+ * check on the bootstrap class path keeps them valid.
+ *
+ * The register map of the method needs no update: the map line at the
+ * invoke's address describes the registers the replacement reads, and
+ * the nops that follow are never GC points.
+ *
+ * Returns "true" if we replace it.
+ */
+static bool inlineTrivialCall(Method* method, u2* insns, u4 insnsSize,
+    MethodType methodType)
+{
+    const Method* callee;
+
+    callee = dvmOptResolveMethod(method->clazz, insns[1], methodType, NULL);
+    if (callee == NULL || dvmIsNativeMethod(callee) ||
+        dvmIsAbstractMethod(callee) || dvmIsSynchronizedMethod(callee) ||
+        callee->insns == NULL)
+    {
+        return false;
+    }
+
+    if (methodType == METHOD_VIRTUAL && !dvmIsFinalMethod(callee) &&
+        !dvmIsFinalClass(callee->clazz))
+    {
+        return false;       /* may be overridden */
+    }
+
+    if ((insns[0] >> 12) != callee->insSize)
+        return false;
+
+    if (methodType == METHOD_STATIC)
+        return inlineConstant(method, insns, insnsSize, callee);
+
+    if (dvmCompareNameDescriptorAndMethod("<init>", "()V", callee) == 0)
+        return inlineEmptyInit(method, insns, callee);
+    if (callee->name[0] == '<')
+        return false;
+
+    if (dvmGetMethodInsnsSize(callee) != 3)
+        return false;
+    return inlineGetter(method, insns, insnsSize, callee) ||
+           inlineSetter(method, insns, callee);
+}
+
 /*
  * Returns "true" if the return-void instructions in this method should
  * be converted to return-void-barrier.
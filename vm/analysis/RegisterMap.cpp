@@ -106,6 +106,42 @@ struct MapStats {
 };
 #endif
 
+/*
+ * Cache of expanded register maps.
+ *
+ * Compressed maps are expanded when the GC needs them.  Rather than
+ * replacing the method's map with the expanded copy (which keeps it around
+ * for the lifetime of the VM, and throws away the compact form), we hold
+ * expanded maps in a small 2-way set-associative cache indexed by Method*.
+ * When both ways of a set are occupied, the least-recently-used one is
+ * evicted and freed.
+ *
+ * Each entry also records the map it was expanded from, so that a method
+ * whose register map is replaced never sees a stale expansion.
+ *
+ * The cache is protected by the same external locking that
+ * dvmGetExpandedRegisterMap0 already requires (the heap lock).
+ */
+#define kExpandedMapCacheSets   512         /* must be power of 2 */
+#define kExpandedMapCacheWays   2
+
+struct ExpandedMapCacheEntry {
+    const Method*       method;
+    const RegisterMap*  srcMap;
+    RegisterMap*        expMap;
+};
+
+struct ExpandedMapCacheSet {
+    ExpandedMapCacheEntry way[kExpandedMapCacheWays];
+};
+
+static inline ExpandedMapCacheSet* expandedMapCacheSet(const Method* method)
+{
+    ExpandedMapCacheSet* sets = (ExpandedMapCacheSet*) gDvm.expandedMapCache;
+    u4 hash = ((u4) method >> 3) ^ ((u4) method >> 12);
+    return &sets[hash & (kExpandedMapCacheSets - 1)];
+}
+
 /*
  * Prepare some things.
  */
@@ -115,6 +151,12 @@ bool dvmRegisterMapStartup()
     MapStats* pStats = calloc(1, sizeof(MapStats));
     gDvm.registerMapStats = pStats;
 #endif
+    if (gDvm.expandedMapCache == NULL) {
+        gDvm.expandedMapCache =
+            calloc(kExpandedMapCacheSets, sizeof(ExpandedMapCacheSet));
+        if (gDvm.expandedMapCache == NULL)
+            return false;
+    }
     return true;
 }
 
@@ -126,6 +168,36 @@ void dvmRegisterMapShutdown()
 #ifdef REGISTER_MAP_STATS
     free(gDvm.registerMapStats);
 #endif
+    ExpandedMapCacheSet* sets = (ExpandedMapCacheSet*) gDvm.expandedMapCache;
+    if (sets != NULL) {
+        for (int i = 0; i < kExpandedMapCacheSets; i++) {
+            for (int j = 0; j < kExpandedMapCacheWays; j++)
+                free(sets[i].way[j].expMap);
+        }
+        free(sets);
+        gDvm.expandedMapCache = NULL;
+    }
+}
+
+/*
+ * Discard any cached expansion of "method"'s register map.  Called when
+ * the method is being freed.
+ */
+void dvmPurgeExpandedRegisterMap(const Method* method)
+{
+    if (gDvm.expandedMapCache == NULL)
+        return;
+
+    dvmLockMutex(&gDvm.gcHeapLock);
+    ExpandedMapCacheSet* pSet = expandedMapCacheSet(method);
+    for (int i = 0; i < kExpandedMapCacheWays; i++) {
+        ExpandedMapCacheEntry* pEntry = &pSet->way[i];
+        if (pEntry->method == method) {
+            free(pEntry->expMap);
+            memset(pEntry, 0, sizeof(*pEntry));
+        }
+    }
+    dvmUnlockMutex(&gDvm.gcHeapLock);
 }
 
 /*
@@ -994,8 +1066,11 @@ static int compareMaps(const RegisterMap* pMap1, const RegisterMap* pMap2)
  * Get the expanded form of the register map associated with the method.
  *
  * If the map is already in one of the uncompressed formats, we return
- * immediately.  Otherwise, we expand the map and replace method's register
- * map pointer, freeing it if it was allocated on the heap.
+ * immediately.  Otherwise, we return the expanded map from the cache,
+ * expanding it and inserting it if necessary.  The method keeps its
+ * compressed map.
+ *
+ * The returned map remains valid until the next call.
  *
  * NOTE: this function is not synchronized; external locking is mandatory
  * (unless we're in the zygote, where single-threaded access is guaranteed).
@@ -1018,6 +1093,24 @@ const RegisterMap* dvmGetExpandedRegisterMap0(Method* method)
     }
 
     RegisterMapFormat format = dvmRegisterMapGetFormat(curMap);
+    ExpandedMapCacheSet* pSet = NULL;
+    if (format == kRegMapFormatDifferential) {
+        pSet = expandedMapCacheSet(method);
+        for (int i = 0; i < kExpandedMapCacheWays; i++) {
+            ExpandedMapCacheEntry* pEntry = &pSet->way[i];
+            if (pEntry->method == method && pEntry->srcMap == curMap) {
+                if (i != 0) {
+                    /* move to the MRU position */
+                    ExpandedMapCacheEntry tmp = *pEntry;
+                    memmove(&pSet->way[1], &pSet->way[0],
+                        i * sizeof(ExpandedMapCacheEntry));
+                    pSet->way[0] = tmp;
+                }
+                return pSet->way[0].expMap;
+            }
+        }
+    }
+
     switch (format) {
     case kRegMapFormatCompact8:
     case kRegMapFormatCompact16:
@@ -1067,12 +1160,16 @@ const RegisterMap* dvmGetExpandedRegisterMap0(Method* method)
     }
 
     /*
-     * Update method, and free compressed map if it was sitting on the heap.
+     * Evict the LRU way and insert the new map in the MRU position.  The
+     * method's compressed map is left alone.
      */
-    dvmSetRegisterMap(method, newMap);
-
-    if (dvmRegisterMapGetOnHeap(curMap))
-        dvmFreeRegisterMap((RegisterMap*) curMap);
+    ExpandedMapCacheEntry* pLast = &pSet->way[kExpandedMapCacheWays - 1];
+    free(pLast->expMap);
+    memmove(&pSet->way[1], &pSet->way[0],
+        (kExpandedMapCacheWays - 1) * sizeof(ExpandedMapCacheEntry));
+    pSet->way[0].method = method;
+    pSet->way[0].srcMap = curMap;
+    pSet->way[0].expMap = newMap;
 
     return newMap;
 }
@@ -238,8 +238,8 @@ RegisterMap* dvmGenerateRegisterMapV(VerifierData* vdata);
 
 /*
  * Get the expanded form of the register map associated with the specified
- * method.  May update method->registerMap, possibly freeing the previous
- * map.
+ * method.  Compressed maps are expanded into a bounded cache; the returned
+ * pointer is only valid until the next call.
  *
  * Returns NULL on failure (e.g. unable to expand map).
  *
@@ -260,6 +260,12 @@ INLINE const RegisterMap* dvmGetExpandedRegisterMap(Method* method)
     }
 }
 
+/*
+ * Drop any cached expansion of the method's register map.  Must be called
+ * before a Method is freed.
+ */
+void dvmPurgeExpandedRegisterMap(const Method* method);
+
 /* dump stats gathered during register map creation process */
 void dvmRegisterMapDumpStats(void);
 
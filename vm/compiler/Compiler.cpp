@@ -16,9 +16,12 @@
 
 #include <sys/mman.h>
 #include <errno.h>
+#include <limits.h>
+#include <algorithm>
 #include <cutils/ashmem.h>
 
 #include "Dalvik.h"
+#include "alloc/HugePages.h"
 #include "interp/Jit.h"
 #include "CompilerInternals.h"
 #ifdef ARCH_IA32
@@ -34,18 +37,65 @@ static inline bool workQueueLength(void)
     return gDvmJit.compilerQueueLength;
 }
 
+/*
+ * The work queue is a binary heap in gDvmJit.compilerWorkQueue, so that
+ * the compiler always picks up the hottest order first.  An order gets
+ * hotter each time the same trace is requested again while it waits,
+ * and orders that are equally hot come out in the order they went in.
+ */
+static inline bool workRanksBefore(const CompilerWorkOrder *a,
+                                   const CompilerWorkOrder *b)
+{
+    if (a->hotness != b->hotness)
+        return a->hotness > b->hotness;
+    return (int) (a->seq - b->seq) < 0;
+}
+
+static void workSiftUp(int i)
+{
+    CompilerWorkOrder *queue = gDvmJit.compilerWorkQueue;
+    CompilerWorkOrder work = queue[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!workRanksBefore(&work, &queue[parent]))
+            break;
+        queue[i] = queue[parent];
+        i = parent;
+    }
+    queue[i] = work;
+}
+
+static void workSiftDown(int i)
+{
+    CompilerWorkOrder *queue = gDvmJit.compilerWorkQueue;
+    int length = gDvmJit.compilerQueueLength;
+    CompilerWorkOrder work = queue[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= length)
+            break;
+        if (child + 1 < length &&
+            workRanksBefore(&queue[child + 1], &queue[child]))
+            child++;
+        if (!workRanksBefore(&queue[child], &work))
+            break;
+        queue[i] = queue[child];
+        i = child;
+    }
+    queue[i] = work;
+}
+
 static CompilerWorkOrder workDequeue(void)
 {
-    assert(gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkDequeueIndex].kind
-           != kWorkOrderInvalid);
-    CompilerWorkOrder work =
-        gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkDequeueIndex];
-    gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkDequeueIndex++].kind =
-        kWorkOrderInvalid;
-    if (gDvmJit.compilerWorkDequeueIndex == COMPILER_WORK_QUEUE_SIZE) {
-        gDvmJit.compilerWorkDequeueIndex = 0;
-    }
-    gDvmJit.compilerQueueLength--;
+    assert(gDvmJit.compilerQueueLength > 0);
+    assert(gDvmJit.compilerWorkQueue[0].kind != kWorkOrderInvalid);
+    CompilerWorkOrder work = gDvmJit.compilerWorkQueue[0];
+    int last = --gDvmJit.compilerQueueLength;
+    if (last > 0) {
+        gDvmJit.compilerWorkQueue[0] = gDvmJit.compilerWorkQueue[last];
+        workSiftDown(0);
+    }
+    gDvmJit.compilerWorkQueue[last].kind = kWorkOrderInvalid;
     if (gDvmJit.compilerQueueLength == 0) {
         dvmSignalCond(&gDvmJit.compilerQueueEmpty);
     }
@@ -87,7 +137,9 @@ void dvmCompilerForceWorkEnqueue(const u2 *pc, WorkOrderKind kind, void* info)
 }
 
 /*
- * Attempt to enqueue a work order, returning true if successful.
+ * Attempt to enqueue a work order, returning true if successful.  A
+ * request for a trace that is already queued is folded into the queued
+ * order, which then ranks higher; the new "info" is freed here.
  *
  * NOTE: Make sure that the caller frees the info pointer if the return value
  * is false.
@@ -96,39 +148,45 @@ bool dvmCompilerWorkEnqueue(const u2 *pc, WorkOrderKind kind, void* info)
 {
     int cc;
     int i;
-    int numWork;
-    bool result = true;
 
     dvmLockMutex(&gDvmJit.compilerLock);
 
     /*
-     * Return if queue or code cache is full.
+     * Return if the code cache is full.
      */
-    if (gDvmJit.compilerQueueLength == COMPILER_WORK_QUEUE_SIZE ||
-        gDvmJit.codeCacheFull == true) {
+    if (gDvmJit.codeCacheFull == true) {
         dvmUnlockMutex(&gDvmJit.compilerLock);
         return false;
     }
 
-    for (numWork = gDvmJit.compilerQueueLength,
-           i = gDvmJit.compilerWorkDequeueIndex;
-         numWork > 0;
-         numWork--) {
-        /* Already enqueued */
-        if (gDvmJit.compilerWorkQueue[i++].pc == pc) {
-            dvmUnlockMutex(&gDvmJit.compilerLock);
-            return true;
+    /* Already enqueued */
+    if (pc != NULL) {
+        for (i = 0; i < gDvmJit.compilerQueueLength; i++) {
+            CompilerWorkOrder *order = &gDvmJit.compilerWorkQueue[i];
+            if (order->pc == pc && order->kind == kind) {
+                order->hotness++;
+                workSiftUp(i);
+                dvmUnlockMutex(&gDvmJit.compilerLock);
+                free(info);
+                return true;
+            }
         }
-        /* Wrap around */
-        if (i == COMPILER_WORK_QUEUE_SIZE)
-            i = 0;
+    }
+
+    if (gDvmJit.compilerQueueLength == COMPILER_WORK_QUEUE_SIZE) {
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+        return false;
     }
 
     CompilerWorkOrder *newOrder =
-        &gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkEnqueueIndex];
+        &gDvmJit.compilerWorkQueue[gDvmJit.compilerQueueLength];
     newOrder->pc = pc;
     newOrder->kind = kind;
     newOrder->info = info;
+    /* mode changes go ahead of the traces they affect */
+    newOrder->hotness = (kind == kWorkOrderProfileMode) ? UINT_MAX : 1;
+    newOrder->seq = gDvmJit.compilerWorkSeq++;
+    newOrder->enqueueTime = dvmGetRelativeTimeUsec();
     newOrder->result.methodCompilationAborted = NULL;
     newOrder->result.codeAddress = NULL;
     newOrder->result.discardResult =
@@ -136,15 +194,13 @@ bool dvmCompilerWorkEnqueue(const u2 *pc, WorkOrderKind kind, void* info)
     newOrder->result.cacheVersion = gDvmJit.cacheVersion;
     newOrder->result.requestingThread = dvmThreadSelf();
 
-    gDvmJit.compilerWorkEnqueueIndex++;
-    if (gDvmJit.compilerWorkEnqueueIndex == COMPILER_WORK_QUEUE_SIZE)
-        gDvmJit.compilerWorkEnqueueIndex = 0;
     gDvmJit.compilerQueueLength++;
+    workSiftUp(gDvmJit.compilerQueueLength - 1);
     cc = pthread_cond_signal(&gDvmJit.compilerQueueActivity);
     assert(cc == 0);
 
     dvmUnlockMutex(&gDvmJit.compilerLock);
-    return result;
+    return true;
 }
 
 /* Block until the queue length is 0, or there is a pending suspend request */
@@ -170,23 +226,44 @@ bool dvmCompilerSetupCodeCache(void)
 {
     int fd;
 
-    /* Allocate the code cache */
-    fd = ashmem_create_region("dalvik-jit-code-cache", gDvmJit.codeCacheSize);
-    if (fd < 0) {
-        ALOGE("Could not create %u-byte ashmem region for the JIT code cache",
-             gDvmJit.codeCacheSize);
-        return false;
-    }
-    gDvmJit.codeCache = mmap(NULL, gDvmJit.codeCacheSize,
-                             PROT_READ | PROT_WRITE | PROT_EXEC,
-                             MAP_PRIVATE , fd, 0);
-    close(fd);
-    if (gDvmJit.codeCache == MAP_FAILED) {
-        ALOGE("Failed to mmap the JIT code cache: %s", strerror(errno));
-        return false;
+    /*
+     * Allocate the code cache.  With huge pages it is protected and
+     * unprotected in whole huge pages, so it is made a whole number of
+     * them.  A cache set up in the zygote keeps small pages, so that the
+     * template pages stay shared.
+     */
+    if (gDvm.hugePageMode != kHugePagesNone && !gDvm.zygote) {
+        unsigned int hugePageSize = dvmHugePageSize();
+        gDvmJit.codeCacheSize = (gDvmJit.codeCacheSize + hugePageSize - 1) &
+                                ~(hugePageSize - 1);
+        gDvmJit.codeCache = dvmAllocHugeRegion(gDvmJit.codeCacheSize,
+                                               PROT_READ | PROT_WRITE |
+                                                   PROT_EXEC,
+                                               "dalvik-jit-code-cache", true);
+        if (gDvmJit.codeCache == NULL) {
+            ALOGE("Could not map %u bytes for the JIT code cache",
+                 gDvmJit.codeCacheSize);
+            return false;
+        }
+    } else {
+        fd = ashmem_create_region("dalvik-jit-code-cache",
+                                  gDvmJit.codeCacheSize);
+        if (fd < 0) {
+            ALOGE("Could not create %u-byte ashmem region for the JIT code "
+                 "cache", gDvmJit.codeCacheSize);
+            return false;
+        }
+        gDvmJit.codeCache = mmap(NULL, gDvmJit.codeCacheSize,
+                                 PROT_READ | PROT_WRITE | PROT_EXEC,
+                                 MAP_PRIVATE , fd, 0);
+        close(fd);
+        if (gDvmJit.codeCache == MAP_FAILED) {
+            ALOGE("Failed to mmap the JIT code cache: %s", strerror(errno));
+            return false;
+        }
     }
 
-    gDvmJit.pageSizeMask = getpagesize() - 1;
+    gDvmJit.pageSizeMask = dvmHugeRegionPageSize(gDvmJit.codeCache) - 1;
 
     /* This can be found through "dalvik-jit-code-cache" in /proc/<pid>/maps */
     // ALOGD("Code cache starts at %p", gDvmJit.codeCache);
@@ -207,6 +284,15 @@ bool dvmCompilerSetupCodeCache(void)
         templateSize = (templateSize + 4095) & ~4095;
     }
 
+    /*
+     * A cache set up in the zygote is inherited by every child; keep their
+     * translations off the template pages so those stay shared.
+     */
+    if (gDvm.zygote) {
+        templateSize = (templateSize + gDvmJit.pageSizeMask) &
+                       ~gDvmJit.pageSizeMask;
+    }
+
     gDvmJit.templateSize = templateSize;
     gDvmJit.codeCacheByteUsed = templateSize;
 
@@ -276,6 +362,111 @@ static void crawlDalvikStack(Thread *thread, bool print)
            (u1 *) (saveArea+1) == thread->interpStackStart);
 }
 
+/*
+ * Copies of the hottest traces at the last code cache reset that are
+ * still to be recompiled, coldest first (protected by compilerLock).
+ * Recompiling them puts the working set back in the cache without the
+ * interpreter having to profile it all over again.
+ */
+static JitTraceDescription **resetSurvivors;
+static int numResetSurvivors;
+
+/* Live translations at a reset, ordered by whether to keep them */
+struct ResetCandidate {
+    const JitEntry *entry;
+    JitTraceCounter_t count;
+};
+
+static bool hotterCandidate(const ResetCandidate &a, const ResetCandidate &b)
+{
+    return a.count > b.count;
+}
+
+/* Translations are laid down in order, so the newest are at the top */
+static bool newerCandidate(const ResetCandidate &a, const ResetCandidate &b)
+{
+    return a.entry->codeAddress > b.entry->codeAddress;
+}
+
+/*
+ * Keep copies of the descriptions of the hottest quarter of the traces
+ * in the cache, by profile count while trace profiling is on and by age
+ * otherwise.  Called with compilerLock held.
+ */
+static void saveResetSurvivors(void)
+{
+    std::vector<ResetCandidate> candidates;
+    void *interpretTemplate = dvmCompilerGetInterpretTemplate();
+
+    dvmLockMutex(&gDvmJit.tableLock);
+    for (unsigned int i = 0; i < gDvmJit.jitTableSize; i++) {
+        const JitEntry *entry = &gDvmJit.pJitEntryTable[i];
+        if (entry->dPC == NULL || entry->u.info.isMethodEntry ||
+            entry->codeAddress == NULL ||
+            entry->codeAddress == interpretTemplate) {
+            continue;
+        }
+        ResetCandidate candidate;
+        candidate.entry = entry;
+        candidate.count = dvmCompilerGetTraceProfileCount(entry);
+        candidates.push_back(candidate);
+    }
+    if (gDvmJit.profileMode != kTraceProfilingDisabled) {
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         hotterCandidate);
+    } else {
+        std::sort(candidates.begin(), candidates.end(), newerCandidate);
+    }
+
+    /* Survivors of an earlier reset that did not make it back are cold */
+    while (numResetSurvivors > 0) {
+        free(resetSurvivors[--numResetSurvivors]);
+    }
+    free(resetSurvivors);
+    resetSurvivors = NULL;
+
+    int numKept = candidates.size() / 4;
+    if (numKept > 0) {
+        resetSurvivors = (JitTraceDescription **)
+            malloc(numKept * sizeof(JitTraceDescription *));
+    }
+    if (resetSurvivors != NULL) {
+        for (int i = numKept - 1; i >= 0; i--) {
+            JitTraceDescription *desc =
+                dvmCopyTraceDescriptor(NULL, candidates[i].entry);
+            if (desc != NULL) {
+                resetSurvivors[numResetSurvivors++] = desc;
+            }
+        }
+    }
+    dvmUnlockMutex(&gDvmJit.tableLock);
+}
+
+/*
+ * Queue reset survivors for recompilation, hottest first, as long as
+ * the queue is below its high water mark.  Called with compilerLock
+ * held, which is dropped while each one is queued.
+ */
+static void requeueResetSurvivors(void)
+{
+    while (numResetSurvivors > 0 &&
+           gDvmJit.compilerQueueLength < gDvmJit.compilerHighWater) {
+        JitTraceDescription *desc = resetSurvivors[--numResetSurvivors];
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+
+        const u2 *pc = desc->method->insns +
+                       desc->trace[0].info.frag.startOffset;
+        JitEntry *entry = dvmJitAddTraceEntry(pc);
+        /* Skip traces the interpreter has already brought back */
+        if (entry == NULL || entry->codeAddress != NULL ||
+            !dvmCompilerWorkEnqueue(pc, kWorkOrderTrace, desc)) {
+            free(desc);
+        }
+
+        dvmLockMutex(&gDvmJit.compilerLock);
+    }
+}
+
 static void resetCodeCache(void)
 {
     Thread* thread;
@@ -320,6 +511,9 @@ static void resetCodeCache(void)
         free(work.info);
     }
 
+    /* Hang on to the hot traces before the JitEntry table forgets them */
+    saveResetSurvivors();
+
     /* Reset the JitEntry table contents to the initial unpopulated state */
     dvmJitResetTable();
 
@@ -340,16 +534,19 @@ static void resetCodeCache(void)
     /* Reset the current mark of used bytes to the end of template code */
     gDvmJit.codeCacheByteUsed = gDvmJit.templateSize;
     gDvmJit.numCompilations = 0;
+    dvmCompilerPerfMapReset();
+    dvmCompilerTraceSampleReset();
+    dvmCompilerImplicitCheckReset();
 
     /* Reset the work queue */
     memset(gDvmJit.compilerWorkQueue, 0,
            sizeof(CompilerWorkOrder) * COMPILER_WORK_QUEUE_SIZE);
-    gDvmJit.compilerWorkEnqueueIndex = gDvmJit.compilerWorkDequeueIndex = 0;
     gDvmJit.compilerQueueLength = 0;
 
-    /* Reset the IC patch work queue */
+    /* Reset the IC patch work queue and forget the old chaining cells */
     dvmLockMutex(&gDvmJit.compilerICPatchLock);
     gDvmJit.compilerICPatchIndex = 0;
+    dvmHashTableClear(gDvmJit.icSiteTable);
     dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
 
     /*
@@ -369,6 +566,67 @@ static void resetCodeCache(void)
          gDvmJit.numCodeCacheResetDelayed);
 }
 
+/* Callees a predicted chaining cell has been patched to */
+struct ICSiteStats {
+    const void *cellAddr;
+    int numTargets;
+    const Method *targets[PREDICTED_CHAIN_MAX_TARGETS];
+};
+
+static int compareICSite(const ICSiteStats *a, const ICSiteStats *b)
+{
+    return (int) a->cellAddr - (int) b->cellAddr;
+}
+
+/*
+ * Record that the predicted chaining cell at cellAddr is about to be
+ * repatched to method, and return true if the site has now seen more
+ * callees than PREDICTED_CHAIN_MAX_TARGETS. Such a site would keep
+ * stopping the world to swap one callee for another, so the caller parks
+ * it and lets it dispatch through the vtable instead. The caller holds
+ * compilerICPatchLock.
+ */
+bool dvmCompilerICSiteIsMegamorphic(const void *cellAddr, const Method *method)
+{
+    ICSiteStats dummySite;
+    ICSiteStats *site;
+    int i;
+
+    if (gDvmJit.icSiteTable == NULL) {
+        return false;
+    }
+
+    dummySite.cellAddr = cellAddr;
+    site = (ICSiteStats *) dvmHashTableLookup(gDvmJit.icSiteTable,
+                                              (u4) cellAddr, &dummySite,
+                                              (HashCompareFunc) compareICSite,
+                                              false);
+    if (site == NULL) {
+        site = (ICSiteStats *) calloc(1, sizeof(ICSiteStats));
+        if (site == NULL) {
+            return false;
+        }
+        site->cellAddr = cellAddr;
+        dvmHashTableLookup(gDvmJit.icSiteTable, (u4) cellAddr, site,
+                           (HashCompareFunc) compareICSite, true);
+    }
+
+    if (site->numTargets > PREDICTED_CHAIN_MAX_TARGETS) {
+        return true;
+    }
+    for (i = 0; i < site->numTargets; i++) {
+        if (site->targets[i] == method) {
+            return false;
+        }
+    }
+    if (site->numTargets == PREDICTED_CHAIN_MAX_TARGETS) {
+        site->numTargets++;
+        return true;
+    }
+    site->targets[site->numTargets++] = method;
+    return false;
+}
+
 /*
  * Perform actions that are only safe when all threads are suspended. Currently
  * we do:
@@ -416,6 +674,9 @@ static bool compilerThreadStartup(void)
     /* Track method-level compilation statistics */
     gDvmJit.methodStatsTable =  dvmHashTableCreate(32, NULL);
 
+    /* Track the callees seen by each predicted chaining cell */
+    gDvmJit.icSiteTable = dvmHashTableCreate(256, free);
+
 #if defined(WITH_JIT_TUNING)
     gDvm.verboseShutdown = true;
 #endif
@@ -443,7 +704,9 @@ static bool compilerThreadStartup(void)
      * and then restoring its original value.  However, this action
      * is not synchronized for speed so threads may continue to hold
      * and update the profile table after profiling has been turned
-     * off by null'ng the global pointer.  Be aware.
+     * off by null'ng the global pointer.  Be aware.  Threads that make
+     * trace requests switch to a private copy of this table (see
+     * updateProfTable in Jit.cpp), so it mostly serves as their seed.
      */
     pJitProfTable = (unsigned char *)malloc(JIT_PROF_SIZE);
     if (!pJitProfTable) {
@@ -487,6 +750,14 @@ static bool compilerThreadStartup(void)
     dvmSuspendAllThreads(SUSPEND_FOR_REFRESH);
     dvmResumeAllThreads(SUSPEND_FOR_REFRESH);
 
+    /* Prime the trace heads saved by the last run */
+    dvmCompilerWarmStartLoad();
+
+    dvmLockMutex(&gDvmJit.compilerLock);
+    dvmCompilerPerfMapStartup();
+    dvmCompilerImplicitCheckStartup();
+    dvmUnlockMutex(&gDvmJit.compilerLock);
+
     /* Enable signature breakpoints by customizing the following code */
 #if defined(SIGNATURE_BREAKPOINT)
     /*
@@ -593,6 +864,127 @@ fail:
 
 }
 
+static int telemetryBucket(u8 usec)
+{
+    int bucket = 0;
+    while (usec != 0 && bucket < JIT_TELEMETRY_BUCKETS - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * Account for a finished work order in gDvmJit.telemetry.  codeBytes is the
+ * size of the installed translation, or -1 if nothing was installed.  The
+ * caller holds compilerLock.
+ */
+static void recordTelemetry(const CompilerWorkOrder *work, u8 startTime,
+                            u8 endTime, int codeBytes)
+{
+    JitTelemetry *telemetry = &gDvmJit.telemetry;
+
+    if (work->kind == kWorkOrderProfileMode) {
+        return;
+    }
+
+    u8 waitUsec = startTime - work->enqueueTime;
+    telemetry->queueWaitUsec += waitUsec;
+    if (waitUsec > telemetry->maxQueueWaitUsec) {
+        telemetry->maxQueueWaitUsec = waitUsec;
+    }
+    telemetry->queueWaitBuckets[telemetryBucket(waitUsec)]++;
+
+    u8 compileUsec = endTime - startTime;
+    telemetry->compileUsec += compileUsec;
+    if (compileUsec > telemetry->maxCompileUsec) {
+        telemetry->maxCompileUsec = compileUsec;
+    }
+    telemetry->compileBuckets[telemetryBucket(compileUsec)]++;
+
+    if (codeBytes >= 0) {
+        telemetry->numCompiled++;
+        telemetry->codeBytes += codeBytes;
+    } else if (!work->result.discardResult) {
+        telemetry->numFailed++;
+    }
+}
+
+/*
+ * Copy the compilation telemetry gathered since startup or the last
+ * dvmCompilerResetTelemetry(), along with the exit counters of the tuning
+ * and self-verification builds.
+ */
+void dvmCompilerGetTelemetry(JitTelemetry *telemetry)
+{
+    memset(telemetry, 0, sizeof(*telemetry));
+    if (gDvm.executionMode == kExecutionModeJit) {
+        dvmLockMutex(&gDvmJit.compilerLock);
+        *telemetry = gDvmJit.telemetry;
+        telemetry->queueLength = gDvmJit.compilerQueueLength;
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+    }
+
+#if defined(WITH_JIT_TUNING)
+    telemetry->numPunts = gDvmJit.puntExit;
+    telemetry->numNoChainExits = 0;
+    for (int i = 0; i < kNoChainExitLast; i++) {
+        telemetry->numNoChainExits += gDvmJit.noChainExit[i];
+    }
+#else
+    telemetry->numPunts = -1;
+    telemetry->numNoChainExits = -1;
+#endif
+#if defined(WITH_SELF_VERIFICATION)
+    telemetry->numSelfVerificationFailures = gDvmJit.selfVerificationFailures;
+#else
+    telemetry->numSelfVerificationFailures = -1;
+#endif
+}
+
+void dvmCompilerResetTelemetry(void)
+{
+    if (gDvm.executionMode != kExecutionModeJit) {
+        return;
+    }
+    dvmLockMutex(&gDvmJit.compilerLock);
+    memset(&gDvmJit.telemetry, 0, sizeof(gDvmJit.telemetry));
+    dvmUnlockMutex(&gDvmJit.compilerLock);
+}
+
+/*
+ * Map the whole code cache writable for a run of compilations, so that the
+ * installs and chain patches made in the meantime need no mprotect calls
+ * of their own.  Each of them still flushes the range it wrote.  A thread
+ * that patches the cache takes codeCacheProtectionLock after compilerLock,
+ * so both may be called with compilerLock held.
+ */
+static void openCodeCacheWindow(void)
+{
+#ifndef ARCH_IA32
+    dvmLockMutex(&gDvmJit.codeCacheProtectionLock);
+    if (!gDvmJit.codeCacheWritable) {
+        mprotect(gDvmJit.codeCache, gDvmJit.codeCacheSize,
+                 UNPROTECT_CODE_CACHE_ATTRS);
+        gDvmJit.codeCacheWritable = true;
+    }
+    dvmUnlockMutex(&gDvmJit.codeCacheProtectionLock);
+#endif
+}
+
+static void closeCodeCacheWindow(void)
+{
+#ifndef ARCH_IA32
+    dvmLockMutex(&gDvmJit.codeCacheProtectionLock);
+    if (gDvmJit.codeCacheWritable) {
+        mprotect(gDvmJit.codeCache, gDvmJit.codeCacheSize,
+                 PROTECT_CODE_CACHE_ATTRS);
+        gDvmJit.codeCacheWritable = false;
+    }
+    dvmUnlockMutex(&gDvmJit.codeCacheProtectionLock);
+#endif
+}
+
 static void *compilerThreadStart(void *arg)
 {
     dvmChangeStatus(NULL, THREAD_VMWAIT);
@@ -652,25 +1044,31 @@ static void *compilerThreadStart(void *arg)
      * bit late when there is suspend request pending.
      */
     while (!gDvmJit.haltCompilerThread) {
+        if (workQueueLength() == 0 && numResetSurvivors > 0) {
+            requeueResetSurvivors();
+            continue;
+        }
         if (workQueueLength() == 0) {
             int cc;
+            closeCodeCacheWindow();
             cc = pthread_cond_signal(&gDvmJit.compilerQueueEmpty);
             assert(cc == 0);
             pthread_cond_wait(&gDvmJit.compilerQueueActivity,
                               &gDvmJit.compilerLock);
             continue;
         } else {
+            openCodeCacheWindow();
             do {
                 CompilerWorkOrder work = workDequeue();
                 dvmUnlockMutex(&gDvmJit.compilerLock);
-#if defined(WITH_JIT_TUNING)
                 /*
-                 * This is live across setjmp().  Mark it volatile to suppress
-                 * a gcc warning.  We should not need this since it is assigned
-                 * only once but gcc is not smart enough.
+                 * These are live across setjmp().  Mark them volatile to
+                 * suppress a gcc warning.  We should not need this since they
+                 * are assigned only once but gcc is not smart enough.
                  */
                 volatile u8 startTime = dvmGetRelativeTimeUsec();
-#endif
+                volatile int cacheUsedBefore = gDvmJit.codeCacheByteUsed;
+                volatile int codeBytes = -1;
                 /*
                  * Check whether there is a suspend request on me.  This
                  * is necessary to allow a clean shutdown.
@@ -717,19 +1115,37 @@ static void *compilerThreadStart(void *arg)
                                               work.result.instructionSet,
                                               false, /* not method entry */
                                               work.result.profileCodeSize);
+                            /* The cache version rules out a reset since */
+                            codeBytes = gDvmJit.codeCacheByteUsed -
+                                        cacheUsedBefore;
+                            dvmCompilerPerfMapAdd(
+                                (JitTraceDescription *) work.info,
+                                (char *) gDvmJit.codeCache + cacheUsedBefore,
+                                codeBytes);
+                            dvmCompilerTraceSampleAdd(
+                                (JitTraceDescription *) work.info,
+                                (char *) gDvmJit.codeCache + cacheUsedBefore,
+                                codeBytes);
                         }
                         dvmUnlockMutex(&gDvmJit.compilerLock);
+                        /* Send loops already running into the new trace */
+                        if (codeBytes != 0) {
+                            dvmJitPrimeProfCounter(work.pc);
+                        }
                     }
                     dvmCompilerArenaReset();
                 }
                 free(work.info);
+                u8 endTime = dvmGetRelativeTimeUsec();
 #if defined(WITH_JIT_TUNING)
-                gDvmJit.jitTime += dvmGetRelativeTimeUsec() - startTime;
+                gDvmJit.jitTime += endTime - startTime;
 #endif
                 dvmLockMutex(&gDvmJit.compilerLock);
+                recordTelemetry(&work, startTime, endTime, codeBytes);
             } while (workQueueLength() != 0);
         }
     }
+    closeCodeCacheWindow();
     pthread_cond_signal(&gDvmJit.compilerQueueEmpty);
     dvmUnlockMutex(&gDvmJit.compilerLock);
 
@@ -745,6 +1161,26 @@ static void *compilerThreadStart(void *arg)
     return NULL;
 }
 
+/*
+ * Called in the zygote before the first fork.  Maps the code cache and
+ * copies the templates into it, so that the children share those pages
+ * copy-on-write instead of each mapping and filling a cache of its own.
+ * compilerThreadStartup keeps an inherited cache.  Failure is not fatal;
+ * the children then set up their own.
+ */
+bool dvmCompilerZygoteStartup(void)
+{
+    assert(gDvm.zygote);
+    if (!dvmCompilerArchInit()) {
+        return false;
+    }
+    if (!dvmCompilerSetupCodeCache()) {
+        gDvmJit.codeCache = NULL;
+        return false;
+    }
+    return true;
+}
+
 bool dvmCompilerStartup(void)
 {
 
@@ -756,7 +1192,7 @@ bool dvmCompilerStartup(void)
     pthread_cond_init(&gDvmJit.compilerQueueEmpty, NULL);
 
     /* Reset the work queue */
-    gDvmJit.compilerWorkEnqueueIndex = gDvmJit.compilerWorkDequeueIndex = 0;
+    gDvmJit.compilerWorkSeq = 0;
     gDvmJit.compilerQueueLength = 0;
     dvmUnlockMutex(&gDvmJit.compilerLock);
 
@@ -773,6 +1209,8 @@ void dvmCompilerShutdown(void)
 {
     void *threadReturn;
 
+    dvmDisableJitTraceSampling();
+
     /* Disable new translation requests */
     gDvmJit.pProfTable = NULL;
     gDvmJit.pProfTableCopy = NULL;
@@ -799,6 +1237,10 @@ void dvmCompilerShutdown(void)
             ALOGD("Compiler thread has shut down");
     }
 
+    /* No more traces can be added, so save their heads for the next run */
+    dvmCompilerWarmStartSave();
+    dvmCompilerPerfMapShutdown();
+
     /* Break loops within the translation cache */
     dvmJitUnchainAll();
 
@@ -39,6 +39,14 @@
 #define PREDICTED_CHAIN_COUNTER_AVOID    0x7fffffff
 /* Rechain after this many misses - shared globally and has to be positive */
 #define PREDICTED_CHAIN_COUNTER_RECHAIN  8192
+/* Give up on a predicted chain after it has been patched to this many callees */
+#define PREDICTED_CHAIN_MAX_TARGETS      4
+
+/*
+ * Field accesses below this offset from a null object are known to fault,
+ * so -Xjitimplicitchecks can leave their null checks to the fault handler.
+ */
+#define IMPLICIT_CHECK_MAX_OFFSET       4096
 
 #define COMPILER_TRACED(X)
 #define COMPILER_TRACEE(X)
@@ -48,21 +56,29 @@
 #define PROTECT_CODE_CACHE_ATTRS       (PROT_READ | PROT_EXEC)
 #define UNPROTECT_CODE_CACHE_ATTRS     (PROT_READ | PROT_EXEC | PROT_WRITE)
 
-/* Acquire the lock before removing PROT_WRITE from the specified mem region */
+/*
+ * Acquire the lock before removing PROT_WRITE from the specified mem region.
+ * Nothing needs to change while the compiler thread holds the whole cache
+ * writable (gDvmJit.codeCacheWritable).
+ */
 #define UNPROTECT_CODE_CACHE(addr, size)                                       \
     {                                                                          \
         dvmLockMutex(&gDvmJit.codeCacheProtectionLock);                        \
-        mprotect((void *) (((intptr_t) (addr)) & ~gDvmJit.pageSizeMask),       \
-                 (size) + (((intptr_t) (addr)) & gDvmJit.pageSizeMask),        \
-                 (UNPROTECT_CODE_CACHE_ATTRS));                                \
+        if (!gDvmJit.codeCacheWritable) {                                      \
+            mprotect((void *) (((intptr_t) (addr)) & ~gDvmJit.pageSizeMask),   \
+                     (size) + (((intptr_t) (addr)) & gDvmJit.pageSizeMask),    \
+                     (UNPROTECT_CODE_CACHE_ATTRS));                            \
+        }                                                                      \
     }
 
 /* Add the PROT_WRITE to the specified memory region then release the lock */
 #define PROTECT_CODE_CACHE(addr, size)                                         \
     {                                                                          \
-        mprotect((void *) (((intptr_t) (addr)) & ~gDvmJit.pageSizeMask),       \
-                 (size) + (((intptr_t) (addr)) & gDvmJit.pageSizeMask),        \
-                 (PROTECT_CODE_CACHE_ATTRS));                                  \
+        if (!gDvmJit.codeCacheWritable) {                                      \
+            mprotect((void *) (((intptr_t) (addr)) & ~gDvmJit.pageSizeMask),   \
+                     (size) + (((intptr_t) (addr)) & gDvmJit.pageSizeMask),    \
+                     (PROTECT_CODE_CACHE_ATTRS));                              \
+        }                                                                      \
         dvmUnlockMutex(&gDvmJit.codeCacheProtectionLock);                      \
     }
 
@@ -90,6 +106,31 @@ typedef struct JitTranslationInfo {
     int cacheVersion;           // Used to identify stale trace requests
 } JitTranslationInfo;
 
+/*
+ * Bucket 0 of a telemetry histogram counts requests that took less than a
+ * microsecond, and bucket i counts those that took [2^(i-1), 2^i)
+ * microseconds.  The last bucket also counts anything longer.
+ */
+#define JIT_TELEMETRY_BUCKETS 24
+
+/* Live compilation statistics, kept in all builds */
+typedef struct JitTelemetry {
+    u4 numCompiled;             // translations installed
+    u4 numFailed;               // requests that bailed out or were dropped
+    u8 codeBytes;               // code cache bytes taken by translations
+    u8 compileUsec;             // total time spent compiling
+    u4 maxCompileUsec;
+    u8 queueWaitUsec;           // total time requests spent in the queue
+    u4 maxQueueWaitUsec;
+    /* Filled in by dvmCompilerGetTelemetry, -1 if not built in */
+    int queueLength;            // orders waiting right now
+    int numPunts;               // WITH_JIT_TUNING only
+    int numNoChainExits;        // WITH_JIT_TUNING only
+    int numSelfVerificationFailures;    // WITH_SELF_VERIFICATION only
+    u4 compileBuckets[JIT_TELEMETRY_BUCKETS];
+    u4 queueWaitBuckets[JIT_TELEMETRY_BUCKETS];
+} JitTelemetry;
+
 typedef enum WorkOrderKind {
     kWorkOrderInvalid = 0,      // Should never see by the backend
     kWorkOrderMethod = 1,       // Work is to compile a whole method
@@ -102,6 +143,9 @@ typedef struct CompilerWorkOrder {
     const u2* pc;
     WorkOrderKind kind;
     void* info;
+    unsigned int hotness;       /* requests coalesced into this order */
+    unsigned int seq;           /* enqueue order, to break ties */
+    u8 enqueueTime;             /* usec, for the queue wait telemetry */
     JitTranslationInfo result;
     jmp_buf *bailPtr;
 } CompilerWorkOrder;
@@ -194,12 +238,14 @@ bool dvmCompilerSetupCodeCache(void);
 bool dvmCompilerArchInit(void);
 void dvmCompilerArchDump(void);
 bool dvmCompilerStartup(void);
+bool dvmCompilerZygoteStartup(void);
 void dvmCompilerShutdown(void);
 void dvmCompilerForceWorkEnqueue(const u2* pc, WorkOrderKind kind, void* info);
 bool dvmCompilerWorkEnqueue(const u2* pc, WorkOrderKind kind, void* info);
 void *dvmCheckCodeCache(void *method);
 CompilerMethodStats *dvmCompilerAnalyzeMethodBody(const Method *method,
                                                   bool isCallee);
+bool dvmCompilerIsDevirtualizable(const Method *method);
 bool dvmCompilerCanIncludeThisInstruction(const Method *method,
                                           const DecodedInstruction *insn);
 bool dvmCompileMethod(const Method *method, JitTranslationInfo *info);
@@ -210,7 +256,53 @@ void dvmCompilerDrainQueue(void);
 void dvmJitUnchainAll(void);
 void dvmJitScanAllClassPointers(void (*callback)(void *ptr));
 void dvmCompilerSortAndPrintTraceProfiles(void);
+void dvmCompilerWarmStartLoad(void);
+bool dvmCompilerWarmStartSave(void);
+void dvmCompilerWarmStartClass(const ClassObject *clazz);
+bool dvmCompilerIsWarmTraceHead(const u2 *pc);
+void dvmCompilerPerfMapStartup(void);
+void dvmCompilerPerfMapAdd(const JitTraceDescription *desc,
+                           const void *start, size_t size);
+void dvmCompilerPerfMapReset(void);
+void dvmCompilerPerfMapShutdown(void);
+void dvmCompilerTraceSampleAdd(const JitTraceDescription *desc,
+                               const void *start, size_t size);
+void dvmCompilerTraceSampleReset(void);
+
+/*
+ * Sample the translations running threads are in every "intervalUsec"
+ * microseconds, or the -Xjittracesample interval with 0, discarding
+ * anything collected before.  Must not be called in the zygote.
+ */
+bool dvmEnableJitTraceSampling(int intervalUsec);
+
+/*
+ * Stop sampling and log the busiest traces.  Does nothing if sampling is
+ * not enabled.
+ */
+void dvmDisableJitTraceSampling(void);
+
+/*
+ * Print the busiest traces.  Prints nothing if sampling is disabled.
+ */
+void dvmDumpJitTraceSamples(const DebugOutputTarget *target);
+
+/*
+ * Generate a byte[] with the sampled trace profile for DDM, or NULL if
+ * sampling is disabled.  The caller must call dvmReleaseTrackedAlloc() on
+ * the array.
+ */
+ArrayObject *dvmDdmGenerateJitTraceSamples(void);
+
+void dvmCompilerImplicitCheckStartup(void);
+bool dvmCompilerImplicitChecksEnabled(void);
+bool dvmCompilerImplicitCheckReserve(int count);
+void dvmCompilerImplicitCheckAdd(const void *faultAddr, const void *resumeAddr);
+void dvmCompilerImplicitCheckReset(void);
+bool dvmCompilerICSiteIsMegamorphic(const void *cellAddr, const Method *method);
 void dvmCompilerPerformSafePointChecks(void);
+void dvmCompilerGetTelemetry(JitTelemetry *telemetry);
+void dvmCompilerResetTelemetry(void);
 void dvmCompilerInlineMIR(struct CompilationUnit *cUnit,
                           JitTranslationInfo *info);
 void dvmInitializeSSAConversion(struct CompilationUnit *cUnit);
@@ -226,6 +318,8 @@ bool dvmCompilerDoConstantPropagation(struct CompilationUnit *cUnit,
                                       struct BasicBlock *bb);
 bool dvmCompilerFindInductionVariables(struct CompilationUnit *cUnit,
                                        struct BasicBlock *bb);
+void dvmCompilerEliminateWriteBarriers(struct CompilationUnit *cUnit);
+void dvmCompilerGlobalValueNumbering(struct CompilationUnit *cUnit);
 /* Clear the visited flag for each BB */
 bool dvmCompilerClearVisitedFlag(struct CompilationUnit *cUnit,
                                  struct BasicBlock *bb);
@@ -107,6 +107,8 @@ typedef enum {
     kMIRInlinedPred,                    // Invoke is inlined via prediction
     kMIRCallee,                         // Instruction is inlined from callee
     kMIRInvokeMethodJIT,                // Callee is JIT'ed as a whole method
+    kMIRIgnoreWriteBarrier,             // Store needs no card mark
+    kMIRUnconditionalBarrier,           // Mark the card even for null
 } MIROptimizationFlagPositons;
 
 #define MIR_IGNORE_NULL_CHECK           (1 << kMIRIgnoreNullCheck)
@@ -117,12 +119,15 @@ typedef enum {
 #define MIR_INLINED_PRED                (1 << kMIRInlinedPred)
 #define MIR_CALLEE                      (1 << kMIRCallee)
 #define MIR_INVOKE_METHOD_JIT           (1 << kMIRInvokeMethodJIT)
+#define MIR_IGNORE_WRITE_BARRIER        (1 << kMIRIgnoreWriteBarrier)
+#define MIR_UNCONDITIONAL_BARRIER       (1 << kMIRUnconditionalBarrier)
 
 typedef struct CallsiteInfo {
     const char *classDescriptor;
     Object *classLoader;
     const Method *method;
     LIR *misPredBranchOver;
+    bool devirtualized;         // Guard on method->isOverridden, not the class
 } CallsiteInfo;
 
 typedef struct MIR {
@@ -213,6 +218,7 @@ typedef struct CompilationUnit {
     int numClassPointers;
     LIR *chainCellOffsetLIR;
     GrowableList pcReconstructionList;
+    GrowableList implicitCheckList;     // Accesses the fault handler checks
     int headerSize;                     // bytes before the first code ptr
     int dataOffset;                     // starting offset of literal pool
     int totalSize;                      // header + code size
@@ -259,6 +265,13 @@ typedef struct CompilationUnit {
      */
     const u2 *switchOverflowPad;
 
+    /*
+     * Block id of the chaining cell for the first case of the switch that
+     * ends the trace.  The cells of the other chained cases and then the
+     * default follow it.
+     */
+    int switchChainingCellBase;
+
     JitMode jitMode;
     int numReachableBlocks;
     int numDalvikRegisters;             // method->registersSize + inlined
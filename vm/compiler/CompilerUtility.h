@@ -22,6 +22,14 @@
 /* Each arena page has some overhead, so take a few bytes off 8k */
 #define ARENA_DEFAULT_SIZE 8100
 
+/*
+ * Requests bigger than this get a block of their own, rounded up to a
+ * power of two, from a pool of large blocks that is kept across
+ * compilations.  Smaller ones are carved out of the ARENA_DEFAULT_SIZE
+ * blocks.
+ */
+#define ARENA_LARGE_THRESHOLD (ARENA_DEFAULT_SIZE / 4)
+
 /* Allocate the initial memory block for arena-based allocation */
 bool dvmCompilerHeapInit(void);
 
@@ -36,6 +44,22 @@ void *dvmCompilerNew(size_t size, bool zero);
 
 void dvmCompilerArenaReset(void);
 
+/* The phases of a compilation that are timed and charged for arena use */
+typedef enum CompilerPass {
+    kCompilerPassFrontend = 0,  // trace or method building, inlining
+    kCompilerPassDataflow,      // SSA conversion, dataflow and loop analysis
+    kCompilerPassRegAlloc,
+    kCompilerPassCodegen,       // MIR to LIR
+    kCompilerPassAssembly,      // LIR to machine code, with any retries
+    kCompilerPassCount
+} CompilerPass;
+
+/*
+ * End the pass in progress, if any, and start "pass".  The arena reset at
+ * the end of a compilation ends the last pass.
+ */
+void dvmCompilerStartPass(CompilerPass pass);
+
 typedef struct GrowableList {
     size_t numAllocated;
     size_t numUsed;
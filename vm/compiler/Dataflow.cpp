@@ -1416,12 +1416,764 @@ bool dvmCompilerDoConstantPropagation(CompilationUnit *cUnit, BasicBlock *bb)
     return true;
 }
 
+/*
+ * Returns true if "mir" can neither reach a GC safe point nor be handed
+ * to the interpreter, so the card table and the set of unpublished
+ * objects are the same after it as before.  Calls, allocations, monitor
+ * operations, statics and anything that may be single-stepped are left
+ * out.
+ */
+static bool keepsBarrierState(const MIR *mir)
+{
+    int opcode = mir->dalvikInsn.opcode;
+
+    if (opcode == kMirOpPhi) {
+        return true;
+    }
+    if (opcode >= kNumPackedOpcodes || SINGLE_STEP_OP(opcode)) {
+        return false;
+    }
+    if (opcode >= OP_NEG_INT && opcode <= OP_USHR_INT_LIT8) {
+        return true;
+    }
+    switch (opcode) {
+        case OP_NOP:
+        case OP_MOVE:
+        case OP_MOVE_FROM16:
+        case OP_MOVE_16:
+        case OP_MOVE_WIDE:
+        case OP_MOVE_WIDE_FROM16:
+        case OP_MOVE_WIDE_16:
+        case OP_MOVE_OBJECT:
+        case OP_MOVE_OBJECT_FROM16:
+        case OP_MOVE_OBJECT_16:
+        case OP_CONST_4:
+        case OP_CONST_16:
+        case OP_CONST:
+        case OP_CONST_HIGH16:
+        case OP_CONST_WIDE_16:
+        case OP_CONST_WIDE_32:
+        case OP_CONST_WIDE:
+        case OP_CONST_WIDE_HIGH16:
+        case OP_CONST_STRING:
+        case OP_CONST_STRING_JUMBO:
+        case OP_CONST_CLASS:
+        case OP_ARRAY_LENGTH:
+        case OP_CMPL_FLOAT:
+        case OP_CMPG_FLOAT:
+        case OP_CMPL_DOUBLE:
+        case OP_CMPG_DOUBLE:
+        case OP_CMP_LONG:
+        case OP_AGET:
+        case OP_AGET_WIDE:
+        case OP_AGET_OBJECT:
+        case OP_AGET_BOOLEAN:
+        case OP_AGET_BYTE:
+        case OP_AGET_CHAR:
+        case OP_AGET_SHORT:
+        case OP_APUT:
+        case OP_APUT_WIDE:
+        case OP_APUT_OBJECT:
+        case OP_APUT_BOOLEAN:
+        case OP_APUT_BYTE:
+        case OP_APUT_CHAR:
+        case OP_APUT_SHORT:
+        case OP_IGET:
+        case OP_IGET_WIDE:
+        case OP_IGET_OBJECT:
+        case OP_IGET_BOOLEAN:
+        case OP_IGET_BYTE:
+        case OP_IGET_CHAR:
+        case OP_IGET_SHORT:
+        case OP_IPUT:
+        case OP_IPUT_WIDE:
+        case OP_IPUT_OBJECT:
+        case OP_IPUT_BOOLEAN:
+        case OP_IPUT_BYTE:
+        case OP_IPUT_CHAR:
+        case OP_IPUT_SHORT:
+        case OP_IGET_VOLATILE:
+        case OP_IPUT_VOLATILE:
+        case OP_IGET_OBJECT_VOLATILE:
+        case OP_IPUT_OBJECT_VOLATILE:
+        case OP_IGET_QUICK:
+        case OP_IGET_WIDE_QUICK:
+        case OP_IGET_OBJECT_QUICK:
+        case OP_IPUT_QUICK:
+        case OP_IPUT_WIDE_QUICK:
+        case OP_IPUT_OBJECT_QUICK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Drop or merge the card marks of reference stores within each block.
+ *
+ * A store into an object allocated earlier in the same block needs no
+ * barrier as long as there has been no safe point since, and the object
+ * has not been stored anywhere yet.  No collection can have started
+ * while it existed, so the collector has not seen it, and will find its
+ * fields when it first reaches it.  Heap arenas look for references
+ * into them through the dirty cards of other objects, so this part is
+ * off when they are in use.
+ *
+ * Cards are only cleared while the world is stopped, so after one store
+ * into an object has marked its card, later stores into the same object
+ * need no mark of their own until the next safe point.  The mark is
+ * normally skipped when the stored value is null, so the first store is
+ * told to mark the card regardless.
+ */
+void dvmCompilerEliminateWriteBarriers(CompilationUnit *cUnit)
+{
+    if (cUnit->allSingleStep ||
+        (gDvmJit.disableOpt & (1 << kWriteBarrierElimination))) {
+        return;
+    }
+
+    bool trackNewObjects = (gDvm.arenaSpaceSize == 0);
+    BitVector *newObjectV =
+        dvmCompilerAllocBitVector(cUnit->numSSARegs, false);
+    BitVector *dirtyV = dvmCompilerAllocBitVector(cUnit->numSSARegs, false);
+    MIR **markedBy =
+        (MIR **) dvmCompilerNew(sizeof(MIR *) * cUnit->numSSARegs, true);
+
+    GrowableListIterator iterator;
+    dvmGrowableListIteratorInit(&cUnit->blockList, &iterator);
+    while (true) {
+        BasicBlock *bb = (BasicBlock *) dvmGrowableListIteratorNext(&iterator);
+        if (bb == NULL) break;
+        if (bb->hidden || bb->blockType != kDalvikByteCode) continue;
+
+        dvmClearAllBits(newObjectV);
+        dvmClearAllBits(dirtyV);
+        for (MIR *mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            int opcode = mir->dalvikInsn.opcode;
+            SSARepresentation *ssaRep = mir->ssaRep;
+
+            if (opcode == OP_NEW_INSTANCE || opcode == OP_NEW_ARRAY) {
+                /* The allocation may collect */
+                dvmClearAllBits(newObjectV);
+                dvmClearAllBits(dirtyV);
+                if (trackNewObjects) {
+                    dvmSetBit(newObjectV, ssaRep->defs[0]);
+                }
+                continue;
+            }
+            if (!keepsBarrierState(mir)) {
+                dvmClearAllBits(newObjectV);
+                dvmClearAllBits(dirtyV);
+                continue;
+            }
+            if (ssaRep == NULL) {
+                continue;
+            }
+
+            int dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+            if (dfAttributes & DF_IS_MOVE) {
+                int src = ssaRep->uses[0];
+                int dest = ssaRep->defs[0];
+                if (dvmIsBitSet(newObjectV, src)) {
+                    dvmSetBit(newObjectV, dest);
+                }
+                if (dvmIsBitSet(dirtyV, src)) {
+                    dvmSetBit(dirtyV, dest);
+                    markedBy[dest] = markedBy[src];
+                }
+                continue;
+            }
+
+            bool isRefStore = false;
+            switch (opcode) {
+                case OP_APUT_OBJECT:
+                case OP_IPUT_OBJECT:
+                case OP_IPUT_OBJECT_VOLATILE:
+                case OP_IPUT_OBJECT_QUICK:
+                    isRefStore = true;
+                    break;
+                default:
+                    break;
+            }
+            if (!isRefStore) {
+                continue;
+            }
+
+            /* uses[0] is the value stored, uses[1] the object or array */
+            int value = ssaRep->uses[0];
+            int target = ssaRep->uses[1];
+            if (dvmIsBitSet(newObjectV, target)) {
+                mir->OptimizationFlags |= MIR_IGNORE_WRITE_BARRIER;
+            } else if (dvmIsBitSet(dirtyV, target)) {
+                mir->OptimizationFlags |= MIR_IGNORE_WRITE_BARRIER;
+                markedBy[target]->OptimizationFlags |=
+                    MIR_UNCONDITIONAL_BARRIER;
+            } else {
+                dvmSetBit(dirtyV, target);
+                markedBy[target] = mir;
+            }
+            /* Once published, new objects may be seen by the collector */
+            if (dvmIsBitSet(newObjectV, value)) {
+                dvmClearAllBits(newObjectV);
+            }
+        }
+    }
+}
+
+/*
+ * Redundancy elimination over the dominator tree.
+ *
+ * Each SSA name gets a value number.  A move shares the number of its
+ * source, and so does a load that is turned into a move, so every name
+ * for an object is known to be the same object.  Walking down the
+ * dominator tree:
+ *  - a null check is dropped when a dominating instruction has already
+ *    dereferenced the same value, or the value is a new object;
+ *  - an instance field load becomes a move when the same field of the
+ *    same object was loaded or stored on the way down and the Dalvik
+ *    register holding its value has not been written since.
+ *
+ * Values never change, so null facts flow into every dominated block.
+ * Field contents can change on any path, so known fields only flow into
+ * blocks with a single predecessor.  They are forgotten after anything
+ * that may write a field, call out or synchronize.  Catch handlers are
+ * entered from the middle of a block and start from scratch.
+ *
+ * The trace JIT only compiles static accesses and allocations whose
+ * class is already initialized, so there are no class initialization
+ * checks left to remove.
+ */
+#define MAX_KNOWN_FIELDS 16
+
+struct FieldAccess {
+    int objIdx;                 /* ssaRep->uses index of the object */
+    int offset;                 /* byte offset of the field */
+    int width;                  /* 4 or 8 bytes */
+    Opcode kind;                /* the iget that reads the field */
+    bool isStore;
+};
+
+struct KnownField {
+    int objValue;               /* value number of the object */
+    int offset;
+    int width;
+    Opcode kind;
+    int sReg[2];                /* SSA names holding the value */
+    int vReg;                   /* Dalvik register holding the low half */
+};
+
+struct RedundancyState {
+    BitVector *nonNullV;        /* value numbers known not to be null */
+    KnownField fields[MAX_KNOWN_FIELDS];
+    int numFields;
+};
+
+struct RedundancyContext {
+    int *valueNumbers;
+    bool rewriteLoads;
+    BitVector *catchEntryV;     /* blocks that begin a catch handler */
+};
+
+/*
+ * Returns in "access" the field that "mir" reads or writes if it is a
+ * non-volatile access to a resolved instance field.
+ */
+static bool getFieldAccess(const CompilationUnit *cUnit, const MIR *mir,
+                           FieldAccess *access)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+    bool isQuick = false;
+
+    switch (opcode) {
+        case OP_IGET:
+        case OP_IGET_WIDE:
+        case OP_IGET_OBJECT:
+        case OP_IGET_BOOLEAN:
+        case OP_IGET_BYTE:
+        case OP_IGET_CHAR:
+        case OP_IGET_SHORT:
+            access->kind = opcode;
+            access->isStore = false;
+            break;
+        case OP_IPUT:
+        case OP_IPUT_WIDE:
+        case OP_IPUT_OBJECT:
+        case OP_IPUT_BOOLEAN:
+        case OP_IPUT_BYTE:
+        case OP_IPUT_CHAR:
+        case OP_IPUT_SHORT:
+            access->kind = (Opcode) (opcode - OP_IPUT + OP_IGET);
+            access->isStore = true;
+            break;
+        case OP_IGET_QUICK:
+        case OP_IPUT_QUICK:
+            access->kind = OP_IGET;
+            access->isStore = (opcode == OP_IPUT_QUICK);
+            isQuick = true;
+            break;
+        case OP_IGET_WIDE_QUICK:
+        case OP_IPUT_WIDE_QUICK:
+            access->kind = OP_IGET_WIDE;
+            access->isStore = (opcode == OP_IPUT_WIDE_QUICK);
+            isQuick = true;
+            break;
+        case OP_IGET_OBJECT_QUICK:
+        case OP_IPUT_OBJECT_QUICK:
+            access->kind = OP_IGET_OBJECT;
+            access->isStore = (opcode == OP_IPUT_OBJECT_QUICK);
+            isQuick = true;
+            break;
+        default:
+            return false;
+    }
+
+    access->width = (access->kind == OP_IGET_WIDE) ? 8 : 4;
+    if (!access->isStore) {
+        access->objIdx = 0;
+    } else {
+        access->objIdx = (access->width == 8) ? 2 : 1;
+    }
+
+    if (isQuick) {
+        access->offset = mir->dalvikInsn.vC;
+        return true;
+    }
+
+    const Method *method = (mir->OptimizationFlags & MIR_CALLEE) ?
+        mir->meta.calleeMethod : cUnit->method;
+    Field *fieldPtr = method->clazz->pDvmDex->pResFields[mir->dalvikInsn.vC];
+    if (fieldPtr == NULL || dvmIsVolatileField(fieldPtr)) {
+        return false;
+    }
+    access->offset = ((InstField *) fieldPtr)->byteOffset;
+    return true;
+}
+
+/*
+ * Returns the ssaRep->uses index of the reference "mir" dereferences, or
+ * -1.  "*canSkip" tells whether the code generator leaves the null check
+ * out when the MIR is marked with MIR_IGNORE_NULL_CHECK.
+ */
+static int getDereferencedUse(const MIR *mir, bool *canSkip)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+    int dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+
+    *canSkip = true;
+    if (dfAttributes & DF_NULL_N_RANGE_CHECK_0) {
+        return 0;
+    } else if (dfAttributes & DF_NULL_N_RANGE_CHECK_1) {
+        return 1;
+    } else if (dfAttributes & DF_NULL_N_RANGE_CHECK_2) {
+        return 2;
+    }
+
+    switch (opcode) {
+        case OP_ARRAY_LENGTH:
+        case OP_IGET:
+        case OP_IGET_WIDE:
+        case OP_IGET_OBJECT:
+        case OP_IGET_BOOLEAN:
+        case OP_IGET_BYTE:
+        case OP_IGET_CHAR:
+        case OP_IGET_SHORT:
+        case OP_IGET_VOLATILE:
+        case OP_IGET_OBJECT_VOLATILE:
+        case OP_IGET_QUICK:
+        case OP_IGET_WIDE_QUICK:
+        case OP_IGET_OBJECT_QUICK:
+            return 0;
+        case OP_IPUT:
+        case OP_IPUT_OBJECT:
+        case OP_IPUT_BOOLEAN:
+        case OP_IPUT_BYTE:
+        case OP_IPUT_CHAR:
+        case OP_IPUT_SHORT:
+        case OP_IPUT_VOLATILE:
+        case OP_IPUT_OBJECT_VOLATILE:
+        case OP_IPUT_QUICK:
+        case OP_IPUT_OBJECT_QUICK:
+            return 1;
+        case OP_IPUT_WIDE:
+        case OP_IPUT_WIDE_QUICK:
+            return 2;
+        /* The receiver is known to be non-null once the call returns */
+        case OP_INVOKE_VIRTUAL:
+        case OP_INVOKE_SUPER:
+        case OP_INVOKE_DIRECT:
+        case OP_INVOKE_INTERFACE:
+        case OP_INVOKE_VIRTUAL_RANGE:
+        case OP_INVOKE_SUPER_RANGE:
+        case OP_INVOKE_DIRECT_RANGE:
+        case OP_INVOKE_INTERFACE_RANGE:
+        case OP_INVOKE_VIRTUAL_QUICK:
+        case OP_INVOKE_VIRTUAL_QUICK_RANGE:
+        case OP_INVOKE_SUPER_QUICK:
+        case OP_INVOKE_SUPER_QUICK_RANGE:
+        case OP_MONITOR_ENTER:
+        case OP_MONITOR_EXIT:
+            *canSkip = false;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/*
+ * Returns true if "mir" leaves every instance field as it was.  Field
+ * accesses themselves are handled by the caller.
+ */
+static bool keepsFieldValues(const MIR *mir)
+{
+    int opcode = mir->dalvikInsn.opcode;
+
+    if (opcode == kMirOpPhi) {
+        return true;
+    }
+    if (opcode >= kNumPackedOpcodes) {
+        return false;
+    }
+    if ((opcode >= OP_NEG_INT && opcode <= OP_USHR_INT_LIT8) ||
+        (opcode >= OP_IF_EQ && opcode <= OP_IF_LEZ) ||
+        (opcode >= OP_AGET && opcode <= OP_APUT_SHORT)) {
+        return true;
+    }
+    switch (opcode) {
+        case OP_NOP:
+        case OP_MOVE:
+        case OP_MOVE_FROM16:
+        case OP_MOVE_16:
+        case OP_MOVE_WIDE:
+        case OP_MOVE_WIDE_FROM16:
+        case OP_MOVE_WIDE_16:
+        case OP_MOVE_OBJECT:
+        case OP_MOVE_OBJECT_FROM16:
+        case OP_MOVE_OBJECT_16:
+        case OP_CONST_4:
+        case OP_CONST_16:
+        case OP_CONST:
+        case OP_CONST_HIGH16:
+        case OP_CONST_WIDE_16:
+        case OP_CONST_WIDE_32:
+        case OP_CONST_WIDE:
+        case OP_CONST_WIDE_HIGH16:
+        case OP_CONST_STRING:
+        case OP_CONST_STRING_JUMBO:
+        case OP_CONST_CLASS:
+        case OP_ARRAY_LENGTH:
+        case OP_CHECK_CAST:
+        case OP_INSTANCE_OF:
+        case OP_CMPL_FLOAT:
+        case OP_CMPG_FLOAT:
+        case OP_CMPL_DOUBLE:
+        case OP_CMPG_DOUBLE:
+        case OP_CMP_LONG:
+        case OP_GOTO:
+        case OP_GOTO_16:
+        case OP_GOTO_32:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static KnownField *findKnownField(RedundancyState *state, int objValue,
+                                  const FieldAccess *access)
+{
+    for (int i = 0; i < state->numFields; i++) {
+        KnownField *field = &state->fields[i];
+        if (field->objValue == objValue && field->offset == access->offset &&
+            field->kind == access->kind) {
+            return field;
+        }
+    }
+    return NULL;
+}
+
+/* Forget the fields that overlap the given bytes of any object */
+static void killFieldsAt(RedundancyState *state, int offset, int width)
+{
+    int i = 0;
+    while (i < state->numFields) {
+        KnownField *field = &state->fields[i];
+        if (field->offset < offset + width &&
+            offset < field->offset + field->width) {
+            *field = state->fields[--state->numFields];
+        } else {
+            i++;
+        }
+    }
+}
+
+/* Forget the fields whose value lived in Dalvik register "vReg" */
+static void killFieldsInReg(RedundancyState *state, int vReg)
+{
+    int i = 0;
+    while (i < state->numFields) {
+        KnownField *field = &state->fields[i];
+        if (field->vReg == vReg ||
+            (field->width == 8 && field->vReg + 1 == vReg)) {
+            *field = state->fields[--state->numFields];
+        } else {
+            i++;
+        }
+    }
+}
+
+static void addKnownField(CompilationUnit *cUnit, RedundancyState *state,
+                          int objValue, const FieldAccess *access,
+                          const int *sRegs)
+{
+    if (state->numFields == MAX_KNOWN_FIELDS) {
+        return;
+    }
+    KnownField *field = &state->fields[state->numFields++];
+    field->objValue = objValue;
+    field->offset = access->offset;
+    field->width = access->width;
+    field->kind = access->kind;
+    field->sReg[0] = sRegs[0];
+    field->sReg[1] = (access->width == 8) ? sRegs[1] : INVALID_SREG;
+    field->vReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit, sRegs[0]));
+}
+
+/* Turn the field load "mir" into a move from where "field" is held */
+static void convertLoadToMove(MIR *mir, const KnownField *field)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+    int numUses = (field->width == 8) ? 2 : 1;
+
+    if (field->width == 8) {
+        mir->dalvikInsn.opcode = OP_MOVE_WIDE_16;
+    } else if (field->kind == OP_IGET_OBJECT) {
+        mir->dalvikInsn.opcode = OP_MOVE_OBJECT_16;
+    } else {
+        mir->dalvikInsn.opcode = OP_MOVE_16;
+    }
+    mir->dalvikInsn.vB = field->vReg;
+    mir->dalvikInsn.vC = 0;
+
+    ssaRep->numUses = numUses;
+    ssaRep->uses = (int *) dvmCompilerNew(sizeof(int) * numUses, false);
+    ssaRep->fpUse = (bool *) dvmCompilerNew(sizeof(bool) * numUses, true);
+    for (int i = 0; i < numUses; i++) {
+        ssaRep->uses[i] = field->sReg[i];
+    }
+}
+
+static void eliminateBlockRedundancies(CompilationUnit *cUnit,
+                                       RedundancyContext *context,
+                                       BasicBlock *bb,
+                                       RedundancyState *state)
+{
+    int *valueNumbers = context->valueNumbers;
+
+    for (MIR *mir = bb->firstMIRInsn; mir; mir = mir->next) {
+        int opcode = mir->dalvikInsn.opcode;
+        SSARepresentation *ssaRep = mir->ssaRep;
+
+        /* Inlined away */
+        if (mir->OptimizationFlags & MIR_INLINED) {
+            continue;
+        }
+        /* Hoisted loop checks test the invariant array reference */
+        if (opcode == kMirOpNullNRangeUpCheck ||
+            opcode == kMirOpNullNRangeDownCheck) {
+            dvmSetBit(state->nonNullV,
+                      valueNumbers[mir->dalvikInsn.vA]);
+            continue;
+        }
+        if (ssaRep == NULL) {
+            if (!keepsFieldValues(mir)) {
+                state->numFields = 0;
+            }
+            continue;
+        }
+
+        bool canSkip;
+        int refIdx = getDereferencedUse(mir, &canSkip);
+        if (refIdx >= 0 && refIdx < ssaRep->numUses) {
+            int value = valueNumbers[ssaRep->uses[refIdx]];
+            if (canSkip && dvmIsBitSet(state->nonNullV, value)) {
+                mir->OptimizationFlags |= MIR_IGNORE_NULL_CHECK;
+            }
+            dvmSetBit(state->nonNullV, value);
+        }
+
+        FieldAccess access;
+        bool isFieldAccess = getFieldAccess(cUnit, mir, &access);
+        KnownField *known = NULL;
+        int objValue = -1;
+        if (isFieldAccess) {
+            objValue = valueNumbers[ssaRep->uses[access.objIdx]];
+            if (!access.isStore) {
+                known = findKnownField(state, objValue, &access);
+            }
+        } else if (!keepsFieldValues(mir)) {
+            state->numFields = 0;
+        }
+
+        int dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+        if (dfAttributes & DF_IS_MOVE) {
+            valueNumbers[ssaRep->defs[0]] = valueNumbers[ssaRep->uses[0]];
+            if (dfAttributes & DF_DA_WIDE) {
+                valueNumbers[ssaRep->defs[1]] = valueNumbers[ssaRep->uses[1]];
+            }
+        }
+        if (known != NULL && context->rewriteLoads) {
+            valueNumbers[ssaRep->defs[0]] = valueNumbers[known->sReg[0]];
+            if (known->width == 8) {
+                valueNumbers[ssaRep->defs[1]] = valueNumbers[known->sReg[1]];
+            }
+            convertLoadToMove(mir, known);
+        }
+
+        for (int i = 0; i < ssaRep->numDefs; i++) {
+            killFieldsInReg(state,
+                DECODE_REG(dvmConvertSSARegToDalvik(cUnit, ssaRep->defs[i])));
+        }
+
+        switch (opcode) {
+            case OP_NEW_INSTANCE:
+            case OP_NEW_ARRAY:
+            case OP_CONST_STRING:
+            case OP_CONST_STRING_JUMBO:
+            case OP_CONST_CLASS:
+                dvmSetBit(state->nonNullV, valueNumbers[ssaRep->defs[0]]);
+                break;
+            default:
+                break;
+        }
+
+        if (!isFieldAccess) {
+            continue;
+        }
+        if (access.isStore) {
+            /* Any object may be the one written */
+            killFieldsAt(state, access.offset, access.width);
+            /* Narrow stores truncate the value */
+            if (access.kind == OP_IGET || access.kind == OP_IGET_WIDE ||
+                access.kind == OP_IGET_OBJECT) {
+                addKnownField(cUnit, state, objValue, &access, ssaRep->uses);
+            }
+        } else if (known == NULL) {
+            addKnownField(cUnit, state, objValue, &access, ssaRep->defs);
+        }
+    }
+}
+
+static void walkDominatorTree(CompilationUnit *cUnit,
+                              RedundancyContext *context, BasicBlock *bb,
+                              const RedundancyState *parentState)
+{
+    RedundancyState *state =
+        (RedundancyState *) dvmCompilerNew(sizeof(RedundancyState), false);
+    state->nonNullV = dvmCompilerAllocBitVector(cUnit->numSSARegs, false);
+
+    if (parentState == NULL || dvmIsBitSet(context->catchEntryV, bb->id)) {
+        dvmClearAllBits(state->nonNullV);
+        state->numFields = 0;
+    } else {
+        dvmCopyBitVector(state->nonNullV, parentState->nonNullV);
+        if (dvmCountSetBits(bb->predecessors) == 1) {
+            state->numFields = parentState->numFields;
+            memcpy(state->fields, parentState->fields,
+                   sizeof(KnownField) * parentState->numFields);
+        } else {
+            state->numFields = 0;
+        }
+    }
+
+    eliminateBlockRedundancies(cUnit, context, bb, state);
+
+    if (bb->iDominated == NULL) {
+        return;
+    }
+    BitVectorIterator bvIterator;
+    dvmBitVectorIteratorInit(bb->iDominated, &bvIterator);
+    while (true) {
+        int bbIdx = dvmBitVectorIteratorNext(&bvIterator);
+        if (bbIdx == -1) break;
+        BasicBlock *dominatedBB =
+            (BasicBlock *) dvmGrowableListGetElement(&cUnit->blockList, bbIdx);
+        walkDominatorTree(cUnit, context, dominatedBB, state);
+    }
+}
+
+/*
+ * Entry point for loop traces and whole methods, which have the
+ * dominator tree this needs.  Runs after SSA conversion.
+ */
+void dvmCompilerGlobalValueNumbering(CompilationUnit *cUnit)
+{
+    if (cUnit->allSingleStep ||
+        (gDvmJit.disableOpt & (1 << kGlobalValueNumbering))) {
+        return;
+    }
+
+    RedundancyContext context;
+    context.valueNumbers =
+        (int *) dvmCompilerNew(sizeof(int) * cUnit->numSSARegs, false);
+    for (int i = 0; i < cUnit->numSSARegs; i++) {
+        context.valueNumbers[i] = i;
+    }
+#if defined(ARCH_IA32)
+    /* The x86 back end lowers loads from their Dalvik encoding */
+    context.rewriteLoads = false;
+#else
+    context.rewriteLoads = true;
+#endif
+
+    context.catchEntryV =
+        dvmCompilerAllocBitVector(cUnit->numBlocks, false);
+    dvmClearAllBits(context.catchEntryV);
+    GrowableListIterator iterator;
+    dvmGrowableListIteratorInit(&cUnit->blockList, &iterator);
+    while (true) {
+        BasicBlock *bb = (BasicBlock *) dvmGrowableListIteratorNext(&iterator);
+        if (bb == NULL) break;
+        if (bb->successorBlockList.blockListType != kCatch) continue;
+
+        GrowableListIterator succIterator;
+        dvmGrowableListIteratorInit(&bb->successorBlockList.blocks,
+                                    &succIterator);
+        while (true) {
+            SuccessorBlockInfo *successorBlockInfo = (SuccessorBlockInfo *)
+                dvmGrowableListIteratorNext(&succIterator);
+            if (successorBlockInfo == NULL) break;
+            dvmSetBit(context.catchEntryV, successorBlockInfo->block->id);
+        }
+    }
+
+    walkDominatorTree(cUnit, &context, cUnit->entryBlock, NULL);
+}
+
+/*
+ * Return the MIR after mir in the loop body, moving on to the next block in
+ * the loop once the current block runs out.
+ */
+static MIR *nextLoopMIR(BasicBlock **bbPtr, MIR *mir)
+{
+    if (mir->next != NULL) {
+        return mir->next;
+    }
+    BasicBlock *bb = *bbPtr;
+    while ((bb = dvmCompilerNextLoopBlock(bb)) != NULL) {
+        if (bb->firstMIRInsn != NULL) {
+            *bbPtr = bb;
+            return bb->firstMIRInsn;
+        }
+    }
+    return NULL;
+}
+
 bool dvmCompilerFindInductionVariables(struct CompilationUnit *cUnit,
                                        struct BasicBlock *bb)
 {
     BitVector *isIndVarV = cUnit->loopAnalysis->isIndVarV;
     BitVector *isConstantV = cUnit->isConstantV;
     GrowableList *ivList = cUnit->loopAnalysis->ivList;
+    BasicBlock *loopBB;
     MIR *mir;
 
     if (bb->blockType != kDalvikByteCode && bb->blockType != kEntryBlock) {
@@ -1435,7 +2187,8 @@ bool dvmCompilerFindInductionVariables(struct CompilationUnit *cUnit,
     }
 
     /* Find basic induction variable first */
-    for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+    for (loopBB = bb, mir = bb->firstMIRInsn; mir;
+         mir = nextLoopMIR(&loopBB, mir)) {
         int dfAttributes =
             dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
 
@@ -1500,7 +2253,8 @@ bool dvmCompilerFindInductionVariables(struct CompilationUnit *cUnit,
     }
 
     /* Find dependent induction variable now */
-    for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+    for (loopBB = bb, mir = bb->firstMIRInsn; mir;
+         mir = nextLoopMIR(&loopBB, mir)) {
         int dfAttributes =
             dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
 
@@ -380,6 +380,28 @@ CompilerMethodStats *dvmCompilerAnalyzeMethodBody(const Method *method,
     return realMethodEntry;
 }
 
+/*
+ * Class hierarchy analysis for invoke-virtual.  Returns true if every
+ * receiver of a virtual call that dispatched to "method" once will keep
+ * dispatching to it: its class introduced the vtable slot, so all receivers
+ * are instances of that class, and no loaded class overrides it.  A class
+ * loaded later can change the answer, so compiled code that relies on it
+ * has to check method->isOverridden at run time.
+ */
+bool dvmCompilerIsDevirtualizable(const Method *method)
+{
+    const ClassObject *clazz = method->clazz;
+
+    if (dvmIsAbstractMethod(method) || dvmIsInterfaceClass(clazz)) {
+        return false;
+    }
+    if (clazz->super != NULL &&
+        method->methodIndex < clazz->super->vtableCount) {
+        return false;
+    }
+    return !method->isOverridden;
+}
+
 /*
  * Crawl the stack of the thread that requesed compilation to see if any of the
  * ancestors are on the blacklist.
@@ -1160,6 +1182,22 @@ static void processCanThrow(CompilationUnit *cUnit, BasicBlock *curBlock,
  *
  * TODO: implementation will be revisited when the trace builder can provide
  * whole-method traces.
+ *
+ * NOTE: only the front end is live.  Every ArchVariant sets kMethodJit in
+ * disableOpt and the only back end, armv7-a-neon/MethodCodegenDriver.cpp,
+ * is compiled out, so nothing produced here is ever installed.  Making
+ * this a real compilation mode needs, in the back end:
+ *  - a suspend check on every backward branch, not just under
+ *    -Xjitsuspendpoll, since a method can loop indefinitely;
+ *  - invokes that build an interpreter-compatible frame (see
+ *    genMethodInflateAndPunt) rather than assuming a leaf;
+ *  - exception edges to the catch blocks set up by processTryCatchBlocks,
+ *    and a way to rebuild the frame for the interpreter when an exception
+ *    is not caught in the method;
+ *  - a stack walker and GC register maps that understand compiled
+ *    frames.
+ * Until then, methods with loops, invokes or handlers are left to the
+ * trace JIT.
  */
 bool dvmCompileMethod(const Method *method, JitTranslationInfo *info)
 {
@@ -1178,6 +1216,7 @@ bool dvmCompileMethod(const Method *method, JitTranslationInfo *info)
 
     memset(&cUnit, 0, sizeof(cUnit));
     cUnit.method = method;
+    dvmCompilerStartPass(kCompilerPassFrontend);
 
     cUnit.jitMode = kJitMethod;
 
@@ -1190,6 +1229,7 @@ bool dvmCompileMethod(const Method *method, JitTranslationInfo *info)
      */
     /* Initialize the PC reconstruction list */
     dvmInitGrowableList(&cUnit.pcReconstructionList, 8);
+    dvmInitGrowableList(&cUnit.implicitCheckList, 4);
 
     /* Allocate the bit-vector to track the beginning of basic blocks */
     BitVector *tryBlockAddr = dvmCompilerAllocBitVector(dexCode->insnsSize,
@@ -1312,9 +1352,12 @@ bool dvmCompileMethod(const Method *method, JitTranslationInfo *info)
 
 
     /* Perform SSA transformation for the whole method */
+    dvmCompilerStartPass(kCompilerPassDataflow);
     dvmCompilerMethodSSATransformation(&cUnit);
+    dvmCompilerGlobalValueNumbering(&cUnit);
 
 #ifndef ARCH_IA32
+    dvmCompilerStartPass(kCompilerPassRegAlloc);
     dvmCompilerInitializeRegAlloc(&cUnit);  // Needs to happen after SSA naming
 
     /* Allocate Registers using simple local allocation scheme */
@@ -1322,6 +1365,7 @@ bool dvmCompileMethod(const Method *method, JitTranslationInfo *info)
 #endif
 
     /* Convert MIR to LIR, etc. */
+    dvmCompilerStartPass(kCompilerPassCodegen);
     dvmCompilerMethodMIR2LIR(&cUnit);
 
     // Debugging only
@@ -1330,6 +1374,7 @@ bool dvmCompileMethod(const Method *method, JitTranslationInfo *info)
     /* Method is not empty */
     if (cUnit.firstLIRInsn) {
         /* Convert LIR into machine code. Loop for recoverable retries */
+        dvmCompilerStartPass(kCompilerPassAssembly);
         do {
             dvmCompilerAssembleLIR(&cUnit, info);
             cUnit.assemblerRetries++;
@@ -1469,6 +1514,7 @@ static bool compileLoop(CompilationUnit *cUnit, unsigned int startOffset,
 
     /* Initialize the PC reconstruction list */
     dvmInitGrowableList(&cUnit->pcReconstructionList, 8);
+    dvmInitGrowableList(&cUnit->implicitCheckList, 4);
 
     /* Create the default entry and exit blocks and enter them to the list */
     BasicBlock *entryBlock = dvmCompilerNewBB(kEntryBlock, numBlocks++);
@@ -1527,10 +1573,13 @@ static bool compileLoop(CompilationUnit *cUnit, unsigned int startOffset,
 
 
     /* Try to identify a loop */
+    dvmCompilerStartPass(kCompilerPassDataflow);
     if (!dvmCompilerBuildLoop(cUnit))
         goto bail;
 
     dvmCompilerLoopOpt(cUnit);
+    dvmCompilerGlobalValueNumbering(cUnit);
+    dvmCompilerEliminateWriteBarriers(cUnit);
 
     /*
      * Change the backward branch to the backward chaining cell after dataflow
@@ -1540,14 +1589,17 @@ static bool compileLoop(CompilationUnit *cUnit, unsigned int startOffset,
 
 #if defined(ARCH_IA32)
     /* Convert MIR to LIR, etc. */
+    dvmCompilerStartPass(kCompilerPassCodegen);
     dvmCompilerMIR2LIR(cUnit, info);
 #else
+    dvmCompilerStartPass(kCompilerPassRegAlloc);
     dvmCompilerInitializeRegAlloc(cUnit);
 
     /* Allocate Registers using simple local allocation scheme */
     dvmCompilerLocalRegAlloc(cUnit);
 
     /* Convert MIR to LIR, etc. */
+    dvmCompilerStartPass(kCompilerPassCodegen);
     dvmCompilerMIR2LIR(cUnit);
 #endif
 
@@ -1561,6 +1613,7 @@ static bool compileLoop(CompilationUnit *cUnit, unsigned int startOffset,
     }
 
     /* Convert LIR into machine code. Loop for recoverable retries */
+    dvmCompilerStartPass(kCompilerPassAssembly);
     do {
         dvmCompilerAssembleLIR(cUnit, info);
         cUnit->assemblerRetries++;
@@ -1671,6 +1724,7 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
 
     compilationId++;
     memset(&cUnit, 0, sizeof(CompilationUnit));
+    dvmCompilerStartPass(kCompilerPassFrontend);
 
 #if defined(WITH_JIT_TUNING)
     /* Locate the entry to store compilation statistics for this method */
@@ -1692,6 +1746,7 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
 
     /* Initialize the PC reconstruction list */
     dvmInitGrowableList(&cUnit.pcReconstructionList, 8);
+    dvmInitGrowableList(&cUnit.implicitCheckList, 4);
 
     /* Initialize the basic block list */
     blockList = &cUnit.blockList;
@@ -1980,6 +2035,7 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
                      2 : size * 2));
 
             /* One chaining cell for the first MAX_CHAINED_SWITCH_CASES cases */
+            cUnit.switchChainingCellBase = numBlocks;
             for (i = 0; i < maxChains; i++) {
                 BasicBlock *caseChain = dvmCompilerNewBB(kChainingCellNormal,
                                                          numBlocks++);
@@ -2102,11 +2158,14 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
     cUnit.numDalvikRegisters = cUnit.method->registersSize;
 
     /* Preparation for SSA conversion */
+    dvmCompilerStartPass(kCompilerPassDataflow);
     dvmInitializeSSAConversion(&cUnit);
 
     dvmCompilerNonLoopAnalysis(&cUnit);
+    dvmCompilerEliminateWriteBarriers(&cUnit);
 
 #ifndef ARCH_IA32
+    dvmCompilerStartPass(kCompilerPassRegAlloc);
     dvmCompilerInitializeRegAlloc(&cUnit);  // Needs to happen after SSA naming
 #endif
 
@@ -2119,13 +2178,16 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
     dvmCompilerLocalRegAlloc(&cUnit);
 
     /* Convert MIR to LIR, etc. */
+    dvmCompilerStartPass(kCompilerPassCodegen);
     dvmCompilerMIR2LIR(&cUnit);
 #else /* ARCH_IA32 */
     /* Convert MIR to LIR, etc. */
+    dvmCompilerStartPass(kCompilerPassCodegen);
     dvmCompilerMIR2LIR(&cUnit, info);
 #endif
 
     /* Convert LIR into machine code. Loop for recoverable retries */
+    dvmCompilerStartPass(kCompilerPassAssembly);
     do {
         dvmCompilerAssembleLIR(&cUnit, info);
         cUnit.assemblerRetries++;
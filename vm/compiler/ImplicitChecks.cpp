@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Implicit null checks.
+ *
+ * With -Xjitimplicitchecks the code generator leaves out the null check
+ * in front of an instance field access whose offset falls inside the
+ * first page.  A null object then makes the access fault, and the SIGSEGV
+ * handler installed here resumes the thread at the PC reconstruction cell
+ * the explicit check would have branched to.  That cell punts to the
+ * interpreter, which re-executes the instruction and throws.
+ *
+ * The faulting native PCs live in an open-addressed table that the
+ * handler reads without taking locks.  Entries are only added by the
+ * compiler thread under compilerLock, and the table is only cleared by a
+ * code cache reset, when no thread is in the code cache.  When it fills
+ * up, installs fail and the code generator goes back to explicit checks
+ * until the next reset.
+ */
+
+#include "Dalvik.h"
+#include "CompilerInternals.h"
+
+#include <errno.h>
+#include <signal.h>
+#if defined(__arm__)
+#include <asm/ucontext.h>
+#endif
+
+/* Must be a power of 2; at most 3/4 of the slots are ever used */
+#define IMPLICIT_CHECK_TABLE_SIZE   8192
+#define IMPLICIT_CHECK_TABLE_LIMIT  (IMPLICIT_CHECK_TABLE_SIZE / 4 * 3)
+
+struct ImplicitCheckEntry {
+    volatile int32_t faultAddr;         // 0 marks an empty slot
+    volatile int32_t resumeAddr;
+};
+
+static ImplicitCheckEntry *checkTable;
+static int numChecks;
+static bool tableFull;
+static struct sigaction prevAction;
+
+static inline u4 checkHash(u4 addr)
+{
+    return ((addr >> 1) * 2654435761u) & (IMPLICIT_CHECK_TABLE_SIZE - 1);
+}
+
+/* Returns the resume address for a fault at "addr", or 0 */
+static u4 lookupCheck(u4 addr)
+{
+    u4 idx = checkHash(addr);
+    for (int probes = 0; probes < IMPLICIT_CHECK_TABLE_SIZE; probes++) {
+        u4 faultAddr =
+            (u4) android_atomic_acquire_load(&checkTable[idx].faultAddr);
+        if (faultAddr == 0) {
+            return 0;
+        }
+        if (faultAddr == addr) {
+            return (u4) checkTable[idx].resumeAddr;
+        }
+        idx = (idx + 1) & (IMPLICIT_CHECK_TABLE_SIZE - 1);
+    }
+    return 0;
+}
+
+static void implicitCheckHandler(int signum, siginfo_t *info, void *context)
+{
+#if defined(__arm__)
+    struct ucontext *uc = (struct ucontext *) context;
+    u4 pc = uc->uc_mcontext.arm_pc;
+    char *codeCache = (char *) gDvmJit.codeCache;
+
+    if ((uintptr_t) info->si_addr < IMPLICIT_CHECK_MAX_OFFSET &&
+        pc >= (u4) codeCache && pc < (u4) codeCache + gDvmJit.codeCacheSize) {
+        u4 resumeAddr = lookupCheck(pc);
+        if (resumeAddr != 0) {
+            uc->uc_mcontext.arm_pc = resumeAddr;
+            return;
+        }
+    }
+#endif
+
+    /* Not ours - hand it on */
+    if (prevAction.sa_flags & SA_SIGINFO) {
+        prevAction.sa_sigaction(signum, info, context);
+    } else if (prevAction.sa_handler != SIG_DFL &&
+               prevAction.sa_handler != SIG_IGN) {
+        prevAction.sa_handler(signum);
+    } else {
+        /* Put the old disposition back; the access faults again on return */
+        sigaction(signum, &prevAction, NULL);
+    }
+}
+
+/*
+ * Install the fault handler.  Called on the compiler thread before the
+ * first compilation; clears gDvmJit.implicitChecks if the handler cannot
+ * be used, so the code generator never relies on it.
+ */
+void dvmCompilerImplicitCheckStartup(void)
+{
+    if (!gDvmJit.implicitChecks || checkTable != NULL) {
+        return;
+    }
+
+#if defined(__arm__) && !defined(WITH_SELF_VERIFICATION)
+    checkTable = (ImplicitCheckEntry *)
+        calloc(IMPLICIT_CHECK_TABLE_SIZE, sizeof(ImplicitCheckEntry));
+    if (checkTable == NULL) {
+        ALOGW("JIT: no memory for the implicit check table");
+        gDvmJit.implicitChecks = false;
+        return;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = implicitCheckHandler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGSEGV, &sa, &prevAction) != 0) {
+        ALOGW("JIT: unable to install the implicit check handler: %s",
+              strerror(errno));
+        free(checkTable);
+        checkTable = NULL;
+        gDvmJit.implicitChecks = false;
+    }
+#else
+    ALOGW("JIT: implicit checks are not supported on this target");
+    gDvmJit.implicitChecks = false;
+#endif
+}
+
+/*
+ * Returns true if "count" more checks fit in the table.  Once one
+ * translation is turned away, new code goes back to explicit checks.
+ * Caller holds compilerLock.
+ */
+bool dvmCompilerImplicitCheckReserve(int count)
+{
+    if (count == 0) {
+        return true;
+    }
+    if (checkTable == NULL || numChecks + count > IMPLICIT_CHECK_TABLE_LIMIT) {
+        if (!tableFull) {
+            ALOGD("JIT: implicit check table full (%d entries)", numChecks);
+        }
+        tableFull = true;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Returns true if the code generator may leave null checks to the fault
+ * handler.  Only meaningful on the compiler thread.
+ */
+bool dvmCompilerImplicitChecksEnabled(void)
+{
+    return gDvmJit.implicitChecks && checkTable != NULL && !tableFull;
+}
+
+/*
+ * Resume at "resumeAddr" when the access at "faultAddr" faults.  Space
+ * must have been reserved.  Caller holds compilerLock.
+ */
+void dvmCompilerImplicitCheckAdd(const void *faultAddr, const void *resumeAddr)
+{
+    assert(numChecks < IMPLICIT_CHECK_TABLE_LIMIT);
+    u4 idx = checkHash((u4) faultAddr);
+    while (checkTable[idx].faultAddr != 0) {
+        idx = (idx + 1) & (IMPLICIT_CHECK_TABLE_SIZE - 1);
+    }
+    checkTable[idx].resumeAddr = (int32_t) resumeAddr;
+    android_atomic_release_store((int32_t) faultAddr,
+                                 &checkTable[idx].faultAddr);
+    numChecks++;
+}
+
+/*
+ * Forget every check.  Called from a code cache reset, when no thread
+ * is running translated code.
+ */
+void dvmCompilerImplicitCheckReset(void)
+{
+    if (checkTable == NULL) {
+        return;
+    }
+    memset(checkTable, 0,
+           IMPLICIT_CHECK_TABLE_SIZE * sizeof(ImplicitCheckEntry));
+    numChecks = 0;
+    tableFull = false;
+}
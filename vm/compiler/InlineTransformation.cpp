@@ -276,6 +276,9 @@ static bool tryInlineVirtualCallsite(CompilationUnit *cUnit,
                                      BasicBlock *invokeBB,
                                      bool isRange)
 {
+    Opcode opcode = invokeMIR->dalvikInsn.opcode;
+    bool inlined = false;
+
     /* Not a Java method */
     if (dvmIsNativeMethod(calleeMethod)) return false;
 
@@ -284,18 +287,31 @@ static bool tryInlineVirtualCallsite(CompilationUnit *cUnit,
 
     /* Empty callee - do nothing by checking the clazz pointer */
     if (methodStats->attributes & METHOD_IS_EMPTY) {
-        return inlineEmptyVirtualCallee(cUnit, calleeMethod, invokeMIR,
-                                        invokeBB);
+        inlined = inlineEmptyVirtualCallee(cUnit, calleeMethod, invokeMIR,
+                                           invokeBB);
+    } else if (methodStats->attributes & METHOD_IS_GETTER) {
+        inlined = inlineGetter(cUnit, calleeMethod, invokeMIR, invokeBB, true,
+                               isRange);
+    } else if (methodStats->attributes & METHOD_IS_SETTER) {
+        inlined = inlineSetter(cUnit, calleeMethod, invokeMIR, invokeBB, true,
+                               isRange);
     }
 
-    if (methodStats->attributes & METHOD_IS_GETTER) {
-        return inlineGetter(cUnit, calleeMethod, invokeMIR, invokeBB, true,
-                            isRange);
-    } else if (methodStats->attributes & METHOD_IS_SETTER) {
-        return inlineSetter(cUnit, calleeMethod, invokeMIR, invokeBB, true,
-                            isRange);
+    /*
+     * If no loaded class overrides the callee, any receiver will do and the
+     * prediction check only needs to watch for one being loaded.  Interface
+     * receivers don't have to share the callee's class, so they always
+     * compare the class.
+     */
+    if (inlined && opcode != OP_INVOKE_INTERFACE &&
+        opcode != OP_INVOKE_INTERFACE_RANGE &&
+        dvmCompilerIsDevirtualizable(calleeMethod)) {
+        invokeMIR->meta.callsiteInfo->devirtualized = true;
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.invokeDevirtualized++;
+#endif
     }
-    return false;
+    return inlined;
 }
 
 
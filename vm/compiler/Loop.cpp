@@ -291,6 +291,36 @@ static bool isSimpleCountedLoop(CompilationUnit *cUnit)
     return true;
 }
 
+/*
+ * Strip-mine the suspend poll of a simple counted loop.  If the basic IV
+ * steps by +/-2^k, bits k and up of it count iterations, so polling only
+ * when the next log2(LOOP_SUSPEND_POLL_INTERVAL) of them are all zero
+ * still polls exactly once every LOOP_SUSPEND_POLL_INTERVAL iterations,
+ * wherever the IV starts.  Other steps keep polling on every iteration.
+ */
+static void setSuspendPollInterval(CompilationUnit *cUnit)
+{
+    LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    unsigned int i;
+
+    for (i = 0; i < loopAnalysis->ivList->numUsed; i++) {
+        InductionVariableInfo *ivInfo;
+
+        ivInfo = GET_ELEM_N(loopAnalysis->ivList, InductionVariableInfo*, i);
+        if (ivInfo->ssaReg != ivInfo->basicSSAReg) continue;
+
+        unsigned int step = (ivInfo->inc < 0) ? -ivInfo->inc : ivInfo->inc;
+        int shift = ffs(step) - 1;
+        if (step == 0 || (step & (step - 1)) != 0 || shift > 24) return;
+
+        int dalvikReg = dvmConvertSSARegToDalvik(cUnit, ivInfo->basicSSAReg);
+        loopAnalysis->suspendPollReg = DECODE_REG(dalvikReg);
+        loopAnalysis->suspendPollMask =
+            (LOOP_SUSPEND_POLL_INTERVAL - 1) << shift;
+        return;
+    }
+}
+
 /*
  * Record the upper and lower bound information for range checks for each
  * induction variable. If array A is accessed by index "i+5", the upper and
@@ -339,86 +369,111 @@ static void updateRangeCheckInfo(CompilationUnit *cUnit, int arrayReg,
     }
 }
 
-/* Returns true if the loop body cannot throw any exceptions */
+/*
+ * The blocks of a loop body form a chain where each block is the immediate
+ * dominator of the next one (see dvmCompilerFilterLoopBlocks). Return the
+ * block after bb in the chain, or NULL if bb ends with the loop back branch.
+ */
+BasicBlock *dvmCompilerNextLoopBlock(const BasicBlock *bb)
+{
+    BasicBlock *next = bb->fallThrough;
+    if (next && next->blockType == kDalvikByteCode && next->iDom == bb) {
+        return next;
+    }
+    next = bb->taken;
+    if (next && next->blockType == kDalvikByteCode && next->iDom == bb) {
+        return next;
+    }
+    return NULL;
+}
+
+/*
+ * Returns true if the loop body cannot throw any exceptions. Every block of
+ * the body runs on each iteration that reaches the back branch, so checks are
+ * hoisted from all of them, not just the first one.
+ */
 static bool doLoopBodyCodeMotion(CompilationUnit *cUnit)
 {
-    BasicBlock *loopBody = cUnit->entryBlock->fallThrough;
+    BasicBlock *loopBody;
     MIR *mir;
     bool loopBodyCanThrow = false;
 
-    for (mir = loopBody->firstMIRInsn; mir; mir = mir->next) {
-        DecodedInstruction *dInsn = &mir->dalvikInsn;
-        int dfAttributes =
-            dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
-
-        /* Skip extended MIR instructions */
-        if (dInsn->opcode >= kNumPackedOpcodes) continue;
-
-        int instrFlags = dexGetFlagsFromOpcode(dInsn->opcode);
+    for (loopBody = cUnit->entryBlock->fallThrough; loopBody;
+         loopBody = dvmCompilerNextLoopBlock(loopBody)) {
+        for (mir = loopBody->firstMIRInsn; mir; mir = mir->next) {
+            DecodedInstruction *dInsn = &mir->dalvikInsn;
+            int dfAttributes =
+                dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
 
-        /* Instruction is clean */
-        if ((instrFlags & kInstrCanThrow) == 0) continue;
+            /* Skip extended MIR instructions */
+            if (dInsn->opcode >= kNumPackedOpcodes) continue;
 
-        /*
-         * Currently we can only optimize away null and range checks. Punt on
-         * instructions that can throw due to other exceptions.
-         */
-        if (!(dfAttributes & DF_HAS_NR_CHECKS)) {
-            loopBodyCanThrow = true;
-            continue;
-        }
-
-        /*
-         * This comparison is redundant now, but we will have more than one
-         * group of flags to check soon.
-         */
-        if (dfAttributes & DF_HAS_NR_CHECKS) {
-            /*
-             * Check if the null check is applied on a loop invariant register?
-             * If the register's SSA id is less than the number of Dalvik
-             * registers, then it is loop invariant.
-             */
-            int refIdx;
-            switch (dfAttributes & DF_HAS_NR_CHECKS) {
-                case DF_NULL_N_RANGE_CHECK_0:
-                    refIdx = 0;
-                    break;
-                case DF_NULL_N_RANGE_CHECK_1:
-                    refIdx = 1;
-                    break;
-                case DF_NULL_N_RANGE_CHECK_2:
-                    refIdx = 2;
-                    break;
-                default:
-                    refIdx = 0;
-                    ALOGE("Jit: bad case in doLoopBodyCodeMotion");
-                    dvmCompilerAbort(cUnit);
-            }
+            int instrFlags = dexGetFlagsFromOpcode(dInsn->opcode);
 
-            int useIdx = refIdx + 1;
-            int subNRegArray =
-                dvmConvertSSARegToDalvik(cUnit, mir->ssaRep->uses[refIdx]);
-            int arraySub = DECODE_SUB(subNRegArray);
+            /* Instruction is clean */
+            if ((instrFlags & kInstrCanThrow) == 0) continue;
 
             /*
-             * If the register is never updated in the loop (ie subscript == 0),
-             * it is an optimization candidate.
+             * Currently we can only optimize away null and range checks. Punt
+             * on instructions that can throw due to other exceptions.
              */
-            if (arraySub != 0) {
+            if (!(dfAttributes & DF_HAS_NR_CHECKS)) {
                 loopBodyCanThrow = true;
                 continue;
             }
 
             /*
-             * Then check if the range check can be hoisted out of the loop if
-             * it is basic or dependent induction variable.
+             * This comparison is redundant now, but we will have more than one
+             * group of flags to check soon.
              */
-            if (dvmIsBitSet(cUnit->loopAnalysis->isIndVarV,
-                            mir->ssaRep->uses[useIdx])) {
-                mir->OptimizationFlags |=
-                    MIR_IGNORE_RANGE_CHECK | MIR_IGNORE_NULL_CHECK;
-                updateRangeCheckInfo(cUnit, mir->ssaRep->uses[refIdx],
-                                     mir->ssaRep->uses[useIdx]);
+            if (dfAttributes & DF_HAS_NR_CHECKS) {
+                /*
+                 * Check if the null check is applied on a loop invariant
+                 * register? If the register's SSA id is less than the number
+                 * of Dalvik registers, then it is loop invariant.
+                 */
+                int refIdx;
+                switch (dfAttributes & DF_HAS_NR_CHECKS) {
+                    case DF_NULL_N_RANGE_CHECK_0:
+                        refIdx = 0;
+                        break;
+                    case DF_NULL_N_RANGE_CHECK_1:
+                        refIdx = 1;
+                        break;
+                    case DF_NULL_N_RANGE_CHECK_2:
+                        refIdx = 2;
+                        break;
+                    default:
+                        refIdx = 0;
+                        ALOGE("Jit: bad case in doLoopBodyCodeMotion");
+                        dvmCompilerAbort(cUnit);
+                }
+
+                int useIdx = refIdx + 1;
+                int subNRegArray =
+                    dvmConvertSSARegToDalvik(cUnit, mir->ssaRep->uses[refIdx]);
+                int arraySub = DECODE_SUB(subNRegArray);
+
+                /*
+                 * If the register is never updated in the loop (ie subscript
+                 * == 0), it is an optimization candidate.
+                 */
+                if (arraySub != 0) {
+                    loopBodyCanThrow = true;
+                    continue;
+                }
+
+                /*
+                 * Then check if the range check can be hoisted out of the loop
+                 * if it is basic or dependent induction variable.
+                 */
+                if (dvmIsBitSet(cUnit->loopAnalysis->isIndVarV,
+                                mir->ssaRep->uses[useIdx])) {
+                    mir->OptimizationFlags |=
+                        MIR_IGNORE_RANGE_CHECK | MIR_IGNORE_NULL_CHECK;
+                    updateRangeCheckInfo(cUnit, mir->ssaRep->uses[refIdx],
+                                         mir->ssaRep->uses[useIdx]);
+                }
             }
         }
     }
@@ -670,6 +725,18 @@ bool dvmCompilerFilterLoopBlocks(CompilationUnit *cUnit)
 /*
  * Main entry point to do loop optimization.
  * Return false if sanity checks for loop formation/optimization failed.
+ *
+ * NOTE: counted loops whose body is an element-wise aget/op/aput are not
+ * vectorized.  The hoisted range checks already prove every access in
+ * bounds, but lowering such a loop needs, in each back end:
+ *  - vector register classes in the allocator (ArmRallocUtil.cpp knows
+ *    only core, single and double FP registers);
+ *  - encodings for the NEON/SSE2 loads, stores and lane arithmetic, none
+ *    of which exist in the ARM EncodingMap or the x86 encoder;
+ *  - a scalar epilogue for the remainder iterations, and a way to leave
+ *    the loop through the PC reconstruction cells in the middle of a
+ *    vector step.
+ * Until then these loops run as scalar code with their checks hoisted.
  */
 bool dvmCompilerLoopOpt(CompilationUnit *cUnit)
 {
@@ -703,6 +770,8 @@ bool dvmCompilerLoopOpt(CompilationUnit *cUnit)
     if (!isSimpleCountedLoop(cUnit))
         return false;
 
+    setSuspendPollInterval(cUnit);
+
     loopAnalysis->arrayAccessInfo =
         (GrowableList *)dvmCompilerNew(sizeof(GrowableList), true);
     dvmInitGrowableList(loopAnalysis->arrayAccessInfo, 4);
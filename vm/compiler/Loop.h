@@ -32,9 +32,18 @@ typedef struct LoopAnalysis {
     LIR *branchToBody;                  // branch over to the body from entry
     LIR *branchToPCR;                   // branch over to the PCR cell
     bool bodyIsClean;                   // loop body cannot throw any exceptions
+    int suspendPollReg;                 // Dalvik register holding the BIV
+    int suspendPollMask;                // poll when BIV & mask == 0; 0 = always
 } LoopAnalysis;
 
+/*
+ * Counted loops whose basic IV steps by a power of 2 poll for suspension
+ * once every this many iterations (must be a power of 2).
+ */
+#define LOOP_SUSPEND_POLL_INTERVAL      16
+
 bool dvmCompilerFilterLoopBlocks(CompilationUnit *cUnit);
+BasicBlock *dvmCompilerNextLoopBlock(const BasicBlock *bb);
 
 /*
  * An unexecuted code path may contain unresolved fields or classes. Before we
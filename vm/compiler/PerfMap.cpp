@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * JIT symbol map.
+ *
+ * With -Xjitperfmap the compiler thread writes every translation it
+ * installs to /tmp/perf-<pid>.map, which is where perf and simpleperf
+ * look for the symbols of JIT-generated code.  One line describes one
+ * translation:
+ *
+ *   <start> <size> dalvik-jit:<class>.<method>@<offset>
+ *
+ * with the start address and size in hex and the dex offset of the trace
+ * head.  The range covers the whole translation, chaining cells and
+ * literal pool included, so samples anywhere in it are attributed to the
+ * method.  The templates at the front of the code cache get an entry of
+ * their own.
+ *
+ * A code cache reset discards every translation, so it truncates the file
+ * and starts over.  All of this runs under compilerLock.
+ */
+
+#include "Dalvik.h"
+#include "CompilerInternals.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+static FILE *perfMapFile;
+
+static void writeTemplateEntry(void)
+{
+    fprintf(perfMapFile, "%x %x dalvik-jit:templates\n",
+            (int) gDvmJit.codeCache, gDvmJit.templateSize);
+    fflush(perfMapFile);
+}
+
+/*
+ * Open the map file.  Called on the compiler thread once the code cache
+ * exists.  Zygote children start their own compiler thread, so the file
+ * is named after the process that runs the code.
+ */
+void dvmCompilerPerfMapStartup(void)
+{
+    if (!gDvmJit.perfMap || perfMapFile != NULL) {
+        return;
+    }
+
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "/tmp/perf-%d.map", getpid());
+    perfMapFile = fopen(fileName, "w");
+    if (perfMapFile == NULL) {
+        ALOGW("JIT: unable to create %s: %s", fileName, strerror(errno));
+        return;
+    }
+    writeTemplateEntry();
+}
+
+/*
+ * Describe the translation of the trace "desc" that occupies the "size"
+ * bytes at "start".  Caller holds compilerLock.
+ */
+void dvmCompilerPerfMapAdd(const JitTraceDescription *desc,
+                           const void *start, size_t size)
+{
+    if (perfMapFile == NULL || size == 0) {
+        return;
+    }
+
+    const Method *method = desc->method;
+    fprintf(perfMapFile, "%x %x dalvik-jit:%s.%s@%#x\n",
+            (int) start, size, method->clazz->descriptor, method->name,
+            desc->trace[0].info.frag.startOffset);
+    fflush(perfMapFile);
+}
+
+/*
+ * Forget every translation.  Caller holds compilerLock.
+ */
+void dvmCompilerPerfMapReset(void)
+{
+    if (perfMapFile == NULL) {
+        return;
+    }
+
+    fflush(perfMapFile);
+    if (ftruncate(fileno(perfMapFile), 0) != 0) {
+        ALOGW("JIT: unable to truncate perf map: %s", strerror(errno));
+    }
+    rewind(perfMapFile);
+    writeTemplateEntry();
+}
+
+void dvmCompilerPerfMapShutdown(void)
+{
+    if (perfMapFile != NULL) {
+        fclose(perfMapFile);
+        perfMapFile = NULL;
+    }
+}
@@ -0,0 +1,718 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sampled JIT trace profiling.
+ *
+ * -Xjitprofile has every translation bump a counter on entry, which costs
+ * too much to leave on.  Here a thread wakes up at a fixed interval and
+ * sends SIGPROF to each thread that is running Java code, one at a time.
+ * The handler only writes the native PC it interrupted to a pipe; the
+ * sampling thread looks the PC up among the installed translations and
+ * charges the sample to the head of the trace, the method and dex offset
+ * the trace starts at.  Samples that miss the traces are counted by where
+ * they landed: the templates, the rest of the code cache (method
+ * translations), or outside it (the interpreter and the VM).
+ *
+ * The compiler thread adds each trace it installs to a table of address
+ * ranges.  The cache fills from the front, so the table is in address
+ * order and a lookup is a binary search.  It costs a few words per
+ * translation and is kept whether or not sampling is on, so traces
+ * installed before sampling starts are known too.  A code cache reset
+ * empties the table and bumps a generation number; samples taken in an
+ * older generation are dropped rather than charged to whatever was
+ * installed since.  The samples themselves are keyed on the trace head,
+ * so they outlive resets.
+ *
+ * Sampling is enabled with -Xjittracesample or through DDM, and the
+ * busiest traces are printed with the thread dump on SIGQUIT, with the
+ * JIT stats, and when sampling stops.  Only ARM builds can read the PC
+ * from the signal context.
+ */
+
+#include "Dalvik.h"
+#include "CompilerInternals.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#if defined(__arm__)
+#include <asm/ucontext.h>
+#endif
+
+/* number of entries in the sample table; must be a power of 2 */
+#define kNumTraceSampleEntries      4096
+#define kTraceSampleEntryLimit      (kNumTraceSampleEntries / 4 * 3)
+
+/* number of entries printed by dvmDumpJitTraceSamples() */
+#define kNumTraceSampleDumpEntries  20
+
+/* number of threads sampled per tick */
+#define kMaxTraceSampledThreads     64
+
+/* default interval between ticks */
+#define kDefaultTraceSampleIntervalUsec 10000
+
+/* how long to wait for a thread to take the signal */
+#define kTraceSampleTimeoutMsec     5
+
+/* A translated trace, as installed by the compiler thread */
+struct TraceRange {
+    const char      *start;
+    u4              size;
+    const Method    *method;
+    u4              startOffset;        /* of the trace head */
+};
+
+struct TraceSampleEntry {
+    const Method    *method;            /* NULL if the entry is unused */
+    u4              startOffset;
+    u4              count;
+};
+
+/* What the signal handler writes; small enough to be written atomically */
+struct TraceSampleReply {
+    int32_t         token;
+    u4              pc;
+};
+
+/*
+ * Guards everything below.  The compiler thread takes it with compilerLock
+ * held, so the sampling thread must never wait for compilerLock.
+ */
+static pthread_mutex_t sampleLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sampleCond = PTHREAD_COND_INITIALIZER;
+
+static TraceRange *ranges;
+static u4 numRanges;
+static u4 maxRanges;
+static u4 rangeGeneration;
+
+/* non-NULL while sampling is enabled */
+static TraceSampleEntry *samples;
+static u4 numSampleEntries;
+static u4 numSamples;
+static u4 numTemplateSamples;
+static u4 numOtherJitSamples;
+static u4 numInterpSamples;
+static u4 numDroppedSamples;
+
+static pthread_t samplingThreadHandle;
+static bool samplingThreadStarted;
+static bool haltSampling;
+
+/* Handshake with the signal handler */
+static int replyPipe[2] = { -1, -1 };
+static volatile int32_t requestToken;       /* 0 when no sample is wanted */
+static pthread_t requestThread;
+static struct sigaction prevAction;
+
+static void traceSampleHandler(int signum, siginfo_t *info, void *context)
+{
+    int32_t token = android_atomic_acquire_load(&requestToken);
+
+    if (token != 0 && pthread_equal(pthread_self(), requestThread)) {
+        int savedErrno = errno;
+        TraceSampleReply reply;
+        reply.token = token;
+#if defined(__arm__)
+        reply.pc = ((struct ucontext *) context)->uc_mcontext.arm_pc;
+#else
+        reply.pc = 0;
+#endif
+        (void) write(replyPipe[1], &reply, sizeof(reply));
+        errno = savedErrno;
+        return;
+    }
+
+    /* Not ours - hand it on, or drop it if nobody else wanted it either */
+    if (prevAction.sa_flags & SA_SIGINFO) {
+        prevAction.sa_sigaction(signum, info, context);
+    } else if (prevAction.sa_handler != SIG_DFL &&
+               prevAction.sa_handler != SIG_IGN) {
+        prevAction.sa_handler(signum);
+    }
+}
+
+/*
+ * Interrupt "handle" and wait for the PC it was at.  Returns "false" if
+ * the thread doesn't answer in time.  Called on the sampling thread only.
+ */
+static bool sampleThread(pthread_t handle, u4 *pPc)
+{
+    static int32_t lastToken;
+    int32_t token = ++lastToken;
+
+    if (token == 0) {
+        token = ++lastToken;
+    }
+    requestThread = handle;
+    android_atomic_release_store(token, &requestToken);
+    if (pthread_kill(handle, SIGPROF) != 0) {
+        android_atomic_release_store(0, &requestToken);
+        return false;
+    }
+
+    /* Replies that come in too late for an older request are skipped */
+    u8 deadline = dvmGetRelativeTimeUsec() + kTraceSampleTimeoutMsec * 1000;
+    bool answered = false;
+    while (!answered) {
+        s8 waitUsec = (s8) (deadline - dvmGetRelativeTimeUsec());
+        if (waitUsec <= 0) {
+            break;
+        }
+        struct pollfd pfd;
+        pfd.fd = replyPipe[0];
+        pfd.events = POLLIN;
+        int ready = poll(&pfd, 1, (int) ((waitUsec + 999) / 1000));
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        } else if (ready <= 0) {
+            break;
+        }
+        TraceSampleReply reply;
+        if (read(replyPipe[0], &reply, sizeof(reply)) == sizeof(reply) &&
+            reply.token == token) {
+            *pPc = reply.pc;
+            answered = true;
+        }
+    }
+    android_atomic_release_store(0, &requestToken);
+    return answered;
+}
+
+/*
+ * Sample every thread that is running Java code.  Returns the number of
+ * PCs stored in "pcs", and the number of threads that were skipped in
+ * "*pMissed".
+ */
+static int takeSamples(Thread *self, u4 *pcs, u4 *pMissed)
+{
+    int count = 0;
+
+    /* Holding the list keeps every handle valid while it is signalled */
+    dvmLockThreadList(self);
+    for (Thread *thread = gDvm.threadList; thread != NULL;
+         thread = thread->next) {
+        if (thread == self || thread->status != THREAD_RUNNING) {
+            continue;
+        }
+        if (count == kMaxTraceSampledThreads ||
+            !sampleThread(thread->handle, &pcs[count])) {
+            (*pMissed)++;
+            continue;
+        }
+        count++;
+    }
+    dvmUnlockThreadList();
+    return count;
+}
+
+/* Returns the trace holding "pc", or NULL.  Caller holds sampleLock. */
+static const TraceRange *findRange(const char *pc)
+{
+    int low = 0;
+    int high = (int) numRanges - 1;
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        const TraceRange *range = &ranges[mid];
+        if (pc < range->start) {
+            high = mid - 1;
+        } else if (pc >= range->start + range->size) {
+            low = mid + 1;
+        } else {
+            return range;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Charge a sample to the entry for its trace head, adding the entry if
+ * needed.  Samples that don't fit in a full table are counted as dropped.
+ * Caller holds sampleLock.
+ */
+static void chargeSample(const Method *method, u4 startOffset)
+{
+    u4 hash = ((u4) method >> 2) * 31 + startOffset;
+
+    for (;;) {
+        TraceSampleEntry *pSlot =
+            &samples[hash++ & (kNumTraceSampleEntries - 1)];
+        if (pSlot->method == NULL) {
+            if (numSampleEntries == kTraceSampleEntryLimit) {
+                numDroppedSamples++;
+                return;
+            }
+            pSlot->method = method;
+            pSlot->startOffset = startOffset;
+            pSlot->count = 1;
+            numSampleEntries++;
+            return;
+        }
+        if (pSlot->method == method && pSlot->startOffset == startOffset) {
+            pSlot->count++;
+            return;
+        }
+    }
+}
+
+/* Caller holds sampleLock. */
+static void recordSamples(const u4 *pcs, int count)
+{
+    const char *codeCache = (const char *) gDvmJit.codeCache;
+
+    for (int i = 0; i < count; i++) {
+        const char *pc = (const char *) pcs[i];
+
+        numSamples++;
+        if (codeCache == NULL || pc < codeCache ||
+            pc >= codeCache + gDvmJit.codeCacheSize) {
+            numInterpSamples++;
+        } else if (pc < codeCache + gDvmJit.templateSize) {
+            numTemplateSamples++;
+        } else {
+            const TraceRange *range = findRange(pc);
+            if (range != NULL) {
+                chargeSample(range->method, range->startOffset);
+            } else {
+                numOtherJitSamples++;
+            }
+        }
+    }
+}
+
+/*
+ * Body of the sampling thread.
+ *
+ * The thread stays in VMWAIT, so it never holds up a suspend-all, and it
+ * doesn't hold sampleLock while it waits for a sample, so the compiler
+ * thread is never kept waiting on it for long.
+ */
+static void *samplingThreadStart(void *arg)
+{
+    Thread *self = dvmThreadSelf();
+    u4 pcs[kMaxTraceSampledThreads];
+
+    UNUSED_PARAMETER(arg);
+
+    dvmChangeStatus(self, THREAD_VMWAIT);
+    for (;;) {
+        dvmLockMutex(&sampleLock);
+        if (!haltSampling) {
+            int usec = gDvmJit.traceSampleIntervalUsec;
+            dvmRelativeCondWait(&sampleCond, &sampleLock,
+                                usec / 1000, (usec % 1000) * 1000);
+        }
+        bool halt = haltSampling;
+        u4 generation = rangeGeneration;
+        dvmUnlockMutex(&sampleLock);
+        if (halt) {
+            break;
+        }
+
+        u4 missed = 0;
+        int count = takeSamples(self, pcs, &missed);
+
+        dvmLockMutex(&sampleLock);
+        numDroppedSamples += missed;
+        if (generation == rangeGeneration) {
+            recordSamples(pcs, count);
+        } else {
+            /* The code cache was reset under us */
+            numDroppedSamples += count;
+        }
+        dvmUnlockMutex(&sampleLock);
+    }
+    return NULL;
+}
+
+static bool installHandler(void)
+{
+    if (replyPipe[0] < 0) {
+        if (pipe(replyPipe) != 0) {
+            ALOGW("JIT: unable to create the trace sample pipe: %s",
+                  strerror(errno));
+            return false;
+        }
+        /* The handler must never block */
+        fcntl(replyPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(replyPipe[1], F_SETFL, O_NONBLOCK);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = traceSampleHandler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, &prevAction) != 0) {
+        ALOGW("JIT: unable to install the trace sample handler: %s",
+              strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Start sampling, discarding anything collected before.
+ *
+ * Returns "true" on success.
+ */
+bool dvmEnableJitTraceSampling(int intervalUsec)
+{
+#if !defined(__arm__)
+    ALOGW("JIT trace sampling is not supported on this architecture");
+    return false;
+#endif
+    assert(!gDvm.zygote);
+
+    dvmDisableJitTraceSampling();
+
+    TraceSampleEntry *table = (TraceSampleEntry *)
+        calloc(kNumTraceSampleEntries, sizeof(TraceSampleEntry));
+    if (table == NULL) {
+        return false;
+    }
+    if (!installHandler()) {
+        free(table);
+        return false;
+    }
+
+    dvmLockMutex(&sampleLock);
+    samples = table;
+    numSampleEntries = 0;
+    numSamples = 0;
+    numTemplateSamples = 0;
+    numOtherJitSamples = 0;
+    numInterpSamples = 0;
+    numDroppedSamples = 0;
+    if (intervalUsec > 0) {
+        gDvmJit.traceSampleIntervalUsec = intervalUsec;
+    } else if (gDvmJit.traceSampleIntervalUsec <= 0) {
+        gDvmJit.traceSampleIntervalUsec = kDefaultTraceSampleIntervalUsec;
+    }
+    haltSampling = false;
+    dvmUnlockMutex(&sampleLock);
+
+    if (!dvmCreateInternalThread(&samplingThreadHandle, "JIT Trace Sampler",
+                                 samplingThreadStart, NULL)) {
+        ALOGW("Unable to create JIT trace sampling thread");
+        sigaction(SIGPROF, &prevAction, NULL);
+        dvmLockMutex(&sampleLock);
+        free(samples);
+        samples = NULL;
+        dvmUnlockMutex(&sampleLock);
+        return false;
+    }
+    samplingThreadStarted = true;
+    ALOGI("JIT trace sampling started (%dus interval)",
+          gDvmJit.traceSampleIntervalUsec);
+    return true;
+}
+
+/*
+ * Stop sampling.  Does nothing if it is not enabled.
+ */
+void dvmDisableJitTraceSampling(void)
+{
+    if (!samplingThreadStarted) {
+        return;
+    }
+
+    dvmLockMutex(&sampleLock);
+    haltSampling = true;
+    dvmSignalCond(&sampleCond);
+    dvmUnlockMutex(&sampleLock);
+
+    Thread *self = dvmThreadSelf();
+    ThreadStatus oldStatus = THREAD_UNDEFINED;
+    if (self != NULL) {
+        oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    }
+    pthread_join(samplingThreadHandle, NULL);
+    if (self != NULL) {
+        dvmChangeStatus(self, oldStatus);
+    }
+    samplingThreadStarted = false;
+    sigaction(SIGPROF, &prevAction, NULL);
+
+    DebugOutputTarget target;
+    dvmCreateLogOutputTarget(&target, ANDROID_LOG_INFO, LOG_TAG);
+    dvmDumpJitTraceSamples(&target);
+
+    dvmLockMutex(&sampleLock);
+    free(samples);
+    samples = NULL;
+    dvmUnlockMutex(&sampleLock);
+}
+
+/*
+ * Describe the translation of the trace "desc" that occupies the "size"
+ * bytes at "start".  Caller holds compilerLock.
+ */
+void dvmCompilerTraceSampleAdd(const JitTraceDescription *desc,
+                               const void *start, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    dvmLockMutex(&sampleLock);
+    if (numRanges == maxRanges) {
+        u4 newMax = (maxRanges == 0) ? 256 : maxRanges * 2;
+        TraceRange *newRanges = (TraceRange *)
+            realloc(ranges, newMax * sizeof(TraceRange));
+        if (newRanges == NULL) {
+            /* Samples in this trace will count as other JIT code */
+            dvmUnlockMutex(&sampleLock);
+            return;
+        }
+        ranges = newRanges;
+        maxRanges = newMax;
+    }
+    TraceRange *range = &ranges[numRanges];
+    range->start = (const char *) start;
+    range->size = size;
+    range->method = desc->method;
+    range->startOffset = desc->trace[0].info.frag.startOffset;
+    assert(numRanges == 0 ||
+           range->start >= ranges[numRanges - 1].start +
+                           ranges[numRanges - 1].size);
+    numRanges++;
+    dvmUnlockMutex(&sampleLock);
+}
+
+/*
+ * Forget every translation.  Caller holds compilerLock.
+ */
+void dvmCompilerTraceSampleReset(void)
+{
+    dvmLockMutex(&sampleLock);
+    numRanges = 0;
+    rangeGeneration++;
+    dvmUnlockMutex(&sampleLock);
+}
+
+/*
+ * Sort entries by sample count, highest first.
+ */
+static int compareEntries(const void *vp1, const void *vp2)
+{
+    const TraceSampleEntry *p1 = *(const TraceSampleEntry **) vp1;
+    const TraceSampleEntry *p2 = *(const TraceSampleEntry **) vp2;
+
+    if (p1->count != p2->count) {
+        return (p1->count < p2->count) ? 1 : -1;
+    }
+    return 0;
+}
+
+/*
+ * Fill "sorted" with the used entries, most sampled first, and return
+ * their number.  Caller holds sampleLock.
+ */
+static int sortEntries(TraceSampleEntry **sorted)
+{
+    int count = 0;
+
+    for (int i = 0; i < kNumTraceSampleEntries; i++) {
+        if (samples[i].method != NULL) {
+            sorted[count++] = &samples[i];
+        }
+    }
+    qsort(sorted, count, sizeof(*sorted), compareEntries);
+    return count;
+}
+
+/*
+ * Print the most sampled traces.  Prints nothing if sampling is disabled.
+ */
+void dvmDumpJitTraceSamples(const DebugOutputTarget *target)
+{
+    dvmLockMutex(&sampleLock);
+    if (samples == NULL) {
+        dvmUnlockMutex(&sampleLock);
+        return;
+    }
+
+    TraceSampleEntry **sorted = (TraceSampleEntry **)
+        malloc(sizeof(TraceSampleEntry *) * kNumTraceSampleEntries);
+    if (sorted == NULL) {
+        dvmUnlockMutex(&sampleLock);
+        return;
+    }
+    int count = sortEntries(sorted);
+
+    u4 total = numSamples != 0 ? numSamples : 1;
+    dvmPrintDebugMessage(target,
+        "JIT TRACE SAMPLES: (%d traces, %u samples: %u%% templates, "
+        "%u%% other JIT code, %u%% outside the code cache; %u dropped)\n",
+        count, numSamples,
+        (u4) ((u8) numTemplateSamples * 100 / total),
+        (u4) ((u8) numOtherJitSamples * 100 / total),
+        (u4) ((u8) numInterpSamples * 100 / total),
+        numDroppedSamples);
+    if (count > kNumTraceSampleDumpEntries) {
+        count = kNumTraceSampleDumpEntries;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const TraceSampleEntry *pEntry = sorted[i];
+        const Method *method = pEntry->method;
+        char *methodDesc = dexProtoCopyMethodDescriptor(&method->prototype);
+
+        dvmPrintDebugMessage(target, "  %8u %5.2f%% [%#x, %d] %s%s;%s\n",
+            pEntry->count, (float) pEntry->count / total * 100.0,
+            pEntry->startOffset,
+            dvmLineNumFromPC(method, pEntry->startOffset),
+            method->clazz->descriptor, method->name, methodDesc);
+        free(methodDesc);
+    }
+    dvmPrintDebugMessage(target, "\n");
+
+    free(sorted);
+    dvmUnlockMutex(&sampleLock);
+}
+
+/*
+ * Store a string as a 2-byte big-endian length followed by its
+ * modified UTF-8 bytes.  Returns the number of bytes used.  With a NULL
+ * "buf", just computes the length.
+ */
+static size_t putString(u1 *buf, const char *str)
+{
+    size_t len = strlen(str);
+
+    if (len > 0xffff) {
+        len = 0xffff;
+    }
+    if (buf != NULL) {
+        set2BE(buf, len);
+        memcpy(buf + 2, str, len);
+    }
+    return 2 + len;
+}
+
+/*
+ * Write one entry to "buf", or just compute its size if "buf" is NULL.
+ * See dvmDdmGenerateJitTraceSamples() for the layout.
+ */
+static size_t putEntry(u1 *buf, const TraceSampleEntry *pEntry)
+{
+    const Method *method = pEntry->method;
+    char *methodDesc = dexProtoCopyMethodDescriptor(&method->prototype);
+    size_t len = 12;
+
+    if (buf != NULL) {
+        set4BE(buf + 0, pEntry->count);
+        set4BE(buf + 4, pEntry->startOffset);
+        set4BE(buf + 8, dvmLineNumFromPC(method, pEntry->startOffset));
+    }
+    len += putString(buf != NULL ? buf + len : NULL,
+                     method->clazz->descriptor);
+    len += putString(buf != NULL ? buf + len : NULL, method->name);
+    len += putString(buf != NULL ? buf + len : NULL,
+                     methodDesc != NULL ? methodDesc : "");
+    free(methodDesc);
+    return len;
+}
+
+/*
+ * Generate the contents of a JTSP chunk, the sampled JIT trace profile.
+ *
+ * Response has:
+ *  (1b) header len
+ *  (1b) reserved
+ *  (2b) number of entries
+ *  (4b) samples taken
+ *  (4b) samples in the templates
+ *  (4b) samples elsewhere in the code cache
+ *  (4b) samples outside the code cache
+ *  (4b) samples dropped
+ * Then, per trace head, most sampled first:
+ *  (4b) number of samples
+ *  (4b) dex offset of the trace head, in code units
+ *  (4b) line number, -1 if unknown
+ *  (str) class descriptor
+ *  (str) method name
+ *  (str) method descriptor
+ *
+ * Strings are a 2-byte length followed by modified UTF-8.
+ *
+ * Returns a new byte[] with the data inside, or NULL on failure or if
+ * sampling is disabled.  The caller must call dvmReleaseTrackedAlloc()
+ * on the array.
+ */
+ArrayObject *dvmDdmGenerateJitTraceSamples(void)
+{
+    const int kHeaderLen = 24;
+
+    /*
+     * Build the data in a native buffer, since allocating on the managed
+     * heap can wait for a GC, which in turn can wait for the compiler
+     * thread, which may be blocked on sampleLock.
+     */
+    dvmLockMutex(&sampleLock);
+    if (samples == NULL) {
+        dvmUnlockMutex(&sampleLock);
+        return NULL;
+    }
+
+    TraceSampleEntry **sorted = (TraceSampleEntry **)
+        malloc(sizeof(TraceSampleEntry *) * kNumTraceSampleEntries);
+    if (sorted == NULL) {
+        dvmUnlockMutex(&sampleLock);
+        return NULL;
+    }
+    int count = sortEntries(sorted);
+    size_t bufLen = kHeaderLen;
+    for (int i = 0; i < count; i++) {
+        bufLen += putEntry(NULL, sorted[i]);
+    }
+
+    u1 *data = (u1 *) malloc(bufLen);
+    if (data == NULL) {
+        free(sorted);
+        dvmUnlockMutex(&sampleLock);
+        return NULL;
+    }
+    u1 *buf = data;
+    set1(buf+0, kHeaderLen);
+    set1(buf+1, 0);
+    set2BE(buf+2, count);
+    set4BE(buf+4, numSamples);
+    set4BE(buf+8, numTemplateSamples);
+    set4BE(buf+12, numOtherJitSamples);
+    set4BE(buf+16, numInterpSamples);
+    set4BE(buf+20, numDroppedSamples);
+    buf += kHeaderLen;
+    for (int i = 0; i < count; i++) {
+        buf += putEntry(buf, sorted[i]);
+    }
+    free(sorted);
+    dvmUnlockMutex(&sampleLock);
+
+    ArrayObject *arrayObj = dvmAllocPrimitiveArray('B', bufLen, ALLOC_DEFAULT);
+    if (arrayObj != NULL) {
+        memcpy(arrayObj->contents, data, bufLen);
+    }
+    free(data);
+    return arrayObj;
+}
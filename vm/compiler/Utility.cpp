@@ -18,7 +18,29 @@
 #include "CompilerInternals.h"
 
 static ArenaMemBlock *arenaHead, *currentArena;
-static int numArenaBlocks;
+static ArenaMemBlock *largeInUse, *largeFree;
+static int numArenaBlocks, numLargeBlocks;
+static size_t arenaFootprint;       /* bytes malloc'ed for all blocks */
+static size_t arenaBytesInUse;      /* handed out since the last reset */
+static size_t arenaMaxBytes;        /* most handed out between two resets */
+static int numArenaMallocs;
+
+/* Log a new arena high water mark once it gets past this */
+#define ARENA_REPORT_BYTES (256 * 1024)
+
+typedef struct CompilerPassStats {
+    u8 usec;
+    u8 bytes;
+    u4 count;
+} CompilerPassStats;
+
+static const char *passNames[kCompilerPassCount] = {
+    "frontend", "dataflow", "regalloc", "codegen", "assembly",
+};
+static CompilerPassStats passStats[kCompilerPassCount];
+static int currentPass = -1;
+static u8 passStartUsec;
+static size_t passStartBytes;
 
 /* Allocate the initial memory block for arena-based allocation */
 bool dvmCompilerHeapInit(void)
@@ -35,18 +57,68 @@ bool dvmCompilerHeapInit(void)
     currentArena->bytesAllocated = 0;
     currentArena->next = NULL;
     numArenaBlocks = 1;
+    arenaFootprint = ARENA_DEFAULT_SIZE;
+    numArenaMallocs = 1;
 
     return true;
 }
 
+/*
+ * Hand out a large block that can hold "size" bytes.  The smallest free
+ * one that fits is reused; a new one is only malloc'ed if none does.
+ */
+static void *allocLargeBlock(size_t size)
+{
+    ArenaMemBlock **best = NULL;
+    for (ArenaMemBlock **link = &largeFree; *link; link = &(*link)->next) {
+        if ((*link)->blockSize >= size &&
+            (best == NULL || (*link)->blockSize < (*best)->blockSize)) {
+            best = link;
+        }
+    }
+
+    ArenaMemBlock *block;
+    if (best != NULL) {
+        block = *best;
+        *best = block->next;
+    } else {
+        size_t blockSize = ARENA_LARGE_THRESHOLD;
+        while (blockSize < size) {
+            blockSize <<= 1;
+        }
+        block = (ArenaMemBlock *) malloc(sizeof(ArenaMemBlock) + blockSize);
+        if (block == NULL) {
+            ALOGE("Arena allocation failure");
+            dvmAbort();
+        }
+        block->blockSize = blockSize;
+        numLargeBlocks++;
+        numArenaMallocs++;
+        arenaFootprint += blockSize;
+    }
+    block->bytesAllocated = size;
+    block->next = largeInUse;
+    largeInUse = block;
+    return block->ptr;
+}
+
 /* Arena-based malloc for compilation tasks */
 void * dvmCompilerNew(size_t size, bool zero)
 {
+    void *ptr;
+
     size = (size + 3) & ~3;
+    arenaBytesInUse += size;
+    if (size > ARENA_LARGE_THRESHOLD) {
+        ptr = allocLargeBlock(size);
+        if (zero) {
+            memset(ptr, 0, size);
+        }
+        return ptr;
+    }
 retry:
     /* Normal case - space is available in the current page */
     if (size + currentArena->bytesAllocated <= currentArena->blockSize) {
-        void *ptr;
         ptr = &currentArena->ptr[currentArena->bytesAllocated];
         currentArena->bytesAllocated += size;
         if (zero) {
@@ -63,38 +135,77 @@ retry:
             goto retry;
         }
 
-        size_t blockSize = (size < ARENA_DEFAULT_SIZE) ?
-                          ARENA_DEFAULT_SIZE : size;
         /* Time to allocate a new arena */
         ArenaMemBlock *newArena = (ArenaMemBlock *)
-            malloc(sizeof(ArenaMemBlock) + blockSize);
+            malloc(sizeof(ArenaMemBlock) + ARENA_DEFAULT_SIZE);
         if (newArena == NULL) {
             ALOGE("Arena allocation failure");
             dvmAbort();
         }
-        newArena->blockSize = blockSize;
+        newArena->blockSize = ARENA_DEFAULT_SIZE;
         newArena->bytesAllocated = 0;
         newArena->next = NULL;
         currentArena->next = newArena;
         currentArena = newArena;
         numArenaBlocks++;
-        if (numArenaBlocks > 10)
-            ALOGI("Total arena pages for JIT: %d", numArenaBlocks);
+        numArenaMallocs++;
+        arenaFootprint += ARENA_DEFAULT_SIZE;
         goto retry;
     }
     /* Should not reach here */
     dvmAbort();
 }
 
-/* Reclaim all the arena blocks allocated so far */
+static void endPass(void)
+{
+    if (currentPass < 0) {
+        return;
+    }
+    CompilerPassStats *stats = &passStats[currentPass];
+    stats->usec += dvmGetRelativeTimeUsec() - passStartUsec;
+    stats->bytes += arenaBytesInUse - passStartBytes;
+    stats->count++;
+    currentPass = -1;
+}
+
+void dvmCompilerStartPass(CompilerPass pass)
+{
+    endPass();
+    currentPass = pass;
+    passStartUsec = dvmGetRelativeTimeUsec();
+    passStartBytes = arenaBytesInUse;
+}
+
+/*
+ * Reclaim all the arena blocks allocated so far.  The blocks are kept for
+ * the next compilation.
+ */
 void dvmCompilerArenaReset(void)
 {
     ArenaMemBlock *block;
 
+    endPass();
+
     for (block = arenaHead; block; block = block->next) {
         block->bytesAllocated = 0;
     }
     currentArena = arenaHead;
+
+    while (largeInUse != NULL) {
+        block = largeInUse;
+        largeInUse = block->next;
+        block->next = largeFree;
+        largeFree = block;
+    }
+
+    if (arenaBytesInUse > arenaMaxBytes) {
+        arenaMaxBytes = arenaBytesInUse;
+        if (arenaMaxBytes > ARENA_REPORT_BYTES) {
+            ALOGI("JIT arena high water mark %d bytes (%d + %d blocks)",
+                  arenaMaxBytes, numArenaBlocks, numLargeBlocks);
+        }
+    }
+    arenaBytesInUse = 0;
 }
 
 /* Growable List initialization */
@@ -244,8 +355,14 @@ void dvmCompilerDumpStats(void)
          gDvmJit.numCompilations,
          gDvmJit.templateSize,
          gDvmJit.codeCacheByteUsed - gDvmJit.templateSize);
-    ALOGD("Compiler arena uses %d blocks (%d bytes each)",
-         numArenaBlocks, ARENA_DEFAULT_SIZE);
+    ALOGD("Compiler arena uses %d + %d large blocks, %d bytes, %d mallocs",
+         numArenaBlocks, numLargeBlocks, arenaFootprint, numArenaMallocs);
+    ALOGD("Compiler arena high water mark is %d bytes", arenaMaxBytes);
+    for (int i = 0; i < kCompilerPassCount; i++) {
+        ALOGD("Compiler pass %-8s: %lld us, %lld arena bytes, %d runs",
+             passNames[i], passStats[i].usec, passStats[i].bytes,
+             passStats[i].count);
+    }
     ALOGD("Compiler work queue length is %d/%d", gDvmJit.compilerQueueLength,
          gDvmJit.compilerMaxQueued);
     dvmJitStats();
@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * JIT warm start.
+ *
+ * At shutdown, or when VMRuntime.saveJitWarmStart() asks for it, the head
+ * of every trace in the JitTable is written to the -Xjitwarmstart file as
+ * the checksum of its dex file, its method, its offset in the method and
+ * its profile count, hottest first.  The next run reads the file back when the
+ * compiler thread starts, and primes each head once its class has been
+ * initialized: the head's profile counter is set to go off the next time
+ * the head is reached, and the head skips the trace selection filter, so
+ * a trace that was hot last time is selected the first time it runs
+ * instead of after 2 * threshold visits.
+ *
+ * Compiled code itself is not saved.  Its literal pools and chaining
+ * cells hold the addresses of methods, classes and strings of the run
+ * that compiled it, and the compiler relies on the interpreter having
+ * executed, and therefore resolved, every instruction of a trace before
+ * it is compiled.  Priming the heads keeps both of those true and costs
+ * a single interpreted pass per trace.
+ *
+ * One line of the file describes one trace head:
+ *
+ *   <dex checksum> <class> <method name> <method descriptor> <offset> <count>
+ *
+ * Heads whose dex file checksum no longer matches are ignored.
+ */
+
+#include "Dalvik.h"
+#include "CompilerInternals.h"
+
+#include <errno.h>
+#include <algorithm>
+
+static const char kWarmStartHeader[] = "dalvik-jit-warmstart 2\n";
+
+/* Room for a line of the file; longer lines are skipped */
+#define kWarmStartMaxLine 1024
+
+/* A trace head read from the file, in the list of its class */
+struct WarmStartHead {
+    WarmStartHead *next;
+    u4 checksum;
+    const char *methodName;
+    const char *methodDescriptor;
+    u4 offset;
+    char text[1];               /* the fields above point in here */
+};
+
+/* An entry of gDvmJit.warmStartClasses */
+struct WarmStartClass {
+    char *descriptor;
+    WarmStartHead *heads;
+};
+
+static void freeWarmStartClass(void *ptr)
+{
+    WarmStartClass *warmClass = (WarmStartClass *) ptr;
+    while (warmClass->heads != NULL) {
+        WarmStartHead *head = warmClass->heads;
+        warmClass->heads = head->next;
+        free(head);
+    }
+    free(warmClass->descriptor);
+    free(warmClass);
+}
+
+static int compareWarmStartClasses(const void *ptr1, const void *ptr2)
+{
+    return strcmp(((const WarmStartClass *) ptr1)->descriptor,
+                  ((const WarmStartClass *) ptr2)->descriptor);
+}
+
+static u4 hashTraceHead(const u2 *pc)
+{
+    /* Dalvik PCs are half-word aligned and mostly share their top bits */
+    return ((u4) pc >> 1) * 2654435761U;
+}
+
+static int compareTraceHeads(const void *ptr1, const void *ptr2)
+{
+    return ptr1 != ptr2;
+}
+
+/*
+ * Split a line of the file into a new trace head, and return the class
+ * descriptor in "descriptor", or return NULL if the line is malformed.
+ */
+static WarmStartHead *parseHead(const char *line, const char **descriptor)
+{
+    size_t len = strlen(line);
+    if (len == 0 || line[len - 1] != '\n') {
+        return NULL;
+    }
+    WarmStartHead *head = (WarmStartHead *) malloc(sizeof(*head) + len);
+    if (head == NULL) {
+        return NULL;
+    }
+    memcpy(head->text, line, len + 1);
+
+    char *fields[7];
+    char *save;
+    int numFields = 0;
+    for (char *field = strtok_r(head->text, " \n", &save);
+         field != NULL && numFields < 7;
+         field = strtok_r(NULL, " \n", &save)) {
+        fields[numFields++] = field;
+    }
+    if (numFields != 6) {
+        free(head);
+        return NULL;
+    }
+
+    char *end;
+    head->checksum = strtoul(fields[0], &end, 16);
+    if (*end != '\0') {
+        free(head);
+        return NULL;
+    }
+    head->offset = strtoul(fields[4], &end, 10);
+    if (*end != '\0') {
+        free(head);
+        return NULL;
+    }
+    head->next = NULL;
+    head->methodName = fields[2];
+    head->methodDescriptor = fields[3];
+    *descriptor = fields[1];
+    return head;
+}
+
+/*
+ * Make the head at "pc" start a trace the next time it is reached.
+ */
+static void primeTraceHead(const u2 *pc)
+{
+    HashTable *heads = gDvmJit.warmTraceHeads;
+    u4 hash = hashTraceHead(pc);
+
+    dvmHashTableLock(heads);
+    dvmHashTableLookup(heads, hash, (void *) pc, compareTraceHeads, true);
+    dvmHashTableUnlock(heads);
+
+    dvmJitPrimeProfCounter(pc);
+}
+
+/*
+ * Prime the heads of "warmClass" that belong to "clazz".  Returns false
+ * if they were saved from a different dex file.
+ */
+static bool primeClass(const ClassObject *clazz,
+                       const WarmStartClass *warmClass)
+{
+    if (clazz->pDvmDex == NULL) {
+        return false;
+    }
+    u4 checksum = clazz->pDvmDex->pDexFile->pHeader->checksum;
+    bool matched = false;
+
+    for (const WarmStartHead *head = warmClass->heads; head != NULL;
+         head = head->next) {
+        if (head->checksum != checksum) {
+            continue;
+        }
+        matched = true;
+        const Method *method =
+            dvmFindDirectMethodByDescriptor(clazz, head->methodName,
+                                            head->methodDescriptor);
+        if (method == NULL) {
+            method = dvmFindVirtualMethodByDescriptor(clazz, head->methodName,
+                                                      head->methodDescriptor);
+        }
+        if (method == NULL || dvmIsNativeMethod(method) ||
+            dvmIsAbstractMethod(method) ||
+            head->offset >= dvmGetMethodInsnsSize(method)) {
+            continue;
+        }
+        primeTraceHead(method->insns + head->offset);
+    }
+    return matched;
+}
+
+void dvmCompilerWarmStartClass(const ClassObject *clazz)
+{
+    HashTable *classes = gDvmJit.warmStartClasses;
+    if (classes == NULL) {
+        return;
+    }
+
+    WarmStartClass key;
+    key.descriptor = (char *) clazz->descriptor;
+    u4 hash = dvmComputeUtf8Hash(clazz->descriptor);
+
+    dvmHashTableLock(classes);
+    WarmStartClass *warmClass = (WarmStartClass *)
+        dvmHashTableLookup(classes, hash, &key, compareWarmStartClasses,
+                           false);
+    /* Leave the heads of another dex file for a class of the same name */
+    if (warmClass != NULL && primeClass(clazz, warmClass)) {
+        dvmHashTableRemove(classes, hash, warmClass);
+        freeWarmStartClass(warmClass);
+    }
+    dvmHashTableUnlock(classes);
+}
+
+static int collectInitializedClass(void *ptr, void *arg)
+{
+    ClassObject *clazz = (ClassObject *) ptr;
+    std::vector<ClassObject *> *initialized =
+        (std::vector<ClassObject *> *) arg;
+    if (dvmIsClassInitialized(clazz)) {
+        initialized->push_back(clazz);
+    }
+    return 0;
+}
+
+bool dvmCompilerIsWarmTraceHead(const u2 *pc)
+{
+    HashTable *heads = gDvmJit.warmTraceHeads;
+    if (heads == NULL) {
+        return false;
+    }
+    return dvmHashTableLookupConcurrent(heads, hashTraceHead(pc), pc,
+                                        compareTraceHeads) != NULL;
+}
+
+void dvmCompilerWarmStartLoad()
+{
+    if (gDvmJit.warmStartFile == NULL) {
+        return;
+    }
+    assert(gDvmJit.pProfTableCopy != NULL);
+
+    FILE *fp = fopen(gDvmJit.warmStartFile, "r");
+    if (fp == NULL) {
+        /* Nothing saved yet */
+        if (errno != ENOENT) {
+            ALOGW("JIT: unable to open %s: %s", gDvmJit.warmStartFile,
+                  strerror(errno));
+        }
+        return;
+    }
+
+    char line[kWarmStartMaxLine];
+    if (fgets(line, sizeof(line), fp) == NULL ||
+        strcmp(line, kWarmStartHeader) != 0) {
+        ALOGW("JIT: ignoring %s, not a warm start profile",
+              gDvmJit.warmStartFile);
+        fclose(fp);
+        return;
+    }
+
+    HashTable *classes = dvmHashTableCreate(256, freeWarmStartClass);
+    if (classes == NULL) {
+        fclose(fp);
+        return;
+    }
+
+    /* More heads than the JitTable can hold would never be used */
+    unsigned int numHeads = 0;
+    while (numHeads < gDvmJit.jitTableSize &&
+           fgets(line, sizeof(line), fp) != NULL) {
+        const char *descriptor;
+        WarmStartHead *head = parseHead(line, &descriptor);
+        if (head == NULL) {
+            /* skip the rest of a line that is too long */
+            while (line[strlen(line) - 1] != '\n' &&
+                   fgets(line, sizeof(line), fp) != NULL) {
+            }
+            continue;
+        }
+
+        WarmStartClass key;
+        key.descriptor = (char *) descriptor;
+        u4 hash = dvmComputeUtf8Hash(descriptor);
+        WarmStartClass *warmClass = (WarmStartClass *)
+            dvmHashTableLookup(classes, hash, &key, compareWarmStartClasses,
+                               false);
+        if (warmClass == NULL) {
+            warmClass = (WarmStartClass *) malloc(sizeof(*warmClass));
+            if (warmClass == NULL ||
+                (warmClass->descriptor = strdup(descriptor)) == NULL) {
+                free(warmClass);
+                free(head);
+                break;
+            }
+            warmClass->heads = NULL;
+            dvmHashTableLookup(classes, hash, warmClass,
+                               compareWarmStartClasses, true);
+        }
+        head->next = warmClass->heads;
+        warmClass->heads = head;
+        numHeads++;
+    }
+    fclose(fp);
+
+    /*
+     * Twice as many slots as heads, so the table of primed heads never
+     * has to grow under its lock-free readers.
+     */
+    HashTable *heads = NULL;
+    if (numHeads != 0) {
+        heads = dvmHashTableCreate(numHeads * 2, NULL);
+    }
+    if (heads == NULL) {
+        dvmHashTableFree(classes);
+        return;
+    }
+    dvmHashTableSetConcurrentReads(heads);
+
+    /* Publish both tables only once they are complete */
+    ANDROID_MEMBAR_STORE();
+    gDvmJit.warmTraceHeads = heads;
+    ANDROID_MEMBAR_STORE();
+    gDvmJit.warmStartClasses = classes;
+
+    if (gDvm.verboseShutdown) {
+        ALOGD("JIT: %u trace heads to warm start from %s", numHeads,
+              gDvmJit.warmStartFile);
+    }
+
+    /*
+     * Classes initialized from here on are primed by dvmInitClass().
+     * Prime the ones that already were, without holding the class table
+     * lock while doing so.
+     */
+    std::vector<ClassObject *> initialized;
+    dvmHashTableLock(gDvm.loadedClasses);
+    dvmHashForeach(gDvm.loadedClasses, collectInitializedClass, &initialized);
+    dvmHashTableUnlock(gDvm.loadedClasses);
+    for (size_t i = 0; i < initialized.size(); i++) {
+        dvmCompilerWarmStartClass(initialized[i]);
+    }
+}
+
+/* A trace head to be saved */
+struct SavedHead {
+    const Method *method;
+    u4 offset;
+    JitTraceCounter_t count;
+};
+
+static bool hotterHead(const SavedHead &head1, const SavedHead &head2)
+{
+    return head1.count > head2.count;
+}
+
+bool dvmCompilerWarmStartSave()
+{
+    if (gDvmJit.warmStartFile == NULL || gDvmJit.pJitEntryTable == NULL) {
+        return false;
+    }
+
+    /*
+     * Collect the heads under the table lock, which also keeps the code
+     * cache from being reset while the trace descriptions are read.
+     */
+    std::vector<SavedHead> saved;
+    void *interpretTemplate = dvmCompilerGetInterpretTemplate();
+    dvmLockMutex(&gDvmJit.tableLock);
+    for (unsigned int i = 0; i < gDvmJit.jitTableSize; i++) {
+        const JitEntry *entry = &gDvmJit.pJitEntryTable[i];
+        if (entry->dPC == NULL || entry->u.info.isMethodEntry ||
+            entry->codeAddress == NULL ||
+            entry->codeAddress == interpretTemplate) {
+            continue;
+        }
+        JitTraceDescription *desc = dvmCopyTraceDescriptor(NULL, entry);
+        if (desc == NULL) {
+            continue;
+        }
+        SavedHead head;
+        head.method = desc->method;
+        head.offset = entry->dPC - desc->method->insns;
+        head.count = dvmCompilerGetTraceProfileCount(entry);
+        free(desc);
+        if (head.method->clazz->pDvmDex != NULL) {
+            saved.push_back(head);
+        }
+    }
+    dvmUnlockMutex(&gDvmJit.tableLock);
+
+    /*
+     * Hottest first, so a JitTable that shrank keeps the heads that
+     * matter on the next load.  The counts are only kept up while trace
+     * profiling is on; otherwise they are all zero and the order is the
+     * JitTable's.
+     */
+    std::stable_sort(saved.begin(), saved.end(), hotterHead);
+
+    /* Write a new file and rename it, so a crash never leaves half of one */
+    std::string tmpName(StringPrintf("%s.tmp", gDvmJit.warmStartFile));
+    FILE *fp = fopen(tmpName.c_str(), "w");
+    if (fp == NULL) {
+        ALOGW("JIT: unable to create %s: %s", tmpName.c_str(),
+              strerror(errno));
+        return false;
+    }
+    fputs(kWarmStartHeader, fp);
+    for (size_t i = 0; i < saved.size(); i++) {
+        const Method *method = saved[i].method;
+        char *methodDescriptor =
+            dexProtoCopyMethodDescriptor(&method->prototype);
+        fprintf(fp, "%08x %s %s %s %u %d\n",
+                method->clazz->pDvmDex->pDexFile->pHeader->checksum,
+                method->clazz->descriptor, method->name, methodDescriptor,
+                saved[i].offset, saved[i].count);
+        free(methodDescriptor);
+    }
+
+    bool failed = ferror(fp) != 0;
+    if (fclose(fp) != 0 || failed ||
+        rename(tmpName.c_str(), gDvmJit.warmStartFile) != 0) {
+        ALOGW("JIT: unable to write %s: %s", gDvmJit.warmStartFile,
+              strerror(errno));
+        unlink(tmpName.c_str());
+        return false;
+    }
+    if (gDvm.verboseShutdown) {
+        ALOGD("JIT: saved %zd trace heads to %s", saved.size(),
+              gDvmJit.warmStartFile);
+    }
+    return true;
+}
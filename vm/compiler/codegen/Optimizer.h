@@ -30,6 +30,9 @@ enum optControlVector {
     kSuppressLoads,
     kMethodInlining,
     kMethodJit,
+    kWriteBarrierElimination,
+    kInstructionScheduling,
+    kGlobalValueNumbering,
 };
 
 /* Forward declarations */
@@ -65,6 +65,49 @@ static TGT_LIR *genNullCheck(CompilationUnit *cUnit, int sReg, int mReg,
     return genRegImmCheck(cUnit, kArmCondEq, mReg, 0, dOffset, pcrLabel);
 }
 
+/*
+ * Start an access at "offset" from the object in sReg whose null check can
+ * be left to the fault handler.  Returns false if the caller still needs
+ * genNullCheck; otherwise the caller emits the access and then calls
+ * genImplicitNullCheckEnd.  The access is fenced off with barriers so that
+ * nothing moves across the point where the thread may resume in the
+ * interpreter.
+ */
+static bool genImplicitNullCheckBegin(CompilationUnit *cUnit, int sReg,
+                                      int offset)
+{
+    if (!dvmCompilerImplicitChecksEnabled() ||
+        offset < 0 || offset >= IMPLICIT_CHECK_MAX_OFFSET ||
+        dvmIsBitSet(cUnit->regPool->nullCheckedRegs, sReg)) {
+        return false;
+    }
+    dvmSetBit(cUnit->regPool->nullCheckedRegs, sReg);
+    /* Forget all def info, as genCheckCommon does */
+    dvmCompilerResetDefTracking(cUnit);
+    genBarrier(cUnit);
+    return true;
+}
+
+/*
+ * Pair the access just emitted with the PC reconstruction cell for dOffset.
+ * The assembler hands the pair to the fault handler.
+ */
+static void genImplicitNullCheckEnd(CompilationUnit *cUnit, int dOffset)
+{
+    ArmLIR *access = (ArmLIR *) cUnit->lastLIRInsn;
+    int dPC = (int) (cUnit->method->insns + dOffset);
+    ArmLIR *pcrLabel = (ArmLIR *) dvmCompilerNew(sizeof(ArmLIR), true);
+    pcrLabel->opcode = kArmPseudoPCReconstructionCell;
+    pcrLabel->operands[0] = dPC;
+    pcrLabel->operands[1] = dOffset;
+    dvmInsertGrowableList(&cUnit->pcReconstructionList, (intptr_t) pcrLabel);
+
+    /* Loads and stores have no use for the branch target */
+    access->generic.target = (LIR *) pcrLabel;
+    dvmInsertGrowableList(&cUnit->implicitCheckList, (intptr_t) access);
+    genBarrier(cUnit);
+}
+
 /*
  * Perform a "reg cmp reg" operation and jump to the PCR region if condition
  * satisfies.
@@ -627,6 +627,16 @@ typedef enum ArmOpcode {
     kThumb2Dmb,          /* dmb [1111001110111111100011110101] option[3-0] */
     kThumb2LdrPcReln12,  /* ldr rd,[pc,-#imm12] [1111100011011111] rt[15-12]
                                   imm12[11-0] */
+    kThumb2Clz,          /* clz [111110101011] rm[19-16] [1111] rd[11-8]
+                                  [1000] rm[3-0] */
+    kThumb2Rbit,         /* rbit [111110101001] rm[19-16] [1111] rd[11-8]
+                                  [1010] rm[3-0] */
+    kThumb2Rev,          /* rev [111110101001] rm[19-16] [1111] rd[11-8]
+                                  [1000] rm[3-0] */
+    kThumb2TstRI8,       /* tst rn, #<const> [11110] i [000001] rn[19-16] [0]
+                                  imm3 [1111] imm8[7..0] */
+    kThumb2Tbh,          /* tbh [pc, rm, lsl #1] [111010001101] [1111]
+                                  [111100000001] rm[3-0] */
     kThumbUndefined,     /* undefined [11011110xxxxxxxx] */
     kArmLast,
 } ArmOpcode;
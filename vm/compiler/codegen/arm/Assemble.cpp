@@ -881,6 +881,27 @@ ArmEncodingMap EncodingMap[kArmLast] = {
                  kFmtUnused, -1, -1,
                  IS_BINARY_OP | REG_DEF0 | REG_USE_PC | IS_LOAD,
                  "ldr", "r!0d, [r15pc, -#!1d]", 2),
+    ENCODING_MAP(kThumb2Clz,         0xfab0f080,
+                 kFmtBitBlt, 11, 8, kFmtBitBlt, 19, 16, kFmtBitBlt, 3, 0,
+                 kFmtUnused, -1, -1, IS_TERTIARY_OP | REG_DEF0_USE12,
+                 "clz", "r!0d, r!1d", 2),
+    ENCODING_MAP(kThumb2Rbit,        0xfa90f0a0,
+                 kFmtBitBlt, 11, 8, kFmtBitBlt, 19, 16, kFmtBitBlt, 3, 0,
+                 kFmtUnused, -1, -1, IS_TERTIARY_OP | REG_DEF0_USE12,
+                 "rbit", "r!0d, r!1d", 2),
+    ENCODING_MAP(kThumb2Rev,         0xfa90f080,
+                 kFmtBitBlt, 11, 8, kFmtBitBlt, 19, 16, kFmtBitBlt, 3, 0,
+                 kFmtUnused, -1, -1, IS_TERTIARY_OP | REG_DEF0_USE12,
+                 "rev", "r!0d, r!1d", 2),
+    ENCODING_MAP(kThumb2TstRI8, 0xf0100f00,
+                 kFmtBitBlt, 19, 16, kFmtModImm, -1, -1, kFmtUnused, -1, -1,
+                 kFmtUnused, -1, -1,
+                 IS_BINARY_OP | REG_USE0 | SETS_CCODES,
+                 "tst", "r!0d, #!1m", 2),
+    ENCODING_MAP(kThumb2Tbh, 0xe8dff010,
+                 kFmtBitBlt, 3, 0, kFmtUnused, -1, -1, kFmtUnused, -1, -1,
+                 kFmtUnused, -1, -1, IS_UNARY_OP | REG_USE0 | IS_BRANCH,
+                 "tbh", "[r15pc, r!0d, lsl #1]", 2),
     ENCODING_MAP(kThumbUndefined,       0xde00,
                  kFmtUnused, -1, -1, kFmtUnused, -1, -1, kFmtUnused, -1, -1,
                  kFmtUnused, -1, -1, NO_OPERAND,
@@ -1029,6 +1050,16 @@ static AssemblerStatus assembleInstructions(CompilationUnit *cUnit,
                 return kRetryHalve;
             }
             lir->operands[0] = delta >> 1;
+        } else if (lir->opcode == kArm16BitData && lir->generic.target) {
+            /* Switch table entry - see genSwitchTableEntries */
+            ArmLIR *targetLIR = (ArmLIR *) lir->generic.target;
+            intptr_t table = lir->generic.offset - 2 * lir->operands[1];
+            int delta = targetLIR->generic.offset - table;
+            if (delta < 0 || delta > 0x1fffe) {
+                ALOGE("Switch table distance out of range: %d", delta);
+                dvmCompilerAbort(cUnit);
+            }
+            lir->operands[0] = delta >> 1;
         } else if (lir->opcode == kThumbBUncond) {
             ArmLIR *targetLIR = (ArmLIR *) lir->generic.target;
             intptr_t pc = lir->generic.offset + 4;
@@ -1350,23 +1381,14 @@ static void matchSignatureBreakpoint(const CompilationUnit *cUnit,
 #endif
 
 /*
- * Go over each instruction in the list and calculate the offset from the top
- * before sending them off to the assembler. If out-of-range branch distance is
- * seen rearrange the instructions a bit to correct it.
+ * Assign each instruction its offset from the top of the compilation unit
+ * and return the size of the code.
  */
-void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
+static int assignInsnOffsets(CompilationUnit *cUnit)
 {
     ArmLIR *armLIR;
     int offset = 0;
-    int i;
-    ChainCellCounts chainCellCounts;
-    int descSize = (cUnit->jitMode == kJitMethod) ?
-        0 : getTraceDescriptionSize(cUnit->traceDesc);
-    int chainingCellGap = 0;
 
-    info->instructionSet = cUnit->instructionSet;
-
-    /* Beginning offset needs to allow space for chain cell offset */
     for (armLIR = (ArmLIR *) cUnit->firstLIRInsn;
          armLIR;
          armLIR = NEXT_LIR(armLIR)) {
@@ -1384,6 +1406,113 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
         }
         /* Pseudo opcodes don't consume space */
     }
+    return offset;
+}
+
+/*
+ * Replace the short branches that can't reach their targets before any
+ * code is emitted: cb[n]z becomes a cmp/b<c> pair, and on Thumb2 a
+ * 16-bit b<c> becomes the 32-bit form.  Widening only ever makes the code
+ * longer, so a branch that reaches its target keeps reaching it as long
+ * as nothing between them is widened; the sweep repeats, recomputing the
+ * offsets only, until it changes nothing.  This leaves assembleInstructions
+ * nothing to ask a full retry for, and saves halving traces whose
+ * conditional branches merely outgrew the 16-bit encoding.
+ *
+ * Returns the size of the code.
+ */
+static int relaxBranches(CompilationUnit *cUnit)
+{
+    bool canWiden = (cUnit->instructionSet == DALVIK_JIT_THUMB2);
+    int offset = assignInsnOffsets(cUnit);
+    bool changed;
+
+    do {
+        ArmLIR *lir;
+
+        changed = false;
+        for (lir = (ArmLIR *) cUnit->firstLIRInsn; lir; lir = NEXT_LIR(lir)) {
+            if (lir->opcode < 0 || lir->flags.isNop) {
+                continue;
+            }
+            if (lir->opcode == kThumb2Cbnz || lir->opcode == kThumb2Cbz) {
+                ArmLIR *targetLIR = (ArmLIR *) lir->generic.target;
+                int delta = targetLIR->generic.offset -
+                            (lir->generic.offset + 4);
+                if (delta > 126 || delta < 0) {
+                    /* Convert to cmp rx,#0 / b[eq/ne] tgt pair */
+                    ArmLIR *newInst =
+                        (ArmLIR *)dvmCompilerNew(sizeof(ArmLIR), true);
+                    newInst->opcode = kThumbBCond;
+                    newInst->operands[0] = 0;
+                    newInst->operands[1] = (lir->opcode == kThumb2Cbz) ?
+                                            kArmCondEq : kArmCondNe;
+                    newInst->generic.target = lir->generic.target;
+                    dvmCompilerSetupResourceMasks(newInst);
+                    dvmCompilerInsertLIRAfter((LIR *)lir, (LIR *)newInst);
+                    /* operand[0] is src1 in both cb[n]z & CmpRI8 */
+                    lir->opcode = kThumbCmpRI8;
+                    lir->operands[1] = 0;
+                    lir->generic.target = 0;
+                    dvmCompilerSetupResourceMasks(lir);
+                    changed = true;
+                }
+            } else if (lir->opcode == kThumbBCond && canWiden) {
+                ArmLIR *targetLIR = (ArmLIR *) lir->generic.target;
+                int delta = targetLIR->generic.offset -
+                            (lir->generic.offset + 4);
+                if (delta > 254 || delta < -256) {
+                    lir->opcode = kThumb2BCond;
+                    changed = true;
+                }
+            }
+        }
+        if (changed) {
+            offset = assignInsnOffsets(cUnit);
+        }
+    } while (changed);
+
+    return offset;
+}
+
+/*
+ * Go over each instruction in the list and calculate the offset from the top
+ * before sending them off to the assembler. If out-of-range branch distance is
+ * seen rearrange the instructions a bit to correct it.
+ */
+/*
+ * Tell the fault handler where each access that skipped its null check
+ * lives, and where to resume when it faults.
+ */
+static void installImplicitChecks(CompilationUnit *cUnit)
+{
+    ArmLIR **accesses = (ArmLIR **) cUnit->implicitCheckList.elemList;
+    char *base = (char *) cUnit->baseAddr;
+    int i;
+
+    for (i = 0; i < (int) cUnit->implicitCheckList.numUsed; i++) {
+        ArmLIR *access = accesses[i];
+        ArmLIR *pcrLabel = (ArmLIR *) access->generic.target;
+        /* The barriers around the access keep the optimizer off it */
+        assert(!access->flags.isNop);
+        dvmCompilerImplicitCheckAdd(base + access->generic.offset,
+                                    base + pcrLabel->generic.offset);
+    }
+}
+
+void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
+{
+    int offset = 0;
+    int i;
+    ChainCellCounts chainCellCounts;
+    int descSize = (cUnit->jitMode == kJitMethod) ?
+        0 : getTraceDescriptionSize(cUnit->traceDesc);
+    int chainingCellGap = 0;
+
+    info->instructionSet = cUnit->instructionSet;
+
+    /* Widen out-of-range branches up front instead of retrying */
+    offset = relaxBranches(cUnit);
 
     /* Const values have to be word aligned */
     offset = (offset + 3) & ~3;
@@ -1497,6 +1626,14 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
         return;
     }
 
+    /* The fault handler must know every implicit check before the code runs */
+    if (!dvmCompilerImplicitCheckReserve(cUnit->implicitCheckList.numUsed)) {
+        info->discardResult = true;
+        info->codeAddress = NULL;
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+        return;
+    }
+
     cUnit->baseAddr = (char *) gDvmJit.codeCache + gDvmJit.codeCacheByteUsed;
     gDvmJit.codeCacheByteUsed += offset;
 
@@ -1527,6 +1664,8 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
     /* Write the literals directly into the code cache */
     installLiteralPools(cUnit);
 
+    installImplicitChecks(cUnit);
+
     /* Flush dcache and invalidate the icache to maintain coherence */
     dvmCompilerCacheFlush((long)cUnit->baseAddr,
                           (long)((char *) cUnit->baseAddr + offset), 0);
@@ -1705,6 +1844,22 @@ static void inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
 
 #if defined(WITH_JIT_TUNING)
         gDvmJit.icPatchLockFree++;
+#endif
+    /*
+     * The site keeps switching between more callees than the cell can hold.
+     * Park it on the fake class so that it dispatches through the vtable
+     * instead of stopping the world for every new callee.
+     */
+    } else if (dvmCompilerICSiteIsMegamorphic(cellAddr, newContent->method)) {
+        UNPROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
+
+        cellAddr->clazz = (ClassObject *) PREDICTED_CHAIN_FAKE_CLAZZ;
+
+        UPDATE_CODE_CACHE_PATCHES();
+        PROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
+
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.icPatchMegamorphic++;
 #endif
     /*
      * Cannot patch the chaining cell inline - queue it until the next safe
@@ -2099,6 +2254,12 @@ JitTraceDescription *dvmCopyTraceDescriptor(const u2 *pc,
     return newCopy;
 }
 
+/* Read the profile count of an existing compilation */
+JitTraceCounter_t dvmCompilerGetTraceProfileCount(const JitEntry *entry)
+{
+    return getProfileCount(entry);
+}
+
 /* qsort callback function */
 static int sortTraceProfileCount(const void *entry1, const void *entry2)
 {
@@ -392,6 +392,21 @@ static ArmLIR *addWordData(CompilationUnit *cUnit, LIR **constantListP,
     return NULL;
 }
 
+/*
+ * Emit a table of the halfword distances from the start of the table to
+ * each of "targets", for genSwitchTable.  The assembler fills them in;
+ * operands[1] holds the index of the entry.
+ */
+static void genSwitchTableEntries(CompilationUnit *cUnit, ArmLIR **targets,
+                                  int count)
+{
+    for (int i = 0; i < count; i++) {
+        ArmLIR *entry = newLIR1(cUnit, kArm16BitData, 0);
+        entry->operands[1] = i;
+        entry->generic.target = (LIR *) targets[i];
+    }
+}
+
 static RegLocation inlinedTargetWide(CompilationUnit *cUnit, MIR *mir,
                                       bool fpHint)
 {
@@ -25,25 +25,108 @@
  */
 
 /*
- * Mark garbage collection card. Skip if the value we're storing is null.
+ * Mark garbage collection card. Skip if the value we're storing is null,
+ * unless the store is the first of several into the same object, or if
+ * dvmCompilerEliminateWriteBarriers() found the mark redundant.
  */
-static void markCard(CompilationUnit *cUnit, int valReg, int tgtAddrReg)
+static void markCard(CompilationUnit *cUnit, MIR *mir, int valReg,
+                     int tgtAddrReg)
 {
+    if (mir->OptimizationFlags & MIR_IGNORE_WRITE_BARRIER) {
+        return;
+    }
     int regCardBase = dvmCompilerAllocTemp(cUnit);
     int regCardNo = dvmCompilerAllocTemp(cUnit);
-    ArmLIR *branchOver = genCmpImmBranch(cUnit, kArmCondEq, valReg, 0);
+    ArmLIR *branchOver = NULL;
+    if (!(mir->OptimizationFlags & MIR_UNCONDITIONAL_BARRIER)) {
+        branchOver = genCmpImmBranch(cUnit, kArmCondEq, valReg, 0);
+    }
     loadWordDisp(cUnit, r6SELF, offsetof(Thread, cardTable),
                  regCardBase);
     opRegRegImm(cUnit, kOpLsr, regCardNo, tgtAddrReg, GC_CARD_SHIFT);
     storeBaseIndexed(cUnit, regCardBase, regCardNo, regCardBase, 0,
                      kUnsignedByte);
-    ArmLIR *target = newLIR0(cUnit, kArmPseudoTargetLabel);
-    target->defMask = ENCODE_ALL;
-    branchOver->generic.target = (LIR *)target;
+    if (branchOver != NULL) {
+        ArmLIR *target = newLIR0(cUnit, kArmPseudoTargetLabel);
+        target->defMask = ENCODE_ALL;
+        branchOver->generic.target = (LIR *)target;
+    }
     dvmCompilerFreeTemp(cUnit, regCardBase);
     dvmCompilerFreeTemp(cUnit, regCardNo);
 }
 
+#if !defined(WITH_SELF_VERIFICATION)
+/* Add "rAddend" to the 64-bit counter at "offset" from "rBase" */
+static void bumpCounter(CompilationUnit *cUnit, int rBase, int offset,
+                        int rAddend, int rZero, int rLo, int rHi)
+{
+    loadWordDisp(cUnit, rBase, offset, rLo);
+    loadWordDisp(cUnit, rBase, offset + 4, rHi);
+    opRegRegReg(cUnit, kOpAdd, rLo, rLo, rAddend);
+    opRegRegReg(cUnit, kOpAdc, rHi, rHi, rZero);
+    storeWordDisp(cUnit, rBase, offset, rLo);
+    storeWordDisp(cUnit, rBase, offset + 4, rHi);
+}
+
+/*
+ * Take the next slot of the thread's allocation buffer for instances of
+ * "classPtr", as dvmTlabAlloc() and dvmAllocObject() would, leaving the
+ * new object in r0.  Returns the branch taken when the buffer is empty
+ * or used up, whose target must call dvmAllocObject() to refill it, or
+ * NULL if instances of the class never come from a buffer.  The buffers
+ * are kept empty while allocations are counted or tracked.
+ * Caller has flushed all registers.
+ */
+static ArmLIR *genTlabAlloc(CompilationUnit *cUnit, ClassObject *classPtr)
+{
+    size_t size = classPtr->objectSize;
+    if (!gDvm.useTlabs || size == 0 || size > TLAB_MAX_OBJECT_SIZE) {
+        return NULL;
+    }
+    int tlabOffset = offsetof(Thread, tlabs) +
+                     dvmTlabSizeClass(size) * sizeof(Tlab);
+
+    dvmCompilerLockTemp(cUnit, r0);
+    dvmCompilerLockTemp(cUnit, r1);
+    dvmCompilerLockTemp(cUnit, r2);
+    dvmCompilerLockTemp(cUnit, r3);
+    int rZero = dvmCompilerAllocTemp(cUnit);
+    int rAddend = dvmCompilerAllocTemp(cUnit);
+
+    /* Empty buffers have both pointers cleared */
+    loadWordDisp(cUnit, r6SELF, tlabOffset + offsetof(Tlab, top), r0);
+    loadWordDisp(cUnit, r6SELF, tlabOffset + offsetof(Tlab, end), r1);
+    opRegReg(cUnit, kOpCmp, r0, r1);
+    ArmLIR *branchSlow = opCondBranch(cUnit, kArmCondCs);
+    loadWordDisp(cUnit, r6SELF, tlabOffset + offsetof(Tlab, stride), r1);
+    opRegRegReg(cUnit, kOpAdd, r1, r0, r1);
+    storeWordDisp(cUnit, r6SELF, tlabOffset + offsetof(Tlab, top), r1);
+
+    /* DVM_OBJECT_INIT: the slot is zeroed, so only the class is stored */
+    loadConstant(cUnit, r1, (int) classPtr);
+    storeWordDisp(cUnit, r0, offsetof(Object, clazz), r1);
+    loadWordDisp(cUnit, r6SELF, offsetof(Thread, cardTable), r2);
+    opRegRegImm(cUnit, kOpLsr, r3, r0, GC_CARD_SHIFT);
+    storeBaseIndexed(cUnit, r2, r3, r2, 0, kUnsignedByte);
+
+    /* dvmBumpThreadMetric() for the object and its bytes */
+    loadWordDisp(cUnit, r6SELF, offsetof(Thread, metrics), r1);
+    loadConstant(cUnit, rZero, 0);
+    loadConstant(cUnit, rAddend, 1);
+    bumpCounter(cUnit, r1,
+                offsetof(VmMetricsBlock, counts[kThreadMetricAllocObjects]),
+                rAddend, rZero, r2, r3);
+    loadConstant(cUnit, rAddend, size);
+    bumpCounter(cUnit, r1,
+                offsetof(VmMetricsBlock, counts[kThreadMetricAllocBytes]),
+                rAddend, rZero, r2, r3);
+
+    dvmCompilerFreeTemp(cUnit, rZero);
+    dvmCompilerFreeTemp(cUnit, rAddend);
+    return branchSlow;
+}
+#endif
+
 static bool genConversionCall(CompilationUnit *cUnit, MIR *mir, void *funct,
                                      int srcSize, int tgtSize)
 {
@@ -308,8 +391,10 @@ static void genIGetWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
 
     assert(rlDest.wide);
 
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kAnyReg, true);
 
@@ -329,8 +414,10 @@ static void genIPutWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     int regPtr;
     rlSrc = loadValueWide(cUnit, rlSrc, kAnyReg);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     regPtr = dvmCompilerAllocTemp(cUnit);
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
 
@@ -354,13 +441,23 @@ static void genIGet(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlDest = dvmCompilerGetDest(cUnit, mir, 0);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, regClass, true);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    bool implicitCheck = false;
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        implicitCheck = genImplicitNullCheckBegin(cUnit, rlObj.sRegLow,
+                                                  fieldOffset);
+        if (!implicitCheck) {
+            genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                         NULL);/* null object? */
+        }
+    }
 
     HEAP_ACCESS_SHADOW(true);
     loadBaseDisp(cUnit, mir, rlObj.lowReg, fieldOffset, rlResult.lowReg,
                  size, rlObj.sRegLow);
     HEAP_ACCESS_SHADOW(false);
+    if (implicitCheck) {
+        genImplicitNullCheckEnd(cUnit, mir->offset);
+    }
     if (isVolatile) {
         dvmCompilerGenMemBarrier(cUnit, kSY);
     }
@@ -380,8 +477,15 @@ static void genIPut(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlObj = dvmCompilerGetSrc(cUnit, mir, 1);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlSrc = loadValue(cUnit, rlSrc, regClass);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    bool implicitCheck = false;
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        implicitCheck = genImplicitNullCheckBegin(cUnit, rlObj.sRegLow,
+                                                  fieldOffset);
+        if (!implicitCheck) {
+            genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                         NULL);/* null object? */
+        }
+    }
 
     if (isVolatile) {
         dvmCompilerGenMemBarrier(cUnit, kST);
@@ -389,12 +493,15 @@ static void genIPut(CompilationUnit *cUnit, MIR *mir, OpSize size,
     HEAP_ACCESS_SHADOW(true);
     storeBaseDisp(cUnit, rlObj.lowReg, fieldOffset, rlSrc.lowReg, size);
     HEAP_ACCESS_SHADOW(false);
+    if (implicitCheck) {
+        genImplicitNullCheckEnd(cUnit, mir->offset);
+    }
     if (isVolatile) {
         dvmCompilerGenMemBarrier(cUnit, kSY);
     }
     if (isObject) {
         /* NOTE: marking card based on object head */
-        markCard(cUnit, rlSrc.lowReg, rlObj.lowReg);
+        markCard(cUnit, mir, rlSrc.lowReg, rlObj.lowReg);
     }
 }
 
@@ -626,7 +733,7 @@ static void genArrayObjectPut(CompilationUnit *cUnit, MIR *mir,
     dvmCompilerFreeTemp(cUnit, regIndex);
 
     /* NOTE: marking card here based on object head */
-    markCard(cUnit, r0, r1);
+    markCard(cUnit, mir, r0, r1);
 }
 
 static bool genShiftOpLong(CompilationUnit *cUnit, MIR *mir,
@@ -1436,10 +1543,24 @@ static void genMonitorPortable(CompilationUnit *cUnit, MIR *mir)
 
 /*
  * Fetch *self->info.breakFlags. If the breakFlags are non-zero,
- * punt to the interpreter.
+ * punt to the interpreter.  A strip-mined counted loop skips the poll
+ * unless the masked bits of its basic IV are all zero.
  */
 static void genSuspendPoll(CompilationUnit *cUnit, MIR *mir)
 {
+    LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    ArmLIR *skipPoll = NULL;
+
+    if (cUnit->jitMode == kJitLoop && loopAnalysis != NULL &&
+        loopAnalysis->suspendPollMask != 0) {
+        int rIV = dvmCompilerAllocTemp(cUnit);
+        /* Stores are written through, so the frame holds the current IV */
+        loadWordDisp(cUnit, r5FP, loopAnalysis->suspendPollReg << 2, rIV);
+        opRegImm(cUnit, kOpTst, rIV, loopAnalysis->suspendPollMask);
+        skipPoll = opCondBranch(cUnit, kArmCondNe);
+        dvmCompilerFreeTemp(cUnit, rIV);
+    }
+
     int rTemp = dvmCompilerAllocTemp(cUnit);
     ArmLIR *ld;
     ld = loadBaseDisp(cUnit, NULL, r6SELF,
@@ -1447,6 +1568,12 @@ static void genSuspendPoll(CompilationUnit *cUnit, MIR *mir)
                       rTemp, kUnsignedByte, INVALID_SREG);
     setMemRefType(ld, true /* isLoad */, kMustNotAlias);
     genRegImmCheck(cUnit, kArmCondNe, rTemp, 0, mir->offset, NULL);
+
+    if (skipPoll != NULL) {
+        ArmLIR *target = newLIR0(cUnit, kArmPseudoTargetLabel);
+        target->defMask = ENCODE_ALL;
+        skipPoll->generic.target = (LIR *) target;
+    }
 }
 
 /*
@@ -1455,6 +1582,53 @@ static void genSuspendPoll(CompilationUnit *cUnit, MIR *mir)
  * or produce corresponding Thumb instructions directly.
  */
 
+/*
+ * Continue the current optimization unit into the fall-through block of a
+ * conditional branch when nothing else enters it, so that the registers and
+ * null checks live at the branch stay valid there. Stores are written through
+ * to the Dalvik frame, so the taken path sees the same state either way.
+ */
+static void genFallThroughBranch(CompilationUnit *cUnit, BasicBlock *bb,
+                                 ArmLIR *labelList)
+{
+    BasicBlock *fallThrough = bb->fallThrough;
+
+    if (fallThrough != bb->taken &&
+        dvmCountSetBits(fallThrough->predecessors) == 1 &&
+        fallThrough->visited == false &&
+        fallThrough->blockType == kDalvikByteCode) {
+        cUnit->nextCodegenBlock = fallThrough;
+    } else {
+        /* This mostly likely will be optimized away in a later phase */
+        genUnconditionalBranch(cUnit, &labelList[fallThrough->id]);
+    }
+}
+
+/*
+ * End a block with a conditional branch to bb->taken.  When the trace went
+ * on through the taken side and left the fall-through to a chaining cell,
+ * as superblocks do, branch out to the cell on the inverted condition and
+ * keep the optimization unit going into the taken block instead.
+ */
+static void genTwoWayBranch(CompilationUnit *cUnit, BasicBlock *bb,
+                            ArmConditionCode cond, ArmLIR *labelList)
+{
+    BasicBlock *taken = bb->taken;
+
+    if (bb->fallThrough->blockType == kChainingCellNormal &&
+        taken->blockType == kDalvikByteCode &&
+        taken->visited == false &&
+        dvmCountSetBits(taken->predecessors) == 1) {
+        /* The condition codes used by if-<cmp> invert in the low bit */
+        genConditionalBranch(cUnit, (ArmConditionCode) (cond ^ 1),
+                             &labelList[bb->fallThrough->id]);
+        cUnit->nextCodegenBlock = taken;
+        return;
+    }
+    genConditionalBranch(cUnit, cond, &labelList[taken->id]);
+    genFallThroughBranch(cUnit, bb, labelList);
+}
+
 static bool handleFmt10t_Fmt20t_Fmt30t(CompilationUnit *cUnit, MIR *mir,
                                        BasicBlock *bb, ArmLIR *labelList)
 {
@@ -1753,7 +1927,7 @@ static bool handleFmt21c_Fmt31c(CompilationUnit *cUnit, MIR *mir)
             }
             if (isSputObject) {
                 /* NOTE: marking card based sfield->clazz */
-                markCard(cUnit, rlSrc.lowReg, objHead);
+                markCard(cUnit, mir, rlSrc.lowReg, objHead);
                 dvmCompilerFreeTemp(cUnit, objHead);
             }
 
@@ -1799,10 +1973,30 @@ static bool handleFmt21c_Fmt31c(CompilationUnit *cUnit, MIR *mir)
             /*
              * If it is going to throw, it should not make to the trace to begin
              * with.  However, Alloc might throw, so we need to genExportPC()
+             *
+             * NOTE: objects that never escape the trace are still allocated
+             * here.  Scalar replacing them would need more than an escape
+             * pass over the SSA form:  every exit from a translation (chaining
+             * cells, PC reconstruction cells, exception dispatch) resumes the
+             * interpreter from the Dalvik frame, so each one would need code
+             * to materialize the object and its fields first.  Traces also
+             * end at invokes and rarely span the whole lifetime of an object
+             * unless they are a loop, and the method JIT that could see it is
+             * compiled out.
              */
             assert((classPtr->accessFlags & (ACC_INTERFACE|ACC_ABSTRACT)) == 0);
             dvmCompilerFlushAllRegs(cUnit);   /* Everything to home location */
             genExportPC(cUnit, mir);
+            ArmLIR *branchDone = NULL;
+#if !defined(WITH_SELF_VERIFICATION)
+            ArmLIR *branchSlow = genTlabAlloc(cUnit, classPtr);
+            if (branchSlow != NULL) {
+                branchDone = opNone(cUnit, kOpUncondBr);
+                ArmLIR *slowLabel = newLIR0(cUnit, kArmPseudoTargetLabel);
+                slowLabel->defMask = ENCODE_ALL;
+                branchSlow->generic.target = (LIR *) slowLabel;
+            }
+#endif
             LOAD_FUNC_ADDR(cUnit, r2, (int)dvmAllocObject);
             loadConstant(cUnit, r0, (int) classPtr);
             loadConstant(cUnit, r1, ALLOC_DONT_TRACK);
@@ -1821,6 +2015,9 @@ static bool handleFmt21c_Fmt31c(CompilationUnit *cUnit, MIR *mir)
             ArmLIR *target = newLIR0(cUnit, kArmPseudoTargetLabel);
             target->defMask = ENCODE_ALL;
             branchOver->generic.target = (LIR *) target;
+            if (branchDone != NULL) {
+                branchDone->generic.target = (LIR *) target;
+            }
             rlDest = dvmCompilerGetDest(cUnit, mir, 0);
             rlResult = dvmCompilerGetReturn(cUnit);
             storeValue(cUnit, rlDest, rlResult);
@@ -2059,8 +2256,10 @@ static bool handleFmt12x(CompilationUnit *cUnit, MIR *mir)
         case OP_ARRAY_LENGTH: {
             int lenOffset = OFFSETOF_MEMBER(ArrayObject, length);
             rlSrc = loadValue(cUnit, rlSrc, kCoreReg);
-            genNullCheck(cUnit, rlSrc.sRegLow, rlSrc.lowReg,
-                         mir->offset, NULL);
+            if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+                genNullCheck(cUnit, rlSrc.sRegLow, rlSrc.lowReg,
+                             mir->offset, NULL);
+            }
             rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kCoreReg, true);
             loadWordDisp(cUnit, rlSrc.lowReg, lenOffset,
                          rlResult.lowReg);
@@ -2140,9 +2339,7 @@ static bool handleFmt21t(CompilationUnit *cUnit, MIR *mir, BasicBlock *bb,
             ALOGE("Unexpected opcode (%d) for Fmt21t", dalvikOpcode);
             dvmCompilerAbort(cUnit);
     }
-    genConditionalBranch(cUnit, cond, &labelList[bb->taken->id]);
-    /* This mostly likely will be optimized away in a later phase */
-    genUnconditionalBranch(cUnit, &labelList[bb->fallThrough->id]);
+    genTwoWayBranch(cUnit, bb, cond, labelList);
     return false;
 }
 
@@ -2538,22 +2735,38 @@ static bool handleFmt22c(CompilationUnit *cUnit, MIR *mir)
         case OP_IGET_OBJECT_VOLATILE:
         case OP_IGET:
         case OP_IGET_OBJECT:
+            genIGet(cUnit, mir, kWord, fieldOffset, isVolatile);
+            break;
+        /*
+         * Volatile sub-word fields keep a whole word, and a narrow access
+         * of its low end is still correct, so only the size matters here.
+         */
         case OP_IGET_BOOLEAN:
+            genIGet(cUnit, mir, kUnsignedByte, fieldOffset, isVolatile);
+            break;
         case OP_IGET_BYTE:
+            genIGet(cUnit, mir, kSignedByte, fieldOffset, isVolatile);
+            break;
         case OP_IGET_CHAR:
+            genIGet(cUnit, mir, kUnsignedHalf, fieldOffset, isVolatile);
+            break;
         case OP_IGET_SHORT:
-            genIGet(cUnit, mir, kWord, fieldOffset, isVolatile);
+            genIGet(cUnit, mir, kSignedHalf, fieldOffset, isVolatile);
             break;
         case OP_IPUT_WIDE:
             genIPutWide(cUnit, mir, fieldOffset);
             break;
         case OP_IPUT_VOLATILE:
         case OP_IPUT:
+            genIPut(cUnit, mir, kWord, fieldOffset, false, isVolatile);
+            break;
         case OP_IPUT_BOOLEAN:
         case OP_IPUT_BYTE:
+            genIPut(cUnit, mir, kUnsignedByte, fieldOffset, false, isVolatile);
+            break;
         case OP_IPUT_CHAR:
         case OP_IPUT_SHORT:
-            genIPut(cUnit, mir, kWord, fieldOffset, false, isVolatile);
+            genIPut(cUnit, mir, kUnsignedHalf, fieldOffset, false, isVolatile);
             break;
         case OP_IPUT_OBJECT_VOLATILE:
         case OP_IPUT_OBJECT:
@@ -2643,9 +2856,7 @@ static bool handleFmt22t(CompilationUnit *cUnit, MIR *mir, BasicBlock *bb,
             ALOGE("Unexpected opcode (%d) for Fmt22t", dalvikOpcode);
             dvmCompilerAbort(cUnit);
     }
-    genConditionalBranch(cUnit, cond, &labelList[bb->taken->id]);
-    /* This mostly likely will be optimized away in a later phase */
-    genUnconditionalBranch(cUnit, &labelList[bb->fallThrough->id]);
+    genTwoWayBranch(cUnit, bb, cond, labelList);
     return false;
 }
 
@@ -2768,87 +2979,24 @@ static bool handleFmt23x(CompilationUnit *cUnit, MIR *mir)
 }
 
 /*
- * Find the matching case.
- *
- * return values:
- * r0 (low 32-bit): pc of the chaining cell corresponding to the resolved case,
- *    including default which is placed at MIN(size, MAX_CHAINED_SWITCH_CASES).
- * r1 (high 32-bit): the branch offset of the matching case (only for indexes
- *    above MAX_CHAINED_SWITCH_CASES).
+ * Switches end the trace.  dvmCompileTrace gives the cases below
+ * MAX_CHAINED_SWITCH_CASES one normal chaining cell each, followed by one
+ * for the default, and the cases are dispatched inline:
  *
- * Instructions around the call are:
+ * packed-switch: the key minus the first key indexes a jump table, after
+ *     an unsigned compare against the number of cases.
+ * sparse-switch: up to MAX_CHAINED_SWITCH_CASES keys are searched with a
+ *     balanced tree of compares that branch straight to the cells.  Larger
+ *     switches find the index of the key with findSparseSwitchIndex and
+ *     then use the jump table.
  *
- * mov r2, pc
- * blx &findPackedSwitchIndex
- * mov pc, r0
- * .align4
- * chaining cell for case 0 [12 bytes]
- * chaining cell for case 1 [12 bytes]
- *               :
- * chaining cell for case MIN(size, MAX_CHAINED_SWITCH_CASES)-1 [12 bytes]
- * chaining cell for case default [8 bytes]
- * noChain exit
+ * The remaining cases leave through dvmJitToInterpNoChain with the branch
+ * offset of the case, loaded from the switch data.
  */
-static u8 findPackedSwitchIndex(const u2* switchData, int testVal, uintptr_t pc)
-{
-    int size;
-    int firstKey;
-    const int *entries;
-    int index;
-    int jumpIndex;
-    uintptr_t caseDPCOffset = 0;
-    /* In Thumb mode pc is 4 ahead of the "mov r2, pc" instruction */
-    uintptr_t chainingPC = (pc + 4) & ~3;
 
-    /*
-     * Packed switch data format:
-     *  ushort ident = 0x0100   magic value
-     *  ushort size             number of entries in the table
-     *  int first_key           first (and lowest) switch case value
-     *  int targets[size]       branch targets, relative to switch opcode
-     *
-     * Total size is (4+size*2) 16-bit code units.
-     */
-    size = switchData[1];
-    assert(size > 0);
-
-    firstKey = switchData[2];
-    firstKey |= switchData[3] << 16;
-
-
-    /* The entries are guaranteed to be aligned on a 32-bit boundary;
-     * we can treat them as a native int array.
-     */
-    entries = (const int*) &switchData[4];
-    assert(((u4)entries & 0x3) == 0);
-
-    index = testVal - firstKey;
-
-    /* Jump to the default cell */
-    if (index < 0 || index >= size) {
-        jumpIndex = MIN(size, MAX_CHAINED_SWITCH_CASES);
-    /* Jump to the non-chaining exit point */
-    } else if (index >= MAX_CHAINED_SWITCH_CASES) {
-        jumpIndex = MAX_CHAINED_SWITCH_CASES + 1;
-        caseDPCOffset = entries[index];
-    /* Jump to the inline chaining cell */
-    } else {
-        jumpIndex = index;
-    }
-
-    chainingPC += jumpIndex * CHAIN_CELL_NORMAL_SIZE;
-    return (((u8) caseDPCOffset) << 32) | (u8) chainingPC;
-}
-
-/* See comments for findPackedSwitchIndex */
-static u8 findSparseSwitchIndex(const u2* switchData, int testVal, uintptr_t pc)
+/* Returns the index of "testVal" in the keys of the sparse switch, or -1 */
+static int findSparseSwitchIndex(const u2* switchData, int testVal)
 {
-    int size;
-    const int *keys;
-    const int *entries;
-    uintptr_t chainingPC = (pc + 4) & ~3;
-    int i;
-
     /*
      * Sparse switch data format:
      *  ushort ident = 0x0200   magic value
@@ -2858,43 +3006,115 @@ static u8 findSparseSwitchIndex(const u2* switchData, int testVal, uintptr_t pc)
      *
      * Total size is (2+size*4) 16-bit code units.
      */
-
-    size = switchData[1];
+    int size = switchData[1];
     assert(size > 0);
 
     /* The keys are guaranteed to be aligned on a 32-bit boundary;
      * we can treat them as a native int array.
      */
-    keys = (const int*) &switchData[2];
+    const int *keys = (const int*) &switchData[2];
     assert(((u4)keys & 0x3) == 0);
 
-    /* The entries are guaranteed to be aligned on a 32-bit boundary;
-     * we can treat them as a native int array.
-     */
-    entries = keys + size;
-    assert(((u4)entries & 0x3) == 0);
-
-    /*
-     * Run through the list of keys, which are guaranteed to
-     * be sorted low-to-high.
-     *
-     * Most tables have 3-4 entries.  Few have more than 10.  A binary
-     * search here is probably not useful.
-     */
-    for (i = 0; i < size; i++) {
-        int k = keys[i];
-        if (k == testVal) {
-            /* MAX_CHAINED_SWITCH_CASES + 1 is the start of the overflow case */
-            int jumpIndex = (i < MAX_CHAINED_SWITCH_CASES) ?
-                           i : MAX_CHAINED_SWITCH_CASES + 1;
-            chainingPC += jumpIndex * CHAIN_CELL_NORMAL_SIZE;
-            return (((u8) entries[i]) << 32) | (u8) chainingPC;
-        } else if (k > testVal) {
-            break;
+    int lo = 0;
+    int hi = size - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        if (testVal < keys[mid]) {
+            hi = mid - 1;
+        } else if (testVal > keys[mid]) {
+            lo = mid + 1;
+        } else {
+            return mid;
         }
     }
-    return chainingPC + MIN(size, MAX_CHAINED_SWITCH_CASES) *
-           CHAIN_CELL_NORMAL_SIZE;
+    return -1;
+}
+
+/* Label of the chaining cell of case "caseIndex"; maxChains is the default */
+static ArmLIR *switchCaseLabel(CompilationUnit *cUnit, int caseIndex)
+{
+    ArmLIR *labelList = (ArmLIR *) cUnit->blockLabelList;
+    return &labelList[cUnit->switchChainingCellBase + caseIndex];
+}
+
+/*
+ * Branch to the cell of keys[lo..hi] that matches rKey, or to the default
+ * cell.  Short ranges are compared in sequence.
+ */
+static void genSparseSwitchTree(CompilationUnit *cUnit, int rKey,
+                                const int *keys, int lo, int hi,
+                                ArmLIR *defaultLabel)
+{
+    while (hi - lo >= 3) {
+        int mid = (lo + hi) >> 1;
+        opRegImm(cUnit, kOpCmp, rKey, keys[mid]);
+        ArmLIR *branch = opCondBranch(cUnit, kArmCondEq);
+        branch->generic.target = (LIR *) switchCaseLabel(cUnit, mid);
+        ArmLIR *branchRight = opCondBranch(cUnit, kArmCondGt);
+        genSparseSwitchTree(cUnit, rKey, keys, lo, mid - 1, defaultLabel);
+        ArmLIR *target = newLIR0(cUnit, kArmPseudoTargetLabel);
+        target->defMask = ENCODE_ALL;
+        branchRight->generic.target = (LIR *) target;
+        lo = mid + 1;
+    }
+    for (int i = lo; i <= hi; i++) {
+        opRegImm(cUnit, kOpCmp, rKey, keys[i]);
+        ArmLIR *branch = opCondBranch(cUnit, kArmCondEq);
+        branch->generic.target = (LIR *) switchCaseLabel(cUnit, i);
+    }
+    genUnconditionalBranch(cUnit, defaultLabel);
+}
+
+/*
+ * Dispatch on the case index in rIndex, where anything outside
+ * [0, size) selects the default.  "entries" are the branch targets of the
+ * switch data.
+ */
+static void genSwitchDispatch(CompilationUnit *cUnit, MIR *mir, int rIndex,
+                              int size, const int *entries)
+{
+    int maxChains = MIN(size, MAX_CHAINED_SWITCH_CASES);
+    ArmLIR *targets[MAX_CHAINED_SWITCH_CASES];
+    ArmLIR *branchOverflow = NULL;
+
+    /* Unsigned, so negative indexes take the default too */
+    opRegImm(cUnit, kOpCmp, rIndex, size);
+    ArmLIR *branchDefault = opCondBranch(cUnit, kArmCondCs);
+    branchDefault->generic.target = (LIR *) switchCaseLabel(cUnit, maxChains);
+    if (maxChains != size) {
+        opRegImm(cUnit, kOpCmp, rIndex, maxChains);
+        branchOverflow = opCondBranch(cUnit, kArmCondCs);
+    }
+
+    for (int i = 0; i < maxChains; i++) {
+        targets[i] = switchCaseLabel(cUnit, i);
+    }
+    genSwitchTable(cUnit, rIndex, targets, maxChains);
+
+    if (branchOverflow == NULL) {
+        return;
+    }
+    ArmLIR *target = newLIR0(cUnit, kArmPseudoTargetLabel);
+    target->defMask = ENCODE_ALL;
+    branchOverflow->generic.target = (LIR *) target;
+
+    /* r1 <- branch offset of the case, in code units */
+    if (rIndex != r1) {
+        opRegReg(cUnit, kOpMov, r1, rIndex);
+    }
+    loadConstant(cUnit, r0, (int) entries);
+    loadBaseIndexed(cUnit, r0, r1, r1, 2, kWord);
+
+    /* r4PC <- Dalvik PC of the case */
+    loadConstant(cUnit, r0, (int) (cUnit->method->insns + mir->offset));
+    loadWordDisp(cUnit, r6SELF, offsetof(Thread,
+                 jitToInterpEntries.dvmJitToInterpNoChain), r2);
+    opRegReg(cUnit, kOpAdd, r1, r1);
+    opRegRegReg(cUnit, kOpAdd, r4PC, r0, r1);
+#if defined(WITH_JIT_TUNING)
+    loadConstant(cUnit, r0, kSwitchOverflow);
+#endif
+    opReg(cUnit, kOpBlx, r2);
 }
 
 static bool handleFmt31t(CompilationUnit *cUnit, MIR *mir)
@@ -2922,31 +3142,40 @@ static bool handleFmt31t(CompilationUnit *cUnit, MIR *mir)
             branchOver->generic.target = (LIR *) target;
             break;
         }
-        /*
-         * Compute the goto target of up to
-         * MIN(switchSize, MAX_CHAINED_SWITCH_CASES) + 1 chaining cells.
-         * See the comment before findPackedSwitchIndex for the code layout.
-         */
+        /* See the comment before findSparseSwitchIndex */
         case OP_PACKED_SWITCH:
         case OP_SPARSE_SWITCH: {
+            if (cUnit->jitMode == kJitMethod) {
+                return true;
+            }
+            const u2 *switchData =
+                cUnit->method->insns + mir->offset + mir->dalvikInsn.vB;
+            int size = switchData[1];
             RegLocation rlSrc = dvmCompilerGetSrc(cUnit, mir, 0);
             dvmCompilerFlushAllRegs(cUnit);   /* Everything to home location */
-            loadValueDirectFixed(cUnit, rlSrc, r1);
-            dvmCompilerLockAllTemps(cUnit);
             if (dalvikOpcode == OP_PACKED_SWITCH) {
-                LOAD_FUNC_ADDR(cUnit, r4PC, (int)findPackedSwitchIndex);
+                /* ident, size, first_key[2], then the targets */
+                int firstKey = switchData[2] | (switchData[3] << 16);
+                rlSrc = loadValue(cUnit, rlSrc, kCoreReg);
+                int rIndex = dvmCompilerAllocTemp(cUnit);
+                opRegRegImm(cUnit, kOpSub, rIndex, rlSrc.lowReg, firstKey);
+                genSwitchDispatch(cUnit, mir, rIndex, size,
+                                  (const int *) &switchData[4]);
+            } else if (size <= MAX_CHAINED_SWITCH_CASES) {
+                rlSrc = loadValue(cUnit, rlSrc, kCoreReg);
+                genSparseSwitchTree(cUnit, rlSrc.lowReg,
+                                    (const int *) &switchData[2], 0, size - 1,
+                                    switchCaseLabel(cUnit, size));
             } else {
-                LOAD_FUNC_ADDR(cUnit, r4PC, (int)findSparseSwitchIndex);
+                loadValueDirectFixed(cUnit, rlSrc, r1);
+                LOAD_FUNC_ADDR(cUnit, r2, (int)findSparseSwitchIndex);
+                loadConstant(cUnit, r0, (int) switchData);
+                opReg(cUnit, kOpBlx, r2);
+                dvmCompilerClobberCallRegs(cUnit);
+                dvmCompilerLockTemp(cUnit, r0);
+                genSwitchDispatch(cUnit, mir, r0, size,
+                                  (const int *) &switchData[2 + size * 2]);
             }
-            /* r0 <- Addr of the switch data */
-            loadConstant(cUnit, r0,
-               (int) (cUnit->method->insns + mir->offset + mir->dalvikInsn.vB));
-            /* r2 <- pc of the instruction following the blx */
-            opRegReg(cUnit, kOpMov, r2, r15pc);
-            opReg(cUnit, kOpBlx, r4PC);
-            dvmCompilerClobberCallRegs(cUnit);
-            /* pc <- computed goto target */
-            opRegReg(cUnit, kOpMov, r15pc, r0);
             break;
         }
         default:
@@ -3592,6 +3821,53 @@ static bool genInlinedLongDoubleConversion(CompilationUnit *cUnit, MIR *mir)
     return false;
 }
 
+/*
+ * dst = Unsafe.get{Int,Object}[Volatile](obj, offset).  The arguments are
+ * {this, obj, offset_lo, offset_hi}; as in the native there is no null
+ * check, and only the low word of the offset is used.
+ */
+static bool genInlinedUnsafeGet(CompilationUnit *cUnit, MIR *mir,
+                                bool isVolatile)
+{
+    RegLocation rlObj = dvmCompilerGetSrc(cUnit, mir, 1);
+    RegLocation rlOffset = dvmCompilerGetSrcWide(cUnit, mir, 2, 3);
+    RegLocation rlDest = inlinedTarget(cUnit, mir, false);
+    rlObj = loadValue(cUnit, rlObj, kCoreReg);
+    rlOffset = loadValueWide(cUnit, rlOffset, kCoreReg);
+    RegLocation rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kCoreReg, true);
+    HEAP_ACCESS_SHADOW(true);
+    loadBaseIndexed(cUnit, rlObj.lowReg, rlOffset.lowReg, rlResult.lowReg, 0,
+                    kWord);
+    HEAP_ACCESS_SHADOW(false);
+    if (isVolatile) {
+        dvmCompilerGenMemBarrier(cUnit, kSY);
+    }
+    storeValue(cUnit, rlDest, rlResult);
+    return false;
+}
+
+/*
+ * dst = Unsafe.getLong(obj, offset).  getLongVolatile needs a 64-bit
+ * atomic load and goes through the C version.
+ */
+static bool genInlinedUnsafeGetLong(CompilationUnit *cUnit, MIR *mir)
+{
+    RegLocation rlObj = dvmCompilerGetSrc(cUnit, mir, 1);
+    RegLocation rlOffset = dvmCompilerGetSrcWide(cUnit, mir, 2, 3);
+    RegLocation rlDest = inlinedTargetWide(cUnit, mir, false);
+    rlObj = loadValue(cUnit, rlObj, kCoreReg);
+    rlOffset = loadValueWide(cUnit, rlOffset, kCoreReg);
+    int regPtr = dvmCompilerAllocTemp(cUnit);
+    opRegRegReg(cUnit, kOpAdd, regPtr, rlObj.lowReg, rlOffset.lowReg);
+    RegLocation rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kCoreReg, true);
+    HEAP_ACCESS_SHADOW(true);
+    loadPair(cUnit, regPtr, rlResult.lowReg, rlResult.highReg);
+    HEAP_ACCESS_SHADOW(false);
+    dvmCompilerFreeTemp(cUnit, regPtr);
+    storeValueWide(cUnit, rlDest, rlResult);
+    return false;
+}
+
 /*
  * JITs a call to a C function.
  * TODO: use this for faster native method invocation for simple native
@@ -3686,15 +3962,49 @@ static bool handleExecuteInline(CompilationUnit *cUnit, MIR *mir)
         case INLINE_LONG_BITS_TO_DOUBLE:
             return genInlinedLongDoubleConversion(cUnit, mir);
 
+        case INLINE_UNSAFE_GET_INT:
+        case INLINE_UNSAFE_GET_OBJECT:
+            return genInlinedUnsafeGet(cUnit, mir, false);
+        case INLINE_UNSAFE_GET_INT_VOLATILE:
+        case INLINE_UNSAFE_GET_OBJECT_VOLATILE:
+            return genInlinedUnsafeGet(cUnit, mir, true);
+        case INLINE_UNSAFE_GET_LONG:
+            return genInlinedUnsafeGetLong(cUnit, mir);
+
+        case INLINE_INTEGER_NUMBER_OF_LEADING_ZEROS:
+        case INLINE_INTEGER_NUMBER_OF_TRAILING_ZEROS:
+        case INLINE_INTEGER_REVERSE:
+        case INLINE_INTEGER_REVERSE_BYTES:
+            return genInlinedIntBitOp(cUnit, mir, dInsn->vB);
+
         /*
          * These ones we just JIT a call to a C function for.
          * TODO: special-case these in the other "invoke" call paths.
          */
         case INLINE_STRING_EQUALS:
+        case INLINE_STRING_INDEXOF_STRING:
+        case INLINE_STRING_HASHCODE:
         case INLINE_MATH_COS:
         case INLINE_MATH_SIN:
         case INLINE_FLOAT_TO_INT_BITS:
         case INLINE_DOUBLE_TO_LONG_BITS:
+        case INLINE_UNSAFE_GET_LONG_VOLATILE:
+        case INLINE_MATH_MIN_LONG:
+        case INLINE_MATH_MAX_LONG:
+        case INLINE_MATH_MIN_FLOAT:
+        case INLINE_MATH_MAX_FLOAT:
+        case INLINE_MATH_MIN_DOUBLE:
+        case INLINE_MATH_MAX_DOUBLE:
+        case INLINE_MATH_FLOOR:
+        case INLINE_MATH_CEIL:
+        case INLINE_MATH_RINT:
+        case INLINE_MATH_ROUND_DOUBLE:
+        case INLINE_MATH_ROUND_FLOAT:
+        case INLINE_INTEGER_BIT_COUNT:
+        case INLINE_LONG_BIT_COUNT:
+        case INLINE_FLOAT_IS_NAN:
+        case INLINE_DOUBLE_IS_NAN:
+        case INLINE_OBJECT_INTERNAL_CLONE:
             return handleExecuteInlineC(cUnit, mir);
     }
     dvmCompilerAbort(cUnit);
@@ -4063,6 +4373,22 @@ static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
     RegLocation rlThis = cUnit->regLocation[mir->dalvikInsn.vC];
 
     rlThis = loadValue(cUnit, rlThis, kCoreReg);
+    if (callsiteInfo->devirtualized) {
+        /*
+         * No loaded class overrides the callee, so any non-null receiver
+         * dispatches to it.  Take the slow invoke once one gets loaded.
+         */
+        int regOverridden = dvmCompilerAllocTemp(cUnit);
+        genNullCheck(cUnit, rlThis.sRegLow, rlThis.lowReg, mir->offset,
+                     NULL);/* null object? */
+        loadConstant(cUnit, regOverridden,
+                     (int) &callsiteInfo->method->isOverridden);
+        loadBaseDisp(cUnit, NULL, regOverridden, 0, regOverridden,
+                     kUnsignedByte, INVALID_SREG);
+        callsiteInfo->misPredBranchOver =
+            (LIR *) genCmpImmBranch(cUnit, kArmCondNe, regOverridden, 0);
+        return;
+    }
     int regPredictedClass = dvmCompilerAllocTemp(cUnit);
     loadClassPointer(cUnit, regPredictedClass, (int) callsiteInfo);
     genNullCheck(cUnit, rlThis.sRegLow, rlThis.lowReg, mir->offset,
@@ -4187,6 +4513,7 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
     ArmLIR *labelList =
         (ArmLIR *) dvmCompilerNew(sizeof(ArmLIR) * cUnit->numBlocks, true);
     ArmLIR *headLIR = NULL;
+    cUnit->blockLabelList = (void *) labelList;
     GrowableList chainingListByType[kChainingCellGap];
     int i;
 
@@ -4576,22 +4903,6 @@ gen_fallthrough:
     /* Mark the bottom of chaining cells */
     cUnit->chainingCellBottom = (LIR *) newLIR0(cUnit, kArmChainingCellBottom);
 
-    /*
-     * Generate the branch to the dvmJitToInterpNoChain entry point at the end
-     * of all chaining cells for the overflow cases.
-     */
-    if (cUnit->switchOverflowPad) {
-        loadConstant(cUnit, r0, (int) cUnit->switchOverflowPad);
-        loadWordDisp(cUnit, r6SELF, offsetof(Thread,
-                     jitToInterpEntries.dvmJitToInterpNoChain), r2);
-        opRegReg(cUnit, kOpAdd, r1, r1);
-        opRegRegReg(cUnit, kOpAdd, r4PC, r0, r1);
-#if defined(WITH_JIT_TUNING)
-        loadConstant(cUnit, r0, kSwitchOverflow);
-#endif
-        opReg(cUnit, kOpBlx, r2);
-    }
-
     dvmCompilerApplyGlobalOptimizations(cUnit);
 
 #if defined(WITH_SELF_VERIFICATION)
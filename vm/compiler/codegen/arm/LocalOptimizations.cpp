@@ -453,6 +453,378 @@ static void applyLoadHoisting(CompilationUnit *cUnit,
     }
 }
 
+/*
+ * Instruction scheduling.
+ *
+ * The instructions between two scheduling barriers are list-scheduled to
+ * hide load, multiply and VFP latencies on in-order cores.  Latencies
+ * come from the core model picked with -Xjitcore.  The numbers are rounded
+ * from the vendors' optimization manuals; they only have to rank the
+ * candidates, not predict cycle counts.
+ */
+#define MAX_SCHED_NODES 64
+
+struct SchedModel {
+    const char *name;
+    u1 load;            /* load to use */
+    u1 mul;             /* integer multiply */
+    u1 fpAdd;           /* VFP add, subtract, convert and compare */
+    u1 fpMul;
+    u1 fpDivS;          /* single precision divide and square root */
+    u1 fpDivD;          /* double precision divide and square root */
+    u1 fpToCore;        /* VFP to core register or flags */
+};
+
+static const SchedModel schedModels[] = {
+    /* name         load mul fpAdd fpMul fpDivS fpDivD fpToCore */
+    { "generic",      2,  3,    4,    5,    15,    28,      3 },
+    { "cortex-a8",    2,  3,    9,   10,    18,    32,     20 },
+    { "cortex-a9",    2,  3,    4,    5,    15,    25,      3 },
+    { "cortex-a7",    3,  3,    4,    4,    16,    31,      3 },
+    { "cortex-a53",   3,  3,    4,    4,    10,    17,      4 },
+};
+
+/* One instruction, together with the pseudo ops and nops in front of it */
+struct SchedNode {
+    ArmLIR *first;
+    ArmLIR *lir;
+    u8 useMask;
+    u8 defMask;
+    u8 rawPreds;        /* earlier nodes whose results it reads */
+    u8 orderPreds;      /* earlier nodes it must otherwise follow */
+    int latency;
+    int height;         /* length of the longest path to the region end */
+};
+
+static const SchedModel *schedModel;
+
+/* Only the compiler thread gets here */
+static const SchedModel *getSchedModel(void)
+{
+    if (schedModel != NULL) {
+        return schedModel;
+    }
+
+    schedModel = &schedModels[0];
+    if (gDvmJit.schedCore != NULL) {
+        size_t i;
+        for (i = 0; i < NELEM(schedModels); i++) {
+            if (strcmp(schedModels[i].name, gDvmJit.schedCore) == 0) {
+                schedModel = &schedModels[i];
+                break;
+            }
+        }
+        if (i == NELEM(schedModels)) {
+            ALOGW("JIT: unknown core '%s', scheduling for %s",
+                  gDvmJit.schedCore, schedModel->name);
+        }
+    }
+    return schedModel;
+}
+
+static int getLatency(const SchedModel *model, ArmLIR *lir)
+{
+    switch (lir->opcode) {
+        case kThumbMul:
+        case kThumb2MulRRR:
+        case kThumb2Mla:
+        case kThumb2Umull:
+            return model->mul;
+        case kThumb2Vadds:
+        case kThumb2Vaddd:
+        case kThumb2Vsubs:
+        case kThumb2Vsubd:
+        case kThumb2VcvtIF:
+        case kThumb2VcvtID:
+        case kThumb2VcvtFI:
+        case kThumb2VcvtDI:
+        case kThumb2VcvtFd:
+        case kThumb2VcvtDF:
+        case kThumb2Vcmpd:
+        case kThumb2Vcmps:
+            return model->fpAdd;
+        case kThumb2Vmuls:
+        case kThumb2Vmuld:
+            return model->fpMul;
+        case kThumb2Vdivs:
+        case kThumb2Vsqrts:
+            return model->fpDivS;
+        case kThumb2Vdivd:
+        case kThumb2Vsqrtd:
+            return model->fpDivD;
+        case kThumb2Fmstat:
+        case kThumb2Fmrs:
+        case kThumb2Fmrrd:
+            return model->fpToCore;
+        default:
+            break;
+    }
+    if (EncodingMap[lir->opcode].flags & IS_LOAD) {
+        return model->load;
+    }
+    return 1;
+}
+
+/* Pseudo ops and nops that simply travel with the next instruction */
+static bool isSchedFollower(ArmLIR *lir)
+{
+    if (lir->flags.isNop) {
+        return true;
+    }
+    return (lir->opcode == kArmPseudoDalvikByteCodeBoundary ||
+            lir->opcode == kArmPseudoSSARep) &&
+           lir->useMask == 0 && lir->defMask == 0;
+}
+
+/* Instructions that nothing may be moved across */
+static bool isSchedBarrier(ArmLIR *lir)
+{
+    if (isPseudoOpcode(lir->opcode) ||
+        (EncodingMap[lir->opcode].flags & (IS_BRANCH | IS_IT)) ||
+        lir->useMask == ENCODE_ALL || lir->defMask == ENCODE_ALL) {
+        return true;
+    }
+    switch (lir->opcode) {
+        /* No resource bits describe what these depend on */
+        case kArm16BitData:
+        case kThumb2Ldrex:
+        case kThumb2Strex:
+        case kThumb2Clrex:
+        case kThumb2Dmb:
+        case kThumbUndefined:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Number of instructions made conditional by an IT instruction */
+static int getITBlockSize(ArmLIR *lir)
+{
+    int mask = lir->operands[1] & 0xf;
+    return mask ? 4 - __builtin_ctz(mask) : 4;
+}
+
+/* Returns true if the two memory accesses must stay in order */
+static bool isMemoryConflict(SchedNode *node1, SchedNode *node2)
+{
+    u8 memMask1 = (node1->useMask | node1->defMask) & ENCODE_MEM;
+    u8 memMask2 = (node2->useMask | node2->defMask) & ENCODE_MEM;
+
+    if (memMask1 == 0 || memMask2 == 0 ||
+        !((EncodingMap[node1->lir->opcode].flags |
+           EncodingMap[node2->lir->opcode].flags) & IS_STORE)) {
+        return false;
+    }
+    if (memMask1 == ENCODE_MEM || memMask2 == ENCODE_MEM) {
+        return true;
+    }
+
+    u8 aliasCondition = memMask1 & memMask2;
+    if (aliasCondition == 0 || aliasCondition == ENCODE_LITERAL) {
+        return false;
+    }
+    if (aliasCondition == ENCODE_DALVIK_REG) {
+        return isDalvikRegisterClobbered(node1->lir, node2->lir);
+    }
+    return true;
+}
+
+static int getEarliestCycle(SchedNode *nodes, int idx, const int *issue)
+{
+    int cycle = 0;
+    int i;
+
+    for (i = 0; i < idx; i++) {
+        if (nodes[idx].rawPreds & (1ULL << i)) {
+            cycle = MAX(cycle, issue[i] + nodes[i].latency);
+        } else if (nodes[idx].orderPreds & (1ULL << i)) {
+            cycle = MAX(cycle, issue[i] + 1);
+        }
+    }
+    return cycle;
+}
+
+/* Cycles a single-issue core needs to get through the nodes in "order" */
+static int estimateCycles(SchedNode *nodes, const int *order, int numNodes)
+{
+    int issue[MAX_SCHED_NODES];
+    int cycle = 0;
+    int end = 0;
+    int i;
+
+    for (i = 0; i < numNodes; i++) {
+        int idx = order[i];
+        issue[idx] = MAX(cycle, getEarliestCycle(nodes, idx, issue));
+        cycle = issue[idx] + 1;
+        end = MAX(end, issue[idx] + nodes[idx].latency);
+    }
+    return end;
+}
+
+static void scheduleRegion(SchedNode *nodes, int numNodes)
+{
+    int order[MAX_SCHED_NODES];
+    int issue[MAX_SCHED_NODES];
+    int i, j;
+
+    if (numNodes < 2) {
+        return;
+    }
+
+    /* Build the dependence graph */
+    for (i = 0; i < numNodes; i++) {
+        u8 useRegMask = nodes[i].useMask & ~ENCODE_MEM;
+        u8 defRegMask = nodes[i].defMask & ~ENCODE_MEM;
+
+        nodes[i].rawPreds = nodes[i].orderPreds = 0;
+        for (j = 0; j < i; j++) {
+            if (nodes[j].defMask & useRegMask) {
+                nodes[i].rawPreds |= 1ULL << j;
+            } else if (((nodes[j].useMask | nodes[j].defMask) &
+                        defRegMask) ||
+                       isMemoryConflict(&nodes[j], &nodes[i])) {
+                nodes[i].orderPreds |= 1ULL << j;
+            }
+        }
+    }
+
+    /* Prioritize by the critical path */
+    for (i = numNodes - 1; i >= 0; i--) {
+        nodes[i].height = nodes[i].latency;
+        for (j = i + 1; j < numNodes; j++) {
+            if (nodes[j].rawPreds & (1ULL << i)) {
+                nodes[i].height = MAX(nodes[i].height,
+                                      nodes[i].latency + nodes[j].height);
+            } else if (nodes[j].orderPreds & (1ULL << i)) {
+                nodes[i].height = MAX(nodes[i].height, 1 + nodes[j].height);
+            }
+        }
+    }
+
+    /*
+     * Issue one instruction per cycle, picking the ready instruction that
+     * can start soonest and, among those, the one with the longest path
+     * to the end.  Ties keep the original order.
+     */
+    u8 scheduled = 0;
+    int cycle = 0;
+    bool reordered = false;
+    for (i = 0; i < numNodes; i++) {
+        int best = -1;
+        int bestStart = 0;
+        for (j = 0; j < numNodes; j++) {
+            if ((scheduled & (1ULL << j)) ||
+                ((nodes[j].rawPreds | nodes[j].orderPreds) & ~scheduled)) {
+                continue;
+            }
+            int start = MAX(cycle, getEarliestCycle(nodes, j, issue));
+            if (best < 0 || start < bestStart ||
+                (start == bestStart && nodes[j].height > nodes[best].height)) {
+                best = j;
+                bestStart = start;
+            }
+        }
+        assert(best >= 0);
+        issue[best] = bestStart;
+        cycle = bestStart + 1;
+        scheduled |= 1ULL << best;
+        order[i] = best;
+        reordered |= (best != i);
+    }
+    if (!reordered) {
+        return;
+    }
+
+    /* Keep the original order unless the new one is faster */
+    int identity[MAX_SCHED_NODES];
+    for (i = 0; i < numNodes; i++) {
+        identity[i] = i;
+    }
+    if (estimateCycles(nodes, order, numNodes) >=
+        estimateCycles(nodes, identity, numNodes)) {
+        return;
+    }
+
+    ArmLIR *prevLIR = PREV_LIR(nodes[0].first);
+    ArmLIR *nextLIR = NEXT_LIR(nodes[numNodes - 1].lir);
+    for (i = 0; i < numNodes; i++) {
+        SchedNode *node = &nodes[order[i]];
+        NEXT_LIR_LVALUE(prevLIR) = (LIR *) node->first;
+        PREV_LIR_LVALUE(node->first) = (LIR *) prevLIR;
+        prevLIR = node->lir;
+    }
+    NEXT_LIR_LVALUE(prevLIR) = (LIR *) nextLIR;
+    PREV_LIR_LVALUE(nextLIR) = (LIR *) prevLIR;
+}
+
+/*
+ * Perform a top-down walk over the superblock, scheduling each run of
+ * instructions between barriers.  The pseudo ops that mark Dalvik
+ * instruction boundaries move along with the instruction that follows
+ * them.
+ */
+static void applyListScheduling(CompilationUnit *cUnit,
+                                ArmLIR *headLIR,
+                                ArmLIR *tailLIR)
+{
+    const SchedModel *model = getSchedModel();
+    SchedNode nodes[MAX_SCHED_NODES];
+    int numNodes = 0;
+    ArmLIR *firstFollower = NULL;
+    int itRemaining = 0;
+    ArmLIR *thisLIR, *nextLIR;
+
+    /* Empty block */
+    if (headLIR == tailLIR) return;
+
+    for (thisLIR = NEXT_LIR(headLIR);
+         thisLIR != tailLIR;
+         thisLIR = nextLIR) {
+        nextLIR = NEXT_LIR(thisLIR);
+
+        if (isSchedFollower(thisLIR)) {
+            if (firstFollower == NULL) {
+                firstFollower = thisLIR;
+            }
+            continue;
+        }
+
+        /* The instructions of an IT block stay where they are */
+        bool isBarrier = itRemaining > 0 || isSchedBarrier(thisLIR);
+        if (itRemaining > 0) {
+            itRemaining--;
+        } else if (thisLIR->opcode == kThumb2It) {
+            itRemaining = getITBlockSize(thisLIR);
+        }
+
+        if (isBarrier || numNodes == MAX_SCHED_NODES) {
+            scheduleRegion(nodes, numNodes);
+            numNodes = 0;
+            firstFollower = NULL;
+            if (isBarrier) {
+                continue;
+            }
+        }
+
+        SchedNode *node = &nodes[numNodes++];
+        node->first = firstFollower ? firstFollower : thisLIR;
+        node->lir = thisLIR;
+        node->useMask = thisLIR->useMask;
+        node->defMask = thisLIR->defMask;
+        /* Keep each compare ahead of the fmstat that reads its result */
+        if (thisLIR->opcode == kThumb2Vcmpd ||
+            thisLIR->opcode == kThumb2Vcmps) {
+            node->defMask |= ENCODE_FP_STATUS;
+        } else if (thisLIR->opcode == kThumb2Fmstat) {
+            node->useMask |= ENCODE_FP_STATUS;
+        }
+        node->latency = getLatency(model, thisLIR);
+        firstFollower = NULL;
+    }
+    scheduleRegion(nodes, numNodes);
+}
+
 void dvmCompilerApplyLocalOptimizations(CompilationUnit *cUnit, LIR *headLIR,
                                         LIR *tailLIR)
 {
@@ -463,4 +835,7 @@ void dvmCompilerApplyLocalOptimizations(CompilationUnit *cUnit, LIR *headLIR,
     if (!(gDvmJit.disableOpt & (1 << kLoadHoisting))) {
         applyLoadHoisting(cUnit, (ArmLIR *) headLIR, (ArmLIR *) tailLIR);
     }
+    if (!(gDvmJit.disableOpt & (1 << kInstructionScheduling))) {
+        applyListScheduling(cUnit, (ArmLIR *) headLIR, (ArmLIR *) tailLIR);
+    }
 }
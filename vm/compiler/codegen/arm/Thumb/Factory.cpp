@@ -229,6 +229,10 @@ static ArmLIR *opRegImm(CompilationUnit *cUnit, OpKind op, int rDestSrc1,
                 opcode = kThumbCmpHL;
             }
             break;
+        case kOpTst:
+            shortForm = false;
+            opcode = kThumbTst;
+            break;
         default:
             ALOGE("Jit: bad case in opRegImm");
             dvmCompilerAbort(cUnit);
@@ -239,7 +243,7 @@ static ArmLIR *opRegImm(CompilationUnit *cUnit, OpKind op, int rDestSrc1,
     else {
         int rScratch = dvmCompilerAllocTemp(cUnit);
         res = loadConstant(cUnit, rScratch, value);
-        if (op == kOpCmp)
+        if (op == kOpCmp || op == kOpTst)
             newLIR2(cUnit, opcode, rDestSrc1, rScratch);
         else
             newLIR3(cUnit, opcode, rDestSrc1, rDestSrc1, rScratch);
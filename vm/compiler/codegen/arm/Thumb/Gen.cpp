@@ -82,6 +82,39 @@ static int genTraceProfileEntry(CompilationUnit *cUnit)
  * Perform a "reg cmp imm" operation and jump to the PCR region if condition
  * satisfies.
  */
+/*
+ * Jump to targets[rIndex], where rIndex is known to be below "count".
+ * There is no tbh in Thumb, so the distance is loaded from the table:
+ *
+ *     add    rBase, pc, #(table - pc)
+ *     lsl    rOffset, rIndex, #1
+ *     ldrh   rOffset, [rBase, rOffset]
+ *     lsl    rOffset, rOffset, #1
+ *     add    rBase, rBase, rOffset
+ *     mov    pc, rBase
+ *     .align4
+ * table:
+ *     .hword (targets[0] - table) / 2
+ *     ...
+ */
+static void genSwitchTable(CompilationUnit *cUnit, int rIndex,
+                           ArmLIR **targets, int count)
+{
+    int rBase = dvmCompilerAllocTemp(cUnit);
+    int rOffset = dvmCompilerAllocTemp(cUnit);
+    ArmLIR *addPcRel = newLIR3(cUnit, kThumbAddPcRel, rBase, 0, 0);
+    newLIR3(cUnit, kThumbLslRRI5, rOffset, rIndex, 1);
+    newLIR3(cUnit, kThumbLdrhRRR, rOffset, rBase, rOffset);
+    newLIR3(cUnit, kThumbLslRRI5, rOffset, rOffset, 1);
+    newLIR3(cUnit, kThumbAddRRR, rBase, rBase, rOffset);
+    opRegReg(cUnit, kOpMov, r15pc, rBase);
+    newLIR0(cUnit, kArmPseudoPseudoAlign4);
+    ArmLIR *table = newLIR0(cUnit, kArmPseudoTargetLabel);
+    table->defMask = ENCODE_ALL;
+    addPcRel->generic.target = (LIR *) table;
+    genSwitchTableEntries(cUnit, targets, count);
+}
+
 static void genNegFloat(CompilationUnit *cUnit, RegLocation rlDest,
                         RegLocation rlSrc)
 {
@@ -266,6 +299,14 @@ static bool genInlinedMinMaxInt(CompilationUnit *cUnit, MIR *mir, bool isMin)
     return false;
 }
 
+/* No clz, rbit or rev in thumb, so call out to the C versions */
+static bool handleExecuteInlineC(CompilationUnit *cUnit, MIR *mir);
+
+static bool genInlinedIntBitOp(CompilationUnit *cUnit, MIR *mir, int inlineOp)
+{
+    return handleExecuteInlineC(cUnit, mir);
+}
+
 static void genMultiplyByTwoBitMultiplier(CompilationUnit *cUnit,
         RegLocation rlSrc, RegLocation rlResult, int lit,
         int firstBit, int secondBit)
@@ -645,6 +645,17 @@ static ArmLIR *opRegImm(CompilationUnit *cUnit, OpKind op, int rDestSrc1,
                 opcode = kThumbCmpHL;
             }
             break;
+        case kOpTst: {
+            int modImm = modifiedImmediate(value);
+            if (modImm >= 0) {
+                return newLIR2(cUnit, kThumb2TstRI8, rDestSrc1, modImm);
+            }
+            int rScratch = dvmCompilerAllocTemp(cUnit);
+            loadConstant(cUnit, rScratch, value);
+            ArmLIR *res = opRegReg(cUnit, kOpTst, rDestSrc1, rScratch);
+            dvmCompilerFreeTemp(cUnit, rScratch);
+            return res;
+        }
         default:
             /* Punt to opRegRegImm - if bad case catch it there */
             shortForm = false;
@@ -73,6 +73,20 @@ static int genTraceProfileEntry(CompilationUnit *cUnit)
     }
 }
 
+/*
+ * Jump to targets[rIndex], where rIndex is known to be below "count":
+ *
+ *     tbh    [pc, rIndex, lsl #1]
+ *     .hword (targets[0] - table) / 2
+ *     ...
+ */
+static void genSwitchTable(CompilationUnit *cUnit, int rIndex,
+                           ArmLIR **targets, int count)
+{
+    newLIR1(cUnit, kThumb2Tbh, rIndex);
+    genSwitchTableEntries(cUnit, targets, count);
+}
+
 static void genNegFloat(CompilationUnit *cUnit, RegLocation rlDest,
                         RegLocation rlSrc)
 {
@@ -233,6 +247,12 @@ static ArmLIR *genExportPC(CompilationUnit *cUnit, MIR *mir)
  * unrelated to locking: the hash state.  This field must be ignored, but
  * preserved.
  *
+ * Before either, we check for a thin lock biased to this thread.  Only
+ * the owner writes such a lock word, so the hold count is adjusted with
+ * a plain load and store.  A full hold count carries into the bias bit
+ * and an empty one borrows from it, so checking that the bias bit is
+ * still set after adjusting the count sends both to the slow path.
+ *
  */
 static void genMonitorEnter(CompilationUnit *cUnit, MIR *mir)
 {
@@ -248,9 +268,28 @@ static void genMonitorEnter(CompilationUnit *cUnit, MIR *mir)
     dvmCompilerFreeTemp(cUnit, r4PC);  // Free up r4 for general use
     genNullCheck(cUnit, rlSrc.sRegLow, r1, mir->offset, NULL);
     loadWordDisp(cUnit, r6SELF, offsetof(Thread, threadId), r3); // Get threadId
+    opRegImm(cUnit, kOpLsl, r3, LW_LOCK_OWNER_SHIFT); // Align owner
+    // Is the lock biased to us?  Then count one more hold.
+    loadWordDisp(cUnit, r1, offsetof(Object, lock), r2); // Get object->lock
+    opRegRegImm(cUnit, kOpAdd, r7, r2, 1 << LW_LOCK_COUNT_SHIFT);
+    opRegRegImm(cUnit, kOpOr, r0, r3, LW_LOCK_BIASED);
+    genRegCopy(cUnit, r2, r7);
+    newLIR3(cUnit, kThumb2Bfc, r2, LW_HASH_STATE_SHIFT,
+            LW_LOCK_OWNER_SHIFT - 1);
+    newLIR3(cUnit, kThumb2Bfc, r2, LW_LOCK_COUNT_SHIFT, 30);
+    opRegReg(cUnit, kOpCmp, r2, r0);
+    ArmLIR *biasBranch = opCondBranch(cUnit, kArmCondNe);
+    storeWordDisp(cUnit, r1, offsetof(Object, lock), r7);
+    ArmLIR *biasDone = opNone(cUnit, kOpUncondBr);
+    ArmLIR *biasTarget = newLIR0(cUnit, kArmPseudoTargetLabel);
+    biasTarget->defMask = ENCODE_ALL;
+    biasBranch->generic.target = (LIR *)biasTarget;
+    if (gDvm.biasedLocking) {
+        // Bias the lock to us if we get it, holding it once
+        opRegRegImm(cUnit, kOpOr, r3, r0, 1 << LW_LOCK_COUNT_SHIFT);
+    }
     newLIR3(cUnit, kThumb2Ldrex, r2, r1,
             offsetof(Object, lock) >> 2); // Get object->lock
-    opRegImm(cUnit, kOpLsl, r3, LW_LOCK_OWNER_SHIFT); // Align owner
     // Is lock unheld on lock or held by us (==threadId) on unlock?
     newLIR4(cUnit, kThumb2Bfi, r3, r2, 0, LW_LOCK_OWNER_SHIFT - 1);
     newLIR3(cUnit, kThumb2Bfc, r2, LW_HASH_STATE_SHIFT,
@@ -281,6 +320,7 @@ static void genMonitorEnter(CompilationUnit *cUnit, MIR *mir)
     target = newLIR0(cUnit, kArmPseudoTargetLabel);
     target->defMask = ENCODE_ALL;
     branch->generic.target = (LIR *)target;
+    biasDone->generic.target = (LIR *)target;
 }
 
 /*
@@ -304,10 +344,28 @@ static void genMonitorExit(CompilationUnit *cUnit, MIR *mir)
     genNullCheck(cUnit, rlSrc.sRegLow, r1, mir->offset, NULL);
     loadWordDisp(cUnit, r1, offsetof(Object, lock), r2); // Get object->lock
     loadWordDisp(cUnit, r6SELF, offsetof(Thread, threadId), r3); // Get threadId
+    opRegImm(cUnit, kOpLsl, r3, LW_LOCK_OWNER_SHIFT); // Align owner
+    // Is the lock biased to us?  Then drop one hold.
+    opRegRegImm(cUnit, kOpOr, r0, r3, LW_LOCK_BIASED);
+    genRegCopy(cUnit, r4PC, r2);
+    newLIR3(cUnit, kThumb2Bfc, r4PC, LW_HASH_STATE_SHIFT,
+            LW_LOCK_OWNER_SHIFT - 1);
+    newLIR3(cUnit, kThumb2Bfc, r4PC, LW_LOCK_COUNT_SHIFT, 30);
+    opRegReg(cUnit, kOpCmp, r4PC, r0);
+    ArmLIR *biasBranch = opCondBranch(cUnit, kArmCondNe);
+    opRegRegImm(cUnit, kOpSub, r7, r2, 1 << LW_LOCK_COUNT_SHIFT);
+    opRegImm(cUnit, kOpCmp, r7, 0);
+    // Bias bit cleared by the borrow?  The lock wasn't held.
+    ArmLIR *unheldBranch = opCondBranch(cUnit, kArmCondGe);
+    storeWordDisp(cUnit, r1, offsetof(Object, lock), r7);
+    ArmLIR *biasDone = opNone(cUnit, kOpUncondBr);
+    ArmLIR *biasTarget = newLIR0(cUnit, kArmPseudoTargetLabel);
+    biasTarget->defMask = ENCODE_ALL;
+    biasBranch->generic.target = (LIR *)biasTarget;
+    unheldBranch->generic.target = (LIR *)biasTarget;
     // Is lock unheld on lock or held by us (==threadId) on unlock?
     opRegRegImm(cUnit, kOpAnd, r7, r2,
                 (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT));
-    opRegImm(cUnit, kOpLsl, r3, LW_LOCK_OWNER_SHIFT); // Align owner
     newLIR3(cUnit, kThumb2Bfc, r2, LW_HASH_STATE_SHIFT,
             LW_LOCK_OWNER_SHIFT - 1);
     opRegReg(cUnit, kOpSub, r2, r3);
@@ -342,6 +400,7 @@ static void genMonitorExit(CompilationUnit *cUnit, MIR *mir)
     target->defMask = ENCODE_ALL;
     branch->generic.target = (LIR *)target;
     branchOver->generic.target = (LIR *) target;
+    biasDone->generic.target = (LIR *)target;
 }
 
 static void genMonitor(CompilationUnit *cUnit, MIR *mir)
@@ -443,6 +502,41 @@ static bool genInlinedMinMaxInt(CompilationUnit *cUnit, MIR *mir, bool isMin)
     return false;
 }
 
+/*
+ * Integer.numberOfLeadingZeros, numberOfTrailingZeros, reverse and
+ * reverseBytes.  The register operand of clz, rbit and rev is encoded
+ * twice, so it is passed twice.
+ */
+static bool genInlinedIntBitOp(CompilationUnit *cUnit, MIR *mir, int inlineOp)
+{
+    RegLocation rlSrc = dvmCompilerGetSrc(cUnit, mir, 0);
+    rlSrc = loadValue(cUnit, rlSrc, kCoreReg);
+    RegLocation rlDest = inlinedTarget(cUnit, mir, false);
+    RegLocation rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kCoreReg, true);
+    int src = rlSrc.lowReg;
+    int dst = rlResult.lowReg;
+    switch (inlineOp) {
+        case INLINE_INTEGER_NUMBER_OF_LEADING_ZEROS:
+            newLIR3(cUnit, kThumb2Clz, dst, src, src);
+            break;
+        case INLINE_INTEGER_NUMBER_OF_TRAILING_ZEROS:
+            /* clz of the reversed bits; clz(0) is 32 */
+            newLIR3(cUnit, kThumb2Rbit, dst, src, src);
+            newLIR3(cUnit, kThumb2Clz, dst, dst, dst);
+            break;
+        case INLINE_INTEGER_REVERSE:
+            newLIR3(cUnit, kThumb2Rbit, dst, src, src);
+            break;
+        case INLINE_INTEGER_REVERSE_BYTES:
+            newLIR3(cUnit, kThumb2Rev, dst, src, src);
+            break;
+        default:
+            dvmCompilerAbort(cUnit);
+    }
+    storeValue(cUnit, rlDest, rlResult);
+    return false;
+}
+
 static void genMultiplyByTwoBitMultiplier(CompilationUnit *cUnit,
         RegLocation rlSrc, RegLocation rlResult, int lit,
         int firstBit, int secondBit)
@@ -1046,6 +1046,22 @@ static void inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
 
 #if defined(WITH_JIT_TUNING)
         gDvmJit.icPatchLockFree++;
+#endif
+    /*
+     * The site keeps switching between more callees than the cell can hold.
+     * Park it on the fake class so that it dispatches through the vtable
+     * instead of stopping the world for every new callee.
+     */
+    } else if (dvmCompilerICSiteIsMegamorphic(cellAddr, newContent->method)) {
+        UNPROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
+
+        cellAddr->clazz = (ClassObject *) PREDICTED_CHAIN_FAKE_CLAZZ;
+
+        UPDATE_CODE_CACHE_PATCHES();
+        PROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
+
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.icPatchMegamorphic++;
 #endif
     /*
      * Cannot patch the chaining cell inline - queue it until the next safe
@@ -1472,6 +1488,12 @@ JitTraceDescription *dvmCopyTraceDescriptor(const u2 *pc,
     return newCopy;
 }
 
+/* Read the profile count of an existing compilation */
+JitTraceCounter_t dvmCompilerGetTraceProfileCount(const JitEntry *entry)
+{
+    return getProfileCount(entry);
+}
+
 /* qsort callback function */
 static int sortTraceProfileCount(const void *entry1, const void *entry2)
 {
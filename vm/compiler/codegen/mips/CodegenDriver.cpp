@@ -25,21 +25,32 @@
  */
 
 /*
- * Mark garbage collection card. Skip if the value we're storing is null.
+ * Mark garbage collection card. Skip if the value we're storing is null,
+ * unless the store is the first of several into the same object, or if
+ * dvmCompilerEliminateWriteBarriers() found the mark redundant.
  */
-static void markCard(CompilationUnit *cUnit, int valReg, int tgtAddrReg)
+static void markCard(CompilationUnit *cUnit, MIR *mir, int valReg,
+                     int tgtAddrReg)
 {
+    if (mir->OptimizationFlags & MIR_IGNORE_WRITE_BARRIER) {
+        return;
+    }
     int regCardBase = dvmCompilerAllocTemp(cUnit);
     int regCardNo = dvmCompilerAllocTemp(cUnit);
-    MipsLIR *branchOver = opCompareBranch(cUnit, kMipsBeq, valReg, r_ZERO);
+    MipsLIR *branchOver = NULL;
+    if (!(mir->OptimizationFlags & MIR_UNCONDITIONAL_BARRIER)) {
+        branchOver = opCompareBranch(cUnit, kMipsBeq, valReg, r_ZERO);
+    }
     loadWordDisp(cUnit, rSELF, offsetof(Thread, cardTable),
                  regCardBase);
     opRegRegImm(cUnit, kOpLsr, regCardNo, tgtAddrReg, GC_CARD_SHIFT);
     storeBaseIndexed(cUnit, regCardBase, regCardNo, regCardBase, 0,
                      kUnsignedByte);
-    MipsLIR *target = newLIR0(cUnit, kMipsPseudoTargetLabel);
-    target->defMask = ENCODE_ALL;
-    branchOver->generic.target = (LIR *)target;
+    if (branchOver != NULL) {
+        MipsLIR *target = newLIR0(cUnit, kMipsPseudoTargetLabel);
+        target->defMask = ENCODE_ALL;
+        branchOver->generic.target = (LIR *)target;
+    }
     dvmCompilerFreeTemp(cUnit, regCardBase);
     dvmCompilerFreeTemp(cUnit, regCardNo);
 }
@@ -374,8 +385,10 @@ static void genIGetWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
 
     assert(rlDest.wide);
 
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kAnyReg, true);
 
@@ -395,8 +408,10 @@ static void genIPutWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     int regPtr;
     rlSrc = loadValueWide(cUnit, rlSrc, kAnyReg);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     regPtr = dvmCompilerAllocTemp(cUnit);
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
 
@@ -420,8 +435,10 @@ static void genIGet(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlDest = dvmCompilerGetDest(cUnit, mir, 0);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, regClass, true);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     HEAP_ACCESS_SHADOW(true);
     loadBaseDisp(cUnit, mir, rlObj.lowReg, fieldOffset, rlResult.lowReg,
@@ -446,8 +463,10 @@ static void genIPut(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlObj = dvmCompilerGetSrc(cUnit, mir, 1);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlSrc = loadValue(cUnit, rlSrc, regClass);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     if (isVolatile) {
         dvmCompilerGenMemBarrier(cUnit, 0);
@@ -460,7 +479,7 @@ static void genIPut(CompilationUnit *cUnit, MIR *mir, OpSize size,
     }
     if (isObject) {
         /* NOTE: marking card based on object head */
-        markCard(cUnit, rlSrc.lowReg, rlObj.lowReg);
+        markCard(cUnit, mir, rlSrc.lowReg, rlObj.lowReg);
     }
 }
 
@@ -687,7 +706,7 @@ static void genArrayObjectPut(CompilationUnit *cUnit, MIR *mir,
     dvmCompilerFreeTemp(cUnit, regIndex);
 
     /* NOTE: marking card here based on object head */
-    markCard(cUnit, r_A0, r_A1);
+    markCard(cUnit, mir, r_A0, r_A1);
 }
 
 static bool genShiftOpLong(CompilationUnit *cUnit, MIR *mir,
@@ -1504,10 +1523,24 @@ static void genMonitorPortable(CompilationUnit *cUnit, MIR *mir)
 
 /*
  * Fetch *self->info.breakFlags. If the breakFlags are non-zero,
- * punt to the interpreter.
+ * punt to the interpreter.  A strip-mined counted loop skips the poll
+ * unless the masked bits of its basic IV are all zero.
  */
 static void genSuspendPoll(CompilationUnit *cUnit, MIR *mir)
 {
+    LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    MipsLIR *skipPoll = NULL;
+
+    if (cUnit->jitMode == kJitLoop && loopAnalysis != NULL &&
+        loopAnalysis->suspendPollMask != 0) {
+        int rIV = dvmCompilerAllocTemp(cUnit);
+        /* Stores are written through, so the frame holds the current IV */
+        loadWordDisp(cUnit, rFP, loopAnalysis->suspendPollReg << 2, rIV);
+        opRegRegImm(cUnit, kOpAnd, rIV, rIV, loopAnalysis->suspendPollMask);
+        skipPoll = opCompareBranch(cUnit, kMipsBne, rIV, r_ZERO);
+        dvmCompilerFreeTemp(cUnit, rIV);
+    }
+
     int rTemp = dvmCompilerAllocTemp(cUnit);
     MipsLIR *ld;
     ld = loadBaseDisp(cUnit, NULL, rSELF,
@@ -1515,6 +1548,12 @@ static void genSuspendPoll(CompilationUnit *cUnit, MIR *mir)
                       rTemp, kUnsignedByte, INVALID_SREG);
     setMemRefType(ld, true /* isLoad */, kMustNotAlias);
     genRegImmCheck(cUnit, kMipsCondNe, rTemp, 0, mir->offset, NULL);
+
+    if (skipPoll != NULL) {
+        MipsLIR *target = newLIR0(cUnit, kMipsPseudoTargetLabel);
+        target->defMask = ENCODE_ALL;
+        skipPoll->generic.target = (LIR *) target;
+    }
 }
 
 /*
@@ -1523,6 +1562,28 @@ static void genSuspendPoll(CompilationUnit *cUnit, MIR *mir)
  * or produce corresponding Thumb instructions directly.
  */
 
+/*
+ * Continue the current optimization unit into the fall-through block of a
+ * conditional branch when nothing else enters it, so that the registers and
+ * null checks live at the branch stay valid there. Stores are written through
+ * to the Dalvik frame, so the taken path sees the same state either way.
+ */
+static void genFallThroughBranch(CompilationUnit *cUnit, BasicBlock *bb,
+                                 MipsLIR *labelList)
+{
+    BasicBlock *fallThrough = bb->fallThrough;
+
+    if (fallThrough != bb->taken &&
+        dvmCountSetBits(fallThrough->predecessors) == 1 &&
+        fallThrough->visited == false &&
+        fallThrough->blockType == kDalvikByteCode) {
+        cUnit->nextCodegenBlock = fallThrough;
+    } else {
+        /* This mostly likely will be optimized away in a later phase */
+        genUnconditionalBranch(cUnit, &labelList[fallThrough->id]);
+    }
+}
+
 static bool handleFmt10t_Fmt20t_Fmt30t(CompilationUnit *cUnit, MIR *mir,
                                        BasicBlock *bb, MipsLIR *labelList)
 {
@@ -1821,7 +1882,7 @@ static bool handleFmt21c_Fmt31c(CompilationUnit *cUnit, MIR *mir)
             }
             if (isSputObject) {
                 /* NOTE: marking card based sfield->clazz */
-                markCard(cUnit, rlSrc.lowReg, objHead);
+                markCard(cUnit, mir, rlSrc.lowReg, objHead);
                 dvmCompilerFreeTemp(cUnit, objHead);
             }
 
@@ -2113,8 +2174,10 @@ static bool handleFmt12x(CompilationUnit *cUnit, MIR *mir)
         case OP_ARRAY_LENGTH: {
             int lenOffset = OFFSETOF_MEMBER(ArrayObject, length);
             rlSrc = loadValue(cUnit, rlSrc, kCoreReg);
-            genNullCheck(cUnit, rlSrc.sRegLow, rlSrc.lowReg,
-                         mir->offset, NULL);
+            if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+                genNullCheck(cUnit, rlSrc.sRegLow, rlSrc.lowReg,
+                             mir->offset, NULL);
+            }
             rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kCoreReg, true);
             loadWordDisp(cUnit, rlSrc.lowReg, lenOffset,
                          rlResult.lowReg);
@@ -2193,8 +2256,7 @@ static bool handleFmt21t(CompilationUnit *cUnit, MIR *mir, BasicBlock *bb,
             dvmCompilerAbort(cUnit);
     }
     genConditionalBranchMips(cUnit, opc, rlSrc.lowReg, rt, &labelList[bb->taken->id]);
-    /* This mostly likely will be optimized away in a later phase */
-    genUnconditionalBranch(cUnit, &labelList[bb->fallThrough->id]);
+    genFallThroughBranch(cUnit, bb, labelList);
     return false;
 }
 
@@ -2598,22 +2660,38 @@ return false;
         case OP_IGET_OBJECT_VOLATILE:
         case OP_IGET:
         case OP_IGET_OBJECT:
+            genIGet(cUnit, mir, kWord, fieldOffset, isVolatile);
+            break;
+        /*
+         * Volatile sub-word fields keep a whole word, and a narrow access
+         * of its low end is still correct, so only the size matters here.
+         */
         case OP_IGET_BOOLEAN:
+            genIGet(cUnit, mir, kUnsignedByte, fieldOffset, isVolatile);
+            break;
         case OP_IGET_BYTE:
+            genIGet(cUnit, mir, kSignedByte, fieldOffset, isVolatile);
+            break;
         case OP_IGET_CHAR:
+            genIGet(cUnit, mir, kUnsignedHalf, fieldOffset, isVolatile);
+            break;
         case OP_IGET_SHORT:
-            genIGet(cUnit, mir, kWord, fieldOffset, isVolatile);
+            genIGet(cUnit, mir, kSignedHalf, fieldOffset, isVolatile);
             break;
         case OP_IPUT_WIDE:
             genIPutWide(cUnit, mir, fieldOffset);
             break;
         case OP_IPUT_VOLATILE:
         case OP_IPUT:
+            genIPut(cUnit, mir, kWord, fieldOffset, false, isVolatile);
+            break;
         case OP_IPUT_BOOLEAN:
         case OP_IPUT_BYTE:
+            genIPut(cUnit, mir, kUnsignedByte, fieldOffset, false, isVolatile);
+            break;
         case OP_IPUT_CHAR:
         case OP_IPUT_SHORT:
-            genIPut(cUnit, mir, kWord, fieldOffset, false, isVolatile);
+            genIPut(cUnit, mir, kUnsignedHalf, fieldOffset, false, isVolatile);
             break;
         case OP_IPUT_OBJECT_VOLATILE:
         case OP_IPUT_OBJECT:
@@ -2723,8 +2801,7 @@ static bool handleFmt22t(CompilationUnit *cUnit, MIR *mir, BasicBlock *bb,
     }
 
     genConditionalBranchMips(cUnit, opc, reg1, reg2, &labelList[bb->taken->id]);
-    /* This mostly likely will be optimized away in a later phase */
-    genUnconditionalBranch(cUnit, &labelList[bb->fallThrough->id]);
+    genFallThroughBranch(cUnit, bb, labelList);
     return false;
 }
 
@@ -3831,10 +3908,38 @@ static bool handleExecuteInline(CompilationUnit *cUnit, MIR *mir)
          * TODO: special-case these in the other "invoke" call paths.
          */
         case INLINE_STRING_EQUALS:
+        case INLINE_STRING_INDEXOF_STRING:
+        case INLINE_STRING_HASHCODE:
         case INLINE_MATH_COS:
         case INLINE_MATH_SIN:
         case INLINE_FLOAT_TO_INT_BITS:
         case INLINE_DOUBLE_TO_LONG_BITS:
+        case INLINE_UNSAFE_GET_INT:
+        case INLINE_UNSAFE_GET_INT_VOLATILE:
+        case INLINE_UNSAFE_GET_LONG:
+        case INLINE_UNSAFE_GET_LONG_VOLATILE:
+        case INLINE_UNSAFE_GET_OBJECT:
+        case INLINE_UNSAFE_GET_OBJECT_VOLATILE:
+        case INLINE_INTEGER_NUMBER_OF_LEADING_ZEROS:
+        case INLINE_INTEGER_NUMBER_OF_TRAILING_ZEROS:
+        case INLINE_INTEGER_REVERSE:
+        case INLINE_INTEGER_REVERSE_BYTES:
+        case INLINE_MATH_MIN_LONG:
+        case INLINE_MATH_MAX_LONG:
+        case INLINE_MATH_MIN_FLOAT:
+        case INLINE_MATH_MAX_FLOAT:
+        case INLINE_MATH_MIN_DOUBLE:
+        case INLINE_MATH_MAX_DOUBLE:
+        case INLINE_MATH_FLOOR:
+        case INLINE_MATH_CEIL:
+        case INLINE_MATH_RINT:
+        case INLINE_MATH_ROUND_DOUBLE:
+        case INLINE_MATH_ROUND_FLOAT:
+        case INLINE_INTEGER_BIT_COUNT:
+        case INLINE_LONG_BIT_COUNT:
+        case INLINE_FLOAT_IS_NAN:
+        case INLINE_DOUBLE_IS_NAN:
+        case INLINE_OBJECT_INTERNAL_CLONE:
             return handleExecuteInlineC(cUnit, mir);
     }
     dvmCompilerAbort(cUnit);
@@ -4185,6 +4290,22 @@ static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
     RegLocation rlThis = cUnit->regLocation[mir->dalvikInsn.vC];
 
     rlThis = loadValue(cUnit, rlThis, kCoreReg);
+    if (callsiteInfo->devirtualized) {
+        /*
+         * No loaded class overrides the callee, so any non-null receiver
+         * dispatches to it.  Take the slow invoke once one gets loaded.
+         */
+        int regOverridden = dvmCompilerAllocTemp(cUnit);
+        genNullCheck(cUnit, rlThis.sRegLow, rlThis.lowReg, mir->offset,
+                     NULL);/* null object? */
+        loadConstant(cUnit, regOverridden,
+                     (int) &callsiteInfo->method->isOverridden);
+        loadBaseDisp(cUnit, NULL, regOverridden, 0, regOverridden,
+                     kUnsignedByte, INVALID_SREG);
+        callsiteInfo->misPredBranchOver =
+            (LIR *) opCompareBranch(cUnit, kMipsBnez, regOverridden, -1);
+        return;
+    }
     int regPredictedClass = dvmCompilerAllocTemp(cUnit);
     loadClassPointer(cUnit, regPredictedClass, (int) callsiteInfo);
     genNullCheck(cUnit, rlThis.sRegLow, rlThis.lowReg, mir->offset,
@@ -4304,6 +4425,36 @@ assert(0); /* MIPSTODO port selfVerificationPuntOps() */
 }
 #endif
 
+/*
+ * findPackedSwitchIndex and findSparseSwitchIndex expect the chaining cells
+ * of the switch that ends the trace to come right after the switch code.
+ * Move them to the front of the normal cells, ahead of the cells of any
+ * branch taken earlier in the trace.
+ */
+static void moveSwitchChainingCellsFirst(CompilationUnit *cUnit,
+                                         GrowableList *normalCells)
+{
+    int base = cUnit->switchChainingCellBase;
+    int *blockIdList = (int *) normalCells->elemList;
+    size_t numSwitchCells = 0;
+
+    if (base == 0) {
+        return;
+    }
+    for (size_t i = 0; i < normalCells->numUsed; i++) {
+        int blockId = blockIdList[i];
+        /* The switch cells were created last */
+        if (blockId < base) {
+            continue;
+        }
+        /* Shift the earlier non-switch cells up by one */
+        for (size_t j = i; j > numSwitchCells; j--) {
+            blockIdList[j] = blockIdList[j - 1];
+        }
+        blockIdList[numSwitchCells++] = blockId;
+    }
+}
+
 void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
 {
     /* Used to hold the labels of each block */
@@ -4632,6 +4783,9 @@ gen_fallthrough:
         }
     }
 
+    moveSwitchChainingCellsFirst(cUnit,
+                                 &chainingListByType[kChainingCellNormal]);
+
     /* Handle the chaining cells in predefined order */
     for (i = 0; i < kChainingCellGap; i++) {
         size_t j;
@@ -453,6 +453,353 @@ static void applyLoadHoisting(CompilationUnit *cUnit,
     }
 }
 
+/*
+ * Instruction scheduling.
+ *
+ * The instructions between two scheduling barriers are list-scheduled to
+ * hide load, multiply, divide and FPU latencies on in-order cores.  Latencies
+ * come from the core model picked with -Xjitcore.  The numbers are rounded
+ * from the vendors' optimization manuals; they only have to rank the
+ * candidates, not predict cycle counts.
+ */
+#define MAX_SCHED_NODES 64
+
+struct SchedModel {
+    const char *name;
+    u1 load;            /* load to use */
+    u1 mul;             /* mul to use */
+    u1 div;             /* div to mfhi/mflo */
+    u1 fpAdd;           /* FPU add, subtract and convert */
+    u1 fpMul;
+    u1 fpDivS;
+    u1 fpDivD;
+    u1 fpToCore;        /* mfc1 */
+};
+
+static const SchedModel schedModels[] = {
+    /* name    load mul div fpAdd fpMul fpDivS fpDivD fpToCore */
+    { "generic", 2,  4, 20,    4,    5,    15,    30,      2 },
+    { "24k",     2,  5, 35,    4,    4,    17,    32,      2 },
+    { "74k",     3,  5, 35,    4,    5,    17,    32,      3 },
+};
+
+/* One instruction, together with the pseudo ops and nops in front of it */
+struct SchedNode {
+    MipsLIR *first;
+    MipsLIR *lir;
+    u8 useMask;
+    u8 defMask;
+    u8 rawPreds;        /* earlier nodes whose results it reads */
+    u8 orderPreds;      /* earlier nodes it must otherwise follow */
+    int latency;
+    int height;         /* length of the longest path to the region end */
+};
+
+static const SchedModel *schedModel;
+
+/* Only the compiler thread gets here */
+static const SchedModel *getSchedModel(void)
+{
+    if (schedModel != NULL) {
+        return schedModel;
+    }
+
+    schedModel = &schedModels[0];
+    if (gDvmJit.schedCore != NULL) {
+        size_t i;
+        for (i = 0; i < NELEM(schedModels); i++) {
+            if (strcmp(schedModels[i].name, gDvmJit.schedCore) == 0) {
+                schedModel = &schedModels[i];
+                break;
+            }
+        }
+        if (i == NELEM(schedModels)) {
+            ALOGW("JIT: unknown core '%s', scheduling for %s",
+                  gDvmJit.schedCore, schedModel->name);
+        }
+    }
+    return schedModel;
+}
+
+static int getLatency(const SchedModel *model, MipsLIR *lir)
+{
+    switch (lir->opcode) {
+        case kMipsMul:
+            return model->mul;
+        case kMipsDiv:
+            return model->div;
+#ifdef __mips_hard_float
+        case kMipsFadds:
+        case kMipsFaddd:
+        case kMipsFsubs:
+        case kMipsFsubd:
+        case kMipsFcvtsd:
+        case kMipsFcvtsw:
+        case kMipsFcvtds:
+        case kMipsFcvtdw:
+        case kMipsFcvtws:
+        case kMipsFcvtwd:
+            return model->fpAdd;
+        case kMipsFmuls:
+        case kMipsFmuld:
+            return model->fpMul;
+        case kMipsFdivs:
+            return model->fpDivS;
+        case kMipsFdivd:
+            return model->fpDivD;
+        case kMipsMfc1:
+            return model->fpToCore;
+#endif
+        default:
+            break;
+    }
+    if (EncodingMap[lir->opcode].flags & IS_LOAD) {
+        return model->load;
+    }
+    return 1;
+}
+
+/* Pseudo ops and nops that simply travel with the next instruction */
+static bool isSchedFollower(MipsLIR *lir)
+{
+    if (lir->flags.isNop) {
+        return true;
+    }
+    return (lir->opcode == kMipsPseudoDalvikByteCodeBoundary ||
+            lir->opcode == kMipsPseudoSSARep) &&
+           lir->useMask == 0 && lir->defMask == 0;
+}
+
+/* Instructions that nothing may be moved across */
+static bool isSchedBarrier(MipsLIR *lir)
+{
+    if (isPseudoOpCode(lir->opcode) ||
+        (EncodingMap[lir->opcode].flags & IS_BRANCH) ||
+        lir->useMask == ENCODE_ALL || lir->defMask == ENCODE_ALL) {
+        return true;
+    }
+    switch (lir->opcode) {
+        /* No resource bits describe what these depend on */
+        case kMips32BitData:
+        case kMipsUndefined:
+        /* Nops are there to pad code sequences to a fixed size */
+        case kMipsNop:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Returns true if the two memory accesses must stay in order */
+static bool isMemoryConflict(SchedNode *node1, SchedNode *node2)
+{
+    u8 memMask1 = (node1->useMask | node1->defMask) & ENCODE_MEM;
+    u8 memMask2 = (node2->useMask | node2->defMask) & ENCODE_MEM;
+
+    if (memMask1 == 0 || memMask2 == 0 ||
+        !((EncodingMap[node1->lir->opcode].flags |
+           EncodingMap[node2->lir->opcode].flags) & IS_STORE)) {
+        return false;
+    }
+    if (memMask1 == ENCODE_MEM || memMask2 == ENCODE_MEM) {
+        return true;
+    }
+
+    u8 aliasCondition = memMask1 & memMask2;
+    if (aliasCondition == 0 || aliasCondition == ENCODE_LITERAL) {
+        return false;
+    }
+    if (aliasCondition == ENCODE_DALVIK_REG) {
+        return isDalvikRegisterClobbered(node1->lir, node2->lir);
+    }
+    return true;
+}
+
+static int getEarliestCycle(SchedNode *nodes, int idx, const int *issue)
+{
+    int cycle = 0;
+    int i;
+
+    for (i = 0; i < idx; i++) {
+        if (nodes[idx].rawPreds & (1ULL << i)) {
+            cycle = MAX(cycle, issue[i] + nodes[i].latency);
+        } else if (nodes[idx].orderPreds & (1ULL << i)) {
+            cycle = MAX(cycle, issue[i] + 1);
+        }
+    }
+    return cycle;
+}
+
+/* Cycles a single-issue core needs to get through the nodes in "order" */
+static int estimateCycles(SchedNode *nodes, const int *order, int numNodes)
+{
+    int issue[MAX_SCHED_NODES];
+    int cycle = 0;
+    int end = 0;
+    int i;
+
+    for (i = 0; i < numNodes; i++) {
+        int idx = order[i];
+        issue[idx] = MAX(cycle, getEarliestCycle(nodes, idx, issue));
+        cycle = issue[idx] + 1;
+        end = MAX(end, issue[idx] + nodes[idx].latency);
+    }
+    return end;
+}
+
+static void scheduleRegion(SchedNode *nodes, int numNodes)
+{
+    int order[MAX_SCHED_NODES];
+    int issue[MAX_SCHED_NODES];
+    int i, j;
+
+    if (numNodes < 2) {
+        return;
+    }
+
+    /* Build the dependence graph */
+    for (i = 0; i < numNodes; i++) {
+        u8 useRegMask = nodes[i].useMask & ~ENCODE_MEM;
+        u8 defRegMask = nodes[i].defMask & ~ENCODE_MEM;
+
+        nodes[i].rawPreds = nodes[i].orderPreds = 0;
+        for (j = 0; j < i; j++) {
+            if (nodes[j].defMask & useRegMask & ~ENCODE_MEM) {
+                nodes[i].rawPreds |= 1ULL << j;
+            } else if (((nodes[j].useMask | nodes[j].defMask) &
+                        defRegMask & ~ENCODE_MEM) ||
+                       isMemoryConflict(&nodes[j], &nodes[i])) {
+                nodes[i].orderPreds |= 1ULL << j;
+            }
+        }
+    }
+
+    /* Prioritize by the critical path */
+    for (i = numNodes - 1; i >= 0; i--) {
+        nodes[i].height = nodes[i].latency;
+        for (j = i + 1; j < numNodes; j++) {
+            if (nodes[j].rawPreds & (1ULL << i)) {
+                nodes[i].height = MAX(nodes[i].height,
+                                      nodes[i].latency + nodes[j].height);
+            } else if (nodes[j].orderPreds & (1ULL << i)) {
+                nodes[i].height = MAX(nodes[i].height, 1 + nodes[j].height);
+            }
+        }
+    }
+
+    /*
+     * Issue one instruction per cycle, picking the ready instruction that
+     * can start soonest and, among those, the one with the longest path
+     * to the end.  Ties keep the original order.
+     */
+    u8 scheduled = 0;
+    int cycle = 0;
+    bool reordered = false;
+    for (i = 0; i < numNodes; i++) {
+        int best = -1;
+        int bestStart = 0;
+        for (j = 0; j < numNodes; j++) {
+            if ((scheduled & (1ULL << j)) ||
+                ((nodes[j].rawPreds | nodes[j].orderPreds) & ~scheduled)) {
+                continue;
+            }
+            int start = MAX(cycle, getEarliestCycle(nodes, j, issue));
+            if (best < 0 || start < bestStart ||
+                (start == bestStart && nodes[j].height > nodes[best].height)) {
+                best = j;
+                bestStart = start;
+            }
+        }
+        assert(best >= 0);
+        issue[best] = bestStart;
+        cycle = bestStart + 1;
+        scheduled |= 1ULL << best;
+        order[i] = best;
+        reordered |= (best != i);
+    }
+    if (!reordered) {
+        return;
+    }
+
+    /* Keep the original order unless the new one is faster */
+    int identity[MAX_SCHED_NODES];
+    for (i = 0; i < numNodes; i++) {
+        identity[i] = i;
+    }
+    if (estimateCycles(nodes, order, numNodes) >=
+        estimateCycles(nodes, identity, numNodes)) {
+        return;
+    }
+
+    MipsLIR *prevLIR = PREV_LIR(nodes[0].first);
+    MipsLIR *nextLIR = NEXT_LIR(nodes[numNodes - 1].lir);
+    for (i = 0; i < numNodes; i++) {
+        SchedNode *node = &nodes[order[i]];
+        NEXT_LIR_LVALUE(prevLIR) = (LIR *) node->first;
+        PREV_LIR_LVALUE(node->first) = (LIR *) prevLIR;
+        prevLIR = node->lir;
+    }
+    NEXT_LIR_LVALUE(prevLIR) = (LIR *) nextLIR;
+    PREV_LIR_LVALUE(nextLIR) = (LIR *) prevLIR;
+}
+
+/*
+ * Perform a top-down walk over the superblock, scheduling each run of
+ * instructions between barriers.  The pseudo ops that mark Dalvik
+ * instruction boundaries move along with the instruction that follows
+ * them.
+ */
+static void applyListScheduling(CompilationUnit *cUnit,
+                                MipsLIR *headLIR,
+                                MipsLIR *tailLIR)
+{
+    const SchedModel *model = getSchedModel();
+    SchedNode nodes[MAX_SCHED_NODES];
+    int numNodes = 0;
+    MipsLIR *firstFollower = NULL;
+    bool inDelaySlot = false;
+    MipsLIR *thisLIR, *nextLIR;
+
+    /* Empty block */
+    if (headLIR == tailLIR) return;
+
+    for (thisLIR = NEXT_LIR(headLIR);
+         thisLIR != tailLIR;
+         thisLIR = nextLIR) {
+        nextLIR = NEXT_LIR(thisLIR);
+
+        if (isSchedFollower(thisLIR)) {
+            if (firstFollower == NULL) {
+                firstFollower = thisLIR;
+            }
+            continue;
+        }
+
+        /* An instruction already placed in a delay slot stays there */
+        bool isBarrier = inDelaySlot || isSchedBarrier(thisLIR);
+        inDelaySlot = !isPseudoOpCode(thisLIR->opcode) &&
+                      (EncodingMap[thisLIR->opcode].flags & IS_BRANCH);
+
+        if (isBarrier || numNodes == MAX_SCHED_NODES) {
+            scheduleRegion(nodes, numNodes);
+            numNodes = 0;
+            firstFollower = NULL;
+            if (isBarrier) {
+                continue;
+            }
+        }
+
+        SchedNode *node = &nodes[numNodes++];
+        node->first = firstFollower ? firstFollower : thisLIR;
+        node->lir = thisLIR;
+        node->useMask = thisLIR->useMask;
+        node->defMask = thisLIR->defMask;
+        node->latency = getLatency(model, thisLIR);
+        firstFollower = NULL;
+    }
+    scheduleRegion(nodes, numNodes);
+}
+
 void dvmCompilerApplyLocalOptimizations(CompilationUnit *cUnit, LIR *headLIR,
                                         LIR *tailLIR)
 {
@@ -463,4 +810,7 @@ void dvmCompilerApplyLocalOptimizations(CompilationUnit *cUnit, LIR *headLIR,
     if (!(gDvmJit.disableOpt & (1 << kLoadHoisting))) {
         applyLoadHoisting(cUnit, (MipsLIR *) headLIR, (MipsLIR *) tailLIR);
     }
+    if (!(gDvmJit.disableOpt & (1 << kInstructionScheduling))) {
+        applyListScheduling(cUnit, (MipsLIR *) headLIR, (MipsLIR *) tailLIR);
+    }
 }
@@ -4066,6 +4066,8 @@ int getTempRegInfo(TempRegInfo* infoArray) { //returns an array of TempRegInfo
         infoArray[7].regNum = 9;
         infoArray[7].refCount = 2; //DU
         infoArray[7].physicalType = LowOpndRegType_gp;
+        if(inst_op == OP_IPUT_BYTE || inst_op == OP_IPUT_BOOLEAN)
+            infoArray[7].is8Bit = true;
         if(inst_op == OP_IPUT_OBJECT || inst_op == OP_IPUT_OBJECT_VOLATILE) {
             infoArray[5].shareWithVR = false;
             return updateMarkCard(infoArray, 7/*index for valReg*/,
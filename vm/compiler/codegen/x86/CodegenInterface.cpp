@@ -68,6 +68,14 @@ bool dvmCompilerArchInit() {
     gDvmJit.codeCacheSize = 512*1024;
     gDvmJit.optLevel = kJitOptLevelO1;
 
+    /*
+     * The loop, SSA and null/range check passes all feed this back end, but
+     * the lowering of inlined callees (WITH_JIT_INLINING) is not built.
+     * Without it, an inlined call runs both the callee body and the real
+     * invoke, so don't inline.
+     */
+    gDvmJit.disableOpt |= (1 << kMethodInlining);
+
 #if defined(WITH_SELF_VERIFICATION)
     /* Force into blocking mode */
     gDvmJit.blockingMode = true;
@@ -166,6 +174,10 @@ JitTraceDescription *dvmCopyTraceDescriptor(const u2 *pc,
     return NULL;
 }
 
+JitTraceCounter_t dvmCompilerGetTraceProfileCount(const JitEntry *entry) {
+    return 0;
+}
+
 void dvmCompilerCodegenDump(CompilationUnit *cUnit) //in ArchUtility.c
 {
 }
@@ -356,6 +368,22 @@ static bool inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
 
 #if defined(WITH_JIT_TUNING)
         gDvmJit.icPatchLockFree++;
+#endif
+    /*
+     * The site keeps switching between more callees than the cell can hold.
+     * Park it on the fake class so that it dispatches through the vtable
+     * instead of stopping the world for every new callee.
+     */
+    } else if (dvmCompilerICSiteIsMegamorphic(cellAddr, newContent->method)) {
+        UNPROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
+
+        cellAddr->clazz = (ClassObject *) PREDICTED_CHAIN_FAKE_CLAZZ;
+
+        UPDATE_CODE_CACHE_PATCHES();
+        PROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
+
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.icPatchMegamorphic++;
 #endif
     /*
      * Cannot patch the chaining cell inline - queue it until the next safe
@@ -184,7 +184,8 @@ typedef enum ArrayAccess {
     to list bytecodes for IGET, IPUT
 */
 typedef enum InstanceAccess {
-    IGET, IGET_WIDE, IPUT, IPUT_WIDE
+    IGET, IGET_WIDE, IGET_CHAR, IGET_SHORT, IGET_BOOLEAN, IGET_BYTE,
+    IPUT, IPUT_WIDE, IPUT_CHAR, IPUT_SHORT, IPUT_BOOLEAN, IPUT_BYTE
 } InstanceAccess;
 /*! An enum type
     to list bytecodes for SGET, SPUT
@@ -442,15 +442,11 @@ void markCard_filled(int tgtAddrReg, bool isTgtPhysical, int scratchReg, bool is
 
 //! It has null check and calls assembly function inst_field_resolve
 int iget_iput_common_nohelper(int tmp, int flag, u2 vA, u2 vB, int isObj, bool isVolatile) {
-#ifdef WITH_JIT_INLINING
+    /* Inlined accessors refer to the callee's field indices */
     const Method *method = (traceCurrentMIR->OptimizationFlags & MIR_CALLEE) ?
         traceCurrentMIR->meta.calleeMethod : currentMethod;
     InstField *pInstField = (InstField *)
             method->clazz->pDvmDex->pResFields[tmp];
-#else
-    InstField *pInstField = (InstField *)
-            currentMethod->clazz->pDvmDex->pResFields[tmp];
-#endif
     int fieldOffset;
 
     assert(pInstField != NULL);
@@ -479,6 +475,18 @@ int iget_iput_common_nohelper(int tmp, int flag, u2 vA, u2 vB, int isObj, bool i
             popAllRegs();
         }
 #endif
+    } else if(flag == IGET_CHAR) {
+        movez_mem_disp_scale_to_reg(OpndSize_16, 7, false, 0, 8, false, 1, 9, false);
+        set_virtual_reg(vA, OpndSize_32, 9, false);
+    } else if(flag == IGET_SHORT) {
+        moves_mem_disp_scale_to_reg(OpndSize_16, 7, false, 0, 8, false, 1, 9, false);
+        set_virtual_reg(vA, OpndSize_32, 9, false);
+    } else if(flag == IGET_BOOLEAN) {
+        movez_mem_disp_scale_to_reg(OpndSize_8, 7, false, 0, 8, false, 1, 9, false);
+        set_virtual_reg(vA, OpndSize_32, 9, false);
+    } else if(flag == IGET_BYTE) {
+        moves_mem_disp_scale_to_reg(OpndSize_8, 7, false, 0, 8, false, 1, 9, false);
+        set_virtual_reg(vA, OpndSize_32, 9, false);
     } else if(flag == IGET_WIDE) {
         if(isVolatile) {
             /* call dvmQuasiAtomicRead64(addr) */
@@ -503,6 +511,12 @@ int iget_iput_common_nohelper(int tmp, int flag, u2 vA, u2 vB, int isObj, bool i
         if(isObj) {
             markCard(9, 7, false, 11, false);
         }
+    } else if(flag == IPUT_CHAR || flag == IPUT_SHORT) {
+        get_virtual_reg(vA, OpndSize_32, 9, false);
+        move_reg_to_mem_disp_scale(OpndSize_16, 9, false, 7, false, 0, 8, false, 1);
+    } else if(flag == IPUT_BOOLEAN || flag == IPUT_BYTE) {
+        get_virtual_reg(vA, OpndSize_32, 9, false);
+        move_reg_to_mem_disp_scale(OpndSize_8, 9, false, 7, false, 0, 8, false, 1);
     } else if(flag == IPUT_WIDE) {
         get_virtual_reg(vA, OpndSize_64, 1, false);
         if(isVolatile) {
@@ -569,25 +583,45 @@ int op_iget_object() {
 
 //!
 int op_iget_boolean() {
-    return op_iget();
+    u2 vA = INST_A(inst);
+    u2 vB = INST_B(inst);
+    u2 tmp = FETCH(1);
+    int retval = iget_iput_common(tmp, IGET_BOOLEAN, vA, vB, 0, false);
+    rPC += 2;
+    return retval;
 }
 //! lower bytecode IGET_BYTE by calling iget_iput_common
 
 //!
 int op_iget_byte() {
-    return op_iget();
+    u2 vA = INST_A(inst);
+    u2 vB = INST_B(inst);
+    u2 tmp = FETCH(1);
+    int retval = iget_iput_common(tmp, IGET_BYTE, vA, vB, 0, false);
+    rPC += 2;
+    return retval;
 }
 //! lower bytecode IGET_CHAR by calling iget_iput_common
 
 //!
 int op_iget_char() {
-    return op_iget();
+    u2 vA = INST_A(inst);
+    u2 vB = INST_B(inst);
+    u2 tmp = FETCH(1);
+    int retval = iget_iput_common(tmp, IGET_CHAR, vA, vB, 0, false);
+    rPC += 2;
+    return retval;
 }
 //! lower bytecode IGET_SHORT by calling iget_iput_common
 
 //!
 int op_iget_short() {
-    return op_iget();
+    u2 vA = INST_A(inst);
+    u2 vB = INST_B(inst);
+    u2 tmp = FETCH(1);
+    int retval = iget_iput_common(tmp, IGET_SHORT, vA, vB, 0, false);
+    rPC += 2;
+    return retval;
 }
 //! lower bytecode IPUT by calling iget_iput_common
 
@@ -626,25 +660,45 @@ int op_iput_object() {
 
 //!
 int op_iput_boolean() {
-    return op_iput();
+    u2 vA = INST_A(inst);
+    u2 vB = INST_B(inst);
+    u2 tmp = FETCH(1);
+    int retval = iget_iput_common(tmp, IPUT_BOOLEAN, vA, vB, 0, false);
+    rPC += 2;
+    return retval;
 }
 //! lower bytecode IPUT_BYTE by calling iget_iput_common
 
 //!
 int op_iput_byte() {
-    return op_iput();
+    u2 vA = INST_A(inst);
+    u2 vB = INST_B(inst);
+    u2 tmp = FETCH(1);
+    int retval = iget_iput_common(tmp, IPUT_BYTE, vA, vB, 0, false);
+    rPC += 2;
+    return retval;
 }
 //! lower bytecode IPUT_CHAR by calling iget_iput_common
 
 //!
 int op_iput_char() {
-    return op_iput();
+    u2 vA = INST_A(inst);
+    u2 vB = INST_B(inst);
+    u2 tmp = FETCH(1);
+    int retval = iget_iput_common(tmp, IPUT_CHAR, vA, vB, 0, false);
+    rPC += 2;
+    return retval;
 }
 //! lower bytecode IPUT_SHORT by calling iget_iput_common
 
 //!
 int op_iput_short() {
-    return op_iput();
+    u2 vA = INST_A(inst);
+    u2 vB = INST_B(inst);
+    u2 tmp = FETCH(1);
+    int retval = iget_iput_common(tmp, IPUT_SHORT, vA, vB, 0, false);
+    rPC += 2;
+    return retval;
 }
 
 #define P_GPR_1 PhysicalReg_EBX
@@ -660,14 +714,9 @@ int sget_sput_common(int flag, u2 vA, u2 tmp, bool isObj, bool isVolatile) {
     //glue: get_res_fields
     //hard-coded: eax (one version?)
     //////////////////////////////////////////
-#ifdef WITH_JIT_INLINING
     const Method *method = (traceCurrentMIR->OptimizationFlags & MIR_CALLEE) ? traceCurrentMIR->meta.calleeMethod : currentMethod;
     void *fieldPtr = (void*)
         (method->clazz->pDvmDex->pResFields[tmp]);
-#else
-    void *fieldPtr = (void*)
-        (currentMethod->clazz->pDvmDex->pResFields[tmp]);
-#endif
     assert(fieldPtr != NULL);
     move_imm_to_reg(OpndSize_32, (int)fieldPtr, PhysicalReg_EAX, true);
     if(flag == SGET) {
@@ -87,15 +87,20 @@ s4 dvmNcgHandleSparseSwitch(const s4* keys, u2 size, s4 testVal)
 s4 dvmJitHandleSparseSwitch(const s4* keys, u2 size, s4 testVal)
 {
     const s4* entries = keys + size;
-    int i;
-    for (i = 0; i < size; i++) {
-        s4 k = s4FromSwitchData(&keys[i]);
-        if (k == testVal) {
+    /* the keys are sorted low-to-high */
+    int lo = 0;
+    int hi = size - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        s4 k = s4FromSwitchData(&keys[mid]);
+        if (testVal < k) {
+            hi = mid - 1;
+        } else if (testVal > k) {
+            lo = mid + 1;
+        } else {
             LOGVV("Value %d found in entry %d (goto 0x%02x)",
-                testVal, i, s4FromSwitchData(&entries[i]));
-            return 2*s4FromSwitchData(&entries[i]); //convert from u2 to byte
-        } else if (k > testVal) {
-            break;
+                testVal, mid, s4FromSwitchData(&entries[mid]));
+            return 2*s4FromSwitchData(&entries[mid]); //convert from u2 to byte
         }
     }
 
@@ -20,6 +20,12 @@
  * we generate some of the data (strings and classes) while we dump the
  * heap, and some analysis tools require that the class and string data
  * appear first.
+ *
+ * The heap data, which is nearly all of the output, is spooled to an
+ * unlinked temp file through a small stdio buffer, so dumping a big heap
+ * doesn't take as much memory again.  Only the string and class records
+ * are kept in memory.  If the output file name ends in ".gz", the file is
+ * written gzip-compressed.
  */
 
 #include "Hprof.h"
@@ -30,11 +36,123 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <zlib.h>
 
 #define kHeadSuffix "-hptemp"
 
+/* stdio buffer for the spooled heap data, and copy buffer size */
+#define kSpoolBufferSize    (64 * 1024)
+
+/*
+ * Open an unlinked temp file for the heap data.  When we're writing to a
+ * named file we put it next to that, since that's known to have room;
+ * otherwise we fall back to tmpfile().
+ *
+ * Returns NULL if no file could be created.
+ */
+static FILE* openSpoolFile(const char* fileName, int fd, bool directToDdms)
+{
+    FILE* fp = NULL;
+
+    if (fd < 0 && !directToDdms) {
+        std::string spoolName(StringPrintf("%s" kHeadSuffix, fileName));
+        int spoolFd = open(spoolName.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0600);
+        if (spoolFd >= 0) {
+            unlink(spoolName.c_str());
+            fp = fdopen(spoolFd, "w+");
+            if (fp == NULL)
+                close(spoolFd);
+        }
+    }
+    if (fp == NULL)
+        fp = tmpfile();
+    if (fp == NULL) {
+        ALOGW("hprof: can't create spool file, buffering in memory: %s",
+            strerror(errno));
+        return NULL;
+    }
+
+    setvbuf(fp, NULL, _IOFBF, kSpoolBufferSize);
+    return fp;
+}
+
+/*
+ * Whether the dump should be gzip-compressed, based on the file name.
+ */
+static bool wantCompressed(const hprof_context_t* ctx)
+{
+    if (ctx->directToDdms)
+        return false;
+    size_t len = strlen(ctx->fileName);
+    return len > 3 && strcmp(ctx->fileName + len - 3, ".gz") == 0;
+}
+
+/*
+ * Write "len" bytes to "outFd", or through "gz" if that's non-NULL.
+ *
+ * Returns 0 on success.
+ */
+static int writeOutput(int outFd, gzFile gz, const void* data, size_t len,
+    const char* logMsg)
+{
+    if (gz == NULL)
+        return sysWriteFully(outFd, data, len, logMsg);
+
+    const u1* ptr = (const u1*) data;
+    while (len > 0) {
+        unsigned int chunk = (len > kSpoolBufferSize) ?
+            kSpoolBufferSize : len;
+        if (gzwrite(gz, ptr, chunk) != (int) chunk) {
+            ALOGE("%s: gzwrite failed", logMsg);
+            return -1;
+        }
+        ptr += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/*
+ * Copy the spooled contents of "ctx" to the output.
+ *
+ * Returns 0 on success.
+ */
+static int copySpoolFile(hprof_context_t* ctx, int outFd, gzFile gz)
+{
+    int spoolFd = fileno(ctx->spoolFp);
+    u1* buf = (u1*) malloc(kSpoolBufferSize);
+    int result = 0;
+
+    if (buf == NULL)
+        return -1;
+    if (lseek(spoolFd, 0, SEEK_SET) != 0) {
+        ALOGE("hprof: spool file seek failed: %s", strerror(errno));
+        free(buf);
+        return -1;
+    }
+    while (true) {
+        ssize_t actual = TEMP_FAILURE_RETRY(read(spoolFd, buf,
+            kSpoolBufferSize));
+        if (actual < 0) {
+            ALOGE("hprof: spool file read failed: %s", strerror(errno));
+            result = -1;
+            break;
+        }
+        if (actual == 0)
+            break;
+        if (writeOutput(outFd, gz, buf, actual, "hprof-tail") != 0) {
+            result = -1;
+            break;
+        }
+    }
+    free(buf);
+    return result;
+}
+
 hprof_context_t* hprofStartup(const char *outputFileName, int fd,
                               bool directToDdms)
 {
@@ -48,7 +166,8 @@ hprof_context_t* hprofStartup(const char *outputFileName, int fd,
     }
 
     /* pass in name or descriptor of the output file */
-    hprofContextInit(ctx, strdup(outputFileName), fd, false, directToDdms);
+    hprofContextInit(ctx, strdup(outputFileName), fd, false, directToDdms,
+        openSpoolFile(outputFileName, fd, directToDdms));
 
     assert(ctx->memFp != NULL);
 
@@ -74,7 +193,7 @@ bool hprofShutdown(hprof_context_t *tailCtx)
         return false;
     }
     hprofContextInit(headCtx, strdup(tailCtx->fileName), tailCtx->fd, true,
-        tailCtx->directToDdms);
+        tailCtx->directToDdms, NULL);
 
     ALOGI("hprof: dumping heap strings to \"%s\".", tailCtx->fileName);
     hprofDumpStrings(headCtx);
@@ -95,16 +214,52 @@ bool hprofShutdown(hprof_context_t *tailCtx)
 
     /* flush to ensure memstream pointer and size are updated */
     fflush(headCtx->memFp);
-    fflush(tailCtx->memFp);
+    if (fflush(tailCtx->memFp) != 0 || ferror(tailCtx->memFp)) {
+        ALOGE("hprof: failed writing heap data: %s", strerror(errno));
+        hprofFreeContext(headCtx);
+        hprofFreeContext(tailCtx);
+        return false;
+    }
+
+    size_t tailSize = tailCtx->fileDataSize;
+    if (tailCtx->spoolFp != NULL) {
+        off_t spoolLen = ftello(tailCtx->spoolFp);
+        if (spoolLen < 0) {
+            ALOGE("hprof: can't size spool file: %s", strerror(errno));
+            hprofFreeContext(headCtx);
+            hprofFreeContext(tailCtx);
+            return false;
+        }
+        tailSize = spoolLen;
+    }
 
     if (tailCtx->directToDdms) {
-        /* send the data off to DDMS */
+        /*
+         * Send the data off to DDMS.  A spooled tail is mapped rather
+         * than read back, so it's paged in from the file as it's sent.
+         */
+        void* tailData = tailCtx->fileDataPtr;
+        if (tailCtx->spoolFp != NULL && tailSize != 0) {
+            tailData = mmap(NULL, tailSize, PROT_READ, MAP_PRIVATE,
+                fileno(tailCtx->spoolFp), 0);
+            if (tailData == MAP_FAILED) {
+                ALOGE("hprof: can't map %zd bytes of heap data: %s",
+                    tailSize, strerror(errno));
+                hprofFreeContext(headCtx);
+                hprofFreeContext(tailCtx);
+                return false;
+            }
+        }
+
         struct iovec iov[2];
         iov[0].iov_base = headCtx->fileDataPtr;
         iov[0].iov_len = headCtx->fileDataSize;
-        iov[1].iov_base = tailCtx->fileDataPtr;
-        iov[1].iov_len = tailCtx->fileDataSize;
+        iov[1].iov_base = tailData;
+        iov[1].iov_len = tailSize;
         dvmDbgDdmSendChunkV(CHUNK_TYPE("HPDS"), iov, 2);
+
+        if (tailData != tailCtx->fileDataPtr)
+            munmap(tailData, tailSize);
     } else {
         /*
          * Open the output file, and copy the head and tail to it.
@@ -131,12 +286,36 @@ bool hprofShutdown(hprof_context_t *tailCtx)
             return false;
         }
 
+        gzFile gz = NULL;
+        if (wantCompressed(tailCtx)) {
+            /* gzclose() closes outFd */
+            gz = gzdopen(outFd, "wb");
+            if (gz == NULL) {
+                ALOGE("hprof: gzdopen failed");
+                close(outFd);
+                hprofFreeContext(headCtx);
+                hprofFreeContext(tailCtx);
+                return false;
+            }
+        }
+
         int result;
-        result = sysWriteFully(outFd, headCtx->fileDataPtr,
+        result = writeOutput(outFd, gz, headCtx->fileDataPtr,
             headCtx->fileDataSize, "hprof-head");
-        result |= sysWriteFully(outFd, tailCtx->fileDataPtr,
-            tailCtx->fileDataSize, "hprof-tail");
-        close(outFd);
+        if (result == 0) {
+            if (tailCtx->spoolFp != NULL) {
+                result = copySpoolFile(tailCtx, outFd, gz);
+            } else {
+                result = writeOutput(outFd, gz, tailCtx->fileDataPtr,
+                    tailCtx->fileDataSize, "hprof-tail");
+            }
+        }
+        if (gz != NULL) {
+            if (gzclose(gz) != Z_OK)
+                result = -1;
+        } else {
+            close(outFd);
+        }
         if (result != 0) {
             hprofFreeContext(headCtx);
             hprofFreeContext(tailCtx);
@@ -146,7 +325,7 @@ bool hprofShutdown(hprof_context_t *tailCtx)
 
     /* throw out a log message for the benefit of "runhat" */
     ALOGI("hprof: heap dump completed (%dKB)",
-        (headCtx->fileDataSize + tailCtx->fileDataSize + 1023) / 1024);
+        (headCtx->fileDataSize + tailSize + 1023) / 1024);
 
     hprofFreeContext(headCtx);
     hprofFreeContext(tailCtx);
@@ -222,6 +401,73 @@ static void hprofBitmapCallback(Object *obj, void *arg)
     hprofDumpHeapObject(ctx, obj);
 }
 
+/*
+ * Walk the roots and heap, and write the dump.  The caller must hold the
+ * heap lock with all threads suspended.
+ *
+ * Returns 0 on success.
+ */
+static int dumpSuspendedHeap(const char* fileName, int fd, bool directToDdms)
+{
+    hprof_context_t *ctx = hprofStartup(fileName, fd, directToDdms);
+    if (ctx == NULL) {
+        return -1;
+    }
+    // first record
+    hprofStartNewRecord(ctx, HPROF_TAG_HEAP_DUMP_SEGMENT, HPROF_TIME);
+    dvmVisitRoots(hprofRootVisitor, ctx);
+    dvmHeapBitmapWalk(dvmHeapSourceGetLiveBits(), hprofBitmapCallback, ctx);
+    hprofFinishHeapDump(ctx);
+//TODO: write a HEAP_SUMMARY record
+    return hprofShutdown(ctx) ? 0 : -1;
+}
+
+/*
+ * Write the dump from a copy-on-write snapshot of the process, so the
+ * VM can resume as soon as the fork is done.  The caller must hold the
+ * heap lock with all threads suspended.
+ *
+ * We fork twice so the dumping process is reparented to init and never
+ * has to be reaped by the VM.  The grandchild has only this thread, and
+ * nothing in the heap can move under it.  It only uses the VM's data
+ * structures read-only, and leaves with _exit() so no VM shutdown code
+ * runs.
+ *
+ * Returns 0 if the dumping process was started; the dump itself may
+ * still fail, which is only logged.
+ */
+static int forkDumpHeap(const char* fileName, int fd)
+{
+    pid_t pid = fork();
+    if (pid < 0) {
+        ALOGE("hprof: fork failed: %s", strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        pid_t grandchild = fork();
+        if (grandchild < 0) {
+            ALOGE("hprof: second fork failed: %s", strerror(errno));
+            _exit(1);
+        }
+        if (grandchild > 0)
+            _exit(0);
+
+        int result = dumpSuspendedHeap(fileName, fd, false);
+        _exit(result == 0 ? 0 : 1);
+    }
+
+    int status;
+    if (TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)) != pid ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        ALOGE("hprof: dump process failed to start");
+        return -1;
+    }
+    ALOGI("hprof: writing heap dump to \"%s\" from a child process",
+        fileName);
+    return 0;
+}
+
 /*
  * Walk the roots and heap writing heap information to the specified
  * file.
@@ -232,27 +478,26 @@ static void hprofBitmapCallback(Object *obj, void *arg)
  * If "directToDdms" is set, the other arguments are ignored, and data is
  * sent directly to DDMS.
  *
+ * With -Xforkheapdump, file dumps are written by a forked child and this
+ * returns as soon as it's running, before the file is complete.  DDMS
+ * dumps are always written in-process, since the child has no JDWP
+ * connection.
+ *
  * Returns 0 on success, or an error code on failure.
  */
 int hprofDumpHeap(const char* fileName, int fd, bool directToDdms)
 {
-    hprof_context_t *ctx;
     int success;
 
     assert(fileName != NULL);
     dvmLockHeap();
     dvmSuspendAllThreads(SUSPEND_FOR_HPROF);
-    ctx = hprofStartup(fileName, fd, directToDdms);
-    if (ctx == NULL) {
-        return -1;
-    }
-    // first record
-    hprofStartNewRecord(ctx, HPROF_TAG_HEAP_DUMP_SEGMENT, HPROF_TIME);
-    dvmVisitRoots(hprofRootVisitor, ctx);
-    dvmHeapBitmapWalk(dvmHeapSourceGetLiveBits(), hprofBitmapCallback, ctx);
-    hprofFinishHeapDump(ctx);
-//TODO: write a HEAP_SUMMARY record
-    success = hprofShutdown(ctx) ? 0 : -1;
+    /* Don't report unused allocation buffer slots as objects. */
+    dvmHeapSourceRetireAllTlabs();
+    if (gDvm.forkHeapDump && !directToDdms)
+        success = forkDumpHeap(fileName, fd);
+    else
+        success = dumpSuspendedHeap(fileName, fd, directToDdms);
     dvmResumeAllThreads(SUSPEND_FOR_HPROF);
     dvmUnlockHeap();
     return success;
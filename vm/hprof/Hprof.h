@@ -138,8 +138,14 @@ struct hprof_context_t {
     char *fileName;
     char *fileDataPtr;          // for open_memstream
     size_t fileDataSize;        // for open_memstream
-    FILE *memFp;
+    FILE *memFp;                // memstream, or spoolFp if set
     int fd;
+
+    /*
+     * If set, output goes to this unlinked temp file rather than to a
+     * memstream, so a big dump doesn't have to fit in memory.
+     */
+    FILE *spoolFp;
 };
 
 
@@ -186,7 +192,7 @@ int hprofDumpHeapObject(hprof_context_t *ctx, const Object *obj);
  */
 
 void hprofContextInit(hprof_context_t *ctx, char *fileName, int fd,
-                      bool writeHeader, bool directToDdms);
+                      bool writeHeader, bool directToDdms, FILE *spoolFp);
 
 int hprofFlushRecord(hprof_record_t *rec, FILE *fp);
 int hprofFlushCurrentRecord(hprof_context_t *ctx);
@@ -59,25 +59,30 @@
 /*
  * Initialize an hprof context struct.
  *
- * This will take ownership of "fileName".
+ * This will take ownership of "fileName", and of "spoolFp" if it isn't
+ * NULL, in which case output goes there instead of to a memstream.
  *
  * NOTE: ctx is expected to have been zeroed out prior to calling this
  * function.
  */
 void hprofContextInit(hprof_context_t *ctx, char *fileName, int fd,
-                      bool writeHeader, bool directToDdms)
+                      bool writeHeader, bool directToDdms, FILE *spoolFp)
 {
     /*
      * Have to do this here, because it must happen after we
      * memset the struct (want to treat fileDataPtr/fileDataSize
      * as read-only while the file is open).
      */
-    FILE* fp = open_memstream(&ctx->fileDataPtr, &ctx->fileDataSize);
+    FILE* fp = spoolFp;
     if (fp == NULL) {
-        /* not expected */
-        ALOGE("hprof: open_memstream failed: %s", strerror(errno));
-        dvmAbort();
+        fp = open_memstream(&ctx->fileDataPtr, &ctx->fileDataSize);
+        if (fp == NULL) {
+            /* not expected */
+            ALOGE("hprof: open_memstream failed: %s", strerror(errno));
+            dvmAbort();
+        }
     }
+    ctx->spoolFp = spoolFp;
 
     ctx->directToDdms = directToDdms;
     ctx->fileName = fileName;
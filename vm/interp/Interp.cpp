@@ -523,6 +523,12 @@ bool dvmAddSingleStep(Thread* thread, int size, int depth)
     pCtrl->depth = static_cast<JdwpStepDepth>(depth);
     pCtrl->thread = thread;
 
+    /*
+     * Only the stepping thread has to check each instruction.  It drops
+     * the subMode itself once the step is over; see updateDebugger().
+     */
+    dvmEnableSubMode(thread, kSubModeDebuggerActive);
+
     /*
      * We may be stepping into or over method calls, or running until we
      * return from the current method.  To make this work we need to track
@@ -742,6 +748,25 @@ static void updateDebugger(const Method* method, const u2* pc, const u4* fp,
      */
     dvmExportPC(pc, fp);
 
+    /*
+     * A thread that was being stepped keeps the subMode until it gets
+     * here.  If nothing else needs it, go back to full speed.  The
+     * thread list lock keeps dvmDbgWatchInterpEvents() from slipping in
+     * between the test and the update.
+     */
+    if (!gDvm.debuggerWatching &&
+        !(gDvm.stepControl.active && gDvm.stepControl.thread == self))
+    {
+        dvmLockThreadList(self);
+        if (!gDvm.debuggerWatching) {
+            dvmDisableSubMode(self, kSubModeDebuggerActive);
+        }
+        dvmUnlockThreadList();
+        if (!gDvm.debuggerWatching) {
+            return;
+        }
+    }
+
     if (self->debugIsMethodEntry) {
         eventFlags |= DBG_METHOD_ENTRY;
         self->debugIsMethodEntry = false;
@@ -1239,6 +1264,16 @@ Method* dvmInterpFindInterfaceMethod(ClassObject* thisClass, u4 methodIdx,
     /* make sure absMethod->methodIndex means what we think it means */
     assert(dvmIsAbstractMethod(absMethod));
 
+    /*
+     * Classes with lots of interfaces hash their interface methods, which
+     * saves scanning the iftable.
+     */
+    if (thisClass->imtable != NULL) {
+        const ImtEntry* pEntry = &thisClass->imtable[dvmImtSlot(absMethod)];
+        if (pEntry->imethod == absMethod)
+            return pEntry->target;
+    }
+
     /*
      * Run through the "this" object's iftable.  Find the entry for
      * absMethod's class, then use absMethod->methodIndex to find
@@ -1666,7 +1701,7 @@ void dvmInitializeInterpBreak(Thread* thread)
     if (gDvm.emulatorTraceEnableCount > 0) {
         dvmEnableSubMode(thread, kSubModeEmulatorTrace);
     }
-    if (gDvm.debuggerActive) {
+    if (gDvm.debuggerWatching) {
         dvmEnableSubMode(thread, kSubModeDebuggerActive);
     }
 #if 0
@@ -79,7 +79,7 @@ Method* dvmInterpFindInterfaceMethod(ClassObject* thisClass, u4 methodIdx,
  */
 static inline bool dvmDebuggerOrProfilerActive()
 {
-    return gDvm.debuggerActive || gDvm.activeProfilers != 0;
+    return gDvm.debuggerWatching || gDvm.activeProfilers != 0;
 }
 
 #if defined(WITH_JIT)
@@ -238,6 +238,8 @@ static void selfVerificationSpinLoop(ShadowSpace *shadowSpace)
 {
     const u2 *startPC = shadowSpace->startPC;
     JitTraceDescription* desc = dvmCopyTraceDescriptor(startPC, NULL);
+
+    gDvmJit.selfVerificationFailures++;
     if (desc) {
         dvmCompilerWorkEnqueue(startPC, kWorkOrderTraceDebug, desc);
         /*
@@ -509,17 +511,19 @@ void dvmJitStats()
              gDvmJit.noChainExit[kSwitchOverflow]);
 
         ALOGD("JIT: ICPatch: %d init, %d rejected, %d lock-free, %d queued, "
-             "%d dropped",
+             "%d dropped, %d megamorphic",
              gDvmJit.icPatchInit, gDvmJit.icPatchRejected,
              gDvmJit.icPatchLockFree, gDvmJit.icPatchQueued,
-             gDvmJit.icPatchDropped);
+             gDvmJit.icPatchDropped, gDvmJit.icPatchMegamorphic);
 
         ALOGD("JIT: Invoke: %d mono, %d poly, %d native, %d return",
              gDvmJit.invokeMonomorphic, gDvmJit.invokePolymorphic,
              gDvmJit.invokeNative, gDvmJit.returnOp);
-        ALOGD("JIT: Inline: %d mgetter, %d msetter, %d pgetter, %d psetter",
+        ALOGD("JIT: Inline: %d mgetter, %d msetter, %d pgetter, %d psetter, "
+             "%d devirtualized",
              gDvmJit.invokeMonoGetterInlined, gDvmJit.invokeMonoSetterInlined,
-             gDvmJit.invokePolyGetterInlined, gDvmJit.invokePolySetterInlined);
+             gDvmJit.invokePolyGetterInlined, gDvmJit.invokePolySetterInlined,
+             gDvmJit.invokeDevirtualized);
         ALOGD("JIT: Total compilation time: %llu ms", gDvmJit.jitTime / 1000);
         ALOGD("JIT: Avg unit compilation time: %llu us",
              gDvmJit.numCompilations == 0 ? 0 :
@@ -538,6 +542,9 @@ void dvmJitStats()
         if (gDvmJit.profileMode == kTraceProfilingContinuous) {
             dvmCompilerSortAndPrintTraceProfiles();
         }
+        DebugOutputTarget target;
+        dvmCreateLogOutputTarget(&target, ANDROID_LOG_DEBUG, LOG_TAG);
+        dvmDumpJitTraceSamples(&target);
     }
 }
 
@@ -554,6 +561,26 @@ void dvmJitEndTraceSelect(Thread* self, const u2* dPC)
     }
 }
 
+/*
+ * Claim the free JitTable slot at idx for dPC.  Returns false if another
+ * thread claimed it first.  Free slots are claimed with a CAS, since trace
+ * heads may be added to their own primary slot without the table lock.
+ */
+static bool claimJitEntry(u4 idx, const u2* dPC)
+{
+    JitEntry *entry = &gDvmJit.pJitEntryTable[idx];
+
+    if (android_atomic_release_cas(0, (int32_t)dPC,
+            (volatile int32_t *)(void *)&entry->dPC) != 0) {
+        return false;
+    }
+    /* for simulator mode, we need to initialized codeAddress to null */
+    entry->codeAddress = NULL;
+    android_atomic_inc((volatile int32_t *)(void *)
+                       &gDvmJit.jitTableEntriesUsed);
+    return true;
+}
+
 /*
  * Find an entry in the JitTable, creating if necessary.
  * Returns null if table is full.
@@ -578,13 +605,25 @@ static JitEntry *lookupAndAdd(const u2* dPC, bool callerLocked,
     if (gDvmJit.pJitEntryTable[idx].dPC != dPC ||
         gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry != isMethodEntry) {
         /*
-         * No match.  Aquire jitTableLock and find the last
+         * No match.  A free slot here is the primary slot for dPC, which
+         * heads no chain yet, so a trace head can simply claim it.  Method
+         * entries also have to set isMethodEntry and always take the lock.
+         */
+        if (!callerLocked && !isMethodEntry &&
+            gDvmJit.pJitEntryTable[idx].dPC == NULL &&
+            claimJitEntry(idx, dPC)) {
+            return &gDvmJit.pJitEntryTable[idx];
+        }
+
+        /*
+         * Aquire jitTableLock and find the last
          * slot in the chain. Possibly continue the chain walk in case
          * some other thread allocated the slot we were looking
          * at previuosly (perhaps even the dPC we're trying to enter).
          */
         if (!callerLocked)
             dvmLockMutex(&gDvmJit.tableLock);
+retry:
         /*
          * At this point, if .dPC is NULL, then the slot we're
          * looking at is the target slot from the primary hash
@@ -636,17 +675,17 @@ static JitEntry *lookupAndAdd(const u2* dPC, bool callerLocked,
             }
         }
         if (gDvmJit.pJitEntryTable[idx].dPC == NULL) {
-            gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry = isMethodEntry;
             /*
-             * Initialize codeAddress and allocate the slot.  Must
-             * happen in this order (since dPC is set, the entry is live.
+             * A lock-free insert may take the slot between the check and
+             * the claim.  The slot is then part of our chain, so pick the
+             * walk up again from there.
              */
-            android_atomic_release_store((int32_t)dPC,
-                 (volatile int32_t *)(void *)&gDvmJit.pJitEntryTable[idx].dPC);
-            /* for simulator mode, we need to initialized codeAddress to null */
-            gDvmJit.pJitEntryTable[idx].codeAddress = NULL;
-            gDvmJit.pJitEntryTable[idx].dPC = dPC;
-            gDvmJit.jitTableEntriesUsed++;
+            if (!claimJitEntry(idx, dPC)) {
+                goto retry;
+            }
+            if (isMethodEntry) {
+                gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry = true;
+            }
         } else {
             /* Table is full */
             idx = chainEndMarker;
@@ -657,6 +696,23 @@ static JitEntry *lookupAndAdd(const u2* dPC, bool callerLocked,
     return (idx == chainEndMarker) ? NULL : &gDvmJit.pJitEntryTable[idx];
 }
 
+/*
+ * Find or create the JitTable entry of a trace head, for a trace that is
+ * queued for compilation without going through trace selection.  Returns
+ * NULL if the table is full.
+ */
+JitEntry *dvmJitAddTraceEntry(const u2* dPC)
+{
+    /*
+     * The compiler thread runs during safe points, so unlike the interpreter
+     * threads it has to hold the lock to stay clear of dvmJitResetTable.
+     */
+    dvmLockMutex(&gDvmJit.tableLock);
+    JitEntry *entry = lookupAndAdd(dPC, true /* caller locked */, false);
+    dvmUnlockMutex(&gDvmJit.tableLock);
+    return entry;
+}
+
 /* Dump a trace description */
 void dvmJitDumpTraceDesc(JitTraceDescription *trace)
 {
@@ -760,6 +816,36 @@ static void insertMoveResult(const u2 *lastPC, int len, int offset,
     self->currRunLen = dexGetWidthFromInstruction(moveResultPC);
 }
 
+/*
+ * Decide whether the trace keeps going through the conditional branch just
+ * added to it, so that it becomes a superblock: one entry, a side exit to
+ * a chaining cell at each branch, and a single compilation unit along the
+ * path the thread actually took.  Only forward branches qualify, so loops
+ * are still found where they start.  Returns false if the trace ends here.
+ */
+static bool extendSuperblock(Thread *self, const DecodedInstruction *decInsn,
+                             int flags)
+{
+    if (flags != (kInstrCanBranch | kInstrCanContinue) ||
+        self->traceBranches >= gDvmJit.superblockBranches ||
+        self->currTraceRun >= MAX_JIT_RUN_LEN - 2) {
+        return false;
+    }
+
+    /* if-<cmp> vA, vB, +CCCC or if-<cmp>z vAA, +BBBB */
+    s4 branchOffset = (dexGetFormatFromOpcode(decInsn->opcode) == kFmt22t) ?
+        (s4) decInsn->vC : (s4) decInsn->vB;
+    if (branchOffset <= 0) {
+        return false;
+    }
+
+    self->traceBranches++;
+    /* Start a new run even if the branch falls through, to end the block */
+    self->currRunHead = NULL;
+    self->currRunLen = 0;
+    return true;
+}
+
 /*
  * Adds to the current trace request one instruction at a time, just
  * before that instruction is interpreted.  This is the primary trace
@@ -862,7 +948,8 @@ void dvmCheckJit(const u2* pc, Thread* self)
                   ((flags & (kInstrCanBranch |
                              kInstrCanSwitch |
                              kInstrCanReturn |
-                             kInstrInvoke)) != 0)) {
+                             kInstrInvoke)) != 0) &&
+                  !extendSuperblock(self, &decInsn, flags)) {
                     self->jitState = kJitTSelectEnd;
 #if defined(SHOW_TRACE)
                 ALOGD("TraceGen: ending on %s, basic block end",
@@ -1145,6 +1232,77 @@ void dvmJitSetCodeAddr(const u2* dPC, void *nPC, JitInstructionSetType set,
     jitEntry->codeAddress = nPC;
 }
 
+/*
+ * Move the thread onto its own trace head counters the first time it makes
+ * a trace request, so that counting doesn't bounce the shared table between
+ * cores.  The private table starts as a copy of the shared one, so warm
+ * start heads and earlier counts carry over.  After that, periodically halve
+ * what each counter has counted so far, so heads that were only hot once
+ * (e.g. during application startup) fade instead of beating the code that
+ * is hot now to the threshold.
+ */
+static void updateProfTable(Thread* self)
+{
+    unsigned char *sharedTable = gDvmJit.pProfTableCopy;
+    unsigned char *table = self->jitProfTable;
+    u4 now = dvmGetRelativeTimeMsec();
+
+    if (table == NULL) {
+        /* Profiling was turned off.  Don't bring it back for this thread */
+        if (sharedTable == NULL || self->pJitProfTable != sharedTable) {
+            return;
+        }
+        table = (unsigned char *) malloc(JIT_PROF_SIZE);
+        if (table == NULL) {
+            return;
+        }
+        memcpy(table, sharedTable, JIT_PROF_SIZE);
+        self->jitProfTable = table;
+        self->jitProfDecayTime = now;
+        /*
+         * The compiler thread may null out pJitProfTable at any time.  Only
+         * switch tables if it hasn't; dvmJitUpdateThreadStateSingle picks
+         * up the private table when profiling comes back on.
+         */
+        android_atomic_release_cas((int32_t) sharedTable, (int32_t) table,
+                (volatile int32_t *)(void *) &self->pJitProfTable);
+        return;
+    }
+
+    if (gDvmJit.profDecayMsec == 0 ||
+        now - self->jitProfDecayTime < gDvmJit.profDecayMsec) {
+        return;
+    }
+    self->jitProfDecayTime = now;
+    /* Counters count down from the threshold */
+    int threshold = gDvmJit.threshold;
+    for (int i = 0; i < JIT_PROF_SIZE; i++) {
+        if (table[i] < threshold) {
+            table[i] += (threshold - table[i]) / 2;
+        }
+    }
+}
+
+/*
+ * Raise the threshold the interpreter resets trace head counters to as the
+ * compiler falls behind, so that only the hotter heads join the queue.  Very
+ * low thresholds are stress test settings and are left alone.
+ */
+static void updateThreshold(Thread* self)
+{
+    int threshold = gDvmJit.threshold;
+
+    if (threshold > 6) {
+        threshold += threshold * gDvmJit.compilerQueueLength /
+                     gDvmJit.compilerHighWater;
+        /* Counters are a byte wide */
+        if (threshold > 255) {
+            threshold = 255;
+        }
+    }
+    self->jitThreshold = threshold;
+}
+
 /*
  * Determine if valid trace-bulding request is active.  If so, set
  * the proper flags in interpBreak and return.  Trace selection will
@@ -1213,9 +1371,16 @@ void dvmJitCheckTraceRequest(Thread* self)
     /* Check if the JIT request can be handled now */
     if ((gDvmJit.pJitEntryTable != NULL) &&
         ((self->interpBreak.ctl.breakFlags & kInterpSingleStep) == 0)){
-        /* Bypass the filter for hot trace requests or during stress mode */
+        updateProfTable(self);
+        updateThreshold(self);
+
+        /*
+         * Bypass the filter for hot trace requests, for heads that were hot
+         * in the last run, or during stress mode
+         */
         if (self->jitState == kJitTSelectRequest &&
-            gDvmJit.threshold > 6) {
+            gDvmJit.threshold > 6 &&
+            !dvmCompilerIsWarmTraceHead(self->interpSave.pc)) {
             /* Two-level filtering scheme */
             for (i=0; i< JIT_TRACE_THRESH_FILTER_SIZE; i++) {
                 if (filterKey == self->threshFilter[i]) {
@@ -1275,6 +1440,7 @@ void dvmJitCheckTraceRequest(Thread* self)
                 self->currTraceHead = self->interpSave.pc;
                 self->currTraceRun = 0;
                 self->totalTraceLen = 0;
+                self->traceBranches = 0;
                 self->currRunHead = self->interpSave.pc;
                 self->currRunLen = 0;
                 self->trace[0].info.frag.startOffset =
@@ -1496,10 +1662,46 @@ void dvmJitTraceProfilingOff()
  */
 void dvmJitUpdateThreadStateSingle(Thread* thread)
 {
-    thread->pJitProfTable = gDvmJit.pProfTable;
+    /* Threads that have their own counters keep using them */
+    if (gDvmJit.pProfTable != NULL && thread->jitProfTable != NULL) {
+        thread->pJitProfTable = thread->jitProfTable;
+    } else {
+        thread->pJitProfTable = gDvmJit.pProfTable;
+    }
     thread->jitThreshold = gDvmJit.threshold;
 }
 
+/*
+ * Set the trace head counter for dPC to 1 in the shared profile table and
+ * in every thread's private one.  The next time any thread branches to dPC
+ * it looks for a translation instead of counting down from the threshold
+ * again, which gets a loop that is already running into its translation
+ * on the following iteration.  Writes to other threads' counters race with
+ * their own updates, which at worst costs one more count down.
+ */
+void dvmJitPrimeProfCounter(const u2* dPC)
+{
+    /* Same hash as common_updateProfile in the mterp footers */
+    u4 key = (u4) dPC;
+    u4 idx = (key ^ (key >> 12)) & (JIT_PROF_SIZE - 1);
+    Thread* self = dvmThreadSelf();
+    Thread* thread;
+
+    if (gDvmJit.pProfTableCopy == NULL) {
+        return;
+    }
+    gDvmJit.pProfTableCopy[idx] = 1;
+
+    /* Holding the list lock keeps the private tables from being freed */
+    dvmLockThreadList(self);
+    for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        if (thread->jitProfTable != NULL) {
+            thread->jitProfTable[idx] = 1;
+        }
+    }
+    dvmUnlockThreadList();
+}
+
 /*
  * Walk through the thread list and refresh all local copies of
  * JIT global state (which was placed there for fast access).
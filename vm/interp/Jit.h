@@ -162,18 +162,21 @@ void dvmJitStats(void);
 bool dvmJitResizeJitTable(unsigned int size);
 void dvmJitResetTable(void);
 JitEntry *dvmJitFindEntry(const u2* pc, bool isMethodEntry);
+JitEntry *dvmJitAddTraceEntry(const u2* dPC);
 s8 dvmJitd2l(double d);
 s8 dvmJitf2l(float f);
 void dvmJitSetCodeAddr(const u2* dPC, void *nPC, JitInstructionSetType set,
                        bool isMethodEntry, int profilePrefixSize);
 void dvmJitEndTraceSelect(Thread* self, const u2* dPC);
 JitTraceCounter_t *dvmJitNextTraceCounter(void);
+JitTraceCounter_t dvmCompilerGetTraceProfileCount(const JitEntry *entry);
 void dvmJitTraceProfilingOff(void);
 void dvmJitTraceProfilingOn(void);
 void dvmJitChangeProfileMode(TraceProfilingModes newState);
 void dvmJitDumpTraceDesc(JitTraceDescription *trace);
 void dvmJitUpdateThreadStateSingle(Thread* threead);
 void dvmJitUpdateThreadStateAll(void);
+void dvmJitPrimeProfCounter(const u2* dPC);
 void dvmJitResumeTranslation(Thread* self, const u2* pc, const u4* fp);
 }
 
@@ -380,7 +380,8 @@ static ClassObject* callPrep(Thread* self, const Method* method, Object* obj,
         free(desc);
     }
 
-    if (checkAccess) {
+    /* public methods are always accessible; skip the caller walk */
+    if (checkAccess && !dvmIsPublicMethod(method)) {
         /* needed for java.lang.reflect.Method.invoke */
         if (!dvmCheckMethodAccess(dvmGetCaller2Class(self->interpSave.curFrame),
                 method))
@@ -775,6 +776,133 @@ bail:
     return retObj;
 }
 
+/*
+ * A method's line number positions, in the order the debug info lists
+ * them, which is ascending by address.  Built the first time a line
+ * number in the method is asked for, and kept in gDvm.lineNumTables.
+ */
+struct LineNumTable {
+    const Method* method;
+    u4          count;
+    struct {
+        u4      address;
+        u4      lineNum;
+    } entries[1];
+};
+
+struct LineNumTableBuilder {
+    LineNumTable* table;
+    u4          capacity;
+    bool        failed;
+};
+
+/* initial room in a table being built; it doubles as needed */
+#define kInitialLineNumEntries  16
+
+static int addLineNumCb(void *cnxt, u4 address, u4 lineNum)
+{
+    LineNumTableBuilder* pBuilder = (LineNumTableBuilder*) cnxt;
+    LineNumTable* table = pBuilder->table;
+
+    if (table->count == pBuilder->capacity) {
+        u4 newCapacity = pBuilder->capacity * 2;
+        LineNumTable* newTable = (LineNumTable*) realloc(table,
+            offsetof(LineNumTable, entries) +
+            newCapacity * sizeof(table->entries[0]));
+        if (newTable == NULL) {
+            pBuilder->failed = true;
+            return 1;
+        }
+        table = pBuilder->table = newTable;
+        pBuilder->capacity = newCapacity;
+    }
+
+    table->entries[table->count].address = address;
+    table->entries[table->count].lineNum = lineNum;
+    table->count++;
+    return 0;
+}
+
+/*
+ * Decode the positions of "method" into a new table.  Returns NULL on
+ * failure.
+ */
+static LineNumTable* buildLineNumTable(const Method* method,
+    const DexCode* pDexCode)
+{
+    LineNumTableBuilder builder;
+    builder.capacity = kInitialLineNumEntries;
+    builder.failed = false;
+    builder.table = (LineNumTable*) malloc(offsetof(LineNumTable, entries) +
+        builder.capacity * sizeof(builder.table->entries[0]));
+    if (builder.table == NULL)
+        return NULL;
+    builder.table->method = method;
+    builder.table->count = 0;
+
+    dexDecodeDebugInfo(method->clazz->pDvmDex->pDexFile, pDexCode,
+            method->clazz->descriptor,
+            method->prototype.protoIdx,
+            method->accessFlags,
+            addLineNumCb, NULL, &builder);
+
+    if (builder.failed) {
+        free(builder.table);
+        return NULL;
+    }
+    return builder.table;
+}
+
+/*
+ * Find the line for "relPc" in a table.
+ *
+ * This gives the same answer as walking the positions in order: the line
+ * of the first position at "relPc" if there is one, otherwise that of
+ * the last position before it, or -1 if there is none.
+ */
+static int lookupLineNum(const LineNumTable* table, u4 relPc)
+{
+    /* find the first entry at or after relPc */
+    u4 lo = 0, hi = table->count;
+    while (lo < hi) {
+        u4 mid = lo + (hi - lo) / 2;
+        if (table->entries[mid].address < relPc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < table->count && table->entries[lo].address == relPc)
+        return table->entries[lo].lineNum;
+    if (lo == 0)
+        return -1;
+    return table->entries[lo - 1].lineNum;
+}
+
+static int compareLineNumTables(const void* ventry, const void* vmethod)
+{
+    const LineNumTable* table = (const LineNumTable*) ventry;
+    return (table->method == (const Method*) vmethod) ? 0 : 1;
+}
+
+/*
+ * Create the table of line number tables.
+ */
+bool dvmLineNumStartup()
+{
+    gDvm.lineNumTables = dvmHashTableCreate(256, free);
+    return gDvm.lineNumTables != NULL;
+}
+
+/*
+ * Free the line number tables.
+ */
+void dvmLineNumShutdown()
+{
+    dvmHashTableFree(gDvm.lineNumTables);
+    gDvm.lineNumTables = NULL;
+}
+
 struct LineNumFromPcContext {
     u4 address;
     u4 lineNum;
@@ -803,6 +931,11 @@ static int lineNumForPcCb(void *cnxt, u4 address, u4 lineNum)
  * Determine the source file line number based on the program counter.
  * "pc" is an offset, in 16-bit units, from the start of the method's code.
  *
+ * The debug info is a state machine that has to be run from the start,
+ * and stack traces ask for the same methods over and over, so the
+ * positions of each method are decoded once into a table that can be
+ * binary searched.
+ *
  * Returns -1 if no match was found (possibly because the source files were
  * compiled without "-g", so no line number information is present).
  * Returns -2 for native methods (as expected in exception traces).
@@ -817,6 +950,32 @@ int dvmLineNumFromPC(const Method* method, u4 relPc)
         return -1;      /* can happen for abstract method stub */
     }
 
+    HashTable* pTables = gDvm.lineNumTables;
+    if (pTables != NULL) {
+        u4 hash = (u4) method >> 3;
+
+        dvmHashTableLock(pTables);
+        LineNumTable* table = (LineNumTable*) dvmHashTableLookup(pTables,
+            hash, (void*) method, compareLineNumTables, false);
+        dvmHashTableUnlock(pTables);
+
+        if (table == NULL) {
+            /* decode without the lock; if we lose a race, use theirs */
+            LineNumTable* newTable = buildLineNumTable(method, pDexCode);
+            if (newTable != NULL) {
+                dvmHashTableLock(pTables);
+                table = (LineNumTable*) dvmHashTableLookup(pTables, hash,
+                    newTable, compareLineNumTables, true);
+                dvmHashTableUnlock(pTables);
+                if (table != newTable)
+                    free(newTable);
+            }
+        }
+
+        if (table != NULL)
+            return lookupLineNum(table, relPc);
+    }
+
     LineNumFromPcContext context;
     memset(&context, 0, sizeof(context));
     context.address = relPc;
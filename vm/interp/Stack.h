@@ -226,6 +226,13 @@ Object* dvmInvokeMethod(Object* invokeObj, const Method* meth,
  */
 extern "C" int dvmLineNumFromPC(const Method* method, u4 relPc);
 
+/*
+ * Set up and tear down the cache of per-method line number tables used by
+ * dvmLineNumFromPC().
+ */
+bool dvmLineNumStartup(void);
+void dvmLineNumShutdown(void);
+
 /*
  * Given a frame pointer, compute the current call depth.  The value can be
  * "exact" (a count of non-break frames) or "vague" (just subtracting
@@ -33,7 +33,12 @@ struct ExpandBuf {
     int     maxLen;
 };
 
-#define kInitialStorage 64
+/*
+ * Most replies are small, but the ones a debugger asks for while it
+ * attaches (class lists, thread lists, frames) are not; start big enough
+ * that those grow only a few times.
+ */
+#define kInitialStorage 1024
 
 /*
  * Allocate a JdwpBuf and some initial storage.
@@ -102,6 +107,14 @@ static void ensureSpace(ExpandBuf* pBuf, int newCount)
     pBuf->storage = newPtr;
 }
 
+/*
+ * Make sure there's room for "count" more bytes without moving the data.
+ */
+void expandBufReserve(ExpandBuf* pBuf, int count)
+{
+    ensureSpace(pBuf, count);
+}
+
 /*
  * Allocate some space in the buffer.
  */
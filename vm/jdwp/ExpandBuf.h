@@ -53,4 +53,10 @@ void expandBufAdd4BE(ExpandBuf* pBuf, u4 val);
 void expandBufAdd8BE(ExpandBuf* pBuf, u8 val);
 void expandBufAddUtf8String(ExpandBuf* pBuf, const u1* str);
 
+/*
+ * Grow the buffer ahead of time when the caller knows roughly how much
+ * it's about to add.
+ */
+void expandBufReserve(ExpandBuf* pBuf, int count);
+
 #endif  // DALVIK_JDWP_EXPANDBUF_H_
@@ -176,6 +176,28 @@ static void dumpEvent(const JdwpEvent* pEvent)
     }
 }
 
+/*
+ * Returns true if only the interpreter can tell when an event of this kind
+ * happens.  Single steps are not included, since they are watched on the
+ * stepping thread alone.
+ */
+static bool needsInterpWatch(JdwpEventKind eventKind)
+{
+    switch (eventKind) {
+    case EK_BREAKPOINT:
+    case EK_FRAME_POP:
+    case EK_EXCEPTION:
+    case EK_FIELD_ACCESS:
+    case EK_FIELD_MODIFICATION:
+    case EK_EXCEPTION_CATCH:
+    case EK_METHOD_ENTRY:
+    case EK_METHOD_EXIT:
+        return true;
+    default:
+        return false;
+    }
+}
+
 /*
  * Add an event to the list.  Ordering is not important.
  *
@@ -211,6 +233,8 @@ JdwpError dvmJdwpRegisterEvent(JdwpState* state, JdwpEvent* pEvent)
             dumpEvent(pEvent);  /* TODO - need for field watches */
         }
     }
+    if (needsInterpWatch(pEvent->eventKind))
+        dvmDbgWatchInterpEvents();
 
     /*
      * Add to list.
@@ -266,6 +290,8 @@ static void unregisterEvent(JdwpState* state, JdwpEvent* pEvent)
             dvmDbgUnconfigureStep(pMod->step.threadId);
         }
     }
+    if (needsInterpWatch(pEvent->eventKind))
+        dvmDbgUnwatchInterpEvents();
 
     state->numEvents--;
     assert(state->numEvents != 0 || state->eventList == NULL);
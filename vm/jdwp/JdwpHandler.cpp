@@ -484,6 +484,11 @@ static JdwpError handleVM_AllClassesWithGeneric(JdwpState* state,
 
     dvmDbgGetClassList(&numClasses, &classRefBuf);
 
+    /*
+     * Apps have thousands of classes; size the reply for a typical
+     * descriptor up front rather than doubling our way there.
+     */
+    expandBufReserve(pReply, 4 + numClasses * (1 + sizeof(RefTypeId) + 48));
     expandBufAdd4BE(pReply, numClasses);
 
     for (u4 i = 0; i < numClasses; i++) {
@@ -1125,21 +1130,32 @@ static JdwpError handleTR_Frames(JdwpState* state,
     assert((int) startFrame >= 0 && (int) startFrame < frameCount);
     assert((int) (startFrame + length) <= frameCount);
 
-    u4 frames = length;
-    expandBufAdd4BE(pReply, frames);
-    for (u4 i = startFrame; i < (startFrame+length); i++) {
-        FrameId frameId;
-        JdwpLocation loc;
-
-        dvmDbgGetThreadFrame(threadId, i, &frameId, &loc);
+    /*
+     * Pull all of the frames out in one walk of the stack; asking for them
+     * one at a time is quadratic in the stack depth.
+     */
+    FrameId* frameIds = (FrameId*) malloc(length * sizeof(FrameId));
+    JdwpLocation* locs = (JdwpLocation*) malloc(length * sizeof(JdwpLocation));
+    if (frameIds == NULL || locs == NULL) {
+        free(frameIds);
+        free(locs);
+        return ERR_OUT_OF_MEMORY;
+    }
 
-        expandBufAdd8BE(pReply, frameId);
-        dvmJdwpAddLocation(pReply, &loc);
+    u4 frames = dvmDbgGetThreadFrames(threadId, startFrame, length,
+        frameIds, locs);
+    expandBufAdd4BE(pReply, frames);
+    for (u4 i = 0; i < frames; i++) {
+        expandBufAdd8BE(pReply, frameIds[i]);
+        dvmJdwpAddLocation(pReply, &locs[i]);
 
         LOGVV("    Frame %d: id=%llx loc={type=%d cls=%llx mth=%x loc=%llx}",
-            i, frameId, loc.typeTag, loc.classId, loc.methodId, loc.idx);
+            startFrame + i, frameIds[i], locs[i].typeTag, locs[i].classId,
+            locs[i].methodId, locs[i].idx);
     }
 
+    free(frameIds);
+    free(locs);
     return ERR_NONE;
 }
 
@@ -1927,6 +1943,9 @@ void dvmJdwpProcessRequest(JdwpState* state, const JdwpReqHeader* pHeader,
             break;
         }
     }
+
+    /* apply any change in the events only the interpreter can see */
+    dvmDbgUpdateInterpWatch();
     if (i == NELEM(gHandlerMap)) {
         ALOGE("REQ: UNSUPPORTED (cmd=%d/%d dataLen=%d id=0x%06x)",
             pHeader->cmdSet, pHeader->cmd, dataLen, pHeader->id);
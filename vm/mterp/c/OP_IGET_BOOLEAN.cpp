@@ -1,2 +1,2 @@
-HANDLE_IGET_X(OP_IGET_BOOLEAN,          "", Int, )
+HANDLE_IGET_X(OP_IGET_BOOLEAN,          "", Boolean, )
 OP_END
@@ -1,2 +1,2 @@
-HANDLE_IGET_X(OP_IGET_BYTE,             "", Int, )
+HANDLE_IGET_X(OP_IGET_BYTE,             "", Byte, )
 OP_END
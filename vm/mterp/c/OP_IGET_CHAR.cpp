@@ -1,2 +1,2 @@
-HANDLE_IGET_X(OP_IGET_CHAR,             "", Int, )
+HANDLE_IGET_X(OP_IGET_CHAR,             "", Char, )
 OP_END
@@ -1,2 +1,2 @@
-HANDLE_IGET_X(OP_IGET_SHORT,            "", Int, )
+HANDLE_IGET_X(OP_IGET_SHORT,            "", Short, )
 OP_END
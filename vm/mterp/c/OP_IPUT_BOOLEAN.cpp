@@ -1,2 +1,2 @@
-HANDLE_IPUT_X(OP_IPUT_BOOLEAN,          "", Int, )
+HANDLE_IPUT_X(OP_IPUT_BOOLEAN,          "", Boolean, )
 OP_END
@@ -1,2 +1,2 @@
-HANDLE_IPUT_X(OP_IPUT_BYTE,             "", Int, )
+HANDLE_IPUT_X(OP_IPUT_BYTE,             "", Byte, )
 OP_END
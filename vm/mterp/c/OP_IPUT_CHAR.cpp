@@ -1,2 +1,2 @@
-HANDLE_IPUT_X(OP_IPUT_CHAR,             "", Int, )
+HANDLE_IPUT_X(OP_IPUT_CHAR,             "", Char, )
 OP_END
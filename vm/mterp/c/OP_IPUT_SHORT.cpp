@@ -1,2 +1,2 @@
-HANDLE_IPUT_X(OP_IPUT_SHORT,            "", Int, )
+HANDLE_IPUT_X(OP_IPUT_SHORT,            "", Short, )
 OP_END
@@ -38,4 +38,28 @@ INLINE Method* dvmFindInterfaceMethodInCache(ClassObject* thisClass,
 #undef ATOMIC_CACHE_CALC
 }
 
+/*
+ * Look up the target of the invoke-interface at "pc" for the interpreters.
+ *
+ * Each call site caches its own receiver classes in pInterfaceSiteCache,
+ * keyed on the class and the site, so a monomorphic site needs one entry
+ * and a polymorphic site one per class seen.  Sites in large apps thus no
+ * longer evict each other from the small per-DEX cache, which is only
+ * consulted when the site misses.  "method" is the caller.
+ */
+INLINE Method* dvmFindInterfaceMethodAtSite(ClassObject* thisClass,
+    u4 methodIdx, const Method* method, const u2* pc)
+{
+    DvmDex* methodClassDex = method->clazz->pDvmDex;
+    AtomicCache* siteCache = methodClassDex->pInterfaceSiteCache;
+
+#define ATOMIC_CACHE_CALC \
+    dvmFindInterfaceMethodInCache(thisClass, methodIdx, method, methodClassDex)
+
+    return (Method*) ATOMIC_CACHE_LOOKUP(siteCache, siteCache->numEntries,
+                thisClass, pc);
+
+#undef ATOMIC_CACHE_CALC
+}
+
 }
@@ -194,16 +194,34 @@ MTERP_OFFSET(offThread_icRechainCount,    Thread, icRechainCount, 152)
 MTERP_OFFSET(offThread_pProfileCountdown, Thread, pProfileCountdown, 156)
 MTERP_OFFSET(offThread_callsiteClass,     Thread, callsiteClass, 160)
 MTERP_OFFSET(offThread_methodToCall,      Thread, methodToCall, 164)
+MTERP_OFFSET(offThread_metrics,           Thread, metrics, 168)
+MTERP_OFFSET(offThread_tlabs,             Thread, tlabs, 172)
 MTERP_OFFSET(offThread_jniLocal_topCookie, \
-                                Thread, jniLocalRefTable.segmentState.all, 168)
+                                Thread, jniLocalRefTable.segmentState.all, 316)
 #if defined(WITH_SELF_VERIFICATION)
-MTERP_OFFSET(offThread_shadowSpace,       Thread, shadowSpace, 188)
+MTERP_OFFSET(offThread_shadowSpace,       Thread, shadowSpace, 344)
 #endif
 #else
+MTERP_OFFSET(offThread_metrics,           Thread, metrics, 100)
+MTERP_OFFSET(offThread_tlabs,             Thread, tlabs, 104)
 MTERP_OFFSET(offThread_jniLocal_topCookie, \
-                                Thread, jniLocalRefTable.segmentState.all, 100)
+                                Thread, jniLocalRefTable.segmentState.all, 248)
 #endif
 
+/* Tlab fields */
+MTERP_OFFSET(offTlab_top,               Tlab, top, 0)
+MTERP_OFFSET(offTlab_end,               Tlab, end, 4)
+MTERP_OFFSET(offTlab_stride,            Tlab, stride, 8)
+MTERP_SIZEOF(sizeofTlab,                Tlab, 12)
+MTERP_CONSTANT(TLAB_MAX_OBJECT_SIZE,    96)
+MTERP_CONSTANT(TLAB_SIZE_CLASS_SHIFT,   3)
+
+/* VmMetricsBlock fields */
+MTERP_OFFSET(offVmMetricsBlock_allocObjects, \
+                            VmMetricsBlock, counts[kThreadMetricAllocObjects], 0)
+MTERP_OFFSET(offVmMetricsBlock_allocBytes, \
+                            VmMetricsBlock, counts[kThreadMetricAllocBytes], 8)
+
 /* Object fields */
 MTERP_OFFSET(offObject_clazz,           Object, clazz, 0)
 MTERP_OFFSET(offObject_lock,            Object, lock, 4)
@@ -245,6 +263,7 @@ MTERP_OFFSET(offClassObject_descriptor, ClassObject, descriptor, 24)
 MTERP_OFFSET(offClassObject_accessFlags, ClassObject, accessFlags, 32)
 MTERP_OFFSET(offClassObject_pDvmDex,    ClassObject, pDvmDex, 40)
 MTERP_OFFSET(offClassObject_status,     ClassObject, status, 44)
+MTERP_OFFSET(offClassObject_objectSize, ClassObject, objectSize, 56)
 MTERP_OFFSET(offClassObject_super,      ClassObject, super, 72)
 MTERP_OFFSET(offClassObject_vtableCount, ClassObject, vtableCount, 112)
 MTERP_OFFSET(offClassObject_vtable,     ClassObject, vtable, 116)
@@ -293,6 +312,7 @@ MTERP_CONSTANT(CLASS_ISFINALIZABLE, 1<<31)
 
 /* flags for dvmMalloc */
 MTERP_CONSTANT(ALLOC_DONT_TRACK,    0x01)
+MTERP_CONSTANT(ALLOC_UNINITIALIZED, 0x08)
 
 /* for GC */
 MTERP_CONSTANT(GC_CARD_SHIFT, 7)
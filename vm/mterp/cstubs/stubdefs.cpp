@@ -134,3 +134,6 @@
             dvmCheckSuspendPending(self);                                   \
         }                                                                   \
     }
+
+/* the assembly interpreter picks its own handler table */
+#define UPDATE_HANDLER_TABLE()
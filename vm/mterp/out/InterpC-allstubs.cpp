@@ -513,6 +513,9 @@ static inline bool checkForNullExportPC(Object* obj, u4* fp, const u2* pc)
         }                                                                   \
     }
 
+/* the assembly interpreter picks its own handler table */
+#define UPDATE_HANDLER_TABLE()
+
 /* File: c/opcommon.cpp */
 /* forward declarations of goto targets */
 GOTO_TARGET_DECL(filledNewArray, bool methodCallRange);
@@ -2092,19 +2095,19 @@ HANDLE_IGET_X(OP_IGET_OBJECT,           "-object", Object, _AS_OBJECT)
 OP_END
 
 /* File: c/OP_IGET_BOOLEAN.cpp */
-HANDLE_IGET_X(OP_IGET_BOOLEAN,          "", Int, )
+HANDLE_IGET_X(OP_IGET_BOOLEAN,          "", Boolean, )
 OP_END
 
 /* File: c/OP_IGET_BYTE.cpp */
-HANDLE_IGET_X(OP_IGET_BYTE,             "", Int, )
+HANDLE_IGET_X(OP_IGET_BYTE,             "", Byte, )
 OP_END
 
 /* File: c/OP_IGET_CHAR.cpp */
-HANDLE_IGET_X(OP_IGET_CHAR,             "", Int, )
+HANDLE_IGET_X(OP_IGET_CHAR,             "", Char, )
 OP_END
 
 /* File: c/OP_IGET_SHORT.cpp */
-HANDLE_IGET_X(OP_IGET_SHORT,            "", Int, )
+HANDLE_IGET_X(OP_IGET_SHORT,            "", Short, )
 OP_END
 
 /* File: c/OP_IPUT.cpp */
@@ -2131,19 +2134,19 @@ HANDLE_IPUT_X(OP_IPUT_OBJECT,           "-object", Object, _AS_OBJECT)
 OP_END
 
 /* File: c/OP_IPUT_BOOLEAN.cpp */
-HANDLE_IPUT_X(OP_IPUT_BOOLEAN,          "", Int, )
+HANDLE_IPUT_X(OP_IPUT_BOOLEAN,          "", Boolean, )
 OP_END
 
 /* File: c/OP_IPUT_BYTE.cpp */
-HANDLE_IPUT_X(OP_IPUT_BYTE,             "", Int, )
+HANDLE_IPUT_X(OP_IPUT_BYTE,             "", Byte, )
 OP_END
 
 /* File: c/OP_IPUT_CHAR.cpp */
-HANDLE_IPUT_X(OP_IPUT_CHAR,             "", Int, )
+HANDLE_IPUT_X(OP_IPUT_CHAR,             "", Char, )
 OP_END
 
 /* File: c/OP_IPUT_SHORT.cpp */
-HANDLE_IPUT_X(OP_IPUT_SHORT,            "", Int, )
+HANDLE_IPUT_X(OP_IPUT_SHORT,            "", Short, )
 OP_END
 
 /* File: c/OP_SGET.cpp */
@@ -3157,7 +3160,9 @@ GOTO_TARGET(filledNewArray, bool methodCallRange, bool)
             GOTO_exceptionThrown();
         }
 
-        newArray = dvmAllocArrayByClass(arrayClass, vsrc1, ALLOC_DONT_TRACK);
+        /* Every element is stored below, before the next safe point. */
+        newArray = dvmAllocArrayByClass(arrayClass, vsrc1,
+                                        ALLOC_DONT_TRACK | ALLOC_UNINITIALIZED);
         if (newArray == NULL)
             GOTO_exceptionThrown();
 
@@ -3399,8 +3404,8 @@ GOTO_TARGET(invokeInterface, bool methodCallRange)
          * Given a class and a method index, find the Method* with the
          * actual code we want to execute.
          */
-        methodToCall = dvmFindInterfaceMethodInCache(thisClass, ref, curMethod,
-                        methodClassDex);
+        methodToCall = dvmFindInterfaceMethodAtSite(thisClass, ref, curMethod,
+                        pc);
 #if defined(WITH_JIT) && defined(MTERP_STUB)
         self->callsiteClass = thisClass;
         self->methodToCall = methodToCall;
@@ -3818,6 +3823,7 @@ GOTO_TARGET(exceptionThrown)
             dvmSetException(self, exception);
 
         dvmReleaseTrackedAlloc(exception, self);
+        UPDATE_HANDLER_TABLE();
         FINISH(0);
     }
 GOTO_TARGET_END
@@ -3858,13 +3864,20 @@ GOTO_TARGET(invokeMethod, bool methodCallRange, const Method* _methodToCall,
          * Copy args.  This may corrupt vsrc1/vdst.
          */
         if (methodCallRange) {
-            // could use memcpy or a "Duff's device"; most functions have
-            // so few args it won't matter much
             assert(vsrc1 <= curMethod->outsSize);
             assert(vsrc1 == methodToCall->insSize);
             outs = OUTS_FROM_FP(fp, vsrc1);
-            for (i = 0; i < vsrc1; i++)
-                outs[i] = GET_REGISTER(vdst+i);
+            if (vsrc1 <= 4) {
+                for (i = 0; i < vsrc1; i++)
+                    outs[i] = GET_REGISTER(vdst+i);
+            } else {
+                /*
+                 * The outs sit below our save area, so they can't overlap
+                 * the registers being passed.
+                 */
+                assert(vdst + vsrc1 <= curMethod->registersSize);
+                memcpy(outs, &fp[vdst], vsrc1 * sizeof(u4));
+            }
         } else {
             u4 count = vsrc1 >> 4;
 
@@ -3993,6 +4006,7 @@ GOTO_TARGET(invokeMethod, bool methodCallRange, const Method* _methodToCall,
             ILOGD("> pc <-- %s.%s %s", curMethod->clazz->descriptor,
                 curMethod->name, curMethod->shorty);
             DUMP_REGS(curMethod, fp, true);         // show input args
+            UPDATE_HANDLER_TABLE();
             FINISH(0);                              // jump to method start
         } else {
             /* set this up for JNI locals, even if not a JNI native */
@@ -4035,6 +4049,8 @@ GOTO_TARGET(invokeMethod, bool methodCallRange, const Method* _methodToCall,
                 GOTO_exceptionThrown();
             }
 
+            UPDATE_HANDLER_TABLE();
+
             ILOGD("> retval=0x%llx (leaving native)", retval.j);
             ILOGD("> (return from native %s.%s to %s.%s %s)",
                 methodToCall->clazz->descriptor, methodToCall->name,
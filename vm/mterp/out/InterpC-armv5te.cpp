@@ -513,6 +513,9 @@ static inline bool checkForNullExportPC(Object* obj, u4* fp, const u2* pc)
         }                                                                   \
     }
 
+/* the assembly interpreter picks its own handler table */
+#define UPDATE_HANDLER_TABLE()
+
 /* File: c/opcommon.cpp */
 /* forward declarations of goto targets */
 GOTO_TARGET_DECL(filledNewArray, bool methodCallRange);
@@ -407,6 +407,12 @@ static inline bool checkForNullExportPC(Object* obj, u4* fp, const u2* pc)
  * case/break, for a threaded implementation it's a goto label and an
  * instruction fetch/computed goto.
  *
+ * Dispatch goes through "curHandlerTable", which is either the main table
+ * or, while any subMode is active, a table that sends every opcode
+ * through dvmCheckBefore() first.  Like the mterp alt tables, it is only
+ * switched at backward branches, invokes, returns and throws, so straight
+ * line code pays nothing for the check.
+ *
  * Assumes the existence of "const u2* pc" and (for threaded operation)
  * "u2 inst".
  */
@@ -415,10 +421,7 @@ static inline bool checkForNullExportPC(Object* obj, u4* fp, const u2* pc)
 # define FINISH(_offset) {                                                  \
         ADJUST_PC(_offset);                                                 \
         inst = FETCH(0);                                                    \
-        if (self->interpBreak.ctl.subMode) {                                \
-            dvmCheckBefore(pc, fp, self);                                   \
-        }                                                                   \
-        goto *handlerTable[INST_INST(inst)];                                \
+        goto *curHandlerTable[INST_INST(inst)];                             \
     }
 # define FINISH_BKPT(_opcode) {                                             \
         goto *handlerTable[_opcode];                                        \
@@ -457,6 +460,15 @@ static inline bool checkForNullExportPC(Object* obj, u4* fp, const u2* pc)
             EXPORT_PC();  /* need for precise GC */                         \
             dvmCheckSuspendPending(self);                                   \
         }                                                                   \
+        UPDATE_HANDLER_TABLE();                                             \
+    }
+
+/*
+ * Pick the dispatch table that matches the thread's current subMode.
+ */
+#define UPDATE_HANDLER_TABLE() {                                            \
+        curHandlerTable = (self->interpBreak.ctl.subMode != 0) ?            \
+            altHandlerTable : handlerTable;                                 \
     }
 
 /* File: c/opcommon.cpp */
@@ -1134,8 +1146,14 @@ void dvmInterpretPortable(Thread* self)
     const Method* methodToCall;
     bool methodCallRange;
 
-    /* static computed goto table */
+    /* static computed goto tables */
     DEFINE_GOTO_TABLE(handlerTable);
+#undef H
+#define H(_op)  &&checkBefore
+    DEFINE_GOTO_TABLE(altHandlerTable);
+#undef H
+#define H(_op)  &&op_##_op
+    const void** curHandlerTable;
 
     /* copy state in */
     curMethod = self->interpSave.method;
@@ -1161,6 +1179,8 @@ void dvmInterpretPortable(Thread* self)
      */
     methodToCall = (const Method*) -1;
 
+    UPDATE_HANDLER_TABLE();
+
 #if 0
     if (self->debugIsMethodEntry) {
         ILOGD("|-- Now interpreting %s.%s", curMethod->clazz->descriptor,
@@ -1171,6 +1191,16 @@ void dvmInterpretPortable(Thread* self)
 
     FINISH(0);                  /* fetch and execute first instruction */
 
+    /*
+     * Every entry of altHandlerTable lands here, with "inst" already
+     * fetched.  dvmCheckBefore() may change the subMode (e.g. at the end
+     * of a counted step), so pick the table again before dispatching.
+     */
+checkBefore:
+    dvmCheckBefore(pc, fp, self);
+    UPDATE_HANDLER_TABLE();
+    goto *handlerTable[INST_INST(inst)];
+
 /*--- start of opcodes ---*/
 
 /* File: c/OP_NOP.cpp */
@@ -2103,19 +2133,19 @@ HANDLE_IGET_X(OP_IGET_OBJECT,           "-object", Object, _AS_OBJECT)
 OP_END
 
 /* File: c/OP_IGET_BOOLEAN.cpp */
-HANDLE_IGET_X(OP_IGET_BOOLEAN,          "", Int, )
+HANDLE_IGET_X(OP_IGET_BOOLEAN,          "", Boolean, )
 OP_END
 
 /* File: c/OP_IGET_BYTE.cpp */
-HANDLE_IGET_X(OP_IGET_BYTE,             "", Int, )
+HANDLE_IGET_X(OP_IGET_BYTE,             "", Byte, )
 OP_END
 
 /* File: c/OP_IGET_CHAR.cpp */
-HANDLE_IGET_X(OP_IGET_CHAR,             "", Int, )
+HANDLE_IGET_X(OP_IGET_CHAR,             "", Char, )
 OP_END
 
 /* File: c/OP_IGET_SHORT.cpp */
-HANDLE_IGET_X(OP_IGET_SHORT,            "", Int, )
+HANDLE_IGET_X(OP_IGET_SHORT,            "", Short, )
 OP_END
 
 /* File: c/OP_IPUT.cpp */
@@ -2142,19 +2172,19 @@ HANDLE_IPUT_X(OP_IPUT_OBJECT,           "-object", Object, _AS_OBJECT)
 OP_END
 
 /* File: c/OP_IPUT_BOOLEAN.cpp */
-HANDLE_IPUT_X(OP_IPUT_BOOLEAN,          "", Int, )
+HANDLE_IPUT_X(OP_IPUT_BOOLEAN,          "", Boolean, )
 OP_END
 
 /* File: c/OP_IPUT_BYTE.cpp */
-HANDLE_IPUT_X(OP_IPUT_BYTE,             "", Int, )
+HANDLE_IPUT_X(OP_IPUT_BYTE,             "", Byte, )
 OP_END
 
 /* File: c/OP_IPUT_CHAR.cpp */
-HANDLE_IPUT_X(OP_IPUT_CHAR,             "", Int, )
+HANDLE_IPUT_X(OP_IPUT_CHAR,             "", Char, )
 OP_END
 
 /* File: c/OP_IPUT_SHORT.cpp */
-HANDLE_IPUT_X(OP_IPUT_SHORT,            "", Int, )
+HANDLE_IPUT_X(OP_IPUT_SHORT,            "", Short, )
 OP_END
 
 /* File: c/OP_SGET.cpp */
@@ -3105,7 +3135,9 @@ GOTO_TARGET(filledNewArray, bool methodCallRange, bool)
             GOTO_exceptionThrown();
         }
 
-        newArray = dvmAllocArrayByClass(arrayClass, vsrc1, ALLOC_DONT_TRACK);
+        /* Every element is stored below, before the next safe point. */
+        newArray = dvmAllocArrayByClass(arrayClass, vsrc1,
+                                        ALLOC_DONT_TRACK | ALLOC_UNINITIALIZED);
         if (newArray == NULL)
             GOTO_exceptionThrown();
 
@@ -3347,8 +3379,8 @@ GOTO_TARGET(invokeInterface, bool methodCallRange)
          * Given a class and a method index, find the Method* with the
          * actual code we want to execute.
          */
-        methodToCall = dvmFindInterfaceMethodInCache(thisClass, ref, curMethod,
-                        methodClassDex);
+        methodToCall = dvmFindInterfaceMethodAtSite(thisClass, ref, curMethod,
+                        pc);
 #if defined(WITH_JIT) && defined(MTERP_STUB)
         self->callsiteClass = thisClass;
         self->methodToCall = methodToCall;
@@ -3766,6 +3798,7 @@ GOTO_TARGET(exceptionThrown)
             dvmSetException(self, exception);
 
         dvmReleaseTrackedAlloc(exception, self);
+        UPDATE_HANDLER_TABLE();
         FINISH(0);
     }
 GOTO_TARGET_END
@@ -3806,13 +3839,20 @@ GOTO_TARGET(invokeMethod, bool methodCallRange, const Method* _methodToCall,
          * Copy args.  This may corrupt vsrc1/vdst.
          */
         if (methodCallRange) {
-            // could use memcpy or a "Duff's device"; most functions have
-            // so few args it won't matter much
             assert(vsrc1 <= curMethod->outsSize);
             assert(vsrc1 == methodToCall->insSize);
             outs = OUTS_FROM_FP(fp, vsrc1);
-            for (i = 0; i < vsrc1; i++)
-                outs[i] = GET_REGISTER(vdst+i);
+            if (vsrc1 <= 4) {
+                for (i = 0; i < vsrc1; i++)
+                    outs[i] = GET_REGISTER(vdst+i);
+            } else {
+                /*
+                 * The outs sit below our save area, so they can't overlap
+                 * the registers being passed.
+                 */
+                assert(vdst + vsrc1 <= curMethod->registersSize);
+                memcpy(outs, &fp[vdst], vsrc1 * sizeof(u4));
+            }
         } else {
             u4 count = vsrc1 >> 4;
 
@@ -3941,6 +3981,7 @@ GOTO_TARGET(invokeMethod, bool methodCallRange, const Method* _methodToCall,
             ILOGD("> pc <-- %s.%s %s", curMethod->clazz->descriptor,
                 curMethod->name, curMethod->shorty);
             DUMP_REGS(curMethod, fp, true);         // show input args
+            UPDATE_HANDLER_TABLE();
             FINISH(0);                              // jump to method start
         } else {
             /* set this up for JNI locals, even if not a JNI native */
@@ -3983,6 +4024,8 @@ GOTO_TARGET(invokeMethod, bool methodCallRange, const Method* _methodToCall,
                 GOTO_exceptionThrown();
             }
 
+            UPDATE_HANDLER_TABLE();
+
             ILOGD("> retval=0x%llx (leaving native)", retval.j);
             ILOGD("> (return from native %s.%s to %s.%s %s)",
                 methodToCall->clazz->descriptor, methodToCall->name,
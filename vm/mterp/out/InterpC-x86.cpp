@@ -513,6 +513,9 @@ static inline bool checkForNullExportPC(Object* obj, u4* fp, const u2* pc)
         }                                                                   \
     }
 
+/* the assembly interpreter picks its own handler table */
+#define UPDATE_HANDLER_TABLE()
+
 /* File: c/opcommon.cpp */
 /* forward declarations of goto targets */
 GOTO_TARGET_DECL(filledNewArray, bool methodCallRange);
@@ -1338,7 +1341,9 @@ GOTO_TARGET(filledNewArray, bool methodCallRange, bool)
             GOTO_exceptionThrown();
         }
 
-        newArray = dvmAllocArrayByClass(arrayClass, vsrc1, ALLOC_DONT_TRACK);
+        /* Every element is stored below, before the next safe point. */
+        newArray = dvmAllocArrayByClass(arrayClass, vsrc1,
+                                        ALLOC_DONT_TRACK | ALLOC_UNINITIALIZED);
         if (newArray == NULL)
             GOTO_exceptionThrown();
 
@@ -1580,8 +1585,8 @@ GOTO_TARGET(invokeInterface, bool methodCallRange)
          * Given a class and a method index, find the Method* with the
          * actual code we want to execute.
          */
-        methodToCall = dvmFindInterfaceMethodInCache(thisClass, ref, curMethod,
-                        methodClassDex);
+        methodToCall = dvmFindInterfaceMethodAtSite(thisClass, ref, curMethod,
+                        pc);
 #if defined(WITH_JIT) && defined(MTERP_STUB)
         self->callsiteClass = thisClass;
         self->methodToCall = methodToCall;
@@ -1999,6 +2004,7 @@ GOTO_TARGET(exceptionThrown)
             dvmSetException(self, exception);
 
         dvmReleaseTrackedAlloc(exception, self);
+        UPDATE_HANDLER_TABLE();
         FINISH(0);
     }
 GOTO_TARGET_END
@@ -2039,13 +2045,20 @@ GOTO_TARGET(invokeMethod, bool methodCallRange, const Method* _methodToCall,
          * Copy args.  This may corrupt vsrc1/vdst.
          */
         if (methodCallRange) {
-            // could use memcpy or a "Duff's device"; most functions have
-            // so few args it won't matter much
             assert(vsrc1 <= curMethod->outsSize);
             assert(vsrc1 == methodToCall->insSize);
             outs = OUTS_FROM_FP(fp, vsrc1);
-            for (i = 0; i < vsrc1; i++)
-                outs[i] = GET_REGISTER(vdst+i);
+            if (vsrc1 <= 4) {
+                for (i = 0; i < vsrc1; i++)
+                    outs[i] = GET_REGISTER(vdst+i);
+            } else {
+                /*
+                 * The outs sit below our save area, so they can't overlap
+                 * the registers being passed.
+                 */
+                assert(vdst + vsrc1 <= curMethod->registersSize);
+                memcpy(outs, &fp[vdst], vsrc1 * sizeof(u4));
+            }
         } else {
             u4 count = vsrc1 >> 4;
 
@@ -2174,6 +2187,7 @@ GOTO_TARGET(invokeMethod, bool methodCallRange, const Method* _methodToCall,
             ILOGD("> pc <-- %s.%s %s", curMethod->clazz->descriptor,
                 curMethod->name, curMethod->shorty);
             DUMP_REGS(curMethod, fp, true);         // show input args
+            UPDATE_HANDLER_TABLE();
             FINISH(0);                              // jump to method start
         } else {
             /* set this up for JNI locals, even if not a JNI native */
@@ -2216,6 +2230,8 @@ GOTO_TARGET(invokeMethod, bool methodCallRange, const Method* _methodToCall,
                 GOTO_exceptionThrown();
             }
 
+            UPDATE_HANDLER_TABLE();
+
             ILOGD("> retval=0x%llx (leaving native)", retval.j);
             ILOGD("> (return from native %s.%s to %s.%s %s)",
                 methodToCall->clazz->descriptor, methodToCall->name,
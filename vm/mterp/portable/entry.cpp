@@ -23,8 +23,14 @@ void dvmInterpretPortable(Thread* self)
     const Method* methodToCall;
     bool methodCallRange;
 
-    /* static computed goto table */
+    /* static computed goto tables */
     DEFINE_GOTO_TABLE(handlerTable);
+#undef H
+#define H(_op)  &&checkBefore
+    DEFINE_GOTO_TABLE(altHandlerTable);
+#undef H
+#define H(_op)  &&op_##_op
+    const void** curHandlerTable;
 
     /* copy state in */
     curMethod = self->interpSave.method;
@@ -50,6 +56,8 @@ void dvmInterpretPortable(Thread* self)
      */
     methodToCall = (const Method*) -1;
 
+    UPDATE_HANDLER_TABLE();
+
 #if 0
     if (self->debugIsMethodEntry) {
         ILOGD("|-- Now interpreting %s.%s", curMethod->clazz->descriptor,
@@ -60,4 +68,14 @@ void dvmInterpretPortable(Thread* self)
 
     FINISH(0);                  /* fetch and execute first instruction */
 
+    /*
+     * Every entry of altHandlerTable lands here, with "inst" already
+     * fetched.  dvmCheckBefore() may change the subMode (e.g. at the end
+     * of a counted step), so pick the table again before dispatching.
+     */
+checkBefore:
+    dvmCheckBefore(pc, fp, self);
+    UPDATE_HANDLER_TABLE();
+    goto *handlerTable[INST_INST(inst)];
+
 /*--- start of opcodes ---*/
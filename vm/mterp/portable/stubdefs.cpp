@@ -29,6 +29,12 @@
  * case/break, for a threaded implementation it's a goto label and an
  * instruction fetch/computed goto.
  *
+ * Dispatch goes through "curHandlerTable", which is either the main table
+ * or, while any subMode is active, a table that sends every opcode
+ * through dvmCheckBefore() first.  Like the mterp alt tables, it is only
+ * switched at backward branches, invokes, returns and throws, so straight
+ * line code pays nothing for the check.
+ *
  * Assumes the existence of "const u2* pc" and (for threaded operation)
  * "u2 inst".
  */
@@ -37,10 +43,7 @@
 # define FINISH(_offset) {                                                  \
         ADJUST_PC(_offset);                                                 \
         inst = FETCH(0);                                                    \
-        if (self->interpBreak.ctl.subMode) {                                \
-            dvmCheckBefore(pc, fp, self);                                   \
-        }                                                                   \
-        goto *handlerTable[INST_INST(inst)];                                \
+        goto *curHandlerTable[INST_INST(inst)];                             \
     }
 # define FINISH_BKPT(_opcode) {                                             \
         goto *handlerTable[_opcode];                                        \
@@ -79,4 +82,13 @@
             EXPORT_PC();  /* need for precise GC */                         \
             dvmCheckSuspendPending(self);                                   \
         }                                                                   \
+        UPDATE_HANDLER_TABLE();                                             \
+    }
+
+/*
+ * Pick the dispatch table that matches the thread's current subMode.
+ */
+#define UPDATE_HANDLER_TABLE() {                                            \
+        curHandlerTable = (self->interpBreak.ctl.subMode != 0) ?            \
+            altHandlerTable : handlerTable;                                 \
     }
@@ -435,6 +435,256 @@ static void Dalvik_dalvik_system_VMDebug_resetInstructionCount(const u4* args,
     RETURN_VOID();
 }
 
+/*
+ * static void getGcPhaseHistograms(long[] data)
+ *
+ * Grab a copy of the GC phase timing histograms.  For each phase in
+ * turn the array gets the number of runs, the total and the longest
+ * time in usec, and then the count of each histogram bucket.  Phases
+ * that do not fit in the array are left out.
+ */
+static void Dalvik_dalvik_system_VMDebug_getGcPhaseHistograms(const u4* args,
+    JValue* pResult)
+{
+    ArrayObject* dataArray = (ArrayObject*) args[0];
+
+    if (dataArray != NULL) {
+        const u4 kValuesPerPhase = 3 + GC_PHASE_HISTOGRAM_BUCKETS;
+        s8* storage = (s8*)(void*)dataArray->contents;
+        GcPhaseHistogram histograms[kGcPhaseCount];
+
+        dvmGetGcPhaseHistograms(histograms);
+        for (u4 i = 0; i < kGcPhaseCount; i++) {
+            if ((i + 1) * kValuesPerPhase > dataArray->length) {
+                break;
+            }
+            s8* values = storage + i * kValuesPerPhase;
+            values[0] = histograms[i].count;
+            values[1] = histograms[i].totalUsec;
+            values[2] = histograms[i].maxUsec;
+            for (u4 j = 0; j < GC_PHASE_HISTOGRAM_BUCKETS; j++) {
+                values[3 + j] = histograms[i].buckets[j];
+            }
+        }
+    }
+
+    RETURN_VOID();
+}
+
+/*
+ * static void resetGcPhaseHistograms()
+ *
+ * Clear the GC phase timing histograms.
+ */
+static void Dalvik_dalvik_system_VMDebug_resetGcPhaseHistograms(const u4* args,
+    JValue* pResult)
+{
+    dvmResetGcPhaseHistograms();
+    RETURN_VOID();
+}
+
+/*
+ * static int getGcEvents(long[] data)
+ *
+ * Grab a copy of the most recent collections, oldest first, as
+ * kGcEventValues longs each: the sequence number, the GcKind, the start
+ * time and the pause and total times in msec, the bytes freed, and the
+ * bytes allocated and the footprint afterwards.  Returns the number of
+ * collections copied.
+ */
+static void Dalvik_dalvik_system_VMDebug_getGcEvents(const u4* args,
+    JValue* pResult)
+{
+    const u4 kGcEventValues = 8;
+    ArrayObject* dataArray = (ArrayObject*) args[0];
+    size_t count = 0;
+
+    if (dataArray != NULL) {
+        size_t maxEvents = MIN(dataArray->length / kGcEventValues,
+                               (size_t)GC_EVENT_LOG_SIZE);
+        GcEvent* events = (GcEvent*) malloc(maxEvents * sizeof(GcEvent));
+        s8* storage = (s8*)(void*)dataArray->contents;
+
+        if (events != NULL) {
+            count = dvmGetGcEvents(events, maxEvents);
+        }
+        for (size_t i = 0; i < count; i++) {
+            s8* values = storage + i * kGcEventValues;
+            values[0] = events[i].seq;
+            values[1] = events[i].kind;
+            values[2] = events[i].startMsec;
+            values[3] = events[i].pauseMsec;
+            values[4] = events[i].totalMsec;
+            values[5] = events[i].bytesFreed;
+            values[6] = events[i].allocated;
+            values[7] = events[i].footprint;
+        }
+        free(events);
+    }
+
+    RETURN_INT(count);
+}
+
+/*
+ * static void resetGcEvents()
+ *
+ * Empty the log read by getGcEvents.
+ */
+static void Dalvik_dalvik_system_VMDebug_resetGcEvents(const u4* args,
+    JValue* pResult)
+{
+    dvmResetGcEvents();
+    RETURN_VOID();
+}
+
+/*
+ * static void getJitStats(long[] data)
+ *
+ * Grab a copy of the JIT compilation telemetry.  The array gets, in
+ * order, the number of translations installed and of requests that
+ * failed, the code bytes installed, the total and longest compile time
+ * and queue wait in usec, the current queue length, the punt, unchained
+ * exit and self-verification failure counts (-1 where the build does not
+ * count them), then the compile time and queue wait histograms, and
+ * last the code cache bytes in use, its size and the number of times it
+ * has been reset.  Values that do not fit in the array are left out.
+ * Builds without the JIT leave the array alone.
+ */
+static void Dalvik_dalvik_system_VMDebug_getJitStats(const u4* args,
+    JValue* pResult)
+{
+#if defined(WITH_JIT)
+    ArrayObject* dataArray = (ArrayObject*) args[0];
+
+    if (dataArray != NULL) {
+        JitTelemetry telemetry;
+        dvmCompilerGetTelemetry(&telemetry);
+
+        const u4 kCacheBase = 11 + 2 * JIT_TELEMETRY_BUCKETS;
+        s8 values[kCacheBase + 3];
+        values[0] = telemetry.numCompiled;
+        values[1] = telemetry.numFailed;
+        values[2] = telemetry.codeBytes;
+        values[3] = telemetry.compileUsec;
+        values[4] = telemetry.maxCompileUsec;
+        values[5] = telemetry.queueWaitUsec;
+        values[6] = telemetry.maxQueueWaitUsec;
+        values[7] = telemetry.queueLength;
+        values[8] = telemetry.numPunts;
+        values[9] = telemetry.numNoChainExits;
+        values[10] = telemetry.numSelfVerificationFailures;
+        for (u4 i = 0; i < JIT_TELEMETRY_BUCKETS; i++) {
+            values[11 + i] = telemetry.compileBuckets[i];
+            values[11 + JIT_TELEMETRY_BUCKETS + i] =
+                telemetry.queueWaitBuckets[i];
+        }
+        values[kCacheBase] = gDvmJit.codeCacheByteUsed;
+        values[kCacheBase + 1] = gDvmJit.codeCacheSize;
+        values[kCacheBase + 2] = gDvmJit.numCodeCacheReset;
+
+        u4 count = NELEM(values);
+        if (count > dataArray->length) {
+            count = dataArray->length;
+        }
+        memcpy(dataArray->contents, values, count * sizeof(s8));
+    }
+#endif
+    RETURN_VOID();
+}
+
+/*
+ * static void resetJitStats()
+ *
+ * Clear the JIT compilation telemetry.
+ */
+static void Dalvik_dalvik_system_VMDebug_resetJitStats(const u4* args,
+    JValue* pResult)
+{
+#if defined(WITH_JIT)
+    dvmCompilerResetTelemetry();
+#endif
+    RETURN_VOID();
+}
+
+/*
+ * static void getVmMetrics(long[] data)
+ *
+ * Grab a copy of the always-on VM counters, in VmMetric order.  Values
+ * that do not fit in the array are left out.
+ */
+static void Dalvik_dalvik_system_VMDebug_getVmMetrics(const u4* args,
+    JValue* pResult)
+{
+    ArrayObject* dataArray = (ArrayObject*) args[0];
+
+    if (dataArray != NULL) {
+        u8 values[kVmMetricCount];
+        dvmGetVmMetrics(values);
+
+        u4 count = NELEM(values);
+        if (count > dataArray->length) {
+            count = dataArray->length;
+        }
+        memcpy(dataArray->contents, values, count * sizeof(u8));
+    }
+    RETURN_VOID();
+}
+
+/*
+ * static long getThreadAllocatedBytes(Thread thread)
+ *
+ * Return the bytes "thread" has allocated since it started, or -1 if it
+ * is not running.  A null thread means the caller.
+ */
+static void Dalvik_dalvik_system_VMDebug_getThreadAllocatedBytes(
+    const u4* args, JValue* pResult)
+{
+    Object* threadObj = (Object*) args[0];
+    s8 result = -1;
+
+    if (threadObj == NULL) {
+        result = dvmGetThreadMetric(dvmThreadSelf(), kThreadMetricAllocBytes);
+    } else {
+        dvmLockThreadList(NULL);
+        Thread* thread = dvmGetThreadFromThreadObject(threadObj);
+        if (thread != NULL)
+            result = dvmGetThreadMetric(thread, kThreadMetricAllocBytes);
+        dvmUnlockThreadList();
+    }
+    RETURN_LONG(result);
+}
+
+/*
+ * static int getClassLoaderUsage(ClassLoader[] loaders, long[] data)
+ *
+ * Report the live heap usage of each class loader, as of the last
+ * collection that measured it.  Entry i goes in loaders[i], null for the
+ * boot class path, with its live object count in data[2*i] and its live
+ * bytes in data[2*i+1].  Entries that do not fit are left out.  Returns
+ * the number of entries.
+ */
+static void Dalvik_dalvik_system_VMDebug_getClassLoaderUsage(const u4* args,
+    JValue* pResult)
+{
+    ArrayObject* loaderArray = (ArrayObject*) args[0];
+    ArrayObject* dataArray = (ArrayObject*) args[1];
+
+    size_t count;
+    VmLoaderUsage* usage = dvmCopyLoaderUsage(&count);
+    for (size_t i = 0; i < count; i++) {
+        if (loaderArray != NULL && i < loaderArray->length)
+            dvmSetObjectArrayElement(loaderArray, i, usage[i].loader);
+        if (dataArray != NULL && 2 * i + 1 < dataArray->length) {
+            u8* data = (u8*) (void*) dataArray->contents;
+            data[2 * i] = usage[i].liveObjects;
+            data[2 * i + 1] = usage[i].liveBytes;
+        }
+    }
+    dvmFreeLoaderUsage(usage, count);
+
+    RETURN_INT(count);
+}
+
 /*
  * static void printLoadedClasses(int flags)
  *
@@ -691,6 +941,55 @@ static void Dalvik_dalvik_system_VMDebug_dumpReferenceTables(const u4* args,
     RETURN_VOID();
 }
 
+/*
+ * static void dumpHeapHistogram(boolean retained)
+ *
+ * Print the classes with the most live bytes to the log, optionally with
+ * an estimate of what they keep alive.
+ */
+static void Dalvik_dalvik_system_VMDebug_dumpHeapHistogram(const u4* args,
+    JValue* pResult)
+{
+    bool retained = (args[0] != 0);
+    DebugOutputTarget target;
+
+    dvmCreateLogOutputTarget(&target, ANDROID_LOG_INFO, LOG_TAG);
+    dvmDumpHeapHistogram(&target, retained);
+    RETURN_VOID();
+}
+
+/*
+ * static boolean saveClassSnapshot()
+ *
+ * Keep the per-class live counts of the last full collection to diff
+ * against later.  Returns false if no collection has counted them.
+ */
+static void Dalvik_dalvik_system_VMDebug_saveClassSnapshot(const u4* args,
+    JValue* pResult)
+{
+    UNUSED_PARAMETER(args);
+
+    RETURN_BOOLEAN(dvmSaveClassSnapshot());
+}
+
+/*
+ * static void dumpClassSnapshotDiff(int maxCount, boolean paths)
+ *
+ * Print the classes that grew the most since the saved snapshot to the
+ * log, optionally with sample paths from the roots to their instances.
+ */
+static void Dalvik_dalvik_system_VMDebug_dumpClassSnapshotDiff(
+    const u4* args, JValue* pResult)
+{
+    int maxCount = args[0];
+    bool paths = (args[1] != 0);
+    DebugOutputTarget target;
+
+    dvmCreateLogOutputTarget(&target, ANDROID_LOG_INFO, LOG_TAG);
+    dvmDumpClassSnapshotDiff(&target, MAX(maxCount, 0), paths);
+    RETURN_VOID();
+}
+
 /*
  * static void crash()
  *
@@ -774,6 +1073,24 @@ const DalvikNativeMethod dvm_dalvik_system_VMDebug[] = {
         Dalvik_dalvik_system_VMDebug_resetInstructionCount },
     { "getInstructionCount",        "([I)V",
         Dalvik_dalvik_system_VMDebug_getInstructionCount },
+    { "resetGcPhaseHistograms",     "()V",
+        Dalvik_dalvik_system_VMDebug_resetGcPhaseHistograms },
+    { "getGcPhaseHistograms",       "([J)V",
+        Dalvik_dalvik_system_VMDebug_getGcPhaseHistograms },
+    { "resetGcEvents",              "()V",
+        Dalvik_dalvik_system_VMDebug_resetGcEvents },
+    { "getGcEvents",                "([J)I",
+        Dalvik_dalvik_system_VMDebug_getGcEvents },
+    { "resetJitStats",              "()V",
+        Dalvik_dalvik_system_VMDebug_resetJitStats },
+    { "getJitStats",                "([J)V",
+        Dalvik_dalvik_system_VMDebug_getJitStats },
+    { "getVmMetrics",               "([J)V",
+        Dalvik_dalvik_system_VMDebug_getVmMetrics },
+    { "getThreadAllocatedBytes",    "(Ljava/lang/Thread;)J",
+        Dalvik_dalvik_system_VMDebug_getThreadAllocatedBytes },
+    { "getClassLoaderUsage",        "([Ljava/lang/ClassLoader;[J)I",
+        Dalvik_dalvik_system_VMDebug_getClassLoaderUsage },
     { "isDebuggerConnected",        "()Z",
         Dalvik_dalvik_system_VMDebug_isDebuggerConnected },
     { "isDebuggingEnabled",         "()Z",
@@ -794,6 +1111,12 @@ const DalvikNativeMethod dvm_dalvik_system_VMDebug[] = {
         Dalvik_dalvik_system_VMDebug_cacheRegisterMap },
     { "dumpReferenceTables",        "()V",
         Dalvik_dalvik_system_VMDebug_dumpReferenceTables },
+    { "dumpHeapHistogram",          "(Z)V",
+        Dalvik_dalvik_system_VMDebug_dumpHeapHistogram },
+    { "saveClassSnapshot",          "()Z",
+        Dalvik_dalvik_system_VMDebug_saveClassSnapshot },
+    { "dumpClassSnapshotDiff",      "(IZ)V",
+        Dalvik_dalvik_system_VMDebug_dumpClassSnapshotDiff },
     { "crash",                      "()V",
         Dalvik_dalvik_system_VMDebug_crash },
     { "infopoint",                 "(I)V",
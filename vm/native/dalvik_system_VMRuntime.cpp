@@ -92,6 +92,27 @@ static void Dalvik_dalvik_system_VMRuntime_disableJitCompilation(const u4* args,
     RETURN_VOID();
 }
 
+/*
+ * public native boolean saveJitWarmStart()
+ *
+ * Writes the heads of the traces compiled so far to the -Xjitwarmstart
+ * file, for processes that are killed rather than shut down.  Returns
+ * false if there is no such file or it could not be written.
+ */
+static void Dalvik_dalvik_system_VMRuntime_saveJitWarmStart(const u4* args,
+    JValue* pResult)
+{
+    bool saved = false;
+#if defined(WITH_JIT)
+    if (gDvm.executionMode == kExecutionModeJit) {
+        ThreadStatus oldStatus = dvmChangeStatus(NULL, THREAD_VMWAIT);
+        saved = dvmCompilerWarmStartSave();
+        dvmChangeStatus(NULL, oldStatus);
+    }
+#endif
+    RETURN_BOOLEAN(saved);
+}
+
 static void Dalvik_dalvik_system_VMRuntime_newNonMovableArray(const u4* args,
     JValue* pResult)
 {
@@ -136,6 +157,84 @@ static void Dalvik_dalvik_system_VMRuntime_addressOf(const u4* args,
     RETURN_LONG(result);
 }
 
+/*
+ * public native long threadAllocatedBytes()
+ *
+ * Returns the bytes the calling thread has allocated since it started.
+ */
+static void Dalvik_dalvik_system_VMRuntime_threadAllocatedBytes(
+    const u4* args, JValue* pResult)
+{
+    RETURN_LONG(dvmGetThreadMetric(dvmThreadSelf(), kThreadMetricAllocBytes));
+}
+
+/*
+ * public native boolean beginArena()
+ *
+ * Makes the objects this thread allocates come from an arena that
+ * endArena() can free all at once.  Returns false if there is none.
+ */
+static void Dalvik_dalvik_system_VMRuntime_beginArena(const u4* args,
+    JValue* pResult)
+{
+    RETURN_BOOLEAN(dvmBeginHeapArena());
+}
+
+/*
+ * public native boolean endArena()
+ *
+ * Ends this thread's arena.  Returns true if its objects were freed,
+ * false if some were still reachable and were left to the GC.
+ */
+static void Dalvik_dalvik_system_VMRuntime_endArena(const u4* args,
+    JValue* pResult)
+{
+    RETURN_BOOLEAN(dvmEndHeapArena());
+}
+
+/*
+ * public native int preloadClasses(String[] classNames, int threadCount)
+ *
+ * Loads and links the named boot classes, without initializing them, on
+ * up to threadCount threads.  Returns the number that loaded.
+ */
+static void Dalvik_dalvik_system_VMRuntime_preloadClasses(const u4* args,
+    JValue* pResult)
+{
+    ArrayObject* classNames = (ArrayObject*) args[1];
+    int threadCount = args[2];
+
+    if (classNames == NULL) {
+        dvmThrowNullPointerException("classNames == null");
+        RETURN_INT(0);
+    }
+    int count = classNames->length;
+    StringObject** names = (StringObject**)(void*) classNames->contents;
+    char** descriptors = (char**) calloc(count, sizeof(char*));
+    if (descriptors == NULL) {
+        dvmThrowOutOfMemoryError("preloadClasses");
+        RETURN_INT(0);
+    }
+    int numDescriptors = 0;
+    for (int i = 0; i < count; i++) {
+        if (names[i] == NULL)
+            continue;
+        char* name = dvmCreateCstrFromString(names[i]);
+        char* descriptor = dvmDotToDescriptor(name);
+        free(name);
+        if (descriptor != NULL)
+            descriptors[numDescriptors++] = descriptor;
+    }
+
+    int numLoaded = dvmPreloadClasses(descriptors, numDescriptors,
+                        threadCount);
+
+    for (int i = 0; i < numDescriptors; i++)
+        free(descriptors[i]);
+    free(descriptors);
+    RETURN_INT(numLoaded);
+}
+
 static void Dalvik_dalvik_system_VMRuntime_clearGrowthLimit(const u4* args,
     JValue* pResult)
 {
@@ -203,6 +302,8 @@ static void Dalvik_dalvik_system_VMRuntime_setTargetSdkVersion(const u4* args,
 const DalvikNativeMethod dvm_dalvik_system_VMRuntime[] = {
     { "addressOf", "(Ljava/lang/Object;)J",
         Dalvik_dalvik_system_VMRuntime_addressOf },
+    { "beginArena", "()Z",
+        Dalvik_dalvik_system_VMRuntime_beginArena },
     { "bootClassPath", "()Ljava/lang/String;",
         Dalvik_dalvik_system_VMRuntime_bootClassPath },
     { "classPath", "()Ljava/lang/String;",
@@ -211,6 +312,8 @@ const DalvikNativeMethod dvm_dalvik_system_VMRuntime[] = {
         Dalvik_dalvik_system_VMRuntime_clearGrowthLimit },
     { "disableJitCompilation", "()V",
         Dalvik_dalvik_system_VMRuntime_disableJitCompilation },
+    { "endArena", "()Z",
+        Dalvik_dalvik_system_VMRuntime_endArena },
     { "isDebuggerActive", "()Z",
         Dalvik_dalvik_system_VMRuntime_isDebuggerActive },
     { "getTargetHeapUtilization", "()F",
@@ -219,12 +322,18 @@ const DalvikNativeMethod dvm_dalvik_system_VMRuntime[] = {
         Dalvik_dalvik_system_VMRuntime_nativeSetTargetHeapUtilization },
     { "newNonMovableArray", "(Ljava/lang/Class;I)Ljava/lang/Object;",
         Dalvik_dalvik_system_VMRuntime_newNonMovableArray },
+    { "preloadClasses", "([Ljava/lang/String;I)I",
+        Dalvik_dalvik_system_VMRuntime_preloadClasses },
     { "properties", "()[Ljava/lang/String;",
         Dalvik_dalvik_system_VMRuntime_properties },
+    { "saveJitWarmStart", "()Z",
+        Dalvik_dalvik_system_VMRuntime_saveJitWarmStart },
     { "setTargetSdkVersion", "(I)V",
         Dalvik_dalvik_system_VMRuntime_setTargetSdkVersion },
     { "startJitCompilation", "()V",
         Dalvik_dalvik_system_VMRuntime_startJitCompilation },
+    { "threadAllocatedBytes", "()J",
+        Dalvik_dalvik_system_VMRuntime_threadAllocatedBytes },
     { "vmVersion", "()Ljava/lang/String;",
         Dalvik_dalvik_system_VMRuntime_vmVersion },
     { NULL, NULL, NULL },
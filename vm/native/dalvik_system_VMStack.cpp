@@ -157,15 +157,10 @@ static int* getTraceBuf(Object* targetThreadObj, size_t* pStackDepth)
     }
 
     /*
-     * Suspend the thread, pull out the stack trace, then resume the thread
-     * and release the thread list lock.  If we're being asked to examine
-     * our own stack trace, skip the suspend/resume.
+     * Pull out the stack trace at the thread's next safe point, then
+     * release the thread list lock.
      */
-    if (thread != self)
-        dvmSuspendThread(thread);
-    traceBuf = dvmFillInStackTraceRaw(thread, pStackDepth);
-    if (thread != self)
-        dvmResumeThread(thread);
+    traceBuf = dvmFillInThreadStackTraceRaw(thread, pStackDepth);
     dvmUnlockThreadList();
 
     return traceBuf;
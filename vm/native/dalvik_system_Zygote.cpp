@@ -334,6 +334,25 @@ static int mountEmulatedStorage(uid_t uid, u4 mountMode) {
     return 0;
 }
 
+/*
+ * Everything the zygote did between VM startup and its first fork is
+ * class and resource preloading; report it with the -Xstartuptrace
+ * steps.
+ */
+static void tracePreload()
+{
+    static bool firstFork = true;
+
+    if (firstFork && gDvm.startupTrace) {
+        ALOGI("startup-trace: zygote preload wall=%d cpu=%d usec, "
+            "%d classes loaded",
+            (int) (dvmGetRelativeTimeUsec() - gDvm.startupEndUsec),
+            (int) (dvmGetThreadCpuTimeUsec() - gDvm.startupEndCpuUsec),
+            gDvm.numLoadedClasses);
+    }
+    firstFork = false;
+}
+
 /* native public static int fork(); */
 static void Dalvik_dalvik_system_Zygote_fork(const u4* args, JValue* pResult)
 {
@@ -346,6 +365,8 @@ static void Dalvik_dalvik_system_Zygote_fork(const u4* args, JValue* pResult)
         RETURN_VOID();
     }
 
+    dvmPrefillBootDexCaches();
+
     if (!dvmGcPreZygoteFork()) {
         ALOGE("pre-fork heap failed");
         dvmAbort();
@@ -354,6 +375,7 @@ static void Dalvik_dalvik_system_Zygote_fork(const u4* args, JValue* pResult)
     setSignalHandler();
 
     dvmDumpLoaderStats("zygote");
+    tracePreload();
     pid = fork();
 
 #ifdef HAVE_ANDROID_OS
@@ -556,6 +578,8 @@ static pid_t forkAndSpecializeCommon(const u4* args, bool isSystemServer)
         return -1;
     }
 
+    dvmPrefillBootDexCaches();
+
     if (!dvmGcPreZygoteFork()) {
         ALOGE("pre-fork heap failed");
         dvmAbort();
@@ -564,11 +588,13 @@ static pid_t forkAndSpecializeCommon(const u4* args, bool isSystemServer)
     setSignalHandler();
 
     dvmDumpLoaderStats("zygote");
+    tracePreload();
     pid = fork();
 
     if (pid == 0) {
         int err;
         /* The child process */
+        u8 startSpecialize = dvmGetRelativeTimeUsec();
 
 #ifdef HAVE_ANDROID_OS
         extern int gMallocLeakZygoteChild;
@@ -670,10 +696,19 @@ static pid_t forkAndSpecializeCommon(const u4* args, bool isSystemServer)
 
         unsetSignalHandler();
         gDvm.zygote = false;
+
+        u8 startInit = dvmGetRelativeTimeUsec();
         if (!dvmInitAfterZygote()) {
             ALOGE("error in post-zygote initialization");
             dvmAbort();
         }
+        if (gDvm.verboseStartup) {
+            u8 endInit = dvmGetRelativeTimeUsec();
+            ALOGI("post-fork specialize=%d vminit=%d total=%d usec",
+                (int)(startInit - startSpecialize),
+                (int)(endInit - startInit),
+                (int)(endInit - startSpecialize));
+        }
     } else if (pid > 0) {
         /* the parent process */
         free(seInfo);
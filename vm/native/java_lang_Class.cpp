@@ -535,20 +535,26 @@ static void Dalvik_java_lang_Class_newInstance(const u4* args, JValue* pResult)
      * Second, make sure it has permission to invoke the constructor.  The
      * constructor must be public or, if the caller is in the same package,
      * have package scope.
+     *
+     * A public constructor of a public class passes both checks no matter
+     * who the caller is, so don't bother walking the stack to find out.
      */
-    ClassObject* callerClass = dvmGetCaller2Class(self->interpSave.curFrame);
-
-    if (!dvmCheckClassAccess(callerClass, clazz)) {
-        ALOGD("newInstance failed: %s not accessible to %s",
-            clazz->descriptor, callerClass->descriptor);
-        dvmThrowIllegalAccessException("access to class not allowed");
-        RETURN_VOID();
-    }
-    if (!dvmCheckMethodAccess(callerClass, init)) {
-        ALOGD("newInstance failed: %s.<init>() not accessible to %s",
-            clazz->descriptor, callerClass->descriptor);
-        dvmThrowIllegalAccessException("access to constructor not allowed");
-        RETURN_VOID();
+    if (!dvmIsPublicClass(clazz) || !dvmIsPublicMethod(init)) {
+        ClassObject* callerClass =
+            dvmGetCaller2Class(self->interpSave.curFrame);
+
+        if (!dvmCheckClassAccess(callerClass, clazz)) {
+            ALOGD("newInstance failed: %s not accessible to %s",
+                clazz->descriptor, callerClass->descriptor);
+            dvmThrowIllegalAccessException("access to class not allowed");
+            RETURN_VOID();
+        }
+        if (!dvmCheckMethodAccess(callerClass, init)) {
+            ALOGD("newInstance failed: %s.<init>() not accessible to %s",
+                clazz->descriptor, callerClass->descriptor);
+            dvmThrowIllegalAccessException("access to constructor not allowed");
+            RETURN_VOID();
+        }
     }
 
     newObj = dvmAllocObject(clazz, ALLOC_DEFAULT);
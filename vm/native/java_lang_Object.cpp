@@ -24,15 +24,13 @@
 /*
  * private Object internalClone()
  *
- * Implements most of Object.clone().
+ * Implements most of Object.clone().  Calls from optimized code are
+ * inlined; this is for the rest.
  */
 static void Dalvik_java_lang_Object_internalClone(const u4* args,
     JValue* pResult)
 {
-    Object* thisPtr = (Object*) args[0];
-    Object* clone = dvmCloneObject(thisPtr, ALLOC_DONT_TRACK);
-
-    RETURN_PTR(clone);
+    MAKE_INTRINSIC_TRAMPOLINE(javaLangObject_internalClone);
 }
 
 /*
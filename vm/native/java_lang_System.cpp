@@ -55,52 +55,88 @@ extern "C" void _memmove_words(void* dest, const void* src, size_t n);
 #define move16 _memmove_words
 #define move32 _memmove_words
 #else
-static void move16(void* dest, const void* src, size_t n)
+/*
+ * Move "n" bytes, where dest/src/n are all multiples of the element size
+ * "elemSize" (2 or 4).
+ *
+ * When dest and src share 64-bit alignment, the bulk of the run is moved
+ * as aligned 64-bit words.  An aligned 64-bit access is at worst two
+ * aligned 32-bit accesses, so no 16- or 32-bit element is ever torn; the
+ * unaligned head and tail are moved an element at a time.
+ */
+static void moveElements(void* dest, const void* src, size_t n,
+    size_t elemSize)
 {
-    assert((((uintptr_t) dest | (uintptr_t) src | n) & 0x01) == 0);
+    u1* d = (u1*) dest;
+    const u1* s = (const u1*) src;
 
-    uint16_t* d = (uint16_t*) dest;
-    const uint16_t* s = (uint16_t*) src;
+    if (elemSize == 2) {
+        assert((((uintptr_t) d | (uintptr_t) s | n) & 0x01) == 0);
+    } else {
+        assert((((uintptr_t) d | (uintptr_t) s | n) & 0x03) == 0);
+    }
 
-    n /= sizeof(uint16_t);
+    bool wide = (((uintptr_t) d ^ (uintptr_t) s) & 0x07) == 0;
 
     if (d < s) {
         /* copy forward */
-        while (n--) {
-            *d++ = *s++;
+        if (wide) {
+            while (n != 0 && ((uintptr_t) d & 0x07) != 0) {
+                if (elemSize == 2)
+                    *(uint16_t*) d = *(const uint16_t*) s;
+                else
+                    *(uint32_t*) d = *(const uint32_t*) s;
+                d += elemSize; s += elemSize; n -= elemSize;
+            }
+            while (n >= sizeof(uint64_t)) {
+                *(uint64_t*) d = *(const uint64_t*) s;
+                d += sizeof(uint64_t); s += sizeof(uint64_t);
+                n -= sizeof(uint64_t);
+            }
+        }
+        while (n != 0) {
+            if (elemSize == 2)
+                *(uint16_t*) d = *(const uint16_t*) s;
+            else
+                *(uint32_t*) d = *(const uint32_t*) s;
+            d += elemSize; s += elemSize; n -= elemSize;
         }
     } else {
         /* copy backward */
         d += n;
         s += n;
-        while (n--) {
-            *--d = *--s;
+        if (wide) {
+            while (n != 0 && ((uintptr_t) d & 0x07) != 0) {
+                d -= elemSize; s -= elemSize; n -= elemSize;
+                if (elemSize == 2)
+                    *(uint16_t*) d = *(const uint16_t*) s;
+                else
+                    *(uint32_t*) d = *(const uint32_t*) s;
+            }
+            while (n >= sizeof(uint64_t)) {
+                d -= sizeof(uint64_t); s -= sizeof(uint64_t);
+                n -= sizeof(uint64_t);
+                *(uint64_t*) d = *(const uint64_t*) s;
+            }
+        }
+        while (n != 0) {
+            d -= elemSize; s -= elemSize; n -= elemSize;
+            if (elemSize == 2)
+                *(uint16_t*) d = *(const uint16_t*) s;
+            else
+                *(uint32_t*) d = *(const uint32_t*) s;
         }
     }
 }
 
-static void move32(void* dest, const void* src, size_t n)
+static void move16(void* dest, const void* src, size_t n)
 {
-    assert((((uintptr_t) dest | (uintptr_t) src | n) & 0x03) == 0);
-
-    uint32_t* d = (uint32_t*) dest;
-    const uint32_t* s = (uint32_t*) src;
-
-    n /= sizeof(uint32_t);
+    moveElements(dest, src, n, sizeof(uint16_t));
+}
 
-    if (d < s) {
-        /* copy forward */
-        while (n--) {
-            *d++ = *s++;
-        }
-    } else {
-        /* copy backward */
-        d += n;
-        s += n;
-        while (n--) {
-            *--d = *--s;
-        }
-    }
+static void move32(void* dest, const void* src, size_t n)
+{
+    moveElements(dest, src, n, sizeof(uint32_t));
 }
 #endif /*HAVE_MEMMOVE_WORDS*/
 
@@ -215,11 +251,11 @@ static void Dalvik_java_lang_System_arraycopy(const u4* args, JValue* pResult)
          */
         const int width = sizeof(Object*);
 
-        if (srcClass->arrayDim == dstClass->arrayDim &&
-            dvmInstanceof(srcClass, dstClass))
-        {
+        if (dvmInstanceof(srcClass, dstClass)) {
             /*
-             * "dst" can hold "src"; copy the whole thing.
+             * "dst" can hold "src"; copy the whole thing.  This also covers
+             * arrays of differing dimension, e.g. String[][] into Object[]:
+             * if the array types are assignable, so is every element.
              */
             if (false) ALOGD("arraycopy ref dst=%p %d src=%p %d len=%d",
                 dstArray->contents, dstPos * width,
@@ -264,6 +300,9 @@ static void Dalvik_java_lang_System_arraycopy(const u4* args, JValue* pResult)
                     /* can't put this element into the array */
                     break;
                 }
+                /* runs of one type are common; remember the last good one */
+                if (srcObj[copyCount] != NULL)
+                    clazz = srcObj[copyCount]->clazz;
             }
 
             if (false) ALOGD("arraycopy iref dst=%p %d src=%p %d count=%d of %d",
@@ -273,7 +312,7 @@ static void Dalvik_java_lang_System_arraycopy(const u4* args, JValue* pResult)
             move32((u1*)dstArray->contents + dstPos * width,
                 (const u1*)srcArray->contents + srcPos * width,
                 copyCount * width);
-            dvmWriteBarrierArray(dstArray, 0, copyCount);
+            dvmWriteBarrierArray(dstArray, dstPos, dstPos + copyCount);
             if (copyCount != length) {
                 dvmThrowArrayStoreExceptionIncompatibleArrayElement(srcPos + copyCount,
                         srcObj[copyCount]->clazz, dstClass);
@@ -69,7 +69,13 @@ static Field* validateFieldAccess(Object* obj, ClassObject* declaringClass,
             dvmThrowIllegalAccessException("field is marked 'final'");
             return NULL;
         }
+    }
 
+    /*
+     * Public fields pass both checks below no matter who the caller is,
+     * so don't bother walking the stack to find out.
+     */
+    if (!noAccessCheck && !dvmIsPublicField(field)) {
         ClassObject* callerClass =
             dvmGetCaller2Class(dvmThreadSelf()->interpSave.curFrame);
 
@@ -543,6 +549,12 @@ static void Dalvik_java_lang_reflect_Field_getPrimitiveField(const u4* args,
     if (field == NULL)
         RETURN_VOID();
 
+    /* the common case: getInt on an int field, etc. */
+    if (fieldType->primitiveType == targetType) {
+        getFieldValue(field, obj, pResult);
+        RETURN_VOID();
+    }
+
     getFieldValue(field, obj, &value);
 
     /* retrieve value, performing a widening conversion if necessary */
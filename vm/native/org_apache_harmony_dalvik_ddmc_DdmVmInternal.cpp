@@ -51,6 +51,83 @@ static void Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getThreadStats(
     RETURN_PTR(result);
 }
 
+/*
+ * public static byte[] getGcPhaseStats()
+ *
+ * Get a buffer full of GC phase timing histograms.
+ */
+static void Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getGcPhaseStats(
+    const u4* args, JValue* pResult)
+{
+    UNUSED_PARAMETER(args);
+
+    ArrayObject* result = dvmDdmGenerateGcPhaseStats();
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+}
+
+/*
+ * public static byte[] getJitStats()
+ *
+ * Get a buffer full of JIT compilation telemetry.
+ */
+static void Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getJitStats(
+    const u4* args, JValue* pResult)
+{
+    UNUSED_PARAMETER(args);
+
+    ArrayObject* result = dvmDdmGenerateJitStats();
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+}
+
+/*
+ * public static byte[] getVmMetrics()
+ *
+ * Get a buffer full of the always-on VM counters.
+ */
+static void Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getVmMetrics(
+    const u4* args, JValue* pResult)
+{
+    UNUSED_PARAMETER(args);
+
+    ArrayObject* result = dvmDdmGenerateVmMetrics();
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+}
+
+/*
+ * public static byte[] getThreadAllocStats()
+ *
+ * Get a buffer full of per-thread allocation counts.
+ */
+static void
+    Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getThreadAllocStats(
+    const u4* args, JValue* pResult)
+{
+    UNUSED_PARAMETER(args);
+
+    ArrayObject* result = dvmDdmGenerateThreadAllocStats();
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+}
+
+/*
+ * public static byte[] getClassLoaderUsage()
+ *
+ * Get a buffer full of per-class-loader live heap usage.
+ */
+static void
+    Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getClassLoaderUsage(
+    const u4* args, JValue* pResult)
+{
+    UNUSED_PARAMETER(args);
+
+    ArrayObject* result = dvmDdmGenerateLoaderUsage();
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+}
+
 /*
  * public static int heapInfoNotify(int what)
  *
@@ -148,11 +225,172 @@ static void
     RETURN_PTR(data);
 }
 
+/*
+ * public static void enableAllocSampling(int intervalBytes)
+ *
+ * Switch allocation tracking to sampling about one allocation per
+ * "intervalBytes", or back to recording every allocation with 0.
+ * Enables tracking if it's off.
+ */
+static void
+    Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_enableAllocSampling(
+    const u4* args, JValue* pResult)
+{
+    int intervalBytes = (int) args[0];
+
+    if (intervalBytes < 0)
+        intervalBytes = 0;
+    (void) dvmEnableAllocSampling(intervalBytes);
+    RETURN_VOID();
+}
+
+/*
+ * public static byte[] getAllocSamples()
+ *
+ * Get a buffer full of aggregated allocation samples.
+ */
+static void Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getAllocSamples(
+    const u4* args, JValue* pResult)
+{
+    UNUSED_PARAMETER(args);
+
+    ArrayObject* result = dvmDdmGenerateAllocSamples();
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+}
+
+/*
+ * public static byte[] getHeapHistogram(boolean retained)
+ *
+ * Get a buffer with the instance count and live bytes of every class,
+ * and optionally the approximate bytes each class retains.
+ */
+static void
+    Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getHeapHistogram(
+    const u4* args, JValue* pResult)
+{
+    bool retained = (args[0] != 0);
+
+    ArrayObject* result = dvmDdmGenerateHeapHistogram(retained);
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+}
+
+/*
+ * public static byte[] getClassSnapshotDiff(int maxCount, boolean paths)
+ *
+ * Get a buffer with the classes that grew the most since the snapshot
+ * saved by VMDebug.saveClassSnapshot(), optionally with sample paths
+ * from the roots.  Returns null if there is no snapshot.
+ */
+static void
+    Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getClassSnapshotDiff(
+    const u4* args, JValue* pResult)
+{
+    int maxCount = args[0];
+    bool paths = (args[1] != 0);
+
+    ArrayObject* result =
+        dvmDdmGenerateClassSnapshotDiff(MAX(maxCount, 0), paths);
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+}
+
+/*
+ * public static void enableLockStats(boolean enable)
+ *
+ * Enable or disable monitor contention profiling.  Enabling discards any
+ * data collected earlier.
+ */
+static void
+    Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_enableLockStats(
+    const u4* args, JValue* pResult)
+{
+    bool enable = (args[0] != 0);
+
+    if (enable)
+        (void) dvmEnableLockProfiler();
+    else
+        dvmDisableLockProfiler();
+    RETURN_VOID();
+}
+
+/*
+ * public static byte[] getLockStats()
+ *
+ * Get a buffer full of monitor contention data.
+ */
+static void Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getLockStats(
+    const u4* args, JValue* pResult)
+{
+    UNUSED_PARAMETER(args);
+
+    ArrayObject* result = dvmDdmGenerateLockStats();
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+}
+
+/*
+ * public static void enableJitTraceSampling(int intervalUsec)
+ *
+ * Start sampling the JIT translations running threads are in every
+ * "intervalUsec" microseconds, or at the default interval with 0,
+ * discarding any data collected earlier.  A negative interval stops
+ * sampling.
+ */
+static void
+    Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_enableJitTraceSampling(
+    const u4* args, JValue* pResult)
+{
+    int intervalUsec = (int) args[0];
+
+#if defined(WITH_JIT)
+    if (intervalUsec < 0)
+        dvmDisableJitTraceSampling();
+    else
+        (void) dvmEnableJitTraceSampling(intervalUsec);
+#else
+    UNUSED_PARAMETER(intervalUsec);
+#endif
+    RETURN_VOID();
+}
+
+/*
+ * public static byte[] getJitTraceSamples()
+ *
+ * Get a buffer full of sampled JIT trace profile data, or null if
+ * sampling is off.
+ */
+static void
+    Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getJitTraceSamples(
+    const u4* args, JValue* pResult)
+{
+    UNUSED_PARAMETER(args);
+
+#if defined(WITH_JIT)
+    ArrayObject* result = dvmDdmGenerateJitTraceSamples();
+    dvmReleaseTrackedAlloc((Object*) result, NULL);
+    RETURN_PTR(result);
+#else
+    RETURN_PTR(NULL);
+#endif
+}
+
 const DalvikNativeMethod dvm_org_apache_harmony_dalvik_ddmc_DdmVmInternal[] = {
     { "threadNotify",       "(Z)V",
       Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_threadNotify },
     { "getThreadStats",     "()[B",
       Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getThreadStats },
+    { "getGcPhaseStats",    "()[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getGcPhaseStats },
+    { "getJitStats",        "()[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getJitStats },
+    { "getVmMetrics",       "()[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getVmMetrics },
+    { "getThreadAllocStats", "()[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getThreadAllocStats },
+    { "getClassLoaderUsage", "()[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getClassLoaderUsage },
     { "heapInfoNotify",     "(I)Z",
       Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_heapInfoNotify },
     { "heapSegmentNotify",  "(IIZ)Z",
@@ -165,5 +403,21 @@ const DalvikNativeMethod dvm_org_apache_harmony_dalvik_ddmc_DdmVmInternal[] = {
       Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getRecentAllocationStatus },
     { "getRecentAllocations", "()[B",
       Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getRecentAllocations },
+    { "enableAllocSampling", "(I)V",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_enableAllocSampling },
+    { "getAllocSamples",    "()[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getAllocSamples },
+    { "getHeapHistogram",   "(Z)[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getHeapHistogram },
+    { "getClassSnapshotDiff", "(IZ)[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getClassSnapshotDiff },
+    { "enableLockStats",    "(Z)V",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_enableLockStats },
+    { "getLockStats",       "()[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getLockStats },
+    { "enableJitTraceSampling", "(I)V",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_enableJitTraceSampling },
+    { "getJitTraceSamples", "()[B",
+      Dalvik_org_apache_harmony_dalvik_ddmc_DdmVmInternal_getJitTraceSamples },
     { NULL, NULL, NULL },
 };
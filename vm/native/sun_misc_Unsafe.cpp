@@ -123,13 +123,7 @@ static void Dalvik_sun_misc_Unsafe_compareAndSwapObject(const u4* args,
 static void Dalvik_sun_misc_Unsafe_getIntVolatile(const u4* args,
     JValue* pResult)
 {
-    // We ignore the this pointer in args[0].
-    Object* obj = (Object*) args[1];
-    s8 offset = GET_ARG_LONG(args, 2);
-    volatile int32_t* address = (volatile int32_t*) (((u1*) obj) + offset);
-
-    int32_t value = android_atomic_acquire_load(address);
-    RETURN_INT(value);
+    MAKE_INTRINSIC_TRAMPOLINE(sunMiscUnsafe_getIntVolatile);
 }
 
 /*
@@ -154,13 +148,7 @@ static void Dalvik_sun_misc_Unsafe_putIntVolatile(const u4* args,
 static void Dalvik_sun_misc_Unsafe_getLongVolatile(const u4* args,
     JValue* pResult)
 {
-    // We ignore the this pointer in args[0].
-    Object* obj = (Object*) args[1];
-    s8 offset = GET_ARG_LONG(args, 2);
-    volatile int64_t* address = (volatile int64_t*) (((u1*) obj) + offset);
-
-    assert((offset & 7) == 0);
-    RETURN_LONG(dvmQuasiAtomicRead64(address));
+    MAKE_INTRINSIC_TRAMPOLINE(sunMiscUnsafe_getLongVolatile);
 }
 
 /*
@@ -186,12 +174,7 @@ static void Dalvik_sun_misc_Unsafe_putLongVolatile(const u4* args,
 static void Dalvik_sun_misc_Unsafe_getObjectVolatile(const u4* args,
     JValue* pResult)
 {
-    // We ignore the this pointer in args[0].
-    Object* obj = (Object*) args[1];
-    s8 offset = GET_ARG_LONG(args, 2);
-    volatile int32_t* address = (volatile int32_t*) (((u1*) obj) + offset);
-
-    RETURN_PTR((Object*) android_atomic_acquire_load(address));
+    MAKE_INTRINSIC_TRAMPOLINE(sunMiscUnsafe_getObjectVolatile);
 }
 
 /*
@@ -217,12 +200,7 @@ static void Dalvik_sun_misc_Unsafe_putObjectVolatile(const u4* args,
  */
 static void Dalvik_sun_misc_Unsafe_getInt(const u4* args, JValue* pResult)
 {
-    // We ignore the this pointer in args[0].
-    Object* obj = (Object*) args[1];
-    s8 offset = GET_ARG_LONG(args, 2);
-    s4* address = (s4*) (((u1*) obj) + offset);
-
-    RETURN_INT(*address);
+    MAKE_INTRINSIC_TRAMPOLINE(sunMiscUnsafe_getInt);
 }
 
 /*
@@ -262,12 +240,7 @@ static void Dalvik_sun_misc_Unsafe_putOrderedInt(const u4* args,
  */
 static void Dalvik_sun_misc_Unsafe_getLong(const u4* args, JValue* pResult)
 {
-    // We ignore the this pointer in args[0].
-    Object* obj = (Object*) args[1];
-    s8 offset = GET_ARG_LONG(args, 2);
-    s8* address = (s8*) (((u1*) obj) + offset);
-
-    RETURN_LONG(*address);
+    MAKE_INTRINSIC_TRAMPOLINE(sunMiscUnsafe_getLong);
 }
 
 /*
@@ -307,12 +280,7 @@ static void Dalvik_sun_misc_Unsafe_putOrderedLong(const u4* args,
  */
 static void Dalvik_sun_misc_Unsafe_getObject(const u4* args, JValue* pResult)
 {
-    // We ignore the this pointer in args[0].
-    Object* obj = (Object*) args[1];
-    s8 offset = GET_ARG_LONG(args, 2);
-    Object** address = (Object**) (((u1*) obj) + offset);
-
-    RETURN_PTR(*address);
+    MAKE_INTRINSIC_TRAMPOLINE(sunMiscUnsafe_getObject);
 }
 
 /*
@@ -155,7 +155,8 @@ ArrayObject* dvmAllocPrimitiveArray(char type, size_t length, int allocFlags)
         return NULL; // Keeps the compiler happy.
     }
 
-    newArray = allocArray(arrayClass, length, width, allocFlags);
+    newArray = allocArray(arrayClass, length, width,
+                          allocFlags | ALLOC_NO_REFERENCES);
 
     /* the caller must dvmReleaseTrackedAlloc if allocFlags==ALLOC_DEFAULT */
     return newArray;
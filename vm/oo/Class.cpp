@@ -169,6 +169,7 @@ may not be worth the performance hit.
 
 static ClassPathEntry* processClassPath(const char* pathStr, bool isBootstrap);
 static void freeCpeArray(ClassPathEntry* cpe);
+static void createBootClassFilter();
 
 static ClassObject* findClassFromLoaderNoInit(
     const char* descriptor, Object* loader);
@@ -186,8 +187,10 @@ static void loadIFieldFromDex(ClassObject* clazz,
 static bool precacheReferenceOffsets(ClassObject* clazz);
 static void computeRefOffsets(ClassObject* clazz);
 static void freeMethodInnards(Method* meth);
+static bool createSuperDisplay(ClassObject* clazz);
 static bool createVtable(ClassObject* clazz);
 static bool createIftable(ClassObject* clazz);
+static bool createImtable(ClassObject* clazz);
 static bool insertMethodStubs(ClassObject* clazz);
 static bool computeFieldOffsets(ClassObject* clazz);
 static void throwEarlierClassFailure(ClassObject* clazz);
@@ -416,6 +419,7 @@ bool dvmClassStartup()
 
     gDvm.loadedClasses =
         dvmHashTableCreate(256, (HashFreeFunc) dvmFreeClassInnards);
+    dvmHashTableSetConcurrentReads(gDvm.loadedClasses);
 
     gDvm.pBootLoaderAlloc = dvmLinearAllocCreate(NULL);
     if (gDvm.pBootLoaderAlloc == NULL)
@@ -459,6 +463,8 @@ bool dvmClassStartup()
     if (gDvm.bootClassPath == NULL)
         return false;
 
+    createBootClassFilter();
+
     return true;
 }
 
@@ -485,6 +491,8 @@ void dvmClassShutdown()
     /* this closes DEX files, JAR files, etc. */
     freeCpeArray(gDvm.bootClassPath);
     gDvm.bootClassPath = NULL;
+    free(gDvm.bootClassFilter);
+    gDvm.bootClassFilter = NULL;
 
     dvmLinearAllocDestroy(NULL);
 
@@ -519,6 +527,7 @@ static void dumpClassPath(const ClassPathEntry* cpe)
             JarFile* pJarFile = (JarFile*) cpe->ptr;
             DvmDex* pDvmDex = dvmGetJarFileDex(pJarFile);
             dvmDumpAtomicCacheStats(pDvmDex->pInterfaceCache);
+            dvmDumpAtomicCacheStats(pDvmDex->pInterfaceSiteCache);
         }
 
         cpe++;
@@ -594,6 +603,19 @@ static void getFileNameSuffix(const char* fileName, char* suffixBuf, size_t suff
     strlcpy(suffixBuf, (lastDot == NULL) ? "<none>" : (lastDot + 1), suffixBufLen);
 }
 
+/*
+ * For -Xstartuptrace, log how long opening (and maybe optimizing) a
+ * class path entry took.
+ */
+static void traceCpeOpen(const ClassPathEntry* cpe, u8 startWall, u8 startCpu)
+{
+    if (gDvm.startupTrace) {
+        ALOGI("startup-trace: open %s wall=%d cpu=%d usec", cpe->fileName,
+            (int) (dvmGetRelativeTimeUsec() - startWall),
+            (int) (dvmGetThreadCpuTimeUsec() - startCpu));
+    }
+}
+
 /*
  * Prepare a ClassPathEntry struct, which at this point only has a valid
  * filename.  We need to figure out what kind of file it is, and for
@@ -603,6 +625,12 @@ static void getFileNameSuffix(const char* fileName, char* suffixBuf, size_t suff
 static bool prepareCpe(ClassPathEntry* cpe, bool isBootstrap)
 {
     struct stat sb;
+    u8 startWall = 0, startCpu = 0;
+
+    if (gDvm.startupTrace) {
+        startWall = dvmGetRelativeTimeUsec();
+        startCpu = dvmGetThreadCpuTimeUsec();
+    }
 
     if (stat(cpe->fileName, &sb) < 0) {
         ALOGD("Unable to stat classpath element '%s'", cpe->fileName);
@@ -622,6 +650,7 @@ static bool prepareCpe(ClassPathEntry* cpe, bool isBootstrap)
         if (dvmJarFileOpen(cpe->fileName, NULL, &pJarFile, isBootstrap) == 0) {
             cpe->kind = kCpeJar;
             cpe->ptr = pJarFile;
+            traceCpeOpen(cpe, startWall, startCpu);
             return true;
         }
     } else if (strcmp(suffix, "dex") == 0) {
@@ -629,6 +658,7 @@ static bool prepareCpe(ClassPathEntry* cpe, bool isBootstrap)
         if (dvmRawDexFileOpen(cpe->fileName, NULL, &pRawDexFile, isBootstrap) == 0) {
             cpe->kind = kCpeDex;
             cpe->ptr = pRawDexFile;
+            traceCpeOpen(cpe, startWall, startCpu);
             return true;
         }
     } else {
@@ -757,6 +787,165 @@ bail:
     return cpe;
 }
 
+/*
+ * Get the DvmDex for a class path entry.
+ */
+static DvmDex* getCpeDex(const ClassPathEntry* cpe)
+{
+    switch (cpe->kind) {
+    case kCpeJar:
+        return dvmGetJarFileDex((JarFile*) cpe->ptr);
+    case kCpeDex:
+        return dvmGetRawDexFileDex((RawDexFile*) cpe->ptr);
+    default:
+        return NULL;
+    }
+}
+
+/* (documented in header) */
+void dvmPrefillBootDexCaches()
+{
+    static int32_t lastLoadedClasses = -1;
+    int numFilled = 0;
+
+    /* nothing new since last time; don't rescan before every fork */
+    if (gDvm.numLoadedClasses == lastLoadedClasses)
+        return;
+    lastLoadedClasses = gDvm.numLoadedClasses;
+
+    for (const ClassPathEntry* cpe = gDvm.bootClassPath;
+         cpe != NULL && cpe->kind != kCpeLastEntry; cpe++)
+    {
+        DvmDex* pDvmDex = getCpeDex(cpe);
+        if (pDvmDex == NULL)
+            continue;
+
+        const DexFile* pDexFile = pDvmDex->pDexFile;
+        u4 typeIdsSize = pDvmDex->pHeader->typeIdsSize;
+        for (u4 idx = 0; idx < typeIdsSize; idx++) {
+            if (dvmDexGetResolvedClass(pDvmDex, idx) != NULL)
+                continue;
+
+            const char* descriptor = dexStringByTypeIdx(pDexFile, idx);
+            if (descriptor[0] != '\0' && descriptor[1] == '\0')
+                continue;       /* primitive, resolved without a lookup */
+
+            u4 hash;
+            if (!dexGetTypeIdHash(pDexFile, idx, &hash))
+                hash = dvmComputeUtf8Hash(descriptor);
+
+            /*
+             * Only boot classes that are already linked.  This is what
+             * dvmResolveClass() would store for a boot class referrer.
+             */
+            ClassObject* clazz =
+                dvmLookupClassWithHash(descriptor, hash, NULL, false);
+            if (clazz != NULL) {
+                dvmDexSetResolvedClass(pDvmDex, idx, clazz);
+                numFilled++;
+            }
+        }
+    }
+
+    ALOGV("Prefilled %d boot class references before fork", numFilled);
+
+    /*
+     * The boot literals are the same in every process, so create them
+     * once here, where the children share them.
+     */
+    static bool literalsInterned = false;
+    if (gDvm.preInternLiterals && !literalsInterned) {
+        int numInterned = 0;
+        for (const ClassPathEntry* cpe = gDvm.bootClassPath;
+             cpe != NULL && cpe->kind != kCpeLastEntry; cpe++)
+        {
+            DvmDex* pDvmDex = getCpeDex(cpe);
+            if (pDvmDex != NULL)
+                numInterned += dvmPreInternStringLiterals(pDvmDex);
+        }
+        literalsInterned = true;
+        ALOGV("Interned %d boot string literals before fork", numInterned);
+    }
+}
+
+/*
+ * The two bit positions a descriptor hash sets in the boot class filter.
+ * The second one comes from the high half of the hash, which the first
+ * doesn't see for filters smaller than 64K bits.
+ */
+static inline u4 bootFilterBit1(u4 hash)
+{
+    return hash & gDvm.bootClassFilterMask;
+}
+static inline u4 bootFilterBit2(u4 hash)
+{
+    return ((hash >> 16) | (hash << 16)) & gDvm.bootClassFilterMask;
+}
+
+/*
+ * Build a Bloom filter holding every class defined on the bootstrap class
+ * path.  Most lookups that reach the boot path are misses (any class
+ * loader delegates to it first), and without the filter each miss probes
+ * every DEX file's lookup table.  We reuse the hashes already stored in
+ * the DexClassLookup tables, so no descriptors need to be touched.
+ *
+ * At 8 bits per class with two probes, about 5% of misses get through.
+ * If we can't allocate it, lookups just go without.
+ */
+static void createBootClassFilter()
+{
+    const ClassPathEntry* cpe;
+    u4 classCount = 0;
+
+    for (cpe = gDvm.bootClassPath; cpe->kind != kCpeLastEntry; cpe++) {
+        DvmDex* pDvmDex = getCpeDex(cpe);
+        if (pDvmDex != NULL)
+            classCount += pDvmDex->pHeader->classDefsSize;
+    }
+
+    u4 bitCount = dexRoundUpPower2(classCount * 8);
+    if (bitCount < 32)
+        bitCount = 32;
+    gDvm.bootClassFilter = (u4*) calloc(bitCount / 32, sizeof(u4));
+    if (gDvm.bootClassFilter == NULL)
+        return;
+    gDvm.bootClassFilterMask = bitCount - 1;
+
+    for (cpe = gDvm.bootClassPath; cpe->kind != kCpeLastEntry; cpe++) {
+        DvmDex* pDvmDex = getCpeDex(cpe);
+        if (pDvmDex == NULL)
+            continue;
+
+        const DexClassLookup* pLookup = pDvmDex->pDexFile->pClassLookup;
+        for (int i = 0; i < pLookup->numEntries; i++) {
+            if (pLookup->table[i].classDescriptorOffset == 0)
+                continue;
+            u4 hash = pLookup->table[i].classDescriptorHash;
+            u4 bit1 = bootFilterBit1(hash);
+            u4 bit2 = bootFilterBit2(hash);
+            gDvm.bootClassFilter[bit1 >> 5] |= 1 << (bit1 & 31);
+            gDvm.bootClassFilter[bit2 >> 5] |= 1 << (bit2 & 31);
+        }
+    }
+
+    ALOGV("Boot class filter: %u classes, %u bits", classCount, bitCount);
+}
+
+/*
+ * Returns "false" if the class with this descriptor hash is definitely
+ * not on the bootstrap class path.
+ */
+static inline bool bootClassFilterMayContain(u4 hash)
+{
+    if (gDvm.bootClassFilter == NULL)
+        return true;
+
+    u4 bit1 = bootFilterBit1(hash);
+    u4 bit2 = bootFilterBit2(hash);
+    return (gDvm.bootClassFilter[bit1 >> 5] & (1 << (bit1 & 31))) != 0 &&
+           (gDvm.bootClassFilter[bit2 >> 5] & (1 << (bit2 & 31))) != 0;
+}
+
 /*
  * Search the DEX files we loaded from the bootstrap class path for a DEX
  * file that has the class with the matching descriptor.
@@ -770,10 +959,14 @@ static DvmDex* searchBootPathForClass(const char* descriptor,
     const ClassPathEntry* cpe = gDvm.bootClassPath;
     const DexClassDef* pFoundDef = NULL;
     DvmDex* pFoundFile = NULL;
+    u4 hash = dexComputeClassDescriptorHash(descriptor);
 
     LOGVV("+++ class '%s' not yet loaded, scanning bootclasspath...",
         descriptor);
 
+    if (!bootClassFilterMayContain(hash))
+        goto optExtra;
+
     while (cpe->kind != kCpeLastEntry) {
         //ALOGV("+++  checking '%s' (%d)", cpe->fileName, cpe->kind);
 
@@ -785,7 +978,8 @@ static DvmDex* searchBootPathForClass(const char* descriptor,
                 DvmDex* pDvmDex;
 
                 pDvmDex = dvmGetJarFileDex(pJarFile);
-                pClassDef = dexFindClass(pDvmDex->pDexFile, descriptor);
+                pClassDef = dexFindClassWithHash(pDvmDex->pDexFile,
+                    descriptor, hash);
                 if (pClassDef != NULL) {
                     /* found */
                     pFoundDef = pClassDef;
@@ -801,7 +995,8 @@ static DvmDex* searchBootPathForClass(const char* descriptor,
                 DvmDex* pDvmDex;
 
                 pDvmDex = dvmGetRawDexFileDex(pRawDexFile);
-                pClassDef = dexFindClass(pDvmDex->pDexFile, descriptor);
+                pClassDef = dexFindClassWithHash(pDvmDex->pDexFile,
+                    descriptor, hash);
                 if (pClassDef != NULL) {
                     /* found */
                     pFoundDef = pClassDef;
@@ -828,11 +1023,12 @@ static DvmDex* searchBootPathForClass(const char* descriptor,
      * here.  It logically comes after all existing entries in the bootstrap
      * class path.
      */
+optExtra:
     if (gDvm.bootClassPathOptExtra != NULL) {
         const DexClassDef* pClassDef;
 
-        pClassDef =
-            dexFindClass(gDvm.bootClassPathOptExtra->pDexFile, descriptor);
+        pClassDef = dexFindClassWithHash(gDvm.bootClassPathOptExtra->pDexFile,
+            descriptor, hash);
         if (pClassDef != NULL) {
             /* found */
             pFoundDef = pClassDef;
@@ -954,12 +1150,9 @@ static InitiatingLoaderList *dvmGetInitiatingLoaderList(ClassObject* clazz)
 /*
  * Determine if "loader" appears in clazz' initiating loader list.
  *
- * The class hash table lock must be held when calling here, since
- * it's also used when updating a class' initiating loader list.
- *
- * TODO: switch to some sort of lock-free data structure so we don't have
- * to grab the lock to do a lookup.  Among other things, this would improve
- * the speed of compareDescriptorClasses().
+ * This doesn't need the class hash table lock.  Loaders are only ever
+ * appended, and dvmAddInitiatingLoader() publishes the list before the
+ * count that covers it, keeping replaced lists until the next GC.
  */
 bool dvmLoaderInInitiatingList(const ClassObject* clazz, const Object* loader)
 {
@@ -978,9 +1171,13 @@ bool dvmLoaderInInitiatingList(const ClassObject* clazz, const Object* loader)
     ClassObject* nonConstClazz = (ClassObject*) clazz;
     const InitiatingLoaderList *loaderList =
         dvmGetInitiatingLoaderList(nonConstClazz);
+    int count = android_atomic_acquire_load(
+                    &loaderList->initiatingLoaderCount);
+    Object** loaders = (Object**) android_atomic_acquire_load(
+                    (const int32_t*) &loaderList->initiatingLoaders);
     int i;
-    for (i = loaderList->initiatingLoaderCount-1; i >= 0; --i) {
-        if (loaderList->initiatingLoaders[i] == loader) {
+    for (i = count-1; i >= 0; --i) {
+        if (loaders[i] == loader) {
             //ALOGI("+++ found initiating match %p in %s",
             //    loader, clazz->descriptor);
             return true;
@@ -1022,29 +1219,39 @@ void dvmAddInitiatingLoader(ClassObject* clazz, Object* loader)
          * number of elements in it, and reallocate the buffer when
          * we run off the end.
          *
-         * The pointer is initially NULL, so we *do* want to call realloc
-         * when count==0.
+         * Lookups read the list without the lock, so a full buffer is
+         * copied rather than realloc()ed, and the old one is left for
+         * the table to free once no lookup can be using it.  The new
+         * loader and buffer are published before the count.
          */
         InitiatingLoaderList *loaderList = dvmGetInitiatingLoaderList(clazz);
-        if ((loaderList->initiatingLoaderCount & (kInitLoaderInc-1)) == 0) {
+        int count = loaderList->initiatingLoaderCount;
+        Object** loaders = loaderList->initiatingLoaders;
+        if ((count & (kInitLoaderInc-1)) == 0) {
             Object** newList;
 
-            newList = (Object**) realloc(loaderList->initiatingLoaders,
-                        (loaderList->initiatingLoaderCount + kInitLoaderInc)
-                         * sizeof(Object*));
+            newList = (Object**) malloc((count + kInitLoaderInc)
+                        * sizeof(Object*));
             if (newList == NULL) {
                 /* this is mainly a cache, so it's not the EotW */
                 assert(false);
                 goto bail_unlock;
             }
-            loaderList->initiatingLoaders = newList;
+            if (loaders != NULL) {
+                memcpy(newList, loaders, count * sizeof(Object*));
+                dvmHashTableRetire(gDvm.loadedClasses, loaders);
+            }
+            newList[count] = loader;
+            android_atomic_release_store((int32_t) newList,
+                (int32_t*) &loaderList->initiatingLoaders);
 
             //ALOGI("Expanded init list to %d (%s)",
-            //    loaderList->initiatingLoaderCount+kInitLoaderInc,
-            //    clazz->descriptor);
+            //    count+kInitLoaderInc, clazz->descriptor);
+        } else {
+            loaders[count] = loader;
         }
-        loaderList->initiatingLoaders[loaderList->initiatingLoaderCount++] =
-            loader;
+        android_atomic_release_store(count + 1,
+            &loaderList->initiatingLoaderCount);
 
 bail_unlock:
         dvmHashTableUnlock(gDvm.loadedClasses);
@@ -1061,7 +1268,8 @@ bail_unlock:
  * loader is in the hashed class' initiating loader list.  If so, we
  * can return "true" immediately and skip some of the loadClass melodrama.
  *
- * The caller must lock the hash table before calling here.
+ * This is also called from lock-free lookups, so it must only read what
+ * can be read without the hash table lock.
  *
  * Returns 0 if a matching entry is found, nonzero otherwise.
  */
@@ -1116,26 +1324,46 @@ static int hashcmpClassByClass(const void* vclazz, const void* vaddclazz)
  * such classes are ignored.  (The only place that should set "unprepOkay"
  * is findClassNoInit(), which will wait for the prep to finish.)
  *
+ * Running threads look without taking the table lock.  Only a lookup
+ * that finds nothing takes it and tries again, because a lock-free one
+ * can miss a class that is being moved around the table.  Threads that
+ * aren't running could still be in a lookup when GC frees what the
+ * table retired, so they always take the lock.
+ *
  * Returns NULL if not found.
  */
 ClassObject* dvmLookupClass(const char* descriptor, Object* loader,
     bool unprepOkay)
+{
+    return dvmLookupClassWithHash(descriptor, dvmComputeUtf8Hash(descriptor),
+        loader, unprepOkay);
+}
+
+/* (documented in header) */
+ClassObject* dvmLookupClassWithHash(const char* descriptor, u4 hash,
+    Object* loader, bool unprepOkay)
 {
     ClassMatchCriteria crit;
     void* found;
-    u4 hash;
 
     crit.descriptor = descriptor;
     crit.loader = loader;
-    hash = dvmComputeUtf8Hash(descriptor);
 
     LOGVV("threadid=%d: dvmLookupClass searching for '%s' %p",
         dvmThreadSelf()->threadId, descriptor, loader);
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    found = dvmHashTableLookup(gDvm.loadedClasses, hash, &crit,
-                hashcmpClassByCrit, false);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    Thread* self = dvmThreadSelf();
+    found = NULL;
+    if (self != NULL && self->status == THREAD_RUNNING) {
+        found = dvmHashTableLookupConcurrent(gDvm.loadedClasses, hash, &crit,
+                    hashcmpClassByCrit);
+    }
+    if (found == NULL) {
+        dvmHashTableLock(gDvm.loadedClasses);
+        found = dvmHashTableLookup(gDvm.loadedClasses, hash, &crit,
+                    hashcmpClassByCrit, false);
+        dvmHashTableUnlock(gDvm.loadedClasses);
+    }
 
     /*
      * The class has been added to the hash table but isn't ready for use.
@@ -1209,6 +1437,18 @@ void dvmCheckClassTablePerf()
 }
 #endif
 
+/*
+ * Free the memory the class hash table and the initiating loader lists
+ * have retired.  Called by the GC with all threads suspended, so no
+ * thread is in a lock-free lookup.
+ */
+void dvmFreeRetiredClassTableMemory()
+{
+    /* It's possible for a GC to happen before dvmClassStartup(). */
+    if (gDvm.loadedClasses != NULL)
+        dvmHashTableFreeRetired(gDvm.loadedClasses);
+}
+
 /*
  * Remove a class object from the hash table.
  */
@@ -1456,6 +1696,97 @@ ClassObject* dvmFindSystemClassNoInit(const char* descriptor)
     return findClassNoInit(descriptor, NULL, NULL);
 }
 
+#define kPreloadMaxThreads  8
+
+/* state shared by the threads of dvmPreloadClasses() */
+struct PreloadContext {
+    const char* const* descriptors;
+    int         count;
+    volatile int32_t next;      /* index of the next descriptor to load */
+    volatile int32_t numLoaded;
+};
+
+/*
+ * Load and link classes from the list until there are none left.
+ * Classes that fail to load are skipped.
+ */
+static void preloadFromList(PreloadContext* ctx)
+{
+    Thread* self = dvmThreadSelf();
+
+    for (;;) {
+        int idx = android_atomic_inc(&ctx->next);
+        if (idx >= ctx->count)
+            break;
+        if (dvmFindSystemClassNoInit(ctx->descriptors[idx]) != NULL) {
+            android_atomic_inc(&ctx->numLoaded);
+        } else {
+            ALOGV("Preload of %s failed", ctx->descriptors[idx]);
+            dvmClearException(self);
+        }
+    }
+}
+
+static void* preloadThreadStart(void* arg)
+{
+    preloadFromList((PreloadContext*) arg);
+    return NULL;
+}
+
+/*
+ * Load and link the boot classes named by "descriptors", without
+ * initializing them, on "numThreads" threads including the caller.
+ *
+ * The threads pull classes off the list one at a time.  Nothing beyond
+ * the per-class locking of findClassNoInit() is needed: a class that is
+ * being linked by one thread is waited for by the others, and one that
+ * two threads load at once is kept from whichever adds it to the hash
+ * table first.  Superclasses and interfaces can't be circular, so the
+ * threads can't end up waiting on each other.  The extra threads are
+ * gone by the time this returns, so the zygote can use it.
+ *
+ * Returns the number of classes that were loaded.
+ */
+int dvmPreloadClasses(const char* const* descriptors, int count,
+    int numThreads)
+{
+    Thread* self = dvmThreadSelf();
+    pthread_t threads[kPreloadMaxThreads - 1];
+    PreloadContext ctx;
+    int numHelpers = 0;
+
+    ctx.descriptors = descriptors;
+    ctx.count = count;
+    ctx.next = 0;
+    ctx.numLoaded = 0;
+
+    if (numThreads > kPreloadMaxThreads)
+        numThreads = kPreloadMaxThreads;
+    while (numHelpers < numThreads - 1 && numHelpers < count - 1) {
+        char name[16];
+        snprintf(name, sizeof(name), "Preload %d", numHelpers + 1);
+        if (!dvmCreateInternalThread(&threads[numHelpers], name,
+                preloadThreadStart, &ctx))
+        {
+            ALOGW("Unable to create class preload thread, continuing "
+                  "with %d", numHelpers + 1);
+            break;
+        }
+        numHelpers++;
+    }
+
+    preloadFromList(&ctx);
+
+    ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    for (int i = 0; i < numHelpers; i++)
+        pthread_join(threads[i], NULL);
+    dvmChangeStatus(self, oldStatus);
+
+    ALOGV("Preloaded %d of %d classes on %d threads",
+        ctx.numLoaded, count, numHelpers + 1);
+    return ctx.numLoaded;
+}
+
 /*
  * Find the named class (by descriptor). If it's not already loaded,
  * we load it and link it, but don't execute <clinit>. (The VM has
@@ -1627,15 +1958,18 @@ static ClassObject* findClassNoInit(const char* descriptor, Object* loader,
         dvmUnlockObject(self, (Object*) clazz);
 
         /*
-         * Add class stats to global counters.
-         *
-         * TODO: these should probably be atomic ops.
+         * Add class stats to global counters.  Several threads can be
+         * loading classes at once, see dvmPreloadClasses().
          */
-        gDvm.numLoadedClasses++;
-        gDvm.numDeclaredMethods +=
-            clazz->virtualMethodCount + clazz->directMethodCount;
-        gDvm.numDeclaredInstFields += clazz->ifieldCount;
-        gDvm.numDeclaredStaticFields += clazz->sfieldCount;
+        android_atomic_inc(&gDvm.numLoadedClasses);
+        android_atomic_add(clazz->virtualMethodCount + clazz->directMethodCount,
+            &gDvm.numDeclaredMethods);
+        android_atomic_add(clazz->ifieldCount, &gDvm.numDeclaredInstFields);
+        android_atomic_add(clazz->sfieldCount, &gDvm.numDeclaredStaticFields);
+
+        /* the first class out of a DEX file kicks off pre-resolution */
+        if (gDvm.preResolve)
+            dvmStartPreResolve(clazz);
 
         /*
          * Cache pointers to basic classes.  We want to use these in
@@ -1721,13 +2055,14 @@ bail:
 }
 
 /*
- * Helper for loadClassFromDex, which takes a DexClassDataHeader and
- * encoded data pointer in addition to the other arguments.
+ * Helper for loadClassFromDex, which takes the decoded class_data_item
+ * in addition to the other arguments.
  */
 static ClassObject* loadClassFromDex0(DvmDex* pDvmDex,
-    const DexClassDef* pClassDef, const DexClassDataHeader* pHeader,
-    const u1* pEncodedData, Object* classLoader)
+    const DexClassDef* pClassDef, const DexClassData* pClassData,
+    Object* classLoader)
 {
+    const DexClassDataHeader* pHeader = &pClassData->header;
     ClassObject* newClass = NULL;
     const DexFile* pDexFile;
     const char* descriptor;
@@ -1825,27 +2160,23 @@ static ClassObject* loadClassFromDex0(DvmDex* pDvmDex,
     if (pHeader->staticFieldsSize != 0) {
         /* static fields stay on system heap; field data isn't "write once" */
         int count = (int) pHeader->staticFieldsSize;
-        u4 lastIndex = 0;
-        DexField field;
 
         newClass->sfieldCount = count;
         for (i = 0; i < count; i++) {
-            dexReadClassDataField(&pEncodedData, &field, &lastIndex);
-            loadSFieldFromDex(newClass, &field, &newClass->sfields[i]);
+            loadSFieldFromDex(newClass, &pClassData->staticFields[i],
+                &newClass->sfields[i]);
         }
     }
 
     if (pHeader->instanceFieldsSize != 0) {
         int count = (int) pHeader->instanceFieldsSize;
-        u4 lastIndex = 0;
-        DexField field;
 
         newClass->ifieldCount = count;
         newClass->ifields = (InstField*) dvmLinearAlloc(classLoader,
                 count * sizeof(InstField));
         for (i = 0; i < count; i++) {
-            dexReadClassDataField(&pEncodedData, &field, &lastIndex);
-            loadIFieldFromDex(newClass, &field, &newClass->ifields[i]);
+            loadIFieldFromDex(newClass, &pClassData->instanceFields[i],
+                &newClass->ifields[i]);
         }
         dvmLinearReadOnly(classLoader, newClass->ifields);
     }
@@ -1886,15 +2217,13 @@ static ClassObject* loadClassFromDex0(DvmDex* pDvmDex,
 
     if (pHeader->directMethodsSize != 0) {
         int count = (int) pHeader->directMethodsSize;
-        u4 lastIndex = 0;
-        DexMethod method;
 
         newClass->directMethodCount = count;
         newClass->directMethods = (Method*) dvmLinearAlloc(classLoader,
                 count * sizeof(Method));
         for (i = 0; i < count; i++) {
-            dexReadClassDataMethod(&pEncodedData, &method, &lastIndex);
-            loadMethodFromDex(newClass, &method, &newClass->directMethods[i]);
+            loadMethodFromDex(newClass, &pClassData->directMethods[i],
+                &newClass->directMethods[i]);
             if (classMapData != NULL) {
                 const RegisterMap* pMap = dvmRegisterMapGetNext(&classMapData);
                 if (dvmRegisterMapGetFormat(pMap) != kRegMapFormatNone) {
@@ -1910,15 +2239,13 @@ static ClassObject* loadClassFromDex0(DvmDex* pDvmDex,
 
     if (pHeader->virtualMethodsSize != 0) {
         int count = (int) pHeader->virtualMethodsSize;
-        u4 lastIndex = 0;
-        DexMethod method;
 
         newClass->virtualMethodCount = count;
         newClass->virtualMethods = (Method*) dvmLinearAlloc(classLoader,
                 count * sizeof(Method));
         for (i = 0; i < count; i++) {
-            dexReadClassDataMethod(&pEncodedData, &method, &lastIndex);
-            loadMethodFromDex(newClass, &method, &newClass->virtualMethods[i]);
+            loadMethodFromDex(newClass, &pClassData->virtualMethods[i],
+                &newClass->virtualMethods[i]);
             if (classMapData != NULL) {
                 const RegisterMap* pMap = dvmRegisterMapGetNext(&classMapData);
                 if (dvmRegisterMapGetFormat(pMap) != kRegMapFormatNone) {
@@ -1951,8 +2278,7 @@ static ClassObject* loadClassFromDex(DvmDex* pDvmDex,
     const DexClassDef* pClassDef, Object* classLoader)
 {
     ClassObject* result;
-    DexClassDataHeader header;
-    const u1* pEncodedData;
+    DexClassData* pClassData;
     const DexFile* pDexFile;
 
     assert((pDvmDex != NULL) && (pClassDef != NULL));
@@ -1963,17 +2289,20 @@ static ClassObject* loadClassFromDex(DvmDex* pDvmDex,
             dexGetClassDescriptor(pDexFile, pClassDef));
     }
 
-    pEncodedData = dexGetClassData(pDexFile, pClassDef);
-
-    if (pEncodedData != NULL) {
-        dexReadClassDataHeader(&pEncodedData, &header);
-    } else {
-        // Provide an all-zeroes header for the rest of the loading.
-        memset(&header, 0, sizeof(header));
+    /*
+     * Decode the whole class_data_item in one call.  It was checked by
+     * the structural verifier, so the only likely failure is running out
+     * of memory.  With no class data we get an all-zeroes header.
+     */
+    pClassData = dexReadClassData(pDexFile, pClassDef);
+    if (pClassData == NULL) {
+        ALOGE("Unable to read class data for %s",
+            dexGetClassDescriptor(pDexFile, pClassDef));
+        return NULL;
     }
 
-    result = loadClassFromDex0(pDvmDex, pClassDef, &header, pEncodedData,
-            classLoader);
+    result = loadClassFromDex0(pDvmDex, pClassDef, pClassData, classLoader);
+    free(pClassData);
 
     if (gDvm.verboseClass && (result != NULL)) {
         ALOGI("[Loaded %s from DEX %p (cl=%p)]",
@@ -2032,10 +2361,19 @@ void dvmFreeClassInnards(ClassObject* clazz)
         } \
     } while (0)
 
-    /* arrays just point at Object's vtable; don't free vtable in this case.
+    /* the address may be reused for another class; drop any JNI
+     * member lookups cached against it.
+     */
+    dvmPurgeAtomicCacheKey1(gDvm.jniMemberCache, (u4) clazz);
+
+    /* arrays just point at Object's vtable, and classes that add no
+     * virtual methods borrow their superclass'; don't free vtable in
+     * these cases.
      */
     clazz->vtableCount = -1;
-    if (clazz->vtable == gDvm.classJavaLangObject->vtable) {
+    if (clazz->vtable == gDvm.classJavaLangObject->vtable ||
+        IS_CLASS_FLAG_SET(clazz, CLASS_SHAREDVTABLE))
+    {
         clazz->vtable = NULL;
     } else {
         NULL_AND_LINEAR_FREE(clazz->vtable);
@@ -2077,11 +2415,18 @@ void dvmFreeClassInnards(ClassObject* clazz)
     NULL_AND_LINEAR_FREE(clazz->interfaces);
 
     clazz->iftableCount = -1;
-    NULL_AND_LINEAR_FREE(clazz->iftable);
+    if (IS_CLASS_FLAG_SET(clazz, CLASS_SHAREDIFTABLE)) {
+        clazz->iftable = NULL;
+    } else {
+        NULL_AND_LINEAR_FREE(clazz->iftable);
+    }
 
     clazz->ifviPoolCount = -1;
     NULL_AND_LINEAR_FREE(clazz->ifviPool);
 
+    NULL_AND_LINEAR_FREE(clazz->superDisplay);
+    NULL_AND_LINEAR_FREE(clazz->imtable);
+
     clazz->sfieldCount = -1;
     /* The sfields are attached to the ClassObject, and will be freed
      * with it. */
@@ -2111,6 +2456,11 @@ static void freeMethodInnards(Method* meth)
      * verification or because we're caching an uncompressed form.
      */
     const RegisterMap* pMap = meth->registerMap;
+    if (pMap != NULL &&
+        dvmRegisterMapGetFormat(pMap) == kRegMapFormatDifferential)
+    {
+        dvmPurgeExpandedRegisterMap(meth);
+    }
     if (pMap != NULL && dvmRegisterMapGetOnHeap(pMap)) {
         dvmFreeRegisterMap((RegisterMap*) pMap);
         meth->registerMap = NULL;
@@ -2749,6 +3099,11 @@ bool dvmLinkClass(ClassObject* clazz)
         }
     }
 
+    if (!createSuperDisplay(clazz)) {
+        ALOGW("failed creating superclass display");
+        goto bail;
+    }
+
     /*
      * Populate vtable.
      */
@@ -2781,6 +3136,12 @@ bool dvmLinkClass(ClassObject* clazz)
     if (!createIftable(clazz))
         goto bail;
 
+    /*
+     * Hash interface methods to their implementations.
+     */
+    if (!createImtable(clazz))
+        goto bail;
+
     /*
      * Insert special-purpose "stub" method implementations.
      */
@@ -2817,10 +3178,12 @@ bool dvmLinkClass(ClassObject* clazz)
     /*
      * Done!
      */
-    if (IS_CLASS_FLAG_SET(clazz, CLASS_ISPREVERIFIED))
+    if (IS_CLASS_FLAG_SET(clazz, CLASS_ISPREVERIFIED)) {
         clazz->status = CLASS_VERIFIED;
-    else
+    } else {
         clazz->status = CLASS_RESOLVED;
+        dvmQueueBackgroundVerify(clazz);
+    }
     okay = true;
     if (gDvm.verboseClass)
         ALOGV("CLASS: linked '%s'", clazz->descriptor);
@@ -2854,6 +3217,37 @@ bail:
     return okay;
 }
 
+/*
+ * Create the superclass display: our superclass' display with ourselves
+ * appended.  If the superclass doesn't have one, neither do we, and
+ * subclass checks fall back to walking the chain.
+ */
+static bool createSuperDisplay(ClassObject* clazz)
+{
+    int depth = 0;
+
+    if (clazz->super != NULL) {
+        if (clazz->super->superDisplay == NULL)
+            return true;
+        depth = clazz->super->classDepth + 1;
+    }
+
+    ClassObject** display = (ClassObject**) dvmLinearAlloc(clazz->classLoader,
+                                sizeof(ClassObject*) * (depth + 1));
+    if (display == NULL)
+        return false;
+    if (depth != 0) {
+        memcpy(display, clazz->super->superDisplay,
+            sizeof(ClassObject*) * depth);
+    }
+    display[depth] = clazz;
+    dvmLinearReadOnly(clazz->classLoader, display);
+
+    clazz->classDepth = depth;
+    clazz->superDisplay = display;
+    return true;
+}
+
 /*
  * Create the virtual method table.
  *
@@ -2884,6 +3278,19 @@ static bool createVtable(ClassObject* clazz)
     }
     //ALOGD("+++ max vmethods for '%s' is %d", clazz->descriptor, maxCount);
 
+    /*
+     * If we don't declare any virtual methods, our vtable is identical to
+     * the superclass', so just point at it.  This is common for deep
+     * generated hierarchies.  createIftable() makes a private copy if it
+     * has to add Miranda methods.
+     */
+    if (clazz->super != NULL && clazz->virtualMethodCount == 0) {
+        clazz->vtable = clazz->super->vtable;
+        clazz->vtableCount = clazz->super->vtableCount;
+        SET_CLASS_FLAG(clazz, CLASS_SHAREDVTABLE);
+        return true;
+    }
+
     /*
      * Over-allocate the table, then realloc it down if necessary.  So
      * long as we don't allocate anything in between we won't cause
@@ -2932,6 +3339,15 @@ static bool createVtable(ClassObject* clazz)
                               superMeth->clazz->descriptor);
                     }
 
+                    if (!superMeth->isOverridden) {
+                        ClassObject* superClazz = superMeth->clazz;
+                        dvmLinearReadWrite(superClazz->classLoader,
+                                           superClazz->virtualMethods);
+                        superMeth->isOverridden = true;
+                        dvmLinearReadOnly(superClazz->classLoader,
+                                          superClazz->virtualMethods);
+                    }
+
                     clazz->vtable[si] = localMeth;
                     localMeth->methodIndex = (u2) si;
                     //ALOGV("+++   override %s.%s (slot %d)",
@@ -3045,6 +3461,19 @@ static bool createIftable(ClassObject* clazz)
         return true;
     }
 
+    /*
+     * If we don't implement anything directly, our table would be an
+     * exact copy of the superclass', vtable indices and all (the indices
+     * for inherited interfaces always come from the superclass).  Share it.
+     */
+    if (clazz->interfaceCount == 0) {
+        assert(ifCount == superIfCount);
+        clazz->iftable = clazz->super->iftable;
+        clazz->iftableCount = superIfCount;
+        SET_CLASS_FLAG(clazz, CLASS_SHAREDIFTABLE);
+        return true;
+    }
+
     /*
      * Create a table with enough space for all interfaces, and copy the
      * superclass' table in.
@@ -3331,6 +3760,22 @@ static bool createIftable(ClassObject* clazz)
                 clazz->descriptor, mirandaCount);
         }
 
+        /*
+         * We're about to modify the vtable, so if we borrowed it from the
+         * superclass we need our own copy first.
+         */
+        if (IS_CLASS_FLAG_SET(clazz, CLASS_SHAREDVTABLE)) {
+            Method** ownVtable = (Method**) dvmLinearAlloc(clazz->classLoader,
+                sizeof(Method*) * clazz->vtableCount);
+            if (ownVtable == NULL)
+                goto bail;
+            memcpy(ownVtable, clazz->vtable,
+                sizeof(Method*) * clazz->vtableCount);
+            dvmLinearReadOnly(clazz->classLoader, ownVtable);
+            clazz->vtable = ownVtable;
+            CLEAR_CLASS_FLAG(clazz, CLASS_SHAREDVTABLE);
+        }
+
         /*
          * We found methods in one or more interfaces for which we do not
          * have vtable entries.  We have to expand our virtualMethods
@@ -3460,6 +3905,51 @@ bail:
 }
 
 
+/*
+ * Create the interface method table for classes that implement enough
+ * interfaces for the linear "iftable" scan to hurt.  This must run after
+ * createIftable(), which may still be moving the vtable around.
+ *
+ * Returns "true" on success.
+ */
+static bool createImtable(ClassObject* clazz)
+{
+    if (dvmIsInterfaceClass(clazz) || clazz->iftableCount < IMT_MIN_INTERFACES)
+        return true;
+
+    ImtEntry* imtable = (ImtEntry*) dvmLinearAlloc(clazz->classLoader,
+                            sizeof(ImtEntry) * IMT_SIZE);
+    if (imtable == NULL)
+        return false;
+    memset(imtable, 0, sizeof(ImtEntry) * IMT_SIZE);
+
+    for (int i = 0; i < clazz->iftableCount; i++) {
+        const ClassObject* iface = clazz->iftable[i].clazz;
+        const int* methodIndexArray = clazz->iftable[i].methodIndexArray;
+
+        if (methodIndexArray == NULL)
+            continue;
+
+        for (int j = 0; j < iface->virtualMethodCount; j++) {
+            const Method* imethod = &iface->virtualMethods[j];
+            ImtEntry* pEntry = &imtable[dvmImtSlot(imethod)];
+
+            /* first one wins; the rest use the slow path */
+            if (pEntry->imethod != NULL)
+                continue;
+
+            int vtableIndex = methodIndexArray[j];
+            assert(vtableIndex >= 0 && vtableIndex < clazz->vtableCount);
+            pEntry->imethod = imethod;
+            pEntry->target = clazz->vtable[vtableIndex];
+        }
+    }
+
+    dvmLinearReadOnly(clazz->classLoader, imtable);
+    clazz->imtable = imtable;
+    return true;
+}
+
 /*
  * Provide "stub" implementations for methods without them.
  *
@@ -3514,7 +4004,29 @@ static inline void swapField(InstField* pOne, InstField* pTwo)
 }
 
 /*
- * Assign instance fields to u4 slots.
+ * Returns the number of bytes an instance field occupies.  Volatile
+ * sub-word fields keep a whole word, because the volatile accessors and
+ * the -volatile opcodes always move 32 bits.
+ */
+static size_t instFieldSize(const InstField* pField)
+{
+    switch (pField->signature[0]) {
+    case 'J':
+    case 'D':
+        return 8;
+    case 'Z':
+    case 'B':
+        return dvmIsVolatileField(pField) ? 4 : 1;
+    case 'C':
+    case 'S':
+        return dvmIsVolatileField(pField) ? 4 : 2;
+    default:
+        return 4;
+    }
+}
+
+/*
+ * Assign instance fields to slots.
  *
  * The top portion of the instance field area is occupied by the superclass
  * fields, the bottom by the fields for this class.
@@ -3527,6 +4039,12 @@ static inline void swapField(InstField* pOne, InstField* pTwo)
  * we want to move non-reference 32-bit fields into gaps rather than
  * creating pad words.
  *
+ * Non-volatile boolean, byte, char and short fields are packed at the
+ * end with byte or halfword granularity, after the 32-bit fields, and
+ * the object size is rounded up to a word.  Their accessors (and the
+ * interpreters and the JIT) load and store exactly the field's width,
+ * and such fields are never rewritten to the word-sized -quick opcodes.
+ *
  * In the worst case we will waste 4 bytes, but because objects are
  * allocated on >= 64-bit boundaries, those bytes may well be wasted anyway
  * (assuming this is the most-derived class).
@@ -3619,101 +4137,68 @@ static bool computeFieldOffsets(ClassObject* clazz)
     /*
      * Now we want to pack all of the double-wide fields together.  If we're
      * not aligned, though, we want to shuffle one 32-bit field into place.
-     * If we can't find one, we'll have to pad it.
+     * If we can't find one, we'll have to pad it -- unless there are no
+     * double-wide fields, in which case the sub-word fields can use the
+     * space.
      */
     if (i != clazz->ifieldCount && (fieldOffset & 0x04) != 0) {
         LOGVV("  +++ not aligned");
 
-        InstField* pField = &clazz->ifields[i];
-        char c = pField->signature[0];
-
-        if (c != 'J' && c != 'D') {
-            /*
-             * The field that comes next is 32-bit, so just advance past it.
-             */
-            assert(c != '[' && c != 'L');
+        bool haveWide = false;
+        int single = -1;
+        for (j = i; j < clazz->ifieldCount; j++) {
+            size_t size = instFieldSize(&clazz->ifields[j]);
+            if (size == 8) {
+                haveWide = true;
+            } else if (size == 4 && single < 0) {
+                single = j;
+            }
+        }
+        if (single >= 0) {
+            InstField* pField = &clazz->ifields[i];
+            if (single != i) {
+                swapField(pField, &clazz->ifields[single]);
+                LOGVV("  +++ swapped '%s' for alignment", pField->name);
+            }
+            assert(pField->signature[0] != '[' && pField->signature[0] != 'L');
             pField->byteOffset = fieldOffset;
             fieldOffset += sizeof(u4);
             i++;
-            LOGVV("  --- offset2 '%s'=%d",
-                pField->name, pField->byteOffset);
-        } else {
-            /*
-             * Next field is 64-bit, so search for a 32-bit field we can
-             * swap into it.
-             */
-            bool found = false;
-            j = clazz->ifieldCount - 1;
-            while (j > i) {
-                InstField* singleField = &clazz->ifields[j--];
-                char rc = singleField->signature[0];
-
-                if (rc != 'J' && rc != 'D') {
-                    swapField(pField, singleField);
-                    //c = rc;
-                    LOGVV("  +++ swapped '%s' for alignment",
-                        pField->name);
-                    pField->byteOffset = fieldOffset;
-                    fieldOffset += sizeof(u4);
-                    LOGVV("  --- offset3 '%s'=%d",
-                        pField->name, pField->byteOffset);
-                    found = true;
-                    i++;
-                    break;
-                }
-            }
-            if (!found) {
-                ALOGV("  +++ inserting pad field in '%s'", clazz->descriptor);
-                fieldOffset += sizeof(u4);
-            }
+            LOGVV("  --- offset2 '%s'=%d", pField->name, pField->byteOffset);
+        } else if (haveWide) {
+            ALOGV("  +++ inserting pad field in '%s'", clazz->descriptor);
+            fieldOffset += sizeof(u4);
         }
     }
 
     /*
-     * Alignment is good, shuffle any double-wide fields forward, and
-     * finish assigning field offsets to all fields.
+     * Alignment is good, so order the remaining fields from the widest to
+     * the narrowest and give each one exactly the space it needs.  Every
+     * field then starts out naturally aligned.  (quicksort-style
+     * partitioning, one pass per size)
      */
-    assert(i == clazz->ifieldCount || (fieldOffset & 0x04) == 0);
-    j = clazz->ifieldCount - 1;
-    for ( ; i < clazz->ifieldCount; i++) {
-        InstField* pField = &clazz->ifields[i];
-        char c = pField->signature[0];
-
-        if (c != 'D' && c != 'J') {
-            /* This isn't a double-wide field; see if any double fields
-             * follow this one.  If so, we'll move it to this position.
-             * (quicksort-style partitioning)
-             */
-            while (j > i) {
-                InstField* doubleField = &clazz->ifields[j--];
-                char rc = doubleField->signature[0];
-
-                if (rc == 'D' || rc == 'J') {
-                    /* Here's a double-wide field that follows at least one
-                     * non-double field.  Swap it with the current field.
-                     * (When this returns, "pField" points to the reference
-                     * field, and "doubleField" points to the non-double field.)
-                     */
-                    swapField(pField, doubleField);
-                    c = rc;
-
-                    break;
-                }
+    static const size_t kFieldSizes[] = { 8, 4, 2 };
+    int next = i;
+    for (int k = 0; k < NELEM(kFieldSizes); k++) {
+        for (j = next; j < clazz->ifieldCount; j++) {
+            if (instFieldSize(&clazz->ifields[j]) == kFieldSizes[k]) {
+                if (j != next)
+                    swapField(&clazz->ifields[next], &clazz->ifields[j]);
+                next++;
             }
-            /* We may or may not have swapped a field.
-             */
-        } else {
-            /* This is a double-wide field, leave it be.
-             */
         }
+    }
+    for ( ; i < clazz->ifieldCount; i++) {
+        InstField* pField = &clazz->ifields[i];
 
         pField->byteOffset = fieldOffset;
         LOGVV("  --- offset4 '%s'=%d", pField->name,pField->byteOffset);
-        fieldOffset += sizeof(u4);
-        if (c == 'J' || c == 'D')
-            fieldOffset += sizeof(u4);
+        fieldOffset += instFieldSize(pField);
     }
 
+    /* Subclass fields and the allocator expect a word-aligned size */
+    fieldOffset = (fieldOffset + 3) & ~3;
+
 #ifndef NDEBUG
     /* Make sure that all reference fields appear before
      * non-reference fields, and all double-wide fields are aligned.
@@ -3726,6 +4211,7 @@ static bool computeFieldOffsets(ClassObject* clazz)
         if (c == 'D' || c == 'J') {
             assert((pField->byteOffset & 0x07) == 0);
         }
+        assert((pField->byteOffset & (instFieldSize(pField) - 1)) == 0);
 
         if (c != '[' && c != 'L') {
             if (!j) {
@@ -3905,8 +4391,6 @@ static void initSFields(ClassObject* clazz)
  * Determine whether "descriptor" yields the same class object in the
  * context of clazz1 and clazz2.
  *
- * The caller must hold gDvm.loadedClasses.
- *
  * Returns "true" if they match.
  */
 static bool compareDescriptorClasses(const char* descriptor,
@@ -3931,16 +4415,12 @@ static bool compareDescriptorClasses(const char* descriptor,
      * The initiating loader test should catch the majority of cases
      * (in particular, the zillions of references to String/Object).
      *
-     * Unfortunately we're still stuck grabbing a mutex to do the lookup.
-     *
      * For this to work, the superclass/interface should be the first
      * argument, so that way if it's from the bootstrap loader this test
      * will work.  (The bootstrap loader, by definition, never shows up
      * as the initiating loader of a class defined by some other loader.)
      */
-    dvmHashTableLock(gDvm.loadedClasses);
     bool isInit = dvmLoaderInInitiatingList(result1, clazz2->classLoader);
-    dvmHashTableUnlock(gDvm.loadedClasses);
 
     if (isInit) {
         //printf("%s(obj=%p) / %s(cl=%p): initiating\n",
@@ -4165,6 +4645,74 @@ bool dvmIsClassInitializing(const ClassObject* clazz)
             clazz->initThreadId == dvmThreadSelf()->threadId);
 }
 
+/*
+ * Returns true if the verification mode calls for verifying "clazz" if
+ * dexopt did not.
+ */
+bool dvmLateVerifyNeeded(const ClassObject* clazz)
+{
+    if (gDvm.classVerifyMode == VERIFY_MODE_NONE)
+        return false;
+    if (gDvm.classVerifyMode == VERIFY_MODE_REMOTE &&
+        clazz->classLoader == NULL)
+        return false;
+    return true;
+}
+
+/*
+ * Verify a linked class that dexopt did not verify, or just mark it
+ * verified if the verification mode doesn't call for it.  The caller must
+ * hold the class's lock, and the class must be in the CLASS_RESOLVED
+ * state.  This normally happens in dvmInitClass, but the background
+ * verifier may get to the class first.
+ *
+ * On failure the class is marked erroneous, with its verifyErrorClass
+ * set, and a VerifyError is thrown in the current thread.
+ */
+bool dvmLateVerifyClass(ClassObject* clazz)
+{
+    assert(clazz->status == CLASS_RESOLVED);
+    assert(!IS_CLASS_FLAG_SET(clazz, CLASS_ISPREVERIFIED));
+
+    if (!dvmLateVerifyNeeded(clazz)) {
+        /* advance to "verified" state */
+        ALOGV("+++ not verifying class %s (cl=%p)",
+            clazz->descriptor, clazz->classLoader);
+        clazz->status = CLASS_VERIFIED;
+        return true;
+    }
+
+    if (!gDvm.optimizing)
+        ALOGV("+++ late verify on %s", clazz->descriptor);
+
+    /*
+     * We're not supposed to optimize an unverified class, but during
+     * development this mode was useful.  We can't verify an optimized
+     * class because the optimization process discards information.
+     */
+    if (IS_CLASS_FLAG_SET(clazz, CLASS_ISOPTIMIZED)) {
+        ALOGW("Class '%s' was optimized without verification; "
+             "not verifying now",
+            clazz->descriptor);
+        ALOGW("  ('rm /data/dalvik-cache/*' and restart to fix this)");
+        goto verify_failed;
+    }
+
+    clazz->status = CLASS_VERIFYING;
+    if (!dvmVerifyClass(clazz)) {
+verify_failed:
+        dvmThrowVerifyError(clazz->descriptor);
+        dvmSetFieldObject((Object*) clazz,
+            OFFSETOF_MEMBER(ClassObject, verifyErrorClass),
+            (Object*) dvmGetException(dvmThreadSelf())->clazz);
+        clazz->status = CLASS_ERROR;
+        return false;
+    }
+
+    clazz->status = CLASS_VERIFIED;
+    return true;
+}
+
 /*
  * If a class has not been initialized, do so by executing the code in
  * <clinit>.  The sequence is described in the VM spec v2 2.17.5.
@@ -4236,6 +4784,9 @@ bool dvmInitClass(ClassObject* clazz)
 #if LOG_CLASS_LOADING
     bool initializedByUs = false;
 #endif
+#if defined(WITH_JIT)
+    bool initializedNow = false;
+#endif
 
     Thread* self = dvmThreadSelf();
     const Method* method;
@@ -4255,50 +4806,9 @@ bool dvmInitClass(ClassObject* clazz)
             goto bail_unlock;
         }
 
-        assert(clazz->status == CLASS_RESOLVED);
-        assert(!IS_CLASS_FLAG_SET(clazz, CLASS_ISPREVERIFIED));
-
-        if (gDvm.classVerifyMode == VERIFY_MODE_NONE ||
-            (gDvm.classVerifyMode == VERIFY_MODE_REMOTE &&
-             clazz->classLoader == NULL))
-        {
-            /* advance to "verified" state */
-            ALOGV("+++ not verifying class %s (cl=%p)",
-                clazz->descriptor, clazz->classLoader);
-            clazz->status = CLASS_VERIFIED;
-            goto noverify;
-        }
-
-        if (!gDvm.optimizing)
-            ALOGV("+++ late verify on %s", clazz->descriptor);
-
-        /*
-         * We're not supposed to optimize an unverified class, but during
-         * development this mode was useful.  We can't verify an optimized
-         * class because the optimization process discards information.
-         */
-        if (IS_CLASS_FLAG_SET(clazz, CLASS_ISOPTIMIZED)) {
-            ALOGW("Class '%s' was optimized without verification; "
-                 "not verifying now",
-                clazz->descriptor);
-            ALOGW("  ('rm /data/dalvik-cache/*' and restart to fix this)");
-            goto verify_failed;
-        }
-
-        clazz->status = CLASS_VERIFYING;
-        if (!dvmVerifyClass(clazz)) {
-verify_failed:
-            dvmThrowVerifyError(clazz->descriptor);
-            dvmSetFieldObject((Object*) clazz,
-                OFFSETOF_MEMBER(ClassObject, verifyErrorClass),
-                (Object*) dvmGetException(self)->clazz);
-            clazz->status = CLASS_ERROR;
+        if (!dvmLateVerifyClass(clazz))
             goto bail_unlock;
-        }
-
-        clazz->status = CLASS_VERIFIED;
     }
-noverify:
 
     /*
      * We need to ensure that certain instructions, notably accesses to
@@ -4495,6 +5005,10 @@ noverify:
         dvmLockObject(self, (Object*) clazz);
         clazz->status = CLASS_INITIALIZED;
         LOGVV("Initialized class: %s", clazz->descriptor);
+        dvmBumpThreadMetric(self, kThreadMetricClassInits, 1);
+#if defined(WITH_JIT)
+        initializedNow = true;
+#endif
 
         /*
          * Update alloc counters.  TODO: guard with mutex.
@@ -4525,6 +5039,13 @@ bail_unlock:
 
     dvmUnlockObject(self, (Object*) clazz);
 
+#if defined(WITH_JIT)
+    /* Its methods can run now, so let its saved trace heads go off */
+    if (initializedNow) {
+        dvmCompilerWarmStartClass(clazz);
+    }
+#endif
+
     return (clazz->status != CLASS_ERROR);
 }
 
@@ -4605,17 +5126,16 @@ void dvmSetRegisterMap(Method* method, const RegisterMap* pMap)
 }
 
 /*
- * dvmHashForeach callback.  A nonzero return value causes foreach to
- * bail out.
+ * Hash table compare function for dvmFindLoadedClass.  Unlike
+ * hashcmpClassByCrit, this matches on the descriptor alone, so a class
+ * defined by any loader will do.
  */
-static int findClassCallback(void* vclazz, void* arg)
+static int hashcmpClassByDescriptor(const void* vclazz, const void* vdescriptor)
 {
-    ClassObject* clazz = (ClassObject*)vclazz;
-    const char* descriptor = (const char*) arg;
+    const ClassObject* clazz = (const ClassObject*) vclazz;
+    const char* descriptor = (const char*) vdescriptor;
 
-    if (strcmp(clazz->descriptor, descriptor) == 0)
-        return (int) clazz;
-    return 0;
+    return strcmp(clazz->descriptor, descriptor);
 }
 
 /*
@@ -4630,14 +5150,20 @@ static int findClassCallback(void* vclazz, void* arg)
  */
 ClassObject* dvmFindLoadedClass(const char* descriptor)
 {
-    int result;
+    ClassObject* clazz;
 
+    /*
+     * Every class is added with the hash of its descriptor, so all of the
+     * candidates sit on one probe chain and we don't need to walk the
+     * whole table.
+     */
     dvmHashTableLock(gDvm.loadedClasses);
-    result = dvmHashForeach(gDvm.loadedClasses, findClassCallback,
-            (void*) descriptor);
+    clazz = (ClassObject*) dvmHashTableLookup(gDvm.loadedClasses,
+            dvmComputeUtf8Hash(descriptor), (void*) descriptor,
+            hashcmpClassByDescriptor, false);
     dvmHashTableUnlock(gDvm.loadedClasses);
 
-    return (ClassObject*) result;
+    return clazz;
 }
 
 /*
@@ -90,6 +90,12 @@ ClassObject* dvmFindClassNoInit(const char* descriptor, Object* loader);
 ClassObject* dvmFindSystemClass(const char* descriptor);
 ClassObject* dvmFindSystemClassNoInit(const char* descriptor);
 
+/*
+ * Load and link a list of system classes on several threads at once.
+ */
+int dvmPreloadClasses(const char* const* descriptors, int count,
+    int numThreads);
+
 /*
  * Find a loaded class by descriptor. Returns the first one found.
  * Because there can be more than one if class loaders are involved,
@@ -130,6 +136,14 @@ bool dvmIsClassInitializing(const ClassObject* clazz);
  */
 extern "C" bool dvmInitClass(ClassObject* clazz);
 
+/*
+ * Verify a linked class that dexopt did not verify.  The caller must hold
+ * the class's lock.  Throws VerifyError and marks the class erroneous on
+ * failure.
+ */
+bool dvmLateVerifyNeeded(const ClassObject* clazz);
+bool dvmLateVerifyClass(ClassObject* clazz);
+
 /*
  * Retrieve the system class loader.
  */
@@ -140,10 +154,14 @@ Object* dvmGetSystemClassLoader(void);
  */
 ClassObject* dvmLookupClass(const char* descriptor, Object* loader,
     bool unprepOkay);
+/* like dvmLookupClass, with dvmComputeUtf8Hash(descriptor) precomputed */
+ClassObject* dvmLookupClassWithHash(const char* descriptor, u4 hash,
+    Object* loader, bool unprepOkay);
 void dvmFreeClassInnards(ClassObject* clazz);
 bool dvmAddClassToHash(ClassObject* clazz);
 void dvmAddInitiatingLoader(ClassObject* clazz, Object* loader);
 bool dvmLoaderInInitiatingList(const ClassObject* clazz, const Object* loader);
+void dvmFreeRetiredClassTableMemory(void);
 
 /*
  * Update method's "nativeFunc" and "insns".  If "insns" is NULL, the
@@ -176,6 +194,14 @@ void dvmSetBootPathExtraDex(DvmDex* pDvmDex);
 void dvmDumpClass(const ClassObject* clazz, int flags);
 void dvmDumpAllClasses(int flags);
 void dvmDumpLoaderStats(const char* msg);
+
+/*
+ * Fill the boot class path DEX files' resolved-class tables with the
+ * classes that are already loaded, so that processes forked from the
+ * zygote share the filled pages instead of writing their own copies.
+ * The first call also interns the boot string literals, with -Xpreintern.
+ */
+void dvmPrefillBootDexCaches(void);
 int  dvmGetNumLoadedClasses();
 
 /* flags for dvmDumpClass / dvmDumpAllClasses */
@@ -684,13 +684,19 @@ const Method* dvmGetVirtualizedMethod(const ClassObject* clazz,
     /*
      * If the method was declared in an interface, we need to scan through
      * the class' list of interfaces for it, and find the vtable index
-     * from that.
-     *
-     * TODO: use the interface cache.
+     * from that, unless the class' interface method table has it.
      */
     if (dvmIsInterfaceClass(meth->clazz)) {
         int i;
 
+        if (clazz->imtable != NULL) {
+            const ImtEntry* pEntry = &clazz->imtable[dvmImtSlot(meth)];
+            if (pEntry->imethod == meth) {
+                actualMeth = pEntry->target;
+                goto found;
+            }
+        }
+
         for (i = 0; i < clazz->iftableCount; i++) {
             if (clazz->iftable[i].clazz == meth->clazz)
                 break;
@@ -709,6 +715,7 @@ const Method* dvmGetVirtualizedMethod(const ClassObject* clazz,
     assert(methodIndex >= 0 && methodIndex < clazz->vtableCount);
     actualMeth = clazz->vtable[methodIndex];
 
+found:
     /*
      * Make sure there's code to execute.
      */
@@ -776,6 +783,12 @@ void dvmDumpObject(const Object* obj)
                     lval = dvmGetFieldLong(obj, pField->byteOffset);
                 else if (type == 'Z')
                     lval = dvmGetFieldBoolean(obj, pField->byteOffset);
+                else if (type == 'B')
+                    lval = dvmGetFieldByte(obj, pField->byteOffset);
+                else if (type == 'C')
+                    lval = dvmGetFieldChar(obj, pField->byteOffset);
+                else if (type == 'S')
+                    lval = dvmGetFieldShort(obj, pField->byteOffset);
                 else
                     lval = dvmGetFieldInt(obj, pField->byteOffset);
 
@@ -77,6 +77,9 @@ enum ClassFlags {
 
     CLASS_MULTIPLE_DEFS        = (1<<23), // DEX verifier: defs in multiple DEXs
 
+    CLASS_SHAREDVTABLE         = (1<<22), // vtable belongs to the superclass
+    CLASS_SHAREDIFTABLE        = (1<<21), // iftable belongs to the superclass
+
     /* unlike the others, these can be present in the optimized DEX file */
     CLASS_ISOPTIMIZED          = (1<<17), // class may contain opt instrs
     CLASS_ISPREVERIFIED        = (1<<16), // class has been pre-verified
@@ -191,6 +194,30 @@ struct InterfaceEntry {
     int*            methodIndexArray;
 };
 
+/*
+ * One slot in a class' interface method table.  "imethod" is the abstract
+ * method declared in the interface, "target" is what it resolves to for
+ * this class.  An empty slot has a NULL imethod.
+ */
+struct ImtEntry {
+    const Method*   imethod;
+    Method*         target;
+};
+
+/* number of slots in an interface method table; must be a power of 2 */
+#define IMT_SIZE            32
+
+/* only classes with at least this many interfaces get a table */
+#define IMT_MIN_INTERFACES  4
+
+/*
+ * Pick the interface method table slot for an interface method.  Method
+ * structs are tens of bytes apart, so mix the pointer a bit.
+ */
+INLINE u4 dvmImtSlot(const Method* imethod) {
+    return (((u4) imethod >> 3) * 0x9e3779b1) >> 27;
+}
+
 
 
 /*
@@ -469,6 +496,43 @@ struct ClassObject : Object {
     /* source file name, if known */
     const char*     sourceFile;
 
+    /*
+     * Superclass display: superDisplay[i] is our ancestor at depth i
+     * (java.lang.Object is at depth 0) and superDisplay[classDepth] is
+     * this class, so subclass tests don't have to walk "super".  NULL for
+     * array and primitive classes, and for anything not yet linked.
+     */
+    int             classDepth;
+    ClassObject**   superDisplay;
+
+    /*
+     * Interface method table: a small hash from interface method to the
+     * implementation, built at link time for classes that implement many
+     * interfaces, so an interface dispatch that misses the caches doesn't
+     * have to scan "iftable".  Where two methods hash to the same slot
+     * only the first is recorded; the others take the scan.  May be NULL.
+     */
+    ImtEntry*       imtable;
+
+    /*
+     * The java.lang.reflect objects made for our members so far, one slot
+     * per field (sfields, then ifields) and per method (directMethods,
+     * then virtualMethods).  Callers only ever get copies.  Allocated on
+     * first use; dropped by a GC that clears soft references.
+     */
+    ArrayObject*    reflectCache;
+
+    /*
+     * Live instances and their bytes, counted by marking for the class
+     * loader accounting and cleared by dvmMetricsRecordLoaderUsage().
+     */
+    u4              gcLiveObjects;
+    u4              gcLiveBytes;
+
+    /* the same counts as of the last collection that took them */
+    u4              lastLiveObjects;
+    u4              lastLiveBytes;
+
     /* static fields */
     int             sfieldCount;
     StaticField     sfields[0]; /* MUST be last item */
@@ -550,8 +614,9 @@ struct Method {
 
     /*
      * JNI: true if this static non-synchronized native method (that has no
-     * reference arguments) needs a JNIEnv* and jclass/jobject. Libcore
-     * uses this.
+     * reference arguments other than primitive arrays) was registered
+     * with a '!' signature, and is called through the fast JNI bridge.
+     * Libcore uses this.
      */
     bool fastJni;
 
@@ -580,6 +645,19 @@ struct Method {
 
     /* set if method was called during method profiling */
     bool            inProfile;
+
+    /*
+     * Set once a loaded class overrides this method.  JIT code that binds
+     * a virtual call to the method without checking the receiver's class
+     * tests this first.
+     */
+    bool            isOverridden;
+
+    /*
+     * Proxy: true if the method takes only reference arguments, which go
+     * into the handler's Object[] without boxing.
+     */
+    bool            refArgsOnly;
 };
 
 
@@ -715,6 +793,9 @@ INLINE bool dvmIsBytecodeMethod(const Method* method) {
     return (method->accessFlags & (ACC_NATIVE | ACC_ABSTRACT)) == 0;
 }
 
+INLINE bool dvmIsPublicField(const Field* field) {
+    return (field->accessFlags & ACC_PUBLIC) != 0;
+}
 INLINE bool dvmIsProtectedField(const Field* field) {
     return (field->accessFlags & ACC_PROTECTED) != 0;
 }
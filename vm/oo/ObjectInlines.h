@@ -39,8 +39,10 @@ INLINE void dvmSetObjectArrayElement(const ArrayObject* obj, int index,
  * We guarantee that long/double field data is 64-bit aligned, so it's safe
  * to access them with ldrd/strd on ARM.
  *
- * The VM treats all fields as 32 or 64 bits, so the field set functions
- * write 32 bits even if the underlying type is smaller.
+ * Non-volatile boolean, byte, char and short fields may share a word with
+ * their neighbors (see computeFieldOffsets), so their set functions write
+ * exactly the field's width.  The volatile ones still occupy a full word
+ * and are read and written 32 bits at a time.
  *
  * Setting Object types to non-null values includes a call to the
  * write barrier.
@@ -52,16 +54,16 @@ INLINE JValue* dvmFieldPtr(const Object* obj, int offset) {
 }
 
 INLINE bool dvmGetFieldBoolean(const Object* obj, int offset) {
-    return ((JValue*)BYTE_OFFSET(obj, offset))->z;
+    return *(u1*)BYTE_OFFSET(obj, offset);
 }
 INLINE s1 dvmGetFieldByte(const Object* obj, int offset) {
-    return ((JValue*)BYTE_OFFSET(obj, offset))->b;
+    return *(s1*)BYTE_OFFSET(obj, offset);
 }
 INLINE s2 dvmGetFieldShort(const Object* obj, int offset) {
-    return ((JValue*)BYTE_OFFSET(obj, offset))->s;
+    return *(s2*)BYTE_OFFSET(obj, offset);
 }
 INLINE u2 dvmGetFieldChar(const Object* obj, int offset) {
-    return ((JValue*)BYTE_OFFSET(obj, offset))->c;
+    return *(u2*)BYTE_OFFSET(obj, offset);
 }
 INLINE s4 dvmGetFieldInt(const Object* obj, int offset) {
     return ((JValue*)BYTE_OFFSET(obj, offset))->i;
@@ -123,16 +125,16 @@ INLINE Object* dvmGetFieldObjectVolatile(const Object* obj, int offset) {
 }
 
 INLINE void dvmSetFieldBoolean(Object* obj, int offset, bool val) {
-    ((JValue*)BYTE_OFFSET(obj, offset))->i = val;
+    *(u1*)BYTE_OFFSET(obj, offset) = val;
 }
 INLINE void dvmSetFieldByte(Object* obj, int offset, s1 val) {
-    ((JValue*)BYTE_OFFSET(obj, offset))->i = val;
+    *(s1*)BYTE_OFFSET(obj, offset) = val;
 }
 INLINE void dvmSetFieldShort(Object* obj, int offset, s2 val) {
-    ((JValue*)BYTE_OFFSET(obj, offset))->i = val;
+    *(s2*)BYTE_OFFSET(obj, offset) = val;
 }
 INLINE void dvmSetFieldChar(Object* obj, int offset, u2 val) {
-    ((JValue*)BYTE_OFFSET(obj, offset))->i = val;
+    *(u2*)BYTE_OFFSET(obj, offset) = val;
 }
 INLINE void dvmSetFieldInt(Object* obj, int offset, s4 val) {
     ((JValue*)BYTE_OFFSET(obj, offset))->i = val;
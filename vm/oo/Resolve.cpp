@@ -92,7 +92,21 @@ ClassObject* dvmResolveClass(const ClassObject* referrer, u4 classIdx,
         /* primitive type */
         resClass = dvmFindPrimitiveClass(className[0]);
     } else {
-        resClass = dvmFindClassNoInit(className, referrer->classLoader);
+        /*
+         * If dexopt stored the descriptor's hash, look for a loaded class
+         * without hashing the string.  This is the first thing the find
+         * path does anyway; a miss just goes the long way around.
+         */
+        u4 hash;
+        resClass = NULL;
+        if (className[0] != '[' &&
+            dexGetTypeIdHash(pDvmDex->pDexFile, classIdx, &hash))
+        {
+            resClass = dvmLookupClassWithHash(className, hash,
+                referrer->classLoader, false);
+        }
+        if (resClass == NULL)
+            resClass = dvmFindClassNoInit(className, referrer->classLoader);
     }
 
     if (resClass != NULL) {
@@ -507,6 +521,28 @@ StaticField* dvmResolveStaticField(const ClassObject* referrer, u4 sfieldIdx)
 }
 
 
+/*
+ * Create the String object for a string ID.  If dexopt stored the literal,
+ * its UTF-16 contents and hash are copied straight out of the opt data.
+ *
+ * The caller must call dvmReleaseTrackedAlloc() on the return value.
+ */
+static StringObject* createLiteral(const DvmDex* pDvmDex, u4 stringIdx)
+{
+    const DexFile* pDexFile = pDvmDex->pDexFile;
+    const u2* chars;
+    const DexStringLiteral* pLiteral =
+        dexFindStringLiteral(pDexFile, stringIdx, &chars);
+    if (pLiteral != NULL) {
+        return dvmCreateStringFromUnicodeAndHash(chars, pLiteral->length,
+            pLiteral->hash);
+    }
+
+    u4 utf16Size;
+    const char* utf8 = dexStringAndSizeById(pDexFile, stringIdx, &utf16Size);
+    return dvmCreateStringFromCstrAndLength(utf8, utf16Size);
+}
+
 /*
  * Resolve a string reference.
  *
@@ -519,8 +555,6 @@ StringObject* dvmResolveString(const ClassObject* referrer, u4 stringIdx)
     DvmDex* pDvmDex = referrer->pDvmDex;
     StringObject* strObj;
     StringObject* internStrObj;
-    const char* utf8;
-    u4 utf16Size;
 
     LOGVV("+++ resolving string, referrer is %s", referrer->descriptor);
 
@@ -528,8 +562,7 @@ StringObject* dvmResolveString(const ClassObject* referrer, u4 stringIdx)
      * Create a UTF-16 version so we can trivially compare it to what's
      * already interned.
      */
-    utf8 = dexStringAndSizeById(pDvmDex->pDexFile, stringIdx, &utf16Size);
-    strObj = dvmCreateStringFromCstrAndLength(utf8, utf16Size);
+    strObj = createLiteral(pDvmDex, stringIdx);
     if (strObj == NULL) {
         /* ran out of space in GC heap? */
         assert(dvmCheckException(dvmThreadSelf()));
@@ -562,6 +595,106 @@ bail:
     return strObj;
 }
 
+/* (documented in header) */
+int dvmPreInternStringLiterals(DvmDex* pDvmDex)
+{
+    const DexStringLiterals* pLiterals = pDvmDex->pDexFile->pStringLiterals;
+    if (pLiterals == NULL)
+        return 0;
+
+    const u2* chars = dexStringLiteralChars(pLiterals);
+    u4 stringIdsSize = pDvmDex->pHeader->stringIdsSize;
+    int numInterned = 0;
+
+    for (u4 i = 0; i < pLiterals->count; i++) {
+        const DexStringLiteral* pEntry = &pLiterals->entries[i];
+        if (pEntry->stringIdx >= stringIdsSize ||
+            (u8) pEntry->charsOff + pEntry->length > pLiterals->charsCount)
+        {
+            continue;
+        }
+        if (dvmDexGetResolvedString(pDvmDex, pEntry->stringIdx) != NULL)
+            continue;
+
+        StringObject* strObj = dvmCreateStringFromUnicodeAndHash(
+            chars + pEntry->charsOff, pEntry->length, pEntry->hash);
+        if (strObj == NULL) {
+            /* out of heap; the rest resolve on first use as usual */
+            dvmClearException(dvmThreadSelf());
+            break;
+        }
+        StringObject* internStrObj = dvmLookupImmortalInternedString(strObj);
+        dvmReleaseTrackedAlloc((Object*) strObj, NULL);
+        if (internStrObj == NULL) {
+            dvmClearException(dvmThreadSelf());
+            break;
+        }
+        dvmDexSetResolvedString(pDvmDex, pEntry->stringIdx, internStrObj);
+        numInterned++;
+    }
+
+    return numInterned;
+}
+
+/*
+ * Body of the pre-resolution thread.  "arg" is a class from the DEX file,
+ * which supplies the class loader and the resolved-class table.  Classes
+ * are never unloaded, so it stays valid.
+ */
+static void* preResolveThreadStart(void* arg)
+{
+    const ClassObject* referrer = (const ClassObject*) arg;
+    const DexFile* pDexFile = referrer->pDvmDex->pDexFile;
+    u4 typeIdsSize = referrer->pDvmDex->pHeader->typeIdsSize;
+    Thread* self = dvmThreadSelf();
+    u4 numResolved = 0;
+
+    for (u4 i = 0; i < pDexFile->resolveProfileCount; i++) {
+        u4 classIdx = pDexFile->pResolveProfile[i];
+        if (classIdx >= typeIdsSize)
+            continue;
+        if (dvmResolveClass(referrer, classIdx, false) != NULL) {
+            numResolved++;
+        } else {
+            /* the class will fail again, and throw, when code asks */
+            dvmClearException(self);
+        }
+    }
+
+    ALOGV("Pre-resolved %u of %u classes for %s", numResolved,
+        pDexFile->resolveProfileCount, referrer->descriptor);
+    return NULL;
+}
+
+/* (documented in header) */
+void dvmStartPreResolve(ClassObject* clazz)
+{
+    DvmDex* pDvmDex = clazz->pDvmDex;
+
+    /*
+     * The zygote has to stay single-threaded, and dexopt resolves
+     * everything itself anyway.
+     */
+    if (gDvm.zygote || gDvm.optimizing || gDvm.initializing)
+        return;
+    if (pDvmDex == NULL || pDvmDex->pDexFile->resolveProfileCount == 0)
+        return;
+    if (pDvmDex->preResolveStarted != 0 ||
+        android_atomic_release_cas(0, 1, &pDvmDex->preResolveStarted) != 0)
+    {
+        return;
+    }
+
+    pthread_t handle;
+    if (!dvmCreateInternalThread(&handle, "PreResolve",
+            preResolveThreadStart, clazz))
+    {
+        ALOGW("Unable to create pre-resolve thread");
+        return;
+    }
+    pthread_detach(handle);
+}
+
 /*
  * For debugging: return a string representing the methodType.
  */
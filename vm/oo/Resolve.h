@@ -90,6 +90,20 @@ extern "C" StaticField* dvmResolveStaticField(const ClassObject* referrer,
  */
 extern "C" StringObject* dvmResolveString(const ClassObject* referrer, u4 stringIdx);
 
+/*
+ * Create, intern and resolve every string literal that dexopt stored for
+ * the DEX file, as dvmResolveString() would on first use.  Returns the
+ * number of strings resolved.
+ */
+int dvmPreInternStringLiterals(DvmDex* pDvmDex);
+
+/*
+ * Start resolving, on a background thread, the classes that dexopt
+ * recorded as used by "clazz"'s DEX file.  Only the first call for a
+ * given DEX file does anything.
+ */
+void dvmStartPreResolve(ClassObject* clazz);
+
 /*
  * Return debug string constant for enum.
  */
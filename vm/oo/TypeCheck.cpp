@@ -241,6 +241,17 @@ static inline int isInstanceof(const ClassObject* instance,
 int dvmInstanceofNonTrivial(const ClassObject* instance,
     const ClassObject* clazz)
 {
+    /*
+     * Class-to-class checks are a single display lookup, which is cheaper
+     * than the cache probe, and keeping them out of the cache leaves its
+     * slots for the interface and array checks that need them.
+     */
+    if (instance->superDisplay != NULL && clazz->superDisplay != NULL &&
+        !dvmIsInterfaceClass(clazz))
+    {
+        return dvmIsSubClass(instance, clazz);
+    }
+
 #define ATOMIC_CACHE_CALC isInstanceof(instance, clazz)
     return ATOMIC_CACHE_LOOKUP(gDvm.instanceofCache,
                 INSTANCEOF_CACHE_SIZE, instance, clazz);
@@ -56,6 +56,11 @@ int dvmImplements(const ClassObject* clazz, const ClassObject* interface);
  * Returns 0 (false) if not, 1 (true) if so.
  */
 INLINE int dvmIsSubClass(const ClassObject* sub, const ClassObject* clazz) {
+    if (sub->superDisplay != NULL && clazz->superDisplay != NULL) {
+        return clazz->classDepth <= sub->classDepth &&
+            sub->superDisplay[clazz->classDepth] == clazz;
+    }
+
     do {
         /*printf("###### sub='%s' clazz='%s'\n", sub->name, clazz->name);*/
         if (sub == clazz)
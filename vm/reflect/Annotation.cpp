@@ -1056,41 +1056,42 @@ static int compareClassDescriptor(DexFile* pDexFile, u4 typeIdx,
  * Search through the annotation set for an annotation with a matching
  * descriptor.
  *
- * Comparing the string descriptor is slower than comparing an integer class
- * index.  If annotation lists are expected to be long, we could look up
- * the class' index by name from the DEX file, rather than doing a class
- * lookup and string compare on each entry.  (Note the index will be
- * different for each DEX file, so we can't cache annotation class indices
- * globally.)
+ * The entries of an annotation_set_item are sorted by type_idx, and the
+ * type_ids table is itself sorted by descriptor, so we can binary-search
+ * on the descriptor strings.  A set holds at most one annotation of each
+ * type, so once we've found the type we just check its visibility.
  */
 static const DexAnnotationItem* searchAnnotationSet(const ClassObject* clazz,
     const DexAnnotationSetItem* pAnnoSet, const char* descriptor,
     int visibility)
 {
     DexFile* pDexFile = clazz->pDvmDex->pDexFile;
-    const DexAnnotationItem* result = NULL;
-    u4 typeIdx;
-    int i;
+    int lo = 0;
+    int hi = (int) pAnnoSet->size - 1;
 
     //printf("##### searchAnnotationSet %s %d\n", descriptor, visibility);
 
-    for (i = 0; i < (int) pAnnoSet->size; i++) {
-        const DexAnnotationItem* pAnnoItem;
-
-        pAnnoItem = dexGetAnnotationItem(pDexFile, pAnnoSet, i);
-        if (pAnnoItem->visibility != visibility)
-            continue;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const DexAnnotationItem* pAnnoItem =
+            dexGetAnnotationItem(pDexFile, pAnnoSet, mid);
         const u1* ptr = pAnnoItem->annotation;
-        typeIdx = readUleb128(&ptr);
+        u4 typeIdx = readUleb128(&ptr);
 
-        if (compareClassDescriptor(pDexFile, typeIdx, descriptor) == 0) {
-            //printf("#####  match on %x/%p at %d\n", typeIdx, pDexFile, i);
-            result = pAnnoItem;
-            break;
+        int cmp = compareClassDescriptor(pDexFile, typeIdx, descriptor);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else if (cmp > 0) {
+            hi = mid - 1;
+        } else {
+            //printf("#####  match on %x/%p at %d\n", typeIdx, pDexFile, mid);
+            if (pAnnoItem->visibility != visibility)
+                return NULL;
+            return pAnnoItem;
         }
     }
 
-    return result;
+    return NULL;
 }
 
 /*
@@ -1580,51 +1581,6 @@ static int compareMethodStr(DexFile* pDexFile, u4 methodIdx,
     return result;
 }
 
-/*
- * Given a method, determine the method's index.
- *
- * We could simply store this in the Method*, but that would cost 4 bytes
- * per method.  Instead we plow through the DEX data.
- *
- * We have two choices: look through the class method data, or look through
- * the global method_ids table.  The former is awkward because the method
- * could have been defined in a superclass or interface.  The latter works
- * out reasonably well because it's in sorted order, though we're still left
- * doing a fair number of string comparisons.
- */
-static u4 getMethodIdx(const Method* method)
-{
-    DexFile* pDexFile = method->clazz->pDvmDex->pDexFile;
-    u4 hi = pDexFile->pHeader->methodIdsSize -1;
-    u4 lo = 0;
-    u4 cur;
-
-    while (hi >= lo) {
-        int cmp;
-        cur = (lo + hi) / 2;
-
-        cmp = compareMethodStr(pDexFile, cur, method);
-        if (cmp < 0) {
-            lo = cur + 1;
-        } else if (cmp > 0) {
-            hi = cur - 1;
-        } else {
-            break;
-        }
-    }
-
-    if (hi < lo) {
-        /* this should be impossible -- the method came out of this DEX */
-        char* desc = dexProtoCopyMethodDescriptor(&method->prototype);
-        ALOGE("Unable to find method %s.%s %s in DEX file!",
-            method->clazz->descriptor, method->name, desc);
-        free(desc);
-        dvmAbort();
-    }
-
-    return cur;
-}
-
 /*
  * Find the DexAnnotationSetItem for this method.
  *
@@ -1648,25 +1604,27 @@ static const DexAnnotationSetItem* findAnnotationSetForMethod(
         pMethodList = dexGetMethodAnnotations(pDexFile, pAnnoDir);
         if (pMethodList != NULL) {
             /*
-             * Run through the list and find a matching method.  We compare the
-             * method ref indices in the annotation list with the method's DEX
-             * method_idx value.
-             *
-             * TODO: use a binary search for long lists
-             *
-             * Alternate approach: for each entry in the annotations list,
-             * find the method definition in the DEX file and perform string
-             * comparisons on class name, method name, and signature.
+             * Find the matching method.  The list is sorted by method_idx,
+             * and method_ids are sorted by (class, name, proto), so we can
+             * binary-search the list comparing the method's strings.  That
+             * takes log2(list size) compares, rather than searching all of
+             * method_ids for our index and then scanning the list.
              */
-            u4 methodIdx = getMethodIdx(method);
-            u4 count = dexGetMethodAnnotationsSize(pDexFile, pAnnoDir);
-            u4 idx;
-
-            for (idx = 0; idx < count; idx++) {
-                if (pMethodList[idx].methodIdx == methodIdx) {
+            int lo = 0;
+            int hi = (int) dexGetMethodAnnotationsSize(pDexFile, pAnnoDir) - 1;
+
+            while (lo <= hi) {
+                int mid = (lo + hi) / 2;
+                int cmp = compareMethodStr(pDexFile,
+                                pMethodList[mid].methodIdx, method);
+                if (cmp < 0) {
+                    lo = mid + 1;
+                } else if (cmp > 0) {
+                    hi = mid - 1;
+                } else {
                     /* found! */
                     pAnnoSet = dexGetMethodAnnotationSetItem(pDexFile,
-                                    &pMethodList[idx]);
+                                    &pMethodList[mid]);
                     break;
                 }
             }
@@ -1897,42 +1855,6 @@ static int compareFieldStr(DexFile* pDexFile, u4 idx, const Field* field)
     return result;
 }
 
-/*
- * Given a field, determine the field's index.
- *
- * This has the same tradeoffs as getMethodIdx.
- */
-static u4 getFieldIdx(const Field* field)
-{
-    DexFile* pDexFile = field->clazz->pDvmDex->pDexFile;
-    u4 hi = pDexFile->pHeader->fieldIdsSize -1;
-    u4 lo = 0;
-    u4 cur;
-
-    while (hi >= lo) {
-        int cmp;
-        cur = (lo + hi) / 2;
-
-        cmp = compareFieldStr(pDexFile, cur, field);
-        if (cmp < 0) {
-            lo = cur + 1;
-        } else if (cmp > 0) {
-            hi = cur - 1;
-        } else {
-            break;
-        }
-    }
-
-    if (hi < lo) {
-        /* this should be impossible -- the field came out of this DEX */
-        ALOGE("Unable to find field %s.%s %s in DEX file!",
-            field->clazz->descriptor, field->name, field->signature);
-        dvmAbort();
-    }
-
-    return cur;
-}
-
 /*
  * Find the DexAnnotationSetItem for this field.
  *
@@ -1954,24 +1876,23 @@ static const DexAnnotationSetItem* findAnnotationSetForField(const Field* field)
         return NULL;
 
     /*
-     * Run through the list and find a matching field.  We compare the
-     * field ref indices in the annotation list with the field's DEX
-     * field_idx value.
-     *
-     * TODO: use a binary search for long lists
-     *
-     * Alternate approach: for each entry in the annotations list,
-     * find the field definition in the DEX file and perform string
-     * comparisons on class name, field name, and signature.
+     * Find the matching field.  As with methods, the list is sorted by
+     * field_idx and field_ids are sorted by (class, name, type), so we
+     * binary-search the list comparing the field's strings.
      */
-    u4 fieldIdx = getFieldIdx(field);
-    u4 count = dexGetFieldAnnotationsSize(pDexFile, pAnnoDir);
-    u4 idx;
+    int lo = 0;
+    int hi = (int) dexGetFieldAnnotationsSize(pDexFile, pAnnoDir) - 1;
 
-    for (idx = 0; idx < count; idx++) {
-        if (pFieldList[idx].fieldIdx == fieldIdx) {
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = compareFieldStr(pDexFile, pFieldList[mid].fieldIdx, field);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else if (cmp > 0) {
+            hi = mid - 1;
+        } else {
             /* found! */
-            return dexGetFieldAnnotationSetItem(pDexFile, &pFieldList[idx]);
+            return dexGetFieldAnnotationSetItem(pDexFile, &pFieldList[mid]);
         }
     }
 
@@ -2136,24 +2057,23 @@ static const DexParameterAnnotationsItem* findAnnotationsItemForMethod(
         return NULL;
 
     /*
-     * Run through the list and find a matching method.  We compare the
-     * method ref indices in the annotation list with the method's DEX
-     * method_idx value.
-     *
-     * TODO: use a binary search for long lists
-     *
-     * Alternate approach: for each entry in the annotations list,
-     * find the method definition in the DEX file and perform string
-     * comparisons on class name, method name, and signature.
+     * Binary-search the list, which is sorted by method_idx; see
+     * findAnnotationSetForMethod.
      */
-    u4 methodIdx = getMethodIdx(method);
-    u4 count = dexGetParameterAnnotationsSize(pDexFile, pAnnoDir);
-    u4 idx;
+    int lo = 0;
+    int hi = (int) dexGetParameterAnnotationsSize(pDexFile, pAnnoDir) - 1;
 
-    for (idx = 0; idx < count; idx++) {
-        if (pParameterList[idx].methodIdx == methodIdx) {
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = compareMethodStr(pDexFile, pParameterList[mid].methodIdx,
+                        method);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else if (cmp > 0) {
+            hi = mid - 1;
+        } else {
             /* found! */
-            return &pParameterList[idx];
+            return &pParameterList[mid];
         }
     }
 
@@ -39,6 +39,8 @@ static void updateExceptionClassList(const Method* method, PointerSet* throws);
 static void createConstructor(ClassObject* clazz, Method* meth);
 static void createHandlerMethod(ClassObject* clazz, Method* dstMeth,
     const Method* srcMeth);
+static bool createMethodInfoField(ClassObject* clazz, int fieldIndex,
+    const char* name, const char* signature, ClassObject* arrayClass);
 static void proxyConstructor(const u4* args, JValue* pResult,
     const Method* method, Thread* self);
 static void proxyInvoker(const u4* args, JValue* pResult,
@@ -47,7 +49,9 @@ static bool mustWrapException(const Method* method, const Object* throwable);
 
 /* private static fields in the Proxy class */
 #define kThrowsField    0
-#define kProxySFieldCount 1
+#define kMethodsField   1
+#define kReturnTypesField 2
+#define kProxySFieldCount 3
 
 /*
  * Generate a proxy class with the specified name, interfaces, and loader.
@@ -169,10 +173,12 @@ ClassObject* dvmGenerateProxyClass(StringObject* str, ArrayObject* interfaces,
     }
 
     /*
-     * Static field list.  We have one private field, for our list of
-     * exceptions declared for each method.
+     * Static field list.  We have three private fields: the exceptions
+     * declared for each method, and the Method object handed to the
+     * handler and the return type for each method, which are filled in
+     * when the method is first called.
      */
-    assert(kProxySFieldCount == 1);
+    assert(kProxySFieldCount == 3);
     newClass->sfieldCount = kProxySFieldCount;
     {
         StaticField* sfield = &newClass->sfields[kThrowsField];
@@ -182,6 +188,14 @@ ClassObject* dvmGenerateProxyClass(StringObject* str, ArrayObject* interfaces,
         sfield->accessFlags = ACC_STATIC | ACC_PRIVATE;
         dvmSetStaticFieldObject(sfield, (Object*)throws);
     }
+    if (!createMethodInfoField(newClass, kMethodsField, "methods",
+            "[Ljava/lang/reflect/Method;",
+            gDvm.classJavaLangReflectMethodArray) ||
+        !createMethodInfoField(newClass, kReturnTypesField, "returnTypes",
+            "[Ljava/lang/Class;", gDvm.classJavaLangClassArray))
+    {
+        goto bail;
+    }
 
     /*
      * Everything is ready. This class didn't come out of a DEX file
@@ -773,10 +787,90 @@ static void createHandlerMethod(ClassObject* clazz, Method* dstMeth,
 
     int argsSize = dvmComputeMethodArgsSize(dstMeth) + 1;
     dstMeth->registersSize = dstMeth->insSize = argsSize;
+    dstMeth->refArgsOnly = (strpbrk(&dstMeth->shorty[1], "ZBCSIJFD") == NULL);
 
     dstMeth->nativeFunc = proxyInvoker;
 }
 
+/*
+ * Create the private static field "name", an array with one entry per
+ * virtual method that proxyInvoker fills in on the method's first call.
+ */
+static bool createMethodInfoField(ClassObject* clazz, int fieldIndex,
+    const char* name, const char* signature, ClassObject* arrayClass)
+{
+    ArrayObject* array = dvmAllocArrayByClass(arrayClass,
+        clazz->virtualMethodCount, ALLOC_DEFAULT);
+    if (array == NULL)
+        return false;
+
+    StaticField* sfield = &clazz->sfields[fieldIndex];
+    sfield->clazz = clazz;
+    sfield->name = name;
+    sfield->signature = signature;
+    sfield->accessFlags = ACC_STATIC | ACC_PRIVATE;
+    dvmSetStaticFieldObject(sfield, (Object*)array);
+    dvmReleaseTrackedAlloc((Object*) array, NULL);
+    return true;
+}
+
+/*
+ * Get the java.lang.reflect.Method object for the interface method that
+ * proxy method "method" implements.  Like the proxies of other VMs we
+ * hand the handler the same object on every call; it's made on the first.
+ *
+ * The result is reachable from the proxy class, so it isn't tracked.
+ * Returns NULL with an exception raised on failure.
+ */
+static Object* getHandlerMethodObject(const Method* method)
+{
+    ClassObject* clazz = method->clazz;
+    int methodIndex = method - clazz->virtualMethods;
+    ArrayObject* methods = (ArrayObject*)
+        dvmGetStaticFieldObject(&clazz->sfields[kMethodsField]);
+    Object* methodObj = ((Object**)(void*)methods->contents)[methodIndex];
+    if (methodObj != NULL)
+        return methodObj;
+
+    /*
+     * We don't want to use "method", because that's the concrete
+     * implementation in the proxy class.  We want the abstract Method
+     * from the declaring interface.  We have a pointer to it tucked
+     * away in the "insns" field.
+     */
+    methodObj = dvmCreateReflectObjForMethod(NULL, (Method*) method->insns);
+    if (methodObj == NULL)
+        return NULL;
+
+    /* publish a fully constructed object; a racing thread may win */
+    ANDROID_MEMBAR_STORE();
+    dvmSetObjectArrayElement(methods, methodIndex, methodObj);
+    dvmReleaseTrackedAlloc(methodObj, NULL);
+    return methodObj;
+}
+
+/*
+ * Get the class of the value proxy method "method" returns, resolving it
+ * on the first call.  Returns NULL with an exception raised on failure.
+ */
+static ClassObject* getHandlerReturnType(const Method* method)
+{
+    ClassObject* clazz = method->clazz;
+    int methodIndex = method - clazz->virtualMethods;
+    ArrayObject* returnTypes = (ArrayObject*)
+        dvmGetStaticFieldObject(&clazz->sfields[kReturnTypesField]);
+    ClassObject* returnType =
+        ((ClassObject**)(void*)returnTypes->contents)[methodIndex];
+    if (returnType != NULL)
+        return returnType;
+
+    returnType = dvmGetBoxedReturnType(method);
+    if (returnType == NULL)
+        return NULL;
+    dvmSetObjectArrayElement(returnTypes, methodIndex, (Object*) returnType);
+    return returnType;
+}
+
 /*
  * Return a new Object[] array with the contents of "args".  We determine
  * the number and types of values in "args" based on the method signature.
@@ -802,6 +896,12 @@ static ArrayObject* boxMethodArgs(const Method* method, const u4* args)
         return NULL;
     Object** argObjects = (Object**)(void*)argArray->contents;
 
+    /* nothing to box; each argument is one reference */
+    if (method->refArgsOnly) {
+        memcpy(argObjects, args, argCount * sizeof(Object*));
+        return argArray;
+    }
+
     /*
      * Fill in the array.
      */
@@ -864,9 +964,10 @@ static void proxyConstructor(const u4* args, JValue* pResult,
  * The method we're calling looks like:
  *   public Object invoke(Object proxy, Method method, Object[] args)
  *
- * This means we have to create a Method object, box our arguments into
+ * This means we have to find the Method object, box our arguments into
  * a new Object[] array, make the call, and unbox the return value if
- * necessary.
+ * necessary.  The Method object and the return type are looked up on the
+ * first call and kept in the proxy class.
  */
 static void proxyInvoker(const u4* args, JValue* pResult,
     const Method* method, Thread* self)
@@ -886,15 +987,13 @@ static void proxyInvoker(const u4* args, JValue* pResult,
     handler = dvmGetFieldObject(thisObj, gDvm.offJavaLangReflectProxy_h);
 
     /*
-     * Find the invoke() method, looking in "this"s class.  (Because we
-     * start here we don't have to convert it to a vtable index and then
-     * index into this' vtable.)
+     * Find the handler's implementation of invoke().
      */
-    invoke = dvmFindVirtualMethodHierByDescriptor(handler->clazz, "invoke",
-            "(Ljava/lang/Object;Ljava/lang/reflect/Method;[Ljava/lang/Object;)Ljava/lang/Object;");
+    invoke = (Method*) dvmGetVirtualizedMethod(handler->clazz,
+            gDvm.methJavaLangReflectInvocationHandler_invoke);
     if (invoke == NULL) {
-        ALOGE("Unable to find invoke()");
-        dvmAbort();
+        assert(dvmCheckException(self));
+        goto bail;
     }
 
     ALOGV("invoke: %s.%s, this=%p, handler=%s",
@@ -902,16 +1001,9 @@ static void proxyInvoker(const u4* args, JValue* pResult,
         thisObj, handler->clazz->descriptor);
 
     /*
-     * Create a java.lang.reflect.Method object for this method.
-     *
-     * We don't want to use "method", because that's the concrete
-     * implementation in the proxy class.  We want the abstract Method
-     * from the declaring interface.  We have a pointer to it tucked
-     * away in the "insns" field.
-     *
-     * TODO: this could be cached for performance.
+     * Get the java.lang.reflect.Method object for this method.
      */
-    methodObj = dvmCreateReflectMethodObject((Method*) method->insns);
+    methodObj = getHandlerMethodObject(method);
     if (methodObj == NULL) {
         assert(dvmCheckException(self));
         goto bail;
@@ -919,10 +1011,8 @@ static void proxyInvoker(const u4* args, JValue* pResult,
 
     /*
      * Determine the return type from the signature.
-     *
-     * TODO: this could be cached for performance.
      */
-    returnType = dvmGetBoxedReturnType(method);
+    returnType = getHandlerReturnType(method);
     if (returnType == NULL) {
         char* desc = dexProtoCopyMethodDescriptor(&method->prototype);
         ALOGE("Could not determine return type for '%s'", desc);
@@ -985,7 +1075,6 @@ static void proxyInvoker(const u4* args, JValue* pResult,
     }
 
 bail:
-    dvmReleaseTrackedAlloc(methodObj, self);
     dvmReleaseTrackedAlloc((Object*)argArray, self);
 }
 
@@ -28,42 +28,36 @@
  * To verify this, we either need to ensure that the class has only one
  * instance field, or we need to look up the field by name and verify
  * that it comes first.  The former is simpler, and should work.
+ *
+ * We also remember the classes in gDvm.boxClasses, so boxing and unboxing
+ * on the reflection call paths don't need descriptor compares or class
+ * lookups.
  */
 bool dvmValidateBoxClasses()
 {
-    static const char* classes[] = {
-        "Ljava/lang/Boolean;",
-        "Ljava/lang/Character;",
-        "Ljava/lang/Float;",
-        "Ljava/lang/Double;",
-        "Ljava/lang/Byte;",
-        "Ljava/lang/Short;",
-        "Ljava/lang/Integer;",
-        "Ljava/lang/Long;",
-        NULL
-    };
-    const char** ccp;
-
-    for (ccp = classes; *ccp != NULL; ccp++) {
+    for (int type = PRIM_BOOLEAN; type <= PRIM_DOUBLE; type++) {
+        const char* descriptor =
+            dexGetBoxedTypeDescriptor((PrimitiveType) type);
         ClassObject* clazz;
 
-        clazz = dvmFindClassNoInit(*ccp, NULL);
+        clazz = dvmFindClassNoInit(descriptor, NULL);
         if (clazz == NULL) {
-            ALOGE("Couldn't find '%s'", *ccp);
+            ALOGE("Couldn't find '%s'", descriptor);
             return false;
         }
 
         if (clazz->ifieldCount != 1) {
             ALOGE("Found %d instance fields in '%s'",
-                clazz->ifieldCount, *ccp);
+                clazz->ifieldCount, descriptor);
             return false;
         }
+
+        gDvm.boxClasses[type] = clazz;
     }
 
     return true;
 }
 
-
 /*
  * Find the named class object.  We have to trim "*pSignature" down to just
  * the first token, do the lookup, and then restore anything important
@@ -173,6 +167,91 @@ static ArrayObject* convertSignatureToClassArray(char** pSignature,
 }
 
 
+/*
+ * Making a reflection object parses a signature, resolves classes and
+ * runs a Java constructor, so each class keeps the ones made for its
+ * members in clazz->reflectCache.  The cached objects never leave the
+ * VM: callers get shallow copies, so one caller's setAccessible() is
+ * not seen by the next.  The copies share the parameter and exception
+ * type arrays, which the class libraries only hand out cloned.
+ *
+ * Returns the cache with a tracked reference the caller must release,
+ * or NULL if caching is off or the cache can't be allocated.
+ */
+static ArrayObject* acquireReflectCache(ClassObject* clazz)
+{
+    if (!gDvm.reflectCache) {
+        return NULL;
+    }
+
+    Thread* self = dvmThreadSelf();
+    ArrayObject* cache = (ArrayObject*)
+        android_atomic_acquire_load((int32_t*) &clazz->reflectCache);
+    if (cache != NULL) {
+        dvmAddTrackedAlloc((Object*) cache, self);
+        return cache;
+    }
+
+    size_t length = clazz->sfieldCount + clazz->ifieldCount +
+        clazz->directMethodCount + clazz->virtualMethodCount;
+    cache = dvmAllocArrayByClass(gDvm.classJavaLangObjectArray, length,
+        ALLOC_DEFAULT);
+    if (cache == NULL) {
+        /* the cache is optional; the caller will make its own objects */
+        dvmClearException(self);
+        return NULL;
+    }
+    if (android_atomic_release_cas(0, (int32_t) cache,
+            (int32_t*) &clazz->reflectCache) == 0) {
+        dvmWriteBarrierField(clazz, &clazz->reflectCache);
+    }
+    /* if another thread got there first, ours is used once and dropped */
+    return cache;
+}
+
+/*
+ * Returns a copy of the object in slot "index" of "cache", or NULL if the
+ * slot is empty or the copy couldn't be allocated.
+ */
+static Object* copyCachedObject(ArrayObject* cache, int index)
+{
+    Object* obj = ((Object**)(void*)cache->contents)[index];
+    if (obj == NULL) {
+        return NULL;
+    }
+    return dvmCloneObject(obj, ALLOC_DEFAULT);
+}
+
+/*
+ * Keeps "obj" in slot "index" of "cache" and returns a copy of it.
+ * Releases the caller's reference to "obj".
+ */
+static Object* cacheAndCopyObject(ArrayObject* cache, int index, Object* obj)
+{
+    dvmSetObjectArrayElement(cache, index, obj);
+    Object* copy = dvmCloneObject(obj, ALLOC_DEFAULT);
+    dvmReleaseTrackedAlloc(obj, NULL);
+    return copy;
+}
+
+/*
+ * Drop the reflection object caches of all loaded classes.  Called by
+ * the GC with all threads suspended.
+ */
+static int clearReflectCache(void* vclazz, void* varg)
+{
+    UNUSED_PARAMETER(varg);
+
+    ClassObject* clazz = (ClassObject*) vclazz;
+    clazz->reflectCache = NULL;
+    return 0;
+}
+
+void dvmClearReflectCaches()
+{
+    dvmHashForeach(gDvm.loadedClasses, clearReflectCache, NULL);
+}
+
 /*
  * Convert a field pointer to a slot number.
  *
@@ -264,6 +343,33 @@ bail:
     return result;
 }
 
+/*
+ * Get a Field object for "field", declared by "clazz", from the class's
+ * reflection cache.
+ *
+ * Caller must dvmReleaseTrackedAlloc(result).
+ */
+static Object* getFieldObject(Field* field, ClassObject* clazz)
+{
+    ArrayObject* cache = acquireReflectCache(clazz);
+    if (cache == NULL) {
+        return createFieldObject(field, clazz);
+    }
+
+    int slot = fieldToSlot(field, clazz);
+    int index = (slot < 0) ? -(slot+1) : clazz->sfieldCount + slot;
+    Object* result = copyCachedObject(cache, index);
+    if (result == NULL && !dvmCheckException(dvmThreadSelf())) {
+        Object* fieldObj = createFieldObject(field, clazz);
+        if (fieldObj != NULL) {
+            result = cacheAndCopyObject(cache, index, fieldObj);
+        }
+    }
+
+    dvmReleaseTrackedAlloc((Object*) cache, NULL);
+    return result;
+}
+
 /*
  *
  * Get an array with all fields declared by a class.
@@ -303,7 +409,7 @@ ArrayObject* dvmGetDeclaredFields(ClassObject* clazz, bool publicOnly)
         if (!publicOnly ||
             (clazz->sfields[i].accessFlags & ACC_PUBLIC) != 0)
         {
-            Object* field = createFieldObject(&clazz->sfields[i], clazz);
+            Object* field = getFieldObject(&clazz->sfields[i], clazz);
             if (field == NULL) {
                 goto fail;
             }
@@ -316,7 +422,7 @@ ArrayObject* dvmGetDeclaredFields(ClassObject* clazz, bool publicOnly)
         if (!publicOnly ||
             (clazz->ifields[i].accessFlags & ACC_PUBLIC) != 0)
         {
-            Object* field = createFieldObject(&clazz->ifields[i], clazz);
+            Object* field = getFieldObject(&clazz->ifields[i], clazz);
             if (field == NULL) {
                 goto fail;
             }
@@ -448,6 +554,38 @@ bail:
     return result;
 }
 
+/*
+ * Get a Method or Constructor object for "meth" from its class's
+ * reflection cache.  The reflection class must be initialized.
+ *
+ * Caller must dvmReleaseTrackedAlloc(result).
+ */
+static Object* getMethodObject(Method* meth)
+{
+    bool isConstructor = (strcmp(meth->name, "<init>") == 0);
+    ClassObject* clazz = meth->clazz;
+    ArrayObject* cache = acquireReflectCache(clazz);
+    if (cache == NULL) {
+        return isConstructor ?
+            createConstructorObject(meth) : dvmCreateReflectMethodObject(meth);
+    }
+
+    int slot = methodToSlot(meth);
+    int index = clazz->sfieldCount + clazz->ifieldCount +
+        ((slot < 0) ? -(slot+1) : clazz->directMethodCount + slot);
+    Object* result = copyCachedObject(cache, index);
+    if (result == NULL && !dvmCheckException(dvmThreadSelf())) {
+        Object* methObj = isConstructor ?
+            createConstructorObject(meth) : dvmCreateReflectMethodObject(meth);
+        if (methObj != NULL) {
+            result = cacheAndCopyObject(cache, index, methObj);
+        }
+    }
+
+    dvmReleaseTrackedAlloc((Object*) cache, NULL);
+    return result;
+}
+
 /*
  * Get an array with all constructors declared by a class.
  */
@@ -493,7 +631,7 @@ ArrayObject* dvmGetDeclaredConstructors(ClassObject* clazz, bool publicOnly)
         if ((!publicOnly || dvmIsPublicMethod(meth)) &&
             dvmIsConstructorMethod(meth) && !dvmIsStaticMethod(meth))
         {
-            Object* ctorObj = createConstructorObject(meth);
+            Object* ctorObj = getMethodObject(meth);
             if (ctorObj == NULL) {
               dvmReleaseTrackedAlloc((Object*) ctorArray, NULL);
               return NULL;
@@ -652,7 +790,7 @@ ArrayObject* dvmGetDeclaredMethods(ClassObject* clazz, bool publicOnly)
         if ((!publicOnly || dvmIsPublicMethod(meth)) &&
             !dvmIsMirandaMethod(meth))
         {
-            Object* methObj = dvmCreateReflectMethodObject(meth);
+            Object* methObj = getMethodObject(meth);
             if (methObj == NULL)
                 goto fail;
             dvmSetObjectArrayElement(methodArray, methObjCount, methObj);
@@ -665,7 +803,7 @@ ArrayObject* dvmGetDeclaredMethods(ClassObject* clazz, bool publicOnly)
         if ((!publicOnly || dvmIsPublicMethod(meth)) &&
             meth->name[0] != '<')
         {
-            Object* methObj = dvmCreateReflectMethodObject(meth);
+            Object* methObj = getMethodObject(meth);
             if (methObj == NULL)
                 goto fail;
             dvmSetObjectArrayElement(methodArray, methObjCount, methObj);
@@ -788,7 +926,7 @@ Object* dvmGetDeclaredField(ClassObject* clazz, StringObject* nameObj)
     for (i = 0; i < clazz->sfieldCount; i++) {
         Field* field = &clazz->sfields[i];
         if (strcmp(name, field->name) == 0) {
-            fieldObj = createFieldObject(field, clazz);
+            fieldObj = getFieldObject(field, clazz);
             break;
         }
     }
@@ -796,7 +934,7 @@ Object* dvmGetDeclaredField(ClassObject* clazz, StringObject* nameObj)
         for (i = 0; i < clazz->ifieldCount; i++) {
             Field* field = &clazz->ifields[i];
             if (strcmp(name, field->name) == 0) {
-                fieldObj = createFieldObject(field, clazz);
+                fieldObj = getFieldObject(field, clazz);
                 break;
             }
         }
@@ -843,32 +981,18 @@ ArrayObject* dvmGetInterfaces(ClassObject* clazz)
  */
 static PrimitiveType getBoxedType(DataObject* arg)
 {
-    static const int kJavaLangLen = 11;     // strlen("Ljava/lang/")
-
     if (arg == NULL)
         return PRIM_NOT;
 
-    const char* name = arg->clazz->descriptor;
-
-    if (strncmp(name, "Ljava/lang/", kJavaLangLen) != 0)
-        return PRIM_NOT;
-
-    if (strcmp(name + kJavaLangLen, "Boolean;") == 0)
-        return PRIM_BOOLEAN;
-    if (strcmp(name + kJavaLangLen, "Character;") == 0)
-        return PRIM_CHAR;
-    if (strcmp(name + kJavaLangLen, "Float;") == 0)
-        return PRIM_FLOAT;
-    if (strcmp(name + kJavaLangLen, "Double;") == 0)
-        return PRIM_DOUBLE;
-    if (strcmp(name + kJavaLangLen, "Byte;") == 0)
-        return PRIM_BYTE;
-    if (strcmp(name + kJavaLangLen, "Short;") == 0)
-        return PRIM_SHORT;
-    if (strcmp(name + kJavaLangLen, "Integer;") == 0)
-        return PRIM_INT;
-    if (strcmp(name + kJavaLangLen, "Long;") == 0)
-        return PRIM_LONG;
+    /*
+     * The box classes can only come from the bootstrap class loader, so
+     * comparing against the classes we found at startup is exact.
+     */
+    const ClassObject* clazz = arg->clazz;
+    for (int type = PRIM_BOOLEAN; type <= PRIM_DOUBLE; type++) {
+        if (gDvm.boxClasses[type] == clazz)
+            return (PrimitiveType) type;
+    }
     return PRIM_NOT;
 }
 
@@ -1063,7 +1187,6 @@ DataObject* dvmBoxPrimitive(JValue value, ClassObject* returnType)
     DataObject* wrapperObj;
     s4* dataPtr;
     PrimitiveType typeIndex = returnType->primitiveType;
-    const char* classDescriptor;
 
     if (typeIndex == PRIM_NOT) {
         /* add to tracking table so return value is always in table */
@@ -1072,14 +1195,13 @@ DataObject* dvmBoxPrimitive(JValue value, ClassObject* returnType)
         return (DataObject*) value.l;
     }
 
-    classDescriptor = dexGetBoxedTypeDescriptor(typeIndex);
-    if (classDescriptor == NULL) {
+    if (typeIndex < PRIM_BOOLEAN || typeIndex > PRIM_DOUBLE) {
         return NULL;
     }
 
-    wrapperClass = dvmFindSystemClass(classDescriptor);
-    if (wrapperClass == NULL) {
-        ALOGW("Unable to find '%s'", classDescriptor);
+    wrapperClass = gDvm.boxClasses[typeIndex];
+    if (!dvmIsClassInitialized(wrapperClass) && !dvmInitClass(wrapperClass)) {
+        ALOGW("Unable to initialize '%s'", wrapperClass->descriptor);
         assert(dvmCheckException(dvmThreadSelf()));
         return NULL;
     }
@@ -1244,7 +1366,7 @@ Object* dvmCreateReflectObjForField(const ClassObject* clazz, Field* field)
         dvmInitClass(gDvm.classJavaLangReflectField);
 
     /* caller must dvmReleaseTrackedAlloc(result) */
-    return createFieldObject(field, clazz);
+    return getFieldObject(field, (ClassObject*) clazz);
 }
 
 /*
@@ -1264,12 +1386,10 @@ Object* dvmCreateReflectObjForMethod(const ClassObject* clazz, Method* method)
     if (strcmp(method->name, "<init>") == 0) {
         if (!dvmIsClassInitialized(gDvm.classJavaLangReflectConstructor))
             dvmInitClass(gDvm.classJavaLangReflectConstructor);
-
-        return createConstructorObject(method);
     } else {
         if (!dvmIsClassInitialized(gDvm.classJavaLangReflectMethod))
             dvmInitClass(gDvm.classJavaLangReflectMethod);
-
-        return dvmCreateReflectMethodObject(method);
     }
+
+    return getMethodObject(method);
 }
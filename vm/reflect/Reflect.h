@@ -62,6 +62,12 @@ Object* dvmGetDeclaredConstructorOrMethod(ClassObject* clazz,
  */
 ArrayObject* dvmGetInterfaces(ClassObject* clazz);
 
+/*
+ * Drop the reflection objects every class keeps for its members.  Called
+ * by the GC with all threads suspended.
+ */
+void dvmClearReflectCaches();
+
 /*
  * Convert slot numbers back to objects.
  */